@@ -80,6 +80,18 @@ struct MNVGblend {
 };
 typedef struct MNVGblend MNVGblend;
 
+// The pipeline states made for a pixel format and blend, kept so that switching
+// between blend modes doesn't recompile them.
+struct MNVGpipelineStates {
+  MTLPixelFormat pixelFormat;
+  MNVGblend blend;
+  id<MTLRenderPipelineState> pipelineState;
+  id<MTLRenderPipelineState> stencilOnlyPipelineState;
+};
+typedef struct MNVGpipelineStates MNVGpipelineStates;
+
+#define MNVG_MAX_PIPELINE_STATES 16
+
 struct MNVGcall {
   int type;
   int image;
@@ -193,6 +205,9 @@ struct MNVGcontext {
   MTLPixelFormat piplelinePixelFormat;
   id<MTLRenderPipelineState> pipelineState;
   id<MTLRenderPipelineState> stencilOnlyPipelineState;
+  MNVGpipelineStates pipelineStates[MNVG_MAX_PIPELINE_STATES];
+  int npipelineStates;
+  int nextPipelineState;  // the entry replaced when all are in use
   id<MTLSamplerState> pseudoSampler;
   id<MTLTexture> pseudoTexture;
   MTLVertexDescriptor* vertexDescriptor;
@@ -560,13 +575,20 @@ static void mtlnvg__updateRenderPipelineStates(MNVGcontext* mtl,
     return;
   }
 
-  if (mtl->pipelineState != nil) {
-    [mtl->pipelineState release];
-    mtl->pipelineState = nil;
-  }
-  if (mtl->stencilOnlyPipelineState != nil) {
-    [mtl->stencilOnlyPipelineState release];
-    mtl->stencilOnlyPipelineState = nil;
+  // The states for the pixel format and blend may have been made before.
+  for (int i = 0; i < mtl->npipelineStates; ++i) {
+    MNVGpipelineStates* states = &mtl->pipelineStates[i];
+    if (states->pixelFormat == pixelFormat &&
+        states->blend.srcRGB == blend->srcRGB &&
+        states->blend.dstRGB == blend->dstRGB &&
+        states->blend.srcAlpha == blend->srcAlpha &&
+        states->blend.dstAlpha == blend->dstAlpha) {
+      mtl->pipelineState = states->pipelineState;
+      mtl->stencilOnlyPipelineState = states->stencilOnlyPipelineState;
+      mtl->blendFunc = *blend;
+      mtl->piplelinePixelFormat = pixelFormat;
+      return;
+    }
   }
 
   MTLRenderPipelineDescriptor *pipelineStateDescriptor = \
@@ -606,6 +628,21 @@ static void mtlnvg__updateRenderPipelineStates(MNVGcontext* mtl,
 
   [pipelineStateDescriptor release];
   mtl->piplelinePixelFormat = pixelFormat;
+
+  // Keeps the states, replacing the oldest entry when the cache is full.
+  MNVGpipelineStates* states;
+  if (mtl->npipelineStates < MNVG_MAX_PIPELINE_STATES) {
+    states = &mtl->pipelineStates[mtl->npipelineStates++];
+  } else {
+    states = &mtl->pipelineStates[mtl->nextPipelineState];
+    mtl->nextPipelineState = (mtl->nextPipelineState + 1) % MNVG_MAX_PIPELINE_STATES;
+    [states->pipelineState release];
+    [states->stencilOnlyPipelineState release];
+  }
+  states->pixelFormat = pixelFormat;
+  states->blend = *blend;
+  states->pipelineState = mtl->pipelineState;
+  states->stencilOnlyPipelineState = mtl->stencilOnlyPipelineState;
 }
 
 // Re-creates stencil texture whenever the specified size is bigger.
@@ -1119,8 +1156,11 @@ static void mtlnvg__renderDelete(void* uptr) {
   [mtl->strokeShapeStencilState release];
   [mtl->strokeAntiAliasStencilState release];
   [mtl->strokeClearStencilState release];
-  [mtl->pipelineState release];
-  [mtl->stencilOnlyPipelineState release];
+  // The current pipeline states are owned by the cache.
+  for (int i = 0; i < mtl->npipelineStates; ++i) {
+    [mtl->pipelineStates[i].pipelineState release];
+    [mtl->pipelineStates[i].stencilOnlyPipelineState release];
+  }
   [mtl->pseudoSampler release];
 
   for (int i = 0; i < mtl->maxBuffers; ++i) {
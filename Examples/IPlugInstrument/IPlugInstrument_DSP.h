@@ -42,6 +42,23 @@ private:
       mADSR1.Release();
     }
 
+    void SoftKill() override
+    {
+      mADSR1.Kill(false);
+    }
+
+    // the envelope's last output is a cheap estimate of the voice's loudness, used for voice stealing
+    double GetLevel() const override
+    {
+      return mADSR1.GetPrevOutput();
+    }
+
+    // this voice doesn't read pressure, so the allocator needn't update it
+    uint32_t GetControlRampsUsed() const override
+    {
+      return (1u << kVoiceControlGate) | (1u << kVoiceControlPitch) | (1u << kVoiceControlPitchBend) | (1u << kVoiceControlTimbre);
+    }
+
     void ProcessSamplesAccumulating(sample** inputs, sample** outputs, int nInputs, int nOutputs, int startIdx, int nFrames) override
     {
       // inputs to the synthesizer can just fetch a value every block, like this:
@@ -49,8 +66,12 @@ private:
       double pitch = mInputs[kVoiceControlPitch].endValue;
       double pitchBend = mInputs[kVoiceControlPitchBend].endValue;
 
-      // or write the entire control ramp to a buffer, like this, to get sample-accurate ramps:
-      mInputs[kVoiceControlTimbre].Write(mTimbreBuffer, startIdx, nFrames);
+      // or write the entire control ramp to a buffer, like this, to get sample-accurate ramps. Most of the time a ramp is flat, and needn't be written:
+      const bool timbreIsConstant = mInputs[kVoiceControlTimbre].IsConstant();
+      const float timbre = mInputs[kVoiceControlTimbre].endValue;
+
+      if(!timbreIsConstant)
+        mInputs[kVoiceControlTimbre].Write(mTimbreBuffer, startIdx, nFrames);
 
       // convert from "1v/oct" pitch space to frequency in Hertz
       double osc1Freq = 440. * pow(2., pitch + pitchBend);
@@ -58,13 +79,16 @@ private:
       // add a second oscillator, up a fifth
       double osc2Freq = osc1Freq * 3. / 2.;
 
+      // the envelope renders a segment at a time
+      mADSR1.ProcessBlock(mEnvBuffer + startIdx, nFrames, 1.);
+
       // make sound output for each output channel
       for(auto i = startIdx; i < startIdx + nFrames; i++)
       {
-        float noise = mTimbreBuffer[i] * Rand();
+        float noise = (timbreIsConstant ? timbre : mTimbreBuffer[i]) * Rand();
 
         // an MPE synth can use pressure here in addition to gain
-        outputs[0][i] += (mOsc1.Process(osc1Freq) + mOsc2.Process(osc2Freq) * mOsc2Gain + noise) * mADSR1.Process(1.) * mGain;
+        outputs[0][i] += (mOsc1.Process(osc1Freq) + mOsc2.Process(osc2Freq) * mOsc2Gain + noise) * mEnvBuffer[i] * mGain;
         outputs[1][i] = outputs[0][i];
       }
     }
@@ -107,6 +131,7 @@ private:
     // would be allocated dynamically in a real example
     static constexpr int kMaxBlockSize = 1024;
     float mTimbreBuffer[kMaxBlockSize];
+    sample mEnvBuffer[kMaxBlockSize];
 
     // noise generator for test
     uint32_t mRandSeed = 0;
@@ -18,6 +18,14 @@ fi
 
 origin="/"
 
+# IPLUG_WEB_WORKER=1 runs the UI on a worker, drawing into an OffscreenCanvas (see IPlugWebWorker.js), which needs streamed images
+uiworker=0
+if [ "$IPLUG_WEB_WORKER" = "1" ]
+then
+  uiworker=1
+  IPLUG_WEB_STREAM_IMAGES=1
+fi
+
 if [ "$#" -eq 2 ]
 then
   origin=${2}
@@ -70,20 +78,39 @@ then
   rm presets.js
 fi
 
+if [ -f resources.js ]
+then
+  rm resources.js
+fi
+
+if [ -d resources ]
+then
+  rm -r resources
+fi
+
 python $EMSCRIPTEN/tools/file_packager.py fonts.data --preload ../resources/fonts/ --exclude .DS_Store --js-output=fonts.js
 python $EMSCRIPTEN/tools/file_packager.py svgs.data --preload ../resources/img/ --exclude *.png --exclude *DS_Store --js-output=svgs.js
 
-# echo "if(window.devicePixelRatio == 1) {\n" > imgs.js
-python $EMSCRIPTEN/tools/file_packager.py imgs.data --use-preload-plugins --preload ../resources/img/ --use-preload-cache --indexedDB-name="/IPlugInstrument_pkg" --exclude *DS_Store --exclude  *@2x.png --exclude  *.svg >> imgs.js
-# echo "\n}" >> imgs.js
-# package @2x resources into separate .data file
-mkdir ./2x/
-cp ../resources/img/*@2x* ./2x
-# echo "if(window.devicePixelRatio > 1) {\n" > imgs@2x.js
-#--use-preload-cache --indexedDB-name="/IPlugInstrument_data"
-python $EMSCRIPTEN/tools/file_packager.py imgs@2x.data --use-preload-plugins --preload ./2x@/resources/img/ --use-preload-cache --indexedDB-name="/IPlugInstrument_pkg" --exclude *DS_Store >> imgs@2x.js
-# echo "\n}" >> imgs@2x.js
-rm -r ./2x
+if [ "$IPLUG_WEB_STREAM_IMAGES" = "1" ]
+then
+  # images are fetched on demand over HTTP (see IPlugResources.js), only a manifest of their sizes is bundled
+  mkdir -p resources/img
+  cp ../resources/img/*.png resources/img/
+  python ../../../Scripts/web_resource_manifest.py resources.js ../resources/img/
+else
+  # echo "if(window.devicePixelRatio == 1) {\n" > imgs.js
+  python $EMSCRIPTEN/tools/file_packager.py imgs.data --use-preload-plugins --preload ../resources/img/ --use-preload-cache --indexedDB-name="/IPlugInstrument_pkg" --exclude *DS_Store --exclude  *@2x.png --exclude  *.svg >> imgs.js
+  # echo "\n}" >> imgs.js
+  # package @2x resources into separate .data file
+  mkdir ./2x/
+  cp ../resources/img/*@2x* ./2x
+  # echo "if(window.devicePixelRatio > 1) {\n" > imgs@2x.js
+  #--use-preload-cache --indexedDB-name="/IPlugInstrument_data"
+  python $EMSCRIPTEN/tools/file_packager.py imgs@2x.data --use-preload-plugins --preload ./2x@/resources/img/ --use-preload-cache --indexedDB-name="/IPlugInstrument_pkg" --exclude *DS_Store >> imgs@2x.js
+  # echo "\n}" >> imgs@2x.js
+  rm -r ./2x
+  python ../../../Scripts/web_resource_manifest.py resources.js
+fi
 
 cd ..
 echo -
@@ -109,6 +136,9 @@ cp ../../../../Dependencies/IPlug/WAM_AWP/*.js .
 cp ../../../../IPlug/WEB/Template/scripts/IPlugWAM-awn.js IPlugInstrument-awn.js
 sed -i.bak s/NAME_PLACEHOLDER/IPlugInstrument/g IPlugInstrument-awn.js
 cp ../../../../IPlug/WEB/Template/scripts/IPlugWAM-awp.js IPlugInstrument-awp.js
+cp ../../../../IPlug/WEB/Template/scripts/IPlugResources.js IPlugResources.js
+cp ../../../../IPlug/WEB/Template/scripts/IPlugWebWorker.js IPlugWebWorker.js
+cp ../../../../IPlug/WEB/Template/scripts/IPlugWebWorkerHost.js IPlugWebWorkerHost.js
 sed -i.bak s/NAME_PLACEHOLDER/IPlugInstrument/g IPlugInstrument-awp.js
 sed -i.bak s,ORIGIN_PLACEHOLDER,$origin,g IPlugInstrument-awn.js
 rm *.bak
@@ -118,6 +148,7 @@ cd ..
 #copy in the template html - comment if you have customised the html
 cp ../../../IPlug/WEB/Template/IPlugWAM-standalone.html index.html
 sed -i.bak s/NAME_PLACEHOLDER/IPlugInstrument/g index.html
+sed -i.bak s/UI_WORKER_PLACEHOLDER/$uiworker/g index.html
 rm *.bak
 
 cp ../../../IPlug/WEB/Template/favicon.ico favicon.ico
@@ -127,7 +158,7 @@ cd ../
 echo
 echo MAKING  - WEB WASM MODULE -----------------------------
 
-emmake make --makefile projects/IPlugInstrument-wam-controller.mk EXTRA_CFLAGS=-DWEBSOCKET_CLIENT=$websocket
+emmake make --makefile projects/IPlugInstrument-wam-controller.mk EXTRA_CFLAGS=-DWEBSOCKET_CLIENT=$websocket WEB_WORKER=$uiworker
 
 if [ $? -ne "0" ]
 then
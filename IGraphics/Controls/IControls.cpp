@@ -175,14 +175,17 @@ IVKnobControl::IVKnobControl(IRECT bounds, IActionFunction actionFunction,
 }
 
 void IVKnobControl::Draw(IGraphics& g)
+{
+  DrawStatic(g);
+  DrawDynamic(g);
+}
+
+void IVKnobControl::DrawStatic(IGraphics& g)
 {
   g.FillRect(GetColor(kBG), mRECT);
 
-  const float v = mAngleMin + ((float)mValue * (mAngleMax - mAngleMin));
   const float cx = mHandleBounds.MW(), cy = mHandleBounds.MH();
   const float radius = (mHandleBounds.W()/2.f);
-
-  g.DrawArc(GetColor(kFR), cx, cy, radius + 5.f, mAngleMin, v, 0, 3.f);
   
   if(mDrawShadows && !mEmboss)
     g.FillCircle(GetColor(kSH), cx + mShadowOffset, cy + mShadowOffset, radius);
@@ -190,18 +193,27 @@ void IVKnobControl::Draw(IGraphics& g)
   g.FillCircle(GetColor(kFG), cx, cy, radius);
 
   g.DrawCircle(GetColor(kON), cx, cy, radius * 0.9f, 0, mFrameThickness);
-
-  if(mMouseIsOver)
-    g.FillCircle(GetColor(kHL), cx, cy, radius * 0.8f);
-  
   g.DrawCircle(GetColor(kFR), cx, cy, radius, 0, mFrameThickness);
-  g.DrawRadialLine(GetColor(kFR), cx, cy, v, 0.7f * radius, 0.9f * radius, 0, mFrameThickness);
 
   if(mLabelBounds.H() > 0.f)
   {
     mLabelText.mFGColor = GetColor(kFG);
     g.DrawText(mLabelText, mLabel.Get(), mLabelBounds);
   }
+}
+
+void IVKnobControl::DrawDynamic(IGraphics& g)
+{
+  const float v = mAngleMin + ((float)mValue * (mAngleMax - mAngleMin));
+  const float cx = mHandleBounds.MW(), cy = mHandleBounds.MH();
+  const float radius = (mHandleBounds.W()/2.f);
+
+  g.DrawArc(GetColor(kFR), cx, cy, radius + 5.f, mAngleMin, v, 0, 3.f);
+
+  if(mMouseIsOver)
+    g.FillCircle(GetColor(kHL), cx, cy, radius * 0.8f);
+  
+  g.DrawRadialLine(GetColor(kFR), cx, cy, v, 0.7f * radius, 0.9f * radius, 0, mFrameThickness);
 
   if(mDisplayParamValue)
   {
@@ -22,6 +22,8 @@
 #include "IVMeterControl.h"
 #include "IVScopeControl.h"
 #include "IVMultiSliderControl.h"
+#include "IVListControl.h"
+#include "IVSpectrogramControl.h"
 #include "IRTTextControl.h"
 
 /**
@@ -100,6 +102,8 @@ public:
   virtual ~IVKnobControl() {}
 
   void Draw(IGraphics& g) override;
+  void DrawStatic(IGraphics& g) override;
+  void DrawDynamic(IGraphics& g) override;
   void OnMouseDown(float x, float y, const IMouseMod& mod) override;
 //  void OnMouseDblClick(float x, float y, const IMouseMod& mod) override {  OnMouseDown(x, y, mod); }
   void OnResize() override;
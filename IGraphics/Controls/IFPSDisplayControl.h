@@ -26,12 +26,20 @@ class IFPSDisplayControl : public IControl
 {
 private:
   static constexpr int MAXBUF = 100;
+  static constexpr int kProfileRows = 12;
+  static constexpr float kProfileRowHeight = 14.f;
+  static constexpr float kProfileWidth = 320.f;
+  static constexpr int kMemoryRows = kNumMemoryCategories + 3;
+  static constexpr float kMemoryWidth = 200.f;
+  static constexpr double kMemoryReportInterval = 0.5;
 public:
   enum EStyle
   {
     kFPS,
     kMS,
     kPercentage,
+    kControls, // the most expensive controls to draw, see IGraphics::EnableDrawProfiling(). Click the header to change the order
+    kMemory, // the memory the plug-in instance holds by category, and with that shared by the process, see IEditorDelegate::GetMemoryReport()
     kNumStyles
   };
 
@@ -39,6 +47,7 @@ public:
   : IControl(bounds)
   , mStyle(style)
   , mNameLabel(label)
+  , mCompactRECT(bounds)
   {
     AttachIControl(this);
 
@@ -49,10 +58,34 @@ public:
 
   void OnMouseDown(float x, float y, const IMouseMod& mod) override
   {
+    if (mStyle == kControls && mRECT.GetFromTop(kProfileRowHeight + 2).Contains(x, y))
+    {
+      mSort = (mSort + 1) % kNumDrawProfileSorts;
+      return;
+    }
+
+    if (mStyle == kControls || mStyle == kMemory)
+    {
+      GetUI()->EnableDrawProfiling(false);
+      GetUI()->SetRegionDirty(mRECT); // uncover what the profile was drawn over
+      SetTargetAndDrawRECTs(mCompactRECT);
+    }
+
     mStyle++;
 
     if(mStyle == kNumStyles)
       mStyle = kFPS;
+
+    if (mStyle == kControls)
+    {
+      GetUI()->EnableDrawProfiling(true);
+      SetTargetAndDrawRECTs(mCompactRECT.GetFromTLHC(kProfileWidth, (kProfileRows + 1) * kProfileRowHeight + 4));
+    }
+    else if (mStyle == kMemory)
+    {
+      mMemoryReportTime = 0.;
+      SetTargetAndDrawRECTs(mCompactRECT.GetFromTLHC(kMemoryWidth, kMemoryRows * kProfileRowHeight + 4));
+    }
   }
 
   bool IsDirty() override
@@ -68,6 +101,17 @@ public:
 
   void Draw(IGraphics& g) override
   {
+    if (mStyle == kControls)
+    {
+      DrawProfile(g);
+      return;
+    }
+    else if (mStyle == kMemory)
+    {
+      DrawMemory(g);
+      return;
+    }
+
     float avg = 0.f;
     for (int i = 0; i < MAXBUF; i++)
       avg += mBuffer[i];
@@ -152,8 +196,94 @@ public:
     }
   }
 private:
+  void DrawProfile(IGraphics& g)
+  {
+    static const char* sortNames[kNumDrawProfileSorts] = { "total", "mean", "max", "count" };
+
+    g.FillRect(GetColor(kBG), mRECT);
+    g.DrawRect(COLOR_BLACK, mRECT);
+
+    const IRECT padded = mRECT.GetPadded(-2);
+    const double duration = std::max(g.GetDrawProfileDuration(), 0.001);
+    WDL_String str;
+
+    g.GetDrawProfile(mProfile, (EDrawProfileSort) mSort);
+
+    for (int row = 0; row <= kProfileRows; row++)
+    {
+      const IRECT r = padded.GetFromTop(kProfileRowHeight).GetTranslated(0, row * kProfileRowHeight);
+
+      if (row == 0)
+      {
+        str.SetFormatted(64, "control by %s", sortNames[mSort]);
+        g.DrawText(mProfileText, str.Get(), r.FracRectHorizontal(0.4f));
+        g.DrawText(mProfileText, "mean ms", r.GetGridCell(0, 2, 1, 5));
+        g.DrawText(mProfileText, "max ms", r.GetGridCell(0, 3, 1, 5));
+        g.DrawText(mProfileText, "per sec", r.GetGridCell(0, 4, 1, 5));
+        continue;
+      }
+
+      if (row > mProfile.GetSize())
+        break;
+
+      const IControl* pControl = mProfile.Get(row - 1);
+      const IDrawStats& stats = pControl->GetDrawStats();
+
+      str.SetFormatted(64, "#%d tag %d", g.GetControlIdx(pControl), pControl->GetTag());
+      g.DrawText(mProfileText, str.Get(), r.FracRectHorizontal(0.4f));
+      str.SetFormatted(32, "%.3f", stats.MeanTime() * 1000.);
+      g.DrawText(mProfileText, str.Get(), r.GetGridCell(0, 2, 1, 5));
+      str.SetFormatted(32, "%.3f", stats.maxTime * 1000.);
+      g.DrawText(mProfileText, str.Get(), r.GetGridCell(0, 3, 1, 5));
+      str.SetFormatted(32, "%.1f", stats.nDraws / duration);
+      g.DrawText(mProfileText, str.Get(), r.GetGridCell(0, 4, 1, 5));
+    }
+  }
+
+  void DrawMemory(IGraphics& g)
+  {
+    // gathering the report locks the shared caches, so it is refreshed a few times a second rather than every frame
+    const double now = GetTimestamp();
+
+    if (now - mMemoryReportTime >= kMemoryReportInterval)
+    {
+      mMemoryReport.Clear();
+      GetDelegate()->GetMemoryReport(mMemoryReport);
+      mMemoryReportTime = now;
+    }
+
+    g.FillRect(GetColor(kBG), mRECT);
+    g.DrawRect(COLOR_BLACK, mRECT);
+
+    const IRECT padded = mRECT.GetPadded(-2);
+    WDL_String str;
+
+    auto drawRow = [&](int row, const char* name, int64_t bytes) {
+      const IRECT r = padded.GetFromTop(kProfileRowHeight).GetTranslated(0, row * kProfileRowHeight);
+      g.DrawText(mProfileText, name, r.FracRectHorizontal(0.55f));
+      IMemoryReport::FormatBytes(bytes, str);
+      g.DrawText(mProfileText, str.Get(), r.FracRectHorizontal(0.45f, true));
+    };
+
+    g.DrawText(mProfileText, "memory", padded.GetFromTop(kProfileRowHeight));
+
+    for (int c = 0; c < kNumMemoryCategories; c++)
+    {
+      const EMemoryCategory category = static_cast<EMemoryCategory>(c);
+      drawRow(c + 1, IMemoryReport::GetCategoryName(category), mMemoryReport.GetTotal(category));
+    }
+
+    drawRow(kNumMemoryCategories + 1, "instance", mMemoryReport.GetTotal(false));
+    drawRow(kNumMemoryCategories + 2, "with shared", mMemoryReport.GetTotal(true));
+  }
+
   int mStyle;
+  int mSort = kDrawProfileSortTotal;
   WDL_String mNameLabel;
+  IRECT mCompactRECT;
+  WDL_PtrList<IControl> mProfile;
+  IMemoryReport mMemoryReport;
+  double mMemoryReportTime = 0.;
   float mBuffer[MAXBUF] = {};
   int mReadPos = 0;
 
@@ -162,5 +292,6 @@ private:
   IText mAPILabelText = IText(14, GetColor(kFR), DEFAULT_FONT, IText::kAlignNear, IText::kVAlignTop);
   IText mTopLabelText = IText(18, GetColor(kFR), DEFAULT_FONT, IText::kAlignFar, IText::kVAlignTop);
   IText mBottomLabelText = IText(15, GetColor(kFR), DEFAULT_FONT, IText::kAlignFar, IText::kVAlignBottom);
+  IText mProfileText = IText(12, GetColor(kFR), DEFAULT_FONT, IText::kAlignNear, IText::kVAlignMiddle);
 };
 
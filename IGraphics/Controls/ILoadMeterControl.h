@@ -0,0 +1,147 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc ILoadMeterControl
+ */
+
+#include "IControl.h"
+#include "IPlugLoadMeter.h"
+#include "IPlugProfiler.h"
+
+/** Displays an IPlugLoadMeter, in the style of IFPSDisplayControl: a graph of the average load, the average and peak load and the counts of risky blocks and overruns.
+ * Given an IPlugProfiler, the min, mean and max time per block of each IPLUG_PROFILE_SCOPE marker is listed below the graph, a row each, as far as the bounds allow.
+ * Attach one in your layout function with the processor's meter, e.g. new ILoadMeterControl(bounds, GetLoadMeter(), &GetProfiler()). Click it to reset the meter */
+class ILoadMeterControl : public IControl
+                        , public IVectorBase
+{
+private:
+  static constexpr int MAXBUF = 100;
+  static constexpr float kGraphHeight = 50.f;
+  static constexpr float kMarkerRowHeight = 14.f;
+public:
+  /** @param bounds The control's bounds
+   * @param meter The meter to display, which must outlive the control
+   * @param pProfiler The profiler whose markers to list, which must outlive the control, or nullptr
+   * @param label The name to draw at the bottom left */
+  ILoadMeterControl(const IRECT& bounds, IPlugLoadMeter& meter, const IPlugProfiler* pProfiler = nullptr, const char* label = "DSP Load")
+  : IControl(bounds)
+  , mMeter(meter)
+  , mProfiler(pProfiler)
+  , mNameLabel(label)
+  {
+    AttachIControl(this);
+
+    SetColor(kBG, COLOR_WHITE);
+
+    // IsDirty() samples the meter, so it must be asked every frame
+    SetPollDirty(true);
+
+    mNameLabelText = IText(14, GetColor(kFR), DEFAULT_FONT, IText::kAlignNear, IText::kVAlignBottom);
+  }
+
+  void OnMouseDown(float x, float y, const IMouseMod& mod) override
+  {
+    mMeter.Reset();
+    std::fill(mBuffer, mBuffer + MAXBUF, 0.f);
+  }
+
+  bool IsDirty() override
+  {
+    // sampled once per frame
+    mReadPos = (mReadPos + 1) % MAXBUF;
+    mBuffer[mReadPos] = mMeter.GetAverageLoad();
+    return true;
+  }
+
+  void Draw(IGraphics& g) override
+  {
+    g.FillRect(GetColor(kBG), mRECT);
+    g.DrawRect(COLOR_BLACK, mRECT);
+
+    const int nMarkers = mProfiler ? mProfiler->GetNMarkers() : 0;
+    const IRECT padded = nMarkers ? mRECT.GetPadded(-2).GetFromTop(std::min(kGraphHeight, mRECT.H() - 4.f)) : mRECT.GetPadded(-2);
+    const float x = padded.L;
+    const float y = padded.T;
+    const float w = padded.W();
+    const float h = padded.H();
+
+    g.PathMoveTo(x, y + h);
+
+    for (int i = 0; i < MAXBUF; i++)
+    {
+      const float v = Clip(mBuffer[(mReadPos + 1 + i) % MAXBUF], 0.f, 1.f);
+      g.PathLineTo(x + ((float) i / (MAXBUF - 1)) * w, y + h - v * h);
+    }
+
+    g.PathLineTo(padded.R, padded.B);
+    g.PathFill(mMeter.GetPeakLoad() >= 1.f ? COLOR_RED : GetColor(kFG));
+
+    // the level above which blocks are counted as risky
+    const float riskyY = y + h - static_cast<float>(IPlugLoadMeter::kRiskyLoad) * h;
+    g.DrawLine(COLOR_RED, x, riskyY, x + w, riskyY);
+
+    if (mNameLabel.GetLength())
+      g.DrawText(mNameLabelText, mNameLabel.Get(), padded);
+
+    WDL_String str;
+    str.SetFormatted(32, "%.1f %%", mMeter.GetAverageLoad() * 100.f);
+    g.DrawText(mTopLabelText, str.Get(), padded);
+
+    str.SetFormatted(64, "peak %.0f %% risky %u xruns %u", mMeter.GetPeakLoad() * 100.f, mMeter.GetNRiskyBlocks(), mMeter.GetNOverruns());
+    g.DrawText(mBottomLabelText, str.Get(), padded);
+
+    if (nMarkers)
+      DrawMarkers(g, nMarkers, padded.B);
+  }
+
+private:
+  void DrawMarkers(IGraphics& g, int nMarkers, float top)
+  {
+    WDL_String str;
+    IRECT r(mRECT.L + 2.f, top, mRECT.R - 2.f, top + kMarkerRowHeight);
+
+    for (int i = -1; i < nMarkers && r.B <= mRECT.B - 2.f; i++, r.Translate(0.f, kMarkerRowHeight))
+    {
+      if (i < 0)
+      {
+        g.DrawText(mMarkerText, "marker", r.FracRectHorizontal(0.4f));
+        g.DrawText(mMarkerText, "min us", r.GetGridCell(0, 2, 1, 5));
+        g.DrawText(mMarkerText, "mean us", r.GetGridCell(0, 3, 1, 5));
+        g.DrawText(mMarkerText, "max us", r.GetGridCell(0, 4, 1, 5));
+        continue;
+      }
+
+      const IPlugProfiler::Stats stats = mProfiler->GetMarkerStats(i);
+
+      g.DrawText(mMarkerText, mProfiler->GetMarkerName(i), r.FracRectHorizontal(0.4f));
+      str.SetFormatted(32, "%.1f", stats.min * 1e6f);
+      g.DrawText(mMarkerText, str.Get(), r.GetGridCell(0, 2, 1, 5));
+      str.SetFormatted(32, "%.1f", stats.mean * 1e6f);
+      g.DrawText(mMarkerText, str.Get(), r.GetGridCell(0, 3, 1, 5));
+      str.SetFormatted(32, "%.1f", stats.max * 1e6f);
+      g.DrawText(mMarkerText, str.Get(), r.GetGridCell(0, 4, 1, 5));
+    }
+  }
+
+  IPlugLoadMeter& mMeter;
+  const IPlugProfiler* mProfiler;
+  WDL_String mNameLabel;
+  float mBuffer[MAXBUF] = {};
+  int mReadPos = 0;
+
+  IText& mNameLabelText = mText;
+  IText mTopLabelText = IText(18, GetColor(kFR), DEFAULT_FONT, IText::kAlignFar, IText::kVAlignTop);
+  IText mBottomLabelText = IText(12, GetColor(kFR), DEFAULT_FONT, IText::kAlignFar, IText::kVAlignBottom);
+  IText mMarkerText = IText(12, GetColor(kFR), DEFAULT_FONT, IText::kAlignNear, IText::kVAlignMiddle);
+};
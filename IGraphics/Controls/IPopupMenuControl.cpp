@@ -180,6 +180,8 @@ void IPopupMenuControl::OnMouseDrag(float x, float y, float dX, float dY, const
 
 void IPopupMenuControl::OnMouseOver(float x, float y, const IMouseMod& mod)
 {
+  mPrevMouseCellBounds = mMouseCellBounds;
+  MenuPanel* pPrevMenuPanel = mActiveMenuPanel;
   mMouseCellBounds = mActiveMenuPanel->HitTestCells(x, y);
   
   // if the mouse event was outside of the active MenuPanel - could be on another menu or completely outside
@@ -207,28 +209,25 @@ void IPopupMenuControl::OnMouseOver(float x, float y, const IMouseMod& mod)
     }
   }
   
-  //  if(mMouseCellBounds != mPrevMouseCellBounds) //FIXME: shouldn't need to redraw all the time
-//  {
-    CalculateMenuPanels(x, y);
+  // moving within a cell changes nothing, so the menu, and what is under it, isn't redrawn
+  if (GetState() == kExpanded && mMouseCellBounds == mPrevMouseCellBounds && mActiveMenuPanel == pPrevMenuPanel && !mActiveMenuPanel->mScroller)
+    return;
+  
+  CalculateMenuPanels(x, y);
   
-    if(mActiveMenuPanel->mScroller)
+  if(mActiveMenuPanel->mScroller)
+  {
+    if(mMouseCellBounds == mActiveMenuPanel->mCellBounds.Get(0))
     {
-      if(mMouseCellBounds == mActiveMenuPanel->mCellBounds.Get(0))
-      {
-        mActiveMenuPanel->ScrollUp();
-      }
-      else if (mMouseCellBounds == mActiveMenuPanel->mCellBounds.Get((mActiveMenuPanel->mCellBounds.GetSize()-1)))
-      {
-        mActiveMenuPanel->ScrollDown();
-      }
+      mActiveMenuPanel->ScrollUp();
     }
+    else if (mMouseCellBounds == mActiveMenuPanel->mCellBounds.Get((mActiveMenuPanel->mCellBounds.GetSize()-1)))
+    {
+      mActiveMenuPanel->ScrollDown();
+    }
+  }
   
-    SetDirty(false);
-//  }
-//  else
-//    SetClean();
-  
-//  mPrevMouseCellBounds = mMouseCellBounds;
+  SetDirty(false);
 }
 
 void IPopupMenuControl::OnMouseOut()
@@ -326,13 +326,15 @@ void ITextEntryControl::CreateTextEntry(const IRECT& bounds, const IText& text,
 void ITextEntryControl::DismissEdit()
 {
   mEditing = false;
+  // only what the entry was drawn over is uncovered
+  GetUI()->SetRegionDirty(mRECT);
   SetTargetAndDrawRECTs(IRECT());
-  GetUI()->SetAllControlsDirty();
 }
 
 void ITextEntryControl::CommitEdit()
 {
   mEditing = false;
+  // only what the entry was drawn over is uncovered
+  GetUI()->SetRegionDirty(mRECT);
   SetTargetAndDrawRECTs(IRECT());
-  GetUI()->SetAllControlsDirty();
 }
@@ -92,6 +92,9 @@ public:
 
     SetNoteRange(minNote, maxNote, keepWidth);
     SetWantsMidi(true);
+
+    // the key bed is cached, and pressed keys are drawn over it, see DrawDynamic()
+    SetCacheMode(kCacheStatic);
   }
 
   void OnMouseDown(float x, float y, const IMouseMod& mod) override
@@ -111,7 +114,7 @@ public:
       TriggerMidiMsgFromKeyPress(mLastTouchedKey, (int) (mLastVelocity * 127.f));
     }
 
-    SetDirty(true);
+    OnKeysChanged();
   }
 
   void OnMouseUp(float x, float y, const IMouseMod& mod) override
@@ -125,7 +128,8 @@ public:
       mMouseOverKey = -1;
       mLastVelocity = 0.;
 
-      SetDirty(false);
+      if (mShowNoteAndVel)
+        SetDirty(false);
     }
   }
 
@@ -160,8 +164,7 @@ public:
       SetKeyIsPressed(prevKey, false);
     }
 
-    SetDirty(true);
-
+    OnKeysChanged();
   }
 
 //  void OnMouseWheel(float x, float y, const IMouseMod& mod, float d) override
@@ -205,9 +208,11 @@ public:
     }
 
     mTargetRECT = mRECT;
+    InvalidateCache();
     SetDirty(false);
   }
 
+  // the keys mark their own areas dirty, see SetKeyIsPressed()
   void OnMidi(const IMidiMsg& msg) override
   {
     switch (msg.StatusMsg())
@@ -224,8 +229,6 @@ public:
         break;
       default: break;
     }
-
-    SetDirty(false);
   }
 
   void DrawKey(IGraphics& g, const IRECT& bounds, const IColor& color)
@@ -237,23 +240,70 @@ public:
   }
 
   void Draw(IGraphics& g) override
+  {
+    DrawKeys(g, true, mRECT.L - 1.f, mRECT.R + 1.f);
+    DrawOverlay(g);
+  }
+
+  void DrawStatic(IGraphics& g) override
+  {
+    DrawKeys(g, false, mRECT.L - 1.f, mRECT.R + 1.f);
+  }
+
+  void DrawDynamic(IGraphics& g) override
+  {
+    if (g.HasPathSupport())
+    {
+      // only the areas of the pressed keys differ from the key bed, drawn clipped to them so that they match it exactly
+      for (int i = 0; i < NKeys(); ++i)
+      {
+        if (GetKeyIsPressed(i))
+        {
+          const IRECT area = GetKeyArea(i);
+          g.PathClipRegion(area);
+          DrawKeys(g, true, area.L, area.R);
+        }
+      }
+
+      g.PathClipRegion();
+    }
+    else
+      DrawKeys(g, true, mRECT.L - 1.f, mRECT.R + 1.f);
+
+    DrawOverlay(g);
+  }
+
+  /** Draw the keys, and the frame
+   * @param g The graphics context
+   * @param showPressed \c false to draw every key as released
+   * @param areaL The left of the area to draw, keys that draw nothing in the area are skipped
+   * @param areaR The right of the area to draw */
+  void DrawKeys(IGraphics& g, bool showPressed, float areaL, float areaR)
   {
     IColor shadowColor = IColor(60, 0, 0, 0);
 
     float BKBottom = mRECT.T + mRECT.H() * mBKHeightRatio;
     float BKWidth = GetBKWidth();
 
+    auto isPressed = [&](int i) { return showPressed && GetKeyIsPressed(i); };
+
+    auto inArea = [&](int i) {
+      float l, r;
+      GetKeyExtent(i, l, r);
+      return r > areaL && l < areaR;
+    };
+
     // first draw white keys
     for (int i = 0; i < NKeys(); ++i)
     {
-      if (!IsBlackKey(i))
+      if (!IsBlackKey(i) && inArea(i))
       {
         float kL = *GetKeyXPos(i);
         IRECT keyBounds = IRECT(kL, mRECT.T, kL + mWKWidth, mRECT.B);
 
         DrawKey(g, keyBounds, GetColor(kWK));
 
-        if (GetKeyIsPressed(i))
+        if (isPressed(i))
         {
           // draw played white key
           DrawKey(g, keyBounds, GetColor(kPK));
@@ -278,17 +328,17 @@ public:
     // then blacks
     for (int i = 0; i < NKeys(); ++i)
     {
-      if (IsBlackKey(i))
+      if (IsBlackKey(i) && inArea(i))
       {
         float kL = *GetKeyXPos(i);
         IRECT keyBounds = IRECT(kL, mRECT.T, kL + BKWidth, BKBottom);
         // first draw underlying shadows
-        if (mDrawShadows && !GetKeyIsPressed(i) && i < NKeys() - 1)
+        if (mDrawShadows && !isPressed(i) && i < NKeys() - 1)
         {
           IRECT shadowBounds = keyBounds;
           float w = shadowBounds.W();
           shadowBounds.L += 0.6f * w;
-          if (GetKeyIsPressed(i + 1))
+          if (isPressed(i + 1))
           {
             // if white to the right is pressed, shadow is longer
             w *= 1.3f;
@@ -299,7 +349,7 @@ public:
         }
         DrawKey(g, keyBounds, GetColor(kBK));
 
-        if (GetKeyIsPressed(i))
+        if (isPressed(i))
         {
           // draw pressed black key
           IColor cBP = GetColor(kPK);
@@ -322,7 +372,11 @@ public:
 
     if (mDrawFrame)
       g.DrawRect(GetColor(kFR), mRECT);
+  }
 
+  /** Draw the note and velocity, and the splash */
+  void DrawOverlay(IGraphics& g)
+  {
     if (mShowNoteAndVel)
     {
       if (mMouseOverKey > -1)
@@ -394,8 +448,13 @@ public:
 
   void SetKeyIsPressed(int key, bool pressed)
   {
+    if (key < 0 || key >= NKeys() || GetKeyIsPressed(key) == pressed)
+      return;
+
     mPressedKeys.Get()[key] = pressed;
-    SetDirty(false);
+
+    // only the key and the neighbours that overlap it are redrawn
+    SetDirtyArea(GetKeyArea(key));
   }
 
   void ClearNotesFromMidi()
@@ -426,6 +485,7 @@ public:
       }
     }
 
+    InvalidateCache();
     SetDirty(false);
   }
 
@@ -439,6 +499,7 @@ public:
 
     if (keepAspectRatio)
       SetWidth(mRECT.W() * r);
+    InvalidateCache();
     SetDirty(false);
   }
 
@@ -460,6 +521,7 @@ public:
     if (keepAspectRatio)
       SetHeight(mRECT.H() * r);
 
+    InvalidateCache();
     SetDirty(false);
   }
 
@@ -497,6 +559,7 @@ public:
       mBKAlpha = Clip(mBKAlpha, 15.f, 255.f);
     }
 
+    InvalidateCache();
     SetDirty(false);
   }
 
@@ -593,6 +656,7 @@ private:
     }
 
     mTargetRECT = mRECT;
+    InvalidateCache();
     SetDirty(false);
   }
 
@@ -686,6 +750,40 @@ private:
     return w;
   }
 
+  /** Get the horizontal extent of everything drawn for a key: its borders, which straddle its edges, and for a black key the shadow, which is longest when the white key to its right is pressed */
+  void GetKeyExtent(int key, float& l, float& r)
+  {
+    const float kL = *GetKeyXPos(key);
+    l = kL - 1.f;
+    r = kL + (IsBlackKey(key) ? 1.9f * GetBKWidth() : mWKWidth) + 1.f;
+  }
+
+  /** @return The area that changes when a key is pressed or released, which covers the neighbours whose borders and shadows overlap it */
+  IRECT GetKeyArea(int key)
+  {
+    float l, r;
+    GetKeyExtent(key, l, r);
+
+    for (int i = std::max(key - 1, 0); i <= std::min(key + 1, NKeys() - 1); ++i)
+    {
+      float il, ir;
+      GetKeyExtent(i, il, ir);
+      l = std::min(l, il);
+      r = std::max(r, ir);
+    }
+
+    return IRECT(l, mRECT.T, r, mRECT.B).Intersect(mRECT.GetPadded(1.f));
+  }
+
+  /** Trigger the action function after the mouse has changed the keys, which have marked their own areas dirty, redrawing the whole control only to show the note and velocity */
+  void OnKeysChanged()
+  {
+    if (mShowNoteAndVel)
+      SetDirty(true);
+    else if (GetActionFunction())
+      GetActionFunction()(this);
+  }
+
   void TriggerMidiMsgFromKeyPress(int key, int velocity)
   {
     IMidiMsg msg;
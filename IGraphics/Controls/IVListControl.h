@@ -0,0 +1,542 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @ingroup Controls
+ * @copydoc IVListControl
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "IPlugWorkerPool.h"
+
+#include "IControl.h"
+
+/** A vectorial scrolling list, or grid, of text items, for browsers of thousands of presets or samples.
+ * Only the rows that are in view exist: a fixed pool of row objects, enough to fill the control, is recycled as it scrolls, and each row caches its drawing in a layer,
+ * so that a row that stays in view while scrolling is drawn from its layer rather than drawn again. The list can be flung with the mouse and keeps scrolling, slowing down,
+ * after the mouse is released. A filter that matches the items is run on the IPlugWorkerPool for long lists, and refines the previous matches when it extends the previous filter,
+ * so that typing into a search box doesn't stall the UI. The selection and the action function refer to the index of the item in the full list
+ * @ingroup IControls */
+class IVListControl : public IControl
+                    , public IVectorBase
+{
+public:
+  /** Lists with fewer items than this are filtered on the UI thread */
+  static constexpr int kMinAsyncFilterItems = 4096;
+
+  /** The fraction of the velocity that a fling keeps after a second */
+  static constexpr float kFlingFriction = 0.05f;
+
+  /** The speed in pixels per second below which a fling stops */
+  static constexpr float kMinFlingVelocity = 20.f;
+
+  /** How far in pixels the mouse can move before a click becomes a drag */
+  static constexpr float kDragThreshold = 3.f;
+
+  /** Create a list control
+   * @param bounds The control's bounds
+   * @param actionFunc Called when an item is selected with the mouse
+   * @param text The IText the items are drawn with
+   * @param colorSpec The colors, kBG for the background, kFG for the items, kPR for the selected item, kFR for the frame and kHL for the item under the mouse. The items' text is drawn with the IText's color
+   * @param rowHeight The height of a row
+   * @param nColumns The number of items in a row, more than one makes a grid */
+  IVListControl(IRECT bounds, IActionFunction actionFunc = nullptr, const IText& text = DEFAULT_TEXT, const IVColorSpec& colorSpec = DEFAULT_SPEC,
+                float rowHeight = 20.f, int nColumns = 1)
+  : IControl(bounds, actionFunc)
+  , IVectorBase(colorSpec)
+  , mItems(std::make_shared<const Items>())
+  , mRowHeight(std::max(rowHeight, 1.f))
+  , mNColumns(std::max(nColumns, 1))
+  {
+    AttachIControl(this);
+    mText = text;
+    mText.mAlign = IText::kAlignNear;
+    mDblAsSingleClick = true;
+    UpdateRows();
+  }
+
+  ~IVListControl()
+  {
+    if (mFilterJob)
+      mFilterJob->Cancel();
+  }
+
+  void Draw(IGraphics& g) override
+  {
+    g.FillRect(GetColor(kBG), mRECT);
+
+    const float scale = g.GetDrawScale() * g.GetScreenScale();
+    int first, last;
+    GetVisibleRange(first, last);
+
+    for (int i = first; i < last; i++)
+    {
+      const int item = mMatches[i];
+      const IRECT bounds = GetCellBounds(i).GetPixelAligned(scale);
+      const bool selected = item == mSelectedItem;
+      const bool mouseOver = i == mMouseOverIdx;
+      Row& row = mRows[i % mRows.size()];
+
+      // a row keeps its layer while its item stays in view, as the layer is moved with it
+      if (row.item != item || row.selected != selected || row.mouseOver != mouseOver || !g.CheckLayer(row.layer)
+          || row.layer->Bounds().W() != bounds.W() || row.layer->Bounds().H() != bounds.H())
+      {
+        row.item = item;
+        row.selected = selected;
+        row.mouseOver = mouseOver;
+        g.StartLayer(bounds);
+        DrawRow(g, bounds, item, selected, mouseOver);
+        row.layer = g.EndLayer();
+      }
+
+      // ending a layer resets the clip, so it is set again for each row
+      g.PathClipRegion(mRECT);
+      g.DrawFittedLayer(row.layer, bounds, nullptr);
+    }
+
+    g.PathClipRegion();
+
+    if (mDrawFrame)
+      g.DrawRect(GetColor(kFR), mRECT, nullptr, mFrameThickness);
+  }
+
+  /** Override this method to change the way an item is drawn
+   * @param g The graphics context
+   * @param bounds The item's cell
+   * @param item The index of the item in the full list
+   * @param selected \c true if it is the selected item
+   * @param mouseOver \c true if the mouse is over it */
+  virtual void DrawRow(IGraphics& g, const IRECT& bounds, int item, bool selected, bool mouseOver)
+  {
+    if (selected)
+      g.FillRect(GetColor(kPR), bounds);
+    else if (mouseOver)
+      g.FillRect(GetColor(kHL), bounds);
+
+    g.DrawText(mText, GetItemText(item), bounds.GetHPadded(-4.f));
+  }
+
+  void OnMouseDown(float x, float y, const IMouseMod& mod) override
+  {
+    // a click stops a fling
+    if (GetAnimationFunction())
+      IControl::OnEndAnimation();
+
+    mDragged = false;
+    mDragDistance = 0.f;
+    mVelocity = 0.f;
+    mLastDragTime = Time::now();
+  }
+
+  void OnMouseDrag(float x, float y, float dX, float dY, const IMouseMod& mod) override
+  {
+    const TimePoint now = Time::now();
+    const float dt = std::max(static_cast<float>(Milliseconds(now - mLastDragTime).count() / 1000.), 0.001f);
+    mLastDragTime = now;
+
+    mDragDistance += std::fabs(dY);
+
+    if (!mDragged && mDragDistance < kDragThreshold)
+      return;
+
+    mDragged = true;
+    // smoothed, as the mouse events don't arrive evenly
+    mVelocity = 0.7f * (-dY / dt) + 0.3f * mVelocity;
+    ScrollTo(mScrollOffset - dY);
+  }
+
+  void OnMouseUp(float x, float y, const IMouseMod& mod) override
+  {
+    if (!mDragged)
+    {
+      const int idx = GetMatchAtPoint(x, y);
+
+      if (idx > -1)
+      {
+        mSelectedItem = mMatches[idx];
+        SetDirty(true);
+      }
+
+      return;
+    }
+
+    // the speed of the last drag is only kept if the mouse was still moving when it was released
+    if (Milliseconds(Time::now() - mLastDragTime).count() > 100.)
+      mVelocity = 0.f;
+
+    if (std::fabs(mVelocity) > kMinFlingVelocity)
+      StartFling();
+  }
+
+  void OnMouseWheel(float x, float y, const IMouseMod& mod, float d) override
+  {
+    ScrollTo(mScrollOffset - d * 3.f * mRowHeight);
+    OnMouseOver(x, y, mod);
+  }
+
+  void OnMouseOver(float x, float y, const IMouseMod& mod) override
+  {
+    const int idx = GetMatchAtPoint(x, y);
+
+    if (idx != mMouseOverIdx)
+    {
+      mMouseOverIdx = idx;
+      SetDirty(false);
+    }
+  }
+
+  void OnMouseOut() override
+  {
+    mMouseOverIdx = -1;
+    SetDirty(false);
+  }
+
+  void OnResize() override
+  {
+    UpdateRows();
+    ScrollTo(mScrollOffset);
+    SetDirty(false);
+  }
+
+  /** Picks up the matches of a filter that was run on a worker thread */
+  bool IsDirty() override
+  {
+    if (mFilterState && mFilterState->done.load())
+    {
+      mMatches = std::move(mFilterState->matches);
+      mMatchedFilter = mFilterState->filter;
+      mMatchesComplete = true;
+      mFilterState = nullptr;
+      mFilterJob = nullptr;
+      SetPollDirty(false);
+      OnMatchesChanged();
+    }
+
+    return IControl::IsDirty();
+  }
+
+#pragma mark - Items
+
+  /** Set the items of the list, which clears the selection and the filter
+   * @param items The items' text */
+  void SetItems(std::vector<std::string> items)
+  {
+    CancelFilter();
+    mItems = std::make_shared<const Items>(std::move(items));
+    mSelectedItem = -1;
+    mFilter.clear();
+    mMatchedFilter.clear();
+    MatchAll();
+    ScrollTo(0.f);
+    OnMatchesChanged();
+  }
+
+  /** @return The number of items in the full list */
+  int NItems() const { return static_cast<int>(mItems->size()); }
+
+  /** @return The number of items that match the filter, which may be the matches of a previous filter while the filter runs */
+  int NMatches() const { return static_cast<int>(mMatches.size()); }
+
+  /** @param idx The index of a match
+   * @return The index of the matched item in the full list */
+  int GetMatch(int idx) const { return mMatches[idx]; }
+
+  /** @param item The index of an item in the full list */
+  const char* GetItemText(int item) const { return (*mItems)[item].c_str(); }
+
+  /** @return The index in the full list of the selected item, or -1 if there is none */
+  int GetSelectedItem() const { return mSelectedItem; }
+
+  /** Select an item, without calling the action function
+   * @param item The index of the item in the full list, or -1 to clear the selection
+   * @param scrollTo \c true to scroll the item into view, if it matches the filter */
+  void SetSelectedItem(int item, bool scrollTo = true)
+  {
+    mSelectedItem = item >= 0 && item < NItems() ? item : -1;
+
+    if (scrollTo && mSelectedItem > -1)
+      ScrollToItem(mSelectedItem);
+
+    SetDirty(false);
+  }
+
+  /** Show only the items that contain a string, ignoring case. Long lists are filtered on a worker thread and the matches shown when it is done
+   * @param filter The string, an empty string shows every item */
+  void SetFilter(const char* filter)
+  {
+    std::string lower(filter ? filter : "");
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+    if (lower == mFilter)
+      return;
+
+    // a filter that extends the one that was matched can only match a subset of its matches
+    const bool refine = mMatchesComplete && lower.find(mMatchedFilter) != std::string::npos;
+
+    CancelFilter();
+    mFilter = lower;
+
+    if (lower.empty())
+    {
+      mMatchedFilter.clear();
+      MatchAll();
+      OnMatchesChanged();
+      return;
+    }
+
+    auto state = std::make_shared<FilterState>();
+    state->filter = lower;
+
+    std::vector<int> source;
+
+    if (refine)
+      source = mMatches;
+    else
+    {
+      source.resize(mItems->size());
+
+      for (int i = 0; i < NItems(); i++)
+        source[i] = i;
+    }
+
+    if (static_cast<int>(source.size()) < kMinAsyncFilterItems)
+    {
+      Filter(*mItems, source, *state, nullptr);
+      mMatches = std::move(state->matches);
+      mMatchedFilter = lower;
+      OnMatchesChanged();
+      return;
+    }
+
+    // the job only uses what it captures, so that it can finish safely after the control has gone
+    std::shared_ptr<const Items> items = mItems;
+    auto pSource = std::make_shared<std::vector<int>>(std::move(source));
+    mFilterState = state;
+    mMatchesComplete = false;
+    mFilterJob = std::make_shared<IPlugJob>([items, pSource, state](IPlugJob& job) { Filter(*items, *pSource, *state, &job); }, nullptr,
+                                            IPlugJob::kPriorityHigh, IPlugJob::ECompletionThread::kMainThread);
+    IPlugWorkerPool::Get().Submit(mFilterJob);
+    SetPollDirty(true);
+  }
+
+  /** @return \c true while a filter is running on a worker thread */
+  bool IsFiltering() const { return mFilterState != nullptr; }
+
+#pragma mark - Layout and scrolling
+
+  /** @param height The height of a row */
+  void SetRowHeight(float height)
+  {
+    mRowHeight = std::max(height, 1.f);
+    OnResize();
+  }
+
+  /** @param nColumns The number of items in a row, more than one makes a grid */
+  void SetNColumns(int nColumns)
+  {
+    mNColumns = std::max(nColumns, 1);
+    OnResize();
+  }
+
+  /** @return The distance in pixels that the list is scrolled from its top */
+  float GetScrollOffset() const { return mScrollOffset; }
+
+  /** Scroll the list, which is limited to its length
+   * @param offset The distance in pixels from its top */
+  void ScrollTo(float offset)
+  {
+    const float maxOffset = std::max(0.f, NRows() * mRowHeight - mRECT.H());
+    offset = Clip(offset, 0.f, maxOffset);
+
+    if (offset != mScrollOffset)
+    {
+      mScrollOffset = offset;
+      mMouseOverIdx = -1;
+      SetDirty(false);
+    }
+  }
+
+  /** Scroll the list the least that brings an item into view
+   * @param item The index of the item in the full list, which does nothing if it doesn't match the filter */
+  void ScrollToItem(int item)
+  {
+    auto it = std::lower_bound(mMatches.begin(), mMatches.end(), item);
+
+    if (it == mMatches.end() || *it != item)
+      return;
+
+    const float top = static_cast<float>(static_cast<int>(it - mMatches.begin()) / mNColumns) * mRowHeight;
+
+    if (top < mScrollOffset)
+      ScrollTo(top);
+    else if (top + mRowHeight > mScrollOffset + mRECT.H())
+      ScrollTo(top + mRowHeight - mRECT.H());
+  }
+
+  /** @return The index into the matches of the item at a point, or -1 if there is none */
+  int GetMatchAtPoint(float x, float y) const
+  {
+    if (!mRECT.Contains(x, y))
+      return -1;
+
+    const int row = static_cast<int>((y - mRECT.T + mScrollOffset) / mRowHeight);
+    const int column = std::min(static_cast<int>((x - mRECT.L) / CellWidth()), mNColumns - 1);
+    const int idx = row * mNColumns + column;
+
+    return idx < NMatches() ? idx : -1;
+  }
+
+private:
+  using Items = std::vector<std::string>;
+
+  /** A recycled row, which holds the drawing of one item while it is in view */
+  struct Row
+  {
+    int item = -1;
+    bool selected = false;
+    bool mouseOver = false;
+    ILayerPtr layer;
+  };
+
+  /** The filter that a worker thread is running, and its matches */
+  struct FilterState
+  {
+    std::string filter;
+    std::vector<int> matches;
+    std::atomic<bool> done {false};
+  };
+
+  /** Match the items in source against the filter, which is lower case, checking for cancellation if run by a job */
+  static void Filter(const Items& items, const std::vector<int>& source, FilterState& state, IPlugJob* pJob)
+  {
+    const std::string& filter = state.filter;
+    auto equal = [](char a, char b) { return std::tolower(static_cast<unsigned char>(a)) == b; };
+
+    for (size_t i = 0; i < source.size(); i++)
+    {
+      if (pJob && !(i & 1023) && pJob->IsCancelled())
+        return;
+
+      const std::string& str = items[source[i]];
+
+      if (std::search(str.begin(), str.end(), filter.begin(), filter.end(), equal) != str.end())
+        state.matches.push_back(source[i]);
+    }
+
+    state.done.store(true);
+  }
+
+  void CancelFilter()
+  {
+    if (mFilterJob)
+      mFilterJob->Cancel();
+
+    mFilterJob = nullptr;
+    mFilterState = nullptr;
+    mMatchesComplete = true;
+    SetPollDirty(false);
+  }
+
+  void MatchAll()
+  {
+    mMatches.resize(mItems->size());
+
+    for (int i = 0; i < NItems(); i++)
+      mMatches[i] = i;
+
+    mMatchesComplete = true;
+  }
+
+  void OnMatchesChanged()
+  {
+    // the rows keep their layers, which are drawn again if their items change
+    mMouseOverIdx = -1;
+    ScrollTo(mScrollOffset);
+    SetDirty(false);
+  }
+
+  /** Size the pool of rows to the most that can be in view at once */
+  void UpdateRows()
+  {
+    const size_t nVisibleRows = static_cast<size_t>(std::ceil(mRECT.H() / mRowHeight)) + 1;
+    mRows.clear();
+    mRows.resize(nVisibleRows * mNColumns);
+  }
+
+  int NRows() const { return (NMatches() + mNColumns - 1) / mNColumns; }
+
+  float CellWidth() const { return mRECT.W() / static_cast<float>(mNColumns); }
+
+  /** @param idx The index into the matches */
+  IRECT GetCellBounds(int idx) const
+  {
+    const float top = mRECT.T + static_cast<float>(idx / mNColumns) * mRowHeight - mScrollOffset;
+    const float left = mRECT.L + static_cast<float>(idx % mNColumns) * CellWidth();
+    return IRECT(left, top, left + CellWidth(), top + mRowHeight);
+  }
+
+  /** Get the matches in view, which never number more than the rows in the pool, so that each has its own row */
+  void GetVisibleRange(int& first, int& last) const
+  {
+    const int firstRow = static_cast<int>(mScrollOffset / mRowHeight);
+    const int lastRow = static_cast<int>(std::ceil((mScrollOffset + mRECT.H()) / mRowHeight));
+    first = std::min(firstRow * mNColumns, NMatches());
+    last = std::min(std::min(lastRow * mNColumns, first + static_cast<int>(mRows.size())), NMatches());
+  }
+
+  /** Keep scrolling after a drag, slowing down until it stops or reaches an end of the list */
+  void StartFling()
+  {
+    mLastDragTime = GetAnimationTime();
+
+    SetAnimation([&](IControl* pCaller) {
+      const TimePoint now = GetAnimationTime();
+      const float dt = static_cast<float>(Milliseconds(now - mLastDragTime).count() / 1000.);
+      mLastDragTime = now;
+
+      const float prevOffset = mScrollOffset;
+      mVelocity *= std::pow(kFlingFriction, dt);
+      ScrollTo(mScrollOffset + mVelocity * dt);
+
+      if (std::fabs(mVelocity) < kMinFlingVelocity || (mScrollOffset == prevOffset && dt > 0.f))
+        OnEndAnimation();
+    }, 10000);
+  }
+
+  std::shared_ptr<const Items> mItems;
+  std::vector<int> mMatches; // the indices of the items that match the filter, in order
+  std::string mFilter; // the filter that was asked for, in lower case
+  std::string mMatchedFilter; // the filter that mMatches is for, which differs from mFilter while a worker runs it
+  bool mMatchesComplete = true; // false while mMatches is for a filter that has been replaced
+  std::shared_ptr<FilterState> mFilterState;
+  std::shared_ptr<IPlugJob> mFilterJob;
+
+  std::vector<Row> mRows;
+  float mRowHeight;
+  int mNColumns;
+  float mScrollOffset = 0.f;
+  int mSelectedItem = -1;
+  int mMouseOverIdx = -1;
+
+  bool mDragged = false;
+  float mDragDistance = 0.f;
+  float mVelocity = 0.f; // pixels per second
+  TimePoint mLastDragTime;
+};
@@ -16,11 +16,15 @@
  * @copydoc IVMeterControl
  */
 
+#include <array>
+
 #include "IControl.h"
-#include "IPlugQueue.h"
-#include "IPlugStructs.h"
+#include "ISender.h"
 
-/** Vectorial multichannel capable meter control
+/** Vectorial multichannel capable meter control.
+ * The tracks are drawn a part at a time for all channels, with one batched fill for each of the backgrounds, the levels and the peaks, so that a meter of many channels,
+ * e.g. for a 7.1.4 bus, costs a few fills rather than a few per channel. Optional ballistics, see SetBallistics(), let the levels fall at a fixed rate and hold their peaks,
+ * advanced at each display refresh rather than only when a frame arrives, so that the meter settles when the sender stops sending
  * @ingroup IControls */
 template <int MAXNC = 1, int QUEUE_SIZE = 1024>
 class IVMeterControl : public IVTrackControlBase
@@ -29,98 +33,159 @@ public:
   static constexpr int kUpdateMessage = 0;
 
   /** Data packet */
-  struct Data
+  using Data = ISenderData<MAXNC>;
+
+  /** Used on the DSP side in order to measure peak levels and transfer them to the low priority thread. */
+  using IVMeterBallistics = IPeakSender<MAXNC, QUEUE_SIZE>;
+
+  IVMeterControl(IRECT bounds, const char* trackNames = 0, ...)
+  : IVTrackControlBase(bounds, MAXNC, 0, 1., trackNames)
   {
-    int nchans = MAXNC;
-    float vals[MAXNC] = {};
+    mPeaks.fill(0.f);
+  }
 
-    bool AboveThreshold()
-    {
-      static const float threshold = (float) DBToAmp(-90.);
+  //  void OnResize() override;
+  //  void OnMouseDblClick(float x, float y, const IMouseMod& mod) override;
+  //  void OnMouseDown(float x, float y, const IMouseMod& mod) override;
 
-      float sum = 0.f;
+  /** Let the levels fall at a fixed rate rather than follow the frames, and hold the peak of each channel
+   * @param releasePerSec How much of the track the level falls in a second, 0 to follow the frames
+   * @param peakHoldMs How long a peak is held before it falls, 0 to show the peak at the level
+   * @param peakFallPerSec How much of the track a peak falls in a second once it has been held */
+  void SetBallistics(float releasePerSec, float peakHoldMs = 1000.f, float peakFallPerSec = 0.5f)
+  {
+    mReleasePerSec = std::max(releasePerSec, 0.f);
+    mPeakHoldMs = std::max(peakHoldMs, 0.f);
+    mPeakFallPerSec = std::max(peakFallPerSec, 0.f);
+  }
+
+  void OnMsgFromDelegate(int messageTag, int dataSize, const void* pData) override
+  {
+    if (messageTag != kUpdateMessage || dataSize != sizeof(Data))
+      return;
 
-      for(int i = 0; i < MAXNC; i++)
+    const Data* pFrame = static_cast<const Data*>(pData);
+    const TimePoint now = GetAnimationTime();
+
+    for (auto i = 0; i < pFrame->nChans && pFrame->chanOffset + i < MAXNC; i++)
+    {
+      const int c = pFrame->chanOffset + i;
+      const float val = Clip(pFrame->vals[i], 0.f, 1.f);
+      float* pVal = GetTrackData(c);
+      *pVal = mReleasePerSec > 0.f ? std::max(*pVal, val) : val;
+
+      if (val >= mPeaks[c])
       {
-        sum += vals[i];
+        mPeaks[c] = val;
+        mPeakTimes[c] = now;
       }
-
-      return std::abs(sum) > threshold;
     }
-  };
 
-  /** Used on the DSP side in order to queue sample values and transfer data to low priority thread. */
-  class IVMeterBallistics
-  {
-  public:
-    IVMeterBallistics(int controlTag)
-    : mControlTag(controlTag)
+    // the ballistics are advanced at each refresh until the levels and peaks have settled
+    if (HasBallistics() && !GetPollDirty())
     {
+      mLastUpdate = now;
+      SetPollDirty(true);
     }
 
-    void ProcessBlock(sample** inputs, int nFrames)
-    {
-      Data d;
+    SetDirty(false);
+  }
 
-      for (auto c = 0; c < MAXNC; c++)
-      {
-        for (auto s = 0; s < nFrames; s++)
-        {
-          float sm = (float)fabs(inputs[c][s]);
-          if (sm > d.vals[c])
-            d.vals[c] = sm;
-        }
-      }
+  bool IsDirty() override
+  {
+    if (GetPollDirty())
+      UpdateBallistics();
+
+    return IVTrackControlBase::IsDirty();
+  }
 
-      if(mPrevAboveThreshold)
-        mQueue.Push(d); // TODO: expensive?
+  void Draw(IGraphics& g) override
+  {
+    g.FillRect(GetColor(kBG), mRECT);
 
-      mPrevAboveThreshold = d.AboveThreshold();
-    }
+    const int nTracks = MaxNTracks();
 
-    // this must be called on the main thread - typically in MyPlugin::OnIdle()
-    void TransmitData(IEditorDelegate& dlg)
+    for (int ch = 0; ch < nTracks; ch++)
     {
-      while(mQueue.ElementsAvailable())
-      {
-        Data d;
-        mQueue.Pop(d);
-        dlg.SendControlMsgFromDelegate(mControlTag, kUpdateMessage, sizeof(Data), (void*) &d);
-      }
+      const IRECT& r = mTrackBounds.Get()[ch];
+      const IRECT fillRect = r.FracRect(mDirection, *GetTrackData(ch));
+      const IRECT peakRect = mPeakHoldMs > 0.f ? r.FracRect(mDirection, std::max(mPeaks[ch], *GetTrackData(ch))) : fillRect;
+
+      mFillRects[ch] = fillRect;
+
+      if (mDirection == kVertical)
+        mPeakRects[ch] = IRECT(peakRect.L, peakRect.T, peakRect.R, peakRect.T + mPeakSize);
+      else
+        mPeakRects[ch] = IRECT(peakRect.R - mPeakSize, peakRect.T, peakRect.R, peakRect.B);
     }
 
-  private:
-    int mControlTag;
-    bool mPrevAboveThreshold = true;
-    IPlugQueue<Data> mQueue {QUEUE_SIZE};
-  };
+    g.FillRects(GetColor(kSH), mTrackBounds.Get(), nTracks);
+    g.FillRects(GetColor(kFG), mFillRects.data(), nTracks);
+    g.FillRects(GetColor(kHL), mPeakRects.data(), nTracks);
 
-  IVMeterControl(IRECT bounds, const char* trackNames = 0, ...)
-  : IVTrackControlBase(bounds, MAXNC, 0, 1., trackNames)
-  {
+    if (mDrawTrackFrame)
+    {
+      for (int ch = 0; ch < nTracks; ch++)
+        g.DrawRect(GetColor(kFR), mTrackBounds.Get()[ch], nullptr, mFrameThickness);
+    }
+
+    if (mDrawFrame)
+      g.DrawRect(GetColor(kFR), mRECT, nullptr, mFrameThickness);
   }
 
-  //  void OnResize() override;
-  //  void OnMouseDblClick(float x, float y, const IMouseMod& mod) override;
-  //  void OnMouseDown(float x, float y, const IMouseMod& mod) override;
+private:
+  bool HasBallistics() const { return mReleasePerSec > 0.f || mPeakHoldMs > 0.f; }
 
-  void OnMsgFromDelegate(int messageTag, int dataSize, const void* pData) override
+  /** Let the levels and the held peaks fall for the time since the last refresh, and stop polling once they have settled */
+  void UpdateBallistics()
   {
-    IByteStream stream(pData, dataSize);
+    const TimePoint now = GetAnimationTime();
+    const float dt = static_cast<float>(Milliseconds(now - mLastUpdate).count() / 1000.);
+    mLastUpdate = now;
 
-    int pos = 0;
-    Data data;
-    pos = stream.Get(&data.nchans, pos);
+    bool changed = false;
+    bool settled = true;
 
-    while(pos < stream.Size())
+    for (int ch = 0; ch < MaxNTracks(); ch++)
     {
-      for (auto i = 0; i < data.nchans; i++) {
-        pos = stream.Get(&data.vals[i], pos);
-        float* pVal = GetTrackData(i);
-        *pVal = Clip(data.vals[i], 0.f, 1.f);
+      float* pVal = GetTrackData(ch);
+
+      if (mReleasePerSec > 0.f && *pVal > 0.f)
+      {
+        *pVal = std::max(*pVal - mReleasePerSec * dt, 0.f);
+        changed = true;
+      }
+
+      if (mPeakHoldMs > 0.f && mPeaks[ch] > *pVal)
+      {
+        if (Milliseconds(now - mPeakTimes[ch]).count() > mPeakHoldMs)
+        {
+          mPeaks[ch] = std::max(mPeaks[ch] - mPeakFallPerSec * dt, *pVal);
+          changed = true;
+        }
+
+        settled = false;
       }
+      else
+        mPeaks[ch] = *pVal;
+
+      if (*pVal > 0.f && mReleasePerSec > 0.f)
+        settled = false;
     }
 
-    SetDirty(false);
+    if (changed)
+      SetDirty(false);
+
+    if (settled)
+      SetPollDirty(false);
   }
+
+  float mReleasePerSec = 0.f;
+  float mPeakHoldMs = 0.f;
+  float mPeakFallPerSec = 0.5f;
+  std::array<float, MAXNC> mPeaks;
+  std::array<TimePoint, MAXNC> mPeakTimes;
+  std::array<IRECT, MAXNC> mFillRects;
+  std::array<IRECT, MAXNC> mPeakRects;
+  TimePoint mLastUpdate;
 };
@@ -16,10 +16,11 @@
  */
 
 #include "IControl.h"
+#include "IPlugDataArray.h"
 
 #define LERP(a,b,f) ((b-a)*f+a)
 
-/** A vectorial multi-slider control
+/** A vectorial multi-slider control. The sliders can edit an IPlugDataArray shared with the processor, see AttachDataArray(), rather than a parameter each
  * @ingroup IControls */
 template <int MAXNC = 1>
 class IVMultiSliderControl : public IVTrackControlBase
@@ -35,6 +36,46 @@ public:
     SetColor(kFG, COLOR_BLACK);
   }
 
+  /** Edit the values of an array shared with the processor, rather than only the control's own track data. Dragging sets the values and publishes them at the end
+   * of each mouse event, and the control redraws just the sliders whose values changed, whether the control or the plug-in changed them, e.g. when a preset is loaded
+   * @param pArray The array, owned by the plug-in, which must outlive the control, or nullptr to detach it */
+  void AttachDataArray(IPlugDataArray<MAXNC>* pArray)
+  {
+    mDataArray = pArray;
+
+    if (mDataArray)
+    {
+      for (int i = 0; i < MaxNTracks(); i++)
+        SetTrackData(i, mDataArray->GetValue(i));
+
+      int startIdx, endIdx;
+      mDataArray->TakeChangedRange(startIdx, endIdx);
+    }
+
+    SetPollDirty(mDataArray != nullptr);
+    SetDirty(false);
+  }
+
+  bool IsDirty() override
+  {
+    int startIdx, endIdx;
+
+    if (mDataArray && mDataArray->TakeChangedRange(startIdx, endIdx))
+    {
+      IRECT area;
+
+      for (int i = startIdx; i < endIdx; i++)
+      {
+        SetTrackData(i, mDataArray->GetValue(i));
+        area = area.Empty() ? mTrackBounds.Get()[i] : area.Union(mTrackBounds.Get()[i]);
+      }
+
+      SetDirtyArea(area);
+    }
+
+    return IControl::IsDirty();
+  }
+
   void SnapToMouse(float x, float y, EDirection direction, IRECT& bounds, float scalar = 1.) override //TODO: fixed for horizontal
   {
     bounds.Constrain(x, y);
@@ -58,7 +99,7 @@ public:
     {
       float* trackValue = GetTrackData(sliderTest);
       *trackValue = mMinTrackValue + (1.f - Clip(yValue, 0.f, 1.f)) * (mMaxTrackValue - mMinTrackValue);
-      OnNewValue(sliderTest, *trackValue);
+      SetNewValue(sliderTest, *trackValue);
 
       mSliderHit = sliderTest;
 
@@ -84,7 +125,7 @@ public:
             trackValue = GetTrackData(i);
             float frac = (float)(i - lowBounds) / float(highBounds-lowBounds);
             *trackValue = LERP(*GetTrackData(lowBounds), *GetTrackData(highBounds), frac);
-            OnNewValue(i, *trackValue);
+            SetNewValue(i, *trackValue);
           }
         }
       }
@@ -95,7 +136,9 @@ public:
       mSliderHit = -1;
     }
 
-    SetDirty();
+    // with an array, IsDirty() marks just the sliders that changed
+    if (!mDataArray)
+      SetDirty();
   }
 
   //  void OnResize() override;
@@ -109,6 +152,7 @@ public:
       mPrevSliderHit = -1;
 
     SnapToMouse(x, y, mDirection, innerBounds);
+    PublishDataArray();
   }
 
   virtual void OnMouseDrag(float x, float y, float dX, float dY, const IMouseMod& mod) override
@@ -116,12 +160,39 @@ public:
     IRECT innerBounds = mRECT.GetPadded(-mOuterPadding);
 
     SnapToMouse(x, y, mDirection, innerBounds);
+    PublishDataArray();
+  }
+
+  // each sample of a fast stroke sets the slider under it, rather than the sliders between two frames being interpolated
+  virtual void OnMouseDragSamples(const IMouseSample* pSamples, int nSamples) override
+  {
+    IRECT innerBounds = mRECT.GetPadded(-mOuterPadding);
+
+    for (int i = 0; i < nSamples; i++)
+      SnapToMouse(pSamples[i].x, pSamples[i].y, mDirection, innerBounds);
+
+    PublishDataArray();
   }
 
   //override to do something when an individual slider is dragged
   virtual void OnNewValue(int trackIdx, float val) {}
 
 protected:
+  void SetNewValue(int trackIdx, float val)
+  {
+    if (mDataArray)
+      mDataArray->SetValue(trackIdx, val);
+
+    OnNewValue(trackIdx, val);
+  }
+
+  void PublishDataArray()
+  {
+    if (mDataArray)
+      mDataArray->Publish();
+  }
+
+  IPlugDataArray<MAXNC>* mDataArray = nullptr;
   int mPrevSliderHit = -1;
   int mSliderHit = -1;
   float mGrain = 0.001f;
@@ -17,8 +17,7 @@
  */
 
 #include "IControl.h"
-#include "IPlugStructs.h"
-#include "IPlugQueue.h"
+#include "ISender.h"
 
 /** Vectorial multichannel capable oscilloscope control
  * @ingroup IControls */
@@ -29,81 +28,11 @@ class IVScopeControl : public IControl
 public:
   static constexpr int kUpdateMessage = 0;
 
-  /* Data packet */
-  struct Data
-  {
-    int nchans = MAXNC;
-    float vals[MAXNC][MAXBUF] = {};
-
-    bool AboveThreshold()
-    {
-      static const float threshold = (float) DBToAmp(-90.);
-
-      float sum = 0.f;
-
-      for(auto c = 0; c < MAXNC; c++)
-      {
-        for(auto s = 0; s < MAXBUF; s++)
-        {
-          sum += vals[c][s];
-        }
-      }
-
-      return std::abs(sum) > threshold;
-    }
-  };
+  /** Data packet */
+  using Data = ISenderData<MAXNC, std::array<float, MAXBUF>>;
 
   /** Used on the DSP side in order to queue sample values and transfer data to low priority thread. */
-  class IVScopeBallistics
-  {
-  public:
-    IVScopeBallistics(int controlTag)
-    : mControlTag(controlTag)
-    {
-    }
-
-    void ProcessBlock(sample** inputs, int nFrames)
-    {
-      for (auto s = 0; s < nFrames; s++)
-      {
-        if(mBufCount == MAXBUF)
-        {
-          if(mPrevAboveThreshold)
-            mQueue.Push(mBuf); // TODO: expensive?
-
-          mPrevAboveThreshold = mBuf.AboveThreshold();
-
-          mBufCount = 0;
-        }
-
-        for (auto c = 0; c < MAXNC; c++)
-        {
-          mBuf.vals[c][mBufCount] = (float) inputs[c][s];
-        }
-
-        mBufCount++;
-      }
-    }
-
-    // this must be called on the main thread - typically in MyPlugin::OnIdle()
-    void TransmitData(IEditorDelegate& dlg)
-    {
-      Data d;
-
-      while(mQueue.ElementsAvailable())
-      {
-        mQueue.Pop(d);
-        dlg.SendControlMsgFromDelegate(mControlTag, kUpdateMessage, sizeof(Data), (void*) &d);
-      }
-    }
-
-  private:
-    Data mBuf;
-    int mControlTag;
-    int mBufCount = 0;
-    IPlugQueue<Data> mQueue {QUEUE_SIZE};
-    bool mPrevAboveThreshold = true;
-  };
+  using IVScopeBallistics = IBufferSender<MAXNC, MAXBUF, QUEUE_SIZE>;
 
   IVScopeControl(IRECT bounds, const char* trackNames = 0, ...)
   : IControl(bounds)
@@ -117,24 +46,17 @@ public:
 
     IRECT r = mRECT.GetPadded(-mPadding);
 
-    const float maxY = (r.H() / 2.f); // y +/- centre
-
     float xPerData = r.W() / (float) MAXBUF;
 
-    for (int c = 0; c < mBuf.nchans; c++)
+    // the last sample is a step short of the right edge
+    r.R = r.L + xPerData * (MAXBUF - 1);
+
+    for (int c = 0; c < mBuf.nChans; c++)
     {
-      float xHi = 0.f;
-      float yHi = mBuf.vals[c][0] * maxY;
-      yHi = Clip(yHi, -maxY, maxY);
-
-      for (int s = 1; s < MAXBUF; s++)
-      {
-        float xLo = xHi, yLo = yHi;
-        xHi = ((float) s * xPerData);
-        yHi = mBuf.vals[c][s] * maxY;
-        yHi = Clip(yHi, -maxY, maxY);
-        g.DrawLine(GetColor(kFG), r.L + xLo, r.MH() - yLo, r.L + xHi, r.MH() - yHi);
-      }
+      for (int s = 0; s < MAXBUF; s++)
+        mPoints[s] = (Clip(mBuf.vals[c][s], -1.f, 1.f) + 1.f) * 0.5f;
+
+      g.DrawData(GetColor(kFG), r, mPoints.data(), MAXBUF);
     }
 
     if (mDrawFrame)
@@ -143,24 +65,17 @@ public:
 
   void OnMsgFromDelegate(int messageTag, int dataSize, const void* pData) override
   {
-    IByteStream stream(pData, dataSize);
+    if (messageTag != kUpdateMessage || dataSize != sizeof(Data))
+      return;
 
-    int pos = stream.Get(&mBuf.nchans, 0);
-
-    while(pos < stream.Size())
-    {
-      for (auto ch = 0; ch < mBuf.nchans; ch++) {
-        for (auto s = 0; s < MAXBUF; s++) {
-          pos = stream.Get(&mBuf.vals[ch][s], pos);
-        }
-      }
-    }
+    mBuf = *static_cast<const Data*>(pData);
 
     SetDirty(false);
   }
 
 private:
   Data mBuf;
+  std::array<float, MAXBUF> mPoints;
   float mPadding = 2.f;
 };
 
@@ -0,0 +1,277 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @ingroup Controls
+ * @copydoc IVSpectrogramControl
+ */
+
+#include <array>
+#include <cstring>
+#include <vector>
+
+#include "IControl.h"
+#include "ISender.h"
+
+/** Vectorial spectrogram, or waterfall, control, showing a history of spectrum frames as a scrolling image, with one column of pixels for each frame, or one row for a waterfall.
+ * The image is a pixel layer, see IGraphics::CreatePixelLayer(). On the path based backends it is a ring: a new frame writes, and on the GPU uploads, only its own column,
+ * and the image is drawn from its oldest column in two stretched blits. Where the drawing can't be clipped to a part of a blit, as with LICE, the image is moved along by a column
+ * in memory for each frame, and drawn in one. A backend that can't write pixels shows the newest frame as a spectrum instead.
+ * Frames are sent from the DSP with an ISender<1, QUEUE_SIZE, std::array<float, NBINS>>, with each bin normalised to 0 to 1, e.g. from a dB range.
+ * ISender::TransmitData() only sends the newest frame for each refresh, so the history advances a column for each frame that the UI receives
+ * @tparam NBINS The number of bins in a frame, the lowest first
+ * @ingroup IControls */
+template <int NBINS = 256>
+class IVSpectrogramControl : public IControl
+                           , public IVectorBase
+{
+public:
+  static constexpr int kUpdateMessage = 0;
+
+  /** Data packet */
+  using Data = ISenderData<1, std::array<float, NBINS>>;
+
+  /** Create a spectrogram control
+   * @param bounds The control's bounds
+   * @param nFrames The number of frames of history shown
+   * @param direction kHorizontal to scroll from right to left with the lowest bin at the bottom, kVertical for a waterfall that scrolls down with the lowest bin on the left */
+  IVSpectrogramControl(IRECT bounds, int nFrames = 256, EDirection direction = kHorizontal)
+  : IControl(bounds)
+  , mNFrames(std::max(nFrames, 2))
+  , mDirection(direction)
+  {
+    AttachIControl(this);
+    mPixels.resize(static_cast<size_t>(mNFrames) * NBINS * 4, 0);
+    mLatest.fill(0.f);
+    SetColorMap(COLOR_BLACK, COLOR_RED, COLOR_YELLOW);
+  }
+
+  /** Set the colors that levels are mapped to, between which they are interpolated. Frames that have already been shown keep their colors
+   * @param low The color of a level of 0
+   * @param mid The color of a level of 0.5
+   * @param high The color of a level of 1 */
+  void SetColorMap(const IColor& low, const IColor& mid, const IColor& high)
+  {
+    for (int i = 0; i < 256; i++)
+    {
+      const float level = i / 255.f;
+      IColor color;
+
+      if (level < 0.5f)
+        IColor::LinearInterpolateBetween(low, mid, color, level * 2.f);
+      else
+        IColor::LinearInterpolateBetween(mid, high, color, (level - 0.5f) * 2.f);
+
+      mColorMap[i] = { static_cast<uint8_t>(color.R), static_cast<uint8_t>(color.G), static_cast<uint8_t>(color.B), static_cast<uint8_t>(color.A) };
+    }
+  }
+
+  /** Clear the history */
+  void Clear()
+  {
+    std::fill(mPixels.begin(), mPixels.end(), 0);
+    mLatest.fill(0.f);
+    mNPending = mNFrames;
+    SetDirty(false);
+  }
+
+  void OnInit() override
+  {
+    // a backend without path support can't clip a blit, so the image is kept in order, which must be chosen before the first frame is written
+    mMoveInMemory = !GetUI()->HasPathSupport();
+  }
+
+  void Draw(IGraphics& g) override
+  {
+    g.FillRect(GetColor(kBG), mRECT);
+
+    const IRECT r = mRECT.GetPadded(-mPadding);
+
+    if (!mRing && !mUnsupported)
+    {
+      mRing = mDirection == kHorizontal ? g.CreatePixelLayer(mNFrames, NBINS) : g.CreatePixelLayer(NBINS, mNFrames);
+      mUnsupported = !mRing;
+      mNPending = mNFrames;
+    }
+
+    if (mRing)
+    {
+      UploadPending(g);
+
+      const IBitmap bitmap = mRing->GetBitmap();
+
+      if (mMoveInMemory)
+        g.DrawFittedBitmap(bitmap, r);
+      else
+      {
+        // the oldest frame is at mHead, the image is drawn twice, from it to the end of the image and then from the start of the image up to it
+        const float step = (mDirection == kHorizontal ? r.W() : r.H()) / mNFrames;
+        const float split = (mNFrames - mHead) * step;
+
+        if (mDirection == kHorizontal)
+        {
+          g.PathClipRegion(IRECT(r.L, r.T, r.L + split, r.B));
+          g.DrawFittedBitmap(bitmap, IRECT(r.L - mHead * step, r.T, r.L + split, r.B));
+          g.PathClipRegion(IRECT(r.L + split, r.T, r.R, r.B));
+          g.DrawFittedBitmap(bitmap, IRECT(r.L + split, r.T, r.R + split, r.B));
+        }
+        else
+        {
+          g.PathClipRegion(IRECT(r.L, r.T, r.R, r.T + split));
+          g.DrawFittedBitmap(bitmap, IRECT(r.L, r.T - mHead * step, r.R, r.T + split));
+          g.PathClipRegion(IRECT(r.L, r.T + split, r.R, r.B));
+          g.DrawFittedBitmap(bitmap, IRECT(r.L, r.T + split, r.R, r.B + split));
+        }
+
+        g.PathClipRegion();
+      }
+    }
+    else
+    {
+      // the newest frame as a spectrum
+      if (mDirection == kHorizontal)
+        g.DrawData(GetColor(kFG), r, mLatest.data(), NBINS);
+      else
+      {
+        std::array<float, NBINS> xPoints;
+
+        for (int b = 0; b < NBINS; b++)
+          xPoints[b] = 1.f - b / (float) (NBINS - 1);
+
+        g.DrawData(GetColor(kFG), r, mLatest.data(), NBINS, xPoints.data());
+      }
+    }
+
+    if (mDrawFrame)
+      g.DrawRect(GetColor(kFR), mRECT, nullptr, mFrameThickness);
+  }
+
+  void OnMsgFromDelegate(int messageTag, int dataSize, const void* pData) override
+  {
+    if (messageTag != kUpdateMessage || dataSize != sizeof(Data))
+      return;
+
+    const std::array<float, NBINS>& frame = static_cast<const Data*>(pData)->vals[0];
+
+    for (int b = 0; b < NBINS; b++)
+      mLatest[b] = Clip(frame[b], 0.f, 1.f);
+
+    if (mMoveInMemory)
+      MoveAndWrite();
+    else
+      WriteToRing();
+
+    mNPending = std::min(mNPending + 1, mNFrames);
+    SetDirty(false);
+  }
+
+private:
+  /** Write the newest frame over the oldest, which becomes the newest, as the head of the ring. A waterfall's ring runs backwards, newest first, so that it is drawn newest at the top */
+  void WriteToRing()
+  {
+    int slot;
+
+    if (mDirection == kHorizontal)
+    {
+      slot = mHead;
+      mHead = (mHead + 1) % mNFrames;
+    }
+    else
+    {
+      mHead = (mHead + mNFrames - 1) % mNFrames;
+      slot = mHead;
+    }
+
+    WriteFrame(slot);
+  }
+
+  /** Move the image along by a frame and write the newest frame at its end, the right or the top */
+  void MoveAndWrite()
+  {
+    if (mDirection == kHorizontal)
+    {
+      const size_t rowBytes = static_cast<size_t>(mNFrames) * 4;
+
+      for (int b = 0; b < NBINS; b++)
+      {
+        uint8_t* pRow = mPixels.data() + b * rowBytes;
+        memmove(pRow, pRow + 4, rowBytes - 4);
+      }
+
+      WriteFrame(mNFrames - 1);
+    }
+    else
+    {
+      const size_t rowBytes = static_cast<size_t>(NBINS) * 4;
+      memmove(mPixels.data() + rowBytes, mPixels.data(), (mNFrames - 1) * rowBytes);
+      WriteFrame(0);
+    }
+  }
+
+  /** Write the colors of the newest frame into a column of the image, or a row for a waterfall */
+  void WriteFrame(int slot)
+  {
+    for (int b = 0; b < NBINS; b++)
+    {
+      const auto& color = mColorMap[static_cast<int>(mLatest[b] * 255.f + 0.5f)];
+      const size_t pixel = mDirection == kHorizontal ? static_cast<size_t>(NBINS - 1 - b) * mNFrames + slot : static_cast<size_t>(slot) * NBINS + b;
+      memcpy(mPixels.data() + pixel * 4, color.data(), 4);
+    }
+  }
+
+  /** Write the frames that have arrived since the last draw to the layer, which for a ring is only their columns, or rows */
+  void UploadPending(IGraphics& g)
+  {
+    if (!mNPending)
+      return;
+
+    const int width = mDirection == kHorizontal ? mNFrames : NBINS;
+    const int height = mDirection == kHorizontal ? NBINS : mNFrames;
+
+    if (mMoveInMemory || mNPending >= mNFrames)
+      g.UpdatePixelLayer(mRing, mPixels.data(), 0, 0, width, height);
+    else
+    {
+      // the pending slots run up to the head for an image, and from it for a waterfall, and may wrap around the end of the ring
+      int first = mDirection == kHorizontal ? (mHead - mNPending + mNFrames) % mNFrames : mHead;
+      int remaining = mNPending;
+
+      while (remaining)
+      {
+        const int n = std::min(remaining, mNFrames - first);
+
+        if (mDirection == kHorizontal)
+          g.UpdatePixelLayer(mRing, mPixels.data(), first, 0, n, height);
+        else
+          g.UpdatePixelLayer(mRing, mPixels.data(), 0, first, width, n);
+
+        remaining -= n;
+        first = 0;
+      }
+    }
+
+    mNPending = 0;
+  }
+
+  const int mNFrames;
+  const EDirection mDirection;
+  std::vector<uint8_t> mPixels; // the image, 8 bit RGBA
+  std::array<std::array<uint8_t, 4>, 256> mColorMap;
+  std::array<float, NBINS> mLatest;
+  ILayerPtr mRing;
+  int mHead = 0; // the slot of the oldest frame in the ring, or the newest for a waterfall
+  int mNPending = 0; // the frames written since the last upload
+  bool mUnsupported = false;
+  bool mMoveInMemory = false;
+  float mPadding = 2.f;
+};
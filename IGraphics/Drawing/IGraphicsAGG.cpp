@@ -15,7 +15,7 @@
 
 // Fonts
 
-static StaticStorage<IFontData> sFontCache;
+static StaticStorage<IFontData> sFontCache {"AGG fonts"};
 
 // Utility
 
@@ -236,6 +236,7 @@ bool IGraphicsAGG::LoadAPIFont(const char* fontID, const PlatformFontPtr& font)
 
   if (data->IsValid() && SetFont(fontID, data.get()))
   {
+    mTextLines.Clear();
     storage.Add(data.release(), fontID);
     return true;
   }
@@ -258,6 +259,9 @@ bool CheckTransform(const agg::trans_affine& mtx)
 
 void IGraphicsAGG::DrawBitmap(const IBitmap& bitmap, const IRECT& dest, int srcX, int srcY, const IBlend* pBlend)
 {
+  if (mDisplayList)
+    mDisplayList->AddBitmap(bitmap, dest, srcX, srcY, pBlend);
+  
   bool preMultiplied = static_cast<AGGBitmap*>(bitmap.GetAPIBitmap())->IsPreMultiplied();
   IRECT bounds = mClipRECT.Empty() ? dest : mClipRECT.Intersect(dest);
   bounds.Scale(GetBackingPixelScale());
@@ -302,6 +306,9 @@ void IGraphicsAGG::DrawBitmap(const IBitmap& bitmap, const IRECT& dest, int srcX
 
 void IGraphicsAGG::PathArc(float cx, float cy, float r, float aMin, float aMax)
 {
+  if (mDisplayList)
+    mDisplayList->AddPathArc(cx, cy, r, aMin, aMax);
+  
   agg::path_storage transformedPath;
     
   agg::arc arc(cx, cy, r, r, DegToRad(aMin - 90.f), DegToRad(aMax - 90.f));
@@ -315,6 +322,9 @@ void IGraphicsAGG::PathArc(float cx, float cy, float r, float aMin, float aMax)
 
 void IGraphicsAGG::PathMoveTo(float x, float y)
 {
+  if (mDisplayList)
+    mDisplayList->AddPathMoveTo(x, y);
+  
   double xd = x;
   double yd = y;
   
@@ -324,6 +334,9 @@ void IGraphicsAGG::PathMoveTo(float x, float y)
 
 void IGraphicsAGG::PathLineTo(float x, float y)
 {
+  if (mDisplayList)
+    mDisplayList->AddPathLineTo(x, y);
+  
   double xd = x;
   double yd = y;
 
@@ -333,6 +346,9 @@ void IGraphicsAGG::PathLineTo(float x, float y)
 
 void IGraphicsAGG::PathCurveTo(float x1, float y1, float x2, float y2, float x3, float y3)
 {
+  if (mDisplayList)
+    mDisplayList->AddPathCurveTo(x1, y1, x2, y2, x3, y3);
+  
   double x1d = x1;
   double y1d = y1;
   double x2d = x2;
@@ -373,6 +389,9 @@ void StrokeOptions(StrokeType& strokes, double thickness, const IStrokeOptions&
 
 void IGraphicsAGG::PathStroke(const IPattern& pattern, float thickness, const IStrokeOptions& options, const IBlend* pBlend)
 {
+  if (mDisplayList)
+    mDisplayList->AddPathStroke(pattern, thickness, options, pBlend);
+  
   typedef agg::conv_curve<agg::path_storage>    CPType;
   typedef agg::conv_transform<CPType>           S1Type;
   typedef agg::conv_stroke<S1Type>              S2Type;
@@ -421,6 +440,9 @@ void IGraphicsAGG::PathStroke(const IPattern& pattern, float thickness, const IS
 
 void IGraphicsAGG::PathFill(const IPattern& pattern, const IFillOptions& options, const IBlend* pBlend)
 {
+  if (mDisplayList)
+    mDisplayList->AddPathFill(pattern, options, pBlend);
+  
   agg::conv_curve<agg::path_storage> curvedPath(mPath);
   mRasterizer.Rasterize(curvedPath, pattern, AGGBlendMode(pBlend), BlendWeight(pBlend), options.mFillRule);
   if (!options.mPreserve)
@@ -577,6 +599,28 @@ void IGraphicsAGG::CalculateTextLines(WDL_TypedBuf<LineInfo>* pLines, const IREC
   }
 }
 
+const std::vector<IGraphicsAGG::LineInfo>& IGraphicsAGG::GetTextLines(const IText& text, const IRECT& bounds, const char* str)
+{
+  // the lines only depend on the advances of the glyphs at the size, as long as they aren't wrapped to the bounds
+  std::string key(text.mFont);
+  key += '\n';
+  key += std::to_string(text.mSize);
+  key += '\n';
+  key += str;
+  
+  const std::vector<LineInfo>* pLines = mTextLines.Find(key);
+  
+  if (!pLines)
+  {
+    WDL_TypedBuf<LineInfo> lines;
+    CalculateTextLines(&lines, bounds, str, mFontManager);
+    mTextLines.Add(key, std::vector<LineInfo>(lines.Get(), lines.Get() + lines.GetSize()));
+    pLines = mTextLines.Find(key);
+  }
+  
+  return *pLines;
+}
+
 bool IGraphicsAGG::SetFont(const char* fontID, IFontData* pFont)
 {
   agg::glyph_rendering render = agg::glyph_ren_outline;
@@ -596,7 +640,7 @@ bool IGraphicsAGG::DoDrawMeasureText(const IText& text, const char* str, IRECT&
 
   mFontContour.width(-weight * (text.mSize * 0.05));
   
-  StaticStorage<IFontData>::Accessor storage(sFontCache);
+  StaticStorage<IFontData>::SharedAccessor storage(sFontCache);
   IFontData* pFont = storage.Find(text.mFont);
   
   if (!pFont || !SetFont(text.mFont, pFont))
@@ -609,9 +653,8 @@ bool IGraphicsAGG::DoDrawMeasureText(const IText& text, const char* str, IRECT&
   mFontEngine.width(text.mSize);
   mFontEngine.flip_y(true);
 
-  WDL_TypedBuf<LineInfo> lines;
-  CalculateTextLines(&lines, bounds, str, mFontManager);
-  LineInfo * pLines = lines.Get();
+  const std::vector<LineInfo>& lines = GetTextLines(text, bounds, str);
+  const LineInfo* pLines = lines.data();
   
   double x = bounds.L;
   double y = bounds.T + (text.mSize);
@@ -627,15 +670,15 @@ bool IGraphicsAGG::DoDrawMeasureText(const IText& text, const char* str, IRECT&
   {
     double width = 0.0;
     
-    for (int i = 0; i < lines.GetSize(); ++i, ++pLines)
+    for (int i = 0; i < (int) lines.size(); ++i, ++pLines)
       width = std::max(width, pLines->mWidth);
     
-    bounds.B = bounds.T + lines.GetSize() * text.mSize;
+    bounds.B = bounds.T + lines.size() * text.mSize;
     bounds.R = bounds.L + width;
   }
   else
   {
-    for (int i = 0; i < lines.GetSize(); ++i, ++pLines)
+    for (int i = 0; i < (int) lines.size(); ++i, ++pLines)
     {
       switch (text.mAlign)
       {
@@ -20,8 +20,13 @@
 
  */
 
+#include <string>
+#include <vector>
+
 #include "IGraphicsPathBase.h"
 #include "IGraphicsAGG_src.h"
+#include "IGraphicsAGG_pixfmt.h"
+#include "ILRUCache.h"
 
 #include "heapbuf.h"
 
@@ -89,11 +94,11 @@ public:
   typedef agg::span_interpolator_linear<> InterpolatorType;
   // Pre-multiplied source types
   typedef agg::comp_op_adaptor_rgba_pre<agg::rgba8, PixelOrder> BlenderPreType;
-  typedef agg::pixfmt_custom_blend_rgba<BlenderPreType, agg::rendering_buffer> PixfmtPreType;
+  typedef pixfmt_simd_rgba<agg::pixfmt_custom_blend_rgba<BlenderPreType, agg::rendering_buffer>, true> PixfmtPreType;
   typedef agg::renderer_base <PixfmtPreType> RenbasePreType;
    // Non pre-multiplied source types
   typedef agg::comp_op_adaptor_rgba<agg::rgba8, PixelOrder> BlenderType;
-  typedef agg::pixfmt_custom_blend_rgba<BlenderType, agg::rendering_buffer> PixfmtType;
+  typedef pixfmt_simd_rgba<agg::pixfmt_custom_blend_rgba<BlenderType, agg::rendering_buffer>, false> PixfmtType;
   typedef agg::renderer_base <PixfmtType> RenbaseType;
   // Image bitmap types
   typedef agg::image_accessor_clone<PixfmtType> imgSourceType;
@@ -148,8 +153,7 @@ public:
     {
       typedef agg::renderer_scanline_aa<RenbaseType, SpanAllocatorType, CustomSpanGeneratorType> RendererType;
       
-      SpanAllocatorType spanAllocator;
-      RendererType renderer(mRenBase, spanAllocator, spanGenerator);
+      RendererType renderer(mRenBase, mSpanAllocator, spanGenerator);
       Render(renderer, op);
     }
     
@@ -227,10 +231,9 @@ public:
     template <typename RendererType>
     void Render(RendererType& renderer, agg::comp_op_e op)
     {
-      agg::scanline_p8 scanline;
       mPixf.comp_op(op);
       mPixfPre.comp_op(op);
-      agg::render_scanlines(mRasterizer, scanline, renderer);
+      agg::render_scanlines(mRasterizer, mScanline, renderer);
     }
     
     template <typename PixSourceType, typename RenderBaseType>
@@ -241,11 +244,10 @@ public:
       typedef alpha_span_generator<FilterType> CustomSpanGeneratorType;
       typedef agg::renderer_scanline_aa<RenderBaseType, SpanAllocatorType, CustomSpanGeneratorType> RendererType;
       
-      SpanAllocatorType spanAllocator;
       InterpolatorType interpolator(srcMtx);
       ImgSrcType imgSrc(src);
       CustomSpanGeneratorType spanGenerator(imgSrc, interpolator, cover);
-      RendererType renderer(renderbase, spanAllocator, spanGenerator);
+      RendererType renderer(renderbase, mSpanAllocator, spanGenerator);
       
       Render(renderer, op);
     }
@@ -255,7 +257,10 @@ public:
     PixfmtType mPixf;
     RenbasePreType mRenBasePre;
     PixfmtPreType mPixfPre;
+    // kept from one path to the next, so that their buffers only grow when a wider span than any before is drawn
     agg::rasterizer_scanline_aa<> mRasterizer;
+    agg::scanline_p8 mScanline;
+    SpanAllocatorType mSpanAllocator;
   };
 
   IGraphicsAGG(IGEditorDelegate& dlg, int w, int h, int fps, float scale);
@@ -265,8 +270,21 @@ public:
 
   void DrawBitmap(const IBitmap& bitmap, const IRECT& dest, int srcX, int srcY, const IBlend* pBlend) override;
 
-  void PathClear() override { mPath.remove_all(); }
-  void PathClose() override { mPath.close_polygon(); }
+  void PathClear() override
+  {
+    if (mDisplayList)
+      mDisplayList->AddPathClear();
+    
+    mPath.remove_all();
+  }
+  
+  void PathClose() override
+  {
+    if (mDisplayList)
+      mDisplayList->AddPathClose();
+    
+    mPath.close_polygon();
+  }
 
   void PathArc(float cx, float cy, float r, float aMin, float aMax) override;
 
@@ -307,6 +325,9 @@ private:
 
   void CalculateTextLines(WDL_TypedBuf<LineInfo>* pLines, const IRECT& bounds, const char* str, FontManagerType& manager);
 
+  /** @return The lines of a string from the cache, calculating them first if needed. They are valid until the next call */
+  const std::vector<LineInfo>& GetTextLines(const IText& text, const IRECT& bounds, const char* str);
+
   double XTranslate()  { return mLayers.empty() ? 0 : -mLayers.top()->Bounds().L; }
   double YTranslate()  { return mLayers.empty() ? 0 : -mLayers.top()->Bounds().T; }
   
@@ -323,6 +344,8 @@ private:
   IRECT mClipRECT;
   FontEngineType mFontEngine;
   FontManagerType mFontManager;
+  /** The lines of recently drawn or measured strings, keyed by font, size and string */
+  ILRUCache<std::string, std::vector<LineInfo>> mTextLines { 256 };
   agg::rendering_buffer mRenBuf;
   agg::path_storage mPath;
   agg::trans_affine mTransform;
@@ -0,0 +1,265 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @brief A pixel format for IGraphicsAGG that blends source over spans with SIMD
+ *
+ * pixfmt_custom_blend_rgba looks up the compositing operator for every pixel it blends, which makes it several times slower than a pixel format for one operator.
+ * pixfmt_simd_rgba wraps it, and blends solid spans, the spans of gradients and images, and bitmaps drawn with blend_from() two pixels at a time with SSE2 or NEON
+ * when the operator is source over, which is what almost everything is drawn with. Other operators, and targets without either, go through pixfmt_custom_blend_rgba.
+ * The arithmetic is that of AGG's comp_op_rgba_src_over, so the results are the same to the bit, except that a pre-multiplied source with a channel above its alpha saturates rather than wrapping
+ */
+
+#include <cstring>
+#include <type_traits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #include <emmintrin.h>
+  #define IGRAPHICS_AGG_SSE2
+#elif defined(__aarch64__) || defined(_M_ARM64)
+  #include <arm_neon.h>
+  #define IGRAPHICS_AGG_NEON
+#endif
+
+#if defined IGRAPHICS_AGG_SSE2 || defined IGRAPHICS_AGG_NEON
+
+/** Two pixels widened to 16 bit lanes, in the channel order of the pixel format */
+template <class Order>
+struct pixfmt_simd_ops
+{
+  // where each lane of a pixel in Order comes from in an rgba8, which is stored r, g, b, a
+  static constexpr int Source(int lane) { return Order::R == lane ? 0 : Order::G == lane ? 1 : Order::B == lane ? 2 : 3; }
+
+#if defined IGRAPHICS_AGG_SSE2
+  typedef __m128i V;
+
+  static constexpr int kAlphaShuffle = _MM_SHUFFLE(Order::A, Order::A, Order::A, Order::A);
+  static constexpr int kColorShuffle = _MM_SHUFFLE(Source(3), Source(2), Source(1), Source(0));
+
+  static V Load2(const agg::int8u* p) { return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)), _mm_setzero_si128()); }
+  static V Load1(const agg::int8u* p) { int x; memcpy(&x, p, 4); return _mm_unpacklo_epi8(_mm_cvtsi32_si128(x), _mm_setzero_si128()); }
+  static void Store2(agg::int8u* p, V v) { _mm_storel_epi64(reinterpret_cast<__m128i*>(p), _mm_packus_epi16(v, v)); }
+  static void Store1(agg::int8u* p, V v) { const int x = _mm_cvtsi128_si32(_mm_packus_epi16(v, v)); memcpy(p, &x, 4); }
+  static V Splat(int x) { return _mm_set1_epi16((short) x); }
+  static V SplatHalves(int lo, int hi) { return _mm_set_epi16((short) hi, (short) hi, (short) hi, (short) hi, (short) lo, (short) lo, (short) lo, (short) lo); }
+  static V Add(V a, V b) { return _mm_add_epi16(a, b); }
+  static V Sub(V a, V b) { return _mm_sub_epi16(a, b); }
+  static V Mul(V a, V b) { return _mm_mullo_epi16(a, b); }
+  static V Shr8(V a) { return _mm_srli_epi16(a, 8); }
+  static V Alpha(V a) { return _mm_shufflehi_epi16(_mm_shufflelo_epi16(a, kAlphaShuffle), kAlphaShuffle); }
+  static V ColorToOrder(V a) { return _mm_shufflehi_epi16(_mm_shufflelo_epi16(a, kColorShuffle), kColorShuffle); }
+  static V AlphaMask() { return _mm_set_epi16(Order::A == 3 ? -1 : 0, Order::A == 2 ? -1 : 0, Order::A == 1 ? -1 : 0, Order::A == 0 ? -1 : 0, Order::A == 3 ? -1 : 0, Order::A == 2 ? -1 : 0, Order::A == 1 ? -1 : 0, Order::A == 0 ? -1 : 0); }
+  static V Select(V mask, V a, V b) { return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b)); }
+#else
+  typedef uint16x8_t V;
+
+  static V Load2(const agg::int8u* p) { return vmovl_u8(vld1_u8(p)); }
+  static V Load1(const agg::int8u* p) { uint32_t x; memcpy(&x, p, 4); return vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(x))); }
+  static void Store2(agg::int8u* p, V v) { vst1_u8(p, vqmovn_u16(v)); }
+  static void Store1(agg::int8u* p, V v) { const uint32_t x = vget_lane_u32(vreinterpret_u32_u8(vqmovn_u16(v)), 0); memcpy(p, &x, 4); }
+  static V Splat(int x) { return vdupq_n_u16((uint16_t) x); }
+  static V SplatHalves(int lo, int hi) { return vcombine_u16(vdup_n_u16((uint16_t) lo), vdup_n_u16((uint16_t) hi)); }
+  static V Add(V a, V b) { return vaddq_u16(a, b); }
+  static V Sub(V a, V b) { return vsubq_u16(a, b); }
+  static V Mul(V a, V b) { return vmulq_u16(a, b); }
+  static V Shr8(V a) { return vshrq_n_u16(a, 8); }
+  static V Alpha(V a) { return vcombine_u16(vdup_lane_u16(vget_low_u16(a), Order::A), vdup_lane_u16(vget_high_u16(a), Order::A)); }
+  static V ColorToOrder(V a)
+  {
+    const uint8_t index[16] = {ByteOf(0, 0), ByteOf(0, 1), ByteOf(1, 0), ByteOf(1, 1), ByteOf(2, 0), ByteOf(2, 1), ByteOf(3, 0), ByteOf(3, 1),
+                               ByteOf(4, 0), ByteOf(4, 1), ByteOf(5, 0), ByteOf(5, 1), ByteOf(6, 0), ByteOf(6, 1), ByteOf(7, 0), ByteOf(7, 1)};
+    return vreinterpretq_u16_u8(vqtbl1q_u8(vreinterpretq_u8_u16(a), vld1q_u8(index)));
+  }
+  static constexpr uint8_t ByteOf(int lane, int byte) { return (uint8_t) (((lane & 4) + Source(lane & 3)) * 2 + byte); }
+  static V AlphaMask()
+  {
+    const uint16_t mask[8] = {Order::A == 0 ? 0xFFFF : 0, Order::A == 1 ? 0xFFFF : 0, Order::A == 2 ? 0xFFFF : 0, Order::A == 3 ? 0xFFFF : 0,
+                              Order::A == 0 ? 0xFFFF : 0, Order::A == 1 ? 0xFFFF : 0, Order::A == 2 ? 0xFFFF : 0, Order::A == 3 ? 0xFFFF : 0};
+    return vld1q_u16(mask);
+  }
+  static V Select(V mask, V a, V b) { return vbslq_u16(mask, a, b); }
+#endif
+
+  /** The colour channels times alpha, as comp_op_adaptor_rgba does for sources that aren't pre-multiplied */
+  static V PreMultiply(V s, V alphaMask)
+  {
+    return Select(alphaMask, s, Shr8(Add(Mul(s, Alpha(s)), Splat(255))));
+  }
+
+  /** comp_op_rgba_src_over::blend_pix() for a pre-multiplied source s with a coverage of 0-255 in each half */
+  static V SourceOver(V d, V s, V cover, V alphaMask)
+  {
+    const V k255 = Splat(255);
+    s = Shr8(Add(Mul(s, cover), k255)); // as AGG for a coverage under 255, and leaves s as it is at 255
+    const V sa = Alpha(s);
+    const V rgb = Add(s, Shr8(Add(Mul(d, Sub(k255, sa)), k255)));
+    const V a = Sub(Add(sa, d), Shr8(Add(Mul(sa, d), k255)));
+    return Select(alphaMask, a, rgb);
+  }
+};
+
+/** A pixfmt_custom_blend_rgba that blends with SIMD when its operator is agg::comp_op_src_over
+ * @tparam PixFmt The pixfmt_custom_blend_rgba
+ * @tparam PreMultipliedSource \c true if it blends with comp_op_adaptor_rgba_pre, whose sources are pre-multiplied */
+template <class PixFmt, bool PreMultipliedSource>
+class pixfmt_simd_rgba : public PixFmt
+{
+public:
+  typedef typename PixFmt::color_type color_type;
+  typedef typename PixFmt::order_type order_type;
+  typedef pixfmt_simd_ops<order_type> Ops;
+  typedef typename Ops::V V;
+
+  static_assert(sizeof(color_type) == 4, "pixfmt_simd_rgba blends 8 bit RGBA");
+
+  pixfmt_simd_rgba() {}
+  explicit pixfmt_simd_rgba(agg::rendering_buffer& rb) : PixFmt(rb) {}
+
+  void blend_hline(int x, int y, unsigned len, const color_type& c, agg::int8u cover)
+  {
+    if (this->comp_op() != agg::comp_op_src_over)
+      return PixFmt::blend_hline(x, y, len, c, cover);
+
+    agg::int8u* p = this->row_ptr(y) + (x << 2);
+
+    if (c.a == 255 && cover == 255)
+      return Fill(p, len, c);
+
+    const V alphaMask = Ops::AlphaMask();
+    const V s = SolidSource(c, alphaMask);
+    const V coverV = Ops::Splat(cover);
+    unsigned i = 0;
+
+    for (; i + 2 <= len; i += 2, p += 8)
+      Ops::Store2(p, Ops::SourceOver(Ops::Load2(p), s, coverV, alphaMask));
+
+    if (i < len)
+      Ops::Store1(p, Ops::SourceOver(Ops::Load1(p), s, coverV, alphaMask));
+  }
+
+  void blend_solid_hspan(int x, int y, unsigned len, const color_type& c, const agg::int8u* covers)
+  {
+    if (this->comp_op() != agg::comp_op_src_over)
+      return PixFmt::blend_solid_hspan(x, y, len, c, covers);
+
+    agg::int8u* p = this->row_ptr(y) + (x << 2);
+    const V alphaMask = Ops::AlphaMask();
+    const V s = SolidSource(c, alphaMask);
+    const agg::int32u opaque = Pixel(c);
+    unsigned i = 0;
+
+    for (; i + 2 <= len; i += 2, p += 8)
+    {
+      // the inside of a shape, where the span is fully covered, is mostly what is drawn
+      if (c.a == 255 && (covers[i] & covers[i + 1]) == 255)
+      {
+        memcpy(p, &opaque, 4);
+        memcpy(p + 4, &opaque, 4);
+      }
+      else
+        Ops::Store2(p, Ops::SourceOver(Ops::Load2(p), s, Ops::SplatHalves(covers[i], covers[i + 1]), alphaMask));
+    }
+
+    if (i < len)
+      Ops::Store1(p, Ops::SourceOver(Ops::Load1(p), s, Ops::Splat(covers[i]), alphaMask));
+  }
+
+  void blend_color_hspan(int x, int y, unsigned len, const color_type* colors, const agg::int8u* covers, agg::int8u cover)
+  {
+    if (this->comp_op() != agg::comp_op_src_over)
+      return PixFmt::blend_color_hspan(x, y, len, colors, covers, cover);
+
+    agg::int8u* p = this->row_ptr(y) + (x << 2);
+    const agg::int8u* pSrc = reinterpret_cast<const agg::int8u*>(colors);
+    const V alphaMask = Ops::AlphaMask();
+    const V coverV = Ops::Splat(cover);
+    unsigned i = 0;
+
+    for (; i + 2 <= len; i += 2, p += 8)
+    {
+      const V s = Source(Ops::ColorToOrder(Ops::Load2(pSrc + (i << 2))), alphaMask);
+      Ops::Store2(p, Ops::SourceOver(Ops::Load2(p), s, covers ? Ops::SplatHalves(covers[i], covers[i + 1]) : coverV, alphaMask));
+    }
+
+    if (i < len)
+    {
+      const V s = Source(Ops::ColorToOrder(Ops::Load1(pSrc + (i << 2))), alphaMask);
+      Ops::Store1(p, Ops::SourceOver(Ops::Load1(p), s, covers ? Ops::Splat(covers[i]) : coverV, alphaMask));
+    }
+  }
+
+  template <class SrcPixFmt>
+  void blend_from(const SrcPixFmt& from, int xdst, int ydst, int xsrc, int ysrc, unsigned len, agg::int8u cover)
+  {
+    const agg::int8u* pSrc = from.row_ptr(ysrc);
+    agg::int8u* p = this->row_ptr(ydst);
+
+    // a copy within the same bitmap may overlap, and has to go the right way along the row
+    if (this->comp_op() != agg::comp_op_src_over || !std::is_same<typename SrcPixFmt::order_type, order_type>::value || !pSrc || pSrc == p)
+      return PixFmt::blend_from(from, xdst, ydst, xsrc, ysrc, len, cover);
+
+    pSrc += xsrc << 2;
+    p += xdst << 2;
+
+    const V alphaMask = Ops::AlphaMask();
+    const V coverV = Ops::Splat(cover);
+    unsigned i = 0;
+
+    for (; i + 2 <= len; i += 2, p += 8, pSrc += 8)
+      Ops::Store2(p, Ops::SourceOver(Ops::Load2(p), Source(Ops::Load2(pSrc), alphaMask), coverV, alphaMask));
+
+    if (i < len)
+      Ops::Store1(p, Ops::SourceOver(Ops::Load1(p), Source(Ops::Load1(pSrc), alphaMask), coverV, alphaMask));
+  }
+
+private:
+  static V Source(V s, V alphaMask) { return PreMultipliedSource ? s : Ops::PreMultiply(s, alphaMask); }
+
+  static agg::int32u Pixel(const color_type& c)
+  {
+    agg::int8u p[4];
+    p[order_type::R] = c.r;
+    p[order_type::G] = c.g;
+    p[order_type::B] = c.b;
+    p[order_type::A] = c.a;
+    agg::int32u x;
+    memcpy(&x, p, 4);
+    return x;
+  }
+
+  static V SolidSource(const color_type& c, V alphaMask)
+  {
+    const agg::int32u x[2] = {Pixel(c), Pixel(c)};
+    return Source(Ops::Load2(reinterpret_cast<const agg::int8u*>(x)), alphaMask);
+  }
+
+  static void Fill(agg::int8u* p, unsigned len, const color_type& c)
+  {
+    const agg::int32u x = Pixel(c);
+
+    for (unsigned i = 0; i < len; i++, p += 4)
+      memcpy(p, &x, 4);
+  }
+};
+
+#else
+
+template <class PixFmt, bool PreMultipliedSource>
+class pixfmt_simd_rgba : public PixFmt
+{
+public:
+  pixfmt_simd_rgba() {}
+  explicit pixfmt_simd_rgba(agg::rendering_buffer& rb) : PixFmt(rb) {}
+};
+
+#endif
@@ -13,6 +13,7 @@
 #include "png.h"
 
 #include "IGraphicsCairo.h"
+#include "IPlugResourceArchive.h"
 #include "ITextEntryControl.h"
 
 struct CairoFont
@@ -41,6 +42,7 @@ struct CairoPlatformFont : CairoFont
   CairoPlatformFont(const void* fontRef) : CairoFont(cairo_win32_font_face_create_for_hfont((HFONT) fontRef))
   {}
 };
+#endif
 
 class PNGStream
 {
@@ -65,9 +67,8 @@ private:
   const uint8_t* mData;
   int mSize;
 };
-#endif
 
-static StaticStorage<CairoFont> sFontCache;
+static StaticStorage<CairoFont> sFontCache {"Cairo fonts"};
 
 CairoBitmap::CairoBitmap(cairo_surface_t* pSurface, int scale, float drawScale)
 {
@@ -78,11 +79,14 @@ CairoBitmap::CairoBitmap(cairo_surface_t* pSurface, int scale, float drawScale)
   SetBitmap(pSurface, width, height, scale, drawScale);
 }
 
-CairoBitmap::CairoBitmap(cairo_surface_t* pSurfaceType, int width, int height, int scale, float drawScale)
+CairoBitmap::CairoBitmap(cairo_surface_t* pSurfaceType, int width, int height, int scale, float drawScale, std::shared_ptr<CairoSurfacePool> pool)
+: mPool(std::move(pool))
 {
   cairo_surface_t* pSurface;
-    
-  if (pSurfaceType)
+  
+  if (mPool)
+    pSurface = mPool->Acquire(pSurfaceType, width, height);
+  else if (pSurfaceType)
     pSurface = cairo_surface_create_similar_image(pSurfaceType, CAIRO_FORMAT_ARGB32, width, height);
   else
     pSurface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
@@ -94,7 +98,78 @@ CairoBitmap::CairoBitmap(cairo_surface_t* pSurfaceType, int width, int height, i
   
 CairoBitmap::~CairoBitmap()
 {
-  cairo_surface_destroy(GetBitmap());
+  if (mPool)
+    mPool->Release(GetBitmap());
+  else
+    cairo_surface_destroy(GetBitmap());
+}
+
+#pragma mark -
+
+CairoSurfacePool::~CairoSurfacePool()
+{
+  Clear();
+}
+
+cairo_surface_t* CairoSurfacePool::Acquire(cairo_surface_t* pSurfaceType, int width, int height)
+{
+  for (auto it = mSurfaces.rbegin(); it != mSurfaces.rend(); ++it)
+  {
+    cairo_surface_t* pSurface = *it;
+    
+    if (cairo_image_surface_get_width(pSurface) == width && cairo_image_surface_get_height(pSurface) == height)
+    {
+      mSurfaces.erase(std::next(it).base());
+      
+      cairo_t* pContext = cairo_create(pSurface);
+      cairo_set_operator(pContext, CAIRO_OPERATOR_CLEAR);
+      cairo_paint(pContext);
+      cairo_destroy(pContext);
+      
+      return pSurface;
+    }
+  }
+  
+  if (pSurfaceType)
+    return cairo_surface_create_similar_image(pSurfaceType, CAIRO_FORMAT_ARGB32, width, height);
+  else
+    return cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+}
+
+void CairoSurfacePool::Release(cairo_surface_t* pSurface)
+{
+  // a surface that something else still holds a reference to, such as a pattern, can't be cleared for another layer
+  if (!pSurface || cairo_surface_status(pSurface) != CAIRO_STATUS_SUCCESS || cairo_surface_get_reference_count(pSurface) != 1)
+  {
+    cairo_surface_destroy(pSurface);
+    return;
+  }
+  
+  if (static_cast<int>(mSurfaces.size()) >= kMaxSurfaces)
+  {
+    cairo_surface_destroy(mSurfaces.front());
+    mSurfaces.erase(mSurfaces.begin());
+  }
+  
+  mSurfaces.push_back(pSurface);
+}
+
+void CairoSurfacePool::Clear()
+{
+  for (cairo_surface_t* pSurface : mSurfaces)
+    cairo_surface_destroy(pSurface);
+  
+  mSurfaces.clear();
+}
+
+int64_t CairoSurfacePool::GetBytes() const
+{
+  int64_t bytes = 0;
+  
+  for (cairo_surface_t* pSurface : mSurfaces)
+    bytes += static_cast<int64_t>(cairo_image_surface_get_stride(pSurface)) * cairo_image_surface_get_height(pSurface);
+  
+  return bytes;
 }
 
 #pragma mark -
@@ -143,10 +218,33 @@ IGraphicsCairo::~IGraphicsCairo()
   // N.B. calls through to destroy context and surface
   
   UpdateCairoMainSurface(nullptr);
+  mPatternCache.Clear();
+  mSurfacePool->Clear();
+}
+
+void IGraphicsCairo::ReportDrawingMemory(IMemoryReport& report)
+{
+  // the Windows surface is allocated in steps, elsewhere the surface is the platform's and its size is estimated
+  if (mSurfaceWidth > 0)
+    report.Add(kMemoryGraphics, "Backing surface", static_cast<int64_t>(mSurfaceWidth) * mSurfaceHeight * 4);
+  else
+    IGraphics::ReportDrawingMemory(report);
+  
+  report.Add(kMemoryGraphics, "Layer pool", mSurfacePool->GetBytes());
+  report.Add(kMemoryGraphics, "Gradients", 0, static_cast<int>(mPatternCache.GetSize()));
 }
 
 void IGraphicsCairo::DrawResize()
 {
+#ifdef OS_WIN
+  // keep the surface while the new size is within the same step, only its device scale may have changed
+  if (mSurface && MainSurfaceSize(WindowWidth() * GetScreenScale()) == mSurfaceWidth && MainSurfaceSize(WindowHeight() * GetScreenScale()) == mSurfaceHeight)
+  {
+    cairo_surface_set_device_scale(mSurface, GetBackingPixelScale(), GetBackingPixelScale());
+    UpdateCairoContext();
+    return;
+  }
+#endif
   SetPlatformContext(nullptr);
 #ifdef OS_WIN
   HWND window = static_cast<HWND>(GetWindow());
@@ -173,7 +271,14 @@ APIBitmap* IGraphicsCairo::LoadAPIBitmap(const char* fileNameOrResID, int scale,
   }
   else
 #endif
-  if (location == EResourceLocation::kAbsolutePath)
+  if (location == EResourceLocation::kPackedArchive)
+  {
+    int size = 0;
+    const void* pData = IPlugResourceArchive::Get().Find(fileNameOrResID, size);
+    PNGStream reader(reinterpret_cast<const uint8_t *>(pData), size);
+    pSurface = cairo_image_surface_create_from_png_stream(&PNGStream::Read, &reader);
+  }
+  else if (location == EResourceLocation::kAbsolutePath)
     pSurface = cairo_image_surface_create_from_png(fileNameOrResID);
 
   assert(!pSurface || cairo_surface_status(pSurface) == CAIRO_STATUS_SUCCESS);
@@ -183,7 +288,7 @@ APIBitmap* IGraphicsCairo::LoadAPIBitmap(const char* fileNameOrResID, int scale,
 
 APIBitmap* IGraphicsCairo::CreateAPIBitmap(int width, int height, int scale, double drawScale)
 {
-  return new CairoBitmap(mSurface, width, height, scale, drawScale);
+  return new CairoBitmap(mSurface, width, height, scale, drawScale, mSurfacePool);
 }
 
 bool IGraphicsCairo::BitmapExtSupported(const char* ext)
@@ -264,6 +369,9 @@ void IGraphicsCairo::ApplyShadowMask(ILayerPtr& layer, RawBitmapData& mask, cons
 
 void IGraphicsCairo::DrawBitmap(const IBitmap& bitmap, const IRECT& dest, int srcX, int srcY, const IBlend* pBlend)
 {
+  if (mDisplayList)
+    mDisplayList->AddBitmap(bitmap, dest, srcX, srcY, pBlend);
+  
   const double scale = GetScreenScale() / (bitmap.GetScale() * bitmap.GetDrawScale());
 
   cairo_save(mContext);
@@ -278,37 +386,58 @@ void IGraphicsCairo::DrawBitmap(const IBitmap& bitmap, const IRECT& dest, int sr
 
 void IGraphicsCairo::PathClear()
 {
+  if (mDisplayList)
+    mDisplayList->AddPathClear();
+  
   if (mContext)
     cairo_new_path(mContext);
 }
 
 void IGraphicsCairo::PathClose()
 {
+  if (mDisplayList)
+    mDisplayList->AddPathClose();
+  
   cairo_close_path(mContext);
 }
 
 void IGraphicsCairo::PathArc(float cx, float cy, float r, float aMin, float aMax)
 {
+  if (mDisplayList)
+    mDisplayList->AddPathArc(cx, cy, r, aMin, aMax);
+  
   cairo_arc(mContext, cx, cy, r, DegToRad(aMin - 90.f), DegToRad(aMax - 90.f));
 }
 
 void IGraphicsCairo::PathMoveTo(float x, float y)
 {
+  if (mDisplayList)
+    mDisplayList->AddPathMoveTo(x, y);
+  
   cairo_move_to(mContext, x, y);
 }
 
 void IGraphicsCairo::PathLineTo(float x, float y)
 {
+  if (mDisplayList)
+    mDisplayList->AddPathLineTo(x, y);
+  
   cairo_line_to(mContext, x, y);
 }
 
 void IGraphicsCairo::PathCurveTo(float x1, float y1, float x2, float y2, float x3, float y3)
 {
+  if (mDisplayList)
+    mDisplayList->AddPathCurveTo(x1, y1, x2, y2, x3, y3);
+  
   cairo_curve_to(mContext, x1, y1, x2, y2, x3, y3);
 }
 
 void IGraphicsCairo::PathStroke(const IPattern& pattern, float thickness, const IStrokeOptions& options, const IBlend* pBlend)
 {
+  if (mDisplayList)
+    mDisplayList->AddPathStroke(pattern, thickness, options, pBlend);
+  
   double dashArray[8];
   
   // First set options
@@ -344,6 +473,9 @@ void IGraphicsCairo::PathStroke(const IPattern& pattern, float thickness, const
 
 void IGraphicsCairo::PathFill(const IPattern& pattern, const IFillOptions& options, const IBlend* pBlend) 
 {
+  if (mDisplayList)
+    mDisplayList->AddPathFill(pattern, options, pBlend);
+  
   cairo_set_fill_rule(mContext, options.mFillRule == kFillEvenOdd ? CAIRO_FILL_RULE_EVEN_ODD : CAIRO_FILL_RULE_WINDING);
   SetCairoSourcePattern(mContext, pattern, pBlend);
   if (options.mPreserve)
@@ -368,38 +500,81 @@ void IGraphicsCairo::SetCairoSourcePattern(cairo_t* context, const IPattern& pat
     case kLinearPattern:
     case kRadialPattern:
     {
-      cairo_pattern_t* cairoPattern;
+      // the gradient is built once and found again while it is drawn, with the transform of each use set on it
+      const PatternKey key(pattern, BlendWeight(pBlend));
+      const CairoPatternPtr* pCached = mPatternCache.Find(key);
+      CairoPatternPtr cairoPattern = pCached ? *pCached : nullptr;
       cairo_matrix_t matrix;
       const IMatrix& m = pattern.mTransform;
       
-      if (pattern.mType == kLinearPattern)
-        cairoPattern = cairo_pattern_create_linear(0.0, 0.0, 0.0, 1.0);
-      else
-        cairoPattern = cairo_pattern_create_radial(0.0, 0.0, 0.0, 0.0, 0.0, 1.0);
-      
-      switch (pattern.mExtend)
-      {
-        case kExtendNone:      cairo_pattern_set_extend(cairoPattern, CAIRO_EXTEND_NONE);      break;
-        case kExtendPad:       cairo_pattern_set_extend(cairoPattern, CAIRO_EXTEND_PAD);       break;
-        case kExtendReflect:   cairo_pattern_set_extend(cairoPattern, CAIRO_EXTEND_REFLECT);   break;
-        case kExtendRepeat:    cairo_pattern_set_extend(cairoPattern, CAIRO_EXTEND_REPEAT);    break;
-      }
-      
-      for (int i = 0; i < pattern.NStops(); i++)
+      if (!cairoPattern)
       {
-        const IColorStop& stop = pattern.GetStop(i);
-        cairo_pattern_add_color_stop_rgba(cairoPattern, stop.mOffset, stop.mColor.R / 255.0, stop.mColor.G / 255.0, stop.mColor.B / 255.0, (BlendWeight(pBlend) * stop.mColor.A) / 255.0);
+        if (pattern.mType == kLinearPattern)
+          cairoPattern = CairoPatternPtr(cairo_pattern_create_linear(0.0, 0.0, 0.0, 1.0), cairo_pattern_destroy);
+        else
+          cairoPattern = CairoPatternPtr(cairo_pattern_create_radial(0.0, 0.0, 0.0, 0.0, 0.0, 1.0), cairo_pattern_destroy);
+        
+        switch (pattern.mExtend)
+        {
+          case kExtendNone:      cairo_pattern_set_extend(cairoPattern.get(), CAIRO_EXTEND_NONE);      break;
+          case kExtendPad:       cairo_pattern_set_extend(cairoPattern.get(), CAIRO_EXTEND_PAD);       break;
+          case kExtendReflect:   cairo_pattern_set_extend(cairoPattern.get(), CAIRO_EXTEND_REFLECT);   break;
+          case kExtendRepeat:    cairo_pattern_set_extend(cairoPattern.get(), CAIRO_EXTEND_REPEAT);    break;
+        }
+        
+        for (int i = 0; i < pattern.NStops(); i++)
+        {
+          const IColorStop& stop = pattern.GetStop(i);
+          cairo_pattern_add_color_stop_rgba(cairoPattern.get(), stop.mOffset, stop.mColor.R / 255.0, stop.mColor.G / 255.0, stop.mColor.B / 255.0, (BlendWeight(pBlend) * stop.mColor.A) / 255.0);
+        }
+        
+        mPatternCache.Add(key, cairoPattern);
       }
       
       cairo_matrix_init(&matrix, m.mXX, m.mYX, m.mXY, m.mYY, m.mTX, m.mTY);
-      cairo_pattern_set_matrix(cairoPattern, &matrix);
-      cairo_set_source(context, cairoPattern);
-      cairo_pattern_destroy(cairoPattern);
+      cairo_pattern_set_matrix(cairoPattern.get(), &matrix);
+      cairo_set_source(context, cairoPattern.get());
     }
     break;
   }
 }
 
+IGraphicsCairo::PatternKey::PatternKey(const IPattern& pattern, float opacity)
+: mType(pattern.mType)
+, mExtend(pattern.mExtend)
+, mNStops(pattern.NStops())
+, mOpacity(opacity)
+{
+  for (int i = 0; i < 16; i++)
+  {
+    const bool isStop = i < mNStops;
+    const IColor& color = pattern.mStops[i].mColor;
+    mOffsets[i] = isStop ? pattern.mStops[i].mOffset : 0.f;
+    mColors[i] = isStop ? (color.A << 24) | (color.R << 16) | (color.G << 8) | color.B : 0;
+  }
+}
+
+bool IGraphicsCairo::PatternKey::operator==(const PatternKey& other) const
+{
+  return mType == other.mType && mExtend == other.mExtend && mNStops == other.mNStops && mOpacity == other.mOpacity
+      && !memcmp(mOffsets, other.mOffsets, sizeof(mOffsets)) && !memcmp(mColors, other.mColors, sizeof(mColors));
+}
+
+size_t IGraphicsCairo::PatternKeyHash::operator()(const PatternKey& key) const
+{
+  size_t hash = std::hash<int>()(key.mType * 16 + key.mNStops);
+  auto combine = [&hash](size_t value) { hash ^= value + 0x9e3779b9 + (hash << 6) + (hash >> 2); };
+  combine(std::hash<float>()(key.mOpacity));
+  
+  for (int i = 0; i < key.mNStops; i++)
+  {
+    combine(std::hash<int>()(key.mColors[i]));
+    combine(std::hash<float>()(key.mOffsets[i]));
+  }
+  
+  return hash;
+}
+
 IColor IGraphicsCairo::GetPoint(int x, int y)
 {
   // Convert suface to cairo image surface of one pixel (avoid copying the whole surface)
@@ -521,6 +696,7 @@ void IGraphicsCairo::UpdateCairoMainSurface(cairo_surface_t* pSurface)
   {
     cairo_surface_destroy(mSurface);
     mSurface = nullptr;
+    mSurfaceWidth = mSurfaceHeight = 0;
   }
   
   if (pSurface)
@@ -541,7 +717,9 @@ void IGraphicsCairo::SetPlatformContext(void* pContext)
     mSurface = cairo_quartz_surface_create_for_cg_context(CGContextRef(pContext), WindowWidth(), WindowHeight());
     cairo_surface_set_device_scale(mSurface, GetDrawScale(), GetDrawScale());
 #elif defined OS_WIN
-    mSurface = cairo_win32_surface_create_with_ddb((HDC) pContext, CAIRO_FORMAT_ARGB32, WindowWidth() * GetScreenScale(), WindowHeight() * GetScreenScale());
+    mSurfaceWidth = MainSurfaceSize(WindowWidth() * GetScreenScale());
+    mSurfaceHeight = MainSurfaceSize(WindowHeight() * GetScreenScale());
+    mSurface = cairo_win32_surface_create_with_ddb((HDC) pContext, CAIRO_FORMAT_ARGB32, mSurfaceWidth, mSurfaceHeight);
     cairo_surface_set_device_scale(mSurface, GetBackingPixelScale(), GetBackingPixelScale());
 #else
   #error NOT IMPLEMENTED
@@ -596,7 +774,7 @@ bool IGraphicsCairo::LoadAPIFont(const char* fontID, const PlatformFontPtr& font
 
 cairo_font_face_t* IGraphicsCairo::FindFont(const IText& text)
 {
-  StaticStorage<CairoFont>::Accessor storage(sFontCache);
+  StaticStorage<CairoFont>::SharedAccessor storage(sFontCache);
   CairoFont* pFont = storage.Find(text.mFont);
   
   if (pFont)
@@ -32,7 +32,37 @@
   #error NOT IMPLEMENTED
 #endif
 
+#include <memory>
+#include <vector>
+
 #include "IGraphicsPathBase.h"
+#include "ILRUCache.h"
+
+/** The image surfaces of layers that have been released, kept for the next layer of the same size, so that a control that draws through a layer every frame
+ * doesn't create and destroy a surface each time. A surface is cleared when it is reused. It is shared by the IGraphicsCairo and its layer bitmaps, which may outlive it */
+class CairoSurfacePool
+{
+public:
+  /** The most surfaces kept */
+  static constexpr int kMaxSurfaces = 16;
+
+  ~CairoSurfacePool();
+
+  /** @return A cleared surface of the size, from the pool or new */
+  cairo_surface_t* Acquire(cairo_surface_t* pSurfaceType, int width, int height);
+
+  /** Give a surface back, which destroys the least recently released one if the pool is full */
+  void Release(cairo_surface_t* pSurface);
+
+  /** Destroy the surfaces in the pool */
+  void Clear();
+
+  /** @return The memory of the surfaces in the pool, in bytes */
+  int64_t GetBytes() const;
+
+private:
+  std::vector<cairo_surface_t*> mSurfaces; // most recently released last
+};
 
 /** A Cairo API bitmap
  * @ingroup APIBitmaps */
@@ -40,8 +70,10 @@ class CairoBitmap : public APIBitmap
 {
 public:
   CairoBitmap(cairo_surface_t* pSurface, int scale, float drawScale);
-  CairoBitmap(cairo_surface_t* pSurfaceType, int width, int height, int scale, float drawScale);
+  CairoBitmap(cairo_surface_t* pSurfaceType, int width, int height, int scale, float drawScale, std::shared_ptr<CairoSurfacePool> pool = nullptr);
   virtual ~CairoBitmap();
+private:
+  std::shared_ptr<CairoSurfacePool> mPool;
 };
 
 /** IGraphics draw class using Cairo
@@ -71,6 +103,7 @@ public:
   void EndFrame() override;
   void SetPlatformContext(void* pContext) override;
   void DrawResize() override;
+  void ReportDrawingMemory(IMemoryReport& report) override;
 
   bool BitmapExtSupported(const char* ext) override;
 
@@ -103,7 +136,39 @@ private:
   void UpdateLayer() override { UpdateCairoContext(); }
     
   cairo_surface_t* CreateCairoDataSurface(const APIBitmap* pBitmap, RawBitmapData& data, bool resize);
-    
+
+  /** A gradient's type, extend and stops, with the opacity they are drawn at. The transform isn't part of it, since it is set on the pattern each time it is used */
+  struct PatternKey
+  {
+    PatternKey(const IPattern& pattern, float opacity);
+
+    bool operator==(const PatternKey& other) const;
+
+    int mType, mExtend, mNStops;
+    float mOpacity;
+    float mOffsets[16];
+    int mColors[16];
+  };
+
+  struct PatternKeyHash
+  {
+    size_t operator()(const PatternKey& key) const;
+  };
+
+  using CairoPatternPtr = std::shared_ptr<cairo_pattern_t>;
+
+  /** The most gradients kept */
+  static constexpr size_t kMaxCachedPatterns = 128;
+
+  /** The main surface is allocated in steps of this many pixels in each dimension, so that resizing the window only reallocates it when a step is crossed */
+  static constexpr int kMainSurfaceStep = 256;
+
+  static int MainSurfaceSize(int size) { return ((size + kMainSurfaceStep - 1) / kMainSurfaceStep) * kMainSurfaceStep; }
+
   cairo_t* mContext;
   cairo_surface_t* mSurface;
+  int mSurfaceWidth = 0;
+  int mSurfaceHeight = 0;
+  ILRUCache<PatternKey, CairoPatternPtr, PatternKeyHash> mPatternCache { kMaxCachedPatterns };
+  std::shared_ptr<CairoSurfacePool> mSurfacePool = std::make_shared<CairoSurfacePool>();
 };
@@ -26,7 +26,7 @@ extern val GetCanvas();
 // Fonts
 
 typedef std::pair<WDL_String, WDL_String> FontDescType;
-StaticStorage<FontDescType> sFontCache;
+StaticStorage<FontDescType> sFontCache {"Canvas fonts"};
 
 // Color Utility
 
@@ -39,16 +39,21 @@ static std::string CanvasColor(const IColor& color, float alpha = 1.0)
 
 // Bitmap
 
-CanvasBitmap::CanvasBitmap(val imageCanvas, const char* name, int scale)
+CanvasBitmap::CanvasBitmap(val imageCanvas, const char* name, int scale, int streamHandle)
+: mStreamHandle(streamHandle)
 {
   SetBitmap(new val(imageCanvas), imageCanvas["width"].as<int>(), imageCanvas["height"].as<int>(), scale, 1.f);
 }
 
 CanvasBitmap::CanvasBitmap(int width, int height, int scale, float drawScale)
 {
+#ifdef IGRAPHICS_WEB_WORKER
+  val canvas = val::global("OffscreenCanvas").new_(width, height);
+#else
   val canvas = val::global("document").call<val>("createElement", std::string("canvas"));
   canvas.set("width", width);
   canvas.set("height", height);
+#endif
 
   SetBitmap(new val(canvas), width, height, scale, drawScale);
 }
@@ -58,6 +63,11 @@ CanvasBitmap::~CanvasBitmap()
   delete GetBitmap();
 }
 
+void CanvasBitmap::RequestIfStreamed()
+{
+  RequestStreamedImage(mStreamHandle);
+}
+
 IGraphicsCanvas::IGraphicsCanvas(IGEditorDelegate& dlg, int w, int h, int fps, float scale)
 : IGraphicsPathBase(dlg, w, h, fps, scale)
 {
@@ -73,8 +83,17 @@ IGraphicsCanvas::~IGraphicsCanvas()
 
 void IGraphicsCanvas::DrawBitmap(const IBitmap& bitmap, const IRECT& bounds, int srcX, int srcY, const IBlend* pBlend)
 {
+  if (mDisplayList)
+    mDisplayList->AddBitmap(bitmap, bounds, srcX, srcY, pBlend);
+  
+  // drawn as a path, which isn't recorded again
+  IDisplayList::Pause pause(mDisplayList);
+  
+  CanvasBitmap* pBitmap = static_cast<CanvasBitmap*>(bitmap.GetAPIBitmap());
+  pBitmap->RequestIfStreamed();
+
   val context = GetContext();
-  val img = *bitmap.GetAPIBitmap()->GetBitmap();
+  val img = *pBitmap->GetBitmap();
   context.call<void>("save");
   SetCanvasBlendMode(context, pBlend);
   context.set("globalAlpha", BlendWeight(pBlend));
@@ -91,36 +110,57 @@ void IGraphicsCanvas::DrawBitmap(const IBitmap& bitmap, const IRECT& bounds, int
 
 void IGraphicsCanvas::PathClear()
 {
+  if (mDisplayList)
+    mDisplayList->AddPathClear();
+  
   GetContext().call<void>("beginPath");
 }
 
 void IGraphicsCanvas::PathClose()
 {
+  if (mDisplayList)
+    mDisplayList->AddPathClose();
+  
   GetContext().call<void>("closePath");
 }
 
 void IGraphicsCanvas::PathArc(float cx, float cy, float r, float aMin, float aMax)
 {
+  if (mDisplayList)
+    mDisplayList->AddPathArc(cx, cy, r, aMin, aMax);
+  
   GetContext().call<void>("arc", cx, cy, r, DegToRad(aMin - 90.f), DegToRad(aMax - 90.f));
 }
 
 void IGraphicsCanvas::PathMoveTo(float x, float y)
 {
+  if (mDisplayList)
+    mDisplayList->AddPathMoveTo(x, y);
+  
   GetContext().call<void>("moveTo", x, y);
 }
 
 void IGraphicsCanvas::PathLineTo(float x, float y)
 {
+  if (mDisplayList)
+    mDisplayList->AddPathLineTo(x, y);
+  
   GetContext().call<void>("lineTo", x, y);
 }
 
 void IGraphicsCanvas::PathCurveTo(float x1, float y1, float x2, float y2, float x3, float y3)
 {
+  if (mDisplayList)
+    mDisplayList->AddPathCurveTo(x1, y1, x2, y2, x3, y3);
+  
   GetContext().call<void>("bezierCurveTo", x1, y1, x2, y2, x3, y3);
 }
 
 void IGraphicsCanvas::PathStroke(const IPattern& pattern, float thickness, const IStrokeOptions& options, const IBlend* pBlend)
 {
+  if (mDisplayList)
+    mDisplayList->AddPathStroke(pattern, thickness, options, pBlend);
+  
   val context = GetContext();
   
   switch (options.mCapOption)
@@ -158,6 +198,9 @@ void IGraphicsCanvas::PathStroke(const IPattern& pattern, float thickness, const
 
 void IGraphicsCanvas::PathFill(const IPattern& pattern, const IFillOptions& options, const IBlend* pBlend)
 {
+  if (mDisplayList)
+    mDisplayList->AddPathFill(pattern, options, pBlend);
+  
   val context = GetContext();
   std::string fillRule(options.mFillRule == kFillWinding ? "nonzero" : "evenodd");
   
@@ -233,7 +276,7 @@ void IGraphicsCanvas::SetCanvasBlendMode(val& context, const IBlend* pBlend)
 
 bool IGraphicsCanvas::DoDrawMeasureText(const IText& text, const char* str, IRECT& bounds, const IBlend* pBlend, bool measure)
 {
-  StaticStorage<FontDescType>::Accessor storage(sFontCache);
+  StaticStorage<FontDescType>::SharedAccessor storage(sFontCache);
   FontDescType* descriptor = storage.Find(text.mFont);
     
   assert(descriptor && "No font found - did you forget to load it?");
@@ -327,6 +370,12 @@ bool IGraphicsCanvas::BitmapExtSupported(const char* ext)
 
 APIBitmap* IGraphicsCanvas::LoadAPIBitmap(const char* fileNameOrResID, int scale, EResourceLocation location, const char* ext)
 {
+  if (IsStreamedImage(fileNameOrResID))
+  {
+    val placeholder = val::global("IPlugResources").call<val>("createPlaceholder", std::string(fileNameOrResID));
+    return new CanvasBitmap(placeholder, fileNameOrResID + 1, scale, placeholder["iplugHandle"].as<int>());
+  }
+
   return new CanvasBitmap(GetPreloadedImages()[fileNameOrResID], fileNameOrResID + 1, scale);
 }
 
@@ -364,6 +413,11 @@ bool IGraphicsCanvas::LoadAPIFont(const char* fontID, const PlatformFontPtr& fon
     
   if (data->IsValid())
   {
+#ifdef IGRAPHICS_WEB_WORKER
+    // A worker has no document to add CSS to, so add a FontFace to the worker's font set, see IPlugWebWorker.js
+    val fontData = val(typed_memory_view(data->GetSize(), data->Get()));
+    val::global("IPlugWebWorker").call<void>("addFont", std::string(fontID), fontData);
+#else
     // Embed the font data in base64 format as CSS in the head of the html
     
     WDL_TypedBuf<char> base64Encoded;
@@ -383,6 +437,7 @@ bool IGraphicsCanvas::LoadAPIFont(const char* fontID, const PlatformFontPtr& fon
     css.set("type", std::string("text/css"));
     css.set("innerHTML", htmlText);
     document["head"].call<void>("appendChild", css);
+#endif
       
     const FontDescType* descriptor = reinterpret_cast<const FontDescType*>(font->GetDescriptor());
     storage.Add(new FontDescType{descriptor->first, descriptor->second}, fontID);
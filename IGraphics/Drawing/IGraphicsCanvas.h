@@ -19,14 +19,20 @@
 
 using namespace emscripten;
 
-/** An HTML5 canvas API bitmap
+/** An HTML5 canvas API bitmap. A streamed bitmap starts as a placeholder canvas of the right size, which the image is drawn into when it arrives, see IPlugResources.js
  * @ingroup APIBitmaps */
 class CanvasBitmap : public APIBitmap
 {
 public:
-  CanvasBitmap(val imageCanvas, const char* name, int scale);
+  CanvasBitmap(val imageCanvas, const char* name, int scale, int streamHandle = -1);
   CanvasBitmap(int width, int height, int scale, float drawScale);
   ~CanvasBitmap();
+
+  /** If this is a streamed bitmap that hasn't been asked for yet, ask for its image at high priority. Called when the bitmap is drawn */
+  void RequestIfStreamed();
+
+private:
+  int mStreamHandle = -1;
 };
 
 /** IGraphics draw class HTML5 canvas
@@ -75,7 +81,11 @@ private:
   
   val GetContext()
   {
+#ifdef IGRAPHICS_WEB_WORKER
+    val canvas = mLayers.empty() ? val::global("Module")["canvas"] : *(mLayers.top()->GetAPIBitmap()->GetBitmap());
+#else
     val canvas = mLayers.empty() ? val::global("document").call<val>("getElementById", std::string("canvas")) : *(mLayers.top()->GetAPIBitmap()->GetBitmap());
+#endif
       
     return canvas.call<val>("getContext", std::string("2d"));
   }
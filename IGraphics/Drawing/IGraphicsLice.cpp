@@ -11,7 +11,9 @@
 #include <cmath>
 
 #include "IGraphicsLice.h"
+#include "IPlugResourceArchive.h"
 #include "ITextEntryControl.h"
+#include "IParallelBands.h"
 
 #include "lice_combine.h"
 
@@ -25,23 +27,11 @@ struct LICEFontInfo
   bool mOutline;
 };
 
-static StaticStorage<LICE_IFont> sFontCache;
-static StaticStorage<LICEFontInfo> sLICEFontInfoCache;
+static StaticStorage<LICE_IFont> sFontCache {"LICE fonts"};
+static StaticStorage<LICEFontInfo> sLICEFontInfoCache {"LICE font info"};
 
 // Utilities for pre-multiplied blits (LICE assumes sources are not pre-multiplied)
 
-inline void PreMulCompositeSourceOver(LICE_pixel_chan* out, LICE_pixel_chan* in)
-{
-  unsigned int alphaCmp = 256 - in[LICE_PIXEL_A];
-  
-  unsigned int A = in[LICE_PIXEL_A] + ((out[LICE_PIXEL_A] * alphaCmp) >> 8);
-  unsigned int R = in[LICE_PIXEL_R] + ((out[LICE_PIXEL_R] * alphaCmp) >> 8);
-  unsigned int G = in[LICE_PIXEL_G] + ((out[LICE_PIXEL_G] * alphaCmp) >> 8);
-  unsigned int B = in[LICE_PIXEL_B] + ((out[LICE_PIXEL_B] * alphaCmp) >> 8);
-  
-  _LICE_MakePixelClamp(out, R, G, B, A);
-}
-
 inline void PreMulCompositeAdd(LICE_pixel_chan* out, LICE_pixel_chan* in)
 {
   unsigned int alpha = in[LICE_PIXEL_A];
@@ -54,14 +44,349 @@ inline void PreMulCompositeAdd(LICE_pixel_chan* out, LICE_pixel_chan* in)
   _LICE_MakePixelClamp(out, R, G, B, A);
 }
 
+// SIMD paths for the blits IGraphicsLice does most: copies, composites with a constant weight and bilinear scaling. Each pixel is widened to four 16 bit lanes, two pixels at a time,
+// with SSE2 on x86 and NEON on arm, both of which are always there on the 64 bit targets, or plain loops over the lanes elsewhere. The blend mode and weight pick a row kernel for each blit,
+// and the modes without one (add, multiply, dodge etc.) are left to LICE. Blits round within a level of LICE, and the bilinear filter, which weighs in 1/256ths, within a few
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #include <emmintrin.h>
+  #define IGRAPHICS_LICE_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+  #include <arm_neon.h>
+  #define IGRAPHICS_LICE_NEON
+#endif
+
+#if defined IGRAPHICS_LICE_SSE2
+using PixV = __m128i;
+
+static inline PixV PixLoad2(const LICE_pixel* p) { return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)), _mm_setzero_si128()); }
+static inline PixV PixLoad1Twice(const LICE_pixel* p) { return _mm_unpacklo_epi8(_mm_set1_epi32((int) *p), _mm_setzero_si128()); }
+static inline void PixStore2(LICE_pixel* p, PixV v) { _mm_storel_epi64(reinterpret_cast<__m128i*>(p), _mm_packus_epi16(v, v)); }
+static inline void PixStore1(LICE_pixel* p, PixV v) { *p = (LICE_pixel) _mm_cvtsi128_si32(_mm_packus_epi16(v, v)); }
+static inline PixV PixSplat(int x) { return _mm_set1_epi16((short) x); }
+static inline PixV PixSplatHalves(int lo, int hi) { return _mm_set_epi16((short) hi, (short) hi, (short) hi, (short) hi, (short) lo, (short) lo, (short) lo, (short) lo); }
+static inline PixV PixAdd(PixV a, PixV b) { return _mm_add_epi16(a, b); }
+static inline PixV PixSub(PixV a, PixV b) { return _mm_sub_epi16(a, b); }
+static inline PixV PixMul(PixV a, PixV b) { return _mm_mullo_epi16(a, b); }
+static inline PixV PixMin(PixV a, PixV b) { return _mm_min_epi16(a, b); } // the lanes never exceed 32767
+static inline PixV PixShr8(PixV a) { return _mm_srli_epi16(a, 8); }
+static inline PixV PixAddHalves(PixV a) { return _mm_add_epi16(a, _mm_srli_si128(a, 8)); }
+static inline PixV PixAlpha(PixV a) { return _mm_shufflehi_epi16(_mm_shufflelo_epi16(a, _MM_SHUFFLE(LICE_PIXEL_A, LICE_PIXEL_A, LICE_PIXEL_A, LICE_PIXEL_A)), _MM_SHUFFLE(LICE_PIXEL_A, LICE_PIXEL_A, LICE_PIXEL_A, LICE_PIXEL_A)); }
+static inline PixV PixAlphaMask()
+{
+  alignas(16) short mask[8] = {};
+  mask[LICE_PIXEL_A] = mask[LICE_PIXEL_A + 4] = -1;
+  return _mm_load_si128(reinterpret_cast<const __m128i*>(mask));
+}
+static inline PixV PixSelect(PixV mask, PixV a, PixV b) { return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b)); }
+#elif defined IGRAPHICS_LICE_NEON
+using PixV = uint16x8_t;
+
+static inline PixV PixLoad2(const LICE_pixel* p) { return vmovl_u8(vld1_u8(reinterpret_cast<const uint8_t*>(p))); }
+static inline PixV PixLoad1Twice(const LICE_pixel* p) { return vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(*p))); }
+static inline void PixStore2(LICE_pixel* p, PixV v) { vst1_u8(reinterpret_cast<uint8_t*>(p), vqmovn_u16(v)); }
+static inline void PixStore1(LICE_pixel* p, PixV v) { vst1_lane_u32(reinterpret_cast<uint32_t*>(p), vreinterpret_u32_u8(vqmovn_u16(v)), 0); }
+static inline PixV PixSplat(int x) { return vdupq_n_u16((uint16_t) x); }
+static inline PixV PixSplatHalves(int lo, int hi) { return vcombine_u16(vdup_n_u16((uint16_t) lo), vdup_n_u16((uint16_t) hi)); }
+static inline PixV PixAdd(PixV a, PixV b) { return vaddq_u16(a, b); }
+static inline PixV PixSub(PixV a, PixV b) { return vsubq_u16(a, b); }
+static inline PixV PixMul(PixV a, PixV b) { return vmulq_u16(a, b); }
+static inline PixV PixMin(PixV a, PixV b) { return vminq_u16(a, b); }
+static inline PixV PixShr8(PixV a) { return vshrq_n_u16(a, 8); }
+static inline PixV PixAddHalves(PixV a) { return vaddq_u16(a, vextq_u16(a, a, 4)); }
+static inline PixV PixAlpha(PixV a) { return vcombine_u16(vdup_lane_u16(vget_low_u16(a), LICE_PIXEL_A), vdup_lane_u16(vget_high_u16(a), LICE_PIXEL_A)); }
+static inline PixV PixAlphaMask()
+{
+  uint16_t mask[8] = {};
+  mask[LICE_PIXEL_A] = mask[LICE_PIXEL_A + 4] = 0xFFFF;
+  return vld1q_u16(mask);
+}
+static inline PixV PixSelect(PixV mask, PixV a, PixV b) { return vbslq_u16(mask, a, b); }
+#else
+struct PixV { uint16_t v[8]; };
+
+static inline PixV PixLoad2(const LICE_pixel* p) { PixV r; const LICE_pixel_chan* c = reinterpret_cast<const LICE_pixel_chan*>(p); for (int i = 0; i < 8; i++) r.v[i] = c[i]; return r; }
+static inline PixV PixLoad1Twice(const LICE_pixel* p) { const LICE_pixel twice[2] = {*p, *p}; return PixLoad2(twice); }
+static inline void PixStore2(LICE_pixel* p, PixV v) { LICE_pixel_chan* c = reinterpret_cast<LICE_pixel_chan*>(p); for (int i = 0; i < 8; i++) c[i] = (LICE_pixel_chan) std::min<int>(v.v[i], 255); }
+static inline void PixStore1(LICE_pixel* p, PixV v) { LICE_pixel_chan* c = reinterpret_cast<LICE_pixel_chan*>(p); for (int i = 0; i < 4; i++) c[i] = (LICE_pixel_chan) std::min<int>(v.v[i], 255); }
+static inline PixV PixSplat(int x) { PixV r; for (int i = 0; i < 8; i++) r.v[i] = (uint16_t) x; return r; }
+static inline PixV PixSplatHalves(int lo, int hi) { PixV r; for (int i = 0; i < 8; i++) r.v[i] = (uint16_t) (i < 4 ? lo : hi); return r; }
+static inline PixV PixAdd(PixV a, PixV b) { for (int i = 0; i < 8; i++) a.v[i] += b.v[i]; return a; }
+static inline PixV PixSub(PixV a, PixV b) { for (int i = 0; i < 8; i++) a.v[i] -= b.v[i]; return a; }
+static inline PixV PixMul(PixV a, PixV b) { for (int i = 0; i < 8; i++) a.v[i] = (uint16_t) (a.v[i] * b.v[i]); return a; }
+static inline PixV PixMin(PixV a, PixV b) { for (int i = 0; i < 8; i++) a.v[i] = std::min(a.v[i], b.v[i]); return a; }
+static inline PixV PixShr8(PixV a) { for (int i = 0; i < 8; i++) a.v[i] >>= 8; return a; }
+static inline PixV PixAddHalves(PixV a) { for (int i = 0; i < 4; i++) a.v[i] += a.v[i + 4]; return a; }
+static inline PixV PixAlpha(PixV a) { PixV r; for (int i = 0; i < 8; i++) r.v[i] = a.v[(i & 4) + LICE_PIXEL_A]; return r; }
+static inline PixV PixAlphaMask() { PixV r; for (int i = 0; i < 8; i++) r.v[i] = (i & 3) == LICE_PIXEL_A ? 0xFFFF : 0; return r; }
+static inline PixV PixSelect(PixV mask, PixV a, PixV b) { for (int i = 0; i < 8; i++) a.v[i] = (a.v[i] & mask.v[i]) | (b.v[i] & ~mask.v[i]); return a; }
+#endif
+
+enum EBlitKernel
+{
+  kBlitNone = -1, // left to LICE
+  kBlitCopy,  // LICE_BLIT_MODE_COPY at full weight
+  kBlitMix, // LICE_BLIT_MODE_COPY at a lower weight
+  kBlitSourceOver, // LICE_BLIT_MODE_COPY | LICE_BLIT_USE_ALPHA, for sources that aren't pre-multiplied
+  kBlitPreMulSourceOver // source over for pre-multiplied sources
+};
+
+static EBlitKernel SelectBlitKernel(int mode, int ia, bool preMultiplied)
+{
+  if (ia <= 0 || ia > 256)
+    return kBlitNone;
+
+  if (preMultiplied)
+    return (mode & LICE_BLIT_MODE_MASK) == LICE_BLIT_MODE_ADD ? kBlitNone : kBlitPreMulSourceOver;
+
+  switch (mode & (LICE_BLIT_MODE_MASK | LICE_BLIT_USE_ALPHA))
+  {
+    case LICE_BLIT_MODE_COPY: return ia == 256 ? kBlitCopy : kBlitMix;
+    case LICE_BLIT_MODE_COPY | LICE_BLIT_USE_ALPHA: return kBlitSourceOver;
+    default: return kBlitNone;
+  }
+}
+
+// one or two pixels of a row, the kernels work on pairs and finish an odd row with a pair padded from the last pixel
+template <class FUNC>
+static inline void ForEachPixelPair(LICE_pixel* pDest, const LICE_pixel* pSrc, int n, FUNC&& func)
+{
+  int i = 0;
+
+  for (; i + 2 <= n; i += 2)
+    PixStore2(pDest + i, func(PixLoad2(pDest + i), PixLoad2(pSrc + i)));
+
+  if (i < n)
+    PixStore1(pDest + i, func(PixLoad1Twice(pDest + i), PixLoad1Twice(pSrc + i)));
+}
+
+static void BlitRow(LICE_pixel* pDest, const LICE_pixel* pSrc, int n, int ia, EBlitKernel kernel)
+{
+  const PixV k256 = PixSplat(256);
+
+  switch (kernel)
+  {
+    case kBlitCopy:
+      memmove(pDest, pSrc, n * sizeof(LICE_pixel));
+      break;
+    case kBlitMix:
+    {
+      // as LICE's copy: d + (s - d) * ia / 256 on all four channels
+      const PixV w = PixSplat(ia), wc = PixSplat(256 - ia);
+      ForEachPixelPair(pDest, pSrc, n, [&](PixV d, PixV s) { return PixShr8(PixAdd(PixMul(d, wc), PixMul(s, w))); });
+      break;
+    }
+    case kBlitSourceOver:
+    {
+      // as LICE's copy with source alpha: the source weighs (a + 1) * ia / 256, or nothing where it is transparent, and its weight is added to the destination's alpha
+      const PixV one = PixSplat(1), w = PixSplat(ia), alphaMask = PixAlphaMask();
+      const bool fullWeight = ia == 256;
+
+      ForEachPixelPair(pDest, pSrc, n, [&](PixV d, PixV s) {
+        const PixV a = PixAlpha(s);
+        const PixV a1 = PixAdd(a, PixMin(a, one));
+        const PixV sc2 = fullWeight ? a1 : PixShr8(PixMul(a1, w));
+        const PixV rgb = PixShr8(PixAdd(PixMul(d, PixSub(k256, sc2)), PixMul(s, sc2)));
+        return PixSelect(alphaMask, PixAdd(d, fullWeight ? a : sc2), rgb);
+      });
+      break;
+    }
+    case kBlitPreMulSourceOver:
+    {
+      // s * ia / 256 + d * (256 - its alpha) / 256
+      const PixV w = PixSplat(ia);
+      const bool fullWeight = ia == 256;
+
+      ForEachPixelPair(pDest, pSrc, n, [&](PixV d, PixV s) {
+        if (!fullWeight)
+          s = PixShr8(PixMul(s, w));
+
+        return PixAdd(s, PixShr8(PixMul(d, PixSub(k256, PixAlpha(s)))));
+      });
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+// samples n pixels along a row at 16.16 fixed point x positions, between the source rows pRow0 and pRow1 (the same one at the bottom edge) yFrac / 256 of the way down
+static void ScaleRowBilinear(LICE_pixel* pDest, const LICE_pixel* pRow0, const LICE_pixel* pRow1, int n, int curx, int idx, int yFrac, int clipRight)
+{
+  const PixV wy = PixSplat(yFrac), wyc = PixSplat(256 - yFrac);
+
+  for (int i = 0; i < n; i++, curx += idx)
+  {
+    const int offs = std::min(curx >> 16, clipRight - 1);
+    const int xFrac = (curx & 0xFFFF) >> 8;
+    const bool edge = offs + 1 >= clipRight;
+
+    // the pixel and its right hand neighbour, from both rows, blended vertically then horizontally
+    const PixV top = edge ? PixLoad1Twice(pRow0 + offs) : PixLoad2(pRow0 + offs);
+    const PixV bottom = edge ? PixLoad1Twice(pRow1 + offs) : PixLoad2(pRow1 + offs);
+    const PixV column = PixShr8(PixAdd(PixMul(top, wyc), PixMul(bottom, wy)));
+    PixStore1(pDest + i, PixShr8(PixAddHalves(PixMul(column, PixSplatHalves(256 - xFrac, xFrac)))));
+  }
+}
+
+// a bitmap's rows, top down, whichever way up they are stored
+static inline LICE_pixel* GetRow(LICE_IBitmap* pBitmap, int y, int& span)
+{
+  span = pBitmap->getRowSpan();
+
+  if (!pBitmap->getBits())
+    return nullptr;
+
+  if (pBitmap->isFlipped())
+  {
+    y = pBitmap->getHeight() - 1 - y;
+    span = -span;
+  }
+
+  return pBitmap->getBits() + y * pBitmap->getRowSpan();
+}
+
+// clipped as LICE_Blit() clips, returns false if nothing is left to draw
+static bool ClipBlit(LICE_IBitmap* dest, LICE_IBitmap* src, int& dstx, int& dsty, int& srcx, int& srcy, int& srcw, int& srch)
+{
+  int right = std::min(srcx + srcw, src->getWidth());
+  int bottom = std::min(srcy + srch, src->getHeight());
+
+  if (srcx < 0) { dstx -= srcx; srcx = 0; }
+  if (srcy < 0) { dsty -= srcy; srcy = 0; }
+  if (dstx < 0) { srcx -= dstx; dstx = 0; }
+  if (dsty < 0) { srcy -= dsty; dsty = 0; }
+
+  right = std::min(right, srcx + dest->getWidth() - dstx);
+  bottom = std::min(bottom, srcy + dest->getHeight() - dsty);
+  srcw = right - srcx;
+  srch = bottom - srcy;
+
+  return srcw > 0 && srch > 0 && dstx < dest->getWidth() && dsty < dest->getHeight();
+}
+
+static void BlitRows(LICE_IBitmap* dest, LICE_IBitmap* src, int dstx, int dsty, int srcx, int srcy, int srcw, int srch, int ia, EBlitKernel kernel)
+{
+  if (!ClipBlit(dest, src, dstx, dsty, srcx, srcy, srcw, srch))
+    return;
+
+  if (!src->getBits() || !dest->getBits())
+    return;
+
+  int inSpan, outSpan;
+  const LICE_pixel* in = GetRow(src, srcy, inSpan) + srcx;
+  LICE_pixel* out = GetRow(dest, dsty, outSpan) + dstx;
+
+  for (int i = 0; i < srch; i++, in += inSpan, out += outSpan)
+    BlitRow(out, in, srcw, ia, kernel);
+}
+
+/** LICE_Blit() through the SIMD kernels, or LICE where there is none for the mode */
+static void SIMDBlit(LICE_IBitmap* dest, LICE_IBitmap* src, int dstx, int dsty, int srcx, int srcy, int srcw, int srch, float alpha, int mode)
+{
+  const int ia = (int) (alpha * 256.f);
+  const EBlitKernel kernel = SelectBlitKernel(mode, ia, false);
+
+  if (kernel == kBlitNone)
+    LICE_Blit(dest, src, dstx, dsty, srcx, srcy, srcw, srch, alpha, mode);
+  else if (dest && src)
+    BlitRows(dest, src, dstx, dsty, srcx, srcy, srcw, srch, ia, kernel);
+}
+
+/** LICE_ScaledBlit() with bilinear filtering through the SIMD kernels. Positions are worked out in 16.16 fixed point and clipped as LICE does, so that a blit split into bands of rows joins up.
+ * Reductions to less than 1/1.7 of the size, which LICE filters over a wider area, flipped axes and modes without a kernel are left to LICE */
+static void SIMDScaledBlit(LICE_IBitmap* dest, LICE_IBitmap* src, int dstx, int dsty, int dstw, int dsth, float srcx, float srcy, float srcw, float srch, float alpha, int mode)
+{
+  const int ia = (int) (alpha * 256.f);
+  const EBlitKernel kernel = SelectBlitKernel(mode, ia, false);
+  const double xadvance = srcw / dstw, yadvance = srch / dsth;
+
+  if (!dest || !src || dstw <= 0 || dsth <= 0 || srcw <= 0.f || srch <= 0.f || kernel == kBlitNone
+      || (mode & LICE_BLIT_FILTER_MASK) != LICE_BLIT_FILTER_BILINEAR || (xadvance >= 1.7 && yadvance >= 1.7))
+  {
+    LICE_ScaledBlit(dest, src, dstx, dsty, dstw, dsth, srcx, srcy, srcw, srch, alpha, mode);
+    return;
+  }
+
+  if (std::fabs(srcw - dstw) < 0.001 && std::fabs(srch - dsth) < 0.001 && std::fabs(srcx - std::floor(srcx + 0.5f)) < 0.03 && std::fabs(srcy - std::floor(srcy + 0.5f)) < 0.03)
+  {
+    BlitRows(dest, src, dstx, dsty, (int) (srcx + 0.5f), (int) (srcy + 0.5f), dstw, dsth, ia, kernel);
+    return;
+  }
+
+  if (dstx < 0) { srcx -= (float) (dstx * xadvance); dstw += dstx; dstx = 0; }
+  if (dsty < 0) { srcy -= (float) (dsty * yadvance); dsth += dsty; dsty = 0; }
+
+  if (dstw < 1 || dsth < 1 || dstx >= dest->getWidth() || dsty >= dest->getHeight())
+    return;
+
+  dstw = std::min(dstw, dest->getWidth() - dstx);
+  dsth = std::min(dsth, dest->getHeight() - dsty);
+
+  const double fidx = std::floor(xadvance * 65536.0), fidy = std::floor(yadvance * 65536.0);
+  double ficurx = std::floor(srcx * 65536.0), ficury = std::floor(srcy * 65536.0);
+
+  if (ficurx < 0) { const int n = (int) ((fidx - 1 - ficurx) / fidx); dstw -= n; dstx += n; ficurx += fidx * n; }
+  if (ficury < 0) { const int n = (int) ((fidy - 1 - ficury) / fidy); dsth -= n; dsty += n; ficury += fidy * n; }
+  if (ficurx + fidx * (dstw - 1) >= src->getWidth() * 65536.0) dstw = std::min(dstw, (int) (((src->getWidth() - 1) * 65536.0 - ficurx) / fidx));
+  if (ficury + fidy * (dsth - 1) >= src->getHeight() * 65536.0) dsth = std::min(dsth, (int) (((src->getHeight() - 1) * 65536.0 - ficury) / fidy));
+
+  const int clipRight = std::min((int) (srcx + srcw + 0.999999), src->getWidth());
+  const int clipBottom = std::min((int) (srcy + srch + 0.999999), src->getHeight());
+
+  if (dstw < 1 || dsth < 1 || clipRight < 1 || clipBottom < 1 || !src->getBits() || !dest->getBits())
+    return;
+
+  const int idx = (int) fidx, idy = (int) fidy;
+  int inSpan, outSpan;
+  const LICE_pixel* in = GetRow(src, 0, inSpan);
+  LICE_pixel* out = GetRow(dest, dsty, outSpan) + dstx;
+  int cury = (int) ficury;
+
+  // sampled straight into the destination for a copy, otherwise a chunk at a time into a buffer that is composited
+  static constexpr int kChunkSize = 256;
+  LICE_pixel chunk[kChunkSize];
+
+  for (int y = 0; y < dsth; y++, cury += idy, out += outSpan)
+  {
+    const int row = cury >> 16;
+
+    if (row >= clipBottom)
+      break;
+
+    const LICE_pixel* pRow0 = in + row * inSpan;
+    const LICE_pixel* pRow1 = row + 1 < clipBottom ? pRow0 + inSpan : pRow0;
+    const int yFrac = (cury & 0xFFFF) >> 8;
+
+    if (kernel == kBlitCopy)
+    {
+      ScaleRowBilinear(out, pRow0, pRow1, dstw, (int) ficurx, idx, yFrac, clipRight);
+      continue;
+    }
+
+    for (int x = 0; x < dstw; x += kChunkSize)
+    {
+      const int n = std::min(kChunkSize, dstw - x);
+      ScaleRowBilinear(chunk, pRow0, pRow1, n, (int) ficurx + x * idx, idx, yFrac, clipRight);
+      BlitRow(out + x, chunk, n, ia, kernel);
+    }
+  }
+}
+
 void PreMulBlit(LICE_IBitmap *dest, LICE_IBitmap *src, int dstx, int dsty, int srcx, int srcy, int srcw, int srch, float alpha, int mode)
 {
-  srcx = dstx < 0 ? srcx - dstx : srcx;
-  srcy = dsty < 0 ? srcy - dsty : srcy;
-  dstx = std::max(dstx, 0);
-  dsty = std::max(dsty, 0);
-  srcw = std::min(srcw, dest->getWidth() - dstx);
-  srch = std::min(srch, dest->getHeight() - dsty);
+  if ((mode & LICE_BLIT_MODE_MASK) != LICE_BLIT_MODE_ADD)
+  {
+    const int ia = std::min((int) (alpha * 256.f), 256);
+    
+    if (ia > 0)
+      BlitRows(dest, src, dstx, dsty, srcx, srcy, srcw, srch, ia, kBlitPreMulSourceOver);
+    
+    return;
+  }
+  
+  if (!ClipBlit(dest, src, dstx, dsty, srcx, srcy, srcw, srch))
+    return;
   
   int inStride = src->getRowSpan() * 4;
   int outStride = dest->getRowSpan() * 4;
@@ -69,21 +394,10 @@ void PreMulBlit(LICE_IBitmap *dest, LICE_IBitmap *src, int dstx, int dsty, int s
   LICE_pixel_chan* in = ((LICE_pixel_chan*) src->getBits()) + (srcy * inStride) + (srcx * 4);
   LICE_pixel_chan* out = ((LICE_pixel_chan*) dest->getBits()) + (dsty * outStride) + (dstx * 4);
   
-  if ((mode & LICE_BLIT_MODE_MASK) == LICE_BLIT_MODE_ADD)
+  for (int i = 0; i < srch; i++, in += inStride, out += outStride)
   {
-    for (int i = 0; i < srch; i++, in += inStride, out += outStride)
-    {
-      for (int j = 0; j < srcw; j++)
-        PreMulCompositeAdd(out + j * 4, in + j * 4);
-    }
-  }
-  else
-  {
-    for (int i = 0; i < srch; i++, in += inStride, out += outStride)
-    {
-      for (int j = 0; j < srcw; j++)
-        PreMulCompositeSourceOver(out + j * 4, in + j * 4);
-    }
+    for (int j = 0; j < srcw; j++)
+      PreMulCompositeAdd(out + j * 4, in + j * 4);
   }
 }
 
@@ -164,7 +478,7 @@ void IGraphicsLice::DrawBitmap(const IBitmap& bitmap, const IRECT& bounds, int s
   if (preMultiplied)
     PreMulBlit(mRenderBitmap, bitmap.GetAPIBitmap()->GetBitmap(), r.L, r.T, srcX, srcY, r.W(), r.H(), BlendWeight(pBlend), LiceBlendMode(pBlend));
   else
-    LICE_Blit(mRenderBitmap, bitmap.GetAPIBitmap()->GetBitmap(), r.L, r.T, srcX, srcY, r.W(), r.H(), BlendWeight(pBlend), LiceBlendMode(pBlend));
+    SIMDBlit(mRenderBitmap, bitmap.GetAPIBitmap()->GetBitmap(), r.L, r.T, srcX, srcY, r.W(), r.H(), BlendWeight(pBlend), LiceBlendMode(pBlend));
 }
 
 void IGraphicsLice::DrawRotatedBitmap(const IBitmap& bitmap, float destCtrX, float destCtrY, double angle, int yOffsetZeroDeg, const IBlend* pBlend)
@@ -207,7 +521,7 @@ void IGraphicsLice::DrawRotatedMask(const IBitmap& base, const IBitmap& mask, co
                    true, 1.0f, LICE_BLIT_MODE_COPY | LICE_BLIT_FILTER_BILINEAR | LICE_BLIT_USE_ALPHA, xOffs, 0.0f);
   
   IRECT r = IRECT(x, y, x + W, y + H).Intersect(mDrawRECT);
-  LICE_Blit(mRenderBitmap, mTmpBitmap.get(), r.L, r.T, r.L - x, r.T - y, r.R - r.L, r.B - r.T, BlendWeight(pBlend), LiceBlendMode(pBlend));
+  SIMDBlit(mRenderBitmap, mTmpBitmap.get(), r.L, r.T, r.L - x, r.T - y, r.R - r.L, r.B - r.T, BlendWeight(pBlend), LiceBlendMode(pBlend));
 }
 
 void IGraphicsLice::DrawFittedBitmap(const IBitmap& bitmap, const IRECT& bounds, const IBlend* pBlend)
@@ -216,7 +530,7 @@ void IGraphicsLice::DrawFittedBitmap(const IBitmap& bitmap, const IRECT& bounds,
   // TODO - clipping
   IRECT r = TransformRECT(bounds);
   LICE_IBitmap* pSrc = bitmap.GetAPIBitmap()->GetBitmap();
-  LICE_ScaledBlit(mRenderBitmap, pSrc, r.L, r.T, r.W(), r.H(), 0.0f, 0.0f, (float) pSrc->getWidth(), (float) pSrc->getHeight(), BlendWeight(pBlend), LiceBlendMode(pBlend) | LICE_BLIT_FILTER_BILINEAR);
+  SIMDScaledBlit(mRenderBitmap, pSrc, r.L, r.T, r.W(), r.H(), 0.0f, 0.0f, (float) pSrc->getWidth(), (float) pSrc->getHeight(), BlendWeight(pBlend), LiceBlendMode(pBlend) | LICE_BLIT_FILTER_BILINEAR);
 }
 
 void IGraphicsLice::DrawPoint(const IColor& color, float x, float y, const IBlend* pBlend)
@@ -628,16 +942,24 @@ void IGraphicsLice::UpdateLayer()
 
 LICE_IFont* IGraphicsLice::CacheFont(const IText& text)
 {
-  StaticStorage<LICE_IFont>::Accessor fontStorage(sFontCache);
   WDL_String hashStr(text.mFont);
   hashStr.AppendFormatted(50, "-%d-%d", text.mSize, text.mOrientation);
   int scale = GetScreenScale();
+  
+  // the font is usually cached already, so look for it without blocking other lookups first
+  {
+    StaticStorage<LICE_IFont>::SharedAccessor fontStorage(sFontCache);
     
+    if (LICE_IFont* font = fontStorage.Find(hashStr.Get(), scale))
+      return font;
+  }
+  
+  StaticStorage<LICE_IFont>::Accessor fontStorage(sFontCache);
   LICE_CachedFont* font = (LICE_CachedFont*) fontStorage.Find(hashStr.Get(), scale);
     
   if (!font)
   {
-    StaticStorage<LICEFontInfo>::Accessor fontInfoStorage(sLICEFontInfoCache);
+    StaticStorage<LICEFontInfo>::SharedAccessor fontInfoStorage(sLICEFontInfoCache);
     LICEFontInfo* fontInfo = fontInfoStorage.Find(text.mFont);
 
     assert (fontInfo && "No font found - did you forget to load it?");
@@ -742,6 +1064,13 @@ APIBitmap* IGraphicsLice::LoadAPIBitmap(const char* fileNameOrResID, int scale,
 
   if (ispng)
   {
+    if (location == EResourceLocation::kPackedArchive)
+    {
+      int size = 0;
+      const void* pData = IPlugResourceArchive::Get().Find(fileNameOrResID, size);
+      return new LICEBitmap(pData ? LICE_LoadPNGFromMemory(pData, size) : nullptr, scale, false);
+    }
+
 #if defined OS_WIN
     if (location == EResourceLocation::kWinBinary)
       return new LICEBitmap(LICE_LoadPNGFromResource((HINSTANCE) GetWinModuleHandle(), fileNameOrResID, 0), scale, false);
@@ -774,6 +1103,26 @@ APIBitmap* IGraphicsLice::CreateAPIBitmap(int width, int height, int scale, doub
   return new LICEBitmap(pBitmap, scale, true);
 }
 
+void IGraphicsLice::UpdatePixelLayer(const ILayerPtr& layer, const uint8_t* pData, int x, int y, int width, int height)
+{
+  LICE_IBitmap* pBitmap = layer->GetAPIBitmap()->GetBitmap();
+  const int imageWidth = pBitmap->getWidth();
+  const int span = pBitmap->getRowSpan();
+  
+  // the bitmap is premultiplied
+  for (int j = y; j < y + height; j++)
+  {
+    const uint8_t* pIn = pData + (static_cast<size_t>(j) * imageWidth + x) * 4;
+    LICE_pixel* pOut = pBitmap->getBits() + j * span + x;
+    
+    for (int i = 0; i < width; i++, pIn += 4)
+    {
+      const unsigned int a = pIn[3];
+      pOut[i] = LICE_RGBA((pIn[0] * a) / 255, (pIn[1] * a) / 255, (pIn[2] * a) / 255, a);
+    }
+  }
+}
+
 void IGraphicsLice::GetLayerBitmapData(const ILayerPtr& layer, RawBitmapData& data)
 {
   const APIBitmap* pBitmap = layer->GetAPIBitmap();
@@ -785,6 +1134,35 @@ void IGraphicsLice::GetLayerBitmapData(const ILayerPtr& layer, RawBitmapData& da
     memcpy(data.Get(), pBitmap->GetBitmap()->getBits(), size);
 }
 
+bool IGraphicsLice::ReadLayerPixels(const ILayerPtr& layer, RawBitmapData& data)
+{
+  LICE_IBitmap* pBitmap = layer->GetAPIBitmap()->GetBitmap();
+  const int width = pBitmap->getWidth();
+  const int height = pBitmap->getHeight();
+  
+  data.Resize(width * height * 4);
+  
+  if (data.GetSize() < width * height * 4)
+    return false;
+  
+  uint8_t* pOut = data.Get();
+  
+  for (int y = 0; y < height; y++)
+  {
+    const LICE_pixel* pIn = pBitmap->getBits() + (pBitmap->isFlipped() ? height - 1 - y : y) * pBitmap->getRowSpan();
+    
+    for (int x = 0; x < width; x++, pOut += 4)
+    {
+      pOut[0] = LICE_GETR(pIn[x]);
+      pOut[1] = LICE_GETG(pIn[x]);
+      pOut[2] = LICE_GETB(pIn[x]);
+      pOut[3] = LICE_GETA(pIn[x]);
+    }
+  }
+  
+  return true;
+}
+
 void IGraphicsLice::ApplyShadowMask(ILayerPtr& layer, RawBitmapData& mask, const IShadow& shadow)
 {
   const APIBitmap* pBitmap = layer->GetAPIBitmap();
@@ -924,8 +1302,13 @@ void IGraphicsLice::EndFrame()
   }
   else
   {
-    LICE_ScaledBlit(mScaleBitmap.get(), mDrawBitmap.get(), 0, 0, WindowWidth(), WindowHeight(), 0, 0, Width(), Height(), 1.0, LICE_BLIT_MODE_COPY | LICE_BLIT_FILTER_BILINEAR
-    );
+    // the scaling touches every pixel of the window each frame, so it is split into bands of rows on the worker threads
+    // bilinear filtering reads the neighbouring source rows beyond a band, as the blit is clamped to the whole bitmap
+    const double yAdvance = (double) Height() / (double) WindowHeight();
+
+    IParallelBands::Run(WindowHeight(), WindowWidth(), [&](int start, int end) {
+      SIMDScaledBlit(mScaleBitmap.get(), mDrawBitmap.get(), 0, start, WindowWidth(), end - start, 0, (float) (start * yAdvance), Width(), (float) ((end - start) * yAdvance), 1.0, LICE_BLIT_MODE_COPY | LICE_BLIT_FILTER_BILINEAR);
+    });
     BitBlt(dc, 0, 0, WindowWidth(), WindowHeight(), mScaleBitmap->getDC(), 0, 0, SRCCOPY);
   }
   
@@ -112,6 +112,7 @@ public:
   void FillCircle(const IColor& color, float cx, float cy, float r, const IBlend* pBlend) override;
     
   IColor GetPoint(int x, int y) override;
+  void UpdatePixelLayer(const ILayerPtr& layer, const uint8_t* pData, int x, int y, int width, int height) override;
   void* GetDrawContext() override { return mDrawBitmap->getBits(); }
   inline LICE_SysBitmap* GetDrawBitmap() const { return mDrawBitmap.get(); }
 
@@ -127,6 +128,7 @@ public:
 protected:
   APIBitmap* LoadAPIBitmap(const char* fileNameOrResID, int scale, EResourceLocation location, const char* ext) override;
   APIBitmap* CreateAPIBitmap(int width, int height, int scale, double drawScale) override;
+  APIBitmap* CreatePixelAPIBitmap(int width, int height) override { return CreateAPIBitmap(width, height, 1, 1.0); }
 
   bool LoadAPIFont(const char* fontID, const PlatformFontPtr& font) override;
 
@@ -134,6 +136,7 @@ protected:
   bool FlippedBitmap() const override { return false; }
 
   void GetLayerBitmapData(const ILayerPtr& layer, RawBitmapData& data) override;
+  bool ReadLayerPixels(const ILayerPtr& layer, RawBitmapData& data) override;
   void ApplyShadowMask(ILayerPtr& layer, RawBitmapData& mask, const IShadow& shadow) override;
 
   bool DoDrawMeasureText(const IText& text, const char* str, IRECT& bounds, const IBlend* pBlend, bool measure) override;
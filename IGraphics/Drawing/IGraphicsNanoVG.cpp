@@ -9,9 +9,15 @@
 */
 
 #include <cmath>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "IGraphicsNanoVG.h"
+#include "IPlugResourceArchive.h"
 #include "ITextEntryControl.h"
+#include "stb_image.h"
 
 #if defined IGRAPHICS_GL
   #if defined OS_MAC
@@ -43,7 +49,13 @@
       #error Define either IGRAPHICS_GL2 or IGRAPHICS_GL3 when using IGRAPHICS_GL and IGRAPHICS_NANOVG with OS_WIN
     #endif
   #elif defined OS_LINUX
-    #error NOT IMPLEMENTED
+    #if defined IGRAPHICS_GL2
+      #define NANOVG_GL2_IMPLEMENTATION
+    #elif defined IGRAPHICS_GL3
+      #define NANOVG_GL3_IMPLEMENTATION
+    #else
+      #error Define either IGRAPHICS_GL2 or IGRAPHICS_GL3 when using IGRAPHICS_GL and IGRAPHICS_NANOVG with OS_LINUX
+    #endif
   #elif defined OS_WEB
     #if defined IGRAPHICS_GLES2
       #define NANOVG_GLES2_IMPLEMENTATION
@@ -53,7 +65,7 @@
       #error Define either IGRAPHICS_GLES2 or IGRAPHICS_GLES3 when using IGRAPHICS_GL and IGRAPHICS_NANOVG with OS_WEB
     #endif
   #endif
-  #if defined IGRAPHICS_GL3
+  #if defined IGRAPHICS_GL3 && defined OS_MAC
     #include <OpenGL/gl3.h>
   #endif
   #include "nanovg_gl.h"
@@ -70,7 +82,7 @@
 
 
 // Fonts
-StaticStorage<IFontData> sFontCache;
+StaticStorage<IFontData> sFontCache {"NanoVG fonts"};
 
 // Retrieving pixels
 void nvgReadPixels(NVGcontext* pContext, int image, int x, int y, int width, int height, void* pData)
@@ -79,13 +91,18 @@ void nvgReadPixels(NVGcontext* pContext, int image, int x, int y, int width, int
   glReadPixels(x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pData);
 #elif defined(IGRAPHICS_METAL)
 #if defined OS_MAC
-  id<MTLCommandBuffer> commandBuffer = [static_cast<id<MTLCommandQueue>>(mnvgCommandQueue(pContext)) commandBuffer];
-  id<MTLBlitCommandEncoder> blitCommandEncoder = [commandBuffer blitCommandEncoder];
   id<MTLTexture> texture = static_cast<id<MTLTexture>>(mnvgImageHandle(pContext, image));
-  [blitCommandEncoder synchronizeTexture:texture slice:0 level:0];
-  [blitCommandEncoder endEncoding];
-  [commandBuffer commit];
-  [commandBuffer waitUntilCompleted];
+  
+  // only a managed texture has a copy in system memory that must be brought up to date, shared textures on unified memory can be read directly
+  if (texture.storageMode == MTLStorageModeManaged)
+  {
+    id<MTLCommandBuffer> commandBuffer = [static_cast<id<MTLCommandQueue>>(mnvgCommandQueue(pContext)) commandBuffer];
+    id<MTLBlitCommandEncoder> blitCommandEncoder = [commandBuffer blitCommandEncoder];
+    [blitCommandEncoder synchronizeTexture:texture slice:0 level:0];
+    [blitCommandEncoder endEncoding];
+    [commandBuffer commit];
+    [commandBuffer waitUntilCompleted];
+  }
 #endif
   mnvgReadPixels(pContext, image, x, y, width, height, pData);
 #endif
@@ -125,6 +142,35 @@ NanoVGBitmap::NanoVGBitmap(IGraphicsNanoVG* pGraphics, NVGcontext* pContext, int
   SetBitmap(mFBO->image, width, height, scale, drawScale);
 }
 
+NanoVGBitmap::NanoVGBitmap(IGraphicsNanoVG* pGraphics, NVGcontext* pContext, NanoVGAtlasPage* pPage, int x, int y, int width, int height, int scale, float drawScale)
+{
+  mGraphics = pGraphics;
+  mVG = pContext;
+  mFBO = pPage->mFBO;
+  mAtlasPage = pPage;
+  mAtlasX = x;
+  mAtlasY = y;
+  
+  // clear the region and its gutter, the rest of the page belongs to other layers
+  const int pageSize = pPage->mPacker.GetWidth();
+  
+  nvgEndFrame(mVG);
+  nvgBindFramebuffer(mFBO);
+#ifdef IGRAPHICS_GL
+  glViewport(0, 0, pageSize, pageSize);
+#endif
+  nvgBeginFrame(mVG, pageSize, pageSize, 1.f);
+  nvgBeginPath(mVG);
+  nvgRect(mVG, x, y, width + 1, height + 1);
+  nvgGlobalCompositeBlendFunc(mVG, NVG_ZERO, NVG_ZERO);
+  nvgFillColor(mVG, nvgRGBAf(0, 0, 0, 0));
+  nvgFill(mVG);
+  nvgGlobalCompositeOperation(mVG, NVG_SOURCE_OVER);
+  nvgEndFrame(mVG);
+  
+  SetBitmap(mFBO->image, width, height, scale, drawScale);
+}
+
 NanoVGBitmap::NanoVGBitmap(NVGcontext* pContext, int width, int height, const uint8_t* pData, int scale, float drawScale)
 {
   int idx = nvgCreateImageRGBA(pContext, width, height, 0, pData);
@@ -134,12 +180,59 @@ NanoVGBitmap::NanoVGBitmap(NVGcontext* pContext, int width, int height, const ui
 
 NanoVGBitmap::~NanoVGBitmap()
 {
-  if(mFBO)
+  if(mAtlasPage)
+    mGraphics->FreeAtlasRegion(mAtlasPage, mAtlasY);
+  else if(mFBO)
     mGraphics->DeleteFBO(mFBO);
   else
     nvgDeleteImage(mVG, GetBitmap());
 }
 
+#if defined IGRAPHICS_GL
+static std::mutex sSharedTexturesMutex;
+static std::unordered_map<std::string, std::weak_ptr<NanoVGSharedTexture>> sSharedTextures;
+
+static std::string SharedTextureKey(const char* path, int scale)
+{
+  return std::string(path) + "@" + std::to_string(scale);
+}
+
+NanoVGSharedTexture::~NanoVGSharedTexture()
+{
+  // any context of the share group can delete it, the bitmaps are deleted with one current
+  glDeleteTextures(1, &mTexture);
+}
+
+std::shared_ptr<NanoVGSharedTexture> NanoVGSharedTexture::Find(const char* path, int scale)
+{
+  std::lock_guard<std::mutex> lock(sSharedTexturesMutex);
+  auto it = sSharedTextures.find(SharedTextureKey(path, scale));
+  
+  if (it == sSharedTextures.end())
+    return nullptr;
+  
+  auto texture = it->second.lock();
+  
+  if (!texture)
+    sSharedTextures.erase(it);
+  
+  return texture;
+}
+
+void NanoVGSharedTexture::Add(const std::shared_ptr<NanoVGSharedTexture>& texture, const char* path, int scale)
+{
+  std::lock_guard<std::mutex> lock(sSharedTexturesMutex);
+  sSharedTextures[SharedTextureKey(path, scale)] = texture;
+}
+#endif
+
+#ifdef OS_WEB
+void NanoVGBitmap::RequestIfStreamed()
+{
+  RequestStreamedImage(mStreamHandle);
+}
+#endif
+
 #pragma mark -
 
 // Utility conversions
@@ -271,7 +364,28 @@ IBitmap IGraphicsNanoVG::LoadBitmap(const char* name, int nStates, bool framesAr
     if(resourceFound == EResourceLocation::kNotFound || !bitmapTypeSupported)
       return IBitmap(); // return invalid IBitmap
 
-    pAPIBitmap = LoadAPIBitmap(fullPathOrResourceID.Get(), sourceScale, resourceFound, ext);
+#ifdef IGRAPHICS_GL
+    // another instance may have uploaded it already
+    pAPIBitmap = LoadSharedAPIBitmap(fullPathOrResourceID.Get(), sourceScale);
+    
+    // use a compressed texture made from the file, if there is one at the same scale and the GPU supports its format, e.g. knob.ktx for knob.png
+    WDL_String ktxName(name);
+    ktxName.SetLen((int) (ext - name));
+    ktxName.Append("ktx");
+
+    WDL_String ktxPathOrResourceID;
+    int ktxScale = 0;
+    EResourceLocation ktxFound = SearchImageResource(ktxName.Get(), "ktx", ktxPathOrResourceID, targetScale, ktxScale);
+
+    if (!pAPIBitmap && ktxFound != EResourceLocation::kNotFound && ktxScale == sourceScale)
+      pAPIBitmap = LoadCompressedAPIBitmap(ktxPathOrResourceID.Get(), sourceScale, ktxFound);
+
+    if (!pAPIBitmap)
+#endif
+    pAPIBitmap = LoadPreloadedBitmap(fullPathOrResourceID.Get(), sourceScale);
+    
+    if (!pAPIBitmap)
+      pAPIBitmap = LoadAPIBitmap(fullPathOrResourceID.Get(), sourceScale, resourceFound, ext);
     
     storage.Add(pAPIBitmap, name, sourceScale);
 
@@ -294,23 +408,710 @@ APIBitmap* IGraphicsNanoVG::LoadAPIBitmap(const char* fileNameOrResID, int scale
     pResData = LoadWinResource(fileNameOrResID, ext, size, GetWinModuleHandle());
 
     if (pResData)
-      idx = nvgCreateImageMem(mVG, 0 /*flags*/, (unsigned char*)pResData, size);
+      idx = nvgCreateImageMem(mVG, GetBitmapImageFlags(), (unsigned char*)pResData, size);
+  }
+  else
+#endif
+  if (location == EResourceLocation::kPackedArchive)
+  {
+    int size = 0;
+    const void* pResData = IPlugResourceArchive::Get().Find(fileNameOrResID, size);
+
+    // decoded straight from the mapped archive
+    if (pResData)
+      idx = nvgCreateImageMem(mVG, GetBitmapImageFlags(), (unsigned char*)pResData, size);
+  }
+  else if (location == EResourceLocation::kAbsolutePath)
+  {
+#ifdef OS_WEB
+    // not in the preloaded file system, so start with a placeholder texture which is updated when the image arrives, see IPlugResources.js
+    if (IsStreamedImage(fileNameOrResID))
+    {
+      val size = val::global("IPlugResources")["manifest"][fileNameOrResID];
+      const int w = size[0].as<int>();
+      const int h = size[1].as<int>();
+
+      WDL_TypedBuf<uint8_t> placeholder;
+      placeholder.Resize(w * h * 4);
+
+      for (int i = 0; i < w * h; i++)
+      {
+        uint8_t* pPixel = placeholder.Get() + i * 4;
+        pPixel[0] = pPixel[1] = pPixel[2] = 128;
+        pPixel[3] = 38;
+      }
+
+      idx = nvgCreateImageRGBA(mVG, w, h, 0, placeholder.Get());
+      NanoVGBitmap* pBitmap = new NanoVGBitmap(mVG, fileNameOrResID, scale, idx);
+      pBitmap->SetStreamHandle(val::global("IPlugResources").call<int>("addTexture", std::string(fileNameOrResID), idx));
+      return pBitmap;
+    }
+#endif
+    idx = nvgCreateImage(mVG, fileNameOrResID, GetBitmapImageFlags());
+  }
+
+  return CreateFileAPIBitmap(fileNameOrResID, scale, idx);
+}
+
+NanoVGBitmap* IGraphicsNanoVG::CreateFileAPIBitmap(const char* path, int scale, int nvgImageID)
+{
+  NanoVGBitmap* pBitmap = new NanoVGBitmap(mVG, path, scale, nvgImageID);
+  
+#ifdef IGRAPHICS_GL
+  if (mSharesGLResources && nvgImageID)
+  {
+    auto texture = std::make_shared<NanoVGSharedTexture>(nvglImageHandle(mVG, nvgImageID), pBitmap->GetWidth(), pBitmap->GetHeight());
+    pBitmap->SetSharedTexture(texture);
+    NanoVGSharedTexture::Add(texture, path, scale);
+  }
+#endif
+  
+  return pBitmap;
+}
+
+int IGraphicsNanoVG::GetBitmapImageFlags() const
+{
+#ifdef IGRAPHICS_GL
+  // the texture is deleted by the last bitmap of any context that has it
+  if (mSharesGLResources)
+    return mBitmapImageFlags | NVG_IMAGE_NODELETE;
+#endif
+  return mBitmapImageFlags;
+}
+
+#ifdef IGRAPHICS_GL
+APIBitmap* IGraphicsNanoVG::LoadSharedAPIBitmap(const char* path, int scale)
+{
+  if (!mSharesGLResources)
+    return nullptr;
+  
+  auto texture = NanoVGSharedTexture::Find(path, scale);
+  
+  if (!texture)
+    return nullptr;
+  
+  const int idx = nvglCreateImageFromHandle(mVG, texture->GetTexture(), texture->GetWidth(), texture->GetHeight(), GetBitmapImageFlags());
+  
+  if (!idx)
+    return nullptr;
+  
+  NanoVGBitmap* pBitmap = new NanoVGBitmap(mVG, path, scale, idx);
+  pBitmap->SetSharedTexture(texture);
+  return pBitmap;
+}
+#endif
+
+#ifdef IGRAPHICS_GL
+// Create a texture from a KTX 1.1 file of compressed 2D texture data, with any mip levels it has. The file's format is passed straight to GL, which rejects those it doesn't support
+static GLuint CreateKTXTexture(const uint8_t* pData, size_t size, int& width, int& height)
+{
+  static const uint8_t identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+  
+  // endianness, glType, glTypeSize, glFormat, glInternalFormat, glBaseInternalFormat, pixelWidth, pixelHeight, pixelDepth,
+  // numberOfArrayElements, numberOfFaces, numberOfMipmapLevels, bytesOfKeyValueData
+  uint32_t header[13];
+  
+  if (size < sizeof(identifier) + sizeof(header) || memcmp(pData, identifier, sizeof(identifier)))
+    return 0;
+  
+  memcpy(header, pData + sizeof(identifier), sizeof(header));
+  
+  // only a single compressed 2D image, written in this machine's byte order
+  if (header[0] != 0x04030201 || header[1] != 0 || header[8] > 0 || header[9] > 0 || header[10] != 1 || !header[6] || !header[7])
+    return 0;
+  
+  const GLenum internalFormat = header[4];
+  const int nLevels = std::max<int>(header[11], 1);
+  size_t offset = sizeof(identifier) + sizeof(header) + header[12];
+  
+  width = header[6];
+  height = header[7];
+  
+  GLint prevTexture = 0;
+  GLuint texture = 0;
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &prevTexture);
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  
+  while (glGetError() != GL_NO_ERROR); // clear earlier errors
+  
+  bool ok = true;
+  
+  for (int level = 0; level < nLevels && ok; level++)
+  {
+    uint32_t imageSize = 0;
+    ok = offset + sizeof(imageSize) <= size;
+    
+    if (ok)
+    {
+      memcpy(&imageSize, pData + offset, sizeof(imageSize));
+      offset += sizeof(imageSize);
+      ok = offset + imageSize <= size;
+    }
+    
+    if (ok)
+    {
+      glCompressedTexImage2D(GL_TEXTURE_2D, level, internalFormat, std::max(width >> level, 1), std::max(height >> level, 1), 0, imageSize, pData + offset);
+      offset += (imageSize + 3) & ~3;
+      ok = glGetError() == GL_NO_ERROR;
+    }
+  }
+  
+  if (ok)
+  {
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, nLevels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+#ifdef GL_TEXTURE_MAX_LEVEL
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, nLevels - 1);
+#endif
+  }
+  else
+  {
+    glDeleteTextures(1, &texture);
+    texture = 0;
+  }
+  
+  // NanoVG keeps track of the bound texture
+  glBindTexture(GL_TEXTURE_2D, prevTexture);
+  
+  return texture;
+}
+
+APIBitmap* IGraphicsNanoVG::LoadCompressedAPIBitmap(const char* fileNameOrResID, int scale, EResourceLocation location)
+{
+  if (APIBitmap* pShared = LoadSharedAPIBitmap(fileNameOrResID, scale))
+    return pShared;
+  
+  WDL_TypedBuf<uint8_t> fileData;
+  const uint8_t* pData = nullptr;
+  size_t size = 0;
+  
+#ifdef OS_WIN
+  if (location == EResourceLocation::kWinBinary)
+  {
+    int resSize = 0;
+    pData = (const uint8_t*) LoadWinResource(fileNameOrResID, "ktx", resSize, GetWinModuleHandle());
+    size = resSize;
+  }
+  else
+#endif
+  if (location == EResourceLocation::kPackedArchive)
+  {
+    int resSize = 0;
+    pData = (const uint8_t*) IPlugResourceArchive::Get().Find(fileNameOrResID, resSize);
+    size = resSize;
+  }
+  else if (location == EResourceLocation::kAbsolutePath)
+  {
+    FILE* pFile = fopen(fileNameOrResID, "rb");
+    
+    if (pFile)
+    {
+      fseek(pFile, 0, SEEK_END);
+      fileData.Resize((int) ftell(pFile));
+      fseek(pFile, 0, SEEK_SET);
+      
+      if (fread(fileData.Get(), 1, fileData.GetSize(), pFile) == (size_t) fileData.GetSize())
+      {
+        pData = fileData.Get();
+        size = fileData.GetSize();
+      }
+      
+      fclose(pFile);
+    }
+  }
+  
+  int width = 0, height = 0;
+  const GLuint texture = pData ? CreateKTXTexture(pData, size, width, height) : 0;
+  
+  if (!texture)
+    return nullptr;
+  
+  // NanoVG deletes the texture along with its image, unless it is shared
+  const int idx = nvglCreateImageFromHandle(mVG, texture, width, height, GetBitmapImageFlags() & NVG_IMAGE_NODELETE);
+  
+  if (!idx)
+  {
+    glDeleteTextures(1, &texture);
+    return nullptr;
+  }
+  
+  return CreateFileAPIBitmap(fileNameOrResID, scale, idx);
+}
+#endif
+
+// Called on a worker thread, decodes as nvgCreateImage() does
+static bool DecodeNanoVGBitmap(IBitmapPreloader::Bitmap& bitmap)
+{
+  unsigned char* pData = nullptr;
+  int nChannels = 0;
+  
+#ifdef OS_WIN
+  if (bitmap.location == EResourceLocation::kWinBinary)
+  {
+    int size = 0;
+    const void* pResData = LoadWinResource(bitmap.path.Get(), bitmap.ext.Get(), size, bitmap.pModule);
+    
+    if (pResData)
+      pData = stbi_load_from_memory((const stbi_uc*) pResData, size, &bitmap.width, &bitmap.height, &nChannels, 4);
   }
   else
 #endif
-  if (location == EResourceLocation::kAbsolutePath)
+  if (bitmap.location == EResourceLocation::kPackedArchive)
+  {
+    int size = 0;
+    const void* pResData = IPlugResourceArchive::Get().Find(bitmap.path.Get(), size);
+    
+    if (pResData)
+      pData = stbi_load_from_memory((const stbi_uc*) pResData, size, &bitmap.width, &bitmap.height, &nChannels, 4);
+  }
+  else if (bitmap.location == EResourceLocation::kAbsolutePath)
+    pData = stbi_load(bitmap.path.Get(), &bitmap.width, &bitmap.height, &nChannels, 4);
+  
+  if (!pData)
+    return false;
+  
+  bitmap.pixels.Resize(bitmap.width * bitmap.height * 4);
+  memcpy(bitmap.pixels.Get(), pData, bitmap.pixels.GetSize());
+  stbi_image_free(pData);
+  return true;
+}
+
+IBitmapPreloader::DecodeFunc IGraphicsNanoVG::GetBitmapDecodeFunc()
+{
+#ifdef OS_WEB
+  return nullptr; // images arrive from the preloaded file system or are streamed, see IPlugResources.js
+#else
+  // stb_image's options are global, so they are set here, before any worker decodes
+  stbi_set_unpremultiply_on_load(1);
+  stbi_convert_iphone_png_to_rgb(1);
+  return DecodeNanoVGBitmap;
+#endif
+}
+
+APIBitmap* IGraphicsNanoVG::CreateAPIBitmapFromPixels(const IBitmapPreloader::Bitmap& bitmap)
+{
+#ifdef IGRAPHICS_GL
+  if (APIBitmap* pShared = LoadSharedAPIBitmap(bitmap.path.Get(), bitmap.scale))
+    return pShared;
+#endif
+  
+  const int idx = nvgCreateImageRGBA(mVG, bitmap.width, bitmap.height, GetBitmapImageFlags(), bitmap.pixels.Get());
+  
+  return idx ? CreateFileAPIBitmap(bitmap.path.Get(), bitmap.scale, idx) : nullptr;
+}
+
+APIBitmap* IGraphicsNanoVG::CreatePixelAPIBitmap(int width, int height)
+{
+  // a texture of its own rather than a framebuffer, so that its pixels can be uploaded
+  std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * 4, 0);
+  return new NanoVGBitmap(mVG, width, height, pixels.data(), 1, 1.f);
+}
+
+void IGraphicsNanoVG::UpdatePixelLayer(const ILayerPtr& layer, const uint8_t* pData, int x, int y, int width, int height)
+{
+  // only the region is uploaded, read from the pixels of the whole image
+  NVGparams* pParams = nvgInternalParams(mVG);
+  pParams->renderUpdateTexture(pParams->userPtr, layer->GetAPIBitmap()->GetBitmap(), x, y, width, height, pData);
+}
+
+#if defined IGRAPHICS_GL
+// The preludes of a shader's GLSL for the version of GL, see IShader
+#if defined IGRAPHICS_GL2
+static const char* kShaderVersion = "";
+static const char* kShaderVertexIn = "attribute";
+static const char* kShaderVaryingOut = "varying";
+static const char* kShaderFragmentIn = "varying vec2 vUV;\n#define fragColor gl_FragColor\n";
+#elif defined IGRAPHICS_GLES2
+static const char* kShaderVersion = "#version 100\nprecision highp float;\n";
+static const char* kShaderVertexIn = "attribute";
+static const char* kShaderVaryingOut = "varying";
+static const char* kShaderFragmentIn = "varying vec2 vUV;\n#define fragColor gl_FragColor\n";
+#elif defined IGRAPHICS_GL3
+static const char* kShaderVersion = "#version 150 core\n";
+static const char* kShaderVertexIn = "in";
+static const char* kShaderVaryingOut = "out";
+static const char* kShaderFragmentIn = "in vec2 vUV;\nout vec4 fragColor;\n#define texture2D texture\n";
+#elif defined IGRAPHICS_GLES3
+static const char* kShaderVersion = "#version 300 es\nprecision highp float;\n";
+static const char* kShaderVertexIn = "in";
+static const char* kShaderVaryingOut = "out";
+static const char* kShaderFragmentIn = "in vec2 vUV;\nout vec4 fragColor;\n#define texture2D texture\n";
+#endif
+
+static GLuint CompileShaderStage(GLenum type, const std::string& source)
+{
+  const char* pSource = source.c_str();
+  GLuint stage = glCreateShader(type);
+  glShaderSource(stage, 1, &pSource, nullptr);
+  glCompileShader(stage);
+  
+  GLint compiled = 0;
+  glGetShaderiv(stage, GL_COMPILE_STATUS, &compiled);
+  
+  if (!compiled)
+  {
+    char log[1024];
+    glGetShaderInfoLog(stage, sizeof(log), nullptr, log);
+    DBGMSG("IGraphicsNanoVG: shader failed to compile: %s\n", log);
+    glDeleteShader(stage);
+    return 0;
+  }
+  
+  return stage;
+}
+
+// The program that draws a shader's GLSL over a full screen triangle, whose texture coordinates put row 0 of the target at uv.y == 0
+static GLuint CreateShaderProgram(const char* glsl)
+{
+  const std::string vertex = std::string(kShaderVersion) + kShaderVertexIn + " vec2 aPosition;\n" + kShaderVaryingOut + " vec2 vUV;\n"
+                             "void main() { vUV = aPosition * 0.5 + 0.5; gl_Position = vec4(aPosition, 0.0, 1.0); }\n";
+  
+  std::string fragment = std::string(kShaderVersion) + kShaderFragmentIn;
+  fragment += "uniform float uValues[" + std::to_string(IShader::kMaxValues) + "];\nuniform vec2 uSize;\nuniform sampler2D uTexture;\n";
+  fragment += glsl;
+  fragment += "\nvoid main() { fragColor = shade(vUV); }\n";
+  
+  GLuint vertexStage = CompileShaderStage(GL_VERTEX_SHADER, vertex);
+  GLuint fragmentStage = CompileShaderStage(GL_FRAGMENT_SHADER, fragment);
+  GLuint program = 0;
+  
+  if (vertexStage && fragmentStage)
+  {
+    program = glCreateProgram();
+    glAttachShader(program, vertexStage);
+    glAttachShader(program, fragmentStage);
+    glBindAttribLocation(program, 0, "aPosition");
+    glLinkProgram(program);
+    
+    GLint linked = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    
+    if (!linked)
+    {
+      DBGMSG("IGraphicsNanoVG: shader failed to link\n");
+      glDeleteProgram(program);
+      program = 0;
+    }
+  }
+  
+  glDeleteShader(vertexStage);
+  glDeleteShader(fragmentStage);
+  return program;
+}
+
+bool IGraphicsNanoVG::RenderShader(const IShader& shader, const ILayerPtr& layer)
+{
+  if (!*shader.GetGLSL())
+    return false;
+  
+  auto it = mShaderPrograms.find(shader.GetGLSL());
+  
+  if (it == mShaderPrograms.end())
+    it = mShaderPrograms.emplace(shader.GetGLSL(), CreateShaderProgram(shader.GetGLSL())).first;
+  
+  const GLuint program = it->second;
+  
+  if (!program)
+    return false;
+  
+  const APIBitmap* pBitmap = layer->GetAPIBitmap();
+  const int width = pBitmap->GetWidth();
+  const int height = pBitmap->GetHeight();
+  
+  if (!mShaderFBO)
+  {
+    static const float kTriangle[] = { -1.f, -1.f, 3.f, -1.f, -1.f, 3.f };
+    
+    glGenFramebuffers(1, &mShaderFBO);
+    glGenBuffers(1, &mShaderVertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, mShaderVertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(kTriangle), kTriangle, GL_STATIC_DRAW);
+#if defined IGRAPHICS_GL3 || defined IGRAPHICS_GLES3
+    glGenVertexArrays(1, &mShaderVertexArray);
+#endif
+  }
+  
+  // this draws at once, while NanoVG draws at the end of the frame, so the GL state it relies on between its calls is put back
+  GLint prevFBO = 0, prevProgram = 0, prevTexture = 0, prevArrayBuffer = 0, prevViewport[4];
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prevFBO);
+  glGetIntegerv(GL_CURRENT_PROGRAM, &prevProgram);
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &prevTexture);
+  glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &prevArrayBuffer);
+  glGetIntegerv(GL_VIEWPORT, prevViewport);
+  const GLboolean blend = glIsEnabled(GL_BLEND);
+  const GLboolean scissor = glIsEnabled(GL_SCISSOR_TEST);
+  const GLboolean stencil = glIsEnabled(GL_STENCIL_TEST);
+  const GLboolean cull = glIsEnabled(GL_CULL_FACE);
+  
+  glBindFramebuffer(GL_FRAMEBUFFER, mShaderFBO);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, nvglImageHandle(mVG, pBitmap->GetBitmap()), 0);
+  const bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+  
+  if (complete)
+  {
+    glViewport(0, 0, width, height);
+    glDisable(GL_BLEND);
+    glDisable(GL_SCISSOR_TEST);
+    glDisable(GL_STENCIL_TEST);
+    glDisable(GL_CULL_FACE);
+    
+    glUseProgram(program);
+    glUniform1fv(glGetUniformLocation(program, "uValues"), IShader::kMaxValues, shader.GetValues());
+    glUniform2f(glGetUniformLocation(program, "uSize"), static_cast<float>(width), static_cast<float>(height));
+    glUniform1i(glGetUniformLocation(program, "uTexture"), 0);
+    
+    const IBitmap& texture = shader.GetTexture();
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture.IsValid() ? nvglImageHandle(mVG, texture.GetAPIBitmap()->GetBitmap()) : 0);
+    
+#if defined IGRAPHICS_GL3 || defined IGRAPHICS_GLES3
+    glBindVertexArray(mShaderVertexArray);
+#endif
+    glBindBuffer(GL_ARRAY_BUFFER, mShaderVertexBuffer);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (const GLvoid*) 0);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glDisableVertexAttribArray(0);
+#if defined IGRAPHICS_GL3 || defined IGRAPHICS_GLES3
+    glBindVertexArray(0);
+#endif
+  }
+  
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, prevFBO);
+  glViewport(prevViewport[0], prevViewport[1], prevViewport[2], prevViewport[3]);
+  glUseProgram(prevProgram);
+  glBindTexture(GL_TEXTURE_2D, prevTexture);
+  glBindBuffer(GL_ARRAY_BUFFER, prevArrayBuffer);
+  if (blend) glEnable(GL_BLEND);
+  if (scissor) glEnable(GL_SCISSOR_TEST);
+  if (stencil) glEnable(GL_STENCIL_TEST);
+  if (cull) glEnable(GL_CULL_FACE);
+  
+  return complete;
+}
+
+void IGraphicsNanoVG::ReleaseShaders()
+{
+  for (auto& program : mShaderPrograms)
+  {
+    if (program.second)
+      glDeleteProgram(program.second);
+  }
+  
+  mShaderPrograms.clear();
+  
+  if (mShaderFBO)
+  {
+    glDeleteFramebuffers(1, &mShaderFBO);
+    glDeleteBuffers(1, &mShaderVertexBuffer);
+#if defined IGRAPHICS_GL3 || defined IGRAPHICS_GLES3
+    glDeleteVertexArrays(1, &mShaderVertexArray);
+#endif
+  }
+  
+  mShaderFBO = mShaderVertexBuffer = mShaderVertexArray = 0;
+}
+#elif defined IGRAPHICS_METAL && defined OS_MAC
+// The functions around a shader's MSL, drawing it over a full screen triangle whose texture coordinates put row 0 of the target at uv.y == 0, see IShader
+static const char* kShaderPrelude = R"(
+#include <metal_stdlib>
+using namespace metal;
+
+struct ShaderVertexOut
+{
+  float4 position [[position]];
+  float2 uv;
+};
+
+vertex ShaderVertexOut shaderVertex(uint vid [[vertex_id]])
+{
+  const float2 positions[3] = { float2(-1.0, -1.0), float2(3.0, -1.0), float2(-1.0, 3.0) };
+  ShaderVertexOut out;
+  out.position = float4(positions[vid], 0.0, 1.0);
+  out.uv = float2(positions[vid].x * 0.5 + 0.5, 0.5 - positions[vid].y * 0.5);
+  return out;
+}
+)";
+
+static const char* kShaderMain = R"(
+fragment float4 shaderFragment(ShaderVertexOut in [[stage_in]], constant float* values [[buffer(0)]], constant float2& size [[buffer(1)]],
+                               texture2d<float> tex [[texture(0)]], sampler smp [[sampler(0)]])
+{
+  return shade(in.uv, values, size, tex, smp);
+}
+)";
+
+static void* CreateShaderPipeline(id<MTLDevice> device, const char* msl)
+{
+  NSString* source = [NSString stringWithFormat:@"%s%s%s", kShaderPrelude, msl, kShaderMain];
+  NSError* error = nil;
+  id<MTLLibrary> library = [device newLibraryWithSource:source options:nil error:&error];
+  
+  if (!library)
   {
-    idx = nvgCreateImage(mVG, fileNameOrResID, 0);
+    DBGMSG("IGraphicsNanoVG: shader failed to compile: %s\n", [[error localizedDescription] UTF8String]);
+    return nullptr;
   }
+  
+  MTLRenderPipelineDescriptor* descriptor = [[MTLRenderPipelineDescriptor alloc] init];
+  id<MTLFunction> vertexFunction = [library newFunctionWithName:@"shaderVertex"];
+  id<MTLFunction> fragmentFunction = [library newFunctionWithName:@"shaderFragment"];
+  descriptor.vertexFunction = vertexFunction;
+  descriptor.fragmentFunction = fragmentFunction;
+  descriptor.colorAttachments[0].pixelFormat = MTLPixelFormatRGBA8Unorm;
+  
+  id<MTLRenderPipelineState> pipeline = [device newRenderPipelineStateWithDescriptor:descriptor error:&error];
+  
+  if (!pipeline)
+    DBGMSG("IGraphicsNanoVG: shader failed to link: %s\n", [[error localizedDescription] UTF8String]);
+  
+  [vertexFunction release];
+  [fragmentFunction release];
+  [descriptor release];
+  [library release];
+  return pipeline;
+}
+
+bool IGraphicsNanoVG::RenderShader(const IShader& shader, const ILayerPtr& layer)
+{
+  if (!*shader.GetMSL())
+    return false;
+  
+  auto it = mShaderPipelines.find(shader.GetMSL());
+  
+  if (it == mShaderPipelines.end())
+    it = mShaderPipelines.emplace(shader.GetMSL(), CreateShaderPipeline(static_cast<id<MTLDevice>>(mnvgDevice(mVG)), shader.GetMSL())).first;
+  
+  id<MTLRenderPipelineState> pipeline = static_cast<id<MTLRenderPipelineState>>(it->second);
+  
+  if (!pipeline)
+    return false;
+  
+  const APIBitmap* pBitmap = layer->GetAPIBitmap();
+  const float size[2] = { static_cast<float>(pBitmap->GetWidth()), static_cast<float>(pBitmap->GetHeight()) };
+  
+  MTLRenderPassDescriptor* pass = [MTLRenderPassDescriptor renderPassDescriptor];
+  pass.colorAttachments[0].texture = static_cast<id<MTLTexture>>(mnvgImageHandle(mVG, pBitmap->GetBitmap()));
+  pass.colorAttachments[0].loadAction = MTLLoadActionDontCare;
+  pass.colorAttachments[0].storeAction = MTLStoreActionStore;
+  
+  // committed to NanoVG's queue before the frame's own command buffer, so the layer is drawn by the time NanoVG samples it
+  id<MTLCommandBuffer> commandBuffer = [static_cast<id<MTLCommandQueue>>(mnvgCommandQueue(mVG)) commandBuffer];
+  id<MTLRenderCommandEncoder> encoder = [commandBuffer renderCommandEncoderWithDescriptor:pass];
+  [encoder setRenderPipelineState:pipeline];
+  [encoder setFragmentBytes:shader.GetValues() length:IShader::kMaxValues * sizeof(float) atIndex:0];
+  [encoder setFragmentBytes:size length:sizeof(size) atIndex:1];
+  
+  const IBitmap& texture = shader.GetTexture();
+  
+  if (texture.IsValid())
+    [encoder setFragmentTexture:static_cast<id<MTLTexture>>(mnvgImageHandle(mVG, texture.GetAPIBitmap()->GetBitmap())) atIndex:0];
+  
+  MTLSamplerDescriptor* samplerDescriptor = [[MTLSamplerDescriptor alloc] init];
+  samplerDescriptor.minFilter = MTLSamplerMinMagFilterLinear;
+  samplerDescriptor.magFilter = MTLSamplerMinMagFilterLinear;
+  id<MTLSamplerState> sampler = [static_cast<id<MTLDevice>>(mnvgDevice(mVG)) newSamplerStateWithDescriptor:samplerDescriptor];
+  [encoder setFragmentSamplerState:sampler atIndex:0];
+  
+  [encoder drawPrimitives:MTLPrimitiveTypeTriangle vertexStart:0 vertexCount:3];
+  [encoder endEncoding];
+  [commandBuffer commit];
+  
+  [sampler release];
+  [samplerDescriptor release];
+  return true;
+}
+
+void IGraphicsNanoVG::ReleaseShaders()
+{
+  for (auto& pipeline : mShaderPipelines)
+    [static_cast<id<MTLRenderPipelineState>>(pipeline.second) release];
+  
+  mShaderPipelines.clear();
+}
+#else
+bool IGraphicsNanoVG::RenderShader(const IShader& shader, const ILayerPtr& layer)
+{
+  return false;
+}
 
-  return new NanoVGBitmap(mVG, fileNameOrResID, scale, idx);
+void IGraphicsNanoVG::ReleaseShaders()
+{
 }
+#endif
 
 APIBitmap* IGraphicsNanoVG::CreateAPIBitmap(int width, int height, int scale, double drawScale)
 {
+  // small layers are packed into shared pages
+  if (width <= kAtlasMaxLayerSize && height <= kAtlasMaxLayerSize)
+  {
+    int x, y;
+    
+    for (int i = 0; i < mAtlasPages.GetSize(); i++)
+    {
+      NanoVGAtlasPage* pPage = mAtlasPages.Get(i);
+      
+      if (pPage->mPacker.Alloc(width, height, x, y))
+        return new NanoVGBitmap(this, mVG, pPage, x, y, width, height, scale, drawScale);
+    }
+    
+    if (mAtlasPages.GetSize() < kAtlasMaxPages)
+    {
+      std::unique_ptr<NanoVGAtlasPage> pPage(new NanoVGAtlasPage(kAtlasPageSize));
+      pPage->mFBO = nvgCreateFramebuffer(mVG, kAtlasPageSize, kAtlasPageSize, 0);
+      
+      if (pPage->mFBO && pPage->mPacker.Alloc(width, height, x, y))
+      {
+        mAtlasPages.Add(pPage.get());
+        return new NanoVGBitmap(this, mVG, pPage.release(), x, y, width, height, scale, drawScale);
+      }
+      
+      if (pPage->mFBO)
+        nvgDeleteFramebuffer(pPage->mFBO);
+    }
+  }
+  
   return new NanoVGBitmap(this, mVG, width, height, scale, drawScale);
 }
 
+void IGraphicsNanoVG::FreeAtlasRegion(NanoVGAtlasPage* pPage, int y)
+{
+  pPage->mPacker.Free(y);
+  
+  if (!pPage->mPacker.Empty())
+    return;
+  
+  if (pPage->mOrphaned)
+    delete pPage;
+  else if (mAtlasPages.Find(pPage) > 0) // keep the first page, rather than create it again for the next layer
+  {
+    DeleteFBO(pPage->mFBO);
+    mAtlasPages.DeletePtr(pPage);
+    delete pPage;
+  }
+}
+
+void IGraphicsNanoVG::ReleaseAtlasPages()
+{
+  for (int i = 0; i < mAtlasPages.GetSize(); i++)
+  {
+    NanoVGAtlasPage* pPage = mAtlasPages.Get(i);
+    nvgDeleteFramebuffer(pPage->mFBO);
+    pPage->mFBO = nullptr;
+    
+    if (pPage->mPacker.Empty())
+      delete pPage;
+    else
+      pPage->mOrphaned = true;
+  }
+  
+  mAtlasPages.Empty();
+}
+
 void IGraphicsNanoVG::GetLayerBitmapData(const ILayerPtr& layer, RawBitmapData& data)
 {
   const APIBitmap* pBitmap = layer->GetAPIBitmap();
@@ -320,12 +1121,55 @@ void IGraphicsNanoVG::GetLayerBitmapData(const ILayerPtr& layer, RawBitmapData&
   
   if (data.GetSize() >= size)
   {
+    const NanoVGBitmap* pNVGBitmap = static_cast<const NanoVGBitmap*>(pBitmap);
+    int x = 0, y = 0;
+    
+    if (pNVGBitmap->GetAtlasPage())
+    {
+      x = pNVGBitmap->GetAtlasX();
+#if defined(IGRAPHICS_GL)
+      y = pNVGBitmap->GetAtlasPage()->mPacker.GetHeight() - pNVGBitmap->GetAtlasY() - pBitmap->GetHeight(); // bottom up
+#else
+      y = pNVGBitmap->GetAtlasY();
+#endif
+    }
+    
     PushLayer(layer.get(), false);
-    nvgReadPixels(mVG, pBitmap->GetBitmap(), 0, 0, pBitmap->GetWidth(), pBitmap->GetHeight(), data.Get());
+    nvgReadPixels(mVG, pBitmap->GetBitmap(), x, y, pBitmap->GetWidth(), pBitmap->GetHeight(), data.Get());
     PopLayer(false);    
   }
 }
 
+bool IGraphicsNanoVG::ReadLayerPixels(const ILayerPtr& layer, RawBitmapData& data)
+{
+  GetLayerBitmapData(layer, data);
+  
+  const APIBitmap* pBitmap = layer->GetAPIBitmap();
+  const int stride = pBitmap->GetWidth() * 4;
+  const int height = pBitmap->GetHeight();
+  
+  if (data.GetSize() < stride * height)
+    return false;
+  
+  // GL reads the rows bottom up
+  if (FlippedBitmap())
+  {
+    WDL_TypedBuf<uint8_t> row;
+    row.Resize(stride);
+    
+    for (int y = 0; y < height / 2; y++)
+    {
+      uint8_t* pTop = data.Get() + y * stride;
+      uint8_t* pBottom = data.Get() + (height - 1 - y) * stride;
+      memcpy(row.Get(), pTop, stride);
+      memcpy(pTop, pBottom, stride);
+      memcpy(pBottom, row.Get(), stride);
+    }
+  }
+  
+  return true;
+}
+
 void IGraphicsNanoVG::ApplyShadowMask(ILayerPtr& layer, RawBitmapData& mask, const IShadow& shadow)
 {
   const APIBitmap* pBitmap = layer->GetAPIBitmap();
@@ -372,6 +1216,8 @@ void IGraphicsNanoVG::ApplyShadowMask(ILayerPtr& layer, RawBitmapData& mask, con
 
 void IGraphicsNanoVG::OnViewInitialized(void* pContext)
 {
+  TRACE_SCOPE;
+  
   int flags = NVG_ANTIALIAS | NVG_STENCIL_STROKES;
   
 #if defined IGRAPHICS_METAL
@@ -389,6 +1235,9 @@ void IGraphicsNanoVG::OnViewDestroyed()
 {
   // need to free framebuffers, before deleting context
   RemoveAllControls();
+  ClearSVGCache();
+  ReleaseAtlasPages();
+  ReleaseShaders();
 
   StaticStorage<APIBitmap>::Accessor storage(mBitmapCache);
   storage.Clear();
@@ -404,6 +1253,14 @@ void IGraphicsNanoVG::OnViewDestroyed()
   mVG = nullptr;
 }
 
+void IGraphicsNanoVG::ReportDrawingMemory(IMemoryReport& report)
+{
+  // the textures are in GPU memory, and each editor has its own, since they belong to its context
+  IGraphics::ReportDrawingMemory(report);
+  StaticStorage<APIBitmap>::SharedAccessor storage(mBitmapCache);
+  report.Add(kMemoryGraphics, "Bitmap textures", storage.GetBytes(), storage.GetCount());
+}
+
 void IGraphicsNanoVG::DrawResize()
 {
   if (mMainFrameBuffer != nullptr)
@@ -424,8 +1281,11 @@ void IGraphicsNanoVG::BeginFrame()
   //  mnvgClearWithColor(mVG, nvgRGBAf(0, 0, 0, 0));
 #else
     glViewport(0, 0, WindowWidth() * GetScreenScale(), WindowHeight() * GetScreenScale());
+  
     glClearColor(0.f, 0.f, 0.f, 0.f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+  
+    // a retained back buffer keeps the last frame outside of the regions that are about to be presented
+    glClear((mBackBufferRetained ? 0 : GL_COLOR_BUFFER_BIT) | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
   #if defined OS_MAC
     glGetIntegerv(GL_FRAMEBUFFER_BINDING, &mInitialFBO); // stash apple fbo
   #endif
@@ -447,10 +1307,30 @@ void IGraphicsNanoVG::EndFrame()
 
   nvgSave(mVG);
   nvgResetTransform(mVG);
-  nvgBeginPath(mVG);
-  nvgRect(mVG, 0, 0, WindowWidth(), WindowHeight());
-  nvgFillPaint(mVG, img);
-  nvgFill(mVG);
+  
+  // only the redrawn regions need copying into a back buffer that still holds the rest of the last frame
+  if (mBackBufferRetained && mFrameRegions)
+  {
+    nvgGlobalCompositeOperation(mVG, NVG_COPY);
+    
+    // one fill for each, since a single rectangle is convex and doesn't need the stencil
+    for (int i = 0; i < mFrameRegions->Size(); i++)
+    {
+      const IRECT r = mFrameRegions->Get(i).GetScaled(GetDrawScale());
+      nvgBeginPath(mVG);
+      nvgRect(mVG, r.L, r.T, r.W(), r.H());
+      nvgFillPaint(mVG, img);
+      nvgFill(mVG);
+    }
+  }
+  else
+  {
+    nvgBeginPath(mVG);
+    nvgRect(mVG, 0, 0, WindowWidth(), WindowHeight());
+    nvgFillPaint(mVG, img);
+    nvgFill(mVG);
+  }
+  
   nvgRestore(mVG);
   
 #if defined OS_MAC && defined IGRAPHICS_GL
@@ -464,9 +1344,16 @@ void IGraphicsNanoVG::EndFrame()
 
 void IGraphicsNanoVG::DrawBitmap(const IBitmap& bitmap, const IRECT& dest, int srcX, int srcY, const IBlend* pBlend)
 {
+  if (mDisplayList)
+    mDisplayList->AddBitmap(bitmap, dest, srcX, srcY, pBlend);
+  
   APIBitmap* pAPIBitmap = bitmap.GetAPIBitmap();
   
   assert(pAPIBitmap);
+
+#ifdef OS_WEB
+  static_cast<NanoVGBitmap*>(pAPIBitmap)->RequestIfStreamed();
+#endif
     
   // First generate a scaled image paint
   NVGpaint imgPaint;
@@ -480,6 +1367,19 @@ void IGraphicsNanoVG::DrawBitmap(const IBitmap& bitmap, const IRECT& dest, int s
   imgPaint.extent[0] = bitmap.W() * bitmap.GetScale();
   imgPaint.extent[1] = bitmap.H() * bitmap.GetScale();
   imgPaint.image = pAPIBitmap->GetBitmap();
+  
+  const NanoVGAtlasPage* pPage = static_cast<NanoVGBitmap*>(pAPIBitmap)->GetAtlasPage();
+  
+  if (pPage)
+  {
+    // the bitmap is a region of a shared page
+    const double pixelScale = 1.0 / (pAPIBitmap->GetScale() * pAPIBitmap->GetDrawScale());
+    imgPaint.xform[4] -= static_cast<NanoVGBitmap*>(pAPIBitmap)->GetAtlasX() * pixelScale;
+    imgPaint.xform[5] -= static_cast<NanoVGBitmap*>(pAPIBitmap)->GetAtlasY() * pixelScale;
+    imgPaint.extent[0] = pPage->mPacker.GetWidth();
+    imgPaint.extent[1] = pPage->mPacker.GetHeight();
+  }
+  
   imgPaint.radius = imgPaint.feather = 0.f;
   imgPaint.innerColor = imgPaint.outerColor = nvgRGBAf(1, 1, 1, BlendWeight(pBlend));
     
@@ -496,31 +1396,49 @@ void IGraphicsNanoVG::DrawBitmap(const IBitmap& bitmap, const IRECT& dest, int s
 
 void IGraphicsNanoVG::PathClear()
 {
+  if (mDisplayList)
+    mDisplayList->AddPathClear();
+  
   nvgBeginPath(mVG);
 }
 
 void IGraphicsNanoVG::PathClose()
 {
+  if (mDisplayList)
+    mDisplayList->AddPathClose();
+  
   nvgClosePath(mVG);
 }
 
 void IGraphicsNanoVG::PathArc(float cx, float cy, float r, float aMin, float aMax)
 {
+  if (mDisplayList)
+    mDisplayList->AddPathArc(cx, cy, r, aMin, aMax);
+  
   nvgArc(mVG, cx, cy, r, DegToRad(aMin - 90.f), DegToRad(aMax - 90.f), NVG_CW);
 }
 
 void IGraphicsNanoVG::PathMoveTo(float x, float y)
 {
+  if (mDisplayList)
+    mDisplayList->AddPathMoveTo(x, y);
+  
   nvgMoveTo(mVG, x, y);
 }
 
 void IGraphicsNanoVG::PathLineTo(float x, float y)
 {
+  if (mDisplayList)
+    mDisplayList->AddPathLineTo(x, y);
+  
   nvgLineTo(mVG, x, y);
 }
 
 void IGraphicsNanoVG::PathCurveTo(float x1, float y1, float x2, float y2, float x3, float y3)
 {
+  if (mDisplayList)
+    mDisplayList->AddPathCurveTo(x1, y1, x2, y2, x3, y3);
+  
   nvgBezierTo(mVG, x1, y1, x2, y2, x3, y3);
 }
 
@@ -605,6 +1523,9 @@ bool IGraphicsNanoVG::DoDrawMeasureText(const IText& text, const char* str, IREC
 
 void IGraphicsNanoVG::PathStroke(const IPattern& pattern, float thickness, const IStrokeOptions& options, const IBlend* pBlend)
 {
+  if (mDisplayList)
+    mDisplayList->AddPathStroke(pattern, thickness, options, pBlend);
+  
   // First set options
   switch (options.mCapOption)
   {
@@ -640,6 +1561,9 @@ void IGraphicsNanoVG::PathStroke(const IPattern& pattern, float thickness, const
 
 void IGraphicsNanoVG::PathFill(const IPattern& pattern, const IFillOptions& options, const IBlend* pBlend)
 {
+  if (mDisplayList)
+    mDisplayList->AddPathFill(pattern, options, pBlend);
+  
   nvgPathWinding(mVG, options.mFillRule == kFillWinding ? NVG_CCW : NVG_CW);
   
   if (pattern.mType == kSolidPattern)
@@ -691,12 +1615,27 @@ void IGraphicsNanoVG::UpdateLayer()
   else
   {
     nvgEndFrame(mVG);
+    const NanoVGBitmap* pBitmap = dynamic_cast<const NanoVGBitmap*>(mLayers.top()->GetAPIBitmap());
+    
+    if (const NanoVGAtlasPage* pPage = pBitmap->GetAtlasPage())
+    {
+      // draw to the whole page, PathTransformSetMatrix() offsets the drawing to the layer's region and clipping keeps it there
+      const int pageSize = pPage->mPacker.GetWidth();
+#ifdef IGRAPHICS_GL
+      glViewport(0, 0, pageSize, pageSize);
+#endif
+      nvgBindFramebuffer(pBitmap->GetFBO());
+      nvgBeginFrame(mVG, (float) pageSize / GetScreenScale(), (float) pageSize / GetScreenScale(), GetScreenScale());
+    }
+    else
+    {
 #ifdef IGRAPHICS_GL
-    const double scale = GetBackingPixelScale();
-    glViewport(0, 0, mLayers.top()->Bounds().W() * scale, mLayers.top()->Bounds().H() * scale);
+      const double scale = GetBackingPixelScale();
+      glViewport(0, 0, mLayers.top()->Bounds().W() * scale, mLayers.top()->Bounds().H() * scale);
 #endif
-    nvgBindFramebuffer(dynamic_cast<const NanoVGBitmap*>(mLayers.top()->GetAPIBitmap())->GetFBO());
-    nvgBeginFrame(mVG, mLayers.top()->Bounds().W() * GetDrawScale(), mLayers.top()->Bounds().H() * GetDrawScale(), GetScreenScale());
+      nvgBindFramebuffer(pBitmap->GetFBO());
+      nvgBeginFrame(mVG, mLayers.top()->Bounds().W() * GetDrawScale(), mLayers.top()->Bounds().H() * GetDrawScale(), GetScreenScale());
+    }
   }
 }
 
@@ -705,15 +1644,21 @@ void IGraphicsNanoVG::PathTransformSetMatrix(const IMatrix& m)
   double xTranslate = 0.0;
   double yTranslate = 0.0;
   
+  nvgResetTransform(mVG);
+
   if (!mLayers.empty())
   {
     IRECT bounds = mLayers.top()->Bounds();
     
     xTranslate = -bounds.L;
     yTranslate = -bounds.T;
+    
+    const NanoVGBitmap* pBitmap = static_cast<const NanoVGBitmap*>(mLayers.top()->GetAPIBitmap());
+    
+    if (pBitmap->GetAtlasPage())
+      nvgTranslate(mVG, (float) pBitmap->GetAtlasX() / GetScreenScale(), (float) pBitmap->GetAtlasY() / GetScreenScale());
   }
   
-  nvgResetTransform(mVG);
   nvgScale(mVG, GetDrawScale(), GetDrawScale());
   nvgTranslate(mVG, xTranslate, yTranslate);
   nvgTransform(mVG, m.mXX, m.mYX, m.mXY, m.mYY, m.mTX, m.mTY);
@@ -12,10 +12,14 @@
 
 #include "IPlugPlatform.h"
 #include "IGraphicsPathBase.h"
+#include "IShelfPacker.h"
 
 #include "nanovg.h"
 #include "mutex.h"
+#include <memory>
 #include <stack>
+#include <string>
+#include <unordered_map>
 
 // Thanks to Olli Wang/MOUI for much of this macro magic  https://github.com/ollix/moui
 
@@ -32,18 +36,26 @@
   #define NANOVG_GL2 1
   #define nvgCreateContext(flags) nvgCreateGL2(flags)
   #define nvgDeleteContext(context) nvgDeleteGL2(context)
+  #define nvglCreateImageFromHandle(ctx, texture, w, h, flags) nvglCreateImageFromHandleGL2(ctx, texture, w, h, flags)
+  #define nvglImageHandle(ctx, image) nvglImageHandleGL2(ctx, image)
 #elif defined IGRAPHICS_GLES2
   #define NANOVG_GLES2 1
   #define nvgCreateContext(flags) nvgCreateGLES2(flags)
   #define nvgDeleteContext(context) nvgDeleteGLES2(context)
+  #define nvglCreateImageFromHandle(ctx, texture, w, h, flags) nvglCreateImageFromHandleGLES2(ctx, texture, w, h, flags)
+  #define nvglImageHandle(ctx, image) nvglImageHandleGLES2(ctx, image)
 #elif defined IGRAPHICS_GL3
   #define NANOVG_GL3 1
   #define nvgCreateContext(flags) nvgCreateGL3(flags)
   #define nvgDeleteContext(context) nvgDeleteGL3(context)
+  #define nvglCreateImageFromHandle(ctx, texture, w, h, flags) nvglCreateImageFromHandleGL3(ctx, texture, w, h, flags)
+  #define nvglImageHandle(ctx, image) nvglImageHandleGL3(ctx, image)
 #elif defined IGRAPHICS_GLES3
   #define NANOVG_GLES3 1
   #define nvgCreateContext(flags) nvgCreateGLES3(flags)
   #define nvgDeleteContext(context) nvgDeleteGLES3(context)
+  #define nvglCreateImageFromHandle(ctx, texture, w, h, flags) nvglCreateImageFromHandleGLES3(ctx, texture, w, h, flags)
+  #define nvglImageHandle(ctx, image) nvglImageHandleGLES3(ctx, image)
 #elif defined IGRAPHICS_METAL
   #define nvgCreateContext(layer, flags) nvgCreateMTL(layer, flags)
   #define nvgDeleteContext(context) nvgDeleteMTL(context)
@@ -67,6 +79,50 @@ void nvgReadPixels(NVGcontext* pContext, int image, int x, int y, int width, int
 
 class IGraphicsNanoVG;
 
+#if defined IGRAPHICS_GL
+/** The texture of a bitmap loaded from a file, owned by the bitmaps of every instance's NanoVG context that draw it, when the instances' GL contexts share their objects,
+ * see IGraphicsNanoVG::SetSharesGLResources(). The texture is deleted with the last of them. The textures are found by the bitmap's path and scale
+ * @ingroup APIBitmaps */
+class NanoVGSharedTexture
+{
+public:
+  NanoVGSharedTexture(GLuint texture, int width, int height)
+  : mTexture(texture), mWidth(width), mHeight(height) {}
+
+  ~NanoVGSharedTexture();
+
+  NanoVGSharedTexture(const NanoVGSharedTexture&) = delete;
+  NanoVGSharedTexture& operator=(const NanoVGSharedTexture&) = delete;
+
+  /** @return The texture loaded from a path at a scale, if a bitmap in any context still has it */
+  static std::shared_ptr<NanoVGSharedTexture> Find(const char* path, int scale);
+
+  /** Add a texture, which is found by Find() until it is deleted */
+  static void Add(const std::shared_ptr<NanoVGSharedTexture>& texture, const char* path, int scale);
+
+  GLuint GetTexture() const { return mTexture; }
+  int GetWidth() const { return mWidth; }
+  int GetHeight() const { return mHeight; }
+
+private:
+  GLuint mTexture;
+  int mWidth;
+  int mHeight;
+};
+#endif
+
+/** A framebuffer shared by many small layers, each of which draws into its own region, so that drawing cached layers uses a few textures rather than one each
+ * @ingroup APIBitmaps */
+struct NanoVGAtlasPage
+{
+  NanoVGAtlasPage(int size) : mPacker(size, size) {}
+
+  NVGframebuffer* mFBO = nullptr;
+  IShelfPacker mPacker;
+  /** Set when the view is destroyed while layers still use the page. Its framebuffer is gone, and it is deleted with its last layer */
+  bool mOrphaned = false;
+};
+
 /** An NanoVG API bitmap
  * @ingroup APIBitmaps */
 class NanoVGBitmap : public APIBitmap
@@ -74,13 +130,44 @@ class NanoVGBitmap : public APIBitmap
 public:
   NanoVGBitmap(NVGcontext* pContext, const char* path, double sourceScale, int nvgImageID);
   NanoVGBitmap(IGraphicsNanoVG* pGraphics, NVGcontext* pContext, int width, int height, int scale, float drawScale);
+  /** Create a layer bitmap in a region of an atlas page, which it frees when it is deleted */
+  NanoVGBitmap(IGraphicsNanoVG* pGraphics, NVGcontext* pContext, NanoVGAtlasPage* pPage, int x, int y, int width, int height, int scale, float drawScale);
   NanoVGBitmap(NVGcontext* pContext, int width, int height, const uint8_t* pData, int scale, float drawScale);
   virtual ~NanoVGBitmap();
   NVGframebuffer* GetFBO() const { return mFBO; }
+
+  /** @return The atlas page the bitmap is a region of, or nullptr if it has its own framebuffer or image */
+  NanoVGAtlasPage* GetAtlasPage() const { return mAtlasPage; }
+
+  /** @return The left of the bitmap's region of its atlas page, in pixels */
+  int GetAtlasX() const { return mAtlasX; }
+
+  /** @return The top of the bitmap's region of its atlas page, in pixels */
+  int GetAtlasY() const { return mAtlasY; }
+#if defined IGRAPHICS_GL
+  /** Own a texture with the bitmaps of other contexts. The bitmap's image must have been created with NVG_IMAGE_NODELETE */
+  void SetSharedTexture(const std::shared_ptr<NanoVGSharedTexture>& texture) { mSharedTexture = texture; }
+#endif
+#ifdef OS_WEB
+  /** Set the handle from IPlugResources.addTexture() for a bitmap whose image is streamed into a placeholder texture */
+  void SetStreamHandle(int handle) { mStreamHandle = handle; }
+
+  /** If this is a streamed bitmap that hasn't been asked for yet, ask for its image at high priority. Called when the bitmap is drawn */
+  void RequestIfStreamed();
+#endif
 private:
   IGraphicsNanoVG *mGraphics = nullptr;
   NVGcontext* mVG;
   NVGframebuffer* mFBO = nullptr;
+  NanoVGAtlasPage* mAtlasPage = nullptr;
+  int mAtlasX = 0;
+  int mAtlasY = 0;
+#if defined IGRAPHICS_GL
+  std::shared_ptr<NanoVGSharedTexture> mSharedTexture;
+#endif
+#ifdef OS_WEB
+  int mStreamHandle = -1;
+#endif
 };
 
 /** IGraphics draw class using NanoVG  
@@ -99,6 +186,10 @@ public:
   void OnViewInitialized(void* pContext) override;
   void OnViewDestroyed() override;
   void DrawResize() override;
+  // the main frame buffer holds the last frame, which EndFrame() stretches to the window
+  bool CanPreviewResize() const override { return mMainFrameBuffer != nullptr; }
+  bool BitmapsAreTextures() const override { return true; }
+  void ReportDrawingMemory(IMemoryReport& report) override;
 
   void DrawBitmap(const IBitmap& bitmap, const IRECT& dest, int srcX, int srcY, const IBlend* pBlend) override;
 
@@ -115,6 +206,8 @@ public:
   void PathFill(const IPattern& pattern, const IFillOptions& options, const IBlend* pBlend) override;
   
   IColor GetPoint(int x, int y) override;
+  void UpdatePixelLayer(const ILayerPtr& layer, const uint8_t* pData, int x, int y, int width, int height) override;
+  bool RenderShader(const IShader& shader, const ILayerPtr& layer) override;
   void* GetDrawContext() override { return (void*) mVG; }
     
   IBitmap LoadBitmap(const char* name, int nStates, bool framesAreHorizontal, int targetScale) override;
@@ -123,10 +216,47 @@ public:
   bool BitmapExtSupported(const char* ext) override;
 
   void DeleteFBO(NVGframebuffer* pBuffer);
+
+  /** Generate mip levels for the bitmaps loaded after this, so that they are sampled smoothly and cheaply when drawn smaller than their size, for a third more texture memory.
+   * Bitmaps loaded from compressed .ktx files use the mip levels stored in the file instead
+   * @param enable \c true to generate mip levels */
+  void SetBitmapMipmaps(bool enable) { mBitmapImageFlags = enable ? NVG_IMAGE_GENERATE_MIPMAPS : 0; }
+
+#if defined IGRAPHICS_GL
+  /** Called by the platform class once it has created the view's GL context, with \c true if the context shares its objects with those of the other instances' views,
+   * which it does when IGRAPHICS_SHARE_GL_RESOURCES is defined. The bitmaps loaded from files are then uploaded once per process, and drawn by every instance from the same textures
+   * @param share \c true if the context shares its objects */
+  void SetSharesGLResources(bool share) { mSharesGLResources = share; }
+#endif
+
+  /** Free the region of an atlas page used by a layer bitmap, deleting the page if it is no longer needed
+   * @param pPage The page
+   * @param y The top of the region */
+  void FreeAtlasRegion(NanoVGAtlasPage* pPage, int y);
+
+  /** The largest layer, in pixels on each side, that is packed into an atlas page rather than given a framebuffer of its own */
+  static constexpr int kAtlasMaxLayerSize = 256;
+
+  /** The size of each atlas page, in pixels on each side */
+  static constexpr int kAtlasPageSize = 2048;
+
+  /** The most atlas pages, once they are full layers get framebuffers of their own */
+  static constexpr int kAtlasMaxPages = 8;
+
+#ifdef OS_WEB
+  /** Replace the placeholder texture of a streamed bitmap with its image, see IPlugResources.js
+   * @param textureID The NanoVG image ID of the placeholder
+   * @param pPixels The image's RGBA pixels, at the size of the placeholder */
+  void UpdateStreamedImage(int textureID, const uint8_t* pPixels) { nvgUpdateImage(mVG, textureID, pPixels); }
+#endif
     
 protected:
   APIBitmap* LoadAPIBitmap(const char* fileNameOrResID, int scale, EResourceLocation location, const char* ext) override;
   APIBitmap* CreateAPIBitmap(int width, int height, int scale, double drawScale) override;
+  IBitmapPreloader::DecodeFunc GetBitmapDecodeFunc() override;
+  APIBitmap* CreateAPIBitmapFromPixels(const IBitmapPreloader::Bitmap& bitmap) override;
+  APIBitmap* CreatePixelAPIBitmap(int width, int height) override;
+  StaticStorage<APIBitmap>& GetBitmapCache() override { return mBitmapCache; }
 
   bool LoadAPIFont(const char* fontID, const PlatformFontPtr& font) override;
 
@@ -142,6 +272,7 @@ protected:
   }
 
   void GetLayerBitmapData(const ILayerPtr& layer, RawBitmapData& data) override;
+  bool ReadLayerPixels(const ILayerPtr& layer, RawBitmapData& data) override;
   void ApplyShadowMask(ILayerPtr& layer, RawBitmapData& mask, const IShadow& shadow) override;
 
   bool DoDrawMeasureText(const IText& text, const char* str, IRECT& bounds, const IBlend* pBlend, bool measure) override;
@@ -151,13 +282,47 @@ private:
   void SetClipRegion(const IRECT& r) override;
   void UpdateLayer() override;
   void ClearFBOStack();
+
+#ifdef IGRAPHICS_GL
+  /** @return A bitmap of the texture that another instance's context loaded from the path at the scale, or nullptr if there isn't one or the contexts don't share textures */
+  APIBitmap* LoadSharedAPIBitmap(const char* path, int scale);
+#endif
+
+  /** @return A bitmap of an image loaded from a file, whose texture is shared with other instances' contexts if they share textures */
+  NanoVGBitmap* CreateFileAPIBitmap(const char* path, int scale, int nvgImageID);
+
+  /** @return The flags to create the images of bitmaps loaded from files with */
+  int GetBitmapImageFlags() const;
+
+#ifdef IGRAPHICS_GL
+  /** Load a bitmap from a KTX file of GPU compressed texture data, such as BC7 or ASTC, made from the bitmap's PNG when the plug-in is built
+   * @return The bitmap, or nullptr if the format isn't supported by the GPU */
+  APIBitmap* LoadCompressedAPIBitmap(const char* fileNameOrResID, int scale, EResourceLocation location);
+#endif
+
+  /** Delete the atlas pages' framebuffers before the context is destroyed, orphaning pages that are still in use */
+  void ReleaseAtlasPages();
+
+  /** Delete the shaders' programs or pipelines, and the objects that run them, before the context is destroyed */
+  void ReleaseShaders();
     
   
   bool mInDraw = false;
   WDL_Mutex mFBOMutex;
   std::stack<NVGframebuffer*> mFBOStack; // A stack of FBOs that requires freeing at the end of the frame
+  WDL_PtrList<NanoVGAtlasPage> mAtlasPages;
   StaticStorage<APIBitmap> mBitmapCache; //not actually static (doesn't require retaining or releasing)
   NVGcontext* mVG = nullptr;
   NVGframebuffer* mMainFrameBuffer = nullptr;
   int mInitialFBO = 0;
+  int mBitmapImageFlags = 0;
+#if defined IGRAPHICS_GL
+  bool mSharesGLResources = false;
+  std::unordered_map<std::string, GLuint> mShaderPrograms; // by GLSL source, 0 for those that failed to compile
+  GLuint mShaderFBO = 0;
+  GLuint mShaderVertexBuffer = 0;
+  GLuint mShaderVertexArray = 0;
+#elif defined IGRAPHICS_METAL
+  std::unordered_map<std::string, void*> mShaderPipelines; // id<MTLRenderPipelineState> by MSL source, nullptr for those that failed to compile
+#endif
 };
@@ -0,0 +1,203 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IBitmapPreloader
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "IPlugWorkerPool.h"
+
+#include "IGraphicsConstants.h"
+#include "IGraphicsStructs.h"
+
+/** Decodes bitmaps to pixels on the process wide IPlugWorkerPool, for IGraphics::PreloadBitmaps(), so that the files of a UI are decoded in parallel
+ * while the UI thread lays it out. The pixels are turned into an APIBitmap on the UI thread, where GPU backends can upload them.
+ * A bitmap that the UI thread needs before a worker has started on it is decoded on the UI thread, one that a worker is decoding is waited for.
+ * The decoding only uses the bitmaps and a plain function, so that it can finish safely after the IGraphics that queued it has gone */
+class IBitmapPreloader
+{
+public:
+  enum EState { kPending, kDecoding, kDecoded, kTaken };
+
+  /** A bitmap to decode, and its pixels once decoded */
+  struct Bitmap
+  {
+    WDL_String name;      // the name the bitmap is cached under
+    WDL_String path;      // the file path or resource ID found by IGraphics::SearchImageResource()
+    WDL_String ext;
+    EResourceLocation location;
+    void* pModule;        // the module to load Windows resources from
+    int scale;
+    RawBitmapData pixels; // 8 bit RGBA, with straight alpha
+    int width = 0;
+    int height = 0;
+    bool ok = false;      // decoding succeeded
+    std::atomic<int> state { kPending };
+  };
+
+  /** Decodes a bitmap's file to its pixels, on any thread, and returns \c true if it succeeded. It must not use the IGraphics instance */
+  using DecodeFunc = bool (*)(Bitmap& bitmap);
+
+  IBitmapPreloader(DecodeFunc func)
+  : mDecodeFunc(func)
+  , mSync(std::make_shared<Sync>())
+  {}
+
+  IBitmapPreloader(const IBitmapPreloader&) = delete;
+  IBitmapPreloader& operator=(const IBitmapPreloader&) = delete;
+
+  /** Bitmaps that are being decoded finish on their own, those that haven't started are dropped */
+  ~IBitmapPreloader()
+  {
+    for (auto& job : mJobs)
+      job->Cancel();
+  }
+
+  /** Queue a bitmap for decoding */
+  void Add(const char* name, const char* path, EResourceLocation location, const char* ext, void* pModule, int scale)
+  {
+    auto bitmap = std::make_shared<Bitmap>();
+    bitmap->name.Set(name);
+    bitmap->path.Set(path);
+    bitmap->ext.Set(ext);
+    bitmap->location = location;
+    bitmap->pModule = pModule;
+    bitmap->scale = scale;
+
+    std::shared_ptr<Sync> sync = mSync;
+    DecodeFunc func = mDecodeFunc;
+    auto job = std::make_shared<IPlugJob>([bitmap, sync, func](IPlugJob&) { Decode(*bitmap, *sync, func); }, nullptr,
+                                          IPlugJob::kPriorityHigh, IPlugJob::ECompletionThread::kMainThread);
+    mBitmaps.push_back(bitmap);
+    mJobs.push_back(job);
+    IPlugWorkerPool::Get().Submit(job);
+  }
+
+  /** @return \c true if a bitmap has been queued
+   * @param path The path it was queued with
+   * @param scale The scale it was queued with */
+  bool Contains(const char* path, int scale) const
+  {
+    return Find(path, scale) != nullptr;
+  }
+
+  /** Take a decoded bitmap, decoding it on this thread if no worker has started on it, or waiting for the worker that has
+   * @param path The path it was queued with
+   * @param scale The scale it was queued with
+   * @return The bitmap, or nullptr if it wasn't queued or has already been taken */
+  std::shared_ptr<Bitmap> Take(const char* path, int scale)
+  {
+    std::shared_ptr<Bitmap> bitmap = Find(path, scale);
+
+    if (!bitmap)
+      return nullptr;
+
+    Decode(*bitmap, *mSync, mDecodeFunc);
+
+    {
+      std::unique_lock<std::mutex> lock(mSync->mutex);
+      mSync->condition.wait(lock, [&bitmap]() { return bitmap->state != kDecoding; });
+    }
+
+    int expected = kDecoded;
+    return bitmap->state.compare_exchange_strong(expected, kTaken) ? bitmap : nullptr;
+  }
+
+  /** Take every bitmap that has been decoded, without waiting for the others
+   * @param func Called with each bitmap */
+  template <class FUNC>
+  void TakeDecoded(FUNC&& func)
+  {
+    for (auto& bitmap : mBitmaps)
+    {
+      int expected = kDecoded;
+
+      if (bitmap->state.compare_exchange_strong(expected, kTaken))
+        func(*bitmap);
+    }
+  }
+
+  /** @return The fraction of the bitmaps that have been decoded */
+  float GetProgress() const
+  {
+    if (mBitmaps.empty())
+      return 1.f;
+
+    int nDecoded = 0;
+
+    for (auto& bitmap : mBitmaps)
+      nDecoded += bitmap->state >= kDecoded;
+
+    return (float) nDecoded / (float) mBitmaps.size();
+  }
+
+  /** @return \c true once every bitmap has been taken */
+  bool Finished() const
+  {
+    for (auto& bitmap : mBitmaps)
+    {
+      if (bitmap->state != kTaken)
+        return false;
+    }
+
+    return true;
+  }
+
+private:
+  struct Sync
+  {
+    std::mutex mutex;
+    std::condition_variable condition;
+  };
+
+  std::shared_ptr<Bitmap> Find(const char* path, int scale) const
+  {
+    for (auto& bitmap : mBitmaps)
+    {
+      if (bitmap->scale == scale && !strcmp(bitmap->path.Get(), path))
+        return bitmap;
+    }
+
+    return nullptr;
+  }
+
+  /** Decode the bitmap, unless another thread has started on it */
+  static void Decode(Bitmap& bitmap, Sync& sync, DecodeFunc func)
+  {
+    int expected = kPending;
+
+    if (!bitmap.state.compare_exchange_strong(expected, kDecoding))
+      return;
+
+    bitmap.ok = func(bitmap);
+
+    {
+      std::lock_guard<std::mutex> lock(sync.mutex);
+      bitmap.state = kDecoded;
+    }
+
+    sync.condition.notify_all();
+  }
+
+  DecodeFunc mDecodeFunc;
+  std::shared_ptr<Sync> mSync;
+  std::vector<std::shared_ptr<Bitmap>> mBitmaps;
+  std::vector<std::shared_ptr<IPlugJob>> mJobs;
+};
@@ -114,6 +114,15 @@ void IControl::SetDirty(bool triggerAction)
 {
   mValue = Clip(mValue, mClampLo, mClampHi);
   mDirty = true;
+  mDirtyArea = IRECT();
+  
+  if (mGraphics)
+    mGraphics->QueueDirtyControl(*this);
+  
+  if (mDynamicLayer)
+    mDynamicLayer->Invalidate();
+  
+  mDisplayList.Invalidate();
   
   if (triggerAction)
   {
@@ -142,6 +151,25 @@ void IControl::SetDirty(bool triggerAction)
   }
 }
 
+void IControl::SetDirtyArea(const IRECT& bounds)
+{
+  // an area only narrows a redraw that isn't already of the whole control
+  if (!mDirty)
+    mDirtyArea = bounds;
+  else if (!mDirtyArea.Empty())
+    mDirtyArea = mDirtyArea.Union(bounds);
+  
+  mDirty = true;
+  
+  if (mGraphics)
+    mGraphics->QueueDirtyControl(*this);
+  
+  if (mDynamicLayer)
+    mDynamicLayer->Invalidate();
+  
+  mDisplayList.Invalidate();
+}
+
 bool IControl::IsDirty()
 {
   if(GetAnimationFunction()) {
@@ -189,6 +217,30 @@ void IControl::OnMouseDblClick(float x, float y, const IMouseMod& mod)
   #endif
 }
 
+void IControl::OnMouseDragSamples(const IMouseSample* pSamples, int nSamples)
+{
+  auto sameMod = [](const IMouseMod& a, const IMouseMod& b) {
+    return a.L == b.L && a.R == b.R && a.S == b.S && a.C == b.C && a.A == b.A;
+  };
+
+  float dX = 0.f;
+  float dY = 0.f;
+
+  for (int i = 0; i < nSamples; i++)
+  {
+    const IMouseSample& sample = pSamples[i];
+    dX += sample.dX;
+    dY += sample.dY;
+
+    // a change of modifiers, e.g. shift for fine adjustment, applies from the sample it happened at
+    if (i == nSamples - 1 || !sameMod(sample.ms, pSamples[i + 1].ms))
+    {
+      OnMouseDrag(sample.x, sample.y, dX, dY, sample.ms);
+      dX = dY = 0.f;
+    }
+  }
+}
+
 void IControl::OnPopupMenuSelection(IPopupMenu* pSelectedMenu)
 {
   if (pSelectedMenu != nullptr && mParamIdx >= 0 && !mDisablePrompt)
@@ -31,6 +31,7 @@
 #include "ptrlist.h"
 
 #include "IGraphics.h"
+#include "IDisplayList.h"
 
 /** The lowest level base class of an IGraphics control. A control is anything on the GUI 
 *  @ingroup BaseControls */
@@ -80,6 +81,12 @@ public:
    * @param dY The Y delta (difference) since the last event
    * @param mod A struct indicating which modifier keys are held for the event */
   virtual void OnMouseDrag(float x, float y, float dX, float dY, const IMouseMod& mod) {}
+
+  /** Called once a frame with the drags that have arrived since the last frame, see IGraphics::QueueMouseDrag(). By default each run of samples with the same modifiers
+   * is one OnMouseDrag(), at the last position of the run and with the sum of its deltas. Override it to use every sample, e.g. to draw the path of a fast stroke
+   * @param pSamples The drags, oldest first
+   * @param nSamples The number of drags, at least one */
+  virtual void OnMouseDragSamples(const IMouseSample* pSamples, int nSamples);
    
   /** Implement this method to respond to a mouse double click event on this control. 
    * @param x The X coordinate of the mouse event
@@ -145,6 +152,39 @@ public:
    * @param g The graphics context to which this control belongs. */
   virtual void Draw(IGraphics& g) = 0;
 
+  /** Draw the parts of the control that only change with its bounds or style, such as a track, frame or label. Only called with kCacheStatic, see SetCacheMode()
+   * @param g The graphics context to which this control belongs. */
+  virtual void DrawStatic(IGraphics& g) {}
+
+  /** Draw the parts of the control that change with its value or state, such as a pointer, over those drawn by DrawStatic(). Only called with kCacheStatic, see SetCacheMode().
+   * The default implementation calls Draw(), controls that implement both should draw both in Draw()
+   * @param g The graphics context to which this control belongs. */
+  virtual void DrawDynamic(IGraphics& g) { Draw(g); }
+
+  /** Choose whether IGraphics draws the control into layers and blits those, or replays a recording of its drawing calls, when its region is redrawn, see ECacheMode.
+   * This suits controls that are expensive to draw and are often redrawn because of the controls around or behind them
+   * @param mode The cache mode */
+  void SetCacheMode(ECacheMode mode) { mCacheMode = mode; InvalidateCache(); SetDirty(false); }
+
+  /** @return The cache mode, see SetCacheMode() */
+  ECacheMode GetCacheMode() const { return mCacheMode; }
+
+  /** @return The time spent drawing the control since the draw profile was last reset, see IGraphics::EnableDrawProfiling() */
+  const IDrawStats& GetDrawStats() const { return mDrawStats; }
+
+  /** Discard the cached layers and display list, so that they are redrawn. The layer drawn by DrawStatic() is only redrawn after this, or when the bounds or scale change,
+   * so call it when something DrawStatic() depends on changes. SetDirty() discards the others */
+  void InvalidateCache()
+  {
+    if (mStaticLayer)
+      mStaticLayer->Invalidate();
+    
+    if (mDynamicLayer)
+      mDynamicLayer->Invalidate();
+    
+    mDisplayList.Invalidate();
+  }
+
   /** Implement this to customise how a colored highlight is drawn on the control in ProTools (AAX format only), when a control is linked to a parameter that is automated.
    * @param g The graphics context to which this control belongs. */
   virtual void DrawPTHighlight(IGraphics& g);
@@ -226,7 +266,7 @@ public:
 
   /** Set the rectangular draw area for this control, within the graphics context
    * @param bounds The control's bounds */
-  void SetRECT(const IRECT& bounds) { mRECT = bounds; mMouseIsOver = false; OnResize(); }
+  void SetRECT(const IRECT& bounds) { mRECT = bounds; mMouseIsOver = false; OnResize(); InvalidateControlGrid(); InvalidateCache(); }
   
   /** Get the rectangular mouse tracking target area, within the graphics context for this control
    * @return The control's target bounds within the graphics context */
@@ -234,11 +274,11 @@ public:
 
   /** Set the rectangular mouse tracking target area, within the graphics context for this control
    * @param bounds The control's new target bounds within the graphics context */
-  void SetTargetRECT(const IRECT& bounds) { mTargetRECT = bounds; mMouseIsOver = false; }
+  void SetTargetRECT(const IRECT& bounds) { mTargetRECT = bounds; mMouseIsOver = false; InvalidateControlGrid(); }
   
   /** Set BOTH the draw rect and the target area, within the graphics context for this control
    * @param bounds The control's new draw and target bounds within the graphics context */
-  void SetTargetAndDrawRECTs(const IRECT& bounds) { mRECT = mTargetRECT = bounds; mMouseIsOver = false; OnResize(); }
+  void SetTargetAndDrawRECTs(const IRECT& bounds) { mRECT = mTargetRECT = bounds; mMouseIsOver = false; OnResize(); InvalidateControlGrid(); InvalidateCache(); }
 
   /** Used internally by the AAX wrapper view interface to set the control parmeter highlight 
    * @param isHighlighted /c true if the control should be highlighted 
@@ -283,6 +323,7 @@ public:
   bool GetIgnoreMouse() const { return mIgnoreMouse; }
 
   /** Hit test the control. Override this method if you want the control to be hit only if a visible part of it is hit, or whatever.
+   * NOTE: IGraphics only tests controls with a point near their draw or target bounds, so the hit area must lie within them
    * @param x The X coordinate within the control to test 
    * @param y The y coordinate within the control to test
    * @return \c Return true if the control was hit. */
@@ -302,15 +343,33 @@ public:
    * NOTE: it is easy to forget that this method always sets the control dirty, the argument is about whether a consective action should be performed */
   virtual void SetDirty(bool triggerAction = true);
 
+  /** Mark part of the control as dirty, so that only that area is redrawn at the next display refresh, for controls where a change only affects a small part, such as a key of a keyboard.
+   * The areas marked before a refresh are combined, and SetDirty() in the same refresh redraws the whole control. Unlike SetDirty() no action is triggered
+   * @param bounds The area to redraw, inside the control's bounds */
+  void SetDirtyArea(const IRECT& bounds);
+  
+  /** @return The area to redraw at the next display refresh, which is empty when the whole control is to be redrawn, see SetDirtyArea() */
+  const IRECT& GetDirtyArea() const { return mDirtyArea; }
+  
   /* Set the control clean, i.e. Called by IGraphics draw loop after control has been drawn */
-  virtual void SetClean() { mDirty = false; }
+  virtual void SetClean() { mDirty = false; mDirtyArea = IRECT(); }
   
   /** Called at each display refresh by the IGraphics draw loop to determine if the control is marked as dirty. 
    * This is not const, because it is typically  overridden and used to update something at the display refresh rate
    * The default implementation executes a control's Animation Function, so if you override this you may want to call the base implementation, @see Animation Functions
+   * NOTE: IGraphics only asks the controls that have called SetDirty() since the last refresh, that are animating, or that have called SetPollDirty(true).
+   * Older code that overrides this to check for new data, e.g. a meter reading a queue, and relied on being asked at every refresh, must now call SetPollDirty(true),
+   * in the constructor or OnAttached(), otherwise the control stops redrawing after it is first drawn
    * @return \c true if the control is marked dirty. */
   virtual bool IsDirty();
 
+  /** Ask IGraphics to call IsDirty() at every display refresh, even when the control hasn't been marked dirty, for controls that override IsDirty() to check for new data
+   * @param poll \c true to be polled at every refresh, \c false to only be asked after SetDirty() or while animating */
+  void SetPollDirty(bool poll) { mPollDirty = poll; if (poll && mGraphics) mGraphics->QueuePolledControl(*this); }
+
+  /** @return \c true if IGraphics calls IsDirty() at every display refresh, see SetPollDirty() */
+  bool GetPollDirty() const { return mPollDirty; }
+
   /** Set a range with which to limit the control's movement
    * @param lo The low bounds of the clamp (should be within the range 0-1)
    * @param hi The high bounds of the clamp (should be within the range 0-1) */
@@ -354,6 +413,9 @@ public:
   /** @return A pointer to the IGraphics context that owns this control */ 
   IGraphics* GetUI() { return mGraphics; }
 
+  /** Tell the IGraphics context that the control's bounds have changed, so that its spatial index is rebuilt, see IGraphics::InvalidateControlGrid() */
+  void InvalidateControlGrid() { if (mGraphics) mGraphics->InvalidateControlGrid(); }
+
   /* This can be used in IControl::Draw() to check if the mouse is over the control, without implementing mouse over methods 
    * @return \true if the mouse is over this control. */
   bool GetMouseIsOver() const { return mMouseIsOver; }
@@ -381,12 +443,12 @@ public:
   
   /** Set the animation function
    * @param func A std::function conforming to IAnimationFunction */
-  void SetAnimation(IAnimationFunction func) { mAnimationFunc = func;}
+  void SetAnimation(IAnimationFunction func) { mAnimationFunc = func; QueuePolledControl(); }
   
   /** Set the animation function and starts it
    * @param func A std::function conforming to IAnimationFunction
    * @param duration Duration in milliseconds for the animation  */
-  void SetAnimation(IAnimationFunction func, int duration) { mAnimationFunc = func; StartAnimation(duration); }
+  void SetAnimation(IAnimationFunction func, int duration) { mAnimationFunc = func; StartAnimation(duration); QueuePolledControl(); }
 
   IAnimationFunction GetAnimationFunction() { return mAnimationFunc; }
   
@@ -397,8 +459,15 @@ public:
     if(!mAnimationFunc)
       return 0.;
     
-    auto elapsed = Milliseconds(Time::now() - mAnimationStartTime);
-    return elapsed.count() / mAnimationDuration.count();
+    // measured against the time of the current frame, which may be before an animation that was started since then
+    auto elapsed = Milliseconds(GetAnimationTime() - mAnimationStartTime);
+    return std::max(elapsed.count(), 0.) / mAnimationDuration.count();
+  }
+  
+  /** @return The time to advance animations to, the time of the current frame once the control is attached, see IGraphics::GetFrameTime() */
+  TimePoint GetAnimationTime() const
+  {
+    return mGraphics && mAttached ? mGraphics->GetFrameTime() : Time::now();
   }
   
 #if defined VST3_API || defined VST3C_API
@@ -425,6 +494,7 @@ protected:
   double mClampLo = 0.;
   double mClampHi = 1.;
   bool mDirty = true;
+  IRECT mDirtyArea; // the part of the control marked dirty by SetDirtyArea(), empty if it is all dirty
   bool mHide = false;
   bool mGrayed = false;
   bool mDisablePrompt = true;
@@ -458,6 +528,22 @@ private:
   IAnimationFunction mAnimationFunc = nullptr;
   TimePoint mAnimationStartTime;
   Milliseconds mAnimationDuration;
+
+  /** Register the control with IGraphics while it animates, so that IsDirty() is called at every refresh */
+  void QueuePolledControl() { if (mAnimationFunc && mGraphics) mGraphics->QueuePolledControl(*this); }
+
+  // the dirty and polled lists of IGraphics, see IGraphics::IsDirty(), the cached layers and display list, see SetCacheMode(), and the draw profile
+  friend class IGraphics;
+  ECacheMode mCacheMode = kCacheNone;
+  ILayerPtr mStaticLayer;
+  ILayerPtr mDynamicLayer;
+  IDisplayList mDisplayList;
+  IDrawStats mDrawStats;
+  /** Set while the control is in the IGraphics control stack, only those controls are queued */
+  bool mAttached = false;
+  bool mDirtyQueued = false;
+  bool mPollQueued = false;
+  bool mPollDirty = false;
 };
 
 #pragma mark - Base Controls
@@ -553,12 +639,15 @@ public:
     if(pX3Color) AddColor(*pX3Color);
   }
 
+  /** Redraw the control, including the parts it caches with kCacheStatic, after its style has changed */
+  void OnStyleChanged() { mControl->InvalidateCache(); mControl->SetDirty(false); }
+
   void SetColor(int colorIdx, const IColor& color)
   {
     if(colorIdx < mColors.GetSize())
       mColors.Get()[colorIdx] = color;
     
-    mControl->SetDirty(false);
+    OnStyleChanged();
   }
   
   void SetColors(const IColor& BGColor,
@@ -581,7 +670,7 @@ public:
     mColors.Get()[kX2] = X2Color;
     mColors.Get()[kX3] = X3Color;
     
-    mControl->SetDirty(false);
+    OnStyleChanged();
   }
 
   void SetColors(const IVColorSpec& spec)
@@ -605,12 +694,12 @@ public:
       return mColors.Get()[0];
   }
   
-  void SetRoundness(float roundness) { mRoundness = Clip(roundness, 0.f, 1.f); mControl->SetDirty(false); }
-  void SetDrawFrame(bool draw) { mDrawFrame = draw; mControl->SetDirty(false); }
-  void SetDrawShadows(bool draw) { mDrawShadows = draw; mControl->SetDirty(false); }
-  void SetEmboss(bool emboss) { mEmboss = emboss; mControl->SetDirty(false); }
-  void SetShadowOffset(float offset) { mShadowOffset = offset; mControl->SetDirty(false); }
-  void SetFrameThickness(float thickness) { mFrameThickness = thickness; mControl->SetDirty(false); }
+  void SetRoundness(float roundness) { mRoundness = Clip(roundness, 0.f, 1.f); OnStyleChanged(); }
+  void SetDrawFrame(bool draw) { mDrawFrame = draw; OnStyleChanged(); }
+  void SetDrawShadows(bool draw) { mDrawShadows = draw; OnStyleChanged(); }
+  void SetEmboss(bool emboss) { mEmboss = emboss; OnStyleChanged(); }
+  void SetShadowOffset(float offset) { mShadowOffset = offset; OnStyleChanged(); }
+  void SetFrameThickness(float thickness) { mFrameThickness = thickness; OnStyleChanged(); }
   void SetSplashRadius(float radius) { mSplashRadius = radius * mMaxSplashRadius; }
 
   void Style(bool drawFrame, bool drawShadows, bool emboss, float roundness, float frameThickness, float shadowOffset, const IVColorSpec& spec)
@@ -787,9 +876,13 @@ public:
   {
     g.FillRect(GetColor(kBG), mRECT);
     
+    // when only some tracks are dirty, the others are clipped anyway
+    const IRECT& region = g.GetDrawRegion();
+    
     for (int ch = 0; ch < MaxNTracks(); ch++)
     {
-      DrawTrack(g, mTrackBounds.Get()[ch], ch);
+      if (region.Empty() || region.Intersects(mTrackBounds.Get()[ch]))
+        DrawTrack(g, mTrackBounds.Get()[ch], ch);
     }
     
     if(mDrawFrame)
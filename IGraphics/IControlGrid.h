@@ -0,0 +1,211 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IControlGrid
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "heapbuf.h"
+
+#include "IGraphicsStructs.h"
+
+/** A uniform grid over the bounds of the controls, which IGraphics uses to find the controls under the mouse and the controls that overlap a dirty region,
+ * without visiting every control. Each cell lists the indices of the items whose bounds touch it, in ascending order, packed into one array.
+ * Items outside the area are clamped to the edge cells. The grid only stores bounds, so hiding or showing an item doesn't change it, but it must be
+ * rebuilt whenever an item is added, removed or moved, see IGraphics::InvalidateControlGrid() */
+class IControlGrid
+{
+public:
+  /** The most cells the grid is divided into */
+  static constexpr int kMaxCells = 16384;
+
+  /** The smallest cell size, in the area's units */
+  static constexpr float kMinCellSize = 8.f;
+
+  /** Mark the grid as out of date, so that it is rebuilt before its next use */
+  void Invalidate() { mValid = false; }
+
+  /** @return \c true if the grid has been built since it was last invalidated */
+  bool IsValid() const { return mValid; }
+
+  /** Build the grid
+   * @param area The area to divide into cells, usually the bounds of the UI
+   * @param nItems The number of items
+   * @param getBounds A callable taking an item index and returning its bounds. Items with empty bounds are left out */
+  template <class GETBOUNDS>
+  void Rebuild(const IRECT& area, int nItems, GETBOUNDS&& getBounds)
+  {
+    const float w = std::max(area.W(), 1.f);
+    const float h = std::max(area.H(), 1.f);
+    const int targetCells = std::max(std::min(nItems / 2, kMaxCells), 1); // about two items a cell
+
+    mL = area.L;
+    mT = area.T;
+    mCellSize = std::max(std::sqrt(w * h / targetCells), kMinCellSize);
+    mNX = std::max(std::min((int) std::ceil(w / mCellSize), kMaxCells), 1);
+    mNY = std::max(std::min((int) std::ceil(h / mCellSize), kMaxCells / mNX), 1);
+
+    const int nCells = mNX * mNY;
+    mCellStart.Resize(nCells + 1);
+    mItemCells.Resize(nItems * 4);
+    int* pStart = mCellStart.Get();
+    int* pItemCells = mItemCells.Get();
+    memset(pStart, 0, (nCells + 1) * sizeof(int));
+
+    // count the items in each cell, then prefix sum the counts into the start of each cell's list
+    for (int i = 0; i < nItems; i++)
+    {
+      const IRECT bounds = getBounds(i);
+      int* pRange = pItemCells + i * 4;
+
+      if (bounds.Empty())
+      {
+        pRange[0] = 1; pRange[1] = 0; pRange[2] = 0; pRange[3] = 0;
+        continue;
+      }
+
+      GetCellRange(bounds, pRange);
+
+      for (int y = pRange[2]; y <= pRange[3]; y++)
+      {
+        for (int x = pRange[0]; x <= pRange[1]; x++)
+          pStart[y * mNX + x + 1]++;
+      }
+    }
+
+    for (int c = 0; c < nCells; c++)
+      pStart[c + 1] += pStart[c];
+
+    mItems.Resize(pStart[nCells]);
+    mFill.Resize(nCells);
+    memcpy(mFill.Get(), pStart, nCells * sizeof(int));
+    int* pItems = mItems.Get();
+    int* pFill = mFill.Get();
+
+    for (int i = 0; i < nItems; i++)
+    {
+      const int* pRange = pItemCells + i * 4;
+
+      for (int y = pRange[2]; y <= pRange[3]; y++)
+      {
+        for (int x = pRange[0]; x <= pRange[1]; x++)
+          pItems[pFill[y * mNX + x]++] = i;
+      }
+    }
+
+    mMarks.Resize(nItems);
+    memset(mMarks.Get(), 0, nItems * sizeof(unsigned int));
+    mStamp = 0;
+    mValid = true;
+  }
+
+  /** Visit the items whose cell contains a point, from the highest index to the lowest, until func returns \c true
+   * @param x The x coordinate of the point
+   * @param y The y coordinate of the point
+   * @param func A callable taking an item index and returning \c true to stop
+   * @return The index for which func returned \c true, or -1 */
+  template <class FUNC>
+  int FindAt(float x, float y, FUNC&& func) const
+  {
+    const int cell = CellY(y) * mNX + CellX(x);
+    const int* pItems = mItems.Get();
+
+    for (int i = mCellStart.Get()[cell + 1] - 1; i >= mCellStart.Get()[cell]; i--)
+    {
+      if (func(pItems[i]))
+        return pItems[i];
+    }
+
+    return -1;
+  }
+
+  /** Find the items whose cells overlap a region
+   * @param bounds The region
+   * @param indices Filled with the indices of the items, each once, in ascending order */
+  void Query(const IRECT& bounds, WDL_TypedBuf<int>& indices)
+  {
+    indices.Resize(0, false);
+
+    if (bounds.Empty() || !mNX)
+      return;
+
+    int range[4];
+    GetCellRange(bounds, range);
+
+    if (++mStamp == 0) // wrapped, clear the marks so that none look current
+    {
+      memset(mMarks.Get(), 0, mMarks.GetSize() * sizeof(unsigned int));
+      mStamp = 1;
+    }
+
+    const int* pStart = mCellStart.Get();
+    const int* pItems = mItems.Get();
+    unsigned int* pMarks = mMarks.Get();
+
+    for (int y = range[2]; y <= range[3]; y++)
+    {
+      for (int x = range[0]; x <= range[1]; x++)
+      {
+        const int cell = y * mNX + x;
+
+        for (int i = pStart[cell]; i < pStart[cell + 1]; i++)
+        {
+          const int item = pItems[i];
+
+          if (pMarks[item] != mStamp)
+          {
+            pMarks[item] = mStamp;
+            indices.Add(item);
+          }
+        }
+      }
+    }
+
+    // a single cell is already in order
+    if (range[0] != range[1] || range[2] != range[3])
+      std::sort(indices.Get(), indices.Get() + indices.GetSize());
+  }
+
+private:
+  int CellX(float x) const { return std::max(std::min((int) std::floor((x - mL) / mCellSize), mNX - 1), 0); }
+  int CellY(float y) const { return std::max(std::min((int) std::floor((y - mT) / mCellSize), mNY - 1), 0); }
+
+  void GetCellRange(const IRECT& bounds, int* pRange) const
+  {
+    pRange[0] = CellX(bounds.L);
+    pRange[1] = CellX(bounds.R);
+    pRange[2] = CellY(bounds.T);
+    pRange[3] = CellY(bounds.B);
+  }
+
+  bool mValid = false;
+  float mL = 0.f;
+  float mT = 0.f;
+  float mCellSize = 1.f;
+  int mNX = 0;
+  int mNY = 0;
+  /** The start of each cell's list in mItems, with a final entry for the end */
+  WDL_TypedBuf<int> mCellStart;
+  /** The item indices of every cell's list */
+  WDL_TypedBuf<int> mItems;
+  /** The range of cells each item touches, x0, x1, y0, y1, while building */
+  WDL_TypedBuf<int> mItemCells;
+  WDL_TypedBuf<int> mFill;
+  /** The query each item was last found by, so that an item in several cells is only listed once */
+  WDL_TypedBuf<unsigned int> mMarks;
+  unsigned int mStamp = 0;
+};
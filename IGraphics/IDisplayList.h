@@ -0,0 +1,267 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IDisplayList
+ */
+
+#include <string>
+#include <vector>
+
+#include "IGraphics.h"
+
+/** A recording of the drawing calls a control makes in IControl::Draw(), which IGraphics replays instead of calling Draw() again, see kCacheDisplayList.
+ * The calls are recorded at the level of the path based backends' primitives: the path commands, stroke and fill, bitmaps and text, and the transform and clip
+ * that they are made with, so that a replay is drawn as the original was without the control's work of laying out its shapes. Unlike a layer it costs no texture memory
+ * and it is drawn at the current scale. A recording is only replayed for the bounds and scale it was made at. A control that uses layers, or draws one, can't be
+ * recorded, as a layer's bitmap may be gone by the next replay, so it is marked unsupported and the control's Draw() is called as usual */
+class IDisplayList
+{
+public:
+  IDisplayList() = default;
+
+  IDisplayList(const IDisplayList&) = delete;
+  IDisplayList& operator=(const IDisplayList&) = delete;
+
+  /** Pauses the recording of a display list while in scope, for a recorded call that draws through the recorded primitives */
+  class Pause
+  {
+  public:
+    Pause(IDisplayList*& pList)
+    : mpList(pList)
+    , mpPaused(pList)
+    {
+      pList = nullptr;
+    }
+
+    ~Pause() { mpList = mpPaused; }
+
+    Pause(const Pause&) = delete;
+    Pause& operator=(const Pause&) = delete;
+
+  private:
+    IDisplayList*& mpList;
+    IDisplayList* mpPaused;
+  };
+
+  /** Discard the recording, so that the control is drawn and recorded again */
+  void Invalidate() { mValid = false; }
+
+  /** @return \c true if the recording can be replayed in bounds at scale */
+  bool IsValid(const IRECT& bounds, float scale) const { return mValid && bounds == mBounds && scale == mScale; }
+
+  /** @return \c true if the control made a call that can't be recorded */
+  bool IsUnsupported() const { return mUnsupported; }
+
+  /** Mark the recording as unsupported, so that the control is drawn as usual from now on */
+  void SetUnsupported() { mUnsupported = true; }
+
+  /** Start a new recording
+   * @param bounds The bounds it is drawn in
+   * @param scale The backing pixel scale it is drawn at */
+  void Begin(const IRECT& bounds, float scale)
+  {
+    mCommands.clear();
+    mFloats.clear();
+    mPatterns.clear();
+    mStrokeOptions.clear();
+    mFillOptions.clear();
+    mBlends.clear();
+    mMatrices.clear();
+    mBitmaps.clear();
+    mTexts.clear();
+    mStrings.clear();
+    mBounds = bounds;
+    mScale = scale;
+    mValid = false;
+  }
+
+  /** Finish the recording, which can be replayed unless it was marked unsupported */
+  void End() { mValid = !mUnsupported; }
+
+  void AddPathClear() { mCommands.push_back(Command(kPathClear)); }
+  void AddPathClose() { mCommands.push_back(Command(kPathClose)); }
+
+  void AddPathArc(float cx, float cy, float r, float aMin, float aMax)
+  {
+    mCommands.push_back(Command(kPathArc));
+    mFloats.insert(mFloats.end(), { cx, cy, r, aMin, aMax });
+  }
+
+  void AddPathMoveTo(float x, float y)
+  {
+    mCommands.push_back(Command(kPathMoveTo));
+    mFloats.insert(mFloats.end(), { x, y });
+  }
+
+  void AddPathLineTo(float x, float y)
+  {
+    mCommands.push_back(Command(kPathLineTo));
+    mFloats.insert(mFloats.end(), { x, y });
+  }
+
+  void AddPathCurveTo(float x1, float y1, float x2, float y2, float x3, float y3)
+  {
+    mCommands.push_back(Command(kPathCurveTo));
+    mFloats.insert(mFloats.end(), { x1, y1, x2, y2, x3, y3 });
+  }
+
+  void AddPathStroke(const IPattern& pattern, float thickness, const IStrokeOptions& options, const IBlend* pBlend)
+  {
+    mCommands.push_back(Command(kPathStroke, AddBlend(pBlend)));
+    mPatterns.push_back(pattern);
+    mFloats.push_back(thickness);
+    mStrokeOptions.push_back(options);
+  }
+
+  void AddPathFill(const IPattern& pattern, const IFillOptions& options, const IBlend* pBlend)
+  {
+    mCommands.push_back(Command(kPathFill, AddBlend(pBlend)));
+    mPatterns.push_back(pattern);
+    mFillOptions.push_back(options);
+  }
+
+  void AddTransform(const IMatrix& matrix)
+  {
+    mCommands.push_back(Command(kTransform));
+    mMatrices.push_back(matrix);
+  }
+
+  /** @param r The clip that was asked for, which is intersected with the region being drawn when the list is replayed */
+  void AddClipRegion(const IRECT& r)
+  {
+    mCommands.push_back(Command(kClipRegion));
+    AddRECT(r);
+  }
+
+  void AddBitmap(const IBitmap& bitmap, const IRECT& bounds, int srcX, int srcY, const IBlend* pBlend)
+  {
+    mCommands.push_back(Command(kBitmap, AddBlend(pBlend)));
+    mBitmaps.push_back(bitmap);
+    AddRECT(bounds);
+    mFloats.insert(mFloats.end(), { (float) srcX, (float) srcY });
+  }
+
+  void AddText(const IText& text, const char* str, const IRECT& bounds, const IBlend* pBlend)
+  {
+    mCommands.push_back(Command(kText, AddBlend(pBlend)));
+    mTexts.push_back(text);
+    mStrings.push_back(str ? str : "");
+    AddRECT(bounds);
+  }
+
+  /** Replay the recording. It must not be recording into a display list
+   * @param g The graphics context to draw to */
+  void Replay(IGraphics& g) const
+  {
+    const float* pFloats = mFloats.data();
+    size_t pattern = 0, strokeOptions = 0, fillOptions = 0, blend = 0, matrix = 0, bitmap = 0, text = 0;
+
+    auto nextBlend = [&](const Command& command) { return command.hasBlend ? &mBlends[blend++] : nullptr; };
+    auto nextRECT = [&]() { const IRECT r(pFloats[0], pFloats[1], pFloats[2], pFloats[3]); pFloats += 4; return r; };
+
+    for (const Command& command : mCommands)
+    {
+      switch (command.type)
+      {
+        case kPathClear:    g.PathClear();  break;
+        case kPathClose:    g.PathClose();  break;
+        case kPathArc:      g.PathArc(pFloats[0], pFloats[1], pFloats[2], pFloats[3], pFloats[4]);                      pFloats += 5; break;
+        case kPathMoveTo:   g.PathMoveTo(pFloats[0], pFloats[1]);                                                       pFloats += 2; break;
+        case kPathLineTo:   g.PathLineTo(pFloats[0], pFloats[1]);                                                       pFloats += 2; break;
+        case kPathCurveTo:  g.PathCurveTo(pFloats[0], pFloats[1], pFloats[2], pFloats[3], pFloats[4], pFloats[5]);      pFloats += 6; break;
+
+        case kPathStroke:
+        {
+          const IBlend* pBlend = nextBlend(command);
+          g.PathStroke(mPatterns[pattern++], *pFloats++, mStrokeOptions[strokeOptions++], pBlend);
+          break;
+        }
+
+        case kPathFill:
+        {
+          const IBlend* pBlend = nextBlend(command);
+          g.PathFill(mPatterns[pattern++], mFillOptions[fillOptions++], pBlend);
+          break;
+        }
+
+        case kTransform:
+          g.PathTransformReset();
+          g.PathTransformMatrix(mMatrices[matrix++]);
+          break;
+
+        case kClipRegion:
+          g.PathClipRegion(nextRECT());
+          break;
+
+        case kBitmap:
+        {
+          const IBlend* pBlend = nextBlend(command);
+          const IRECT bounds = nextRECT();
+          g.DrawBitmap(mBitmaps[bitmap++], bounds, (int) pFloats[0], (int) pFloats[1], pBlend);
+          pFloats += 2;
+          break;
+        }
+
+        case kText:
+        {
+          const IBlend* pBlend = nextBlend(command);
+          const IRECT bounds = nextRECT();
+          g.DrawText(mTexts[text], mStrings[text].c_str(), bounds, pBlend);
+          text++;
+          break;
+        }
+      }
+    }
+  }
+
+private:
+  enum ECommand : unsigned char
+  {
+    kPathClear, kPathClose, kPathArc, kPathMoveTo, kPathLineTo, kPathCurveTo, kPathStroke, kPathFill, kTransform, kClipRegion, kBitmap, kText
+  };
+
+  struct Command
+  {
+    Command(ECommand t, bool blend = false) : type(t), hasBlend(blend) {}
+
+    ECommand type;
+    bool hasBlend;
+  };
+
+  bool AddBlend(const IBlend* pBlend)
+  {
+    if (pBlend)
+      mBlends.push_back(*pBlend);
+
+    return pBlend != nullptr;
+  }
+
+  void AddRECT(const IRECT& r) { mFloats.insert(mFloats.end(), { r.L, r.T, r.R, r.B }); }
+
+  // the arguments of the commands, in the order they are used
+  std::vector<Command> mCommands;
+  std::vector<float> mFloats;
+  std::vector<IPattern> mPatterns;
+  std::vector<IStrokeOptions> mStrokeOptions;
+  std::vector<IFillOptions> mFillOptions;
+  std::vector<IBlend> mBlends;
+  std::vector<IMatrix> mMatrices;
+  std::vector<IBitmap> mBitmaps;
+  std::vector<IText> mTexts;
+  std::vector<std::string> mStrings;
+  IRECT mBounds;
+  float mScale = 0.f;
+  bool mValid = false;
+  bool mUnsupported = false;
+};
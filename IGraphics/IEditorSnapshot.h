@@ -0,0 +1,175 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IEditorSnapshot
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+#if defined OS_WIN
+  #include <windows.h>
+#else
+  #include <sys/stat.h>
+#endif
+
+#include "IPlugPaths.h"
+#include "IPlugWorkerPool.h"
+
+#include "IGraphicsStructs.h"
+
+/** The last frame of an editor, drawn at one size and scale, kept in the plug-in's folder in the user's settings, see INIPath(), for IGraphics::EnableSnapshotOnOpen().
+ * The file is a header and the pixels, 8 bit RGBA with straight alpha, a row after another, so that it is shown without decoding. It is written on the IPlugWorkerPool,
+ * to a temporary file that then replaces the last one, so that an editor that opens while it is written, e.g. in another instance, reads a whole frame or none */
+class IEditorSnapshot
+{
+public:
+  static constexpr uint32_t kVersion = 1;
+
+  /** @param name The name of the plug-in's folder, e.g. PLUG_NAME
+   * @param width The width of the editor
+   * @param height The height of the editor
+   * @param scale The scale of the pixels to the editor's size */
+  IEditorSnapshot(const char* name, int width, int height, float scale)
+  : mWidth(static_cast<int>(std::ceil(width * scale)))
+  , mHeight(static_cast<int>(std::ceil(height * scale)))
+  {
+    GetFolder(mFolder, name);
+
+    if (mFolder.GetLength())
+      mPath.SetFormatted(mFolder.GetLength() + 64, "%s/editor_%dx%d@%d.snapshot", mFolder.Get(), width, height, static_cast<int>(std::round(scale * 100.f)));
+  }
+
+  /** Read the frame that was saved at this size and scale
+   * @return \c true if there is one */
+  bool Load()
+  {
+    FILE* fp = mPath.GetLength() ? fopen(mPath.Get(), "rb") : nullptr;
+
+    if (!fp)
+      return false;
+
+    uint32_t header[4];
+    const int size = mWidth * mHeight * 4;
+    bool ok = fread(header, sizeof(header), 1, fp) == 1 && !memcmp(header, "ISNP", 4) && header[1] == kVersion
+           && static_cast<int>(header[2]) == mWidth && static_cast<int>(header[3]) == mHeight;
+
+    if (ok)
+    {
+      mPixels.Resize(size);
+      ok = mPixels.GetSize() == size && fread(mPixels.Get(), 1, size, fp) == static_cast<size_t>(size);
+    }
+
+    fclose(fp);
+
+    if (!ok)
+      mPixels.Resize(0);
+
+    return ok;
+  }
+
+  /** Save a frame on a worker thread, replacing the last one saved at this size and scale
+   * @param pFrame The frame, 8 bit RGBA premultiplied by its alpha, a row after another, which the worker converts and writes */
+  void Save(std::shared_ptr<RawBitmapData> pFrame)
+  {
+    if (!mPath.GetLength() || !pFrame || pFrame->GetSize() != mWidth * mHeight * 4)
+      return;
+
+    const WDL_String folder(mFolder), path(mPath);
+    const int width = mWidth, height = mHeight;
+
+    auto job = std::make_shared<IPlugJob>([pFrame, folder, path, width, height](IPlugJob&) {
+      Write(*pFrame, folder.Get(), path.Get(), width, height);
+    }, nullptr, IPlugJob::kPriorityLow, IPlugJob::ECompletionThread::kMainThread);
+
+    IPlugWorkerPool::Get().Submit(job);
+  }
+
+  /** @return The pixels read by Load() */
+  const uint8_t* GetPixels() const { return mPixels.Get(); }
+
+  /** Release the pixels read by Load(), once they have been uploaded */
+  void ReleasePixels() { mPixels.Resize(0, true); }
+
+  int GetWidth() const { return mWidth; }
+  int GetHeight() const { return mHeight; }
+
+private:
+  static void GetFolder(WDL_String& folder, const char* name)
+  {
+#if defined OS_WEB
+    folder.Set("");
+#else
+    INIPath(folder, name);
+#endif
+  }
+
+  static void Write(RawBitmapData& frame, const char* folder, const char* path, int width, int height)
+  {
+    // the frame is saved with straight alpha, as UpdatePixelLayer() takes it
+    uint8_t* pPixel = frame.Get();
+
+    for (int i = 0; i < width * height; i++, pPixel += 4)
+    {
+      const unsigned int a = pPixel[3];
+
+      if (a && a < 255)
+      {
+        pPixel[0] = static_cast<uint8_t>(std::min(255u, (pPixel[0] * 255u + a / 2) / a));
+        pPixel[1] = static_cast<uint8_t>(std::min(255u, (pPixel[1] * 255u + a / 2) / a));
+        pPixel[2] = static_cast<uint8_t>(std::min(255u, (pPixel[2] * 255u + a / 2) / a));
+      }
+    }
+
+#if defined OS_WIN
+    CreateDirectoryA(folder, NULL);
+#else
+    mkdir(folder, 0755);
+#endif
+
+    WDL_String tempPath;
+    tempPath.SetFormatted(static_cast<int>(strlen(path)) + 8, "%s.tmp", path);
+
+    FILE* fp = fopen(tempPath.Get(), "wb");
+
+    if (!fp)
+      return;
+
+    uint32_t header[4] = { 0, kVersion, static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
+    memcpy(header, "ISNP", 4);
+
+    const bool ok = fwrite(header, sizeof(header), 1, fp) == 1 && fwrite(frame.Get(), 1, frame.GetSize(), fp) == static_cast<size_t>(frame.GetSize());
+
+    if (fclose(fp) || !ok)
+    {
+      remove(tempPath.Get());
+      return;
+    }
+
+#if defined OS_WIN
+    MoveFileExA(tempPath.Get(), path, MOVEFILE_REPLACE_EXISTING);
+#else
+    rename(tempPath.Get(), path);
+#endif
+  }
+
+  WDL_String mFolder;
+  WDL_String mPath;
+  RawBitmapData mPixels;
+  int mWidth;
+  int mHeight;
+};
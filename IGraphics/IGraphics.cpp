@@ -8,7 +8,13 @@
  ==============================================================================
 */
 
+#include <typeinfo>
+
 #include "IGraphics.h"
+#include "ITextMeasureCache.h"
+#include "IParallelBands.h"
+#include "IPlugResourceIndex.h"
+#include "IPlugResourceArchive.h"
 
 #define NANOSVG_IMPLEMENTATION
 #include "nanosvg.h"
@@ -69,8 +75,54 @@ struct SVGHolder
   }
 };
 
-static StaticStorage<APIBitmap> sBitmapCache;
-static StaticStorage<SVGHolder> sSVGCache;
+static StaticStorage<APIBitmap> sBitmapCache {"Bitmaps"};
+static StaticStorage<SVGHolder> sSVGCache {"SVGs"};
+
+// the memory of the cached resources, for the budget of the cache
+static size_t APIBitmapBytes(const APIBitmap* pBitmap)
+{
+  return static_cast<size_t>(pBitmap->GetWidth()) * pBitmap->GetHeight() * 4;
+}
+
+static size_t SVGBytes(const NSVGimage* pImage)
+{
+  size_t bytes = sizeof(NSVGimage);
+  
+  for (const NSVGshape* pShape = pImage ? pImage->shapes : nullptr; pShape; pShape = pShape->next)
+  {
+    bytes += sizeof(NSVGshape);
+    
+    for (const NSVGpath* pPath = pShape->paths; pPath; pPath = pPath->next)
+      bytes += sizeof(NSVGpath) + pPath->npts * 2 * sizeof(float);
+  }
+  
+  return bytes;
+}
+
+// times the LoadBitmap(), LoadSVG() and LoadFont() calls made while the editor opens, for the IEditorOpenStats
+class ResourceLoadTimer
+{
+public:
+  ResourceLoadTimer(bool timing, int& count, double& time)
+  : mCount(timing ? &count : nullptr)
+  , mTime(time)
+  , mStart(timing ? GetTimestamp() : 0.)
+  {}
+  
+  ~ResourceLoadTimer()
+  {
+    if (mCount)
+    {
+      (*mCount)++;
+      mTime += GetTimestamp() - mStart;
+    }
+  }
+  
+private:
+  int* mCount;
+  double& mTime;
+  double mStart;
+};
 
 IGraphics::IGraphics(IGEditorDelegate& dlg, int w, int h, int fps, float scale)
 : mDelegate(&dlg)
@@ -85,6 +137,7 @@ IGraphics::IGraphics(IGEditorDelegate& dlg, int w, int h, int fps, float scale)
 , mMaxHeight(h * 2)
 {
   mFPS = (fps > 0 ? fps : DEFAULT_FPS);
+  mTimerRate.SetActiveInterval(static_cast<uint32_t>(std::round(1000.0 / mFPS)));
     
   StaticStorage<APIBitmap>::Accessor bitmapStorage(sBitmapCache);
   bitmapStorage.Retain();
@@ -97,11 +150,36 @@ IGraphics::~IGraphics()
   RemoveAllControls();
     
   StaticStorage<APIBitmap>::Accessor bitmapStorage(sBitmapCache);
+  bitmapStorage.RemoveUser(this);
   bitmapStorage.Release();
   StaticStorage<SVGHolder>::Accessor svgStorage(sSVGCache);
+  svgStorage.RemoveUser(this);
   svgStorage.Release();
 }
 
+void IGraphics::SetResourceCacheBudget(size_t bytes)
+{
+  // SVGs are small next to bitmaps, so they get an eighth of the budget
+  StaticStorage<APIBitmap>::Accessor bitmapStorage(sBitmapCache);
+  bitmapStorage.SetBudget(bytes - bytes / 8);
+  StaticStorage<SVGHolder>::Accessor svgStorage(sSVGCache);
+  svgStorage.SetBudget(bytes / 8);
+}
+
+size_t IGraphics::GetResourceCacheBytes()
+{
+  StaticStorage<APIBitmap>::SharedAccessor bitmapStorage(sBitmapCache);
+  const size_t bitmapBytes = bitmapStorage.GetBytes();
+  StaticStorage<SVGHolder>::SharedAccessor svgStorage(sSVGCache);
+  return bitmapBytes + svgStorage.GetBytes();
+}
+
+void IGraphics::SetDropScaledBitmapsOnClose(bool drop)
+{
+  StaticStorage<APIBitmap>::Accessor storage(sBitmapCache);
+  storage.SetDropScaledWhenUnused(drop);
+}
+
 void IGraphics::SetScreenScale(int scale)
 {
   mScreenScale = scale;
@@ -124,12 +202,28 @@ void IGraphics::Resize(int w, int h, float scale)
   mDrawScale = scale;
   mWidth = w;
   mHeight = h;
+  InvalidateControlGrid();
   
   if (mCornerResizer)
     mCornerResizer->OnRescale();
 
   GetDelegate()->EditorPropertiesModified();
   PlatformResize();
+  
+  // while a gesture is previewed, the frames just stretch the last one to the window, see Draw(), and the rest waits for the gesture to end
+  if (mResizingInProcess && mResizePreview && CanPreviewResize())
+  {
+    mResizePreviewPending = true;
+    mResizePreviewDirty = true;
+    return;
+  }
+  
+  ResizeControls();
+}
+
+void IGraphics::ResizeControls()
+{
+  mResizePreviewPending = false;
   ForAllControls(&IControl::OnResize);
   SetAllControlsDirty();
   DrawResize();
@@ -143,6 +237,103 @@ void IGraphics::SetLayoutOnResize(bool layoutOnResize)
   mLayoutOnResize = layoutOnResize;
 }
 
+void IGraphics::EnableSnapshotOnOpen(bool enable, const char* name)
+{
+  mSnapshotName.Set(enable && name ? name : "");
+}
+
+void IGraphics::StartEditorOpenStats(double startTimestamp, double createdTimestamp)
+{
+  mEditorOpenStats = IEditorOpenStats();
+  mEditorOpenStats.startTimestamp = startTimestamp;
+  mEditorOpenStats.graphicsCreatedTime = createdTimestamp - startTimestamp;
+  mEditorOpenTiming = true;
+}
+
+void IGraphics::LayoutUIOnOpen()
+{
+  TRACE_SCOPE;
+  
+  const double now = GetTimestamp();
+  
+  // a platform opened without IGEditorDelegate::OpenWindow() is timed from here
+  if (!mEditorOpenTiming)
+  {
+    mEditorOpenStats = IEditorOpenStats();
+    mEditorOpenStats.startTimestamp = now;
+    mEditorOpenTiming = true;
+  }
+  
+  mEditorOpenStats.viewInitializedTime = now - mEditorOpenStats.startTimestamp;
+  
+  mSnapshot = nullptr;
+  mSnapshotLayer = nullptr;
+  mSnapshotState = kSnapshotOff;
+  mSnapshotIdleTicks = 0;
+  mSnapshotTicks = 0;
+  mSnapshotDrawn = false;
+  
+  if (mSnapshotName.GetLength())
+  {
+    mSnapshot.reset(new IEditorSnapshot(mSnapshotName.Get(), Width(), Height(), GetBackingPixelScale()));
+    
+    // the layout waits until the snapshot has been shown
+    if (!NControls() && mSnapshot->Load())
+    {
+      mSnapshotState = kSnapshotShowing;
+      return;
+    }
+    
+    mSnapshotState = kSnapshotSettling;
+  }
+  
+  LayoutUIForOpen();
+}
+
+void IGraphics::LayoutUIForOpen()
+{
+  mEditorOpenStats.layoutStartTime = GetTimestamp() - mEditorOpenStats.startTimestamp;
+  GetDelegate()->LayoutUI(this);
+  mEditorOpenStats.layoutDoneTime = GetTimestamp() - mEditorOpenStats.startTimestamp;
+  
+  if (mEditorOpenTiming)
+    FinishEditorOpenStats();
+}
+
+void IGraphics::FinishEditorOpenStats()
+{
+  if (!mEditorOpenStats.Finished())
+    return;
+  
+  mEditorOpenTiming = false;
+  
+  IEditorOpenStats& stats = mEditorOpenStats;
+  
+  {
+    StaticStorage<APIBitmap>::SharedAccessor storage(GetBitmapCache());
+    (BitmapsAreTextures() ? stats.gpuBitmapBytes : stats.cpuBitmapBytes) = storage.GetBytes();
+  }
+  
+  {
+    StaticStorage<SVGHolder>::SharedAccessor storage(sSVGCache);
+    stats.svgBytes = storage.GetBytes();
+  }
+  
+  TRACE_COUNTER("EditorOpen view initialized us", stats.viewInitializedTime * 1e6);
+  TRACE_COUNTER("EditorOpen layout us", (stats.layoutDoneTime - stats.layoutStartTime) * 1e6);
+  TRACE_COUNTER("EditorOpen first frame us", stats.firstFrameTime * 1e6);
+  TRACE_COUNTER("EditorOpen resources us", stats.ResourceTime() * 1e6);
+  TRACE_COUNTER("EditorOpen bitmaps", stats.nBitmaps);
+  TRACE_COUNTER("Bitmap cache CPU bytes", stats.cpuBitmapBytes);
+  TRACE_COUNTER("Bitmap cache GPU bytes", stats.gpuBitmapBytes);
+  TRACE_COUNTER("SVG cache bytes", stats.svgBytes);
+  
+  DBGMSG("Editor open: view %.1f ms, layout %.1f ms, first frame %.1f ms, %i bitmaps %.1f ms, %i SVGs %.1f ms, %i fonts %.1f ms, bitmaps %i KB CPU %i KB GPU, SVGs %i KB\n",
+         stats.viewInitializedTime * 1000., (stats.layoutDoneTime - stats.layoutStartTime) * 1000., stats.firstFrameTime * 1000.,
+         stats.nBitmaps, stats.bitmapTime * 1000., stats.nSVGs, stats.svgTime * 1000., stats.nFonts, stats.fontTime * 1000.,
+         static_cast<int>(stats.cpuBitmapBytes / 1024), static_cast<int>(stats.gpuBitmapBytes / 1024), static_cast<int>(stats.svgBytes / 1024));
+}
+
 void IGraphics::RemoveControls(int fromIdx)
 {
   int idx = NControls()-1;
@@ -159,9 +350,16 @@ void IGraphics::RemoveControls(int fromIdx)
       mMouseOverIdx = -1;
     }
     
+    OnControlDetached(pControl);
     mControls.Delete(idx--, true);
   }
   
+  // groups that would have gone above the removed controls go with them
+  mLazyGroups.erase(std::remove_if(mLazyGroups.begin(), mLazyGroups.end(), [fromIdx](const LazyGroup& group) {
+    return group.controlIdx >= fromIdx;
+  }), mLazyGroups.end());
+  
+  InvalidateControlGrid();
   SetAllControlsDirty();
 }
 
@@ -179,7 +377,11 @@ void IGraphics::RemoveAllControls()
   mLiveEdit.reset(nullptr);
 #endif
   
+  mDirtyControls.Empty();
+  mPolledControls.Empty();
   mControls.Empty(true);
+  mLazyGroups.clear();
+  InvalidateControlGrid();
 }
 
 void IGraphics::SetControlValueFromStringAfterPrompt(IControl& control, const char* str)
@@ -199,6 +401,7 @@ void IGraphics::AttachBackground(const char* name)
   IControl* pBG = new IBitmapControl(0, 0, bg, kNoParameter, kBlendClobber);
   pBG->SetDelegate(*GetDelegate());
   mControls.Insert(0, pBG);
+  OnControlAttached(pBG);
 }
 
 void IGraphics::AttachPanelBackground(const IColor& color)
@@ -206,6 +409,7 @@ void IGraphics::AttachPanelBackground(const IColor& color)
   IControl* pBG = new IPanelControl(GetBounds(), color);
   pBG->SetDelegate(*GetDelegate());
   mControls.Insert(0, pBG);
+  OnControlAttached(pBG);
 }
 
 int IGraphics::AttachControl(IControl* pControl, int controlTag, const char* group)
@@ -214,6 +418,7 @@ int IGraphics::AttachControl(IControl* pControl, int controlTag, const char* gro
   pControl->SetTag(controlTag);
   pControl->SetGroup(group);
   mControls.Add(pControl);
+  OnControlAttached(pControl);
   return mControls.GetSize() - 1;
 }
 
@@ -263,14 +468,14 @@ void IGraphics::ShowFPSDisplay(bool enable)
     {
       mPerfDisplay.reset(new IFPSDisplayControl(GetBounds().GetPadded(-10).GetFromTLHC(200, 50)));
       mPerfDisplay->SetDelegate(*GetDelegate());
+      SetRegionDirty(mPerfDisplay->GetRECT());
     }
   }
-  else
+  else if (mPerfDisplay)
   {
+    SetRegionDirty(mPerfDisplay->GetRECT());
     mPerfDisplay.reset(nullptr);
   }
-
-  SetAllControlsDirty();
 }
 
 IControl* IGraphics::GetControlWithTag(int controlTag)
@@ -342,6 +547,81 @@ void IGraphics::ForControlInGroup(const char* group, std::function<void(IControl
   }
 }
 
+void IGraphics::AttachLazyGroup(const char* group, ILazyGroupFunction func, const char** prefetchBitmaps, int nPrefetchBitmaps, bool createWhenIdle)
+{
+  assert(CStringHasContents(group));
+
+  LazyGroup lazyGroup;
+  lazyGroup.name.Set(group);
+  lazyGroup.func = func;
+  lazyGroup.controlIdx = NControls();
+  lazyGroup.createWhenIdle = createWhenIdle;
+  lazyGroup.created = false;
+  mLazyGroups.push_back(std::move(lazyGroup));
+
+  if (prefetchBitmaps && nPrefetchBitmaps)
+    PreloadBitmaps(prefetchBitmaps, nPrefetchBitmaps);
+}
+
+bool IGraphics::CreateLazyGroup(const char* group)
+{
+  for (size_t i = 0; i < mLazyGroups.size(); i++)
+  {
+    if (mLazyGroups[i].created || strcmp(mLazyGroups[i].name.Get(), group))
+      continue;
+
+    mLazyGroups[i].created = true;
+
+    // copied, as the function may declare more groups
+    const WDL_String name(mLazyGroups[i].name);
+    const ILazyGroupFunction func = mLazyGroups[i].func;
+    const int firstIdx = NControls();
+    func(*this, name.Get());
+    const int nCreated = NControls() - firstIdx;
+    const int controlIdx = std::min(mLazyGroups[i].controlIdx, firstIdx);
+
+    // the controls were attached at the top, they go where the group was declared
+    for (int c = 0; c < nCreated; c++)
+    {
+      IControl* pControl = mControls.Get(firstIdx + c);
+      mControls.Delete(firstIdx + c);
+      mControls.Insert(controlIdx + c, pControl);
+
+      if (!CStringHasContents(pControl->GetGroup()))
+        pControl->SetGroup(name.Get());
+
+      pControl->Hide(true);
+    }
+
+    // and the groups declared after it move up
+    for (size_t j = 0; j < mLazyGroups.size(); j++)
+    {
+      LazyGroup& other = mLazyGroups[j];
+
+      if (j != i && !other.created && (other.controlIdx > controlIdx || (other.controlIdx == controlIdx && j > i)))
+        other.controlIdx += nCreated;
+    }
+
+    if (nCreated)
+    {
+      mMouseOverIdx = -1;
+      InvalidateControlGrid();
+    }
+
+    return true;
+  }
+
+  return false;
+}
+
+void IGraphics::HideGroup(const char* group, bool hide)
+{
+  if (!hide)
+    CreateLazyGroup(group);
+
+  ForControlInGroup(group, [hide](IControl& control) { control.Hide(hide); });
+}
+
 void IGraphics::ForStandardControlsFunc(std::function<void(IControl& control)> func)
 {
   for (auto c = 0; c < NControls(); c++)
@@ -351,7 +631,11 @@ void IGraphics::ForStandardControlsFunc(std::function<void(IControl& control)> f
 void IGraphics::ForAllControlsFunc(std::function<void(IControl& control)> func)
 {
   ForStandardControlsFunc(func);
-  
+  ForSpecialControlsFunc(func);
+}
+
+void IGraphics::ForSpecialControlsFunc(std::function<void(IControl& control)> func)
+{
   if (mPerfDisplay)
     func(*mPerfDisplay);
   
@@ -384,12 +668,77 @@ void IGraphics::ForMatchingControls(T method, int paramIdx, Args... args)
 
 void IGraphics::SetAllControlsDirty()
 {
+  WakeTimer();
   ForAllControls(&IControl::SetDirty, false);
 }
 
+void IGraphics::SetRegionDirty(const IRECT& bounds)
+{
+  if (bounds.Empty())
+    return;
+  
+  mDirtyRegions.Add(bounds.GetPadded(0.75));
+  WakeTimer();
+}
+
 void IGraphics::SetAllControlsClean()
 {
-  ForAllControls(&IControl::SetClean);
+  // only the queued controls can be dirty
+  for (int i = 0; i < mDirtyControls.GetSize(); i++)
+  {
+    IControl* pControl = mDirtyControls.Get(i);
+    pControl->mDirtyQueued = false;
+    pControl->SetClean();
+  }
+  
+  mDirtyControls.Empty();
+  ForSpecialControlsFunc([](IControl& control) { control.SetClean(); });
+}
+
+void IGraphics::QueueDirtyControl(IControl& control)
+{
+  if (control.mAttached && !control.mDirtyQueued)
+  {
+    control.mDirtyQueued = true;
+    mDirtyControls.Add(&control);
+  }
+}
+
+void IGraphics::QueuePolledControl(IControl& control)
+{
+  if (control.mAttached && !control.mPollQueued)
+  {
+    control.mPollQueued = true;
+    mPolledControls.Add(&control);
+  }
+  
+  // an animation may start outside of the input paths, e.g. from a MIDI message, while the timer has backed off
+  if (control.mAttached && control.GetAnimationFunction())
+    WakeTimer();
+}
+
+void IGraphics::OnControlAttached(IControl* pControl)
+{
+  pControl->mAttached = true;
+  
+  if (pControl->mDirty)
+    QueueDirtyControl(*pControl);
+  
+  if (pControl->GetAnimationFunction() || pControl->GetPollDirty())
+    QueuePolledControl(*pControl);
+  
+  InvalidateControlGrid();
+}
+
+void IGraphics::OnControlDetached(IControl* pControl)
+{
+  if (pControl->mDirtyQueued)
+    mDirtyControls.DeletePtr(pControl);
+  
+  if (pControl->mPollQueued)
+    mPolledControls.DeletePtr(pControl);
+  
+  pControl->mAttached = pControl->mDirtyQueued = pControl->mPollQueued = false;
 }
 
 void IGraphics::AssignParamNameToolTips()
@@ -454,13 +803,32 @@ void IGraphics::PromptUserInput(IControl& control, const IRECT& bounds)
 
 bool IGraphics::DrawText(const IText& text, const char* str, const IRECT& bounds, const IBlend* pBlend)
 {
+  if (mDisplayList)
+    mDisplayList->AddText(text, str, bounds, pBlend);
+  
+  IDisplayList::Pause pause(mDisplayList);
   IRECT r(bounds);
   return DoDrawMeasureText(text, str, r, pBlend, false);
 }
 
 bool IGraphics::MeasureText(const IText& text, const char* str, IRECT& bounds)
 {
-  return DoDrawMeasureText(text, str, bounds, nullptr, true);
+  if (!str)
+    return DoDrawMeasureText(text, str, bounds, nullptr, true);
+  
+  ITextMeasureCache& cache = ITextMeasureCache::Get();
+  const float scale = GetBackingPixelScale();
+  
+  if (cache.Find(text, str, bounds, scale))
+    return true;
+  
+  const IRECT measureBounds = bounds;
+  
+  if (!DoDrawMeasureText(text, str, bounds, nullptr, true))
+    return false;
+  
+  cache.Add(text, str, measureBounds, bounds, scale);
+  return true;
 }
 
 bool IGraphics::DrawText(const IText& text, const char* str, float x, float y, const IBlend* pBlend)
@@ -616,24 +984,190 @@ void IGraphics::DrawGrid(const IColor& color, const IRECT& bounds, float gridSiz
 
 void IGraphics::DrawData(const IColor& color, const IRECT& bounds, float* normYPoints, int nPoints, float* normXPoints, const IBlend* pBlend, float thickness)
 {
-  //TODO:
+  int n = 0;
+  const float* pPoints = CalculateDataPoints(bounds, normYPoints, nPoints, normXPoints, n);
+  
+  for (int i = 1; i < n; i++)
+    DrawLine(color, pPoints[i * 2 - 2], pPoints[i * 2 - 1], pPoints[i * 2], pPoints[i * 2 + 1], pBlend, thickness);
+}
+
+const float* IGraphics::CalculateDataPoints(const IRECT& bounds, const float* normYPoints, int nPoints, const float* normXPoints, int& nOutPoints)
+{
+  const float xStep = nPoints > 1 ? bounds.W() / (float) (nPoints - 1) : 0.f;
+  auto getX = [&](int i) { return normXPoints ? bounds.L + (bounds.W() * normXPoints[i]) : bounds.L + (xStep * i); };
+  auto getY = [&](int i) { return bounds.B - (bounds.H() * normYPoints[i]); };
+  
+  mDataPoints.Resize(0, false);
+  
+  const float pixelScale = GetBackingPixelScale();
+  
+  if (nPoints <= 4 * bounds.W() * pixelScale)
+  {
+    mDataPoints.Resize(nPoints * 2, false);
+    float* pPoints = mDataPoints.Get();
+    
+    for (int i = 0; i < nPoints; i++)
+    {
+      pPoints[i * 2] = getX(i);
+      pPoints[i * 2 + 1] = getY(i);
+    }
+    
+    nOutPoints = nPoints;
+    return mDataPoints.Get();
+  }
+  
+  // each run of points in one pixel column keeps its first, lowest, highest and last point, in their order
+  for (int i = 0; i < nPoints;)
+  {
+    const int column = static_cast<int>(std::floor(getX(i) * pixelScale));
+    int first = i, minIdx = i, maxIdx = i;
+    
+    for (i++; i < nPoints && static_cast<int>(std::floor(getX(i) * pixelScale)) == column; i++)
+    {
+      if (normYPoints[i] < normYPoints[minIdx])
+        minIdx = i;
+      else if (normYPoints[i] > normYPoints[maxIdx])
+        maxIdx = i;
+    }
+    
+    const int keep[4] = { first, std::min(minIdx, maxIdx), std::max(minIdx, maxIdx), i - 1 };
+    
+    for (int k = 0; k < 4; k++)
+    {
+      if (k == 0 || keep[k] != keep[k - 1])
+      {
+        mDataPoints.Add(getX(keep[k]));
+        mDataPoints.Add(getY(keep[k]));
+      }
+    }
+  }
+  
+  nOutPoints = mDataPoints.GetSize() / 2;
+  return mDataPoints.Get();
 }
 
 bool IGraphics::IsDirty(IRECTList& rects)
 {
   bool dirty = false;
+  mFrameTime = Time::now();
+  
+  // what the moves since the last frame change is drawn in this one
+  FlushMouseMoves();
+  
+  if (mSnapshotState == kSnapshotShowing && mSnapshotDrawn)
+  {
+    // the snapshot is on screen, so the UI is laid out behind it, and faded to from the end of the layout
+    LayoutUIForOpen();
+    SetAllControlsDirty();
+    mSnapshotState = kSnapshotFading;
+    mSnapshotFadeStart = mFrameTime;
+  }
+  else if (mSnapshotState == kSnapshotFading && std::chrono::duration<double, std::milli>(mFrameTime - mSnapshotFadeStart).count() >= SNAPSHOT_FADE_DURATION)
+  {
+    mSnapshotLayer = nullptr;
+    mSnapshotState = kSnapshotSettling;
+  }
+  
+  if (mSnapshotState == kSnapshotShowing || mSnapshotState == kSnapshotFading)
+  {
+    rects.Add(GetBounds());
+    dirty = true;
+  }
+  
+  if (mResizePreviewDirty)
+  {
+    rects.Add(GetBounds());
+    mResizePreviewDirty = false;
+    dirty = true;
+  }
+  
+  if (mDirtyRegions.Size())
+  {
+    for (int i = 0; i < mDirtyRegions.Size(); i++)
+      rects.Add(mDirtyRegions.Get(i));
+    
+    mDirtyRegions.Clear();
+    dirty = true;
+  }
     
   auto func = [&dirty, &rects](IControl& control)
   {
     if (control.IsDirty())
     {
-      // N.B padding outlines for single line outlines
-      rects.Add(control.GetRECT().GetPadded(0.75));
+      // a control that overrides IsDirty() may have changed without being marked dirty
+      if (control.mDynamicLayer)
+        control.mDynamicLayer->Invalidate();
+      
+
+      // N.B padding outlines for single line outlines. An animation redraws the whole control
+      const IRECT& area = control.GetDirtyArea();
+      rects.Add((area.Empty() || control.GetAnimationFunction() ? control.GetRECT() : area).GetPadded(0.75));
       dirty = true;
+      return true;
     }
+    
+    return false;
   };
+  
+  // rather than asking every control, ask those marked dirty since the last refresh. Any that have been marked dirty by an animation below are
+  // asked at the next refresh, which is harmless, since that animation has already added its bounds
+  for (int i = 0; i < mDirtyControls.GetSize();)
+  {
+    IControl* pControl = mDirtyControls.Get(i);
     
-  ForAllControlsFunc(func);
+    if (func(*pControl))
+      i++;
+    else
+    {
+      pControl->mDirtyQueued = false;
+      mDirtyControls.Delete(i);
+    }
+  }
+  
+  // then the animating and polled controls, apart from those just asked, dropping those that have stopped animating
+  for (int i = 0; i < mPolledControls.GetSize();)
+  {
+    IControl* pControl = mPolledControls.Get(i);
+    
+    if (!pControl->mDirtyQueued)
+      func(*pControl);
+    
+    if (pControl->GetAnimationFunction() || pControl->GetPollDirty())
+      i++;
+    else
+    {
+      pControl->mPollQueued = false;
+      mPolledControls.Delete(i);
+    }
+  }
+  
+  ForSpecialControlsFunc(func);
+  
+  // the snapshot is taken once the UI has had nothing to draw for a while, or after a longer while for a UI that is always animating
+  if (mSnapshotState == kSnapshotSettling)
+  {
+    mSnapshotIdleTicks = dirty ? 0 : mSnapshotIdleTicks + 1;
+    
+    if (mSnapshotIdleTicks > SNAPSHOT_IDLE_TICKS || ++mSnapshotTicks > SNAPSHOT_IDLE_TICKS * 10)
+    {
+      mSnapshotState = kSnapshotCapturing;
+      rects.Add(GetBounds());
+      dirty = true;
+    }
+  }
+  
+  // one group created ahead of need on each frame that has nothing else to do
+  if (!dirty)
+  {
+    for (auto& lazyGroup : mLazyGroups)
+    {
+      if (lazyGroup.createWhenIdle && !lazyGroup.created)
+      {
+        CreateLazyGroup(lazyGroup.name.Get());
+        break;
+      }
+    }
+  }
   
 #ifdef USE_IDLE_CALLS
   if (dirty)
@@ -642,12 +1176,140 @@ bool IGraphics::IsDirty(IRECTList& rects)
   }
   else if (++mIdleTicks > IDLE_TICKS)
   {
-    OnGUIIdle();
-    mIdleTicks = 0;
+    OnGUIIdle();
+    mIdleTicks = 0;
+  }
+#endif
+
+  return dirty;
+}
+
+void IGraphics::SetAdaptiveFrameRate(bool enable)
+{
+  mTimerRate.SetEnabled(enable);
+  SetPlatformTimerInterval(mTimerRate.GetInterval());
+}
+
+void IGraphics::WakeTimer()
+{
+  if (mTimerRate.Wake())
+    SetPlatformTimerInterval(mTimerRate.GetInterval());
+}
+
+void IGraphics::AdaptTimerInterval(bool dirty)
+{
+  const uint32_t interval = mTimerRate.GetInterval();
+  
+  if (mTimerRate.Tick(dirty) != interval)
+    SetPlatformTimerInterval(mTimerRate.GetInterval());
+}
+
+void IGraphics::SetVSync(bool enable)
+{
+  mVSync = enable;
+  SetPlatformTimerInterval(mTimerRate.GetInterval());
+}
+
+bool IGraphics::OnDisplayRefresh(double timestamp)
+{
+  if (mMaxFPS <= 0)
+    return true;
+  
+  const double period = 1.0 / mMaxFPS;
+  
+  // allow for jitter in the refresh times
+  if (timestamp < mNextFrameTime - 0.001)
+    return false;
+  
+  // step from the previous frame time so that the average rate is the cap, unless we have fallen behind
+  mNextFrameTime = timestamp - mNextFrameTime < period ? mNextFrameTime + period : timestamp + period;
+  return true;
+}
+
+void IGraphics::SetReduceEffects(bool reduce)
+{
+  if (reduce == mReduceEffects)
+    return;
+  
+  mReduceEffects = reduce;
+  ForAllControls(&IControl::InvalidateCache);
+  SetAllControlsDirty();
+}
+
+void IGraphics::EnableDrawProfiling(bool enable)
+{
+  mDrawProfiling = enable;
+  
+  if (enable)
+    ResetDrawProfile();
+}
+
+void IGraphics::ResetDrawProfile()
+{
+  ForAllControlsFunc([](IControl& control) { control.mDrawStats.Clear(); });
+  mDrawProfileStart = GetTimestamp();
+}
+
+void IGraphics::GetDrawProfile(WDL_PtrList<IControl>& controls, EDrawProfileSort sort)
+{
+  controls.Empty();
+  
+  for (auto i = 0; i < NControls(); i++)
+  {
+    if (GetControl(i)->GetDrawStats().nDraws)
+      controls.Add(GetControl(i));
+  }
+  
+  auto key = [sort](const IControl* pControl) {
+    const IDrawStats& stats = pControl->GetDrawStats();
+    
+    switch (sort)
+    {
+      case kDrawProfileSortMean:  return stats.MeanTime();
+      case kDrawProfileSortMax:   return stats.maxTime;
+      case kDrawProfileSortCount: return (double) stats.nDraws;
+      default:                    return stats.totalTime;
+    }
+  };
+  
+  std::stable_sort(controls.GetList(), controls.GetList() + controls.GetSize(), [&key](const IControl* pA, const IControl* pB) { return key(pA) > key(pB); });
+}
+
+void IGraphics::DumpDrawProfile(WDL_String& csv)
+{
+  WDL_PtrList<IControl> controls;
+  GetDrawProfile(controls);
+  
+  const double duration = std::max(GetDrawProfileDuration(), 0.001);
+  
+  csv.Set("index,class,tag,left,top,right,bottom,draws,draws_per_sec,mean_ms,max_ms,total_ms\n");
+  
+  for (auto i = 0; i < controls.GetSize(); i++)
+  {
+    IControl* pControl = controls.Get(i);
+    const IDrawStats& stats = pControl->GetDrawStats();
+    const IRECT& r = pControl->GetRECT();
+    
+    csv.AppendFormatted(256, "%d,%s,%d,%.1f,%.1f,%.1f,%.1f,%d,%.2f,%.4f,%.4f,%.4f\n", GetControlIdx(pControl), typeid(*pControl).name(), pControl->GetTag(),
+                        r.L, r.T, r.R, r.B, stats.nDraws, stats.nDraws / duration, stats.MeanTime() * 1000., stats.maxTime * 1000., stats.totalTime * 1000.);
   }
-#endif
+  
+  DBGMSG("%s", csv.Get());
+}
 
-  return dirty;
+void IGraphics::GetMemoryReport(IMemoryReport& report)
+{
+  // controls are counted at the size of the base class, their subclasses' own members and buffers aren't known here
+  report.Add(kMemoryGraphics, "Controls", NControls() * static_cast<int64_t>(sizeof(IControl)), NControls());
+  report.Add(kMemoryGraphics, "Snapshot", mSnapshotLayer ? APIBitmapBytes(mSnapshotLayer->GetAPIBitmap()) : 0);
+  report.Add(kMemoryGraphics, "Input and plot data", (mQueuedDrags.capacity() + mFlushedDrags.capacity()) * sizeof(IMouseSample) + mDataPoints.GetSize() * sizeof(float));
+  ReportDrawingMemory(report);
+}
+
+void IGraphics::ReportDrawingMemory(IMemoryReport& report)
+{
+  const float scale = GetBackingPixelScale();
+  report.Add(kMemoryGraphics, "Backing surface", static_cast<int64_t>(std::ceil(Width() * scale)) * static_cast<int64_t>(std::ceil(Height() * scale)) * 4);
 }
 
 void IGraphics::BeginFrame()
@@ -674,10 +1336,27 @@ void IGraphics::DrawControl(IControl* pControl, const IRECT& bounds, float scale
       return;
     
     PrepareRegion(clipBounds);
-    pControl->Draw(*this);
+    
+    // the FPS display is left out, so that showing the profile doesn't change it
+    const bool profile = mDrawProfiling && pControl != mPerfDisplay.get();
+    const double startTime = profile ? GetTimestamp() : 0.;
+    
+    if (pControl->GetCacheMode() != kCacheNone || CacheAtScale(*pControl, scale))
+      DrawCachedControl(*pControl, controlBounds);
+    else
+    {
+      // the layer of a control that was cached at a fractional scale
+      pControl->mDynamicLayer = nullptr;
+      mDrawRegion = clipBounds;
+      pControl->Draw(*this);
+      mDrawRegion = IRECT();
+    }
 #ifdef AAX_API
     pControl->DrawPTHighlight(*this);
 #endif
+    
+    if (profile)
+      pControl->mDrawStats.Add(GetTimestamp() - startTime);
 
 #ifndef NDEBUG
     if (mShowControlBounds)
@@ -690,10 +1369,73 @@ void IGraphics::DrawControl(IControl* pControl, const IRECT& bounds, float scale
   }
 }
 
+bool IGraphics::CacheAtScale(IControl& control, float scale) const
+{
+  return mCacheAtFractionalScale && scale != std::floor(scale) && !control.GetAnimationFunction() && !control.GetPollDirty() && &control != mPerfDisplay.get();
+}
+
+void IGraphics::DrawCachedControl(IControl& control, const IRECT& bounds)
+{
+  if (control.mCacheMode == kCacheDisplayList)
+  {
+    IDisplayList& list = control.mDisplayList;
+    const float scale = GetBackingPixelScale();
+    
+    // an animation changes the control at every frame, without marking it dirty
+    if (!HasPathSupport() || list.IsUnsupported() || control.GetAnimationFunction() || mDisplayList)
+      control.Draw(*this);
+    else if (list.IsValid(bounds, scale))
+      list.Replay(*this);
+    else
+    {
+      list.Begin(bounds, scale);
+      mDisplayList = &list;
+      control.Draw(*this);
+      mDisplayList = nullptr;
+      list.End();
+    }
+    
+    return;
+  }
+  
+  if (control.mCacheMode == kCacheStatic)
+  {
+    if (!CheckLayer(control.mStaticLayer))
+    {
+      StartLayer(bounds);
+      control.DrawStatic(*this);
+      control.mStaticLayer = EndLayer();
+    }
+    
+    DrawLayer(control.mStaticLayer);
+  }
+  
+  // an animation changes the control at every frame, without marking it dirty
+  if (!CheckLayer(control.mDynamicLayer) || control.GetAnimationFunction())
+  {
+    StartLayer(bounds);
+    
+    if (control.mCacheMode == kCacheStatic)
+      control.DrawDynamic(*this);
+    else
+      control.Draw(*this);
+    
+    control.mDynamicLayer = EndLayer();
+  }
+  
+  DrawLayer(control.mDynamicLayer);
+}
+
 // Draw a region of the graphics (redrawing all contained items)
 void IGraphics::Draw(const IRECT& bounds, float scale)
 {
-  ForAllControlsFunc([this, bounds, scale](IControl& control) { DrawControl(&control, bounds, scale); });
+  // only the controls in the cells the region overlaps, in their drawing order
+  GetControlGrid().Query(bounds, mControlGridQuery);
+
+  for (auto i = 0; i < mControlGridQuery.GetSize(); i++)
+    DrawControl(GetControl(mControlGridQuery.Get()[i]), bounds, scale);
+
+  ForSpecialControlsFunc([this, bounds, scale](IControl& control) { DrawControl(&control, bounds, scale); });
 
 #ifndef NDEBUG
   if (mShowAreaDrawn)
@@ -714,25 +1456,131 @@ void IGraphics::Draw(IRECTList& rects)
     return;
   
   float scale = GetBackingPixelScale();
-    
-  BeginFrame();
+  
+  if (mBitmapPreloader)
+    FinishPreloadingBitmaps();
+  
+  IRECTList strictRects;
     
   if (mStrict)
   {
     IRECT r = rects.Bounds();
     r.PixelAlign(scale);
-    Draw(r, scale);
+    strictRects.Add(r);
   }
   else
   {
     rects.PixelAlign(scale);
     rects.Optimize();
+  }
+  
+  // a previewed resize presents the last frame stretched to the window, without drawing the controls at the size they haven't been laid out for yet
+  if (mResizePreviewPending)
+  {
+    BeginFrame();
+    EndFrame();
+    return;
+  }
+  
+  const IRECTList& regions = mStrict ? strictRects : rects;
+  mFrameRegions = &regions;
+  
+  BeginFrame();
 
-    for (auto i = 0; i < rects.Size(); i++)
-      Draw(rects.Get(i), scale);
+  if (mSnapshotState == kSnapshotCapturing)
+    CaptureSnapshot(scale);
+  else
+  {
+    for (auto i = 0; i < regions.Size(); i++)
+      Draw(regions.Get(i), scale);
   }
   
+  if (mSnapshotState == kSnapshotShowing || mSnapshotState == kSnapshotFading)
+    DrawSnapshot(regions);
+  
   EndFrame();
+  
+  mFrameRegions = nullptr;
+  
+  if (mEditorOpenTiming && mEditorOpenStats.firstFrameTime < 0.)
+  {
+    mEditorOpenStats.firstFrameTime = GetTimestamp() - mEditorOpenStats.startTimestamp;
+    FinishEditorOpenStats();
+  }
+}
+
+void IGraphics::DrawSnapshot(const IRECTList& regions)
+{
+  if (!mSnapshotLayer && !mSnapshotDrawn)
+  {
+    mSnapshotLayer = CreatePixelLayer(mSnapshot->GetWidth(), mSnapshot->GetHeight());
+    
+    if (mSnapshotLayer)
+      UpdatePixelLayer(mSnapshotLayer, mSnapshot->GetPixels(), 0, 0, mSnapshot->GetWidth(), mSnapshot->GetHeight());
+    
+    mSnapshot->ReleasePixels();
+  }
+  
+  // a backend that can't show it lays out at the next frame all the same
+  mSnapshotDrawn = true;
+  
+  if (!mSnapshotLayer)
+    return;
+  
+  float alpha = 1.f;
+  
+  if (mSnapshotState == kSnapshotFading)
+    alpha = 1.f - static_cast<float>(std::chrono::duration<double, std::milli>(mFrameTime - mSnapshotFadeStart).count() / SNAPSHOT_FADE_DURATION);
+  
+  const IBlend blend(kBlendDefault, alpha);
+  
+  for (auto i = 0; i < regions.Size(); i++)
+  {
+    PrepareRegion(regions.Get(i));
+    DrawFittedLayer(mSnapshotLayer, GetBounds(), &blend);
+    CompleteRegion(regions.Get(i));
+  }
+}
+
+void IGraphics::CaptureSnapshot(float scale)
+{
+  auto pFrame = std::make_shared<RawBitmapData>();
+  int width, height;
+  
+  if (DrawFrameToPixels(*pFrame, width, height, scale))
+    mSnapshot->Save(pFrame);
+  
+  mSnapshotState = kSnapshotDone;
+  mSnapshot = nullptr;
+}
+
+bool IGraphics::DrawFrameToPixels(RawBitmapData& data, int& width, int& height, float scale)
+{
+  const IRECT bounds = GetBounds();
+  
+  // the whole UI is drawn to a layer, whose pixels are read, and which is then drawn to the window
+  StartLayer(bounds);
+  Draw(bounds, scale);
+  ILayerPtr layer = EndLayer();
+  
+  const bool read = layer && ReadLayerPixels(layer, data);
+  
+  if (read)
+  {
+    width = layer->GetAPIBitmap()->GetWidth();
+    height = layer->GetAPIBitmap()->GetHeight();
+  }
+  
+  if (layer)
+  {
+    PrepareRegion(bounds);
+    DrawLayer(layer);
+    CompleteRegion(bounds);
+  }
+  else
+    Draw(bounds, scale);
+  
+  return read;
 }
 
 void IGraphics::SetStrictDrawing(bool strict)
@@ -741,8 +1589,22 @@ void IGraphics::SetStrictDrawing(bool strict)
   SetAllControlsDirty();
 }
 
+void IGraphics::SetCacheAtFractionalScale(bool enable)
+{
+  mCacheAtFractionalScale = enable;
+  
+  ForAllControlsFunc([](IControl& control) {
+    if (control.GetCacheMode() == kCacheNone)
+      control.mDynamicLayer = nullptr;
+  });
+  
+  SetAllControlsDirty();
+}
+
 void IGraphics::OnMouseDown(float x, float y, const IMouseMod& mod)
 {
+  WakeTimer();
+  FlushMouseMoves();
   Trace("IGraphics::OnMouseDown", __LINE__, "x:%0.2f, y:%0.2f, mod:LRSCA: %i%i%i%i%i",
         x, y, mod.L, mod.R, mod.S, mod.C, mod.A);
 
@@ -795,6 +1657,8 @@ void IGraphics::OnMouseDown(float x, float y, const IMouseMod& mod)
 
 void IGraphics::OnMouseUp(float x, float y, const IMouseMod& mod)
 {
+  WakeTimer();
+  FlushMouseMoves();
   Trace("IGraphics::OnMouseUp", __LINE__, "x:%0.2f, y:%0.2f, mod:LRSCA: %i%i%i%i%i",
         x, y, mod.L, mod.R, mod.S, mod.C, mod.A);
    
@@ -812,6 +1676,10 @@ void IGraphics::OnMouseUp(float x, float y, const IMouseMod& mod)
   if (mResizingInProcess)
   {
     mResizingInProcess = false;
+    
+    if (mResizePreviewPending)
+      ResizeControls();
+    
     if (GetResizerMode() == EUIResizerMode::kUIResizerScale)
     {
       // If scaling up we may want to load in high DPI bitmaps if scale > 1.
@@ -823,6 +1691,7 @@ void IGraphics::OnMouseUp(float x, float y, const IMouseMod& mod)
 
 bool IGraphics::OnMouseOver(float x, float y, const IMouseMod& mod)
 {
+  WakeTimer();
   Trace("IGraphics::OnMouseOver", __LINE__, "x:%0.2f, y:%0.2f, mod:LRSCA: %i%i%i%i%i",
         x, y, mod.L, mod.R, mod.S, mod.C, mod.A);
 
@@ -845,6 +1714,8 @@ bool IGraphics::OnMouseOver(float x, float y, const IMouseMod& mod)
 
 void IGraphics::OnMouseOut()
 {
+  WakeTimer();
+  FlushMouseMoves();
   Trace("IGraphics::OnMouseOut", __LINE__, "");
 
   // Store the old cursor type so this gets restored when the mouse enters again
@@ -856,6 +1727,7 @@ void IGraphics::OnMouseOut()
 
 void IGraphics::OnMouseDrag(float x, float y, float dX, float dY, const IMouseMod& mod)
 {
+  WakeTimer();
   Trace("IGraphics::OnMouseDrag:", __LINE__, "x:%0.2f, y:%0.2f, dX:%0.2f, dY:%0.2f, mod:LRSCA: %i%i%i%i%i",
         x, y, dX, dY, mod.L, mod.R, mod.S, mod.C, mod.A);
 
@@ -869,8 +1741,50 @@ void IGraphics::OnMouseDrag(float x, float y, float dX, float dY, const IMouseMo
   }
 }
 
+void IGraphics::QueueMouseOver(float x, float y, const IMouseMod& mod)
+{
+  WakeTimer();
+  mQueuedMouseOver = { x, y, mod };
+  mMouseOverQueued = true;
+}
+
+void IGraphics::QueueMouseDrag(float x, float y, float dX, float dY, const IMouseMod& mod)
+{
+  WakeTimer();
+  
+  if (dX != 0 || dY != 0)
+    mQueuedDrags.push_back({ x, y, dX, dY, mod });
+}
+
+void IGraphics::FlushMouseMoves()
+{
+  if (mMouseOverQueued)
+  {
+    mMouseOverQueued = false;
+    OnMouseOver(mQueuedMouseOver.x, mQueuedMouseOver.y, mQueuedMouseOver.ms);
+  }
+  
+  if (mQueuedDrags.empty())
+    return;
+  
+  // swapped out first, as a control may queue more while handling these
+  mFlushedDrags.swap(mQueuedDrags);
+  const IMouseSample& last = mFlushedDrags.back();
+  
+  Trace("IGraphics::FlushMouseMoves:", __LINE__, "x:%0.2f, y:%0.2f, samples:%i", last.x, last.y, static_cast<int>(mFlushedDrags.size()));
+  
+  if (mResizingInProcess)
+    OnResizeGesture(last.x, last.y);
+  else if (mMouseCapture)
+    mMouseCapture->OnMouseDragSamples(mFlushedDrags.data(), static_cast<int>(mFlushedDrags.size()));
+  
+  mFlushedDrags.clear();
+}
+
 bool IGraphics::OnMouseDblClick(float x, float y, const IMouseMod& mod)
 {
+  WakeTimer();
+  FlushMouseMoves();
   Trace("IGraphics::OnMouseDblClick", __LINE__, "x:%0.2f, y:%0.2f, mod:LRSCA: %i%i%i%i%i",
         x, y, mod.L, mod.R, mod.S, mod.C, mod.A);
 
@@ -894,12 +1808,16 @@ bool IGraphics::OnMouseDblClick(float x, float y, const IMouseMod& mod)
 
 void IGraphics::OnMouseWheel(float x, float y, const IMouseMod& mod, float d)
 {
+  WakeTimer();
+  FlushMouseMoves();
   IControl* pControl = GetMouseControl(x, y, false);
   if (pControl) pControl->OnMouseWheel(x, y, mod, d);
 }
 
 bool IGraphics::OnKeyDown(float x, float y, const IKeyPress& key)
 {
+  WakeTimer();
+  FlushMouseMoves();
   Trace("IGraphics::OnKeyDown", __LINE__, "x:%0.2f, y:%0.2f, key:%i",
         x, y, key.Ascii);
 
@@ -918,6 +1836,8 @@ bool IGraphics::OnKeyDown(float x, float y, const IKeyPress& key)
 
 void IGraphics::OnDrop(const char* str, float x, float y)
 {
+  WakeTimer();
+  FlushMouseMoves();
   IControl* pControl = GetMouseControl(x, y, false);
   if (pControl) pControl->OnDrop(str);
 }
@@ -932,11 +1852,13 @@ int IGraphics::GetMouseControlIdx(float x, float y, bool mouseOver)
 {
   if (!mouseOver || mHandleMouseOver)
   {
-    // Search from front to back
-    for (auto c = NControls() - 1; c >= (mouseOver ? 1 : 0); --c)
-    {
+    // Search the controls in the grid cell under the point from front to back
+    return GetControlGrid().FindAt(x, y, [this, x, y, mouseOver](int c) {
       IControl* pControl = GetControl(c);
 
+      if (c < (mouseOver ? 1 : 0))
+        return false;
+
 #if _DEBUG
       if(!mLiveEdit)
       {
@@ -947,7 +1869,7 @@ int IGraphics::GetMouseControlIdx(float x, float y, bool mouseOver)
           {
             if (pControl->IsHit(x, y))
             {
-              return c;
+              return true;
             }
           }
         }
@@ -955,15 +1877,30 @@ int IGraphics::GetMouseControlIdx(float x, float y, bool mouseOver)
       }
       else if (pControl->IsHit(x, y))
       {
-        return c;
+        return true;
       }
 #endif
-    }
+      return false;
+    });
   }
   
   return -1;
 }
 
+IControlGrid& IGraphics::GetControlGrid()
+{
+  if (!mControlGrid.IsValid())
+  {
+    // the grid has to cover the area each control draws into (padded and pixel aligned by DrawControl()) and the area it is hit in
+    mControlGrid.Rebuild(GetBounds(), NControls(), [this](int c) {
+      const IControl* pControl = GetControl(c);
+      return pControl->GetRECT().GetPadded(2.f).Union(pControl->GetTargetRECT());
+    });
+  }
+
+  return mControlGrid;
+}
+
 IControl* IGraphics::GetMouseControl(float x, float y, bool capture, bool mouseOver)
 {
   if (mMouseCapture)
@@ -1135,7 +2072,7 @@ void IGraphics::EnableLiveEdit(bool enable, const char* file, int gridsize)
   {
     if (!mLiveEdit)
     {
-      mLiveEdit.reset(new IGraphicsLiveEdit(mHandleMouseOver/*, file, gridsize*/));
+      mLiveEdit.reset(new IGraphicsLiveEdit(mHandleMouseOver, file, static_cast<float>(gridsize)));
       mLiveEdit->SetDelegate(*GetDelegate());
       mHandleMouseOver = true;
     }
@@ -1154,6 +2091,16 @@ void IGraphics::EnableLiveEdit(bool enable, const char* file, int gridsize)
 
 ISVG IGraphics::LoadSVG(const char* fileName, const char* units, float dpi)
 {
+  TRACE_SCOPE;
+  ResourceLoadTimer timer(mEditorOpenTiming, mEditorOpenStats.nSVGs, mEditorOpenStats.svgTime);
+  
+  {
+    StaticStorage<SVGHolder>::SharedAccessor storage(sSVGCache);
+    
+    if (SVGHolder* pHolder = storage.FindUsed(fileName, 1., this))
+      return ISVG(pHolder->mImage);
+  }
+  
   StaticStorage<SVGHolder>::Accessor storage(sSVGCache);
   SVGHolder* pHolder = storage.Find(fileName);
 
@@ -1184,6 +2131,23 @@ ISVG IGraphics::LoadSVG(const char* fileName, const char* units, float dpi)
     }
 #endif
 
+    if (resourceFound == EResourceLocation::kPackedArchive)
+    {
+      int size = 0;
+      const void* pResData = IPlugResourceArchive::Get().Find(path.Get(), size);
+
+      if (pResData)
+      {
+        // copied, as nsvgParse() modifies the string it parses
+        WDL_String svgStr;
+        svgStr.Set(static_cast<const char*>(pResData), size);
+
+        pImage = nsvgParse(svgStr.Get(), units, dpi);
+      }
+      else
+        return ISVG(nullptr); // return invalid SVG
+    }
+
     if (resourceFound == EResourceLocation::kAbsolutePath)
     {
       pImage = nsvgParseFromFile(path.Get(), units, dpi);
@@ -1194,17 +2158,37 @@ ISVG IGraphics::LoadSVG(const char* fileName, const char* units, float dpi)
 
     pHolder = new SVGHolder(pImage);
     
-    storage.Add(pHolder, path.Get());
+    // stored under the name it is found by
+    storage.Add(pHolder, fileName, 1., SVGBytes(pImage));
   }
 
+  storage.AddUser(pHolder, this);
   return ISVG(pHolder->mImage);
 }
 
+static const char* GetBitmapExt(const char* name)
+{
+  const char* ext = name + strlen(name) - 1;
+  while (ext >= name && *ext != '.') --ext;
+  return ++ext;
+}
+
 IBitmap IGraphics::LoadBitmap(const char* name, int nStates, bool framesAreHorizontal, int targetScale)
 {
+  TRACE_SCOPE;
+  ResourceLoadTimer timer(mEditorOpenTiming, mEditorOpenStats.nBitmaps, mEditorOpenStats.bitmapTime);
+  
   if (targetScale == 0)
     targetScale = GetScreenScale();
 
+  // most bitmaps are found in the cache, without blocking other lookups
+  {
+    StaticStorage<APIBitmap>::SharedAccessor storage(sBitmapCache);
+    
+    if (APIBitmap* pAPIBitmap = storage.FindUsed(name, targetScale, this))
+      return IBitmap(pAPIBitmap, nStates, framesAreHorizontal, name);
+  }
+  
   StaticStorage<APIBitmap>::Accessor storage(sBitmapCache);
   APIBitmap* pAPIBitmap = storage.Find(name, targetScale);
 
@@ -1215,9 +2199,7 @@ IBitmap IGraphics::LoadBitmap(const char* name, int nStates, bool framesAreHoriz
     std::unique_ptr<APIBitmap> loadedBitmap;
     int sourceScale = 0;
     
-    const char* ext = name + strlen(name) - 1;
-    while (ext >= name && *ext != '.') --ext;
-    ++ext;
+    const char* ext = GetBitmapExt(name);
     
     bool bitmapTypeSupported = BitmapExtSupported(ext);
     
@@ -1240,7 +2222,11 @@ IBitmap IGraphics::LoadBitmap(const char* name, int nStates, bool framesAreHoriz
       // Load the resource if no match found
       if (!pAPIBitmap)
       {
-        loadedBitmap.reset(LoadAPIBitmap(fullPath.Get(), sourceScale, resourceLocation, ext));
+        loadedBitmap.reset(LoadPreloadedBitmap(fullPath.Get(), sourceScale));
+        
+        if (!loadedBitmap)
+          loadedBitmap.reset(LoadAPIBitmap(fullPath.Get(), sourceScale, resourceLocation, ext));
+        
         pAPIBitmap= loadedBitmap.get();
       }
     }
@@ -1251,7 +2237,9 @@ IBitmap IGraphics::LoadBitmap(const char* name, int nStates, bool framesAreHoriz
     // Scale or retain if needed (N.B. - scaling retains in the cache)
     if (pAPIBitmap->GetScale() != targetScale)
     {
-      return ScaleBitmap(IBitmap(pAPIBitmap, nStates, framesAreHorizontal, name), name, targetScale);
+      IBitmap bitmap = ScaleBitmap(IBitmap(pAPIBitmap, nStates, framesAreHorizontal, name), name, targetScale);
+      storage.AddUser(bitmap.GetAPIBitmap(), this);
+      return bitmap;
     }
     else if (loadedBitmap)
     {
@@ -1259,6 +2247,7 @@ IBitmap IGraphics::LoadBitmap(const char* name, int nStates, bool framesAreHoriz
     }
   }
 
+  storage.AddUser(pAPIBitmap, this);
   return IBitmap(pAPIBitmap, nStates, framesAreHorizontal, name);
 }
 
@@ -1268,10 +2257,72 @@ void IGraphics::ReleaseBitmap(const IBitmap& bitmap)
   storage.Remove(bitmap.GetAPIBitmap());
 }
 
+void IGraphics::PreloadBitmaps(const char** names, int nBitmaps, int targetScale)
+{
+  IBitmapPreloader::DecodeFunc decodeFunc = GetBitmapDecodeFunc();
+  
+  if (!decodeFunc)
+    return;
+  
+  if (targetScale == 0)
+    targetScale = GetScreenScale();
+  
+  if (!mBitmapPreloader)
+    mBitmapPreloader.reset(new IBitmapPreloader(decodeFunc));
+  
+  StaticStorage<APIBitmap>::Accessor storage(GetBitmapCache());
+  
+  // the resources are found here, as LoadBitmap() would, so that only the decoding is left to the workers
+  for (auto i = 0; i < nBitmaps; i++)
+  {
+    const char* name = names[i];
+    const char* ext = GetBitmapExt(name);
+    WDL_String fullPath;
+    int sourceScale = 0;
+    
+    if (!BitmapExtSupported(ext) || storage.Find(name, targetScale))
+      continue;
+    
+    EResourceLocation resourceLocation = SearchImageResource(name, ext, fullPath, targetScale, sourceScale);
+    
+    if (resourceLocation == EResourceLocation::kNotFound || storage.Find(name, sourceScale) || mBitmapPreloader->Contains(fullPath.Get(), sourceScale))
+      continue;
+    
+    mBitmapPreloader->Add(name, fullPath.Get(), resourceLocation, ext, GetWinModuleHandle(), sourceScale);
+  }
+}
+
+void IGraphics::FinishPreloadingBitmaps()
+{
+  StaticStorage<APIBitmap>::Accessor storage(GetBitmapCache());
+  
+  mBitmapPreloader->TakeDecoded([this, &storage](IBitmapPreloader::Bitmap& bitmap) {
+    APIBitmap* pAPIBitmap = bitmap.ok ? CreateAPIBitmapFromPixels(bitmap) : nullptr;
+    
+    if (pAPIBitmap)
+      storage.Add(pAPIBitmap, bitmap.name.Get(), bitmap.scale, APIBitmapBytes(pAPIBitmap));
+  });
+  
+  if (mBitmapPreloader->Finished())
+    mBitmapPreloader.reset();
+}
+
+APIBitmap* IGraphics::LoadPreloadedBitmap(const char* fileNameOrResID, int scale)
+{
+  std::shared_ptr<IBitmapPreloader::Bitmap> bitmap = mBitmapPreloader ? mBitmapPreloader->Take(fileNameOrResID, scale) : nullptr;
+  
+  return bitmap && bitmap->ok ? CreateAPIBitmapFromPixels(*bitmap) : nullptr;
+}
+
+StaticStorage<APIBitmap>& IGraphics::GetBitmapCache()
+{
+  return sBitmapCache;
+}
+
 void IGraphics::RetainBitmap(const IBitmap& bitmap, const char* cacheName)
 {
   StaticStorage<APIBitmap>::Accessor storage(sBitmapCache);
-  storage.Add(bitmap.GetAPIBitmap(), cacheName, bitmap.GetScale());
+  storage.Add(bitmap.GetAPIBitmap(), cacheName, bitmap.GetScale(), APIBitmapBytes(bitmap.GetAPIBitmap()));
 }
 
 IBitmap IGraphics::ScaleBitmap(const IBitmap& inBitmap, const char* name, int scale)
@@ -1308,6 +2359,18 @@ inline void IGraphics::SearchNextScale(int& sourceScale, int targetScale)
 
 EResourceLocation IGraphics::SearchImageResource(const char* name, const char* type, WDL_String& result, int targetScale, int& sourceScale)
 {
+  // an indexed image is only looked for at the first scale in the search order that it has
+  if (const IPlugResourceIndex::Entry* pEntry = IPlugResourceIndex::Get().Find(name))
+  {
+    for (sourceScale = targetScale ; sourceScale > 0; SearchNextScale(sourceScale, targetScale))
+    {
+      if (pEntry->scales & (1u << sourceScale))
+        return LocateResource(IPlugResourceIndex::ScaledName(name, sourceScale).c_str(), type, result, GetBundleID(), GetWinModuleHandle());
+    }
+
+    return EResourceLocation::kNotFound;
+  }
+
   // Search target scale, then descending
   for (sourceScale = targetScale ; sourceScale > 0; SearchNextScale(sourceScale, targetScale))
   {
@@ -1405,6 +2468,10 @@ ILayerPtr IGraphics::EndLayer()
 
 void IGraphics::PushLayer(ILayer *layer, bool clearTransforms)
 {
+  // a layer's bitmap may be gone by the time a display list is replayed
+  if (mDisplayList)
+    mDisplayList->SetUnsupported();
+  
   mLayers.push(layer);
   UpdateLayer();
   PathTransformReset(clearTransforms);
@@ -1438,6 +2505,9 @@ bool IGraphics::CheckLayer(const ILayerPtr& layer)
 
 void IGraphics::DrawLayer(const ILayerPtr& layer, const IBlend* pBlend)
 {
+  if (mDisplayList)
+    mDisplayList->SetUnsupported();
+  
   PathTransformSave();
   PathTransformReset();
   IBitmap bitmap = layer->GetBitmap();
@@ -1448,6 +2518,9 @@ void IGraphics::DrawLayer(const ILayerPtr& layer, const IBlend* pBlend)
 
 void IGraphics::DrawFittedLayer(const ILayerPtr& layer, const IRECT& bounds, const IBlend* pBlend)
 {
+  if (mDisplayList)
+    mDisplayList->SetUnsupported();
+  
   IBitmap bitmap = layer->GetBitmap();
   IRECT layerBounds = layer->Bounds();
   PathTransformSave();
@@ -1468,43 +2541,117 @@ void IGraphics::DrawRotatedLayer(const ILayerPtr& layer, double angle)
   PathTransformRestore();
 }
 
-void GaussianBlurSwap(unsigned char *out, unsigned char *in, unsigned char *kernel, int width, int height, int outStride, int inStride, int kernelSize, unsigned long norm)
+// Box blur n values with a window of 2 * radius + 1, treating those outside as zero
+static void BoxBlur(int* out, const int* in, int n, int radius)
+{
+  const int size = 2 * radius + 1;
+  int accum = 0;
+  
+  for (int k = 0; k < std::min(radius, n); k++)
+    accum += in[k];
+  
+  for (int j = 0; j < n; j++)
+  {
+    if (j + radius < n)
+      accum += in[j + radius];
+    if (j - radius > 0)
+      accum -= in[j - radius - 1];
+    
+    out[j] = (accum + radius) / size;
+  }
+}
+
+// Blur the alpha of each row of a 32 bit bitmap with three box blurs, which approximate a gaussian at a cost that doesn't depend on its size, writing the rows out as columns
+static void BoxBlurSwap(unsigned char* out, const unsigned char* in, const int* radii, int width, int height, int outStride, int inStride, WDL_TypedBuf<int>& buffer)
 {
+  buffer.Resize(2 * width, false);
+  int* pA = buffer.Get();
+  int* pB = pA + width;
+  
   for (int i = 0; i < height; i++, in += inStride)
   {
-    for (int j = 0; j < kernelSize - 1; j++)
-    {
-      unsigned long accum = in[j * 4] * kernel[0];
-      for (int k = 1; k < j + 1; k++)
-        accum += kernel[k] * in[(j - k) * 4];
-      for (int k = 1; k < kernelSize; k++)
-        accum += kernel[k] * in[(j + k) * 4];
-      out[j * outStride + (i * 4)] = static_cast<unsigned char>(std::min(static_cast<unsigned long>(255), accum / norm));
-    }
-    for (int j = kernelSize - 1; j < (width - kernelSize) + 1; j++)
+    // 8 bits of fraction, so that rounding doesn't build up over the passes
+    for (int j = 0; j < width; j++)
+      pA[j] = in[j * 4] << 8;
+    
+    for (int pass = 0; pass < 3; pass++)
     {
-      unsigned long accum = in[j * 4] * kernel[0];
-      for (int k = 1; k < kernelSize; k++)
-        accum += kernel[k] * (in[(j - k) * 4] + in[(j + k) * 4]);
-      out[j * outStride + (i * 4)] = static_cast<unsigned char>(std::min(static_cast<unsigned long>(255), accum / norm));
+      BoxBlur(pB, pA, width, radii[pass]);
+      std::swap(pA, pB);
     }
-    for (int j = (width - kernelSize) + 1; j < width; j++)
+    
+    for (int j = 0; j < width; j++)
+      out[j * outStride + (i * 4)] = static_cast<unsigned char>(std::min(255, (pA[j] + 128) >> 8));
+  }
+}
+
+ILayerPtr IGraphics::CreatePixelLayer(int width, int height)
+{
+  APIBitmap* pBitmap = width > 0 && height > 0 ? CreatePixelAPIBitmap(width, height) : nullptr;
+  
+  return pBitmap ? ILayerPtr(new ILayer(pBitmap, IRECT(0.f, 0.f, static_cast<float>(width), static_cast<float>(height)))) : nullptr;
+}
+
+bool IGraphics::DrawShader(IShader& shader, const IRECT& bounds, const IBlend* pBlend)
+{
+  // the largest side of a shader layer, which is about the largest texture every GPU backend can make
+  static constexpr int kMaxShaderSize = 4096;
+  
+  const float scale = GetBackingPixelScale();
+  const int width = std::min(static_cast<int>(std::ceil(bounds.W() * scale)), kMaxShaderSize);
+  const int height = std::min(static_cast<int>(std::ceil(bounds.H() * scale)), kMaxShaderSize);
+  
+  if (width <= 0 || height <= 0)
+    return false;
+  
+  if (!shader.mLayer || shader.mLayer->mInvalid || shader.mLayer->GetAPIBitmap()->GetWidth() != width || shader.mLayer->GetAPIBitmap()->GetHeight() != height)
+  {
+    shader.mLayer = CreatePixelLayer(width, height);
+    shader.mDirty = true;
+  }
+  
+  if (!shader.mLayer)
+    return false;
+  
+  if (shader.mDirty && !RenderShader(shader, shader.mLayer))
+  {
+    const IShader::PixelFunc& func = shader.GetPixelFunc();
+    
+    if (!func)
+      return false;
+    
+    shader.mPixels.resize(static_cast<size_t>(width) * height * 4);
+    uint8_t* pPixel = shader.mPixels.data();
+    
+    for (int y = 0; y < height; y++)
     {
-      unsigned long accum = in[j * 4] * kernel[0];
-      for (int k = 1; k < kernelSize; k++)
-        accum += kernel[k] * in[(j - k) * 4];
-      for (int k = 1; k < width - j; k++)
-        accum += kernel[k] * in[(j + k) * 4];
-      out[j * outStride + (i * 4)] = static_cast<unsigned char>(std::min(static_cast<unsigned long>(255), accum / norm));
+      const float v = (y + 0.5f) / height;
+      
+      for (int x = 0; x < width; x++, pPixel += 4)
+      {
+        const IColor color = func((x + 0.5f) / width, v, shader.GetValues());
+        pPixel[0] = static_cast<uint8_t>(color.R);
+        pPixel[1] = static_cast<uint8_t>(color.G);
+        pPixel[2] = static_cast<uint8_t>(color.B);
+        pPixel[3] = static_cast<uint8_t>(color.A);
+      }
     }
+    
+    UpdatePixelLayer(shader.mLayer, shader.mPixels.data(), 0, 0, width, height);
   }
+  
+  shader.mDirty = false;
+  DrawFittedBitmap(shader.mLayer->GetBitmap(), bounds, pBlend);
+  return true;
 }
 
 void IGraphics::ApplyLayerDropShadow(ILayerPtr& layer, const IShadow& shadow)
 {
+  if (mReduceEffects)
+    return;
+  
   RawBitmapData temp1;
   RawBitmapData temp2;
-  RawBitmapData kernel;
     
   // Get bitmap in 32-bit form
   GetLayerBitmapData(layer, temp1);
@@ -1513,29 +2660,29 @@ void IGraphics::ApplyLayerDropShadow(ILayerPtr& layer, const IShadow& shadow)
       return;
   temp2.Resize(temp1.GetSize());
     
-  // Form kernel (reference blurSize from zero (which will be no blur))
+  // Form the box sizes (reference blurSize from zero (which will be no blur))
   bool flipped = FlippedBitmap();
   float scale = layer->GetAPIBitmap()->GetScale() * layer->GetAPIBitmap()->GetDrawScale();
   float blurSize = std::max(1.f, (shadow.mBlurSize * scale) + 1.f);
-  float blurConst = 4.5f / (blurSize * blurSize);
-  int iSize = static_cast<int>(ceil(blurSize));
   int width = layer->GetAPIBitmap()->GetWidth();
   int height = layer->GetAPIBitmap()->GetHeight();
   int stride1 = temp1.GetSize() / width;
   int stride2 = flipped ? -temp1.GetSize() / height : temp1.GetSize() / height;
   int stride3 = flipped ? -stride2 : stride2;
 
-  kernel.Resize(iSize);
-        
-  for (int i = 0; i < iSize; i++)
-    kernel.Get()[i] = static_cast<uint8_t>(std::round(255.f * std::expf(-(i * i) * blurConst)));
+  // three boxes whose combined variance is that of the gaussian with a standard deviation of blurSize / 3, as the kernel this replaced used
+  // the odd sizes nearest to the ideal one are mixed to match the variance, see Kutskir, "Fastest Gaussian Blur"
+  const float variance = blurSize * blurSize / 9.f;
+  int lower = static_cast<int>(std::floor(std::sqrt(4.f * variance + 1.f)));
   
-  // Kernel normalisation
+  if (!(lower & 1))
+    lower--;
   
-  int normFactor = kernel.Get()[0];
-    
-  for (int i = 1; i < iSize; i++)
-    normFactor += kernel.Get()[i] + kernel.Get()[i];
+  const int nLower = static_cast<int>(std::round((12.f * variance - 3 * lower * lower - 12 * lower - 9) / (-4.f * lower - 4.f)));
+  int radii[3];
+  
+  for (int i = 0; i < 3; i++)
+    radii[i] = ((i < nLower ? lower : lower + 2) - 1) / 2;
   
   // Do blur
   
@@ -1543,8 +2690,16 @@ void IGraphics::ApplyLayerDropShadow(ILayerPtr& layer, const IShadow& shadow)
   unsigned char* inRows = flipped ? asRows + stride3 * (height - 1) : asRows;
   unsigned char* asCols = temp2.Get() + AlphaChannel();
   
-  GaussianBlurSwap(asCols, inRows, kernel.Get(), width, height, stride1, stride2, iSize, normFactor);
-  GaussianBlurSwap(asRows, asCols, kernel.Get(), height, width, stride3, stride1, iSize, normFactor);
+  // the rows of each pass are independent, so they are blurred in bands on the worker threads
+  IParallelBands::Run(height, width, [&](int start, int end) {
+    WDL_TypedBuf<int> buffer;
+    BoxBlurSwap(asCols + start * 4, inRows + start * stride2, radii, width, end - start, stride1, stride2, buffer);
+  });
+  
+  IParallelBands::Run(width, height, [&](int start, int end) {
+    WDL_TypedBuf<int> buffer;
+    BoxBlurSwap(asRows + start * 4, asCols + start * stride1, radii, height, end - start, stride3, stride1, buffer);
+  });
   
   // Apply alphas to the pattern and recombine/replace the image
     
@@ -1553,6 +2708,9 @@ void IGraphics::ApplyLayerDropShadow(ILayerPtr& layer, const IShadow& shadow)
 
 bool IGraphics::LoadFont(const char* fontID, const char* fileNameOrResID)
 {
+  TRACE_SCOPE;
+  ResourceLoadTimer timer(mEditorOpenTiming, mEditorOpenStats.nFonts, mEditorOpenStats.fontTime);
+  
   PlatformFontPtr font = LoadPlatformFont(fontID, fileNameOrResID);
   
   if (font)
@@ -1560,6 +2718,7 @@ bool IGraphics::LoadFont(const char* fontID, const char* fileNameOrResID)
     if (LoadAPIFont(fontID, font))
     {
       CachePlatformFont(fontID, font);
+      ITextMeasureCache::Get().Clear();
       return true;
     }
   }
@@ -1570,6 +2729,9 @@ bool IGraphics::LoadFont(const char* fontID, const char* fileNameOrResID)
 
 bool IGraphics::LoadFont(const char* fontID, const char* fontName, ETextStyle style)
 {
+  TRACE_SCOPE;
+  ResourceLoadTimer timer(mEditorOpenTiming, mEditorOpenStats.nFonts, mEditorOpenStats.fontTime);
+  
   PlatformFontPtr font = LoadPlatformFont(fontID, fontName, style);
   
   if (font)
@@ -1577,6 +2739,7 @@ bool IGraphics::LoadFont(const char* fontID, const char* fontName, ETextStyle st
     if (LoadAPIFont(fontID, font))
     {
       CachePlatformFont(fontID, font);
+      ITextMeasureCache::Get().Clear();
       return true;
     }
   }
@@ -43,12 +43,16 @@
 #include "IPlugConstants.h"
 #include "IPlugLogger.h"
 #include "IPlugPaths.h"
+#include "IAdaptiveTimerRate.h"
 
 #include "IGraphicsConstants.h"
 #include "IGraphicsStructs.h"
 #include "IGraphicsUtilities.h"
 #include "IGraphicsPopupMenu.h"
 #include "IGraphicsEditorDelegate.h"
+#include "IControlGrid.h"
+#include "IBitmapPreloader.h"
+#include "IEditorSnapshot.h"
 
 #include <stack>
 #include <memory>
@@ -62,6 +66,7 @@
 #endif
 
 class IControl;
+class IDisplayList;
 class IPopupMenuControl;
 class ITextEntryControl;
 class ICornerResizerControl;
@@ -102,6 +107,34 @@ public:
   /** Called after a platform view is destroyed, so that drawing classes can e.g. free any resources */
   virtual void OnViewDestroyed() {};
 
+  /** Called by the platform class once its view is initialized, to lay out the UI with IGEditorDelegate::LayoutUI(). If a snapshot is shown, see EnableSnapshotOnOpen(),
+   * the layout is done on the frame after the one that shows it */
+  void LayoutUIOnOpen();
+
+private:
+  /** Draw the snapshot shown on open over the regions, faded while the UI is faded to, uploading it on the first frame */
+  void DrawSnapshot(const IRECTList& regions);
+
+  /** Draw the whole UI through a layer, and save its pixels as the snapshot */
+  void CaptureSnapshot(float scale);
+
+  /** Lay out the UI with IGEditorDelegate::LayoutUI() as the editor opens, timing it for the IEditorOpenStats */
+  void LayoutUIForOpen();
+
+  /** Fill in the memory counters of the IEditorOpenStats, and report them once the open is finished */
+  void FinishEditorOpenStats();
+
+protected:
+  /** Draw the whole UI into a layer, read its pixels back and then draw the layer, called between BeginFrame() and EndFrame(). Needs a backend that implements ReadLayerPixels()
+   * @param data Set to the pixels, 8 bit RGBA premultiplied by their alpha, a row after another from the top
+   * @param width Set to the width of the pixels, the width of the UI at GetBackingPixelScale()
+   * @param height Set to the height of the pixels
+   * @param scale The backing pixel scale to draw at
+   * @return \c true if the pixels were read, otherwise the UI is drawn without a layer */
+  bool DrawFrameToPixels(RawBitmapData& data, int& width, int& height, float scale);
+
+public:
+
   /** Called by some drawing API classes to finally blit the draw bitmap onto the screen or perform other cleanup after drawing */
   virtual void EndFrame() {};
 
@@ -121,6 +154,18 @@ public:
    * @param pBlend Optional blend method, see IBlend documentation */
   virtual void DrawRotatedSVG(const ISVG& svg, float destCentreX, float destCentreY, float width, float height, double angle, const IBlend* pBlend = 0) = 0;
 
+  /** Rasterize each SVG once for each size it is drawn at, into a layer that is then drawn as a bitmap, instead of rebuilding its paths and gradients on every draw.
+   * The layers are redrawn when the screen or draw scale changes. SVGs drawn rotated reuse the layer of their size, and those drawn skewed or stretched are always drawn as paths.
+   * Only path based drawing backends cache SVGs
+   * @param enable \c true to cache SVGs, \c false to draw them as paths and free the cache */
+  void EnableSVGCache(bool enable) { mSVGCacheEnabled = enable; if (!enable) ClearSVGCache(); }
+
+  /** @return \c true if SVGs are cached, see EnableSVGCache() */
+  bool SVGCacheEnabled() const { return mSVGCacheEnabled; }
+
+  /** Free the layers of the SVG cache, see EnableSVGCache() */
+  virtual void ClearSVGCache() {}
+
   /** Draw a bitmap (raster) image to the graphics context
    * @param bitmap The bitmap image to draw to the graphics context
    * @param bounds The rectangular region to draw the image in
@@ -331,6 +376,41 @@ public:
    * @param pBlend Optional blend method, see IBlend documentation */
   virtual void FillEllipse(const IColor& color, float x, float y, float r1, float r2, float angle = 0.0, const IBlend* pBlend = 0) = 0;
   
+  /** Fill many rectangular regions of the graphics context with one color. Path based backends fill them as one path, in one call to the drawing API,
+   * so where they overlap they are filled once, rather than once for each as FillRect() would
+   * @param color The color to fill the shapes with
+   * @param pBounds The rectangular regions to fill
+   * @param nRects The number of regions
+   * @param pBlend Optional blend method, see IBlend documentation */
+  virtual void FillRects(const IColor& color, const IRECT* pBounds, int nRects, const IBlend* pBlend = 0)
+  {
+    for (int i = 0; i < nRects; i++)
+      FillRect(color, pBounds[i], pBlend);
+  }
+  
+  /** Fill many circles in the graphics context with one color, see FillRects()
+   * @param color The color to fill the shapes with
+   * @param pCircles The x and y coordinates of the centre and the radius of each circle
+   * @param nCircles The number of circles
+   * @param pBlend Optional blend method, see IBlend documentation */
+  virtual void FillCircles(const IColor& color, const float* pCircles, int nCircles, const IBlend* pBlend = 0)
+  {
+    for (int i = 0; i < nCircles; i++)
+      FillCircle(color, pCircles[i * 3], pCircles[i * 3 + 1], pCircles[i * 3 + 2], pBlend);
+  }
+  
+  /** Draw many separate lines in one color and thickness. Path based backends stroke them as one path, see FillRects()
+   * @param color The color to draw the lines with
+   * @param pLines The x1, y1, x2 and y2 coordinates of each line
+   * @param nLines The number of lines
+   * @param pBlend Optional blend method, see IBlend documentation
+   * @param thickness Optional line thickness */
+  virtual void DrawLines(const IColor& color, const float* pLines, int nLines, const IBlend* pBlend = 0, float thickness = 1.f)
+  {
+    for (int i = 0; i < nLines; i++)
+      DrawLine(color, pLines[i * 4], pLines[i * 4 + 1], pLines[i * 4 + 2], pLines[i * 4 + 3], pBlend, thickness);
+  }
+  
   /** Fill an arc segment in the graphics context with a color
    * @param color The color to fill the shape with
    * @param cx The X coordinate in the graphics context of the centre of the circle on which the arc lies
@@ -364,7 +444,7 @@ public:
    * @return \todo */
   bool DrawText(const IText& text, const char* str, float x, float y, const IBlend* pBlend = 0);
   
-  /** Measure the rectangular region that some text will occupy
+  /** Measure the rectangular region that some text will occupy. The results are shared by all instances, see ITextMeasureCache
    * @param text An IText struct containing font and text properties and layout info
    * @param str The text string to draw in the graphics context
    * @param bounds after calling the method this IRECT will be updated with the rectangular region the text will occupy
@@ -400,6 +480,20 @@ public:
    * @param bitmap /todo */
   virtual void ReleaseBitmap(const IBitmap& bitmap);
 
+  /** Set the memory that the bitmaps and SVGs shared by the instances in this binary are kept in, once no editor uses them. Each instance counts as a user of what it loads
+   * until it is destroyed, and unused resources are kept for the next editor to open until the cache is over its budget, when those that were used longest ago are deleted first.
+   * Resources in use are never deleted, so the cache can be over its budget while editors are open. NanoVG's bitmaps belong to its context, and aren't in the shared cache
+   * @param bytes The budget in bytes, of which an eighth is for SVGs, or 0 to keep every resource until the last instance is destroyed, the default */
+  static void SetResourceCacheBudget(size_t bytes);
+  
+  /** @return The memory used by the bitmaps and SVGs in the shared cache, in bytes, see SetResourceCacheBudget() */
+  static size_t GetResourceCacheBytes();
+  
+  /** Delete cached bitmaps above 1x as soon as no editor uses them, rather than keep them within the budget, e.g. to free the 2x bitmaps of an editor that was closed
+   * on a high resolution screen, see SetResourceCacheBudget()
+   * @param drop \c true to delete them */
+  static void SetDropScaledBitmapsOnClose(bool drop);
+
   /** /todo 
    * @param src /todo
    * @return IBitmap /todo */
@@ -482,14 +576,16 @@ public:
    * @param thickness Optional line thickness */
   virtual void DrawGrid(const IColor& color, const IRECT& bounds, float gridSizeH, float gridSizeV, const IBlend* pBlend = 0, float thickness = 1.f);
 
-  /** /todo
-   * @param color /todo
-   * @param bounds /todo
-   * @param normYPoints /todo
-   * @param nPoints /todo
-   * @param normXPoints /todo
-   * @param pBlend /todo
-   * @param thickness /todo */
+  /** Draw a line through a series of points, such as a waveform or a spectrum, as one path. When there are more points than the bounds are pixels wide,
+   * the points that fall in each pixel column are reduced to the first, the lowest, the highest and the last, so that the cost of drawing depends on the width
+   * rather than the number of points, and peaks are kept
+   * @param color The color of the line
+   * @param bounds The region to draw the points in
+   * @param normYPoints The heights of the points, from 0 at the bottom of the bounds to 1 at the top
+   * @param nPoints The number of points
+   * @param normXPoints Optional positions of the points, from 0 at the left of the bounds to 1 at the right. If nullptr the points are spaced evenly across the bounds
+   * @param pBlend Optional blend method, see IBlend documentation
+   * @param thickness Optional line thickness */
   virtual void DrawData(const IColor& color, const IRECT& bounds, float* normYPoints, int nPoints, float* normXPoints = nullptr, const IBlend* pBlend = 0, float thickness = 1.f);
   
   /** Load a font to be used by the graphics context
@@ -544,6 +640,37 @@ public:
   * @param layer - the layer to add the shadow to 
   * @param shadow - the shadow to add */
   void ApplyLayerDropShadow(ILayerPtr& layer, const IShadow& shadow);
+
+  /** Read back the pixels of a layer. On a GPU backend this waits until the layer has been drawn, so it also serves to time drawing. Only NanoVG and LICE implement it
+   * @param layer The layer
+   * @param data Set to the pixels, 8 bit RGBA premultiplied by their alpha, a row after another from the top
+   * @return \c true if the pixels were read */
+  bool CopyLayerPixels(const ILayerPtr& layer, RawBitmapData& data) { return layer && ReadLayerPixels(layer, data); }
+
+  /** Create a layer whose pixels are written with UpdatePixelLayer() rather than drawn, for a display that adds a row or column of pixels at a time, such as a spectrogram.
+   * Its bitmap has as many pixels as asked for, whatever the scale of the UI, and is drawn stretched with DrawFittedLayer(), or DrawFittedBitmap() of its bitmap
+   * @param width The width in pixels
+   * @param height The height in pixels
+   * @return The layer, with transparent pixels and bounds of its size in pixels, or nullptr if the backend can't write pixels to a bitmap */
+  ILayerPtr CreatePixelLayer(int width, int height);
+  
+  /** Write a region of the pixels of a layer made by CreatePixelLayer(). GPU backends upload only the region, so call it from IControl::Draw(), where the context is current,
+   * before the layer is drawn
+   * @param layer The layer
+   * @param pData The pixels of the whole layer, 8 bit RGBA with straight alpha, a row after another, of which only the region is read
+   * @param x The left of the region
+   * @param y The top of the region
+   * @param width The width of the region
+   * @param height The height of the region */
+  virtual void UpdatePixelLayer(const ILayerPtr& layer, const uint8_t* pData, int x, int y, int width, int height) {}
+
+  /** Draw a fragment shader over a region. The shader is drawn into a layer of the region's size in pixels, which is kept until a value, the texture or the size changes,
+   * so a shader that doesn't change costs no more than a bitmap. GPU backends run the shader's source, others call its pixel function, see IShader, so call it from IControl::Draw()
+   * @param shader The shader, which keeps the layer
+   * @param bounds The region to fill
+   * @param pBlend Optional blend method, see IBlend documentation
+   * @return \c true if the shader was drawn, \c false if the backend can neither run the source nor write the pixel function's pixels to a layer */
+  bool DrawShader(IShader& shader, const IRECT& bounds, const IBlend* pBlend = 0);
     
   /** /todo */
   virtual void UpdateLayer() {}
@@ -558,6 +685,12 @@ public:
    * @param mask /todo
    * @param shadow /todo */
   virtual void ApplyShadowMask(ILayerPtr& layer, RawBitmapData& mask, const IShadow& shadow) = 0;
+
+  /** Implemented by backends that run shaders, to draw a shader's source into a layer made by CreatePixelLayer(), see DrawShader()
+   * @param shader The shader
+   * @param layer The layer, of the size to draw at
+   * @return \c true if the shader was run, \c false to fall back to its pixel function */
+  virtual bool RenderShader(const IShader& shader, const ILayerPtr& layer) { return false; }
   
   /** /todo
    * @param layer /todo
@@ -569,6 +702,12 @@ public:
    * @return ILayer* /todo */
   ILayer* PopLayer(bool clearTransforms);
   
+protected:
+  /** Calculate the points that DrawData() draws, in the UI's coordinates, see DrawData()
+   * @param nOutPoints Set to the number of points
+   * @return The x and y of each point, which are valid until the next call */
+  const float* CalculateDataPoints(const IRECT& bounds, const float* normYPoints, int nPoints, const float* normXPoints, int& nOutPoints);
+
 #pragma mark - Drawing API path support
 public:
   
@@ -729,6 +868,10 @@ public:
   /** /todo 
    * @param r /todo */
   virtual void PathClipRegion(const IRECT r = IRECT()) {}
+
+  /** @return The area being redrawn while a control draws, so that a control made of many parts, such as IVTrackControlBase, can skip the parts outside it.
+   * It is empty when the whole control is drawn, such as into its cache layer */
+  const IRECT& GetDrawRegion() const { return mDrawRegion; }
   
 private:
   /** Prepare a particular area of the display for drawing, normally resulting in clipping of the region.
@@ -892,6 +1035,11 @@ protected:
    * @param pCaller /todo
    * @return IPopupMenu* /todo */
   virtual IPopupMenu* CreatePlatformPopupMenu(IPopupMenu& menu, const IRECT& bounds, IControl* pCaller = nullptr) = 0;
+  
+  /** Implemented on platforms that can change the rate of their redraw timer while it is running, see SetAdaptiveFrameRate(). Platforms that can follow the display's refresh
+   * should do so instead of running the timer while VSyncActive(), see SetVSync()
+   * @param intervalMs The new interval between timer ticks in milliseconds */
+  virtual void SetPlatformTimerInterval(uint32_t intervalMs) {}
 
 #pragma mark - Base implementation
 public:
@@ -908,6 +1056,10 @@ public:
    * @return /c true if a control is dirty */
   bool IsDirty(IRECTList& rects);
 
+  /** @return The time sampled at the start of the current display refresh, see IsDirty(). The progress of every animation is measured against it,
+   * so that the animations of a frame advance together and the clock is read once per frame rather than once per animation */
+  TimePoint GetFrameTime() const { return mFrameTime; }
+
   /** Called by the platform class when an area needs to be redrawn
    * @param rects A set of rectangular regions to draw */
   void Draw(IRECTList& rects);
@@ -969,6 +1121,32 @@ public:
   void SetStrictDrawing(bool strict);
   
   void SetLayoutOnResize(bool layoutOnResize);
+  
+  /** Show the last frame of the editor as soon as its window opens, before the UI is laid out, then lay the UI out and crossfade from the frame to it.
+   * A frame is saved for each size and scale, on a worker thread, once the UI has settled after opening, see IEditorSnapshot. Call it before the window opens,
+   * e.g. where the graphics are made. Only backends that can read and write the pixels of a layer support it, see CreatePixelLayer()
+   * @param enable Set \c true to show the last frame
+   * @param name The name of the plug-in's folder in the user's settings, where the frames are kept, e.g. PLUG_NAME */
+  void EnableSnapshotOnOpen(bool enable, const char* name);
+  
+  /** Preview a resize gesture, made with the corner resizer, by stretching the last frame to the window while the gesture is active.
+   * The controls are resized, laid out and redrawn and the backing surfaces are recreated only once, when the gesture ends, rather than at every mouse move,
+   * which keeps resizing a big UI smooth. Only backends that can stretch their last frame support it, see CanPreviewResize()
+   * @param enable Set \c true to preview resize gestures */
+  void EnableResizePreview(bool enable) { mResizePreview = enable; }
+  
+  /** @return \c true if resize gestures are previewed, see EnableResizePreview() */
+  bool ResizePreviewEnabled() const { return mResizePreview; }
+  
+  /** Cache the drawing of each control that has no cache mode of its own in a layer aligned to the backing pixels, while the backing pixel scale is fractional, such as 1.25 or 1.5.
+   * At those scales the antialiased edges of a control's padded bounds share pixels with its neighbours, so a control that changes has them redrawn too, each at the full cost of its Draw().
+   * With this on, a neighbour only blits its layer, which is drawn again when the control is marked dirty or the scale changes. Controls that animate or are polled are drawn as usual,
+   * as they change at every frame, and so are all controls at whole number scales
+   * @param enable Set \c true to cache controls at fractional scales */
+  void SetCacheAtFractionalScale(bool enable);
+  
+  /** @return \c true if controls are cached at fractional scales, see SetCacheAtFractionalScale() */
+  bool GetCacheAtFractionalScale() const { return mCacheAtFractionalScale; }
 
   /** Gets the width of the graphics context
    * @return A whole number representing the width of the graphics context in pixels on a 1:1 screen */
@@ -989,6 +1167,50 @@ public:
   /** Gets the drawing frame rate
    * @return A whole number representing the desired frame rate at which the graphics context is redrawn. NOTE: the actual frame rate might be different */
   int FPS() const { return mFPS; }
+  
+  /** Let the redraw timer back off, up to ADAPTIVE_TIMER_MAX_INTERVAL, after ADAPTIVE_TIMER_IDLE_TICKS ticks with nothing dirty, so that an idle UI costs next to nothing.
+   * Input, animations and updates from the delegate put it back to FPS() straight away. On by default, where the platform supports it
+   * @param enable \c false to always redraw at FPS() */
+  void SetAdaptiveFrameRate(bool enable);
+  
+  /** Put the redraw timer back to FPS() straight away, e.g. when a control is about to change outside of the usual input and delegate paths */
+  void WakeTimer();
+  
+  /** Called by the platform on each tick of its redraw timer, after checking whether anything needs redrawing
+   * @param dirty \c true if anything was dirty on this tick */
+  void AdaptTimerInterval(bool dirty);
+
+  /** Drive redraws from the display's refresh, with CVDisplayLink on macOS, DwmFlush() on Windows and requestAnimationFrame on the web, rather than from a timer at FPS(),
+   * so that frames are in step with the display at whatever rate it runs. As with the timer, only refreshes where something is dirty are drawn, and while the adaptive frame rate
+   * has backed off the platform's timer takes over. On by default, where the platform supports it
+   * @param enable \c false to always use the timer */
+  void SetVSync(bool enable);
+
+  /** @return \c true if redraws follow the display's refresh where the platform supports it, see SetVSync() */
+  bool GetVSync() const { return mVSync; }
+
+  /** @return \c true if the platform should drive redraws from the display's refresh now, rather than from its timer */
+  bool VSyncActive() const { return mVSync && mTimerRate.IsActive(); }
+
+  /** Cap the frame rate while redraws follow the display's refresh, e.g. to 60 on a 120 Hz display, by skipping refreshes
+   * @param fps The most frames per second, or 0 for no cap */
+  void SetMaxFPS(int fps) { mMaxFPS = fps; }
+
+  /** @return The frame rate cap, or 0 for none, see SetMaxFPS() */
+  int GetMaxFPS() const { return mMaxFPS; }
+
+  /** Called by the platform at each display refresh while redraws follow it, before checking whether anything needs redrawing
+   * @param timestamp The time of the refresh in seconds, on any clock that increases steadily
+   * @return \c true to go on with this refresh, \c false to skip it to keep under GetMaxFPS() */
+  bool OnDisplayRefresh(double timestamp);
+
+  /** Leave out costly effects, currently the drop shadows applied with ApplyLayerDropShadow(), e.g. while the device is saving power or is hot.
+   * The controls' cached layers are discarded, so that they are redrawn with or without them
+   * @param reduce \c true to leave them out */
+  void SetReduceEffects(bool reduce);
+
+  /** @return \c true if costly effects are left out, see SetReduceEffects() */
+  bool GetReduceEffects() const { return mReduceEffects; }
 
   /** Gets the graphics context scaling factor.
    * @return The scaling applied to the graphics context */
@@ -1033,10 +1255,55 @@ public:
   
   /**@return \c true if showning the control bounds */
   bool ShowControlBoundsEnabled() const { return mShowControlBounds; }
+
+  /** Time each control's drawing, to find the controls that are expensive to draw, see IControl::GetDrawStats(). The FPS display shows the profile in its controls style,
+   * see ShowFPSDisplay(). A control drawn in several regions in one frame is counted once for each. With GPU backends only the time taken to issue the drawing is measured
+   * @param enable \c true to start profiling, which also resets the profile */
+  void EnableDrawProfiling(bool enable);
+
+  /** @return \c true if the drawing of controls is being timed */
+  bool DrawProfilingEnabled() const { return mDrawProfiling; }
+
+  /** Clear the draw statistics of every control */
+  void ResetDrawProfile();
+
+  /** @return The time in seconds since the draw profile was reset, to turn the numbers of draws into rates */
+  double GetDrawProfileDuration() const { return GetTimestamp() - mDrawProfileStart; }
+
+  /** Get the controls that have been drawn since the draw profile was reset, most expensive first
+   * @param controls Filled with the controls
+   * @param sort The statistic to order them by */
+  void GetDrawProfile(WDL_PtrList<IControl>& controls, EDrawProfileSort sort = kDrawProfileSortTotal);
+
+  /** Write the draw profile as CSV, one line per control that has been drawn, in the order of GetDrawProfile(), and print it with DBGMSG
+   * @param csv Filled with the CSV */
+  void DumpDrawProfile(WDL_String& csv);
+
+  /** Start timing the opening of the editor, called by IGEditorDelegate::OpenWindow(). Without it, the timing starts when the view is initialized
+   * @param startTimestamp GetTimestamp() when the open started
+   * @param createdTimestamp GetTimestamp() when the graphics had been created */
+  void StartEditorOpenStats(double startTimestamp, double createdTimestamp);
+
+  /** Get the phases of the last opening of the editor and what it loaded, see IEditorOpenStats. Once it is finished, the stats are also reported with TRACE_COUNTER
+   * and printed with DBGMSG, so that the open time can be tracked across releases
+   * @return The stats, which are complete once IEditorOpenStats::Finished() */
+  const IEditorOpenStats& GetEditorOpenStats() const { return mEditorOpenStats; }
+
+  /** @return \c true if the backend keeps its bitmaps in GPU textures, for the memory counters of IEditorOpenStats */
+  virtual bool BitmapsAreTextures() const { return false; }
+
+  /** Add the memory this editor holds to a report, called by IGEditorDelegate for IEditorDelegate::GetMemoryReport() while the editor is open.
+   * The bitmap, SVG and font caches are shared by every editor in the process, so are reported by IMemoryRegistry rather than here
+   * @param report The report to add items to */
+  void GetMemoryReport(IMemoryReport& report);
+  
+  /** Override in a drawing backend to add the memory it holds for this editor, such as pooled layers. The base implementation estimates the backing surface from the size of the UI
+   * @param report The report to add items to */
+  virtual void ReportDrawingMemory(IMemoryReport& report);
   
   /** Live edit mode allows you to relocate controls at runtime in debug builds and save the locations to a predefined file (e.g. main plugin .cpp file) \todo we need a separate page for liveedit info
    * @param enable Set \c true if you wish to enable live editing mode
-   * @param file The absolute path of the file which contains the layout info (correctly tagged) for live editing
+   * @param file The absolute path of the file which contains the layout info for live editing. The edited layout is written to this path with ".layout" appended
    * @param gridsize The size of the layout grid in pixels */
   void EnableLiveEdit(bool enable, const char* file = 0, int gridsize = 10);
   
@@ -1059,6 +1326,10 @@ private:
   /** /todo */
   virtual void DrawResize() {}
   
+  /** @return \c true if the backend keeps its last frame in a surface that it stretches to the window when presenting, so that a resize gesture can be previewed
+   * without redrawing, see EnableResizePreview() */
+  virtual bool CanPreviewResize() const { return false; }
+  
   /** /todo
    * @param bounds /todo
    * @param scale /todo */
@@ -1074,6 +1345,9 @@ protected: // TODO: correct?
   /** /todo */
   void StartResizeGesture() { mResizingInProcess = true; };
   
+  /** Resize the controls, recreate the backing surfaces and lay out the UI after the size or scale has changed, see Resize() */
+  void ResizeControls();
+  
 #pragma mark - Control management
 public:
   
@@ -1092,6 +1366,10 @@ public:
   /** For all standard controls in the main control stack perform a function
    * @param func A std::function to perform on each control */
   void ForStandardControlsFunc(std::function<void(IControl& control)> func);
+
+  /** For the special controls that IGraphics owns outside the main control stack (performance display, live edit, corner resizer, text entry and popup menu) perform a function
+   * @param func A std::function to perform on each control */
+  void ForSpecialControlsFunc(std::function<void(IControl& control)> func);
   
   /** /todo
    * @tparam T /todo
@@ -1112,6 +1390,27 @@ public:
    * @param func /todo */
   void ForControlInGroup(const char* group, std::function<void(IControl& control)> func);
   
+  /** Declare a group of controls, such as a page of a tabbed UI, whose controls are only created, and their bitmaps and SVGs loaded, when the group is first shown
+   * with HideGroup(group, false), so that an editor opens without building pages that may never be looked at. The function attaches the controls as usual,
+   * they are given the group if they don't have one, and take the group's place in the control stack, i.e. above the controls attached before this call.
+   * The group is created hidden, so the layout should show the page that is open with HideGroup()
+   * @param group The name of the group
+   * @param func Attaches the group's controls
+   * @param prefetchBitmaps If not nullptr, bitmaps the group loads, which start decoding on worker threads now, see PreloadBitmaps()
+   * @param nPrefetchBitmaps The number of bitmaps in prefetchBitmaps
+   * @param createWhenIdle \c true to create the group, still hidden, on the first frame that has nothing to draw, so that it shows at once when it is needed */
+  void AttachLazyGroup(const char* group, ILazyGroupFunction func, const char** prefetchBitmaps = nullptr, int nPrefetchBitmaps = 0, bool createWhenIdle = false);
+
+  /** Create the controls of a group declared with AttachLazyGroup(), hidden, if they haven't been created
+   * @param group The name of the group
+   * @return \c true if the group was created by this call */
+  bool CreateLazyGroup(const char* group);
+
+  /** Hide or show every control in a group, first creating the controls of a group declared with AttachLazyGroup() that is shown for the first time
+   * @param group The name of the group
+   * @param hide \c true to hide */
+  void HideGroup(const char* group, bool hide);
+
   /** Attach an IBitmapControl as the lowest IControl in the control stack to be the background for the graphics context
    * @param fileName CString fileName resource id for the bitmap image \todo check this */
   void AttachBackground(const char* fileName);
@@ -1189,6 +1488,10 @@ public:
   /** @return The number of controls that have been added to this graphics context */
   int NControls() const { return mControls.GetSize(); }
 
+  /** @param pControl A control
+   * @return The index of the control in the control stack, or -1 if it is not in it */
+  int GetControlIdx(const IControl* pControl) const { return mControls.Find(pControl); }
+
   /** Remove controls from the control list above a particular index, (frees memory).  */
   void RemoveControls(int fromIdx);
   
@@ -1214,10 +1517,29 @@ public:
 
   /** Calls SetDirty() on every control */
   void SetAllControlsDirty();
+
+  /** Redraw a region at the next frame without marking the controls in it dirty, e.g. to uncover what an overlay was drawn over when it closes.
+   * Only the controls that overlap the region are drawn, and those that are cached are drawn from their layers
+   * @param bounds The region */
+  void SetRegionDirty(const IRECT& bounds);
   
-  /** Calls SetClean() on every control */
+  /** Calls SetClean() on every control marked dirty since the last call, and on the special controls */
   void SetAllControlsClean();
 
+  /** Mark the spatial index of the controls' bounds as out of date, so that it is rebuilt before the next hit test or draw. IControl calls this when its bounds are set
+   * through SetRECT(), SetTargetRECT() or SetTargetAndDrawRECTs(), and IGraphics when controls are attached or removed, or the UI is resized.
+   * NOTE: call it yourself if a control assigns mRECT or mTargetRECT directly after it has been attached */
+  void InvalidateControlGrid() { mControlGrid.Invalidate(); }
+
+  /** Add a control to the list of controls to redraw at the next refresh, called by IControl::SetDirty(). Controls are only listed once, and only while attached
+   * @param control The control that has been marked dirty */
+  void QueueDirtyControl(IControl& control);
+
+  /** Add a control to the list of controls whose IsDirty() is called at every refresh, called by IControl when it starts animating or by IControl::SetPollDirty().
+   * A control leaves the list once it is neither animating nor polled
+   * @param control The control to poll */
+  void QueuePolledControl(IControl& control);
+
 private:
   /** /todo
    * @param x /todo
@@ -1225,6 +1547,28 @@ private:
    * @param mouseOver /todo
    * @return int /todo */
   int GetMouseControlIdx(float x, float y, bool mouseOver = false);
+
+  /** @return The spatial index of the controls' bounds, rebuilt first if it is out of date */
+  IControlGrid& GetControlGrid();
+
+  /** Draw a control from its cached layers, redrawing those that are out of date, see IControl::SetCacheMode()
+   * @param control The control
+   * @param bounds The bounds of the layers, the control's bounds padded and pixel aligned */
+  void DrawCachedControl(IControl& control, const IRECT& bounds);
+  
+  /** @return \c true if a control without a cache mode is drawn through a layer at a backing pixel scale, see SetCacheAtFractionalScale() */
+  bool CacheAtScale(IControl& control, float scale) const;
+
+  /** Add the bitmaps that PreloadBitmaps() has decoded, but that haven't been loaded, to the cache, and drop the preloader once every bitmap is done */
+  void FinishPreloadingBitmaps();
+
+  /** Called when a control has been added to the control stack, so that it is queued for its first draw and, if it is animating, polled
+   * @param pControl The control */
+  void OnControlAttached(IControl* pControl);
+
+  /** Called before a control is removed from the control stack, so that the dirty and polled lists don't keep a pointer to it
+   * @param pControl The control */
+  void OnControlDetached(IControl* pControl);
   
   /** /todo
    * @param x /todo
@@ -1279,6 +1623,25 @@ public:
 
   /** \todo */
   void OnMouseOut();
+
+  /** Called by the platform class for a move of the mouse with no buttons down. Only the last of the moves between two frames is handled, by FlushMouseMoves(),
+   * as a high rate mouse or a pen can send as many as a thousand a second and each is a hit test
+   * @param x The X coordinate in the graphics context of the mouse
+   * @param y The Y coordinate in the graphics context of the mouse
+   * @param mod IMouseMod struct contain information about the modifiers held */
+  void QueueMouseOver(float x, float y, const IMouseMod& mod);
+
+  /** Called by the platform class for a drag. The drags between two frames are handled together by FlushMouseMoves(), which gives every sample to the captured control,
+   * see IControl::OnMouseDragSamples(), so that a gesture changes its parameter, and the host is told of it, at most once a frame rather than at each event
+   * @param x The X coordinate in the graphics context of the mouse
+   * @param y The Y coordinate in the graphics context of the mouse
+   * @param dX The X delta since the last drag
+   * @param dY The Y delta since the last drag
+   * @param mod IMouseMod struct contain information about the modifiers held */
+  void QueueMouseDrag(float x, float y, float dX, float dY, const IMouseMod& mod);
+
+  /** Handle the moves queued since the last frame. Called by IsDirty(), and by the other mouse and key handlers before they handle their event, so that events keep their order */
+  void FlushMouseMoves();
   
   /** \todo */
   void OnSetCursor() { SetMouseCursor(mCursorType); }
@@ -1358,6 +1721,18 @@ public:
    * @return An IBitmap representing the image */
   virtual IBitmap LoadBitmap(const char* fileNameOrResID, int nStates = 1, bool framesAreHorizontal = false, int targetScale = 0);
 
+  /** Start decoding bitmaps in parallel on worker threads, so that an editor with many bitmaps opens sooner. Call it at the start of the layout with the bitmaps
+   * that the layout loads, then load them with LoadBitmap() as usual: a bitmap that has been decoded is only uploaded, one that is being decoded is waited for,
+   * and one that no worker has started on is loaded straight away. Bitmaps that are decoded but not loaded are added to GetBitmapCache() when the UI is next drawn.
+   * Bitmaps that are already in the cache are skipped, and backends that can't decode off the UI thread load every bitmap with LoadBitmap()
+   * @param fileNamesOrResIDs The file names or resource IDs of the bitmaps
+   * @param nBitmaps The number of bitmaps
+   * @param targetScale Set \c to a number > 0 to explicity load e.g. @2x.pngs */
+  void PreloadBitmaps(const char** fileNamesOrResIDs, int nBitmaps, int targetScale = 0);
+
+  /** @return The fraction of the bitmaps passed to PreloadBitmaps() that have been decoded, or 1 if none are being preloaded, e.g. for a progress display */
+  float GetBitmapPreloadProgress() const { return mBitmapPreloader ? mBitmapPreloader->GetProgress() : 1.f; }
+
   /** Load an SVG from disk or from windows resource
    * @param fileNameOrResID A CString absolute path or resource ID
    * @return An ISVG representing the image */
@@ -1380,6 +1755,36 @@ protected:
    * @return APIBitmap* /todo */
   virtual APIBitmap* CreateAPIBitmap(int width, int height, int scale, double drawScale) = 0;
 
+  /** Implemented by backends that can decode bitmaps off the UI thread, see PreloadBitmaps(), along with CreateAPIBitmapFromPixels()
+   * @return A function that decodes a bitmap's file to pixels on a worker thread, or nullptr to load bitmaps on the UI thread */
+  virtual IBitmapPreloader::DecodeFunc GetBitmapDecodeFunc() { return nullptr; }
+
+  /** Create an APIBitmap from the pixels decoded by the function from GetBitmapDecodeFunc(), on the UI thread
+   * @param bitmap The decoded bitmap
+   * @return APIBitmap* The bitmap, or nullptr if it couldn't be created */
+  virtual APIBitmap* CreateAPIBitmapFromPixels(const IBitmapPreloader::Bitmap& bitmap) { return nullptr; }
+
+  /** Implemented by backends that can write pixels to a bitmap, see CreatePixelLayer()
+   * @param width The width in pixels
+   * @param height The height in pixels
+   * @return APIBitmap* The bitmap, with transparent pixels, or nullptr if the backend can't write them */
+  virtual APIBitmap* CreatePixelAPIBitmap(int width, int height) { return nullptr; }
+
+  /** Implemented by backends that can write pixels to a bitmap, to read a layer's pixels in the form that UpdatePixelLayer() writes them
+   * @param layer The layer
+   * @param data Set to the pixels, 8 bit RGBA premultiplied by their alpha, a row after another from the top
+   * @return \c true if the pixels were read */
+  virtual bool ReadLayerPixels(const ILayerPtr& layer, RawBitmapData& data) { return false; }
+
+  /** @return The cache that LoadBitmap() keeps bitmaps in, and that PreloadBitmaps() adds to, shared by all instances unless the backend's bitmaps belong to its context */
+  virtual StaticStorage<APIBitmap>& GetBitmapCache();
+
+  /** Used by LoadBitmap() to get a bitmap from PreloadBitmaps(), waiting for it if it is being decoded
+   * @param fileNameOrResID The path or resource ID found by SearchImageResource()
+   * @param scale The scale of the file
+   * @return The bitmap, or nullptr if it wasn't preloaded or couldn't be decoded */
+  APIBitmap* LoadPreloadedBitmap(const char* fileNameOrResID, int scale);
+
   /** /todo
    * @param fontID /todo
    * @param font /todo
@@ -1429,11 +1834,21 @@ protected:
 
 private:
   WDL_PtrList<IControl> mControls;
+  /** A spatial index of the bounds of mControls, used for hit testing and to find the controls that overlap a dirty region, see InvalidateControlGrid() */
+  IControlGrid mControlGrid;
+  /** The controls found by the last query of mControlGrid */
+  WDL_TypedBuf<int> mControlGridQuery;
+  /** The attached controls that have been marked dirty since the last SetAllControlsClean(), so that IsDirty() doesn't visit every control */
+  WDL_PtrList<IControl> mDirtyControls;
+  IRECTList mDirtyRegions;
+  /** The attached controls that are animating or have asked to be polled, see IControl::SetPollDirty() */
+  WDL_PtrList<IControl> mPolledControls;
 
   // Order (front-to-back) ToolTip / PopUp / TextEntry / LiveEdit / Corner / PerfDisplay
   std::unique_ptr<ICornerResizerControl> mCornerResizer;
   std::unique_ptr<IPopupMenuControl> mPopupControl;
   std::unique_ptr<IFPSDisplayControl> mPerfDisplay;
+  std::unique_ptr<IBitmapPreloader> mBitmapPreloader;
   std::unique_ptr<ITextEntryControl> mTextEntryControl;
   std::unique_ptr<IControl> mLiveEdit;
   
@@ -1446,8 +1861,29 @@ private:
   int mScreenScale = 1; // the scaling of the display that the UI is currently on e.g. 2 for retina
   float mDrawScale = 1.f; // scale deviation from  default width and height i.e stretching the UI by dragging bottom right hand corner
   int mIdleTicks = 0;
+  IAdaptiveTimerRate mTimerRate;
+  TimePoint mFrameTime;
+  bool mVSync = true;
+  bool mReduceEffects = false;
+  int mMaxFPS = 0;
+  double mNextFrameTime = 0.;
   IControl* mMouseCapture = nullptr;
   IControl* mMouseOver = nullptr;
+  IMouseInfo mQueuedMouseOver;
+  bool mMouseOverQueued = false;
+  std::vector<IMouseSample> mQueuedDrags;
+  std::vector<IMouseSample> mFlushedDrags; // kept so that its capacity is reused
+
+  struct LazyGroup
+  {
+    WDL_String name;
+    ILazyGroupFunction func;
+    int controlIdx; // where the group's controls go in the stack
+    bool createWhenIdle;
+    bool created;
+  };
+
+  std::vector<LazyGroup> mLazyGroups; // see AttachLazyGroup()
   int mMouseOverIdx = -1;
   float mMouseDownX = -1.f;
   float mMouseDownY = -1.f;
@@ -1460,10 +1896,31 @@ private:
   int mLastClickedParam = kNoParameter;
   bool mHandleMouseOver = false;
   bool mStrict = false;
+  bool mCacheAtFractionalScale = false;
   bool mEnableTooltips = false;
   bool mShowControlBounds = false;
   bool mShowAreaDrawn = false;
+  bool mDrawProfiling = false;
+  IRECT mDrawRegion; // the region of the control drawing, see GetDrawRegion()
+  double mDrawProfileStart = 0.;
+  IEditorOpenStats mEditorOpenStats;
+  bool mEditorOpenTiming = false; // from the start of an open until its stats are finished
+  bool mSVGCacheEnabled = false;
+  WDL_TypedBuf<float> mDataPoints;
   bool mResizingInProcess = false;
+  bool mResizePreview = false;
+  bool mResizePreviewPending = false; // a previewed resize that the controls and backing surfaces haven't caught up with
+  
+  enum ESnapshotState { kSnapshotOff, kSnapshotShowing, kSnapshotFading, kSnapshotSettling, kSnapshotCapturing, kSnapshotDone };
+  WDL_String mSnapshotName; // see EnableSnapshotOnOpen(), empty if it is off
+  std::unique_ptr<IEditorSnapshot> mSnapshot;
+  ILayerPtr mSnapshotLayer;
+  ESnapshotState mSnapshotState = kSnapshotOff;
+  TimePoint mSnapshotFadeStart;
+  int mSnapshotIdleTicks = 0;
+  int mSnapshotTicks = 0;
+  bool mSnapshotDrawn = false;
+  bool mResizePreviewDirty = false; // the window has changed size since the last preview frame
   bool mLayoutOnResize = false;
   EUIResizerMode mGUISizeMode = EUIResizerMode::kUIResizerScale;
   double mPrevTimestamp = 0.;
@@ -1476,6 +1933,12 @@ protected:
   bool mTabletInput = false;
   float mCursorX = -1.f;
   float mCursorY = -1.f;
+  // set by platforms whose window keeps what was presented from one frame to the next, so that GPU backends only need to present the regions redrawn
+  bool mBackBufferRetained = false;
+  // the regions being redrawn, from BeginFrame() to EndFrame()
+  const IRECTList* mFrameRegions = nullptr;
+  // the display list of the control being drawn, while its drawing calls are recorded, see kCacheDisplayList
+  IDisplayList* mDisplayList = nullptr;
 
   friend class IGraphicsLiveEdit;
   friend class ICornerResizerControl;
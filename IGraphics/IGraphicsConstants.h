@@ -20,6 +20,16 @@ static const int IDLE_TICKS = 20;
 
 #define DEFAULT_ANIMATION_DURATION 100
 
+// The length in ms of the crossfade from the snapshot shown on open to the UI, see IGraphics::EnableSnapshotOnOpen()
+#ifndef SNAPSHOT_FADE_DURATION
+#define SNAPSHOT_FADE_DURATION 150
+#endif
+
+// The number of frames with nothing to draw, after opening, before the snapshot of the UI is taken
+#ifndef SNAPSHOT_IDLE_TICKS
+#define SNAPSHOT_IDLE_TICKS 10
+#endif
+
 #ifndef CONTROL_BOUNDS_COLOR
 #define CONTROL_BOUNDS_COLOR COLOR_GREEN
 #endif
@@ -135,6 +145,25 @@ enum EPatternExtend
   kExtendRepeat
 };
 
+/** How IGraphics caches the drawing of a control, in layers or a display list, see IControl::SetCacheMode() */
+enum ECacheMode
+{
+  kCacheNone,       // call Draw() whenever the control's region is redrawn
+  kCacheControl,    // cache Draw() in a layer, which is redrawn after SetDirty()
+  kCacheStatic,     // cache DrawStatic() in a layer that is redrawn after InvalidateCache(), and DrawDynamic() in one that is redrawn after SetDirty()
+  kCacheDisplayList // record the drawing calls of Draw() and replay them until SetDirty(), with path based backends, see IDisplayList
+};
+
+/** The order of the controls in a draw profile, see IGraphics::GetDrawProfile() */
+enum EDrawProfileSort
+{
+  kDrawProfileSortTotal,  // most time in total first
+  kDrawProfileSortMean,   // slowest on average first
+  kDrawProfileSortMax,    // slowest draw first
+  kDrawProfileSortCount,  // most often drawn first
+  kNumDrawProfileSorts
+};
+
 enum EUIResizerMode
 {
   kUIResizerScale,
@@ -45,13 +45,22 @@ void IGEditorDelegate::OnUIOpen()
 
 void* IGEditorDelegate::OpenWindow(void* pParent)
 {
+  TRACE_SCOPE;
+  
+  const double startTimestamp = GetTimestamp();
+  double createdTimestamp = startTimestamp;
+  
   if(!mGraphics) {
     mIGraphicsTransient = true;
     mGraphics.reset(CreateGraphics());
+    createdTimestamp = GetTimestamp();
   }
   
   if(mGraphics)
+  {
+    mGraphics->StartEditorOpenStats(startTimestamp, createdTimestamp);
     return mGraphics->OpenWindow(pParent);
+  }
   else
     return nullptr;
 }
@@ -77,11 +86,21 @@ void IGEditorDelegate::CloseWindow()
   }
 }
 
+void IGEditorDelegate::ReportMemory(IMemoryReport& report) const
+{
+  if (mGraphics)
+    mGraphics->GetMemoryReport(report);
+  
+  IEditorDelegate::ReportMemory(report);
+}
+
 void IGEditorDelegate::SendControlValueFromDelegate(int controlTag, double normalizedValue)
 {
   if(!mGraphics)
     return;
 
+  mGraphics->WakeTimer();
+
   if (controlTag > kNoTag)
   {
     for (auto c = 0; c < mGraphics->NControls(); c++)
@@ -100,6 +119,8 @@ void IGEditorDelegate::SendControlMsgFromDelegate(int controlTag, int messageTag
 {
   if(!mGraphics)
     return;
+
+  mGraphics->WakeTimer();
   
   if (controlTag > kNoTag)
   {
@@ -119,6 +140,8 @@ void IGEditorDelegate::SendParameterValueFromDelegate(int paramIdx, double value
 {
   if(mGraphics)
   {
+    mGraphics->WakeTimer();
+
     if (!normalized)
       value = GetParam(paramIdx)->ToNormalized(value);
 
@@ -141,6 +164,8 @@ void IGEditorDelegate::SendMidiMsgFromDelegate(const IMidiMsg& msg)
 {
   if(mGraphics)
   {
+    mGraphics->WakeTimer();
+
     for (auto c = 0; c < mGraphics->NControls(); c++) // TODO: could keep a map
     {
       IControl* pControl = mGraphics->GetControl(c);
@@ -80,6 +80,8 @@ public:
   virtual int UnSerializeEditorProperties(const IByteChunk& chunk, int startPos) { TRACE; return startPos; }
     
 protected:
+  void ReportMemory(IMemoryReport& report) const override;
+
   std::function<IGraphics*()> mMakeGraphicsFunc = nullptr;
   std::function<void(IGraphics* pGraphics)> mLayoutFunc = nullptr;
 private:
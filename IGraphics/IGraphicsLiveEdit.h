@@ -17,16 +17,26 @@
 
 #ifndef NDEBUG
 
+#include <cstdio>
+#include <memory>
+#include <string>
+
 #include "IControl.h"
+#include "IPlugWorkerPool.h"
 
 /** A control to enable live modification of control layout in an IGraphics context in debug builds
  * This is based on the work of Youlean, who first included it in iPlug-Youlean
  * The lives outside the main IGraphics control stack and it can be added with IGraphics::EnableLiveEdit().
  * It should not be used in the main control stack.
+ * A drag only redraws the old and new bounds of the control being edited, and the grid is drawn once into a layer. If a source file is given,
+ * the layout is written next to it, to the file's path with ".layout" appended, on a worker thread, once the layout has been still for kSaveDelayMs
  * @ingroup SpecialControls */
 class IGraphicsLiveEdit : public IControl
 {
 public:
+  /** The time after the last change to the layout before it is written */
+  static constexpr double kSaveDelayMs = 500.;
+
   IGraphicsLiveEdit(bool mouseOversEnabled, const char* pathToSourceFile = 0, float gridSize = 10)
   : IControl(IRECT())
   , mPathToSourceFile(pathToSourceFile)
@@ -40,6 +50,10 @@ public:
   
   ~IGraphicsLiveEdit()
   {
+    // a change that is still waiting for its delay is written straight away
+    if (mLayoutChanged)
+      WriteLayout(mPathToSourceFile.Get(), GetLayout());
+    
     GetUI()->HandleMouseOver(mMouseOversEnabled);
   }
 
@@ -84,11 +98,12 @@ public:
       {
         pControl->SetRECT(mMouseDownRECT);
         pControl->SetTargetRECT(mMouseDownTargetRECT);
+        SetDirtyArea(GetEditArea(r).Union(GetEditArea(mMouseDownRECT)));
+        OnLayoutChanged();
       }
     }
     mClickedOnControl = -1;
     mMouseClickedOnResizeHandle = false;
-    GetUI()->SetAllControlsDirty();
   }
   
   void OnMouseDblClick(float x, float y, const IMouseMod& mod) override
@@ -123,7 +138,8 @@ public:
     if(mClickedOnControl > 0)
     {
       IControl* pControl = GetUI()->GetControl(mClickedOnControl);
-      IRECT r = pControl->GetRECT();
+      const IRECT prev = pControl->GetRECT();
+      IRECT r = prev;
       
       if(mMouseClickedOnResizeHandle)
       {
@@ -141,18 +157,30 @@ public:
         r.B = r.T + mMouseDownRECT.H();
       }
       
+      if (r == prev)
+        return;
+      
       pControl->SetRECT(r);
       pControl->SetTargetRECT(r);
       
       DBGMSG("%i, %i, %i, %i\n", (int) r.L, (int) r.T, (int) r.R, (int) r.B);
       
-      GetUI()->SetAllControlsDirty();
+      // the controls under the old and new bounds are redrawn, with the overlay
+      SetDirtyArea(GetEditArea(prev).Union(GetEditArea(r)));
+      OnLayoutChanged();
     }
   }
   
   void Draw(IGraphics& g) override
   {
-    g.DrawGrid(mGridColor, g.GetBounds(), mGridSize, mGridSize, &BLEND_25);
+    if (!g.CheckLayer(mGridLayer))
+    {
+      g.StartLayer(mRECT);
+      g.DrawGrid(mGridColor, mRECT, mGridSize, mGridSize);
+      mGridLayer = g.EndLayer();
+    }
+    
+    g.DrawLayer(mGridLayer, &BLEND_25);
     
     for(int i = 1; i < g.NControls(); i++)
     {
@@ -177,9 +205,25 @@ public:
   {
     mRECT = GetUI()->GetBounds();
     SetTargetRECT(mRECT);
+    mGridLayer = nullptr;
   }
   
-  bool IsDirty() override { return true; }
+  bool IsDirty() override
+  {
+    if (mLayoutChanged && std::chrono::duration_cast<Milliseconds>(Time::now() - mLayoutChangeTime).count() >= kSaveDelayMs)
+    {
+      mLayoutChanged = false;
+      
+      // the layout is taken here, on the main thread, and only the file is written by the worker
+      const std::string path(mPathToSourceFile.Get());
+      const std::string layout = GetLayout();
+      
+      IPlugWorkerPool::Get().Submit(std::make_shared<IPlugJob>([path, layout](IPlugJob&) { WriteLayout(path.c_str(), layout); }, nullptr,
+                                                               IPlugJob::kPriorityLow, IPlugJob::ECompletionThread::kMainThread));
+    }
+    
+    return IControl::IsDirty();
+  }
 
   inline IRECT GetHandleRect(const IRECT& r)
   {
@@ -195,6 +239,52 @@ public:
   }
 
 private:
+  /** @return The area the overlay draws for a control's bounds, its outline and resize handle */
+  IRECT GetEditArea(const IRECT& r) const
+  {
+    return r.GetPadded(1.f);
+  }
+  
+  /** Start the delay before the layout is written, again if it has already started */
+  void OnLayoutChanged()
+  {
+    if (!mPathToSourceFile.GetLength())
+      return;
+    
+    mLayoutChanged = true;
+    mLayoutChangeTime = Time::now();
+  }
+  
+  /** @return The bounds of each control, a line for each that can be pasted into the layout code */
+  std::string GetLayout()
+  {
+    IGraphics* pGraphics = GetUI();
+    std::string layout;
+    
+    for (int i = 1; i < pGraphics->NControls(); i++)
+    {
+      IControl* pControl = pGraphics->GetControl(i);
+      const IRECT& r = pControl->GetRECT();
+      char line[128];
+      snprintf(line, sizeof(line), "IRECT(%.1f, %.1f, %.1f, %.1f) // control %d, tag %d\n", r.L, r.T, r.R, r.B, i, pControl->GetTag());
+      layout += line;
+    }
+    
+    return layout;
+  }
+  
+  static void WriteLayout(const char* sourcePath, const std::string& layout)
+  {
+    const std::string path = std::string(sourcePath) + ".layout";
+    FILE* pFile = fopen(path.c_str(), "w");
+    
+    if (pFile)
+    {
+      fwrite(layout.data(), 1, layout.size(), pFile);
+      fclose(pFile);
+    }
+  }
+
   bool mMouseOversEnabled;
 //  bool mEditModeActive = false;
 //  bool mLiveEditingEnabled = false;
@@ -212,6 +302,10 @@ private:
 
   float mGridSize = 10;
   int mClickedOnControl = -1;
+  
+  ILayerPtr mGridLayer;
+  bool mLayoutChanged = false;
+  TimePoint mLayoutChangeTime;
 };
 
 #endif // !NDEBUG
@@ -16,9 +16,13 @@
  */
 
 #include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <stack>
+#include <vector>
 
 #include "IGraphics.h"
+#include "IDisplayList.h"
 
 #include "nanosvg.h"
 
@@ -101,21 +105,17 @@ public:
   
   void DrawData(const IColor& color, const IRECT& bounds, float* normYPoints, int nPoints, float* normXPoints, const IBlend* pBlend, float thickness) override
   {
-    PathClear();
+    int n = 0;
+    const float* pPoints = CalculateDataPoints(bounds, normYPoints, nPoints, normXPoints, n);
     
-    float xPos = bounds.L;
-
-    PathMoveTo(xPos, bounds.B - (bounds.H() * normYPoints[0]));
+    if (!n)
+      return;
+    
+    PathClear();
+    PathMoveTo(pPoints[0], pPoints[1]);
 
-    for (auto i = 1; i < nPoints; i++)
-    {
-      if(normXPoints)
-        xPos = bounds.L + (bounds.W() * normXPoints[i]);
-      else
-        xPos = bounds.L + ((bounds.W() / (float) (nPoints - 1) * i));
-      
-      PathLineTo(xPos, bounds.B - (bounds.H() * normYPoints[i]));
-    }
+    for (auto i = 1; i < n; i++)
+      PathLineTo(pPoints[i * 2], pPoints[i * 2 + 1]);
     
     PathStroke(color, thickness, IStrokeOptions(), pBlend);
   }
@@ -254,6 +254,39 @@ public:
     PathFill(color, IFillOptions(), pBlend);
   }
   
+  void FillRects(const IColor& color, const IRECT* pBounds, int nRects, const IBlend* pBlend) override
+  {
+    PathClear();
+    
+    for (int i = 0; i < nRects; i++)
+      PathRect(pBounds[i]);
+    
+    PathFill(color, IFillOptions(), pBlend);
+  }
+  
+  void FillCircles(const IColor& color, const float* pCircles, int nCircles, const IBlend* pBlend) override
+  {
+    PathClear();
+    
+    for (int i = 0; i < nCircles; i++)
+      PathCircle(pCircles[i * 3], pCircles[i * 3 + 1], pCircles[i * 3 + 2]);
+    
+    PathFill(color, IFillOptions(), pBlend);
+  }
+  
+  void DrawLines(const IColor& color, const float* pLines, int nLines, const IBlend* pBlend, float thickness) override
+  {
+    PathClear();
+    
+    for (int i = 0; i < nLines; i++)
+    {
+      PathMoveTo(pLines[i * 4], pLines[i * 4 + 1]);
+      PathLineTo(pLines[i * 4 + 2], pLines[i * 4 + 3]);
+    }
+    
+    PathStroke(color, thickness, IStrokeOptions(), pBlend);
+  }
+  
   void FillEllipse(const IColor& color, const IRECT& bounds, const IBlend* pBlend) override
   {
     PathClear();
@@ -357,7 +390,7 @@ public:
     {
       mTransform = mTransformStates.top();
       mTransformStates.pop();
-      PathTransformSetMatrix(mTransform);
+      UpdateTransform();
     }
   }
   
@@ -370,19 +403,19 @@ public:
     }
     
     mTransform = IMatrix();
-    PathTransformSetMatrix(mTransform);
+    UpdateTransform();
   }
   
   void PathTransformTranslate(float x, float y) override
   {
     mTransform.Translate(x, y);
-    PathTransformSetMatrix(mTransform);
+    UpdateTransform();
   }
   
   void PathTransformScale(float scaleX, float scaleY) override
   {
     mTransform.Scale(scaleX, scaleY);
-    PathTransformSetMatrix(mTransform);
+    UpdateTransform();
   }
   
   void PathTransformScale(float scale) override
@@ -393,23 +426,27 @@ public:
   void PathTransformRotate(float angle) override
   {
     mTransform.Rotate(angle);
-    PathTransformSetMatrix(mTransform);
+    UpdateTransform();
   }
     
   void PathTransformSkew(float xAngle, float yAngle) override
   {
     mTransform.Skew(xAngle, yAngle);
-    PathTransformSetMatrix(mTransform);
+    UpdateTransform();
   }
 
   void PathTransformMatrix(const IMatrix& matrix) override
   {
     mTransform.Transform(matrix);
-    PathTransformSetMatrix(mTransform);
+    UpdateTransform();
   }
 
   void PathClipRegion(const IRECT r = IRECT()) override
   {
+    if (mDisplayList)
+      mDisplayList->AddClipRegion(r);
+    
+    mPathClip = r;
     IRECT drawArea = mLayers.empty() ? mClipRECT : mLayers.top()->Bounds();
     IRECT clip = r.Empty() ? drawArea : r.Intersect(drawArea);
     PathTransformSetMatrix(IMatrix());
@@ -436,7 +473,11 @@ public:
     PathTransformSave();
     PathTransformTranslate(dest.L, dest.T);
     PathTransformScale(scale);
-    RenderNanoSVG(svg.mImage);
+    
+    // a cached SVG's layer may be gone by the time a display list is replayed, so it is recorded as paths
+    if (!SVGCacheEnabled() || mDisplayList || !DrawCachedSVG(svg, pBlend))
+      RenderNanoSVG(svg.mImage);
+    
     PathTransformRestore();
   }
   
@@ -449,7 +490,80 @@ public:
     PathTransformRestore();
   }
 
+  void ClearSVGCache() override
+  {
+    mSVGCache.clear();
+  }
+
 private:
+  /** A rasterized SVG, at a size in UI units */
+  struct CachedSVG
+  {
+    const NSVGimage* pImage;
+    int w;
+    int h;
+    ILayerPtr layer;
+    uint64_t lastUse;
+  };
+  
+  static constexpr int kMaxCachedSVGs = 64;
+  static constexpr int kMaxCachedSVGSize = 2048;
+  
+  /** Draw an SVG from the cache, rasterizing it first if needed, with the current transform mapping the SVG's own units to the UI
+   * @return \c false if the transform can't be drawn from a layer, so that the SVG should be drawn as paths */
+  bool DrawCachedSVG(const ISVG& svg, const IBlend* pBlend)
+  {
+    // a layer can only stand in for a rotation and a uniform scale
+    const double scale = std::sqrt(mTransform.mXX * mTransform.mXX + mTransform.mYX * mTransform.mYX);
+    const double tolerance = 1e-4 * scale;
+    
+    if (scale <= 0. || std::abs(mTransform.mXX - mTransform.mYY) > tolerance || std::abs(mTransform.mYX + mTransform.mXY) > tolerance)
+      return false;
+    
+    const int w = static_cast<int>(std::ceil(svg.W() * scale));
+    const int h = static_cast<int>(std::ceil(svg.H() * scale));
+    
+    if (w <= 0 || h <= 0 || w > kMaxCachedSVGSize || h > kMaxCachedSVGSize)
+      return false;
+    
+    auto it = std::find_if(mSVGCache.begin(), mSVGCache.end(), [&](const CachedSVG& c) { return c.pImage == svg.mImage && c.w == w && c.h == h; });
+    
+    if (it == mSVGCache.end())
+    {
+      if (mSVGCache.size() >= kMaxCachedSVGs)
+        mSVGCache.erase(std::min_element(mSVGCache.begin(), mSVGCache.end(), [](const CachedSVG& a, const CachedSVG& b) { return a.lastUse < b.lastUse; }));
+      
+      mSVGCache.push_back({ svg.mImage, w, h, nullptr, 0 });
+      it = mSVGCache.end() - 1;
+    }
+    
+    it->lastUse = ++mSVGCacheStamp;
+    
+    if (!CheckLayer(it->layer))
+    {
+      // layers start from a clear transform stack and clip, which the caller's drawing carries on with afterwards
+      const IMatrix transform = mTransform;
+      const std::stack<IMatrix> transformStates = mTransformStates;
+      const IRECT clip = mPathClip;
+      
+      StartLayer(IRECT(0.f, 0.f, static_cast<float>(w), static_cast<float>(h)));
+      PathTransformScale(static_cast<float>(scale));
+      RenderNanoSVG(svg.mImage);
+      it->layer = EndLayer();
+      
+      mTransform = transform;
+      mTransformStates = transformStates;
+      PathClipRegion(clip);
+    }
+    
+    PathTransformSave();
+    PathTransformScale(static_cast<float>(1. / scale));
+    DrawBitmap(it->layer->GetBitmap(), IRECT(0.f, 0.f, static_cast<float>(w), static_cast<float>(h)), 0, 0, pBlend);
+    PathTransformRestore();
+    
+    return true;
+  }
+  
   IPattern GetSVGPattern(const NSVGpaint& paint, float opacity)
   {
     int alpha = std::min(255, std::max(int(roundf(opacity * 255.f)), 0));
@@ -570,13 +684,26 @@ private:
     PathClear();
     SetClipRegion(r);
     mClipRECT = r;
+    mPathClip = IRECT();
+  }
+  
+  /** Apply mTransform, recording it in the display list being recorded */
+  void UpdateTransform()
+  {
+    if (mDisplayList)
+      mDisplayList->AddTransform(mTransform);
+    
+    PathTransformSetMatrix(mTransform);
   }
   
   virtual void SetClipRegion(const IRECT& r) = 0;
   virtual void PathTransformSetMatrix(const IMatrix& matrix) = 0;
 
   IRECT mClipRECT;
+  IRECT mPathClip;
   IMatrix mTransform;
   std::stack<IMatrix> mTransformStates;
+  std::vector<CachedSVG> mSVGCache;
+  uint64_t mSVGCacheStamp = 0;
 };
 
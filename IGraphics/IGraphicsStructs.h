@@ -25,6 +25,10 @@
 #include <numeric>
 #include <chrono>
 #include <string>
+#include <unordered_map>
+#include <memory>
+#include <tuple>
+#include <vector>
 
 #include "mutex.h"
 #include "wdlstring.h"
@@ -37,6 +41,7 @@
 #include "IPlugPlatform.h"
 #include "IPlugUtilities.h"
 #include "IPlugLogger.h"
+#include "IPlugMemoryReport.h"
 #include "IGraphicsConstants.h"
 
 class IGraphics;
@@ -50,6 +55,7 @@ inline T DegToRad(T degrees);
 typedef std::function<void(IControl*)> IActionFunction;
 typedef std::function<void(IControl*)> IAnimationFunction;
 typedef std::function<void(ILambdaControl*, IGraphics&, IRECT&)> ILambdaDrawFunction;
+typedef std::function<void(IGraphics&, const char* group)> ILazyGroupFunction;
 
 void DefaultClickActionFunc(IControl* pCaller);
 void DefaultAnimationFunc(IControl* pCaller);
@@ -1699,6 +1705,64 @@ struct IMouseInfo
   IMouseMod ms;
 };
 
+/** A drag of the mouse, as queued between frames, see IGraphics::QueueMouseDrag() */
+struct IMouseSample
+{
+  float x, y;
+  float dX, dY;
+  IMouseMod ms;
+};
+
+/** The time a control has spent drawing, collected while IGraphics::EnableDrawProfiling() is on. Times are in seconds */
+struct IDrawStats
+{
+  int nDraws = 0;
+  double totalTime = 0.;
+  double maxTime = 0.;
+
+  void Add(double time)
+  {
+    nDraws++;
+    totalTime += time;
+    maxTime = std::max(maxTime, time);
+  }
+
+  void Clear() { *this = IDrawStats(); }
+
+  /** @return The mean time of a draw */
+  double MeanTime() const { return nDraws ? totalTime / nDraws : 0.; }
+};
+
+/** Where the time goes when an editor opens, from IGEditorDelegate::OpenWindow() to the first frame, and the memory of what it loaded, see IGraphics::GetEditorOpenStats().
+ * The phases are times in seconds since the open started, or -1 until they are reached. The view is initialized once the platform has made its window and the drawing
+ * backend its context, see IGraphics::OnViewInitialized(). With a snapshot shown on open, the first frame is the snapshot's, and the layout comes after it */
+struct IEditorOpenStats
+{
+  double startTimestamp = 0.; // GetTimestamp() when the open started
+  double graphicsCreatedTime = -1.; // IGEditorDelegate::CreateGraphics() returned, or 0 if the graphics already existed
+  double viewInitializedTime = -1.;
+  double layoutStartTime = -1.;
+  double layoutDoneTime = -1.; // IGEditorDelegate::LayoutUI() returned
+  double firstFrameTime = -1.; // the first EndFrame() returned
+
+  int nBitmaps = 0; // calls to IGraphics::LoadBitmap(), including those found in the cache
+  double bitmapTime = 0.;
+  int nSVGs = 0;
+  double svgTime = 0.;
+  int nFonts = 0;
+  double fontTime = 0.;
+
+  size_t cpuBitmapBytes = 0; // the bitmap cache, which all instances share, counted where the backend keeps its bitmaps
+  size_t gpuBitmapBytes = 0;
+  size_t svgBytes = 0;
+
+  /** @return \c true once the UI has been laid out and drawn */
+  bool Finished() const { return layoutDoneTime >= 0. && firstFrameTime >= 0.; }
+
+  /** @return The time spent in the LoadBitmap(), LoadSVG() and LoadFont() calls */
+  double ResourceTime() const { return bitmapTime + svgTime + fontTime; }
+};
+
 /** Used to manage a list of rectangular areas and optimize them for drawing to the screen. */
 class IRECTList
 {
@@ -1810,105 +1874,135 @@ public:
     return true;
   }
   
-  /** /todo  */
-  void Optimize()
+  /** Replace the rects with a set of rects that don't overlap and cover the same region, or with their bounds if that is estimated to be cheaper to draw.
+   * The region is swept from top to bottom: within each band between consecutive top and bottom edges the spans of the rects that cross the band are merged,
+   * and a band with the same spans as the one above it extends that band's rects. The cost of drawing a set of rects is estimated as their total area plus rectCost for each rect
+   * @param rectCost The estimated fixed cost of drawing a rect, in units of area
+   * @param maxRects The most rects to keep, if the region is more fragmented than this it is replaced by its bounds */
+  void Optimize(float rectCost = 1024.f, int maxRects = 64)
   {
-    // Remove rects that are contained by other rects and intersections
+    WDL_TypedBuf<IRECT> byTop;
+    WDL_TypedBuf<float> edges;
+    
     for (int i = 0; i < Size(); i++)
     {
-      for (int j = i + 1; j < Size(); j++)
+      const IRECT& r = Get(i);
+      
+      if (r.W() > 0.f && r.H() > 0.f)
       {
-        if (Get(i).Contains(Get(j)))
-        {
-          mRects.Delete(j);
-          j--;
-        }
-        else if (Get(j).Contains(Get(i)))
-        {
-          mRects.Delete(i);
-          i--;
-          break;
-        }
-        else if (Get(i).Intersects(Get(j)))
-        {
-          IRECT intersection = Get(i).Intersect(Get(j));
-            
-          if (Get(i).Mergeable(intersection))
-            Set(i, Shrink(Get(i), intersection));
-          else if (Get(j).Mergeable(intersection))
-            Set(j, Shrink(Get(j), intersection));
-          else if (Get(i).Area() < Get(j).Area())
-            Set(i, Split(Get(i), intersection));
-          else
-            Set(j, Split(Get(j), intersection));
-        }
+        byTop.Add(r);
+        edges.Add(r.T);
+        edges.Add(r.B);
       }
     }
     
-    // Merge any rects that can be merged
-    for (int i = 0; i < Size(); i++)
+    const int nRects = byTop.GetSize();
+    
+    if (nRects < 2)
+    {
+      mRects = byTop;
+      return;
+    }
+    
+    IRECT* pByTop = byTop.Get();
+    float* pEdges = edges.Get();
+    std::sort(pByTop, pByTop + nRects, [](const IRECT& a, const IRECT& b) { return a.T < b.T; });
+    std::sort(pEdges, pEdges + edges.GetSize());
+    const int nEdges = (int) (std::unique(pEdges, pEdges + edges.GetSize()) - pEdges);
+    
+    IRECT bounds = pByTop[0];
+    WDL_TypedBuf<IRECT> active;
+    WDL_TypedBuf<IRECT> region;
+    int next = 0;
+    int bandStart = 0; // the first rect of the last band added to region
+    float bandBottom = 0.f;
+    double area = 0.;
+    
+    for (int e = 0; e + 1 < nEdges; e++)
     {
-      for (int j = i + 1; j < Size(); j++)
+      const float top = pEdges[e];
+      const float bottom = pEdges[e + 1];
+      
+      // the rects crossing this band: drop those that end above it, add those that start at its top
+      int nActive = 0;
+      
+      for (int a = 0; a < active.GetSize(); a++)
+      {
+        if (active.Get()[a].B > top)
+          active.Get()[nActive++] = active.Get()[a];
+      }
+      
+      active.Resize(nActive, false);
+      
+      for (; next < nRects && pByTop[next].T <= top; next++)
+      {
+        active.Add(pByTop[next]);
+        bounds = bounds.Union(pByTop[next]);
+      }
+      
+      if (!active.GetSize())
+        continue;
+      
+      IRECT* pActive = active.Get();
+      std::sort(pActive, pActive + active.GetSize(), [](const IRECT& a, const IRECT& b) { return a.L < b.L; });
+      
+      // merge the spans, checking whether they match the band above
+      const int nAbove = bandBottom == top ? region.GetSize() - bandStart : 0;
+      const int thisStart = region.GetSize();
+      bool matches = nAbove > 0;
+      int nSpans = 0;
+      float l = pActive[0].L;
+      float r = pActive[0].R;
+      
+      for (int a = 1; a <= active.GetSize(); a++)
       {
-        if (Get(i).Mergeable(Get(j)))
+        if (a < active.GetSize() && pActive[a].L <= r)
         {
-          Set(j, Get(i).Union(Get(j)));
-          mRects.Delete(i);
-          i = -1;
-          break;
+          r = std::max(r, pActive[a].R);
+          continue;
+        }
+        
+        matches = matches && nSpans < nAbove && region.Get()[bandStart + nSpans].L == l && region.Get()[bandStart + nSpans].R == r;
+        region.Add(IRECT(l, top, r, bottom));
+        nSpans++;
+        
+        if (a < active.GetSize())
+        {
+          l = pActive[a].L;
+          r = pActive[a].R;
         }
       }
-    }
-  }
-  
-private:
-  /** /todo 
-   * @param r /todo
-   * @param i /todo
-   * @return IRECT /todo */
-  IRECT Shrink(const IRECT &r, const IRECT &i)
-  {
-    if (i.L != r.L)
-      return IRECT(r.L, r.T, i.L, r.B);
-    if (i.T != r.T)
-      return IRECT(r.L, r.T, r.R, i.T);
-    if (i.R != r.R)
-      return IRECT(i.R, r.T, r.R, r.B);
-    return IRECT(r.L, i.B, r.R, r.B);
-  }
-  
-  /** /todo 
-   * @param r /todo
-   * @param i /todo
-   * @return IRECT /todo */
-  IRECT Split(const IRECT r, const IRECT &i)
-  {
-    if (r.L == i.L)
-    {
-      if (r.T == i.T)
+      
+      if (matches && nSpans == nAbove)
       {
-        Add(IRECT(i.R, r.T, r.R, i.B));
-        return IRECT(r.L, i.B, r.R, r.B);
+        // extend the band above instead
+        region.Resize(thisStart, false);
+        
+        for (int i = bandStart; i < thisStart; i++)
+          region.Get()[i].B = bottom;
       }
       else
-      {
-        Add(IRECT(r.L, r.T, r.R, i.T));
-        return IRECT(i.R, i.T, r.R, r.B);
-      }
+        bandStart = thisStart;
+      
+      bandBottom = bottom;
     }
     
-    if (r.T == i.T)
+    for (int i = 0; i < region.GetSize(); i++)
+      area += region.Get()[i].Area();
+    
+    const double regionCost = area + (double) rectCost * region.GetSize();
+    const double boundsCost = (double) bounds.Area() + rectCost;
+    
+    if (region.GetSize() > maxRects || boundsCost <= regionCost)
     {
-      Add(IRECT(r.L, r.T, i.L, i.B));
-      return IRECT(r.L, i.B, r.R, r.B);
+      mRects.Resize(0);
+      mRects.Add(bounds);
     }
     else
-    {
-      Add(IRECT(r.L, r.T, r.R, i.T));
-      return IRECT(r.L, i.T, i.L, r.B);
-    }
+      mRects = region;
   }
   
+private:
   WDL_TypedBuf<IRECT> mRects;
 };
 
@@ -2283,133 +2377,374 @@ struct IShadow
   bool mDrawForeground = true;
 };
 
-/** Used internally to store data statically, making sure memory is not wasted when there are multiple plug-in instances loaded */
+/** A fragment shader drawn by IGraphics::DrawShader(), for per-pixel effects that are costly or impossible to build from paths, such as glows, noise or a colour wheel.
+ * The shader is a function returning the colour, straight RGBA, at a point uv of the bounds, from (0, 0) at the top left to (1, 1) at the bottom right,
+ * with a source for each shading language, to which the backend adds the inputs and the entry point:
+ * - GLSL: vec4 shade(vec2 uv), reading uniform float uValues[IShader::kMaxValues], uniform vec2 uSize, the size in pixels, and uniform sampler2D uTexture
+ * - MSL: float4 shade(float2 uv, constant float* values, float2 size, texture2d<float> tex, sampler smp)
+ * - WGSL: fn shade(uv: vec2<f32>) -> vec4<f32>, for a WebGPU backend, which doesn't exist yet
+ * A backend without a shading language calls the pixel function for each pixel instead, without the texture, so it should compute the same colours, if more slowly.
+ * NanoVG runs GLSL on GL and MSL on macOS Metal, LICE calls the pixel function, and Cairo and AGG can't draw shaders. Only sample the texture if one is set.
+ * The shader keeps what it last drew, which is only drawn again when a value, the texture or the size changes, so it belongs to one control, and one IGraphics */
+class IShader
+{
+public:
+  static constexpr int kMaxValues = 16;
+
+  /** Computes the colour of a pixel, for backends that can't run the shader
+   * @param u The horizontal position of the pixel's centre, in [0, 1]
+   * @param v The vertical position of the pixel's centre, in [0, 1] from the top
+   * @param pValues The kMaxValues values, see SetValue() */
+  using PixelFunc = std::function<IColor(float u, float v, const float* pValues)>;
+
+  /** @param glsl The GLSL source, or nullptr
+   * @param msl The Metal shading language source, or nullptr
+   * @param wgsl The WGSL source, or nullptr
+   * @param pixelFunc The function for backends without a shading language, or nullptr to draw nothing on them */
+  IShader(const char* glsl, const char* msl = nullptr, const char* wgsl = nullptr, PixelFunc pixelFunc = nullptr)
+  : mGLSL(glsl ? glsl : "")
+  , mMSL(msl ? msl : "")
+  , mWGSL(wgsl ? wgsl : "")
+  , mPixelFunc(std::move(pixelFunc))
+  {
+    std::fill(mValues, mValues + kMaxValues, 0.f);
+  }
+
+  IShader(const IShader&) = delete;
+  IShader& operator=(const IShader&) = delete;
+
+  /** Set a value the shader reads, such as a time or a colour component, e.g. from IControl::Draw() or an animation
+   * @param idx The index of the value, in uValues in GLSL and values in MSL
+   * @param value The value */
+  void SetValue(int idx, float value)
+  {
+    assert(idx >= 0 && idx < kMaxValues);
+
+    if (mValues[idx] != value)
+    {
+      mValues[idx] = value;
+      mDirty = true;
+    }
+  }
+
+  /** @param idx The index of a value
+   * @return The value */
+  float GetValue(int idx) const { return mValues[idx]; }
+
+  /** @return The kMaxValues values */
+  const float* GetValues() const { return mValues; }
+
+  /** Set the bitmap the shader samples, as uTexture in GLSL and tex in MSL
+   * @param bitmap The bitmap, loaded by the IGraphics the shader is drawn with, or an empty IBitmap for none */
+  void SetTexture(const IBitmap& bitmap) { mTexture = bitmap; mDirty = true; }
+
+  /** @return The bitmap the shader samples, which may be empty */
+  const IBitmap& GetTexture() const { return mTexture; }
+
+  const char* GetGLSL() const { return mGLSL.Get(); }
+  const char* GetMSL() const { return mMSL.Get(); }
+  const char* GetWGSL() const { return mWGSL.Get(); }
+  const PixelFunc& GetPixelFunc() const { return mPixelFunc; }
+
+  /** Draw the shader again at the next IGraphics::DrawShader(), e.g. for one that reads something other than its values */
+  void SetDirty() { mDirty = true; }
+
+private:
+  friend IGraphics;
+
+  WDL_String mGLSL;
+  WDL_String mMSL;
+  WDL_String mWGSL;
+  PixelFunc mPixelFunc;
+  float mValues[kMaxValues];
+  IBitmap mTexture;
+  ILayerPtr mLayer; // the pixels last drawn
+  std::vector<uint8_t> mPixels; // the pixel function's output
+  bool mDirty = true;
+};
+
+/** Used internally to store data statically, making sure memory is not wasted when there are multiple plug-in instances loaded.
+ * The data are kept in a hash map keyed by name and scale. Accessor locks the storage exclusively, and SharedAccessor, which can only find data,
+ * lets lookups from several threads run at once. A thread holding a SharedAccessor must not create an Accessor, or another SharedAccessor, for the same storage.
+ * Each item records its users, such as the IGraphics instances that loaded it, and its size in bytes. An item without users is kept for the next user, unless the
+ * storage is over its budget, when those that lost their last user longest ago are deleted first. An item with users is never deleted to meet the budget.
+ * Storage that is given a name reports its size to IMemoryRegistry, as memory shared by every instance in the process */
 template <class T>
 class StaticStorage
 {
 public:
   /** Accessor class that mantains thread safety when using static storage via RAII */
-  class Accessor : private WDL_MutexLock
+  class Accessor : private WDL_MutexLockExclusive
   {
   public:
     Accessor(StaticStorage& storage) 
-    : WDL_MutexLock(&storage.mMutex)
+    : WDL_MutexLockExclusive(&storage.mMutex)
     , mStorage(storage) 
     {}
     
-    T* Find(const char* str, double scale = 1.)               { return mStorage.Find(str, scale); }
-    void Add(T* pData, const char* str, double scale = 1.)    { return mStorage.Add(pData, str, scale); }
-    void Remove(T* pData)                                     { return mStorage.Remove(pData); }
-    void Clear()                                              { return mStorage.Clear(); }
-    void Retain()                                             { return mStorage.Retain(); }
-    void Release()                                            { return mStorage.Release(); }
+    T* Find(const char* str, double scale = 1.)                               { return mStorage.Find(str, scale); }
+    void Add(T* pData, const char* str, double scale = 1., size_t bytes = 0)  { return mStorage.Add(pData, str, scale, bytes); }
+    void Remove(T* pData)                                                     { return mStorage.Remove(pData); }
+    void Clear()                                                              { return mStorage.Clear(); }
+    void Retain()                                                             { return mStorage.Retain(); }
+    void Release()                                                            { return mStorage.Release(); }
+    void AddUser(T* pData, const void* pUser)                                 { return mStorage.AddUser(pData, pUser); }
+    void RemoveUser(const void* pUser)                                        { return mStorage.RemoveUser(pUser); }
+    void SetBudget(size_t bytes)                                              { return mStorage.SetBudget(bytes); }
+    void SetDropScaledWhenUnused(bool drop)                                   { return mStorage.SetDropScaledWhenUnused(drop); }
+    size_t GetBytes() const                                                   { return mStorage.mBytes; }
+    int GetCount() const                                                      { return static_cast<int>(mStorage.mDatas.size()); }
       
   private:
     StaticStorage& mStorage;
   };
+
+  /** Accessor for lookups only, which doesn't block other lookups */
+  class SharedAccessor : private WDL_MutexLockShared
+  {
+  public:
+    SharedAccessor(StaticStorage& storage)
+    : WDL_MutexLockShared(&storage.mMutex)
+    , mStorage(storage)
+    {}
+
+    T* Find(const char* str, double scale = 1.)                               { return mStorage.Find(str, scale); }
+    T* FindUsed(const char* str, double scale, const void* pUser)             { return mStorage.FindUsed(str, scale, pUser); }
+    size_t GetBytes() const                                                   { return mStorage.mBytes; }
+    int GetCount() const                                                      { return static_cast<int>(mStorage.mDatas.size()); }
+
+  private:
+    StaticStorage& mStorage;
+  };
   
+  /** @param name The name the storage's size is reported under by IMemoryRegistry::Report(), or nullptr not to report it, e.g. for storage owned by one instance */
+  StaticStorage(const char* name = nullptr)
+  {
+    if (name)
+    {
+      mRegistration.reset(new IMemoryRegistry::Registration([this, name](IMemoryReport& report) {
+        SharedAccessor storage(*this);
+        report.Add(kMemoryShared, name, storage.GetBytes(), storage.GetCount());
+      }));
+    }
+  }
+
   ~StaticStorage()
   {
+    mRegistration = nullptr;
     Clear();
   }
 
 private:
-  /** /todo */
+  /** The name and scale that data are stored under */
   struct DataKey
   {
-    // N.B. - hashID is not guaranteed to be unique
-    size_t hashID;
-    WDL_String name;
+    std::string name;
     double scale;
-    std::unique_ptr<T> data;
+
+    bool operator==(const DataKey& other) const { return scale == other.scale && name == other.name; }
+  };
+
+  struct DataKeyHash
+  {
+    size_t operator()(const DataKey& key) const
+    {
+      return std::hash<std::string>()(key.name) ^ (std::hash<double>()(key.scale) * 31);
+    }
   };
   
-  /** /todo 
-   * @param str /todo
-   * @return size_t /todo */
-  size_t Hash(const char* str)
+  /** An item of data, with what the budget needs to know about it */
+  struct Entry
   {
-    std::string string(str);
-    return std::hash<std::string>()(string);
-  }
+    Entry(T* pData, size_t bytes, uint64_t lastUse)
+    : data(pData)
+    , bytes(bytes)
+    , lastUse(lastUse)
+    {}
+    
+    std::unique_ptr<T> data;
+    size_t bytes;
+    uint64_t lastUse; // when it was added or lost its last user, in the storage's own clock
+    std::vector<const void*> users;
+  };
+  
+  using Map = std::unordered_multimap<DataKey, Entry, DataKeyHash>;
 
-  /** /todo 
-   * @param str /todo
-   * @param scale /todo
-   * @return T* /todo */
+  /** Find data
+   * @param str The name of the data
+   * @param scale The scale of the data
+   * @return The data, or nullptr if none is stored under the name and scale */
   T* Find(const char* str, double scale = 1.)
   {
-    WDL_String cacheName(str);
-    cacheName.AppendFormatted((int) strlen(str) + 6, "-%.1fx", scale);
+    auto it = mDatas.find(DataKey { str, scale });
+    return it != mDatas.end() ? it->second.data.get() : nullptr;
+  }
+  
+  /** Find data that is already used by a user, which a lookup under a shared lock can return without adding the user
+   * @param str The name of the data
+   * @param scale The scale of the data
+   * @param pUser The user
+   * @return The data, or nullptr if none is stored under the name and scale, or it isn't used by pUser */
+  T* FindUsed(const char* str, double scale, const void* pUser)
+  {
+    auto it = mDatas.find(DataKey { str, scale });
     
-    size_t hashID = Hash(cacheName.Get());
+    if (it == mDatas.end())
+      return nullptr;
     
-    int i, n = mDatas.GetSize();
-    for (i = 0; i < n; ++i)
-    {
-      DataKey* pKey = mDatas.Get(i);
-
-      // Use the hash id for a quick search and then confirm with the scale and identifier to ensure uniqueness
-      if (pKey->hashID == hashID && scale == pKey->scale && !strcmp(str, pKey->name.Get()))
-        return pKey->data.get();
-    }
-    return nullptr;
+    const std::vector<const void*>& users = it->second.users;
+    return std::find(users.begin(), users.end(), pUser) != users.end() ? it->second.data.get() : nullptr;
   }
 
-  /** /todo 
-   * @param pData /todo
-   * @param str /todo
-   * @param scale /todo scale where 2x = retina, omit if not needed */
-  void Add(T* pData, const char* str, double scale = 1.)
+  /** Add data, which the storage then owns. If data is already stored under the name and scale, Find() returns either.
+   * The data has no users, so add one straight away if it may be deleted to meet the budget before it is used
+   * @param pData The data
+   * @param str The name of the data
+   * @param scale The scale of the data, where 2x = retina, omit if not needed
+   * @param bytes The memory the data uses, for the budget */
+  void Add(T* pData, const char* str, double scale = 1., size_t bytes = 0)
   {
-    DataKey* pKey = mDatas.Add(new DataKey);
-
-    WDL_String cacheName(str);
-    cacheName.AppendFormatted((int) strlen(str) + 6, "-%.1fx", scale);
-    
-    pKey->hashID = Hash(cacheName.Get());
-    pKey->data = std::unique_ptr<T>(pData);
-    pKey->scale = scale;
-    pKey->name.Set(str);
+    mDatas.emplace(std::piecewise_construct, std::forward_as_tuple(DataKey { str, scale }), std::forward_as_tuple(pData, bytes, ++mClock));
+    mBytes += bytes;
 
     //DBGMSG("adding %s to the static storage at %.1fx the original scale\n", str, scale);
   }
 
-  /** /todo @param pData /todo */
+  /** Remove and delete data, whether or not it has users
+   * @param pData The data */
   void Remove(T* pData)
   {
-    for (int i = 0; i < mDatas.GetSize(); ++i)
+    for (auto it = mDatas.begin(); it != mDatas.end(); ++it)
     {
-      if (mDatas.Get(i)->data.get() == pData)
+      if (it->second.data.get() == pData)
       {
-        mDatas.Delete(i, true);
+        Erase(it);
         break;
       }
     }
   }
 
-  /** /todo  */
+  /** Remove and delete all data */
   void Clear()
   {
-    mDatas.Empty(true);
+    mDatas.clear();
+    mBytes = 0;
   };
 
-  /** /todo  */
+  /** Count a user of the storage */
   void Retain()
   {
     mCount++;
   }
   
-  /** /todo  */
+  /** Uncount a user of the storage, and clear it once it has no users */
   void Release()
   {
     if (--mCount == 0)
       Clear();
   }
+  
+  /** Record a user of an item, which then isn't deleted to meet the budget until the user is removed
+   * @param pData The data
+   * @param pUser The user */
+  void AddUser(T* pData, const void* pUser)
+  {
+    for (auto& item : mDatas)
+    {
+      Entry& entry = item.second;
+      
+      if (entry.data.get() == pData)
+      {
+        if (std::find(entry.users.begin(), entry.users.end(), pUser) == entry.users.end())
+          entry.users.push_back(pUser);
+        
+        break;
+      }
+    }
+    
+    Trim();
+  }
+  
+  /** Remove a user from every item it uses, then delete unused items to meet the budget
+   * @param pUser The user */
+  void RemoveUser(const void* pUser)
+  {
+    for (auto it = mDatas.begin(); it != mDatas.end();)
+    {
+      std::vector<const void*>& users = it->second.users;
+      auto user = std::find(users.begin(), users.end(), pUser);
+      
+      if (user != users.end())
+      {
+        users.erase(user);
+        
+        if (users.empty())
+        {
+          it->second.lastUse = ++mClock;
+          
+          if (mDropScaledWhenUnused && it->first.scale > 1.)
+          {
+            it = Erase(it);
+            continue;
+          }
+        }
+      }
+      
+      ++it;
+    }
+    
+    Trim();
+  }
+  
+  /** Set the memory that the storage keeps unused items in up to
+   * @param bytes The budget in bytes, or 0 to keep every item for as long as the storage is retained */
+  void SetBudget(size_t bytes)
+  {
+    mBudget = bytes;
+    Trim();
+  }
+  
+  /** Delete items above a scale of 1 as soon as they lose their last user, such as the 2x bitmaps of an editor that was closed
+   * @param drop \c true to delete them */
+  void SetDropScaledWhenUnused(bool drop)
+  {
+    mDropScaledWhenUnused = drop;
+  }
+  
+  /** Delete the items without users that lost their last user longest ago, until the storage is within its budget */
+  void Trim()
+  {
+    while (mBudget && mBytes > mBudget)
+    {
+      auto oldest = mDatas.end();
+      
+      for (auto it = mDatas.begin(); it != mDatas.end(); ++it)
+      {
+        if (it->second.users.empty() && (oldest == mDatas.end() || it->second.lastUse < oldest->second.lastUse))
+          oldest = it;
+      }
+      
+      if (oldest == mDatas.end())
+        break;
+      
+      Erase(oldest);
+    }
+  }
+  
+  typename Map::iterator Erase(typename Map::iterator it)
+  {
+    mBytes -= it->second.bytes;
+    return mDatas.erase(it);
+  }
     
-  int mCount;
-  WDL_Mutex mMutex;
-  WDL_PtrList<DataKey> mDatas;
+  int mCount = 0;
+  size_t mBytes = 0;
+  size_t mBudget = 0;
+  uint64_t mClock = 0;
+  bool mDropScaledWhenUnused = false;
+  WDL_SharedMutex mMutex;
+  Map mDatas;
+  std::unique_ptr<IMemoryRegistry::Registration> mRegistration;
 };
 
 /**@}*/
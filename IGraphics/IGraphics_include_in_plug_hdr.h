@@ -21,7 +21,9 @@
 
 #ifndef NO_IGRAPHICS
 
-#ifdef OS_WIN
+#if defined IGRAPHICS_HEADLESS
+  #include "IGraphicsHeadless.h"
+#elif defined OS_WIN
   #include "IGraphicsWin.h"
 #elif defined OS_MAC
   #include "IGraphicsMac.h"
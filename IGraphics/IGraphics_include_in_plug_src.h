@@ -21,7 +21,22 @@
 
 #ifndef NO_IGRAPHICS
 
- #if defined OS_WIN
+ #if defined IGRAPHICS_HEADLESS
+  #if defined OS_WIN
+  extern HINSTANCE gHINSTANCE;
+  #endif
+
+  IGraphics* MakeGraphics(IGEditorDelegate& dlg, int w, int h, int fps = 0, float scale = 1.)
+  {
+    IGraphicsHeadless* pGraphics = new IGraphicsHeadless(dlg, w, h, fps, scale);
+  #if defined OS_WIN
+    pGraphics->SetWinModuleHandle(gHINSTANCE);
+  #elif defined OS_MAC
+    pGraphics->SetBundleID(BUNDLE_ID);
+  #endif
+    return pGraphics;
+  }
+ #elif defined OS_WIN
   extern HINSTANCE gHINSTANCE;
 
   IGraphics* MakeGraphics(IGEditorDelegate& dlg, int w, int h, int fps = 0, float scale = 1.)
@@ -46,6 +61,12 @@
 
     return pGraphics;
   }
+  #elif defined OS_LINUX
+  IGraphics* MakeGraphics(IGEditorDelegate& dlg, int w, int h, int fps = 0, float scale = 1.)
+  {
+    IGraphicsLinux* pGraphics = new IGraphicsLinux(dlg, w, h, fps, scale);
+    return pGraphics;
+  }
   #elif defined OS_WEB
   #include <emscripten.h>
 
@@ -0,0 +1,87 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc ILRUCache
+ */
+
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+/** A map of a fixed number of entries, which drops the least recently used entry when a new one is added to it when full.
+ * It isn't thread safe, see ITextMeasureCache for a shared cache built on it
+ * @tparam KEY The key type, which must be copyable and comparable with ==
+ * @tparam VALUE The value type, which must be copyable
+ * @tparam HASH The hash of KEY */
+template <class KEY, class VALUE, class HASH = std::hash<KEY>>
+class ILRUCache
+{
+public:
+  /** @param maxEntries The most entries kept */
+  ILRUCache(size_t maxEntries)
+  : mMaxEntries(maxEntries)
+  {}
+
+  /** Find an entry, and make it the most recently used
+   * @return The value, or nullptr if the key isn't in the cache. It is valid until the next call to Add() or Clear() */
+  const VALUE* Find(const KEY& key)
+  {
+    auto it = mMap.find(key);
+
+    if (it == mMap.end())
+      return nullptr;
+
+    mList.splice(mList.begin(), mList, it->second);
+    return &it->second->second;
+  }
+
+  /** Add or replace an entry, as the most recently used */
+  void Add(const KEY& key, const VALUE& value)
+  {
+    auto it = mMap.find(key);
+
+    if (it != mMap.end())
+    {
+      it->second->second = value;
+      mList.splice(mList.begin(), mList, it->second);
+      return;
+    }
+
+    if (mMap.size() >= mMaxEntries && !mList.empty())
+    {
+      mMap.erase(mList.back().first);
+      mList.pop_back();
+    }
+
+    mList.emplace_front(key, value);
+    mMap.emplace(key, mList.begin());
+  }
+
+  /** Remove every entry */
+  void Clear()
+  {
+    mMap.clear();
+    mList.clear();
+  }
+
+  size_t GetSize() const { return mMap.size(); }
+
+private:
+  using Entry = std::pair<KEY, VALUE>;
+
+  size_t mMaxEntries;
+  /** The entries, most recently used first */
+  std::list<Entry> mList;
+  std::unordered_map<KEY, typename std::list<Entry>::iterator, HASH> mMap;
+};
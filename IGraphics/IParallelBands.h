@@ -0,0 +1,117 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IParallelBands
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+
+#include "IPlugWorkerPool.h"
+
+/** Splits a pass over the rows of a CPU rendered image into bands, which are rasterized at the same time on the process wide IPlugWorkerPool and the calling thread.
+ * The calling thread takes any band that no worker has started on, so a pool that is busy with other jobs only costs the parallelism, and Run() returns once every
+ * band is done. A band must only write to its own rows. Small images, and machines with a single core, are done in one band on the calling thread */
+class IParallelBands final
+{
+public:
+  /** The fewest pixels in a band, below which handing it to a worker costs more than it saves */
+  static constexpr int kMinBandPixels = 16384;
+
+  /** The most bands a pass is split into */
+  static constexpr int kMaxBands = 5;
+
+  /** Run a pass over the rows of an image
+   * @param nRows The number of rows
+   * @param rowPixels The number of pixels in a row, used to size the bands
+   * @param func A callable taking the first row of a band and the row after its last, called once for each band */
+  template <class FUNC>
+  static void Run(int nRows, int rowPixels, FUNC&& func)
+  {
+    if (nRows <= 0)
+      return;
+
+    const int minRows = std::max(1, (kMinBandPixels + rowPixels - 1) / std::max(rowPixels, 1));
+    const int nBands = std::min(MaxBands(), nRows / minRows);
+
+    if (nBands <= 1)
+    {
+      func(0, nRows);
+      return;
+    }
+
+    // the state is shared with the jobs, which may only be taken by a worker after every band is done, when they find nothing to do
+    auto state = std::make_shared<State>();
+    state->nRows = nRows;
+    state->nBands = nBands;
+    state->pFunc = (void*) &func;
+    state->callFunc = [](void* pFunc, int start, int end) { (*static_cast<typename std::remove_reference<FUNC>::type*>(pFunc))(start, end); };
+
+    for (int i = 1; i < nBands; i++)
+    {
+      IPlugWorkerPool::Get().Submit(std::make_shared<IPlugJob>([state](IPlugJob&) { RunBands(*state); }, nullptr,
+                                                               IPlugJob::kPriorityHigh, IPlugJob::ECompletionThread::kMainThread));
+    }
+
+    RunBands(*state);
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->condition.wait(lock, [&state]() { return state->nDone == state->nBands; });
+  }
+
+private:
+  struct State
+  {
+    int nRows = 0;
+    int nBands = 0;
+    void* pFunc = nullptr;
+    void (*callFunc)(void* pFunc, int start, int end) = nullptr;
+    std::atomic<int> next {0};
+    int nDone = 0;
+    std::mutex mutex;
+    std::condition_variable condition;
+  };
+
+  /** @return The most bands worth splitting a pass into, one for each worker of the pool and one for the calling thread */
+  static int MaxBands()
+  {
+    static const int sMaxBands = []() {
+      const int nCores = static_cast<int>(std::thread::hardware_concurrency());
+      return nCores <= 1 ? 1 : std::min(std::min(nCores - 1, 4) + 1, (int) kMaxBands);
+    }();
+
+    return sMaxBands;
+  }
+
+  /** Take bands until there are none left */
+  static void RunBands(State& state)
+  {
+    int band;
+
+    while ((band = state.next.fetch_add(1)) < state.nBands)
+    {
+      state.callFunc(state.pFunc, band * state.nRows / state.nBands, (band + 1) * state.nRows / state.nBands);
+
+      std::lock_guard<std::mutex> lock(state.mutex);
+
+      if (++state.nDone == state.nBands)
+        state.condition.notify_all();
+    }
+  }
+};
@@ -0,0 +1,146 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IShelfPacker
+ */
+
+#include <algorithm>
+
+#include "heapbuf.h"
+
+/** Packs rectangles into a fixed size page in rows, or shelves, for sharing one texture between many small layers.
+ * A rectangle goes on the shortest shelf that it fits, a new shelf is opened below the others if there is none. Space on a shelf is only
+ * reclaimed once every rectangle on it has been freed, when the shelf can be reused for rectangles of up to its height, and empty shelves
+ * next to each other, or at the bottom of the page, are merged. This suits layers, which are mostly of a few sizes and are freed together */
+class IShelfPacker
+{
+public:
+  /** IShelfPacker constructor
+   * @param width The width of the page, in pixels
+   * @param height The height of the page, in pixels
+   * @param gutter The space left after each rectangle, so that filtering doesn't pick up its neighbours */
+  IShelfPacker(int width, int height, int gutter = 1)
+  : mWidth(width)
+  , mHeight(height)
+  , mGutter(gutter)
+  {}
+
+  /** Find space for a rectangle
+   * @param w The width of the rectangle
+   * @param h The height of the rectangle
+   * @param x Set to the left of the rectangle in the page
+   * @param y Set to the top of the rectangle in the page
+   * @return \c true if there was space */
+  bool Alloc(int w, int h, int& x, int& y)
+  {
+    const int ww = w + mGutter;
+    const int hh = h + mGutter;
+    Shelf* pShelves = mShelves.Get();
+    int best = -1;
+
+    // the shortest shelf the rectangle fits, ignoring much taller ones unless they are empty
+    for (int i = 0; i < mShelves.GetSize(); i++)
+    {
+      const Shelf& s = pShelves[i];
+
+      if (s.h >= hh && s.x + ww <= mWidth && (s.h <= 2 * hh || !s.nItems) && (best < 0 || s.h < pShelves[best].h))
+        best = i;
+    }
+
+    if (best < 0)
+    {
+      if (ww > mWidth || mTop + hh > mHeight)
+        return false;
+
+      // round the height up, so that rectangles of similar heights share the shelf
+      const Shelf s { mTop, std::min((hh + 7) & ~7, mHeight - mTop), 0, 0 };
+      mShelves.Add(s);
+      mTop += s.h;
+      best = mShelves.GetSize() - 1;
+      pShelves = mShelves.Get();
+    }
+
+    Shelf& s = pShelves[best];
+    x = s.x;
+    y = s.y;
+    s.x += ww;
+    s.nItems++;
+    mNItems++;
+    return true;
+  }
+
+  /** Free a rectangle returned by Alloc()
+   * @param y The top of the rectangle */
+  void Free(int y)
+  {
+    Shelf* pShelves = mShelves.Get();
+    int i = 0;
+
+    while (i < mShelves.GetSize() && pShelves[i].y != y)
+      i++;
+
+    if (i == mShelves.GetSize() || !pShelves[i].nItems)
+      return;
+
+    mNItems--;
+
+    if (--pShelves[i].nItems)
+      return;
+
+    pShelves[i].x = 0;
+
+    // merge with empty neighbours
+    if (i + 1 < mShelves.GetSize() && !pShelves[i + 1].nItems)
+    {
+      pShelves[i].h += pShelves[i + 1].h;
+      mShelves.Delete(i + 1);
+    }
+
+    pShelves = mShelves.Get();
+
+    if (i > 0 && !pShelves[i - 1].nItems)
+    {
+      pShelves[i - 1].h += pShelves[i].h;
+      mShelves.Delete(i--);
+    }
+
+    if (i == mShelves.GetSize() - 1)
+    {
+      mTop = mShelves.Get()[i].y;
+      mShelves.Delete(i);
+    }
+  }
+
+  /** @return \c true if no rectangles are allocated */
+  bool Empty() const { return !mNItems; }
+
+  int GetWidth() const { return mWidth; }
+  int GetHeight() const { return mHeight; }
+
+private:
+  struct Shelf
+  {
+    int y;
+    int h;
+    int x;      // the left of the free space
+    int nItems;
+  };
+
+  int mWidth;
+  int mHeight;
+  int mGutter;
+  int mTop = 0; // the bottom of the last shelf
+  int mNItems = 0;
+  WDL_TypedBuf<Shelf> mShelves;
+};
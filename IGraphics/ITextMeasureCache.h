@@ -0,0 +1,136 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc ITextMeasureCache
+ */
+
+#include <functional>
+#include <string>
+
+#include "mutex.h"
+
+#include "IGraphicsStructs.h"
+#include "ILRUCache.h"
+
+/** A cache of the results of IGraphics::MeasureText(), shared by all the plug-in instances in the binary, so that text that is measured on every draw,
+ * such as a caption or a value readout, is only laid out by the drawing backend once. A result is keyed by everything it depends on: the string, the font,
+ * size, alignment, quality and orientation of the IText, the bounds it is measured in and the backing pixel scale, so that a change of scale misses the cache
+ * and the entries of the old scale age out. When the cache is full the least recently used entry is dropped. It is cleared when a font is loaded,
+ * in case the font was missing when text was measured with it */
+class ITextMeasureCache final
+{
+public:
+  /** The most entries kept */
+  static constexpr size_t kMaxEntries = 2048;
+
+  /** @return The process wide cache */
+  static ITextMeasureCache& Get()
+  {
+    static ITextMeasureCache sCache;
+    return sCache;
+  }
+
+  ITextMeasureCache(const ITextMeasureCache&) = delete;
+  ITextMeasureCache& operator=(const ITextMeasureCache&) = delete;
+
+  /** Find a measurement
+   * @param text The IText the string is measured with
+   * @param str The string
+   * @param bounds The bounds it is measured in, set to the result if found
+   * @param scale The backing pixel scale
+   * @return \c true if found */
+  bool Find(const IText& text, const char* str, IRECT& bounds, float scale)
+  {
+    const Key key(text, str, bounds, scale);
+    WDL_MutexLock lock(&mMutex);
+
+    const IRECT* pResult = mEntries.Find(key);
+
+    if (pResult)
+      bounds = *pResult;
+
+    return pResult != nullptr;
+  }
+
+  /** Store a measurement
+   * @param text The IText the string was measured with
+   * @param str The string
+   * @param bounds The bounds it was measured in
+   * @param result The measured bounds
+   * @param scale The backing pixel scale */
+  void Add(const IText& text, const char* str, const IRECT& bounds, const IRECT& result, float scale)
+  {
+    const Key key(text, str, bounds, scale);
+    WDL_MutexLock lock(&mMutex);
+    mEntries.Add(key, result);
+  }
+
+  /** Remove every measurement */
+  void Clear()
+  {
+    WDL_MutexLock lock(&mMutex);
+    mEntries.Clear();
+  }
+
+private:
+  ITextMeasureCache()
+  : mEntries(kMaxEntries)
+  {}
+
+  struct Key
+  {
+    Key(const IText& text, const char* str, const IRECT& bounds, float scale)
+    : mStr(str)
+    , mFont(text.mFont)
+    , mSize(text.mSize)
+    , mAlign(text.mAlign)
+    , mVAlign(text.mVAlign)
+    , mQuality(text.mQuality)
+    , mOrientation(text.mOrientation)
+    , mL(bounds.L), mT(bounds.T), mR(bounds.R), mB(bounds.B)
+    , mScale(scale)
+    {}
+
+    bool operator==(const Key& other) const
+    {
+      return mStr == other.mStr && mFont == other.mFont && mSize == other.mSize && mAlign == other.mAlign && mVAlign == other.mVAlign
+          && mQuality == other.mQuality && mOrientation == other.mOrientation && mL == other.mL && mT == other.mT && mR == other.mR
+          && mB == other.mB && mScale == other.mScale;
+    }
+
+    std::string mStr;
+    std::string mFont;
+    int mSize, mAlign, mVAlign, mQuality, mOrientation;
+    float mL, mT, mR, mB, mScale;
+  };
+
+  struct KeyHash
+  {
+    size_t operator()(const Key& key) const
+    {
+      size_t hash = std::hash<std::string>()(key.mStr);
+      auto combine = [&hash](size_t value) { hash ^= value + 0x9e3779b9 + (hash << 6) + (hash >> 2); };
+      combine(std::hash<std::string>()(key.mFont));
+      combine(std::hash<int>()(key.mSize));
+      combine(std::hash<float>()(key.mL));
+      combine(std::hash<float>()(key.mT));
+      combine(std::hash<float>()(key.mR));
+      combine(std::hash<float>()(key.mScale));
+      return hash;
+    }
+  };
+
+  WDL_Mutex mMutex;
+  ILRUCache<Key, IRECT, KeyHash> mEntries;
+};
@@ -0,0 +1,561 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#include "IGraphicsHeadless.h"
+#include "IPlugPaths.h"
+#include "IPlugResourceArchive.h"
+
+#if defined IGRAPHICS_GL
+  #if defined OS_LINUX
+    #include <EGL/egl.h>
+  #elif defined OS_MAC
+    #include <OpenGL/OpenGL.h>
+    #if defined IGRAPHICS_GL2
+      #include <OpenGL/glext.h>
+    #endif
+  #else
+    #error IGraphicsHeadless makes its GL context with EGL on Linux or CGL on macOS
+  #endif
+#elif defined IGRAPHICS_NANOVG
+  #error IGraphicsHeadless draws NanoVG with IGRAPHICS_GL2 or IGRAPHICS_GL3
+#elif defined IGRAPHICS_CAIRO || defined IGRAPHICS_CANVAS
+  #error IGraphicsHeadless draws with IGRAPHICS_LICE, IGRAPHICS_AGG or IGRAPHICS_NANOVG
+#endif
+
+#pragma mark - PNG
+
+/** CRC of PNG chunks, as in the PNG specification's sample code */
+static uint32_t UpdateCRC(uint32_t crc, const uint8_t* pData, size_t size)
+{
+  static uint32_t table[256] = {};
+
+  if (!table[1])
+  {
+    for (uint32_t n = 0; n < 256; n++)
+    {
+      uint32_t c = n;
+
+      for (int k = 0; k < 8; k++)
+        c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+
+      table[n] = c;
+    }
+  }
+
+  for (size_t i = 0; i < size; i++)
+    crc = table[(crc ^ pData[i]) & 0xFF] ^ (crc >> 8);
+
+  return crc;
+}
+
+static void AppendBigEndian(std::vector<uint8_t>& dst, uint32_t value)
+{
+  dst.push_back(static_cast<uint8_t>(value >> 24));
+  dst.push_back(static_cast<uint8_t>(value >> 16));
+  dst.push_back(static_cast<uint8_t>(value >> 8));
+  dst.push_back(static_cast<uint8_t>(value));
+}
+
+static void AppendChunk(std::vector<uint8_t>& dst, const char* type, const std::vector<uint8_t>& data)
+{
+  AppendBigEndian(dst, static_cast<uint32_t>(data.size()));
+  const size_t start = dst.size();
+  dst.insert(dst.end(), type, type + 4);
+  dst.insert(dst.end(), data.begin(), data.end());
+  AppendBigEndian(dst, UpdateCRC(0xFFFFFFFFu, dst.data() + start, dst.size() - start) ^ 0xFFFFFFFFu);
+}
+
+/** Write 8 bit RGBA pixels with straight alpha to a PNG file. The image data is deflated with stored blocks only, which makes bigger files than a compressor would,
+ * but these are images for comparing, not for shipping, and it needs no library that every backend would have to link
+ * @return \c true if the file was written */
+static bool WritePNG(const char* path, const uint8_t* pPixels, int width, int height)
+{
+  // each row is preceded by its filter type, none
+  std::vector<uint8_t> raw;
+  raw.reserve((width * 4 + 1) * height);
+
+  for (int y = 0; y < height; y++)
+  {
+    raw.push_back(0);
+    raw.insert(raw.end(), pPixels + y * width * 4, pPixels + (y + 1) * width * 4);
+  }
+
+  // a zlib stream of stored blocks of up to 65535 bytes
+  std::vector<uint8_t> idat = { 0x78, 0x01 };
+  uint32_t a = 1, b = 0;
+
+  for (size_t pos = 0; pos < raw.size() || pos == 0; )
+  {
+    const uint16_t len = static_cast<uint16_t>(std::min<size_t>(raw.size() - pos, 65535));
+    const bool last = pos + len == raw.size();
+    idat.push_back(last ? 1 : 0);
+    idat.push_back(len & 0xFF);
+    idat.push_back(len >> 8);
+    idat.push_back(~len & 0xFF);
+    idat.push_back((~len >> 8) & 0xFF);
+    idat.insert(idat.end(), raw.begin() + pos, raw.begin() + pos + len);
+
+    for (size_t i = pos; i < pos + len; i++)
+    {
+      a = (a + raw[i]) % 65521;
+      b = (b + a) % 65521;
+    }
+
+    pos += len;
+
+    if (last)
+      break;
+  }
+
+  AppendBigEndian(idat, (b << 16) | a);
+
+  std::vector<uint8_t> header;
+  AppendBigEndian(header, static_cast<uint32_t>(width));
+  AppendBigEndian(header, static_cast<uint32_t>(height));
+  header.insert(header.end(), { 8, 6, 0, 0, 0 }); // 8 bit RGBA, deflate, adaptive filtering, no interlace
+
+  static const uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+  std::vector<uint8_t> file(signature, signature + sizeof(signature));
+  AppendChunk(file, "IHDR", header);
+  AppendChunk(file, "IDAT", idat);
+  AppendChunk(file, "IEND", {});
+
+  FILE* fp = fopen(path, "wb");
+
+  if (!fp)
+    return false;
+
+  const bool written = fwrite(file.data(), 1, file.size(), fp) == file.size();
+  return fclose(fp) == 0 && written;
+}
+
+#pragma mark - Fonts
+
+IFontDataPtr IGraphicsHeadless::HeadlessFont::GetFontData()
+{
+  if (mData)
+    return IFontDataPtr(new IFontData(mData, mSize, 0));
+
+  IFontDataPtr fontData(new IFontData());
+  FILE* fp = fopen(mPath.Get(), "rb");
+
+  if (!fp)
+    return fontData;
+
+  fseek(fp, 0, SEEK_END);
+  fontData.reset(new IFontData((int) ftell(fp)));
+
+  if (!fontData->GetSize())
+  {
+    fclose(fp);
+    return fontData;
+  }
+
+  fseek(fp, 0, SEEK_SET);
+  size_t readSize = fread(fontData->Get(), 1, fontData->GetSize(), fp);
+  fclose(fp);
+
+  if (readSize && readSize == fontData->GetSize())
+    fontData->SetFaceIdx(0);
+
+  return fontData;
+}
+
+IGraphics::PlatformFontPtr IGraphicsHeadless::LoadPlatformFont(const char* fontID, const char* fileNameOrResID)
+{
+  WDL_String fullPath;
+  const EResourceLocation fontLocation = LocateResource(fileNameOrResID, "ttf", fullPath, GetBundleID(), GetWinModuleHandle());
+
+  if (fontLocation == kNotFound)
+    return nullptr;
+
+  int size = 0;
+  const void* pData = nullptr;
+
+  if (fontLocation == kPackedArchive)
+    pData = IPlugResourceArchive::Get().Find(fullPath.Get(), size);
+#ifdef OS_WIN
+  else if (fontLocation == kWinBinary)
+    pData = LoadWinResource(fullPath.Get(), "ttf", size, GetWinModuleHandle());
+#endif
+  else
+    return PlatformFontPtr(new HeadlessFont(fullPath.Get()));
+
+  return pData ? PlatformFontPtr(new HeadlessFont(pData, size)) : nullptr;
+}
+
+#pragma mark - Window
+
+IGraphicsHeadless::IGraphicsHeadless(IGEditorDelegate& dlg, int w, int h, int fps, float scale)
+  : IGRAPHICS_DRAW_CLASS(dlg, w, h, fps, scale)
+{
+}
+
+IGraphicsHeadless::~IGraphicsHeadless()
+{
+  CloseWindow();
+}
+
+void* IGraphicsHeadless::OpenWindow(void* pParent)
+{
+  if (mOpen)
+    CloseWindow();
+
+#ifdef IGRAPHICS_GL
+  if (!CreateGLContext())
+  {
+    DestroyGLContext();
+    return nullptr;
+  }
+#endif
+
+  mOpen = true;
+
+  // the fallbacks for the platform's text entries and menus, which are drawn like any control
+  AttachTextEntryControl();
+  AttachPopupMenuControl();
+
+  OnViewInitialized(nullptr);
+
+  SetScreenScale(1);
+
+  LayoutUIOnOpen();
+
+  SetAllControlsDirty();
+
+  return GetWindow();
+}
+
+void IGraphicsHeadless::CloseWindow()
+{
+  if (!mOpen)
+    return;
+
+#ifdef IGRAPHICS_GL
+  ActivateGLContext();
+  OnViewDestroyed();
+  DestroyGLContext();
+#else
+  OnViewDestroyed();
+#endif
+
+  mOpen = false;
+}
+
+void IGraphicsHeadless::DrawResize()
+{
+#ifdef IGRAPHICS_GL
+  ActivateGLContext();
+  ResizeGLFramebuffer();
+#endif
+  IGRAPHICS_DRAW_CLASS::DrawResize();
+}
+
+void IGraphicsHeadless::EndFrame()
+{
+#ifdef IGRAPHICS_GL
+  // NanoVG copies its main framebuffer into the offscreen one, which stands in for the window's
+  IGRAPHICS_DRAW_CLASS::EndFrame();
+#endif
+  // the CPU backends would blit their bitmap to the window here, and the frame is already in it
+}
+
+int IGraphicsHeadless::ShowMessageBox(const char* str, const char* caption, EMessageBoxType type)
+{
+  ReleaseMouseCapture();
+  DBGMSG("%s: %s\n", caption, str);
+
+  // answered as a dismissed dialog would be
+  switch (type)
+  {
+    case kMB_OK: return kOK;
+    case kMB_YESNO: return kNO;
+    default: return kCANCEL;
+  }
+}
+
+#pragma mark - Simulation
+
+bool IGraphicsHeadless::OnTimer()
+{
+  if (!mOpen)
+    return false;
+
+  IRECTList rects;
+  const bool dirty = IsDirty(rects);
+
+  if (dirty)
+  {
+    SetAllControlsClean();
+#ifdef IGRAPHICS_GL
+    ActivateGLContext();
+#endif
+    Draw(rects);
+#ifdef IGRAPHICS_GL
+    glFinish();
+#endif
+  }
+
+  return dirty;
+}
+
+void IGraphicsHeadless::Click(float x, float y, const IMouseMod& mod)
+{
+  OnMouseOver(x, y, mod);
+  OnMouseDown(x, y, mod);
+  OnMouseUp(x, y, mod);
+}
+
+void IGraphicsHeadless::Drag(float x1, float y1, float x2, float y2, int nSteps, const IMouseMod& mod)
+{
+  OnMouseOver(x1, y1, mod);
+  OnMouseDown(x1, y1, mod);
+
+  float x = x1, y = y1;
+
+  for (int i = 1; i <= nSteps; i++)
+  {
+    const float nextX = x1 + (x2 - x1) * i / nSteps;
+    const float nextY = y1 + (y2 - y1) * i / nSteps;
+    OnMouseDrag(nextX, nextY, nextX - x, nextY - y, mod);
+    x = nextX;
+    y = nextY;
+  }
+
+  OnMouseUp(x2, y2, mod);
+}
+
+bool IGraphicsHeadless::CapturePixels(RawBitmapData& data, int& width, int& height)
+{
+  if (!mOpen)
+    return false;
+
+#ifdef IGRAPHICS_GL
+  ActivateGLContext();
+#endif
+
+  BeginFrame();
+  const bool read = DrawFrameToPixels(data, width, height, GetBackingPixelScale());
+  EndFrame();
+
+  if (!read)
+    return false;
+
+  // PNGs and reference images are compared with straight alpha
+  uint8_t* pPixel = data.Get();
+
+  for (int i = 0; i < width * height; i++, pPixel += 4)
+  {
+    const int alpha = pPixel[3];
+
+    if (alpha && alpha < 255)
+    {
+      for (int c = 0; c < 3; c++)
+        pPixel[c] = static_cast<uint8_t>(std::min(255, (pPixel[c] * 255 + alpha / 2) / alpha));
+    }
+  }
+
+  return true;
+}
+
+bool IGraphicsHeadless::SavePNG(const char* path)
+{
+  RawBitmapData data;
+  int width, height;
+
+  return CapturePixels(data, width, height) && WritePNG(path, data.Get(), width, height);
+}
+
+#pragma mark - GL
+
+#ifdef IGRAPHICS_GL
+bool IGraphicsHeadless::CreateGLContext()
+{
+#if defined OS_LINUX
+  EGLDisplay display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+  if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr) || !eglBindAPI(EGL_OPENGL_API))
+    return false;
+
+  mGLDisplay = display;
+
+  const EGLint configAttributes[] = {
+    EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+    EGL_RED_SIZE, 8,
+    EGL_GREEN_SIZE, 8,
+    EGL_BLUE_SIZE, 8,
+    EGL_ALPHA_SIZE, 8,
+    EGL_STENCIL_SIZE, 8,
+    EGL_NONE
+  };
+
+  EGLConfig config;
+  EGLint nConfigs = 0;
+
+  if (!eglChooseConfig(display, configAttributes, &config, 1, &nConfigs) || !nConfigs)
+    return false;
+
+  // everything is drawn into a framebuffer object, the surface only has to exist to make the context current
+  const EGLint surfaceAttributes[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+  mGLSurface = eglCreatePbufferSurface(display, config, surfaceAttributes);
+
+  if (mGLSurface == EGL_NO_SURFACE)
+    return false;
+
+#if defined IGRAPHICS_GL3
+  const EGLint contextAttributes[] = {
+    EGL_CONTEXT_MAJOR_VERSION, 3,
+    EGL_CONTEXT_MINOR_VERSION, 2,
+    EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+    EGL_NONE
+  };
+#else
+  const EGLint contextAttributes[] = { EGL_NONE };
+#endif
+
+  mGLContext = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+
+  if (mGLContext == EGL_NO_CONTEXT)
+    return false;
+#elif defined OS_MAC
+  const CGLPixelFormatAttribute attributes[] = {
+#if defined IGRAPHICS_GL3
+    kCGLPFAOpenGLProfile, static_cast<CGLPixelFormatAttribute>(kCGLOGLPVersion_3_2_Core),
+#else
+    kCGLPFAOpenGLProfile, static_cast<CGLPixelFormatAttribute>(kCGLOGLPVersion_Legacy),
+#endif
+    kCGLPFAColorSize, static_cast<CGLPixelFormatAttribute>(24),
+    kCGLPFAAlphaSize, static_cast<CGLPixelFormatAttribute>(8),
+    kCGLPFAStencilSize, static_cast<CGLPixelFormatAttribute>(8),
+    kCGLPFAAllowOfflineRenderers,
+    static_cast<CGLPixelFormatAttribute>(0)
+  };
+
+  CGLPixelFormatObj pixelFormat = nullptr;
+  GLint nFormats = 0;
+
+  if (CGLChoosePixelFormat(attributes, &pixelFormat, &nFormats) != kCGLNoError || !pixelFormat)
+    return false;
+
+  CGLContextObj context = nullptr;
+  CGLCreateContext(pixelFormat, nullptr, &context);
+  CGLDestroyPixelFormat(pixelFormat);
+
+  if (!context)
+    return false;
+
+  mGLContext = context;
+#endif
+
+  ActivateGLContext();
+
+  // bound before NanoVG first binds a framebuffer, so that it takes this one for the window's
+  glGenFramebuffers(1, &mFBO);
+  glGenRenderbuffers(1, &mColorRBO);
+  glGenRenderbuffers(1, &mDepthStencilRBO);
+  ResizeGLFramebuffer();
+
+  return glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+}
+
+void IGraphicsHeadless::DestroyGLContext()
+{
+  if (!mGLContext)
+    return;
+
+  ActivateGLContext();
+
+  if (mFBO)
+    glDeleteFramebuffers(1, &mFBO);
+
+  if (mColorRBO)
+    glDeleteRenderbuffers(1, &mColorRBO);
+
+  if (mDepthStencilRBO)
+    glDeleteRenderbuffers(1, &mDepthStencilRBO);
+
+  mFBO = mColorRBO = mDepthStencilRBO = 0;
+
+#if defined OS_LINUX
+  eglMakeCurrent(mGLDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  eglDestroyContext(mGLDisplay, mGLContext);
+
+  if (mGLSurface)
+    eglDestroySurface(mGLDisplay, mGLSurface);
+
+  eglTerminate(mGLDisplay);
+  mGLDisplay = nullptr;
+  mGLSurface = nullptr;
+#elif defined OS_MAC
+  CGLSetCurrentContext(nullptr);
+  CGLDestroyContext(static_cast<CGLContextObj>(mGLContext));
+#endif
+
+  mGLContext = nullptr;
+}
+
+void IGraphicsHeadless::ActivateGLContext()
+{
+  if (!mGLContext)
+    return;
+
+#if defined OS_LINUX
+  eglMakeCurrent(mGLDisplay, mGLSurface, mGLSurface, mGLContext);
+#elif defined OS_MAC
+  CGLSetCurrentContext(static_cast<CGLContextObj>(mGLContext));
+#endif
+
+  if (mFBO)
+    glBindFramebuffer(GL_FRAMEBUFFER, mFBO);
+}
+
+void IGraphicsHeadless::ResizeGLFramebuffer()
+{
+  if (!mFBO)
+    return;
+
+  const int w = std::max(1, WindowWidth() * GetScreenScale());
+  const int h = std::max(1, WindowHeight() * GetScreenScale());
+
+  glBindFramebuffer(GL_FRAMEBUFFER, mFBO);
+  glBindRenderbuffer(GL_RENDERBUFFER, mColorRBO);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, w, h);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, mColorRBO);
+  glBindRenderbuffer(GL_RENDERBUFFER, mDepthStencilRBO);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, w, h);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, mDepthStencilRBO);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_RENDERBUFFER, mDepthStencilRBO);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+}
+#endif
+
+#ifndef NO_IGRAPHICS
+#if defined IGRAPHICS_AGG
+  #include "IGraphicsAGG.cpp"
+#elif defined IGRAPHICS_LICE
+  #include "IGraphicsLice.cpp"
+#elif defined IGRAPHICS_NANOVG
+  #include "IGraphicsNanoVG.cpp"
+
+  // on macOS nanovg.c is built by IGraphicsNanoVG_src.m
+  #ifndef OS_MAC
+    #ifdef IGRAPHICS_FREETYPE
+      #define FONS_USE_FREETYPE
+    #endif
+
+    #include "nanovg.c"
+  #endif
+#endif
+#endif
@@ -0,0 +1,141 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IGraphicsHeadless
+ */
+
+#include "IGraphics_select.h"
+
+/** IGraphics platform class without a window, for benchmarks and golden image tests on machines without a display, selected by defining IGRAPHICS_HEADLESS.
+ * LICE and AGG draw into their own bitmaps as usual, and NanoVG with IGRAPHICS_GL2 or IGRAPHICS_GL3 into a framebuffer of an offscreen context, made with EGL on Linux and CGL on macOS.
+ * There is no timer or event loop: OnTimer() draws whatever is dirty, as a platform's redraw timer would, and the mouse and keyboard are driven through Click(), Drag()
+ * and the IGraphics event methods, such as OnMouseOver() and OnKeyDown(). CapturePixels() and SavePNG() read back the whole UI, which needs a backend that
+ * implements ReadLayerPixels(), NanoVG or LICE. Dialogs, menus and text entries return at once, as a cancelled one would
+ * @ingroup PlatformClasses */
+class IGraphicsHeadless final : public IGRAPHICS_DRAW_CLASS
+{
+public:
+  /** A font read from a file, or from the resources of the binary or the resource archive, whose data is copied when it is needed */
+  class HeadlessFont : public PlatformFont
+  {
+  public:
+    HeadlessFont(const char* path) : mPath(path) {}
+    HeadlessFont(const void* pData, int size) : mData(pData), mSize(size) {}
+
+    IFontDataPtr GetFontData() override;
+
+  private:
+    WDL_String mPath;
+    const void* mData = nullptr;
+    int mSize = 0;
+  };
+
+  IGraphicsHeadless(IGEditorDelegate& dlg, int w, int h, int fps, float scale);
+  ~IGraphicsHeadless();
+
+  /** Create the offscreen context, if the backend needs one, and lay out the UI
+   * @param pParent Ignored, there is no window to attach to
+   * @return A non-null handle if the UI is open, or nullptr if the context couldn't be made */
+  void* OpenWindow(void* pParent) override;
+  void CloseWindow() override;
+  void* GetWindow() override { return mOpen ? this : nullptr; }
+  bool WindowIsOpen() override { return mOpen; }
+
+  void DrawResize() override; // overriden here to make the GL context current and resize its framebuffer
+  void EndFrame() override;
+
+  void HideMouseCursor(bool hide, bool lock) override {}
+  void MoveMouseCursor(float x, float y) override {}
+
+  int ShowMessageBox(const char* str, const char* caption, EMessageBoxType type) override;
+  void ForceEndUserEdit() override {}
+
+  const char* GetPlatformAPIStr() override { return "headless"; }
+
+  void UpdateTooltips() override {}
+
+  void PromptForFile(WDL_String& fileName, WDL_String& path, EFileAction action, const char* ext) override { fileName.Set(""); }
+  void PromptForDirectory(WDL_String& dir) override { dir.Set(""); }
+  bool PromptForColor(IColor& color, const char* str) override { return false; }
+
+  bool OpenURL(const char* url, const char* msgWindowTitle, const char* confirmMsg, const char* errMsgOnFailure) override { return false; }
+
+  bool GetTextFromClipboard(WDL_String& str) override { str.Set(mClipboard.Get()); return str.GetLength(); }
+  bool SetTextInClipboard(const char* str) { mClipboard.Set(str); return true; }
+
+  void SetBundleID(const char* bundleID) { mBundleID.Set(bundleID); }
+  const char* GetBundleID() override { return mBundleID.Get(); }
+
+  void SetWinModuleHandle(void* pInstance) override { mHInstance = pInstance; }
+  void* GetWinModuleHandle() override { return mHInstance; }
+
+  /** Draw whatever is dirty, as each tick of a platform's redraw timer does. On a GPU backend this waits until the frame has been drawn, so that it can be timed
+   * @return \c true if anything was drawn */
+  bool OnTimer();
+
+  /** Click with the left button, a mouse down and up at the same point
+   * @param x The x position in the UI
+   * @param y The y position in the UI
+   * @param mod The buttons and modifier keys, the left button by default */
+  void Click(float x, float y, const IMouseMod& mod = IMouseMod(true));
+
+  /** Press the button at one point, drag to another in even steps and release it there
+   * @param x1 The x position to press at
+   * @param y1 The y position to press at
+   * @param x2 The x position to release at
+   * @param y2 The y position to release at
+   * @param nSteps The number of drag events between them
+   * @param mod The buttons and modifier keys, the left button by default */
+  void Drag(float x1, float y1, float x2, float y2, int nSteps = 10, const IMouseMod& mod = IMouseMod(true));
+
+  /** Draw the whole UI and read back its pixels
+   * @param data Set to the pixels, 8 bit RGBA with straight alpha, a row after another from the top
+   * @param width Set to the width of the pixels, the width of the UI at GetBackingPixelScale()
+   * @param height Set to the height of the pixels
+   * @return \c true if the pixels were read, which needs NanoVG or LICE */
+  bool CapturePixels(RawBitmapData& data, int& width, int& height);
+
+  /** Draw the whole UI and write it to a PNG file, with CapturePixels()
+   * @param path The path of the file to write
+   * @return \c true if the file was written */
+  bool SavePNG(const char* path);
+
+protected:
+  IPopupMenu* CreatePlatformPopupMenu(IPopupMenu& menu, const IRECT& bounds, IControl* pCaller) override { return nullptr; }
+  void CreatePlatformTextEntry(IControl& control, const IText& text, const IRECT& bounds, const char* str) override {}
+
+private:
+  PlatformFontPtr LoadPlatformFont(const char* fontID, const char* fileNameOrResID) override;
+  PlatformFontPtr LoadPlatformFont(const char* fontID, const char* fontName, ETextStyle style) override { return nullptr; }
+  void CachePlatformFont(const char* fontID, const PlatformFontPtr& font) override {}
+
+#ifdef IGRAPHICS_GL
+  bool CreateGLContext();
+  void DestroyGLContext();
+  void ActivateGLContext();
+  void ResizeGLFramebuffer();
+
+  void* mGLDisplay = nullptr; // EGLDisplay
+  void* mGLSurface = nullptr; // EGLSurface
+  void* mGLContext = nullptr; // EGLContext or CGLContextObj
+  unsigned int mFBO = 0;
+  unsigned int mColorRBO = 0;
+  unsigned int mDepthStencilRBO = 0;
+#endif
+
+  WDL_String mBundleID;
+  WDL_String mClipboard;
+  void* mHInstance = nullptr;
+  bool mOpen = false;
+};
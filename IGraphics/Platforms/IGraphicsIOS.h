@@ -53,6 +53,7 @@ public:
 protected:
   IPopupMenu* CreatePlatformPopupMenu(IPopupMenu& menu, const IRECT& bounds, IControl* pCaller) override;
   void CreatePlatformTextEntry(IControl& control, const IText& text, const IRECT& bounds, const char* str) override;
+  void SetPlatformTimerInterval(uint32_t intervalMs) override;
 
 private:
   void* mView = nullptr;
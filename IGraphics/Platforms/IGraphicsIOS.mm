@@ -45,7 +45,7 @@ void* IGraphicsIOS::OpenWindow(void* pParent)
   
   SetScreenScale([UIScreen mainScreen].scale);
   
-  GetDelegate()->LayoutUI(this);
+  LayoutUIOnOpen();
 
   if (pParent)
   {
@@ -73,6 +73,12 @@ void IGraphicsIOS::CloseWindow()
   }
 }
 
+void IGraphicsIOS::SetPlatformTimerInterval(uint32_t intervalMs)
+{
+  if (mView)
+    [(IGraphicsIOS_View*) mView setTimerInterval: intervalMs];
+}
+
 bool IGraphicsIOS::WindowIsOpen()
 {
   return mView;
@@ -21,6 +21,7 @@ inline CGRect ToCGRect(IGraphics* pGraphics, const IRECT& bounds)
 {  
 @public
   IGraphicsIOS* mGraphics; // OBJC instance variables have to be pointers
+  uint32_t mTimerInterval; // the interval of the backed off redraw timer, see IGraphics::SetAdaptiveFrameRate()
 }
 - (id) initWithIGraphics: (IGraphicsIOS*) pGraphics;
 - (BOOL) isOpaque;
@@ -31,6 +32,9 @@ inline CGRect ToCGRect(IGraphics* pGraphics, const IRECT& bounds)
 - (void) createTextEntry: (IControl&) control : (const IText&) text : (const char*) str : (CGRect) areaRect;
 - (void) endUserInput;
 - (void) getTouchXY: (CGPoint) pt x: (float*) pX y: (float*) pY;
+- (void) setTimerInterval: (uint32_t) intervalMs;
+- (void) updateFrameRate;
+- (void) powerStateChanged: (NSNotification*) pNotification;
 @property (readonly) CAMetalLayer* metalLayer;
 @property (nonatomic, strong) CADisplayLink *displayLink;
 
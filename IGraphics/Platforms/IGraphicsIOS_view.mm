@@ -27,6 +27,7 @@
 
   self.layer.opaque = YES;
   self.layer.contentsScale = [UIScreen mainScreen].scale;
+  mTimerInterval = 0;
   
 //  self.multipleTouchEnabled = YES;
   
@@ -115,6 +116,7 @@
 - (void)dealloc
 {
   [_displayLink invalidate];
+  [[NSNotificationCenter defaultCenter] removeObserver:self];
   
   [super dealloc];
 }
@@ -126,23 +128,88 @@
   {
     self.displayLink = [CADisplayLink displayLinkWithTarget:self selector:@selector(redraw:)];
     [self.displayLink addToRunLoop:[NSRunLoop mainRunLoop] forMode:NSRunLoopCommonModes];
+    
+    NSNotificationCenter* center = [NSNotificationCenter defaultCenter];
+    [center addObserver:self selector:@selector(powerStateChanged:) name:NSProcessInfoPowerStateDidChangeNotification object:nil];
+    [center addObserver:self selector:@selector(powerStateChanged:) name:NSProcessInfoThermalStateDidChangeNotification object:nil];
+    [self powerStateChanged: nil];
   }
   else
   {
     [self.displayLink invalidate];
     self.displayLink = nil;
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
   }
 }
 
 - (void)redraw:(CADisplayLink*) displayLink
 {
+  if (!mGraphics->OnDisplayRefresh(displayLink.timestamp))
+    return;
+  
   IRECTList rects;
+  const bool dirty = mGraphics->IsDirty(rects);
   
-  if (mGraphics->IsDirty(rects))
+  if (dirty)
   {
     mGraphics->SetAllControlsClean();
     mGraphics->Draw(rects);
   }
+  
+  mGraphics->AdaptTimerInterval(dirty);
+}
+
+- (void) setTimerInterval: (uint32_t) intervalMs
+{
+  mTimerInterval = intervalMs;
+  [self updateFrameRate];
+}
+
+// the display link runs at the display's rate, up to 120 Hz with ProMotion, while anything moves, and drops to the backed off timer's rate while the UI is idle,
+// it is capped at 60 Hz in Low Power Mode and lower as the device heats up
+- (void) updateFrameRate
+{
+  if (!self.displayLink)
+    return;
+  
+  NSProcessInfo* processInfo = [NSProcessInfo processInfo];
+  const NSProcessInfoThermalState thermalState = processInfo.thermalState;
+  float maxRate = (float) [UIScreen mainScreen].maximumFramesPerSecond;
+  
+  if (processInfo.lowPowerModeEnabled || thermalState == NSProcessInfoThermalStateFair)
+    maxRate = std::min(maxRate, 60.f);
+  
+  if (thermalState == NSProcessInfoThermalStateSerious)
+    maxRate = std::min(maxRate, 30.f);
+  else if (thermalState == NSProcessInfoThermalStateCritical)
+    maxRate = std::min(maxRate, 15.f);
+  
+  if (mGraphics->GetMaxFPS() > 0)
+    maxRate = std::min(maxRate, (float) mGraphics->GetMaxFPS());
+  
+  float minRate = maxRate / 2.f;
+  float rate = maxRate;
+  
+  if (!mGraphics->VSyncActive() && mTimerInterval > 0)
+    minRate = rate = std::min(maxRate, std::max(1.f, 1000.f / mTimerInterval));
+  
+  if (@available(iOS 15.0, *))
+    self.displayLink.preferredFrameRateRange = CAFrameRateRangeMake(minRate, maxRate, rate);
+  else
+    self.displayLink.preferredFramesPerSecond = (NSInteger) rate;
+}
+
+- (void) powerStateChanged: (NSNotification*) pNotification
+{
+  // the notifications may arrive on any thread
+  dispatch_async(dispatch_get_main_queue(), ^{
+    if (!mGraphics || !self.displayLink)
+      return;
+    
+    NSProcessInfo* processInfo = [NSProcessInfo processInfo];
+    mGraphics->SetReduceEffects(processInfo.lowPowerModeEnabled || processInfo.thermalState >= NSProcessInfoThermalStateSerious);
+    [self updateFrameRate];
+  });
 }
 
 - (BOOL) isOpaque
@@ -164,6 +231,7 @@
 {
   [self.displayLink invalidate];
   self.displayLink = nil;
+  [[NSNotificationCenter defaultCenter] removeObserver:self];
 }
 
 - (void) controlTextDidEndEditing: (NSNotification*) aNotification
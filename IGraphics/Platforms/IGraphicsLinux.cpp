@@ -8,4 +8,1022 @@
  ==============================================================================
 */
 
-//todo
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <fontconfig/fontconfig.h>
+
+#include "IGraphicsLinux.h"
+#include "IPlugPaths.h"
+#include "IPlugResourceArchive.h"
+
+// included after IGraphics, so that GL has its prototypes, and with X's Time renamed as IGraphics has its own
+#define Time XTime
+#include <X11/Xlib.h>
+#include <X11/Xlib-xcb.h>
+#include <X11/XKBlib.h>
+#include <X11/cursorfont.h>
+#include <X11/keysym.h>
+#include <GL/glx.h>
+#include <GL/glxext.h>
+#undef Time
+
+#ifndef IGRAPHICS_GL
+  #error IGraphicsLinux presents with GLX, use IGRAPHICS_NANOVG with IGRAPHICS_GL2 or IGRAPHICS_GL3
+#endif
+
+// X only reports clicks, so two on the same button within this time are a double click
+static const xcb_timestamp_t kDoubleClickMs = 400;
+
+#pragma mark - Helpers
+
+/** Run a program, such as a dialog, without a shell and wait for it to exit
+ * @param args The program and its arguments
+ * @param pOutput If not nullptr, what the program writes to its standard output, without the final newline
+ * @return The program's exit status, or -1 if it couldn't be run */
+static int RunProgram(std::initializer_list<const char*> args, WDL_String* pOutput = nullptr)
+{
+  std::vector<char*> argv;
+
+  for (const char* arg : args)
+    argv.push_back(const_cast<char*>(arg));
+
+  argv.push_back(nullptr);
+
+  int fds[2];
+
+  if (pipe(fds) != 0)
+    return -1;
+
+  const pid_t pid = fork();
+
+  if (pid == 0)
+  {
+    dup2(fds[1], STDOUT_FILENO);
+    close(fds[0]);
+    close(fds[1]);
+    execvp(argv[0], argv.data());
+    _exit(127);
+  }
+
+  close(fds[1]);
+
+  if (pid < 0)
+  {
+    close(fds[0]);
+    return -1;
+  }
+
+  if (pOutput)
+    pOutput->Set("");
+
+  char buffer[256];
+  ssize_t n;
+
+  while ((n = read(fds[0], buffer, sizeof(buffer))) > 0)
+  {
+    if (pOutput)
+      pOutput->Append(buffer, static_cast<int>(n));
+  }
+
+  close(fds[0]);
+
+  int status = 0;
+  waitpid(pid, &status, 0);
+
+  if (pOutput && pOutput->GetLength() && pOutput->Get()[pOutput->GetLength() - 1] == '\n')
+    pOutput->SetLen(pOutput->GetLength() - 1);
+
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static xcb_atom_t GetAtom(xcb_connection_t* pConnection, const char* name)
+{
+  xcb_intern_atom_reply_t* pReply = xcb_intern_atom_reply(pConnection, xcb_intern_atom(pConnection, 0, static_cast<uint16_t>(strlen(name)), name), nullptr);
+  const xcb_atom_t atom = pReply ? pReply->atom : XCB_ATOM_NONE;
+  free(pReply);
+  return atom;
+}
+
+#pragma mark - Fonts
+
+IFontDataPtr IGraphicsLinux::LinuxFileFont::GetFontData()
+{
+  IFontDataPtr fontData(new IFontData());
+  FILE* fp = fopen(mPath.Get(), "rb");
+
+  if (!fp)
+    return fontData;
+
+  fseek(fp, 0, SEEK_END);
+  fontData.reset(new IFontData((int) ftell(fp)));
+
+  if (!fontData->GetSize())
+  {
+    fclose(fp);
+    return fontData;
+  }
+
+  fseek(fp, 0, SEEK_SET);
+  size_t readSize = fread(fontData->Get(), 1, fontData->GetSize(), fp);
+  fclose(fp);
+
+  if (readSize && readSize == fontData->GetSize())
+    fontData->SetFaceIdx(mFaceIdx);
+
+  return fontData;
+}
+
+IGraphics::PlatformFontPtr IGraphicsLinux::LoadPlatformFont(const char* fontID, const char* fileNameOrResID)
+{
+  WDL_String fullPath;
+  const EResourceLocation fontLocation = LocateResource(fileNameOrResID, "ttf", fullPath, GetBundleID(), nullptr);
+
+  if (fontLocation == kNotFound)
+    return nullptr;
+
+  if (fontLocation == kPackedArchive)
+  {
+    int size = 0;
+    const void* pData = IPlugResourceArchive::Get().Find(fullPath.Get(), size);
+    return pData ? PlatformFontPtr(new LinuxArchiveFont(pData, size)) : nullptr;
+  }
+
+  return PlatformFontPtr(new LinuxFileFont(fullPath.Get()));
+}
+
+IGraphics::PlatformFontPtr IGraphicsLinux::LoadPlatformFont(const char* fontID, const char* fontName, ETextStyle style)
+{
+  if (!FcInit())
+    return nullptr;
+
+  FcPattern* pPattern = FcNameParse(reinterpret_cast<const FcChar8*>(fontName));
+
+  if (!pPattern)
+    return nullptr;
+
+  FcPatternAddInteger(pPattern, FC_WEIGHT, style == kTextStyleBold ? FC_WEIGHT_BOLD : FC_WEIGHT_REGULAR);
+  FcPatternAddInteger(pPattern, FC_SLANT, style == kTextStyleItalic ? FC_SLANT_ITALIC : FC_SLANT_ROMAN);
+  FcConfigSubstitute(nullptr, pPattern, FcMatchPattern);
+  FcDefaultSubstitute(pPattern);
+
+  FcResult result;
+  FcPattern* pMatch = FcFontMatch(nullptr, pPattern, &result);
+  PlatformFontPtr font;
+
+  if (pMatch)
+  {
+    FcChar8* pFile = nullptr;
+    int faceIdx = 0;
+
+    if (FcPatternGetString(pMatch, FC_FILE, 0, &pFile) == FcResultMatch)
+    {
+      FcPatternGetInteger(pMatch, FC_INDEX, 0, &faceIdx);
+      font.reset(new LinuxFileFont(reinterpret_cast<const char*>(pFile), faceIdx));
+    }
+
+    FcPatternDestroy(pMatch);
+  }
+
+  FcPatternDestroy(pPattern);
+
+  return font;
+}
+
+#pragma mark - Window
+
+IGraphicsLinux::IGraphicsLinux(IGEditorDelegate& dlg, int w, int h, int fps, float scale)
+  : IGRAPHICS_DRAW_CLASS(dlg, w, h, fps, scale)
+{
+}
+
+IGraphicsLinux::~IGraphicsLinux()
+{
+  CloseWindow();
+}
+
+void* IGraphicsLinux::OpenWindow(void* pParent)
+{
+  if (mWindow)
+    CloseWindow();
+
+  mParentWindow = static_cast<xcb_window_t>(reinterpret_cast<uintptr_t>(pParent));
+  WakeTimer(); // the timer starts at FPS()
+
+  // Xlib is only used for GLX, the events are read with XCB
+  mDisplay = XOpenDisplay(nullptr);
+
+  if (!mDisplay)
+    return nullptr;
+
+  mConnection = XGetXCBConnection(mDisplay);
+  XSetEventQueueOwner(mDisplay, XCBOwnsEventQueue);
+
+  xcb_screen_iterator_t screens = xcb_setup_roots_iterator(xcb_get_setup(mConnection));
+
+  for (int i = DefaultScreen(mDisplay); screens.rem && i > 0; i--)
+    xcb_screen_next(&screens);
+
+  mScreen = screens.data;
+
+  if (!mParentWindow)
+    mParentWindow = mScreen->root;
+
+  if (!CreateGLContext())
+  {
+    CloseWindow();
+    return nullptr;
+  }
+
+  mClipboardAtom = GetAtom(mConnection, "CLIPBOARD");
+  mUTF8Atom = GetAtom(mConnection, "UTF8_STRING");
+  mPropertyAtom = GetAtom(mConnection, "IPLUG_SELECTION");
+
+  xcb_map_window(mConnection, mWindow);
+  xcb_flush(mConnection);
+
+  // events and redraws are driven by the host's run loop, on its UI thread
+  if (IPlugRunLoop* pRunLoop = GetDelegate()->GetHostRunLoop())
+    pRunLoop->AddFD(GetEventFD(), [this]() { OnEventFD(); });
+
+  SetPlatformTimerInterval(static_cast<uint32_t>(std::round(1000.0 / FPS())));
+
+  // the fallbacks for the platform's text entries and menus, which X doesn't have
+  AttachTextEntryControl();
+  AttachPopupMenuControl();
+
+  OnViewInitialized(nullptr);
+
+  SetScreenScale(1);
+
+  LayoutUIOnOpen();
+
+  SetAllControlsDirty();
+
+  return GetWindow();
+}
+
+void IGraphicsLinux::CloseWindow()
+{
+  if (mConnection)
+  {
+    if (IPlugRunLoop* pRunLoop = GetDelegate()->GetHostRunLoop())
+    {
+      pRunLoop->StopTimer();
+      pRunLoop->RemoveFD(GetEventFD());
+    }
+
+    if (mGLContext)
+    {
+      ActivateGLContext();
+      OnViewDestroyed();
+    }
+
+    DestroyGLContext();
+
+    if (mCursor)
+      xcb_free_cursor(mConnection, mCursor);
+
+    if (mHiddenCursor)
+      xcb_free_cursor(mConnection, mHiddenCursor);
+
+    if (mWindow)
+      xcb_destroy_window(mConnection, mWindow);
+
+    xcb_flush(mConnection);
+  }
+
+  // closing the display closes its XCB connection
+  if (mDisplay)
+    XCloseDisplay(mDisplay);
+
+  mDisplay = nullptr;
+  mConnection = nullptr;
+  mScreen = nullptr;
+  mWindow = 0;
+  mCursor = 0;
+  mHiddenCursor = 0;
+  mExposed.Clear();
+}
+
+void IGraphicsLinux::PlatformResize()
+{
+  if (WindowIsOpen())
+  {
+    const uint32_t size[] = { static_cast<uint32_t>(WindowWidth()), static_cast<uint32_t>(WindowHeight()) };
+    xcb_configure_window(mConnection, mWindow, XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT, size);
+    xcb_flush(mConnection);
+  }
+}
+
+void IGraphicsLinux::DrawResize()
+{
+  ActivateGLContext();
+  IGRAPHICS_DRAW_CLASS::DrawResize();
+}
+
+#pragma mark - GL
+
+bool IGraphicsLinux::CreateGLContext()
+{
+  const int screen = DefaultScreen(mDisplay);
+  const int attributes[] = {
+    GLX_X_RENDERABLE, True,
+    GLX_DRAWABLE_TYPE, GLX_WINDOW_BIT,
+    GLX_RENDER_TYPE, GLX_RGBA_BIT,
+    GLX_X_VISUAL_TYPE, GLX_TRUE_COLOR,
+    GLX_RED_SIZE, 8,
+    GLX_GREEN_SIZE, 8,
+    GLX_BLUE_SIZE, 8,
+    GLX_ALPHA_SIZE, 8,
+    GLX_STENCIL_SIZE, 8,
+    GLX_DOUBLEBUFFER, True,
+    None
+  };
+
+  int nConfigs = 0;
+  GLXFBConfig* pConfigs = glXChooseFBConfig(mDisplay, screen, attributes, &nConfigs);
+
+  if (!pConfigs || !nConfigs)
+  {
+    DBGMSG("No GLX framebuffer configuration.\n");
+    return false;
+  }
+
+  mFBConfig = pConfigs[0];
+  XFree(pConfigs);
+
+  XVisualInfo* pVisual = glXGetVisualFromFBConfig(mDisplay, mFBConfig);
+
+  if (!pVisual)
+    return false;
+
+  // the window has the visual of the framebuffer configuration, which may not be the parent's, so needs its own colormap and border
+  const xcb_colormap_t colormap = xcb_generate_id(mConnection);
+  xcb_create_colormap(mConnection, XCB_COLORMAP_ALLOC_NONE, colormap, mScreen->root, static_cast<xcb_visualid_t>(pVisual->visualid));
+
+  const uint32_t eventMask = XCB_EVENT_MASK_EXPOSURE | XCB_EVENT_MASK_BUTTON_PRESS | XCB_EVENT_MASK_BUTTON_RELEASE | XCB_EVENT_MASK_POINTER_MOTION
+                           | XCB_EVENT_MASK_ENTER_WINDOW | XCB_EVENT_MASK_LEAVE_WINDOW | XCB_EVENT_MASK_KEY_PRESS | XCB_EVENT_MASK_KEY_RELEASE
+                           | XCB_EVENT_MASK_STRUCTURE_NOTIFY | XCB_EVENT_MASK_PROPERTY_CHANGE;
+  const uint32_t values[] = { 0, eventMask, colormap };
+
+  mWindow = xcb_generate_id(mConnection);
+  xcb_create_window(mConnection, static_cast<uint8_t>(pVisual->depth), mWindow, mParentWindow, 0, 0, WindowWidth(), WindowHeight(), 0,
+                    XCB_WINDOW_CLASS_INPUT_OUTPUT, static_cast<xcb_visualid_t>(pVisual->visualid),
+                    XCB_CW_BORDER_PIXEL | XCB_CW_EVENT_MASK | XCB_CW_COLORMAP, values);
+  xcb_free_colormap(mConnection, colormap);
+  XFree(pVisual);
+
+#if defined IGRAPHICS_GL3
+  // a core profile needs a context created with attributes
+  auto createContextAttribs = reinterpret_cast<PFNGLXCREATECONTEXTATTRIBSARBPROC>(glXGetProcAddressARB(reinterpret_cast<const GLubyte*>("glXCreateContextAttribsARB")));
+
+  if (createContextAttribs)
+  {
+    const int contextAttributes[] = {
+      GLX_CONTEXT_MAJOR_VERSION_ARB, 3,
+      GLX_CONTEXT_MINOR_VERSION_ARB, 2,
+      GLX_CONTEXT_PROFILE_MASK_ARB, GLX_CONTEXT_CORE_PROFILE_BIT_ARB,
+      None
+    };
+
+    mGLContext = createContextAttribs(mDisplay, mFBConfig, nullptr, True, contextAttributes);
+  }
+#else
+  mGLContext = glXCreateNewContext(mDisplay, mFBConfig, GLX_RGBA_TYPE, nullptr, True);
+#endif
+
+  if (!mGLContext)
+  {
+    DBGMSG("Could not create a GLX context.\n");
+    return false;
+  }
+
+  mGLXWindow = glXCreateWindow(mDisplay, mFBConfig, mWindow, nullptr);
+  mSwapInterval = -1;
+
+  // the contents of the back buffer are undefined after a swap
+  mBackBufferRetained = false;
+
+  ActivateGLContext();
+
+  return true;
+}
+
+void IGraphicsLinux::DestroyGLContext()
+{
+  if (!mDisplay)
+    return;
+
+  glXMakeContextCurrent(mDisplay, None, None, nullptr);
+
+  if (mGLXWindow)
+    glXDestroyWindow(mDisplay, mGLXWindow);
+
+  if (mGLContext)
+    glXDestroyContext(mDisplay, mGLContext);
+
+  mGLXWindow = 0;
+  mGLContext = nullptr;
+}
+
+void IGraphicsLinux::ActivateGLContext()
+{
+  // the host may have made its own context current since the last call
+  if (mGLContext && glXGetCurrentContext() != mGLContext)
+    glXMakeContextCurrent(mDisplay, mGLXWindow, mGLXWindow, mGLContext);
+}
+
+void IGraphicsLinux::SetSwapInterval(int interval)
+{
+  if (interval == mSwapInterval || !mGLContext)
+    return;
+
+  static auto swapIntervalEXT = reinterpret_cast<PFNGLXSWAPINTERVALEXTPROC>(glXGetProcAddressARB(reinterpret_cast<const GLubyte*>("glXSwapIntervalEXT")));
+  static auto swapIntervalMESA = reinterpret_cast<PFNGLXSWAPINTERVALMESAPROC>(glXGetProcAddressARB(reinterpret_cast<const GLubyte*>("glXSwapIntervalMESA")));
+
+  ActivateGLContext();
+
+  if (swapIntervalEXT)
+    swapIntervalEXT(mDisplay, mGLXWindow, interval);
+  else if (swapIntervalMESA)
+    swapIntervalMESA(static_cast<unsigned int>(interval));
+
+  mSwapInterval = interval;
+}
+
+#pragma mark - Drawing
+
+void IGraphicsLinux::SetPlatformTimerInterval(uint32_t intervalMs)
+{
+  if (!mWindow)
+    return;
+
+  // while VSyncActive() a swap waits for the display's refresh, so the timer only has to come round as often
+  SetSwapInterval(VSyncActive() ? 1 : 0);
+
+  if (intervalMs == mTimerIntervalMs)
+    return;
+
+  mTimerIntervalMs = intervalMs;
+
+  if (IPlugRunLoop* pRunLoop = GetDelegate()->GetHostRunLoop())
+    pRunLoop->StartTimer(intervalMs, [this]() { OnTimer(); }); // replaces the interval of the existing timer
+}
+
+void IGraphicsLinux::OnTimer()
+{
+  if (!mWindow)
+    return;
+
+  if (VSyncActive() && !OnDisplayRefresh(GetTimestamp()))
+    return;
+
+  IRECTList rects;
+  const bool dirty = IsDirty(rects);
+
+  if (dirty)
+  {
+    SetAllControlsClean();
+    Paint(rects);
+  }
+
+  AdaptTimerInterval(dirty);
+}
+
+void IGraphicsLinux::Paint(IRECTList& rects)
+{
+  if (!rects.Size())
+    return;
+
+  ActivateGLContext();
+  Draw(rects);
+  glXSwapBuffers(mDisplay, mGLXWindow);
+}
+
+#pragma mark - Events
+
+int IGraphicsLinux::GetEventFD() const
+{
+  return mConnection ? xcb_get_file_descriptor(mConnection) : -1;
+}
+
+void IGraphicsLinux::OnEventFD()
+{
+  if (!mConnection)
+    return;
+
+  while (xcb_generic_event_t* pEvent = xcb_poll_for_event(mConnection))
+  {
+    HandleEvent(pEvent);
+    free(pEvent);
+
+    // an event may have closed the window
+    if (!mConnection)
+      return;
+  }
+}
+
+IMouseMod IGraphicsLinux::GetMouseMod(uint16_t state, bool left, bool right) const
+{
+  return IMouseMod(left, right, state & XCB_MOD_MASK_SHIFT, state & XCB_MOD_MASK_CONTROL, state & XCB_MOD_MASK_1);
+}
+
+IKeyPress IGraphicsLinux::GetKeyPress(uint8_t keycode, uint16_t state) const
+{
+  const KeySym keysym = XkbKeycodeToKeysym(mDisplay, keycode, 0, (state & XCB_MOD_MASK_SHIFT) ? 1 : 0);
+  int vk = kVK_NONE;
+
+  if (keysym >= XK_a && keysym <= XK_z)
+    vk = static_cast<int>(keysym - XK_a) + 'A';
+  else if (keysym >= XK_A && keysym <= XK_Z)
+    vk = static_cast<int>(keysym - XK_A) + 'A';
+  else if (keysym >= XK_0 && keysym <= XK_9)
+    vk = static_cast<int>(keysym - XK_0) + '0';
+  else if (keysym >= XK_F1 && keysym <= XK_F12)
+    vk = static_cast<int>(keysym - XK_F1) + kVK_F1;
+  else if (keysym >= XK_KP_0 && keysym <= XK_KP_9)
+    vk = static_cast<int>(keysym - XK_KP_0) + kVK_NUMPAD0;
+  else
+  {
+    switch (keysym)
+    {
+      case XK_BackSpace:    vk = kVK_BACK;      break;
+      case XK_Tab:          vk = kVK_TAB;       break;
+      case XK_Return:
+      case XK_KP_Enter:     vk = kVK_RETURN;    break;
+      case XK_Escape:       vk = kVK_ESCAPE;    break;
+      case XK_space:        vk = kVK_SPACE;     break;
+      case XK_Page_Up:      vk = kVK_PRIOR;     break;
+      case XK_Page_Down:    vk = kVK_NEXT;      break;
+      case XK_End:          vk = kVK_END;       break;
+      case XK_Home:         vk = kVK_HOME;      break;
+      case XK_Left:         vk = kVK_LEFT;      break;
+      case XK_Up:           vk = kVK_UP;        break;
+      case XK_Right:        vk = kVK_RIGHT;     break;
+      case XK_Down:         vk = kVK_DOWN;      break;
+      case XK_Insert:       vk = kVK_INSERT;    break;
+      case XK_Delete:       vk = kVK_DELETE;    break;
+      case XK_KP_Multiply:  vk = kVK_MULTIPLY;  break;
+      case XK_KP_Add:       vk = kVK_ADD;       break;
+      case XK_KP_Subtract:  vk = kVK_SUBTRACT;  break;
+      case XK_KP_Decimal:   vk = kVK_DECIMAL;   break;
+      case XK_KP_Divide:    vk = kVK_DIVIDE;    break;
+      case XK_Shift_L:
+      case XK_Shift_R:      vk = kVK_SHIFT;     break;
+      case XK_Control_L:
+      case XK_Control_R:    vk = kVK_CONTROL;   break;
+      case XK_Alt_L:
+      case XK_Alt_R:        vk = kVK_MENU;      break;
+      default: break;
+    }
+  }
+
+  // the keysyms of the printable Latin-1 characters are the characters
+  const char ascii = (keysym >= 0x20 && keysym <= 0x7e) ? static_cast<char>(keysym) : 0;
+
+  return IKeyPress(ascii, vk, state & XCB_MOD_MASK_SHIFT, state & XCB_MOD_MASK_CONTROL, state & XCB_MOD_MASK_1);
+}
+
+void IGraphicsLinux::HandleEvent(xcb_generic_event_t* pEvent)
+{
+  const float scale = GetDrawScale();
+
+  switch (pEvent->response_type & ~0x80)
+  {
+    case XCB_EXPOSE:
+    {
+      auto* pExpose = reinterpret_cast<xcb_expose_event_t*>(pEvent);
+      IRECT r(pExpose->x, pExpose->y, pExpose->x + pExpose->width, pExpose->y + pExpose->height);
+      r.Scale(1.f / scale);
+      r.PixelAlign();
+      mExposed.Add(r);
+
+      // the last of a run of expose events has a count of 0, so their regions are drawn together
+      if (!pExpose->count)
+      {
+        Paint(mExposed);
+        mExposed.Clear();
+      }
+      break;
+    }
+
+    case XCB_BUTTON_PRESS:
+    {
+      auto* pButton = reinterpret_cast<xcb_button_press_event_t*>(pEvent);
+      const float x = pButton->event_x / scale;
+      const float y = pButton->event_y / scale;
+
+      // buttons 4 to 7 are the wheel's steps
+      if (pButton->detail >= 4 && pButton->detail <= 7)
+      {
+        if (pButton->detail <= 5)
+          OnMouseWheel(x, y, GetMouseMod(pButton->state, false, false), pButton->detail == 4 ? 1.f : -1.f);
+        break;
+      }
+
+      const IMouseMod mod = GetMouseMod(pButton->state, pButton->detail == 1, pButton->detail == 3);
+      const bool dblClick = pButton->detail == mLastButton && pButton->time - mLastClickTime < kDoubleClickMs;
+
+      xcb_set_input_focus(mConnection, XCB_INPUT_FOCUS_PARENT, mWindow, XCB_CURRENT_TIME); // to get keyboard focus when the user clicks in the window
+      mCursorX = x;
+      mCursorY = y;
+
+      if (!dblClick || !OnMouseDblClick(x, y, mod))
+        OnMouseDown(x, y, mod);
+
+      // a double click doesn't start another
+      mLastButton = dblClick ? 0 : pButton->detail;
+      mLastClickTime = pButton->time;
+      break;
+    }
+
+    case XCB_BUTTON_RELEASE:
+    {
+      auto* pButton = reinterpret_cast<xcb_button_release_event_t*>(pEvent);
+
+      if (pButton->detail >= 4 && pButton->detail <= 7)
+        break;
+
+      OnMouseUp(pButton->event_x / scale, pButton->event_y / scale, GetMouseMod(pButton->state, pButton->detail == 1, pButton->detail == 3));
+      break;
+    }
+
+    case XCB_MOTION_NOTIFY:
+    {
+      auto* pMotion = reinterpret_cast<xcb_motion_notify_event_t*>(pEvent);
+      const float x = pMotion->event_x / scale;
+      const float y = pMotion->event_y / scale;
+      const IMouseMod mod = GetMouseMod(pMotion->state, pMotion->state & XCB_BUTTON_MASK_1, pMotion->state & XCB_BUTTON_MASK_3);
+
+      if (pMotion->state & (XCB_BUTTON_MASK_1 | XCB_BUTTON_MASK_2 | XCB_BUTTON_MASK_3))
+      {
+        const float dX = x - mCursorX;
+        const float dY = y - mCursorY;
+
+        if (dX || dY)
+        {
+          mCursorX = x;
+          mCursorY = y;
+          QueueMouseDrag(x, y, dX, dY, mod);
+
+          if (mCursorHidden && mCursorLock)
+            MoveMouseCursor(mHiddenCursorX, mHiddenCursorY);
+        }
+      }
+      else
+      {
+        mCursorX = x;
+        mCursorY = y;
+        QueueMouseOver(x, y, mod);
+      }
+      break;
+    }
+
+    case XCB_LEAVE_NOTIFY:
+      OnMouseOut();
+      break;
+
+    case XCB_KEY_PRESS:
+    {
+      auto* pKey = reinterpret_cast<xcb_key_press_event_t*>(pEvent);
+      OnKeyDown(mCursorX, mCursorY, GetKeyPress(pKey->detail, pKey->state));
+      break;
+    }
+
+    case XCB_CONFIGURE_NOTIFY:
+    {
+      // the host has resized the window, which is then drawn on the next expose
+      break;
+    }
+
+    default:
+      break;
+  }
+}
+
+#pragma mark - Mouse cursor
+
+void IGraphicsLinux::HideMouseCursor(bool hide, bool lock)
+{
+  if (mCursorHidden == hide || !mWindow)
+    return;
+
+  if (hide)
+  {
+    if (!mHiddenCursor)
+    {
+      // an empty 1 x 1 pixmap
+      xcb_pixmap_t pixmap = xcb_generate_id(mConnection);
+      xcb_create_pixmap(mConnection, 1, pixmap, mWindow, 1, 1);
+      mHiddenCursor = xcb_generate_id(mConnection);
+      xcb_create_cursor(mConnection, mHiddenCursor, pixmap, pixmap, 0, 0, 0, 0, 0, 0, 0, 0);
+      xcb_free_pixmap(mConnection, pixmap);
+    }
+
+    mHiddenCursorX = mCursorX;
+    mHiddenCursorY = mCursorY;
+
+    xcb_change_window_attributes(mConnection, mWindow, XCB_CW_CURSOR, &mHiddenCursor);
+    mCursorHidden = true;
+    mCursorLock = lock && !mTabletInput;
+  }
+  else
+  {
+    if (mCursorLock)
+      MoveMouseCursor(mHiddenCursorX, mHiddenCursorY);
+
+    xcb_change_window_attributes(mConnection, mWindow, XCB_CW_CURSOR, &mCursor);
+    mCursorHidden = false;
+    mCursorLock = false;
+  }
+
+  xcb_flush(mConnection);
+}
+
+void IGraphicsLinux::MoveMouseCursor(float x, float y)
+{
+  if (mTabletInput || !mWindow)
+    return;
+
+  const float scale = GetDrawScale() * GetScreenScale();
+
+  xcb_warp_pointer(mConnection, XCB_NONE, mWindow, 0, 0, 0, 0, static_cast<int16_t>(std::round(x * scale)), static_cast<int16_t>(std::round(y * scale)));
+  xcb_flush(mConnection);
+
+  mCursorX = x;
+  mCursorY = y;
+}
+
+ECursor IGraphicsLinux::SetMouseCursor(ECursor cursorType)
+{
+  if (mWindow)
+  {
+    static const uint16_t glyphs[] = {
+      XC_left_ptr,              // ARROW
+      XC_xterm,                 // IBEAM
+      XC_watch,                 // WAIT
+      XC_crosshair,             // CROSS
+      XC_sb_up_arrow,           // UPARROW
+      XC_bottom_right_corner,   // SIZENWSE
+      XC_bottom_left_corner,    // SIZENESW
+      XC_sb_h_double_arrow,     // SIZEWE
+      XC_sb_v_double_arrow,     // SIZENS
+      XC_fleur,                 // SIZEALL
+      XC_X_cursor,              // INO
+      XC_hand2,                 // HAND
+      XC_watch,                 // APPSTARTING
+      XC_question_arrow         // HELP
+    };
+
+    const uint16_t glyph = glyphs[cursorType];
+    xcb_font_t font = xcb_generate_id(mConnection);
+    xcb_open_font(mConnection, font, strlen("cursor"), "cursor");
+
+    if (mCursor)
+      xcb_free_cursor(mConnection, mCursor);
+
+    mCursor = xcb_generate_id(mConnection);
+    xcb_create_glyph_cursor(mConnection, mCursor, font, font, glyph, glyph + 1, 0, 0, 0, 65535, 65535, 65535);
+    xcb_close_font(mConnection, font);
+
+    if (!mCursorHidden)
+      xcb_change_window_attributes(mConnection, mWindow, XCB_CW_CURSOR, &mCursor);
+
+    xcb_flush(mConnection);
+  }
+
+  return IGraphics::SetMouseCursor(cursorType);
+}
+
+#pragma mark - Dialogs
+
+int IGraphicsLinux::ShowMessageBox(const char* str, const char* caption, EMessageBoxType type)
+{
+  ReleaseMouseCapture();
+
+  // zenity answers a question with its exit status, the extra button of a three way question by printing its label
+  switch (type)
+  {
+    case kMB_OK:
+      RunProgram({ "zenity", "--info", "--title", caption, "--text", str });
+      return kOK;
+
+    case kMB_OKCANCEL:
+      return RunProgram({ "zenity", "--question", "--title", caption, "--text", str, "--ok-label", "OK", "--cancel-label", "Cancel" }) == 0 ? kOK : kCANCEL;
+
+    case kMB_YESNO:
+      return RunProgram({ "zenity", "--question", "--title", caption, "--text", str, "--ok-label", "Yes", "--cancel-label", "No" }) == 0 ? kYES : kNO;
+
+    case kMB_RETRYCANCEL:
+      return RunProgram({ "zenity", "--question", "--title", caption, "--text", str, "--ok-label", "Retry", "--cancel-label", "Cancel" }) == 0 ? kRETRY : kCANCEL;
+
+    case kMB_YESNOCANCEL:
+    {
+      WDL_String output;
+      const int status = RunProgram({ "zenity", "--question", "--title", caption, "--text", str, "--ok-label", "Yes", "--cancel-label", "No", "--extra-button", "Cancel" }, &output);
+
+      if (!strcmp(output.Get(), "Cancel"))
+        return kCANCEL;
+
+      return status == 0 ? kYES : kNO;
+    }
+
+    default:
+      return 0;
+  }
+}
+
+void IGraphicsLinux::PromptForFile(WDL_String& fileName, WDL_String& path, EFileAction action, const char* extensions)
+{
+  if (!WindowIsOpen())
+  {
+    fileName.Set("");
+    return;
+  }
+
+  WDL_String start(path.Get());
+
+  if (start.GetLength() && start.Get()[start.GetLength() - 1] != '/')
+    start.Append("/");
+
+  start.Append(fileName.Get());
+
+  // zenity filters with a list of patterns after the filter's name
+  WDL_String filter;
+
+  if (CStringHasContents(extensions))
+  {
+    filter.Set(extensions);
+    filter.Append(" |");
+
+    for (const char* pExt = extensions; *pExt;)
+    {
+      const char* pEnd = strchr(pExt, ' ');
+      const int len = pEnd ? static_cast<int>(pEnd - pExt) : static_cast<int>(strlen(pExt));
+
+      if (len)
+      {
+        filter.Append(" *.");
+        filter.Append(pExt, len);
+      }
+
+      pExt += pEnd ? len + 1 : len;
+    }
+  }
+
+  WDL_String result;
+  int status;
+
+  if (action == kFileSave)
+    status = filter.GetLength() ? RunProgram({ "zenity", "--file-selection", "--save", "--confirm-overwrite", "--filename", start.Get(), "--file-filter", filter.Get() }, &result)
+                                : RunProgram({ "zenity", "--file-selection", "--save", "--confirm-overwrite", "--filename", start.Get() }, &result);
+  else
+    status = filter.GetLength() ? RunProgram({ "zenity", "--file-selection", "--filename", start.Get(), "--file-filter", filter.Get() }, &result)
+                                : RunProgram({ "zenity", "--file-selection", "--filename", start.Get() }, &result);
+
+  if (status == 0 && result.GetLength())
+  {
+    fileName.Set(result.Get());
+    path.Set(result.Get());
+
+    const char* pSlash = strrchr(path.Get(), '/');
+    path.SetLen(pSlash ? static_cast<int>(pSlash - path.Get()) + 1 : 0);
+  }
+  else
+    fileName.Set("");
+}
+
+void IGraphicsLinux::PromptForDirectory(WDL_String& dir)
+{
+  if (!WindowIsOpen())
+  {
+    dir.Set("");
+    return;
+  }
+
+  WDL_String result;
+
+  if (RunProgram({ "zenity", "--file-selection", "--directory", "--filename", dir.Get() }, &result) == 0 && result.GetLength())
+  {
+    dir.Set(result.Get());
+    dir.Append("/");
+  }
+  else
+    dir.Set("");
+}
+
+bool IGraphicsLinux::PromptForColor(IColor& color, const char* str)
+{
+  if (!mWindow)
+    return false;
+
+  char initial[32];
+  snprintf(initial, sizeof(initial), "rgb(%d,%d,%d)", color.R, color.G, color.B);
+
+  WDL_String result;
+
+  if (RunProgram({ "zenity", "--color-selection", "--title", CStringHasContents(str) ? str : "Color", "--color", initial }, &result) != 0)
+    return false;
+
+  // zenity prints rgb(r,g,b), or rgba(r,g,b,a) with a fractional alpha
+  int r, g, b;
+
+  if (sscanf(result.Get(), "rgb(%d,%d,%d)", &r, &g, &b) == 3 || sscanf(result.Get(), "rgba(%d,%d,%d", &r, &g, &b) == 3)
+  {
+    color.R = r;
+    color.G = g;
+    color.B = b;
+    return true;
+  }
+
+  return false;
+}
+
+bool IGraphicsLinux::OpenURL(const char* url, const char* msgWindowTitle, const char* confirmMsg, const char* errMsgOnFailure)
+{
+  if (confirmMsg && ShowMessageBox(confirmMsg, msgWindowTitle, kMB_YESNO) != kYES)
+    return false;
+
+  if (RunProgram({ "xdg-open", url }) == 0)
+    return true;
+
+  if (errMsgOnFailure)
+    ShowMessageBox(errMsgOnFailure, msgWindowTitle, kMB_OK);
+
+  return false;
+}
+
+bool IGraphicsLinux::RevealPathInExplorerOrFinder(WDL_String& path, bool select)
+{
+  WDL_String folder(path.Get());
+
+  // xdg-open can't select a file, so a file's folder is opened
+  if (select)
+  {
+    const char* pSlash = strrchr(folder.Get(), '/');
+
+    if (pSlash)
+      folder.SetLen(static_cast<int>(pSlash - folder.Get()) + 1);
+  }
+
+  return RunProgram({ "xdg-open", folder.Get() }) == 0;
+}
+
+bool IGraphicsLinux::GetTextFromClipboard(WDL_String& str)
+{
+  str.Set("");
+
+  if (!mWindow)
+    return false;
+
+  // the owner of the clipboard writes it to a property of the window, and says so with a selection notify event
+  xcb_convert_selection(mConnection, mWindow, mClipboardAtom, mUTF8Atom, mPropertyAtom, XCB_CURRENT_TIME);
+  xcb_flush(mConnection);
+
+  const double timeout = GetTimestamp() + 0.5;
+  bool notified = false;
+
+  while (!notified && GetTimestamp() < timeout)
+  {
+    xcb_generic_event_t* pEvent = xcb_poll_for_event(mConnection);
+
+    if (!pEvent)
+    {
+      usleep(1000);
+      continue;
+    }
+
+    if ((pEvent->response_type & ~0x80) == XCB_SELECTION_NOTIFY)
+      notified = reinterpret_cast<xcb_selection_notify_event_t*>(pEvent)->property != XCB_ATOM_NONE;
+    else if ((pEvent->response_type & ~0x80) != XCB_PROPERTY_NOTIFY)
+      HandleEvent(pEvent);
+
+    free(pEvent);
+  }
+
+  if (!notified)
+    return false;
+
+  xcb_get_property_reply_t* pReply = xcb_get_property_reply(mConnection, xcb_get_property(mConnection, 1, mWindow, mPropertyAtom, XCB_ATOM_ANY, 0, UINT32_MAX / 4), nullptr);
+
+  if (pReply)
+  {
+    str.Set(static_cast<const char*>(xcb_get_property_value(pReply)), xcb_get_property_value_length(pReply));
+    free(pReply);
+  }
+
+  return str.GetLength() > 0;
+}
+
+#if defined IGRAPHICS_NANOVG
+  #include "IGraphicsNanoVG.cpp"
+
+  #ifdef IGRAPHICS_FREETYPE
+    #define FONS_USE_FREETYPE
+  #endif
+
+  #include "nanovg.c"
+#else
+  #error Either NO_IGRAPHICS or one and only one choice of graphics library must be defined!
+#endif
@@ -10,42 +10,131 @@
 
 #pragma once
 
+#include <xcb/xcb.h>
+
 #include "IGraphics_select.h"
 
-/** IGraphics platform class for linux
-*   @ingroup PlatformClasses
-*/
+// Xlib and GLX are only included by the implementation, as their macros clash with plug-in code
+typedef struct _XDisplay Display;
+typedef struct __GLXcontextRec* GLXContext;
+typedef struct __GLXFBConfigRec* GLXFBConfig;
+
+/** IGraphics platform class for Linux, using XCB for the window and its events, and GLX to present what NanoVG draws.
+ * It has no event loop or thread of its own: the connection's file descriptor and the redraw timer are handed to the host's run loop, see IEditorDelegate::GetHostRunLoop(),
+ * so that events are read and frames drawn on the host's UI thread. Where there is no host run loop, e.g. in a standalone app, GetEventFD() should be watched and
+ * OnEventFD() and OnTimer() called from the app's own loop. While VSyncActive() buffers are swapped at the display's refresh, so frames never tear
+ * @ingroup PlatformClasses */
 class IGraphicsLinux final : public IGRAPHICS_DRAW_CLASS
 {
 public:
+
+  class LinuxFileFont : public PlatformFont
+  {
+  public:
+    LinuxFileFont(const char* path, int faceIdx = 0) : mPath(path), mFaceIdx(faceIdx) {}
+
+    IFontDataPtr GetFontData() override;
+
+  private:
+    WDL_String mPath;
+    int mFaceIdx;
+  };
+
+  /** A font in the resource archive, see IPlugResourceArchive, which is copied from the mapped bytes when its data is needed */
+  class LinuxArchiveFont : public PlatformFont
+  {
+  public:
+    LinuxArchiveFont(const void* pData, int size) : mData(pData), mSize(size) {}
+
+    IFontDataPtr GetFontData() override { return IFontDataPtr(new IFontData(mData, mSize, 0)); }
+
+  private:
+    const void* mData;
+    int mSize;
+  };
+
   IGraphicsLinux(IGEditorDelegate& dlg, int w, int h, int fps, float scale);
-  virtual ~IGraphicsLinux);
+  ~IGraphicsLinux();
 
-  void* OpenWindow(void* pWindow) override;
+  void* OpenWindow(void* pParent) override;
   void CloseWindow() override;
-  bool WindowIsOpen() override;
+  bool WindowIsOpen() override { return mWindow; }
+  void* GetWindow() override { return reinterpret_cast<void*>(static_cast<uintptr_t>(mWindow)); }
   void PlatformResize() override;
 
-  void HideMouseCursor() override;
-  void ShowMouseCursor() override;
+  void DrawResize() override; // overriden here to make the GL context current
+
+  void HideMouseCursor(bool hide, bool lock) override;
+  void MoveMouseCursor(float x, float y) override;
+  ECursor SetMouseCursor(ECursor cursorType) override;
 
   int ShowMessageBox(const char* str, const char* caption, EMessageBoxType type) override;
-  void ForceEndUserEdit() override;
+  void ForceEndUserEdit() override {}
 
-  const char* GetPlatformAPIStr() override;
+  const char* GetPlatformAPIStr() override { return "xcb"; }
 
-  void UpdateTooltips() override;
+  void UpdateTooltips() override {}
 
   bool RevealPathInExplorerOrFinder(WDL_String& path, bool select) override;
-  void PromptForFile(WDL_String& fileName, WDL_String& path, EFileAction action,  const char* ext) override;
+  void PromptForFile(WDL_String& fileName, WDL_String& path, EFileAction action, const char* ext) override;
+  void PromptForDirectory(WDL_String& dir) override;
   bool PromptForColor(IColor& color, const char* str) override;
 
   bool OpenURL(const char* url, const char* msgWindowTitle, const char* confirmMsg, const char* errMsgOnFailure) override;
 
-  static int GetUserOSVersion();
   bool GetTextFromClipboard(WDL_String& str) override;
 
+  /** @return The file descriptor of the connection to the X server, which has data to read when there are events, or -1 if the window isn't open */
+  int GetEventFD() const;
+
+  /** Handle the events that have arrived, called when the file descriptor from GetEventFD() has data to read */
+  void OnEventFD();
+
+  /** Redraw whatever is dirty, called at each tick of the redraw timer */
+  void OnTimer();
+
 protected:
-  IPopupMenu* CreatePlatformPopupMenu(const IPopupMenu& menu, IRECT& bounds) override;
-  void CreatePlatformTextEntry(IControl* pControl, const IText& text, const IRECT& bounds, const char* str) override;
-}
+  IPopupMenu* CreatePlatformPopupMenu(IPopupMenu& menu, const IRECT& bounds, IControl* pCaller) override { return nullptr; }
+  void CreatePlatformTextEntry(IControl& control, const IText& text, const IRECT& bounds, const char* str) override {}
+  void SetPlatformTimerInterval(uint32_t intervalMs) override;
+
+private:
+  PlatformFontPtr LoadPlatformFont(const char* fontID, const char* fileNameOrResID) override;
+  PlatformFontPtr LoadPlatformFont(const char* fontID, const char* fontName, ETextStyle style) override;
+  void CachePlatformFont(const char* fontID, const PlatformFontPtr& font) override {}
+
+  void HandleEvent(xcb_generic_event_t* pEvent);
+  IMouseMod GetMouseMod(uint16_t state, bool left, bool right) const;
+  IKeyPress GetKeyPress(uint8_t keycode, uint16_t state) const;
+
+  /** Draw the regions and present them */
+  void Paint(IRECTList& rects);
+
+  bool CreateGLContext();
+  void DestroyGLContext();
+  void ActivateGLContext();
+  void SetSwapInterval(int interval);
+
+  Display* mDisplay = nullptr;
+  GLXContext mGLContext = nullptr;
+  unsigned long mGLXWindow = 0; // GLXWindow
+  GLXFBConfig mFBConfig = nullptr;
+  int mSwapInterval = -1;
+
+  xcb_connection_t* mConnection = nullptr;
+  xcb_screen_t* mScreen = nullptr;
+  xcb_window_t mWindow = 0;
+  xcb_window_t mParentWindow = 0;
+  xcb_cursor_t mCursor = 0;
+  xcb_cursor_t mHiddenCursor = 0;
+  xcb_atom_t mClipboardAtom = 0;
+  xcb_atom_t mUTF8Atom = 0;
+  xcb_atom_t mPropertyAtom = 0;
+
+  IRECTList mExposed; // the regions exposed since the last of a run of expose events
+  uint32_t mTimerIntervalMs = 0;
+  float mHiddenCursorX = 0.f;
+  float mHiddenCursorY = 0.f;
+  uint8_t mLastButton = 0;
+  xcb_timestamp_t mLastClickTime = 0;
+};
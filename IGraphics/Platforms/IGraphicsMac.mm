@@ -12,6 +12,7 @@
 
 #include "IControl.h"
 #include "IPopupMenuControl.h"
+#include "IPlugResourceArchive.h"
 
 #import "IGraphicsMac_view.h"
 
@@ -107,7 +108,7 @@ struct MacFontDescriptor
   CTFontDescriptorRef mDescriptor;
 };
 
-static StaticStorage<MacFontDescriptor> sFontDescriptorCache;
+static StaticStorage<MacFontDescriptor> sFontDescriptorCache {"Font descriptors"};
   
 #pragma mark -
 
@@ -146,9 +147,23 @@ IGraphics::PlatformFontPtr IGraphicsMac::LoadPlatformFont(const char* fontID, co
   if (fontLocation == kNotFound)
     return nullptr;
 
-  CFLocal<CFStringRef> path = CFStringCreateWithCString(NULL, fullPath.Get(), kCFStringEncodingUTF8);
-  CFLocal<CFURLRef> url = CFURLCreateWithFileSystemPath(NULL, path.Get(), kCFURLPOSIXPathStyle, false);
-  CFLocal<CGDataProviderRef> provider = url.Get() ? CGDataProviderCreateWithURL(url.Get()) : nullptr;
+  CGDataProviderRef pProvider = nullptr;
+
+  if (fontLocation == kPackedArchive)
+  {
+    // the mapped bytes aren't copied, as the archive is mapped for the life of the process
+    int size = 0;
+    const void* pData = IPlugResourceArchive::Get().Find(fullPath.Get(), size);
+    pProvider = pData ? CGDataProviderCreateWithData(NULL, pData, size, NULL) : nullptr;
+  }
+  else
+  {
+    CFLocal<CFStringRef> path = CFStringCreateWithCString(NULL, fullPath.Get(), kCFStringEncodingUTF8);
+    CFLocal<CFURLRef> url = CFURLCreateWithFileSystemPath(NULL, path.Get(), kCFURLPOSIXPathStyle, false);
+    pProvider = url.Get() ? CGDataProviderCreateWithURL(url.Get()) : nullptr;
+  }
+
+  CFLocal<CGDataProviderRef> provider = pProvider;
   CFLocal<CGFontRef> cgFont = CGFontCreateWithDataProvider(provider.Get());
   CFLocal<CTFontRef> ctFont = CTFontCreateWithGraphicsFont(cgFont.Get(), 0.f, NULL, NULL);
   CFLocal<CTFontDescriptorRef> descriptor = CTFontCopyFontDescriptor(ctFont.Get());
@@ -203,7 +218,7 @@ void IGraphicsMac::ContextReady(void* pLayer)
 {
   OnViewInitialized(pLayer);
   SetScreenScale([[NSScreen mainScreen] backingScaleFactor]);
-  GetDelegate()->LayoutUI(this);
+  LayoutUIOnOpen();
   UpdateTooltips();
 }
 
@@ -211,6 +226,7 @@ void* IGraphicsMac::OpenWindow(void* pParent)
 {
   TRACE;
   CloseWindow();
+  WakeTimer(); // the view's timer starts at FPS()
   mView = (IGRAPHICS_VIEW*) [[IGRAPHICS_VIEW alloc] initWithIGraphics: this];
   
   IGRAPHICS_VIEW* pView = (IGRAPHICS_VIEW*) mView;
@@ -242,6 +258,12 @@ void IGraphicsMac::CloseWindow()
   }
 }
 
+void IGraphicsMac::SetPlatformTimerInterval(uint32_t intervalMs)
+{
+  if (mView)
+    [(IGRAPHICS_VIEW*) mView setTimerInterval: intervalMs];
+}
+
 bool IGraphicsMac::WindowIsOpen()
 {
   return mView;
@@ -9,8 +9,11 @@
 */
 
 #import <Cocoa/Cocoa.h>
+#import <CoreVideo/CoreVideo.h>
 //#import <WebKit/WebKit.h>
 
+#include <atomic>
+
 #include "IGraphicsMac.h"
 
 #if defined IGRAPHICS_GL
@@ -88,6 +91,8 @@ inline NSColor* ToNSColor(const IColor& c)
 {
   NSTrackingArea* mTrackingArea;
   NSTimer* mTimer;
+  CVDisplayLinkRef mDisplayLink; // drives redraws instead of mTimer while IGraphics::VSyncActive()
+  BOOL mRedrawing; // NO once the timer has been killed
   IGRAPHICS_TEXTFIELD* mTextFieldView;
   NSCursor* mMoveCursor;
 //  WKWebView* mWebView;
@@ -96,6 +101,7 @@ inline NSColor* ToNSColor(const IColor& c)
   IRECTList mDirtyRects;
 @public
   IGraphicsMac* mGraphics; // OBJC instance variables have to be pointers
+  std::atomic<bool> mDisplayLinkPending; // set while a refresh from the display link is waiting for the main thread
 }
 - (id) initWithIGraphics: (IGraphicsMac*) pGraphics;
 - (BOOL) isOpaque;
@@ -106,7 +112,10 @@ inline NSColor* ToNSColor(const IColor& c)
 - (void) drawRect: (NSRect) bounds;
 - (void) render;
 - (void) onTimer: (NSTimer*) pTimer;
+- (void) onDisplayLink: (double) timestamp;
+- (void) updateDisplayLinkScreen;
 - (void) killTimer;
+- (void) setTimerInterval: (uint32_t) intervalMs;
 //mouse
 - (void) getMouseXY: (NSEvent*) pEvent x: (float&) pX y: (float&) pY;
 - (IMouseInfo) getMouseLeft: (NSEvent*) pEvent;
@@ -404,7 +404,18 @@ inline int GetMouseOver(IGraphicsMac* pGraphics)
 
 - (NSOpenGLContext *)openGLContextForPixelFormat:(NSOpenGLPixelFormat *)pixelFormat
 {
+#ifdef IGRAPHICS_SHARE_GL_RESOURCES
+  // every view's context shares its objects with one that is kept for the process, so that the share group outlives the views
+  static NSOpenGLContext* sShareContext = [[NSOpenGLContext alloc] initWithFormat: pixelFormat shareContext: nil];
+  NSOpenGLContext* context = sShareContext ? [[[NSOpenGLContext alloc] initWithFormat: pixelFormat shareContext: sShareContext] autorelease] : nil;
+  
+  mView->mGraphics->SetSharesGLResources(context != nil);
+  
+  if (!context)
+    context = [super openGLContextForPixelFormat: pixelFormat];
+#else
   NSOpenGLContext* context = [super openGLContextForPixelFormat: pixelFormat];
+#endif
   
   [context makeCurrentContext];
   
@@ -449,6 +460,24 @@ inline int GetMouseOver(IGraphicsMac* pGraphics)
 
 #pragma mark -
 
+// called on the display link's own thread at each refresh of the display
+static CVReturn IGraphicsDisplayLinkCallback(CVDisplayLinkRef displayLink, const CVTimeStamp* pNow, const CVTimeStamp* pOutputTime, CVOptionFlags flagsIn, CVOptionFlags* pFlagsOut, void* pContext)
+{
+  IGRAPHICS_VIEW* pView = (IGRAPHICS_VIEW*) pContext;
+  
+  // redraw on the main thread, without queueing more than one refresh if it is busy
+  if (!pView->mDisplayLinkPending.exchange(true))
+  {
+    const double timestamp = (double) pOutputTime->videoTime / (double) pOutputTime->videoTimeScale;
+    
+    dispatch_async(dispatch_get_main_queue(), ^{
+      [pView onDisplayLink: timestamp];
+    });
+  }
+  
+  return kCVReturnSuccess;
+}
+
 @implementation IGRAPHICS_VIEW
 
 - (id) initWithIGraphics: (IGraphicsMac*) pGraphics
@@ -477,9 +506,11 @@ inline int GetMouseOver(IGraphicsMac* pGraphics)
 
   [self registerForDraggedTypes:[NSArray arrayWithObjects: NSFilenamesPboardType, nil]];
 
-  double sec = 1.0 / (double) pGraphics->FPS();
-  mTimer = [NSTimer timerWithTimeInterval:sec target:self selector:@selector(onTimer:) userInfo:nil repeats:YES];
-  [[NSRunLoop currentRunLoop] addTimer: mTimer forMode: (NSString*) kCFRunLoopCommonModes];
+  mTimer = 0;
+  mDisplayLink = nullptr;
+  mDisplayLinkPending = false;
+  mRedrawing = YES;
+  [self setTimerInterval: static_cast<uint32_t>(std::round(1000.0 / pGraphics->FPS()))];
 
   return self;
 }
@@ -524,6 +555,8 @@ inline int GetMouseOver(IGraphicsMac* pGraphics)
     if (mGraphics && mGraphics->GetDrawContext())
       mGraphics->SetScreenScale([pWindow backingScaleFactor]);
     
+    [self updateDisplayLinkScreen];
+    
 //    [[NSNotificationCenter defaultCenter] addObserver:self
 //                                             selector:@selector(windowResized:) name:NSWindowDidEndLiveResizeNotification
 //                                               object:pWindow];
@@ -549,6 +582,8 @@ inline int GetMouseOver(IGraphicsMac* pGraphics)
   
   if (newScale != mGraphics->GetScreenScale())
     mGraphics->SetScreenScale(newScale);
+  
+  [self updateDisplayLinkScreen];
 
 #ifdef IGRAPHICS_GL
   self.layer.contentsScale = 1./newScale;
@@ -600,8 +635,9 @@ inline int GetMouseOver(IGraphicsMac* pGraphics)
 - (void) onTimer: (NSTimer*) pTimer
 {
   mDirtyRects.Clear();
+  const bool dirty = mGraphics->IsDirty(mDirtyRects);
   
-  if (mGraphics->IsDirty(mDirtyRects))
+  if (dirty)
   {
 #ifdef IGRAPHICS_GL
     [self.layer setNeedsDisplay];
@@ -611,6 +647,24 @@ inline int GetMouseOver(IGraphicsMac* pGraphics)
   }
   
   mGraphics->SetAllControlsClean();
+  mGraphics->AdaptTimerInterval(dirty);
+}
+
+- (void) onDisplayLink: (double) timestamp
+{
+  mDisplayLinkPending = false;
+  
+  // ignore refreshes that were queued before the display link was stopped
+  if (mGraphics && mDisplayLink && CVDisplayLinkIsRunning(mDisplayLink) && mGraphics->OnDisplayRefresh(timestamp))
+    [self onTimer: nil];
+}
+
+- (void) updateDisplayLinkScreen
+{
+  NSScreen* pScreen = [[self window] screen];
+  
+  if (mDisplayLink && pScreen)
+    CVDisplayLinkSetCurrentCGDisplay(mDisplayLink, [[[pScreen deviceDescription] objectForKey: @"NSScreenNumber"] unsignedIntValue]);
 }
 
 - (void) getMouseXY: (NSEvent*) pEvent x: (float&) pX y: (float&) pY
@@ -700,7 +754,7 @@ inline int GetMouseOver(IGraphicsMac* pGraphics)
   float prevY = mPrevY;
   IMouseInfo info = [self getMouseLeft:pEvent];
   if (mGraphics && !mTextFieldView)
-    mGraphics->OnMouseDrag(info.x, info.y, info.x - prevX, info.y - prevY, info.ms);
+    mGraphics->QueueMouseDrag(info.x, info.y, info.x - prevX, info.y - prevY, info.ms);
 }
 
 - (void) rightMouseDown: (NSEvent*) pEvent
@@ -725,14 +779,14 @@ inline int GetMouseOver(IGraphicsMac* pGraphics)
   IMouseInfo info = [self getMouseRight:pEvent];
 
   if (mGraphics && !mTextFieldView)
-    mGraphics->OnMouseDrag(info.x, info.y, info.x - prevX, info.y - prevY, info.ms);
+    mGraphics->QueueMouseDrag(info.x, info.y, info.x - prevX, info.y - prevY, info.ms);
 }
 
 - (void) mouseMoved: (NSEvent*) pEvent
 {
   IMouseInfo info = [self getMouseLeft:pEvent];
   if (mGraphics)
-    mGraphics->OnMouseOver(info.x, info.y, info.ms);
+    mGraphics->QueueMouseOver(info.x, info.y, info.ms);
 }
 
 - (void)keyDown: (NSEvent *)pEvent
@@ -917,6 +971,42 @@ static void MakeCursorFromName(NSCursor*& cursor, const char *name)
 {
   [mTimer invalidate];
   mTimer = 0;
+  mRedrawing = NO;
+  
+  if (mDisplayLink)
+  {
+    CVDisplayLinkStop(mDisplayLink); // waits for a callback that is running to return
+    CVDisplayLinkRelease(mDisplayLink);
+    mDisplayLink = nullptr;
+  }
+}
+
+- (void) setTimerInterval: (uint32_t) intervalMs
+{
+  if (!mRedrawing)
+    return;
+  
+  // an NSTimer's interval can't be changed, so replace it
+  [mTimer invalidate];
+  mTimer = 0;
+  
+  if (mGraphics->VSyncActive())
+  {
+    if (!mDisplayLink && CVDisplayLinkCreateWithActiveCGDisplays(&mDisplayLink) == kCVReturnSuccess)
+    {
+      CVDisplayLinkSetOutputCallback(mDisplayLink, IGraphicsDisplayLinkCallback, self);
+      [self updateDisplayLinkScreen];
+    }
+    
+    if (mDisplayLink && (CVDisplayLinkIsRunning(mDisplayLink) || CVDisplayLinkStart(mDisplayLink) == kCVReturnSuccess))
+      return;
+  }
+  
+  if (mDisplayLink)
+    CVDisplayLinkStop(mDisplayLink);
+  
+  mTimer = [NSTimer timerWithTimeInterval:intervalMs / 1000.0 target:self selector:@selector(onTimer:) userInfo:nil repeats:YES];
+  [[NSRunLoop currentRunLoop] addTimer: mTimer forMode: (NSString*) kCFRunLoopCommonModes];
 }
 
 - (void) removeFromSuperview
@@ -258,6 +258,7 @@ EM_BOOL key_callback(int eventType, const EmscriptenKeyboardEvent* pEvent, void*
   return 0;
 }
 
+#ifndef IGRAPHICS_WEB_WORKER
 EM_BOOL outside_mouse_callback(int eventType, const EmscriptenMouseEvent* pEvent, void* pUserData)
 {
   IGraphicsWeb* pGraphics = (IGraphicsWeb*) pUserData;
@@ -294,6 +295,7 @@ EM_BOOL outside_mouse_callback(int eventType, const EmscriptenMouseEvent* pEvent
     
   return true;
 }
+#endif
 
 EM_BOOL mouse_callback(int eventType, const EmscriptenMouseEvent* pEvent, void* pUserData)
 {
@@ -322,14 +324,18 @@ EM_BOOL mouse_callback(int eventType, const EmscriptenMouseEvent* pEvent, void*
     case EMSCRIPTEN_EVENT_MOUSEENTER:
       pGraphics->OnSetCursor();
       pGraphics->OnMouseOver(x, y, modifiers);
+#ifndef IGRAPHICS_WEB_WORKER
       emscripten_set_mousemove_callback("#window", pGraphics, 1, nullptr);
+#endif
       break;
     case EMSCRIPTEN_EVENT_MOUSELEAVE:
+#ifndef IGRAPHICS_WEB_WORKER // the page captures the pointer while dragging, so drags outside the canvas still arrive as canvas events
       if(pEvent->buttons != 0)
       {
         emscripten_set_mousemove_callback("#window", pGraphics, 1, outside_mouse_callback);
         emscripten_set_mouseup_callback("#window", pGraphics, 1, outside_mouse_callback);
       }
+#endif
       pGraphics->OnMouseOut(); break;
     default:
       break;
@@ -362,15 +368,97 @@ EM_BOOL wheel_callback(int eventType, const EmscriptenWheelEvent* pEvent, void*
   return true;
 }
 
+// Called from IPlugResources.js when a streamed image has been drawn into its placeholder canvas (IGraphicsCanvas)
+static void _OnStreamedImageLoaded()
+{
+  if (gGraphics)
+    gGraphics->SetAllControlsDirty();
+}
+
+#ifdef IGRAPHICS_NANOVG
+// Called from IPlugResources.js with the RGBA pixels of a streamed image, to update its placeholder texture (IGraphicsNanoVG)
+static void _OnStreamedImagePixels(int textureID, uintptr_t pPixels)
+{
+  if (gGraphics)
+  {
+    static_cast<IGraphicsNanoVG*>(gGraphics)->UpdateStreamedImage(textureID, reinterpret_cast<const uint8_t*>(pPixels)); // embind doesn't allow us to pass raw pointers
+    gGraphics->SetAllControlsDirty();
+  }
+}
+#endif
+
+#ifdef IGRAPHICS_WEB_WORKER
+// Input events forwarded from the page, see IPlugWebWorkerHost.js. They are turned back into emscripten events so that they share the callbacks above
+// modifiers: 1 = shift, 2 = ctrl, 4 = alt. x and y are in CSS pixels, relative to the canvas
+static void _OnMouseEventFromPage(int eventType, double x, double y, double movementX, double movementY, int buttons, int modifiers)
+{
+  EmscriptenMouseEvent event = {};
+  event.targetX = (long) x;
+  event.targetY = (long) y;
+  event.movementX = (long) movementX;
+  event.movementY = (long) movementY;
+  event.buttons = (unsigned short) buttons;
+  event.shiftKey = (modifiers & 1) != 0;
+  event.ctrlKey = (modifiers & 2) != 0;
+  event.altKey = (modifiers & 4) != 0;
+
+  if (gGraphics)
+    mouse_callback(eventType, &event, static_cast<IGraphicsWeb*>(gGraphics));
+}
+
+static void _OnWheelEventFromPage(double x, double y, double deltaY, int modifiers)
+{
+  EmscriptenWheelEvent event = {};
+  event.mouse.targetX = (long) x;
+  event.mouse.targetY = (long) y;
+  event.mouse.shiftKey = (modifiers & 1) != 0;
+  event.mouse.ctrlKey = (modifiers & 2) != 0;
+  event.mouse.altKey = (modifiers & 4) != 0;
+  event.deltaY = deltaY;
+
+  if (gGraphics)
+    wheel_callback(EMSCRIPTEN_EVENT_WHEEL, &event, static_cast<IGraphicsWeb*>(gGraphics));
+}
+
+static void _OnKeyDownFromPage(int keyCode, std::string key, int modifiers)
+{
+  EmscriptenKeyboardEvent event = {};
+  strncpy(event.key, key.c_str(), sizeof(event.key) - 1);
+  event.keyCode = keyCode;
+  event.shiftKey = (modifiers & 1) != 0;
+  event.ctrlKey = (modifiers & 2) != 0;
+  event.altKey = (modifiers & 4) != 0;
+
+  if (gGraphics)
+    key_callback(EMSCRIPTEN_EVENT_KEYDOWN, &event, static_cast<IGraphicsWeb*>(gGraphics));
+}
+#endif
+
+EMSCRIPTEN_BINDINGS(IGraphicsWeb) {
+  function("IGWRL", &_OnStreamedImageLoaded);
+#ifdef IGRAPHICS_NANOVG
+  function("IGWRP", &_OnStreamedImagePixels);
+#endif
+#ifdef IGRAPHICS_WEB_WORKER
+  function("IGWME", &_OnMouseEventFromPage);
+  function("IGWMW", &_OnWheelEventFromPage);
+  function("IGWKD", &_OnKeyDownFromPage);
+#endif
+}
+
 #pragma mark -
 
 IGraphicsWeb::IGraphicsWeb(IGEditorDelegate& dlg, int w, int h, int fps, float scale)
 : IGRAPHICS_DRAW_CLASS(dlg, w, h, fps, scale)
 {
-  val keys = val::global("Object").call<val>("keys", GetPreloadedImages());
-  
-  DBGMSG("Preloaded %i images\n", keys["length"].as<int>());
+  if (!GetPreloadedImages().isUndefined())
+  {
+    val keys = val::global("Object").call<val>("keys", GetPreloadedImages());
+
+    DBGMSG("Preloaded %i images\n", keys["length"].as<int>());
+  }
   
+#ifndef IGRAPHICS_WEB_WORKER // in a worker, input events are forwarded from the page instead
   emscripten_set_click_callback("canvas", this, 1, mouse_callback);
   emscripten_set_mousedown_callback("canvas", this, 1, mouse_callback);
   emscripten_set_mouseup_callback("canvas", this, 1, mouse_callback);
@@ -380,6 +468,7 @@ IGraphicsWeb::IGraphicsWeb(IGEditorDelegate& dlg, int w, int h, int fps, float s
   emscripten_set_mouseleave_callback("canvas", this, 1, mouse_callback);
   emscripten_set_wheel_callback("canvas", this, 1, wheel_callback);
   emscripten_set_keydown_callback("#window", this, 1, key_callback);
+#endif
 }
 
 IGraphicsWeb::~IGraphicsWeb()
@@ -401,15 +490,36 @@ void* IGraphicsWeb::OpenWindow(void* pHandle)
   
   OnViewInitialized(nullptr /* not used */);
 
+#ifdef IGRAPHICS_WEB_WORKER
+  SetScreenScale(std::max(val::global("Module")["devicePixelRatio"].as<double>(), 1.)); // passed from the page, workers have no window
+#else
   SetScreenScale(std::max(emscripten_get_device_pixel_ratio(), 1.));
+#endif
 
-  GetDelegate()->LayoutUI(this);
+  LayoutUIOnOpen();
   
   return nullptr;
 }
 
 void IGraphicsWeb::HideMouseCursor(bool hide, bool lock)
 {
+#ifdef IGRAPHICS_WEB_WORKER
+  if (!hide && !mCursorLock)
+  {
+    OnSetCursor();
+  }
+  else
+  {
+    val msg = val::object();
+    msg.set("hide", hide);
+    msg.set("lock", hide ? lock : mCursorLock);
+    PostToPage("hidecursor", msg);
+  }
+
+  mCursorLock = hide && lock;
+  return;
+#endif
+
   if (hide)
   {
     if (lock)
@@ -452,13 +562,23 @@ ECursor IGraphicsWeb::SetMouseCursor(ECursor cursorType)
     case ECursor::HELP:             cursor = "help";            break;
   }
   
+#ifdef IGRAPHICS_WEB_WORKER
+  val msg = val::object();
+  msg.set("cursor", cursor);
+  PostToPage("cursor", msg);
+#else
   val::global("document")["body"]["style"].set("cursor", cursor);
+#endif
   return IGraphics::SetMouseCursor(cursorType);
 }
 
 //static
 void IGraphicsWeb::OnMainLoopTimer()
 {
+  // the main loop runs on requestAnimationFrame, so each call is a display refresh
+  if (!gGraphics->OnDisplayRefresh(emscripten_get_now() / 1000.))
+    return;
+
   IRECTList rects;
 
   if (gGraphics->IsDirty(rects))
@@ -470,6 +590,10 @@ void IGraphicsWeb::OnMainLoopTimer()
 
 bool IGraphicsWeb::GetTextFromClipboard(WDL_String& str)
 {
+#ifdef IGRAPHICS_WEB_WORKER
+  return false; // the clipboard can't be read synchronously from a worker
+#endif
+
   val clipboardText = val::global("window")["clipboardData"].call<val>("getData", std::string("Text"));
   
   str.Set(clipboardText.as<std::string>().c_str());
@@ -479,6 +603,14 @@ bool IGraphicsWeb::GetTextFromClipboard(WDL_String& str)
 
 int IGraphicsWeb::ShowMessageBox(const char* str, const char* caption, EMessageBoxType type)
 {
+#ifdef IGRAPHICS_WEB_WORKER
+  // the page shows an alert, but a worker can't wait for the answer to a confirm()
+  val msg = val::object();
+  msg.set("text", std::string(str));
+  PostToPage("alert", msg);
+  return 0;
+#endif
+
   switch (type)
   {
     case kMB_OK: val::global("window").call<val>("alert", std::string(str)); return 0;
@@ -493,6 +625,14 @@ int IGraphicsWeb::ShowMessageBox(const char* str, const char* caption, EMessageB
 
 void IGraphicsWeb::PromptForFile(WDL_String& filename, WDL_String& path, EFileAction action, const char* ext)
 {
+#ifdef IGRAPHICS_WEB_WORKER
+  val msg = val::object();
+  msg.set("accept", std::string(ext));
+  msg.set("directory", false);
+  PostToPage("prompt", msg);
+  return;
+#endif
+
   val inputEl = val::global("document").call<val>("getElementById", std::string("pluginInput"));
   
   inputEl.call<void>("setAttribute", std::string("accept"), std::string(ext));
@@ -501,6 +641,13 @@ void IGraphicsWeb::PromptForFile(WDL_String& filename, WDL_String& path, EFileAc
 
 void IGraphicsWeb::PromptForDirectory(WDL_String& path)
 {
+#ifdef IGRAPHICS_WEB_WORKER
+  val msg = val::object();
+  msg.set("directory", true);
+  PostToPage("prompt", msg);
+  return;
+#endif
+
   val inputEl = val::global("document").call<val>("getElementById", std::string("pluginInput"));
   
   inputEl.call<void>("setAttribute", std::string("directory"));
@@ -562,7 +709,13 @@ IPopupMenu* IGraphicsWeb::CreatePlatformPopupMenu(IPopupMenu& menu, const IRECT&
 
 bool IGraphicsWeb::OpenURL(const char* url, const char* msgWindowTitle, const char* confirmMsg, const char* errMsgOnFailure)
 {
+#ifdef IGRAPHICS_WEB_WORKER
+  val msg = val::object();
+  msg.set("url", std::string(url));
+  PostToPage("openurl", msg);
+#else
   val::global("window").call<val>("open", std::string(url), std::string("_blank"));
+#endif
   
   return true;
 }
@@ -571,8 +724,16 @@ void IGraphicsWeb::DrawResize()
 {
   val canvas = GetCanvas();
   
+#ifdef IGRAPHICS_WEB_WORKER
+  // the worker owns the OffscreenCanvas' backing store, but the page owns the element's CSS size
+  val msg = val::object();
+  msg.set("width", Width() * GetDrawScale());
+  msg.set("height", Height() * GetDrawScale());
+  PostToPage("resize", msg);
+#else
   canvas["style"].set("width", val(Width() * GetDrawScale()));
   canvas["style"].set("height", val(Height() * GetDrawScale()));
+#endif
   
   canvas.set("width", Width() * GetBackingPixelScale());
   canvas.set("height", Height() * GetBackingPixelScale());
@@ -26,15 +26,53 @@ using namespace emscripten;
 
 static val GetCanvas()
 {
+#ifdef IGRAPHICS_WEB_WORKER
+  return val::global("Module")["canvas"]; // the OffscreenCanvas transferred to the worker, see IPlugWebWorker.js
+#else
   return val::global("document").call<val>("getElementById", std::string("canvas"));
+#endif
 }
 
+#ifdef IGRAPHICS_WEB_WORKER
+/** Ask the page to do something a worker can't, such as setting the cursor or opening a URL, see IPlugWebWorkerHost.js */
+static void PostToPage(const char* type, val msg = val::object())
+{
+  msg.set("type", std::string(type));
+  val::global("IPlugWebWorker").call<void>("postToPage", msg);
+}
+#endif
+
 static val GetPreloadedImages()
 {
   return val::global("Module")["preloadedImages"];
 }
 
+/** @return \c true if an image isn't in the preloaded bundle, but is listed in the manifest of images that are streamed on demand, see IPlugResources.js */
+static bool IsStreamedImage(const char* path)
+{
+  val preloadedImages = GetPreloadedImages();
+  val resources = val::global("IPlugResources");
+
+  if (!preloadedImages.isUndefined() && preloadedImages.call<bool>("hasOwnProperty", std::string(path)))
+    return false;
+
+  return !resources.isUndefined() && resources["manifest"].call<bool>("hasOwnProperty", std::string(path));
+}
+
+/** Ask for a streamed image at high priority, the first time it is drawn. Until then it is only prefetched when the browser is idle
+ * @param handle The handle from IPlugResources.createPlaceholder() or addTexture(), which is set to -1 so that the image is only asked for once */
+static void RequestStreamedImage(int& handle)
+{
+  if (handle >= 0)
+  {
+    val::global("IPlugResources").call<void>("request", handle, true);
+    handle = -1;
+  }
+}
+
 /** IGraphics platform class for the web
+* If IGRAPHICS_WEB_WORKER is defined (WEB_WORKER=1 in common-web.mk) the UI module runs on a dedicated worker and draws into an OffscreenCanvas.
+* The page forwards input events to it, and carries out the requests it can't do itself, see IPlugWebWorker.js and IPlugWebWorkerHost.js
 * @ingroup PlatformClasses */
 class IGraphicsWeb final : public IGRAPHICS_DRAW_CLASS
 {
@@ -11,6 +11,7 @@
 
 #include <Shlobj.h>
 #include <commctrl.h>
+#include <dwmapi.h>
 
 #include "heapbuf.h"
 
@@ -19,9 +20,12 @@
 #include "IControl.h"
 #include "IPopupMenuControl.h"
 #include "IPlugPaths.h"
+#include "IPlugResourceArchive.h"
 
 #include <wininet.h>
 
+#pragma comment(lib, "dwmapi.lib")
+
 #pragma warning(disable:4244) // Pointer size cast mismatch.
 #pragma warning(disable:4312) // Pointer size cast mismatch.
 #pragma warning(disable:4311) // Pointer size cast mismatch.
@@ -32,6 +36,7 @@ static double sFPS = 0.0;
 
 #define PARAM_EDIT_ID 99
 #define IPLUG_TIMER_ID 2
+#define IPLUG_VSYNC_MSG (WM_USER + 0x100)
 #define IPLUG_WIN_MAX_WIDE_PATH 4096
 
 // Fonts
@@ -106,8 +111,8 @@ IFontDataPtr IGraphicsWin::WinFont::GetFontData()
   return fontData;
 }
 
-static StaticStorage<WinCachedFont> sPlatformFontCache;
-static StaticStorage<WinFontDescriptor> sFontDescriptorCache;
+static StaticStorage<WinCachedFont> sPlatformFontCache {"Platform fonts"};
+static StaticStorage<WinFontDescriptor> sFontDescriptorCache {"Font descriptors"};
 
 inline IMouseInfo IGraphicsWin::GetMouseInfo(LPARAM lParam, WPARAM wParam)
 {
@@ -203,9 +208,17 @@ LRESULT CALLBACK IGraphicsWin::WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARA
   
   switch (msg)
   {
+    case IPLUG_VSYNC_MSG:
+    {
+      pGraphics->mVSyncPending = false;
+
+      if (!pGraphics->mVSyncRunning || !pGraphics->OnDisplayRefresh(GetTimestamp()))
+        return 0;
+    }
+    // on a refresh, do what the timer does
     case WM_TIMER:
     {
-      if (wParam == IPLUG_TIMER_ID)
+      if (wParam == IPLUG_TIMER_ID || msg == IPLUG_VSYNC_MSG)
       {
         if (pGraphics->mParamEditWnd && pGraphics->mParamEditMsg != kNone)
         {
@@ -253,9 +266,18 @@ LRESULT CALLBACK IGraphicsWin::WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARA
           return 0; // TODO: check this!
         }
 
+        pGraphics->FlushMouseMoves();
+
+        if (pGraphics->mMouseOverPending)
+        {
+          pGraphics->mMouseOverPending = false;
+          pGraphics->TrackMouseOver();
+        }
+
         IRECTList rects;
+        const bool dirty = pGraphics->IsDirty(rects);
          
-        if (pGraphics->IsDirty(rects))
+        if (dirty)
         {
           pGraphics->SetAllControlsClean();
 
@@ -284,6 +306,8 @@ LRESULT CALLBACK IGraphicsWin::WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARA
             UpdateWindow(hWnd);
           }
         }
+        
+        pGraphics->AdaptTimerInterval(dirty);
       }
       return 0;
     }
@@ -314,22 +338,8 @@ LRESULT CALLBACK IGraphicsWin::WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARA
       if (!(wParam & (MK_LBUTTON | MK_RBUTTON)))
       {
         IMouseInfo info = pGraphics->GetMouseInfo(lParam, wParam);
-        if (pGraphics->OnMouseOver(info.x, info.y, info.ms))
-        {
-          TRACKMOUSEEVENT eventTrack = { sizeof(TRACKMOUSEEVENT), TME_LEAVE, hWnd, HOVER_DEFAULT };
-          if (pGraphics->TooltipsEnabled()) 
-          {
-            int c = pGraphics->GetMouseOver();
-            if (c != pGraphics->mTooltipIdx) 
-            {
-              if (c >= 0) eventTrack.dwFlags |= TME_HOVER;
-              pGraphics->mTooltipIdx = c;
-              pGraphics->HideTooltip();
-            }
-          }
-
-          TrackMouseEvent(&eventTrack);
-        }
+        pGraphics->QueueMouseOver(info.x, info.y, info.ms);
+        pGraphics->mMouseOverPending = true;
       }
       else if (GetCapture() == hWnd && !pGraphics->mParamEditWnd)
       {
@@ -337,7 +347,7 @@ LRESULT CALLBACK IGraphicsWin::WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARA
         IMouseInfo info = pGraphics->GetMouseInfoDeltas(dX, dY, lParam, wParam);
         if (dX || dY)
         {
-          pGraphics->OnMouseDrag(info.x, info.y, dX, dY, info.ms);
+          pGraphics->QueueMouseDrag(info.x, info.y, dX, dY, info.ms);
           if (pGraphics->MouseCursorIsLocked())
             pGraphics->MoveMouseCursor(pGraphics->mHiddenCursorX, pGraphics->mHiddenCursorY);
         }
@@ -444,7 +454,8 @@ LRESULT CALLBACK IGraphicsWin::WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARA
       HRGN region = CreateRectRgn(0, 0, 0, 0);
       int regionType = GetUpdateRgn(hWnd, region, FALSE);
 
-      if ((regionType == COMPLEXREGION) || (regionType = SIMPLEREGION))
+      // an empty update region has nothing to draw, so don't activate the GL context or present
+      if ((regionType == COMPLEXREGION) || (regionType == SIMPLEREGION))
       {
         #ifdef IGRAPHICS_GL
         pGraphics->ActivateGLContext();
@@ -818,6 +829,15 @@ bool IGraphicsWin::MouseCursorIsLocked()
 }
 
 #ifdef IGRAPHICS_GL
+#ifdef IGRAPHICS_SHARE_GL_RESOURCES
+// the contexts of the open windows, which share their objects, created on the main thread
+static std::vector<HGLRC>& SharedGLContexts()
+{
+  static std::vector<HGLRC> sContexts;
+  return sContexts;
+}
+#endif
+
 void IGraphicsWin::CreateGLContext()
 {
 
@@ -825,7 +845,7 @@ void IGraphicsWin::CreateGLContext()
   {
     sizeof(PIXELFORMATDESCRIPTOR),
     1,
-    PFD_DRAW_TO_WINDOW | PFD_SUPPORT_OPENGL | PFD_DOUBLEBUFFER, //Flags
+    PFD_DRAW_TO_WINDOW | PFD_SUPPORT_OPENGL | PFD_DOUBLEBUFFER | PFD_SWAP_COPY, //Flags
     PFD_TYPE_RGBA, // The kind of framebuffer. RGBA or palette.
     32, // Colordepth of the framebuffer.
     0, 0, 0, 0, 0, 0,
@@ -845,7 +865,24 @@ void IGraphicsWin::CreateGLContext()
   int fmt = ChoosePixelFormat(dc, &pfd);
   SetPixelFormat(dc, fmt, &pfd);
 
+  // with copy swaps the back buffer keeps the last frame, so only the regions redrawn need to be presented
+  PIXELFORMATDESCRIPTOR chosen = {};
+  DescribePixelFormat(dc, fmt, sizeof(chosen), &chosen);
+  mBackBufferRetained = (chosen.dwFlags & PFD_SWAP_COPY) != 0;
+
   mHGLRC = wglCreateContext(dc);
+
+#ifdef IGRAPHICS_SHARE_GL_RESOURCES
+  // the new context has no objects yet, so it can join the others' share group, which outlives any one of them
+  std::vector<HGLRC>& sharedContexts = SharedGLContexts();
+  const bool shared = sharedContexts.empty() || wglShareLists(sharedContexts.front(), mHGLRC);
+
+  if (shared)
+    sharedContexts.push_back(mHGLRC);
+
+  SetSharesGLResources(shared);
+#endif
+
   wglMakeCurrent(dc, mHGLRC);
 
   //TODO: do we want this?
@@ -859,6 +896,11 @@ void IGraphicsWin::CreateGLContext()
 
 void IGraphicsWin::DestroyGLContext()
 {
+#ifdef IGRAPHICS_SHARE_GL_RESOURCES
+  std::vector<HGLRC>& sharedContexts = SharedGLContexts();
+  sharedContexts.erase(std::remove(sharedContexts.begin(), sharedContexts.end(), mHGLRC), sharedContexts.end());
+#endif
+
   wglMakeCurrent(NULL, NULL);
   wglDeleteContext(mHGLRC);
 }
@@ -888,6 +930,7 @@ void* IGraphicsWin::OpenWindow(void* pParent)
 {
   int x = 0, y = 0, w = WindowWidth(), h = WindowHeight();
   mParentWnd = (HWND) pParent;
+  WakeTimer(); // the window's timer starts at FPS()
 
   if (mPlugWnd)
   {
@@ -909,6 +952,7 @@ void* IGraphicsWin::OpenWindow(void* pParent)
 
   sFPS = FPS();
   mPlugWnd = CreateWindow(wndClassName, "IPlug", WS_CHILD | WS_VISIBLE, x, y, w, h, mParentWnd, 0, mHInstance, this);
+  SetPlatformTimerInterval(static_cast<uint32_t>(std::round(1000.0 / sFPS))); // switches from the window's timer to the display, if VSyncActive()
 
   HDC dc = GetDC(mPlugWnd);
   SetPlatformContext(dc);
@@ -922,7 +966,7 @@ void* IGraphicsWin::OpenWindow(void* pParent)
 
   SetScreenScale(1); // CHECK!
 
-  GetDelegate()->LayoutUI(this);
+  LayoutUIOnOpen();
 
   if (!mPlugWnd && --nWndClassReg == 0)
   {
@@ -1026,10 +1070,63 @@ void IGraphicsWin::SetWindowTitle(const char* str)
   SetWindowText(mPlugWnd, str);
 }
 
+void IGraphicsWin::SetPlatformTimerInterval(uint32_t intervalMs)
+{
+  if (!mPlugWnd)
+    return;
+
+  if (VSyncActive())
+  {
+    KillTimer(mPlugWnd, IPLUG_TIMER_ID);
+    StartVSyncThread();
+  }
+  else
+  {
+    StopVSyncThread();
+    SetTimer(mPlugWnd, IPLUG_TIMER_ID, intervalMs, NULL); // replaces the interval of the existing timer
+  }
+}
+
+void IGraphicsWin::StartVSyncThread()
+{
+  if (mVSyncRunning)
+    return;
+
+  mVSyncRunning = true;
+  mVSyncPending = false;
+  mVSyncThread = std::thread(&IGraphicsWin::VSyncThread, this);
+}
+
+void IGraphicsWin::StopVSyncThread()
+{
+  if (!mVSyncRunning)
+    return;
+
+  // waits for at most one composition
+  mVSyncRunning = false;
+  mVSyncThread.join();
+}
+
+void IGraphicsWin::VSyncThread()
+{
+  const DWORD fallbackMs = static_cast<DWORD>(std::round(1000.0 / FPS()));
+
+  while (mVSyncRunning)
+  {
+    // fails when desktop composition is off, in which case pace at FPS()
+    if (FAILED(DwmFlush()))
+      Sleep(fallbackMs);
+
+    if (mVSyncRunning && !mVSyncPending.exchange(true))
+      PostMessage(mPlugWnd, IPLUG_VSYNC_MSG, 0, 0);
+  }
+}
+
 void IGraphicsWin::CloseWindow()
 {
   if (mPlugWnd)
   {
+    StopVSyncThread();
     OnViewDestroyed();
 
 #ifdef IGRAPHICS_GL
@@ -1250,7 +1347,7 @@ void IGraphicsWin::CreatePlatformTextEntry(IControl& control, const IText& text,
     scaledBounds.L, scaledBounds.T, scaledBounds.W()+1, scaledBounds.H()+1,
     mPlugWnd, (HMENU) PARAM_EDIT_ID, mHInstance, 0);
 
-  StaticStorage<WinFontDescriptor>::Accessor descriptorStorage(sFontDescriptorCache);
+  StaticStorage<WinFontDescriptor>::SharedAccessor descriptorStorage(sFontDescriptorCache);
 
   LOGFONT lFont = { 0 };
   WinFontDescriptor* descriptor = descriptorStorage.Find(text.mFont);
@@ -1549,6 +1646,25 @@ void IGraphicsWin::HideTooltip()
   }
 }
 
+void IGraphicsWin::TrackMouseOver()
+{
+  const int c = GetMouseOver();
+
+  if (c < 0)
+    return;
+
+  TRACKMOUSEEVENT eventTrack = { sizeof(TRACKMOUSEEVENT), TME_LEAVE, mPlugWnd, HOVER_DEFAULT };
+
+  if (TooltipsEnabled() && c != mTooltipIdx)
+  {
+    eventTrack.dwFlags |= TME_HOVER;
+    mTooltipIdx = c;
+    HideTooltip();
+  }
+
+  TrackMouseEvent(&eventTrack);
+}
+
 bool IGraphicsWin::GetTextFromClipboard(WDL_String& str)
 {
   int numChars = 0;
@@ -1672,6 +1788,12 @@ IGraphics::PlatformFontPtr IGraphicsWin::LoadPlatformFont(const char* fontID, co
       pFont.reset(new WinCachedFont(pFontMem, resSize));
     }
     break;
+    case kPackedArchive:
+    {
+      pFontMem = const_cast<void *>(IPlugResourceArchive::Get().Find(fullPath.Get(), resSize));
+      pFont.reset(new WinCachedFont(pFontMem, resSize));
+    }
+    break;
   } 
 
   if (pFontMem && pFont && pFont->IsValid())
@@ -14,6 +14,9 @@
 #include <windowsx.h>
 #include <winuser.h>
 
+#include <atomic>
+#include <thread>
+
 #include "IGraphics_select.h"
 
 /** IGraphics platform class for Windows
@@ -90,10 +93,13 @@ public:
 protected:
   IPopupMenu* CreatePlatformPopupMenu(IPopupMenu& menu, const IRECT& bounds, IControl* pCaller) override;
   void CreatePlatformTextEntry(IControl& control, const IText& text, const IRECT& bounds, const char* str) override;
+  void SetPlatformTimerInterval(uint32_t intervalMs) override;
 
   void SetTooltip(const char* tooltip);
   void ShowTooltip();
   void HideTooltip();
+  /** Track the mouse leaving the window and hovering over the control it is now over, for its tooltip, after a mouse over has been handled */
+  void TrackMouseOver();
 
 private:
   enum EParamEditMsg
@@ -113,6 +119,11 @@ private:
   inline IMouseInfo IGraphicsWin::GetMouseInfoDeltas(float&dX, float& dY, LPARAM lParam, WPARAM wParam);
   bool MouseCursorIsLocked();
 
+  // The vsync thread waits for each composition with DwmFlush() and posts a message to the window, while VSyncActive()
+  void StartVSyncThread();
+  void StopVSyncThread();
+  void VSyncThread();
+
 #ifdef IGRAPHICS_GL
   //OpenGL context management - TODO: RAII instead?
   void CreateGLContext();
@@ -140,10 +151,15 @@ private:
   IControl* mEdControl = nullptr;
   EParamEditMsg mParamEditMsg = kNone;
   bool mShowingTooltip = false;
+  bool mMouseOverPending = false; // a mouse over has been queued since the last tick, see TrackMouseOver()
   float mHiddenCursorX;
   float mHiddenCursorY;
   int mTooltipIdx = -1;
 
+  std::thread mVSyncThread;
+  std::atomic<bool> mVSyncRunning { false };
+  std::atomic<bool> mVSyncPending { false }; // a vsync message is in the queue, so that they don't pile up if drawing falls behind
+
   WDL_String mMainWndClassName;
 public:
   static LRESULT CALLBACK WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam);
@@ -114,6 +114,7 @@ IPlugAAX::IPlugAAX(IPlugInstanceInfo instanceInfo, IPlugConfig c)
 
 IPlugAAX::~IPlugAAX()
 {
+  IPlugInstanceGroup<IPlugAAX>::Leave(this);
   mParamIDs.Empty(true);
 }
 
@@ -209,9 +210,22 @@ AAX_Result IPlugAAX::EffectInit()
     mParameterManager.AddParameter(pAAXParam);
   }
   
+  // the stem formats are fixed for the lifetime of an instance, so the channel connections are set once here rather than on every render
+  AAX_EStemFormat inFormat, outFormat;
+  Controller()->GetInputStemFormat(&inFormat);
+  Controller()->GetOutputStemFormat(&outFormat);
+  mNInputChannels = std::min((int) AAX_STEM_FORMAT_CHANNEL_COUNT(inFormat), MaxNChannels(ERoute::kInput));
+  mNOutputChannels = std::min((int) AAX_STEM_FORMAT_CHANNEL_COUNT(outFormat), MaxNChannels(ERoute::kOutput));
+
+  SetChannelConnections(ERoute::kInput, 0, mNInputChannels, true);
+  SetChannelConnections(ERoute::kInput, mNInputChannels, MaxNChannels(ERoute::kInput) - mNInputChannels, false);
+  SetChannelConnections(ERoute::kOutput, 0, mNOutputChannels, true);
+  SetChannelConnections(ERoute::kOutput, mNOutputChannels, MaxNChannels(ERoute::kOutput) - mNOutputChannels, false);
+
   AAX_CSampleRate sr;
   Controller()->GetSampleRate(&sr);
   SetSampleRate(sr);
+  AllocateParamRamps();
   OnReset();
   
   return AAX_SUCCESS;
@@ -258,10 +272,8 @@ void IPlugAAX::RenderAudio(AAX_SIPlugRenderInfo* pRenderInfo)
   bool bypass;
   mBypassParameter->GetValueAsBool(&bypass);
   
-  AAX_EStemFormat inFormat, outFormat;
-  Controller()->GetInputStemFormat(&inFormat);
-  Controller()->GetOutputStemFormat(&outFormat);
-  
+  const int32_t numSamples = *(pRenderInfo->mNumSamples);
+
   if (DoesMIDIIn()) 
   {
     AAX_IMIDINode* pMidiIn = pRenderInfo->mInputNode;
@@ -271,8 +283,15 @@ void IPlugAAX::RenderAudio(AAX_SIPlugRenderInfo* pRenderInfo)
         
     for (int i = 0; i<packets_count; i++, pMidiPacket++) 
     {
-      IMidiMsg msg(pMidiPacket->mTimestamp, pMidiPacket->mData[0], pMidiPacket->mData[1], pMidiPacket->mData[2]);
-      ProcessMidiMsg(msg);
+      // packet timestamps are sample offsets into this buffer
+      const int offset = std::min((int) pMidiPacket->mTimestamp, numSamples - 1);
+      IMidiMsg msg(offset, pMidiPacket->mData[0], pMidiPacket->mData[1], pMidiPacket->mData[2]);
+
+      if (GetSampleAccurateMidi())
+        AddMidiEvent(msg);
+      else
+        ProcessMidiMsg(msg);
+
       mMidiMsgsFromProcessor.Push(msg);
     }
   }
@@ -280,17 +299,9 @@ void IPlugAAX::RenderAudio(AAX_SIPlugRenderInfo* pRenderInfo)
   AAX_IMIDINode* pTransportNode = pRenderInfo->mTransportNode;
   mTransport = pTransportNode->GetTransport();
 
-  int32_t numSamples = *(pRenderInfo->mNumSamples);
-  int32_t numInChannels = AAX_STEM_FORMAT_CHANNEL_COUNT(inFormat);
-  int32_t numOutChannels = AAX_STEM_FORMAT_CHANNEL_COUNT(outFormat);
-
-  SetChannelConnections(ERoute::kInput, 0, numInChannels, true);
-  SetChannelConnections(ERoute::kInput, numInChannels, MaxNChannels(ERoute::kInput) - numInChannels, false);
-  AttachBuffers(ERoute::kInput, 0, MaxNChannels(ERoute::kInput), pRenderInfo->mAudioInputs, numSamples);
-  
-  SetChannelConnections(ERoute::kOutput, 0, numOutChannels, true);
-  SetChannelConnections(ERoute::kOutput, numOutChannels, MaxNChannels(ERoute::kOutput) - numOutChannels, false);
-  AttachBuffers(ERoute::kOutput, 0, MaxNChannels(ERoute::kOutput), pRenderInfo->mAudioOutputs, numSamples);
+  // the host's float buffers are attached as they are: with SAMPLE_TYPE_FLOAT ProcessBlock() works on them directly, otherwise they are converted once
+  AttachBuffers(ERoute::kInput, 0, mNInputChannels, pRenderInfo->mAudioInputs, numSamples);
+  AttachBuffers(ERoute::kOutput, 0, mNOutputChannels, pRenderInfo->mAudioOutputs, numSamples);
   
   if (bypass) 
     PassThroughBuffers(0.0f, numSamples);
@@ -327,6 +338,7 @@ void IPlugAAX::RenderAudio(AAX_SIPlugRenderInfo* pRenderInfo)
       ProcessMidiMsg(msg);
     }
     
+    ProcessBlockStartTasks();
     ProcessBuffers(0.0f, numSamples);
   }
   
@@ -338,58 +350,58 @@ void IPlugAAX::RenderAudio(AAX_SIPlugRenderInfo* pRenderInfo)
     if(midiOut)
     {
       //MIDI
-      if (!mMidiOutputQueue.Empty())
-      {        
-        while (!mMidiOutputQueue.Empty())
-        {
-          IMidiMsg& msg = mMidiOutputQueue.Peek();
-          
-          AAX_CMidiPacket packet;
-          
-          packet.mIsImmediate = true; // TODO: how does this affect sample accuracy?
-          
-          packet.mTimestamp = (uint32_t) msg.mOffset;
-          packet.mLength = 3;
-          
-          packet.mData[0] = msg.mStatus;
-          packet.mData[1] = msg.mData1;
-          packet.mData[2] = msg.mData2;
-          
-          midiOut->PostMIDIPacket (&packet);
-          
-          mMidiOutputQueue.Remove();
-        }
+      while (!mMidiOutputQueue.Empty())
+      {
+        const IMidiMsg& msg = mMidiOutputQueue.Peek();
+
+        if (msg.mOffset >= numSamples) // belongs to a later buffer, see Flush() below
+          break;
+
+        AAX_CMidiPacket packet;
+
+        packet.mIsImmediate = false; // so that the host honours mTimestamp, the offset in samples into this buffer
+        packet.mTimestamp = (uint32_t) std::max(msg.mOffset, 0);
+        packet.mLength = 3;
+
+        packet.mData[0] = msg.mStatus;
+        packet.mData[1] = msg.mData1;
+        packet.mData[2] = msg.mData2;
+
+        midiOut->PostMIDIPacket (&packet);
+
+        mMidiOutputQueue.Remove();
       }
       
       mMidiOutputQueue.Flush(numSamples);
       
       //Output SYSEX from the editor, which has bypassed ProcessSysEx()
-      if(mSysExDataFromEditor.ElementsAvailable())
+      IPlugMessageRing::Record record;
+      
+      while (mSysExDataFromEditor.Peek(record))
       {
-        while (mSysExDataFromEditor.Pop(mSysexBuf))
+        int numPackets = (int) ceil((float) record.mSize/4.); // each packet can store 4 bytes of data
+        int bytesPos = 0;
+        
+        for (int p = 0; p < numPackets; p++)
         {
-          int numPackets = (int) ceil((float) mSysexBuf.mSize/4.); // each packet can store 4 bytes of data
-          int bytesPos = 0;
+          AAX_CMidiPacket packet;
+          
+          packet.mTimestamp = (uint32_t) record.mTag;
+          packet.mIsImmediate = true;
+          
+          int b = 0;
           
-          for (int p = 0; p < numPackets; p++)
+          while (b < 4 && bytesPos < record.mSize)
           {
-            AAX_CMidiPacket packet;
-            
-            packet.mTimestamp = (uint32_t) mSysexBuf.mOffset;
-            packet.mIsImmediate = true;
-            
-            int b = 0;
-            
-            while (b < 4 && bytesPos < mSysexBuf.mSize)
-            {
-              packet.mData[b++] = mSysexBuf.mData[bytesPos++];
-            }
-            
-            packet.mLength = (uint32_t) b;
-            
-            midiOut->PostMIDIPacket (&packet);
+            packet.mData[b++] = record.mData[bytesPos++];
           }
+          
+          packet.mLength = (uint32_t) b;
+          
+          midiOut->PostMIDIPacket (&packet);
         }
+        
+        mSysExDataFromEditor.Release();
       }
     }
   }
@@ -414,7 +426,8 @@ AAX_Result IPlugAAX::GetChunkSize(AAX_CTypeID chunkID, uint32_t* pSize) const
     
   if (chunkID == GetUniqueID())
   {
-    IByteChunk chunk;
+    IByteChunkPool::ScopedChunk scopedChunk = AcquireStateChunk();
+    IByteChunk& chunk = scopedChunk.Get();
     
     //IByteChunk::InitChunkWithIPlugVer(&IPlugChunk);
     
@@ -438,7 +451,8 @@ AAX_Result IPlugAAX::GetChunk(AAX_CTypeID chunkID, AAX_SPlugInChunk* pChunk) con
 
   if (chunkID == GetUniqueID())
   {
-    IByteChunk chunk;
+    IByteChunkPool::ScopedChunk scopedChunk = AcquireStateChunk();
+    IByteChunk& chunk = scopedChunk.Get();
     
     //IByteChunk::InitChunkWithIPlugVer(&IPlugChunk); // TODO: IPlugVer should be in chunk!
     
@@ -493,21 +507,67 @@ AAX_Result IPlugAAX::CompareActiveChunk(const AAX_SPlugInChunk* pChunk, AAX_CBoo
   return AAX_SUCCESS;
 }  
 
+AAX_Result IPlugAAX::NotificationReceived(AAX_CTypeID type, const void* pData, uint32_t size)
+{
+  // mono instances of the plug-in on the same track are the instances of a multi-mono insert
+  if (type == AAX_eNotificationEvent_TrackNameChanged && pData && mNInputChannels <= 1 && mNOutputChannels == 1)
+  {
+    const AAX_IString* pTrackName = (const AAX_IString*) pData;
+    WDL_String groupKey;
+    groupKey.SetFormatted(512, "%08x:%s", GetUniqueID(), pTrackName->Get());
+    IPlugInstanceGroup<IPlugAAX>::Join(this, groupKey.Get());
+  }
+
+  return AAX_CIPlugParameters::NotificationReceived(type, pData, size);
+}
+
+void IPlugAAX::SyncStateToMultiMonoSiblings()
+{
+  TRACE;
+
+  if (!DoesStateChunks())
+    return;
+
+  IByteChunkPool::ScopedChunk scopedChunk = AcquireStateChunk();
+  IByteChunk& chunk = scopedChunk.Get();
+
+  if (!SerializeState(chunk))
+    return;
+
+  IPlugInstanceGroup<IPlugAAX>::ForEachSibling(this, [&chunk](IPlugAAX& sibling) {
+    sibling.RestoreStateFromSibling(chunk);
+  });
+}
+
+void IPlugAAX::RestoreStateFromSibling(const IByteChunk& chunk)
+{
+  UnserializeState(chunk, 0);
+
+  for (int i = 0; i< NParams(); i++)
+    SetParameterNormalizedValue(mParamIDs.Get(i)->Get(), GetParam(i)->GetNormalized() );
+
+  OnRestoreState();
+  mNumPlugInChanges++;
+}
+
 void IPlugAAX::BeginInformHostOfParamChange(int idx)
 {
   TRACE;
+  IPLUG_HOST_CALL_SCOPE(kHostCallBeginEdit);
   TouchParameter(mParamIDs.Get(idx)->Get());
 }
 
 void IPlugAAX::InformHostOfParamChange(int idx, double normalizedValue)
 {
   TRACE;
+  IPLUG_HOST_CALL_SCOPE(kHostCallPerformEdit);
   SetParameterNormalizedValue(mParamIDs.Get(idx)->Get(), normalizedValue );
 }
 
 void IPlugAAX::EndInformHostOfParamChange(int idx)
 {
   TRACE;
+  IPLUG_HOST_CALL_SCOPE(kHostCallEndEdit);
   ReleaseParameter(mParamIDs.Get(idx)->Get());
 }
 
@@ -522,7 +582,10 @@ void IPlugAAX::EditorPropertiesChangedFromDelegate(int viewWidth, int viewHeight
     oEffectViewSize.vert = (float) viewHeight;
     
     if (pViewInterface && (viewWidth != GetEditorWidth() || viewHeight != GetEditorHeight()))
+    {
+      IPLUG_HOST_CALL_SCOPE(kHostCallResize);
       pViewInterface->GetViewContainer()->SetViewSize(oEffectViewSize);
+    }
 
     IPlugAPIBase::EditorPropertiesChangedFromDelegate(viewWidth, viewHeight, data);
   }
@@ -530,9 +593,10 @@ void IPlugAAX::EditorPropertiesChangedFromDelegate(int viewWidth, int viewHeight
 
 void IPlugAAX::SetLatency(int latency)
 {
-  Controller()->SetSignalLatency(latency);
-  
   IPlugProcessor::SetLatency(latency); // will update delay time
+
+  IPLUG_HOST_CALL_SCOPE(kHostCallLatency);
+  Controller()->SetSignalLatency(GetLatency());
 }
 
 bool IPlugAAX::SendMidiMsg(const IMidiMsg& msg)
@@ -540,3 +604,13 @@ bool IPlugAAX::SendMidiMsg(const IMidiMsg& msg)
   mMidiOutputQueue.Add(msg);
   return true;
 }
+
+bool IPlugAAX::SendMidiMsgs(WDL_TypedBuf<IMidiMsg>& msgs)
+{
+  const IMidiMsg* pMsgs = msgs.Get();
+
+  for (int i = 0; i < msgs.GetSize(); i++)
+    mMidiOutputQueue.Add(pMsgs[i]);
+
+  return true;
+}
@@ -21,6 +21,7 @@
 #include "IPlugAPIBase.h"
 #include "IPlugProcessor.h"
 #include "IPlugMidi.h"
+#include "IPlugSharedData.h"
 
 #include "IPlugAAX_Parameters.h"
 
@@ -92,6 +93,9 @@ public:
   //IPlug Processor Overrides
   void SetLatency(int samples) override;
   bool SendMidiMsg(const IMidiMsg& msg) override;
+  bool SendMidiMsgs(WDL_TypedBuf<IMidiMsg>& msgs) override;
+  void ProcessParamRamps(int startIdx, int nFrames) override { RenderParamRamps(*this, startIdx, nFrames); }
+  void AllocateParamRamps() override { CreateParamRamps(*this); }
   
   AAX_Result UpdateParameterNormalizedValue(AAX_CParamID iParameterID, double iValue, AAX_EUpdateSource iSource ) override;
   
@@ -106,17 +110,29 @@ public:
   AAX_Result GetChunk(AAX_CTypeID chunkID, AAX_SPlugInChunk* pChunk) const override;
   AAX_Result SetChunk(AAX_CTypeID chunkID, const AAX_SPlugInChunk* pChunk) override;
   AAX_Result CompareActiveChunk(const AAX_SPlugInChunk* pChunk, AAX_CBoolean* pIsEqual) const override;
+  AAX_Result NotificationReceived(AAX_CTypeID type, const void* pData, uint32_t size) override;
 
   //IPlugAAX
   /** This is needed in chunks based plug-ins to tell PT a non-indexed param changed and to turn on the compare light. You can call this method from your plug-in implementation by doing a dynamic_cast in order to convert an "IPlug" into a "IPlugAAX"
    */
   void DirtyPTCompareState() { mNumPlugInChanges++; }
 
+  /** With PLUG_DOES_STATE_CHUNKS, Pro Tools only keeps the parameters of multi-mono instances in sync. Call this on the main thread after changing
+   * state that isn't a parameter (e.g. from the UI of one instance) to restore the state of this instance into the other mono instances of the plug-in on the same track */
+  void SyncStateToMultiMonoSiblings();
+
+  /** @return The number of mono instances of this plug-in on the same track, including this one, or 0 if this instance isn't part of a multi-mono group */
+  int NMultiMonoInstances() { return IPlugInstanceGroup<IPlugAAX>::NInstancesInGroup(this); }
+
 private:
+  void RestoreStateFromSibling(const IByteChunk& chunk);
+
   AAX_CParameter<bool>* mBypassParameter = nullptr;
   AAX_ITransport* mTransport = nullptr;
   WDL_PtrList<WDL_String> mParamIDs;
-  IMidiQueue mMidiOutputQueue;
+  IMidiEventBuffer mMidiOutputQueue; // preallocated, and sorted by offset when it is posted to the MIDI output node
+  int mNInputChannels = 0; // from the stem formats, set in EffectInit()
+  int mNOutputChannels = 0;
 };
 
 IPlugAAX* MakePlug();
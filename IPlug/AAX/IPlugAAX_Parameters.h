@@ -109,12 +109,12 @@ struct AAX_SIPlugPrivateData
 //  AAX_EStemFormat       mOutputStemFormat;
 };
 
+/** The algorithm context. Every field is a registered port (see StaticDescribe()) and the host keeps one per instance, so it holds pointers only and nothing that is not used by RenderAudio() */
 struct AAX_SIPlugRenderInfo
 {
   float** mAudioInputs;           // Audio input buffers
   float** mAudioOutputs;          // Audio output buffers
   int32_t* mNumSamples;           // Number of samples in each buffer.  Bounded as per \ref AAE_EAudioBufferLengthNative.  The exact value can vary from buffer to buffer.
-  AAX_CTimestamp* mClock;         // Pointer to the global running time clock.
 
   AAX_IMIDINode* mInputNode;      // Buffered local MIDI input node.
   AAX_IMIDINode* mOutputNode;     // Buffered local MIDI output node.
@@ -50,7 +50,7 @@ void IPlugAPP::EditorPropertiesChangedFromDelegate(int viewWidth, int viewHeight
 
 bool IPlugAPP::SendMidiMsg(const IMidiMsg& msg)
 {
-  if (DoesMIDIOut() && mAppHost->mMidiOut)
+  if (DoesMIDIOut() && mAppHost && mAppHost->mMidiOut)
   {
     //TODO: midi out channel
 //    uint8_t status;
@@ -74,7 +74,7 @@ bool IPlugAPP::SendMidiMsg(const IMidiMsg& msg)
 
 bool IPlugAPP::SendSysEx(const ISysEx& msg)
 {
-  if (DoesMIDIOut() && mAppHost->mMidiOut)
+  if (DoesMIDIOut() && mAppHost && mAppHost->mMidiOut)
   {
     //TODO: midi out channel
     std::vector<uint8_t> message;
@@ -96,23 +96,84 @@ void IPlugAPP::SendSysexMsgFromUI(const ISysEx& msg)
   SendSysEx(msg);
 }
 
+void IPlugAPP::SetDeviceChannels(int nInputs, int nOutputs)
+{
+  nInputs = IsInstrument() ? 0 : std::min(nInputs, MaxNChannels(ERoute::kInput));
+  nOutputs = std::min(nOutputs, MaxNChannels(ERoute::kOutput));
+
+  SetChannelConnections(ERoute::kInput, 0, MaxNChannels(ERoute::kInput), false);
+  SetChannelConnections(ERoute::kInput, 0, nInputs, true);
+  SetChannelConnections(ERoute::kOutput, 0, MaxNChannels(ERoute::kOutput), false);
+  SetChannelConnections(ERoute::kOutput, 0, nOutputs, true);
+}
+
+void IPlugAPP::SetMidiTimeWindow(double startTime, double endTime, int nFrames)
+{
+  mMidiWindowStart = startTime;
+  mMidiWindowEnd = endTime;
+  mMidiWindowFrames = nFrames;
+  mMidiBlockStart = 0;
+}
+
+int IPlugAPP::GetMidiFrame(double time) const
+{
+  if (mMidiWindowFrames == 0) // no window, so process everything straight away
+    return 0;
+
+  if (time >= mMidiWindowEnd) // arrived after the buffer's callback, belongs to the next buffer
+    return std::numeric_limits<int>::max();
+
+  const double windowLength = mMidiWindowEnd - mMidiWindowStart;
+
+  if (windowLength <= 0.)
+    return 0;
+
+  // scale by the measured window rather than the sample rate, so that jitter in the callback timing never pushes messages past the end of the buffer
+  const int frame = (int) ((time - mMidiWindowStart) / windowLength * mMidiWindowFrames);
+
+  return Clip(frame, 0, mMidiWindowFrames - 1);
+}
+
 void IPlugAPP::AppProcess(double** inputs, double** outputs, int nFrames)
 {
-  SetChannelConnections(ERoute::kInput, 0, MaxNChannels(ERoute::kInput), !IsInstrument()); //TODO: go elsewhere - enable inputs
-  SetChannelConnections(ERoute::kOutput, 0, MaxNChannels(ERoute::kOutput), true); //TODO: go elsewhere
-  AttachBuffers(ERoute::kInput, 0, NChannelsConnected(ERoute::kInput), inputs, GetBlockSize());
-  AttachBuffers(ERoute::kOutput, 0, NChannelsConnected(ERoute::kOutput), outputs, GetBlockSize());
+  AppProcessImpl(inputs, outputs, nFrames);
+}
+
+void IPlugAPP::AppProcess(float** inputs, float** outputs, int nFrames)
+{
+  AppProcessImpl(inputs, outputs, nFrames);
+}
+
+template <typename T>
+void IPlugAPP::AppProcessImpl(T** inputs, T** outputs, int nFrames)
+{
+  AttachBuffers(ERoute::kInput, 0, NChannelsConnected(ERoute::kInput), inputs, nFrames);
+  AttachBuffers(ERoute::kOutput, 0, NChannelsConnected(ERoute::kOutput), outputs, nFrames);
   
-  if(mMidiMsgsFromCallback.ElementsAvailable())
+  // MIDI input is due in this block if it arrived during the part of the time window this block covers
+  while (mHasHeldMidiMsg || mMidiMsgsFromCallback.Pop(mHeldMidiMsg))
   {
-    IMidiMsg msg;
-    
-    while (mMidiMsgsFromCallback.Pop(msg))
-    {
+    mHasHeldMidiMsg = true;
+
+    const int frame = GetMidiFrame(mHeldMidiMsg.mTime);
+
+    if (frame >= mMidiBlockStart + nFrames)
+      break;
+
+    IMidiMsg msg = mHeldMidiMsg.mMsg;
+    msg.mOffset = std::max(frame - mMidiBlockStart, 0);
+    mHasHeldMidiMsg = false;
+
+    if (GetSampleAccurateMidi())
+      AddMidiEvent(msg);
+    else
       ProcessMidiMsg(msg);
-      mMidiMsgsFromProcessor.Push(msg); // queue incoming MIDI for UI
-    }
+
+    mMidiMsgsFromProcessor.Push(msg); // queue incoming MIDI for UI
   }
+
+  if (mMidiWindowFrames)
+    mMidiBlockStart += nFrames;
   
   if(mSysExMsgsFromCallback.ElementsAvailable())
   {
@@ -122,7 +183,7 @@ void IPlugAPP::AppProcess(double** inputs, double** outputs, int nFrames)
     {
       ISysEx msg { data.mOffset, data.mData, data.mSize };
       ProcessSysEx(msg);
-      mSysExDataFromProcessor.Push(data); // queue incoming Sysex for UI
+      mSysExDataFromProcessor.Push(data.mOffset, 0, data.mData, data.mSize); // queue incoming Sysex for UI
     }
   }
   
@@ -138,5 +199,6 @@ void IPlugAPP::AppProcess(double** inputs, double** outputs, int nFrames)
 
   //Do not handle Sysex messages here - SendSysexMsgFromUI overridden
 
-  ProcessBuffers(0.0, GetBlockSize());
+  ProcessBlockStartTasks();
+  ProcessBuffers((T) 0, nFrames);
 }
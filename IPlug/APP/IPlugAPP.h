@@ -17,6 +17,9 @@
  */
 
 
+#include <chrono>
+#include <limits>
+
 #include "IPlugPlatform.h"
 #include "IPlugAPIBase.h"
 #include "IPlugProcessor.h"
@@ -49,16 +52,59 @@ public:
   //IPlugProcessor
   bool SendMidiMsg(const IMidiMsg& msg) override;
   bool SendSysEx(const ISysEx& msg) override;
+  void ProcessParamRamps(int startIdx, int nFrames) override { RenderParamRamps(*this, startIdx, nFrames); }
+  void AllocateParamRamps() override { CreateParamRamps(*this); }
   
   //IPlugAPP
+  /** Process a block of the audio device's non-interleaved buffers
+   * @param inputs The device input channels, as many as were passed to SetDeviceChannels()
+   * @param outputs The device output channels, as many as were passed to SetDeviceChannels()
+   * @param nFrames The number of frames, no more than GetHostBlockSize() */
   void AppProcess(double** inputs, double** outputs, int nFrames);
+  void AppProcess(float** inputs, float** outputs, int nFrames);
+
+  /** Connect the plug-in's channels to the channels of the audio device. Call this when the stream is stopped
+   * @param nInputs The number of device input channels that will be passed to AppProcess()
+   * @param nOutputs The number of device output channels that will be passed to AppProcess() */
+  void SetDeviceChannels(int nInputs, int nOutputs);
+
+  /** Say which span of time the next device buffer was captured over, so that MIDI input stamped with GetMidiTime() is placed at the matching sample offset.
+   * Call this before the AppProcess() calls for each buffer. Without it, MIDI input is processed at the start of each block
+   * @param startTime The GetMidiTime() of the previous buffer's callback
+   * @param endTime The GetMidiTime() of this buffer's callback
+   * @param nFrames The number of frames in the device buffer */
+  void SetMidiTimeWindow(double startTime, double endTime, int nFrames);
+
+  /** @return The time in seconds on the clock used to stamp MIDI input, a steady high resolution clock */
+  static double GetMidiTime() { return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
 
 private:
+  template <typename T>
+  void AppProcessImpl(T** inputs, T** outputs, int nFrames);
+
+  /** @return The frame of the current device buffer a MIDI message stamped at time belongs to, 0 if it came before the buffer, or nFrames if after it */
+  int GetMidiFrame(double time) const;
+
+  /** MIDI input from the MIDI callback, stamped with GetMidiTime() on arrival */
+  struct TimedMidiMsg
+  {
+    IMidiMsg mMsg;
+    double mTime = 0.;
+  };
+
   IPlugAPPHost* mAppHost = nullptr;
-  IPlugQueue<IMidiMsg> mMidiMsgsFromCallback {MIDI_TRANSFER_SIZE};
+  IPlugQueue<TimedMidiMsg> mMidiMsgsFromCallback {MIDI_TRANSFER_SIZE};
+  TimedMidiMsg mHeldMidiMsg; // popped from mMidiMsgsFromCallback, but not due until a later block
+  bool mHasHeldMidiMsg = false;
+  double mMidiWindowStart = 0.; // see SetMidiTimeWindow()
+  double mMidiWindowEnd = 0.;
+  int mMidiWindowFrames = 0;
+  int mMidiBlockStart = 0; // the frame of the current device buffer that the next AppProcess() block starts at
   IPlugQueue<SysExData> mSysExMsgsFromCallback {SYSEX_TRANSFER_SIZE};
 
   friend class IPlugAPPHost;
+  friend class IPlugAPPOfflineRenderer;
+  friend class IPlugAPPBenchmark;
 };
 
 IPlugAPP* MakePlug(void* pAPPHost);
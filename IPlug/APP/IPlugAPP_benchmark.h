@@ -0,0 +1,453 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IPlugAPPBenchmark
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "wdlstring.h"
+
+#include "IPlugAPP.h"
+
+/** Measures the plug-in's processing without an audio device or a UI, for performance regressions in CI. The plug-in is driven through IPlugAPP::AppProcess()
+ * with a generated signal, at each combination of block size and sample rate, as fast as the CPU allows. The command line is:
+ *
+ *     app --benchmark [--seconds S] [--warmup S] [--blocksizes 64,512] [--samplerates 44100,96000] [--inputs N] [--outputs N]
+ *                     [--signal noise|sine|impulse|silence] [--script file.txt] [--preset file.fxp] [--csv file.csv] [--min-realtime X] [--max-allocations N]
+ *
+ * For each combination the realtime factor, the 50th, 90th and 99th percentile and the longest block times and the number of allocations on the processing thread
+ * are printed, and appended to the csv file if there is one. Allocations are only counted if IPLUG_COUNT_ALLOCATIONS is set, which it is for the APP by default.
+ * The exit code is 1 if a combination is slower than --min-realtime or allocates more than --max-allocations, so that CI can fail on a regression.
+ *
+ * A script is a text file with an event per line, at a time in seconds from the end of the warm up, which is applied at the start of the block it falls in,
+ * or at its offset in the block for MIDI. # starts a comment.
+ *
+ *     0.0   param 0 0.5     # set parameter 0 to a normalized value
+ *     0.0   noteon 60 100   # note number, velocity
+ *     1.0   noteoff 60
+ *     0.5   cc 1 0.25       # controller, normalized value
+ *     2.0   pitchbend -0.5
+ *
+ * Instruments without a script play a generated arpeggio, so that their voices are measured */
+class IPlugAPPBenchmark
+{
+public:
+  struct Options
+  {
+    double mSeconds = 10.; // the measured length of each run
+    double mWarmupSeconds = 0.5; // processed before measuring, so that caches, denormals and lazy allocations settle
+    std::vector<int> mBlockSizes {64, 512};
+    std::vector<double> mSampleRates {48000.};
+    int mNInputs = -1; // -1 for the plug-in's maximum
+    int mNOutputs = -1;
+    WDL_String mSignal {"noise"};
+    WDL_String mScriptPath;
+    WDL_String mPresetPath;
+    WDL_String mCSVPath;
+    double mMinRealtime = 0.;
+    int mMaxAllocations = -1; // -1 for no limit
+  };
+
+  /** @return \c true if the command line asks for a benchmark, in which case options are filled in */
+  static bool ParseCommandLine(int argc, char* argv[], Options& options)
+  {
+    if (argc < 2 || strcmp(argv[1], "--benchmark"))
+      return false;
+
+    for (int i = 2; i < argc; i++)
+    {
+      const char* arg = argv[i];
+      const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+      if (!value)
+        printf("ignoring %s\n", arg);
+      else if (!strcmp(arg, "--seconds")) { options.mSeconds = std::max(atof(value), 0.01); i++; }
+      else if (!strcmp(arg, "--warmup")) { options.mWarmupSeconds = std::max(atof(value), 0.); i++; }
+      else if (!strcmp(arg, "--blocksizes")) { ParseList(value, options.mBlockSizes); i++; }
+      else if (!strcmp(arg, "--samplerates")) { ParseList(value, options.mSampleRates); i++; }
+      else if (!strcmp(arg, "--inputs")) { options.mNInputs = std::max(atoi(value), 0); i++; }
+      else if (!strcmp(arg, "--outputs")) { options.mNOutputs = std::max(atoi(value), 0); i++; }
+      else if (!strcmp(arg, "--signal")) { options.mSignal.Set(value); i++; }
+      else if (!strcmp(arg, "--script")) { options.mScriptPath.Set(value); i++; }
+      else if (!strcmp(arg, "--preset")) { options.mPresetPath.Set(value); i++; }
+      else if (!strcmp(arg, "--csv")) { options.mCSVPath.Set(value); i++; }
+      else if (!strcmp(arg, "--min-realtime")) { options.mMinRealtime = atof(value); i++; }
+      else if (!strcmp(arg, "--max-allocations")) { options.mMaxAllocations = atoi(value); i++; }
+      else
+        printf("ignoring %s\n", arg);
+    }
+
+    return true;
+  }
+
+  /** Run every combination of block size and sample rate, printing the results to stdout. Call this on the main thread, instead of starting the app
+   * @return The process exit code, 0 if every combination met the limits */
+  static int Run(const Options& options)
+  {
+    std::unique_ptr<IPlugAPP> plug(MakePlug(nullptr));
+
+    if (options.mPresetPath.GetLength() && !plug->LoadProgramFromFXP(options.mPresetPath.Get()))
+    {
+      printf("couldn't load preset %s\n", options.mPresetPath.Get());
+      return 1;
+    }
+
+    std::vector<Event> script;
+
+    if (options.mScriptPath.GetLength())
+    {
+      if (!ReadScript(options.mScriptPath.Get(), script))
+        return 1;
+    }
+    else if (plug->IsInstrument())
+      MakeArpeggio(options.mSeconds, script);
+
+    const ESignal signal = GetSignal(options.mSignal.Get());
+
+    if (signal == kNumSignals)
+    {
+      printf("unknown signal %s, use noise, sine, impulse or silence\n", options.mSignal.Get());
+      return 1;
+    }
+
+    std::unique_ptr<FILE, int(*)(FILE*)> csv(options.mCSVPath.GetLength() ? fopen(options.mCSVPath.Get(), "a") : nullptr, [](FILE* fp) { return fp ? fclose(fp) : 0; });
+
+    if (csv && ftell(csv.get()) == 0)
+      fprintf(csv.get(), "plugin,samplerate,blocksize,inputs,outputs,realtime,p50_us,p90_us,p99_us,max_us,allocations\n");
+
+    bool failed = false;
+
+    for (auto sampleRate : options.mSampleRates)
+    {
+      for (auto blockSize : options.mBlockSizes)
+      {
+        Result result;
+        RunOne(*plug, options, signal, script, sampleRate, blockSize, result);
+
+        const bool tooSlow = options.mMinRealtime > 0. && result.mRealtime < options.mMinRealtime;
+        const bool tooManyAllocations = options.mMaxAllocations >= 0 && result.mNAllocations > (uint64_t) options.mMaxAllocations;
+
+        printf("%s %g Hz, %i frames, %i in %i out: %.1fx realtime, block us p50 %.1f p90 %.1f p99 %.1f max %.1f, allocations %s%s\n",
+               plug->GetPluginName(), sampleRate, blockSize, result.mNInputs, result.mNOutputs, result.mRealtime,
+               result.mP50 * 1e6, result.mP90 * 1e6, result.mP99 * 1e6, result.mMax * 1e6, AllocationsStr(result.mNAllocations).Get(),
+               tooSlow ? " TOO SLOW" : tooManyAllocations ? " TOO MANY ALLOCATIONS" : "");
+
+        PrintMarkers(plug->GetProfiler());
+
+        if (csv)
+          fprintf(csv.get(), "%s,%g,%i,%i,%i,%.3f,%.3f,%.3f,%.3f,%.3f,%s\n", plug->GetPluginName(), sampleRate, blockSize, result.mNInputs, result.mNOutputs,
+                  result.mRealtime, result.mP50 * 1e6, result.mP90 * 1e6, result.mP99 * 1e6, result.mMax * 1e6, AllocationsStr(result.mNAllocations).Get());
+
+        failed |= tooSlow || tooManyAllocations;
+      }
+    }
+
+    return failed ? 1 : 0;
+  }
+
+private:
+  enum ESignal { kNoise, kSine, kImpulse, kSilence, kNumSignals };
+
+  enum EEventType { kParam, kNoteOn, kNoteOff, kCC, kPitchBend };
+
+  struct Event
+  {
+    double mTime;
+    EEventType mType;
+    int mIdx;
+    double mValue;
+  };
+
+  struct Result
+  {
+    int mNInputs = 0;
+    int mNOutputs = 0;
+    double mRealtime = 0.;
+    double mP50 = 0.;
+    double mP90 = 0.;
+    double mP99 = 0.;
+    double mMax = 0.;
+    uint64_t mNAllocations = 0;
+  };
+
+  template <typename T>
+  static void ParseList(const char* str, std::vector<T>& list)
+  {
+    list.clear();
+
+    for (const char* p = str; *p; )
+    {
+      const double v = atof(p);
+
+      if (v > 0.)
+        list.push_back((T) v);
+
+      p = strchr(p, ',');
+
+      if (!p)
+        break;
+
+      p++;
+    }
+  }
+
+  static ESignal GetSignal(const char* name)
+  {
+    static const char* names[kNumSignals] = { "noise", "sine", "impulse", "silence" };
+
+    for (int i = 0; i < kNumSignals; i++)
+    {
+      if (!strcmp(name, names[i]))
+        return (ESignal) i;
+    }
+
+    return kNumSignals;
+  }
+
+  static WDL_String AllocationsStr(uint64_t nAllocations)
+  {
+    WDL_String str;
+#if IPLUG_COUNT_ALLOCATIONS
+    str.SetFormatted(32, "%llu", (unsigned long long) nAllocations);
+#else
+    str.Set("not counted");
+#endif
+    return str;
+  }
+
+  static bool ReadScript(const char* path, std::vector<Event>& script)
+  {
+    std::unique_ptr<FILE, int(*)(FILE*)> fp(fopen(path, "r"), fclose);
+
+    if (!fp)
+    {
+      printf("couldn't open script %s\n", path);
+      return false;
+    }
+
+    char line[256];
+    int lineNumber = 0;
+
+    while (fgets(line, sizeof(line), fp.get()))
+    {
+      lineNumber++;
+
+      if (char* pComment = strchr(line, '#'))
+        *pComment = '\0';
+
+      char type[32];
+      Event event {};
+      double a = 0., b = 0.;
+      const int n = sscanf(line, "%lf %31s %lf %lf", &event.mTime, type, &a, &b);
+
+      if (n <= 0)
+        continue;
+
+      if (n >= 3 && !strcmp(type, "param")) { event.mType = kParam; event.mIdx = (int) a; event.mValue = b; }
+      else if (n >= 3 && !strcmp(type, "noteon")) { event.mType = kNoteOn; event.mIdx = (int) a; event.mValue = n == 4 ? b : 100.; }
+      else if (n >= 3 && !strcmp(type, "noteoff")) { event.mType = kNoteOff; event.mIdx = (int) a; }
+      else if (n == 4 && !strcmp(type, "cc")) { event.mType = kCC; event.mIdx = (int) a; event.mValue = b; }
+      else if (n >= 3 && !strcmp(type, "pitchbend")) { event.mType = kPitchBend; event.mValue = a; }
+      else
+      {
+        printf("%s:%i: can't parse %s", path, lineNumber, line);
+        return false;
+      }
+
+      script.push_back(event);
+    }
+
+    std::stable_sort(script.begin(), script.end(), [](const Event& a, const Event& b) { return a.mTime < b.mTime; });
+    return true;
+  }
+
+  /** Eight notes a second, each held for half a second, so that four voices are playing most of the time */
+  static void MakeArpeggio(double seconds, std::vector<Event>& script)
+  {
+    static const int notes[] = { 48, 55, 60, 64, 67, 72, 76, 79 };
+
+    for (int i = 0; i * 0.125 < seconds; i++)
+    {
+      const int note = notes[i % 8];
+      script.push_back({ i * 0.125, kNoteOn, note, 100. });
+      script.push_back({ i * 0.125 + 0.5, kNoteOff, note, 0. });
+    }
+
+    std::stable_sort(script.begin(), script.end(), [](const Event& a, const Event& b) { return a.mTime < b.mTime; });
+  }
+
+  static void ApplyEvent(IPlugAPP& plug, const Event& event, int offset)
+  {
+    IMidiMsg msg;
+
+    switch (event.mType)
+    {
+      case kParam:
+        if (event.mIdx >= 0 && event.mIdx < plug.NParams())
+        {
+          plug.GetParam(event.mIdx)->SetNormalized(event.mValue);
+          plug.OnParamChange(event.mIdx, kHost, offset);
+        }
+        return;
+      case kNoteOn: msg.MakeNoteOnMsg(event.mIdx, (int) event.mValue, offset); break;
+      case kNoteOff: msg.MakeNoteOffMsg(event.mIdx, offset); break;
+      case kCC: msg.MakeControlChangeMsg((IMidiMsg::EControlChangeMsg) event.mIdx, event.mValue, 0, offset); break;
+      case kPitchBend: msg.MakePitchWheelMsg(event.mValue, 0, offset); break;
+    }
+
+    if (plug.GetSampleAccurateMidi())
+      plug.AddMidiEvent(msg);
+    else
+      plug.ProcessMidiMsg(msg);
+  }
+
+  /** Fill the inputs for a block, which is done before the block is timed */
+  static void Generate(ESignal signal, std::vector<std::vector<double>>& inputs, int nFrames, int64_t startFrame, double sampleRate, uint32_t& seed)
+  {
+    for (size_t c = 0; c < inputs.size(); c++)
+    {
+      double* pSample = inputs[c].data();
+
+      for (int s = 0; s < nFrames; s++)
+      {
+        const int64_t frame = startFrame + s;
+
+        switch (signal)
+        {
+          case kNoise:
+            // xorshift, so that every run gets the same noise
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            pSample[s] = (seed / 4294967295.0 * 2. - 1.) * 0.5;
+            break;
+          case kSine:
+            pSample[s] = 0.5 * std::sin(2. * PI * 440. * frame / sampleRate);
+            break;
+          case kImpulse:
+            pSample[s] = frame % (int64_t) sampleRate == 0 ? 1. : 0.;
+            break;
+          default:
+            pSample[s] = 0.;
+            break;
+        }
+      }
+    }
+  }
+
+  static void RunOne(IPlugAPP& plug, const Options& options, ESignal signal, const std::vector<Event>& script, double sampleRate, int blockSize, Result& result)
+  {
+    const int nInputs = options.mNInputs < 0 ? plug.MaxNChannels(ERoute::kInput) : std::min(options.mNInputs, plug.MaxNChannels(ERoute::kInput));
+    const int nOutputs = options.mNOutputs < 0 ? plug.MaxNChannels(ERoute::kOutput) : std::min(options.mNOutputs, plug.MaxNChannels(ERoute::kOutput));
+
+    plug.SetDeviceChannels(nInputs, nOutputs);
+    plug.SetSampleRate(sampleRate);
+    plug.SetBlockSize(blockSize);
+    plug.SetRenderingOffline(false);
+    plug.OnReset();
+    plug.OnActivate(true);
+
+    result.mNInputs = plug.NChannelsConnected(ERoute::kInput);
+    result.mNOutputs = plug.NChannelsConnected(ERoute::kOutput);
+
+    std::vector<std::vector<double>> inputs(result.mNInputs, std::vector<double>(blockSize, 0.));
+    std::vector<std::vector<double>> outputs(result.mNOutputs, std::vector<double>(blockSize, 0.));
+    std::vector<double*> inputPtrs(result.mNInputs), outputPtrs(result.mNOutputs);
+
+    for (int c = 0; c < result.mNInputs; c++)
+      inputPtrs[c] = inputs[c].data();
+
+    for (int c = 0; c < result.mNOutputs; c++)
+      outputPtrs[c] = outputs[c].data();
+
+    const int64_t nWarmupFrames = (int64_t) (options.mWarmupSeconds * sampleRate);
+    const int64_t nFrames = nWarmupFrames + std::max((int64_t) (options.mSeconds * sampleRate), (int64_t) 1);
+    std::vector<double> blockTimes;
+    blockTimes.reserve((size_t) ((nFrames - nWarmupFrames) / blockSize + 1));
+
+    uint32_t seed = 0x9E3779B9;
+    size_t nextEvent = 0;
+    double totalTime = 0.;
+
+    for (int64_t frame = 0; frame < nFrames; frame += blockSize)
+    {
+      const int n = (int) std::min((int64_t) blockSize, nFrames - frame);
+      const bool measured = frame >= nWarmupFrames;
+
+      Generate(signal, inputs, n, frame, sampleRate, seed);
+
+      // script times start after the warm up
+      const double blockEnd = (frame + n - nWarmupFrames) / sampleRate;
+
+      for (; nextEvent < script.size() && script[nextEvent].mTime < blockEnd; nextEvent++)
+      {
+        const int offset = Clip((int) ((script[nextEvent].mTime * sampleRate) - (frame - nWarmupFrames)), 0, n - 1);
+        ApplyEvent(plug, script[nextEvent], offset);
+      }
+
+      if (!measured)
+      {
+        plug.AppProcess(inputPtrs.data(), outputPtrs.data(), n);
+        continue;
+      }
+
+      const uint64_t nAllocations = IAllocationCounter::GetCount();
+      const auto start = std::chrono::steady_clock::now();
+
+      {
+        IAllocationCounter::Scope countAllocations;
+        plug.AppProcess(inputPtrs.data(), outputPtrs.data(), n);
+      }
+
+      const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      result.mNAllocations += IAllocationCounter::GetCount() - nAllocations;
+      blockTimes.push_back(elapsed);
+      totalTime += elapsed;
+    }
+
+    plug.OnActivate(false);
+
+    if (blockTimes.empty())
+      return;
+
+    std::sort(blockTimes.begin(), blockTimes.end());
+
+    auto percentile = [&](double p) { return blockTimes[std::min((size_t) (p * blockTimes.size()), blockTimes.size() - 1)]; };
+
+    result.mRealtime = totalTime > 0. ? (nFrames - nWarmupFrames) / sampleRate / totalTime : 0.;
+    result.mP50 = percentile(0.5);
+    result.mP90 = percentile(0.9);
+    result.mP99 = percentile(0.99);
+    result.mMax = blockTimes.back();
+  }
+
+  /** Print the IPLUG_PROFILE_SCOPE markers of the last run, if there are any */
+  static void PrintMarkers(const IPlugProfiler& profiler)
+  {
+    for (int i = 0; i < profiler.GetNMarkers(); i++)
+    {
+      const IPlugProfiler::Stats stats = profiler.GetMarkerStats(i);
+      printf("  %s: us per block min %.1f mean %.1f max %.1f\n", profiler.GetMarkerName(i), stats.min * 1e6, stats.mean * 1e6, stats.max * 1e6);
+    }
+  }
+};
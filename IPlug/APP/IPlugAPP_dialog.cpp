@@ -17,6 +17,8 @@
 #define GET_MENU() GetMenu(gHWND)
 #elif defined OS_MAC
 #define GET_MENU() SWELL_GetCurrentMenu()
+#elif defined OS_LINUX
+#define GET_MENU() GetMenu(gHWND)
 #endif
 
 #if defined _DEBUG && !defined NO_IGRAPHICS
@@ -162,6 +164,8 @@ void IPlugAPPHost::PopulateDriverSpecificControls(HWND hwndDlg)
   RtAudio::DeviceInfo inputDevInfo;
   RtAudio::DeviceInfo outputDevInfo;
 
+  std::lock_guard<std::mutex> lock(mDACMutex); // waits for a stream that is being reopened
+
   if (mAudioInputDevs.size())
   {
     inputDevInfo = mDAC->getDeviceInfo(mAudioInputDevs[indevidx]);
@@ -285,6 +289,17 @@ void IPlugAPPHost::PopulatePreferencesDialog(HWND hwndDlg)
   PopulateAudioDialogs(hwndDlg);
   PopulateMidiDialogs(hwndDlg);
 }
+
+#elif defined OS_LINUX
+void IPlugAPPHost::PopulatePreferencesDialog(HWND hwndDlg)
+{
+  SendDlgItemMessage(hwndDlg,IDC_COMBO_AUDIO_DRIVER,CB_ADDSTRING,0,(LPARAM)"ALSA");
+  SendDlgItemMessage(hwndDlg,IDC_COMBO_AUDIO_DRIVER,CB_ADDSTRING,0,(LPARAM)"JACK");
+  SendDlgItemMessage(hwndDlg,IDC_COMBO_AUDIO_DRIVER,CB_SETCURSEL, mState.mAudioDriverType, 0);
+
+  PopulateAudioDialogs(hwndDlg);
+  PopulateMidiDialogs(hwndDlg);
+}
 #else
   #error NOT IMPLEMENTED
 #endif
@@ -454,6 +469,9 @@ WDL_DLGRET IPlugAPPHost::PreferencesDlgProc(HWND hwndDlg, UINT uMsg, WPARAM wPar
               ASIOControlPanel();
             #elif defined OS_MAC
             system("open \"/Applications/Utilities/Audio MIDI Setup.app\"");
+            #elif defined OS_LINUX
+            if (_this->mState.mAudioDriverType == kDeviceJack)
+              system("qjackctl &"); // the JACK server's buffer size and periods are set there
             #else
               #error NOT IMPLEMENTED
             #endif
@@ -542,9 +560,9 @@ WDL_DLGRET IPlugAPPHost::MainDlgProc(HWND hwndDlg, UINT uMsg, WPARAM wParam, LPA
       
       #ifdef OS_WIN
       PostQuitMessage(0);
-      #else
+      #elif defined OS_MAC
       SWELL_PostQuitMessage(hwndDlg);
-      #endif
+      #endif // on Linux the message loop ends once the window has been destroyed
 
       return 0;
     case WM_CLOSE:
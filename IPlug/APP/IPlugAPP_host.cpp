@@ -10,10 +10,14 @@
 
 #include "IPlugAPP_host.h"
 
-#ifdef OS_WIN
+#if defined OS_WIN || defined OS_LINUX
 #include <sys/stat.h>
 #endif
 
+#ifdef OS_LINUX
+#include <sched.h>
+#endif
+
 #include "IPlugLogger.h"
 
 #ifndef MAX_PATH_LEN
@@ -28,10 +32,22 @@ UINT gSCROLLMSG;
 IPlugAPPHost::IPlugAPPHost()
 {
   mIPlug = MakePlug(this);
+  mIPlug->AttachHandoff(&mStreamConfig); // old stream configs are freed on the plug-in's timer
 }
 
 IPlugAPPHost::~IPlugAPPHost()
 {
+  if (mAudioDeviceThread.joinable())
+  {
+    {
+      std::lock_guard<std::mutex> lock(mRequestMutex);
+      mQuitAudioDeviceThread = true;
+    }
+
+    mRequestCV.notify_one();
+    mAudioDeviceThread.join();
+  }
+
   if(mMidiIn)
     mMidiIn->cancelCallback();
 
@@ -65,6 +81,7 @@ bool IPlugAPPHost::Init()
     return false;
   
   TryToChangeAudioDriverType(); // will init RTAudio with an API type based on gState->mAudioDriverType
+  mAudioDeviceThread = std::thread(&IPlugAPPHost::AudioDeviceThread, this); // opens streams requested by TryToChangeAudio()
   ProbeAudioIO(); // find out what audio IO devs are available and put their IDs in the global variables gAudioInputDevs / gAudioOutputDevs
   InitMidi(); // creates RTMidiIn and RTMidiOut objects
   ProbeMidiIO(); // find out what midi IO devs are available and put their names in the global variables gMidiInputDevs / gMidiOutputDevs
@@ -101,6 +118,11 @@ bool IPlugAPPHost::InitState()
   mINIPath.SetFormatted(MAX_PATH_LEN, "%s\\%s\\", strPath, BUNDLE_NAME);
 #elif defined OS_MAC
   mINIPath.SetFormatted(MAX_PATH_LEN, "%s/Library/Application Support/%s/", getenv("HOME"), BUNDLE_NAME);
+#elif defined OS_LINUX
+  if (const char* configHome = getenv("XDG_CONFIG_HOME"))
+    mINIPath.SetFormatted(MAX_PATH_LEN, "%s/%s/", configHome, BUNDLE_NAME);
+  else
+    mINIPath.SetFormatted(MAX_PATH_LEN, "%s/.config/%s/", getenv("HOME"), BUNDLE_NAME);
 #else
   #error NOT IMPLEMENTED
 #endif
@@ -119,8 +141,8 @@ bool IPlugAPPHost::InitState()
       
       mState.mAudioDriverType = GetPrivateProfileInt("audio", "driver", 0, mINIPath.Get());
 
-      GetPrivateProfileString("audio", "indev", "Built-in Input", buf, STRBUFSZ, mINIPath.Get()); mState.mAudioInDev.Set(buf);
-      GetPrivateProfileString("audio", "outdev", "Built-in Output", buf, STRBUFSZ, mINIPath.Get()); mState.mAudioOutDev.Set(buf);
+      GetPrivateProfileString("audio", "indev", DEFAULT_INPUT_DEV, buf, STRBUFSZ, mINIPath.Get()); mState.mAudioInDev.Set(buf);
+      GetPrivateProfileString("audio", "outdev", DEFAULT_OUTPUT_DEV, buf, STRBUFSZ, mINIPath.Get()); mState.mAudioOutDev.Set(buf);
 
       //audio
       mState.mAudioInChanL = GetPrivateProfileInt("audio", "in1", 1, mINIPath.Get()); // 1 is first audio input
@@ -164,6 +186,16 @@ bool IPlugAPPHost::InitState()
     {
       return false;
     }
+#elif defined OS_LINUX
+    if(!mkdir(mINIPath.Get(), S_IRWXU))
+    {
+      mINIPath.Append("settings.ini");
+      UpdateINI(); // will write file if doesn't exist
+    }
+    else
+    {
+      return false;
+    }
 #else
   #error NOT IMPLEMENTED
 #endif
@@ -234,7 +266,7 @@ int IPlugAPPHost::GetMIDIPortNumber(ERoute direction, const char* nameToTest) co
   {
     if(!strcmp(nameToTest, OFF_TEXT)) return 0;
     
-  #ifdef OS_MAC
+  #if defined OS_MAC || defined OS_LINUX
     start = 2;
     if(!strcmp(nameToTest, "virtual input")) return 1;
   #endif
@@ -249,7 +281,7 @@ int IPlugAPPHost::GetMIDIPortNumber(ERoute direction, const char* nameToTest) co
   {
     if(!strcmp(nameToTest, OFF_TEXT)) return 0;
   
-  #ifdef OS_MAC
+  #if defined OS_MAC || defined OS_LINUX
     start = 2;
     if(!strcmp(nameToTest, "virtual output")) return 1;
   #endif
@@ -274,6 +306,8 @@ void IPlugAPPHost::ProbeAudioIO()
   mAudioOutputDevs.clear();
   mAudioIDDevNames.clear();
 
+  std::lock_guard<std::mutex> lock(mDACMutex); // waits for a stream that is being reopened
+
   uint32_t nDevices = mDAC->getDeviceCount();
 
   for (int i=0; i<nDevices; i++)
@@ -322,7 +356,7 @@ void IPlugAPPHost::ProbeMidiIO()
 
     mMidiInputDevNames.push_back(OFF_TEXT);
 
-#ifdef OS_MAC
+#if defined OS_MAC || defined OS_LINUX
     mMidiInputDevNames.push_back("virtual input");
 #endif
 
@@ -335,7 +369,7 @@ void IPlugAPPHost::ProbeMidiIO()
 
     mMidiOutputDevNames.push_back(OFF_TEXT);
 
-#ifdef OS_MAC
+#if defined OS_MAC || defined OS_LINUX
     mMidiOutputDevNames.push_back("virtual output");
 #endif
 
@@ -375,6 +409,14 @@ bool IPlugAPPHost::MIDISettingsInStateAreEqual(AppState& os, AppState& ns)
 
 bool IPlugAPPHost::TryToChangeAudioDriverType()
 {
+  {
+    // a request for devices of the old driver type is meaningless now
+    std::lock_guard<std::mutex> lock(mRequestMutex);
+    mHasRequest = false;
+  }
+
+  std::lock_guard<std::mutex> lock(mDACMutex);
+
   if (mDAC)
   {
     if (mDAC->isStreamOpen())
@@ -395,6 +437,12 @@ bool IPlugAPPHost::TryToChangeAudioDriverType()
     mDAC = new RtAudio(RtAudio::MACOSX_CORE);
   //else
   //mDAC = new RtAudio(RtAudio::UNIX_JACK);
+#elif defined OS_LINUX
+  // RtAudio only compiles the APIs the build defines, __UNIX_JACK__ and __LINUX_ALSA__. Without them it falls back to its dummy API, which has no devices
+  if(mState.mAudioDriverType == kDeviceJack)
+    mDAC = new RtAudio(RtAudio::UNIX_JACK);
+  else
+    mDAC = new RtAudio(RtAudio::LINUX_ALSA);
 #else
   #error NOT IMPLEMENTED
 #endif
@@ -415,7 +463,7 @@ bool IPlugAPPHost::TryToChangeAudio()
     inputID = GetAudioDeviceIdx(mState.mAudioOutDev.Get());
   else
     inputID = GetAudioDeviceIdx(mState.mAudioInDev.Get());
-#elif defined OS_MAC
+#elif defined OS_MAC || defined OS_LINUX
   inputID = GetAudioDeviceIdx(mState.mAudioInDev.Get());
 #else
   #error NOT IMPLEMENTED
@@ -466,12 +514,65 @@ bool IPlugAPPHost::TryToChangeAudio()
 
   if (inputID != -1 && outputID != -1)
   {
-    return InitAudio(inputID, outputID, mState.mAudioSR, mState.mBufferSize);
+    {
+      std::lock_guard<std::mutex> lock(mRequestMutex);
+      mRequest = { (uint32_t) inputID, (uint32_t) outputID, mState.mAudioSR, mState.mBufferSize };
+      mHasRequest = true;
+    }
+
+    mRequestCV.notify_one();
+    mActiveState = mState;
+
+    return true;
   }
 
   return false;
 }
 
+void IPlugAPPHost::AudioDeviceThread()
+{
+  std::unique_lock<std::mutex> lock(mRequestMutex);
+
+  while (true)
+  {
+    mRequestCV.wait(lock, [this]() { return mHasRequest || mQuitAudioDeviceThread; });
+
+    if (mQuitAudioDeviceThread)
+      return;
+
+    const AudioDeviceRequest request = mRequest;
+    mHasRequest = false;
+    lock.unlock();
+
+    {
+      std::lock_guard<std::mutex> dacLock(mDACMutex);
+
+      if (mDAC)
+      {
+        FadeOutStream();
+
+        if (!InitAudio(request.mInputID, request.mOutputID, request.mSampleRate, request.mBufferSize))
+          DBGMSG("failed to open audio stream\n");
+      }
+    }
+
+    lock.lock();
+  }
+}
+
+void IPlugAPPHost::FadeOutStream()
+{
+  if (!mDAC->isStreamRunning())
+    return;
+
+  mFadedOut = false;
+  mFadeOutRequested = true;
+
+  // the fade takes one device buffer, give up after a while in case the device has stopped calling back
+  for (int i = 0; i < 500 && !mFadedOut; i++)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
 bool IPlugAPPHost::SelectMIDIDevice(ERoute direction, const char* pPortName)
 {
   int port = GetMIDIPortNumber(direction, pPortName);
@@ -500,7 +601,7 @@ bool IPlugAPPHost::SelectMIDIDevice(ERoute direction, const char* pPortName)
         mMidiIn->openPort(port-1);
         return true;
       }
-  #elif defined OS_MAC
+  #elif defined OS_MAC || defined OS_LINUX
       else if(port == 1)
       {
         std::string virtualMidiInputName = "To ";
@@ -540,7 +641,7 @@ bool IPlugAPPHost::SelectMIDIDevice(ERoute direction, const char* pPortName)
         mMidiOut->openPort(port-1);
         return true;
       }
-#elif defined OS_MAC
+#elif defined OS_MAC || defined OS_LINUX
       else if(port == 1)
       {
         std::string virtualMidiOutputName = "From ";
@@ -581,14 +682,44 @@ bool IPlugAPPHost::InitAudio(uint32_t inId, uint32_t outId, uint32_t sr, uint32_
     mDAC->closeStream();
   }
 
+  RtAudio::DeviceInfo inInfo, outInfo;
+
+  try
+  {
+    inInfo = mDAC->getDeviceInfo(inId);
+    outInfo = mDAC->getDeviceInfo(outId);
+  }
+  catch (RtAudioError& e)
+  {
+    e.printMessage();
+    return false;
+  }
+
+  // open as many channels as both the plug-in and the devices have
+  mIPlug->SetDeviceChannels((int) inInfo.inputChannels, (int) outInfo.outputChannels);
+
+  std::unique_ptr<StreamConfig> pConfig(new StreamConfig);
+  const int nInputChans = pConfig->mNInputChans = mIPlug->NChannelsConnected(ERoute::kInput);
+  const int nOutputChans = pConfig->mNOutputChans = mIPlug->NChannelsConnected(ERoute::kOutput);
+
+  pConfig->mInputPtrsD.Resize(nInputChans); pConfig->mInputPtrsF.Resize(nInputChans);
+  pConfig->mOutputPtrsD.Resize(nOutputChans); pConfig->mOutputPtrsF.Resize(nOutputChans);
+
+  // ask for float32 if that's what the devices use, rather than have RtAudio convert to and from float64 on every buffer
+  auto isNativeFloat32 = [](const RtAudio::DeviceInfo& info) {
+    return (info.nativeFormats & RTAUDIO_FLOAT32) && !(info.nativeFormats & RTAUDIO_FLOAT64);
+  };
+
+  const bool useFloat32 = pConfig->mUseFloat32 = isNativeFloat32(outInfo) && (nInputChans == 0 || isNativeFloat32(inInfo));
+
   RtAudio::StreamParameters iParams, oParams;
   iParams.deviceId = inId;
-  iParams.nChannels = 2; // TODO: flexible channel count
-  iParams.firstChannel = 0; // TODO: flexible channel count
+  iParams.nChannels = nInputChans;
+  iParams.firstChannel = 0; // TODO: flexible first channel
 
   oParams.deviceId = outId;
-  oParams.nChannels = 2; // TODO: flexible channel count
-  oParams.firstChannel = 0; // TODO: flexible channel count
+  oParams.nChannels = nOutputChans;
+  oParams.firstChannel = 0; // TODO: flexible first channel
 
   mBufferSize = iovs; // mBufferSize may get changed by stream
 
@@ -596,20 +727,35 @@ bool IPlugAPPHost::InitAudio(uint32_t inId, uint32_t outId, uint32_t sr, uint32_
 
   RtAudio::StreamOptions options;
   options.flags = RTAUDIO_NONINTERLEAVED;
-  // options.streamName = BUNDLE_NAME; // JACK stream name, not used on other streams
+  options.streamName = BUNDLE_NAME; // JACK client name, which the ports registered for each channel are listed under, not used on other streams
+#ifdef OS_LINUX
+  // ALSA opens the buffer size nearest to mBufferSize as a period, which is what the callback is then given, and runs the callback with SCHED_RR, as JACK does its clients.
+  // JACK runs at the server's buffer size, whatever is asked for
+  options.flags |= RTAUDIO_SCHEDULE_REALTIME;
+  options.numberOfBuffers = APP_DEVICE_PERIODS;
+  options.priority = sched_get_priority_max(SCHED_RR);
+#endif
 
-  mBufIndex = 0;
   mSamplesElapsed = 0;
   mFadeMult = 0.;
+  mFadeOutRequested = false;
+  mFadedOut = false;
+  mLastCallbackTime = 0.;
   mSampleRate = (double) sr;
-  
-  mIPlug->SetBlockSize(APP_SIGNAL_VECTOR_SIZE);
-  mIPlug->SetSampleRate(mSampleRate);
-  mIPlug->OnReset();
+
+  // the stream is closed, so the callback will pick this up when it first runs
+  mStreamConfig.Publish(std::move(pConfig));
 
   try
   {
-    mDAC->openStream(&oParams, &iParams, RTAUDIO_FLOAT64, sr, &mBufferSize, &AudioCallback, NULL, &options /*, &ErrorCallback */);
+    mDAC->openStream(&oParams, nInputChans ? &iParams : nullptr, useFloat32 ? RTAUDIO_FLOAT32 : RTAUDIO_FLOAT64, sr, &mBufferSize, &AudioCallback, NULL, &options /*, &ErrorCallback */);
+
+    // the device buffer size is only known once the stream is open
+    const uint32_t blockSize = APP_SIGNAL_VECTOR_SIZE > 0 ? std::min<uint32_t>(APP_SIGNAL_VECTOR_SIZE, mBufferSize) : mBufferSize;
+    mIPlug->SetBlockSize(blockSize);
+    mIPlug->SetSampleRate(mSampleRate);
+    mIPlug->OnReset();
+
     mDAC->startStream();
 
     mActiveState = mState;
@@ -653,56 +799,108 @@ bool IPlugAPPHost::InitMidi()
   return true;
 }
 
-// static
-int IPlugAPPHost::AudioCallback(void* pOutputBuffer, void* pInputBuffer, uint32_t nFrames, double streamTime, RtAudioStreamStatus status, void* pUserData)
+template <typename T>
+void IPlugAPPHost::ProcessDeviceBuffer(StreamConfig& config, T* pInputBuffer, T* pOutputBuffer, uint32_t nFrames)
 {
-  if ( status )
-    std::cout << "Stream underflow detected!" << std::endl;
+  T** inputs = config.GetInputPtrs(pInputBuffer);
+  T** outputs = config.GetOutputPtrs(pOutputBuffer);
+  const uint32_t blockSize = mIPlug->GetHostBlockSize();
+
+  // MIDI that arrived since the last callback is spread over this buffer. That adds a constant buffer of latency, instead of jitter of up to a buffer
+  const double now = IPlugAPP::GetMidiTime();
+  const double nominalLength = nFrames / mSampleRate;
+  const bool lastCallbackIsRecent = mLastCallbackTime > 0. && now - mLastCallbackTime < 4. * nominalLength; // else the stream just started or stalled
+  mIPlug->SetMidiTimeWindow(lastCallbackIsRecent ? mLastCallbackTime : now - nominalLength, now, (int) nFrames);
+  mLastCallbackTime = now;
+
+  // the buffers are non-interleaved, so a block is just an offset into each channel
+  for (uint32_t s = 0; s < nFrames; s += blockSize)
+  {
+    const uint32_t n = std::min(blockSize, nFrames - s);
 
-  IPlugAPPHost* _this = sInstance;
+    for (int c = 0; c < config.mNInputChans; c++)
+      inputs[c] = pInputBuffer + (c * nFrames) + s;
 
-  double* pInputBufferD = static_cast<double*>(pInputBuffer);
-  double* pOutputBufferD = static_cast<double*>(pOutputBuffer);
+    for (int c = 0; c < config.mNOutputChans; c++)
+      outputs[c] = pOutputBuffer + (c * nFrames) + s;
 
-  int inRightOffset = 0;
+    mIPlug->AppProcess(inputs, outputs, n);
+    mSamplesElapsed += n;
+  }
 
-//  if(!mState.mAudioInIsMono)
-    inRightOffset = nFrames;
+  ApplyOutputGain(config, pOutputBuffer, nFrames);
+}
 
-  if (_this->mVecElapsed > APP_N_VECTOR_WAIT ) // wait APP_N_VECTOR_WAIT * iovs before processing audio, to avoid clicks
+template <typename T>
+void IPlugAPPHost::ApplyOutputGain(StreamConfig& config, T* pOutputBuffer, uint32_t nFrames)
+{
+  const double fadeStart = mFadeMult;
+  const bool fadeOut = mFadeOutRequested.load(std::memory_order_acquire);
+
+  if (fadeOut && fadeStart <= 0.)
   {
-    for (int i=0; i<nFrames; i++)
+    memset(pOutputBuffer, 0, nFrames * config.mNOutputChans * sizeof(T));
+    mFadedOut = true;
+    return;
+  }
+
+  if (!fadeOut && fadeStart >= 1. && APP_MULT == 1)
+    return;
+
+  const double fadeInc = fadeOut ? -1. / nFrames : 1. / nFrames; // fade in or out over one buffer
+
+  for (int c = 0; c < config.mNOutputChans; c++)
+  {
+    T* pChan = pOutputBuffer + (c * nFrames);
+
+    if (!fadeOut && fadeStart >= 1.)
     {
-      _this->mBufIndex %= APP_SIGNAL_VECTOR_SIZE;
+      const T gain = (T) APP_MULT;
 
-      if (_this->mBufIndex == 0)
-      {
-        double* inputs[2] = {pInputBufferD + i, pInputBufferD + inRightOffset + i};
-        double* outputs[2] = {pOutputBufferD + i, pOutputBufferD + nFrames + i};
+      for (uint32_t s = 0; s < nFrames; s++)
+        pChan[s] *= gain;
+    }
+    else
+    {
+      for (uint32_t s = 0; s < nFrames; s++)
+        pChan[s] *= (T) (Clip(fadeStart + (s + 1) * fadeInc, 0., 1.) * APP_MULT);
+    }
+  }
 
-        _this->mIPlug->AppProcess(inputs, outputs, APP_SIGNAL_VECTOR_SIZE);
+  mFadeMult = Clip(fadeStart + nFrames * fadeInc, 0., 1.);
+}
 
-        _this->mSamplesElapsed += APP_SIGNAL_VECTOR_SIZE;
-      }
+// static
+int IPlugAPPHost::AudioCallback(void* pOutputBuffer, void* pInputBuffer, uint32_t nFrames, double streamTime, RtAudioStreamStatus status, void* pUserData)
+{
+  IPlugAPPHost* _this = sInstance;
 
-      // fade in
-      if (_this->mFadeMult < 1.)
-      {
-        _this->mFadeMult += (1. / nFrames);
-      }
+  if ( status )
+  {
+    if (status & RTAUDIO_INPUT_OVERFLOW)
+      _this->mNInputOverflows.fetch_add(1, std::memory_order_relaxed);
+
+    if (status & RTAUDIO_OUTPUT_UNDERFLOW)
+      _this->mNOutputUnderflows.fetch_add(1, std::memory_order_relaxed);
 
-      pOutputBufferD[i] *= _this->mFadeMult;
-      pOutputBufferD[i + nFrames] *= _this->mFadeMult;
+    std::cout << "Stream underflow detected!" << std::endl;
+  }
 
-      pOutputBufferD[i] *= APP_MULT;
-      pOutputBufferD[i + nFrames] *= APP_MULT;
+  StreamConfig* pConfig = _this->mStreamConfig.Acquire();
 
-      _this->mBufIndex++;
-    }
+  if (!pConfig)
+    return 0;
+
+  if (_this->mVecElapsed > APP_N_VECTOR_WAIT ) // wait APP_N_VECTOR_WAIT * iovs before processing audio, to avoid clicks
+  {
+    if (pConfig->mUseFloat32)
+      _this->ProcessDeviceBuffer(*pConfig, static_cast<float*>(pInputBuffer), static_cast<float*>(pOutputBuffer), nFrames);
+    else
+      _this->ProcessDeviceBuffer(*pConfig, static_cast<double*>(pInputBuffer), static_cast<double*>(pOutputBuffer), nFrames);
   }
   else
   {
-    memset(pOutputBufferD, 0, nFrames * APP_NUM_CHANNELS * sizeof(double));
+    memset(pOutputBuffer, 0, nFrames * pConfig->mNOutputChans * (pConfig->mUseFloat32 ? sizeof(float) : sizeof(double)));
   }
   
   _this->mVecElapsed++;
@@ -733,7 +931,7 @@ void IPlugAPPHost::MIDICallback(double deltatime, std::vector<uint8_t>* pMsg, vo
   }
   else
   {
-    IMidiMsg msg(0, pMsg->at(0), pMsg->at(1), pMsg->at(2));
+    IPlugAPP::TimedMidiMsg msg { IMidiMsg(0, pMsg->at(0), pMsg->at(1), pMsg->at(2)), IPlugAPP::GetMidiTime() };
     
     _this->mIPlug->mMidiMsgsFromCallback.Push(msg);
   }
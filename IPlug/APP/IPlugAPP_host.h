@@ -29,18 +29,25 @@
  */
 
 #include <cstdlib>
+#include <cstring>
 #include <string>
 #include <vector>
 #include <limits>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 #include "RtAudio.h"
 #include "RtMidi.h"
 
 #include "wdltypes.h"
 #include "wdlstring.h"
+#include "heapbuf.h"
 
 #include "IPlugPlatform.h"
 #include "IPlugConstants.h"
+#include "IPlugHandoff.h"
 
 #include "IPlugAPP.h"
 
@@ -58,11 +65,22 @@
   #define DEFAULT_INPUT_DEV "Built-in Input"
   #define DEFAULT_OUTPUT_DEV "Built-in Output"
 #elif defined(OS_LINUX)
+  // there is no Linux project in this tree: a Linux build must define __LINUX_ALSA__ and/or __UNIX_JACK__ for RtAudio, and link asound and/or jack
   #include <IPlugSWELL.h>
+  #define DEFAULT_INPUT_DEV "default"
+  #define DEFAULT_OUTPUT_DEV "default"
 #endif
 
 #define OFF_TEXT "off"
 
+#ifndef APP_SIGNAL_VECTOR_SIZE
+  #define APP_SIGNAL_VECTOR_SIZE 0 // the maximum block size passed to the plug-in, 0 to process each device buffer in one block
+#endif
+
+#ifndef APP_DEVICE_PERIODS
+  #define APP_DEVICE_PERIODS 2 // the number of periods of the buffer size an ALSA device is opened with, more survive longer stalls at the cost of latency
+#endif
+
 const int kNumBufferSizeOptions = 11;
 const std::string kBufferSizeOptions[kNumBufferSizeOptions] = {"32", "64", "96", "128", "192", "256", "512", "1024", "2048", "4096", "8192" };
 const int kDeviceDS = 0; const int kDeviceCoreAudio = 0; const int kDeviceAlsa = 0;
@@ -152,6 +170,30 @@ public:
     bool operator!=(const AppState& rhs) { return !operator==(rhs); }
   };
   
+  /** What the audio callback needs to know about the open stream. A new one is handed to the callback through an IPlugHandoff each time the stream is opened */
+  struct StreamConfig
+  {
+    int mNInputChans = 0; // device channels in the stream
+    int mNOutputChans = 0;
+    bool mUseFloat32 = false; // true if the stream is RTAUDIO_FLOAT32, because the devices are natively float32
+    WDL_TypedBuf<double*> mInputPtrsD, mOutputPtrsD; // channel pointers for AppProcess()
+    WDL_TypedBuf<float*> mInputPtrsF, mOutputPtrsF;
+
+    double** GetInputPtrs(double*) { return mInputPtrsD.Get(); }
+    double** GetOutputPtrs(double*) { return mOutputPtrsD.Get(); }
+    float** GetInputPtrs(float*) { return mInputPtrsF.Get(); }
+    float** GetOutputPtrs(float*) { return mOutputPtrsF.Get(); }
+  };
+
+  /** The devices and settings to open a stream with, posted to the audio device thread */
+  struct AudioDeviceRequest
+  {
+    uint32_t mInputID;
+    uint32_t mOutputID;
+    uint32_t mSampleRate;
+    uint32_t mBufferSize;
+  };
+
   static IPlugAPPHost* Create();
   static IPlugAPPHost* sInstance;
   
@@ -198,9 +240,26 @@ public:
   bool MIDISettingsInStateAreEqual(AppState& os, AppState& ns);
 
   bool TryToChangeAudioDriverType();
+
+  /** Find the devices in mState and ask the audio device thread to reopen the stream with them. Returns without waiting, so that a slow driver doesn't block the main loop
+   * @return \c true if the devices were found and the request was posted */
   bool TryToChangeAudio();
   bool SelectMIDIDevice(ERoute direction, const char* portName);
   
+  /** The audio device thread. Waits for requests from TryToChangeAudio(), fades out the running stream and reopens it. Only the latest request is acted on */
+  void AudioDeviceThread();
+
+  /** Ask the audio callback to fade out, and wait until it has (or the stream is stuck). Audio device thread only, with mDACMutex held */
+  void FadeOutStream();
+
+  /** Process one device buffer, in blocks of up to the plug-in's block size, then apply the fade in and APP_MULT */
+  template <typename T>
+  void ProcessDeviceBuffer(StreamConfig& config, T* pInputBuffer, T* pOutputBuffer, uint32_t nFrames);
+
+  /** Scale the output channels by the fade in and APP_MULT. Once faded in, this is a plain gain per channel (or nothing if APP_MULT is 1) */
+  template <typename T>
+  void ApplyOutputGain(StreamConfig& config, T* pOutputBuffer, uint32_t nFrames);
+
   static int AudioCallback(void* pOutputBuffer, void* pInputBuffer, uint32_t nFrames, double streamTime, RtAudioStreamStatus status, void* pUserData);
   static void MIDICallback(double deltatime, std::vector<uint8_t>* pMsg, void* pUserData);
   static void ErrorCallback(RtAudioError::Type type, const std::string& errorText);
@@ -209,6 +268,12 @@ public:
   static WDL_DLGRET MainDlgProc(HWND hwndDlg, UINT uMsg, WPARAM wParam, LPARAM lParam);
 
   IPlugAPP* GetPlug() { return mIPlug; }
+
+  /** @return The number of callbacks for which the device reported lost input, since the app started, e.g. to show with the count of IPlugXrunWatchdog */
+  uint32_t GetNInputOverflows() const { return mNInputOverflows.load(std::memory_order_relaxed); }
+
+  /** @return The number of callbacks for which the device reported that output was late, since the app started */
+  uint32_t GetNOutputUnderflows() const { return mNOutputUnderflows.load(std::memory_order_relaxed); }
 private:
   IPlugAPP* mIPlug = nullptr;
   RtAudio* mDAC = nullptr;
@@ -224,12 +289,27 @@ private:
   /** When the audio driver is started the current state is copied here so that if OK is pressed after APPLY nothing is changed */
   AppState mActiveState;
   
-  double mFadeMult = 0.; // Fade multiplier
+  double mFadeMult = 0.; // Fade multiplier, audio callback only once the stream is running
   double mSampleRate = 44100.;
   uint32_t mSamplesElapsed = 0;
   uint32_t mVecElapsed = 0;
+  double mLastCallbackTime = 0.; // IPlugAPP::GetMidiTime() at the last audio callback, see ProcessDeviceBuffer()
   uint32_t mBufferSize = 512;
-  uint32_t mBufIndex; // index for signal vector, loops from 0 to mSigVS
+  IPlugHandoff<StreamConfig> mStreamConfig; // published by InitAudio(), acquired by the audio callback
+
+  std::atomic<bool> mFadeOutRequested {false}; // set by the audio device thread before it closes the stream
+  std::atomic<bool> mFadedOut {false}; // set by the audio callback once the output is silent
+  std::atomic<uint32_t> mNInputOverflows {0}; // counted by the audio callback, from the status RtAudio passes it
+  std::atomic<uint32_t> mNOutputUnderflows {0};
+
+  std::thread mAudioDeviceThread;
+  std::mutex mRequestMutex; // guards mRequest, mHasRequest and mQuitAudioDeviceThread, only ever held briefly
+  std::condition_variable mRequestCV;
+  AudioDeviceRequest mRequest;
+  bool mHasRequest = false;
+  bool mQuitAudioDeviceThread = false;
+  /** Held by the audio device thread while it reopens the stream, and by the main thread when it uses mDAC. Never taken by the audio callback */
+  std::mutex mDACMutex;
   
   /** The index of the operating systems default input device, -1 if not detected */
   int32_t mDefaultInputDev = -1;
@@ -13,6 +13,8 @@
 
 #include "IPlugPlatform.h"
 #include "IPlugAPP_host.h"
+#include "IPlugAPP_offline.h"
+#include "IPlugAPP_benchmark.h"
 
 #include "config.h"
 #include "resource.h"
@@ -30,6 +32,17 @@ UINT gScrollMessage;
 
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpszCmdParam, int nShowCmd)
 {
+  IPlugAPPOfflineRenderer::Options offlineOptions;
+  std::vector<std::string> offlineFiles;
+
+  if (IPlugAPPOfflineRenderer::ParseCommandLine(__argc, __argv, offlineOptions, offlineFiles))
+    return IPlugAPPOfflineRenderer::Run(offlineOptions, offlineFiles);
+
+  IPlugAPPBenchmark::Options benchmarkOptions;
+
+  if (IPlugAPPBenchmark::ParseCommandLine(__argc, __argv, benchmarkOptions))
+    return IPlugAPPBenchmark::Run(benchmarkOptions);
+
   try
   {
     HANDLE hMutex = OpenMutex(MUTEX_ALL_ACCESS, 0, BUNDLE_NAME); // BUNDLE_NAME used because it won't have spaces in it
@@ -128,6 +141,17 @@ extern HMENU SWELL_app_stocksysmenu;
 
 int main(int argc, char *argv[])
 {
+  IPlugAPPOfflineRenderer::Options offlineOptions;
+  std::vector<std::string> offlineFiles;
+
+  if (IPlugAPPOfflineRenderer::ParseCommandLine(argc, argv, offlineOptions, offlineFiles))
+    return IPlugAPPOfflineRenderer::Run(offlineOptions, offlineFiles);
+
+  IPlugAPPBenchmark::Options benchmarkOptions;
+
+  if (IPlugAPPBenchmark::ParseCommandLine(argc, argv, benchmarkOptions))
+    return IPlugAPPBenchmark::Run(benchmarkOptions);
+
 #if APP_COPY_AUV3
   //if invoked with an argument registerauv3 use plug-in kit to explicitly register auv3 app extension (doesn't happen from debugger)
   if(strcmp(argv[2], "registerauv3"))
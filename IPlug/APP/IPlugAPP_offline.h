@@ -0,0 +1,382 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IPlugAPPOfflineRenderer
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "wdlstring.h"
+#include "wdlcstring.h"
+
+#include "IPlugAPP.h"
+
+/** Renders WAV files through the plug-in without an audio device, for regression renders, batch processing and throughput benchmarks.
+ * Each file is processed with SetRenderingOffline(true) as fast as the CPU allows, and files are shared out between several threads, each with its own plug-in instance.
+ * The command line is:
+ *
+ *     app --offline [--blocksize N] [--samplerate SR] [--preset file.fxp] [--threads N] [--tail seconds] [--outdir path] in1.wav in2.wav ...
+ *
+ * Each output is a 32 bit float WAV named after its input with a "-render" suffix. The plug-in's latency is removed so that the output lines up with the input.
+ * Instruments get no input, the input file only sets the length of the render */
+class IPlugAPPOfflineRenderer
+{
+public:
+  struct Options
+  {
+    int mBlockSize = 512;
+    double mSampleRate = 0.; // 0 to render each file at its own sample rate. Files at a different rate are not resampled, they fail
+    WDL_String mPresetPath; // a program saved with IPluginBase::SaveProgramAsFXP(), loaded into every instance
+    WDL_String mOutputDir; // empty to write each output beside its input
+    int mNThreads = 0; // 0 for one per hardware thread
+    double mTailSeconds = 0.; // rendered after the end of the input, for reverb and delay tails
+  };
+
+  /** @return \c true if the command line asks for an offline render, in which case options and files are filled in */
+  static bool ParseCommandLine(int argc, char* argv[], Options& options, std::vector<std::string>& files)
+  {
+    if (argc < 2 || strcmp(argv[1], "--offline"))
+      return false;
+
+    for (int i = 2; i < argc; i++)
+    {
+      const char* arg = argv[i];
+      const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+      if (!strcmp(arg, "--blocksize") && value) { options.mBlockSize = std::max(atoi(value), 1); i++; }
+      else if (!strcmp(arg, "--samplerate") && value) { options.mSampleRate = atof(value); i++; }
+      else if (!strcmp(arg, "--preset") && value) { options.mPresetPath.Set(value); i++; }
+      else if (!strcmp(arg, "--outdir") && value) { options.mOutputDir.Set(value); i++; }
+      else if (!strcmp(arg, "--threads") && value) { options.mNThreads = std::max(atoi(value), 0); i++; }
+      else if (!strcmp(arg, "--tail") && value) { options.mTailSeconds = std::max(atof(value), 0.); i++; }
+      else
+        files.push_back(arg);
+    }
+
+    return true;
+  }
+
+  /** Render the files, printing the result and realtime factor of each to stdout. Call this on the main thread, instead of starting the app
+   * @return The process exit code, 0 if every file was rendered */
+  static int Run(const Options& options, const std::vector<std::string>& files)
+  {
+    if (files.empty())
+    {
+      printf("usage: --offline [--blocksize N] [--samplerate SR] [--preset file.fxp] [--threads N] [--tail seconds] [--outdir path] in.wav ...\n");
+      return 1;
+    }
+
+    int nThreads = options.mNThreads ? options.mNThreads : (int) std::thread::hardware_concurrency();
+    nThreads = Clip(nThreads, 1, (int) files.size());
+
+    // plug-in constructors are not expected to be thread safe, so the instances are made here and only process on the workers
+    std::vector<std::unique_ptr<IPlugAPP>> plugs;
+
+    for (int i = 0; i < nThreads; i++)
+    {
+      plugs.emplace_back(MakePlug(nullptr));
+
+      if (options.mPresetPath.GetLength() && !plugs.back()->LoadProgramFromFXP(options.mPresetPath.Get()))
+      {
+        printf("couldn't load preset %s\n", options.mPresetPath.Get());
+        return 1;
+      }
+    }
+
+    std::atomic<int> nextFile {0};
+    std::atomic<int> nFailed {0};
+    std::vector<std::thread> threads;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    for (int t = 0; t < nThreads; t++)
+    {
+      threads.emplace_back([&, t]() {
+        for (int f = nextFile++; f < (int) files.size(); f = nextFile++)
+        {
+          if (!RenderFile(*plugs[t], options, files[f]))
+            nFailed++;
+        }
+      });
+    }
+
+    for (auto& thread : threads)
+      thread.join();
+
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("rendered %i of %i files in %.3f s on %i threads\n", (int) files.size() - nFailed.load(), (int) files.size(), elapsed, nThreads);
+
+    return nFailed.load() ? 1 : 0;
+  }
+
+private:
+  /** A WAV file, non-interleaved */
+  struct AudioFile
+  {
+    double mSampleRate = 0.;
+    int mNFrames = 0;
+    std::vector<std::vector<double>> mChannels;
+  };
+
+  static bool RenderFile(IPlugAPP& plug, const Options& options, const std::string& inPath)
+  {
+    AudioFile input;
+
+    if (!ReadWav(inPath.c_str(), input))
+    {
+      printf("%s: can't read, only PCM and float WAV files are supported\n", inPath.c_str());
+      return false;
+    }
+
+    const double sampleRate = options.mSampleRate > 0. ? options.mSampleRate : input.mSampleRate;
+
+    if (sampleRate != input.mSampleRate)
+    {
+      printf("%s: sample rate is %g, not %g\n", inPath.c_str(), input.mSampleRate, sampleRate);
+      return false;
+    }
+
+    plug.SetDeviceChannels((int) input.mChannels.size(), plug.MaxNChannels(ERoute::kOutput));
+    plug.SetSampleRate(sampleRate);
+    plug.SetBlockSize(options.mBlockSize);
+    plug.SetRenderingOffline(true);
+    plug.OnReset();
+    plug.OnActivate(true);
+
+    const int nInputs = plug.NChannelsConnected(ERoute::kInput);
+    const int nOutputs = plug.NChannelsConnected(ERoute::kOutput);
+    const int latency = plug.GetLatency();
+    const int nOutFrames = input.mNFrames + (int) (options.mTailSeconds * sampleRate);
+    const int nRenderFrames = nOutFrames + latency;
+
+    // pad the input with silence, so that the tail and latency are rendered by the same loop
+    for (auto& chan : input.mChannels)
+      chan.resize(nRenderFrames, 0.);
+
+    AudioFile output;
+    output.mSampleRate = sampleRate;
+    output.mNFrames = nOutFrames;
+    output.mChannels.assign(nOutputs, std::vector<double>(nRenderFrames, 0.));
+
+    std::vector<double*> inputs(nInputs);
+    std::vector<double*> outputs(nOutputs);
+
+    const auto start = std::chrono::steady_clock::now();
+
+    for (int s = 0; s < nRenderFrames; s += options.mBlockSize)
+    {
+      const int n = std::min(options.mBlockSize, nRenderFrames - s);
+
+      for (int c = 0; c < nInputs; c++)
+        inputs[c] = input.mChannels[c].data() + s;
+
+      for (int c = 0; c < nOutputs; c++)
+        outputs[c] = output.mChannels[c].data() + s;
+
+      plug.AppProcess(inputs.data(), outputs.data(), n);
+    }
+
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    plug.OnActivate(false);
+
+    for (auto& chan : output.mChannels)
+      chan.erase(chan.begin(), chan.begin() + latency);
+
+    WDL_String outPath;
+
+    if (options.mOutputDir.GetLength())
+    {
+      outPath.Set(options.mOutputDir.Get());
+      outPath.Append(WDL_DIRCHAR_STR);
+      outPath.Append(WDL_get_filepart(inPath.c_str()));
+    }
+    else
+      outPath.Set(inPath.c_str());
+
+    outPath.remove_fileext();
+    outPath.Append("-render.wav");
+
+    if (!WriteWav(outPath.Get(), output))
+    {
+      printf("%s: can't write %s\n", inPath.c_str(), outPath.Get());
+      return false;
+    }
+
+    const double duration = nRenderFrames / sampleRate;
+    printf("%s -> %s: %.3f s in %.3f s (%.1fx realtime)\n", inPath.c_str(), outPath.Get(), duration, elapsed, elapsed > 0. ? duration / elapsed : 0.);
+
+    return true;
+  }
+
+  static uint32_t ReadLE(const unsigned char* pData, int nBytes)
+  {
+    uint32_t v = 0;
+
+    for (int i = nBytes - 1; i >= 0; i--)
+      v = (v << 8) | pData[i];
+
+    return v;
+  }
+
+  static void WriteLE(FILE* fp, uint32_t v, int nBytes)
+  {
+    for (int i = 0; i < nBytes; i++)
+      fputc((v >> (i * 8)) & 0xff, fp);
+  }
+
+  /** Read a 16, 24 or 32 bit PCM, or 32 or 64 bit float WAV file */
+  static bool ReadWav(const char* path, AudioFile& file)
+  {
+    std::unique_ptr<FILE, int(*)(FILE*)> fp(fopen(path, "rb"), fclose);
+
+    if (!fp)
+      return false;
+
+    unsigned char header[12];
+
+    if (fread(header, 1, 12, fp.get()) != 12 || memcmp(header, "RIFF", 4) || memcmp(header + 8, "WAVE", 4))
+      return false;
+
+    int format = 0, nChans = 0, bitsPerSample = 0;
+    unsigned char chunk[8];
+
+    while (fread(chunk, 1, 8, fp.get()) == 8)
+    {
+      const uint32_t size = ReadLE(chunk + 4, 4);
+
+      if (!memcmp(chunk, "fmt ", 4))
+      {
+        unsigned char fmt[40] = {};
+
+        if (size < 16 || fread(fmt, 1, std::min<uint32_t>(size, 40), fp.get()) != std::min<uint32_t>(size, 40))
+          return false;
+
+        if (size > 40)
+          fseek(fp.get(), size - 40, SEEK_CUR);
+
+        format = (int) ReadLE(fmt, 2);
+        nChans = (int) ReadLE(fmt + 2, 2);
+        file.mSampleRate = (double) ReadLE(fmt + 4, 4);
+        bitsPerSample = (int) ReadLE(fmt + 14, 2);
+
+        if (format == 0xFFFE && size >= 40) // WAVE_FORMAT_EXTENSIBLE, the format is the start of the sub format GUID
+          format = (int) ReadLE(fmt + 24, 2);
+      }
+      else if (!memcmp(chunk, "data", 4))
+      {
+        const bool isFloat = format == 3 && (bitsPerSample == 32 || bitsPerSample == 64);
+        const bool isPCM = format == 1 && (bitsPerSample == 16 || bitsPerSample == 24 || bitsPerSample == 32);
+
+        if (nChans < 1 || !(isFloat || isPCM))
+          return false;
+
+        const int bytesPerSample = bitsPerSample / 8;
+        const int nFrames = (int) (size / (bytesPerSample * nChans));
+        std::vector<unsigned char> data((size_t) nFrames * nChans * bytesPerSample);
+
+        if (fread(data.data(), 1, data.size(), fp.get()) != data.size())
+          return false;
+
+        file.mNFrames = nFrames;
+        file.mChannels.assign(nChans, std::vector<double>(nFrames));
+
+        const unsigned char* pSample = data.data();
+
+        for (int s = 0; s < nFrames; s++)
+        {
+          for (int c = 0; c < nChans; c++, pSample += bytesPerSample)
+          {
+            double v;
+
+            if (isFloat && bytesPerSample == 4)
+            {
+              const uint32_t bits = ReadLE(pSample, 4);
+              float f;
+              memcpy(&f, &bits, 4);
+              v = f;
+            }
+            else if (isFloat)
+            {
+              const uint64_t bits = ReadLE(pSample, 4) | ((uint64_t) ReadLE(pSample + 4, 4) << 32);
+              memcpy(&v, &bits, 8);
+            }
+            else
+            {
+              // sign extend from the top byte
+              const int shift = 32 - bitsPerSample;
+              const int32_t i = (int32_t) (ReadLE(pSample, bytesPerSample) << shift) >> shift;
+              v = i / (double) (1u << (bitsPerSample - 1));
+            }
+
+            file.mChannels[c][s] = v;
+          }
+        }
+
+        return true;
+      }
+      else
+        fseek(fp.get(), size + (size & 1), SEEK_CUR); // chunks are word aligned
+    }
+
+    return false;
+  }
+
+  /** Write a 32 bit float WAV file, so that renders can be compared without dither or clipping */
+  static bool WriteWav(const char* path, const AudioFile& file)
+  {
+    std::unique_ptr<FILE, int(*)(FILE*)> fp(fopen(path, "wb"), fclose);
+
+    if (!fp)
+      return false;
+
+    const int nChans = (int) file.mChannels.size();
+    const uint32_t dataSize = (uint32_t) file.mNFrames * nChans * 4;
+
+    fwrite("RIFF", 1, 4, fp.get());
+    WriteLE(fp.get(), 36 + dataSize, 4);
+    fwrite("WAVEfmt ", 1, 8, fp.get());
+    WriteLE(fp.get(), 16, 4);
+    WriteLE(fp.get(), 3, 2); // WAVE_FORMAT_IEEE_FLOAT
+    WriteLE(fp.get(), nChans, 2);
+    WriteLE(fp.get(), (uint32_t) file.mSampleRate, 4);
+    WriteLE(fp.get(), (uint32_t) file.mSampleRate * nChans * 4, 4);
+    WriteLE(fp.get(), nChans * 4, 2);
+    WriteLE(fp.get(), 32, 2);
+    fwrite("data", 1, 4, fp.get());
+    WriteLE(fp.get(), dataSize, 4);
+
+    for (int s = 0; s < file.mNFrames; s++)
+    {
+      for (int c = 0; c < nChans; c++)
+      {
+        const float f = (float) file.mChannels[c][s];
+        uint32_t bits;
+        memcpy(&bits, &f, 4);
+        WriteLE(fp.get(), bits, 4);
+      }
+    }
+
+    return ferror(fp.get()) == 0;
+  }
+};
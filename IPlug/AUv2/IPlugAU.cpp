@@ -10,6 +10,7 @@
 
 #include <algorithm>
 #include <CoreMIDI/CoreMIDI.h>
+#include <Block.h>
 
 #include "heapbuf.h"
 
@@ -480,7 +481,7 @@ OSStatus IPlugAU::GetProperty(AudioUnitPropertyID propID, AudioUnitScope scope,
       *pWriteable = true;
       if (pData)
       {
-        *((Float64*) pData) = GetSampleRate();
+        *((Float64*) pData) = GetHostSampleRate();
       }
       return noErr;
     }
@@ -652,7 +653,7 @@ OSStatus IPlugAU::GetProperty(AudioUnitPropertyID propID, AudioUnitScope scope,
           nChannels = pBus->mNPlugChannels;
         }
         STREAM_DESC* pASBD = (STREAM_DESC*) pData;
-        MakeDefaultASBD(pASBD, GetSampleRate(), nChannels, false);
+        MakeDefaultASBD(pASBD, GetHostSampleRate(), nChannels, false);
       }
       return noErr;
     }
@@ -680,7 +681,7 @@ OSStatus IPlugAU::GetProperty(AudioUnitPropertyID propID, AudioUnitScope scope,
       *pDataSize = sizeof(Float64);
       if (pData)
       {
-        *((Float64*) pData) = (double) GetLatency() / GetSampleRate();
+        *((Float64*) pData) = (double) GetLatency() / GetHostSampleRate();
       }
       return noErr;
     }
@@ -719,7 +720,7 @@ OSStatus IPlugAU::GetProperty(AudioUnitPropertyID propID, AudioUnitScope scope,
       *pWriteable = true;
       if (pData)
       {
-        *((UInt32*) pData) = GetBlockSize();
+        *((UInt32*) pData) = GetHostBlockSize();
       }
       return noErr;
     }
@@ -768,7 +769,7 @@ OSStatus IPlugAU::GetProperty(AudioUnitPropertyID propID, AudioUnitScope scope,
       
       if (pData)
       {
-        *((Float64*) pData) = (double) GetTailSize() / GetSampleRate();
+        *((Float64*) pData) = (double) GetTailSize() / GetHostSampleRate();
       }
       return noErr;
     }
@@ -845,7 +846,17 @@ OSStatus IPlugAU::GetProperty(AudioUnitPropertyID propID, AudioUnitScope scope,
       *pWriteable = true;
       return noErr;
     }
-    NO_OP(kAudioUnitProperty_InPlaceProcessing);          // 29,
+    case kAudioUnitProperty_InPlaceProcessing:            // 29,
+    {
+      ASSERT_SCOPE(kAudioUnitScope_Global);
+      *pDataSize = sizeof(UInt32);
+      *pWriteable = DoesInPlaceProcessing();
+      if (pData)
+      {
+        *((UInt32*) pData) = (mInPlaceProcessing ? 1 : 0);
+      }
+      return noErr;
+    }
     case kAudioUnitProperty_ElementName:
     {
       *pDataSize = sizeof(CFStringRef);
@@ -1055,6 +1066,22 @@ OSStatus IPlugAU::GetProperty(AudioUnitPropertyID propID, AudioUnitScope scope,
     }
     NO_OP(kAudioUnitProperty_InputSamplesInOutput);       // 49,
     NO_OP(kAudioUnitProperty_ClassInfoFromDocument);      // 50
+#ifdef IPLUG_OS_WORKGROUP
+    case kAudioUnitProperty_RenderContextObserver:        // 60,
+    {
+      // the host calls the block on its render thread, before rendering in a new context
+      if (pData == 0)
+      {
+        *pWriteable = false;
+        *pDataSize = sizeof(AURenderContextObserver);
+      }
+      else
+      {
+        *((AURenderContextObserver*) pData) = mRenderContextObserver;
+      }
+      return noErr;
+    }
+#endif
       
     default:
     {
@@ -1217,7 +1244,16 @@ OSStatus IPlugAU::SetProperty(AudioUnitPropertyID propID, AudioUnitScope scope,
       memcpy(&mHostCallbacks, pData, sizeof(HostCallbackInfo));
       return noErr;
     }
-    NO_OP(kAudioUnitProperty_InPlaceProcessing);         // 29,
+    case kAudioUnitProperty_InPlaceProcessing:           // 29,
+    {
+      const bool inPlace = *((UInt32*) pData) != 0;
+      
+      if (inPlace && !DoesInPlaceProcessing())
+        return kAudioUnitErr_InvalidPropertyValue;
+      
+      mInPlaceProcessing = inPlace;
+      return noErr;
+    }
     NO_OP(kAudioUnitProperty_ElementName);               // 30,
     NO_OP(kAudioUnitProperty_CocoaUI);                   // 31,
     NO_OP(kAudioUnitProperty_SupportedChannelLayoutTags); // 32,
@@ -1334,6 +1370,7 @@ bool IPlugAU::CheckLegalIO()
 void IPlugAU::AssessInputConnections()
 {
   TRACE;
+  mRenderTopologyChanged = true;
   SetChannelConnections(ERoute::kInput, 0, MaxNChannels(ERoute::kInput), false);
 
   int nIn = mInBuses.GetSize();
@@ -1410,7 +1447,8 @@ OSStatus IPlugAU::GetState(CFPropertyListRef* ppPropList)
   PutNumberInDict(pDict, kAUPresetManufacturerKey, &(cd.componentManufacturer), kCFNumberSInt32Type);
   PutStrInDict(pDict, kAUPresetNameKey, GetPresetName(GetCurrentPresetIdx()));
 
-  IByteChunk chunk;
+  IByteChunkPool::ScopedChunk scopedChunk = AcquireStateChunk();
+  IByteChunk& chunk = scopedChunk.Get();
   //InitChunkWithIPlugVer(&IPlugChunk); // TODO: IPlugVer should be in chunk!
 
   if (SerializeState(chunk))
@@ -1418,6 +1456,22 @@ OSStatus IPlugAU::GetState(CFPropertyListRef* ppPropList)
     PutDataInDict(pDict, kAUPresetDataKey, &chunk);
   }
 
+  // large data goes under its own key, written into blocks that are copied once into the CFData, rather than appended to the state chunk
+  if (HasLargeState())
+  {
+    IStateMemoryWriter writer;
+
+    if (WriteLargeState(writer))
+    {
+      CFStrLocal cfKey(kLargeStateKey);
+      CFMutableDataRef pData = CFDataCreateMutable(0, (CFIndex) writer.Size());
+      CFDataSetLength(pData, (CFIndex) writer.Size());
+      writer.CopyTo(CFDataGetMutableBytePtr(pData));
+      CFDictionarySetValue(pDict, cfKey.mCFStr, pData);
+      CFRelease(pData);
+    }
+  }
+
   *ppPropList = pDict;
   TRACE;
   return noErr;
@@ -1474,6 +1528,19 @@ OSStatus IPlugAU::SetState(CFPropertyListRef pPropList)
   }
 
   OnRestoreState();
+
+  // the parameters apply at once, the large data follows, read in place from the CFData
+  CFStrLocal cfKey(kLargeStateKey);
+  CFDataRef pLargeState = (CFDataRef) CFDictionaryGetValue(pDict, cfKey.mCFStr);
+
+  if (pLargeState)
+  {
+    IStateMemoryReader reader(CFDataGetBytePtr(pLargeState), (int64_t) CFDataGetLength(pLargeState));
+
+    if (!ReadLargeState(reader))
+      return kAudioUnitErr_InvalidPropertyValue;
+  }
+
   return noErr;
 }
 
@@ -1547,6 +1614,16 @@ OSStatus IPlugAU::SetParamProc(void* pPlug, AudioUnitParameterID paramID, AudioU
   return noErr;
 }
 
+void IPlugAU::ProcessParamEvent(const IParamEvent& event)
+{
+  // no params mutex here: parameter values are atomic, and every event in the list is applied on the audio thread
+  if (event.mNormalized)
+    GetParam(event.mParamIdx)->SetNormalized(event.mValue);
+  else
+    GetParam(event.mParamIdx)->Set(event.mValue);
+  OnParamChange(event.mParamIdx, kHost, event.mOffset);
+}
+
 inline OSStatus RenderCallback(AURenderCallbackStruct* pCB, AudioUnitRenderActionFlags* pFlags, const AudioTimeStamp* pTimestamp, UInt32 inputBusIdx, UInt32 nFrames, AudioBufferList* pOutBufList)
 {
   TRACE;
@@ -1563,7 +1640,7 @@ OSStatus IPlugAU::RenderProc(void* pPlug, AudioUnitRenderActionFlags* pFlags, co
   
   _this->mLastRenderTimeStamp = *pTimestamp;
 
-  if (!(pTimestamp->mFlags & kAudioTimeStampSampleTimeValid) || outputBusIdx >= _this->mOutBuses.GetSize() || nFrames > _this->GetBlockSize())
+  if (!(pTimestamp->mFlags & kAudioTimeStampSampleTimeValid) || outputBusIdx >= _this->mOutBuses.GetSize() || nFrames > _this->GetHostBlockSize())
   {
     return kAudioUnitErr_InvalidPropertyValue;
   }
@@ -1580,31 +1657,35 @@ OSStatus IPlugAU::RenderProc(void* pPlug, AudioUnitRenderActionFlags* pFlags, co
     }
   }
 
+  if (_this->mRenderTopologyChanged.exchange(false))
+    _this->UpdateRenderTopology();
+
   double renderSampleTime = pTimestamp->mSampleTime;
 
   // Pull input buffers.
   if (renderSampleTime != _this->mLastRenderSampleTime)
   {
-    BufferList bufList;
-    AudioBufferList* pInBufList = (AudioBufferList*) &bufList;
-
     int nIn = _this->mInBuses.GetSize();
 
     for (int i = 0; i < nIn; ++i)
     {
       BusChannels* pInBus = _this->mInBuses.Get(i);
       InputBusConnection* pInBusConn = _this->mInBusConnections.Get(i);
+      AudioBufferList* pInBufList = (AudioBufferList*) (_this->mInBufLists.Get() + i);
 
       if (pInBus->mConnected)
       {
-        pInBufList->mNumberBuffers = pInBus->mNHostChannels;
+        // upstream may have replaced the data pointers and sizes last time, so only they are reset
+        AudioSampleType* pScratchInput = pInBusConn->mInputType == eRenderCallback ? _this->mInScratchBuf.Get() + pInBus->mPlugChannelStartIdx * nFrames : nullptr;
 
         for (int b = 0; b < pInBufList->mNumberBuffers; ++b)
         {
           AudioBuffer* pBuffer = &(pInBufList->mBuffers[b]);
-          pBuffer->mNumberChannels = 1;
           pBuffer->mDataByteSize = nFrames * sizeof(AudioSampleType);
-          pBuffer->mData = 0;
+          pBuffer->mData = pScratchInput;
+
+          if (pScratchInput)
+            pScratchInput += nFrames;
         }
 
         AudioUnitRenderActionFlags flags = 0;
@@ -1624,13 +1705,6 @@ OSStatus IPlugAU::RenderProc(void* pPlug, AudioUnitRenderActionFlags* pFlags, co
           }
           case eRenderCallback:
           {
-            AudioSampleType* pScratchInput = _this->mInScratchBuf.Get() + pInBus->mPlugChannelStartIdx * nFrames;
-
-            for (int b = 0; b < pInBufList->mNumberBuffers; ++b, pScratchInput += nFrames)
-            {
-              pInBufList->mBuffers[b].mData = pScratchInput;
-            }
-
             r = RenderCallback(&(pInBusConn->mUpstreamRenderCallback), &flags, pTimestamp, i, nFrames, pInBufList);
             break;
           }
@@ -1642,8 +1716,9 @@ OSStatus IPlugAU::RenderProc(void* pPlug, AudioUnitRenderActionFlags* pFlags, co
           return r;   // Something went wrong upstream.
         }
 
-        for (int i = 0, chIdx = pInBus->mPlugChannelStartIdx; i < pInBus->mNHostChannels; ++i, ++chIdx)
+        for (int i = 0, chIdx = pInBus->mPlugChannelStartIdx; i < pInBufList->mNumberBuffers; ++i, ++chIdx)
         {
+          _this->mPulledInputs.Get()[chIdx] = (AudioSampleType*) pInBufList->mBuffers[i].mData;
           _this->AttachBuffers(ERoute::kInput, chIdx, 1, (AudioSampleType**) &(pInBufList->mBuffers[i].mData), nFrames);
         }
       }
@@ -1663,42 +1738,32 @@ OSStatus IPlugAU::RenderProc(void* pPlug, AudioUnitRenderActionFlags* pFlags, co
     assert(nConnected > -1);
     _this->SetChannelConnections(ERoute::kOutput, startChannelIdx, nConnected, true);
     _this->SetChannelConnections(ERoute::kOutput, startChannelIdx + nConnected, nUnconnected, false); // This will disconnect the right handle channel on a single stereo bus
-    pOutBus->mConnected = true;
+    
+    if (!pOutBus->mConnected)
+    {
+      pOutBus->mConnected = true;
+      _this->UpdateRenderTopology();
+    }
   }
 
+  const int nPulledInputs = _this->mPulledInputs.GetSize();
+
   for (int i = 0, chIdx = pOutBus->mPlugChannelStartIdx; i < pOutBufList->mNumberBuffers; ++i, ++chIdx)
   {
     if (!(pOutBufList->mBuffers[i].mData)) // Downstream unit didn't give us buffers.
-      pOutBufList->mBuffers[i].mData = _this->mOutScratchBuf.Get() + chIdx * nFrames;
-
-    _this->AttachBuffers(ERoute::kOutput, chIdx, 1, (AudioSampleType**) &(pOutBufList->mBuffers[i].mData), nFrames);
-  }
-
-  int lastConnectedOutputBus = -1;
-
-  for(int i = 0; i < _this->mOutBuses.GetSize(); i++)
-  {
-    if(!_this->mOutBuses.Get(i)->mConnected)
-    {
-      break;
-    }
-    else
     {
-      lastConnectedOutputBus++;
+      // when processing in place, render straight into the input buffer rather than a scratch buffer
+      if (_this->mInPlaceProcessing && chIdx < nPulledInputs && _this->mPulledInputs.Get()[chIdx])
+        pOutBufList->mBuffers[i].mData = _this->mPulledInputs.Get()[chIdx];
+      else
+        pOutBufList->mBuffers[i].mData = _this->mOutScratchBuf.Get() + chIdx * nFrames;
     }
+
+    _this->AttachBuffers(ERoute::kOutput, chIdx, 1, (AudioSampleType**) &(pOutBufList->mBuffers[i].mData), nFrames);
   }
 
-  if (outputBusIdx == lastConnectedOutputBus)
+  if ((int) outputBusIdx == _this->mLastConnectedOutputBus)
   {
-    int busIdx1based = outputBusIdx+1;
-
-    if (busIdx1based < _this->mOutBuses.GetSize() /*&& (_this->GetHost() != kHostAbletonLive)*/)
-    {
-      int totalNumChans = _this->mOutBuses.GetSize() * 2; // stereo only for the time being
-      int nConnected = busIdx1based * 2;
-      _this->SetChannelConnections(ERoute::kOutput, nConnected, totalNumChans - nConnected, false); // this will disconnect the channels that are on the unconnected buses
-    }
-
     if (_this->GetBypassed())
     {
       _this->PassThroughBuffers((AudioSampleType) 0, nFrames);
@@ -1716,10 +1781,16 @@ OSStatus IPlugAU::RenderProc(void* pPlug, AudioUnitRenderActionFlags* pFlags, co
       }
       
       _this->PreProcess();
+      _this->ProcessBlockStartTasks();
       _this->ProcessBuffers((AudioSampleType) 0, nFrames);
     }
+
+    _this->OutputMidiMsgs(nFrames);
   }
 
+  if (_this->GetOutputsSilent())
+    *pFlags |= kAudioUnitRenderAction_OutputIsSilence;
+
   if (nRenderNotify)
   {
     for (int i = 0; i < nRenderNotify; ++i)
@@ -1753,8 +1824,41 @@ IPlugAU::BusChannels* IPlugAU::GetBus(AudioUnitScope scope, AudioUnitElement bus
   return 0;
 }
 
+void IPlugAU::UpdateRenderTopology()
+{
+  // called from the render proc, so nothing here allocates
+  for (int i = 0; i < mInBuses.GetSize(); ++i)
+  {
+    BusChannels* pInBus = mInBuses.Get(i);
+    BufferList& bufList = mInBufLists.Get()[i];
+    bufList.mNumberBuffers = pInBus->mConnected ? std::min(pInBus->mNHostChannels, AU_MAX_IO_CHANNELS) : 0;
+
+    for (int b = 0; b < bufList.mNumberBuffers; ++b)
+      bufList.mBuffers[b].mNumberChannels = 1;
+
+    // channels that won't be pulled can't be rendered in place
+    for (int ch = bufList.mNumberBuffers; ch < pInBus->mNPlugChannels && pInBus->mPlugChannelStartIdx + ch < mPulledInputs.GetSize(); ++ch)
+      mPulledInputs.Get()[pInBus->mPlugChannelStartIdx + ch] = nullptr;
+  }
+
+  mLastConnectedOutputBus = -1;
+
+  for (int i = 0; i < mOutBuses.GetSize() && mOutBuses.Get(i)->mConnected; i++)
+    mLastConnectedOutputBus++;
+
+  const int busIdx1based = mLastConnectedOutputBus + 1;
+
+  if (busIdx1based > 0 && busIdx1based < mOutBuses.GetSize() /*&& (GetHost() != kHostAbletonLive)*/)
+  {
+    int totalNumChans = mOutBuses.GetSize() * 2; // stereo only for the time being
+    int nConnected = busIdx1based * 2;
+    SetChannelConnections(ERoute::kOutput, nConnected, totalNumChans - nConnected, false); // this will disconnect the channels that are on the unconnected buses
+  }
+}
+
 void IPlugAU::ClearConnections()
 {
+  mRenderTopologyChanged = true;
   int nInBuses = mInBuses.GetSize();
   for (int i = 0; i < nInBuses; ++i)
   {
@@ -1783,6 +1887,7 @@ IPlugAU::IPlugAU(IPlugInstanceInfo instanceInfo, IPlugConfig c)
 
   memset(&mHostCallbacks, 0, sizeof(HostCallbackInfo));
   memset(&mMidiCallback, 0, sizeof(AUMIDIOutputCallbackStruct));
+  mMidiPacketListBuf.Resize(kMidiPacketListSize); // so that OutputMidiMsgs() never allocates
 
   mCocoaViewFactoryClassName.Set(instanceInfo.mCocoaViewFactoryClassName.Get());
 
@@ -1810,6 +1915,21 @@ IPlugAU::IPlugAU(IPlugInstanceInfo instanceInfo, IPlugConfig c)
     pOutBus->mNPlugChannels = std::abs(MaxNChannelsForBus(ERoute::kOutput, bus));
   }
 
+  mInBufLists.Resize(maxNIBuses);
+  memset(mInBufLists.Get(), 0, maxNIBuses * sizeof(BufferList));
+  mPulledInputs.Resize(MaxNChannels(ERoute::kInput));
+  memset(mPulledInputs.Get(), 0, mPulledInputs.GetSize() * sizeof(AudioSampleType*));
+
+#ifdef IPLUG_OS_WORKGROUP
+  if (__builtin_available(macOS 11.0, *))
+  {
+    IPlugAudioWorkgroup* pWorkgroup = &GetAudioWorkgroup();
+    mRenderContextObserver = Block_copy(^(const AudioUnitRenderContext* pContext) {
+      pWorkgroup->Set(pContext ? (void*) pContext->workgroup : nullptr);
+    });
+  }
+#endif
+
   AssessInputConnections();
 
   SetBlockSize(DEFAULT_BLOCK_SIZE);
@@ -1820,6 +1940,10 @@ IPlugAU::IPlugAU(IPlugInstanceInfo instanceInfo, IPlugConfig c)
 
 IPlugAU::~IPlugAU()
 {
+#ifdef IPLUG_OS_WORKGROUP
+  if (mRenderContextObserver)
+    Block_release(mRenderContextObserver);
+#endif
   mRenderNotify.Empty(true);
   mInBuses.Empty(true);
   mOutBuses.Empty(true);
@@ -1842,29 +1966,34 @@ void IPlugAU::SendAUEvent(AudioUnitEventType type, AudioComponentInstance ci, in
 void IPlugAU::BeginInformHostOfParamChange(int idx)
 {
   Trace(TRACELOC, "%d", idx);
+  IPLUG_HOST_CALL_SCOPE(kHostCallBeginEdit);
   SendAUEvent(kAudioUnitEvent_BeginParameterChangeGesture, mCI, idx);
 }
 
 void IPlugAU::InformHostOfParamChange(int idx, double normalizedValue)
 {
   Trace(TRACELOC, "%d:%f", idx, normalizedValue);
+  IPLUG_HOST_CALL_SCOPE(kHostCallPerformEdit);
   SendAUEvent(kAudioUnitEvent_ParameterValueChange, mCI, idx);
 }
 
 void IPlugAU::EndInformHostOfParamChange(int idx)
 {
   Trace(TRACELOC, "%d", idx);
+  IPLUG_HOST_CALL_SCOPE(kHostCallEndEdit);
   SendAUEvent(kAudioUnitEvent_EndParameterChangeGesture, mCI, idx);
 }
 
 void IPlugAU::InformHostOfProgramChange()
 {
+  IPLUG_HOST_CALL_SCOPE(kHostCallPresetChange);
   //InformListeners(kAudioUnitProperty_CurrentPreset, kAudioUnitScope_Global);
   InformListeners(kAudioUnitProperty_PresentPreset, kAudioUnitScope_Global);
 }
 
 void IPlugAU::InformHostOfParameterDetailsChange()
 {
+  IPLUG_HOST_CALL_SCOPE(kHostCallParamDetails);
   InformListeners(kAudioUnitProperty_ParameterList, kAudioUnitScope_Global);
   InformListeners(kAudioUnitProperty_ParameterInfo, kAudioUnitScope_Global);
 }
@@ -1913,8 +2042,8 @@ void IPlugAU::PreProcess()
 void IPlugAU::ResizeScratchBuffers()
 {
   TRACE;
-  int NInputs = MaxNChannels(ERoute::kInput) * GetBlockSize();
-  int NOutputs = MaxNChannels(ERoute::kOutput) * GetBlockSize();
+  int NInputs = MaxNChannels(ERoute::kInput) * GetHostBlockSize();
+  int NOutputs = MaxNChannels(ERoute::kOutput) * GetHostBlockSize();
   mInScratchBuf.Resize(NInputs);
   mOutScratchBuf.Resize(NOutputs);
   memset(mInScratchBuf.Get(), 0, NInputs * sizeof(AudioSampleType));
@@ -1947,6 +2076,7 @@ void IPlugAU::SetLatency(int samples)
     PropertyListener* pListener = mPropertyListeners.Get(i);
     if (pListener->mPropID == kAudioUnitProperty_Latency)
     {
+      IPLUG_HOST_CALL_SCOPE(kHostCallLatency);
       pListener->mListenerProc(pListener->mProcArgs, mCI, kAudioUnitProperty_Latency, kAudioUnitScope_Global, 0);
     }
   }
@@ -1958,56 +2088,66 @@ bool IPlugAU::SendMidiMsg(const IMidiMsg& msg)
 {
   if(mMidiCallback.midiOutputCallback == nullptr)
     return false;
-  
-  MIDIPacketList packetList;
-  
-  packetList.packet[0].data[0] = msg.mStatus;
-  packetList.packet[0].data[1] = msg.mData1;
-  packetList.packet[0].data[2] = msg.mData2;
-  packetList.packet[0].length = 3;
-  packetList.packet[0].timeStamp = msg.mOffset;
-  packetList.numPackets = 1;
-  
-  if(mMidiCallback.midiOutputCallback)
-  {
-    OSStatus status = mMidiCallback.midiOutputCallback(mMidiCallback.userData, &mLastRenderTimeStamp, 0, &packetList);
-    
-    if (status == noErr)
-      return true;
-  }
-  
-  return false;
+
+  mMidiOutputQueue.Add(msg);
+  return true;
 }
 
 bool IPlugAU::SendMidiMsgs(WDL_TypedBuf<IMidiMsg>& msgs)
 {
-  bool result = false;
-  
   if(mMidiCallback.midiOutputCallback == nullptr)
     return false;
-  
-  WDL_HeapBuf heapBuf;
-  MIDIPacketList* pPktlist = (MIDIPacketList*) heapBuf.ResizeOK(msgs.GetSize() * 3);
-  MIDIPacket* pPkt = MIDIPacketListInit(pPktlist);
-  ByteCount listSize = heapBuf.GetSize();
-    
-  IMidiMsg* pMsg = msgs.Get();
-  for (int i = 0; i < msgs.GetSize(); ++i, ++pMsg)
+
+  const IMidiMsg* pMsgs = msgs.Get();
+
+  for (int i = 0; i < msgs.GetSize(); i++)
+    mMidiOutputQueue.Add(pMsgs[i]);
+
+  return true;
+}
+
+void IPlugAU::OutputMidiMsgs(int nFrames)
+{
+  if (mMidiOutputQueue.Empty())
+    return;
+
+  if (mMidiCallback.midiOutputCallback == nullptr)
   {
-    pPkt = MIDIPacketListAdd(pPktlist, listSize, pPkt, pMsg->mOffset /* TODO: is this correct? */, 1, &pMsg->mStatus);
-    pPkt = MIDIPacketListAdd(pPktlist, listSize, pPkt, pMsg->mOffset /* TODO: is this correct? */, 1, &pMsg->mData1);
-    pPkt = MIDIPacketListAdd(pPktlist, listSize, pPkt, pMsg->mOffset /* TODO: is this correct? */, 1, &pMsg->mData2);
+    mMidiOutputQueue.Clear();
+    return;
   }
-  
-  if(mMidiCallback.midiOutputCallback)
+
+  // the block's messages in order, packed into as few packets as possible: MIDIPacketListAdd() appends to the last packet when the timestamp is the same
+  MIDIPacketList* pPktList = (MIDIPacketList*) mMidiPacketListBuf.Get();
+  const ByteCount listSize = mMidiPacketListBuf.GetSize();
+  MIDIPacket* pPkt = MIDIPacketListInit(pPktList);
+
+  while (!mMidiOutputQueue.Empty())
   {
-    OSStatus status = mMidiCallback.midiOutputCallback(mMidiCallback.userData, &mLastRenderTimeStamp, 0, pPktlist);
-    
-    if (status == noErr)
-      result = true;
+    const IMidiMsg& msg = mMidiOutputQueue.Peek();
+
+    if (msg.mOffset >= nFrames) // belongs to a later buffer, see Flush() below
+      break;
+
+    const Byte data[3] = {msg.mStatus, msg.mData1, msg.mData2};
+    const ByteCount size = (msg.StatusMsg() == IMidiMsg::kProgramChange || msg.StatusMsg() == IMidiMsg::kChannelAftertouch) ? 2 : 3;
+    MIDIPacket* pNextPkt = MIDIPacketListAdd(pPktList, listSize, pPkt, (MIDITimeStamp) std::max(msg.mOffset, 0), size, data);
+
+    if (!pNextPkt) // the list is full, so send it and start another
+    {
+      mMidiCallback.midiOutputCallback(mMidiCallback.userData, &mLastRenderTimeStamp, 0, pPktList);
+      pPkt = MIDIPacketListInit(pPktList);
+      continue;
+    }
+
+    pPkt = pNextPkt;
+    mMidiOutputQueue.Remove();
   }
-  
-  return result;
+
+  if (pPktList->numPackets)
+    mMidiCallback.midiOutputCallback(mMidiCallback.userData, &mLastRenderTimeStamp, 0, pPktList);
+
+  mMidiOutputQueue.Flush(nFrames);
 }
 
 bool IPlugAU::SendSysEx(const ISysEx& sysEx)
@@ -2048,13 +2188,13 @@ bool IPlugAU::SendSysEx(const ISysEx& sysEx)
 void IPlugAU::OutputSysexFromEditor()
 {
   //Output SYSEX from the editor, which has bypassed ProcessSysEx()
-  if(mSysExDataFromEditor.ElementsAvailable())
+  IPlugMessageRing::Record record;
+  
+  while (mSysExDataFromEditor.Peek(record))
   {
-    while (mSysExDataFromEditor.Pop(mSysexBuf))
-    {
-      ISysEx smsg {mSysexBuf.mOffset, mSysexBuf.mData, mSysexBuf.mSize};
-      SendSysEx(smsg);
-    }
+    ISysEx smsg {record.mTag, record.mData, record.mSize};
+    SendSysEx(smsg);
+    mSysExDataFromEditor.Release();
   }
 }
 
@@ -2198,6 +2338,7 @@ OSStatus IPlugAU::DoInitialize(IPlugAU* _this)
   }
 
   _this->mActive = true;
+  _this->AllocateParamRamps();
   _this->OnParamReset(kReset);
   _this->OnActivate(true);
   
@@ -2363,6 +2504,14 @@ OSStatus IPlugAU::DoScheduleParameters(IPlugAU* _this, const AudioUnitParameterE
   {
     if (pEvent->eventType == kParameterEvent_Immediate)
     {
+      if (_this->GetSampleAccurateParams() && pEvent->scope == kAudioUnitScope_Global)
+      {
+        // applied by IPlugProcessor as ProcessBlock() is split into sub-blocks
+        _this->AddParamEvent(IParamEvent { (int) pEvent->eventValues.immediate.bufferOffset, (int) pEvent->parameter, pEvent->eventValues.immediate.value, false });
+        _this->SendParameterValueFromAPI(pEvent->parameter, pEvent->eventValues.immediate.value, false);
+        continue;
+      }
+
       OSStatus r = SetParamProc(_this, pEvent->parameter, pEvent->scope, pEvent->element,
                                 pEvent->eventValues.immediate.value, pEvent->eventValues.immediate.bufferOffset);
       if (r != noErr)
@@ -2370,6 +2519,48 @@ OSStatus IPlugAU::DoScheduleParameters(IPlugAU* _this, const AudioUnitParameterE
         return r;
       }
     }
+    else if (pEvent->eventType == kParameterEvent_Ramped)
+    {
+      const auto& ramp = pEvent->eventValues.ramp;
+
+      if (_this->GetSampleAccurateParams() && pEvent->scope == kAudioUnitScope_Global)
+      {
+        // the ramp is applied as a series of steps, one per sub-block, up to the end of the largest render slice
+        const int startOffset = (int) ramp.startBufferOffset;
+        const int duration = std::max((int) ramp.durationInFrames, 1);
+        const int step = _this->GetMinSubBlockSize();
+        const int blockSize = _this->GetHostBlockSize();
+
+        // a ramp that began in an earlier slice has a negative start offset, and its steps before this slice are skipped
+        const int elapsed = std::max(0, -startOffset);
+        const int firstOffset = ((elapsed + step - 1) / step) * step;
+
+        if (firstOffset > elapsed && elapsed < duration)
+        {
+          const double value = ramp.startValue + (ramp.endValue - ramp.startValue) * (double) elapsed / (double) duration;
+          _this->AddParamEvent(IParamEvent { 0, (int) pEvent->parameter, value, false });
+        }
+
+        for (int offset = firstOffset; offset < duration && startOffset + offset < blockSize; offset += step)
+        {
+          const double value = ramp.startValue + (ramp.endValue - ramp.startValue) * (double) offset / (double) duration;
+          _this->AddParamEvent(IParamEvent { startOffset + offset, (int) pEvent->parameter, value, false });
+        }
+
+        if (startOffset + duration <= blockSize)
+          _this->AddParamEvent(IParamEvent { std::max(startOffset + duration, 0), (int) pEvent->parameter, ramp.endValue, false });
+
+        _this->SendParameterValueFromAPI(pEvent->parameter, ramp.endValue, false);
+        continue;
+      }
+
+      // without sub-block splitting, the ramp is quantized to the render slice, like the last point of a VST3 parameter queue
+      OSStatus r = SetParamProc(_this, pEvent->parameter, pEvent->scope, pEvent->element, ramp.endValue, ramp.startBufferOffset);
+      if (r != noErr)
+      {
+        return r;
+      }
+    }
   }
   return noErr;
 }
@@ -17,6 +17,8 @@
  * @copydoc IPlugAU
  */
 
+#include <atomic>
+
 #include <CoreServices/CoreServices.h>
 #include <AudioUnit/AUComponent.h>
 #include <AudioUnit/AudioUnitProperties.h>
@@ -65,9 +67,13 @@ public:
   bool SendMidiMsgs(WDL_TypedBuf<IMidiMsg>& msgs) override;
   bool SendSysEx(const ISysEx& msg) override;
   void SetLatency(int samples) override;
+  void ProcessParamEvent(const IParamEvent& event) override;
+  void ProcessParamRamps(int startIdx, int nFrames) override { RenderParamRamps(*this, startIdx, nFrames); }
+  void AllocateParamRamps() override { CreateParamRamps(*this); }
 
 //IPlugAU
   void OutputSysexFromEditor();
+  void OutputMidiMsgs(int nFrames);
   void PreProcess();
   void ResizeScratchBuffers();
   static const char* AUInputTypeStr(int type);
@@ -121,6 +127,7 @@ private:
   bool CheckLegalIO(AudioUnitScope scope, int busIdx, int nChannels);
   bool CheckLegalIO();
   void AssessInputConnections();
+  void UpdateRenderTopology();
 
   UInt32 GetTagForNumChannels(int numChannels);
   UInt32 GetChannelLayoutTags(AudioUnitScope scope, AudioUnitElement element, AudioChannelLayoutTag* pTags);
@@ -190,9 +197,21 @@ private:
   WDL_PtrList<PropertyListener> mPropertyListeners;
   WDL_TypedBuf<AudioSampleType> mInScratchBuf;
   WDL_TypedBuf<AudioSampleType> mOutScratchBuf;
+  WDL_TypedBuf<BufferList> mInBufLists; // one per input bus, set up by UpdateRenderTopology() rather than on every render
+  WDL_TypedBuf<AudioSampleType*> mPulledInputs; // the input buffers pulled for the current render, per plug-in input channel
+  std::atomic<bool> mRenderTopologyChanged {true}; // set when connections or formats change, so the render proc can update its caches
+  int mLastConnectedOutputBus = -1;
+  bool mInPlaceProcessing = false; // kAudioUnitProperty_InPlaceProcessing, only allowed if DoesInPlaceProcessing()
   WDL_PtrList<AURenderCallbackStruct> mRenderNotify;
   AUMIDIOutputCallbackStruct mMidiCallback;
+  static constexpr const char* kLargeStateKey = "iplug-large-state"; // the key of the large state in the ClassInfo dictionary, see IPluginBase::SerializeLargeState()
+  static constexpr int kMidiPacketListSize = 65536; // the most a host reads of a MIDIPacketList
+  IMidiEventBuffer mMidiOutputQueue; // the messages sent during a render, sent to the host in one callback at the end of it, see OutputMidiMsgs()
+  WDL_HeapBuf mMidiPacketListBuf;
   AudioTimeStamp mLastRenderTimeStamp;
+#ifdef IPLUG_OS_WORKGROUP
+  AURenderContextObserver mRenderContextObserver = nullptr; // kAudioUnitProperty_RenderContextObserver, sets the audio workgroup
+#endif
 
   friend class IPlugAUFactory;
 };
@@ -0,0 +1,34 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#import <AudioToolbox/AudioToolbox.h>
+
+#include "config.h"   // This is your plugin's config.h.
+
+#ifndef AUV3_AUAUDIOUNIT_CLASS
+  #error AUV3_AUAUDIOUNIT_CLASS not defined - the name of the Objective-C AUAudioUnit subclass for the AUv3 plug-in, without quotes
+#endif
+
+/** The AUAudioUnit subclass for an IPlug AUv3 plug-in. It owns the IPlugAUv3 instance, publishes its parameters as an AUParameterTree
+ * and renders it from a C++ only internalRenderBlock */
+@interface AUV3_AUAUDIOUNIT_CLASS : AUAudioUnit
+
+/** Called by IPlugAUv3 when the UI starts, changes and ends a parameter gesture. Main thread only */
+- (void) beginInformHostOfParamChange: (uint64_t) address;
+- (void) informHostOfParamChange: (uint64_t) address : (float) realValue;
+- (void) endInformHostOfParamChange: (uint64_t) address;
+
+/** Rebuild the parameter tree, e.g. after the display texts of parameters have changed */
+- (void) informHostOfParameterDetailsChange;
+
+/** @return The IPlugAUv3 instance, as a void* so that this header can be included from Objective-C */
+- (void*) getPlug;
+
+@end
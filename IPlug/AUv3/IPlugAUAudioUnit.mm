@@ -0,0 +1,497 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#import <AVFoundation/AVFoundation.h>
+
+#import "IPlugAUAudioUnit.h"
+#include "IPlugAUv3.h"
+
+/** Everything the internalRenderBlock needs, captured by pointer so that rendering never messages self */
+struct IPlugAUv3RenderContext
+{
+  AUHostMusicalContextBlock mMusicalContext = nil;
+  AUHostTransportStateBlock mTransportState = nil;
+  AUMIDIOutputEventBlock mMIDIOutput = nil;
+  WDL_HeapBuf mInputBufList; // an AudioBufferList with mNInputChannels buffers
+  WDL_TypedBuf<float> mInputBuffers;
+  WDL_TypedBuf<float> mOutputBuffers;
+  int mNInputChannels = 0;
+  int mNOutputChannels = 0;
+  uint32_t mMaxFrames = 0;
+  bool mInPlace = false;
+
+  AudioBufferList* GetInputBufList() { return (AudioBufferList*) mInputBufList.Get(); }
+
+  /** Point the input buffer list at our own buffers, ready to be pulled */
+  void PrepareInputBufList(AUAudioFrameCount nFrames)
+  {
+    AudioBufferList* pBufList = GetInputBufList();
+    pBufList->mNumberBuffers = mNInputChannels;
+
+    for (int i = 0; i < mNInputChannels; i++)
+    {
+      pBufList->mBuffers[i].mNumberChannels = 1;
+      pBufList->mBuffers[i].mDataByteSize = nFrames * sizeof(float);
+      pBufList->mBuffers[i].mData = mInputBuffers.Get() + i * mMaxFrames;
+    }
+  }
+
+  void GetTimeInfo(ITimeInfo& timeInfo)
+  {
+    if (mMusicalContext)
+    {
+      double tempo = 0., tsNum = 0., beatPos = 0., downbeatPos = 0.;
+      NSInteger tsDenom = 0, sampleOffsetToNextBeat = 0;
+
+      if (mMusicalContext(&tempo, &tsNum, &tsDenom, &beatPos, &sampleOffsetToNextBeat, &downbeatPos))
+      {
+        if (tempo > 0.) timeInfo.mTempo = tempo;
+        if (tsNum > 0.) timeInfo.mNumerator = (int) tsNum;
+        if (tsDenom > 0) timeInfo.mDenominator = (int) tsDenom;
+        timeInfo.mPPQPos = beatPos;
+        timeInfo.mLastBar = downbeatPos;
+      }
+    }
+
+    if (mTransportState)
+    {
+      AUHostTransportStateFlags flags = 0;
+      double samplePos = 0., cycleStart = 0., cycleEnd = 0.;
+
+      if (mTransportState(&flags, &samplePos, &cycleStart, &cycleEnd))
+      {
+        timeInfo.mSamplePos = samplePos;
+        timeInfo.mCycleStart = cycleStart;
+        timeInfo.mCycleEnd = cycleEnd;
+        timeInfo.mTransportIsRunning = flags & AUHostTransportStateMoving;
+        timeInfo.mTransportLoopEnabled = flags & AUHostTransportStateCycling;
+      }
+    }
+  }
+};
+
+static bool SendMidiOutput(void* ctx, int64_t sampleTime, const uint8_t* pData, int size)
+{
+  IPlugAUv3RenderContext* pContext = (IPlugAUv3RenderContext*) ctx;
+  return pContext->mMIDIOutput && pContext->mMIDIOutput(sampleTime, 0, size, pData) == noErr;
+}
+
+@implementation AUV3_AUAUDIOUNIT_CLASS
+{
+  IPlugAUv3* mPlug;
+  IPlugAUv3RenderContext mRenderContext;
+  AUAudioUnitBus* mInputBus;
+  AUAudioUnitBus* mOutputBus;
+  AUAudioUnitBusArray* mInputBusArray;
+  AUAudioUnitBusArray* mOutputBusArray;
+  AUParameterTree* mParameterTree;
+  AUParameterObserverToken mUIUpdateToken;
+  BOOL mBypassed;
+}
+
+- (instancetype) initWithComponentDescription: (AudioComponentDescription) componentDescription options: (AudioComponentInstantiationOptions) options error: (NSError**) outError
+{
+  self = [super initWithComponentDescription: componentDescription options: options error: outError];
+
+  if (self == nil)
+    return nil;
+
+  mPlug = MakePlug();
+  mPlug->SetAUAudioUnit((__bridge void*) self);
+  mBypassed = NO;
+
+  mRenderContext.mNInputChannels = mPlug->IsInstrument() ? 0 : mPlug->MaxNChannelsForBus(ERoute::kInput, 0);
+  mRenderContext.mNOutputChannels = mPlug->MaxNChannelsForBus(ERoute::kOutput, 0);
+
+  AVAudioFormat* pDefaultFormat = [[AVAudioFormat alloc] initStandardFormatWithSampleRate: DEFAULT_SAMPLE_RATE channels: std::max(mRenderContext.mNOutputChannels, 1)];
+
+  mOutputBus = [[AUAudioUnitBus alloc] initWithFormat: pDefaultFormat error: nil];
+  mOutputBusArray = [[AUAudioUnitBusArray alloc] initWithAudioUnit: self busType: AUAudioUnitBusTypeOutput busses: @[mOutputBus]];
+
+  if (mRenderContext.mNInputChannels > 0)
+  {
+    AVAudioFormat* pInputFormat = [[AVAudioFormat alloc] initStandardFormatWithSampleRate: DEFAULT_SAMPLE_RATE channels: mRenderContext.mNInputChannels];
+    mInputBus = [[AUAudioUnitBus alloc] initWithFormat: pInputFormat error: nil];
+    mInputBusArray = [[AUAudioUnitBusArray alloc] initWithAudioUnit: self busType: AUAudioUnitBusTypeInput busses: @[mInputBus]];
+  }
+  else
+  {
+    mInputBusArray = [[AUAudioUnitBusArray alloc] initWithAudioUnit: self busType: AUAudioUnitBusTypeInput busses: @[]];
+  }
+
+  [self createParameterTree];
+
+  self.maximumFramesToRender = 512;
+
+  return self;
+}
+
+- (void) dealloc
+{
+  delete mPlug;
+}
+
+- (void*) getPlug
+{
+  return mPlug;
+}
+
+#pragma mark - Parameters
+
+- (void) createParameterTree
+{
+  NSMutableArray* pParams = [[NSMutableArray alloc] init];
+
+  for (int paramIdx = 0; paramIdx < mPlug->NParams(); paramIdx++)
+  {
+    const IParam* pParam = mPlug->GetParam(paramIdx);
+
+    AudioUnitParameterOptions flags = kAudioUnitParameterFlag_IsReadable | kAudioUnitParameterFlag_IsWritable;
+
+    if (!pParam->GetCanAutomate())
+      flags |= kAudioUnitParameterFlag_NonRealTime;
+
+    if (pParam->GetMeta())
+      flags |= kAudioUnitParameterFlag_IsGlobalMeta;
+
+    NSMutableArray* pValueStrings = nil;
+    AudioUnitParameterUnit unit = kAudioUnitParameterUnit_Generic;
+
+    if (pParam->NDisplayTexts() && pParam->GetStepped())
+    {
+      unit = kAudioUnitParameterUnit_Indexed;
+      pValueStrings = [[NSMutableArray alloc] init];
+
+      for (int i = 0; i < pParam->NDisplayTexts(); i++)
+        [pValueStrings addObject: [NSString stringWithUTF8String: pParam->GetDisplayTextAtIdx(i)]];
+    }
+    else if (pParam->Type() == IParam::kTypeBool)
+    {
+      unit = kAudioUnitParameterUnit_Boolean;
+    }
+
+    AUParameter* pAUParam = [AUParameterTree createParameterWithIdentifier: [NSString stringWithFormat: @"%d", paramIdx]
+                                                                    name: [NSString stringWithUTF8String: pParam->GetNameForHost()]
+                                                                 address: paramIdx
+                                                                     min: pParam->GetMin()
+                                                                     max: pParam->GetMax()
+                                                                    unit: unit
+                                                                unitName: [NSString stringWithUTF8String: pParam->GetLabelForHost()]
+                                                                   flags: flags
+                                                            valueStrings: pValueStrings
+                                                     dependentParameters: nil];
+    pAUParam.value = pParam->Value();
+    [pParams addObject: pAUParam];
+  }
+
+  mParameterTree = [AUParameterTree createTreeWithChildren: pParams];
+
+  // the blocks capture the C++ instance rather than self, so they don't retain the audio unit, and they never run on the render thread
+  IPlugAUv3* pPlug = mPlug;
+
+  mParameterTree.implementorValueObserver = ^(AUParameter* pAUParam, AUValue value) {
+    pPlug->SetParameterFromObserver((int) pAUParam.address, value);
+  };
+
+  mParameterTree.implementorValueProvider = ^AUValue(AUParameter* pAUParam) {
+    return (AUValue) pPlug->GetParameterForProvider((int) pAUParam.address);
+  };
+
+  mParameterTree.implementorStringFromValueCallback = ^NSString* (AUParameter* pAUParam, const AUValue* pValue) {
+    WDL_String display;
+    const IParam* pParam = pPlug->GetParam((int) pAUParam.address);
+    pParam->GetDisplayForHost(pValue ? *pValue : pParam->Value(), false, display);
+    return [NSString stringWithUTF8String: display.Get()];
+  };
+
+  mUIUpdateToken = [mParameterTree tokenByAddingParameterObserver: ^(AUParameterAddress address, AUValue value) {}];
+}
+
+- (AUParameterTree*) parameterTree
+{
+  return mParameterTree;
+}
+
+- (void) beginInformHostOfParamChange: (uint64_t) address
+{
+  AUParameter* pAUParam = [mParameterTree parameterWithAddress: address];
+  [pAUParam setValue: pAUParam.value originator: mUIUpdateToken atHostTime: 0 eventType: AUParameterAutomationEventTypeTouch];
+}
+
+- (void) informHostOfParamChange: (uint64_t) address : (float) realValue
+{
+  [[mParameterTree parameterWithAddress: address] setValue: realValue originator: mUIUpdateToken];
+}
+
+- (void) endInformHostOfParamChange: (uint64_t) address
+{
+  AUParameter* pAUParam = [mParameterTree parameterWithAddress: address];
+  [pAUParam setValue: pAUParam.value originator: mUIUpdateToken atHostTime: 0 eventType: AUParameterAutomationEventTypeRelease];
+}
+
+- (void) informHostOfParameterDetailsChange
+{
+  [self willChangeValueForKey: @"parameterTree"];
+  [self createParameterTree];
+  [self didChangeValueForKey: @"parameterTree"];
+}
+
+#pragma mark - Buses and properties
+
+- (AUAudioUnitBusArray*) inputBusses
+{
+  return mInputBusArray;
+}
+
+- (AUAudioUnitBusArray*) outputBusses
+{
+  return mOutputBusArray;
+}
+
+- (NSArray<NSNumber*>*) channelCapabilities
+{
+  NSMutableArray* pCapabilities = [[NSMutableArray alloc] init];
+
+  for (int i = 0; i < mPlug->NIOConfigs(); i++)
+  {
+    const IOConfig* pConfig = mPlug->GetIOConfig(i);
+    [pCapabilities addObject: @(pConfig->NChansOnBusSAFE(ERoute::kInput, 0))];
+    [pCapabilities addObject: @(pConfig->NChansOnBusSAFE(ERoute::kOutput, 0))];
+  }
+
+  return pCapabilities;
+}
+
+- (BOOL) canProcessInPlace
+{
+  return mPlug->DoesInPlaceProcessing();
+}
+
+- (BOOL) shouldBypassEffect
+{
+  return mBypassed;
+}
+
+- (void) setShouldBypassEffect: (BOOL) shouldBypassEffect
+{
+  mBypassed = shouldBypassEffect;
+  mPlug->SetBypassedFromHost(shouldBypassEffect);
+}
+
+- (void) setRenderingOffline: (BOOL) renderingOffline
+{
+  [super setRenderingOffline: renderingOffline];
+  mPlug->SetRenderingOfflineFromHost(renderingOffline);
+}
+
+- (NSTimeInterval) latency
+{
+  return (NSTimeInterval) mPlug->GetLatency() / mPlug->GetHostSampleRate();
+}
+
+- (NSTimeInterval) tailTime
+{
+  return (NSTimeInterval) std::max(mPlug->GetTailSize(), 0) / mPlug->GetHostSampleRate();
+}
+
+- (NSArray<NSString*>*) MIDIOutputNames
+{
+  return mPlug->DoesMIDIOut() ? @[@"MIDI Out"] : @[];
+}
+
+#pragma mark - State
+
+- (NSDictionary<NSString*, id>*) fullState
+{
+  NSMutableDictionary* pState = [[NSMutableDictionary alloc] initWithDictionary: [super fullState]];
+
+  IByteChunkPool::ScopedChunk scopedChunk = mPlug->AcquireStateChunk();
+  IByteChunk& chunk = scopedChunk.Get();
+
+  if (mPlug->SerializeState(chunk))
+    pState[@"data"] = [[NSData alloc] initWithBytes: chunk.GetData() length: chunk.Size()];
+
+  return pState;
+}
+
+- (void) setFullState: (NSDictionary<NSString*, id>*) fullState
+{
+  [super setFullState: fullState];
+
+  NSData* pData = fullState[@"data"];
+
+  if (pData)
+  {
+    IByteChunkPool::ScopedChunk scopedChunk = mPlug->AcquireStateChunk();
+    IByteChunk& chunk = scopedChunk.Get();
+    chunk.PutBytes(pData.bytes, (int) pData.length);
+    mPlug->UnserializeState(chunk, 0);
+    mPlug->OnRestoreState();
+  }
+}
+
+- (NSArray<AUAudioUnitPreset*>*) factoryPresets
+{
+  NSMutableArray* pPresets = [[NSMutableArray alloc] init];
+
+  for (int i = 0; i < mPlug->NPresets(); i++)
+  {
+    AUAudioUnitPreset* pPreset = [[AUAudioUnitPreset alloc] init];
+    pPreset.number = i;
+    pPreset.name = [NSString stringWithUTF8String: mPlug->GetPresetName(i)];
+    [pPresets addObject: pPreset];
+  }
+
+  return pPresets;
+}
+
+- (void) setCurrentPreset: (AUAudioUnitPreset*) currentPreset
+{
+  [super setCurrentPreset: currentPreset];
+
+  if (currentPreset && currentPreset.number >= 0 && currentPreset.number < mPlug->NPresets())
+    mPlug->RestorePreset((int) currentPreset.number);
+}
+
+#pragma mark - Rendering
+
+- (BOOL) allocateRenderResourcesAndReturnError: (NSError**) outError
+{
+  if (![super allocateRenderResourcesAndReturnError: outError])
+    return NO;
+
+  const int nIn = mInputBus ? (int) mInputBus.format.channelCount : 0;
+  const int nOut = (int) mOutputBus.format.channelCount;
+
+  if (nIn > 0 && mInputBus.format.sampleRate != mOutputBus.format.sampleRate)
+  {
+    if (outError)
+      *outError = [NSError errorWithDomain: NSOSStatusErrorDomain code: kAudioUnitErr_FormatNotSupported userInfo: nil];
+
+    return NO;
+  }
+
+  // everything the render block touches is allocated here
+  IPlugAUv3RenderContext& context = mRenderContext;
+  context.mMaxFrames = self.maximumFramesToRender;
+  context.mNInputChannels = nIn;
+  context.mNOutputChannels = nOut;
+  context.mInputBufList.Resize((int) (offsetof(AudioBufferList, mBuffers) + std::max(nIn, 1) * sizeof(AudioBuffer)));
+  context.mInputBuffers.Resize(nIn * context.mMaxFrames);
+  context.mOutputBuffers.Resize(nOut * context.mMaxFrames);
+  context.mInPlace = mPlug->DoesInPlaceProcessing();
+  context.mMusicalContext = self.musicalContextBlock;
+  context.mTransportState = self.transportStateBlock;
+  context.mMIDIOutput = self.MIDIOutputEventBlock;
+
+  mPlug->SetMidiOutputFunc(context.mMIDIOutput ? SendMidiOutput : nullptr, &mRenderContext);
+  mPlug->Prepare(mOutputBus.format.sampleRate, context.mMaxFrames, nIn, nOut);
+
+  return YES;
+}
+
+- (void) deallocateRenderResources
+{
+  mPlug->Release();
+  mPlug->SetMidiOutputFunc(nullptr, nullptr);
+  mRenderContext.mMusicalContext = nil;
+  mRenderContext.mTransportState = nil;
+  mRenderContext.mMIDIOutput = nil;
+
+  [super deallocateRenderResources];
+}
+
+#ifdef IPLUG_OS_WORKGROUP
+- (AURenderContextObserver) renderContextObserver API_AVAILABLE(macos(11.0), ios(14.0))
+{
+  // called on the render thread, before rendering in a new context: the block must not message self
+  IPlugAudioWorkgroup* pWorkgroup = &mPlug->GetAudioWorkgroup();
+
+  return ^(const AudioUnitRenderContext* pContext) {
+    pWorkgroup->Set(pContext ? (__bridge void*) pContext->workgroup : nullptr);
+  };
+}
+#endif
+
+- (AUInternalRenderBlock) internalRenderBlock
+{
+  // captured by value: the render block must not message self
+  IPlugAUv3* pPlug = mPlug;
+  IPlugAUv3RenderContext* pContext = &mRenderContext;
+
+  return ^AUAudioUnitStatus(AudioUnitRenderActionFlags* pActionFlags, const AudioTimeStamp* pTimestamp, AUAudioFrameCount nFrames, NSInteger outputBusNumber,
+                            AudioBufferList* pOutBufList, const AURenderEvent* pEventList, AURenderPullInputBlock pullInputBlock) {
+    if (nFrames > pContext->mMaxFrames)
+      return kAudioUnitErr_TooManyFramesToProcess;
+
+    AudioBufferList* pInBufList = nullptr;
+
+    if (pContext->mNInputChannels > 0)
+    {
+      if (!pullInputBlock)
+        return kAudioUnitErr_NoConnection;
+
+      pContext->PrepareInputBufList(nFrames);
+      pInBufList = pContext->GetInputBufList();
+
+      AudioUnitRenderActionFlags pullFlags = 0;
+      AUAudioUnitStatus status = pullInputBlock(&pullFlags, pTimestamp, nFrames, 0, pInBufList);
+
+      if (status != noErr)
+        return status;
+    }
+
+    for (int i = 0; i < (int) pOutBufList->mNumberBuffers; i++)
+    {
+      if (!pOutBufList->mBuffers[i].mData) // the host wants us to provide the buffers
+      {
+        if (pContext->mInPlace && pInBufList && i < (int) pInBufList->mNumberBuffers)
+          pOutBufList->mBuffers[i].mData = pInBufList->mBuffers[i].mData;
+        else
+          pOutBufList->mBuffers[i].mData = pContext->mOutputBuffers.Get() + std::min(i, pContext->mNOutputChannels - 1) * pContext->mMaxFrames;
+      }
+
+      pOutBufList->mBuffers[i].mDataByteSize = nFrames * sizeof(float);
+    }
+
+    const AUEventSampleTime blockStart = (AUEventSampleTime) pTimestamp->mSampleTime;
+
+    for (const AURenderEvent* pEvent = pEventList; pEvent; pEvent = pEvent->head.next)
+    {
+      const int offset = (int) std::max<AUEventSampleTime>(0, std::min<AUEventSampleTime>(pEvent->head.eventSampleTime - blockStart, nFrames - 1));
+
+      switch (pEvent->head.eventType)
+      {
+        case AURenderEventParameter:
+          pPlug->ProcessParamFromRenderEvent((int) pEvent->parameter.parameterAddress, pEvent->parameter.value, offset);
+          break;
+        case AURenderEventParameterRamp:
+          pPlug->ProcessParamRampFromRenderEvent((int) pEvent->parameter.parameterAddress, pEvent->parameter.value, offset, (int) pEvent->parameter.rampDurationSampleFrames, (int) nFrames);
+          break;
+        case AURenderEventMIDI:
+        case AURenderEventMIDISysEx:
+          pPlug->ProcessMidiFromRenderEvent(pEvent->MIDI.data, (int) pEvent->MIDI.length, offset);
+          break;
+        default:
+          break;
+      }
+    }
+
+    ITimeInfo timeInfo;
+    pContext->GetTimeInfo(timeInfo);
+
+    if (pPlug->Render(pInBufList, pOutBufList, (int) nFrames, blockStart, timeInfo))
+      *pActionFlags |= kAudioUnitRenderAction_OutputIsSilence;
+
+    return noErr;
+  };
+}
+
+@end
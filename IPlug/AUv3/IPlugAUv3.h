@@ -0,0 +1,120 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#ifndef _IPLUGAPI_
+#define _IPLUGAPI_
+// Only load one API class!
+
+/**
+ * @file
+ * @copydoc IPlugAUv3
+ */
+
+#include <AudioToolbox/AudioToolbox.h>
+
+#include "IPlugAPIBase.h"
+#include "IPlugProcessor.h"
+
+/** Used to pass various instance info to the API class */
+struct IPlugInstanceInfo
+{};
+
+/**  AudioUnit v3 API base class for an IPlug plug-in.
+ * The Objective-C AUAudioUnit subclass (see IPlugAUAudioUnit.h) owns an instance of this class. It builds the AUParameterTree, sets up the buses
+ * and provides the internalRenderBlock, which only calls the C++ methods in the "render thread" section below, so there is no Objective-C messaging on the render thread
+ *   @ingroup APIClasses */
+class IPlugAUv3 : public IPlugAPIBase
+                , public IPlugProcessor<PLUG_SAMPLE_DST>
+{
+public:
+  IPlugAUv3(IPlugInstanceInfo instanceInfo, IPlugConfig config);
+
+  //IPlugAPIBase
+  void BeginInformHostOfParamChange(int paramIdx) override;
+  void InformHostOfParamChange(int paramIdx, double normalizedValue) override;
+  void EndInformHostOfParamChange(int paramIdx) override;
+  void InformHostOfProgramChange() override {};
+  void InformHostOfParameterDetailsChange() override;
+
+  //IPlugProcessor
+  bool SendMidiMsg(const IMidiMsg& msg) override;
+  bool SendSysEx(const ISysEx& msg) override;
+  void ProcessParamEvent(const IParamEvent& event) override;
+  void ProcessParamRamps(int startIdx, int nFrames) override { RenderParamRamps(*this, startIdx, nFrames); }
+  void AllocateParamRamps() override { CreateParamRamps(*this); }
+
+  //IPlugAUv3 - main thread, called by the AUAudioUnit
+  /** Store the AUAudioUnit that owns this plug-in, so that parameter gestures from the UI can be forwarded to the AUParameterTree */
+  void SetAUAudioUnit(void* pAUAudioUnit) { mAUAudioUnit = pAUAudioUnit; }
+
+  /** Called from allocateRenderResourcesAndReturnError
+   * @param sampleRate The sample rate of the output bus
+   * @param maxFramesToRender The largest number of frames the host will render at once
+   * @param nInputChannels The number of channels on the input bus, 0 for instruments
+   * @param nOutputChannels The number of channels on the output bus */
+  void Prepare(double sampleRate, uint32_t maxFramesToRender, int nInputChannels, int nOutputChannels);
+
+  /** Called from deallocateRenderResources */
+  void Release();
+
+  /** Called from the AUParameterTree's implementorValueObserver, when the host or another view of the tree changes a parameter. May be called on any non-realtime thread
+   * @param paramIdx The parameter index (the AUParameterAddress)
+   * @param value The new non-normalized value */
+  void SetParameterFromObserver(int paramIdx, double value);
+
+  /** Called from the AUParameterTree's implementorValueProvider
+   * @return The current non-normalized value of the parameter */
+  double GetParameterForProvider(int paramIdx) const { return GetParam(paramIdx)->Value(); }
+
+  /** Set the function used to send MIDI to the host, from the AUAudioUnit's MIDIOutputEventBlock.
+   * @param func Called on the render thread with ctx, the sample time and the bytes of the message
+   * @param ctx Owned by the AUAudioUnit, must stay valid while render resources are allocated */
+  void SetMidiOutputFunc(bool (*func)(void* ctx, int64_t sampleTime, const uint8_t* pData, int size), void* ctx) { mMidiOutputFunc = func; mMidiOutputCtx = ctx; }
+
+  /** Called when the host sets the AUAudioUnit's shouldBypassEffect property */
+  void SetBypassedFromHost(bool bypassed) { SetBypassed(bypassed); }
+
+  /** Called when the host sets the AUAudioUnit's renderingOffline property */
+  void SetRenderingOfflineFromHost(bool offline) { SetRenderingOffline(offline); }
+
+  //IPlugAUv3 - render thread, called by the internalRenderBlock. No Objective-C, no locks, no allocation
+  /** Queue a parameter change from an AURenderEventParameter
+   * @param offset The offset in samples from the start of the render cycle */
+  void ProcessParamFromRenderEvent(int paramIdx, double value, int offset);
+
+  /** Queue a parameter ramp from an AURenderEventParameterRamp, which runs from the current value of the parameter to value
+   * @param offset The offset in samples from the start of the render cycle
+   * @param duration The length of the ramp in samples */
+  void ProcessParamRampFromRenderEvent(int paramIdx, double value, int offset, int duration, int nFrames);
+
+  /** Handle an AURenderEventMIDI or AURenderEventMIDISysEx */
+  void ProcessMidiFromRenderEvent(const uint8_t* pData, int size, int offset);
+
+  /** Attach the host's buffers, apply the events queued by the methods above and process
+   * @param pInBufList The input buffers that were pulled, nullptr if there is no input bus
+   * @param pOutBufList The output buffers, with mData set (the AUAudioUnit substitutes its own buffers if the host passes nullptr)
+   * @param nFrames The number of frames to render
+   * @param sampleTime The sample time of the first frame, used to time MIDI output
+   * @param timeInfo Tempo and transport, from the musicalContextBlock and transportStateBlock
+   * @return \c true if the output is silent */
+  bool Render(AudioBufferList* pInBufList, AudioBufferList* pOutBufList, int nFrames, int64_t sampleTime, const ITimeInfo& timeInfo);
+
+private:
+  void* mAUAudioUnit = nullptr;
+  bool (*mMidiOutputFunc)(void* ctx, int64_t sampleTime, const uint8_t* pData, int size) = nullptr;
+  void* mMidiOutputCtx = nullptr;
+  int64_t mRenderSampleTime = 0;
+  WDL_TypedBuf<float*> mInputPtrs; // sized by Prepare()
+  WDL_TypedBuf<float*> mOutputPtrs;
+};
+
+IPlugAUv3* MakePlug();
+
+#endif
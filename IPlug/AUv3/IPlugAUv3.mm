@@ -0,0 +1,229 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#import <AudioToolbox/AudioToolbox.h>
+
+#include "IPlugAUv3.h"
+#import "IPlugAUAudioUnit.h"
+
+IPlugAUv3::IPlugAUv3(IPlugInstanceInfo instanceInfo, IPlugConfig c)
+: IPlugAPIBase(c, kAPIAUv3)
+, IPlugProcessor<PLUG_SAMPLE_DST>(c, kAPIAUv3)
+{
+  Trace(TRACELOC, "%s", c.pluginName);
+
+  SetBlockSize(DEFAULT_BLOCK_SIZE);
+
+  CreateTimer();
+}
+
+#pragma mark - IPlugAPIBase overrides
+
+void IPlugAUv3::BeginInformHostOfParamChange(int paramIdx)
+{
+  [(AUV3_AUAUDIOUNIT_CLASS*) mAUAudioUnit beginInformHostOfParamChange:paramIdx];
+}
+
+void IPlugAUv3::InformHostOfParamChange(int paramIdx, double normalizedValue)
+{
+  [(AUV3_AUAUDIOUNIT_CLASS*) mAUAudioUnit informHostOfParamChange:paramIdx :(float) GetParam(paramIdx)->FromNormalized(normalizedValue)];
+}
+
+void IPlugAUv3::EndInformHostOfParamChange(int paramIdx)
+{
+  [(AUV3_AUAUDIOUNIT_CLASS*) mAUAudioUnit endInformHostOfParamChange:paramIdx];
+}
+
+void IPlugAUv3::InformHostOfParameterDetailsChange()
+{
+  [(AUV3_AUAUDIOUNIT_CLASS*) mAUAudioUnit informHostOfParameterDetailsChange];
+}
+
+#pragma mark - IPlugProcessor overrides
+
+bool IPlugAUv3::SendMidiMsg(const IMidiMsg& msg)
+{
+  if (!mMidiOutputFunc)
+    return false;
+
+  const uint8_t data[3] = { msg.mStatus, msg.mData1, msg.mData2 };
+  return mMidiOutputFunc(mMidiOutputCtx, mRenderSampleTime + msg.mOffset, data, 3);
+}
+
+bool IPlugAUv3::SendSysEx(const ISysEx& msg)
+{
+  if (!mMidiOutputFunc)
+    return false;
+
+  return mMidiOutputFunc(mMidiOutputCtx, mRenderSampleTime + msg.mOffset, msg.mData, msg.mSize);
+}
+
+void IPlugAUv3::ProcessParamEvent(const IParamEvent& event)
+{
+  // no params mutex here: parameter values are atomic, and every event in the list is applied on the audio thread
+  if (event.mNormalized)
+    GetParam(event.mParamIdx)->SetNormalized(event.mValue);
+  else
+    GetParam(event.mParamIdx)->Set(event.mValue);
+  OnParamChange(event.mParamIdx, kHost, event.mOffset);
+}
+
+#pragma mark - IPlugAUv3 main thread
+
+void IPlugAUv3::Prepare(double sampleRate, uint32_t maxFramesToRender, int nInputChannels, int nOutputChannels)
+{
+  TRACE;
+
+  const int nIn = std::min(nInputChannels, MaxNChannels(ERoute::kInput));
+  const int nOut = std::min(nOutputChannels, MaxNChannels(ERoute::kOutput));
+
+  // the bus formats can only change while render resources are deallocated, so the connections are set here rather than on every render
+  SetChannelConnections(ERoute::kInput, 0, MaxNChannels(ERoute::kInput), false);
+  SetChannelConnections(ERoute::kInput, 0, nIn, true);
+  SetChannelConnections(ERoute::kOutput, 0, MaxNChannels(ERoute::kOutput), false);
+  SetChannelConnections(ERoute::kOutput, 0, nOut, true);
+
+  mInputPtrs.Resize(nIn);
+  mOutputPtrs.Resize(nOut);
+
+  SetSampleRate(sampleRate);
+  SetBlockSize(maxFramesToRender);
+  OnReset();
+  OnActivate(true);
+}
+
+void IPlugAUv3::Release()
+{
+  TRACE;
+  OnActivate(false);
+}
+
+void IPlugAUv3::SetParameterFromObserver(int paramIdx, double value)
+{
+  if (paramIdx < 0 || paramIdx >= NParams())
+    return;
+
+  // the observer is also called for changes that our own UI made through the parameter tree
+  if (GetParam(paramIdx)->Value() == value)
+    return;
+
+  ENTER_PARAMS_MUTEX;
+  GetParam(paramIdx)->Set(value);
+  SendParameterValueFromAPI(paramIdx, value, false);
+  OnParamChange(paramIdx, kHost);
+  LEAVE_PARAMS_MUTEX;
+}
+
+#pragma mark - IPlugAUv3 render thread
+
+void IPlugAUv3::ProcessParamFromRenderEvent(int paramIdx, double value, int offset)
+{
+  if (paramIdx < 0 || paramIdx >= NParams())
+    return;
+
+  // applied by IPlugProcessor as ProcessBlock() is split into sub-blocks, otherwise at the start of the block
+  if (GetSampleAccurateParams())
+    AddParamEvent(IParamEvent { offset, paramIdx, value, false });
+  else
+    ProcessParamEvent(IParamEvent { offset, paramIdx, value, false });
+
+  SendParameterValueFromAPI(paramIdx, value, false);
+}
+
+void IPlugAUv3::ProcessParamRampFromRenderEvent(int paramIdx, double value, int offset, int duration, int nFrames)
+{
+  if (paramIdx < 0 || paramIdx >= NParams())
+    return;
+
+  if (!GetSampleAccurateParams() || duration <= 0)
+  {
+    ProcessParamFromRenderEvent(paramIdx, value, offset);
+    return;
+  }
+
+  // the ramp is applied as a series of steps, one per sub-block, up to the end of this render cycle
+  const double startValue = GetParam(paramIdx)->Value();
+  const int step = GetMinSubBlockSize();
+
+  for (int i = 0; i < duration && offset + i < nFrames; i += step)
+    AddParamEvent(IParamEvent { offset + i, paramIdx, startValue + (value - startValue) * (double) i / (double) duration, false });
+
+  if (offset + duration <= nFrames)
+    AddParamEvent(IParamEvent { offset + duration, paramIdx, value, false });
+
+  SendParameterValueFromAPI(paramIdx, value, false);
+}
+
+void IPlugAUv3::ProcessMidiFromRenderEvent(const uint8_t* pData, int size, int offset)
+{
+  if (!DoesMIDIIn() || size <= 0)
+    return;
+
+  if (pData[0] == 0xF0 || size > 3)
+  {
+    ISysEx sysex { offset, pData, size };
+    ProcessSysEx(sysex);
+    return;
+  }
+
+  IMidiMsg msg;
+  msg.mOffset = offset;
+  msg.mStatus = pData[0];
+  msg.mData1 = size > 1 ? pData[1] : 0;
+  msg.mData2 = size > 2 ? pData[2] : 0;
+
+  if (GetSampleAccurateMidi())
+    AddMidiEvent(msg);
+  else
+    ProcessMidiMsg(msg);
+
+  mMidiMsgsFromProcessor.Push(msg);
+}
+
+bool IPlugAUv3::Render(AudioBufferList* pInBufList, AudioBufferList* pOutBufList, int nFrames, int64_t sampleTime, const ITimeInfo& timeInfo)
+{
+  mRenderSampleTime = sampleTime;
+  SetTimeInfo(timeInfo);
+
+  // AUv3 buffers are always deinterleaved float
+  const int nIn = pInBufList ? std::min((int) pInBufList->mNumberBuffers, mInputPtrs.GetSize()) : 0;
+  const int nOut = std::min((int) pOutBufList->mNumberBuffers, mOutputPtrs.GetSize());
+
+  for (int i = 0; i < nIn; i++)
+    mInputPtrs.Get()[i] = (float*) pInBufList->mBuffers[i].mData;
+
+  for (int i = 0; i < nOut; i++)
+    mOutputPtrs.Get()[i] = (float*) pOutBufList->mBuffers[i].mData;
+
+  AttachBuffers(ERoute::kInput, 0, nIn, mInputPtrs.Get(), nFrames);
+  AttachBuffers(ERoute::kOutput, 0, nOut, mOutputPtrs.Get(), nFrames);
+
+  if (GetBypassed())
+  {
+    PassThroughBuffers(0.f, nFrames);
+  }
+  else
+  {
+    if (mMidiMsgsFromEditor.ElementsAvailable())
+    {
+      IMidiMsg msg;
+
+      while (mMidiMsgsFromEditor.Pop(msg))
+      {
+        ProcessMidiMsg(msg);
+      }
+    }
+
+    ProcessBlockStartTasks();
+    ProcessBuffers(0.f, nFrames);
+  }
+
+  return GetOutputsSilent();
+}
@@ -0,0 +1,937 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#include <cstring>
+
+#include "IPlugCLAP.h"
+
+#define CLAP_THIS IPlugCLAP* _this = (IPlugCLAP*) pPlugin->plugin_data
+
+static inline clap_event_header MakeClapEventHeader(uint32_t size, uint16_t type, uint32_t time = 0)
+{
+  return clap_event_header { size, time, CLAP_CORE_EVENT_SPACE_ID, type, 0 };
+}
+
+#pragma mark - IPlugCLAP Construct
+
+IPlugCLAP::IPlugCLAP(IPlugInstanceInfo instanceInfo, IPlugConfig c)
+: IPlugAPIBase(c, kAPICLAP)
+, IPlugProcessor<PLUG_SAMPLE_DST>(c, kAPICLAP)
+, mHost(instanceInfo.mHost)
+{
+  Trace(TRACELOC, "%s", c.pluginName);
+
+  memset(&mClapPlugin, 0, sizeof(clap_plugin));
+  mClapPlugin.desc = instanceInfo.mDescriptor;
+  mClapPlugin.plugin_data = this;
+  mClapPlugin.init = ClapInit;
+  mClapPlugin.destroy = ClapDestroy;
+  mClapPlugin.activate = ClapActivate;
+  mClapPlugin.deactivate = ClapDeactivate;
+  mClapPlugin.start_processing = ClapStartProcessing;
+  mClapPlugin.stop_processing = ClapStopProcessing;
+  mClapPlugin.reset = ClapReset;
+  mClapPlugin.process = ClapProcess;
+  mClapPlugin.get_extension = ClapGetExtension;
+  mClapPlugin.on_main_thread = ClapOnMainThread;
+
+  SetChannelConnections(ERoute::kInput, 0, MaxNChannels(ERoute::kInput), true);
+  SetChannelConnections(ERoute::kOutput, 0, MaxNChannels(ERoute::kOutput), true);
+
+  for (int d = 0; d < 2; d++)
+  {
+    const ERoute direction = (ERoute) d;
+    mNChansConnected[d].Resize(MaxNBuses(direction));
+
+    for (int b = 0; b < MaxNBuses(direction); b++)
+      mNChansConnected[d].Get()[b] = MaxNChannelsForBus(direction, b);
+  }
+
+  SetBlockSize(DEFAULT_BLOCK_SIZE);
+
+  CreateTimer();
+}
+
+bool IPlugCLAP::Init()
+{
+  TRACE;
+
+  mHostParams = (const clap_host_params*) mHost->get_extension(mHost, CLAP_EXT_PARAMS);
+  mHostLatency = (const clap_host_latency*) mHost->get_extension(mHost, CLAP_EXT_LATENCY);
+  mHostThreadPool = (const clap_host_thread_pool*) mHost->get_extension(mHost, CLAP_EXT_THREAD_POOL);
+
+  SetHost(mHost->name, 0);
+
+  // the plug-in's constructor has set up the parameters by now
+  mParamBaseValues.reset(new std::atomic<double>[NParams()]);
+  mParamModAmounts.Resize(NParams());
+
+  for (int i = 0; i < NParams(); i++)
+  {
+    mParamBaseValues[i].store(GetParam(i)->Value());
+    mParamModAmounts.Get()[i] = 0.;
+  }
+
+  return true;
+}
+
+bool IPlugCLAP::Activate(double sampleRate, uint32_t minFrames, uint32_t maxFrames)
+{
+  TRACE;
+
+  // latency changes are reported with clap_host_latency::changed() during activate, see SetLatency()
+  mActivating = true;
+  SetSampleRate(sampleRate);
+  SetBlockSize((int) maxFrames);
+  OnReset();
+  OnActivate(true);
+  mActivating = false;
+
+  return true;
+}
+
+void IPlugCLAP::Deactivate()
+{
+  TRACE;
+  OnActivate(false);
+}
+
+const void* IPlugCLAP::GetExtension(const char* id)
+{
+  static const clap_plugin_params sParams = {
+    ClapParamsCount, ClapParamsGetInfo, ClapParamsGetValue, ClapParamsValueToText, ClapParamsTextToValue, ClapParamsFlush
+  };
+
+  static const clap_plugin_audio_ports sAudioPorts = { ClapAudioPortsCount, ClapAudioPortsGet };
+  static const clap_plugin_note_ports sNotePorts = { ClapNotePortsCount, ClapNotePortsGet };
+  static const clap_plugin_state sState = { ClapStateSave, ClapStateLoad };
+  static const clap_plugin_latency sLatency = { ClapLatencyGet };
+  static const clap_plugin_tail sTail = { ClapTailGet };
+  static const clap_plugin_thread_pool sThreadPool = { ClapThreadPoolExec };
+
+  if (!strcmp(id, CLAP_EXT_PARAMS)) return &sParams;
+  if (!strcmp(id, CLAP_EXT_AUDIO_PORTS)) return &sAudioPorts;
+  if (!strcmp(id, CLAP_EXT_NOTE_PORTS) && (DoesMIDIIn() || DoesMIDIOut())) return &sNotePorts;
+  if (!strcmp(id, CLAP_EXT_STATE)) return &sState;
+  if (!strcmp(id, CLAP_EXT_LATENCY)) return &sLatency;
+  if (!strcmp(id, CLAP_EXT_TAIL)) return &sTail;
+  if (!strcmp(id, CLAP_EXT_THREAD_POOL)) return &sThreadPool;
+
+  return nullptr;
+}
+
+#pragma mark - IPlugAPIBase overrides
+
+void IPlugCLAP::BeginInformHostOfParamChange(int idx)
+{
+  mParamsToHost.Push(ParamToHost { CLAP_EVENT_PARAM_GESTURE_BEGIN, idx, 0. });
+}
+
+void IPlugCLAP::InformHostOfParamChange(int idx, double normalizedValue)
+{
+  const double value = GetParam(idx)->FromNormalized(normalizedValue);
+
+  if (mParamBaseValues)
+    mParamBaseValues[idx].store(value);
+
+  mParamsToHost.Push(ParamToHost { CLAP_EVENT_PARAM_VALUE, idx, value });
+
+  // the queue is drained in process(), or in params.flush() if the host isn't processing
+  if (mHostParams)
+    mHostParams->request_flush(mHost);
+}
+
+void IPlugCLAP::EndInformHostOfParamChange(int idx)
+{
+  mParamsToHost.Push(ParamToHost { CLAP_EVENT_PARAM_GESTURE_END, idx, 0. });
+
+  if (mHostParams)
+    mHostParams->request_flush(mHost);
+}
+
+void IPlugCLAP::InformHostOfParameterDetailsChange()
+{
+  if (mHostParams)
+    mHostParams->rescan(mHost, CLAP_PARAM_RESCAN_VALUES | CLAP_PARAM_RESCAN_TEXT);
+}
+
+#pragma mark - IPlugProcessor overrides
+
+void IPlugCLAP::SetLatency(int samples)
+{
+  IPlugProcessor::SetLatency(samples);
+
+  // CLAP only allows the latency to change while activating, otherwise the host has to restart the plug-in to pick it up
+  if (mActivating)
+  {
+    if (mHostLatency)
+      mHostLatency->changed(mHost);
+  }
+  else
+  {
+    mHost->request_restart(mHost);
+  }
+}
+
+bool IPlugCLAP::SendMidiMsg(const IMidiMsg& msg)
+{
+  if (!mOutEvents)
+    return false;
+
+  clap_event_midi event;
+  event.header = MakeClapEventHeader(sizeof(clap_event_midi), CLAP_EVENT_MIDI, (uint32_t) Clip(msg.mOffset + GetSubBlockOffset(), 0, std::max(mNFrames - 1, 0)));
+  event.port_index = 0;
+  event.data[0] = msg.mStatus;
+  event.data[1] = msg.mData1;
+  event.data[2] = msg.mData2;
+
+  return mOutEvents->try_push(mOutEvents, &event.header);
+}
+
+bool IPlugCLAP::SendSysEx(const ISysEx& msg)
+{
+  if (!mOutEvents)
+    return false;
+
+  // the host copies the event, including the buffer, in try_push()
+  clap_event_midi_sysex event;
+  event.header = MakeClapEventHeader(sizeof(clap_event_midi_sysex), CLAP_EVENT_MIDI_SYSEX, (uint32_t) Clip(msg.mOffset + GetSubBlockOffset(), 0, std::max(mNFrames - 1, 0)));
+  event.port_index = 0;
+  event.buffer = msg.mData;
+  event.size = (uint32_t) msg.mSize;
+
+  return mOutEvents->try_push(mOutEvents, &event.header);
+}
+
+void IPlugCLAP::ProcessParamEvent(const IParamEvent& event)
+{
+  // no params mutex here: parameter values are atomic, and every event in the list is applied on the audio thread
+  if (event.mNormalized)
+    GetParam(event.mParamIdx)->SetNormalized(event.mValue);
+  else
+    GetParam(event.mParamIdx)->Set(event.mValue);
+  OnParamChange(event.mParamIdx, kHost, event.mOffset);
+}
+
+bool IPlugCLAP::HostParallelFor(int nTasks, void (*task)(void* taskCtx, int taskIdx), void* taskCtx)
+{
+  if (!mHostThreadPool || nTasks <= 0)
+    return false;
+
+  mParallelTask = task;
+  mParallelTaskCtx = taskCtx;
+
+  // request_exec() returns once every task has run, or false straight away if the host can't run them
+  const bool ran = mHostThreadPool->request_exec(mHost, (uint32_t) nTasks);
+
+  mParallelTask = nullptr;
+  mParallelTaskCtx = nullptr;
+
+  return ran;
+}
+
+#pragma mark - Processing
+
+void IPlugCLAP::SetTimeInfoFromTransport(const clap_event_transport* pTransport)
+{
+  ITimeInfo timeInfo;
+
+  if (pTransport)
+  {
+    if (pTransport->flags & CLAP_TRANSPORT_HAS_TEMPO)
+    {
+      timeInfo.mTempo = pTransport->tempo;
+      timeInfo.mTempoIncrement = pTransport->tempo_inc;
+    }
+
+    if (pTransport->flags & CLAP_TRANSPORT_HAS_BEATS_TIMELINE)
+    {
+      timeInfo.mPPQPos = (double) pTransport->song_pos_beats / (double) CLAP_BEATTIME_FACTOR;
+      timeInfo.mLastBar = (double) pTransport->bar_start / (double) CLAP_BEATTIME_FACTOR;
+      timeInfo.mCycleStart = (double) pTransport->loop_start_beats / (double) CLAP_BEATTIME_FACTOR;
+      timeInfo.mCycleEnd = (double) pTransport->loop_end_beats / (double) CLAP_BEATTIME_FACTOR;
+    }
+
+    if (pTransport->flags & CLAP_TRANSPORT_HAS_SECONDS_TIMELINE)
+      timeInfo.mSamplePos = (double) pTransport->song_pos_seconds / (double) CLAP_SECTIME_FACTOR * GetHostSampleRate();
+
+    if (pTransport->flags & CLAP_TRANSPORT_HAS_TIME_SIGNATURE)
+    {
+      timeInfo.mNumerator = (int) pTransport->tsig_num;
+      timeInfo.mDenominator = (int) pTransport->tsig_denom;
+    }
+
+    timeInfo.mTransportIsRunning = pTransport->flags & CLAP_TRANSPORT_IS_PLAYING;
+    timeInfo.mTransportLoopEnabled = pTransport->flags & CLAP_TRANSPORT_IS_LOOP_ACTIVE;
+  }
+
+  SetTimeInfo(timeInfo);
+}
+
+void IPlugCLAP::ApplyParamValue(int paramIdx, int offset, bool inProcess)
+{
+  const IParam* pParam = GetParam(paramIdx);
+  const double value = Clip(mParamBaseValues[paramIdx].load() + mParamModAmounts.Get()[paramIdx], pParam->GetMin(), pParam->GetMax());
+
+  // applied by IPlugProcessor as ProcessBlock() is split into sub-blocks, otherwise straight away
+  if (inProcess && GetSampleAccurateParams())
+    AddParamEvent(IParamEvent { offset, paramIdx, value, false });
+  else
+    ProcessParamEvent(IParamEvent { offset, paramIdx, value, false });
+}
+
+void IPlugCLAP::ProcessInputEvent(const clap_event_header* pEvent, bool inProcess)
+{
+  if (pEvent->space_id != CLAP_CORE_EVENT_SPACE_ID)
+    return;
+
+  const int offset = inProcess ? std::min((int) pEvent->time, std::max(mNFrames - 1, 0)) : 0;
+
+  // with sample accurate MIDI, messages are merged with the parameter changes and delivered as ProcessBlock() reaches them
+  auto DeliverMidiMsg = [&](const IMidiMsg& msg) {
+    if (!DoesMIDIIn())
+      return;
+
+    if (inProcess && GetSampleAccurateMidi())
+      AddMidiEvent(msg);
+    else
+      ProcessMidiMsg(msg);
+
+    mMidiMsgsFromProcessor.Push(msg);
+  };
+
+  switch (pEvent->type)
+  {
+    case CLAP_EVENT_NOTE_ON:
+    case CLAP_EVENT_NOTE_OFF:
+    case CLAP_EVENT_NOTE_CHOKE:
+    {
+      const clap_event_note* pNote = (const clap_event_note*) pEvent;
+
+      if (pNote->key < 0) // wildcard notes, e.g. a choke of all notes, aren't representable as MIDI
+        break;
+
+      IMidiMsg msg;
+      const int channel = pNote->channel < 0 ? 0 : pNote->channel;
+
+      if (pEvent->type == CLAP_EVENT_NOTE_ON)
+        msg.MakeNoteOnMsg(pNote->key, (int) std::round(pNote->velocity * 127.), offset, channel);
+      else
+        msg.MakeNoteOffMsg(pNote->key, offset, channel);
+
+      DeliverMidiMsg(msg);
+      break;
+    }
+    case CLAP_EVENT_MIDI:
+    {
+      const clap_event_midi* pMidi = (const clap_event_midi*) pEvent;
+      DeliverMidiMsg(IMidiMsg(offset, pMidi->data[0], pMidi->data[1], pMidi->data[2]));
+      break;
+    }
+    case CLAP_EVENT_MIDI_SYSEX:
+    {
+      const clap_event_midi_sysex* pSysEx = (const clap_event_midi_sysex*) pEvent;
+
+      if (DoesMIDIIn())
+      {
+        ISysEx sysex { offset, pSysEx->buffer, (int) pSysEx->size };
+        ProcessSysEx(sysex);
+      }
+      break;
+    }
+    case CLAP_EVENT_PARAM_VALUE:
+    {
+      const clap_event_param_value* pParamValue = (const clap_event_param_value*) pEvent;
+      const int paramIdx = (int) pParamValue->param_id;
+
+      if (paramIdx >= 0 && paramIdx < NParams())
+      {
+        mParamBaseValues[paramIdx].store(pParamValue->value);
+        ApplyParamValue(paramIdx, offset, inProcess);
+        SendParameterValueFromAPI(paramIdx, pParamValue->value, false);
+      }
+      break;
+    }
+    case CLAP_EVENT_PARAM_MOD:
+    {
+      const clap_event_param_mod* pParamMod = (const clap_event_param_mod*) pEvent;
+      const int paramIdx = (int) pParamMod->param_id;
+
+      // only global modulation is supported, parameters don't advertise per-note modulation
+      if (paramIdx >= 0 && paramIdx < NParams() && pParamMod->note_id == -1)
+      {
+        mParamModAmounts.Get()[paramIdx] = pParamMod->amount;
+        ApplyParamValue(paramIdx, offset, inProcess);
+      }
+      break;
+    }
+    case CLAP_EVENT_TRANSPORT:
+    {
+      // a change during the block, e.g. a tempo change or a jump, after the transport the block started with
+      const clap_event_transport* pTransport = (const clap_event_transport*) pEvent;
+
+      if (inProcess && (pTransport->flags & CLAP_TRANSPORT_HAS_TEMPO))
+      {
+        const double ppqPos = (pTransport->flags & CLAP_TRANSPORT_HAS_BEATS_TIMELINE) ? (double) pTransport->song_pos_beats / (double) CLAP_BEATTIME_FACTOR : -1.;
+        AddTransportChange(offset, pTransport->tempo, pTransport->tempo_inc, ppqPos);
+      }
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+void IPlugCLAP::ProcessInputEvents(const clap_input_events* pInEvents, bool inProcess)
+{
+  if (!pInEvents)
+    return;
+
+  const uint32_t nEvents = pInEvents->size(pInEvents);
+
+  for (uint32_t i = 0; i < nEvents; i++)
+  {
+    const clap_event_header* pEvent = pInEvents->get(pInEvents, i);
+
+    if (pEvent)
+      ProcessInputEvent(pEvent, inProcess);
+  }
+}
+
+void IPlugCLAP::SendParamsToHost(const clap_output_events* pOutEvents)
+{
+  if (!pOutEvents)
+    return;
+
+  ParamToHost change;
+
+  while (mParamsToHost.Pop(change))
+  {
+    if (change.mType == CLAP_EVENT_PARAM_VALUE)
+    {
+      clap_event_param_value event;
+      event.header = MakeClapEventHeader(sizeof(clap_event_param_value), CLAP_EVENT_PARAM_VALUE);
+      event.param_id = (clap_id) change.mIdx;
+      event.cookie = nullptr;
+      event.note_id = -1;
+      event.port_index = -1;
+      event.channel = -1;
+      event.key = -1;
+      event.value = change.mValue;
+      pOutEvents->try_push(pOutEvents, &event.header);
+    }
+    else
+    {
+      clap_event_param_gesture event;
+      event.header = MakeClapEventHeader(sizeof(clap_event_param_gesture), change.mType);
+      event.param_id = (clap_id) change.mIdx;
+      pOutEvents->try_push(pOutEvents, &event.header);
+    }
+  }
+}
+
+void IPlugCLAP::SendSysExFromEditor()
+{
+  //Output SYSEX from the editor, which has bypassed ProcessSysEx()
+  IPlugMessageRing::Record record;
+
+  while (mSysExDataFromEditor.Peek(record))
+  {
+    ISysEx smsg {0, record.mData, record.mSize};
+    SendSysEx(smsg);
+    mSysExDataFromEditor.Release();
+  }
+}
+
+bool IPlugCLAP::AttachClapBuffers(ERoute direction, const clap_audio_buffer* pBuffers, uint32_t nBuffers, bool use64, int nFrames)
+{
+  int* pNChansConnected = mNChansConnected[direction].Get();
+  bool allSilent = true;
+  int chanOffset = 0;
+
+  for (int b = 0; b < MaxNBuses(direction); b++)
+  {
+    const int maxNChans = MaxNChannelsForBus(direction, b);
+    const int nChans = b < (int) nBuffers ? std::min((int) pBuffers[b].channel_count, maxNChans) : 0;
+
+    // only touch the connections when the host's layout changes
+    if (nChans != pNChansConnected[b])
+    {
+      SetChannelConnections(direction, chanOffset, nChans, true);
+      SetChannelConnections(direction, chanOffset + nChans, maxNChans - nChans, false);
+      pNChansConnected[b] = nChans;
+    }
+
+    if (nChans > 0)
+    {
+      const clap_audio_buffer& buffer = pBuffers[b];
+
+      if (use64)
+        AttachBuffers(direction, chanOffset, nChans, buffer.data64, nFrames);
+      else
+        AttachBuffers(direction, chanOffset, nChans, buffer.data32, nFrames);
+
+      // constant_mask flags channels whose samples all equal the first one, so the first sample tells us if they are zero
+      for (int c = 0; c < nChans && allSilent; c++)
+      {
+        const bool constant = c < 64 && (buffer.constant_mask & (1ULL << c));
+        const bool zero = use64 ? buffer.data64[c][0] == 0. : buffer.data32[c][0] == 0.f;
+        allSilent = constant && zero;
+      }
+    }
+
+    chanOffset += maxNChans;
+  }
+
+  return allSilent;
+}
+
+clap_process_status IPlugCLAP::Process(const clap_process* pProcess)
+{
+  const int nFrames = (int) pProcess->frames_count;
+
+  if (nFrames <= 0)
+    return CLAP_PROCESS_CONTINUE;
+
+  mNFrames = nFrames;
+  mOutEvents = pProcess->out_events;
+
+  SetTimeInfoFromTransport(pProcess->transport);
+
+  // the host's events are sorted by time, so they go straight onto the event timeline
+  ProcessInputEvents(pProcess->in_events, true);
+  SendParamsToHost(pProcess->out_events);
+
+  IMidiMsg msg;
+
+  while (mMidiMsgsFromEditor.Pop(msg))
+  {
+    ProcessMidiMsg(msg);
+  }
+
+  SendSysExFromEditor();
+
+  // every port has the same sample size (CLAP_AUDIO_PORT_REQUIRES_COMMON_SAMPLE_SIZE), so the first buffer tells us which it is
+  const clap_audio_buffer* pFirst = pProcess->audio_outputs_count ? pProcess->audio_outputs : (pProcess->audio_inputs_count ? pProcess->audio_inputs : nullptr);
+  const bool use64 = pFirst && pFirst->data64;
+
+  const bool inputsSilent = AttachClapBuffers(ERoute::kInput, pProcess->audio_inputs, pProcess->audio_inputs_count, use64, nFrames);
+  AttachClapBuffers(ERoute::kOutput, pProcess->audio_outputs, pProcess->audio_outputs_count, use64, nFrames);
+
+  SetInputsFlaggedSilent(pProcess->audio_inputs_count > 0 && inputsSilent);
+
+  ProcessBlockStartTasks();
+
+  if (use64)
+    ProcessBuffers((double) 0., nFrames);
+  else
+    ProcessBuffers((float) 0.f, nFrames);
+
+  mOutEvents = nullptr;
+
+  if (GetOutputsSilent())
+  {
+    for (uint32_t b = 0; b < pProcess->audio_outputs_count; b++)
+      pProcess->audio_outputs[b].constant_mask = ~0ULL;
+
+    // the host may stop calling process() until there is input again
+    return CLAP_PROCESS_CONTINUE_IF_NOT_QUIET;
+  }
+
+  return CLAP_PROCESS_CONTINUE;
+}
+
+#pragma mark - clap_plugin callbacks
+
+bool IPlugCLAP::ClapInit(const clap_plugin* pPlugin)
+{
+  CLAP_THIS;
+  return _this->Init();
+}
+
+void IPlugCLAP::ClapDestroy(const clap_plugin* pPlugin)
+{
+  CLAP_THIS;
+  delete _this;
+}
+
+bool IPlugCLAP::ClapActivate(const clap_plugin* pPlugin, double sampleRate, uint32_t minFrames, uint32_t maxFrames)
+{
+  CLAP_THIS;
+  return _this->Activate(sampleRate, minFrames, maxFrames);
+}
+
+void IPlugCLAP::ClapDeactivate(const clap_plugin* pPlugin)
+{
+  CLAP_THIS;
+  _this->Deactivate();
+}
+
+bool IPlugCLAP::ClapStartProcessing(const clap_plugin* pPlugin)
+{
+  return true;
+}
+
+void IPlugCLAP::ClapStopProcessing(const clap_plugin* pPlugin)
+{
+}
+
+void IPlugCLAP::ClapReset(const clap_plugin* pPlugin)
+{
+  CLAP_THIS;
+  _this->OnReset();
+}
+
+clap_process_status IPlugCLAP::ClapProcess(const clap_plugin* pPlugin, const clap_process* pProcess)
+{
+  CLAP_THIS;
+  return _this->Process(pProcess);
+}
+
+const void* IPlugCLAP::ClapGetExtension(const clap_plugin* pPlugin, const char* id)
+{
+  CLAP_THIS;
+  return _this->GetExtension(id);
+}
+
+void IPlugCLAP::ClapOnMainThread(const clap_plugin* pPlugin)
+{
+}
+
+#pragma mark - clap.params
+
+uint32_t IPlugCLAP::ClapParamsCount(const clap_plugin* pPlugin)
+{
+  CLAP_THIS;
+  return (uint32_t) _this->NParams();
+}
+
+bool IPlugCLAP::ClapParamsGetInfo(const clap_plugin* pPlugin, uint32_t paramIdx, clap_param_info* pInfo)
+{
+  CLAP_THIS;
+
+  if (paramIdx >= (uint32_t) _this->NParams())
+    return false;
+
+  const IParam* pParam = _this->GetParam((int) paramIdx);
+
+  clap_param_info_flags flags = 0;
+
+  if (pParam->GetCanAutomate())
+    flags |= CLAP_PARAM_IS_AUTOMATABLE;
+
+  if (pParam->GetStepped() || pParam->Type() != IParam::kTypeDouble)
+    flags |= CLAP_PARAM_IS_STEPPED;
+  else
+    flags |= CLAP_PARAM_IS_MODULATABLE; // continuous parameters can be modulated
+
+  memset(pInfo, 0, sizeof(clap_param_info));
+  pInfo->id = (clap_id) paramIdx;
+  pInfo->flags = flags;
+  pInfo->cookie = nullptr;
+  strncpy(pInfo->name, pParam->GetNameForHost(), CLAP_NAME_SIZE - 1);
+  strncpy(pInfo->module, pParam->GetGroupForHost(), CLAP_PATH_SIZE - 1);
+  pInfo->min_value = pParam->GetMin();
+  pInfo->max_value = pParam->GetMax();
+  pInfo->default_value = pParam->GetDefault();
+
+  return true;
+}
+
+bool IPlugCLAP::ClapParamsGetValue(const clap_plugin* pPlugin, clap_id paramID, double* pValue)
+{
+  CLAP_THIS;
+
+  if (paramID >= (clap_id) _this->NParams() || !_this->mParamBaseValues)
+    return false;
+
+  // the base value, without modulation
+  *pValue = _this->mParamBaseValues[paramID].load();
+  return true;
+}
+
+bool IPlugCLAP::ClapParamsValueToText(const clap_plugin* pPlugin, clap_id paramID, double value, char* pDisplay, uint32_t size)
+{
+  CLAP_THIS;
+
+  if (paramID >= (clap_id) _this->NParams())
+    return false;
+
+  const IParam* pParam = _this->GetParam((int) paramID);
+  WDL_String display;
+  pParam->GetDisplayForHost(value, false, display);
+
+  const char* label = pParam->GetLabelForHost();
+
+  if (label && *label && !pParam->NDisplayTexts())
+  {
+    display.Append(" ");
+    display.Append(label);
+  }
+
+  strncpy(pDisplay, display.Get(), size);
+
+  if (size)
+    pDisplay[size - 1] = '\0';
+
+  return true;
+}
+
+bool IPlugCLAP::ClapParamsTextToValue(const clap_plugin* pPlugin, clap_id paramID, const char* pDisplay, double* pValue)
+{
+  CLAP_THIS;
+
+  if (paramID >= (clap_id) _this->NParams())
+    return false;
+
+  *pValue = _this->GetParam((int) paramID)->StringToValue(pDisplay);
+  return true;
+}
+
+void IPlugCLAP::ClapParamsFlush(const clap_plugin* pPlugin, const clap_input_events* pInEvents, const clap_output_events* pOutEvents)
+{
+  CLAP_THIS;
+
+  // called instead of process() while the plug-in isn't processing
+  _this->ProcessInputEvents(pInEvents, false);
+  _this->SendParamsToHost(pOutEvents);
+}
+
+#pragma mark - clap.audio-ports
+
+uint32_t IPlugCLAP::ClapAudioPortsCount(const clap_plugin* pPlugin, bool isInput)
+{
+  CLAP_THIS;
+  return (uint32_t) _this->MaxNBuses(isInput ? ERoute::kInput : ERoute::kOutput);
+}
+
+bool IPlugCLAP::ClapAudioPortsGet(const clap_plugin* pPlugin, uint32_t index, bool isInput, clap_audio_port_info* pInfo)
+{
+  CLAP_THIS;
+
+  const ERoute direction = isInput ? ERoute::kInput : ERoute::kOutput;
+
+  if (index >= (uint32_t) _this->MaxNBuses(direction))
+    return false;
+
+  const int nChans = _this->MaxNChannelsForBus(direction, (int) index);
+
+  memset(pInfo, 0, sizeof(clap_audio_port_info));
+  pInfo->id = (clap_id) index;
+
+  if (index == 0)
+    strncpy(pInfo->name, isInput ? "Main In" : "Main Out", CLAP_NAME_SIZE - 1);
+  else
+    snprintf(pInfo->name, CLAP_NAME_SIZE, "%s %u", isInput ? "Aux In" : "Aux Out", index);
+
+  pInfo->flags = CLAP_AUDIO_PORT_REQUIRES_COMMON_SAMPLE_SIZE;
+
+  if (index == 0)
+    pInfo->flags |= CLAP_AUDIO_PORT_IS_MAIN;
+
+#ifdef SAMPLE_TYPE_DOUBLE
+  pInfo->flags |= CLAP_AUDIO_PORT_SUPPORTS_64BITS | CLAP_AUDIO_PORT_PREFERS_64BITS;
+#endif
+
+  pInfo->channel_count = (uint32_t) nChans;
+  pInfo->port_type = nChans == 1 ? CLAP_PORT_MONO : (nChans == 2 ? CLAP_PORT_STEREO : nullptr);
+  pInfo->in_place_pair = CLAP_INVALID_ID;
+
+  return true;
+}
+
+#pragma mark - clap.note-ports
+
+uint32_t IPlugCLAP::ClapNotePortsCount(const clap_plugin* pPlugin, bool isInput)
+{
+  CLAP_THIS;
+  return (isInput ? _this->DoesMIDIIn() : _this->DoesMIDIOut()) ? 1 : 0;
+}
+
+bool IPlugCLAP::ClapNotePortsGet(const clap_plugin* pPlugin, uint32_t index, bool isInput, clap_note_port_info* pInfo)
+{
+  if (index != 0)
+    return false;
+
+  memset(pInfo, 0, sizeof(clap_note_port_info));
+  pInfo->id = 0;
+  pInfo->supported_dialects = CLAP_NOTE_DIALECT_CLAP | CLAP_NOTE_DIALECT_MIDI;
+  pInfo->preferred_dialect = isInput ? CLAP_NOTE_DIALECT_CLAP : CLAP_NOTE_DIALECT_MIDI; // output is always sent as MIDI
+  strncpy(pInfo->name, isInput ? "MIDI In" : "MIDI Out", CLAP_NAME_SIZE - 1);
+
+  return true;
+}
+
+#pragma mark - clap.state
+
+// a plug-in with large state (see IPluginBase::HasLargeState()) writes [int32 'IPLC'][int32 state chunk size][state chunk][large state], so that on load
+// only the state chunk is buffered, and the large state is read straight from the host's stream. Otherwise the state is just the state chunk, as before
+static constexpr int32_t kLargeStateLayoutMagic = 'IPLC';
+
+class ClapStateWriter : public IStateWriter
+{
+public:
+  ClapStateWriter(const clap_ostream* pStream) : mStream(pStream) {}
+
+  bool Write(const void* pData, int64_t size) override
+  {
+    const uint8_t* pBytes = static_cast<const uint8_t*>(pData);
+
+    // the stream may accept fewer bytes than asked for
+    while (size > 0)
+    {
+      const int64_t written = mStream->write(mStream, pBytes, (uint64_t) size);
+
+      if (written <= 0)
+        return false;
+
+      pBytes += written;
+      size -= written;
+    }
+
+    return true;
+  }
+
+private:
+  const clap_ostream* mStream;
+};
+
+class ClapStateReader : public IStateReader
+{
+public:
+  ClapStateReader(const clap_istream* pStream) : mStream(pStream) {}
+
+  int64_t Read(void* pData, int64_t size) override
+  {
+    uint8_t* pBytes = static_cast<uint8_t*>(pData);
+    int64_t nRead = 0;
+
+    while (nRead < size)
+    {
+      const int64_t bytesRead = mStream->read(mStream, pBytes + nRead, (uint64_t) (size - nRead));
+
+      if (bytesRead < 0)
+        return -1;
+
+      if (bytesRead == 0)
+        break;
+
+      nRead += bytesRead;
+    }
+
+    return nRead;
+  }
+
+private:
+  const clap_istream* mStream;
+};
+
+bool IPlugCLAP::ClapStateSave(const clap_plugin* pPlugin, const clap_ostream* pStream)
+{
+  CLAP_THIS;
+
+  IByteChunkPool::ScopedChunk scopedChunk = _this->AcquireStateChunk();
+  IByteChunk& chunk = scopedChunk.Get();
+
+  if (!_this->SerializeState(chunk))
+    return false;
+
+  ClapStateWriter writer(pStream);
+
+  if (!_this->HasLargeState())
+    return writer.Write(chunk.GetData(), chunk.Size());
+
+  return writer.Put(kLargeStateLayoutMagic) && writer.Put<int32_t>(chunk.Size()) && writer.Write(chunk.GetData(), chunk.Size()) && _this->WriteLargeState(writer);
+}
+
+bool IPlugCLAP::ClapStateLoad(const clap_plugin* pPlugin, const clap_istream* pStream)
+{
+  CLAP_THIS;
+
+  IByteChunkPool::ScopedChunk scopedChunk = _this->AcquireStateChunk();
+  IByteChunk& chunk = scopedChunk.Get();
+  ClapStateReader reader(pStream);
+  int32_t header[2] = {0, 0};
+  const int64_t headerRead = reader.Read(header, sizeof(header));
+
+  if (headerRead < 0)
+    return false;
+
+  const bool largeState = headerRead == (int64_t) sizeof(header) && header[0] == kLargeStateLayoutMagic && header[1] >= 0;
+
+  if (largeState)
+  {
+    chunk.Resize(header[1]);
+
+    if (!reader.ReadAll(chunk.GetData(), header[1]))
+      return false;
+  }
+  else
+  {
+    if (headerRead > 0)
+      chunk.PutBytes(header, (int) headerRead);
+
+    uint8_t buffer[4096];
+
+    for (;;)
+    {
+      const int64_t bytesRead = reader.Read(buffer, sizeof(buffer));
+
+      if (bytesRead < 0)
+        return false;
+
+      if (bytesRead == 0)
+        break;
+
+      chunk.PutBytes(buffer, (int) bytesRead);
+    }
+  }
+
+  ENTER_PARAMS_MUTEX_STATIC;
+  const int pos = _this->UnserializeState(chunk, 0);
+
+  // loaded values replace the base values, modulation keeps applying on top
+  for (int i = 0; i < _this->NParams(); i++)
+    _this->mParamBaseValues[i].store(_this->GetParam(i)->Value());
+  LEAVE_PARAMS_MUTEX_STATIC;
+
+  if (pos < 0)
+    return false;
+
+  _this->OnRestoreState();
+
+  // the parameters apply at once, the large data follows
+  return !largeState || _this->ReadLargeState(reader);
+}
+
+#pragma mark - clap.latency, clap.tail
+
+uint32_t IPlugCLAP::ClapLatencyGet(const clap_plugin* pPlugin)
+{
+  CLAP_THIS;
+  return (uint32_t) std::max(_this->GetLatency(), 0);
+}
+
+uint32_t IPlugCLAP::ClapTailGet(const clap_plugin* pPlugin)
+{
+  CLAP_THIS;
+  const int tailSize = _this->GetTailSize();
+  return tailSize < 0 ? UINT32_MAX : (uint32_t) tailSize; // a negative tail size means an infinite tail
+}
+
+#pragma mark - clap.thread-pool
+
+void IPlugCLAP::ClapThreadPoolExec(const clap_plugin* pPlugin, uint32_t taskIdx)
+{
+  CLAP_THIS;
+
+  if (_this->mParallelTask)
+    _this->mParallelTask(_this->mParallelTaskCtx, (int) taskIdx);
+}
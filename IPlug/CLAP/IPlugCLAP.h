@@ -0,0 +1,156 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#ifndef _IPLUGAPI_
+#define _IPLUGAPI_
+// Only load one API class!
+
+/**
+ * @file
+ * @copydoc IPlugCLAP
+ */
+
+#include <atomic>
+#include <memory>
+
+#include "clap/clap.h"
+
+#include "IPlugAPIBase.h"
+#include "IPlugProcessor.h"
+
+/** Used to pass various instance info to the API class */
+struct IPlugInstanceInfo
+{
+  const clap_host* mHost = nullptr;
+  const clap_plugin_descriptor* mDescriptor = nullptr;
+};
+
+/**  CLAP API base class for an IPlug plug-in.
+ * The input events of each clap_process are already sorted by time, so they are mapped straight onto the sample accurate event timeline
+ * (see IPlugProcessor::SetSampleAccurateParams() and SetSampleAccurateMidi()). Parameter modulation (CLAP_EVENT_PARAM_MOD) is applied on top of the
+ * base value of a parameter without changing it, and HostParallelFor() runs tasks on the host's clap.thread-pool. Nothing allocates on the audio thread
+ *   @ingroup APIClasses */
+class IPlugCLAP : public IPlugAPIBase
+                , public IPlugProcessor<PLUG_SAMPLE_DST>
+{
+public:
+  IPlugCLAP(IPlugInstanceInfo instanceInfo, IPlugConfig config);
+
+  //IPlugAPIBase
+  void BeginInformHostOfParamChange(int idx) override;
+  void InformHostOfParamChange(int idx, double normalizedValue) override;
+  void EndInformHostOfParamChange(int idx) override;
+  void InformHostOfProgramChange() override {};
+  void InformHostOfParameterDetailsChange() override;
+
+  //IPlugProcessor
+  void SetLatency(int samples) override;
+  bool SendMidiMsg(const IMidiMsg& msg) override;
+  bool SendSysEx(const ISysEx& msg) override;
+  void ProcessParamEvent(const IParamEvent& event) override;
+  void ProcessParamRamps(int startIdx, int nFrames) override { RenderParamRamps(*this, startIdx, nFrames); }
+  void AllocateParamRamps() override { CreateParamRamps(*this); }
+  bool HostParallelFor(int nTasks, void (*task)(void* taskCtx, int taskIdx), void* taskCtx) override;
+
+  //IPlugCLAP
+  /** @return The clap_plugin that the factory hands to the host. Its destroy() deletes this instance */
+  const clap_plugin* GetClapPlugin() const { return &mClapPlugin; }
+
+private:
+  /** A parameter gesture or change from the UI, queued on the main thread and sent to the host as output events */
+  struct ParamToHost
+  {
+    uint16_t mType; // CLAP_EVENT_PARAM_GESTURE_BEGIN, CLAP_EVENT_PARAM_VALUE or CLAP_EVENT_PARAM_GESTURE_END
+    int mIdx;
+    double mValue;
+  };
+
+  bool Init();
+  bool Activate(double sampleRate, uint32_t minFrames, uint32_t maxFrames);
+  void Deactivate();
+  clap_process_status Process(const clap_process* pProcess);
+  const void* GetExtension(const char* id);
+
+  /** Apply the events from the host, in order
+   * @param inProcess \c true when called from process(), so that events are merged into the event timeline, \c false from params.flush() */
+  void ProcessInputEvents(const clap_input_events* pInEvents, bool inProcess);
+  void ProcessInputEvent(const clap_event_header* pEvent, bool inProcess);
+  void ApplyParamValue(int paramIdx, int offset, bool inProcess);
+  void SendParamsToHost(const clap_output_events* pOutEvents);
+  void SendSysExFromEditor();
+  void SetTimeInfoFromTransport(const clap_event_transport* pTransport);
+
+  /** Attach the channels of the host's audio buffers, one clap_audio_buffer per bus, updating the channel connections if the host gives a bus fewer channels
+   * @return \c true if the host flagged every channel it provided as constant zero */
+  bool AttachClapBuffers(ERoute direction, const clap_audio_buffer* pBuffers, uint32_t nBuffers, bool use64, int nFrames);
+
+  static bool ClapInit(const clap_plugin* pPlugin);
+  static void ClapDestroy(const clap_plugin* pPlugin);
+  static bool ClapActivate(const clap_plugin* pPlugin, double sampleRate, uint32_t minFrames, uint32_t maxFrames);
+  static void ClapDeactivate(const clap_plugin* pPlugin);
+  static bool ClapStartProcessing(const clap_plugin* pPlugin);
+  static void ClapStopProcessing(const clap_plugin* pPlugin);
+  static void ClapReset(const clap_plugin* pPlugin);
+  static clap_process_status ClapProcess(const clap_plugin* pPlugin, const clap_process* pProcess);
+  static const void* ClapGetExtension(const clap_plugin* pPlugin, const char* id);
+  static void ClapOnMainThread(const clap_plugin* pPlugin);
+
+  // clap.params
+  static uint32_t ClapParamsCount(const clap_plugin* pPlugin);
+  static bool ClapParamsGetInfo(const clap_plugin* pPlugin, uint32_t paramIdx, clap_param_info* pInfo);
+  static bool ClapParamsGetValue(const clap_plugin* pPlugin, clap_id paramID, double* pValue);
+  static bool ClapParamsValueToText(const clap_plugin* pPlugin, clap_id paramID, double value, char* pDisplay, uint32_t size);
+  static bool ClapParamsTextToValue(const clap_plugin* pPlugin, clap_id paramID, const char* pDisplay, double* pValue);
+  static void ClapParamsFlush(const clap_plugin* pPlugin, const clap_input_events* pInEvents, const clap_output_events* pOutEvents);
+
+  // clap.audio-ports
+  static uint32_t ClapAudioPortsCount(const clap_plugin* pPlugin, bool isInput);
+  static bool ClapAudioPortsGet(const clap_plugin* pPlugin, uint32_t index, bool isInput, clap_audio_port_info* pInfo);
+
+  // clap.note-ports
+  static uint32_t ClapNotePortsCount(const clap_plugin* pPlugin, bool isInput);
+  static bool ClapNotePortsGet(const clap_plugin* pPlugin, uint32_t index, bool isInput, clap_note_port_info* pInfo);
+
+  // clap.state
+  static bool ClapStateSave(const clap_plugin* pPlugin, const clap_ostream* pStream);
+  static bool ClapStateLoad(const clap_plugin* pPlugin, const clap_istream* pStream);
+
+  // clap.latency, clap.tail
+  static uint32_t ClapLatencyGet(const clap_plugin* pPlugin);
+  static uint32_t ClapTailGet(const clap_plugin* pPlugin);
+
+  // clap.thread-pool
+  static void ClapThreadPoolExec(const clap_plugin* pPlugin, uint32_t taskIdx);
+
+  clap_plugin mClapPlugin;
+  const clap_host* mHost;
+  const clap_host_params* mHostParams = nullptr;
+  const clap_host_latency* mHostLatency = nullptr;
+  const clap_host_thread_pool* mHostThreadPool = nullptr;
+
+  bool mActivating = false;
+  const clap_output_events* mOutEvents = nullptr; // valid during process() only, for SendMidiMsg() and SendSysEx()
+  int mNFrames = 0;
+
+  // parameter modulation: the host's base value of each parameter and the modulation amount on top of it
+  std::unique_ptr<std::atomic<double>[]> mParamBaseValues; // read by params.get_value() on the main thread
+  WDL_TypedBuf<double> mParamModAmounts; // audio thread only
+
+  IPlugQueue<ParamToHost> mParamsToHost {PARAM_TRANSFER_SIZE};
+
+  WDL_TypedBuf<int> mNChansConnected[2]; // per bus, the number of channels connected at the last process()
+
+  void (*mParallelTask)(void* taskCtx, int taskIdx) = nullptr;
+  void* mParallelTaskCtx = nullptr;
+};
+
+IPlugCLAP* MakePlug(const clap_host* pHost, const clap_plugin_descriptor* pDescriptor);
+
+#endif
@@ -8,6 +8,12 @@
  ==============================================================================
  */
 
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
 template <typename T>
 class ADSREnvelope
 {
@@ -239,7 +245,164 @@ public:
     mPrevOutput = (result * mLevel);
     return mPrevOutput;
   }
+
+  /** Render a block of the envelope, the same as calling Process() nFrames times but a segment at a time:
+   * the number of samples left in the attack, decay or release is worked out up front, and the segment is filled with a loop the compiler vectorizes.
+   * The short retrigger and early release ramps still go sample by sample, as does any stage with an increment of 0
+   * @param pOut nFrames of output
+   * @param sustainLevel The sustain level for the whole block */
+  void ProcessBlock(T* pOut, int nFrames, double sustainLevel)
+  {
+    int s = 0;
+
+    while (s < nFrames)
+    {
+      const int remaining = nFrames - s;
+      int done = 0;
+
+      switch (mStage)
+      {
+        case kIdle:
+          Fill(pOut + s, remaining, mEnvValue);
+          done = remaining;
+          break;
+        case kSustain:
+          Fill(pOut + s, remaining, sustainLevel);
+          done = remaining;
+          break;
+        case kAttack:
+          done = RenderAttack(pOut + s, remaining);
+          break;
+        case kDecay:
+          done = RenderExp(pOut + s, remaining, mDecayIncr, 1. - sustainLevel, sustainLevel, kSustain, 1., sustainLevel);
+          break;
+        case kRelease:
+          done = RenderExp(pOut + s, remaining, mReleaseIncr, mReleaseLevel, 0., kIdle, 0., 0.);
+          break;
+        default:
+          break;
+      }
+
+      if (!done) // a ramp with side effects, or an edge case
+      {
+        pOut[s] = (T) Process(sustainLevel);
+        done = 1;
+      }
+
+      s += done;
+    }
+  }
+
 private:
+  /** Fill with a constant result
+   * @return n */
+  int Fill(T* pOut, int n, double result)
+  {
+    const T output = (T) (result * mLevel);
+
+    for (int i = 0; i < n; i++)
+      pOut[i] = output;
+
+    mPrevResult = result;
+    mPrevOutput = result * mLevel;
+    return n;
+  }
+
+  /** The linear attack, in closed form: sample k of it is mEnvValue + k * incr
+   * @return The number of samples rendered, up to and including the one that moves to decay, or 0 to leave it to Process() */
+  int RenderAttack(T* pOut, int n)
+  {
+    const double incr = mAttackIncr * mScalar;
+
+    if (!(incr > 0.))
+      return 0;
+
+    const double env0 = mEnvValue;
+    // the first step whose value is above ENV_VALUE_HIGH is the last of the attack
+    const double stepsToEnd = std::floor((ENV_VALUE_HIGH - env0) / incr) + 1.;
+    const int nRamp = stepsToEnd > (double) n ? n : std::max(0, (int) stepsToEnd - 1);
+    const double level = mLevel;
+
+    for (int i = 0; i < nRamp; i++)
+      pOut[i] = (T) ((env0 + (i + 1) * incr) * level);
+
+    double result = env0 + nRamp * incr;
+    mEnvValue = result;
+
+    if (nRamp < n)
+    {
+      mStage = kDecay;
+      mEnvValue = result = 1.;
+      pOut[nRamp] = (T) (result * level);
+    }
+
+    mPrevResult = result;
+    mPrevOutput = result * level;
+    return std::min(n, nRamp + 1);
+  }
+
+  /** An exponential decay or release, in closed form: the envelope is mEnvValue * r^k, with r = 1 - incr * mScalar, and the result is envelope * scale + offset.
+   * The sample where the envelope drops below ENV_VALUE_LOW moves to nextStage, with nextEnvValue, and has nextResult
+   * @return The number of samples rendered, or 0 to leave it to Process() */
+  int RenderExp(T* pOut, int n, double incr, double scale, double offset, int nextStage, double nextEnvValue, double nextResult)
+  {
+    const double r = 1. - incr * mScalar;
+
+    if (!(r > 0. && r < 1.) || !(mEnvValue >= ENV_VALUE_LOW))
+      return 0;
+
+    // the first step below ENV_VALUE_LOW ends the segment
+    const double stepsToEnd = std::floor(std::log(ENV_VALUE_LOW / mEnvValue) / std::log(r)) + 1.;
+    const int nRamp = stepsToEnd > (double) n ? n : std::max(0, (int) stepsToEnd - 1);
+    const double level = mLevel;
+    const double outScale = scale * level;
+    const double outOffset = offset * level;
+
+    // four interleaved geometric series, so that the loop vectorizes
+    const double r2 = r * r;
+    const double r4 = r2 * r2;
+    double env[4];
+    env[0] = mEnvValue * r;
+    env[1] = env[0] * r;
+    env[2] = env[1] * r;
+    env[3] = env[2] * r;
+    double last = mEnvValue;
+    int i = 0;
+
+    for (; i + 4 <= nRamp; i += 4)
+    {
+      for (int j = 0; j < 4; j++)
+      {
+        pOut[i + j] = (T) (env[j] * outScale + outOffset);
+        env[j] *= r4;
+      }
+    }
+
+    if (i)
+      last = env[3] / r4;
+
+    for (int j = 0; i < nRamp; i++, j++)
+    {
+      pOut[i] = (T) (env[j] * outScale + outOffset);
+      last = env[j];
+    }
+
+    double result = last * scale + offset;
+    mEnvValue = last;
+
+    if (nRamp < n)
+    {
+      mStage = nextStage;
+      mEnvValue = nextEnvValue;
+      result = nextResult;
+      pOut[nRamp] = (T) (result * level);
+    }
+
+    mPrevResult = result;
+    mPrevOutput = result * level;
+    return std::min(n, nRamp + 1);
+  }
+
   inline T CalcIncrFromTimeLinear(T timeMS, T sr) const
   {
     if (timeMS <= 0.) return 0.;
@@ -0,0 +1,502 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc FFT
+ */
+
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "mutex.h"
+
+#include "IPlugConstants.h"
+
+#if defined(IPLUG_FFT_VDSP)
+  #include <Accelerate/Accelerate.h>
+#elif defined(IPLUG_FFT_PFFFT)
+  #include "pffft.h"
+#endif
+
+/** Power of two real and complex FFTs, for the DSP in IPlug/Extras (PartitionedConvolver, analysers...).
+ *
+ * Spectra are interleaved: a complex FFT of size n reads and writes n (re, im) pairs, and a real FFT of size n writes n floats, the DC and Nyquist
+ * bins (both real) first, then the (re, im) pairs of bins 1 to n / 2 - 1. That is the "ordered" layout of pffft and, scaled, vDSP's.
+ * Neither direction normalises, so Inverse(Forward(x)) is n * x. In and out may be the same buffer.
+ *
+ * The built-in implementation is a radix-2 FFT on split real and imaginary arrays, with every stage's twiddles stored contiguously so that
+ * the butterflies are plain loops the compiler vectorizes. Define IPLUG_FFT_VDSP to use Accelerate's vDSP instead (add Accelerate.framework to
+ * the project), or IPLUG_FFT_PFFFT to use pffft (add pffft.c and pffft.h, which aren't part of iPlug, to the project).
+ *
+ * The tables of each size are shared by every FFT in the process, built by the first FFT of that size and freed after the last one is destroyed.
+ * Constructing an FFT is therefore not realtime safe; Forward() and Inverse() are, but an FFT object is not thread safe, since it has scratch buffers */
+class FFT
+{
+public:
+  enum EType
+  {
+    kReal = 0,
+    kComplex
+  };
+
+  /** @param size The number of samples (kReal) or complex values (kComplex), a power of two, at least 4 */
+  FFT(int size, EType type = kReal)
+  : mSize(size)
+  , mType(type)
+  {
+    assert(size >= 4 && !(size & (size - 1)));
+
+    Storage& storage = GetStorage();
+    WDL_MutexLock lock(&storage.mMutex);
+    storage.mCount++;
+
+#if defined(IPLUG_FFT_VDSP)
+    mLog2Size = Log2(size);
+    mSetup = storage.GetSetup(mLog2Size);
+    mReal.resize(size);
+    mImag.resize(size);
+#elif defined(IPLUG_FFT_PFFFT)
+    if (size >= (type == kReal ? 32 : 16))
+    {
+      mSetup = pffft_new_setup(size, type == kReal ? PFFFT_REAL : PFFFT_COMPLEX);
+      const int nFloats = type == kReal ? size : 2 * size;
+      mWork = static_cast<float*>(pffft_aligned_malloc(3 * nFloats * sizeof(float)));
+      return;
+    }
+#endif
+
+#if !defined(IPLUG_FFT_VDSP)
+    const int complexSize = type == kReal ? size / 2 : size;
+    mPlan = storage.GetPlan(Log2(complexSize));
+    mReal.resize(complexSize);
+    mImag.resize(complexSize);
+#endif
+  }
+
+  ~FFT()
+  {
+#if defined(IPLUG_FFT_PFFFT)
+    if (mSetup)
+    {
+      pffft_destroy_setup(mSetup);
+      pffft_aligned_free(mWork);
+    }
+#endif
+
+    Storage& storage = GetStorage();
+    WDL_MutexLock lock(&storage.mMutex);
+
+    if (--storage.mCount == 0)
+      storage.Clear();
+  }
+
+  FFT(const FFT&) = delete;
+  FFT& operator=(const FFT&) = delete;
+
+  int GetSize() const { return mSize; }
+  EType GetType() const { return mType; }
+
+  /** @return The number of floats in a spectrum: GetSize() for kReal, 2 * GetSize() for kComplex */
+  int GetSpectrumSize() const { return mType == kReal ? mSize : 2 * mSize; }
+
+  /** @param pIn GetSize() samples (kReal) or complex values (kComplex)
+   * @param pOut GetSpectrumSize() floats */
+  void Forward(const float* pIn, float* pOut) { Transform(pIn, pOut, false); }
+
+  /** @param pIn GetSpectrumSize() floats
+   * @param pOut GetSize() samples (kReal) or complex values (kComplex), n times the signal */
+  void Inverse(const float* pIn, float* pOut) { Transform(pIn, pOut, true); }
+
+  /** pDest += pA * pB, bin by bin, for spectra of a real FFT of the given size. This is the inner loop of a fast convolution */
+  static void MultiplyAccumulate(float* pDest, const float* pA, const float* pB, int size)
+  {
+    pDest[0] += pA[0] * pB[0];
+    pDest[1] += pA[1] * pB[1];
+
+    for (int i = 2; i < size; i += 2)
+    {
+      pDest[i] += pA[i] * pB[i] - pA[i + 1] * pB[i + 1];
+      pDest[i + 1] += pA[i] * pB[i + 1] + pA[i + 1] * pB[i];
+    }
+  }
+
+private:
+  void Transform(const float* pIn, float* pOut, bool inverse)
+  {
+#if defined(IPLUG_FFT_VDSP)
+    DSPSplitComplex split { mReal.data(), mImag.data() };
+    const FFTDirection direction = inverse ? kFFTDirection_Inverse : kFFTDirection_Forward;
+
+    if (mType == kReal)
+    {
+      vDSP_ctoz(reinterpret_cast<const DSPComplex*>(pIn), 2, &split, 1, mSize / 2);
+      vDSP_fft_zrip(mSetup, &split, 1, mLog2Size, direction);
+
+      if (!inverse) // vDSP's real forward transform is twice the DFT
+      {
+        const float half = 0.5f;
+        vDSP_vsmul(split.realp, 1, &half, split.realp, 1, mSize / 2);
+        vDSP_vsmul(split.imagp, 1, &half, split.imagp, 1, mSize / 2);
+      }
+
+      vDSP_ztoc(&split, 1, reinterpret_cast<DSPComplex*>(pOut), 2, mSize / 2);
+    }
+    else
+    {
+      vDSP_ctoz(reinterpret_cast<const DSPComplex*>(pIn), 2, &split, 1, mSize);
+      vDSP_fft_zip(mSetup, &split, 1, mLog2Size, direction);
+      vDSP_ztoc(&split, 1, reinterpret_cast<DSPComplex*>(pOut), 2, mSize);
+    }
+#else
+  #if defined(IPLUG_FFT_PFFFT)
+    if (mSetup)
+    {
+      // pffft needs 16 byte aligned buffers
+      const int nFloats = GetSpectrumSize();
+      const bool aligned = !(reinterpret_cast<uintptr_t>(pIn) & 15) && !(reinterpret_cast<uintptr_t>(pOut) & 15);
+      float* pSrc = aligned ? const_cast<float*>(pIn) : mWork + nFloats;
+      float* pDest = aligned ? pOut : mWork + 2 * nFloats;
+
+      if (!aligned)
+        memcpy(pSrc, pIn, nFloats * sizeof(float));
+
+      pffft_transform_ordered(mSetup, pSrc, pDest, mWork, inverse ? PFFFT_BACKWARD : PFFFT_FORWARD);
+
+      if (!aligned)
+        memcpy(pOut, pDest, nFloats * sizeof(float));
+
+      return;
+    }
+  #endif
+
+    if (mType == kReal)
+    {
+      if (inverse)
+        RealInverse(pIn, pOut);
+      else
+        RealForward(pIn, pOut);
+    }
+    else
+    {
+      const int n = mSize;
+      const int* pBitReverse = mPlan->bitReverse.data();
+
+      float* pRe = mReal.data();
+      float* pIm = mImag.data();
+
+      for (int i = 0; i < n; i++)
+      {
+        pRe[pBitReverse[i]] = pIn[2 * i];
+        pIm[pBitReverse[i]] = pIn[2 * i + 1];
+      }
+
+      // the inverse is the forward transform with the real and imaginary parts swapped
+      if (inverse)
+        Butterflies(pIm, pRe);
+      else
+        Butterflies(pRe, pIm);
+
+      for (int i = 0; i < n; i++)
+      {
+        pOut[2 * i] = pRe[i];
+        pOut[2 * i + 1] = pIm[i];
+      }
+    }
+#endif
+  }
+
+#if !defined(IPLUG_FFT_VDSP)
+  /** The tables for a complex FFT of size n, and those for the real FFT of size 2 * n that it computes */
+  struct Plan
+  {
+    explicit Plan(int log2Size)
+    : n(1 << log2Size)
+    {
+      bitReverse.resize(n);
+
+      for (int i = 0; i < n; i++)
+      {
+        int r = 0;
+
+        for (int b = 0; b < log2Size; b++)
+          r |= ((i >> b) & 1) << (log2Size - 1 - b);
+
+        bitReverse[i] = r;
+      }
+
+      // the stage with half-length m uses twiddles [m, 2m), e^(-2 pi i k / 2m) for k in [0, m)
+      twiddleRe.resize(n);
+      twiddleIm.resize(n);
+
+      for (int m = 1; m < n; m *= 2)
+      {
+        for (int k = 0; k < m; k++)
+        {
+          const double angle = -PI * k / m;
+          twiddleRe[m + k] = static_cast<float>(std::cos(angle));
+          twiddleIm[m + k] = static_cast<float>(std::sin(angle));
+        }
+      }
+
+      // e^(-2 pi i k / 2n), to split the complex FFT of the even and odd samples into the real FFT
+      realRe.resize(n);
+      realIm.resize(n);
+
+      for (int k = 0; k < n; k++)
+      {
+        const double angle = -PI * k / n;
+        realRe[k] = static_cast<float>(std::cos(angle));
+        realIm[k] = static_cast<float>(std::sin(angle));
+      }
+    }
+
+    const int n;
+    std::vector<int> bitReverse;
+    std::vector<float> twiddleRe, twiddleIm;
+    std::vector<float> realRe, realIm;
+  };
+
+  /** In place decimation in time on data loaded in bit reversed order */
+  void Butterflies(float* pRe, float* pIm) const
+  {
+    const int n = mPlan->n;
+
+    if (n == 2) // a real FFT of size 4
+    {
+      const float r = pRe[0], i = pIm[0];
+      pRe[0] += pRe[1]; pIm[0] += pIm[1];
+      pRe[1] = r - pRe[1]; pIm[1] = i - pIm[1];
+      return;
+    }
+
+    // the first two stages have trivial twiddles, 1, and 1 and -i
+    for (int i = 0; i < n; i += 4)
+    {
+      const float r0 = pRe[i] + pRe[i + 1], i0 = pIm[i] + pIm[i + 1];
+      const float r1 = pRe[i] - pRe[i + 1], i1 = pIm[i] - pIm[i + 1];
+      const float r2 = pRe[i + 2] + pRe[i + 3], i2 = pIm[i + 2] + pIm[i + 3];
+      const float r3 = pRe[i + 2] - pRe[i + 3], i3 = pIm[i + 2] - pIm[i + 3];
+      pRe[i] = r0 + r2; pIm[i] = i0 + i2;
+      pRe[i + 2] = r0 - r2; pIm[i + 2] = i0 - i2;
+      pRe[i + 1] = r1 + i3; pIm[i + 1] = i1 - r3; // (r3, i3) * -i = (i3, -r3)
+      pRe[i + 3] = r1 - i3; pIm[i + 3] = i1 + r3;
+    }
+
+    for (int m = 4; m < n; m *= 2)
+    {
+      const float* pWRe = mPlan->twiddleRe.data() + m;
+      const float* pWIm = mPlan->twiddleIm.data() + m;
+
+      for (int j = 0; j < n; j += 2 * m)
+        Butterfly(pRe + j, pIm + j, pRe + j + m, pIm + j + m, pWRe, pWIm, m);
+    }
+  }
+
+  /** One group of a stage. The halves never overlap, telling the compiler so lets it vectorize */
+  static inline void Butterfly(float* __restrict pARe, float* __restrict pAIm, float* __restrict pBRe, float* __restrict pBIm,
+                               const float* __restrict pWRe, const float* __restrict pWIm, int m)
+  {
+    for (int k = 0; k < m; k++)
+    {
+      const float tRe = pBRe[k] * pWRe[k] - pBIm[k] * pWIm[k];
+      const float tIm = pBRe[k] * pWIm[k] + pBIm[k] * pWRe[k];
+      pBRe[k] = pARe[k] - tRe;
+      pBIm[k] = pAIm[k] - tIm;
+      pARe[k] += tRe;
+      pAIm[k] += tIm;
+    }
+  }
+
+  /** The complex FFT of z[k] = x[2k] + i x[2k + 1], then split into the spectrum of x */
+  void RealForward(const float* pIn, float* pOut)
+  {
+    const int n = mPlan->n;
+    const int* pBitReverse = mPlan->bitReverse.data();
+    float* pRe = mReal.data();
+    float* pIm = mImag.data();
+
+    for (int i = 0; i < n; i++)
+    {
+      pRe[pBitReverse[i]] = pIn[2 * i];
+      pIm[pBitReverse[i]] = pIn[2 * i + 1];
+    }
+
+    Butterflies(pRe, pIm);
+
+    const float* pWRe = mPlan->realRe.data();
+    const float* pWIm = mPlan->realIm.data();
+    const float dc = pRe[0] + pIm[0];
+    const float nyquist = pRe[0] - pIm[0];
+
+    // X[k] = E + W^k O, where E = (Z[k] + conj(Z[n - k])) / 2 and O = (Z[k] - conj(Z[n - k])) / 2i. k and n - k are done together, so that it works in place
+    for (int k = 1; k <= n / 2; k++)
+    {
+      const int nk = n - k;
+      const float zr = pRe[k], zi = pIm[k], cr = pRe[nk], ci = pIm[nk];
+
+      const float er = 0.5f * (zr + cr), ei = 0.5f * (zi - ci);
+      const float dr = 0.5f * (zr - cr), di = 0.5f * (zi + ci);
+      const float ork = pWRe[k] * di + pWIm[k] * dr;
+      const float oik = pWIm[k] * di - pWRe[k] * dr;
+
+      // for n - k, E is conj(E) and D is -conj(D)
+      const float ornk = pWRe[nk] * di - pWIm[nk] * dr;
+      const float oink = pWRe[nk] * dr + pWIm[nk] * di;
+
+      pOut[2 * k] = er + ork;
+      pOut[2 * k + 1] = ei + oik;
+      pOut[2 * nk] = er + ornk;
+      pOut[2 * nk + 1] = -ei + oink;
+    }
+
+    pOut[0] = dc;
+    pOut[1] = nyquist;
+  }
+
+  /** The inverse of RealForward(): Z[k] = (X[k] + conj(X[n - k])) + i (X[k] - conj(X[n - k])) W^-k, then the inverse complex FFT */
+  void RealInverse(const float* pIn, float* pOut)
+  {
+    const int n = mPlan->n;
+    const int* pBitReverse = mPlan->bitReverse.data();
+    const float* pWRe = mPlan->realRe.data();
+    const float* pWIm = mPlan->realIm.data();
+
+    // Z is built straight into bit reversed order
+    float* pRe = mReal.data();
+    float* pIm = mImag.data();
+
+    const float dc = pIn[0];
+    const float nyquist = pIn[1];
+    pRe[0] = dc + nyquist;
+    pIm[0] = dc - nyquist;
+
+    for (int k = 1; k < n; k++)
+    {
+      const int nk = n - k;
+      const float xr = pIn[2 * k], xi = pIn[2 * k + 1];
+      const float cr = pIn[2 * nk], ci = -pIn[2 * nk + 1];
+      const float er = xr + cr, ei = xi + ci;
+      const float dr = xr - cr, di = xi - ci;
+
+      // D * W^-k, W^-k = (wr, -wi)
+      const float odr = dr * pWRe[k] + di * pWIm[k];
+      const float odi = di * pWRe[k] - dr * pWIm[k];
+
+      // E + i * OD
+      const int r = pBitReverse[k];
+      pRe[r] = er - odi;
+      pIm[r] = ei + odr;
+    }
+
+    Butterflies(pIm, pRe); // swapped, for the inverse
+
+    for (int i = 0; i < n; i++)
+    {
+      pOut[2 * i] = pRe[i];
+      pOut[2 * i + 1] = pIm[i];
+    }
+  }
+#endif
+
+  static int Log2(int n)
+  {
+    int log2 = 0;
+
+    while ((1 << log2) < n)
+      log2++;
+
+    return log2;
+  }
+
+  struct Storage
+  {
+    ~Storage() { Clear(); }
+
+#if defined(IPLUG_FFT_VDSP)
+    /** A setup works for every size up to its own, so only the largest is kept. FFTs hold on to the one they were made with */
+    FFTSetup GetSetup(int log2Size)
+    {
+      if (log2Size > mSetupLog2Size)
+      {
+        if (mSetup)
+          mRetiredSetups.push_back(mSetup);
+
+        mSetup = vDSP_create_fftsetup(log2Size, kFFTRadix2);
+        mSetupLog2Size = log2Size;
+      }
+
+      return mSetup;
+    }
+
+    void Clear()
+    {
+      for (auto setup : mRetiredSetups)
+        vDSP_destroy_fftsetup(setup);
+
+      if (mSetup)
+        vDSP_destroy_fftsetup(mSetup);
+
+      mRetiredSetups.clear();
+      mSetup = nullptr;
+      mSetupLog2Size = -1;
+    }
+
+    FFTSetup mSetup = nullptr;
+    int mSetupLog2Size = -1;
+    std::vector<FFTSetup> mRetiredSetups;
+#else
+    const Plan* GetPlan(int log2Size)
+    {
+      if (!mPlans[log2Size])
+        mPlans[log2Size].reset(new Plan(log2Size));
+
+      return mPlans[log2Size].get();
+    }
+
+    void Clear()
+    {
+      for (auto& plan : mPlans)
+        plan.reset();
+    }
+
+    std::unique_ptr<Plan> mPlans[31];
+#endif
+
+    int mCount = 0;
+    WDL_Mutex mMutex;
+  };
+
+  static Storage& GetStorage()
+  {
+    static Storage sStorage;
+    return sStorage;
+  }
+
+  const int mSize;
+  const EType mType;
+  std::vector<float> mReal, mImag; // split scratch
+#if defined(IPLUG_FFT_VDSP)
+  int mLog2Size = 0;
+  FFTSetup mSetup = nullptr;
+#else
+  const Plan* mPlan = nullptr;
+  #if defined(IPLUG_FFT_PFFFT)
+  PFFFT_Setup* mSetup = nullptr;
+  float* mWork = nullptr;
+  #endif
+#endif
+};
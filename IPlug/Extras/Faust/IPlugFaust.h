@@ -20,6 +20,7 @@
 #include "assocarray.h"
 
 #include "IPlugAPIBase.h"
+#include "IPlugProcessor.h"
 
 #include "Oversampler.h"
 
@@ -31,17 +32,24 @@
   #endif
 #endif
 
+#ifndef DEFAULT_FAUST_RAMP_CHUNK_SIZE
+  #define DEFAULT_FAUST_RAMP_CHUNK_SIZE 16 // samples between zone updates while a parameter ramp is smoothing
+#endif
+
 /** This abstract interface is used by the IPlug FAUST architecture file and the IPlug libfaust JIT compiling class FaustGen
  * In order to provide a consistent interface to FAUST DSP whether using the JIT compiler or a compiled C++ class */
 class IPlugFaust : public UI, public Meta
 {
 public:
 
+  /** @param name The name of the FAUST block
+   * @param nVoices The number of voices
+   * @param rate The oversampling rate. If it is more than 1, an OverSampler is allocated with the stages up to 16x, so that SetOverSamplingRate() can change it in real time */
   IPlugFaust(const char* name, int nVoices = 1, int rate = 1)
   : mNVoices(nVoices)
   {
     if(rate > 1)
-      mOverSampler = new OverSampler<sample>(OverSampler<sample>::RateToFactor(rate), true, 2 /* TODO: flexible channel count */);
+      mOverSampler = new OverSampler<sample>(OverSampler<sample>::RateToFactor(rate), true, mOverSamplerNChans);
     
     mName.Set(name);
   }
@@ -57,8 +65,52 @@ public:
 
   virtual void Init() = 0;
 
-  // NO-OP in the base class
-  virtual void SetMaxChannelCount(int maxNInputs, int maxNOutputs) {}
+  /** Call this method after constructing the class to say what the maximum I/O count is, so that the OverSampler, if there is one, has buffers for all of the channels.
+   * Not realtime safe, call it before processing
+   * @param maxNInputs The maximum number of inputs the hosting code can accommodate
+   * @param maxNOutputs The maximum number of outputs the hosting code can accommodate */
+  virtual void SetMaxChannelCount(int maxNInputs, int maxNOutputs)
+  {
+    const int nChans = std::max(1, std::max(maxNInputs, maxNOutputs));
+    
+    mChunkInputs.resize(nChans);
+    mChunkOutputs.resize(nChans);
+    
+    if(mOverSampler && nChans != mOverSamplerNChans)
+    {
+      const int rate = mOverSampler->GetRate();
+      delete mOverSampler;
+      mOverSamplerNChans = nChans;
+      mOverSampler = new OverSampler<sample>(OverSampler<sample>::RateToFactor(rate), true, mOverSamplerNChans);
+    }
+  }
+  
+  /** Set the options the FAUST compiler is given along with the defaults, such as "-vec", "-vs", "32" to generate vectorized code in loops of 32 samples,
+   * and "-dfs" to schedule them depth first. In FaustGen this recompiles the code, and the options are also given to the command line compiler by CompileCPP(),
+   * so the C++ code made with the IPlugFaust_arch architecture file matches. NO-OP in the base class
+   * @param options The options, each word a separate string */
+  virtual void SetCompileOptions(std::initializer_list<const char*> options) {}
+  
+  /** Get the options the DSP was compiled with, from its "compile_options" metadata, e.g. to report them alongside measurements of its speed
+   * @param options Set to the options, or an empty string if there is no DSP */
+  void GetCompileOptions(WDL_String& options)
+  {
+    struct CompileOptionsMeta : public Meta
+    {
+      void declare(const char* key, const char* value) override
+      {
+        if(strcmp(key, "compile_options") == 0)
+          mOptions.Set(value);
+      }
+      
+      WDL_String mOptions;
+    } meta;
+    
+    if(mDSP)
+      mDSP->metadata(&meta);
+    
+    options.Set(meta.mOptions.Get());
+  }
   
   /** In FaustGen this is implemented, so that the SVG files generated by a specific instance can be located. The path to the SVG file for process.svg will be returned.
    * There is a NO-OP implementation here so that when not using the JIT compiler, the same class can be used interchangeably
@@ -72,27 +124,42 @@ public:
 
   static void SetAutoRecompile(bool enable) {}
   
-  void FreeDSP()
+  virtual void FreeDSP()
   {
     DELETE_NULL(mDSP);
   }
   
+  /** Change the oversampling rate. This doesn't allocate, so it can be called in real time, but it does nothing unless the block was constructed with a rate above 1
+   * @param rate The new rate, 1, 2, 4, 8 or 16 */
   void SetOverSamplingRate(int rate)
   {
     if(mOverSampler)
+    {
       mOverSampler->SetOverSampling(OverSampler<sample>::RateToFactor(rate));
+      
+      if(mDSP)
+        mDSP->instanceConstants(GetDSPSampleRate()); // the state is kept, only the coefficients change
+    }
   }
 
   // Unique methods
   void SetSampleRate(double sampleRate)
+  {
+    mSampleRate = sampleRate;
+    
+    if (mDSP)
+      mDSP->init(GetDSPSampleRate());
+  }
+
+  /** @return The sample rate the DSP runs at, the last one given to SetSampleRate() multiplied by the oversampling rate */
+  int GetDSPSampleRate() const
   {
     int multiplier = 1;
     
     if(mOverSampler)
       multiplier = mOverSampler->GetRate();
     
-    if (mDSP)
-      mDSP->init(((int) sampleRate) * multiplier);
+    return ((int) mSampleRate) * multiplier;
   }
 
   void ProcessMidiMsg(const IMidiMsg& msg)
@@ -100,20 +167,46 @@ public:
 //    TODO:
   }
 
+  /** Make the zones of the parameters with a smoothing policy (see IParam::SetSmoothing()) follow the plug-in's ramp buffers, rather than jumping to each new value
+   * at the start of a block. While a ramp is smoothing, ProcessBlock() computes the DSP in chunks and updates the zones between them, so the zones change at control rate.
+   * Changes that arrive during a block are split at their offsets when the plug-in enables IPlugProcessor::SetSampleAccurateParams().
+   * Needs SetMaxChannelCount() to have been called. Call it before processing
+   * @param pProcessor The plug-in whose ramps to follow, or nullptr to stop
+   * @param chunkSize The number of samples between zone updates
+   * @param plugParamStartIdx The index of the plug-in parameter of the first FAUST parameter, or -1 for the one given to CreateIPlugParameters(), or 0 if they are not linked */
+  void SetParamRamps(const IPlugProcessor<sample>* pProcessor, int chunkSize = DEFAULT_FAUST_RAMP_CHUNK_SIZE, int plugParamStartIdx = -1)
+  {
+    mRampProcessor = pProcessor;
+    mRampChunkSize = std::max(1, chunkSize);
+    mRampParamStartIdx = plugParamStartIdx;
+  }
+
   virtual void ProcessBlock(sample** inputs, sample** outputs, int nFrames)
   {
     if (mDSP)
     {
       assert(mDSP->getSampleRate() != 0); // did you forget to call SetSampleRate?
       
-      if(mOverSampler)
-        mOverSampler->ProcessBlock(inputs, outputs, nFrames, 2 /* TODO: flexible channel count */,
-                                   [&](sample** inputs, sample** outputs, int nFrames) //TODO:: badness capture = allocated
-                                   {
-                                     mDSP->compute(nFrames, inputs, outputs);
-                                   });
+      const int nChans = std::max(mDSP->getNumInputs(), mDSP->getNumOutputs());
+      
+      if(UpdateRampedZones(0) && nChans <= (int) mChunkInputs.size())
+      {
+        for(auto offset = 0; offset < nFrames; offset += mRampChunkSize)
+        {
+          if(offset)
+            UpdateRampedZones(offset);
+          
+          for(auto c = 0; c < nChans; c++)
+          {
+            mChunkInputs[c] = inputs[c] + offset;
+            mChunkOutputs[c] = outputs[c] + offset;
+          }
+          
+          Compute(mChunkInputs.data(), mChunkOutputs.data(), std::min(mRampChunkSize, nFrames - offset));
+        }
+      }
       else
-        mDSP->compute(nFrames, inputs, outputs);
+        Compute(inputs, outputs, nFrames);
     }
 //    else silence?
   }
@@ -152,17 +245,26 @@ public:
       DBGMSG("SetParameterValue called with no FAUST params\n");
   }
 
+  /** Set a parameter by name. This looks the name up on each call, so code that sets a parameter often should get its index once with GetParamIdx()
+   * @param labelToLookup The label of the FAUST UI item
+   * @param nonNormalizedValue The value */
   void SetParameterValue(const char* labelToLookup, double nonNormalizedValue)
   {
-    FAUSTFLOAT* dest = nullptr;
-    dest = mMap.Get(labelToLookup, nullptr);
-//    mParams.Get(paramIdx)->Set(nonNormalizedValue); // TODO: we are not updating the IPlug parameter
+    const int paramIdx = GetParamIdx(labelToLookup);
 
-    if(dest)
-      *dest = nonNormalizedValue;
+    if(paramIdx > kNoParameter)
+      SetParameterValue(paramIdx, nonNormalizedValue);
     else
       DBGMSG("IPlugFaust-%s:: No parameter named %s\n", mName.Get(), labelToLookup);
   }
+  
+  /** @param name The label of the FAUST UI item
+   * @return The index of the parameter with the label, for SetParameterValue() and SetParameterValueNormalised(), or kNoParameter. The index stays the same when FaustGen recompiles,
+   * as long as the label is still there, so it can be looked up once at initialization */
+  int GetParamIdx(const char* name) const
+  {
+    return mParamIdxs.Get(name, kNoParameter);
+  }
 
   int CreateIPlugParameters(IPlugAPIBase* pPlug, int startIdx = 0, int endIdx = -1, bool setToDefault = true)
   {
@@ -280,16 +382,20 @@ protected:
     mZones.Add(zone);
   }
   
-  void BuildParameterMap()
+  /** @param setToDefault \c false to keep the values of linked IPlug parameters, as when a new DSP is swapped in by FaustGen */
+  void BuildParameterMap(bool setToDefault = true)
   {
+    mParamIdxs.DeleteAll();
+    
     for(auto p = 0; p < NParams(); p++)
     {
+      mParamIdxs.Insert(mParams.Get(p)->GetNameForHost(), p);
       mMap.Insert(mParams.Get(p)->GetNameForHost(), mZones.Get(p)); // insert will overwrite keys with the same name
     }
     
     if(mIPlugParamStartIdx > -1 && mPlug != nullptr) // if we've allready linked parameters
     {
-      CreateIPlugParameters(mPlug, mIPlugParamStartIdx);
+      CreateIPlugParameters(mPlug, mIPlugParamStartIdx, -1, setToDefault);
     }
     
     for(auto p = 0; p < NParams(); p++)
@@ -311,14 +417,68 @@ protected:
     return -1;
   }
   
+  /** Compute a block, through the OverSampler if there is one */
+  void Compute(sample** inputs, sample** outputs, int nFrames)
+  {
+    if(mOverSampler)
+    {
+      // channels beyond those passed to SetMaxChannelCount() aren't oversampled
+      const int nChans = std::min(std::max(mDSP->getNumInputs(), mDSP->getNumOutputs()), mOverSamplerNChans);
+      
+      mOverSampler->ProcessBlockFullRate(inputs, outputs, nFrames, nChans,
+                                         [&](sample** inputs, sample** outputs, int nFrames)
+                                         {
+                                           mDSP->compute(nFrames, inputs, outputs);
+                                         });
+    }
+    else
+      mDSP->compute(nFrames, inputs, outputs);
+  }
+  
+  /** Write the values of the ramp buffers at an offset in the block to the zones of the parameters that have them, see SetParamRamps()
+   * @param offset The offset in the block
+   * @return \c true if any of the ramps is smoothing in this block */
+  bool UpdateRampedZones(int offset)
+  {
+    if(!mRampProcessor || mZones.GetSize() != NParams())
+      return false;
+    
+    const bool linked = mIPlugParamStartIdx > -1;
+    const int startIdx = mRampParamStartIdx > -1 ? mRampParamStartIdx : std::max(mIPlugParamStartIdx, 0);
+    bool smoothing = false;
+    
+    for(auto p = 0; p < NParams(); p++)
+    {
+      const sample* pRamp = mRampProcessor->GetParamRamp(startIdx + p);
+      
+      if(!pRamp)
+        continue;
+      
+      // linked parameters have the FAUST ranges, otherwise the plug-in's values are normalized, as with SetParameterValueNormalised()
+      const double value = linked ? pRamp[offset] : mParams.Get(p)->FromNormalized(pRamp[offset]);
+      *(mZones.Get(p)) = static_cast<FAUSTFLOAT>(value);
+      smoothing |= mRampProcessor->IsParamRampSmoothing(startIdx + p);
+    }
+    
+    return smoothing;
+  }
+
   OverSampler<sample>* mOverSampler = nullptr;
+  int mOverSamplerNChans = 2; // until SetMaxChannelCount() is called
   WDL_String mName;
   int mNVoices;
+  double mSampleRate = DEFAULT_SAMPLE_RATE;
   ::dsp* mDSP = nullptr;
   MidiUI* mMidiUI = nullptr;
   WDL_PtrList<IParam> mParams;
   WDL_PtrList<FAUSTFLOAT> mZones;
   WDL_StringKeyedArray<FAUSTFLOAT*> mMap; // map is used for setting FAUST parameters by name, also used to reconnect existing parameters
+  WDL_StringKeyedArray<int> mParamIdxs; // the index of each parameter by name, see GetParamIdx()
+  const IPlugProcessor<sample>* mRampProcessor = nullptr;
+  int mRampChunkSize = DEFAULT_FAUST_RAMP_CHUNK_SIZE;
+  int mRampParamStartIdx = -1;
+  std::vector<sample*> mChunkInputs; // the buffers offset to each chunk, sized by SetMaxChannelCount()
+  std::vector<sample*> mChunkOutputs;
   int mIPlugParamStartIdx = -1; // if this is negative, it means there is no linking
   IPlugAPIBase* mPlug = nullptr;
   bool mInitialized = false;
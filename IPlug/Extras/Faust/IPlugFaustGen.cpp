@@ -26,6 +26,9 @@ bool FaustGen::sAutoRecompile = false;
 std::map<std::string, FaustGen::Factory *> FaustGen::Factory::sFactoryMap;
 std::list<GUI*> GUI::fGuiList;
 Timer* FaustGen::sTimer = nullptr;
+int FaustGen::sTimerTicks = 0;
+WDL_Mutex FaustGen::sCompileMutex;
+std::shared_ptr<IPlugJob> FaustGen::sCompileCPPJob;
 
 FaustGen::Factory::Factory(const char* name, const char* libraryPath, const char* drawPath, const char* inputDSP)
 {
@@ -53,11 +56,29 @@ void FaustGen::Factory::FreeDSPFactory()
 {
   WDL_MutexLock lock(&mDSPMutex);
 
+  // a background compile of the old code shouldn't be swapped in later
+  if (mCompileJob)
+  {
+    mCompileJob->Cancel();
+    mCompileJob = nullptr;
+  }
+
+  mCompileResult = nullptr;
+
   for (auto inst : mInstances)
   {
     inst->FreeDSP();
   }
 
+  WDL_MutexLock compileLock(&sCompileMutex);
+
+  for (auto& retired : mRetiredFactories)
+  {
+    deleteDSPFactory(retired.pFactory);
+  }
+
+  mRetiredFactories.clear();
+
   if(mLLVMFactory)
   {
     deleteDSPFactory(mLLVMFactory); // this is commented in faustgen~
@@ -65,6 +86,22 @@ void FaustGen::Factory::FreeDSPFactory()
   }
 }
 
+FaustGen::Factory::CompileResult::~CompileResult()
+{
+  if (!pFactory)
+    return; // the DSPs were all taken, or none could be made
+
+  WDL_MutexLock lock(&sCompileMutex);
+
+  for (auto& instance : instances)
+  {
+    delete instance.pDSP;
+  }
+
+  if (pFactory)
+    deleteDSPFactory(pFactory);
+}
+
 llvm_dsp_factory* FaustGen::Factory::CreateFactoryFromBitCode()
 {
   //return readDSPFactoryFromBitCodeStr(mBitCodeStr.Get(), getTarget(), mOptimizationLevel);
@@ -141,9 +178,10 @@ llvm_dsp_factory *FaustGen::Factory::CreateFactoryFromSourceCode()
   }
 }
 
-::dsp *FaustGen::Factory::CreateDSPInstance(int nVoices)
+//static
+::dsp *FaustGen::Factory::CreateDSPInstance(llvm_dsp_factory* pFactory, int nVoices)
 {
-  ::dsp* pMonoDSP = mLLVMFactory->createDSPInstance();
+  ::dsp* pMonoDSP = pFactory->createDSPInstance();
 
   // Check 'nvoices' metadata
   if (nVoices == 0)
@@ -348,6 +386,24 @@ bool FaustGen::Factory::LoadFile(const char* file)
 {
   // Delete the existing Faust module
   //FreeDSPFactory();
+  if (ReadFile(file))
+  {
+    // Update all instances
+    for (auto inst : mInstances)
+    {
+      inst->Init();
+    }
+    
+    return true;
+  }
+  
+  assert(0); // The FAUST_BLOCK file was not found
+  
+  return false;
+}
+
+bool FaustGen::Factory::ReadFile(const char* file)
+{
   WDL_String fileStr(file);
 
   mBitCodeStr.Set("");
@@ -372,20 +428,151 @@ bool FaustGen::Factory::LoadFile(const char* file)
     
     mInputDSPFile.Set(file);
     
-    // Update all instances
-    for (auto inst : mInstances)
-    {
-      inst->Init();
-    }
-    
     return true;
   }
   
-  assert(0); // The FAUST_BLOCK file was not found
-  
   return false;
 }
 
+void FaustGen::Factory::CompileInBackground()
+{
+  if (!ReadFile(mInputDSPFile.Get()))
+  {
+    DBGMSG("FaustGen-%s: Could not read %s\n", mName.Get(), mInputDSPFile.Get());
+    return;
+  }
+
+  if (mCompileJob)
+    mCompileJob->Cancel();
+
+  SetDefaultCompileOptions();
+  PrintCompileOptions();
+
+  // everything the job needs is copied, so that it doesn't touch the factory
+  WDL_String name;
+  name.SetFormatted(64, "FaustGen-%d", mInstanceIdx);
+  
+  auto pResult = std::make_shared<CompileResult>();
+
+  for (auto inst : mInstances)
+  {
+    pResult->instances.push_back({inst, inst->GetDSPSampleRate(), nullptr});
+  }
+
+  mCompileJob = std::make_shared<IPlugJob>([pResult, name = std::string(name.Get()), sourceCode = std::string(mSourceCodeStr.Get()),
+                                            options = mCompileOptions, optimizationLevel = mOptimizationLevel](IPlugJob& job) {
+    const char* argv[64];
+    const int N = (int) options.size();
+
+    assert(N < 64);
+
+    for (auto i = 0; i < N; i++)
+    {
+      argv[i] = options[i].c_str();
+    }
+
+    argv[N] = 0; // NULL terminated argv
+
+    WDL_MutexLock lock(&sCompileMutex);
+
+    pResult->pFactory = createDSPFactoryFromString(name, sourceCode, N, argv, GetLLVMArchStr(), pResult->error, optimizationLevel);
+
+    if (!pResult->pFactory)
+      return;
+
+    for (auto& instance : pResult->instances)
+    {
+      if (job.IsCancelled())
+        return;
+
+      instance.pDSP = CreateDSPInstance(pResult->pFactory);
+      instance.pDSP->init(instance.sampleRate);
+    }
+  }, nullptr, IPlugJob::kPriorityLow, IPlugJob::ECompletionThread::kMainThread);
+
+  mCompileResult = pResult;
+  IPlugWorkerPool::Get().Submit(mCompileJob);
+}
+
+bool FaustGen::Factory::FinishBackgroundCompile()
+{
+  bool swapped = false;
+
+  if (mCompileJob && mCompileJob->GetState() >= IPlugJob::kFinished)
+  {
+    const bool cancelled = mCompileJob->GetState() == IPlugJob::kCancelled;
+    std::shared_ptr<CompileResult> pResult = std::move(mCompileResult);
+    mCompileJob = nullptr;
+
+    if (!cancelled && !pResult->pFactory)
+    {
+      // the DSPs made from the previous code keep running
+      DBGMSG("FaustGen-%s: Invalid Faust code or compile options : %s\n", mName.Get(), pResult->error.c_str());
+    }
+    else if (!cancelled)
+    {
+      if (mLLVMFactory)
+        mRetiredFactories.push_back({mLLVMFactory, 0});
+
+      mLLVMFactory = pResult->pFactory;
+      pResult->pFactory = nullptr;
+      mBitCodeStr.Set("");
+
+      for (auto& instance : pResult->instances)
+      {
+        if (!instance.pDSP)
+          continue;
+
+        if (mInstances.find(instance.pInstance) == mInstances.end()) // removed while compiling
+        {
+          DELETE_NULL(instance.pDSP);
+          continue;
+        }
+
+        mNInputs = instance.pDSP->getNumInputs();
+        mNOutputs = instance.pDSP->getNumOutputs();
+
+        if (instance.pInstance->SwapDSP(instance.pDSP))
+          instance.pInstance->SetErrored(false);
+
+        instance.pDSP = nullptr;
+      }
+
+      DBGMSG("FaustGen-%s: Background compilation succeeded, %i input(s), %i output(s)\n", mName.Get(), mNInputs, mNOutputs);
+      swapped = true;
+    }
+  }
+
+  // a factory can go once no instance has a DSP from it waiting to be swapped in, or swapped out and not yet freed.
+  // The audio thread swaps before it queues the old DSP, so a factory has to be idle for two ticks
+  bool pending = false;
+
+  for (auto inst : mInstances)
+  {
+    inst->CollectDSPGarbage();
+    pending |= inst->HasPendingDSP();
+  }
+
+  for (auto it = mRetiredFactories.begin(); it != mRetiredFactories.end();)
+  {
+    if (pending)
+    {
+      it->nIdleTicks = 0;
+      ++it;
+    }
+    else if (++it->nIdleTicks >= 2)
+    {
+      WDL_MutexLock lock(&sCompileMutex);
+      deleteDSPFactory(it->pFactory);
+      it = mRetiredFactories.erase(it);
+    }
+    else
+      ++it;
+  }
+
+  return swapped;
+}
+
 bool FaustGen::Factory::WriteToFile(const char* file)
 {
   return false;
@@ -398,9 +585,13 @@ void FaustGen::Factory::SetCompileOptions(std::initializer_list<const char*> opt
   if (options.size() == 0)
     DBGMSG("FaustGen-%s: No argument entered, no additional compilation option will be used", mName.Get());
 
-  //TODO
-//  mOptions = options;
-//
+  mOptions.clear();
+
+  for (auto option : options)
+  {
+    mOptions.push_back(option);
+  }
+
 //  /*
 //  if (optimize) {
 //
@@ -415,16 +606,17 @@ void FaustGen::Factory::SetCompileOptions(std::initializer_list<const char*> opt
 //    DBGMSG("FaustGen-%s: Optimal compilation options found\n");
 //  }
 //  */
-//
-//  // Delete the existing Faust module
-//  FreeDSPFactory();
-//  mBitCodeStr.Set("");
-//
-//  // Update all instances
-//  for (auto i : fInstances) {
-//    i->UpdateSourceCode();
-//  }
 
+  // Delete the existing Faust module
+  FreeDSPFactory();
+  mBitCodeStr.Set("");
+
+  // Update the instances that have been initialized, the others will compile with the options when they are
+  for (auto inst : mInstances)
+  {
+    if (inst->mInitialized)
+      inst->Init();
+  }
 }
 
 #pragma mark -
@@ -471,13 +663,25 @@ void FaustGen::Init()
 {
   mZones.Empty(); // remove existing pointers to zones
   
-  mDSP = mFactory->GetDSP(mMaxNInputs, mMaxNOutputs);
-  assert(mDSP);
+  ::dsp* pDSP = nullptr;
+  
+  {
+    WDL_MutexLock lock(&sCompileMutex);
+    pDSP = mFactory->GetDSP(mMaxNInputs, mMaxNOutputs);
+  }
+  
+  assert(pDSP);
+  
+  // not processing, so the DSP can be swapped in here rather than at the next block
+  mDSPHandoff.CollectGarbage();
+  mDSPHandoff.Publish(std::unique_ptr<::dsp>(pDSP));
+  mDSP = mDSPHandoff.Acquire();
+  mDSPHandoff.CollectGarbage();
 
 //    AddMidiHandler();
 //    mDSP->buildUserInterface(mMidiUI);
   mDSP->buildUserInterface(this);
-  mDSP->init(DEFAULT_SAMPLE_RATE);
+  mDSP->init(GetDSPSampleRate());
 
   assert((mDSP->getNumInputs() <= mMaxNInputs) && (mDSP->getNumOutputs() <= mMaxNOutputs)); // don't have enough buffers to process the DSP
   
@@ -493,6 +697,63 @@ void FaustGen::Init()
     mPlug->OnParamReset(EParamSource::kRecompile);
 }
 
+void FaustGen::FreeDSP()
+{
+  mDSPHandoff.CollectGarbage();
+  mDSPHandoff.Publish(nullptr);
+  mDSP = mDSPHandoff.Acquire();
+  mDSPHandoff.CollectGarbage();
+}
+
+bool FaustGen::SwapDSP(::dsp* pDSP)
+{
+  std::unique_ptr<::dsp> pNewDSP(pDSP);
+
+  if ((pDSP->getNumInputs() > mMaxNInputs) || (pDSP->getNumOutputs() > mMaxNOutputs))
+  {
+    DBGMSG("FaustGen-%s: New DSP has %i input(s), %i output(s), more than the %i, %i buffers\n", mName.Get(), pDSP->getNumInputs(), pDSP->getNumOutputs(), mMaxNInputs, mMaxNOutputs);
+    return false;
+  }
+
+  if (pDSP->getSampleRate() != GetDSPSampleRate()) // SetSampleRate() was called while compiling
+    pDSP->init(GetDSPSampleRate());
+
+  std::map<std::string, double> values;
+
+  for (auto p = 0; p < NParams(); p++)
+  {
+    values[mParams.Get(p)->GetNameForHost()] = mParams.Get(p)->Value();
+  }
+
+  // the zones of the new DSP replace those of the one still processing, which only the audio thread uses from now on
+  mZones.Empty();
+  mMap.DeleteAll();
+  pDSP->buildUserInterface(this);
+  BuildParameterMap(false);
+
+  for (auto p = 0; p < NParams(); p++)
+  {
+    IParam* pParam = mParams.Get(p);
+    auto it = values.find(pParam->GetNameForHost());
+
+    if (it == values.end())
+      continue;
+
+    pParam->Set(it->second);
+
+    if (FAUSTFLOAT* pZone = mMap.Get(pParam->GetNameForHost(), nullptr))
+      *pZone = pParam->Value();
+  }
+
+  mDSPHandoff.Publish(std::move(pNewDSP));
+  mInitialized = true;
+
+  if(mPlug)
+    mPlug->OnParamReset(EParamSource::kRecompile);
+
+  return true;
+}
+
 void FaustGen::GetDrawPath(WDL_String& path)
 {
   assert(!CStringHasContents(mFactory->mDrawPath.Get()));
@@ -501,6 +762,14 @@ void FaustGen::GetDrawPath(WDL_String& path)
 }
 
 bool FaustGen::CompileCPP()
+{
+  std::vector<std::string> commands;
+  GetCompileCPPCommands(commands);
+  return RunCommands(commands);
+}
+
+//static
+void FaustGen::GetCompileCPPCommands(std::vector<std::string>& commands)
 {
 //#ifndef OS_WIN
   WDL_String archFile;
@@ -519,12 +788,15 @@ bool FaustGen::CompileCPP()
     outputFile.remove_fileext();
     outputFile.AppendFormatted(1024, ".tmp");
     //-double
-    command.SetFormatted(1024, "%s -cn %s -i -a %s -o %s %s", FAUST_EXE, f.second->mName.Get(), archFile.Get(), outputFile.Get(), inputFile.Get());
+    WDL_String options;
 
-    DBGMSG("exec: %s\n", command.Get());
+    for (auto& option : f.second->mOptions)
+    {
+      options.AppendFormatted(256, "%s ", option.c_str());
+    }
 
-    if(system(command.Get()) == -1)
-      return false;
+    command.SetFormatted(2048, "%s -cn %s %s-i -a %s -o %s %s", FAUST_EXE, f.second->mName.Get(), options.Get(), archFile.Get(), outputFile.Get(), inputFile.Get());
+    commands.push_back(command.Get());
   }
 
   WDL_String folder = inputFile;
@@ -536,28 +808,32 @@ bool FaustGen::CompileCPP()
 #else
   command.SetFormatted(1024, "copy %s*.tmp %s", folder.Get(), finalOutput.Get());
 #endif
-
-  if(system(command.Get()) == -1)
-  {
-    DBGMSG("Error concatanating files %s %i\n", __FILE__, __LINE__);
-
-    return false;
-  }
+  commands.push_back(command.Get());
 
 #ifndef OS_WIN
   command.SetFormatted(1024, "rm %s*.tmp", folder.Get());
 #else
   command.SetFormatted(1024, "del %s*.tmp", folder.Get());
 #endif
+  commands.push_back(command.Get());
+
+//#endif
+}
 
-  if(system(command.Get()) == -1)
+//static
+bool FaustGen::RunCommands(const std::vector<std::string>& commands)
+{
+  for (auto& command : commands)
   {
-    DBGMSG("Error removing output files %s %i\n", __FILE__, __LINE__);
+    DBGMSG("exec: %s\n", command.c_str());
 
-    return false;
-  }
+    if(system(command.c_str()) == -1)
+    {
+      DBGMSG("Error running %s %s %i\n", command.c_str(), __FILE__, __LINE__);
 
-//#endif
+      return false;
+    }
+  }
 
   return true;
 }
@@ -573,37 +849,49 @@ bool FaustGen::CompileCPP()
 
 void FaustGen::OnTimer(Timer& timer)
 {
-  WDL_String* pInputFile;
-  bool recompile = false;
-
-  for (auto f : Factory::sFactoryMap)
+  // the files are only polled every FAUST_RECOMPILE_INTERVAL, but finished compiles are looked for at every tick
+  if (++sTimerTicks * FAUST_TIMER_INTERVAL >= FAUST_RECOMPILE_INTERVAL)
   {
-    pInputFile = &f.second->mInputDSPFile;
-    StatType buf;
-    GetStat(pInputFile->Get(), &buf);
-    StatTime oldTime = f.second->mPreviousTime;
-    StatTime newTime = GetModifiedTime(buf);
+    sTimerTicks = 0;
 
-    if(!Equal(newTime, oldTime))
+    for (auto f : Factory::sFactoryMap)
     {
-      WDL_MutexLock lock(&mMutex);
-
-      recompile = true;
-      f.second->FreeDSPFactory();
-      DBGMSG("FaustGen-%s: File change detected ----------------------------------\n", mName.Get());
-      DBGMSG("FaustGen-%s: JIT compiling %s\n", mName.Get(), pInputFile->Get());
-      f.second->LoadFile(pInputFile->Get());
-      Init();
+      WDL_String* pInputFile = &f.second->mInputDSPFile;
+      StatType buf;
+      GetStat(pInputFile->Get(), &buf);
+      StatTime oldTime = f.second->mPreviousTime;
+      StatTime newTime = GetModifiedTime(buf);
+
+      if(!Equal(newTime, oldTime))
+      {
+        DBGMSG("FaustGen-%s: File change detected ----------------------------------\n", mName.Get());
+        DBGMSG("FaustGen-%s: JIT compiling %s in the background\n", mName.Get(), pInputFile->Get());
+        f.second->CompileInBackground();
+      }
+
+      f.second->mPreviousTime = newTime;
     }
-      
-    f.second->mPreviousTime = newTime;
   }
 
-  if(recompile)
+  bool recompiled = false;
+
+  for (auto f : Factory::sFactoryMap)
+  {
+    recompiled |= f.second->FinishBackgroundCompile();
+  }
+
+  if(recompiled)
   {
-    // TODO: should check for successfull JIT
     DBGMSG("FaustGen-%s: Statically compiling all FAUST blocks\n", mName.Get());
-    CompileCPP();
+
+    if (sCompileCPPJob)
+      sCompileCPPJob->Cancel();
+
+    std::vector<std::string> commands;
+    GetCompileCPPCommands(commands);
+    sCompileCPPJob = std::make_shared<IPlugJob>([commands](IPlugJob& job) { RunCommands(commands); },
+                                                nullptr, IPlugJob::kPriorityLow, IPlugJob::ECompletionThread::kMainThread);
+    IPlugWorkerPool::Get().Submit(sCompileCPPJob);
     //WDL_String objFile;
     //objFile.Set(pInputFile);
     //objFile.remove_fileext();
@@ -624,7 +912,7 @@ void FaustGen::SetAutoRecompile(bool enable)
   if(enable)
   {
     if(sTimer == nullptr)
-      sTimer = Timer::Create(std::bind(&FaustGen::OnTimer, this, std::placeholders::_1), FAUST_RECOMPILE_INTERVAL);
+      sTimer = Timer::Create(std::bind(&FaustGen::OnTimer, this, std::placeholders::_1), FAUST_TIMER_INTERVAL);
   }
   else
   {
@@ -640,7 +928,10 @@ void FaustGen::SetAutoRecompile(bool enable)
 
 void FaustGen::ProcessBlock(sample** inputs, sample** outputs, int nFrames)
 {
-  WDL_MutexLock lock(&mMutex);
+  // a DSP from a background compile is swapped in at the start of a block
+  if(mDSPHandoff.HasPending())
+    mDSP = mDSPHandoff.Acquire();
+
   if(!mErrored)
     IPlugFaust::ProcessBlock(inputs, outputs, nFrames);
   else
@@ -26,6 +26,7 @@ typedef IPlugFaust FaustGen; // not used, except for CompileCPP();
 #include <set>
 #include <vector>
 #include <map>
+#include <memory>
 
 #include "IPlugPlatform.h"
 #include "IPlugConstants.h"
@@ -67,6 +68,8 @@ static inline StatTime TimeZero() { return (StatTime) 0; }
 #include "faust/dsp/llvm-dsp.h"
 #include "IPlugFaust.h"
 #include "IPlugTimer.h"
+#include "IPlugHandoff.h"
+#include "IPlugWorkerPool.h"
 
 #include "mutex.h"
 
@@ -84,6 +87,7 @@ static inline StatTime TimeZero() { return (StatTime) 0; }
 
 #define FAUST_CLASS_PREFIX "F"
 #define FAUST_RECOMPILE_INTERVAL 5000 //ms
+#define FAUST_TIMER_INTERVAL 100 //ms, how often a finished background compile is looked for
 
 #ifndef FAUST_EXE
   #if defined OS_MAC || defined OS_LINUX
@@ -151,12 +155,22 @@ class FaustGen : public IPlugFaust
 
     void UpdateSourceCode(const char* str);
 
-    ::dsp* CreateDSPInstance(int nVoices = 0);
+    ::dsp* CreateDSPInstance(int nVoices = 0) { return CreateDSPInstance(mLLVMFactory, nVoices); }
+    static ::dsp* CreateDSPInstance(llvm_dsp_factory* pFactory, int nVoices = 0);
     void AddInstance(FaustGen* pDSP) { mInstances.insert(pDSP); }
     void RemoveInstance(FaustGen* pDSP);
 
     bool LoadFile(const char* file);
+    bool ReadFile(const char* file);
     bool WriteToFile(const char* file);
+
+    /** Read the source code from the input file and compile it on a worker thread, along with a new DSP for each instance, while the current DSPs keep running. Main thread only */
+    void CompileInBackground();
+
+    /** Swap the DSPs of a finished background compile into the instances, and free the factories whose DSPs the audio thread has let go of. Main thread only
+     * @return \c true if new DSPs were swapped in */
+    bool FinishBackgroundCompile();
+
     void SetCompileOptions(std::initializer_list<const char*> options);
 
   private:
@@ -190,9 +204,36 @@ class FaustGen : public IPlugFaust
       }
     };
 
+    /** What a background compile makes, which deletes whatever hasn't been taken from it */
+    struct CompileResult
+    {
+      ~CompileResult();
+
+      struct Instance
+      {
+        FaustGen* pInstance;
+        int sampleRate;
+        ::dsp* pDSP;
+      };
+
+      llvm_dsp_factory* pFactory = nullptr;
+      std::vector<Instance> instances;
+      std::string error;
+    };
+
+    /** A factory replaced by a background compile, which is deleted once the audio thread has let go of the DSPs made from it */
+    struct RetiredFactory
+    {
+      llvm_dsp_factory* pFactory;
+      int nIdleTicks;
+    };
+
   private:
     int mInstanceIdx;
     WDL_Mutex mDSPMutex;
+    std::shared_ptr<IPlugJob> mCompileJob;
+    std::shared_ptr<CompileResult> mCompileResult;
+    std::vector<RetiredFactory> mRetiredFactories;
     std::set<FaustGen*> mInstances;
 
     llvm_dsp_factory* mLLVMFactory = nullptr;
@@ -224,7 +265,15 @@ public:
   /** Call this method after constructing the class to inform FaustGen what the maximum I/O count is
    * @param maxNInputs Specify a number here to tell FaustGen the maximum number of inputs the hosting code can accommodate
    * @param maxNOutputs Specify a number here to tell FaustGen the maximum number of outputs the hosting code can accommodate */
-  void SetMaxChannelCount(int maxNInputs, int maxNOutputs) override { mMaxNInputs = maxNInputs; mMaxNOutputs = maxNOutputs; }
+  void SetMaxChannelCount(int maxNInputs, int maxNOutputs) override
+  {
+    mMaxNInputs = maxNInputs;
+    mMaxNOutputs = maxNOutputs;
+    IPlugFaust::SetMaxChannelCount(maxNInputs, maxNOutputs);
+  }
+  
+  /** Set the compile options of this block's factory, shared by the instances with the same name, and recompile them, see IPlugFaust::SetCompileOptions() */
+  void SetCompileOptions(std::initializer_list<const char*> options) override { mFactory->SetCompileOptions(options); }
   
   /** Call this method after constructing the class to JIT compile */
   void Init() override;
@@ -250,16 +299,40 @@ public:
   
   void SetErrored(bool errored) { mErrored = errored; }
   
+  /** Free the DSP, along with any swapped in or out by a background compile. It must not be processing, e.g. before its factory is deleted */
+  void FreeDSP() override;
+  
 private:
+  /** Hand a DSP made by a background compile to the audio thread, which swaps it in at the start of its next block. The values of the parameters carry over to the zones
+   * of the same names in the new DSP, and the replaced DSP is freed on the main thread by CollectDSPGarbage(). Main thread only
+   * @param pDSP The new DSP, initialized at GetDSPSampleRate(), which the instance takes ownership of
+   * @return \c false if the DSP has more channels than the instance has buffers for, in which case it is deleted and the current one keeps running */
+  bool SwapDSP(::dsp* pDSP);
+  
+  /** @return \c true if a DSP handed to the audio thread by SwapDSP() hasn't been swapped in yet */
+  bool HasPendingDSP() const { return mDSPHandoff.HasPending(); }
+  
+  /** Free the DSPs the audio thread has swapped out. Main thread only */
+  void CollectDSPGarbage() { mDSPHandoff.CollectGarbage(); }
+  
+  /** Run shell commands, such as those made by CompileCPP()
+   * @return \c true if every command could be run */
+  static bool RunCommands(const std::vector<std::string>& commands);
+  
+  /** Make the commands that compile the C++ code of the FAUST blocks, see CompileCPP() */
+  static void GetCompileCPPCommands(std::vector<std::string>& commands);
+  
   Factory* mFactory = nullptr;
+  IPlugHandoff<::dsp> mDSPHandoff; // owns mDSP, the DSP the audio thread processes with
+  static WDL_Mutex sCompileMutex; // serializes the libfaust calls of the main thread and the background compiles
+  static std::shared_ptr<IPlugJob> sCompileCPPJob;
+  static int sTimerTicks;
   static Timer* sTimer;
   static int sFaustGenCounter;
   static bool sAutoRecompile;
   int mMaxNInputs = -1;
   int mMaxNOutputs = -1;
   bool mErrored = false;
-  
-  WDL_Mutex mMutex;
 };
 
 #endif // #ifndef FAUST_COMPILED
@@ -0,0 +1,206 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * Multi-channel versions of Upsampler2xFPU and Downsampler2xFPU, which run NCH channels of the same polyphase stages in lockstep, one channel per SIMD lane,
+ * as hiir's SSE classes do. The filter state is kept as [coefficient][channel], and each coefficient is applied to every channel in a fixed length loop,
+ * which the compiler vectorizes, so NCH should match the vector width for T: 4 for float with SSE or NEON, 8 for float with AVX, 2 or 4 for double.
+ * The results are the same as running Upsampler2xFPU/Downsampler2xFPU on each channel. OverSampler uses them when it has more than one channel.
+ */
+
+#include <cassert>
+
+namespace hiir
+{
+
+/** The all-pass chain of a polyphase stage, applied to NCH channels at once, see StageProcFPU */
+template <int NC, typename T, int NCH>
+struct StageProcMulti
+{
+  static inline void process_sample_pos(T spl_0[NCH], T spl_1[NCH], const T coef[NC], T x[NC][NCH], T y[NC][NCH])
+  {
+    int cnt = 0;
+
+    for (; cnt + 1 < NC; cnt += 2)
+    {
+      const T c0 = coef[cnt + 0];
+      const T c1 = coef[cnt + 1];
+
+      for (int ch = 0; ch < NCH; ch++)
+      {
+        const T temp_0 = (spl_0[ch] - y[cnt + 0][ch]) * c0 + x[cnt + 0][ch];
+        const T temp_1 = (spl_1[ch] - y[cnt + 1][ch]) * c1 + x[cnt + 1][ch];
+        x[cnt + 0][ch] = spl_0[ch];
+        x[cnt + 1][ch] = spl_1[ch];
+        y[cnt + 0][ch] = temp_0;
+        y[cnt + 1][ch] = temp_1;
+        spl_0[ch] = temp_0;
+        spl_1[ch] = temp_1;
+      }
+    }
+
+    if (cnt < NC) // an odd number of coefficients, the last one only applies to spl_0
+    {
+      const T c = coef[cnt];
+
+      for (int ch = 0; ch < NCH; ch++)
+      {
+        const T temp = (spl_0[ch] - y[cnt][ch]) * c + x[cnt][ch];
+        x[cnt][ch] = spl_0[ch];
+        y[cnt][ch] = temp;
+        spl_0[ch] = temp;
+      }
+    }
+  }
+};
+
+/** Upsamples (x2) NCH channels at once, see Upsampler2xFPU */
+template <int NC, typename T, int NCH>
+class Upsampler2xMulti
+{
+public:
+  enum { NBR_COEFS = NC, NBR_CHANNELS = NCH };
+
+  Upsampler2xMulti()
+  {
+    for (int i = 0; i < NC; i++)
+      _coef[i] = 0;
+
+    clear_buffers();
+  }
+
+  void set_coefs(const double coef_arr[NBR_COEFS])
+  {
+    assert(coef_arr != 0);
+
+    for (int i = 0; i < NC; i++)
+      _coef[i] = static_cast<T>(coef_arr[i]);
+  }
+
+  /** Upsample nbr_spl samples of each channel
+   * @param out_ptrs nbr_chn output arrays, each with a capacity of nbr_spl * 2 samples. They must not overlap the inputs
+   * @param in_ptrs nbr_chn input arrays of nbr_spl samples
+   * @param nbr_chn The number of channels, up to NCH. The lanes of the missing channels process silence */
+  void process_block(T* const out_ptrs[], const T* const in_ptrs[], long nbr_spl, int nbr_chn = NCH)
+  {
+    assert(nbr_chn > 0 && nbr_chn <= NCH);
+    assert(nbr_spl > 0);
+
+    alignas(32) T even[NCH] = {};
+    alignas(32) T odd[NCH] = {};
+
+    for (long pos = 0; pos < nbr_spl; pos++)
+    {
+      for (int ch = 0; ch < nbr_chn; ch++)
+        even[ch] = in_ptrs[ch][pos];
+
+      for (int ch = 0; ch < NCH; ch++)
+        odd[ch] = even[ch];
+
+      StageProcMulti<NC, T, NCH>::process_sample_pos(even, odd, _coef, _x, _y);
+
+      for (int ch = 0; ch < nbr_chn; ch++)
+      {
+        out_ptrs[ch][pos * 2] = even[ch];
+        out_ptrs[ch][pos * 2 + 1] = odd[ch];
+      }
+    }
+  }
+
+  void clear_buffers()
+  {
+    for (int i = 0; i < NC; i++)
+    {
+      for (int ch = 0; ch < NCH; ch++)
+      {
+        _x[i][ch] = 0;
+        _y[i][ch] = 0;
+      }
+    }
+  }
+
+private:
+  T _coef[NC];
+  T _x[NC][NCH];
+  T _y[NC][NCH];
+};
+
+/** Downsamples (x2) NCH channels at once, see Downsampler2xFPU */
+template <int NC, typename T, int NCH>
+class Downsampler2xMulti
+{
+public:
+  enum { NBR_COEFS = NC, NBR_CHANNELS = NCH };
+
+  Downsampler2xMulti()
+  {
+    for (int i = 0; i < NC; i++)
+      _coef[i] = 0;
+
+    clear_buffers();
+  }
+
+  void set_coefs(const double coef_arr[NBR_COEFS])
+  {
+    assert(coef_arr != 0);
+
+    for (int i = 0; i < NC; i++)
+      _coef[i] = static_cast<T>(coef_arr[i]);
+  }
+
+  /** Downsample nbr_spl * 2 samples of each channel into nbr_spl. Each output may be its input, as with Downsampler2xFPU::process_block()
+   * @param out_ptrs nbr_chn output arrays of nbr_spl samples
+   * @param in_ptrs nbr_chn input arrays of nbr_spl * 2 samples
+   * @param nbr_chn The number of channels, up to NCH. The lanes of the missing channels process silence */
+  void process_block(T* const out_ptrs[], const T* const in_ptrs[], long nbr_spl, int nbr_chn = NCH)
+  {
+    assert(nbr_chn > 0 && nbr_chn <= NCH);
+    assert(nbr_spl > 0);
+
+    alignas(32) T spl_0[NCH] = {};
+    alignas(32) T spl_1[NCH] = {};
+
+    for (long pos = 0; pos < nbr_spl; pos++)
+    {
+      for (int ch = 0; ch < nbr_chn; ch++)
+      {
+        spl_0[ch] = in_ptrs[ch][pos * 2 + 1];
+        spl_1[ch] = in_ptrs[ch][pos * 2];
+      }
+
+      StageProcMulti<NC, T, NCH>::process_sample_pos(spl_0, spl_1, _coef, _x, _y);
+
+      for (int ch = 0; ch < nbr_chn; ch++)
+        out_ptrs[ch][pos] = T(0.5f) * (spl_0[ch] + spl_1[ch]);
+    }
+  }
+
+  void clear_buffers()
+  {
+    for (int i = 0; i < NC; i++)
+    {
+      for (int ch = 0; ch < NCH; ch++)
+      {
+        _x[i][ch] = 0;
+        _y[i][ch] = 0;
+      }
+    }
+  }
+
+private:
+  T _coef[NC];
+  T _x[NC][NCH];
+  T _y[NC][NCH];
+};
+
+} // namespace hiir
@@ -0,0 +1,211 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * Linear phase half-band FIR filters for 2x up and down sampling, an alternative to the polyphase IIR stages of hiir, used by OverSampler with kLinearPhaseFIR.
+ * A half-band filter has every other tap zero apart from the centre one, which is 0.5, so each output needs only the nonzero taps: the polyphase
+ * structure computes one output of each pair with a dot product over those taps, and the other is just a delayed input. The dot products use contiguous
+ * history (each sample is written twice, into a buffer twice the kernel's length) and four partial sums, so that the compiler can vectorize them.
+ * A stage with half-length M (odd) delays the signal by M samples at the higher rate. The kernels are designed once per M and shared by every stage in the process, see SharedTable.
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+#include "IPlugConstants.h"
+#include "SharedTables.h"
+
+/** Designs the kernels, a Kaiser windowed sinc. The names of the process methods follow hiir's, so that the stages are interchangeable */
+struct HalfBandFIR
+{
+  /** @param M The half-length of the filter, odd. The filter has 2 * M + 1 taps
+   * @param attenuationDB The stopband attenuation that sets the window's shape
+   * @return The M + 1 nonzero taps off the centre, h[-M], h[-M + 2] ... h[M], normalised so that the filter has unity gain at DC */
+  static std::vector<double> Design(int M, double attenuationDB = 96.)
+  {
+    assert(M > 0 && (M & 1));
+
+    const double beta = attenuationDB > 50. ? 0.1102 * (attenuationDB - 8.7) : 0.5842 * std::pow(attenuationDB - 21., 0.4) + 0.07886 * (attenuationDB - 21.);
+    std::vector<double> taps(M + 1);
+    double sum = 0.;
+
+    for (int i = 0; i <= M; i++)
+    {
+      const int k = 2 * i - M; // odd
+      const double x = (double) k / M;
+      const double window = BesselI0(beta * std::sqrt(std::max(0., 1. - x * x))) / BesselI0(beta);
+      taps[i] = std::sin(PI * k / 2.) / (PI * k) * window;
+      sum += taps[i];
+    }
+
+    // the centre tap gives half of the DC gain, the others the other half
+    for (auto& tap : taps)
+      tap *= 0.5 / sum;
+
+    return taps;
+  }
+
+  static double BesselI0(double x)
+  {
+    double sum = 1., term = 1.;
+
+    for (int k = 1; k < 50 && term > 1e-12 * sum; k++)
+    {
+      term *= (x / (2. * k)) * (x / (2. * k));
+      sum += term;
+    }
+
+    return sum;
+  }
+
+  /** Dot product of n values, with four partial sums so that it vectorizes without reassociating a single sum */
+  template <typename T>
+  static inline T Dot(const T* pA, const T* pB, int n)
+  {
+    T s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4)
+    {
+      s0 += pA[i] * pB[i];
+      s1 += pA[i + 1] * pB[i + 1];
+      s2 += pA[i + 2] * pB[i + 2];
+      s3 += pA[i + 3] * pB[i + 3];
+    }
+
+    for (; i < n; i++)
+      s0 += pA[i] * pB[i];
+
+    return (s0 + s1) + (s2 + s3);
+  }
+};
+
+/** Upsamples (x2) with a half-band FIR of half-length M */
+template <typename T>
+class HalfBandFIRUpsampler
+{
+public:
+  HalfBandFIRUpsampler(int M)
+  : mM(M)
+  , mNTaps(M + 1)
+  , mPos(0)
+  {
+    mCoeffs.Acquire({"HalfBandFIRUpsampler", 0., {static_cast<double>(M)}}, [M]() {
+      const std::vector<double> taps = HalfBandFIR::Design(M);
+      std::vector<T>* pCoeffs = new std::vector<T>(taps.size());
+
+      for (size_t i = 0; i < taps.size(); i++)
+        (*pCoeffs)[i] = static_cast<T>(2. * taps[i]); // zero stuffing halves the gain
+
+      return pCoeffs;
+    });
+
+    mpCoeffs = mCoeffs.Get()->data();
+    mHistory.resize(2 * mNTaps);
+    clear_buffers();
+  }
+
+  /** @param out_ptr nbr_spl * 2 samples, which must not overlap the input
+   * @param in_ptr nbr_spl samples */
+  void process_block(T out_ptr[], const T in_ptr[], long nbr_spl)
+  {
+    const int centre = (mM + 1) / 2; // the position of x[n - (M - 1) / 2] in the window
+
+    for (long pos = 0; pos < nbr_spl; pos++)
+    {
+      // write the sample twice, so that the last mNTaps samples always start at mHistory[mPos + 1]
+      mPos = mPos + 1 == mNTaps ? 0 : mPos + 1;
+      mHistory[mPos] = mHistory[mPos + mNTaps] = in_ptr[pos];
+      const T* pWindow = mHistory.data() + mPos + 1;
+
+      out_ptr[pos * 2] = HalfBandFIR::Dot(mpCoeffs, pWindow, mNTaps);
+      out_ptr[pos * 2 + 1] = pWindow[centre];
+    }
+  }
+
+  void clear_buffers()
+  {
+    std::fill(mHistory.begin(), mHistory.end(), T(0));
+    mPos = 0;
+  }
+
+private:
+  int mM;
+  int mNTaps;
+  int mPos;
+  SharedTable<std::vector<T>> mCoeffs;
+  const T* mpCoeffs; // the table's, which is built when the stage is constructed
+  std::vector<T> mHistory;
+};
+
+/** Downsamples (x2) with a half-band FIR of half-length M */
+template <typename T>
+class HalfBandFIRDownsampler
+{
+public:
+  HalfBandFIRDownsampler(int M)
+  : mNTaps(M + 1)
+  , mNOdd((M + 1) / 2)
+  {
+    mCoeffs.Acquire({"HalfBandFIRDownsampler", 0., {static_cast<double>(M)}}, [M]() {
+      const std::vector<double> taps = HalfBandFIR::Design(M);
+      return new std::vector<T>(taps.begin(), taps.end());
+    });
+
+    mpCoeffs = mCoeffs.Get()->data();
+    mHistory.resize(2 * mNTaps);
+    mOdd.resize(mNOdd);
+    clear_buffers();
+  }
+
+  /** @param out_ptr nbr_spl samples. It may be the input, as with Downsampler2xFPU::process_block()
+   * @param in_ptr nbr_spl * 2 samples */
+  void process_block(T out_ptr[], const T in_ptr[], long nbr_spl)
+  {
+    for (long pos = 0; pos < nbr_spl; pos++)
+    {
+      const T even = in_ptr[pos * 2];
+      const T odd = in_ptr[pos * 2 + 1];
+
+      mPos = mPos + 1 == mNTaps ? 0 : mPos + 1;
+      mHistory[mPos] = mHistory[mPos + mNTaps] = even;
+
+      // the centre tap reads the odd sample (M + 1) / 2 pairs back, which is the oldest in mOdd
+      const T centre = mOdd[mOddPos];
+      mOdd[mOddPos] = odd;
+      mOddPos = mOddPos + 1 == mNOdd ? 0 : mOddPos + 1;
+
+      out_ptr[pos] = HalfBandFIR::Dot(mpCoeffs, mHistory.data() + mPos + 1, mNTaps) + T(0.5) * centre;
+    }
+  }
+
+  void clear_buffers()
+  {
+    std::fill(mHistory.begin(), mHistory.end(), T(0));
+    std::fill(mOdd.begin(), mOdd.end(), T(0));
+    mPos = 0;
+    mOddPos = 0;
+  }
+
+private:
+  int mNTaps;
+  int mNOdd;
+  int mPos = 0;
+  int mOddPos = 0;
+  SharedTable<std::vector<T>> mCoeffs;
+  const T* mpCoeffs;
+  std::vector<T> mHistory;
+  std::vector<T> mOdd;
+};
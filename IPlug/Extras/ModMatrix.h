@@ -0,0 +1,417 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * A modulation matrix that routes block buffers of sources, such as LFOs, envelopes and MPE expressions, to many destinations.
+ * ModRoutes holds the routes, compiled into a flat table sorted by destination, and can be shared by several ModMatrix instances, e.g. one per voice.
+ * ModMatrix holds the buffers. Each block, the sources are set, as a buffer, a ControlRamp or a constant, and Process() sums the routes into each destination
+ * in the normalized domain, with one multiply-accumulate pass over the block for each route whose source varies, then clamps the sum and maps it through the destination
+ * parameter's shape once. Disabled routes and routes with zero depth are left out of the table, inactive sources are skipped, and a destination that only
+ * constant sources reach is computed once for the block rather than per sample, e.g.
+ * @code
+ * // in the constructor
+ * mRoutes.SetDestinationParam(kDestCutoff, GetParam(kParamCutoff));
+ * mRoutes.AddRoute(kSourceLFO1, kDestCutoff, 0.25);
+ *
+ * // in ProcessBlock()
+ * mLFO1.ProcessBlock(mModMatrix.GetSourceBuffer(kSourceLFO1), nFrames);
+ * mModMatrix.SetSource(kSourcePressure, voiceInputs[kVoiceControlPressure], nFrames);
+ * mModMatrix.Process(nFrames);
+ * const float* pCutoff = mModMatrix.GetBuffer(kDestCutoff); // in Hz, or mModMatrix.GetValue(kDestCutoff, s) if it isn't modulated
+ * @endcode
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+#include "IPlugParameter.h"
+#include "IPlugControlRamp.h"
+#include "IPlugCPU.h"
+
+/** The routes of a modulation matrix, from sources to destinations, each with a depth in the normalized domain of the destination.
+ * Edit it on the audio thread, or while no ModMatrix that uses it is processing. It doesn't allocate after construction */
+class ModRoutes
+{
+public:
+  /** @param nSources The number of sources
+   * @param nDestinations The number of destinations
+   * @param maxRoutes The most routes there can be */
+  ModRoutes(int nSources, int nDestinations, int maxRoutes = 256)
+  : mNSources(nSources)
+  , mRoutes(maxRoutes)
+  , mTable(maxRoutes)
+  , mDestStart(nDestinations + 1, 0)
+  , mDestParams(nDestinations, nullptr)
+  {}
+
+  int NSources() const { return mNSources; }
+  int NDestinations() const { return (int) mDestParams.size(); }
+
+  /** @param dest A destination
+   * @param pParam The parameter that gives the destination its base value and its shape, which must outlive the routes, or nullptr for a destination whose output is normalized with no base */
+  void SetDestinationParam(int dest, const IParam* pParam) { mDestParams[dest] = pParam; }
+
+  const IParam* GetDestinationParam(int dest) const { return mDestParams[dest]; }
+
+  /** Add a route
+   * @param source The source
+   * @param dest The destination
+   * @param depth The change of the destination's normalized value per unit of the source, from -1 to 1 for the whole range
+   * @return The route's index, which stays the same until it is removed, or -1 if there are already maxRoutes */
+  int AddRoute(int source, int dest, double depth)
+  {
+    assert(source >= 0 && source < mNSources && dest >= 0 && dest < NDestinations());
+
+    for (int r = 0; r < (int) mRoutes.size(); r++)
+    {
+      if (mRoutes[r].source < 0)
+      {
+        // Route has default member initializers, so it is not an aggregate in C++11
+        Route& route = mRoutes[r];
+        route.source = source;
+        route.dest = dest;
+        route.depth = depth;
+        route.enabled = true;
+        mDirty = true;
+        return r;
+      }
+    }
+
+    return -1;
+  }
+
+  void RemoveRoute(int route)
+  {
+    mRoutes[route].source = -1;
+    mDirty = true;
+  }
+
+  void SetDepth(int route, double depth)
+  {
+    // the table only needs rebuilding if the route goes to or from zero depth
+    if ((mRoutes[route].depth == 0.) != (depth == 0.))
+      mDirty = true;
+
+    mRoutes[route].depth = depth;
+  }
+
+  double GetDepth(int route) const { return mRoutes[route].depth; }
+
+  /** @param route A route
+   * @param enabled \c false to bypass the route, keeping its depth */
+  void SetEnabled(int route, bool enabled)
+  {
+    if (mRoutes[route].enabled != enabled)
+      mDirty = true;
+
+    mRoutes[route].enabled = enabled;
+  }
+
+  /** Rebuild the table if the routes have changed since it was last built. Called by ModMatrix::Process() */
+  void Compile()
+  {
+    if (!mDirty)
+      return;
+
+    // a counting sort of the routes that contribute by their destination
+    const int nDests = NDestinations();
+    std::fill(mDestStart.begin(), mDestStart.end(), 0);
+
+    for (const auto& route : mRoutes)
+    {
+      if (Contributes(route))
+        mDestStart[route.dest + 1]++;
+    }
+
+    for (int d = 0; d < nDests; d++)
+      mDestStart[d + 1] += mDestStart[d];
+
+    // mDestStart[d + 1] is now the end of destination d. Fill each destination from its end, going backwards so that its routes stay in order,
+    // which leaves mDestStart[d + 1] at the start of destination d
+    int total = 0;
+
+    for (int r = (int) mRoutes.size() - 1; r >= 0; r--)
+    {
+      const Route& route = mRoutes[r];
+
+      if (Contributes(route))
+      {
+        mTable[--mDestStart[route.dest + 1]] = { route.source, r };
+        total++;
+      }
+    }
+
+    for (int d = 0; d < nDests; d++)
+      mDestStart[d] = mDestStart[d + 1];
+
+    mDestStart[nDests] = total;
+    mDirty = false;
+  }
+
+private:
+  template <typename T> friend class ModMatrix;
+
+  struct Route
+  {
+    int source = -1; // -1 if the slot is free
+    int dest = 0;
+    double depth = 0.;
+    bool enabled = false;
+  };
+
+  struct Entry
+  {
+    int source;
+    int route;
+  };
+
+  static bool Contributes(const Route& route) { return route.source >= 0 && route.enabled && route.depth != 0.; }
+
+  int mNSources;
+  std::vector<Route> mRoutes;
+  std::vector<Entry> mTable;
+  std::vector<int> mDestStart; // the routes of destination d are mTable[mDestStart[d] ... mDestStart[d + 1] - 1]
+  std::vector<const IParam*> mDestParams;
+  bool mDirty = true;
+};
+
+/** The buffers of a modulation matrix: one per source, written each block, and one per destination, computed by Process() from the routes in a ModRoutes.
+ * The destinations' outputs are in the units of their parameters, or normalized if they have none
+ * @tparam T The sample type of the buffers */
+template <typename T = float>
+class ModMatrix
+{
+public:
+  /** @param routes The routes, shared with other instances, which must outlive the matrix
+   * @param maxBlockSize The largest nFrames that Process() will be called with */
+  ModMatrix(ModRoutes& routes, int maxBlockSize)
+  : mRoutes(routes)
+  , mSources(routes.NSources())
+  , mDests(routes.NDestinations())
+  {
+    SetMaxBlockSize(maxBlockSize);
+  }
+
+  /** Resize the buffers. Not on the audio thread */
+  void SetMaxBlockSize(int maxBlockSize)
+  {
+    mMaxBlockSize = maxBlockSize;
+    mSourceData.assign(mSources.size() * maxBlockSize, T(0));
+    mDestData.assign(mDests.size() * maxBlockSize, T(0));
+  }
+
+  /** @param source A source
+   * @return The source's buffer of maxBlockSize samples, to write this block's values into. The source varies for the block, until it is set otherwise */
+  T* GetSourceBuffer(int source)
+  {
+    mSources[source].state = kSourceVarying;
+    return mSourceData.data() + source * mMaxBlockSize;
+  }
+
+  /** Set a source from a ramp, such as one of a voice's inputs. If the ramp holds one value, it isn't written out
+   * @param source A source
+   * @param ramp The ramp
+   * @param nFrames The number of samples in the block */
+  void SetSource(int source, ControlRamp& ramp, int nFrames)
+  {
+    if (ramp.IsConstant())
+      SetSourceConstant(source, static_cast<T>(ramp.endValue));
+    else
+      ramp.Write(GetSourceBuffer(source), 0, nFrames);
+  }
+
+  /** Set a source to one value for the block. A source of zero is skipped, as if it were inactive */
+  void SetSourceConstant(int source, T value)
+  {
+    mSources[source].state = value != T(0) ? kSourceConstant : kSourceInactive;
+    mSources[source].value = value;
+  }
+
+  /** Skip the routes of a source, e.g. an LFO that is switched off or an envelope that has finished */
+  void SetSourceInactive(int source) { mSources[source].state = kSourceInactive; }
+
+  /** Compute the destinations for a block from the sources as they are now
+   * @param nFrames The number of samples, up to maxBlockSize */
+  void Process(int nFrames)
+  {
+    assert(nFrames <= mMaxBlockSize);
+    mRoutes.Compile();
+
+    const MulAddFunc mulAdd = GetMulAdd().Get();
+    const MulSetFunc mulSet = GetMulSet().Get();
+    const int nDests = (int) mDests.size();
+
+    for (int d = 0; d < nDests; d++)
+    {
+      Dest& dest = mDests[d];
+      const IParam* pParam = mRoutes.mDestParams[d];
+      const int begin = mRoutes.mDestStart[d], end = mRoutes.mDestStart[d + 1];
+
+      // the constant sources add to the base, the varying ones are accumulated sample by sample
+      double offset = pParam ? pParam->GetNormalized() : 0.;
+      int nVarying = 0;
+
+      for (int e = begin; e < end; e++)
+      {
+        const ModRoutes::Entry& entry = mRoutes.mTable[e];
+        const Source& source = mSources[entry.source];
+
+        if (source.state == kSourceConstant)
+          offset += mRoutes.mRoutes[entry.route].depth * source.value;
+        else if (source.state == kSourceVarying)
+          nVarying++;
+      }
+
+      if (nVarying == 0)
+      {
+        dest.modulated = false;
+        dest.value = static_cast<T>(pParam ? pParam->FromNormalized(Clip(offset, 0., 1.)) : Clip(offset, 0., 1.));
+        continue;
+      }
+
+      T* pDest = mDestData.data() + d * mMaxBlockSize;
+      bool first = true;
+
+      for (int e = begin; e < end; e++)
+      {
+        const ModRoutes::Entry& entry = mRoutes.mTable[e];
+
+        if (mSources[entry.source].state != kSourceVarying)
+          continue;
+
+        const T* pSource = mSourceData.data() + entry.source * mMaxBlockSize;
+        const T depth = static_cast<T>(mRoutes.mRoutes[entry.route].depth);
+
+        if (first)
+          mulSet(pDest, pSource, depth, static_cast<T>(offset), nFrames);
+        else
+          mulAdd(pDest, pSource, depth, nFrames);
+
+        first = false;
+      }
+
+      MapToParam(pDest, pParam, nFrames);
+      dest.modulated = true;
+      dest.value = pDest[nFrames - 1];
+    }
+  }
+
+  /** @return \c true if the destination varies over the block, so that GetBuffer() is valid */
+  bool IsModulated(int dest) const { return mDests[dest].modulated; }
+
+  /** @return The destination's values for the block, valid only if IsModulated() */
+  const T* GetBuffer(int dest) const { return mDestData.data() + dest * mMaxBlockSize; }
+
+  /** @return The destination's value at a sample of the block */
+  T GetValue(int dest, int offset) const { return mDests[dest].modulated ? GetBuffer(dest)[offset] : mDests[dest].value; }
+
+  /** @return The destination's value at the end of the block, e.g. for a destination that is only read once per block */
+  T GetValue(int dest) const { return mDests[dest].value; }
+
+private:
+  enum ESourceState { kSourceInactive, kSourceConstant, kSourceVarying };
+
+  struct Source
+  {
+    ESourceState state = kSourceInactive;
+    T value = T(0);
+  };
+
+  struct Dest
+  {
+    bool modulated = false;
+    T value = T(0);
+  };
+
+  typedef void (*MulAddFunc)(T* pDest, const T* pSrc, T depth, int n);
+  typedef void (*MulSetFunc)(T* pDest, const T* pSrc, T depth, T offset, int n);
+
+  // plain loops, which the compiler vectorizes for the baseline instruction set, and again for AVX2 with FMA in the versions with IPLUG_TARGET_AVX2
+  static void MulAdd(T* pDest, const T* pSrc, T depth, int n)
+  {
+    for (int i = 0; i < n; i++)
+      pDest[i] += depth * pSrc[i];
+  }
+
+  static void MulSet(T* pDest, const T* pSrc, T depth, T offset, int n)
+  {
+    for (int i = 0; i < n; i++)
+      pDest[i] = offset + depth * pSrc[i];
+  }
+
+#ifdef IPLUG_SIMD_AVX
+  IPLUG_TARGET_AVX2 static void AVX2MulAdd(T* pDest, const T* pSrc, T depth, int n)
+  {
+    for (int i = 0; i < n; i++)
+      pDest[i] += depth * pSrc[i];
+  }
+
+  IPLUG_TARGET_AVX2 static void AVX2MulSet(T* pDest, const T* pSrc, T depth, T offset, int n)
+  {
+    for (int i = 0; i < n; i++)
+      pDest[i] = offset + depth * pSrc[i];
+  }
+#endif
+
+  static const IPlugDispatch<MulAddFunc>& GetMulAdd()
+  {
+#ifdef IPLUG_SIMD_AVX
+    static const IPlugDispatch<MulAddFunc> sDispatch { MulAdd, { { kISAAVX2, AVX2MulAdd } } };
+#else
+    static const IPlugDispatch<MulAddFunc> sDispatch { MulAdd };
+#endif
+    return sDispatch;
+  }
+
+  static const IPlugDispatch<MulSetFunc>& GetMulSet()
+  {
+#ifdef IPLUG_SIMD_AVX
+    static const IPlugDispatch<MulSetFunc> sDispatch { MulSet, { { kISAAVX2, AVX2MulSet } } };
+#else
+    static const IPlugDispatch<MulSetFunc> sDispatch { MulSet };
+#endif
+    return sDispatch;
+  }
+
+  /** Clamp the sum to the normalized range and map it through the parameter's shape, in one pass. The linear shape is a multiply-add, the others call the shape's function */
+  static void MapToParam(T* pValues, const IParam* pParam, int n)
+  {
+    if (!pParam)
+    {
+      for (int i = 0; i < n; i++)
+        pValues[i] = std::min(std::max(pValues[i], T(0)), T(1));
+    }
+    else if (pParam->GetShapeType() == IParam::kShapeLinear && !pParam->GetStepped())
+    {
+      const T min = static_cast<T>(pParam->GetMin());
+      const T range = static_cast<T>(pParam->GetRange());
+
+      for (int i = 0; i < n; i++)
+        pValues[i] = min + std::min(std::max(pValues[i], T(0)), T(1)) * range;
+    }
+    else
+    {
+      for (int i = 0; i < n; i++)
+        pValues[i] = static_cast<T>(pParam->FromNormalized(Clip(static_cast<double>(pValues[i]), 0., 1.)));
+    }
+  }
+
+  ModRoutes& mRoutes;
+  std::vector<Source> mSources;
+  std::vector<Dest> mDests;
+  std::vector<T> mSourceData;
+  std::vector<T> mDestData;
+  int mMaxBlockSize = 0;
+};
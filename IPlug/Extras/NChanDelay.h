@@ -10,58 +10,287 @@
 
 #pragma once
 
-// A static delayline used to delay bypassed signals to match mLatency in AAX/VST3/AU
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+// A delayline used to delay bypassed signals to match mLatency in AAX/VST3/AU
+// The ring buffer is allocated for a maximum delay time, within which SetDelayTime() is lock-free and can be called from the audio thread.
+// Delay time changes are crossfaded over DELAY_CROSSFADE_SAMPLES to avoid clicks. Outside of a crossfade, ProcessBlock() copies whole blocks in and out of the ring.
+// It can also be used for effects: Write() a block, then read any number of fractional, optionally modulated taps from it with ReadTap() and ReadTaps()
 template<typename T>
 class NChanDelayLine
 {
 public:
-  NChanDelayLine(int nInputChans = 2, int nOutputChans = 2)
+  static const int DELAY_CROSSFADE_SAMPLES = 128;
+
+  enum EInterpolation
+  {
+    kInterpNone = 0, // rounds the delay down to whole samples
+    kInterpLinear, // cheap, but filters the signal a little, depending on the fraction
+    kInterpAllpass, // flat magnitude, for fixed or slowly moving delays such as a flanger's. Needs the tap's state
+    kInterpCubic // 4 point Hermite, for delays that move quickly, such as a chorus's
+  };
+
+  NChanDelayLine(int nInputChans = 2, int nOutputChans = 2, int maxDelayTimeSamples = 0)
   : mNInChans(nInputChans)
   , mNOutChans(nOutputChans)
-  {}
+  {
+    SetMaxDelayTime(maxDelayTimeSamples);
+  }
 
-  void SetDelayTime(int delayTimeSamples)
+  /** Allocate the ring buffer, this is not realtime safe
+   * @param maxDelayTimeSamples The longest delay that SetDelayTime() can set without reallocating */
+  void SetMaxDelayTime(int maxDelayTimeSamples)
   {
-    mDTSamples = delayTimeSamples;
-    mBuffer.Resize(mNInChans * delayTimeSamples);
+    uint32_t size = 1;
+    while (size <= (uint32_t) maxDelayTimeSamples) size <<= 1;
+
+    mMaxDTSamples = maxDelayTimeSamples;
+    mMask = size - 1;
+    mBuffer.Resize(mNInChans * size);
     mWriteAddress = 0;
+    mStarted = false;
     ClearBuffer();
   }
 
+  /** Set the delay time, this is lock-free if delayTimeSamples is within the maximum delay time, otherwise the buffer is reallocated
+   * @param delayTimeSamples The delay in samples */
+  void SetDelayTime(int delayTimeSamples)
+  {
+    if (delayTimeSamples > mMaxDTSamples)
+    {
+      SetMaxDelayTime(delayTimeSamples);
+      mDTSamples = mFadeFromDTSamples = delayTimeSamples;
+      mFadeRemaining = 0;
+    }
+
+    mPendingDTSamples.store(delayTimeSamples);
+  }
+
+  int GetMaxDelayTime() const { return mMaxDTSamples; }
+
+  // the memory the ring buffer holds, in bytes
+  int64_t GetBytes() const { return static_cast<int64_t>(mBuffer.GetSize()) * sizeof(T); }
+
   void ClearBuffer()
   {
-    memset(mBuffer.Get(), 0, mNInChans * mDTSamples * sizeof(T));
+    memset(mBuffer.Get(), 0, mBuffer.GetSize() * sizeof(T));
   }
 
   void ProcessBlock(T** inputs, T** outputs, int nFrames)
+  {
+    const int pendingDT = std::min(mPendingDTSamples.load(), mMaxDTSamples);
+
+    if (pendingDT != (int) mDTSamples)
+    {
+      // there is nothing to crossfade from before the first block
+      mFadeFromDTSamples = mStarted ? mDTSamples : pendingDT;
+      mDTSamples = pendingDT;
+      mFadeRemaining = mStarted ? DELAY_CROSSFADE_SAMPLES : 0;
+    }
+
+    mStarted = true;
+
+    const int nChans = std::min(mNInChans, mNOutChans);
+    const int nFadeFrames = std::min(nFrames, mFadeRemaining);
+
+    if (nFadeFrames)
+      ProcessFade(inputs, outputs, nFadeFrames, nChans);
+
+    T* buffer = mBuffer.Get();
+    const uint32_t size = mMask + 1;
+    const int maxChunk = (int) (size - mDTSamples); // the input has to be written before the output is read, in case they are the same buffers
+
+    for (auto start = nFadeFrames; start < nFrames;)
+    {
+      const int chunk = std::min(nFrames - start, maxChunk);
+      const uint32_t readAddress = (mWriteAddress - mDTSamples) & mMask;
+
+      for (auto c = 0; c < nChans; c++)
+      {
+        RingWrite(buffer + c * size, mWriteAddress, inputs[c] + start, chunk);
+        RingRead(outputs[c] + start, buffer + c * size, readAddress, chunk);
+      }
+
+      mWriteAddress = (mWriteAddress + chunk) & mMask;
+      start += chunk;
+    }
+  }
+
+  /** Write a block into the ring, for ReadTap() and ReadTaps(). Don't mix with ProcessBlock(), which writes too
+   * @param inputs One buffer for each of the input channels */
+  void Write(T** inputs, int nFrames)
+  {
+    const uint32_t size = mMask + 1;
+    mLastWriteAddress = mWriteAddress;
+    mLastWriteFrames = nFrames;
+
+    // a block longer than the ring only leaves its end
+    const int skip = std::max(0, nFrames - (int) size);
+
+    for (auto c = 0; c < mNInChans; c++)
+      RingWrite(mBuffer.Get() + c * size, (mWriteAddress + skip) & mMask, inputs[c] + skip, nFrames - skip);
+
+    mWriteAddress = (mWriteAddress + nFrames) & mMask;
+  }
+
+  /** Read a tap with a fixed delay from the block passed to the last Write(), so that a delay of 0 reads that block itself.
+   * Delays are clamped to what the interpolation can read: at least 1 sample for kInterpCubic, and at most the ring's size less the block and 3 samples.
+   * Allocate the ring long enough with SetMaxDelayTime(maxTapDelay + maxBlockSize)
+   * @param chan The input channel
+   * @param pOut The output, the same length as the last Write()
+   * @param delay The delay in samples, may be fractional
+   * @param pAllpassState The tap's filter state for kInterpAllpass, one value per tap and channel that the caller keeps. Ignored otherwise */
+  void ReadTap(int chan, T* pOut, T delay, EInterpolation interp = kInterpLinear, T* pAllpassState = nullptr) const
+  {
+    ReadInterpolated(chan, pOut, interp, pAllpassState, [delay](int) { return delay; });
+  }
+
+  /** Read a tap with a delay for every sample, such as a chorus's or a flanger's, see the other ReadTap()
+   * @param pDelays The delay in samples for each sample of the last Write() */
+  void ReadTap(int chan, T* pOut, const T* pDelays, EInterpolation interp = kInterpCubic, T* pAllpassState = nullptr) const
+  {
+    ReadInterpolated(chan, pOut, interp, pAllpassState, [pDelays](int s) { return pDelays[s]; });
+  }
+
+  /** Sum several taps with fixed delays, such as early reflections or a multi-tap echo, into pOut, which is overwritten
+   * @param pDelays nTaps delays in samples
+   * @param pGains nTaps gains */
+  void ReadTaps(int chan, T* pOut, const T* pDelays, const T* pGains, int nTaps, EInterpolation interp = kInterpLinear) const
+  {
+    const int nFrames = mLastWriteFrames;
+    memset(pOut, 0, nFrames * sizeof(T));
+
+    for (auto t = 0; t < nTaps; t++)
+    {
+      const T gain = pGains[t];
+      ReadInterpolated(chan, pOut, interp, nullptr, [pDelays, t](int) { return pDelays[t]; }, true, gain);
+    }
+  }
+
+private:
+  /** Copy n samples into the ring at pos, in at most two pieces */
+  void RingWrite(T* pRing, uint32_t pos, const T* pSrc, int n) const
+  {
+    const int first = std::min(n, (int) (mMask + 1 - pos));
+    memcpy(pRing + pos, pSrc, first * sizeof(T));
+    memcpy(pRing, pSrc + first, (n - first) * sizeof(T));
+  }
+
+  void RingRead(T* pDest, const T* pRing, uint32_t pos, int n) const
+  {
+    const int first = std::min(n, (int) (mMask + 1 - pos));
+    memcpy(pDest, pRing + pos, first * sizeof(T));
+    memcpy(pDest + first, pRing, (n - first) * sizeof(T));
+  }
+
+  /** Read a tap into pOut, or add it times gain, getting the delay of each sample from getDelay(s) */
+  template <typename DELAYFUNC>
+  void ReadInterpolated(int chan, T* pOut, EInterpolation interp, T* pAllpassState, DELAYFUNC getDelay, bool accumulate = false, T gain = T(1)) const
+  {
+    const int nFrames = mLastWriteFrames;
+    const uint32_t size = mMask + 1;
+    const T* pRing = mBuffer.Get() + chan * size;
+    const T minDelay = interp == kInterpCubic ? T(1) : T(0);
+    const T maxDelay = (T) std::max(0, (int) size - nFrames - 3);
+    T allpassY = pAllpassState ? *pAllpassState : T(0);
+
+    for (auto s = 0; s < nFrames; s++)
+    {
+      const T delay = std::min(std::max(getDelay(s), minDelay), maxDelay);
+      const int whole = (int) delay;
+      const T frac = delay - (T) whole;
+      const uint32_t pos = (mLastWriteAddress + s - whole) & mMask; // x[n - whole], the samples before it are older
+      const T x0 = pRing[pos];
+      T y;
+
+      switch (interp)
+      {
+        case kInterpNone:
+          y = x0;
+          break;
+        case kInterpLinear:
+          y = x0 + frac * (pRing[(pos - 1) & mMask] - x0);
+          break;
+        case kInterpAllpass:
+        {
+          const T eta = (T(1) - frac) / (T(1) + frac);
+          y = eta * x0 + pRing[(pos - 1) & mMask] - eta * allpassY;
+          allpassY = y;
+          break;
+        }
+        case kInterpCubic:
+        default:
+        {
+          const T xm1 = pRing[(pos + 1) & mMask];
+          const T x1 = pRing[(pos - 1) & mMask];
+          const T x2 = pRing[(pos - 2) & mMask];
+          const T c1 = T(0.5) * (x1 - xm1);
+          const T c2 = xm1 - T(2.5) * x0 + T(2) * x1 - T(0.5) * x2;
+          const T c3 = T(0.5) * (x2 - xm1) + T(1.5) * (x0 - x1);
+          y = ((c3 * frac + c2) * frac + c1) * frac + x0;
+          break;
+        }
+      }
+
+      if (accumulate)
+        pOut[s] += gain * y;
+      else
+        pOut[s] = y;
+    }
+
+    if (pAllpassState)
+      *pAllpassState = allpassY;
+  }
+
+  /** The per-sample path, while a delay change is crossfading */
+  void ProcessFade(T** inputs, T** outputs, int nFrames, int nChans)
   {
     T* buffer = mBuffer.Get();
+    const uint32_t size = mMask + 1;
 
     for (auto s = 0 ; s < nFrames; ++s)
     {
-      int32_t readAddress = mWriteAddress - mDTSamples;
-      readAddress %= mDTSamples;
+      // the write happens after the read, so a delay of 0 has to read the input directly
+      const uint32_t readAddress = (mWriteAddress - mDTSamples) & mMask;
+      const uint32_t fadeReadAddress = (mWriteAddress - mFadeFromDTSamples) & mMask;
+      const T fadeGain = (T) mFadeRemaining / (T) DELAY_CROSSFADE_SAMPLES;
 
-      for (auto c = 0; c < mNInChans; c++)
+      for (auto c = 0; c < nChans; c++)
       {
-        if (c < mNOutChans)
+        T input = inputs[c][s];
+        const uint32_t offset = c * size;
+        T output = mDTSamples ? buffer[offset + readAddress] : input;
+
+        if (mFadeRemaining)
         {
-          T input = inputs[c][s];
-          const int offset = c * mDTSamples;
-          outputs[c][s] = buffer[offset + readAddress];
-          buffer[offset + mWriteAddress] = input;
+          const T fadeOutput = mFadeFromDTSamples ? buffer[offset + fadeReadAddress] : input;
+          output += fadeGain * (fadeOutput - output);
         }
+
+        buffer[offset + mWriteAddress] = input;
+        outputs[c][s] = output;
       }
 
-      mWriteAddress++;
-      mWriteAddress %= mDTSamples;
+      if (mFadeRemaining)
+        mFadeRemaining--;
+
+      mWriteAddress = (mWriteAddress + 1) & mMask;
     }
   }
 
-private:
   WDL_TypedBuf<T> mBuffer;
-  uint32_t mNInChans, mNOutChans;
+  int mNInChans, mNOutChans;
+  int mMaxDTSamples = 0;
+  std::atomic<int> mPendingDTSamples {0};
+  uint32_t mMask = 0;
   uint32_t mWriteAddress = 0;
   uint32_t mDTSamples = 0;
+  uint32_t mFadeFromDTSamples = 0;
+  int mFadeRemaining = 0;
+  bool mStarted = false;
+  uint32_t mLastWriteAddress = 0; // where the last Write() started, for the taps
+  int mLastWriteFrames = 0;
 } WDL_FIXALIGN;
-
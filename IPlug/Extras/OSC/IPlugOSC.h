@@ -17,12 +17,20 @@
  *
  */
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstring>
 #include <ctime>
 #include <unistd.h>
 #include <functional>
+#include <thread>
+#include <vector>
 
 #include "jnetlib/jnetlib.h"
+#ifndef _WIN32
+#include <sys/select.h>
+#endif
 
 #include "IPlugOSC_msg.h"
 #include "IPlugTimer.h"
@@ -64,6 +72,12 @@ public:
     m_instances.Add(r);
   }
   
+  virtual void removeinst(void *d1)
+  {
+    for (int x = m_instances.GetSize() - 1; x >= 0; x--)
+      if (m_instances.Get()[x].data1 == d1) m_instances.Delete(x);
+  }
+  
   virtual void onMessage(char type, const unsigned char *msg, int len)
   {
     const int n=m_instances.GetSize();
@@ -253,25 +267,324 @@ WDL_PtrList<IODevice > g_devices;
 
 class OSCReciever;
 
+/** OSC packets received by the OSCReceiveThread, waiting to be parsed. A lock-free SPSC queue of fixed size slots, so that the receive thread
+ * doesn't lock or allocate to queue a packet, and the consumer parses each packet where it lies, see OSCInterface::ProcessOSCMessages() */
+class OSCPacketQueue
+{
+public:
+  static constexpr int kMaxPacketSize = 16384;
+  
+  struct Packet
+  {
+    int size;
+    char data[kMaxPacketSize];
+  };
+  
+  /** @param nPackets The number of packets that can wait, rounded up to a power of two */
+  OSCPacketQueue(int nPackets)
+  {
+    size_t capacity = 1;
+    
+    while (capacity < static_cast<size_t>(nPackets))
+      capacity <<= 1;
+    
+    mPackets.resize(capacity);
+  }
+  
+  /** @return The slot to write the next packet into, or nullptr if the queue is full. Producer thread only */
+  Packet* BeginPush()
+  {
+    const size_t writeIdx = mWriteIdx.load(std::memory_order_relaxed);
+    
+    if (writeIdx - mReadIdx.load(std::memory_order_acquire) >= mPackets.size())
+      return nullptr;
+    
+    return &mPackets[writeIdx & (mPackets.size() - 1)];
+  }
+  
+  /** Publish the packet written into the slot returned by BeginPush(). Producer thread only */
+  void EndPush() { mWriteIdx.store(mWriteIdx.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+  
+  /** @return The oldest packet, or nullptr if the queue is empty. Consumer thread only */
+  Packet* Front()
+  {
+    const size_t readIdx = mReadIdx.load(std::memory_order_relaxed);
+    
+    if (readIdx == mWriteIdx.load(std::memory_order_acquire))
+      return nullptr;
+    
+    return &mPackets[readIdx & (mPackets.size() - 1)];
+  }
+  
+  /** Release the packet returned by Front(). Consumer thread only */
+  void Pop() { mReadIdx.store(mReadIdx.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+  
+private:
+  std::vector<Packet> mPackets;
+  std::atomic<size_t> mWriteIdx {0};
+  std::atomic<size_t> mReadIdx {0};
+};
+
+/** The thread that receives OSC for all of the OSCReciever objects in the process. It blocks in select() on the sockets of the listening devices, so a packet is queued
+ * as soon as it arrives, and no CPU is spent while nothing does. It runs while there are receivers, see Retain() */
+class OSCReceiveThread
+{
+public:
+  static OSCReceiveThread& Get()
+  {
+    static OSCReceiveThread sThread;
+    return sThread;
+  }
+  
+  /** Held while changing the devices or their instances, since the thread calls them */
+  WDL_Mutex& GetMutex() { return mMutex; }
+  
+  /** Start receiving on a device, if it isn't already. Call with GetMutex() held */
+  void AddDevice(OSCDevice* pDevice)
+  {
+    if (mDevices.Find(pDevice) < 0)
+      mDevices.Add(pDevice);
+    
+    Wake();
+  }
+  
+  /** Start the thread for the first receiver */
+  void Retain()
+  {
+    if (mNReceivers++ == 0)
+      Start();
+  }
+  
+  /** Stop the thread after the last receiver */
+  void Release()
+  {
+    if (--mNReceivers == 0)
+      Stop();
+  }
+  
+private:
+  OSCReceiveThread() {}
+  ~OSCReceiveThread() { Stop(); }
+  
+  void Start()
+  {
+    // a socket the thread also waits on, so that it can be woken to see new devices or to stop
+    mWakeSocket = socket(AF_INET, SOCK_DGRAM, 0);
+    
+    if (mWakeSocket == INVALID_SOCKET)
+      return;
+    
+    memset(&mWakeAddr, 0, sizeof(mWakeAddr));
+    mWakeAddr.sin_family = AF_INET;
+    mWakeAddr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    mWakeAddr.sin_port = 0;
+    socklen_t addrLen = (socklen_t) sizeof(mWakeAddr);
+    
+    if (bind(mWakeSocket, (struct sockaddr*) &mWakeAddr, sizeof(mWakeAddr)) || getsockname(mWakeSocket, (struct sockaddr*) &mWakeAddr, &addrLen))
+    {
+      closesocket(mWakeSocket);
+      mWakeSocket = INVALID_SOCKET;
+      return;
+    }
+    
+    SET_SOCK_BLOCK(mWakeSocket, false);
+    mRunning = true;
+    mThread = std::thread(&OSCReceiveThread::Run, this);
+  }
+  
+  void Stop()
+  {
+    if (mThread.joinable())
+    {
+      mRunning = false;
+      Wake();
+      mThread.join();
+    }
+    
+    if (mWakeSocket != INVALID_SOCKET)
+    {
+      closesocket(mWakeSocket);
+      mWakeSocket = INVALID_SOCKET;
+    }
+  }
+  
+  void Wake()
+  {
+    if (mWakeSocket != INVALID_SOCKET)
+      sendto(mWakeSocket, "w", 1, 0, (struct sockaddr*) &mWakeAddr, sizeof(mWakeAddr));
+  }
+  
+  void Run()
+  {
+    WDL_FastString results;
+    
+    while (mRunning)
+    {
+      fd_set readSet;
+      FD_ZERO(&readSet);
+      FD_SET(mWakeSocket, &readSet);
+      SOCKET maxSocket = mWakeSocket;
+      
+      {
+        WDL_MutexLock lock(&mMutex);
+        
+        for (auto i = 0; i < mDevices.GetSize(); i++)
+        {
+          const SOCKET s = mDevices.Get(i)->m_sendsock;
+          
+          if (s != INVALID_SOCKET)
+          {
+            FD_SET(s, &readSet);
+            maxSocket = std::max(maxSocket, s);
+          }
+        }
+      }
+      
+      if (select((int) maxSocket + 1, &readSet, nullptr, nullptr, nullptr) < 1)
+        continue;
+      
+      if (FD_ISSET(mWakeSocket, &readSet))
+      {
+        char buf[16];
+        while (recv(mWakeSocket, buf, sizeof(buf), 0) > 0) {}
+      }
+      
+      WDL_MutexLock lock(&mMutex);
+      
+      for (auto i = 0; i < mDevices.GetSize(); i++)
+      {
+        OSCDevice* pDevice = mDevices.Get(i);
+        
+        if (pDevice->m_sendsock != INVALID_SOCKET && FD_ISSET(pDevice->m_sendsock, &readSet))
+          pDevice->run_input(results); // reads until the socket would block, calling the instances' callbacks
+      }
+    }
+  }
+  
+  WDL_Mutex mMutex;
+  WDL_PtrList<OSCDevice> mDevices; // non-owned, the devices live in g_devices
+  std::thread mThread;
+  std::atomic<bool> mRunning {false};
+  SOCKET mWakeSocket = INVALID_SOCKET;
+  struct sockaddr_in mWakeAddr;
+  int mNReceivers = 0;
+};
+
+/** The base of OSCSender and OSCReciever. Received packets are queued by the OSCReceiveThread, and parsed into OnOSCMessage() calls by ProcessOSCMessages(),
+ * on the UI thread by the timer, or wherever the plug-in calls it, e.g. in ProcessBlock() for control at the audio thread's timing.
+ * Each message is also passed, as an OscMessageView that points into the packet, to the handlers added to GetDispatcher() and to OnOSCMessageView().
+ * When ProcessOSCMessages() is given the block's size and sample rate, the bundles are scheduled by their timetags: a bundle due in a later block waits for it,
+ * and the offset of the sample that each message is due at is passed to the handlers.
+ * The timer also sends the queued output of an OSCSender */
 class OSCInterface
 {
 public:
-  OSCInterface(int updateRateMs = 100)
+  /** @param updateRateMs The interval of the timer, which sends the queued output and calls ProcessOSCMessages() unless SetProcessOnTimer(false) is called
+   * @param nPackets The number of received packets that can wait to be processed, later ones are dropped
+   * @param nScheduledPackets The number of bundles that can wait for their timetags, see ProcessOSCMessages(int, double). Later ones are handled when they arrive */
+  OSCInterface(int updateRateMs = 100, int nPackets = 32, int nScheduledPackets = 8)
+  : mPackets(nPackets)
+  , mScheduled(nScheduledPackets)
   {
     JNL::open_socketlib();
     
-    if(mTimer == nullptr)
-      mTimer = Timer::Create(std::bind(&OSCInterface::OnTimer, this, std::placeholders::_1), updateRateMs);
+    mTimer = Timer::Create(std::bind(&OSCInterface::OnTimer, this, std::placeholders::_1), updateRateMs);
   }
   
   virtual ~OSCInterface()
   {
     if(mTimer != nullptr)
-      delete mTimer;
+      mTimer->Stop();
     
     mTimer = nullptr;
+    
+    // the receive thread may be calling the devices
+    {
+      WDL_MutexLock lock(&OSCReceiveThread::Get().GetMutex());
+      
+      for (auto x = 0; x < m_devs.GetSize(); x++)
+        m_devs.Get(x)->removeinst(this);
+    }
+    
+    if (mReceiving)
+      OSCReceiveThread::Get().Release();
+  }
+  
+  /** Parse the received packets into OnOSCMessage() calls. This doesn't lock or allocate, so it can be called on the audio thread, if OnOSCMessage() doesn't either.
+   * One thread only, and not at the same time as the timer unless SetProcessOnTimer(false) has been called
+   * @param maxPackets The most packets to process, or -1 for all of them
+   * @return The number of packets processed */
+  int ProcessOSCMessages(int maxPackets = -1)
+  {
+    int nPackets = 0;
+    
+    while (maxPackets < 0 || nPackets < maxPackets)
+    {
+      OSCPacketQueue::Packet* pPacket = mPackets.Front();
+      
+      if (!pPacket)
+        break;
+      
+      ParsePacket(pPacket->data, pPacket->size);
+      mPackets.Pop();
+      nPackets++;
+    }
+    
+    return nPackets;
+  }
+  
+  /** Parse the received packets into calls to the handlers added to GetDispatcher() and to OnOSCMessageView(), at the offsets into the block that their bundles' timetags
+   * are due at. The timetags are compared with the system clock when this is called, at the start of the block, so they are as precise as the host's timing of the blocks.
+   * A bundle due after the block is kept until a later call, and one that is late, or a message not in a bundle, is handled at offset 0.
+   * This doesn't lock or allocate, so call it at the start of ProcessBlock(), after SetProcessOnTimer(false). OnOSCMessage() isn't called
+   * @param nFrames The number of frames in the block
+   * @param sampleRate The sample rate
+   * @return The number of messages handled */
+  int ProcessOSCMessages(int nFrames, double sampleRate)
+  {
+    const uint64_t now = GetNTPTime();
+    const uint64_t blockEnd = now + static_cast<uint64_t>(nFrames / sampleRate * 4294967296.);
+    int nMessages = 0;
+    
+    for (ScheduledPacket& scheduled : mScheduled)
+    {
+      if (scheduled.timetag && scheduled.timetag < blockEnd)
+      {
+        nMessages += DispatchPacket(scheduled.packet.data, scheduled.packet.size, now, nFrames, sampleRate);
+        scheduled.timetag = 0;
+      }
+    }
+    
+    while (OSCPacketQueue::Packet* pPacket = mPackets.Front())
+    {
+      const uint64_t timetag = OscMessageView::GetTimetag(pPacket->data, pPacket->size);
+      
+      if (timetag < blockEnd || !Schedule(*pPacket, timetag))
+        nMessages += DispatchPacket(pPacket->data, pPacket->size, now, nFrames, sampleRate);
+      
+      mPackets.Pop();
+    }
+    
+    return nMessages;
+  }
+  
+  /** @return The current time of the system clock as an OSC timetag, the seconds since 1900 in the upper 32 bits and the fraction in the lower 32 */
+  static uint64_t GetNTPTime()
+  {
+    const uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    const uint64_t seconds = us / 1000000 + 2208988800ull; // from 1970 to 1900
+    return (seconds << 32) | (((us % 1000000) << 32) / 1000000);
   }
   
+  /** @return The dispatcher whose handlers are called with each message. Add the addresses before the messages are processed */
+  OscAddressDispatcher& GetDispatcher() { return mDispatcher; }
+  
+  /** @param processOnTimer \c false to stop the timer calling ProcessOSCMessages(), so that the plug-in can call it, e.g. in ProcessBlock() */
+  void SetProcessOnTimer(bool processOnTimer) { mProcessOnTimer = processOnTimer; }
+  
+  /** @return The number of packets dropped because the queue was full or they were too big */
+  uint32_t GetNDroppedPackets() const { return mNDroppedPackets.load(std::memory_order_relaxed); }
+  
   static void MessageCallback(void *d1, int dev_idx, char type, int msglen, void *msg);
   
   void CreateReciever(WDL_String& results, int port = 8000)
@@ -323,11 +636,22 @@ public:
     
     if (r)
     {
+      OSCReceiveThread& receiveThread = OSCReceiveThread::Get();
+      WDL_MutexLock lock(&receiveThread.GetMutex());
+      
       r->addinst(MessageCallback, this, m_devs.GetSize());
       m_devs.Add(r);
       
       if (!is_reuse)
         g_devices.Add(r);
+      
+      receiveThread.AddDevice(r);
+    }
+    
+    if (r && !mReceiving)
+    {
+      mReceiving = true;
+      OSCReceiveThread::Get().Retain();
     }
   }
   
@@ -366,6 +690,8 @@ public:
     
     if (r)
     {
+      WDL_MutexLock lock(&OSCReceiveThread::Get().GetMutex());
+      
       r->addinst(MessageCallback, this, m_devs.GetSize());
       m_devs.Add(r);
       
@@ -380,89 +706,115 @@ public:
     g_devices.Get(0)->oscSend(msg, len); // TODO: device 0?
   }
   
-  struct incomingEvent
+  virtual void OnOSCMessage(OscMessageRead& msg) {};
+  
+  /** Called with each message after the dispatcher's handlers, on the thread that calls ProcessOSCMessages()
+   * @param msg A view of the message, valid for the duration of the call
+   * @param sampleOffset The offset into the block that the message is due at, 0 when it is processed by the timer or isn't scheduled */
+  virtual void OnOSCMessageView(const OscMessageView& msg, int sampleOffset) {};
+  
+private:
+  struct ScheduledPacket
   {
-    IODevice* dev_ptr;
-    int sz; // size of msg[], 1..3 for midi, anything for OSC
-    char type; // 0=midi, 1=OSC
-    unsigned char msg[3];
+    uint64_t timetag = 0; // 0 if the slot is free
+    OSCPacketQueue::Packet packet;
   };
   
-  virtual void OnOSCMessage(OscMessageRead& msg) {};
+  /** Copy a bundle into a free slot to wait for its timetag
+   * @return \c false if there is no free slot */
+  bool Schedule(const OSCPacketQueue::Packet& packet, uint64_t timetag)
+  {
+    for (ScheduledPacket& scheduled : mScheduled)
+    {
+      if (!scheduled.timetag)
+      {
+        memcpy(scheduled.packet.data, packet.data, packet.size);
+        scheduled.packet.size = packet.size;
+        scheduled.timetag = timetag;
+        return true;
+      }
+    }
+    
+    return false;
+  }
   
-private:
+  /** Pass each message in a packet to the dispatcher and OnOSCMessageView(), at the offset its bundle's timetag is due at
+   * @return The number of messages */
+  int DispatchPacket(const char* data, int size, uint64_t now, int nFrames, double sampleRate)
+  {
+    return OscMessageView::ForEachMessage(data, size, [&](const OscMessageView& msg, uint64_t timetag) {
+      int offset = 0;
+      
+      if (timetag > now)
+        offset = std::max(0, std::min(static_cast<int>((timetag - now) / 4294967296. * sampleRate), nFrames - 1));
+      
+      mDispatcher.Dispatch(msg, offset);
+      OnOSCMessageView(msg, offset);
+    });
+  }
+  
+
   void OnTimer(Timer& timer)
   {
     if(mInputProc)
       mInputProc();
     
-    if (m_incoming_events.GetSize())
+    if(mProcessOnTimer)
+      ProcessOSCMessages();
+    
+    if(mOutputProc)
+      mOutputProc();
+  }
+  
+  /** Call the dispatcher, OnOSCMessageView() and OnOSCMessage() for each message in a packet, a message or a bundle of them, ignoring the timetags.
+   * The views are dispatched first, since OnOSCMessage() is given messages parsed in place */
+  void ParsePacket(char* data, int size)
+  {
+    DispatchPacket(data, size, UINT64_MAX, 1, 0.);
+    
+    int rd_pos = 0;
+    int rd_sz = size;
+    if (size > 20 && !strcmp(data, "#bundle"))
     {
-      static WDL_HeapBuf tmp;
-      
-      m_incoming_events_mutex.Enter();
-      tmp.CopyFrom(&m_incoming_events,false);
-      m_incoming_events.Resize(0,false);
-      m_incoming_events_mutex.Leave();
+      rd_sz = *(int *)(data+16);
+      OSC_MAKEINTMEM4BE(&rd_sz);
+      rd_pos += 20;
+    }
+    
+    while (rd_pos + rd_sz <= size && rd_sz>=0)
+    {
+      OscMessageRead rmsg(data + rd_pos, rd_sz);
       
-      int pos=0;
-      const int endpos = tmp.GetSize();
-      while (pos < endpos+1 - sizeof(incomingEvent))
+      const char *mstr = rmsg.GetMessage();
+      if (mstr && *mstr)
       {
-        incomingEvent *evt = (incomingEvent*) ((char *)tmp.Get()+pos);
-        
-        const int this_sz = ((sizeof(incomingEvent) + (evt->sz-3)) + 7) & ~7;
-        
-        if (pos+this_sz > endpos) break;
-        pos += this_sz;
-        
-        int rd_pos = 0;
-        int rd_sz = evt->sz;
-        if (evt->sz > 20 && !strcmp((char*)evt->msg, "#bundle"))
-        {
-          rd_sz = *(int *)(evt->msg+16);
-          OSC_MAKEINTMEM4BE(&rd_sz);
-          rd_pos += 20;
-        }
-        //        if (m_var_msgs[3]) m_var_msgs[3][0] = evt->dev_ptr ? *evt->dev_ptr : -1.0;
-        
-        while (rd_pos + rd_sz <= evt->sz && rd_sz>=0)
-        {
-          OscMessageRead rmsg((char*)evt->msg + rd_pos, rd_sz);
-          
-          const char *mstr = rmsg.GetMessage();
-          if (mstr && *mstr)
-          {
-            OnOSCMessage(rmsg);
-          }
-          
-          rd_pos += rd_sz+4;
-          if (rd_pos >= evt->sz) break;
-          
-          rd_sz = *(int *)(evt->msg+rd_pos-4);
-          OSC_MAKEINTMEM4BE(&rd_sz);
-        }
+        OnOSCMessage(rmsg);
       }
+      
+      rd_pos += rd_sz+4;
+      if (rd_pos >= size) break;
+      
+      rd_sz = *(int *)(data+rd_pos-4);
+      OSC_MAKEINTMEM4BE(&rd_sz);
     }
-    
-    if(mOutputProc)
-      mOutputProc();
   }
   
   // these are non-owned refs
   WDL_PtrList<IODevice> m_devs;
 protected:
-  static Timer* mTimer;
+  Timer* mTimer = nullptr;
   WDL_FastString results;
   std::function<void()> mInputProc = nullptr;
   std::function<void()> mOutputProc = nullptr;
-  WDL_HeapBuf m_incoming_events;  // incomingEvent list, each is 8-byte aligned
-  WDL_Mutex m_incoming_events_mutex;
+  OSCPacketQueue mPackets; // filled by the receive thread
+  std::vector<ScheduledPacket> mScheduled; // bundles waiting for their timetags
+  OscAddressDispatcher mDispatcher;
+  std::atomic<uint32_t> mNDroppedPackets {0};
+  bool mProcessOnTimer = true;
+  bool mReceiving = false;
   static const int DEVICE_INDEX_BASE = 0x400000;
 };
 
-Timer* OSCInterface::mTimer = nullptr;
-
 class OSCSender : public OSCInterface
 {
 public:
@@ -494,24 +846,8 @@ public:
     WDL_String str;
     CreateReciever(str, port);
     DBGMSG("%s\n", str.Get());
-    
-    mInputProc = [&]()
-    {
-      //      const int sizeOfData = results.GetLength();
-      
-      for (auto x = 0; x < g_devices.GetSize(); x++)
-        g_devices.Get(x)->run_input(results);
-      
-      //      if (results.GetLength() != sizeOfData) // if some input device added results
-      //      {
-      //        OscMessageRead msg{mReadBuf, sizeOfData};
-      //        OnOSCMessage(msg);
-      //      }
-    };
   }
   
-  virtual void OnOSCMessage(OscMessageRead& msg) = 0;
-  
 private:
   const char* mTest = "TEST";
   char mReadBuf[MAX_OSC_MSG_LEN] = {};
@@ -522,26 +858,18 @@ void OSCInterface::MessageCallback(void *d1, int dev_idx, char type, int len, vo
 {
   OSCInterface* _this  = (OSCInterface *) d1;
   
+  // called on the receive thread
   if (_this && msg)
   {
-    if (_this->m_incoming_events.GetSize() < 65536*8)
+    OSCPacketQueue::Packet* pPacket = len <= OSCPacketQueue::kMaxPacketSize ? _this->mPackets.BeginPush() : nullptr;
+    
+    if (pPacket)
     {
-      const int this_sz = ((sizeof(incomingEvent) + (len-3)) + 7) & ~7;
-      
-      _this->m_incoming_events_mutex.Enter();
-      const int oldsz = _this->m_incoming_events.GetSize();
-      _this->m_incoming_events.Resize(oldsz + this_sz,false);
-      
-      if (_this->m_incoming_events.GetSize() == oldsz+this_sz)
-      {
-        incomingEvent *item=(incomingEvent *) ((char *)_this->m_incoming_events.Get() + oldsz);
-        item->dev_ptr = _this->m_devs.Get(dev_idx);
-        item->sz = len;
-        item->type = type;
-        memcpy(item->msg,msg,len);
-      }
-      _this->m_incoming_events_mutex.Leave();
+      memcpy(pPacket->data, msg, len);
+      pPacket->size = len;
+      _this->mPackets.EndPush();
     }
+    else
+      _this->mNDroppedPackets.fetch_add(1, std::memory_order_relaxed);
   }
 }
-
@@ -383,3 +383,269 @@ void OscMessageWrite::DebugDump(const char* label, char* dump, int dumplen)
     rmsg.DebugDump(label, dump, dumplen);    
   }
 }
+
+// the size of an argument of a type, or -1 if the type is unknown or the argument doesn't fit
+static int OscArgSize(char type, const char* p, const char* end)
+{
+  switch (type)
+  {
+    case 'i': case 'f': case 'c': case 'r': case 'm': return 4;
+    case 'h': case 't': case 'd': return 8;
+    case 'T': case 'F': case 'N': case 'I': return 0;
+    case 's': case 'S':
+    {
+      const int len = _strlen(p, (int) (end - p));
+      return p + len < end ? pad4(len) : -1;
+    }
+    case 'b':
+    {
+      if (end - p < 4) return -1;
+      const int32_t size = (int32_t) OscMessageView::ReadUInt32(p);
+      return size >= 0 ? 4 + ((size + 3) & ~3) : -1;
+    }
+    default: return -1;
+  }
+}
+
+bool OscMessageView::Parse(const char* data, int size)
+{
+  mAddress = nullptr;
+  mTypes = nullptr;
+  mNArgs = 0;
+
+  if (!data || size < 4 || *data != '/') return false;
+
+  const char* end = data + size;
+  const int addressLen = _strlen(data, size);
+  if (addressLen == size) return false;
+
+  const char* p = data + pad4(addressLen);
+
+  // a message without a type tag string has no arguments, as in the older implementations
+  if (p < end && *p == ',')
+  {
+    const int typesLen = _strlen(p, (int) (end - p));
+    if (p + typesLen == end || typesLen - 1 > kMaxArgs) return false;
+
+    const char* types = p + 1;
+    const char* arg = p + pad4(typesLen);
+
+    for (int i = 0; i < typesLen - 1; i++)
+    {
+      const int argSize = arg <= end ? OscArgSize(types[i], arg, end) : -1;
+      if (argSize < 0 || argSize > end - arg) return false;
+
+      mArgs[i] = arg;
+      arg += argSize;
+    }
+
+    mTypes = types;
+    mNArgs = typesLen - 1;
+  }
+
+  mAddress = data;
+  return true;
+}
+
+bool OscMessageView::GetInt(int idx, int32_t& value) const
+{
+  const char* p = GetArg(idx, 'i');
+  if (!p) return false;
+  value = (int32_t) ReadUInt32(p);
+  return true;
+}
+
+bool OscMessageView::GetFloat(int idx, float& value) const
+{
+  const char* p = GetArg(idx, 'f');
+  if (!p) return false;
+  const uint32_t bits = ReadUInt32(p);
+  memcpy(&value, &bits, sizeof(value));
+  return true;
+}
+
+bool OscMessageView::GetString(int idx, const char*& value) const
+{
+  const char type = GetType(idx);
+  if (type != 's' && type != 'S') return false;
+  value = mArgs[idx];
+  return true;
+}
+
+bool OscMessageView::GetBlob(int idx, const void*& pData, int& size) const
+{
+  const char* p = GetArg(idx, 'b');
+  if (!p) return false;
+  size = (int) ReadUInt32(p);
+  pData = p + 4;
+  return true;
+}
+
+bool OscMessageView::GetInt64(int idx, int64_t& value) const
+{
+  const char type = GetType(idx);
+  if (type != 'h' && type != 't') return false;
+  value = (int64_t) ReadUInt64(mArgs[idx]);
+  return true;
+}
+
+bool OscMessageView::GetDouble(int idx, double& value) const
+{
+  const char* p = GetArg(idx, 'd');
+  if (!p) return false;
+  const uint64_t bits = ReadUInt64(p);
+  memcpy(&value, &bits, sizeof(value));
+  return true;
+}
+
+double OscMessageView::GetNumber(int idx, double defaultValue) const
+{
+  switch (GetType(idx))
+  {
+    case 'i': case 'c': return (double) (int32_t) ReadUInt32(mArgs[idx]);
+    case 'h': return (double) (int64_t) ReadUInt64(mArgs[idx]);
+    case 'f': { float f; GetFloat(idx, f); return f; }
+    case 'd': { double d; GetDouble(idx, d); return d; }
+    case 'T': return 1.;
+    case 'F': case 'N': return 0.;
+    default: return defaultValue;
+  }
+}
+
+void OscAddressDispatcher::Add(const char* address, Handler handler)
+{
+  Entry entry { Hash(address), address, std::move(handler) };
+
+  if (IsPattern(address))
+  {
+    mPatterns.push_back(std::move(entry));
+    return;
+  }
+
+  auto it = mAddresses.begin();
+  while (it != mAddresses.end() && it->hash <= entry.hash) ++it;
+  mAddresses.insert(it, std::move(entry));
+}
+
+int OscAddressDispatcher::Dispatch(const OscMessageView& msg, int sampleOffset) const
+{
+  const char* address = msg.GetAddress();
+  if (!address) return 0;
+
+  int nCalled = 0;
+
+  if (IsPattern(address))
+  {
+    for (const Entry& entry : mAddresses)
+    {
+      if (Match(address, entry.address.c_str()))
+      {
+        entry.handler(msg, sampleOffset);
+        nCalled++;
+      }
+    }
+
+    return nCalled;
+  }
+
+  const uint32_t hash = Hash(address);
+  int lo = 0, hi = (int) mAddresses.size();
+
+  while (lo < hi)
+  {
+    const int mid = (lo + hi) / 2;
+    if (mAddresses[mid].hash < hash) lo = mid + 1;
+    else hi = mid;
+  }
+
+  // the string is only compared to confirm a hash that matches
+  for (int i = lo; i < (int) mAddresses.size() && mAddresses[i].hash == hash; i++)
+  {
+    if (mAddresses[i].address == address)
+    {
+      mAddresses[i].handler(msg, sampleOffset);
+      nCalled++;
+    }
+  }
+
+  for (const Entry& entry : mPatterns)
+  {
+    if (Match(entry.address.c_str(), address))
+    {
+      entry.handler(msg, sampleOffset);
+      nCalled++;
+    }
+  }
+
+  return nCalled;
+}
+
+bool OscAddressDispatcher::Match(const char* pattern, const char* address)
+{
+  while (*pattern)
+  {
+    switch (*pattern)
+    {
+      case '?':
+        if (!*address || *address == '/') return false;
+        ++pattern;
+        ++address;
+        break;
+      case '*':
+        while (*pattern == '*') ++pattern;
+        for (;;)
+        {
+          if (Match(pattern, address)) return true;
+          if (!*address || *address == '/') return false;
+          ++address;
+        }
+      case '[':
+      {
+        if (!*address || *address == '/') return false;
+        ++pattern;
+        const bool negate = *pattern == '!';
+        if (negate) ++pattern;
+        bool found = false;
+        while (*pattern && *pattern != ']')
+        {
+          if (pattern[1] == '-' && pattern[2] && pattern[2] != ']')
+          {
+            if (*address >= pattern[0] && *address <= pattern[2]) found = true;
+            pattern += 3;
+          }
+          else
+          {
+            if (*address == *pattern) found = true;
+            ++pattern;
+          }
+        }
+        if (*pattern != ']' || found == negate) return false;
+        ++pattern;
+        ++address;
+        break;
+      }
+      case '{':
+      {
+        const char* close = strchr(pattern, '}');
+        if (!close) return false;
+        const char* alt = pattern + 1;
+        while (alt <= close)
+        {
+          const char* altEnd = alt;
+          while (altEnd < close && *altEnd != ',') ++altEnd;
+          const size_t len = altEnd - alt;
+          if (!strncmp(alt, address, len) && Match(close + 1, address + len)) return true;
+          alt = altEnd + 1;
+        }
+        return false;
+      }
+      default:
+        if (*pattern != *address) return false;
+        ++pattern;
+        ++address;
+        break;
+    }
+  }
+
+  return !*address;
+}
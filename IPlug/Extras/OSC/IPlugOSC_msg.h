@@ -17,6 +17,12 @@
  *
  */
 
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
 #define MAX_OSC_MSG_LEN 1024
 
 static void OSC_BSWAPINTMEM(void *buf)
@@ -71,3 +77,200 @@ private:
   bool m_msgok;
 };
 
+
+/** A read-only view of an OSC message in a receive buffer, parsed without copying, allocating or writing over the buffer, unlike OscMessageRead.
+ * Parse() finds where each argument lies, and the accessors decode the big endian values as they are read. The buffer must outlive the view.
+ * The types of OSC 1.0 are supported: i f s S b h t d c r m T F N I */
+class OscMessageView
+{
+public:
+  /** The most arguments a message can have. Messages with more fail to parse */
+  static constexpr int kMaxArgs = 32;
+  /** The timetag of a bundle whose messages are to be handled as soon as they arrive */
+  static constexpr uint64_t kTimetagImmediately = 1;
+
+  OscMessageView() = default;
+
+  /** Parse a message
+   * @param data The message, which starts with its address, e.g. \c "/synth/cutoff"
+   * @param size The size of the message in bytes
+   * @return \c true if the message is valid */
+  bool Parse(const char* data, int size);
+
+  /** @return \c true if the last Parse() succeeded */
+  bool IsValid() const { return mAddress != nullptr; }
+
+  /** @return The address, a null terminated string in the buffer */
+  const char* GetAddress() const { return mAddress; }
+
+  /** @return The number of arguments */
+  int GetNArgs() const { return mNArgs; }
+
+  /** @param idx The index of an argument
+   * @return The type tag of the argument, e.g. \c 'f', or 0 if there is no argument at the index */
+  char GetType(int idx) const { return idx >= 0 && idx < mNArgs ? mTypes[idx] : 0; }
+
+  /** @param idx The index of an \c 'i' argument
+   * @param value Set to the value, if the argument is an int
+   * @return \c true if it is */
+  bool GetInt(int idx, int32_t& value) const;
+
+  /** @param idx The index of an \c 'f' argument
+   * @param value Set to the value, if the argument is a float
+   * @return \c true if it is */
+  bool GetFloat(int idx, float& value) const;
+
+  /** @param idx The index of an \c 's' or \c 'S' argument
+   * @param value Set to the null terminated string in the buffer, if the argument is a string
+   * @return \c true if it is */
+  bool GetString(int idx, const char*& value) const;
+
+  /** @param idx The index of a \c 'b' argument
+   * @param pData Set to the bytes in the buffer, if the argument is a blob
+   * @param size Set to the number of bytes
+   * @return \c true if it is */
+  bool GetBlob(int idx, const void*& pData, int& size) const;
+
+  /** @param idx The index of an \c 'h' or \c 't' argument
+   * @param value Set to the value, if the argument is a 64 bit int or a timetag
+   * @return \c true if it is */
+  bool GetInt64(int idx, int64_t& value) const;
+
+  /** @param idx The index of a \c 'd' argument
+   * @param value Set to the value, if the argument is a double
+   * @return \c true if it is */
+  bool GetDouble(int idx, double& value) const;
+
+  /** Read any numeric argument as a double, the way most controllers' values are wanted, whether they are sent as ints or floats
+   * @param idx The index of an \c 'i' \c 'f' \c 'h' \c 'd' \c 'c' \c 'T' \c 'F' or \c 'N' argument
+   * @param defaultValue Returned if there is no numeric argument at the index
+   * @return The value */
+  double GetNumber(int idx, double defaultValue = 0.) const;
+
+  /** Call a function for each message in a packet, which is a message or a bundle of messages and bundles. Nothing is copied
+   * @param data The packet
+   * @param size The size of the packet in bytes
+   * @param func Called with each valid message and the timetag of the bundle that contains it, or kTimetagImmediately for a message that isn't in a bundle.
+   * The timetag is an NTP time, the seconds since 1900 in the upper 32 bits and the fraction in the lower 32
+   * @param timetag The timetag of the enclosing bundle, used for a packet that is a message
+   * @param depth The depth of nested bundles, which is limited
+   * @return The number of messages */
+  template <typename FUNC>
+  static int ForEachMessage(const char* data, int size, FUNC&& func, uint64_t timetag = kTimetagImmediately, int depth = 0)
+  {
+    if (size < 8 || (size & 3))
+      return 0;
+
+    if (!IsBundle(data, size))
+    {
+      OscMessageView msg;
+
+      if (!msg.Parse(data, size))
+        return 0;
+
+      func(msg, timetag);
+      return 1;
+    }
+
+    if (depth >= 8)
+      return 0;
+
+    const uint64_t bundleTimetag = ReadUInt64(data + 8);
+    int nMessages = 0;
+    int pos = 16;
+
+    while (pos + 4 <= size)
+    {
+      const int32_t elementSize = static_cast<int32_t>(ReadUInt32(data + pos));
+      pos += 4;
+
+      if (elementSize < 0 || elementSize > size - pos)
+        break;
+
+      nMessages += ForEachMessage(data + pos, elementSize, func, bundleTimetag, depth + 1);
+      pos += elementSize;
+    }
+
+    return nMessages;
+  }
+
+  /** @return \c true if a packet is a bundle, which starts with \c "#bundle" and a timetag */
+  static bool IsBundle(const char* data, int size) { return size >= 16 && !memcmp(data, "#bundle", 8); }
+
+  /** @return The timetag of a bundle, or kTimetagImmediately if the packet is a message */
+  static uint64_t GetTimetag(const char* data, int size) { return IsBundle(data, size) ? ReadUInt64(data + 8) : kTimetagImmediately; }
+
+  static uint32_t ReadUInt32(const char* p)
+  {
+    const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+    return (uint32_t(u[0]) << 24) | (uint32_t(u[1]) << 16) | (uint32_t(u[2]) << 8) | uint32_t(u[3]);
+  }
+
+  static uint64_t ReadUInt64(const char* p) { return (uint64_t(ReadUInt32(p)) << 32) | ReadUInt32(p + 4); }
+
+private:
+  const char* GetArg(int idx, char type) const { return GetType(idx) == type ? mArgs[idx] : nullptr; }
+
+  const char* mAddress = nullptr;
+  const char* mTypes = nullptr; // after the comma
+  const char* mArgs[kMaxArgs] = {};
+  int mNArgs = 0;
+};
+
+/** Maps OSC addresses to handlers, and calls the handlers that match each message. The addresses are added once, before messages are dispatched, and hashed,
+ * so that a message with a plain address costs a hash and a binary search rather than a chain of string compares, however many addresses there are.
+ * Messages whose address is an OSC pattern, e.g. \c "/voice/[1-4]/gate", are matched against every address added, as are added patterns, e.g. \c "/track/[0-9]/gain",
+ * which suit addresses that a controller makes at run time */
+class OscAddressDispatcher
+{
+public:
+  /** Called with a message and the offset into the block that it is due at, 0 when it isn't scheduled */
+  using Handler = std::function<void(const OscMessageView& msg, int sampleOffset)>;
+
+  /** Add an address or pattern. This allocates, so call it before the messages are dispatched, not while they are
+   * @param address An address, or an OSC pattern using \c ? \c * \c [] or \c {}
+   * @param handler Called with each message that matches */
+  void Add(const char* address, Handler handler);
+
+  /** Remove all of the addresses */
+  void Clear() { mAddresses.clear(); mPatterns.clear(); }
+
+  /** @return \c true if no address has been added */
+  bool Empty() const { return mAddresses.empty() && mPatterns.empty(); }
+
+  /** Call the handlers that match a message. This doesn't lock or allocate, unless the handlers do
+   * @param msg The message
+   * @param sampleOffset The offset to pass to the handlers
+   * @return The number of handlers called */
+  int Dispatch(const OscMessageView& msg, int sampleOffset = 0) const;
+
+  /** Match an address against an OSC 1.0 pattern. \c ? matches any character but \c / and \c * any run of them, \c [a-z] and \c [!a-z] a character in or out of a set,
+   * and \c {foo,bar} any of the strings
+   * @return \c true if the address matches */
+  static bool Match(const char* pattern, const char* address);
+
+  /** @return \c true if an address has any of the pattern characters */
+  static bool IsPattern(const char* address) { return strpbrk(address, "?*[]{}") != nullptr; }
+
+  /** @return The FNV-1a hash of a string */
+  static uint32_t Hash(const char* str)
+  {
+    uint32_t hash = 2166136261u;
+
+    while (*str)
+      hash = (hash ^ static_cast<unsigned char>(*str++)) * 16777619u;
+
+    return hash;
+  }
+
+private:
+  struct Entry
+  {
+    uint32_t hash;
+    std::string address;
+    Handler handler;
+  };
+
+  std::vector<Entry> mAddresses; // sorted by hash
+  std::vector<Entry> mPatterns;
+};
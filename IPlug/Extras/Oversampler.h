@@ -12,11 +12,16 @@
 
 #define OVERSAMPLING_FACTORS_VA_LIST "None", "2x", "4x", "8x", "16x"
 
+#include <algorithm>
+#include <atomic>
 #include <functional>
 #include <cmath>
+#include <cstring>
 
 #include "HIIR/FPUUpsampler2x.h"
 #include "HIIR/FPUDownsampler2x.h"
+#include "HIIR/Multi2x.h"
+#include "HalfBandFIR.h"
 //#include "HIIR/PolyphaseIIR2Designer.h"
 
 #include "heapbuf.h"
@@ -34,75 +39,123 @@ enum EFactor
   kNumFactors
 };
 
+/** The filters OverSampler uses for its 2x stages */
+enum EOverSamplerFilter
+{
+  kPolyphaseIIR = 0, // hiir's polyphase all-pass stages: cheap, with little latency, but not phase linear
+  kLinearPhaseFIR, // half-band FIR stages: phase linear, at the cost of more CPU and the latency reported by OverSampler::GetLatency()
+  kNumOverSamplerFilters
+};
+
+/** The polyphase IIR coefficients of each 2x stage, shared by OverSampler and Decimator.
+ * Calculated with PolyphaseIir2Designer::compute_coefs() for 96 dB of stopband attenuation */
+struct OverSamplerCoeffs
+{
+  static const double* Get2x() // transition bandwidth 0.01
+  {
+    static constexpr double coeffs[12] = { 0.036681502163648017, 0.13654762463195794, 0.27463175937945444, 0.42313861743656711, 0.56109869787919531, 0.67754004997416184, 0.76974183386322703, 0.83988962484963892, 0.89226081800387902, 0.9315419599631839, 0.96209454837808417, 0.98781637073289585 };
+    return coeffs;
+  }
+
+  static const double* Get4x() // transition bandwidth 0.255
+  {
+    static constexpr double coeffs[4] = { 0.041893991997656171, 0.16890348243995201, 0.39056077292116603, 0.74389574826847926 };
+    return coeffs;
+  }
+
+  static const double* Get8x() // transition bandwidth 0.3775
+  {
+    static constexpr double coeffs[3] = { 0.055748680811302048, 0.24305119574153072, 0.64669913119268196 };
+    return coeffs;
+  }
+
+  static const double* Get16x() // transition bandwidth 0.43865
+  {
+    static constexpr double coeffs[2] = { 0.10717745346023573, 0.53091435354504557 };
+    return coeffs;
+  }
+};
+
+/** The vector width in bytes that OverSampler's multi-channel stages are sized for, see HIIR/Multi2x.h */
+#ifndef OVERSAMPLER_SIMD_BYTES
+  #if defined(__AVX__)
+    #define OVERSAMPLER_SIMD_BYTES 32
+  #else
+    #define OVERSAMPLER_SIMD_BYTES 16
+  #endif
+#endif
+
 template<typename T = double>
 class OverSampler
 {
 public:
   typedef std::function<void(T**, T**, int)> BlockProcessFunc;
+
+  /** The number of channels ProcessBlock() filters at once, when there is more than one channel */
+  static constexpr int kLanes = OVERSAMPLER_SIMD_BYTES / sizeof(T) < 2 ? 2 : OVERSAMPLER_SIMD_BYTES / sizeof(T);
   
-  OverSampler(EFactor factor = kNone, bool blockProcessing = true, int nChannels = 1)
+  /** @param factor The initial factor
+   * @param blockProcessing \c true to use ProcessBlock() or ProcessBlockFullRate(), \c false for Process() or ProcessGen()
+   * @param nChannels The number of channels
+   * @param maxFactor The highest factor that SetOverSampling() will be asked for. Only the stages and buffers up to it are allocated
+   * @param filter The kind of filters. kLinearPhaseFIR needs block processing */
+  OverSampler(EFactor factor = kNone, bool blockProcessing = true, int nChannels = 1, EFactor maxFactor = k16x, EOverSamplerFilter filter = kPolyphaseIIR)
   : mBlockProcessing(blockProcessing)
   , mNChannels(nChannels)
+  , mMaxFactor(maxFactor)
+  , mMaxRate(1 << (int) maxFactor)
+  , mFilter(filter)
   {
-    for (auto c = 0; c < mNChannels; c++)
+    assert(mFilter == kPolyphaseIIR || mBlockProcessing);
+
+    if (mFilter == kLinearPhaseFIR)
     {
-      mUpsampler2x.Add(new Upsampler2xFPU<12, T>());
-      mDownsampler2x.Add(new Downsampler2xFPU<12, T>());
-      mUpsampler4x.Add(new Upsampler2xFPU<4, T>());
-      mDownsampler4x.Add(new Downsampler2xFPU<4, T>());
-      mUpsampler8x.Add(new Upsampler2xFPU<3, T>());
-      mDownsampler8x.Add(new Downsampler2xFPU<3, T>());
-      mUpsampler16x.Add(new Upsampler2xFPU<2, T>());
-      mDownsampler16x.Add(new Downsampler2xFPU<2, T>());
-      
-      static constexpr double coeffs2x[12] = { 0.036681502163648017, 0.13654762463195794, 0.27463175937945444, 0.42313861743656711, 0.56109869787919531, 0.67754004997416184, 0.76974183386322703, 0.83988962484963892, 0.89226081800387902, 0.9315419599631839, 0.96209454837808417, 0.98781637073289585 };
-      
-//    PolyphaseIir2Designer::compute_coefs(coeffs2x, 96., 0.01);
+      for (auto c = 0; c < mNChannels; c++)
+      {
+        for (auto stage = 0; (2 << stage) <= mMaxRate; stage++)
+        {
+          mFIRUpsamplers[stage].Add(new HalfBandFIRUpsampler<T>(FIRHalfLength(stage)));
+          mFIRDownsamplers[stage].Add(new HalfBandFIRDownsampler<T>(FIRHalfLength(stage)));
+        }
+      }
+    }
 
+    for (auto c = 0; c < mNChannels && mFilter == kPolyphaseIIR; c++)
+    {
+//    PolyphaseIir2Designer::compute_coefs(coeffs2x, 96., 0.01);
+//    PolyphaseIir2Designer::compute_coefs(coeffs4x, 96., 0.255);
+//    PolyphaseIir2Designer::compute_coefs(coeffs8x, 96., 0.3775);
+//    PolyphaseIir2Designer::compute_coefs(coeffs16x, 96., 0.43865);
+//
 //    printf("coeffs2x\n");
 //
 //    for(int i=0;i<12;i++)
 //      printf("%.17g,\n", coeffs2x[i]);
 
-      mUpsampler2x.Get(c)->set_coefs(coeffs2x);
-      mDownsampler2x.Get(c)->set_coefs(coeffs2x);
-      
-      
-      static constexpr double coeffs4x[4] = {0.041893991997656171, 0.16890348243995201, 0.39056077292116603, 0.74389574826847926 };
-  
-  //    PolyphaseIir2Designer::compute_coefs(coeffs4x, 96., 0.255);
-  
-  //    printf("coeffs4x\n");
-  //
-  //    for(int i=0;i<4;i++)
-  //      printf("%.17g,\n", coeffs4x[i]);
-  
-      mUpsampler4x.Get(c)->set_coefs(coeffs4x);
-      mDownsampler4x.Get(c)->set_coefs(coeffs4x);
-  
-      static constexpr double coeffs8x[3] = {0.055748680811302048, 0.24305119574153072, 0.64669913119268196 };
-  
-  //  PolyphaseIir2Designer::compute_coefs(coeffs8x, 96., 0.3775);
-  
-  //    printf("coeffs8x\n");
-  //
-  //    for(int i=0;i<3;i++)
-  //      printf("%.17g,\n", coeffs8x[i]);
-  
-      mUpsampler8x.Get(c)->set_coefs(coeffs8x);
-      mDownsampler8x.Get(c)->set_coefs(coeffs8x);
-  
-      static constexpr double coeffs16x[2] = {0.10717745346023573, 0.53091435354504557 };
-  
-  //    PolyphaseIir2Designer::compute_coefs(coeffs16x, 96., 0.43865);
-  
-  //    printf("coeffs16x\n");
-  //
-  //    for(int i=0;i<2;i++)
-  //      printf("%.17g,\n", coeffs16x[i]);
-  
-      mUpsampler16x.Get(c)->set_coefs(coeffs16x);
-      mDownsampler16x.Get(c)->set_coefs(coeffs16x);
+      AddStage(mUpsampler2x, 2, OverSamplerCoeffs::Get2x());
+      AddStage(mDownsampler2x, 2, OverSamplerCoeffs::Get2x());
+      AddStage(mUpsampler4x, 4, OverSamplerCoeffs::Get4x());
+      AddStage(mDownsampler4x, 4, OverSamplerCoeffs::Get4x());
+      AddStage(mUpsampler8x, 8, OverSamplerCoeffs::Get8x());
+      AddStage(mDownsampler8x, 8, OverSamplerCoeffs::Get8x());
+      AddStage(mUpsampler16x, 16, OverSamplerCoeffs::Get16x());
+      AddStage(mDownsampler16x, 16, OverSamplerCoeffs::Get16x());
+    }
+
+    // with several channels, ProcessBlock() runs them kLanes at a time through the same stages
+    if (mNChannels > 1 && mFilter == kPolyphaseIIR)
+    {
+      for (auto g = 0; g * kLanes < mNChannels; g++)
+      {
+        AddStage(mUpsampler2xMulti, 2, OverSamplerCoeffs::Get2x());
+        AddStage(mDownsampler2xMulti, 2, OverSamplerCoeffs::Get2x());
+        AddStage(mUpsampler4xMulti, 4, OverSamplerCoeffs::Get4x());
+        AddStage(mDownsampler4xMulti, 4, OverSamplerCoeffs::Get4x());
+        AddStage(mUpsampler8xMulti, 8, OverSamplerCoeffs::Get8x());
+        AddStage(mDownsampler8xMulti, 8, OverSamplerCoeffs::Get8x());
+        AddStage(mUpsampler16xMulti, 16, OverSamplerCoeffs::Get16x());
+        AddStage(mDownsampler16xMulti, 16, OverSamplerCoeffs::Get16x());
+      }
     }
     
     for (auto c = 0; c < mNChannels; c++)
@@ -126,8 +179,25 @@ public:
     mDownsampler8x.Empty(true);
     mUpsampler16x.Empty(true);
     mDownsampler16x.Empty(true);
+    mUpsampler2xMulti.Empty(true);
+    mDownsampler2xMulti.Empty(true);
+    mUpsampler4xMulti.Empty(true);
+    mDownsampler4xMulti.Empty(true);
+    mUpsampler8xMulti.Empty(true);
+    mDownsampler8xMulti.Empty(true);
+    mUpsampler16xMulti.Empty(true);
+    mDownsampler16xMulti.Empty(true);
+
+    for (auto stage = 0; stage < 4; stage++)
+    {
+      mFIRUpsamplers[stage].Empty(true);
+      mFIRDownsamplers[stage].Empty(true);
+    }
   }
 
+  /** Size the buffers for the maximum factor and clear the filters. This allocates, so call it from a non-realtime thread, e.g. in OnReset().
+   * The factor can then be changed with SetOverSampling() without allocating
+   * @param blockSize The largest nFrames that ProcessBlock() will be called with */
   void Reset(int blockSize = DEFAULT_BLOCK_SIZE)
   {
     int numBufSamples = 1;
@@ -141,16 +211,17 @@ public:
     }
     
     numBufSamples *= mNChannels;
+
+    // buffers for the rates above the maximum stay empty
+    mUp2x.Resize(mMaxRate >= 2 ? 2 * numBufSamples : 0);
+    mUp4x.Resize(mMaxRate >= 4 ? 4 * numBufSamples : 0);
+    mUp8x.Resize(mMaxRate >= 8 ? 8 * numBufSamples : 0);
+    mUp16x.Resize(mMaxRate >= 16 ? 16 * numBufSamples : 0);
     
-    mUp2x.Resize(2 * numBufSamples);
-    mUp4x.Resize(4 * numBufSamples);
-    mUp8x.Resize(8 * numBufSamples);
-    mUp16x.Resize(16 * numBufSamples);
-    
-    mDown2x.Resize(2 * numBufSamples);
-    mDown4x.Resize(4 * numBufSamples);
-    mDown8x.Resize(8 * numBufSamples);
-    mDown16x.Resize(16 * numBufSamples);
+    mDown2x.Resize(mMaxRate >= 2 ? 2 * numBufSamples : 0);
+    mDown4x.Resize(mMaxRate >= 4 ? 4 * numBufSamples : 0);
+    mDown8x.Resize(mMaxRate >= 8 ? 8 * numBufSamples : 0);
+    mDown16x.Resize(mMaxRate >= 16 ? 16 * numBufSamples : 0);
     
     mUp16BufferPtrs.Empty();
     mUp8BufferPtrs.Empty();
@@ -164,86 +235,53 @@ public:
     
     for (auto c = 0; c < mNChannels; c++)
     {
-      mUpsampler2x.Get(c)->clear_buffers();
-      mUpsampler4x.Get(c)->clear_buffers();
-      mUpsampler8x.Get(c)->clear_buffers();
-      mUpsampler16x.Get(c)->clear_buffers();
-      mDownsampler2x.Get(c)->clear_buffers();
-      mDownsampler4x.Get(c)->clear_buffers();
-      mDownsampler8x.Get(c)->clear_buffers();
-      mDownsampler16x.Get(c)->clear_buffers();
-      
-      mUp2BufferPtrs.Add(mUp2x.Get() + c * 2 * blockSize);
-      mUp4BufferPtrs.Add(mUp4x.Get() + (c * 4 * blockSize));
-      mUp8BufferPtrs.Add(mUp8x.Get() + (c * 8 * blockSize));
-      mUp16BufferPtrs.Add(mUp16x.Get() + (c * 16 * blockSize));
-      mDown2BufferPtrs.Add(mDown2x.Get() + c * 2 * blockSize);
-      mDown4BufferPtrs.Add(mDown4x.Get() + (c * 4 * blockSize));
-      mDown8BufferPtrs.Add(mDown8x.Get() + (c * 8 * blockSize));
-      mDown16BufferPtrs.Add(mDown16x.Get() + (c * 16 * blockSize));
+      if (mMaxRate >= 2)
+      {
+        mUp2BufferPtrs.Add(mUp2x.Get() + c * 2 * blockSize);
+        mDown2BufferPtrs.Add(mDown2x.Get() + c * 2 * blockSize);
+      }
+
+      if (mMaxRate >= 4)
+      {
+        mUp4BufferPtrs.Add(mUp4x.Get() + (c * 4 * blockSize));
+        mDown4BufferPtrs.Add(mDown4x.Get() + (c * 4 * blockSize));
+      }
+
+      if (mMaxRate >= 8)
+      {
+        mUp8BufferPtrs.Add(mUp8x.Get() + (c * 8 * blockSize));
+        mDown8BufferPtrs.Add(mDown8x.Get() + (c * 8 * blockSize));
+      }
+
+      if (mMaxRate >= 16)
+      {
+        mUp16BufferPtrs.Add(mUp16x.Get() + (c * 16 * blockSize));
+        mDown16BufferPtrs.Add(mDown16x.Get() + (c * 16 * blockSize));
+      }
     }
+
+    mPadHistory.Resize(mNChannels * kMaxPad);
+    ClearStages();
+    mFadeGain = 1.;
   }
 
+  /** @return The delay that the up and down sampling adds at the current factor, in samples at the lower rate, to report with IPlugProcessor::SetLatency()
+   * (in OnReset(), and when the factor changes). It is nonzero only with kLinearPhaseFIR, whose delay is padded to a whole number of samples.
+   * The polyphase IIR stages have a small frequency dependent delay, which isn't reported */
+  int GetLatency() const { return mLatency; }
+
   /** Over sample an input block with a per-block function (up sample input -> process with function -> down sample)
    * @param inputs Two-dimensional array containing the non-interleaved input buffers of audio samples for all channels
    * @param outputs Two-dimensional array for audio output (non-interleaved).
    * @param nFrames The block size for this block: number of samples per channel.
    * @param nChans The number of channels to process. Must be less or equal to the number of channels passed to the constructor
-   * @param func The function that processes the audio sample at the higher sampling rate. NOTE: std::function can call malloc if you pass in captures */
+   * @param func The function that processes the audio sample at the higher sampling rate. NOTE: std::function can call malloc if you pass in captures, see ProcessBlockFullRate() */
   void ProcessBlock(T** inputs, T** outputs, int nFrames, int nChans, BlockProcessFunc func)
   {
     assert(nChans <= mNChannels);
     
-    if(mRate != mPrevRate)
-    {
-      switch (mRate) {
-        case 2:
-          mInPtrLoopSrc = &mUp2BufferPtrs;
-          mOutPtrLoopSrc = &mDown2BufferPtrs;
-          break;
-        case 4:
-          mInPtrLoopSrc = &mUp4BufferPtrs;
-          mOutPtrLoopSrc = &mDown4BufferPtrs;
-          break;
-        case 8:
-          mInPtrLoopSrc = &mUp8BufferPtrs;
-          mOutPtrLoopSrc = &mDown8BufferPtrs;
-          break;
-        case 16:
-          mInPtrLoopSrc = &mUp16BufferPtrs;
-          mOutPtrLoopSrc = &mDown16BufferPtrs;
-          break;
-        default:
-          break;
-      }
-      
-      mPrevRate = mRate;
-    }
+    Upsample(inputs, nFrames, nChans);
 
-    if (mRate >= 2) {
-      for(auto c = 0; c < nChans; c++) {
-        mUpsampler2x.Get(c)->process_block(mUp2BufferPtrs.Get(c), inputs[c], nFrames);
-      }
-    }
-    
-    if (mRate >= 4) {
-      for(auto c = 0; c < nChans; c++) {
-        mUpsampler4x.Get(c)->process_block(mUp4BufferPtrs.Get(c), mUp2BufferPtrs.Get(c), nFrames * 2);
-      }
-    }
-    
-    if (mRate >= 8) {
-      for(auto c = 0; c < nChans; c++) {
-        mUpsampler8x.Get(c)->process_block(mUp8BufferPtrs.Get(c), mUp4BufferPtrs.Get(c), nFrames * 4);
-      }
-    }
-    
-    if (mRate == 16) {
-      for(auto c = 0; c < nChans; c++) {
-        mUpsampler16x.Get(c)->process_block(mUp16BufferPtrs.Get(c), mUp8BufferPtrs.Get(c), nFrames * 8);
-      }
-    }
-    
     if (mRate == 1) {
       func(inputs, outputs, nFrames);
     }
@@ -257,29 +295,32 @@ public:
       }
     }
     
-    if (mRate == 16) {
-      for(auto c = 0; c < nChans; c++) {
-        mDownsampler16x.Get(c)->process_block(mDown8BufferPtrs.Get(c), mDown16BufferPtrs.Get(c), nFrames * 8);
-      }
-    }
-    
-    if (mRate >= 8) {
-      for(auto c = 0; c < nChans; c++) {
-        mDownsampler8x.Get(c)->process_block(mDown4BufferPtrs.Get(c), mDown8BufferPtrs.Get(c), nFrames * 4);
-      }
-    }
-    
-    if (mRate >= 4) {
-      for(auto c = 0; c < nChans; c++) {
-        mDownsampler4x.Get(c)->process_block(mDown2BufferPtrs.Get(c), mDown4BufferPtrs.Get(c), nFrames * 2);
-      }
-    }
-    
-    if (mRate >= 2) {
-      for(auto c = 0; c < nChans; c++) {
-        mDownsampler2x.Get(c)->process_block(outputs[c], mDown2BufferPtrs.Get(c), nFrames);
-      }
+    Downsample(outputs, nFrames, nChans);
+    Fade(outputs, nFrames, nChans);
+  }
+
+  /** Over sample an input block with a function that processes the whole block at the higher rate in one call (up sample input -> process with function -> down sample).
+   * Unlike ProcessBlock() the function is called once, with nFrames * GetRate() samples per channel, and it can be any callable, so it can be inlined
+   * @param inputs Two-dimensional array containing the non-interleaved input buffers of audio samples for all channels
+   * @param outputs Two-dimensional array for audio output (non-interleaved).
+   * @param nFrames The block size for this block: number of samples per channel.
+   * @param nChans The number of channels to process. Must be less or equal to the number of channels passed to the constructor
+   * @param func Called as func(T** inputs, T** outputs, int nFrames) with the buffers and the number of frames at the higher rate */
+  template <typename FUNC>
+  void ProcessBlockFullRate(T** inputs, T** outputs, int nFrames, int nChans, FUNC&& func)
+  {
+    assert(nChans <= mNChannels);
+
+    if (mRate == 1)
+      func(inputs, outputs, nFrames);
+    else
+    {
+      Upsample(inputs, nFrames, nChans);
+      func(mInPtrLoopSrc->GetList(), mOutPtrLoopSrc->GetList(), nFrames * mRate);
+      Downsample(outputs, nFrames, nChans);
     }
+
+    Fade(outputs, nFrames, nChans);
   }
   
   /** Over sample an input sample with a per-sample function (up-sample input -> process with function -> down-sample)
@@ -435,16 +476,21 @@ public:
     return output;
   }
 
-  void SetOverSampling(EFactor factor)
+  /** Change the factor, up to the maximum passed to the constructor. This doesn't allocate
+   * @param factor The new factor
+   * @param fade \c false to switch at once, \c true to have ProcessBlock() or ProcessBlockFullRate() fade the output out over SetFadeLength() samples,
+   * switch, and fade back in, so that a change during playback doesn't click. With \c true this can be called from any thread */
+  void SetOverSampling(EFactor factor, bool fade = false)
   {
-    if(factor != mFactor)
-    {
-      mFactor = factor;
-      mRate = std::pow(2, (int) factor);
-      
-      Reset();
-    }
+    factor = std::min(factor, mMaxFactor);
+    mTargetFactor.store((int) factor);
+
+    if (!fade || !mBlockProcessing)
+      SwitchFactor(factor);
   }
+
+  /** @param nSamples The length of each half of a faded factor change, see SetOverSampling() */
+  void SetFadeLength(int nSamples) { mFadeLength = std::max(1, nSamples); }
   
   static EFactor RateToFactor(int rate)
   {
@@ -465,6 +511,240 @@ public:
   }
 
 private:
+  /** Up sample the inputs into mInPtrLoopSrc. Does nothing but pick the buffers at mRate 1 */
+  void Upsample(T** inputs, int nFrames, int nChans)
+  {
+    if(mRate != mPrevRate)
+    {
+      switch (mRate) {
+        case 2:
+          mInPtrLoopSrc = &mUp2BufferPtrs;
+          mOutPtrLoopSrc = &mDown2BufferPtrs;
+          break;
+        case 4:
+          mInPtrLoopSrc = &mUp4BufferPtrs;
+          mOutPtrLoopSrc = &mDown4BufferPtrs;
+          break;
+        case 8:
+          mInPtrLoopSrc = &mUp8BufferPtrs;
+          mOutPtrLoopSrc = &mDown8BufferPtrs;
+          break;
+        case 16:
+          mInPtrLoopSrc = &mUp16BufferPtrs;
+          mOutPtrLoopSrc = &mDown16BufferPtrs;
+          break;
+        default:
+          break;
+      }
+      
+      mPrevRate = mRate;
+    }
+
+    if (mFilter == kLinearPhaseFIR)
+    {
+      T** upBuffers[4] = {mUp2BufferPtrs.GetList(), mUp4BufferPtrs.GetList(), mUp8BufferPtrs.GetList(), mUp16BufferPtrs.GetList()};
+
+      for (auto stage = 0; (2 << stage) <= mRate; stage++)
+      {
+        for (auto c = 0; c < nChans; c++)
+          mFIRUpsamplers[stage].Get(c)->process_block(upBuffers[stage][c], stage ? upBuffers[stage - 1][c] : inputs[c], nFrames << stage);
+      }
+
+      return;
+    }
+
+    if (mRate >= 2)
+      ProcessStage(mUpsampler2x, mUpsampler2xMulti, mUp2BufferPtrs.GetList(), inputs, nFrames, nChans);
+
+    if (mRate >= 4)
+      ProcessStage(mUpsampler4x, mUpsampler4xMulti, mUp4BufferPtrs.GetList(), mUp2BufferPtrs.GetList(), nFrames * 2, nChans);
+
+    if (mRate >= 8)
+      ProcessStage(mUpsampler8x, mUpsampler8xMulti, mUp8BufferPtrs.GetList(), mUp4BufferPtrs.GetList(), nFrames * 4, nChans);
+
+    if (mRate == 16)
+      ProcessStage(mUpsampler16x, mUpsampler16xMulti, mUp16BufferPtrs.GetList(), mUp8BufferPtrs.GetList(), nFrames * 8, nChans);
+  }
+
+  /** Down sample mOutPtrLoopSrc into the outputs. Does nothing at mRate 1 */
+  void Downsample(T** outputs, int nFrames, int nChans)
+  {
+    if (mFilter == kLinearPhaseFIR)
+    {
+      if (mRate == 1)
+        return;
+
+      T** downBuffers[4] = {mDown2BufferPtrs.GetList(), mDown4BufferPtrs.GetList(), mDown8BufferPtrs.GetList(), mDown16BufferPtrs.GetList()};
+      int stage = 0;
+
+      while ((4 << stage) <= mRate)
+        stage++;
+
+      PadLatency(downBuffers[stage], nFrames * mRate, nChans);
+
+      for (; stage >= 0; stage--)
+      {
+        for (auto c = 0; c < nChans; c++)
+          mFIRDownsamplers[stage].Get(c)->process_block(stage ? downBuffers[stage - 1][c] : outputs[c], downBuffers[stage][c], nFrames << stage);
+      }
+
+      return;
+    }
+
+    if (mRate == 16)
+      ProcessStage(mDownsampler16x, mDownsampler16xMulti, mDown8BufferPtrs.GetList(), mDown16BufferPtrs.GetList(), nFrames * 8, nChans);
+
+    if (mRate >= 8)
+      ProcessStage(mDownsampler8x, mDownsampler8xMulti, mDown4BufferPtrs.GetList(), mDown8BufferPtrs.GetList(), nFrames * 4, nChans);
+
+    if (mRate >= 4)
+      ProcessStage(mDownsampler4x, mDownsampler4xMulti, mDown2BufferPtrs.GetList(), mDown4BufferPtrs.GetList(), nFrames * 2, nChans);
+
+    if (mRate >= 2)
+      ProcessStage(mDownsampler2x, mDownsampler2xMulti, outputs, mDown2BufferPtrs.GetList(), nFrames, nChans);
+  }
+
+  /** Add a stage to a list if its rate is within the maximum, so that the lists of the higher rates stay empty */
+  template <class STAGE>
+  void AddStage(WDL_PtrList<STAGE>& stages, int rate, const double* pCoeffs)
+  {
+    if (rate <= mMaxRate)
+      stages.Add(new STAGE())->set_coefs(pCoeffs);
+  }
+
+  /** Delay the signal at the highest rate by mPadLength samples, so that the FIR stages' latency is a whole number of samples at the lower rate */
+  void PadLatency(T** buffers, int nSamples, int nChans)
+  {
+    const int pad = mPadLength;
+
+    if (!pad)
+      return;
+
+    T tail[kMaxPad];
+
+    for (auto c = 0; c < nChans; c++)
+    {
+      T* pBuffer = buffers[c];
+      T* pHistory = mPadHistory.Get() + c * kMaxPad;
+      memcpy(tail, pBuffer + nSamples - pad, pad * sizeof(T));
+      memmove(pBuffer + pad, pBuffer, (nSamples - pad) * sizeof(T));
+      memcpy(pBuffer, pHistory, pad * sizeof(T));
+      memcpy(pHistory, tail, pad * sizeof(T));
+    }
+  }
+
+  template <class STAGE>
+  static void ClearStages(WDL_PtrList<STAGE>& stages)
+  {
+    for (auto i = 0; i < stages.GetSize(); i++)
+      stages.Get(i)->clear_buffers();
+  }
+
+  void ClearStages()
+  {
+    ClearStages(mUpsampler2x);
+    ClearStages(mUpsampler4x);
+    ClearStages(mUpsampler8x);
+    ClearStages(mUpsampler16x);
+    ClearStages(mDownsampler2x);
+    ClearStages(mDownsampler4x);
+    ClearStages(mDownsampler8x);
+    ClearStages(mDownsampler16x);
+    ClearStages(mUpsampler2xMulti);
+    ClearStages(mUpsampler4xMulti);
+    ClearStages(mUpsampler8xMulti);
+    ClearStages(mUpsampler16xMulti);
+    ClearStages(mDownsampler2xMulti);
+    ClearStages(mDownsampler4xMulti);
+    ClearStages(mDownsampler8xMulti);
+    ClearStages(mDownsampler16xMulti);
+
+    for (auto stage = 0; stage < 4; stage++)
+    {
+      ClearStages(mFIRUpsamplers[stage]);
+      ClearStages(mFIRDownsamplers[stage]);
+    }
+
+    if (mPadHistory.GetSize())
+      memset(mPadHistory.Get(), 0, mPadHistory.GetSize() * sizeof(T));
+  }
+
+  /** Change the rate, clearing the filters so that the stages of the new rate don't start from stale state */
+  void SwitchFactor(EFactor factor)
+  {
+    if (factor != mFactor)
+    {
+      mFactor = factor;
+      mRate = 1 << (int) factor;
+      mWritePos = 0;
+      ClearStages();
+      CalcLatency();
+    }
+  }
+
+  /** Each FIR stage delays by its half-length at its higher rate, both ways. Count that in samples at the highest rate, and pad it up to a whole number at the lower rate */
+  void CalcLatency()
+  {
+    mLatency = 0;
+    mPadLength = 0;
+
+    if (mFilter != kLinearPhaseFIR || mRate == 1)
+      return;
+
+    int delay = 0;
+
+    for (auto stage = 0; (2 << stage) <= mRate; stage++)
+      delay += FIRHalfLength(stage) * (mRate >> stage);
+
+    mLatency = (delay + mRate - 1) / mRate;
+    mPadLength = mLatency * mRate - delay;
+    assert(mPadLength < kMaxPad);
+  }
+
+  /** Carry out a faded factor change, see SetOverSampling(): move the gain towards 0 while a change is pending, switching once it gets there, and back to 1 after */
+  void Fade(T** outputs, int nFrames, int nChans)
+  {
+    const EFactor target = (EFactor) mTargetFactor.load();
+
+    if (target == mFactor && mFadeGain >= 1.)
+      return;
+
+    const double step = (target == mFactor ? 1. : -1.) / mFadeLength;
+    double gain = mFadeGain;
+
+    for (auto c = 0; c < nChans; c++)
+    {
+      gain = mFadeGain;
+
+      for (auto s = 0; s < nFrames; s++)
+      {
+        gain = std::min(1., std::max(0., gain + step));
+        outputs[c][s] *= (T) gain;
+      }
+    }
+
+    mFadeGain = gain;
+
+    if (mFadeGain <= 0. && target != mFactor)
+      SwitchFactor(target);
+  }
+
+  /** Run one 2x stage over nChans channels, kLanes at a time if there are multi-channel stages, otherwise a channel at a time */
+  template <class FPU, class MULTI>
+  static void ProcessStage(WDL_PtrList<FPU>& stages, WDL_PtrList<MULTI>& multiStages, T** outputs, T** inputs, int nSamples, int nChans)
+  {
+    if (multiStages.GetSize())
+    {
+      for (auto g = 0; g * kLanes < nChans; g++)
+        multiStages.Get(g)->process_block(outputs + g * kLanes, inputs + g * kLanes, nSamples, std::min(kLanes, nChans - g * kLanes));
+    }
+    else
+    {
+      for (auto c = 0; c < nChans; c++)
+        stages.Get(c)->process_block(outputs[c], inputs[c], nSamples);
+    }
+  }
+
   EFactor mFactor = kNone;
   int mPrevRate = 0;
   int mRate = 1;
@@ -472,6 +752,13 @@ private:
   T mDownSamplerOutput = 0.;
   bool mBlockProcessing; // false
   int mNChannels; // 1
+  EFactor mMaxFactor;
+  int mMaxRate;
+  EOverSamplerFilter mFilter;
+  int mLatency = 0;
+  std::atomic<int> mTargetFactor {kNone}; // the factor requested by SetOverSampling()
+  double mFadeGain = 1.;
+  int mFadeLength = 256;
   
   // the actual data
   WDL_TypedBuf<T> mUp16x;
@@ -512,4 +799,97 @@ private:
   WDL_PtrList<Downsampler2xFPU<4, T>> mDownsampler4x;  // decimator for 4x to 2x SR
   WDL_PtrList<Downsampler2xFPU<3, T>> mDownsampler8x;  // decimator for 8x to 4x SR
   WDL_PtrList<Downsampler2xFPU<2, T>> mDownsampler16x; // decimator for 16x to 8x SR
+
+  //Ptrs to the multi-channel oversamplers for each group of kLanes channels, used by ProcessBlock() when there are several channels
+  WDL_PtrList<Upsampler2xMulti<12, T, kLanes>> mUpsampler2xMulti;
+  WDL_PtrList<Upsampler2xMulti<4, T, kLanes>> mUpsampler4xMulti;
+  WDL_PtrList<Upsampler2xMulti<3, T, kLanes>> mUpsampler8xMulti;
+  WDL_PtrList<Upsampler2xMulti<2, T, kLanes>> mUpsampler16xMulti;
+
+  WDL_PtrList<Downsampler2xMulti<12, T, kLanes>> mDownsampler2xMulti;
+  WDL_PtrList<Downsampler2xMulti<4, T, kLanes>> mDownsampler4xMulti;
+  WDL_PtrList<Downsampler2xMulti<3, T, kLanes>> mDownsampler8xMulti;
+  WDL_PtrList<Downsampler2xMulti<2, T, kLanes>> mDownsampler16xMulti;
+
+  // the half-band FIR stages for each channel, 2x, 4x, 8x and 16x, when the filter is kLinearPhaseFIR. The later stages have more room for their transition bands
+  static int FIRHalfLength(int stage) { static const int halfLengths[4] = {61, 15, 11, 7}; return halfLengths[stage]; }
+  static constexpr int kMaxPad = 16;
+  WDL_PtrList<HalfBandFIRUpsampler<T>> mFIRUpsamplers[4];
+  WDL_PtrList<HalfBandFIRDownsampler<T>> mFIRDownsamplers[4];
+  WDL_TypedBuf<T> mPadHistory; // the last mPadLength samples at the highest rate of each channel, see PadLatency()
+  int mPadLength = 0;
+};
+
+// std::min() binds kLanes by reference, which needs a definition before C++17
+template<typename T>
+constexpr int OverSampler<T>::kLanes;
+
+/** The decimation half of OverSampler, for signals that are generated at the higher rate rather than upsampled, such as an oversampled synth voice
+ * (see SynthVoice::GetOversampling()). Each channel runs the same cascade of 2x stages as OverSampler */
+template<typename T = double>
+class Decimator
+{
+public:
+  Decimator(int nChannels = 1)
+  {
+    for (auto c = 0; c < nChannels; c++)
+    {
+      mStages.Add(new Stages);
+      mStages.Get(c)->mDownsampler2x.set_coefs(OverSamplerCoeffs::Get2x());
+      mStages.Get(c)->mDownsampler4x.set_coefs(OverSamplerCoeffs::Get4x());
+      mStages.Get(c)->mDownsampler8x.set_coefs(OverSamplerCoeffs::Get8x());
+      mStages.Get(c)->mDownsampler16x.set_coefs(OverSamplerCoeffs::Get16x());
+    }
+  }
+
+  ~Decimator()
+  {
+    mStages.Empty(true);
+  }
+
+  void Reset()
+  {
+    for (auto c = 0; c < mStages.GetSize(); c++)
+    {
+      mStages.Get(c)->mDownsampler2x.clear_buffers();
+      mStages.Get(c)->mDownsampler4x.clear_buffers();
+      mStages.Get(c)->mDownsampler8x.clear_buffers();
+      mStages.Get(c)->mDownsampler16x.clear_buffers();
+    }
+  }
+
+  int NChannels() const { return mStages.GetSize(); }
+
+  /** Decimate nFrames * rate samples of one channel in place, leaving nFrames samples at the start of the buffer
+   * @param pBuffer The samples at the higher rate
+   * @param nFrames The number of samples at the lower rate
+   * @param rate 2, 4, 8 or 16
+   * @param channel The channel, whose filter state is used */
+  void ProcessBlock(T* pBuffer, int nFrames, int rate, int channel)
+  {
+    Stages* pStages = mStages.Get(channel);
+
+    if (rate == 16)
+      pStages->mDownsampler16x.process_block(pBuffer, pBuffer, nFrames * 8);
+
+    if (rate >= 8)
+      pStages->mDownsampler8x.process_block(pBuffer, pBuffer, nFrames * 4);
+
+    if (rate >= 4)
+      pStages->mDownsampler4x.process_block(pBuffer, pBuffer, nFrames * 2);
+
+    if (rate >= 2)
+      pStages->mDownsampler2x.process_block(pBuffer, pBuffer, nFrames);
+  }
+
+private:
+  struct Stages
+  {
+    Downsampler2xFPU<12, T> mDownsampler2x; // decimator for 2x to 1x SR
+    Downsampler2xFPU<4, T> mDownsampler4x;  // decimator for 4x to 2x SR
+    Downsampler2xFPU<3, T> mDownsampler8x;  // decimator for 8x to 4x SR
+    Downsampler2xFPU<2, T> mDownsampler16x; // decimator for 16x to 8x SR
+  };
+
+  WDL_PtrList<Stages> mStages;
 };
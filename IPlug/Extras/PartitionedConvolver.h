@@ -0,0 +1,449 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc PartitionedConvolver
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "IPlugHandoff.h"
+#include "FFT.h"
+
+/** A multi-channel, zero latency convolution reverb engine for long impulse responses, e.g. 6 seconds on 12 channels.
+ * The impulse response is split non-uniformly, as in Gardner's scheme: its first tailBlockSize samples (the head) are convolved in headBlockSize
+ * partitions on the audio thread, in every block, and so are the next tailBlockSize samples, whose result is used one tail block later.
+ * The rest (the tail) is convolved in tailBlockSize partitions on a background thread, which has a whole tail block to finish each job.
+ * The audio thread only waits for it if it is more than a tail block late, which, with a tail block of 4096 samples, means around 85 ms at 48 kHz.
+ *
+ * SetImpulse() prepares the partitions' spectra and every buffer off the audio thread, and hands them over through an IPlugHandoff, so the audio
+ * thread never allocates or frees. Attach the handoff returned by GetHandoff() to the plug-in with IPlugAPIBase::AttachHandoff(), so that replaced
+ * impulse responses are deleted on the main thread. A new impulse response starts from silence, its reverb tail builds up again.
+ * ProcessBlock() outputs the wet signal only
+ * The transforms are done with FFT, so IPLUG_FFT_VDSP and IPLUG_FFT_PFFFT choose its backend too
+ * @tparam T The sample type of ProcessBlock(), the convolution itself runs in float */
+template <typename T = double>
+class PartitionedConvolver
+{
+public:
+  /** @param nChans The number of channels ProcessBlock() processes
+   * @param headBlockSize The partition size on the audio thread, a power of two. Smaller costs more CPU, but spreads it evenly over small host blocks
+   * @param tailBlockSize The partition size on the background thread, a power of two and a multiple of headBlockSize
+   * @param backgroundTail \c false to convolve the tail on the audio thread too, e.g. for offline rendering */
+  PartitionedConvolver(int nChans = 2, int headBlockSize = 128, int tailBlockSize = 4096, bool backgroundTail = true)
+  : mNChans(nChans)
+  , mHeadBlockSize(headBlockSize)
+  , mTailBlockSize(tailBlockSize)
+  , mHeadFFT(2 * headBlockSize)
+  , mTailFFT(2 * tailBlockSize)
+  {
+    assert(headBlockSize >= 2 && !(headBlockSize & (headBlockSize - 1)));
+    assert(tailBlockSize >= headBlockSize && !(tailBlockSize & (tailBlockSize - 1)));
+
+    if (backgroundTail)
+      mWorker = std::thread([this]() { WorkerLoop(); });
+  }
+
+  PartitionedConvolver(const PartitionedConvolver&) = delete;
+  PartitionedConvolver& operator=(const PartitionedConvolver&) = delete;
+
+  ~PartitionedConvolver()
+  {
+    if (mWorker.joinable())
+    {
+      {
+        std::lock_guard<std::mutex> lock(mWorkerMutex);
+        mQuit = true;
+      }
+
+      mWorkerCondition.notify_one();
+      mWorker.join();
+    }
+  }
+
+  /** Prepare an impulse response and hand it to the audio thread, which switches to it at the start of a block. Not realtime safe:
+   * call it on the main thread or in a background job, see IPluginBase::RunInBackground(). Passing a length of 0 silences the output
+   * @param ppIR nIRChans arrays of length samples. Channel c of ProcessBlock() is convolved with impulse channel c % nIRChans
+   * @param nIRChans The number of impulse response channels
+   * @param length The length of the impulse response in samples */
+  void SetImpulse(const T* const* ppIR, int nIRChans, int length)
+  {
+    mHandoff.Publish(length > 0 && nIRChans > 0 ? std::unique_ptr<Engine>(new Engine(*this, ppIR, nIRChans, length)) : nullptr);
+  }
+
+  /** Convolve nFrames of each channel. inputs and outputs may be the same buffers. Audio thread only */
+  void ProcessBlock(T** inputs, T** outputs, int nFrames)
+  {
+    // the worker may still be using the current engine, so only switch when it is idle. It almost always is
+    if (mHandoff.HasPending() && !mTailBusy.load(std::memory_order_acquire))
+      mHandoff.Acquire();
+
+    Engine* pEngine = mHandoff.Get();
+
+    if (!pEngine)
+    {
+      for (int c = 0; c < mNChans; c++)
+        memset(outputs[c], 0, nFrames * sizeof(T));
+
+      return;
+    }
+
+    int processed = 0;
+
+    while (processed < nFrames)
+      processed += pEngine->Process(inputs, outputs, processed, nFrames - processed);
+  }
+
+  /** Clear the convolution state, e.g. in OnReset(). Waits for the background thread to finish what it is doing */
+  void Reset()
+  {
+    WaitForTail();
+
+    if (mHandoff.HasPending())
+      mHandoff.Acquire();
+
+    if (Engine* pEngine = mHandoff.Get())
+      pEngine->Reset();
+  }
+
+  /** @return The latency, which is always 0 */
+  int GetLatency() const { return 0; }
+
+  int NChans() const { return mNChans; }
+
+  /** @return The handoff to register with IPlugAPIBase::AttachHandoff() */
+  IPlugHandoffBase& GetHandoff() { return mHandoff; }
+
+private:
+  /** Convolves one channel with one impulse response channel in uniform partitions of blockSize, with an FFT of twice that.
+   * The partition spectra belong to the Engine and are shared by the channels that use the same impulse channel.
+   * Process() can take part of a block at a time: it transforms the partial block each call, so it adds no latency */
+  class UniformConvolver
+  {
+  public:
+    void Init(int blockSize, int nSegments, const float* pSpectra)
+    {
+      mBlockSize = blockSize;
+      mFFTSize = 2 * blockSize;
+      mNSegments = nSegments;
+      mSpectra = pSpectra;
+      mFDL.resize(mNSegments * mFFTSize);
+      mInput.resize(mBlockSize);
+      mOverlap.resize(mBlockSize);
+      mPreMultiplied.resize(mFFTSize);
+      mConv.resize(mFFTSize);
+      Reset();
+    }
+
+    bool Empty() const { return mNSegments == 0; }
+
+    void Reset()
+    {
+      std::fill(mFDL.begin(), mFDL.end(), 0.f);
+      std::fill(mInput.begin(), mInput.end(), 0.f);
+      std::fill(mOverlap.begin(), mOverlap.end(), 0.f);
+      mFill = 0;
+      mCurrent = 0;
+    }
+
+    /** @param nFrames No more than what is left of the current block */
+    void Process(FFT& fft, const float* pIn, float* pOut, int nFrames)
+    {
+      assert(mFill + nFrames <= mBlockSize);
+
+      const bool newBlock = mFill == 0;
+      memcpy(mInput.data() + mFill, pIn, nFrames * sizeof(float));
+
+      float* pSegment = mFDL.data() + mCurrent * mFFTSize;
+      memcpy(pSegment, mInput.data(), mBlockSize * sizeof(float));
+      memset(pSegment + mBlockSize, 0, mBlockSize * sizeof(float));
+      fft.Forward(pSegment, pSegment);
+
+      // the older segments don't change within a block, so their sum is only computed at its start
+      if (newBlock)
+      {
+        std::fill(mPreMultiplied.begin(), mPreMultiplied.end(), 0.f);
+
+        for (int i = 1; i < mNSegments; i++)
+        {
+          const int segment = (mCurrent + i) % mNSegments;
+          FFT::MultiplyAccumulate(mPreMultiplied.data(), mSpectra + i * mFFTSize, mFDL.data() + segment * mFFTSize, mFFTSize);
+        }
+      }
+
+      memcpy(mConv.data(), mPreMultiplied.data(), mFFTSize * sizeof(float));
+      FFT::MultiplyAccumulate(mConv.data(), mSpectra, pSegment, mFFTSize);
+      fft.Inverse(mConv.data(), mConv.data());
+
+      for (int i = 0; i < nFrames; i++)
+        pOut[i] = mConv[mFill + i] + mOverlap[mFill + i];
+
+      mFill += nFrames;
+
+      if (mFill == mBlockSize)
+      {
+        std::fill(mInput.begin(), mInput.end(), 0.f);
+        memcpy(mOverlap.data(), mConv.data() + mBlockSize, mBlockSize * sizeof(float));
+        mFill = 0;
+        mCurrent = mCurrent > 0 ? mCurrent - 1 : mNSegments - 1;
+      }
+    }
+
+  private:
+    int mBlockSize = 0;
+    int mFFTSize = 0;
+    int mNSegments = 0;
+    int mFill = 0;
+    int mCurrent = 0;
+    const float* mSpectra = nullptr;
+    std::vector<float> mFDL; // the spectra of the last mNSegments input blocks, newest at mCurrent
+    std::vector<float> mInput;
+    std::vector<float> mOverlap;
+    std::vector<float> mPreMultiplied;
+    std::vector<float> mConv;
+  };
+
+  /** The spectra of one impulse channel's partitions, cut from offset onwards in blockSize pieces */
+  struct Partitions
+  {
+    int nSegments = 0;
+    std::vector<float> spectra;
+
+    void Init(FFT& fft, const T* pIR, int length, int offset, int irLength, int blockSize)
+    {
+      const int fftSize = 2 * blockSize;
+      irLength = std::max(0, std::min(irLength, length - offset));
+      nSegments = (irLength + blockSize - 1) / blockSize;
+      spectra.assign(nSegments * fftSize, 0.f);
+
+      for (int s = 0; s < nSegments; s++)
+      {
+        float* pSpectrum = spectra.data() + s * fftSize;
+        const int n = std::min(blockSize, irLength - s * blockSize);
+
+        for (int i = 0; i < n; i++)
+          pSpectrum[i] = static_cast<float>(pIR[offset + s * blockSize + i] / fftSize); // the inverse FFT doesn't normalise, so the spectra do
+
+        fft.Forward(pSpectrum, pSpectrum);
+      }
+    }
+  };
+
+  /** The state of one channel: a convolver for each part of the impulse response, and the buffers that delay the tails */
+  struct Channel
+  {
+    UniformConvolver head; // ir[0, tail), in head blocks
+    UniformConvolver tail0; // ir[tail, 2 * tail), in head blocks, one tail block late
+    UniformConvolver tail; // ir[2 * tail, end), in tail blocks, on the worker
+    std::vector<float> headIn, headOut;
+    std::vector<float> tailInput, tail0Output, tail0Ready, tailOutput, tailReady, workerInput;
+  };
+
+  /** Everything that depends on the impulse response, built off the audio thread and handed over as one object */
+  class Engine
+  {
+  public:
+    Engine(PartitionedConvolver& owner, const T* const* ppIR, int nIRChans, int length)
+    : mOwner(owner)
+    , mHead(owner.mHeadBlockSize)
+    , mTail(owner.mTailBlockSize)
+    {
+      // the owner's FFTs belong to the audio and worker threads
+      FFT headFFT(2 * mHead);
+      FFT tailFFT(2 * mTail);
+      mHeadParts.resize(nIRChans);
+      mTail0Parts.resize(nIRChans);
+      mTailParts.resize(nIRChans);
+
+      for (int i = 0; i < nIRChans; i++)
+      {
+        mHeadParts[i].Init(headFFT, ppIR[i], length, 0, mTail, mHead);
+        mTail0Parts[i].Init(headFFT, ppIR[i], length, mTail, mTail, mHead);
+        mTailParts[i].Init(tailFFT, ppIR[i], length, 2 * mTail, length, mTail);
+      }
+
+      mHasTail0 = mTail0Parts[0].nSegments > 0;
+      mHasTail = mTailParts[0].nSegments > 0;
+      mChannels.resize(owner.mNChans);
+
+      for (int c = 0; c < owner.mNChans; c++)
+      {
+        Channel& channel = mChannels[c];
+        const int irChan = c % nIRChans;
+        channel.head.Init(mHead, mHeadParts[irChan].nSegments, mHeadParts[irChan].spectra.data());
+        channel.tail0.Init(mHead, mTail0Parts[irChan].nSegments, mTail0Parts[irChan].spectra.data());
+        channel.tail.Init(mTail, mTailParts[irChan].nSegments, mTailParts[irChan].spectra.data());
+        channel.headIn.resize(mHead);
+        channel.headOut.resize(mHead);
+
+        for (auto* pBuf : { &channel.tailInput, &channel.tail0Output, &channel.tail0Ready, &channel.tailOutput, &channel.tailReady, &channel.workerInput })
+          pBuf->assign(mTail, 0.f);
+      }
+    }
+
+    void Reset()
+    {
+      for (auto& channel : mChannels)
+      {
+        channel.head.Reset();
+        channel.tail0.Reset();
+        channel.tail.Reset();
+
+        for (auto* pBuf : { &channel.tailInput, &channel.tail0Output, &channel.tail0Ready, &channel.tailOutput, &channel.tailReady, &channel.workerInput })
+          std::fill(pBuf->begin(), pBuf->end(), 0.f);
+      }
+
+      mTailFill = 0;
+    }
+
+    /** Process up to the end of the current head block
+     * @return The number of frames processed */
+    int Process(T** inputs, T** outputs, int offset, int nFrames)
+    {
+      FFT& fft = mOwner.mHeadFFT;
+      const int n = std::min(nFrames, mHead - (mTailFill % mHead));
+      const bool headBlockDone = (mTailFill + n) % mHead == 0;
+
+      for (int c = 0; c < mOwner.mNChans; c++)
+      {
+        Channel& channel = mChannels[c];
+        const T* pIn = inputs[c] + offset;
+        T* pOut = outputs[c] + offset;
+
+        for (int i = 0; i < n; i++)
+          channel.headIn[i] = static_cast<float>(pIn[i]);
+
+        memcpy(channel.tailInput.data() + mTailFill, channel.headIn.data(), n * sizeof(float));
+        channel.head.Process(fft, channel.headIn.data(), channel.headOut.data(), n);
+
+        const float* pTail0 = channel.tail0Ready.data() + mTailFill;
+        const float* pTail = channel.tailReady.data() + mTailFill;
+
+        for (int i = 0; i < n; i++)
+          pOut[i] = static_cast<T>(channel.headOut[i] + pTail0[i] + pTail[i]);
+
+        if (mHasTail0 && headBlockDone)
+        {
+          const int blockStart = mTailFill + n - mHead;
+          channel.tail0.Process(fft, channel.tailInput.data() + blockStart, channel.tail0Output.data() + blockStart, mHead);
+        }
+      }
+
+      mTailFill += n;
+
+      if (mTailFill == mTail)
+      {
+        for (auto& channel : mChannels)
+          std::swap(channel.tail0Ready, channel.tail0Output);
+
+        if (mHasTail)
+          StartTail();
+
+        mTailFill = 0;
+      }
+
+      return n;
+    }
+
+    /** Called on the worker, or on the audio thread without one */
+    void ProcessTail()
+    {
+      for (auto& channel : mChannels)
+        channel.tail.Process(mOwner.mTailFFT, channel.workerInput.data(), channel.tailOutput.data(), mTail);
+    }
+
+  private:
+    /** Hand the tail block that has just filled up to the worker, and take the result of the one before */
+    void StartTail()
+    {
+      mOwner.WaitForTail();
+
+      for (auto& channel : mChannels)
+      {
+        std::swap(channel.tailReady, channel.tailOutput);
+        std::swap(channel.workerInput, channel.tailInput);
+      }
+
+      mOwner.StartTail(this);
+    }
+
+    PartitionedConvolver& mOwner;
+    int mHead;
+    int mTail;
+    int mTailFill = 0; // the position in the current tail block, always a whole number of head blocks plus the head's own fill
+    bool mHasTail0 = false;
+    bool mHasTail = false;
+    std::vector<Partitions> mHeadParts, mTail0Parts, mTailParts; // per impulse channel
+    std::vector<Channel> mChannels;
+  };
+
+  /** Audio thread */
+  void StartTail(Engine* pEngine)
+  {
+    if (!mWorker.joinable())
+    {
+      pEngine->ProcessTail();
+      return;
+    }
+
+    mTailEngine = pEngine;
+    mTailBusy.store(true, std::memory_order_release);
+    mWorkerCondition.notify_one(); // doesn't need the mutex, the worker also wakes up every millisecond
+  }
+
+  /** Spin until the worker has finished its job, which it normally has long before this is called */
+  void WaitForTail()
+  {
+    while (mTailBusy.load(std::memory_order_acquire))
+      std::this_thread::yield();
+  }
+
+  void WorkerLoop()
+  {
+    std::unique_lock<std::mutex> lock(mWorkerMutex);
+
+    while (!mQuit)
+    {
+      mWorkerCondition.wait_for(lock, std::chrono::milliseconds(1), [this]() { return mQuit || mTailBusy.load(std::memory_order_acquire); });
+
+      if (mTailBusy.load(std::memory_order_acquire))
+      {
+        mTailEngine->ProcessTail();
+        mTailBusy.store(false, std::memory_order_release);
+      }
+    }
+  }
+
+  const int mNChans;
+  const int mHeadBlockSize;
+  const int mTailBlockSize;
+  FFT mHeadFFT; // audio thread
+  FFT mTailFFT; // worker thread
+  IPlugHandoff<Engine> mHandoff;
+
+  std::thread mWorker;
+  std::mutex mWorkerMutex;
+  std::condition_variable mWorkerCondition;
+  bool mQuit = false;
+  std::atomic<bool> mTailBusy {false};
+  Engine* mTailEngine = nullptr;
+};
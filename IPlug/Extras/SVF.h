@@ -43,9 +43,9 @@ public:
     UpdateCoefficients();
   }
 
-  void SetFreqCPS(double freqCPS) { mNewState.freq = Clip(freqCPS, 10, 20000.); }
+  void SetFreqCPS(double freqCPS) { mNewState.freq = Clip(freqCPS, 10., 20000.); }
   void SetQ(double Q) { mNewState.Q = Clip(Q, 0.1, 100.); }
-  void SetGain(double gainDB) { mNewState.gain = Clip(gainDB, -36, 36.); }
+  void SetGain(double gainDB) { mNewState.gain = Clip(gainDB, -36., 36.); }
   void SetMode(EMode mode) { mNewState.mode = mode; }
   void SetSampleRate(double sampleRate) { mNewState.sampleRate = sampleRate; }
 
@@ -56,6 +56,13 @@ public:
     if(mState != mNewState)
       UpdateCoefficients();
 
+    if (nChans == NC && NC > 1)
+    {
+      // all of the channels a sample at a time, so that the compiler can vectorize across them
+      ProcessFrames(inputs, outputs, nFrames, nullptr);
+      return;
+    }
+
     for (auto c = 0; c < nChans; c++)
     {
       for (auto s = 0; s < nFrames; s++)
@@ -73,6 +80,19 @@ public:
     }
   }
 
+  /** Process a block with the cutoff modulated every sample, e.g. by an envelope or an LFO at audio rate. The mode, Q, gain and sample rate are taken
+   * from the last calls to their setters, the frequency set by SetFreqCPS() is ignored. Coefficients are recomputed every sample with FastTan()
+   * @param pFreqCPS nFrames cutoff frequencies in Hz, shared by all of the channels, clipped like SetFreqCPS() and to below Nyquist */
+  void ProcessBlock(T** inputs, T** outputs, int nChans, int nFrames, const T* pFreqCPS)
+  {
+    assert(nChans <= NC);
+
+    if(mState != mNewState)
+      UpdateCoefficients();
+
+    ProcessFrames(inputs, outputs, nFrames, pFreqCPS, nChans);
+  }
+
   void Reset()
   {
     for (auto c = 0; c < NC; c++)
@@ -85,112 +105,128 @@ public:
     }
   }
 
-private:
-  void UpdateCoefficients()
+  /** A fast approximation of std::tan(x) for x in [0, PI/2), within 2e-7 (double) or 2e-6 (float) of it up to x = 1.5, which is 20 kHz at 42 kHz.
+   * A Pade approximant of tan(x/2), then the double angle formula. It has no branches, so it vectorizes */
+  template <typename V>
+  static inline V FastTan(V x)
   {
-    mState = mNewState;
+    const V y = x * V(0.5);
+    const V y2 = y * y;
+    const V t = y * (V(945.) + y2 * (V(-105.) + y2)) / (V(945.) + y2 * (V(-420.) + y2 * V(15.)));
+    return V(2.) * t / (V(1.) - t * t);
+  }
+
+  /** The factor by which a mode scales g = tan(PI * freqCPS/sampleRate) in CalcCoefficients(), so that modulated coefficients only need a new g */
+  static double CalcGScale(EMode mode, double gainDB)
+  {
+    return (mode == kLowPassShelf || mode == kHighPassShelf) ? 1. / std::sqrt(std::pow(10., gainDB/40.)) : 1.;
+  }
 
-    const double w = std::tan(PI * mState.freq/mState.sampleRate);
+  /** Calculate the coefficients for a mode and its settings, as ProcessBlock() uses them. Also used by SVFLanes, see VoiceLanes.h */
+  static void CalcCoefficients(EMode mode, double freqCPS, double Q, double gainDB, double sampleRate,
+                               double& a1, double& a2, double& a3, double& m0, double& m1, double& m2)
+  {
+    const double w = std::tan(PI * freqCPS/sampleRate);
 
-    switch(mState.mode)
+    switch(mode)
     {
       case kLowPass:
       {
         const double g = w;
-        const double k = 1. / mState.Q;
-        m_a1 = 1./(1. + g * (g + k));
-        m_a2 = g * m_a1;
-        m_a3 = g * m_a2;
-        m_m0 = 0;
-        m_m1 = 0;
-        m_m2 = 1.;
+        const double k = 1. / Q;
+        a1 = 1./(1. + g * (g + k));
+        a2 = g * a1;
+        a3 = g * a2;
+        m0 = 0;
+        m1 = 0;
+        m2 = 1.;
         break;
       }
       case kHighPass:
       {
         const double g = w;
-        const double k = 1. / mState.Q;
-        m_a1 = 1./(1. + g * (g + k));
-        m_a2 = g * m_a1;
-        m_a3 = g * m_a2;
-        m_m0 = 1.;
-        m_m1 = -k;
-        m_m2 = -1.;
+        const double k = 1. / Q;
+        a1 = 1./(1. + g * (g + k));
+        a2 = g * a1;
+        a3 = g * a2;
+        m0 = 1.;
+        m1 = -k;
+        m2 = -1.;
         break;
       }
       case kBandPass:
       {
         const double g = w;
-        const double k = 1. / mState.Q;
-        m_a1 = 1./(1. + g * (g + k));
-        m_a2 = g * m_a1;
-        m_a3 = g * m_a2;
-        m_m0 = 0.;
-        m_m1 = 1.;
-        m_m2 = 0.;
+        const double k = 1. / Q;
+        a1 = 1./(1. + g * (g + k));
+        a2 = g * a1;
+        a3 = g * a2;
+        m0 = 0.;
+        m1 = 1.;
+        m2 = 0.;
         break;
       }
       case kNotch:
       {
         const double g = w;
-        const double k = 1. / mState.Q;
-        m_a1 = 1./(1. + g * (g + k));
-        m_a2 = g * m_a1;
-        m_a3 = g * m_a2;
-        m_m0 = 1.;
-        m_m1 = -k;
-        m_m2 = 0.;
+        const double k = 1. / Q;
+        a1 = 1./(1. + g * (g + k));
+        a2 = g * a1;
+        a3 = g * a2;
+        m0 = 1.;
+        m1 = -k;
+        m2 = 0.;
         break;
       }
       case kPeak:
       {
         const double g = w;
-        const double k = 1. / mState.Q;
-        m_a1 = 1./(1. + g * (g + k));
-        m_a2 = g * m_a1;
-        m_a3 = g * m_a2;
-        m_m0 = 1.;
-        m_m1 = -k;
-        m_m2 = -2.;
+        const double k = 1. / Q;
+        a1 = 1./(1. + g * (g + k));
+        a2 = g * a1;
+        a3 = g * a2;
+        m0 = 1.;
+        m1 = -k;
+        m2 = -2.;
         break;
       }
       case kBell:
       {
-        const double A = std::pow(10., mState.gain/40.);
+        const double A = std::pow(10., gainDB/40.);
         const double g = w;
-        const double k = 1 / mState.Q;
-        m_a1 = 1./(1. + g * (g + k));
-        m_a2 = g * m_a1;
-        m_a3 = g * m_a2;
-        m_m0 = 1.;
-        m_m1 = k * (A * A - 1.);
-        m_m2 = 0.;
+        const double k = 1 / Q;
+        a1 = 1./(1. + g * (g + k));
+        a2 = g * a1;
+        a3 = g * a2;
+        m0 = 1.;
+        m1 = k * (A * A - 1.);
+        m2 = 0.;
         break;
       }
       case kLowPassShelf:
       {
-        const double A = std::pow(10., mState.gain/40.);
+        const double A = std::pow(10., gainDB/40.);
         const double g = w / std::sqrt(A);
-        const double k = 1. / mState.Q;
-        m_a1 = 1./(1. + g * (g + k));
-        m_a2 = g * m_a1;
-        m_a3 = g * m_a2;
-        m_m0 = 1.;
-        m_m1 = k * (A - 1.);
-        m_m2 = (A * A - 1.);
+        const double k = 1. / Q;
+        a1 = 1./(1. + g * (g + k));
+        a2 = g * a1;
+        a3 = g * a2;
+        m0 = 1.;
+        m1 = k * (A - 1.);
+        m2 = (A * A - 1.);
         break;
       }
       case kHighPassShelf:
       {
-        const double A = std::pow(10., mState.gain/40.);
+        const double A = std::pow(10., gainDB/40.);
         const double g = w / std::sqrt(A);
-        const double k = 1. / mState.Q;
-        m_a1 = 1./(1. + g * (g + k));
-        m_a2 = g * m_a1;
-        m_a3 = g * m_a2;
-        m_m0 = A*A;
-        m_m1 = k*(1. - A)*A;
-        m_m2 = (1. - A*A);
+        const double k = 1. / Q;
+        a1 = 1./(1. + g * (g + k));
+        a2 = g * a1;
+        a3 = g * a2;
+        m0 = A*A;
+        m1 = k*(1. - A)*A;
+        m2 = (1. - A*A);
         break;
       }
       default:
@@ -198,6 +234,66 @@ private:
     }
   }
 
+private:
+  void UpdateCoefficients()
+  {
+    mState = mNewState;
+    CalcCoefficients(mState.mode, mState.freq, mState.Q, mState.gain, mState.sampleRate, m_a1, m_a2, m_a3, m_m0, m_m1, m_m2);
+  }
+
+  /** Process the channels a sample at a time, with the state in local arrays and a fixed length channel loop
+   * @param pFreqCPS Per sample cutoff frequencies, or nullptr to use the block's coefficients */
+  void ProcessFrames(T** inputs, T** outputs, int nFrames, const T* pFreqCPS, int nChans = NC)
+  {
+    double ic1eq[NC], ic2eq[NC], v0[NC];
+
+    for (auto c = 0; c < NC; c++)
+    {
+      ic1eq[c] = mIc1eq[c];
+      ic2eq[c] = mIc2eq[c];
+      v0[c] = 0.;
+    }
+
+    double a1 = m_a1, a2 = m_a2, a3 = m_a3;
+    const double k = 1. / mState.Q;
+    const double gScale = CalcGScale(mState.mode, mState.gain);
+    const double piOverSampleRate = PI / mState.sampleRate;
+    const double maxFreq = std::min(20000., 0.49 * mState.sampleRate);
+
+    for (auto s = 0; s < nFrames; s++)
+    {
+      if (pFreqCPS)
+      {
+        const double g = FastTan(Clip((double) pFreqCPS[s], 10., maxFreq) * piOverSampleRate) * gScale;
+        a1 = 1./(1. + g * (g + k));
+        a2 = g * a1;
+        a3 = g * a2;
+      }
+
+      for (auto c = 0; c < NC; c++)
+        v0[c] = c < nChans ? (double) inputs[c][s] : 0.;
+
+      for (auto c = 0; c < NC; c++)
+      {
+        const double v3 = v0[c] - ic2eq[c];
+        const double v1 = a1 * ic1eq[c] + a2 * v3;
+        const double v2 = ic2eq[c] + a2 * ic1eq[c] + a3 * v3;
+        ic1eq[c] = 2. * v1 - ic1eq[c];
+        ic2eq[c] = 2. * v2 - ic2eq[c];
+        v0[c] = m_m0 * v0[c] + m_m1 * v1 + m_m2 * v2;
+      }
+
+      for (auto c = 0; c < nChans; c++)
+        outputs[c][s] = (T) v0[c];
+    }
+
+    for (auto c = 0; c < nChans; c++)
+    {
+      mIc1eq[c] = ic1eq[c];
+      mIc2eq[c] = ic2eq[c];
+    }
+  }
+
 private:
   double mV1[NC] = {};
   double mV2[NC] = {};
@@ -0,0 +1,101 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc ISharedMemoryConnection
+ */
+
+#include <cstring>
+#include <memory>
+
+#include "IPlugStructs.h"
+#include "shm_connection.h" // after the standard library headers, since swell defines min and max
+
+/** One end of the connection between a plug-in and an editor running in another process, see ISharedMemoryEditorDelegate and ISharedMemoryEditorClient.
+ * Messages use the same vocabulary as a websocket editor (SPVFUI, SMMFUI, SPVFD, SCVFD etc.): a verb written with IByteChunk::PutStr(), followed by its arguments.
+ * Each message is prefixed with its size in the stream, which WDL_SHM_Connection carries over a pair of shared memory rings on Windows, and over a local socket on macOS and Linux.
+ * Both directions are serviced from the main thread of each process by ProcessMessages(), so the audio thread never touches the connection.
+ * Your project needs to compile WDL/shm_connection.cpp */
+class ISharedMemoryConnection
+{
+public:
+  /** The size of each ring in bytes. Messages bigger than this are allowed, they just take more than one call to ProcessMessages() to go through */
+  static constexpr int kRingSize = 262144;
+
+  /** Open the connection. The plug-in side must be opened first
+   * @param isEditor \c true in the editor process, \c false in the plug-in
+   * @param name A name that identifies the connection, unique to the plug-in instance, which the plug-in passes to the editor process
+   * @param timeoutSec If nonzero, treat the connection as lost after this many seconds without hearing from the other side */
+  void Open(bool isEditor, const char* name, int timeoutSec = 0)
+  {
+    mConnection.reset(new WDL_SHM_Connection(isEditor, name, kRingSize, timeoutSec));
+  }
+
+  void Close() { mConnection = nullptr; }
+
+  bool IsOpen() const { return mConnection != nullptr; }
+
+  /** Queue a message for the other side */
+  void Send(const IByteChunk& msg)
+  {
+    if (!mConnection)
+      return;
+
+    const int size = msg.Size();
+    mConnection->send_queue.Add(&size, sizeof(int)); // both ends are on the same machine, so native byte order throughout
+    mConnection->send_queue.Add(msg.GetData(), size);
+  }
+
+  /** Send anything queued and call func(const WDL_String& verb, IByteStream& msg, int pos) for each message that has arrived, with pos just after the verb
+   * @return \c false if the connection has been lost, in which case it is closed */
+  template <typename FUNC>
+  bool ProcessMessages(FUNC&& func)
+  {
+    if (!mConnection)
+      return false;
+
+    if (mConnection->Run() < 0)
+    {
+      Close();
+      return false;
+    }
+
+    WDL_Queue& queue = mConnection->recv_queue;
+
+    while (queue.Available() >= (int) sizeof(int))
+    {
+      int size;
+      memcpy(&size, queue.Get(), sizeof(int));
+
+      if (queue.Available() < (int) sizeof(int) + size)
+        break;
+
+      queue.Advance(sizeof(int));
+
+      IByteStream msg(queue.Get(), size);
+      WDL_String verb;
+      const int pos = msg.GetStr(verb, 0);
+
+      if (pos > 0)
+        func(verb, msg, pos);
+
+      queue.Advance(size);
+    }
+
+    queue.Compact();
+    return true;
+  }
+
+private:
+  std::unique_ptr<WDL_SHM_Connection> mConnection;
+};
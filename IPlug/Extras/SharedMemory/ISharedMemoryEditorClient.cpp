@@ -0,0 +1,172 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#include "ISharedMemoryEditorClient.h"
+
+ISharedMemoryEditorClient::ISharedMemoryEditorClient(int nParams)
+: IGEditorDelegate(nParams)
+{
+}
+
+ISharedMemoryEditorClient::~ISharedMemoryEditorClient()
+{
+  DisconnectFromPlugin();
+}
+
+void ISharedMemoryEditorClient::ConnectToPlugin(const char* name)
+{
+  mConnection.Open(true, name);
+
+  WDL_String stateName;
+  stateName.SetFormatted(256, "%s-state", name); // see ISharedMemoryEditorDelegate::GetSharedMemoryStateName()
+  mState.Open(stateName.Get());
+
+  mMsg.Clear();
+  mMsg.PutStr("RDYFUI");
+  mConnection.Send(mMsg);
+}
+
+void ISharedMemoryEditorClient::DisconnectFromPlugin()
+{
+  mConnection.Close();
+  mState.Close();
+}
+
+bool ISharedMemoryEditorClient::ProcessSharedMemoryQueue()
+{
+  return mConnection.ProcessMessages([&](const WDL_String& verb, IByteStream& msg, int pos) {
+    OnMessageFromPlugin(verb, msg, pos);
+  });
+}
+
+void ISharedMemoryEditorClient::OnMessageFromPlugin(const WDL_String& verb, IByteStream& msg, int pos)
+{
+  const char* pVerb = verb.Get();
+
+  if (strcmp(pVerb, "SPVFD") == 0) // send parameter value from delegate
+  {
+    int paramIdx;
+    double value;
+    pos = msg.Get(&paramIdx, pos);
+    pos = msg.Get(&value, pos);
+
+    if (pos > 0 && paramIdx >= 0 && paramIdx < NParams())
+    {
+      GetParam(paramIdx)->SetNormalized(value);
+      SendParameterValueFromDelegate(paramIdx, value, true);
+    }
+  }
+  else if (strcmp(pVerb, "SCVFD") == 0) // send control value from delegate
+  {
+    int controlTag;
+    double value;
+    pos = msg.Get(&controlTag, pos);
+    pos = msg.Get(&value, pos);
+
+    if (pos > 0)
+      SendControlValueFromDelegate(controlTag, value);
+  }
+  else if (strcmp(pVerb, "SCMFD") == 0) // send control message from delegate
+  {
+    int controlTag, messageTag, dataSize;
+    pos = msg.Get(&controlTag, pos);
+    pos = msg.Get(&messageTag, pos);
+    pos = msg.Get(&dataSize, pos);
+
+    if (pos > 0 && dataSize >= 0 && pos + dataSize <= msg.Size())
+      SendControlMsgFromDelegate(controlTag, messageTag, dataSize, msg.GetData() + pos);
+  }
+  else if (strcmp(pVerb, "SAMFD") == 0) // send arbitrary message from delegate
+  {
+    int messageTag, dataSize;
+    pos = msg.Get(&messageTag, pos);
+    pos = msg.Get(&dataSize, pos);
+
+    if (pos > 0 && dataSize >= 0 && pos + dataSize <= msg.Size())
+      SendArbitraryMsgFromDelegate(messageTag, dataSize, msg.GetData() + pos);
+  }
+  else if (strcmp(pVerb, "SMMFD") == 0) // send midi message from delegate
+  {
+    IMidiMsg midiMsg;
+    pos = msg.Get(&midiMsg.mStatus, pos);
+    pos = msg.Get(&midiMsg.mData1, pos);
+    pos = msg.Get(&midiMsg.mData2, pos);
+
+    if (pos > 0)
+      SendMidiMsgFromDelegate(midiMsg);
+  }
+  else if (strcmp(pVerb, "SSMFD") == 0) // send sysex message from delegate
+  {
+    int dataSize;
+    pos = msg.Get(&dataSize, pos);
+
+    if (pos > 0 && dataSize >= 0 && pos + dataSize <= msg.Size())
+      SendSysexMsgFromDelegate(ISysEx(0, msg.GetData() + pos, dataSize));
+  }
+}
+
+void ISharedMemoryEditorClient::SendParamIdx(const char* verb, int paramIdx)
+{
+  mMsg.Clear();
+  mMsg.PutStr(verb);
+  mMsg.Put(&paramIdx);
+  mConnection.Send(mMsg);
+}
+
+void ISharedMemoryEditorClient::BeginInformHostOfParamChangeFromUI(int paramIdx)
+{
+  SendParamIdx("BPCFUI", paramIdx);
+}
+
+void ISharedMemoryEditorClient::SendParameterValueFromUI(int paramIdx, double normalizedValue)
+{
+  mMsg.Clear();
+  mMsg.PutStr("SPVFUI");
+  mMsg.Put(&paramIdx);
+  mMsg.Put(&normalizedValue);
+  mConnection.Send(mMsg);
+
+  IGEditorDelegate::SendParameterValueFromUI(paramIdx, normalizedValue);
+}
+
+void ISharedMemoryEditorClient::EndInformHostOfParamChangeFromUI(int paramIdx)
+{
+  SendParamIdx("EPCFUI", paramIdx);
+}
+
+void ISharedMemoryEditorClient::SendMidiMsgFromUI(const IMidiMsg& msg)
+{
+  mMsg.Clear();
+  mMsg.PutStr("SMMFUI");
+  mMsg.Put(&msg.mStatus);
+  mMsg.Put(&msg.mData1);
+  mMsg.Put(&msg.mData2);
+  mConnection.Send(mMsg);
+}
+
+void ISharedMemoryEditorClient::SendSysexMsgFromUI(const ISysEx& msg)
+{
+  mMsg.Clear();
+  mMsg.PutStr("SSMFUI");
+  mMsg.Put(&msg.mSize);
+  mMsg.PutBytes(msg.mData, msg.mSize);
+  mConnection.Send(mMsg);
+}
+
+void ISharedMemoryEditorClient::SendArbitraryMsgFromUI(int messageTag, int controlTag, int dataSize, const void* pData)
+{
+  mMsg.Clear();
+  mMsg.PutStr("SAMFUI");
+  mMsg.Put(&messageTag);
+  mMsg.Put(&controlTag);
+  mMsg.Put(&dataSize);
+  mMsg.PutBytes(pData, dataSize);
+  mConnection.Send(mMsg);
+}
@@ -0,0 +1,60 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+#include "IGraphicsEditorDelegate.h"
+#include "ISharedMemoryConnection.h"
+#include "ISharedMemoryStateBlock.h"
+
+/**
+ * @file
+ * @copydoc ISharedMemoryEditorClient
+ */
+
+/** The editor process side of an out of process editor, the counterpart of ISharedMemoryEditorDelegate in the plug-in.
+ * Changes made in the UI are sent to the plug-in, and values and messages from the plug-in update the UI, through the usual IGEditorDelegate methods.
+ * The editor process must initialise the same parameters as the plug-in (e.g. by sharing the code that does so), set up its IGraphics as usual,
+ * open the window with OpenWindow() and call ProcessSharedMemoryQueue() from its main loop */
+class ISharedMemoryEditorClient : public IGEditorDelegate
+{
+public:
+  ISharedMemoryEditorClient(int nParams);
+  virtual ~ISharedMemoryEditorClient();
+
+  /** Connect to the plug-in and ask it for the current state
+   * @param name The name the plug-in passed to ISharedMemoryEditorDelegate::OpenSharedMemoryEditor() */
+  void ConnectToPlugin(const char* name);
+
+  void DisconnectFromPlugin();
+
+  /** Call this repeatedly on the main thread to apply the messages from the plug-in and send the ones queued for it
+   * @return \c false if the connection to the plug-in has been lost, at which point the editor process should usually quit */
+  bool ProcessSharedMemoryQueue();
+
+  /** @return The plug-in's state block, opened by ConnectToPlugin(), whose meters the UI can read as it draws, e.g. in a control's Draw() */
+  const ISharedMemoryStateBlock& GetSharedMemoryState() const { return mState; }
+
+  //IEditorDelegate
+  void BeginInformHostOfParamChangeFromUI(int paramIdx) override;
+  void SendParameterValueFromUI(int paramIdx, double normalizedValue) override;
+  void EndInformHostOfParamChangeFromUI(int paramIdx) override;
+  void SendMidiMsgFromUI(const IMidiMsg& msg) override;
+  void SendSysexMsgFromUI(const ISysEx& msg) override;
+  void SendArbitraryMsgFromUI(int messageTag, int controlTag = kNoTag, int dataSize = 0, const void* pData = nullptr) override;
+
+private:
+  void OnMessageFromPlugin(const WDL_String& verb, IByteStream& msg, int pos);
+  void SendParamIdx(const char* verb, int paramIdx);
+
+  ISharedMemoryConnection mConnection;
+  ISharedMemoryStateBlock mState;
+  IByteChunk mMsg;
+};
@@ -0,0 +1,242 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#include "ISharedMemoryEditorDelegate.h"
+
+ISharedMemoryEditorDelegate::ISharedMemoryEditorDelegate(int nParams)
+: IGEditorDelegate(nParams)
+{
+}
+
+ISharedMemoryEditorDelegate::~ISharedMemoryEditorDelegate()
+{
+  CloseSharedMemoryEditor();
+}
+
+void ISharedMemoryEditorDelegate::OpenSharedMemoryEditor(const char* name, int nMeters)
+{
+  mConnectionName.Set(name);
+  mConnection.Open(false, name);
+
+  WDL_String stateName;
+  GetSharedMemoryStateName(stateName);
+
+  if (mState.Create(stateName.Get(), NParams(), nMeters))
+  {
+    for (int i = 0; i < NParams(); i++)
+      mState.SetParamValue(i, GetParam(i)->GetNormalized());
+  }
+}
+
+void ISharedMemoryEditorDelegate::CloseSharedMemoryEditor()
+{
+  mConnectionName.Set("");
+  mEditorConnected = false;
+  mConnection.Close();
+  mState.Close();
+}
+
+void ISharedMemoryEditorDelegate::ProcessSharedMemoryQueue()
+{
+  if (!mConnectionName.GetLength())
+    return;
+
+  const bool open = mConnection.ProcessMessages([&](const WDL_String& verb, IByteStream& msg, int pos) {
+    mInEditorMessage = true;
+    OnMessageFromEditor(verb, msg, pos);
+    mInEditorMessage = false;
+  });
+
+  if (!open)
+  {
+    // the editor process has gone, wait for another to connect
+    mEditorConnected = false;
+    mConnection.Open(false, mConnectionName.Get());
+  }
+}
+
+void ISharedMemoryEditorDelegate::SendToEditor()
+{
+  if (mEditorConnected)
+    mConnection.Send(mMsg);
+}
+
+// called on the main thread. The virtual methods called here go to the API class, which informs the host and queues for the processor
+void ISharedMemoryEditorDelegate::OnMessageFromEditor(const WDL_String& verb, IByteStream& msg, int pos)
+{
+  const char* pVerb = verb.Get();
+
+  if (strcmp(pVerb, "SPVFUI") == 0) // send parameter value from user interface
+  {
+    int paramIdx;
+    double value;
+    pos = msg.Get(&paramIdx, pos);
+    pos = msg.Get(&value, pos);
+
+    if (pos > 0 && paramIdx >= 0 && paramIdx < NParams())
+    {
+      SendParameterValueFromUI(paramIdx, value);
+      IGEditorDelegate::SendParameterValueFromDelegate(paramIdx, value, true); // update the in process UI, if it's open
+    }
+  }
+  else if (strcmp(pVerb, "BPCFUI") == 0 || strcmp(pVerb, "EPCFUI") == 0) // begin/end parameter change from user interface
+  {
+    int paramIdx;
+    pos = msg.Get(&paramIdx, pos);
+
+    if (pos > 0 && paramIdx >= 0 && paramIdx < NParams())
+    {
+      if (pVerb[0] == 'B')
+        BeginInformHostOfParamChangeFromUI(paramIdx);
+      else
+        EndInformHostOfParamChangeFromUI(paramIdx);
+    }
+  }
+  else if (strcmp(pVerb, "SMMFUI") == 0) // send midi message from user interface
+  {
+    IMidiMsg midiMsg;
+    pos = msg.Get(&midiMsg.mStatus, pos);
+    pos = msg.Get(&midiMsg.mData1, pos);
+    pos = msg.Get(&midiMsg.mData2, pos);
+
+    if (pos > 0)
+    {
+      SendMidiMsgFromUI(midiMsg);
+      IGEditorDelegate::SendMidiMsgFromDelegate(midiMsg);
+    }
+  }
+  else if (strcmp(pVerb, "SSMFUI") == 0) // send sysex message from user interface
+  {
+    int dataSize;
+    pos = msg.Get(&dataSize, pos);
+
+    if (pos > 0 && dataSize >= 0 && pos + dataSize <= msg.Size())
+      SendSysexMsgFromUI(ISysEx(0, msg.GetData() + pos, dataSize));
+  }
+  else if (strcmp(pVerb, "SAMFUI") == 0) // send arbitrary message from user interface
+  {
+    int messageTag, controlTag, dataSize;
+    pos = msg.Get(&messageTag, pos);
+    pos = msg.Get(&controlTag, pos);
+    pos = msg.Get(&dataSize, pos);
+
+    if (pos > 0 && dataSize >= 0 && pos + dataSize <= msg.Size())
+      SendArbitraryMsgFromUI(messageTag, controlTag, dataSize, msg.GetData() + pos);
+  }
+  else if (strcmp(pVerb, "RDYFUI") == 0) // the editor process has connected and needs the current state
+  {
+    mEditorConnected = true;
+    SendCurrentParamValuesFromDelegate();
+  }
+}
+
+void ISharedMemoryEditorDelegate::SendParameterValueFromUI(int paramIdx, double normalizedValue)
+{
+  mState.SetParamValue(paramIdx, normalizedValue);
+
+  if (!mInEditorMessage)
+  {
+    mMsg.Clear();
+    mMsg.PutStr("SPVFD");
+    mMsg.Put(&paramIdx);
+    mMsg.Put(&normalizedValue);
+    SendToEditor();
+  }
+
+  IGEditorDelegate::SendParameterValueFromUI(paramIdx, normalizedValue);
+}
+
+void ISharedMemoryEditorDelegate::SendMidiMsgFromUI(const IMidiMsg& msg)
+{
+  if (!mInEditorMessage)
+  {
+    mMsg.Clear();
+    mMsg.PutStr("SMMFD");
+    mMsg.Put(&msg.mStatus);
+    mMsg.Put(&msg.mData1);
+    mMsg.Put(&msg.mData2);
+    SendToEditor();
+  }
+
+  IGEditorDelegate::SendMidiMsgFromUI(msg);
+}
+
+void ISharedMemoryEditorDelegate::SendParameterValueFromDelegate(int paramIdx, double value, bool normalized)
+{
+  double normalizedValue = normalized ? value : GetParam(paramIdx)->ToNormalized(value);
+  mState.SetParamValue(paramIdx, normalizedValue);
+
+  mMsg.Clear();
+  mMsg.PutStr("SPVFD");
+  mMsg.Put(&paramIdx);
+  mMsg.Put(&normalizedValue);
+  SendToEditor();
+
+  IGEditorDelegate::SendParameterValueFromDelegate(paramIdx, value, normalized);
+}
+
+void ISharedMemoryEditorDelegate::SendControlValueFromDelegate(int controlTag, double normalizedValue)
+{
+  mMsg.Clear();
+  mMsg.PutStr("SCVFD");
+  mMsg.Put(&controlTag);
+  mMsg.Put(&normalizedValue);
+  SendToEditor();
+
+  IGEditorDelegate::SendControlValueFromDelegate(controlTag, normalizedValue);
+}
+
+void ISharedMemoryEditorDelegate::SendControlMsgFromDelegate(int controlTag, int messageTag, int dataSize, const void* pData)
+{
+  mMsg.Clear();
+  mMsg.PutStr("SCMFD");
+  mMsg.Put(&controlTag);
+  mMsg.Put(&messageTag);
+  mMsg.Put(&dataSize);
+  mMsg.PutBytes(pData, dataSize);
+  SendToEditor();
+
+  IGEditorDelegate::SendControlMsgFromDelegate(controlTag, messageTag, dataSize, pData);
+}
+
+void ISharedMemoryEditorDelegate::SendArbitraryMsgFromDelegate(int messageTag, int dataSize, const void* pData)
+{
+  mMsg.Clear();
+  mMsg.PutStr("SAMFD");
+  mMsg.Put(&messageTag);
+  mMsg.Put(&dataSize);
+  mMsg.PutBytes(pData, dataSize);
+  SendToEditor();
+
+  IGEditorDelegate::SendArbitraryMsgFromDelegate(messageTag, dataSize, pData);
+}
+
+void ISharedMemoryEditorDelegate::SendMidiMsgFromDelegate(const IMidiMsg& msg)
+{
+  mMsg.Clear();
+  mMsg.PutStr("SMMFD");
+  mMsg.Put(&msg.mStatus);
+  mMsg.Put(&msg.mData1);
+  mMsg.Put(&msg.mData2);
+  SendToEditor();
+
+  IGEditorDelegate::SendMidiMsgFromDelegate(msg);
+}
+
+void ISharedMemoryEditorDelegate::SendSysexMsgFromDelegate(const ISysEx& msg)
+{
+  mMsg.Clear();
+  mMsg.PutStr("SSMFD");
+  mMsg.Put(&msg.mSize);
+  mMsg.PutBytes(msg.mData, msg.mSize);
+  SendToEditor();
+
+  IGEditorDelegate::SendSysexMsgFromDelegate(msg);
+}
@@ -0,0 +1,80 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+#include "IGraphicsEditorDelegate.h"
+#include "ISharedMemoryConnection.h"
+#include "ISharedMemoryStateBlock.h"
+
+/**
+ * @file
+ * @copydoc ISharedMemoryEditorDelegate
+ */
+
+/** An IEditorDelegate base class for plug-ins whose editor can run in another process, connected over shared memory (see ISharedMemoryConnection).
+ * The editor process uses ISharedMemoryEditorClient. Heavy UIs then draw without competing with the host's UI thread or using its memory, and a crash
+ * in the editor doesn't take the host down. The in process IGraphics UI still works, and is kept in sync with the remote one.
+ * Select it by defining SHM_EDITOR_SERVER, then call OpenSharedMemoryEditor() with a name that you pass to the editor process (e.g. on its command line),
+ * and ProcessSharedMemoryQueue() from your plug-in's OnIdle().
+ * The parameter values and any meters are also published in an ISharedMemoryStateBlock, for local control surfaces and companion apps to read without messages,
+ * see GetSharedMemoryStateName() and SetSharedMemoryMeter() */
+class ISharedMemoryEditorDelegate : public IGEditorDelegate
+{
+public:
+  ISharedMemoryEditorDelegate(int nParams);
+  virtual ~ISharedMemoryEditorDelegate();
+
+  /** Open the plug-in side of the connection. Call this before starting the editor process
+   * @param name Identifies the connection, must be unique to this plug-in instance
+   * @param nMeters The number of meters to publish in the state block, see SetSharedMemoryMeter() */
+  void OpenSharedMemoryEditor(const char* name, int nMeters = 0);
+
+  void CloseSharedMemoryEditor();
+
+  /** @return \c true if the connection is open, whether or not an editor process has connected to it yet */
+  bool SharedMemoryEditorIsOpen() const { return mConnection.IsOpen(); }
+
+  /** @param name Set to the name of the state block, which the other process opens with ISharedMemoryStateBlock::Open() */
+  void GetSharedMemoryStateName(WDL_String& name) const { name.SetFormatted(256, "%s-state", mConnectionName.Get()); }
+
+  /** Publish a meter's value in the state block. Any thread, including the audio thread, e.g. from ProcessBlock() with the peak of the block
+   * @param meterIdx The index of the meter, less than the number passed to OpenSharedMemoryEditor()
+   * @param value The value */
+  void SetSharedMemoryMeter(int meterIdx, float value) { mState.SetMeterValue(meterIdx, value); }
+
+  /** Call this repeatedly on the main thread, e.g. from OnIdle(), to apply the messages from the editor process and send the ones queued for it */
+  void ProcessSharedMemoryQueue();
+
+  //IEditorDelegate
+  // changes made in the in process UI are mirrored to the editor process
+  void SendParameterValueFromUI(int paramIdx, double normalizedValue) override;
+  void SendMidiMsgFromUI(const IMidiMsg& msg) override;
+
+  void SendParameterValueFromDelegate(int paramIdx, double value, bool normalized) override;
+  void SendControlValueFromDelegate(int controlTag, double normalizedValue) override;
+  void SendControlMsgFromDelegate(int controlTag, int messageTag, int dataSize, const void* pData) override;
+  void SendArbitraryMsgFromDelegate(int messageTag, int dataSize, const void* pData) override;
+  void SendMidiMsgFromDelegate(const IMidiMsg& msg) override;
+  void SendSysexMsgFromDelegate(const ISysEx& msg) override;
+
+private:
+  void OnMessageFromEditor(const WDL_String& verb, IByteStream& msg, int pos);
+
+  /** Queue mMsg for the editor process. Nothing is queued until an editor has connected, so that the queue can't grow without one */
+  void SendToEditor();
+
+  ISharedMemoryConnection mConnection;
+  ISharedMemoryStateBlock mState;
+  WDL_String mConnectionName;
+  bool mEditorConnected = false;
+  bool mInEditorMessage = false; // set while a message from the editor process is applied, so that it isn't echoed back
+  IByteChunk mMsg;
+};
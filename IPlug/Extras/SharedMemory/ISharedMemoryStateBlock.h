@@ -0,0 +1,274 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc ISharedMemoryStateBlock
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+
+#include "IPlugPlatform.h"
+
+#if defined OS_WIN
+  #include <windows.h>
+#elif !defined OS_WEB
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2, "the values are shared between processes, which needs lock-free atomics");
+
+/** A block of shared memory that a plug-in publishes its parameter values and meters in, for a control surface, companion app or out of process editor
+ * on the same machine to read directly. Nothing is copied or sent: the writer stores each value atomically, and a reader loads it from the mapped memory whenever it draws,
+ * so a meter written on the audio thread is visible at once, without going through the main thread or a socket. Each parameter also has a generation, incremented on each change,
+ * and the block a generation of all of them, so that a reader can skip the parameters that haven't changed.
+ * Changes going the other way, from the controller, are messages, see ISharedMemoryConnection. The plug-in creates the block, e.g. with ISharedMemoryEditorDelegate::OpenSharedMemoryEditor(),
+ * and the other process opens it by the same name. It is a POSIX shared memory object on macOS and Linux (link librt on older glibc), and a named file mapping on Windows */
+class ISharedMemoryStateBlock
+{
+public:
+  static constexpr uint32_t kMagic = 0x424D5349; // "ISMB"
+  static constexpr uint32_t kVersion = 1;
+
+  ISharedMemoryStateBlock() = default;
+  ~ISharedMemoryStateBlock() { Close(); }
+
+  ISharedMemoryStateBlock(const ISharedMemoryStateBlock&) = delete;
+  ISharedMemoryStateBlock& operator=(const ISharedMemoryStateBlock&) = delete;
+
+  /** Create the block, in the plug-in. The values start at 0
+   * @param name Identifies the block, unique to the plug-in instance and short, since macOS allows 30 characters
+   * @param nParams The number of parameter values
+   * @param nMeters The number of meter values
+   * @return \c true if the block was created */
+  bool Create(const char* name, int nParams, int nMeters)
+  {
+    Close();
+
+    const size_t size = GetSize(nParams, nMeters);
+
+    if (!Map(name, size, true))
+      return false;
+
+    Header* pHeader = new (mpData) Header;
+    pHeader->nParams = nParams;
+    pHeader->nMeters = nMeters;
+
+    for (int i = 0; i < nParams; i++)
+    {
+      new (&GetParamValues()[i]) std::atomic<uint64_t>(0);
+      new (&GetParamGenerations()[i]) std::atomic<uint32_t>(0);
+    }
+
+    for (int i = 0; i < nMeters; i++)
+      new (&GetMeterValues()[i]) std::atomic<uint32_t>(0);
+
+    pHeader->version = kVersion;
+    pHeader->magic.store(kMagic, std::memory_order_release); // last, so a reader doesn't see a block that is being made
+    return true;
+  }
+
+  /** Open a block created by another process
+   * @param name The name the block was created with
+   * @return \c true if the block was opened, \c false if it doesn't exist yet or its version is different */
+  bool Open(const char* name)
+  {
+    Close();
+
+    if (!Map(name, sizeof(Header), false))
+      return false;
+
+    const Header* pHeader = GetHeader();
+
+    if (pHeader->magic.load(std::memory_order_acquire) != kMagic || pHeader->version != kVersion)
+    {
+      Close();
+      return false;
+    }
+
+    const int nParams = pHeader->nParams;
+    const int nMeters = pHeader->nMeters;
+    Unmap();
+
+    // now that the size is known, map all of it
+    return Map(name, GetSize(nParams, nMeters), false);
+  }
+
+  void Close()
+  {
+    Unmap();
+#if !defined OS_WIN && !defined OS_WEB
+    if (mCreated)
+      shm_unlink(mName.c_str());
+#endif
+    mCreated = false;
+  }
+
+  bool IsOpen() const { return mpData != nullptr; }
+
+  int NParams() const { return mpData ? GetHeader()->nParams : 0; }
+  int NMeters() const { return mpData ? GetHeader()->nMeters : 0; }
+
+  /** Store a parameter's value. Any thread, but one at a time for each parameter
+   * @param paramIdx The index of the parameter
+   * @param normalizedValue The value */
+  void SetParamValue(int paramIdx, double normalizedValue)
+  {
+    if (paramIdx < 0 || paramIdx >= NParams())
+      return;
+
+    uint64_t bits;
+    memcpy(&bits, &normalizedValue, sizeof(bits));
+    GetParamValues()[paramIdx].store(bits, std::memory_order_relaxed);
+    GetParamGenerations()[paramIdx].fetch_add(1, std::memory_order_release);
+    GetHeader()->generation.fetch_add(1, std::memory_order_release);
+  }
+
+  /** @param paramIdx The index of the parameter
+   * @return The normalized value last stored */
+  double GetParamValue(int paramIdx) const
+  {
+    if (paramIdx < 0 || paramIdx >= NParams())
+      return 0.;
+
+    const uint64_t bits = GetParamValues()[paramIdx].load(std::memory_order_relaxed);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+
+  /** @param paramIdx The index of the parameter
+   * @return The number of times the parameter's value has been stored, which a reader compares with the one it last saw */
+  uint32_t GetParamGeneration(int paramIdx) const { return paramIdx >= 0 && paramIdx < NParams() ? GetParamGenerations()[paramIdx].load(std::memory_order_acquire) : 0; }
+
+  /** @return The number of times any parameter's value has been stored, so that a reader only looks through them when it has changed */
+  uint32_t GetGeneration() const { return mpData ? GetHeader()->generation.load(std::memory_order_acquire) : 0; }
+
+  /** Store a meter's value. Any thread, including the audio thread, since this doesn't lock, allocate or call the OS
+   * @param meterIdx The index of the meter
+   * @param value The value, in whatever units the reader expects */
+  void SetMeterValue(int meterIdx, float value)
+  {
+    if (meterIdx < 0 || meterIdx >= NMeters())
+      return;
+
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    GetMeterValues()[meterIdx].store(bits, std::memory_order_relaxed);
+  }
+
+  /** @param meterIdx The index of the meter
+   * @return The value last stored */
+  float GetMeterValue(int meterIdx) const
+  {
+    if (meterIdx < 0 || meterIdx >= NMeters())
+      return 0.f;
+
+    const uint32_t bits = GetMeterValues()[meterIdx].load(std::memory_order_relaxed);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+
+private:
+  struct Header
+  {
+    std::atomic<uint32_t> magic {0};
+    uint32_t version = 0;
+    int32_t nParams = 0;
+    int32_t nMeters = 0;
+    std::atomic<uint32_t> generation {0};
+  };
+
+  static constexpr size_t kHeaderSize = 64; // keeps the values on their own cache lines
+
+  static size_t GetSize(int nParams, int nMeters) { return kHeaderSize + nParams * (sizeof(uint64_t) + sizeof(uint32_t)) + nMeters * sizeof(uint32_t); }
+
+  Header* GetHeader() const { return reinterpret_cast<Header*>(mpData); }
+  std::atomic<uint64_t>* GetParamValues() const { return reinterpret_cast<std::atomic<uint64_t>*>(mpData + kHeaderSize); }
+  std::atomic<uint32_t>* GetParamGenerations() const { return reinterpret_cast<std::atomic<uint32_t>*>(mpData + kHeaderSize + GetHeader()->nParams * sizeof(uint64_t)); }
+  std::atomic<uint32_t>* GetMeterValues() const { return GetParamGenerations() + GetHeader()->nParams; }
+
+  bool Map(const char* name, size_t size, bool create)
+  {
+#if defined OS_WIN
+    std::string mappingName = std::string("Local\\ISharedMemoryStateBlock_") + name;
+
+    if (create)
+      mMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, static_cast<DWORD>(static_cast<uint64_t>(size) >> 32), static_cast<DWORD>(size), mappingName.c_str());
+    else
+      mMapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, mappingName.c_str());
+
+    if (!mMapping)
+      return false;
+
+    mpData = static_cast<uint8_t*>(MapViewOfFile(mMapping, FILE_MAP_ALL_ACCESS, 0, 0, size));
+#elif !defined OS_WEB
+    mName = std::string("/") + name;
+
+    const int fd = shm_open(mName.c_str(), create ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR, 0600);
+
+    if (fd < 0)
+      return false;
+
+    mCreated = create;
+    struct stat st;
+
+    if ((!create || ftruncate(fd, static_cast<off_t>(size)) == 0) && fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= size)
+    {
+      void* pData = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+      if (pData != MAP_FAILED)
+        mpData = static_cast<uint8_t*>(pData);
+    }
+
+    // the mapping keeps the object open
+    close(fd);
+#endif
+    mSize = mpData ? size : 0;
+    return mpData != nullptr;
+  }
+
+  void Unmap()
+  {
+#if defined OS_WIN
+    if (mpData)
+      UnmapViewOfFile(mpData);
+
+    if (mMapping)
+      CloseHandle(mMapping);
+
+    mMapping = NULL;
+#elif !defined OS_WEB
+    if (mpData)
+      munmap(mpData, mSize);
+#endif
+    mpData = nullptr;
+    mSize = 0;
+  }
+
+  uint8_t* mpData = nullptr;
+  size_t mSize = 0;
+  bool mCreated = false;
+#if defined OS_WIN
+  HANDLE mMapping = NULL;
+#else
+  std::string mName;
+#endif
+};
@@ -0,0 +1,242 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc SharedTable
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "IPlugMemoryReport.h"
+#include "IPlugWorkerPool.h"
+
+/** Identifies a table in the process: what it is, the sample rate it was made for, and the values it was designed with.
+ * Two instances asking for the same key share one table, so the key must include everything the table depends on */
+struct SharedTableKey
+{
+  /** @param id What the table is, e.g. "MyPlugin-tanh" or "HalfBandFIR"
+   * @param sampleRate The sample rate the table is for, or 0 if it doesn't depend on one
+   * @param params The other values the table is designed with, e.g. a filter's order and cutoff */
+  SharedTableKey(const char* id, double sampleRate = 0., std::initializer_list<double> params = {})
+  : id(id)
+  , sampleRate(sampleRate)
+  , params(params)
+  {}
+
+  bool operator==(const SharedTableKey& other) const { return sampleRate == other.sampleRate && id == other.id && params == other.params; }
+
+  std::string id;
+  double sampleRate;
+  std::vector<double> params;
+};
+
+struct SharedTableKeyHash
+{
+  size_t operator()(const SharedTableKey& key) const
+  {
+    size_t hash = std::hash<std::string>()(key.id) ^ (std::hash<double>()(key.sampleRate) * 31);
+
+    for (double param : key.params)
+      hash = hash * 131 ^ std::hash<double>()(param);
+
+    return hash;
+  }
+};
+
+/** The bytes a table holds, for the memory report. Overload this for tables that own more than sizeof(T) */
+template <typename T>
+size_t GetSharedTableBytes(const T& table) { return sizeof(T); }
+
+template <typename T>
+size_t GetSharedTableBytes(const std::vector<T>& table) { return sizeof(table) + table.capacity() * sizeof(T); }
+
+/** A handle on read-only DSP data that every instance in the process would otherwise build for itself, such as a waveshaper's lookup table, a window function or the
+ * coefficients of a filter at a sample rate. The first handle to ask for a key builds the table, either at once or on an IPlugWorkerPool thread, and later handles
+ * for the key share it. The table is freed when the last handle for it is released, in the same way as StaticStorage keeps the bitmaps while an IGraphics uses them, e.g.
+ * @code
+ * SharedTable<std::vector<float>> mShaper;
+ *
+ * void OnReset() override
+ * {
+ *   mShaper.Acquire({"MyPlugin-tanh", 0., {4096.}}, []() { return MakeTanhTable(4096); });
+ * }
+ *
+ * void ProcessBlock(sample** inputs, sample** outputs, int nFrames) override
+ * {
+ *   if (const std::vector<float>* pShaper = mShaper.Get())
+ *     ...
+ * }
+ * @endcode
+ * Acquire() and Release() lock a mutex, so call them outside of the audio thread, and not while the audio thread reads the same handle, e.g. in the constructor or OnReset().
+ * Get() doesn't lock, and can be called on any thread.
+ * The tables of a type T are reported to IMemoryRegistry, under "Shared tables" */
+template <typename T>
+class SharedTable
+{
+public:
+  /** Makes a new table, of which the registry takes ownership. Called on a worker thread when built in the background */
+  using BuildFunc = std::function<T*()>;
+
+  SharedTable() {}
+
+  /** @see Acquire() */
+  SharedTable(const SharedTableKey& key, BuildFunc build, bool buildInBackground = false)
+  {
+    Acquire(key, std::move(build), buildInBackground);
+  }
+
+  ~SharedTable() { Release(); }
+
+  SharedTable(const SharedTable&) = delete;
+  SharedTable& operator=(const SharedTable&) = delete;
+
+  /** Use the table for a key, releasing the one held before. The table is built if no handle in the process holds it. Not realtime safe
+   * @param key The table's key
+   * @param build Makes the table, if it has to be built. It must only depend on the key
+   * @param buildInBackground \c true to build it on a worker thread, when Get() returns nullptr until it is ready, \c false to build it before returning.
+   * A table that another handle is building in the background is not ready either, unless Wait() is called */
+  void Acquire(const SharedTableKey& key, BuildFunc build, bool buildInBackground = false)
+  {
+    if (mEntry && mEntry->key == key)
+      return;
+
+    Release();
+
+    Storage& storage = GetStorage();
+    bool isNew = false;
+
+    {
+      std::lock_guard<std::mutex> lock(storage.mMutex);
+      std::shared_ptr<Entry>& entry = storage.mEntries[key];
+
+      if (!entry)
+      {
+        entry = std::make_shared<Entry>(key);
+        isNew = true;
+      }
+
+      entry->users++;
+      mEntry = entry;
+    }
+
+    if (!isNew)
+      return;
+
+    if (buildInBackground)
+    {
+      std::shared_ptr<Entry> entry = mEntry; // the job keeps the entry alive if the last handle is released before it runs
+
+      IPlugWorkerPool::Get().Submit(std::make_shared<IPlugJob>([entry, build](IPlugJob&) { entry->Build(build); },
+                                                               nullptr, IPlugJob::kPriorityNormal, IPlugJob::ECompletionThread::kMainThread));
+    }
+    else
+      mEntry->Build(build);
+  }
+
+  /** Stop using the table, which is freed if no other handle uses it. Not realtime safe */
+  void Release()
+  {
+    if (!mEntry)
+      return;
+
+    Storage& storage = GetStorage();
+    std::lock_guard<std::mutex> lock(storage.mMutex);
+
+    if (--mEntry->users == 0)
+      storage.mEntries.erase(mEntry->key);
+
+    mEntry = nullptr;
+  }
+
+  /** @return The table, or nullptr if none is acquired, or it is still being built. Doesn't lock, so it can be called on the audio thread */
+  const T* Get() const { return mEntry ? mEntry->pTable.load(std::memory_order_acquire) : nullptr; }
+
+  /** @return \c true if the table is acquired and built */
+  bool IsReady() const { return Get() != nullptr; }
+
+  /** Block until the table has been built, e.g. before processing starts when it was built in the background. Not realtime safe
+   * @return The table, or nullptr if none is acquired */
+  const T* Wait() const
+  {
+    if (!mEntry)
+      return nullptr;
+
+    std::unique_lock<std::mutex> lock(mEntry->mutex);
+    mEntry->built.wait(lock, [this]() { return mEntry->pTable.load() != nullptr; });
+    return mEntry->pTable.load();
+  }
+
+private:
+  struct Entry
+  {
+    Entry(const SharedTableKey& key)
+    : key(key)
+    {}
+
+    void Build(const BuildFunc& build)
+    {
+      T* pNew = build();
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        table.reset(pNew);
+        bytes = GetSharedTableBytes(*pNew);
+        pTable.store(pNew, std::memory_order_release);
+      }
+
+      built.notify_all();
+    }
+
+    const SharedTableKey key;
+    std::unique_ptr<T> table;
+    std::atomic<const T*> pTable {nullptr};
+    std::atomic<size_t> bytes {0};
+    int users = 0; // guarded by the storage's mutex
+    std::mutex mutex;
+    std::condition_variable built;
+  };
+
+  struct Storage
+  {
+    Storage()
+    : mRegistration([this](IMemoryReport& report) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        size_t bytes = 0;
+
+        for (auto& entry : mEntries)
+          bytes += entry.second->bytes.load();
+
+        report.Add(kMemoryShared, "Shared tables", bytes, static_cast<int>(mEntries.size()));
+      })
+    {}
+
+    std::mutex mMutex;
+    std::unordered_map<SharedTableKey, std::shared_ptr<Entry>, SharedTableKeyHash> mEntries;
+    IMemoryRegistry::Registration mRegistration; // last, so that it is unregistered before the entries go
+  };
+
+  static Storage& GetStorage()
+  {
+    static Storage sStorage;
+    return sStorage;
+  }
+
+  std::shared_ptr<Entry> mEntry;
+};
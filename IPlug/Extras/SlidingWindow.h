@@ -0,0 +1,264 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * Sliding window detectors for dynamics and metering: the maximum or minimum, and the RMS level, of the last W samples of N channels, updated every sample.
+ * Each costs a few operations per sample whatever the window, where searching or summing the window costs O(W), so a lookahead limiter can use a 10 ms window.
+ * The channels are lanes, laid out as in VoiceLanes.h, so that the loops over the lanes have a fixed length and the compiler vectorizes them:
+ * N should match the vector width for T, e.g. 4 for float with SSE or NEON, 2 for double, with unused lanes fed silence.
+ * A detector for a linked stereo limiter is a single lane fed with the larger magnitude of the two channels.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "heapbuf.h"
+
+/** The maximum, or minimum, of the last W samples of N lanes, with the van Herk/Gil-Werman algorithm.
+ * The input is cut into segments of W samples. The output is the extreme of the current segment so far, which is kept as a running value, and of the part of the previous
+ * segment still in the window, which is read from the previous segment's suffix extremes, computed in one backward pass when the segment ends.
+ * That is three comparisons per sample, however long the window, and no branches in the lanes. The output includes the current sample, so for a lookahead limiter
+ * the signal should be delayed by W - 1 samples, e.g. with NChanDelayLine, to line its peaks up with the end of the window
+ * @tparam T The sample type
+ * @tparam N The number of lanes
+ * @tparam MIN \c true for the minimum rather than the maximum */
+template <typename T, int N, bool MIN = false>
+class SlidingExtremumLanes
+{
+public:
+  /** @param windowSize The number of samples in the window, see SetWindowSize() */
+  SlidingExtremumLanes(int windowSize = 1)
+  {
+    SetWindowSize(windowSize);
+  }
+
+  /** Allocate the window and reset it to silence, this is not realtime safe
+   * @param windowSize The number of samples in the window, at least 1 */
+  void SetWindowSize(int windowSize)
+  {
+    mWindowSize = std::max(windowSize, 1);
+    mSegment.Resize(mWindowSize * N);
+    mSuffix.Resize((mWindowSize + 1) * N);
+    Reset();
+  }
+
+  int GetWindowSize() const { return mWindowSize; }
+
+  /** Fill the window with a value, as though the last W samples of every lane were that value
+   * @param value The value, 0 for silence */
+  void Reset(T value = T(0))
+  {
+    T* pSuffix = mSuffix.Get();
+    std::fill(pSuffix, pSuffix + mWindowSize * N, value);
+    std::fill(pSuffix + mWindowSize * N, pSuffix + (mWindowSize + 1) * N, Identity());
+    std::fill(mPrefix, mPrefix + N, value);
+    mPos = 0;
+  }
+
+  /** Add the next sample of each lane
+   * @param pInput The samples of the N lanes
+   * @param pOutput Set to the extreme of the last W samples of each lane, including this one. May be the same as pInput */
+  inline void Process(const T* pInput, T* pOutput)
+  {
+    T* pSegment = mSegment.Get() + mPos * N;
+    const T* pSuffix = mSuffix.Get() + (mPos + 1) * N;
+
+    if (mPos == 0)
+    {
+      for (int l = 0; l < N; l++)
+        mPrefix[l] = pInput[l];
+    }
+    else
+    {
+      for (int l = 0; l < N; l++)
+        mPrefix[l] = Pick(mPrefix[l], pInput[l]);
+    }
+
+    for (int l = 0; l < N; l++)
+    {
+      pSegment[l] = pInput[l];
+      pOutput[l] = Pick(mPrefix[l], pSuffix[l]);
+    }
+
+    if (++mPos == mWindowSize)
+      EndSegment();
+  }
+
+  /** Process a block of separate channels, e.g. a plug-in's inputs
+   * @param inputs One buffer for each channel
+   * @param outputs One buffer for each channel, which may be the inputs
+   * @param nFrames The number of samples in each buffer
+   * @param nChans The number of channels, at most N. The other lanes are fed silence
+   * @param rectify \c true to measure the magnitude of the input, for peak detection */
+  void ProcessBlock(T** inputs, T** outputs, int nFrames, int nChans = N, bool rectify = false)
+  {
+    if (rectify)
+      ProcessFrames<true>(inputs, outputs, nFrames, std::min(nChans, N));
+    else
+      ProcessFrames<false>(inputs, outputs, nFrames, std::min(nChans, N));
+  }
+
+private:
+  static inline T Pick(T a, T b) { return MIN ? (b < a ? b : a) : (b > a ? b : a); }
+
+  static constexpr T Identity() { return MIN ? std::numeric_limits<T>::max() : std::numeric_limits<T>::lowest(); }
+
+  // the suffix extremes of the segment that just ended, for the next one
+  void EndSegment()
+  {
+    const T* pSegment = mSegment.Get();
+    T* pSuffix = mSuffix.Get();
+
+    for (int i = mWindowSize - 1; i >= 0; i--)
+    {
+      for (int l = 0; l < N; l++)
+        pSuffix[i * N + l] = Pick(pSegment[i * N + l], pSuffix[(i + 1) * N + l]);
+    }
+
+    mPos = 0;
+  }
+
+  template <bool RECTIFY>
+  void ProcessFrames(T** inputs, T** outputs, int nFrames, int nChans)
+  {
+    T frame[N] = {};
+
+    for (int s = 0; s < nFrames; s++)
+    {
+      for (int c = 0; c < nChans; c++)
+        frame[c] = RECTIFY ? std::fabs(inputs[c][s]) : inputs[c][s];
+
+      Process(frame, frame);
+
+      for (int c = 0; c < nChans; c++)
+        outputs[c][s] = frame[c];
+
+      // Process() wrote the lanes' outputs back into the frame
+      for (int c = nChans; c < N; c++)
+        frame[c] = T(0);
+    }
+  }
+
+  int mWindowSize = 1;
+  int mPos = 0; // the position of the next sample in the current segment
+  T mPrefix[N]; // the extreme of the current segment so far
+  WDL_TypedBuf<T> mSegment; // the samples of the current segment, W frames of N lanes
+  WDL_TypedBuf<T> mSuffix; // the previous segment's extremes from each position to its end, W + 1 frames, the last the identity
+};
+
+template <typename T, int N>
+using SlidingMaxLanes = SlidingExtremumLanes<T, N, false>;
+
+template <typename T, int N>
+using SlidingMinLanes = SlidingExtremumLanes<T, N, true>;
+
+/** The RMS level of the last W samples of N lanes, from a running sum of the squares: each sample adds its square and takes away the square of the sample leaving the window.
+ * The rounding errors of a running sum accumulate, so a second sum is kept from scratch as the ring of squares is overwritten, and replaces the running sum each time
+ * the ring has been overwritten in full, since that is then the exact sum of the window. The error stays that of one window's additions, even for float
+ * @tparam T The sample type
+ * @tparam N The number of lanes */
+template <typename T, int N>
+class SlidingRMSLanes
+{
+public:
+  /** @param windowSize The number of samples in the window, see SetWindowSize() */
+  SlidingRMSLanes(int windowSize = 1)
+  {
+    SetWindowSize(windowSize);
+  }
+
+  /** Allocate the window and reset it to silence, this is not realtime safe
+   * @param windowSize The number of samples in the window, at least 1 */
+  void SetWindowSize(int windowSize)
+  {
+    mWindowSize = std::max(windowSize, 1);
+    mReciprocal = T(1) / static_cast<T>(mWindowSize);
+    mSquares.Resize(mWindowSize * N);
+    Reset();
+  }
+
+  int GetWindowSize() const { return mWindowSize; }
+
+  /** Fill the window with silence */
+  void Reset()
+  {
+    std::fill(mSquares.Get(), mSquares.Get() + mWindowSize * N, T(0));
+    std::fill(mSum, mSum + N, T(0));
+    std::fill(mFreshSum, mFreshSum + N, T(0));
+    mPos = 0;
+  }
+
+  /** Add the next sample of each lane
+   * @param pInput The samples of the N lanes
+   * @param pOutput Set to the RMS level of the last W samples of each lane, including this one. May be the same as pInput */
+  inline void Process(const T* pInput, T* pOutput)
+  {
+    T* pSquares = mSquares.Get() + mPos * N;
+
+    for (int l = 0; l < N; l++)
+    {
+      const T square = pInput[l] * pInput[l];
+      mSum[l] += square - pSquares[l];
+      mFreshSum[l] += square;
+      pSquares[l] = square;
+      pOutput[l] = std::sqrt(std::max(mSum[l], T(0)) * mReciprocal);
+    }
+
+    if (++mPos == mWindowSize)
+    {
+      for (int l = 0; l < N; l++)
+      {
+        mSum[l] = mFreshSum[l];
+        mFreshSum[l] = T(0);
+      }
+
+      mPos = 0;
+    }
+  }
+
+  /** Process a block of separate channels, e.g. a plug-in's inputs
+   * @param inputs One buffer for each channel
+   * @param outputs One buffer for each channel, which may be the inputs
+   * @param nFrames The number of samples in each buffer
+   * @param nChans The number of channels, at most N. The other lanes are fed silence */
+  void ProcessBlock(T** inputs, T** outputs, int nFrames, int nChans = N)
+  {
+    nChans = std::min(nChans, N);
+    T frame[N] = {};
+
+    for (int s = 0; s < nFrames; s++)
+    {
+      for (int c = 0; c < nChans; c++)
+        frame[c] = inputs[c][s];
+
+      Process(frame, frame);
+
+      for (int c = 0; c < nChans; c++)
+        outputs[c][s] = frame[c];
+
+      // Process() wrote the lanes' outputs back into the frame
+      for (int c = nChans; c < N; c++)
+        frame[c] = T(0);
+    }
+  }
+
+private:
+  int mWindowSize = 1;
+  int mPos = 0; // the position of the next sample in the ring
+  T mReciprocal = T(1);
+  T mSum[N]; // the running sum of the window's squares
+  T mFreshSum[N]; // the sum of the squares written since the ring was last overwritten in full
+  WDL_TypedBuf<T> mSquares; // the ring of the window's squares, W frames of N lanes
+};
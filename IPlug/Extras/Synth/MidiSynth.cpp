@@ -438,26 +438,18 @@ bool MidiSynth::ProcessBlock(sample** inputs, sample** outputs, int nInputs, int
       mSampleTime += blockSize;
     }
 
-    bool voicesbusy = false;
-    int activeCount = 0;
-
+#if DEBUG_VOICE_COUNT
     for(int v = 0; v < NVoices(); v++)
     {
-      bool busy = GetVoice(v)->GetBusy();
-      voicesbusy |= busy;
-
-      activeCount += (busy==true);
-#if DEBUG_VOICE_COUNT
       if(GetVoice(v)->GetBusy()) printf("X");
       else DBGMSG("_");
     }
     DBGMSG("\n");
-    DBGMSG("Num Voices busy %i\n", activeCount);
-#else
-    }
+    DBGMSG("Num Voices busy %i\n", (int) mVoiceAllocator.GetNActiveVoices());
 #endif
 
-    mVoicesAreActive = voicesbusy;
+    // the allocator keeps track of the voices still sounding, so there's no need to ask every voice
+    mVoicesAreActive = mVoiceAllocator.GetNActiveVoices() > 0;
 
     mMidiQueue.Flush(nFrames);
   }
@@ -474,11 +466,19 @@ void MidiSynth::SetSampleRateAndBlockSize(double sampleRate, int blockSize)
   Reset();
 
   mSampleRate = sampleRate;
-  mMidiQueue.Resize(blockSize);
   mVoiceAllocator.SetSampleRate(sampleRate);
 
+  // room for at least a message per frame, this is called from OnReset() so it may allocate
+  if(mMidiQueue.GetCapacity() < blockSize)
+  {
+    mMidiQueue.SetCapacity(blockSize);
+  }
+
   for(int v = 0; v < NVoices(); v++)
   {
-    GetVoice(v)->SetSampleRate(sampleRate);
+    // oversampled voices run at a multiple of the sample rate
+    GetVoice(v)->SetSampleRate(sampleRate * mVoiceAllocator.GetVoiceOversampling(v));
   }
+
+  mVoiceAllocator.SetOversampledOutputs(mNOversampledOutputs, mBlockSize);
 }
@@ -72,6 +72,18 @@ public:
     mVoiceAllocator.mATMode = mode;
   }
 
+  void SetStealMode(VoiceAllocator::EStealMode mode)
+  {
+    mVoiceAllocator.SetStealMode(mode);
+  }
+
+  /** Limit the time the voices may take to render each block, see VoiceAllocator::SetCPUBudget()
+   * @param fraction The fraction of the block's duration, or 0 for no limit */
+  void SetCPUBudget(double fraction)
+  {
+    mVoiceAllocator.SetCPUBudget(fraction);
+  }
+
   /** Set this function to something other than the default
    * if you need to implement a tuning table for microtonal support
    * @param fn A function taking an integer key value and returning a double-precision
@@ -106,12 +118,72 @@ public:
     return mVoiceAllocator.GetNVoices();
   }
 
+  /** @return The number of voices that are playing, e.g. for IPlugXrunWatchdog::SetNVoices() */
+  size_t NActiveVoices() const
+  {
+    return mVoiceAllocator.GetNActiveVoices();
+  }
+
   /** adds a SynthVoice to this MidiSynth, taking ownership of the object. */
   void AddVoice(SynthVoice* pVoice, uint8_t zone)
   {
     mVoiceAllocator.AddVoice(pVoice, zone);
   }
 
+  /** Spread the busy voices over nTasks tasks, see VoiceAllocator::SetParallelFor(). Call from a non-realtime thread */
+  void SetParallelFor(VoiceAllocator::ParallelForFunc func, void* ctx, int nTasks, int nOutputs, int maxBlockSize)
+  {
+    mVoiceAllocator.SetParallelFor(func, ctx, nTasks, nOutputs, maxBlockSize);
+  }
+
+  /** Use fewer of the tasks set up with SetParallelFor(), see VoiceAllocator::SetNActiveTasks(). This doesn't allocate */
+  void SetNActiveTasks(int nTasks) { mVoiceAllocator.SetNActiveTasks(nTasks); }
+
+  /** Split the outputs into buses, e.g. for a drum instrument with a stereo out per pad, see VoiceAllocator::SetOutputBuses(). Call from a non-realtime thread, after adding the voices, e.g.
+   * @code
+   * mSynth.SetOutputBuses(16, 2);
+   * for (int pad = 0; pad < 16; pad++)
+   *   mSynth.SetZoneOutputBus(pad, pad);
+   * @endcode
+   * and then in ProcessBlock() skip the buses the host hasn't connected with SetOutputBusActive(b, IsChannelConnected(ERoute::kOutput, b * 2)) */
+  void SetOutputBuses(int nBuses, int nChannelsPerBus)
+  {
+    mVoiceAllocator.SetOutputBuses(nBuses, nChannelsPerBus);
+  }
+
+  /** Route a voice to a bus, see VoiceAllocator::SetVoiceOutputBus() */
+  void SetVoiceOutputBus(int voiceIdx, int bus)
+  {
+    mVoiceAllocator.SetVoiceOutputBus(voiceIdx, bus);
+  }
+
+  /** Route the voices of a zone to a bus, see VoiceAllocator::SetZoneOutputBus() */
+  void SetZoneOutputBus(uint8_t zone, int bus)
+  {
+    mVoiceAllocator.SetZoneOutputBus(zone, bus);
+  }
+
+  /** Render the voices of a bus or skip them, see VoiceAllocator::SetOutputBusActive() */
+  void SetOutputBusActive(int bus, bool active)
+  {
+    mVoiceAllocator.SetOutputBusActive(bus, active);
+  }
+
+  /** Set the number of output channels that oversampled voices render (see SynthVoice::GetOversampling()), 2 by default.
+   * Call this before SetSampleRateAndBlockSize(), which allocates the buffers for them */
+  void SetNOversampledOutputs(int nOutputs)
+  {
+    mNOversampledOutputs = nOutputs;
+  }
+
+  /** Set how many MIDI messages can be queued for one ProcessBlock(). Messages beyond that are dropped, see IMidiEventBuffer.
+   * The default suits dense MPE input. This allocates, so call it from a non-realtime thread */
+  void SetMidiEventCapacity(int capacity)
+  {
+    mMidiQueue.SetCapacity(capacity);
+  }
+
+  /** Queue a message for the next ProcessBlock(). Doesn't allocate, and messages may be added out of order */
   void AddMidiMsgToQueue(const IMidiMsg& msg)
   {
     mMidiQueue.Add(msg);
@@ -169,7 +241,7 @@ private:
 
   VoiceAllocator mVoiceAllocator;
   uint16_t mUnisonVoices{1};
-  IMidiQueue mMidiQueue;
+  IMidiEventBuffer mMidiQueue;
   float mVelocityLUT[128];
   float mAfterTouchLUT[128];
   ChannelState mChannelStates[16]{};
@@ -177,6 +249,7 @@ private:
   int64_t mSampleTime{0};
   double mSampleRate = DEFAULT_SAMPLE_RATE;
   bool mVoicesAreActive = false;
+  int mNOversampledOutputs = 2;
 
   // the synth will startup in basic MIDI mode. When an MPE Zone setup message is received, MPE mode is entered.
   // To leave MPE mode, use RPNs to set all MPE zone channel counts to 0 as per the MPE spec.
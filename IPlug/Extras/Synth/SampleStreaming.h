@@ -0,0 +1,697 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @brief Sample playback streamed from disk, for SynthVoice based samplers whose libraries are too big to load
+ *
+ * SamplePreloadCache keeps the attack of each file in memory, once per process. The rest is read by the SampleStreamer thread into a SampleStream ring per voice,
+ * and StreamingSamplerVoice plays the zones of a SampleZoneMap from them. What is read and decoded depends on the voices playing, not on the size of the library
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "IPlugLogger.h"
+#include "SynthVoice.h"
+#include "ADSREnvelope.h"
+
+/** A WAV file's format and where its audio is, found without reading the audio, which is then read and decoded to float a piece at a time.
+ * 16, 24 and 32 bit PCM and 32 and 64 bit float are supported, including WAVE_FORMAT_EXTENSIBLE. Read() can be called from several threads */
+class SampleFile
+{
+public:
+  SampleFile() = default;
+  ~SampleFile() { Close(); }
+
+  SampleFile(const SampleFile&) = delete;
+  SampleFile& operator=(const SampleFile&) = delete;
+
+  /** @param path The path of the file
+   * @return \c true if it is a WAV file in a supported format */
+  bool Open(const char* path)
+  {
+    Close();
+    mFile = fopen(path, "rb");
+
+    if (!mFile)
+      return false;
+
+    uint8_t header[12];
+
+    if (fread(header, 1, 12, mFile) != 12 || memcmp(header, "RIFF", 4) || memcmp(header + 8, "WAVE", 4))
+    {
+      Close();
+      return false;
+    }
+
+    bool gotFormat = false;
+    uint8_t chunk[8];
+
+    while (fread(chunk, 1, 8, mFile) == 8)
+    {
+      const uint32_t size = ReadLE(chunk + 4, 4);
+
+      if (!memcmp(chunk, "fmt ", 4) && size >= 16)
+      {
+        uint8_t fmt[40] = {};
+
+        if (fread(fmt, 1, std::min<uint32_t>(size, 40), mFile) != std::min<uint32_t>(size, 40))
+          break;
+
+        uint32_t formatTag = ReadLE(fmt, 2);
+
+        if (formatTag == 0xFFFE && size >= 26)
+          formatTag = ReadLE(fmt + 24, 2); // the sub format of WAVE_FORMAT_EXTENSIBLE
+
+        mNChannels = static_cast<int>(ReadLE(fmt + 2, 2));
+        mSampleRate = static_cast<double>(ReadLE(fmt + 4, 4));
+        mBitsPerSample = static_cast<int>(ReadLE(fmt + 14, 2));
+        mFloat = formatTag == 3;
+        gotFormat = (formatTag == 1 && (mBitsPerSample == 16 || mBitsPerSample == 24 || mBitsPerSample == 32))
+                 || (formatTag == 3 && (mBitsPerSample == 32 || mBitsPerSample == 64));
+
+        if (!gotFormat || mNChannels < 1)
+          break;
+
+        Seek(mFile, static_cast<int64_t>(size + (size & 1)) - std::min<uint32_t>(size, 40), SEEK_CUR);
+      }
+      else if (!memcmp(chunk, "data", 4) && gotFormat)
+      {
+        mDataOffset = Tell(mFile);
+        mNFrames = size / (mNChannels * (mBitsPerSample / 8));
+        return true;
+      }
+      else
+        Seek(mFile, size + (size & 1), SEEK_CUR);
+    }
+
+    Close();
+    return false;
+  }
+
+  void Close()
+  {
+    if (mFile)
+      fclose(mFile);
+
+    mFile = nullptr;
+    mNFrames = 0;
+  }
+
+  int NChannels() const { return mNChannels; }
+  int64_t NFrames() const { return mNFrames; }
+  double GetSampleRate() const { return mSampleRate; }
+
+  /** Read and decode frames
+   * @param startFrame The first frame to read
+   * @param nFrames The number of frames to read
+   * @param pDest Filled with nFrames * NChannels() interleaved samples
+   * @return The number of frames read, fewer at the end of the file */
+  int Read(int64_t startFrame, int nFrames, float* pDest)
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    if (!mFile || startFrame >= mNFrames || nFrames <= 0)
+      return 0;
+
+    nFrames = static_cast<int>(std::min<int64_t>(nFrames, mNFrames - startFrame));
+    const int bytesPerSample = mBitsPerSample / 8;
+    const int frameBytes = bytesPerSample * mNChannels;
+    mReadBuffer.resize(static_cast<size_t>(nFrames) * frameBytes);
+
+    if (Seek(mFile, mDataOffset + startFrame * frameBytes, SEEK_SET) != 0)
+      return 0;
+
+    nFrames = static_cast<int>(fread(mReadBuffer.data(), frameBytes, nFrames, mFile));
+    const uint8_t* pSrc = mReadBuffer.data();
+    const int nSamples = nFrames * mNChannels;
+
+    for (int i = 0; i < nSamples; i++, pSrc += bytesPerSample)
+    {
+      if (mFloat && mBitsPerSample == 32)
+      {
+        const uint32_t bits = ReadLE(pSrc, 4);
+        memcpy(&pDest[i], &bits, 4);
+      }
+      else if (mFloat)
+      {
+        const uint64_t bits = ReadLE(pSrc, 4) | (uint64_t(ReadLE(pSrc + 4, 4)) << 32);
+        double value;
+        memcpy(&value, &bits, 8);
+        pDest[i] = static_cast<float>(value);
+      }
+      else
+      {
+        // sign extend from the top of a 32 bit word
+        const int32_t value = static_cast<int32_t>(ReadLE(pSrc, bytesPerSample) << (32 - mBitsPerSample));
+        pDest[i] = static_cast<float>(value * (1. / 2147483648.));
+      }
+    }
+
+    return nFrames;
+  }
+
+private:
+  static uint32_t ReadLE(const uint8_t* p, int nBytes)
+  {
+    uint32_t value = 0;
+
+    for (int i = 0; i < nBytes; i++)
+      value |= uint32_t(p[i]) << (8 * i);
+
+    return value;
+  }
+
+  static int Seek(FILE* pFile, int64_t offset, int origin)
+  {
+#ifdef _WIN32
+    return _fseeki64(pFile, offset, origin);
+#else
+    return fseeko(pFile, static_cast<off_t>(offset), origin);
+#endif
+  }
+
+  static int64_t Tell(FILE* pFile)
+  {
+#ifdef _WIN32
+    return _ftelli64(pFile);
+#else
+    return static_cast<int64_t>(ftello(pFile));
+#endif
+  }
+
+  FILE* mFile = nullptr;
+  int64_t mDataOffset = 0;
+  int64_t mNFrames = 0;
+  double mSampleRate = 44100.;
+  int mNChannels = 0;
+  int mBitsPerSample = 0;
+  bool mFloat = false;
+  std::mutex mMutex;
+  std::vector<uint8_t> mReadBuffer;
+};
+
+/** A file whose first frames are held in memory, so that a voice can start playing it at once while the rest is streamed, see SamplePreloadCache */
+struct PreloadedSample
+{
+  std::unique_ptr<SampleFile> file;
+  std::vector<float> attack; // the first nPreloadFrames frames, interleaved
+  int nPreloadFrames = 0;
+
+  int NChannels() const { return file->NChannels(); }
+  int64_t NFrames() const { return file->NFrames(); }
+};
+
+/** The preloaded samples of the process, shared by every instance and zone that plays the same file, and freed when the last one lets go of it */
+class SamplePreloadCache
+{
+public:
+  /** The most channels a streamed file can have */
+  static constexpr int kMaxChannels = 2;
+
+  static SamplePreloadCache& Get()
+  {
+    static SamplePreloadCache sCache;
+    return sCache;
+  }
+
+  /** Open a file and preload its attack, or share the one already loaded. Not on the audio thread, since this reads the file
+   * @param path The path of the file
+   * @param nPreloadFrames The number of frames to keep in memory, which must last while the streamer fills a ring, e.g. half a second.
+   * A sample already loaded with fewer is loaded again with this many
+   * @return The sample, or nullptr if the file couldn't be read */
+  std::shared_ptr<const PreloadedSample> Load(const char* path, int nPreloadFrames = 32768)
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::weak_ptr<const PreloadedSample>& entry = mSamples[path];
+
+    if (std::shared_ptr<const PreloadedSample> pSample = entry.lock())
+    {
+      if (pSample->nPreloadFrames >= std::min<int64_t>(nPreloadFrames, pSample->NFrames()))
+        return pSample;
+    }
+
+    auto pSample = std::make_shared<PreloadedSample>();
+    pSample->file.reset(new SampleFile());
+
+    if (!pSample->file->Open(path) || pSample->file->NChannels() > kMaxChannels)
+    {
+      DBGMSG("SamplePreloadCache: couldn't stream %s\n", path);
+      return nullptr;
+    }
+
+    pSample->nPreloadFrames = static_cast<int>(std::min<int64_t>(nPreloadFrames, pSample->file->NFrames()));
+    pSample->attack.resize(static_cast<size_t>(pSample->nPreloadFrames) * pSample->NChannels());
+    pSample->nPreloadFrames = pSample->file->Read(0, pSample->nPreloadFrames, pSample->attack.data());
+    entry = pSample;
+    return pSample;
+  }
+
+  /** Forget the samples that nothing uses any more */
+  void Purge()
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    for (auto it = mSamples.begin(); it != mSamples.end();)
+      it = it->second.expired() ? mSamples.erase(it) : std::next(it);
+  }
+
+private:
+  SamplePreloadCache() = default;
+
+  std::mutex mMutex;
+  std::unordered_map<std::string, std::weak_ptr<const PreloadedSample>> mSamples;
+};
+
+class SampleStreamer;
+
+/** The frames of a voice's sample after its attack, in a lock-free ring that the SampleStreamer thread fills ahead of the voice, which reads them on the audio thread.
+ * Start() and Stop() don't lock, allocate or wait: they post a request that the streamer picks up, and the frames read for an earlier request are ignored */
+class SampleStream
+{
+public:
+  /** @param ringFrames The number of frames read ahead, which must cover the time the streamer may take to come back to this stream */
+  SampleStream(int ringFrames = 32768);
+  ~SampleStream();
+
+  SampleStream(const SampleStream&) = delete;
+  SampleStream& operator=(const SampleStream&) = delete;
+
+  /** Start playing a sample from its first frame. Audio thread
+   * @param pSample The sample, which must be kept alive by the caller while the stream plays it */
+  void Start(const PreloadedSample* pSample)
+  {
+    mpSample = pSample;
+    mReadFrame.store(pSample ? pSample->nPreloadFrames : 0, std::memory_order_relaxed);
+    mSample.store(pSample, std::memory_order_relaxed);
+    mRequest.store(++mRequestCount, std::memory_order_release);
+  }
+
+  /** Stop playing, so that the streamer stops reading. Audio thread */
+  void Stop() { Start(nullptr); }
+
+  /** Find a frame, in the preloaded attack or the ring. Audio thread
+   * @param frame The index of the frame in the file, at least the one passed to Consume() last
+   * @return The frame's interleaved samples, or nullptr if the frame is past the end of the file or hasn't been streamed in time */
+  const float* GetFrame(int64_t frame)
+  {
+    const PreloadedSample* pSample = mpSample;
+
+    if (!pSample || frame < 0 || frame >= pSample->NFrames())
+      return nullptr;
+
+    const int nChans = pSample->NChannels();
+
+    if (frame < pSample->nPreloadFrames)
+      return &pSample->attack[static_cast<size_t>(frame) * nChans];
+
+    if (mServed.load(std::memory_order_acquire) != mRequestCount || frame >= mWriteFrame.load(std::memory_order_acquire))
+    {
+      Underruns().fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    }
+
+    return &mRing[static_cast<size_t>(frame % mRingFrames) * nChans];
+  }
+
+  /** Let the streamer reuse the ring's space before a frame. Audio thread, once a block
+   * @param frame The index of the first frame the voice still needs */
+  void Consume(int64_t frame)
+  {
+    if (frame > mReadFrame.load(std::memory_order_relaxed))
+      mReadFrame.store(frame, std::memory_order_release);
+  }
+
+  /** @return The number of frames voices have wanted before they were streamed, across all of the streams */
+  static uint32_t GetNUnderruns() { return Underruns().load(std::memory_order_relaxed); }
+
+private:
+  friend class SampleStreamer;
+
+  /** Fill the ring, on the streamer thread
+   * @param maxFrames The most frames to read
+   * @return The number of frames read */
+  int Fill(int maxFrames)
+  {
+    const uint32_t request = mRequest.load(std::memory_order_acquire);
+
+    if (request != mServedRequest)
+    {
+      // a new request: the old frames are ignored from here on, see GetFrame()
+      mServedRequest = request;
+      mpStreamedSample = mSample.load(std::memory_order_relaxed);
+      mStreamFrame = mpStreamedSample ? mpStreamedSample->nPreloadFrames : 0;
+      mWriteFrame.store(mStreamFrame, std::memory_order_relaxed);
+      mServed.store(request, std::memory_order_release);
+    }
+
+    const PreloadedSample* pSample = mpStreamedSample;
+
+    if (!pSample || mStreamFrame >= pSample->NFrames())
+      return 0;
+
+    const int64_t space = mReadFrame.load(std::memory_order_acquire) + mRingFrames - mStreamFrame;
+    const int nChans = pSample->NChannels();
+    int nRead = 0;
+
+    while (nRead < maxFrames && nRead < space && mStreamFrame < pSample->NFrames())
+    {
+      const int ringPos = static_cast<int>(mStreamFrame % mRingFrames);
+      const int n = static_cast<int>(std::min<int64_t>({ static_cast<int64_t>(maxFrames - nRead), space - nRead, static_cast<int64_t>(mRingFrames - ringPos) }));
+      const int got = pSample->file->Read(mStreamFrame, n, &mRing[static_cast<size_t>(ringPos) * nChans]);
+
+      if (got <= 0)
+        break;
+
+      mStreamFrame += got;
+      nRead += got;
+    }
+
+    mWriteFrame.store(mStreamFrame, std::memory_order_release);
+    return nRead;
+  }
+
+  /** @return The number of frames streamed ahead of the voice, 0 for a new request or -1 if the stream has nothing left to read. Streamer thread */
+  int64_t GetNBuffered() const
+  {
+    if (mRequest.load(std::memory_order_acquire) != mServedRequest)
+      return 0;
+
+    if (!mpStreamedSample || mStreamFrame >= mpStreamedSample->NFrames())
+      return -1;
+
+    return mStreamFrame - mReadFrame.load(std::memory_order_relaxed);
+  }
+
+  static std::atomic<uint32_t>& Underruns()
+  {
+    static std::atomic<uint32_t> sNUnderruns {0};
+    return sNUnderruns;
+  }
+
+  const int mRingFrames;
+  std::vector<float> mRing; // mRingFrames * SamplePreloadCache::kMaxChannels
+
+  // written by the audio thread
+  const PreloadedSample* mpSample = nullptr;
+  uint32_t mRequestCount = 0;
+  std::atomic<const PreloadedSample*> mSample {nullptr};
+  std::atomic<uint32_t> mRequest {0};
+  std::atomic<int64_t> mReadFrame {0};
+
+  // written by the streamer thread
+  std::atomic<uint32_t> mServed {0};
+  std::atomic<int64_t> mWriteFrame {0};
+  uint32_t mServedRequest = 0;
+  const PreloadedSample* mpStreamedSample = nullptr;
+  int64_t mStreamFrame = 0;
+};
+
+/** The thread that fills the rings of the SampleStream objects in the process. Each pass it tops up the streams that have the fewest frames ahead of their voices first,
+ * a chunk at a time, so the reading follows the voices that are playing. Idle streams cost a comparison each. It runs while there are streams */
+class SampleStreamer
+{
+public:
+  /** The most frames read for a stream at a time, so that one stream doesn't hold up the others */
+  static constexpr int kChunkFrames = 4096;
+
+  static SampleStreamer& Get()
+  {
+    static SampleStreamer sStreamer;
+    return sStreamer;
+  }
+
+  ~SampleStreamer() { Stop(); }
+
+  void Add(SampleStream* pStream)
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStreams.push_back(pStream);
+
+    if (!mThread.joinable())
+    {
+      mRunning.store(true);
+      mThread = std::thread(&SampleStreamer::Run, this);
+    }
+  }
+
+  void Remove(SampleStream* pStream)
+  {
+    bool stop = false;
+
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mStreams.erase(std::remove(mStreams.begin(), mStreams.end(), pStream), mStreams.end());
+      stop = mStreams.empty();
+    }
+
+    if (stop)
+      Stop();
+  }
+
+private:
+  SampleStreamer() = default;
+
+  void Stop()
+  {
+    mRunning.store(false);
+
+    if (mThread.joinable() && mThread.get_id() != std::this_thread::get_id())
+      mThread.join();
+  }
+
+  void Run()
+  {
+    std::vector<std::pair<int64_t, SampleStream*>> due;
+
+    while (mRunning.load())
+    {
+      int nRead = 0;
+
+      {
+        std::lock_guard<std::mutex> lock(mMutex);
+        due.clear();
+
+        for (SampleStream* pStream : mStreams)
+        {
+          const int64_t nBuffered = pStream->GetNBuffered();
+
+          if (nBuffered >= 0 && nBuffered < pStream->mRingFrames)
+            due.emplace_back(nBuffered, pStream);
+        }
+
+        std::sort(due.begin(), due.end(), [](const std::pair<int64_t, SampleStream*>& a, const std::pair<int64_t, SampleStream*>& b) { return a.first < b.first; });
+
+        for (auto& item : due)
+          nRead += item.second->Fill(kChunkFrames);
+      }
+
+      // come straight back while there is reading to do, otherwise poll for new requests, which the audio thread can't wake us for without a system call
+      if (!nRead)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+
+  std::mutex mMutex;
+  std::vector<SampleStream*> mStreams;
+  std::atomic<bool> mRunning {false};
+  std::thread mThread;
+};
+
+inline SampleStream::SampleStream(int ringFrames)
+: mRingFrames(ringFrames)
+, mRing(static_cast<size_t>(ringFrames) * SamplePreloadCache::kMaxChannels)
+{
+  SampleStreamer::Get().Add(this);
+}
+
+inline SampleStream::~SampleStream()
+{
+  SampleStreamer::Get().Remove(this);
+}
+
+/** Selects the streamed sample for a note */
+struct SampleZone
+{
+  std::shared_ptr<const PreloadedSample> sample;
+  int lowKey = 0;
+  int highKey = 127;
+  int lowVelocity = 0;
+  int highVelocity = 127;
+  double rootKey = 60.; // the MIDI note that plays the sample at its own pitch
+  double gain = 1.;
+};
+
+/** The zones of a sampler, set up on the main thread before the voices play them */
+class SampleZoneMap
+{
+public:
+  /** Add a zone, loading its sample through the SamplePreloadCache
+   * @return \c true if the sample was loaded */
+  bool AddZone(const char* path, int lowKey, int highKey, double rootKey, int lowVelocity = 0, int highVelocity = 127, double gain = 1., int nPreloadFrames = 32768)
+  {
+    SampleZone zone;
+    zone.sample = SamplePreloadCache::Get().Load(path, nPreloadFrames);
+    zone.lowKey = lowKey;
+    zone.highKey = highKey;
+    zone.lowVelocity = lowVelocity;
+    zone.highVelocity = highVelocity;
+    zone.rootKey = rootKey;
+    zone.gain = gain;
+
+    if (!zone.sample)
+      return false;
+
+    mZones.push_back(std::move(zone));
+    return true;
+  }
+
+  /** @return The first zone for a key and velocity, or nullptr */
+  const SampleZone* Find(int key, int velocity) const
+  {
+    for (const SampleZone& zone : mZones)
+    {
+      if (key >= zone.lowKey && key <= zone.highKey && velocity >= zone.lowVelocity && velocity <= zone.highVelocity)
+        return &zone;
+    }
+
+    return nullptr;
+  }
+
+private:
+  std::vector<SampleZone> mZones;
+};
+
+/** A SynthVoice that plays the zone of a SampleZoneMap for its key and velocity, streamed from disk through its own SampleStream, transposed by the pitch ramp
+ * with linear interpolation and shaped by an ADSREnvelope. A retrigger fades the old note out before the new one's stream is started.
+ * The map must outlive the voice and not change while it plays */
+class StreamingSamplerVoice : public SynthVoice
+{
+public:
+  StreamingSamplerVoice(const SampleZoneMap& zones, int ringFrames = 32768)
+  : mZones(zones)
+  , mStream(ringFrames)
+  , mEnvelope("sampler", [this]() { StartZone(); })
+  {
+    mEnvelope.SetStageTime(ADSREnvelope<sample>::kAttack, 1.);
+    mEnvelope.SetStageTime(ADSREnvelope<sample>::kDecay, 1.);
+    mEnvelope.SetStageTime(ADSREnvelope<sample>::kRelease, 200.);
+  }
+
+  bool GetBusy() const override { return mEnvelope.GetBusy(); }
+
+  double GetLevel() const override { return mEnvelope.GetPrevOutput(); }
+
+  void Trigger(double level, bool isRetrigger) override
+  {
+    mPendingVelocity = static_cast<int>(level * 127. + 0.5);
+
+    if (isRetrigger)
+      mEnvelope.Retrigger(level); // the zone is started by the envelope's reset, once the old note has faded
+    else
+    {
+      StartZone();
+      mEnvelope.Start(level);
+    }
+  }
+
+  void Release() override { mEnvelope.Release(); }
+
+  void SoftKill() override { mEnvelope.Kill(false); }
+
+  void SetSampleRate(double sampleRate) override
+  {
+    mSampleRate = sampleRate;
+    mEnvelope.SetSampleRate(sampleRate);
+  }
+
+  uint32_t GetControlRampsUsed() const override { return (1u << kVoiceControlPitch) | (1u << kVoiceControlPitchBend); }
+
+  /** @param releaseMs The release time of the envelope, in milliseconds */
+  void SetReleaseTime(double releaseMs) { mEnvelope.SetStageTime(ADSREnvelope<sample>::kRelease, releaseMs); }
+
+  void ProcessSamplesAccumulating(sample** inputs, sample** outputs, int nInputs, int nOutputs, int startIdx, int nFrames) override
+  {
+    const PreloadedSample* pSample = mpZone ? mpZone->sample.get() : nullptr;
+
+    if (!pSample)
+    {
+      for (int s = 0; s < nFrames; s++)
+        mEnvelope.Process(1.);
+
+      return;
+    }
+
+    const int nChans = pSample->NChannels();
+    const double key = 69. + 12. * (mInputs[kVoiceControlPitch].endValue + mInputs[kVoiceControlPitchBend].endValue);
+    const double increment = std::pow(2., (key - mpZone->rootKey) / 12.) * pSample->file->GetSampleRate() / mSampleRate;
+
+    for (int s = startIdx; s < startIdx + nFrames; s++)
+    {
+      const sample env = static_cast<sample>(mEnvelope.Process(1.) * mpZone->gain);
+      const int64_t frame = static_cast<int64_t>(mPosition);
+      const float* p0 = mStream.GetFrame(frame);
+
+      if (!p0)
+      {
+        // the end of the sample, or an underrun, which plays silence rather than a glitch
+        if (frame >= pSample->NFrames())
+          mEnvelope.Kill(true);
+      }
+      else
+      {
+        const float* p1 = mStream.GetFrame(frame + 1);
+        const float frac = static_cast<float>(mPosition - frame);
+
+        for (int c = 0; c < nOutputs; c++)
+        {
+          const int srcChan = std::min(c, nChans - 1);
+          const float v0 = p0[srcChan];
+          const float v1 = p1 ? p1[srcChan] : 0.f;
+          outputs[c][s] += static_cast<sample>(v0 + (v1 - v0) * frac) * env;
+        }
+      }
+
+      mPosition += increment;
+    }
+
+    mStream.Consume(static_cast<int64_t>(mPosition));
+  }
+
+private:
+  void StartZone()
+  {
+    mpZone = mZones.Find(mKey, mPendingVelocity);
+    mPosition = 0.;
+    mStream.Start(mpZone ? mpZone->sample.get() : nullptr);
+  }
+
+  const SampleZoneMap& mZones;
+  SampleStream mStream;
+  ADSREnvelope<sample> mEnvelope;
+  const SampleZone* mpZone = nullptr;
+  double mPosition = 0.;
+  double mSampleRate = 44100.;
+  int mPendingVelocity = 127;
+};
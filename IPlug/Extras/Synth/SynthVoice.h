@@ -49,6 +49,26 @@ using namespace voiceControlNames;
 
 typedef std::array< ControlRamp, kNumVoiceControlRamps > VoiceInputs;
 
+#pragma mark - Voice lanes class
+
+/** An optional way of processing voices: instead of each voice rendering itself in ProcessSamplesAccumulating(), a SynthVoiceLanes shared by
+ * several voices renders them together, NLanes() voices at a time, one voice per SIMD lane, keeping their DSP state as structure-of-arrays (see VoiceLanes.h).
+ * Voices opt in by overriding SynthVoice::GetLanes(), and then just forward Trigger(), Release() etc. to their lane.
+ * The allocator groups voices by the lane group they belong to, and calls ProcessLanesAccumulating() once for each group that has a busy voice */
+class SynthVoiceLanes
+{
+public:
+  virtual ~SynthVoiceLanes() {};
+
+  /** @return The number of lanes in a group, normally the SIMD width, e.g. 4 or 8 */
+  virtual int NLanes() const = 0;
+
+  /** Process a block of audio data for the voices in one lane group, accumulating into the outputs like SynthVoice::ProcessSamplesAccumulating()
+   * @param group The index of the group, containing the voices with slots group * NLanes() ... group * NLanes() + NLanes() - 1
+   * @param busyLanes Bit l is set if the voice in lane l is busy. The other lanes can be processed too, as long as they don't add to the outputs */
+  virtual void ProcessLanesAccumulating(int group, uint32_t busyLanes, sample** inputs, sample** outputs, int nInputs, int nOutputs, int startIdx, int nFrames) = 0;
+};
+
 #pragma mark - Voice class
 
 class SynthVoice
@@ -68,6 +88,15 @@ public:
   /** As with Trigger, called to do optional tasks when a voice is released. */
   virtual void Release() {};
 
+  /** Called by the VoiceAllocator to fade a voice out quickly, when it is over its CPU budget, see VoiceAllocator::SetCPUBudget().
+   * Override this to end the voice faster than Release() would, e.g. with ADSREnvelope::Kill(false). The voice should go idle within a few milliseconds */
+  virtual void SoftKill() { Release(); }
+
+  /** Override this to report a cheap estimate of how loud the voice is, e.g. the last output of its amplitude envelope, which the VoiceAllocator uses
+   * to pick the quietest voices to steal or soft-kill. Called from the audio thread, so it must not do any work
+   * @return A level in [0, 1]. The default reports every busy voice at full level, so that the oldest voice is picked */
+  virtual double GetLevel() const { return GetBusy() ? 1. : 0.; }
+
   /** Process a block of audio data for the voice
    @param inputs Pointer to input channel arrays. Sometimes synthesisers have audio inputs. Alternatively you can pass in modulation from global LFOs etc here.
    @param outputs Pointer to output channel arrays. You should add to the existing data in these arrays (so that all the voices get summed)
@@ -100,16 +129,35 @@ public:
    */
   virtual void SetControl(int controlNumber, float value) {};
 
+  /** Override this to have the voice render at a multiple of the sample rate, so that its nonlinearities don't alias. The VoiceAllocator gives it
+   * buffers of nFrames * rate samples, and decimates them into the outputs with a Decimator of its own, see Oversampler.h. Only the voices that need it
+   * pay for oversampling. SetSampleRate() is called with the oversampled rate, and an oversampled voice gets no audio inputs.
+   * Called once, when the voice is added to the VoiceAllocator. Voices processed by SynthVoiceLanes aren't oversampled
+   * @return 1 (the default), 2, 4, 8 or 16 */
+  virtual int GetOversampling() const { return 1; }
+
+  /** Override this to declare which of the control ramps in mInputs the voice reads, so that the VoiceAllocator only updates those.
+   * Called once, when the voice is added to the VoiceAllocator. Ramps that are left out keep their initial value
+   * @return A mask with bit (1 << kVoiceControlPitch) etc. set for each ramp used. The default is all of them */
+  virtual uint32_t GetControlRampsUsed() const { return (1u << kNumVoiceControlRamps) - 1; }
+
+  /** Override this to have the voice processed by a SynthVoiceLanes, in which case its ProcessSamplesAccumulating() isn't called.
+   * Called once, when the voice is added to the VoiceAllocator
+   * @param slot Set this to the voice's slot in the lanes, which must be unique to the voice: the group is slot / NLanes() and the lane slot % NLanes()
+   * @return The lanes that process the voice, or nullptr to process it on its own */
+  virtual SynthVoiceLanes* GetLanes(int& slot) { return nullptr; }
+
 protected:
   VoiceInputs mInputs;
   int64_t mLastTriggeredTime{-1};
-  uint8_t mVoiceNumber{0};
+  int mVoiceNumber{0}; // the voice's index in the voice allocator
   uint8_t mZone{0};
   uint8_t mChannel{0};
   uint8_t mKey{0};
   double mBasePitch{0.};
   double mAftertouch{0.};
   double mGain{0.}; // used by voice allocator to hard-kill voices.
+  int mActiveIndex{-1}; // position in the voice allocator's list of active voices, or -1 if the voice isn't in it
 
   friend class MidiSynth;
   friend class VoiceAllocator;
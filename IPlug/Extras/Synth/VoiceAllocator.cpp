@@ -9,8 +9,13 @@
  */
 
 #include "VoiceAllocator.h"
+#include "IPlugSIMD.h"
+#include "Oversampler.h"
 
 #include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
 #include <numeric>
 #include <iostream>
 
@@ -51,12 +56,23 @@ void VoiceAllocator::ClearVoiceInputs(SynthVoice* pVoice)
 
 void VoiceAllocator::AddVoice(SynthVoice* pVoice, uint8_t zone)
 {
-  if(mVoicePtrs.size() + 1 < UCHAR_MAX)
+  if(mVoicePtrs.size() < VoiceBitsArray::kMaxVoices)
   {
+    const int voiceIdx = static_cast<int>(mVoicePtrs.size());
     mVoicePtrs.push_back(pVoice);
     ClearVoiceInputs(pVoice);
     pVoice->mKey = -1;
     pVoice->mZone = zone;
+    pVoice->mActiveIndex = -1;
+    mActiveVoices.reserve(mVoicePtrs.size());
+
+    if (mZoneBits.size() <= zone)
+      mZoneBits.resize(zone + 1);
+
+    mAllVoiceBits.Set(voiceIdx);
+    mZoneBits[zone].Set(voiceIdx);
+    pVoice->mVoiceNumber = voiceIdx;
+    IndexVoiceChannelAndKey(voiceIdx, true);
 
     // make a glides structure and set the output for each glide to a control ramp of the new voice
     mVoiceGlides.emplace_back( std::unique_ptr<VoiceControlRamps> (new VoiceControlRamps));
@@ -66,6 +82,13 @@ void VoiceAllocator::AddVoice(SynthVoice* pVoice, uint8_t zone)
     {
       pRamps->at(i).mpOutput = &(pVoice->mInputs[i]);
     }
+
+    mVoiceRampsUsed.push_back(pVoice->GetControlRampsUsed());
+    mVoiceOversampling.push_back(std::max(1, pVoice->GetOversampling()));
+    mVoiceDecimators.emplace_back(nullptr);
+    mVoiceOutputBuses.push_back(0);
+    AddVoiceToLaneGroup(pVoice);
+    mBusUnits.reserve(mVoicePtrs.size() + mLaneGroups.size()); // so that ProcessVoices() never allocates
   }
   else
   {
@@ -73,26 +96,18 @@ void VoiceAllocator::AddVoice(SynthVoice* pVoice, uint8_t zone)
   }
 }
 
-VoiceAllocator::VoiceBitsArray VoiceAllocator::VoicesMatchingAddress(VoiceAddress addr)
+VoiceBitsArray VoiceAllocator::VoicesMatchingAddress(VoiceAddress addr)
 {
-  const int n = static_cast<int>(mVoicePtrs.size());
+  // start with all voices in the zone, then for each other criterion present in address, clear any voice bits not matching
   VoiceBitsArray v;
 
-  // set all bits to true
-  for(int i=0; i<n; ++i)
+  if(addr.mZone == kAllZones)
   {
-    v[i] = true;
+    v = mAllVoiceBits;
   }
-
-  // for each criterion present in address, clear any voice bits not matching
-
-  // zone
-  if(addr.mZone != kAllZones)
+  else if(addr.mZone < mZoneBits.size())
   {
-    for(int i=0; i<n; ++i)
-    {
-      v[i] = v[i] & (mVoicePtrs[i]->mZone == addr.mZone);
-    }
+    v = mZoneBits[addr.mZone];
   }
 
   // setting the flag kVoicesAll returns all voices matching the zone of the address.
@@ -101,28 +116,47 @@ VoiceAllocator::VoiceBitsArray VoiceAllocator::VoicesMatchingAddress(VoiceAddres
   // channel
   if(addr.mChannel != kAllChannels)
   {
-    for(int i=0; i<n; ++i)
+    if(addr.mChannel < kNumChannelBits)
     {
-      v[i] = v[i] & (mVoicePtrs[i]->mChannel == addr.mChannel);
+      v &= mChannelBits[addr.mChannel];
+    }
+    else
+    {
+      VoiceBitsArray matching;
+      v.ForEach([&](int i) { if(mVoicePtrs[i]->mChannel == addr.mChannel) matching.Set(i); });
+      v = matching;
     }
   }
 
   // Key
   if(addr.mKey != kAllKeys)
   {
-    for(int i=0; i<n; ++i)
+    if(addr.mKey < kNumKeyBits)
+    {
+      v &= mKeyBits[addr.mKey];
+    }
+    else
     {
-      v[i] = v[i] & (mVoicePtrs[i]->mKey == addr.mKey);
+      VoiceBitsArray matching;
+      v.ForEach([&](int i) { if(mVoicePtrs[i]->mKey == addr.mKey) matching.Set(i); });
+      v = matching;
     }
   }
 
-  // busy flag
+  // busy flag, only active voices can be busy
   if(addr.mFlags & kVoicesBusy)
   {
-    for(int i=0; i<n; ++i)
+    VoiceBitsArray busy;
+
+    for(int i : mActiveVoices)
     {
-      v[i] = v[i] & mVoicePtrs[i]->GetBusy();
+      if(v[i] && mVoicePtrs[i]->GetBusy())
+      {
+        busy.Set(i);
+      }
     }
+
+    v = busy;
   }
 
   // most recent
@@ -130,67 +164,41 @@ VoiceAllocator::VoiceBitsArray VoiceAllocator::VoicesMatchingAddress(VoiceAddres
   {
     int64_t maxT = -1;
     int maxIdx = -1;
-    for(int i=0; i<n; ++i)
-    {
-      if(v[i])
+
+    v.ForEach([&](int i) {
+      int64_t vt = mVoicePtrs[i]->mLastTriggeredTime;
+      if(vt > maxT)
       {
-        int64_t vt = mVoicePtrs[i]->mLastTriggeredTime;
-        if(vt > maxT)
-        {
-          maxT = vt;
-          maxIdx = i;
-        }
+        maxT = vt;
+        maxIdx = i;
       }
-    }
+    });
 
-    // set all bits to false
-    //v.reset();
-    for(int i=0; i<n; ++i)
-    {
-      v[i] = 0;
-    }
+    v.Clear();
 
     if(maxIdx >= 0)
     {
-      v[maxIdx] = true;
+      v.Set(maxIdx);
     }
   }
   return v;
 }
 
-void VoiceAllocator::SendControlToVoiceInputs(VoiceBitsArray v, int ctlIdx, float val, int glideSamples)
+void VoiceAllocator::SendControlToVoiceInputs(const VoiceBitsArray& v, int ctlIdx, float val, int glideSamples)
 {
   // send control change to all matched voices through glide generators
-  for(int i=0; i<mVoicePtrs.size(); ++i)
-  {
-    if(v[i])
-    {
-      mVoiceGlides[i]->at(ctlIdx).SetTarget(val, 0, glideSamples, mBlockSize);
-    }
-  }
+  v.ForEach([&](int i) { mVoiceGlides[i]->at(ctlIdx).SetTarget(val, 0, glideSamples, mBlockSize); });
 }
 
-void VoiceAllocator::SendControlToVoicesDirect(VoiceBitsArray v, int ctlIdx, float val)
+void VoiceAllocator::SendControlToVoicesDirect(const VoiceBitsArray& v, int ctlIdx, float val)
 {
   // send generic control change directly to voice
-  for(int i=0; i<mVoicePtrs.size(); ++i)
-  {
-    if(v[i])
-    {
-      mVoicePtrs[i]->SetControl(ctlIdx, val);
-    }
-  }
+  v.ForEach([&](int i) { mVoicePtrs[i]->SetControl(ctlIdx, val); });
 }
 
-void VoiceAllocator::SendProgramChangeToVoices(VoiceBitsArray v, int pgm)
+void VoiceAllocator::SendProgramChangeToVoices(const VoiceBitsArray& v, int pgm)
 {
-  for(int i=0; i<mVoicePtrs.size(); ++i)
-  {
-    if(v[i])
-    {
-      mVoicePtrs[i]->SetProgramNumber(pgm);
-    }
-  }
+  v.ForEach([&](int i) { mVoicePtrs[i]->SetProgramNumber(pgm); });
 }
 
 void VoiceAllocator::ProcessEvents(int blockSize, int64_t sampleTime)
@@ -199,7 +207,7 @@ void VoiceAllocator::ProcessEvents(int blockSize, int64_t sampleTime)
   {
     VoiceInputEvent event;
     mInputQueue.Pop(event);
-    VoiceAllocator::VoiceBitsArray voices = VoicesMatchingAddress(event.mAddress);
+    const VoiceBitsArray voices = VoicesMatchingAddress(event.mAddress);
 
     switch(event.mAction)
     {
@@ -278,12 +286,18 @@ void VoiceAllocator::ProcessEvents(int blockSize, int64_t sampleTime)
     }
   }
 
-  // update any glides in progress, writing voice control outputs
-  for(auto& glides : mVoiceGlides)
+  // update any glides in progress, writing voice control outputs, for the ramps that each voice uses
+  for(size_t v=0; v<mVoiceGlides.size(); ++v)
   {
+    VoiceControlRamps& glides = *mVoiceGlides[v];
+    const uint32_t rampsUsed = mVoiceRampsUsed[v];
+
     for(int i=0; i<kNumVoiceControlRamps; ++i)
     {
-      glides->at(i).Process(blockSize);
+      if(rampsUsed & (1u << i))
+      {
+        glides[i].Process(blockSize);
+      }
     }
   }
 }
@@ -301,7 +315,7 @@ int VoiceAllocator::FindFreeVoiceIndex(int startIndex) const
   {
     int j = (startIndex + i)%voices;
     SynthVoice* pv = mVoicePtrs[j];
-    if(!pv->GetBusy())
+    if(!mActiveBits[j] || !pv->GetBusy())
     {
       return j;
     }
@@ -311,6 +325,9 @@ int VoiceAllocator::FindFreeVoiceIndex(int startIndex) const
 
 int VoiceAllocator::FindVoiceIndexToSteal(int64_t sampleTime) const
 {
+  if(mStealMode == kStealQuietest)
+    return std::max(0, FindQuietestVoiceIndex(VoiceBitsArray()));
+
   size_t voices = mVoicePtrs.size();
   int64_t earliestTime = sampleTime;
   int longestPlayingVoiceIdx = 0;
@@ -326,6 +343,47 @@ int VoiceAllocator::FindVoiceIndexToSteal(int64_t sampleTime) const
   return longestPlayingVoiceIdx;
 }
 
+// the active voice with the lowest level that isn't in exclude, of those the one triggered first, or -1 if there is none
+int VoiceAllocator::FindQuietestVoiceIndex(const VoiceBitsArray& exclude) const
+{
+  int quietestVoiceIdx = -1;
+  double lowestLevel = 0.;
+  int64_t earliestTime = 0;
+
+  for(int v : mActiveVoices)
+  {
+    if(exclude[v])
+      continue;
+
+    const SynthVoice* pv = mVoicePtrs[v];
+    const double level = pv->GetLevel();
+
+    if(quietestVoiceIdx < 0 || level < lowestLevel || (level == lowestLevel && pv->mLastTriggeredTime < earliestTime))
+    {
+      quietestVoiceIdx = v;
+      lowestLevel = level;
+      earliestTime = pv->mLastTriggeredTime;
+    }
+  }
+  return quietestVoiceIdx;
+}
+
+// soft-kill up to nVoices of the quietest voices that haven't already been soft-killed.
+void VoiceAllocator::SoftKillQuietestVoices(int nVoices)
+{
+  for(int i = 0; i < nVoices; i++)
+  {
+    const int v = FindQuietestVoiceIndex(mSoftKilledBits);
+
+    if(v < 0)
+      break;
+
+    mSoftKilledBits.Set(v);
+    mVoicePtrs[v]->SoftKill();
+    mNOverBudgetKills++;
+  }
+}
+
 // start a single voice and set its current channel and key.
 void VoiceAllocator::StartVoice(int voiceIdx, int channel, int key, float pitch, float velocity, int sampleOffset, int64_t sampleTime, bool retrig)
 {
@@ -341,45 +399,95 @@ void VoiceAllocator::StartVoice(int voiceIdx, int channel, int key, float pitch,
   // set things directly in voice
   SynthVoice* pVoice = mVoicePtrs[voiceIdx];
   pVoice->mLastTriggeredTime = sampleTime;
-  pVoice->mChannel = channel;
-  pVoice->mKey = key;
+  SetVoiceChannelAndKey(voiceIdx, channel, key);
   pVoice->mGain = 1.;
+  mSoftKilledBits.Reset(voiceIdx);
+  ActivateVoice(voiceIdx);
 
   // call voice's Trigger method
   pVoice->Trigger(velocity, retrig);
 }
 
 // start all of the voice indexes marked in the VoieBitsArray and set the current channel and key of each.
-void VoiceAllocator::StartVoices(VoiceBitsArray vbits, int channel, int key, float pitch, float velocity, int sampleOffset, int64_t sampleTime, bool retrig)
+void VoiceAllocator::StartVoices(const VoiceBitsArray& vbits, int channel, int key, float pitch, float velocity, int sampleOffset, int64_t sampleTime, bool retrig)
 {
-  for(int i=0; i<mVoicePtrs.size(); ++i)
-  {
-    if(vbits[i])
-    {
-      StartVoice(i, channel, key, pitch, velocity, sampleOffset, sampleTime, retrig);
-    }
-  }
+  vbits.ForEach([&](int i) { StartVoice(i, channel, key, pitch, velocity, sampleOffset, sampleTime, retrig); });
 }
 
 void VoiceAllocator::StopVoice(int voiceIdx, int sampleOffset)
 {
   mVoiceGlides[voiceIdx]->at(kVoiceControlGate).SetTarget(0.0, sampleOffset, 1, mBlockSize);
-  mVoicePtrs[voiceIdx]->mKey = -1;
+  SetVoiceChannelAndKey(voiceIdx, mVoicePtrs[voiceIdx]->mChannel, -1);
   mVoicePtrs[voiceIdx]->Release();
 }
 
-// stop all voices marked in the VoiceBitsArray.
-void VoiceAllocator::StopVoices(VoiceBitsArray vbits, int sampleOffset)
+void VoiceAllocator::SetVoiceChannelAndKey(int voiceIdx, uint8_t channel, uint8_t key)
 {
-  for(int i=0; i<mVoicePtrs.size(); ++i)
+  IndexVoiceChannelAndKey(voiceIdx, false);
+  mVoicePtrs[voiceIdx]->mChannel = channel;
+  mVoicePtrs[voiceIdx]->mKey = key;
+  IndexVoiceChannelAndKey(voiceIdx, true);
+}
+
+void VoiceAllocator::IndexVoiceChannelAndKey(int voiceIdx, bool add)
+{
+  const SynthVoice* pVoice = mVoicePtrs[voiceIdx];
+
+  if(pVoice->mChannel < kNumChannelBits)
   {
-    if(vbits[i])
+    if(add) mChannelBits[pVoice->mChannel].Set(voiceIdx);
+    else mChannelBits[pVoice->mChannel].Reset(voiceIdx);
+  }
+
+  if(pVoice->mKey < kNumKeyBits)
+  {
+    if(add) mKeyBits[pVoice->mKey].Set(voiceIdx);
+    else mKeyBits[pVoice->mKey].Reset(voiceIdx);
+  }
+}
+
+void VoiceAllocator::ActivateVoice(int voiceIdx)
+{
+  SynthVoice* pVoice = mVoicePtrs[voiceIdx];
+
+  if(pVoice->mActiveIndex < 0)
+  {
+    pVoice->mActiveIndex = static_cast<int>(mActiveVoices.size());
+    mActiveVoices.push_back(voiceIdx); // capacity reserved by AddVoice()
+    mActiveBits.Set(voiceIdx);
+
+    // a new note, so nothing should be left of the last one in the decimator
+    if(mVoiceDecimators[voiceIdx])
+      mVoiceDecimators[voiceIdx]->Reset();
+  }
+}
+
+void VoiceAllocator::DeactivateIdleVoices()
+{
+  // backwards, since a removed voice is replaced by the last one
+  for(int i = static_cast<int>(mActiveVoices.size()) - 1; i >= 0; i--)
+  {
+    const int voiceIdx = mActiveVoices[i];
+    SynthVoice* pVoice = mVoicePtrs[voiceIdx];
+
+    if(!pVoice->GetBusy())
     {
-      StopVoice(i, sampleOffset);
+      const int lastVoiceIdx = mActiveVoices.back();
+      mActiveVoices[i] = lastVoiceIdx;
+      mVoicePtrs[lastVoiceIdx]->mActiveIndex = i;
+      mActiveVoices.pop_back();
+      pVoice->mActiveIndex = -1;
+      mActiveBits.Reset(voiceIdx);
     }
   }
 }
 
+// stop all voices marked in the VoiceBitsArray.
+void VoiceAllocator::StopVoices(const VoiceBitsArray& vbits, int sampleOffset)
+{
+  vbits.ForEach([&](int i) { StopVoice(i, sampleOffset); });
+}
+
 void VoiceAllocator::SoftKillAllVoices()
 {
   mHeldKeys.clear();
@@ -531,14 +639,437 @@ void VoiceAllocator::NoteOff(VoiceInputEvent e, int64_t sampleTime)
   }
 }
 
+void VoiceAllocator::AddVoiceToLaneGroup(SynthVoice* pVoice)
+{
+  int slot = 0;
+  SynthVoiceLanes* pLanes = pVoice->GetLanes(slot);
+  int groupIdx = -1;
+
+  if (pLanes)
+  {
+    mVoiceOversampling.back() = 1; // lanes are processed at the sample rate
+    const int nLanes = pLanes->NLanes();
+    assert(nLanes > 0 && nLanes <= 32);
+    const int group = slot / nLanes;
+
+    for (int g = 0; g < (int) mLaneGroups.size(); g++)
+    {
+      if (mLaneGroups[g].mLanes == pLanes && mLaneGroups[g].mGroup == group)
+        groupIdx = g;
+    }
+
+    if (groupIdx < 0)
+    {
+      mLaneGroups.push_back({pLanes, group, 0, 0});
+      groupIdx = (int) mLaneGroups.size() - 1;
+      mBusyLaneGroups.reserve(mLaneGroups.size()); // so that ProcessVoices() never allocates
+    }
+
+    mVoiceLanes.push_back((uint8_t) (slot % nLanes));
+  }
+  else
+    mVoiceLanes.push_back(0);
+
+  mVoiceLaneGroups.push_back(groupIdx);
+}
+
 void VoiceAllocator::ProcessVoices(sample** inputs, sample** outputs, int nInputs, int nOutputs, int startIndex, int blockSize)
 {
-  for(auto pVoice : mVoicePtrs)
+  if(mCPUBudget <= 0. || blockSize <= 0)
+  {
+    RenderVoices(inputs, outputs, nInputs, nOutputs, startIndex, blockSize);
+    return;
+  }
+
+  const auto startTime = std::chrono::steady_clock::now();
+  RenderVoices(inputs, outputs, nInputs, nOutputs, startIndex, blockSize);
+  const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+  const double budget = mCPUBudget * blockSize / mSampleRate;
+
+  if(elapsed > budget)
+  {
+    // shed the share of the voices by which the block overran, at least one voice
+    const double overrun = (elapsed - budget) / elapsed;
+    const int nVoices = std::max(1, static_cast<int>(std::ceil(overrun * mActiveVoices.size())));
+    SoftKillQuietestVoices(nVoices);
+  }
+}
+
+void VoiceAllocator::RenderVoices(sample** inputs, sample** outputs, int nInputs, int nOutputs, int startIndex, int blockSize)
+{
+  if (mNOutputBuses > 1)
+  {
+    RenderVoicesByBus(inputs, outputs, nInputs, nOutputs, startIndex, blockSize);
+    return;
+  }
+
+  const int nAvailableTasks = mNActiveTasks > 0 ? std::min(mNActiveTasks, mNTasks) : mNTasks;
+  const bool canRunInParallel = mParallelFor && nAvailableTasks > 1 && nOutputs <= mTaskNOutputs && startIndex + blockSize <= mTaskMaxBlockSize;
+
+  for (auto& group : mLaneGroups)
+    group.mBusyLanes = 0;
+
+  if (canRunInParallel)
+  {
+    mBusyVoices.clear(); // capacity reserved by SetParallelFor()
+    mBusyLaneGroups.clear(); // capacity reserved by AddVoiceToLaneGroup()
+
+    for (int v : mActiveVoices)
+    {
+      SynthVoice* pVoice = mVoicePtrs[v];
+
+      if (!pVoice->GetBusy())
+        continue;
+
+      if (mVoiceLaneGroups[v] >= 0)
+      {
+        LaneGroup& group = mLaneGroups[mVoiceLaneGroups[v]];
+
+        if (!group.mBusyLanes)
+          mBusyLaneGroups.push_back(&group);
+
+        group.mBusyLanes |= 1u << mVoiceLanes[v];
+      }
+      else if (mBusyVoices.size() < mBusyVoices.capacity())
+        mBusyVoices.push_back(v);
+    }
+
+    const int nUnits = (int) (mBusyLaneGroups.size() + mBusyVoices.size());
+
+    if (nUnits > 1)
+    {
+      mTaskInputs = inputs;
+      mTaskNInputs = nInputs;
+      mTaskStartIndex = startIndex;
+      mTaskBlockSize = blockSize;
+
+      const int nTasks = std::min(nAvailableTasks, nUnits);
+      mTaskNTasks = nTasks;
+
+      if (mParallelFor(mParallelForCtx, nTasks, ProcessVoicesTask, this))
+      {
+        // sum the tasks' buffers into the outputs, a channel at a time so that the output stays in cache
+        for (int c = 0; c < nOutputs; c++)
+        {
+          for (int t = 0; t < nTasks; t++)
+            AccumulateSamples(outputs[c] + startIndex, mTaskOutputPtrs[t * mTaskNOutputs + c] + startIndex, blockSize);
+        }
+
+        DeactivateIdleVoices();
+        return;
+      }
+    }
+
+    for (auto& group : mLaneGroups)
+      group.mBusyLanes = 0;
+  }
+
+  for(int v : mActiveVoices)
   {
-    // TODO distribute voices across cores
+    SynthVoice* pVoice = mVoicePtrs[v];
+
     if(pVoice->GetBusy())
     {
-      pVoice->ProcessSamplesAccumulating(inputs, outputs, nInputs, nOutputs, startIndex, blockSize);
+      if (mVoiceLaneGroups[v] >= 0)
+        mLaneGroups[mVoiceLaneGroups[v]].mBusyLanes |= 1u << mVoiceLanes[v];
+      else
+        ProcessVoice(v, inputs, outputs, nInputs, nOutputs, startIndex, blockSize, 0);
+    }
+  }
+
+  for (auto& group : mLaneGroups)
+  {
+    if (group.mBusyLanes)
+      group.mLanes->ProcessLanesAccumulating(group.mGroup, group.mBusyLanes, inputs, outputs, nInputs, nOutputs, startIndex, blockSize);
+  }
+
+  DeactivateIdleVoices();
+}
+
+void VoiceAllocator::ProcessVoicesTask(void* pAllocator, int taskIdx)
+{
+  VoiceAllocator* _this = (VoiceAllocator*) pAllocator;
+  sample** pTaskOutputs = _this->mTaskOutputPtrs.data() + taskIdx * _this->mTaskNOutputs;
+  const int startIndex = _this->mTaskStartIndex;
+  const int blockSize = _this->mTaskBlockSize;
+  const int nGroups = (int) _this->mBusyLaneGroups.size();
+  const int nUnits = nGroups + (int) _this->mBusyVoices.size();
+  const int nTasks = _this->mTaskNTasks;
+
+  for (int c = 0; c < _this->mTaskNOutputs; c++)
+    std::fill(pTaskOutputs[c] + startIndex, pTaskOutputs[c] + startIndex + blockSize, (sample) 0);
+
+  // lane groups, then voices, are dealt out in turn, so that tasks get a similar mix of work
+  for (int u = taskIdx; u < nUnits; u += nTasks)
+  {
+    if (u < nGroups)
+    {
+      const LaneGroup* pGroup = _this->mBusyLaneGroups[u];
+      pGroup->mLanes->ProcessLanesAccumulating(pGroup->mGroup, pGroup->mBusyLanes, _this->mTaskInputs, pTaskOutputs, _this->mTaskNInputs, _this->mTaskNOutputs, startIndex, blockSize);
+    }
+    else
+      _this->ProcessVoice(_this->mBusyVoices[u - nGroups], _this->mTaskInputs, pTaskOutputs, _this->mTaskNInputs, _this->mTaskNOutputs, startIndex, blockSize, taskIdx);
+  }
+}
+
+void VoiceAllocator::RenderVoicesByBus(sample** inputs, sample** outputs, int nInputs, int nOutputs, int startIndex, int blockSize)
+{
+  const uint64_t activeBuses = mActiveOutputBuses.load(std::memory_order_relaxed);
+  std::array<int, kMaxOutputBuses + 1> busStarts {};
+
+  for (auto& group : mLaneGroups)
+    group.mBusyLanes = 0;
+
+  // count the units of each bus: the busy voices that aren't lanes and the lane groups with a busy voice
+  for (int v : mActiveVoices)
+  {
+    const int laneGroupIdx = mVoiceLaneGroups[v];
+    const int bus = laneGroupIdx >= 0 ? mLaneGroups[laneGroupIdx].mOutputBus : mVoiceOutputBuses[v];
+
+    if (bus >= mNOutputBuses || !((activeBuses >> bus) & 1) || !mVoicePtrs[v]->GetBusy())
+      continue;
+
+    if (laneGroupIdx >= 0)
+    {
+      LaneGroup& group = mLaneGroups[laneGroupIdx];
+
+      if (!group.mBusyLanes)
+        busStarts[bus + 1]++;
+
+      group.mBusyLanes |= 1u << mVoiceLanes[v];
+    }
+    else
+      busStarts[bus + 1]++;
+  }
+
+  for (int b = 0; b < mNOutputBuses; b++)
+    busStarts[b + 1] += busStarts[b];
+
+  // then place them, so that the units of each bus are together and in bus order
+  const int nUnits = busStarts[mNOutputBuses];
+  mBusUnits.resize(nUnits); // capacity reserved by AddVoice() and SetOutputBuses()
+  mBusesWithUnits = 0;
+
+  for (auto& group : mLaneGroups)
+  {
+    if (group.mBusyLanes)
+    {
+      mBusUnits[busStarts[group.mOutputBus]++] = {group.mOutputBus, -1, &group};
+      mBusesWithUnits |= uint64_t(1) << group.mOutputBus;
+    }
+  }
+
+  for (int v : mActiveVoices)
+  {
+    const int bus = mVoiceOutputBuses[v];
+
+    if (mVoiceLaneGroups[v] >= 0 || bus >= mNOutputBuses || !((activeBuses >> bus) & 1) || !mVoicePtrs[v]->GetBusy())
+      continue;
+
+    mBusUnits[busStarts[bus]++] = {bus, v, nullptr};
+    mBusesWithUnits |= uint64_t(1) << bus;
+  }
+
+  const int nAvailableTasks = mNActiveTasks > 0 ? std::min(mNActiveTasks, mNTasks) : mNTasks;
+  const bool canRunInParallel = mParallelFor && nAvailableTasks > 1 && nOutputs <= mTaskNOutputs && startIndex + blockSize <= mTaskMaxBlockSize;
+
+  if (canRunInParallel && nUnits > 1)
+  {
+    mTaskInputs = inputs;
+    mTaskNInputs = nInputs;
+    mTaskStartIndex = startIndex;
+    mTaskBlockSize = blockSize;
+
+    const int nTasks = std::min(nAvailableTasks, nUnits);
+    mTaskNTasks = nTasks;
+
+    if (mParallelFor(mParallelForCtx, nTasks, ProcessBusUnitsTask, this))
+    {
+      // sum the tasks' buffers into the channels of the buses that were rendered
+      for (int b = 0; b < mNOutputBuses; b++)
+      {
+        if (!((mBusesWithUnits >> b) & 1))
+          continue;
+
+        const int endChannel = std::min(nOutputs, (b + 1) * mBusNChannels);
+
+        for (int c = b * mBusNChannels; c < endChannel; c++)
+        {
+          for (int t = 0; t < nTasks; t++)
+            AccumulateSamples(outputs[c] + startIndex, mTaskOutputPtrs[t * mTaskNOutputs + c] + startIndex, blockSize);
+        }
+      }
+
+      DeactivateIdleVoices();
+      return;
     }
   }
+
+  for (const BusUnit& unit : mBusUnits)
+    ProcessBusUnit(unit, inputs, outputs, nInputs, nOutputs, startIndex, blockSize, 0);
+
+  DeactivateIdleVoices();
+}
+
+void VoiceAllocator::ProcessBusUnit(const BusUnit& unit, sample** inputs, sample** outputs, int nInputs, int nOutputs, int startIndex, int blockSize, int bufferIdx)
+{
+  const int firstChannel = unit.mBus * mBusNChannels;
+  const int nChans = std::min(mBusNChannels, nOutputs - firstChannel);
+
+  // the host has fewer channels than the bus layout, which leaves this bus out
+  if (nChans <= 0)
+    return;
+
+  if (unit.mGroup)
+    unit.mGroup->mLanes->ProcessLanesAccumulating(unit.mGroup->mGroup, unit.mGroup->mBusyLanes, inputs, outputs + firstChannel, nInputs, nChans, startIndex, blockSize);
+  else
+    ProcessVoice(unit.mVoiceIdx, inputs, outputs + firstChannel, nInputs, nChans, startIndex, blockSize, bufferIdx);
+}
+
+void VoiceAllocator::ProcessBusUnitsTask(void* pAllocator, int taskIdx)
+{
+  VoiceAllocator* _this = (VoiceAllocator*) pAllocator;
+  sample** pTaskOutputs = _this->mTaskOutputPtrs.data() + taskIdx * _this->mTaskNOutputs;
+  const int startIndex = _this->mTaskStartIndex;
+  const int blockSize = _this->mTaskBlockSize;
+  const int nUnits = (int) _this->mBusUnits.size();
+  const int nTasks = _this->mTaskNTasks;
+
+  for (int c = 0; c < _this->mTaskNOutputs; c++)
+  {
+    const int bus = c / _this->mBusNChannels;
+
+    if (bus < _this->mNOutputBuses && ((_this->mBusesWithUnits >> bus) & 1))
+      std::fill(pTaskOutputs[c] + startIndex, pTaskOutputs[c] + startIndex + blockSize, (sample) 0);
+  }
+
+  for (int u = taskIdx; u < nUnits; u += nTasks)
+    _this->ProcessBusUnit(_this->mBusUnits[u], _this->mTaskInputs, pTaskOutputs, _this->mTaskNInputs, _this->mTaskNOutputs, startIndex, blockSize, taskIdx);
+}
+
+void VoiceAllocator::SetOutputBuses(int nBuses, int nChannelsPerBus)
+{
+  mNOutputBuses = Clip(nBuses, 1, kMaxOutputBuses);
+  mBusNChannels = std::max(nChannelsPerBus, 1);
+  mBusUnits.reserve(mVoicePtrs.size() + mLaneGroups.size());
+}
+
+void VoiceAllocator::SetVoiceOutputBus(int voiceIndex, int bus)
+{
+  if (voiceIndex < 0 || voiceIndex >= (int) mVoicePtrs.size())
+    return;
+
+  const uint8_t outputBus = (uint8_t) Clip(bus, 0, kMaxOutputBuses - 1);
+  mVoiceOutputBuses[voiceIndex] = outputBus;
+
+  if (mVoiceLaneGroups[voiceIndex] >= 0)
+  {
+    LaneGroup& group = mLaneGroups[mVoiceLaneGroups[voiceIndex]];
+    group.mOutputBus = outputBus;
+
+    for (size_t v = 0; v < mVoicePtrs.size(); v++)
+    {
+      if (mVoiceLaneGroups[v] == mVoiceLaneGroups[voiceIndex])
+        mVoiceOutputBuses[v] = outputBus;
+    }
+  }
+}
+
+void VoiceAllocator::SetZoneOutputBus(uint8_t zone, int bus)
+{
+  if (zone < mZoneBits.size())
+    mZoneBits[zone].ForEach([this, bus](int v) { SetVoiceOutputBus(v, bus); });
+}
+
+void VoiceAllocator::SetParallelFor(ParallelForFunc func, void* ctx, int nTasks, int nOutputs, int maxBlockSize)
+{
+  mParallelFor = nTasks > 1 ? func : nullptr;
+  mParallelForCtx = ctx;
+  mNTasks = mParallelFor ? nTasks : 0;
+  mTaskNOutputs = nOutputs;
+  mTaskMaxBlockSize = maxBlockSize;
+
+  mTaskBuffers.assign((size_t) mNTasks * nOutputs * maxBlockSize, (sample) 0);
+  mTaskOutputPtrs.resize((size_t) mNTasks * nOutputs);
+
+  for (int i = 0; i < mNTasks * nOutputs; i++)
+    mTaskOutputPtrs[i] = mTaskBuffers.data() + (size_t) i * maxBlockSize;
+
+  mBusyVoices.clear();
+  mBusyVoices.reserve(std::max(mVoicePtrs.size(), (size_t) VoiceBitsArray::kMaxVoices));
+
+  ResizeOversampledBuffers(); // each task needs its own
+}
+
+void VoiceAllocator::ProcessVoice(int voiceIdx, sample** inputs, sample** outputs, int nInputs, int nOutputs, int startIndex, int blockSize, int bufferIdx)
+{
+  SynthVoice* pVoice = mVoicePtrs[voiceIdx];
+  const int rate = mVoiceOversampling[voiceIdx];
+
+  if(rate == 1)
+  {
+    pVoice->ProcessSamplesAccumulating(inputs, outputs, nInputs, nOutputs, startIndex, blockSize);
+    return;
+  }
+
+  Decimator<sample>* pDecimator = mVoiceDecimators[voiceIdx].get();
+
+  // SetOversampledOutputs() hasn't been called, or was called with too small a block size
+  if(!pDecimator || blockSize > mOversampledMaxBlockSize)
+  {
+    assert(false);
+    return;
+  }
+
+  const int nChans = std::min(nOutputs, mOversampledNOutputs);
+  const int nFramesOversampled = blockSize * rate;
+  sample** pBuffers = mOversampledPtrs.data() + bufferIdx * mOversampledNOutputs;
+
+  for(int c = 0; c < nChans; c++)
+    std::fill(pBuffers[c], pBuffers[c] + nFramesOversampled, (sample) 0);
+
+  pVoice->ProcessSamplesAccumulating(nullptr, pBuffers, 0, nChans, 0, nFramesOversampled);
+
+  for(int c = 0; c < nChans; c++)
+  {
+    pDecimator->ProcessBlock(pBuffers[c], blockSize, rate, c);
+    AccumulateSamples(outputs[c] + startIndex, pBuffers[c], blockSize);
+  }
+}
+
+void VoiceAllocator::SetOversampledOutputs(int nOutputs, int maxBlockSize)
+{
+  mOversampledNOutputs = nOutputs;
+  mOversampledMaxBlockSize = maxBlockSize;
+  mMaxOversampling = 1;
+
+  for(size_t v = 0; v < mVoicePtrs.size(); v++)
+  {
+    const int rate = mVoiceOversampling[v];
+    mMaxOversampling = std::max(mMaxOversampling, rate);
+
+    if(rate > 1 && (!mVoiceDecimators[v] || mVoiceDecimators[v]->NChannels() != nOutputs))
+      mVoiceDecimators[v].reset(new Decimator<sample>(nOutputs));
+  }
+
+  ResizeOversampledBuffers();
+}
+
+void VoiceAllocator::ResizeOversampledBuffers()
+{
+  if(mMaxOversampling == 1)
+  {
+    mOversampledBuffers.clear();
+    mOversampledPtrs.clear();
+    return;
+  }
+
+  const int nSets = std::max(1, mNTasks);
+  const size_t bufferSize = (size_t) mOversampledMaxBlockSize * mMaxOversampling;
+
+  mOversampledBuffers.assign(nSets * mOversampledNOutputs * bufferSize, (sample) 0);
+  mOversampledPtrs.resize(nSets * mOversampledNOutputs);
+
+  for(size_t i = 0; i < mOversampledPtrs.size(); i++)
+    mOversampledPtrs[i] = mOversampledBuffers.data() + i * bufferSize;
 }
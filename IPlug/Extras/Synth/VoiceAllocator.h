@@ -16,10 +16,16 @@
  */
 
 #include <array>
+#include <atomic>
 #include <vector>
 #include <stdint.h>
+#include <cstdlib>
+#include <cstring>
 #include <functional>
-#include <bitset>
+
+#if defined _MSC_VER
+  #include <intrin.h>
+#endif
 //#include <iostream>
 
 #include "IPlugLogger.h"
@@ -27,6 +33,8 @@
 
 #include "SynthVoice.h"
 
+template <typename T> class Decimator; // see Oversampler.h
+
 using namespace voiceControlNames;
 
 struct VoiceAddress
@@ -76,6 +84,77 @@ struct VoiceInputEvent
   int mSampleOffset;
 };
 
+#pragma mark - VoiceBitsArray class
+
+/** The most voices that a VoiceAllocator can hold. Define this in your project to allow more, e.g. for a granular engine with thousands of grains.
+ * Every voice set is this many bits long, but only the words that hold voices are visited */
+#ifndef VOICE_ALLOCATOR_MAX_VOICES
+  #define VOICE_ALLOCATOR_MAX_VOICES 256
+#endif
+
+/** A set of voice indices, kept as 64 bit words, so that set operations and iterating over the members work a word at a time */
+class VoiceBitsArray
+{
+public:
+  static constexpr int kMaxVoices = VOICE_ALLOCATOR_MAX_VOICES;
+  static constexpr int kNumWords = (kMaxVoices + 63) / 64;
+
+  bool operator[](int i) const { return (mWords[i >> 6] >> (i & 63)) & 1; }
+
+  void Set(int i) { mWords[i >> 6] |= uint64_t(1) << (i & 63); }
+  void Reset(int i) { mWords[i >> 6] &= ~(uint64_t(1) << (i & 63)); }
+  void Clear() { mWords.fill(0); }
+
+  bool Any() const
+  {
+    for (auto word : mWords)
+    {
+      if (word)
+        return true;
+    }
+
+    return false;
+  }
+
+  VoiceBitsArray& operator&=(const VoiceBitsArray& other)
+  {
+    for (int w = 0; w < kNumWords; w++)
+      mWords[w] &= other.mWords[w];
+
+    return *this;
+  }
+
+  /** Call func(int voiceIdx) for each voice in the set, in ascending order */
+  template <typename FUNC>
+  void ForEach(FUNC&& func) const
+  {
+    for (int w = 0; w < kNumWords; w++)
+    {
+      uint64_t bits = mWords[w];
+
+      while (bits)
+      {
+        func((w << 6) + LowestSetBit(bits));
+        bits &= bits - 1;
+      }
+    }
+  }
+
+private:
+  static inline int LowestSetBit(uint64_t bits)
+  {
+#if defined _MSC_VER
+    unsigned long idx;
+    _BitScanForward64(&idx, bits);
+    return (int) idx;
+#else
+    return __builtin_ctzll(bits);
+#endif
+  }
+
+  std::array<uint64_t, kNumWords> mWords {};
+};
+
 #pragma mark - VoiceAllocator class
 
 class VoiceAllocator final
@@ -96,8 +175,19 @@ public:
     kNumPolyModes
   };
 
+  /** How a voice is picked to be stolen when a note starts and all of the voices are busy */
+  enum EStealMode
+  {
+    kStealOldest = 0, // the voice that was triggered first
+    kStealQuietest, // the voice with the lowest SynthVoice::GetLevel(), or of those the one that was triggered first
+    kNumStealModes
+  };
+
   static constexpr int kVoiceMostRecent = 1 << 7;
 
+  /** The most output buses that voices can be routed to, see SetOutputBuses() */
+  static constexpr int kMaxOutputBuses = 64;
+
   // one voice worth of ramp generators
   typedef std::array<ControlRampProcessor, kNumVoiceControlRamps> VoiceControlRamps;
 
@@ -110,7 +200,7 @@ public:
   void SetNoteGlideTime(double t) { mNoteGlideTime = t; CalcGlideTimesInSamples(); }
   void SetControlGlideTime(double t) { mControlGlideTime = t; CalcGlideTimesInSamples(); }
 
-  /** Add a synth voice to the allocator. We do not take ownership ot the voice.
+  /** Add a synth voice to the allocator. We do not take ownership ot the voice. Throws if there are already VOICE_ALLOCATOR_MAX_VOICES voices.
    @param pv Pointer to the voice to add.
    @param zone A zone can be specified to make multitimbral synths.
    */
@@ -138,43 +228,155 @@ public:
    */
   void SendEventToVoices(VoiceInputEvent event);
 
+  /** Process the busy voices. Voices that return a SynthVoiceLanes from SynthVoice::GetLanes() are processed a lane group at a time, the others one at a time */
   void ProcessVoices(sample** inputs, sample** outputs, int nInputs, int nOutputs, int startIndex, int blockSize);
 
+  /** Runs task(taskCtx, i) for every i in [0, nTasks), possibly on several threads, and returns once all have finished, e.g. with a host thread pool
+   * such as CLAP's clap.thread-pool, see IPlugProcessor::HostParallelFor(), or IPlugRealtimePool::ParallelForFunc() where the host has none.
+   * Returns false if it couldn't run the tasks, in which case they haven't run */
+  using ParallelForFunc = bool (*)(void* ctx, int nTasks, void (*task)(void* taskCtx, int taskIdx), void* taskCtx);
+
+  /** Let ProcessVoices() spread the busy voices over nTasks tasks run by func. Each task renders its voices into its own buffers, which are then summed into the outputs.
+   * The voices must not share mutable state. This allocates, so call it from a non-realtime thread, e.g. in OnReset(). Passing nullptr or nTasks < 2 processes voices serially again
+   * @param func The function that runs the tasks
+   * @param ctx Passed to func
+   * @param nTasks The number of tasks, e.g. the number of cores
+   * @param nOutputs The number of output channels the voices render
+   * @param maxBlockSize The largest startIndex + blockSize that ProcessVoices() will be called with */
+  void SetParallelFor(ParallelForFunc func, void* ctx, int nTasks, int nOutputs, int maxBlockSize);
+
+  /** Use fewer of the tasks set up with SetParallelFor(), e.g. all of them while rendering offline and a couple in realtime, see IPlugOfflinePolicy. This doesn't allocate
+   * @param nTasks The most tasks to use, or 0 for all of them. 1 processes the voices serially */
+  void SetNActiveTasks(int nTasks) { mNActiveTasks = nTasks; }
+
+  /** Split the outputs of ProcessVoices() into buses, e.g. the 16 stereo outs of a drum instrument, so that each voice renders into the channels of its own bus, see SetVoiceOutputBus().
+   * The busy voices are grouped by bus, and each group accumulates into its bus's channels only, rather than every voice into the same outputs. Buses that aren't active are skipped, see SetOutputBusActive().
+   * Voices processed as lanes render to one bus per lane group. This allocates, so call it from a non-realtime thread, after adding the voices. With one bus (the default) every voice renders into all of the outputs
+   * @param nBuses The number of buses, up to kMaxOutputBuses
+   * @param nChannelsPerBus The number of channels of each bus. Bus b is channels b * nChannelsPerBus ... b * nChannelsPerBus + nChannelsPerBus - 1 of the outputs */
+  void SetOutputBuses(int nBuses, int nChannelsPerBus);
+
+  /** Route a voice to a bus, see SetOutputBuses(). A voice processed as a lane routes all of the voices in its lane group. Call between blocks, or on the audio thread
+   * @param voiceIndex The voice
+   * @param bus The bus, 0 by default */
+  void SetVoiceOutputBus(int voiceIndex, int bus);
+
+  /** Route all of the voices of a zone to a bus, e.g. a drum pad's voices, see AddVoice() */
+  void SetZoneOutputBus(uint8_t zone, int bus);
+
+  /** Skip rendering the voices of a bus that the host hasn't connected, e.g. from IPlugProcessor::IsChannelConnected(), which is cached, so is cheap to call every block.
+   * Voices on a bus that isn't active are not processed at all, so they carry on where they left off if it is connected again. All buses are active by default. Safe to call from any thread */
+  void SetOutputBusActive(int bus, bool active)
+  {
+    if (bus < 0 || bus >= kMaxOutputBuses)
+      return;
+
+    const uint64_t bit = uint64_t(1) << bus;
+
+    if (active)
+      mActiveOutputBuses.fetch_or(bit, std::memory_order_relaxed);
+    else
+      mActiveOutputBuses.fetch_and(~bit, std::memory_order_relaxed);
+  }
+
+  /** @return \c true if the voices of the bus are rendered, see SetOutputBusActive() */
+  bool GetOutputBusActive(int bus) const { return bus >= 0 && bus < kMaxOutputBuses && ((mActiveOutputBuses.load(std::memory_order_relaxed) >> bus) & 1); }
+
+  int GetNOutputBuses() const { return mNOutputBuses; }
+  int GetVoiceOutputBus(int voiceIndex) const { return mVoiceOutputBuses[voiceIndex]; }
+
+  /** Allocate the buffers and decimators for voices that render oversampled, see SynthVoice::GetOversampling().
+   * This allocates, so call it from a non-realtime thread, after adding the voices. MidiSynth calls it from SetSampleRateAndBlockSize()
+   * @param nOutputs The number of output channels the oversampled voices render
+   * @param maxBlockSize The largest blockSize that ProcessVoices() will be called with */
+  void SetOversampledOutputs(int nOutputs, int maxBlockSize);
+
+  /** Set a limit on the time ProcessVoices() may take, as a fraction of the duration of the block it renders. When a block takes longer,
+   * the quietest voices are soft-killed, see SynthVoice::SoftKill(), roughly in proportion to the overrun, so that the synth thins out rather than dropping out.
+   * Voices that are soft-killed are not picked again, and the limit is only checked when it is set, so that the timing costs nothing otherwise
+   * @param fraction e.g. 0.5 for half of the block's duration, or 0 (the default) for no limit */
+  void SetCPUBudget(double fraction) { mCPUBudget = fraction; }
+
+  void SetStealMode(EStealMode mode) { mStealMode = mode; }
+
+  /** @return The number of voices that have been soft-killed by the CPU budget since the last call to ResetNOverBudgetKills() */
+  int GetNOverBudgetKills() const { return mNOverBudgetKills; }
+  void ResetNOverBudgetKills() { mNOverBudgetKills = 0; }
+
   size_t GetNVoices() const {return mVoicePtrs.size();}
+
+  /** @return The number of active voices: those that have been started and were still busy at the end of the last ProcessVoices() */
+  size_t GetNActiveVoices() const {return mActiveVoices.size();}
   SynthVoice* GetVoice(int voiceIndex) const {return mVoicePtrs[voiceIndex];}
+  int GetVoiceOversampling(int voiceIndex) const {return mVoiceOversampling[voiceIndex];}
   void SetPitchOffset(float offset) { mPitchOffset = offset; }
 
 private:
 
-  typedef std::bitset<UCHAR_MAX> VoiceBitsArray;
-
   VoiceBitsArray VoicesMatchingAddress(VoiceAddress va);
 
-  void SendControlToVoiceInputs(VoiceBitsArray v, int ctlIdx, float val, int glideSamples);
-  void SendControlToVoicesDirect(VoiceBitsArray v, int ctlIdx, float val);
-  void SendProgramChangeToVoices(VoiceBitsArray v, int pgm);
+  void SendControlToVoiceInputs(const VoiceBitsArray& v, int ctlIdx, float val, int glideSamples);
+  void SendControlToVoicesDirect(const VoiceBitsArray& v, int ctlIdx, float val);
+  void SendProgramChangeToVoices(const VoiceBitsArray& v, int pgm);
 
   void StartVoice(int voiceIdx, int channel, int key, float pitch, float velocity, int sampleOffset, int64_t sampleTime, bool retrig);
-  void StartVoices(VoiceBitsArray voices, int channel, int key, float pitch, float velocity, int sampleOffset, int64_t sampleTime, bool retrig);
+  void StartVoices(const VoiceBitsArray& voices, int channel, int key, float pitch, float velocity, int sampleOffset, int64_t sampleTime, bool retrig);
 
   void StopVoice(int voiceIdx, int sampleOffset);
-  void StopVoices(VoiceBitsArray voices, int sampleOffset);
+  void StopVoices(const VoiceBitsArray& voices, int sampleOffset);
+
+  void SetVoiceChannelAndKey(int voiceIdx, uint8_t channel, uint8_t key);
+  void IndexVoiceChannelAndKey(int voiceIdx, bool add);
+  void ActivateVoice(int voiceIdx);
+  void DeactivateIdleVoices();
 
   void CalcGlideTimesInSamples();
   void ClearVoiceInputs(SynthVoice* pVoice);
   int FindFreeVoiceIndex(int startIndex) const;
   int FindVoiceIndexToSteal(int64_t sampleTime) const;
+  int FindQuietestVoiceIndex(const VoiceBitsArray& exclude) const;
+  void SoftKillQuietestVoices(int nVoices);
 
   void NoteOn(VoiceInputEvent e, int64_t sampleTime);
   void NoteOff(VoiceInputEvent e, int64_t sampleTime);
 
+  void AddVoiceToLaneGroup(SynthVoice* pVoice);
+  void ResizeOversampledBuffers();
+  void RenderVoices(sample** inputs, sample** outputs, int nInputs, int nOutputs, int startIndex, int blockSize);
+  void RenderVoicesByBus(sample** inputs, sample** outputs, int nInputs, int nOutputs, int startIndex, int blockSize);
+  void ProcessVoice(int voiceIdx, sample** inputs, sample** outputs, int nInputs, int nOutputs, int startIndex, int blockSize, int bufferIdx);
+
+  static void ProcessVoicesTask(void* pAllocator, int taskIdx);
+  static void ProcessBusUnitsTask(void* pAllocator, int taskIdx);
+
   IPlugQueue<VoiceInputEvent> mInputQueue{1024};
 
   std::vector<SynthVoice*> mVoicePtrs;
   std::vector<std::unique_ptr<VoiceControlRamps>> mVoiceGlides;
+  std::vector<uint32_t> mVoiceRampsUsed; // per voice, see SynthVoice::GetControlRampsUsed()
   std::vector<int> mHeldKeys; // The currently physically held keys on the keyboard
   std::vector<int> mSustainedNotes; // Any notes that are sustained, including those that are physically held
 
+  // Only the active voices are processed. A voice becomes active when it is started, and stays active until ProcessVoices() finds it idle.
+  // Voices are only started by the allocator, so a voice that isn't active is never busy
+  std::vector<int> mActiveVoices; // voice indices, each voice knows its position, see SynthVoice::mActiveIndex
+  VoiceBitsArray mActiveBits;
+
+  static constexpr int kNumChannelBits = 16; // MIDI channels and keys, other values are found by a scan
+  static constexpr int kNumKeyBits = 128;
+
+  // the voices of each zone, channel and key, so that VoicesMatchingAddress() needs no scan of the voices
+  VoiceBitsArray mAllVoiceBits;
+  std::vector<VoiceBitsArray> mZoneBits;
+  std::array<VoiceBitsArray, kNumChannelBits> mChannelBits;
+  std::array<VoiceBitsArray, kNumKeyBits> mKeyBits; // voices that have been stopped have the key UCHAR_MAX, which isn't indexed
+
+  // voice stealing and the CPU budget, see SetCPUBudget()
+  EStealMode mStealMode{kStealOldest};
+  double mCPUBudget{0.};
+  VoiceBitsArray mSoftKilledBits; // voices soft-killed by the CPU budget since they were last started
+  int mNOverBudgetKills{0};
+
   std::function<double(int)> mKeyToPitchFn;
   double mPitchOffset{0.};
 
@@ -185,6 +387,62 @@ private:
   double mSampleRate;
   int mBlockSize;
 
+  // voices processed in lockstep, see SynthVoiceLanes
+  struct LaneGroup
+  {
+    SynthVoiceLanes* mLanes;
+    int mGroup;
+    uint32_t mBusyLanes; // set by ProcessVoices()
+    int mOutputBus; // see SetVoiceOutputBus()
+  };
+
+  std::vector<LaneGroup> mLaneGroups;
+  std::vector<int> mVoiceLaneGroups; // per voice, its index in mLaneGroups, or -1
+  std::vector<uint8_t> mVoiceLanes; // per voice, its lane in the group
+
+  // oversampled voices, see SynthVoice::GetOversampling()
+  std::vector<int> mVoiceOversampling; // per voice
+  std::vector<std::unique_ptr<Decimator<sample>>> mVoiceDecimators; // per voice, nullptr for voices that aren't oversampled
+  int mOversampledNOutputs{0};
+  int mOversampledMaxBlockSize{0};
+  int mMaxOversampling{1};
+  std::vector<sample> mOversampledBuffers; // one set per task, see SetParallelFor(), each mOversampledNOutputs * mOversampledMaxBlockSize * mMaxOversampling
+  std::vector<sample*> mOversampledPtrs;
+
+  // parallel voice processing, see SetParallelFor()
+  // output buses, see SetOutputBuses()
+  struct BusUnit
+  {
+    int mBus;
+    int mVoiceIdx; // or -1 for a lane group
+    LaneGroup* mGroup;
+  };
+
+  void ProcessBusUnit(const BusUnit& unit, sample** inputs, sample** outputs, int nInputs, int nOutputs, int startIndex, int blockSize, int bufferIdx);
+
+  int mNOutputBuses{1};
+  int mBusNChannels{0};
+  std::vector<uint8_t> mVoiceOutputBuses; // per voice
+  std::atomic<uint64_t> mActiveOutputBuses{~uint64_t(0)};
+  std::vector<BusUnit> mBusUnits; // the busy voices and lane groups of the current block, ordered by bus
+  uint64_t mBusesWithUnits{0};
+
+  ParallelForFunc mParallelFor{nullptr};
+  void* mParallelForCtx{nullptr};
+  int mNTasks{0};
+  int mNActiveTasks{0}; // see SetNActiveTasks()
+  int mTaskNTasks{0}; // the tasks the current block's voices are dealt to
+  int mTaskNOutputs{0};
+  int mTaskMaxBlockSize{0};
+  std::vector<sample> mTaskBuffers; // mNTasks * mTaskNOutputs * mTaskMaxBlockSize
+  std::vector<sample*> mTaskOutputPtrs; // mNTasks * mTaskNOutputs
+  std::vector<int> mBusyVoices;
+  std::vector<LaneGroup*> mBusyLaneGroups;
+  sample** mTaskInputs{nullptr};
+  int mTaskNInputs{0};
+  int mTaskStartIndex{0};
+  int mTaskBlockSize{0};
+
   bool mRotateVoices{true};
   int mVoiceRotateIndex{0};
   bool mSustainPedalDown{false};
@@ -0,0 +1,375 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * Structure-of-arrays versions of SinOscillator, ADSREnvelope and SVF, which run N voices in lockstep, one voice per SIMD lane.
+ * They are the building blocks of a SynthVoiceLanes implementation (see SynthVoice.h).
+ * Each Process() computes one sample for every lane with fixed length loops over plain arrays, without branches, which the compiler vectorizes,
+ * so N should match the vector width for T: 4 for float with SSE or NEON, 8 for float with AVX, 2 or 4 for double.
+ * Idle lanes are processed along with the others, which costs nothing extra, their output is just ignored.
+ */
+
+#include <cassert>
+#include <cmath>
+#include <functional>
+
+#include "IPlugUtilities.h"
+#include "ADSREnvelope.h"
+#include "SVF.h"
+
+/** A sine oscillator for N lanes. Uses a polynomial rather than SinOscillator's std::sin() or FastSinOscillator's table lookup,
+ * since neither vectorizes. The error is below 1e-5 */
+template <typename T, int N>
+class SinOscillatorLanes
+{
+public:
+  void SetSampleRate(double sampleRate) { mSampleRateReciprocal = 1. / sampleRate; }
+
+  inline void SetFreqCPS(int lane, double freqCPS) { mPhaseIncr[lane] = static_cast<T>(freqCPS * mSampleRateReciprocal); }
+
+  /** @param phase The start phase, between 0 and 1 */
+  void Reset(int lane, double phase = 0.) { mPhase[lane] = static_cast<T>(phase); }
+
+  /** Compute the next sample of each lane into pOutput[0 ... N-1] */
+  inline void Process(T* pOutput)
+  {
+    for (int l = 0; l < N; l++)
+    {
+      T phase = mPhase[l] + mPhaseIncr[l];
+      phase -= phase >= T(1) ? T(1) : T(0);
+      mPhase[l] = phase;
+
+      // sin(2pi * phase) = -sin(2pi * x) with x in [-0.5, 0.5), folded into [-0.25, 0.25] where the Taylor series converges quickly
+      const T x = phase - T(0.5);
+      const T y = x > T(0.25) ? T(0.5) - x : (x < T(-0.25) ? T(-0.5) - x : x);
+      const T z = y * T(2. * PI);
+      const T z2 = z * z;
+      pOutput[l] = -z * (T(1) + z2 * (T(-1./6.) + z2 * (T(1./120.) + z2 * (T(-1./5040.) + z2 * T(1./362880.)))));
+    }
+  }
+
+private:
+  T mPhase[N] = {};
+  T mPhaseIncr[N] = {};
+  double mSampleRateReciprocal = 1. / 44100.;
+};
+
+/** ADSREnvelope for N lanes, with the same stages, times and output.
+ * Every stage is written as env = env * mul + add, with per lane coefficients, and its output as a weighted mix of env and the sustain level,
+ * so that the per sample work is the same for every lane. A lane only takes the scalar path in the sample where it moves to another stage */
+template <typename T, int N>
+class ADSREnvelopeLanes
+{
+public:
+  using EStages = typename ADSREnvelope<T>::EStages;
+
+  /** @param resetFunc Called with the lane when a retriggered lane restarts its attack, see ADSREnvelope */
+  ADSREnvelopeLanes(std::function<void(int lane)> resetFunc = nullptr)
+  : mResetFunc(resetFunc)
+  {
+    for (int l = 0; l < N; l++)
+      SetStage(l, ADSREnvelope<T>::kIdle);
+
+    SetSampleRate(44100.);
+  }
+
+  /** Set a stage time for all lanes. Call SetStageTime() for kAttack, kDecay and kRelease before starting any lane */
+  void SetStageTime(int stage, double timeMS)
+  {
+    const double t = Clip(timeMS, ADSREnvelope<T>::MIN_ENV_TIME_MS, ADSREnvelope<T>::MAX_ENV_TIME_MS);
+
+    switch (stage)
+    {
+      case ADSREnvelope<T>::kAttack: mAttackIncr = CalcIncrFromTimeLinear(t, mSampleRate); break;
+      case ADSREnvelope<T>::kDecay: mDecayIncr = CalcIncrFromTimeExp(t, mSampleRate); break;
+      case ADSREnvelope<T>::kRelease: mReleaseIncr = CalcIncrFromTimeExp(t, mSampleRate); break;
+      default: break;
+    }
+  }
+
+  void SetSampleRate(double sampleRate)
+  {
+    mSampleRate = sampleRate;
+    mEarlyReleaseIncr = CalcIncrFromTimeLinear(ADSREnvelope<T>::EARLY_RELEASE_TIME, sampleRate);
+    mRetriggerReleaseIncr = CalcIncrFromTimeLinear(ADSREnvelope<T>::RETRIGGER_RELEASE_TIME, sampleRate);
+  }
+
+  bool GetBusy(int lane) const { return mStage[lane] != ADSREnvelope<T>::kIdle; }
+
+  T GetPrevOutput(int lane) const { return mPrevResult[lane] * mLevel[lane]; }
+
+  void Start(int lane, double level, double timeScalar = 1.)
+  {
+    mEnvValue[lane] = T(0);
+    mLevel[lane] = static_cast<T>(level);
+    mScalar[lane] = 1. / timeScalar;
+    SetStage(lane, ADSREnvelope<T>::kAttack);
+  }
+
+  void Release(int lane)
+  {
+    mReleaseLevel[lane] = mPrevResult[lane];
+    mEnvValue[lane] = T(1);
+    SetStage(lane, ADSREnvelope<T>::kRelease);
+  }
+
+  void Retrigger(int lane, double newStartLevel, double timeScalar = 1.)
+  {
+    mEnvValue[lane] = T(1);
+    mNewStartLevel[lane] = static_cast<T>(newStartLevel);
+    mScalar[lane] = 1. / timeScalar;
+    mReleaseLevel[lane] = mPrevResult[lane];
+    SetStage(lane, ADSREnvelope<T>::kReleasedToRetrigger);
+  }
+
+  void Kill(int lane, bool hard)
+  {
+    if (mStage[lane] == ADSREnvelope<T>::kIdle)
+      return;
+
+    mReleaseLevel[lane] = hard ? T(0) : mPrevResult[lane];
+    mEnvValue[lane] = hard ? T(0) : T(1);
+    SetStage(lane, hard ? ADSREnvelope<T>::kIdle : ADSREnvelope<T>::kReleasedToEndEarly);
+  }
+
+  /** Compute the next sample of each lane into pOutput[0 ... N-1] */
+  inline void Process(T sustainLevel, T* pOutput)
+  {
+    bool anyStageEnds = false;
+
+    for (int l = 0; l < N; l++)
+    {
+      const T env = mEnvValue[l] * mMul[l] + mAdd[l];
+      mEnvValue[l] = env;
+      anyStageEnds |= (env > mEndAbove[l]) | (env < mEndBelow[l]);
+    }
+
+    if (anyStageEnds)
+    {
+      for (int l = 0; l < N; l++)
+      {
+        if (mEnvValue[l] > mEndAbove[l] || mEnvValue[l] < mEndBelow[l])
+          EndStage(l);
+      }
+    }
+
+    for (int l = 0; l < N; l++)
+    {
+      const T sus = sustainLevel * mSustainWeight[l];
+      const T result = mEnvValue[l] * mEnvWeight[l] * (T(1) - sus) + sus;
+      mPrevResult[l] = result;
+      pOutput[l] = result * mLevel[l];
+    }
+  }
+
+private:
+  static constexpr T kNever = T(2); // outside the range of env, so the comparison with it is always false
+
+  /** Move a lane to stage, setting its coefficients */
+  void SetStage(int lane, int stage)
+  {
+    const T scalar = static_cast<T>(mScalar[lane]);
+    mStage[lane] = stage;
+    mMul[lane] = T(1);
+    mAdd[lane] = T(0);
+    mEndAbove[lane] = kNever;
+    mEndBelow[lane] = -kNever;
+    mEnvWeight[lane] = T(1);
+    mSustainWeight[lane] = T(0);
+
+    switch (stage)
+    {
+      case ADSREnvelope<T>::kAttack:
+        mAdd[lane] = static_cast<T>(mAttackIncr) * scalar;
+        mEndAbove[lane] = mAttackIncr == 0. ? -kNever : static_cast<T>(ADSREnvelope<T>::ENV_VALUE_HIGH);
+        break;
+      case ADSREnvelope<T>::kDecay:
+        mMul[lane] = T(1) - static_cast<T>(mDecayIncr) * scalar;
+        mEndBelow[lane] = static_cast<T>(ADSREnvelope<T>::ENV_VALUE_LOW);
+        mSustainWeight[lane] = T(1);
+        break;
+      case ADSREnvelope<T>::kSustain:
+        mEnvWeight[lane] = T(0);
+        mSustainWeight[lane] = T(1);
+        break;
+      case ADSREnvelope<T>::kRelease:
+        mMul[lane] = T(1) - static_cast<T>(mReleaseIncr) * scalar;
+        mEndBelow[lane] = mReleaseIncr == 0. ? kNever : static_cast<T>(ADSREnvelope<T>::ENV_VALUE_LOW);
+        mEnvWeight[lane] = mReleaseLevel[lane];
+        break;
+      case ADSREnvelope<T>::kReleasedToRetrigger:
+        mAdd[lane] = -static_cast<T>(mRetriggerReleaseIncr);
+        mEndBelow[lane] = static_cast<T>(ADSREnvelope<T>::ENV_VALUE_LOW);
+        mEnvWeight[lane] = mReleaseLevel[lane];
+        break;
+      case ADSREnvelope<T>::kReleasedToEndEarly:
+        mAdd[lane] = -static_cast<T>(mEarlyReleaseIncr);
+        mEndBelow[lane] = static_cast<T>(ADSREnvelope<T>::ENV_VALUE_LOW);
+        mEnvWeight[lane] = mReleaseLevel[lane];
+        break;
+      default: // kIdle
+        mEnvValue[lane] = T(0);
+        break;
+    }
+  }
+
+  /** The stage transitions of ADSREnvelope::Process() */
+  void EndStage(int lane)
+  {
+    switch (mStage[lane])
+    {
+      case ADSREnvelope<T>::kAttack:
+        mEnvValue[lane] = T(1);
+        SetStage(lane, ADSREnvelope<T>::kDecay);
+        break;
+      case ADSREnvelope<T>::kDecay:
+        mEnvValue[lane] = T(1);
+        SetStage(lane, ADSREnvelope<T>::kSustain);
+        break;
+      case ADSREnvelope<T>::kReleasedToRetrigger:
+        mLevel[lane] = mNewStartLevel[lane];
+        mEnvValue[lane] = T(0);
+        mPrevResult[lane] = T(0);
+        mReleaseLevel[lane] = T(0);
+        SetStage(lane, ADSREnvelope<T>::kAttack);
+
+        if (mResetFunc)
+          mResetFunc(lane);
+        break;
+      case ADSREnvelope<T>::kReleasedToEndEarly:
+        mLevel[lane] = T(0);
+        mPrevResult[lane] = T(0);
+        mReleaseLevel[lane] = T(0);
+        SetStage(lane, ADSREnvelope<T>::kIdle);
+        break;
+      default: // kRelease
+        SetStage(lane, ADSREnvelope<T>::kIdle);
+        break;
+    }
+  }
+
+  static double CalcIncrFromTimeLinear(double timeMS, double sr)
+  {
+    return timeMS <= 0. ? 0. : (1. / sr) / (timeMS / 1000.);
+  }
+
+  static double CalcIncrFromTimeExp(double timeMS, double sr)
+  {
+    if (timeMS <= 0.)
+      return 0.;
+
+    const double r = -std::expm1(1000.0 * std::log(0.001) / (sr * timeMS));
+    return r < 1. ? r : 1.;
+  }
+
+  // per lane state and coefficients
+  T mEnvValue[N] = {};
+  T mMul[N] = {};
+  T mAdd[N] = {};
+  T mEndAbove[N] = {};
+  T mEndBelow[N] = {};
+  T mEnvWeight[N] = {};
+  T mSustainWeight[N] = {};
+  T mLevel[N] = {};
+  T mPrevResult[N] = {};
+  T mReleaseLevel[N] = {};
+  T mNewStartLevel[N] = {};
+  double mScalar[N] = {};
+  int mStage[N] = {};
+
+  double mSampleRate = 44100.;
+  double mAttackIncr = 0.;
+  double mDecayIncr = 0.;
+  double mReleaseIncr = 0.;
+  double mEarlyReleaseIncr = 0.;
+  double mRetriggerReleaseIncr = 0.;
+  std::function<void(int lane)> mResetFunc;
+};
+
+/** A mono SVF for N lanes, each with its own settings and state. Coefficients are calculated with SVF::CalcCoefficients() when settings change,
+ * which allocates nothing but isn't cheap, so change them at control rate */
+template <typename T, int N>
+class SVFLanes
+{
+public:
+  using EMode = typename SVF<T>::EMode;
+
+  /** Set the settings of a lane, see SVF */
+  void SetParams(int lane, EMode mode, double freqCPS, double Q, double gainDB, double sampleRate)
+  {
+    double a1, a2, a3, m0, m1, m2;
+    SVF<T>::CalcCoefficients(mode, Clip(freqCPS, 10., 20000.), Clip(Q, 0.1, 100.), Clip(gainDB, -36., 36.), sampleRate, a1, a2, a3, m0, m1, m2);
+    m_a1[lane] = static_cast<T>(a1);
+    m_a2[lane] = static_cast<T>(a2);
+    m_a3[lane] = static_cast<T>(a3);
+    m_m0[lane] = static_cast<T>(m0);
+    m_m1[lane] = static_cast<T>(m1);
+    m_m2[lane] = static_cast<T>(m2);
+    mK[lane] = static_cast<T>(1. / Clip(Q, 0.1, 100.));
+    mGScale[lane] = static_cast<T>(SVF<T>::CalcGScale(mode, Clip(gainDB, -36., 36.)));
+    mPiOverSampleRate[lane] = static_cast<T>(PI / sampleRate);
+    mMaxFreq[lane] = static_cast<T>(std::min(20000., 0.49 * sampleRate));
+  }
+
+  void Reset(int lane)
+  {
+    mIc1eq[lane] = T(0);
+    mIc2eq[lane] = T(0);
+  }
+
+  /** Filter one sample of each lane in place, pIO[0 ... N-1] */
+  inline void Process(T* pIO)
+  {
+    for (int l = 0; l < N; l++)
+    {
+      const T v0 = pIO[l];
+      const T v3 = v0 - mIc2eq[l];
+      const T v1 = m_a1[l] * mIc1eq[l] + m_a2[l] * v3;
+      const T v2 = mIc2eq[l] + m_a2[l] * mIc1eq[l] + m_a3[l] * v3;
+      mIc1eq[l] = T(2) * v1 - mIc1eq[l];
+      mIc2eq[l] = T(2) * v2 - mIc2eq[l];
+      pIO[l] = m_m0[l] * v0 + m_m1[l] * v1 + m_m2[l] * v2;
+    }
+  }
+
+  /** Filter one sample of each lane in place, with each lane's cutoff modulated, e.g. by its envelope. The coefficients are recomputed from the
+   * cutoffs with SVF::FastTan(), the other settings are those of the last SetParams()
+   * @param pFreqCPS The cutoffs in Hz, N values */
+  inline void Process(T* pIO, const T* pFreqCPS)
+  {
+    for (int l = 0; l < N; l++)
+    {
+      const T freq = pFreqCPS[l] < T(10) ? T(10) : (pFreqCPS[l] > mMaxFreq[l] ? mMaxFreq[l] : pFreqCPS[l]);
+      const T g = SVF<T>::FastTan(freq * mPiOverSampleRate[l]) * mGScale[l];
+      m_a1[l] = T(1) / (T(1) + g * (g + mK[l]));
+      m_a2[l] = g * m_a1[l];
+      m_a3[l] = g * m_a2[l];
+    }
+
+    Process(pIO);
+  }
+
+private:
+  T mIc1eq[N] = {};
+  T mIc2eq[N] = {};
+  T m_a1[N] = {};
+  T m_a2[N] = {};
+  T m_a3[N] = {};
+  T m_m0[N] = {};
+  T m_m1[N] = {};
+  T m_m2[N] = {};
+  T mK[N] = {};
+  T mGScale[N] = {};
+  T mPiOverSampleRate[N] = {};
+  T mMaxFreq[N] = {};
+};
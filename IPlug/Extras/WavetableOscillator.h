@@ -0,0 +1,475 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * Band-limited wavetable oscillators. A Wavetable holds one cycle of a waveform at a series of octave spaced mip levels, each with half the harmonics
+ * of the one before, and an oscillator reads the level whose highest harmonic stays below Nyquist at its frequency.
+ * Tables are built once per process and shared between plug-in instances, see SharedWavetables.
+ * WavetableOscillator is a single oscillator, WavetableOscillatorBank renders N of them per call, e.g. for unison or for several voices.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mutex.h"
+#include "ptrlist.h"
+#include "wdlstring.h"
+
+#include "IPlugConstants.h"
+#include "Oscillator.h"
+
+/** One cycle of a waveform, band-limited at kNumLevels octave spaced mip levels. Level m has up to kMaxHarmonics >> m harmonics, in a table
+ * of kTableSize >> m samples (at least kMinTableSize), so all of the levels together take about twice the memory of the first.
+ * The levels are stored one after the other, each followed by a copy of its first sample, so that linear interpolation needs no wrap */
+template <typename T>
+class Wavetable
+{
+public:
+  static constexpr int kTableSize = 4096;
+  static constexpr int kMinTableSize = 64;
+  static constexpr int kMaxHarmonics = kTableSize / 4;
+  static constexpr int kNumLevels = 11; // down to a single harmonic
+
+  /** Build the table from the amplitudes of its harmonics
+   * @param pSinAmps The amplitude of the sine component of harmonic h at [h], [0] is ignored. nullptr for none
+   * @param pCosAmps The amplitude of the cosine component of harmonic h at [h], [0] is the DC offset. nullptr for none
+   * @param nHarmonics The size of the arrays. Harmonics beyond kMaxHarmonics are dropped
+   * @param normalize \c true to scale the table so that the peak of its first level is 1, the same scale is applied to every level */
+  Wavetable(const double* pSinAmps, const double* pCosAmps, int nHarmonics, bool normalize = true)
+  {
+    Build(pSinAmps, pCosAmps, nHarmonics, normalize);
+  }
+
+  /** Build the table from a single cycle of a waveform, by finding its harmonics
+   * @param pCycle The samples of the cycle
+   * @param length The number of samples, harmonics at or above length / 2 are dropped */
+  static Wavetable* FromCycle(const T* pCycle, int length, bool normalize = true)
+  {
+    const int nHarmonics = std::min(kMaxHarmonics + 1, length / 2);
+    std::vector<double> sinAmps(nHarmonics, 0.);
+    std::vector<double> cosAmps(nHarmonics, 0.);
+    std::vector<double> sinTable(length);
+
+    for (int i = 0; i < length; i++)
+      sinTable[i] = std::sin(2. * PI * i / length);
+
+    for (int h = 0; h < nHarmonics; h++)
+    {
+      double s = 0., c = 0.;
+      int sinIdx = 0; // h * i % length, so that every sine and cosine is a lookup
+      const int cosOffset = length / 4;
+
+      for (int i = 0; i < length; i++)
+      {
+        s += pCycle[i] * sinTable[sinIdx];
+        c += pCycle[i] * (length % 4 ? std::cos(2. * PI * sinIdx / length) : sinTable[(sinIdx + cosOffset) % length]);
+        sinIdx += h;
+        sinIdx -= sinIdx >= length ? length : 0;
+      }
+
+      sinAmps[h] = 2. * s / length;
+      cosAmps[h] = (h ? 2. : 1.) * c / length;
+    }
+
+    return new Wavetable(sinAmps.data(), cosAmps.data(), nHarmonics, normalize);
+  }
+
+  /** A rising sawtooth */
+  static Wavetable* MakeSaw()
+  {
+    std::vector<double> sinAmps(kMaxHarmonics + 1, 0.);
+
+    for (int h = 1; h <= kMaxHarmonics; h++)
+      sinAmps[h] = (h & 1 ? 2. : -2.) / (PI * h);
+
+    return new Wavetable(sinAmps.data(), nullptr, kMaxHarmonics + 1);
+  }
+
+  static Wavetable* MakeSquare()
+  {
+    std::vector<double> sinAmps(kMaxHarmonics + 1, 0.);
+
+    for (int h = 1; h <= kMaxHarmonics; h += 2)
+      sinAmps[h] = 4. / (PI * h);
+
+    return new Wavetable(sinAmps.data(), nullptr, kMaxHarmonics + 1);
+  }
+
+  static Wavetable* MakeTriangle()
+  {
+    std::vector<double> sinAmps(kMaxHarmonics + 1, 0.);
+
+    for (int h = 1; h <= kMaxHarmonics; h += 2)
+      sinAmps[h] = ((h / 2) & 1 ? -8. : 8.) / (PI * PI * h * h);
+
+    return new Wavetable(sinAmps.data(), nullptr, kMaxHarmonics + 1);
+  }
+
+  /** @param phaseIncr The oscillator's frequency in cycles per sample
+   * @return The level to read at that frequency: the first whose highest harmonic is below Nyquist */
+  static int LevelForIncrement(double phaseIncr)
+  {
+    const double x = std::fabs(phaseIncr) * (2 * kMaxHarmonics);
+
+    if (x < 1.)
+      return 0;
+
+    return std::min(kNumLevels - 1, std::ilogb(x) + 1);
+  }
+
+  /** @return The first sample of level, which is followed by LevelSize(level) + 1 samples */
+  const T* GetLevel(int level) const { return mData.data() + mOffsets[level]; }
+
+  static int LevelSize(int level) { return std::max(kMinTableSize, kTableSize >> level); }
+
+  /** Read the table with linear interpolation
+   * @param phase Between 0 and 1 */
+  inline T Lookup(int level, double phase) const
+  {
+    const T* pTable = GetLevel(level);
+    const double pos = phase * LevelSize(level);
+    const int idx = static_cast<int>(pos);
+    const T frac = static_cast<T>(pos - idx);
+    return pTable[idx] + frac * (pTable[idx + 1] - pTable[idx]);
+  }
+
+private:
+  void Build(const double* pSinAmps, const double* pCosAmps, int nHarmonics, bool normalize)
+  {
+    int size = 0;
+
+    for (int m = 0; m < kNumLevels; m++)
+    {
+      mOffsets[m] = size;
+      size += LevelSize(m) + 1;
+    }
+
+    mData.assign(size, T(0));
+
+    std::vector<double> level;
+    std::vector<double> sinTable;
+    double scale = 1.;
+
+    for (int m = 0; m < kNumLevels; m++)
+    {
+      const int levelSize = LevelSize(m);
+      const int maxHarmonic = std::min(nHarmonics - 1, kMaxHarmonics >> m);
+      level.assign(levelSize, pCosAmps ? pCosAmps[0] : 0.);
+      sinTable.resize(levelSize);
+
+      for (int i = 0; i < levelSize; i++)
+        sinTable[i] = std::sin(2. * PI * i / levelSize);
+
+      // level sizes are powers of two, so h * i wraps with a mask and the cosine is the sine a quarter of a cycle on
+      const int mask = levelSize - 1;
+
+      for (int h = 1; h <= maxHarmonic; h++)
+      {
+        const double sinAmp = pSinAmps ? pSinAmps[h] : 0.;
+        const double cosAmp = pCosAmps ? pCosAmps[h] : 0.;
+
+        if (sinAmp == 0. && cosAmp == 0.)
+          continue;
+
+        for (int i = 0; i < levelSize; i++)
+        {
+          const int idx = (h * i) & mask;
+          level[i] += sinAmp * sinTable[idx] + cosAmp * sinTable[(idx + levelSize / 4) & mask];
+        }
+      }
+
+      if (m == 0 && normalize)
+      {
+        double peak = 0.;
+
+        for (double s : level)
+          peak = std::max(peak, std::fabs(s));
+
+        scale = peak > 0. ? 1. / peak : 1.;
+      }
+
+      T* pLevel = mData.data() + mOffsets[m];
+
+      for (int i = 0; i < levelSize; i++)
+        pLevel[i] = static_cast<T>(level[i] * scale);
+
+      pLevel[levelSize] = pLevel[0];
+    }
+  }
+
+  std::vector<T> mData;
+  int mOffsets[kNumLevels];
+};
+
+/** Gives access to the wavetables of the process, which are built the first time they are asked for and shared by every instance that holds a SharedWavetables,
+ * in the same way as IGraphics shares bitmaps with StaticStorage. The tables are freed when the last SharedWavetables is destroyed.
+ * Getting a table locks a mutex and may build it, so do it outside of the audio thread, e.g. in the plug-in's constructor or OnReset() */
+template <typename T>
+class SharedWavetables
+{
+public:
+  enum EWaveform
+  {
+    kSaw = 0,
+    kSquare,
+    kTriangle,
+    kNumWaveforms
+  };
+
+  SharedWavetables()
+  {
+    Storage& storage = GetStorage();
+    WDL_MutexLock lock(&storage.mMutex);
+    storage.mCount++;
+  }
+
+  ~SharedWavetables()
+  {
+    Storage& storage = GetStorage();
+    WDL_MutexLock lock(&storage.mMutex);
+
+    if (--storage.mCount == 0)
+      storage.mTables.Empty(true);
+  }
+
+  SharedWavetables(const SharedWavetables&) = delete;
+  SharedWavetables& operator=(const SharedWavetables&) = delete;
+
+  const Wavetable<T>* Get(EWaveform waveform)
+  {
+    switch (waveform)
+    {
+      case kSquare: return Get("square", &Wavetable<T>::MakeSquare);
+      case kTriangle: return Get("triangle", &Wavetable<T>::MakeTriangle);
+      default: return Get("saw", &Wavetable<T>::MakeSaw);
+    }
+  }
+
+  /** Get a custom table, building it if no instance has yet
+   * @param name Identifies the table in the process, e.g. "MyPlugin-formant"
+   * @param build A function returning a new Wavetable<T>, of which the storage takes ownership */
+  template <typename FUNC>
+  const Wavetable<T>* Get(const char* name, FUNC&& build)
+  {
+    Storage& storage = GetStorage();
+    WDL_MutexLock lock(&storage.mMutex);
+    const size_t hashID = std::hash<std::string>()(name);
+
+    for (int i = 0; i < storage.mTables.GetSize(); i++)
+    {
+      TableKey* pKey = storage.mTables.Get(i);
+
+      // use the hash for a quick search, then confirm with the name
+      if (pKey->hashID == hashID && !strcmp(name, pKey->name.Get()))
+        return pKey->table.get();
+    }
+
+    TableKey* pKey = storage.mTables.Add(new TableKey);
+    pKey->hashID = hashID;
+    pKey->name.Set(name);
+    pKey->table = std::unique_ptr<Wavetable<T>>(build());
+    return pKey->table.get();
+  }
+
+private:
+  struct TableKey
+  {
+    size_t hashID; // not guaranteed to be unique
+    WDL_String name;
+    std::unique_ptr<Wavetable<T>> table;
+  };
+
+  struct Storage
+  {
+    ~Storage() { mTables.Empty(true); }
+
+    int mCount = 0;
+    WDL_Mutex mMutex;
+    WDL_PtrList<TableKey> mTables;
+  };
+
+  static Storage& GetStorage()
+  {
+    static Storage sStorage;
+    return sStorage;
+  }
+};
+
+/** An oscillator that reads a Wavetable, choosing the level from its frequency so that it doesn't alias */
+template <typename T>
+class WavetableOscillator : public IOscillator<T>
+{
+public:
+  WavetableOscillator(const Wavetable<T>* pTable = nullptr, double startPhase = 0., double startFreq = 1.)
+  : IOscillator<T>(startPhase, startFreq)
+  , mTable(pTable)
+  {
+  }
+
+  /** @param pTable The table to read, which must outlive the oscillator, e.g. from SharedWavetables */
+  void SetWavetable(const Wavetable<T>* pTable) { mTable = pTable; }
+
+  inline T Process(double freqHz) override
+  {
+    IOscillator<T>::SetFreqCPS(freqHz);
+    T output = 0.;
+    ProcessBlock(&output, 1);
+    return output;
+  }
+
+  /** Render nFrames at the frequency set by the last SetFreqCPS() or Process() */
+  void ProcessBlock(T* pOutput, int nFrames)
+  {
+    if (!mTable)
+    {
+      memset(pOutput, 0, nFrames * sizeof(T));
+      return;
+    }
+
+    const double phaseIncr = IOscillator<T>::mPhaseIncr - std::floor(IOscillator<T>::mPhaseIncr);
+    const int level = Wavetable<T>::LevelForIncrement(IOscillator<T>::mPhaseIncr);
+    double phase = IOscillator<T>::mPhase - std::floor(IOscillator<T>::mPhase);
+
+    for (int s = 0; s < nFrames; s++)
+    {
+      pOutput[s] = mTable->Lookup(level, phase);
+      phase += phaseIncr;
+      phase -= phase >= 1. ? 1. : 0.;
+    }
+
+    IOscillator<T>::mPhase = phase;
+  }
+
+private:
+  const Wavetable<T>* mTable;
+};
+
+/** N wavetable oscillators kept as structure-of-arrays, each with its own table, frequency and phase, rendered together a sample at a time,
+ * with the interpolation of every oscillator in one fixed length loop that the compiler can vectorize (the table reads are gathers, see VoiceLanes.h).
+ * The level is chosen when the frequency is set, so set frequencies once per block */
+template <typename T, int N>
+class WavetableOscillatorBank
+{
+public:
+  WavetableOscillatorBank()
+  {
+    for (int i = 0; i < N; i++)
+      SetWavetable(i, nullptr);
+  }
+
+  void SetSampleRate(double sampleRate) { mSampleRateReciprocal = 1. / sampleRate; }
+
+  /** @param pTable The table that oscillator i reads, which must outlive the bank. nullptr silences it */
+  void SetWavetable(int i, const Wavetable<T>* pTable)
+  {
+    mTables[i] = pTable;
+    SetLevel(i);
+  }
+
+  inline void SetFreqCPS(int i, double freqCPS)
+  {
+    const double phaseIncr = freqCPS * mSampleRateReciprocal;
+    mPhaseIncr[i] = phaseIncr - std::floor(phaseIncr);
+    mLevels[i] = Wavetable<T>::LevelForIncrement(phaseIncr);
+    SetLevel(i);
+  }
+
+  /** @param phase The start phase, between 0 and 1 */
+  void Reset(int i, double phase = 0.) { mPhase[i] = phase - std::floor(phase); }
+
+  /** Render each oscillator into its own buffer
+   * @param pOutputs N buffers of nFrames */
+  void ProcessBlock(T** pOutputs, int nFrames)
+  {
+    T values[N];
+
+    for (int s = 0; s < nFrames; s++)
+    {
+      Process(values);
+
+      for (int i = 0; i < N; i++)
+        pOutputs[i][s] = values[i];
+    }
+  }
+
+  /** Mix the oscillators into one buffer, adding to what is there
+   * @param pGains The gain of each oscillator, N values */
+  void ProcessBlockAccumulating(T* pOutput, const T* pGains, int nFrames)
+  {
+    T values[N];
+
+    for (int s = 0; s < nFrames; s++)
+    {
+      Process(values);
+
+      T sum = 0.;
+
+      for (int i = 0; i < N; i++)
+        sum += values[i] * pGains[i];
+
+      pOutput[s] += sum;
+    }
+  }
+
+  /** Compute the next sample of each oscillator into pOutput[0 ... N-1] */
+  inline void Process(T* pOutput)
+  {
+    for (int i = 0; i < N; i++)
+    {
+      const double pos = mPhase[i] * mSizes[i];
+      const int idx = static_cast<int>(pos);
+      const T frac = static_cast<T>(pos - idx);
+      const T a = mLevelPtrs[i][idx];
+      const T b = mLevelPtrs[i][idx + 1];
+      pOutput[i] = (a + frac * (b - a)) * mGains[i];
+
+      double phase = mPhase[i] + mPhaseIncr[i];
+      phase -= phase >= 1. ? 1. : 0.;
+      mPhase[i] = phase;
+    }
+  }
+
+private:
+  void SetLevel(int i)
+  {
+    // an oscillator without a table reads a silent one, so that Process() needs no branch
+    static const T sSilence[Wavetable<T>::kMinTableSize + 1] = {};
+
+    if (mTables[i])
+    {
+      mLevelPtrs[i] = mTables[i]->GetLevel(mLevels[i]);
+      mSizes[i] = Wavetable<T>::LevelSize(mLevels[i]);
+      mGains[i] = T(1);
+    }
+    else
+    {
+      mLevelPtrs[i] = sSilence;
+      mSizes[i] = Wavetable<T>::kMinTableSize;
+      mGains[i] = T(0);
+    }
+  }
+
+  double mSampleRateReciprocal = 1. / 44100.;
+  double mPhase[N] = {};
+  double mPhaseIncr[N] = {};
+  int mLevels[N] = {};
+  const Wavetable<T>* mTables[N];
+  const T* mLevelPtrs[N];
+  double mSizes[N];
+  T mGains[N];
+};
@@ -1,12 +1,17 @@
 #include "IWebsocketEditorDelegate.h"
 #include "IPlugStructs.h"
 
+#ifdef WEBSOCKET_COMPRESSION
+#include "zlib/zlib.h"
+#endif
+
 IWebsocketEditorDelegate::IWebsocketEditorDelegate(int nParams)
 : IGEditorDelegate(nParams)
 , mParamChangeFromClients(PARAM_TRANSFER_SIZE)
 , mMIDIFromClients(MIDI_TRANSFER_SIZE)
+, mParamDirtyBits((nParams + 63) / 64)
+, mParamDirtyValues(nParams)
 {
-  
 }
 
 IWebsocketEditorDelegate::~IWebsocketEditorDelegate()
@@ -15,7 +20,8 @@ IWebsocketEditorDelegate::~IWebsocketEditorDelegate()
 
 void IWebsocketEditorDelegate::OnWebsocketReady(int connIdx)
 {
-  //TODO: need to send serialize state and send it to the client
+  // the state is serialized on the main thread, in ProcessWebsocketQueue()
+  mConnectionsReady.Push(connIdx);
 }
 
 bool IWebsocketEditorDelegate::OnWebsocketText(int connIdx, const char* pStr, size_t dataSize)
@@ -28,6 +34,10 @@ bool IWebsocketEditorDelegate::OnWebsocketData(int connIdx, void* pData, size_t
 {
   uint8_t* pByteData = (uint8_t*) pData;
   int pos = 6;
+  IByteChunk echo; // a frame for the other clients, in the same format as the ones from ProcessWebsocketQueue()
+  const int nEchoParams = memcmp(pData, "SPVFUI" , 6) == 0 ? 1 : 0;
+  echo.PutStr("SBFD");
+  echo.Put(&nEchoParams);
 
   if (memcmp(pData, "SPVFUI" , 6) == 0) // send parameter value from user interface
   {
@@ -35,6 +45,8 @@ bool IWebsocketEditorDelegate::OnWebsocketData(int connIdx, void* pData, size_t
     double value = * ((double*)(pByteData + pos)); pos += 8;
     
     mParamChangeFromClients.Push(IParamChange { paramIdx, value, true } );
+    echo.Put(&paramIdx);
+    echo.Put(&value);
   }
   else if (memcmp(pData, "SMMFUI" , 6) == 0) // send midi message from user interface
   {
@@ -44,6 +56,15 @@ bool IWebsocketEditorDelegate::OnWebsocketData(int connIdx, void* pData, size_t
     msg.mData2 = * ((uint8_t*)(pByteData + pos)); pos++;
 
     mMIDIFromClients.Push(msg);
+    
+    IByteChunk midi;
+    midi.PutStr("SMMFD");
+    midi.Put(&msg.mStatus);
+    midi.Put(&msg.mData1);
+    midi.Put(&msg.mData2);
+    const int size = midi.Size();
+    echo.Put(&size);
+    echo.PutChunk(&midi);
   }
   else if (memcmp(pData, "SSMFUI" , 6) == 0) // send sysex message from user interface
   {
@@ -52,50 +73,60 @@ bool IWebsocketEditorDelegate::OnWebsocketData(int connIdx, void* pData, size_t
   else if (memcmp(pData, "SAMFUI" , 6) == 0) // send arbitrary message from user interface
   {
   }
+  else
+    return true;
   
-  //TODO: should now echo message to other clients
+  // echoed from this server thread, the frame is queued once for all of the other clients rather than waiting for the main thread
+  if (echo.Size() > 12)
+    SendDataToConnection(-1, echo.GetData(), echo.Size(), connIdx);
   
   return true;
 }
 
+void IWebsocketEditorDelegate::OnWebsocketOverflow(int connIdx)
+{
+  // the client missed frames, so sync it again as if it had just connected
+  mConnectionsReady.Push(connIdx);
+}
+
 void IWebsocketEditorDelegate::SendMidiMsgFromUI(const IMidiMsg& msg)
 {
-  IByteChunk data;
-  data.PutStr("SMMFD");
-  data.Put(&msg.mStatus);
-  data.Put(&msg.mData1);
-  data.Put(&msg.mData2);
+  mMsg.Clear();
+  mMsg.PutStr("SMMFD");
+  mMsg.Put(&msg.mStatus);
+  mMsg.Put(&msg.mData1);
+  mMsg.Put(&msg.mData2);
 
   // Server side UI edit, send to clients
-  SendDataToConnection(-1, data.GetData(), data.Size());
+  QueueMessage();
   
   IGEditorDelegate::SendMidiMsgFromUI(msg);
 }
 
 void IWebsocketEditorDelegate::SendSysexMsgFromUI(const ISysEx& msg)
 {
-  IByteChunk data;
-  data.PutStr("SSMFD");
-  data.Put(&msg.mSize);
-  data.PutBytes(&msg.mData, msg.mSize);
+  mMsg.Clear();
+  mMsg.PutStr("SSMFD");
+  mMsg.Put(&msg.mSize);
+  mMsg.PutBytes(&msg.mData, msg.mSize);
   
   // Server side UI edit, send to clients
-  SendDataToConnection(-1, data.GetData(), data.Size());
+  QueueMessage();
   
   IGEditorDelegate::SendSysexMsgFromUI(msg);
 }
 
 void IWebsocketEditorDelegate::SendArbitraryMsgFromUI(int messageTag, int controlTag, int dataSize, const void* pData)
 {
-  IByteChunk data;
-  data.PutStr("SSMFD");
-  data.Put(&messageTag);
-  data.Put(&controlTag);
-  data.Put(&dataSize);
-  data.PutBytes(pData, dataSize);
+  mMsg.Clear();
+  mMsg.PutStr("SSMFD");
+  mMsg.Put(&messageTag);
+  mMsg.Put(&controlTag);
+  mMsg.Put(&dataSize);
+  mMsg.PutBytes(pData, dataSize);
   
   // Server side UI edit, send to clients
-  SendDataToConnection(-1, data.GetData(), data.Size());
+  QueueMessage();
   
   IGEditorDelegate::SendArbitraryMsgFromUI(messageTag, controlTag, dataSize, pData);
 }
@@ -108,13 +139,8 @@ void IWebsocketEditorDelegate::SendArbitraryMsgFromUI(int messageTag, int contro
 
 void IWebsocketEditorDelegate::SendParameterValueFromUI(int paramIdx, double normalizedValue)
 {
-  IByteChunk data;
-  data.PutStr("SPVFD");
-  data.Put(&paramIdx);
-  data.Put(&normalizedValue);
-  
   // Server side UI edit, send to clients
-  SendDataToConnection(-1, data.GetData(), data.Size());
+  MarkParamDirty(paramIdx, normalizedValue);
 
   IGEditorDelegate::SendParameterValueFromUI(paramIdx, normalizedValue);
 }
@@ -126,74 +152,158 @@ void IWebsocketEditorDelegate::SendParameterValueFromUI(int paramIdx, double nor
 
 void IWebsocketEditorDelegate::SendControlValueFromDelegate(int controlTag, double normalizedValue)
 {
-  IByteChunk data;
-  data.PutStr("SCVFD");
-  data.Put(&controlTag);
-  data.Put(&normalizedValue);
+  mMsg.Clear();
+  mMsg.PutStr("SCVFD");
+  mMsg.Put(&controlTag);
+  mMsg.Put(&normalizedValue);
   
-  SendDataToConnection(-1, data.GetData(), data.Size());
+  QueueMessage();
   
   IGEditorDelegate::SendControlValueFromDelegate(controlTag, normalizedValue);
 }
 
 void IWebsocketEditorDelegate::SendControlMsgFromDelegate(int controlTag, int messageTag, int dataSize, const void* pData)
 {
-  IByteChunk data;
-  data.PutStr("SCMFD");
-  data.Put(&controlTag);
-  data.Put(&messageTag);
-  data.Put(&dataSize);
-  data.PutBytes(pData, dataSize);
+  mMsg.Clear();
+  mMsg.PutStr("SCMFD");
+  mMsg.Put(&controlTag);
+  mMsg.Put(&messageTag);
+  mMsg.Put(&dataSize);
+  mMsg.PutBytes(pData, dataSize);
   
-  SendDataToConnection(-1, data.GetData(), data.Size());
+  QueueMessage();
   
   IGEditorDelegate::SendControlMsgFromDelegate(controlTag, messageTag, dataSize, pData);
 }
 
 void IWebsocketEditorDelegate::SendArbitraryMsgFromDelegate(int messageTag, int dataSize, const void* pData)
 {
-  IByteChunk data;
-  data.PutStr("SAMFD");
-  data.Put(&messageTag);
-  data.Put(&dataSize);
-  data.PutBytes(pData, dataSize);
+  mMsg.Clear();
+  mMsg.PutStr("SAMFD");
+  mMsg.Put(&messageTag);
+  mMsg.Put(&dataSize);
+  mMsg.PutBytes(pData, dataSize);
   
-  SendDataToConnection(-1, data.GetData(), data.Size());
+  QueueMessage();
   
   IGEditorDelegate::SendArbitraryMsgFromDelegate(messageTag, dataSize, pData);
 }
 
 void IWebsocketEditorDelegate::SendMidiMsgFromDelegate(const IMidiMsg& msg)
 {
-  IByteChunk data;
-  data.PutStr("SMMFD");
-  data.Put(&msg.mStatus);
-  data.Put(&msg.mData1);
-  data.Put(&msg.mData2);
+  mMsg.Clear();
+  mMsg.PutStr("SMMFD");
+  mMsg.Put(&msg.mStatus);
+  mMsg.Put(&msg.mData1);
+  mMsg.Put(&msg.mData2);
 
-  SendDataToConnection(-1, data.GetData(), data.Size());
+  QueueMessage();
   
   IGEditorDelegate::SendMidiMsgFromDelegate(msg);
 }
 
 void IWebsocketEditorDelegate::SendSysexMsgFromDelegate(const ISysEx& msg)
 {
-  IByteChunk data;
-  data.PutStr("SSMFD");
-  data.Put(&msg.mSize);
-  data.PutBytes(msg.mData, msg.mSize);
+  mMsg.Clear();
+  mMsg.PutStr("SSMFD");
+  mMsg.Put(&msg.mSize);
+  mMsg.PutBytes(msg.mData, msg.mSize);
   
-  SendDataToConnection(-1, data.GetData(), data.Size());
+  QueueMessage();
   
   IGEditorDelegate::SendSysexMsgFromDelegate(msg);
 }
 
+void IWebsocketEditorDelegate::SendParameterValueFromDelegate(int paramIdx, double value, bool normalized)
+{
+  if (const IParam* pParam = GetParam(paramIdx))
+    MarkParamDirty(paramIdx, normalized ? value : pParam->ToNormalized(value));
+  
+  IGEditorDelegate::SendParameterValueFromDelegate(paramIdx, value, normalized);
+}
+
+bool IWebsocketEditorDelegate::SerializeState(IByteChunk& chunk) const
+{
+  for (int i = 0; i < NParams(); i++)
+  {
+    const double value = GetParam(i)->GetNormalized();
+    chunk.Put(&value);
+  }
+  
+  return true;
+}
+
+void IWebsocketEditorDelegate::QueueMessage()
+{
+  if (!NClients())
+    return;
+  
+  const int size = mMsg.Size();
+  mMessages.Put(&size);
+  mMessages.PutChunk(&mMsg);
+  mNMessages++;
+}
+
+void IWebsocketEditorDelegate::MarkParamDirty(int paramIdx, double normalizedValue)
+{
+  if (paramIdx < 0 || paramIdx >= static_cast<int>(mParamDirtyValues.size()))
+    return;
+  
+  uint64_t& bits = mParamDirtyBits[paramIdx >> 6];
+  const uint64_t bit = uint64_t(1) << (paramIdx & 63);
+  
+  if (!(bits & bit))
+  {
+    bits |= bit;
+    mNParamsDirty++;
+  }
+  
+  mParamDirtyValues[paramIdx] = normalizedValue;
+}
+
+static inline int LowestSetBit(uint64_t bits)
+{
+#if defined _MSC_VER
+  unsigned long idx;
+  _BitScanForward64(&idx, bits);
+  return (int) idx;
+#else
+  return __builtin_ctzll(bits);
+#endif
+}
+
+void IWebsocketEditorDelegate::SendFrame(int connIdx, IByteChunk& frame)
+{
+#ifdef WEBSOCKET_COMPRESSION
+  if (mCompressionLevel > 0 && frame.Size() >= mCompressionMinSize)
+  {
+    const int size = frame.Size();
+    uLongf compressedSize = compressBound(size);
+    
+    mCompressedFrame.Clear();
+    mCompressedFrame.PutStr("SZFD");
+    mCompressedFrame.Put(&size);
+    const int headerSize = mCompressedFrame.Size();
+    mCompressedFrame.Resize(headerSize + static_cast<int>(compressedSize));
+    
+    if (compress2(mCompressedFrame.GetData() + headerSize, &compressedSize, frame.GetData(), size, mCompressionLevel) == Z_OK && compressedSize < static_cast<uLongf>(size))
+    {
+      mCompressedFrame.Resize(headerSize + static_cast<int>(compressedSize));
+      SendDataToConnection(connIdx, mCompressedFrame.GetData(), mCompressedFrame.Size());
+      return;
+    }
+  }
+#endif
+  
+  SendDataToConnection(connIdx, frame.GetData(), frame.Size());
+}
+
 void IWebsocketEditorDelegate::ProcessWebsocketQueue()
 {
-  while(mParamChangeFromClients.ElementsAvailable())
+  IParamChange p;
+  
+  while(mParamChangeFromClients.Pop(p))
   {
-    IParamChange p;
-    mParamChangeFromClients.Pop(p);
     
     //FIXME: how do params get updated?
 //    ENTER_PARAMS_MUTEX;
@@ -205,13 +315,74 @@ void IWebsocketEditorDelegate::ProcessWebsocketQueue()
 //    OnParamChange(p.paramIdx, kHost);
 //    LEAVE_PARAMS_MUTEX;
     
-    SendParameterValueFromDelegate(p.paramIdx, p.value, p.normalized); // TODO:  if the parameter hasn't changed maybe we shouldn't do anything?
+    // the other clients have been sent the change by OnWebsocketData(), so call the superclass, which updates the local UI without marking it for the next frame
+    IGEditorDelegate::SendParameterValueFromDelegate(p.paramIdx, p.value, p.normalized); // TODO:  if the parameter hasn't changed maybe we shouldn't do anything?
   }
   
-  while (mMIDIFromClients.ElementsAvailable()) {
-    IMidiMsg msg;
-    mMIDIFromClients.Pop(msg);
+  IMidiMsg msg;
+  
+  while (mMIDIFromClients.Pop(msg)) {
     IGEditorDelegate::SendMidiMsgFromDelegate(msg); // Call the superclass, since we don't want to send another MIDI message to the websocket
     DeferMidiMsg(msg); // can't just call SendMidiMsgFromUI here which would cause a feedback loop
   }
+  
+  // a client that has connected gets the state and all of the parameters, the others only what changed
+  int connIdx;
+  
+  while (mConnectionsReady.Pop(connIdx))
+  {
+    mMsg.Clear();
+    
+    if (SerializeState(mMsg))
+    {
+      const int size = mMsg.Size();
+      mFrame.Clear();
+      mFrame.PutStr("SSTFD");
+      mFrame.Put(&size);
+      mFrame.PutChunk(&mMsg);
+      SendFrame(connIdx, mFrame);
+    }
+    
+    const int nParams = NParams();
+    mFrame.Clear();
+    mFrame.PutStr("SBFD");
+    mFrame.Put(&nParams);
+    
+    for (int i = 0; i < nParams; i++)
+    {
+      const double value = GetParam(i)->GetNormalized();
+      mFrame.Put(&i);
+      mFrame.Put(&value);
+    }
+    
+    SendFrame(connIdx, mFrame);
+  }
+  
+  if (!mNParamsDirty && !mNMessages)
+    return;
+  
+  if (NClients())
+  {
+    mFrame.Clear();
+    mFrame.PutStr("SBFD");
+    mFrame.Put(&mNParamsDirty);
+    
+    for (int w = 0; w < static_cast<int>(mParamDirtyBits.size()); w++)
+    {
+      for (uint64_t bits = mParamDirtyBits[w]; bits; bits &= bits - 1)
+      {
+        const int paramIdx = (w << 6) + LowestSetBit(bits);
+        mFrame.Put(&paramIdx);
+        mFrame.Put(&mParamDirtyValues[paramIdx]);
+      }
+    }
+    
+    mFrame.PutChunk(&mMessages);
+    SendFrame(-1, mFrame);
+  }
+  
+  std::fill(mParamDirtyBits.begin(), mParamDirtyBits.end(), 0);
+  mNParamsDirty = 0;
+  mMessages.Clear();
+  mNMessages = 0;
 }
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <vector>
+
 #include "IGraphicsEditorDelegate.h"
 #include "IWebsocketServer.h"
 #include "IPlugStructs.h"
@@ -10,7 +12,15 @@
  * @copydoc IWebsocketEditorDelegate
  */
 
-/** An IEditorDelegate base class that embeds a websocket server ... */
+/** An IEditorDelegate base class that embeds a websocket server, so that remote UIs, e.g. web pages on tablets, can control the plug-in.
+ * Changes from a client are echoed to the other clients on its server thread. A client that connects, or that was too slow to take its frames, is sent the plug-in's state, from SerializeState(), then the values of all of the parameters. After that, everything for the clients
+ * is batched into one frame per call to ProcessWebsocketQueue(): the parameters changed since the last call, each once with its latest value, and the other messages in the order
+ * they were sent. Frames can be compressed with zlib, see SetWebsocketCompression(), if WEBSOCKET_COMPRESSION is defined and zlib is linked.
+ *
+ * The frames are binary, starting with a tag from IByteChunk::PutStr():
+ * - \c "SSTFD": int size, then the bytes of the state
+ * - \c "SBFD": int nParams, then nParams of (int paramIdx, double normalizedValue), then each message as an int size and its bytes, e.g. an \c "SMMFD" MIDI message
+ * - \c "SZFD": int uncompressedSize, then a zlib stream of one of the above */
 class IWebsocketEditorDelegate : public IGEditorDelegate, public IWebsocketServer
 {
 public:
@@ -22,6 +32,7 @@ public:
   void OnWebsocketReady(int idx) override;
   bool OnWebsocketText(int idx, const char* pStr, size_t dataSize) override;
   bool OnWebsocketData(int idx, void* pData, size_t dataSize) override;
+  void OnWebsocketOverflow(int idx) override;
 
   //IEditorDelegate
   void SendMidiMsgFromUI(const IMidiMsg& msg) override;
@@ -38,10 +49,48 @@ public:
   void SendSysexMsgFromDelegate(const ISysEx& msg) override;
 //  void SendParameterValueFromDelegate(int paramIdx, double value, bool normalized) override;
   
-  // Call this repeatedly in order to handle incoming data
+  void SendParameterValueFromDelegate(int paramIdx, double value, bool normalized) override;
+  
+  /** Serialize the state sent to a client when it connects. Overridden by IPluginBase::SerializeState(), so the plug-in's state is sent.
+   * This default writes the normalized value of each parameter
+   * @param chunk The chunk to append the state to
+   * @return \c true if the state was serialized */
+  virtual bool SerializeState(IByteChunk& chunk) const;
+  
+  /** Call this repeatedly on the main thread, e.g. from OnIdle(), to apply the changes from the clients, sync the clients that have connected and send the frame of changes batched since the last call */
   void ProcessWebsocketQueue();
   
+  /** @param level The zlib level to compress the frames bigger than minSize with, from 1 for the fastest to 9 for the smallest, or 0 not to. Ignored unless WEBSOCKET_COMPRESSION is defined
+   * @param minSize The size in bytes of the smallest frame worth compressing */
+  void SetWebsocketCompression(int level, int minSize = 256) { mCompressionLevel = level; mCompressionMinSize = minSize; }
+  
 private:
-  IPlugQueue<IParamChange> mParamChangeFromClients; // TODO: This is a single producer single consumer queue - it is not sufficient, since each client connection will be on a different server thread
-  IPlugQueue<IMidiMsg> mMIDIFromClients; // TODO: This is a single producer single consumer queue - it is not sufficient, since each client connection will be on a different server thread
+  /** Append mMsg to the frame for the next ProcessWebsocketQueue() */
+  void QueueMessage();
+  
+  /** Mark a parameter changed, to be sent in the next frame
+   * @param paramIdx The index of the parameter
+   * @param normalizedValue The value to send, the latest one marked wins */
+  void MarkParamDirty(int paramIdx, double normalizedValue);
+  
+  /** Send a frame, compressed if it's big enough and compression is on
+   * @param connIdx The index of the connection, or -1 for all of them */
+  void SendFrame(int connIdx, IByteChunk& frame);
+  
+
+  IPlugMPSCQueue<IParamChange> mParamChangeFromClients; // each client connection is on a different server thread, hence MPSC
+  IPlugMPSCQueue<IMidiMsg> mMIDIFromClients;
+  IPlugMPSCQueue<int> mConnectionsReady {32}; // connections to sync, pushed on their server threads
+  
+  // only touched by the main thread
+  std::vector<uint64_t> mParamDirtyBits; // one bit per parameter, changed since the last frame
+  std::vector<double> mParamDirtyValues;
+  int mNParamsDirty = 0;
+  int mNMessages = 0;
+  IByteChunk mMsg; // reused for each message
+  IByteChunk mMessages; // the messages for the next frame
+  IByteChunk mFrame;
+  IByteChunk mCompressedFrame;
+  int mCompressionLevel = 0;
+  int mCompressionMinSize = 256;
 };
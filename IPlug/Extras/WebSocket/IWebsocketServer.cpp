@@ -17,6 +17,9 @@ IWebsocketServer::IWebsocketServer()
 IWebsocketServer::~IWebsocketServer()
 {
   DestroyServer();
+  
+  WDL_MutexLock lock(&mMutex);
+  mConnections.Empty(true);
 }
 
 bool IWebsocketServer::CreateServer(const char* DOCUMENT_ROOT, const char* PORT)
@@ -105,37 +108,107 @@ bool IWebsocketServer::OnWebsocketData(int idx, void* pData, size_t dataSize)
 
 bool IWebsocketServer::DoSendToConnection(int idx, int opcode, const char* pData, size_t sizeInBytes, int exclude)
 {
-  int nclients = NClients();
+  WDL_MutexLock lock(&mMutex);
   
-  std::function<bool(int)> sendFunc = [&](int connIdx) {
-    WDL_MutexLock lock(&mMutex);
-    mg_connection* pConn = mConnections.Get(connIdx);
-    
-    if(pConn) {
-      if(mg_websocket_write(pConn, opcode, pData, sizeInBytes))
-        return true;
-    }
-    
+  if (!mConnections.GetSize())
     return false;
-  };
   
-  bool success = false;
+  // copied once, however many connections it goes to
+  auto pFrame = std::make_shared<Frame>();
+  pFrame->opcode = opcode;
+  pFrame->data.assign(pData, pData + sizeInBytes);
+  const FramePtr frame = pFrame;
   
-  if(idx == -1)
+  const size_t maxQueuedBytes = mMaxQueuedBytes.load(std::memory_order_relaxed);
+  bool success = true;
+  
+  for (int i = 0; i < mConnections.GetSize(); i++)
   {
-    for(int i=0;i<nclients;i++) // TODO: sending to self?
+    if ((idx != -1 && i != idx) || i == exclude)
+      continue;
+    
+    if (!mConnections.Get(i)->Push(frame, maxQueuedBytes, mNDroppedFrames))
     {
-      if(i != exclude)
-        success &= sendFunc(i);
+      success = false;
+      OnWebsocketOverflow(i);
     }
   }
-  else {
-    sendFunc(idx);
-  }
   
   return success;
 }
 
+int IWebsocketServer::FindConnection(const mg_connection* pConn) const
+{
+  for (int i = 0; i < mConnections.GetSize(); i++)
+  {
+    if (mConnections.Get(i)->GetConnection() == pConn)
+      return i;
+  }
+  
+  return -1;
+}
+
+IWebsocketServer::Connection::Connection(mg_connection* pConn)
+: mConn(pConn)
+{
+  mThread = std::thread(&Connection::Run, this);
+}
+
+IWebsocketServer::Connection::~Connection()
+{
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStop = true;
+  }
+  
+  mCV.notify_one();
+  mThread.join();
+}
+
+bool IWebsocketServer::Connection::Push(const FramePtr& frame, size_t maxQueuedBytes, std::atomic<uint32_t>& nDroppedFrames)
+{
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    
+    if (mQueuedBytes + frame->data.size() > maxQueuedBytes)
+    {
+      // the client is too slow, so rather than fall further behind it is sent only what is queued from now on
+      nDroppedFrames.fetch_add(static_cast<uint32_t>(mQueue.size()) + 1, std::memory_order_relaxed);
+      mQueue.clear();
+      mQueuedBytes = 0;
+      return false;
+    }
+    
+    mQueue.push_back(frame);
+    mQueuedBytes += frame->data.size();
+  }
+  
+  mCV.notify_one();
+  return true;
+}
+
+void IWebsocketServer::Connection::Run()
+{
+  std::unique_lock<std::mutex> lock(mMutex);
+  
+  while (true)
+  {
+    mCV.wait(lock, [this]() { return mStop || !mQueue.empty(); });
+    
+    if (mStop)
+      break;
+    
+    const FramePtr frame = mQueue.front();
+    mQueue.pop_front();
+    mQueuedBytes -= frame->data.size();
+    
+    // the write may block on a slow client, so it is done without the lock, letting frames be queued meanwhile
+    lock.unlock();
+    mg_websocket_write(mConn, frame->opcode, frame->data.data(), frame->data.size());
+    lock.lock();
+  }
+}
+
 // CivetWebSocketHandler
 // These methods are called on the server thread
 bool IWebsocketServer::handleConnection(CivetServer* pServer, const struct mg_connection* pConn)
@@ -150,7 +223,7 @@ void IWebsocketServer::handleReadyState(CivetServer* pServer, struct mg_connecti
 {
   WDL_MutexLock lock(&mMutex);
   
-  mConnections.Add(pConn);
+  mConnections.Add(new Connection(pConn));
   
   DBGMSG("WS ready NClients %i\n", NClients());
   
@@ -165,11 +238,11 @@ bool IWebsocketServer::handleData(CivetServer* pServer, struct mg_connection* pC
   
   if(*firstByte == 129) // TODO: check that
   {
-    return OnWebsocketText(mConnections.Find(pConn), pData, dataSize);
+    return OnWebsocketText(FindConnection(pConn), pData, dataSize);
   }
   else if(*firstByte == 130) // TODO: check that
   {
-    return OnWebsocketData(mConnections.Find(pConn), (void*) pData, dataSize);
+    return OnWebsocketData(FindConnection(pConn), (void*) pData, dataSize);
   }
   
   return true;
@@ -179,7 +252,11 @@ void IWebsocketServer::handleClose(CivetServer* pServer, const struct mg_connect
 {
   WDL_MutexLock lock(&mMutex);
 
-  mConnections.DeletePtr(pConn);
+  // waits for the connection's thread, which the closing socket lets out of any write
+  const int idx = FindConnection(pConn);
+  
+  if (idx >= 0)
+    mConnections.Delete(idx, true);
   
   DBGMSG("WS closed NClients %i\n", NClients());
 }
@@ -9,7 +9,14 @@
 */
 
 #include "CivetServer.h"
+#include <atomic>
+#include <condition_variable>
 #include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include "ptrlist.h"
 #include "IPlugLogger.h"
@@ -20,9 +27,22 @@
 #include <unistd.h>
 #endif
 
+/** A websocket server for remote UIs. Sending doesn't write to the sockets on the calling thread: each frame is copied once into a shared buffer
+ * and queued for every connection it goes to, and each connection has a thread that writes its queue, so that a slow client holds up neither the caller nor the other clients.
+ * A client whose queue grows past the limit, see SetMaxQueuedBytes(), has its queue dropped and OnWebsocketOverflow() called, so that it can be resynced */
 class IWebsocketServer : public CivetWebSocketHandler
 {
 public:
+  /** A frame to send, shared by the queues of the connections it is sent to */
+  struct Frame
+  {
+    int opcode;
+    std::vector<char> data;
+  };
+  
+  using FramePtr = std::shared_ptr<const Frame>;
+  
+
   IWebsocketServer();
   virtual ~IWebsocketServer();
   bool CreateServer(const char* DOCUMENT_ROOT, const char* PORT = "8001");
@@ -37,13 +57,53 @@ public:
   
   bool SendDataToConnection(int idx, void* pData, size_t sizeInBytes, int exclude = -1);
   
+  /** @param maxQueuedBytes The most bytes that can wait to be sent to a client, before its queue is dropped */
+  void SetMaxQueuedBytes(size_t maxQueuedBytes) { mMaxQueuedBytes.store(maxQueuedBytes, std::memory_order_relaxed); }
+  
+  /** @return The number of frames dropped because clients couldn't keep up */
+  uint32_t GetNDroppedFrames() const { return mNDroppedFrames.load(std::memory_order_relaxed); }
+  
   virtual void OnWebsocketReady(int idx);
   
+  /** Called on the sending thread when a client's queue has been dropped because it was too slow to take its frames, with the server mutex held
+   * @param idx The index of the connection, whose later frames are queued as usual */
+  virtual void OnWebsocketOverflow(int idx) {}
+  
   virtual bool OnWebsocketText(int idx, const char* str, size_t dataSize);
   
   virtual bool OnWebsocketData(int idx, void* pData, size_t dataSize);
   
 private:
+  /** A connected client, with a thread that sends the frames queued for it */
+  class Connection
+  {
+  public:
+    Connection(mg_connection* pConn);
+    ~Connection();
+    
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+    
+    /** Queue a frame, or drop the queue if it would grow past the limit
+     * @return \c false if the queue was dropped */
+    bool Push(const FramePtr& frame, size_t maxQueuedBytes, std::atomic<uint32_t>& nDroppedFrames);
+    
+    mg_connection* GetConnection() const { return mConn; }
+    
+  private:
+    void Run();
+    
+    mg_connection* mConn;
+    std::mutex mMutex;
+    std::condition_variable mCV;
+    std::deque<FramePtr> mQueue;
+    size_t mQueuedBytes = 0;
+    bool mStop = false;
+    std::thread mThread;
+  };
+  
+  int FindConnection(const mg_connection* pConn) const;
+  
   bool DoSendToConnection(int idx, int opcode, const char* pData, size_t sizeInBytes, int exclude);
   
   // CivetWebSocketHandler
@@ -55,7 +115,9 @@ private:
   
   void handleClose(CivetServer* pServer, const struct mg_connection* pConn) override;
   
-  WDL_PtrList<mg_connection> mConnections;
+  WDL_PtrList<Connection> mConnections;
+  std::atomic<size_t> mMaxQueuedBytes {4 * 1024 * 1024};
+  std::atomic<uint32_t> mNDroppedFrames {0};
   static CivetServer* sServer;
   static int sInstances;
 
@@ -0,0 +1,97 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IAdaptiveTimerRate
+ */
+
+#include <cstdint>
+
+#include "IPlugConstants.h"
+
+/** Works out the interval for a periodic main thread timer that backs off when there is nothing to do.
+ * Call Tick() on every tick with whether the tick did any work. After ADAPTIVE_TIMER_IDLE_TICKS idle ticks in a row the interval doubles
+ * on each further idle tick, up to the idle interval. As soon as a tick does work, or Wake() is called because of user input, it goes back to the active interval */
+class IAdaptiveTimerRate
+{
+public:
+  /** IAdaptiveTimerRate constructor
+   * @param activeIntervalMs The interval to use while there is work to do
+   * @param idleIntervalMs The longest interval to back off to
+   * @param idleTicks The number of idle ticks in a row before backing off */
+  IAdaptiveTimerRate(uint32_t activeIntervalMs = IDLE_TIMER_RATE, uint32_t idleIntervalMs = ADAPTIVE_TIMER_MAX_INTERVAL, int idleTicks = ADAPTIVE_TIMER_IDLE_TICKS)
+  : mActiveInterval(activeIntervalMs)
+  , mIdleInterval(idleIntervalMs > activeIntervalMs ? idleIntervalMs : activeIntervalMs)
+  , mIdleTicksBeforeBackoff(idleTicks)
+  , mInterval(activeIntervalMs)
+  {
+  }
+  
+  /** @param enable \c false to always use the active interval */
+  void SetEnabled(bool enable) { mEnabled = enable; if (!enable) Wake(); }
+  
+  bool GetEnabled() const { return mEnabled; }
+  
+  /** @param activeIntervalMs The interval to use while there is work to do */
+  void SetActiveInterval(uint32_t activeIntervalMs)
+  {
+    mActiveInterval = activeIntervalMs;
+    mIdleInterval = mIdleInterval > activeIntervalMs ? mIdleInterval : activeIntervalMs;
+    Wake();
+  }
+  
+  /** Call on every tick
+   * @param active \c true if the tick did any work
+   * @return The interval to use from now on */
+  uint32_t Tick(bool active)
+  {
+    if (active || !mEnabled)
+    {
+      mIdleTicks = 0;
+      mInterval = mActiveInterval;
+    }
+    else if (++mIdleTicks >= mIdleTicksBeforeBackoff)
+    {
+      mInterval = mInterval * 2 < mIdleInterval ? mInterval * 2 : mIdleInterval;
+    }
+    
+    return mInterval;
+  }
+  
+  /** Go back to the active interval straight away
+   * @return \c true if the timer had backed off, in which case it should be given the new interval now rather than on its next tick */
+  bool Wake()
+  {
+    mIdleTicks = 0;
+    
+    if (mInterval == mActiveInterval)
+      return false;
+    
+    mInterval = mActiveInterval;
+    return true;
+  }
+  
+  /** @return The current interval in milliseconds */
+  uint32_t GetInterval() const { return mInterval; }
+  
+  /** @return \c true if the timer is at the active interval, rather than backed off */
+  bool IsActive() const { return mInterval == mActiveInterval; }
+  
+private:
+  uint32_t mActiveInterval;
+  uint32_t mIdleInterval;
+  int mIdleTicksBeforeBackoff;
+  uint32_t mInterval;
+  int mIdleTicks = 0;
+  bool mEnabled = true;
+};
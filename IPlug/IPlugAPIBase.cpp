@@ -18,7 +18,12 @@
 #include <ctime>
 #include <cassert>
 
+#if defined _MSC_VER
+#include <intrin.h>
+#endif
+
 #include "IPlugAPIBase.h"
+#include "IPlugProcessor.h"
 
 IPlugAPIBase::IPlugAPIBase(IPlugConfig c, EAPI plugAPI)
   : IPluginBase(c.nParams, c.nPresets)
@@ -39,6 +44,17 @@ IPlugAPIBase::IPlugAPIBase(IPlugConfig c, EAPI plugAPI)
   Trace(TRACELOC, "%s:%s", c.pluginName, CurrentTime());
   
   mParamDisplayStr.Set("", MAX_PARAM_DISPLAY_LEN);
+  
+  mNParamsTracked = c.nParams;
+  mNParamDirtyWords = (c.nParams + 63) / 64;
+  mParamDirtyBits.reset(new std::atomic<uint64_t>[mNParamDirtyWords]);
+  mParamPendingValues.reset(new std::atomic<double>[c.nParams]);
+  
+  for (int i = 0; i < mNParamDirtyWords; i++)
+    mParamDirtyBits[i].store(0);
+  
+  for (int i = 0; i < c.nParams; i++)
+    mParamPendingValues[i].store(-1.); // not a valid normalized value, so the first change always gets through
 }
 
 IPlugAPIBase::~IPlugAPIBase()
@@ -63,7 +79,7 @@ void IPlugAPIBase::OnHostRequestingImportantParameters(int count, WDL_TypedBuf<i
 
 void IPlugAPIBase::CreateTimer()
 {
-  mTimer = Timer::Create(std::bind(&IPlugAPIBase::OnTimer, this, std::placeholders::_1), IDLE_TIMER_RATE);
+  mTimer = Timer::Create(std::bind(&IPlugAPIBase::OnTimer, this, std::placeholders::_1), mTimerRate.GetInterval());
 }
 
 bool IPlugAPIBase::CompareState(const uint8_t* pIncomingState, int startPos) const
@@ -74,9 +90,49 @@ bool IPlugAPIBase::CompareState(const uint8_t* pIncomingState, int startPos) con
   
   // dirty hack here because protools treats param values as 32 bit int and in IPlug they are 64bit float
   // if we memcmp() the incoming state with the current they may have tiny differences due to the quantization
+  const std::atomic<double>* pValues = GetParamValues();
+  
+  uint64_t magic;
+  memcpy(&magic, data, sizeof(uint64_t));
+  
+  if (magic == SPARSE_PARAMS_MAGIC)
+  {
+    // see SerializeParamsSparse(), entries are in ascending parameter order so they can be merged with a walk over the parameters
+    const uint8_t* pData = (const uint8_t*) data + sizeof(uint64_t);
+    int header[3]; // version, isDelta, nChanged
+    memcpy(header, pData, sizeof(header));
+    pData += sizeof(header);
+    
+    int entry = 0;
+    
+    for (int i = 0; i < NParams(); i++)
+    {
+      int paramIdx = -1;
+      double vi;
+      
+      if (entry < header[2])
+        memcpy(&paramIdx, pData, sizeof(int));
+      
+      if (paramIdx == i)
+      {
+        memcpy(&vi, pData + sizeof(int), sizeof(double));
+        pData += sizeof(int) + sizeof(double);
+        entry++;
+      }
+      else if (header[1])
+        continue; // a delta says nothing about this parameter
+      else
+        vi = GetParam(i)->GetDefault();
+      
+      isEqual &= (std::fabs((float) pValues[i].load() - (float) vi) < 0.00001);
+    }
+    
+    return isEqual;
+  }
+  
   for (int i = 0; i < NParams(); i++)
   {
-    float v = (float) GetParam(i)->Value();
+    float v = (float) pValues[i].load();
     float vi = (float) *(data++);
     
     isEqual &= (std::fabs(v - vi) < 0.00001);
@@ -94,6 +150,25 @@ void IPlugAPIBase::PrintDebugInfo() const
   DBGMSG("\n--------------------------------------------------\n%s\n", buildInfo.Get());
 }
 
+void IPlugAPIBase::ReportMemory(IMemoryReport& report) const
+{
+  const int64_t midiBytes = mMidiMsgsFromEditor.GetBytes() + mMidiMsgsFromProcessor.GetBytes();
+  const int64_t sysExBytes = mSysExDataFromEditor.GetBytes() + mSysExDataFromProcessor.GetBytes();
+  const int64_t dirtyBytes = mNParamDirtyWords * static_cast<int64_t>(sizeof(std::atomic<uint64_t>)) + mNParamsTracked * static_cast<int64_t>(sizeof(std::atomic<double>));
+
+  report.Add(kMemoryQueues, "Parameters from processor", mParamChangeFromProcessor.GetBytes() + dirtyBytes);
+  report.Add(kMemoryQueues, "MIDI", midiBytes);
+  report.Add(kMemoryQueues, "SysEx", sysExBytes);
+  report.Add(kMemoryQueues, "Messages from processor", mMsgsFromProcessor.GetBytes());
+  report.Add(kMemoryPresets, "Preset snapshot", mPresetSnapshot.GetSize() * static_cast<int64_t>(sizeof(double)));
+
+  // the API class is also the processor, except for the controller of a distributed plug-in
+  if (auto pProcessor = dynamic_cast<const IPlugProcessor<PLUG_SAMPLE_DST>*>(this))
+    pProcessor->ReportProcessorMemory(report);
+
+  IPluginBase::ReportMemory(report);
+}
+
 #pragma mark -
 
 void IPlugAPIBase::SetHost(const char* host, int version)
@@ -115,8 +190,153 @@ void IPlugAPIBase::SetParameterValue(int idx, double normalizedValue)
 {
   Trace(TRACELOC, "%d:%f", idx, normalizedValue);
   GetParam(idx)->SetNormalized(normalizedValue);
-  InformHostOfParamChange(idx, normalizedValue);
+  
+  // the UI now shows this value, so an echo of it from the host doesn't need forwarding
+  if (idx >= 0 && idx < mNParamsTracked)
+    mParamPendingValues[idx].store(normalizedValue, std::memory_order_relaxed);
+  
+  if (!HoldParamChange(idx, normalizedValue))
+    InformHostOfParamChange(idx, normalizedValue);
+  
   OnParamChange(idx, kUI);
+  WakeTimer();
+}
+
+void IPlugAPIBase::BeginInformHostOfParamChangeFromUI(int paramIdx)
+{
+  BeginInformHostOfParamChange(paramIdx);
+  
+  for (auto& gesture : mParamGestures)
+  {
+    if (gesture.paramIdx == paramIdx)
+      return;
+  }
+  
+  // the first change of a gesture is informed at once
+  mParamGestures.push_back({ paramIdx, {}, 0., false });
+}
+
+void IPlugAPIBase::EndInformHostOfParamChangeFromUI(int paramIdx)
+{
+  for (auto it = mParamGestures.begin(); it != mParamGestures.end(); ++it)
+  {
+    if (it->paramIdx == paramIdx)
+    {
+      // the host always gets the final value before the gesture ends
+      if (it->held)
+        InformHostOfParamChange(paramIdx, it->heldValue);
+      
+      mParamGestures.erase(it);
+      break;
+    }
+  }
+  
+  EndInformHostOfParamChange(paramIdx);
+}
+
+bool IPlugAPIBase::HoldParamChange(int paramIdx, double normalizedValue)
+{
+  if (mParamGestures.empty() || !mHostParamInformInterval)
+    return false;
+  
+  const auto now = std::chrono::steady_clock::now();
+  
+  for (auto& gesture : mParamGestures)
+  {
+    if (gesture.paramIdx == paramIdx)
+    {
+      if (now - gesture.informTime < std::chrono::milliseconds(mHostParamInformInterval))
+      {
+        gesture.heldValue = normalizedValue;
+        gesture.held = true;
+        return true;
+      }
+      
+      gesture.informTime = now;
+      gesture.held = false;
+      return false;
+    }
+  }
+  
+  return false;
+}
+
+bool IPlugAPIBase::InformHostOfHeldParamChanges()
+{
+  const auto now = std::chrono::steady_clock::now();
+  bool held = false;
+  
+  for (auto& gesture : mParamGestures)
+  {
+    if (!gesture.held)
+      continue;
+    
+    if (now - gesture.informTime >= std::chrono::milliseconds(mHostParamInformInterval))
+    {
+      gesture.informTime = now;
+      gesture.held = false;
+      InformHostOfParamChange(gesture.paramIdx, gesture.heldValue);
+    }
+    else
+      held = true;
+  }
+  
+  return held;
+}
+
+void IPlugAPIBase::SetParameterValues(const IParamChange* pChanges, int nChanges)
+{
+  for (int i = 0; i < nChanges; i++)
+  {
+    const IParamChange& change = pChanges[i];
+    IParam* pParam = GetParam(change.paramIdx);
+    
+    Trace(TRACELOC, "%d:%f", change.paramIdx, change.value);
+    
+    if (change.normalized)
+      pParam->SetNormalized(change.value);
+    else
+      pParam->Set(change.value);
+    
+    if (change.paramIdx < mNParamsTracked)
+      mParamPendingValues[change.paramIdx].store(pParam->GetNormalized(), std::memory_order_relaxed);
+  }
+  
+  // hosts that only record automation inside gestures would drop the batch, so each parameter not already in a UI gesture gets one around it
+  auto needsGesture = [&](int i) {
+    const int paramIdx = pChanges[i].paramIdx;
+
+    for (int j = 0; j < i; j++)
+    {
+      if (pChanges[j].paramIdx == paramIdx)
+        return false;
+    }
+
+    for (const auto& gesture : mParamGestures)
+    {
+      if (gesture.paramIdx == paramIdx)
+        return false;
+    }
+
+    return true;
+  };
+
+  for (int i = 0; i < nChanges; i++)
+  {
+    if (needsGesture(i))
+      BeginInformHostOfParamChange(pChanges[i].paramIdx);
+  }
+
+  InformHostOfParamChanges(pChanges, nChanges);
+
+  for (int i = 0; i < nChanges; i++)
+  {
+    if (needsGesture(i))
+      EndInformHostOfParamChange(pChanges[i].paramIdx);
+  }
+
+  OnParamChanges(pChanges, nChanges, kUI);
+  WakeTimer();
 }
 
 void IPlugAPIBase::DirtyParametersFromUI()
@@ -130,74 +350,305 @@ void IPlugAPIBase::DirtyParametersFromUI()
 
 void IPlugAPIBase::SendParameterValueFromAPI(int paramIdx, double value, bool normalized)
 {
-  //TODO: Can we assume that no host is stupid enough to try and set parameters on multiple threads at the same time?
-  // If that is the case then we need a MPSPC queue not SPSC
-  mParamChangeFromProcessor.Push(IParamChange { paramIdx, value, normalized } );
+  if (paramIdx < 0 || paramIdx >= mNParamsTracked)
+  {
+    mParamChangeFromProcessor.Push(IParamChange { paramIdx, value, normalized } );
+    return;
+  }
+  
+  const double normalizedValue = normalized ? value : GetParam(paramIdx)->ToNormalized(value);
+  
+  // the value and the bit are both atomic, so this is safe from several threads, the last value written wins
+  if (mParamPendingValues[paramIdx].exchange(normalizedValue, std::memory_order_relaxed) != normalizedValue)
+    mParamDirtyBits[paramIdx >> 6].fetch_or(uint64_t(1) << (paramIdx & 63), std::memory_order_release);
+}
+
+void IPlugAPIBase::InvalidateParamPendingValues()
+{
+  for (int i = 0; i < mNParamsTracked; i++)
+    mParamPendingValues[i].store(-1., std::memory_order_relaxed);
+}
+
+static inline int LowestSetBit(uint64_t bits)
+{
+#if defined _MSC_VER
+  unsigned long idx;
+  _BitScanForward64(&idx, bits);
+  return (int) idx;
+#else
+  return __builtin_ctzll(bits);
+#endif
+}
+
+bool IPlugAPIBase::SendParameterValuesFromProcessor()
+{
+  bool sent = false;
+  
+  for (int w = 0; w < mNParamDirtyWords; w++)
+  {
+    if (mParamDirtyBits[w].load(std::memory_order_relaxed) == 0)
+      continue;
+    
+    uint64_t bits = mParamDirtyBits[w].exchange(0, std::memory_order_acquire);
+    sent |= bits != 0;
+    
+    while (bits)
+    {
+      const int paramIdx = (w << 6) + LowestSetBit(bits);
+      bits &= bits - 1;
+      const double normalizedValue = mParamPendingValues[paramIdx].load(std::memory_order_relaxed);
+      // invalidated since the host sent it, see InvalidateParamPendingValues()
+      SendParameterValueFromDelegate(paramIdx, normalizedValue >= 0. ? normalizedValue : GetParam(paramIdx)->GetNormalized(), true);
+    }
+  }
+  
+  IParamChange changes[QUEUE_BATCH_SIZE];
+  int nChanges;
+  
+  while((nChanges = mParamChangeFromProcessor.PopBulk(changes, QUEUE_BATCH_SIZE)) > 0)
+  {
+    for (int i = 0; i < nChanges; i++)
+      SendParameterValueFromDelegate(changes[i].paramIdx, changes[i].value, changes[i].normalized);
+    
+    sent = true;
+  }
+  
+  return sent;
+}
+
+void IPlugAPIBase::AttachSharedState(int controlTag, IPlugTripleBufferBase* pState)
+{
+  const int n = mSharedStates.GetSize();
+  
+  for (int i = 0; i < n; i++)
+  {
+    if (mSharedStates.Get()[i].first == controlTag)
+    {
+      if (pState)
+        mSharedStates.Get()[i].second = pState;
+      else
+        mSharedStates.Delete(i);
+      
+      return;
+    }
+  }
+  
+  if (pState)
+    mSharedStates.Add(std::make_pair(controlTag, pState));
+}
+
+bool IPlugAPIBase::SendSharedStatesFromProcessor()
+{
+  const int n = mSharedStates.GetSize();
+  bool sent = false;
+  
+  for (int i = 0; i < n; i++)
+  {
+    IPlugTripleBufferBase* pState = mSharedStates.Get()[i].second;
+    
+    if (pState->Update())
+    {
+      SendControlMsgFromDelegate(mSharedStates.Get()[i].first, IPlugTripleBufferBase::kUpdateMessage, pState->GetReadDataSize(), pState->GetReadData());
+      sent = true;
+    }
+  }
+  
+  return sent;
+}
+
+void IPlugAPIBase::ProcessPresetRequests()
+{
+  switch (mPresetSnapshotState.load(std::memory_order_acquire))
+  {
+    case kPresetSnapshotIdle:
+    {
+      const int idx = mRequestedPresetIdx.exchange(-1, std::memory_order_acquire);
+      
+      if (idx < 0 || idx >= NPresets())
+        return;
+      
+#ifndef NO_PRESETS
+      IPreset* pPreset = mPresets.Get(idx);
+      
+      if (!DoesStateChunks() && pPreset->mInitialized)
+      {
+        if (UnserializeParamValues(GetPresetChunk(pPreset), 0, mPresetSnapshot) > 0)
+        {
+          mPresetSnapshotIdx = idx;
+          mPresetSnapshotTicks = 0;
+          mPresetSnapshotState.store(kPresetSnapshotReady, std::memory_order_release);
+        }
+        return;
+      }
+#endif
+      // custom state can only be restored through UnserializeState()
+      RestorePreset(idx);
+      return;
+    }
+    case kPresetSnapshotReady:
+    {
+      // if the host isn't processing, nothing will pick up the snapshot, so apply it here
+      int expected = kPresetSnapshotReady;
+      
+      if (++mPresetSnapshotTicks > PRESET_SNAPSHOT_TIMEOUT_TICKS
+          && mPresetSnapshotState.compare_exchange_strong(expected, kPresetSnapshotApplying, std::memory_order_acquire))
+        ApplyPresetSnapshot();
+      
+      return;
+    }
+    case kPresetSnapshotApplied:
+    {
+      mCurrentPresetIdx = mPresetSnapshotIdx;
+      
+      for (int i = 0; i < NParams(); ++i)
+        OnParamChangeUI(i, kPresetRecall);
+      
+#ifndef NO_PRESETS
+      OnPresetsModified();
+#endif
+      OnRestoreState();
+      InformHostOfProgramChange();
+      mPresetSnapshotState.store(kPresetSnapshotIdle, std::memory_order_release);
+      return;
+    }
+    default:
+      return;
+  }
+}
+
+void IPlugAPIBase::ApplyPresetSnapshot()
+{
+  const int n = std::min(NParams(), mPresetSnapshot.GetSize());
+  const double* pValues = mPresetSnapshot.Get();
+  
+  for (int i = 0; i < n; ++i)
+    GetParam(i)->Set(pValues[i]);
+  
+  for (int i = 0; i < n; ++i)
+    OnParamChange(i, kPresetRecall);
+  
+  InvalidateParamPendingValues();
+  mPresetSnapshotState.store(kPresetSnapshotApplied, std::memory_order_release);
 }
 
 void IPlugAPIBase::OnTimer(Timer& t)
 {
+  // anything in flight keeps the timer at its active rate
+  bool active = mRequestedPresetIdx.load(std::memory_order_relaxed) >= 0
+             || mPresetSnapshotState.load(std::memory_order_relaxed) != kPresetSnapshotIdle
+             || !mBackgroundJobs.empty();
+  
+  ProcessPresetRequests();
+  ProcessJobCompletions();
+  active |= InformHostOfHeldParamChanges();
+  
+  for (int i = 0; i < mHandoffs.GetSize(); i++)
+    mHandoffs.Get(i)->CollectGarbage();
+  
   if(HasUI())
   {
     // in distributed VST 3, parameter changes are managed by the host
   #if !defined VST3C_API && !defined VST3P_API
-    while(mParamChangeFromProcessor.ElementsAvailable())
+    active |= SendParameterValuesFromProcessor();
+    active |= SendSharedStatesFromProcessor();
+    
+    IMidiMsg msgs[QUEUE_BATCH_SIZE];
+    int nMsgs;
+    
+    while ((nMsgs = mMidiMsgsFromProcessor.PopBulk(msgs, QUEUE_BATCH_SIZE)) > 0)
     {
-      IParamChange p;
-      mParamChangeFromProcessor.Pop(p);
-      SendParameterValueFromDelegate(p.paramIdx, p.value, p.normalized); // TODO:  if the parameter hasn't changed maybe we shouldn't do anything?
+      for (int i = 0; i < nMsgs; i++)
+        SendMidiMsgFromDelegate(msgs[i]);
+      
+      active = true;
     }
     
-    while (mMidiMsgsFromProcessor.ElementsAvailable())
+    IPlugMessageRing::Record record;
+    
+    while (mSysExDataFromProcessor.Peek(record))
     {
-      IMidiMsg msg;
-      mMidiMsgsFromProcessor.Pop(msg);
-      SendMidiMsgFromDelegate(msg);
+      SendSysexMsgFromDelegate({record.mTag, record.mData, record.mSize});
+      mSysExDataFromProcessor.Release();
+      active = true;
     }
     
-    while (mSysExDataFromProcessor.ElementsAvailable())
+    while (mMsgsFromProcessor.Peek(record))
     {
-      SysExData msg;
-      mSysExDataFromProcessor.Pop(msg);
-      SendSysexMsgFromDelegate({msg.mOffset, msg.mData, msg.mSize});
+      if (record.mSubTag == kNoTag)
+        SendArbitraryMsgFromDelegate(record.mTag, record.mSize, record.mData);
+      else
+        SendControlMsgFromDelegate(record.mSubTag, record.mTag, record.mSize, record.mData);
+      
+      mMsgsFromProcessor.Release();
+      active = true;
     }
   #endif
     
-    // Midi messages from the processor to the controller, are sent as IMessages and SendMidiMsgFromDelegate gets triggered on the other side's notify
+    // Messages from the processor to the controller are batched into one IMessage per tick, and SendXXXFromDelegate gets triggered on the other side's notify
   #if defined VST3P_API
-    while (mMidiMsgsFromProcessor.ElementsAvailable())
+    active |= SendSharedStatesFromProcessor();
+    
+    IMidiMsg msgs[QUEUE_BATCH_SIZE];
+    int nMsgs;
+    
+    while ((nMsgs = mMidiMsgsFromProcessor.PopBulk(msgs, QUEUE_BATCH_SIZE)) > 0)
     {
-      IMidiMsg msg;
-      mMidiMsgsFromProcessor.Pop(msg);
-      TransmitMidiMsgFromProcessor(msg);
+      for (int i = 0; i < nMsgs; i++)
+        TransmitMidiMsgFromProcessor(msgs[i]);
+      
+      active = true;
     }
     
-    while (mSysExDataFromProcessor.ElementsAvailable())
+    IPlugMessageRing::Record record;
+    
+    while (mSysExDataFromProcessor.Peek(record))
     {
-      SysExData data;
-      mSysExDataFromProcessor.Pop(data);
-      TransmitSysExDataFromProcessor(data);
+      TransmitSysExDataFromProcessor({record.mTag, record.mData, record.mSize});
+      mSysExDataFromProcessor.Release();
+      active = true;
+    }
+    
+    while (mMsgsFromProcessor.Peek(record))
+    {
+      if (record.mSubTag == kNoTag)
+        SendArbitraryMsgFromDelegate(record.mTag, record.mSize, record.mData);
+      else
+        SendControlMsgFromDelegate(record.mSubTag, record.mTag, record.mSize, record.mData);
+      
+      mMsgsFromProcessor.Release();
+      active = true;
     }
   #endif
   }
   
   OnIdle();
+  
+  // anything sent above or from OnIdle() goes to the controller as a single message
+  FlushMessagesFromProcessor();
+  
+  const uint32_t interval = mTimerRate.GetInterval();
+  
+  if (mTimerRate.Tick(active) != interval)
+    t.SetInterval(mTimerRate.GetInterval());
 }
 
 void IPlugAPIBase::SendMidiMsgFromUI(const IMidiMsg& msg)
 {
+  WakeTimer();
   DeferMidiMsg(msg); // queue the message so that it will be handled by the processor
   EDITOR_DELEGATE_CLASS::SendMidiMsgFromUI(msg); // for remote editors
 }
 
 void IPlugAPIBase::SendSysexMsgFromUI(const ISysEx& msg)
 {
+  WakeTimer();
   DeferSysexMsg(msg); // queue the message so that it will be handled by the processor
   EDITOR_DELEGATE_CLASS::SendSysexMsgFromUI(msg); // for remote editors
 }
 
 void IPlugAPIBase::SendArbitraryMsgFromUI(int messageTag, int controlTag, int dataSize, const void* pData)
 {
+  WakeTimer();
   OnMessage(messageTag, controlTag, dataSize, pData); // IPlugAPIBase implementation handles non distributed plug-ins - just call OnMessage() directly
   
   EDITOR_DELEGATE_CLASS::SendArbitraryMsgFromUI(messageTag, controlTag, dataSize, pData);
@@ -12,6 +12,10 @@
 
 #include <cstring>
 #include <cstdint>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <vector>
 
 #include "ptrlist.h"
 #include "mutex.h"
@@ -23,7 +27,11 @@
 #include "IPlugUtilities.h"
 #include "IPlugParameter.h"
 #include "IPlugQueue.h"
+#include "IPlugTripleBuffer.h"
+#include "IPlugHandoff.h"
 #include "IPlugTimer.h"
+#include "IAdaptiveTimerRate.h"
+#include "IPlugHostCallStats.h"
 
 /**
  * @file
@@ -123,6 +131,19 @@ public:
    * @param normalizedValue The new (normalised) value */
   void SetParameterValue(int paramIdx, double normalizedValue);
   
+  /** Apply a batch of parameter changes from the UI or a delegate, for example when morphing, randomising or interpolating presets.
+   * Every value is set first, then the host is informed of the whole batch via InformHostOfParamChanges() and OnParamChanges() is called once.
+   * The host is informed inside a begin and end edit gesture for each parameter, except those already in a UI gesture, see BeginInformHostOfParamChangeFromUI()
+   * @param pChanges The changes to apply, non-normalized values are allowed
+   * @param nChanges The number of changes */
+  void SetParameterValues(const IParamChange* pChanges, int nChanges);
+  
+  /** Set how often the host may be informed of the changes to a parameter during a UI gesture. The plug-in sees every value at once, but the host, for which each
+   * change is a call that some hosts handle slowly, is only informed at this interval, with the latest value, which is always informed before the gesture ends.
+   * Changes outside a gesture are informed at once
+   * @param intervalMs The shortest interval in ms, or 0 to inform the host of every change. Defaults to HOST_PARAM_INFORM_INTERVAL */
+  void SetHostParamInformInterval(int intervalMs) { mHostParamInformInterval = std::max(intervalMs, 0); }
+  
   /** Get the color of the track that the plug-in is inserted on */
   virtual void GetTrackColor(int& r, int& g, int& b) {};
 
@@ -131,6 +152,14 @@ public:
   
   /** /todo */
   virtual void DirtyParametersFromUI() override;
+  
+  /** Request a preset change without touching the parameters from the calling thread, for example on a MIDI program change in ProcessMidiMsg().
+   * This is realtime safe and may be called from any thread. The preset is decoded into a snapshot on the main thread, the snapshot is applied
+   * at the start of the next processed block on the audio thread, and then the UI is notified on the main thread.
+   * Parameters with smoothing (see IParam::SetSmoothing()) glide to the new values rather than jumping.
+   * Plug-ins that do custom state chunks fall back to RestorePreset() on the main thread
+   * @param idx The index of the preset to restore */
+  void RequestPresetChange(int idx) { mRequestedPresetIdx.store(idx, std::memory_order_release); }
 #pragma mark - Methods called by the API class - you do not call these methods in your plug-in class
 
   /** This is called from the plug-in API class in order to update UI controls linked to plug-in parameters, prior to calling OnParamChange()
@@ -139,6 +168,23 @@ public:
    * @param value The new value
    * @param normalized /true if value is normalised */
   virtual void SendParameterValueFromAPI(int paramIdx, double value, bool normalized);
+  
+  /** Called from ProcessBlockStartTasks() at the start of each block, to apply a preset snapshot published by RequestPresetChange() */
+  void ApplyPendingPreset()
+  {
+    int expected = kPresetSnapshotReady;
+    
+    if (mPresetSnapshotState.load(std::memory_order_relaxed) == kPresetSnapshotReady
+        && mPresetSnapshotState.compare_exchange_strong(expected, kPresetSnapshotApplying, std::memory_order_acquire))
+      ApplyPresetSnapshot();
+  }
+
+  /** Called by the API class on the audio thread at the start of each block, before ProcessBuffers() */
+  void ProcessBlockStartTasks()
+  {
+    ApplyPendingPreset();
+    ProcessAudioThreadJobCompletions();
+  }
 
   /** Called to set the name of the current host, if known (calls on to HostSpecificInit() and OnHostIdentified()).
   * @param host The name of the plug-in host
@@ -150,9 +196,9 @@ public:
   virtual void HostSpecificInit() {}
 
   //IEditorDelegate
-  void BeginInformHostOfParamChangeFromUI(int paramIdx) override { BeginInformHostOfParamChange(paramIdx); }
+  void BeginInformHostOfParamChangeFromUI(int paramIdx) override;
   
-  void EndInformHostOfParamChangeFromUI(int paramIdx) override { EndInformHostOfParamChange(paramIdx); }
+  void EndInformHostOfParamChangeFromUI(int paramIdx) override;
   
   void EditorPropertiesChangedFromUI(int viewWidth, int viewHeight, const IByteChunk& data) override { EditorPropertiesChangedFromDelegate(viewWidth, viewHeight, data); }
   
@@ -162,6 +208,19 @@ public:
     IPluginBase::SendParameterValueFromUI(paramIdx, normalisedValue);
   }
   
+  void SendCurrentParamValuesFromDelegate() override
+  {
+    InvalidateParamPendingValues();
+    IPluginBase::SendCurrentParamValuesFromDelegate();
+  }
+  
+  //IPluginBase
+  void OnParamReset(EParamSource source) override
+  {
+    InvalidateParamPendingValues();
+    IPluginBase::OnParamReset(source);
+  }
+  
   //These are handled in IPlugAPIBase for non DISTRIBUTED APIs
   void SendMidiMsgFromUI(const IMidiMsg& msg) override;
   
@@ -173,36 +232,163 @@ public:
   
   void DeferSysexMsg(const ISysEx& msg) override
   {
-    SysExData data(msg.mOffset, msg.mSize, msg.mData); // copies data
-    mSysExDataFromEditor.Push(data);
+    mSysExDataFromEditor.Push(msg.mOffset, 0, msg.mData, msg.mSize); // copies data
+  }
+  
+  /** Send a message to a control in the user interface from the realtime audio thread. The message is copied into a lock-free ring
+   * and forwarded to SendControlMsgFromDelegate() on the main thread, unlike SendControlMsgFromDelegate() itself this is safe to call in ProcessBlock()
+   * @param controlTag A unique tag to identify the control that is the destination of the message, or kNoTag to send it via SendArbitraryMsgFromDelegate()
+   * @param messageTag A unique tag to identify the message
+   * @param dataSize The size in bytes of the data payload pointed to by pData
+   * @param pData Ptr to the opaque data payload for the message
+   * @return \c true if the message was queued, \c false if the ring was full or the payload too large */
+  bool SendControlMsgFromProcessor(int controlTag, int messageTag, int dataSize = 0, const void* pData = nullptr)
+  {
+    return mMsgsFromProcessor.Push(messageTag, controlTag, pData, dataSize);
   }
+  
+  /** Reserve space in the ring for a message to a control, to be filled in place from the realtime audio thread and then sent with CommitControlMsgFromProcessor()
+   * @param controlTag A unique tag to identify the control that is the destination of the message, or kNoTag
+   * @param messageTag A unique tag to identify the message
+   * @param dataSize The size in bytes of the data payload
+   * @return Pointer to dataSize bytes to write the payload into, or nullptr if the ring was full */
+  void* BeginControlMsgFromProcessor(int controlTag, int messageTag, int dataSize) { return mMsgsFromProcessor.BeginWrite(messageTag, controlTag, dataSize); }
+  
+  /** Send the message reserved by the last successful BeginControlMsgFromProcessor() */
+  void CommitControlMsgFromProcessor() { mMsgsFromProcessor.CommitWrite(); }
+  
+  /** Bind a triple buffer to a control in the user interface. Whenever the audio thread publishes new state, the timer sends the
+   * latest buffer in place to SendControlMsgFromDelegate() with messageTag IPlugTripleBufferBase::kUpdateMessage.
+   * Call this on the main thread, e.g. in the plug-in constructor. The triple buffer must outlive the binding
+   * @param controlTag The tag of the control that should receive the state
+   * @param pState The triple buffer written on the audio thread, or nullptr to remove the binding */
+  void AttachSharedState(int controlTag, IPlugTripleBufferBase* pState);
+  
+  /** Register a handoff so that the objects its audio thread retires are deleted on the main thread, from the timer.
+   * Call this on the main thread, e.g. in the plug-in constructor
+   * @param pHandoff The handoff, typically a member of your plug-in class */
+  void AttachHandoff(IPlugHandoffBase* pHandoff) { mHandoffs.Add(pHandoff); }
+  
+  /** Unregister a handoff registered with AttachHandoff(). Call this on the main thread */
+  void DetachHandoff(IPlugHandoffBase* pHandoff) { mHandoffs.DeletePtr(pHandoff); }
 
   /** /todo */
   void CreateTimer();
   
+  /** Let the timer that services the queues from the processor and calls OnIdle() back off, up to ADAPTIVE_TIMER_MAX_INTERVAL, while there is nothing to send,
+   * and go back to IDLE_TIMER_RATE as soon as there is. This saves CPU with many instances open, at the cost of OnIdle() being called less often
+   * and of the first update after a quiet spell arriving late. Off by default, since OnIdle() may have work of its own, see WakeTimer()
+   * @param enable \c true to let the timer back off */
+  void SetAdaptiveTimerRate(bool enable) { mTimerRate.SetEnabled(enable); UpdateTimerInterval(); }
+  
+  /** Put the timer back to IDLE_TIMER_RATE straight away, e.g. when OnIdle() has started work it needs to be called for often. Main thread only */
+  void WakeTimer()
+  {
+    if (mTimerRate.Wake())
+      UpdateTimerInterval();
+  }
+  
+  /** The time the host takes to return from each kind of call the API class makes to it, such as informing it of parameter changes, which is only measured if IPLUG_HOST_CALL_STATS is defined
+   * @return The plug-in's host call statistics */
+  IPlugHostCallStats& GetHostCallStats() { return mHostCallStats; }
+  
 private:
   /** Implemented by the API class, called by the UI via SetParameterValue() with the value of a parameter change gesture
    * @param paramIdx The parameter that is being changed
    * @param normalizedValue The new normalised value of the parameter being changed */
   virtual void InformHostOfParamChange(int paramIdx, double normalizedValue) {};
   
+  /** Implemented by the API class, called via SetParameterValues() to inform the host of a batch of parameter changes.
+   * APIs that can group edits should override this, the default implementation informs the host of each change separately
+   * @param pChanges The changes, which have already been applied to the parameters
+   * @param nChanges The number of changes */
+  virtual void InformHostOfParamChanges(const IParamChange* pChanges, int nChanges)
+  {
+    for (int i = 0; i < nChanges; i++)
+      InformHostOfParamChange(pChanges[i].paramIdx, GetParam(pChanges[i].paramIdx)->GetNormalized());
+  }
+  
   //DISTRIBUTED ONLY (Currently only VST3)
   /** /todo */
   virtual void TransmitMidiMsgFromProcessor(const IMidiMsg& msg) {};
   
   /** /todo */
-  virtual void TransmitSysExDataFromProcessor(const SysExData& data) {};
+  virtual void TransmitSysExDataFromProcessor(const ISysEx& msg) {};
+  
+  /** Send everything queued for the other side of a distributed plug-in since the last call. Called at the end of OnTimer() */
+  virtual void FlushMessagesFromProcessor() {};
 
   void OnTimer(Timer& t);
+  
+  void UpdateTimerInterval()
+  {
+    if (mTimer)
+      mTimer->SetInterval(mTimerRate.GetInterval());
+  }
 
 protected:
+  void ReportMemory(IMemoryReport& report) const override;
+
+  /** Forward parameter changes received from the API to the delegate. Called on the main thread from OnTimer().
+   * Only parameters whose dirty bit is set are visited, and each is sent once with its latest value, however many times it changed since the last call
+   * @return \c true if anything was sent */
+  bool SendParameterValuesFromProcessor();
+  
+  /** Forward the latest state of each bound triple buffer that has changed to its control. Called on the main thread from OnTimer()
+   * @return \c true if anything was sent */
+  bool SendSharedStatesFromProcessor();
+  
+  /** Main thread part of RequestPresetChange(), called from OnTimer() */
+  void ProcessPresetRequests();
+  
+  /** Hold back informing the host of a change during a gesture, if it was informed of the parameter less than the interval ago, see SetHostParamInformInterval()
+   * @return \c true if the change is held back, to be informed by InformHostOfHeldParamChanges() or at the end of the gesture */
+  bool HoldParamChange(int paramIdx, double normalizedValue);
+  
+  /** Inform the host of the changes held back for at least the interval. Called from OnTimer(), so that the host gets the value a gesture rests at
+   * @return \c true if any are still held back */
+  bool InformHostOfHeldParamChanges();
+  
+  /** Set the parameters from the preset snapshot, then mark it applied. Called by whichever thread claimed the snapshot */
+  void ApplyPresetSnapshot();
+
+  /** Forget the values last received from the API, when the parameters change some other way, so that the next value the host sends is forwarded
+   * even if it is the same as the last one, see SendParameterValueFromAPI() */
+  void InvalidateParamPendingValues();
+
   WDL_String mParamDisplayStr;
   Timer* mTimer = nullptr;
+  IAdaptiveTimerRate mTimerRate;
+  
+  IPlugMPSCQueue<IParamChange> mParamChangeFromProcessor {PARAM_TRANSFER_SIZE}; // only used for parameters added after construction, which have no dirty bit. Hosts may set parameters from several threads, hence MPSC
+  std::unique_ptr<std::atomic<uint64_t>[]> mParamDirtyBits; // one bit per parameter, set by SendParameterValueFromAPI() and cleared a word at a time by SendParameterValuesFromProcessor()
+  std::unique_ptr<std::atomic<double>[]> mParamPendingValues; // the latest normalized value received from the API for each parameter, or -1. once invalidated, see InvalidateParamPendingValues()
+  int mNParamDirtyWords = 0;
+  int mNParamsTracked = 0;
   
-  IPlugQueue<IParamChange> mParamChangeFromProcessor {PARAM_TRANSFER_SIZE};
+  enum EPresetSnapshotState { kPresetSnapshotIdle, kPresetSnapshotReady, kPresetSnapshotApplying, kPresetSnapshotApplied };
+  std::atomic<int> mRequestedPresetIdx {-1}; // set by RequestPresetChange() on any thread
+  std::atomic<int> mPresetSnapshotState {kPresetSnapshotIdle}; // hands mPresetSnapshot between the main and audio threads
+  WDL_TypedBuf<double> mPresetSnapshot; // the decoded values of the requested preset, only written on the main thread while idle
+  int mPresetSnapshotIdx = -1;
+  int mPresetSnapshotTicks = 0; // timer ticks the snapshot has been waiting for the audio thread
   IPlugQueue<IMidiMsg> mMidiMsgsFromEditor {MIDI_TRANSFER_SIZE}; // a queue of midi messages generated in the editor by clicking keyboard UI etc
   IPlugQueue<IMidiMsg> mMidiMsgsFromProcessor {MIDI_TRANSFER_SIZE}; // a queue of MIDI messages received (potentially on the high priority thread), by the processor to send to the editor
-  IPlugQueue<SysExData> mSysExDataFromEditor {SYSEX_TRANSFER_SIZE}; // a queue of SYSEX data to send to the processor
-  IPlugQueue<SysExData> mSysExDataFromProcessor {SYSEX_TRANSFER_SIZE}; // a queue of SYSEX data to send to the editor
-  SysExData mSysexBuf;
+  IPlugMessageRing mSysExDataFromEditor {SYSEX_RING_SIZE}; // a ring of SYSEX data to send to the processor, the record tag is the offset
+  IPlugMessageRing mSysExDataFromProcessor {SYSEX_RING_SIZE}; // a ring of SYSEX data to send to the editor, the record tag is the offset
+  WDL_PtrList<IPlugHandoffBase> mHandoffs; // see AttachHandoff()
+  WDL_TypedBuf<std::pair<int, IPlugTripleBufferBase*>> mSharedStates; // control tag and triple buffer, see AttachSharedState()
+  IPlugMessageRing mMsgsFromProcessor {MESSAGE_RING_SIZE}; // a ring of control and arbitrary messages to send to the editor, the record tags are the message and control tags
+  
+  struct ParamGesture
+  {
+    int paramIdx;
+    std::chrono::steady_clock::time_point informTime; // when the host was last informed
+    double heldValue;
+    bool held;
+  };
+  
+  std::vector<ParamGesture> mParamGestures; // the UI gestures in progress, usually one
+  IPlugHostCallStats mHostCallStats;
+  int mHostParamInformInterval = HOST_PARAM_INFORM_INTERVAL;
 };
@@ -0,0 +1,122 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IPlugArena
+ */
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+#include "heapbuf.h"
+#include "IPlugConstants.h"
+
+/** A linear (bump) allocator for temporary memory on the realtime audio thread, such as oversampling buffers, FFT scratch or per-voice temporaries.
+ * The memory is allocated once by Reserve() on a non-realtime thread. Allocate() just advances an offset, so it never locks or calls the system allocator,
+ * and Reset() frees everything at once. Allocations are SCRATCH_BUFFER_ALIGNMENT aligned, and consecutive allocations are contiguous, which keeps the
+ * working set warm in the cache. Running out of space asserts in debug builds and returns nullptr in release builds */
+class IPlugArena
+{
+public:
+  IPlugArena() {}
+
+  IPlugArena(const IPlugArena&) = delete;
+  IPlugArena& operator=(const IPlugArena&) = delete;
+
+  /** Make sure the arena can hold at least nBytes of allocations. This may allocate, so call it from a non-realtime thread, and never while memory from the arena is in use.
+   * Each allocation is padded to SCRATCH_BUFFER_ALIGNMENT, so allow for that when working out nBytes
+   * @param nBytes The number of bytes to reserve */
+  void Reserve(int nBytes)
+  {
+    if (nBytes > mCapacity)
+    {
+      mBuf.Resize(nBytes + SCRATCH_BUFFER_ALIGNMENT);
+      mCapacity = nBytes;
+    }
+
+    mHighWaterMark = 0;
+    Reset();
+  }
+
+  /** Free memory used by the arena */
+  void Release()
+  {
+    mBuf.Resize(0);
+    mCapacity = 0;
+    Reset();
+  }
+
+  /** Free every allocation at once. Realtime safe */
+  void Reset() { mUsed = 0; }
+
+  /** Take nBytes from the arena. Realtime safe
+   * @param nBytes The number of bytes to allocate
+   * @return SCRATCH_BUFFER_ALIGNMENT aligned memory that stays valid until the next Reset(), or nullptr if the arena is full */
+  void* Allocate(int nBytes)
+  {
+    const int size = ((nBytes + SCRATCH_BUFFER_ALIGNMENT - 1) / SCRATCH_BUFFER_ALIGNMENT) * SCRATCH_BUFFER_ALIGNMENT;
+
+    if (nBytes < 0 || mUsed + size > mCapacity)
+    {
+      assert(false && "IPlugArena overflow, reserve more memory");
+      return nullptr;
+    }
+
+    uint8_t* pMem = static_cast<uint8_t*>(mBuf.GetAligned(SCRATCH_BUFFER_ALIGNMENT)) + mUsed;
+    mUsed += size;
+
+    if (mUsed > mHighWaterMark)
+      mHighWaterMark = mUsed;
+
+    return pMem;
+  }
+
+  /** Take an array from the arena. The elements are not constructed, so this is meant for plain data like samples. Realtime safe
+   * @param n The number of elements
+   * @return Pointer to the first element, or nullptr if the arena is full */
+  template <typename T>
+  T* Allocate(int n)
+  {
+    return static_cast<T*>(Allocate(n * static_cast<int>(sizeof(T))));
+  }
+
+  /** Take a zeroed array from the arena. Realtime safe
+   * @param n The number of elements
+   * @return Pointer to the first element, or nullptr if the arena is full */
+  template <typename T>
+  T* AllocateZeroed(int n)
+  {
+    T* pMem = Allocate<T>(n);
+
+    if (pMem)
+      memset(pMem, 0, n * sizeof(T));
+
+    return pMem;
+  }
+
+  /** @return The number of bytes that can be allocated between resets */
+  int GetCapacity() const { return mCapacity; }
+
+  /** @return The number of bytes allocated since the last Reset() */
+  int GetUsed() const { return mUsed; }
+
+  /** @return The largest number of bytes that has been in use at once since the last Reserve(), useful to size the arena during development */
+  int GetHighWaterMark() const { return mHighWaterMark; }
+
+private:
+  WDL_HeapBuf mBuf;
+  int mCapacity = 0;
+  int mUsed = 0;
+  int mHighWaterMark = 0;
+};
@@ -0,0 +1,354 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @brief Runtime selection of multi-versioned kernels for the instruction sets of the CPU the plug-in runs on
+ *
+ * A plug-in ships as one binary per platform, so it can only assume the baseline instruction set: SSE2 on x64, NEON on arm64, and SIMD128 on WebAssembly when built with it.
+ * On x86/x64 the wider sets are detected at runtime with cpuid, and kernels for them are compiled in the same file as the baseline ones with IPLUG_TARGET_AVX, IPLUG_TARGET_AVX2 or IPLUG_TARGET_AVX512,
+ * which enable the instructions for one function only. An IPlugDispatch holds a kernel's versions and points at the best one the CPU supports, e.g.
+ * @code
+ * static IPlugDispatch<GainFunc> sGain { ScalarGain, { { kISASSE2, SSE2Gain }, { kISAAVX2, AVX2Gain } } };
+ * sGain.Get()(pData, gain, nFrames);
+ * @endcode
+ * The choice is made when an IPlugDispatch is created, and the CPU is detected when IPluginBase is first constructed, so that neither happens on the audio thread. IPlugCPU::ForceISA(), or the IPLUG_ISA environment variable
+ * (e.g. IPLUG_ISA=sse2), limits the choice to an instruction set and those below it, to benchmark or test one version against another
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <mutex>
+#include <utility>
+
+#include "IPlugPlatform.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define IPLUG_SIMD_SSE2
+  #include <emmintrin.h>
+  #if defined(_MSC_VER)
+    #include <intrin.h>
+    #include <immintrin.h>
+    #define IPLUG_SIMD_AVX
+    #define IPLUG_TARGET_AVX
+    #define IPLUG_TARGET_AVX2
+    #define IPLUG_TARGET_AVX512
+  #elif defined(__GNUC__) || defined(__clang__)
+    #include <cpuid.h>
+    #include <immintrin.h>
+    #define IPLUG_SIMD_AVX
+    #define IPLUG_TARGET_AVX __attribute__((target("avx")))
+    #define IPLUG_TARGET_AVX2 __attribute__((target("avx2,fma")))
+    #define IPLUG_TARGET_AVX512 __attribute__((target("avx512f,avx512bw,avx512dq,avx512vl")))
+  #endif
+  #if defined(__APPLE__)
+    #include <sys/sysctl.h>
+  #endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+  #define IPLUG_SIMD_NEON
+  #include <arm_neon.h>
+#elif defined(__wasm_simd128__)
+  #define IPLUG_SIMD_WASM
+  #include <wasm_simd128.h>
+#endif
+
+/** The instruction sets a kernel can have a version for. Each implies the ones before it in its family, and a dispatch falls back down the list to the best version it has */
+enum EIPlugISA
+{
+  kISAScalar = 0,
+  kISASSE2,
+  kISAAVX,
+  kISAAVX2, // with FMA
+  kISAAVX512, // F, BW, DQ and VL, as on every CPU that has AVX-512 since Skylake-SP
+  kISANEON,
+  kISAWASM,
+  kNumISAs
+};
+
+/** Detects the instruction sets of the CPU, and resolves the IPlugDispatch objects to the versions for the selected one */
+class IPlugCPU
+{
+public:
+  /** The base of IPlugDispatch, kept in a list so that all of them can be resolved again when the selected instruction set changes */
+  class Dispatcher
+  {
+  public:
+    virtual ~Dispatcher() { Unregister(this); }
+
+  protected:
+    Dispatcher() = default;
+    Dispatcher(const Dispatcher&) = delete;
+    Dispatcher& operator=(const Dispatcher&) = delete;
+
+    /** Add to the list and resolve for the selected instruction set. Call at the end of the derived class's constructor */
+    void Register() { IPlugCPU::Register(this); }
+
+    /** Point at the best version for isa or one below it */
+    virtual void Resolve(EIPlugISA isa) = 0;
+
+  private:
+    friend class IPlugCPU;
+    Dispatcher* mpNext = nullptr;
+  };
+
+  /** @param isa An instruction set
+   * @return \c true if the CPU and the OS support it, and the plug-in was compiled for its family */
+  static bool Supports(EIPlugISA isa) { return (GetSupportedISAs() & (1u << isa)) != 0; }
+
+  /** @return The best instruction set the CPU supports */
+  static EIPlugISA GetBestISA()
+  {
+    const uint32_t supported = GetSupportedISAs();
+
+    for (int isa = kNumISAs - 1; isa > kISAScalar; isa--)
+    {
+      if (supported & (1u << isa))
+        return static_cast<EIPlugISA>(isa);
+    }
+
+    return kISAScalar;
+  }
+
+  /** @return The instruction set the dispatches are resolved for: the best one, unless ForceISA() or IPLUG_ISA has limited it */
+  static EIPlugISA GetISA()
+  {
+    const int forced = GetState().forced.load(std::memory_order_acquire);
+    return forced >= 0 ? static_cast<EIPlugISA>(forced) : GetBestISA();
+  }
+
+  /** Limit the dispatches to an instruction set and those below it, for benchmarking and testing. This is process wide and takes effect at once,
+   * so call it before any audio runs, not while another thread may be calling the kernels
+   * @param isa The instruction set, or kNumISAs to go back to the best one
+   * @return \c false if the CPU doesn't support isa, in which case nothing changes */
+  static bool ForceISA(EIPlugISA isa)
+  {
+    if (isa != kNumISAs && !Supports(isa))
+      return false;
+
+    GetState().forced.store(isa == kNumISAs ? -1 : static_cast<int>(isa), std::memory_order_release);
+    ResolveAll();
+    return true;
+  }
+
+  /** Detect the CPU, if it hasn't been, and resolve every IPlugDispatch for the selected instruction set. Called by the IPluginBase constructor */
+  static void ResolveDispatchers()
+  {
+    GetSupportedISAs();
+    ResolveAll();
+  }
+
+  /** @return The name of an instruction set, as IPLUG_ISA takes it */
+  static const char* GetISAName(EIPlugISA isa)
+  {
+    static const char* sNames[kNumISAs] = { "scalar", "sse2", "avx", "avx2", "avx512", "neon", "wasm" };
+    return isa >= kISAScalar && isa < kNumISAs ? sNames[isa] : "unknown";
+  }
+
+  /** @param name The name of an instruction set, see GetISAName()
+   * @return The instruction set, or kNumISAs if there is none of that name */
+  static EIPlugISA FindISA(const char* name)
+  {
+    for (int isa = kISAScalar; isa < kNumISAs; isa++)
+    {
+      if (name && !strcmp(name, GetISAName(static_cast<EIPlugISA>(isa))))
+        return static_cast<EIPlugISA>(isa);
+    }
+
+    return kNumISAs;
+  }
+
+  /** @return A bit for each EIPlugISA that can be used, detected once */
+  static uint32_t GetSupportedISAs()
+  {
+    static const uint32_t sSupported = Detect();
+    return sSupported;
+  }
+
+private:
+  struct State
+  {
+    std::mutex mutex;
+    Dispatcher* pHead = nullptr;
+    std::atomic<int> forced {InitialForcedISA()};
+  };
+
+  static State& GetState()
+  {
+    static State sState;
+    return sState;
+  }
+
+  static int InitialForcedISA()
+  {
+    const EIPlugISA isa = FindISA(getenv("IPLUG_ISA"));
+    return isa != kNumISAs && Supports(isa) ? static_cast<int>(isa) : -1;
+  }
+
+  static void Register(Dispatcher* pDispatcher)
+  {
+    State& state = GetState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    pDispatcher->mpNext = state.pHead;
+    state.pHead = pDispatcher;
+    pDispatcher->Resolve(GetISA());
+  }
+
+  static void Unregister(Dispatcher* pDispatcher)
+  {
+    State& state = GetState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+
+    for (Dispatcher** ppLink = &state.pHead; *ppLink; ppLink = &(*ppLink)->mpNext)
+    {
+      if (*ppLink == pDispatcher)
+      {
+        *ppLink = pDispatcher->mpNext;
+        break;
+      }
+    }
+  }
+
+  static void ResolveAll()
+  {
+    State& state = GetState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    const EIPlugISA isa = GetISA();
+
+    for (Dispatcher* pDispatcher = state.pHead; pDispatcher; pDispatcher = pDispatcher->mpNext)
+      pDispatcher->Resolve(isa);
+  }
+
+  static uint32_t Detect()
+  {
+    uint32_t supported = 1u << kISAScalar;
+#if defined IPLUG_SIMD_SSE2
+    supported |= 1u << kISASSE2;
+  #ifdef IPLUG_SIMD_AVX
+    uint32_t leaf1[4] = {}, leaf7[4] = {};
+    CPUID(1, leaf1);
+
+    if (CPUID(0, leaf7) && leaf7[0] >= 7)
+      CPUID(7, leaf7);
+    else
+      memset(leaf7, 0, sizeof(leaf7));
+
+    const bool osxsave = (leaf1[2] & (1u << 27)) != 0;
+    const uint64_t xcr0 = osxsave ? GetXCR0() : 0;
+    const bool ymmSaved = (xcr0 & 0x6) == 0x6;
+
+    if (ymmSaved && (leaf1[2] & (1u << 28)))
+    {
+      supported |= 1u << kISAAVX;
+
+      if ((leaf7[1] & (1u << 5)) && (leaf1[2] & (1u << 12)))
+      {
+        supported |= 1u << kISAAVX2;
+
+        const uint32_t avx512 = (1u << 16) | (1u << 17) | (1u << 30) | (1u << 31); // F, DQ, BW, VL
+
+        if ((leaf7[1] & avx512) == avx512 && ZMMStateEnabled(xcr0))
+          supported |= 1u << kISAAVX512;
+      }
+    }
+  #endif
+#elif defined IPLUG_SIMD_NEON
+    supported |= 1u << kISANEON;
+#elif defined IPLUG_SIMD_WASM
+    supported |= 1u << kISAWASM;
+#endif
+    return supported;
+  }
+
+#ifdef IPLUG_SIMD_AVX
+  /** @return \c false if the leaf is beyond the CPU's highest one */
+  static bool CPUID(uint32_t leaf, uint32_t regs[4])
+  {
+  #ifdef _MSC_VER
+    int info[4];
+    __cpuidex(info, (int) leaf, 0);
+    memcpy(regs, info, sizeof(info));
+    return true;
+  #else
+    return __get_cpuid_count(leaf, 0, &regs[0], &regs[1], &regs[2], &regs[3]) != 0;
+  #endif
+  }
+
+  static uint64_t GetXCR0()
+  {
+  #ifdef _MSC_VER
+    return _xgetbv(0);
+  #else
+    uint32_t lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((uint64_t) hi << 32) | lo;
+  #endif
+  }
+
+  static bool ZMMStateEnabled(uint64_t xcr0)
+  {
+  #if defined(__APPLE__)
+    // macOS turns the AVX-512 state on the first time a thread uses it, so XCR0 doesn't show it yet
+    int value = 0;
+    size_t size = sizeof(value);
+    return sysctlbyname("hw.optional.avx512f", &value, &size, nullptr, 0) == 0 && value != 0;
+  #else
+    return (xcr0 & 0xE6) == 0xE6; // the opmask and upper ZMM registers are saved as well as the YMM ones
+  #endif
+  }
+#endif
+};
+
+/** A kernel with versions for several instruction sets, pointing at the best one for IPlugCPU::GetISA().
+ * Declare it static, at namespace or function scope, so that it is resolved once rather than for each instance
+ * @tparam T A function pointer type, or a pointer to a table of them */
+template <typename T>
+class IPlugDispatch : public IPlugCPU::Dispatcher
+{
+public:
+  /** @param scalar The version every CPU can run
+   * @param versions The versions for other instruction sets. Only include those compiled for the target, e.g. inside #ifdef IPLUG_SIMD_AVX */
+  IPlugDispatch(T scalar, std::initializer_list<std::pair<EIPlugISA, T>> versions = {})
+  : mCurrent(scalar)
+  {
+    mVersions[kISAScalar] = scalar;
+
+    for (const auto& version : versions)
+      mVersions[version.first] = version.second;
+
+    Register();
+  }
+
+  /** @return The version for the selected instruction set */
+  T Get() const { return mCurrent.load(std::memory_order_relaxed); }
+
+  /** @param isa An instruction set
+   * @return The version that would be chosen for isa, whatever is selected, e.g. to compare two versions in a test */
+  T GetFor(EIPlugISA isa) const
+  {
+    for (int i = isa; i > kISAScalar; i--)
+    {
+      if (mVersions[i] && IPlugCPU::Supports(static_cast<EIPlugISA>(i)))
+        return mVersions[i];
+    }
+
+    return mVersions[kISAScalar];
+  }
+
+private:
+  void Resolve(EIPlugISA isa) override { mCurrent.store(GetFor(isa), std::memory_order_relaxed); }
+
+  T mVersions[kNumISAs] = {};
+  std::atomic<T> mCurrent;
+};
@@ -33,8 +33,7 @@ typedef double PLUG_SAMPLE_SRC;
 typedef PLUG_SAMPLE_DST sample;
 
 #define LOGFILE "IPlugLog.txt"
-#define MAX_PROCESS_TRACE_COUNT 100
-#define MAX_IDLE_TRACE_COUNT 15
+#define TRACEFILE "IPlugTrace.itrc"
 
 enum EIPlugPluginType
 {
@@ -106,19 +105,61 @@ static const int MAX_PARAM_DISPLAY_PRECISION = 6;
 #define IDLE_TIMER_RATE 20 // this controls the frequency of data going from processor to editor (and OnIdle calls)
 #endif
 
+#ifndef ADAPTIVE_TIMER_IDLE_TICKS
+#define ADAPTIVE_TIMER_IDLE_TICKS 30 // the number of idle ticks in a row before an adaptive timer starts to back off
+#endif
+
+#ifndef ADAPTIVE_TIMER_MAX_INTERVAL
+#define ADAPTIVE_TIMER_MAX_INTERVAL 250 // the longest interval in ms that an adaptive timer backs off to
+#endif
+
+#ifndef HOST_PARAM_INFORM_INTERVAL
+#define HOST_PARAM_INFORM_INTERVAL 30 // the shortest interval in ms between informing the host of changes to a parameter during a UI gesture, 0 to inform it of every change
+#endif
+
 #ifndef MAX_SYSEX_SIZE
 #define MAX_SYSEX_SIZE 512
 #endif
 
+#ifndef MAX_PARAM_EVENTS_PER_BLOCK
+#define MAX_PARAM_EVENTS_PER_BLOCK 1024 // the maximum number of sample accurate parameter changes that can be queued in a single block
+#endif
+
+#ifndef MAX_MIDI_EVENTS_PER_BLOCK
+#define MAX_MIDI_EVENTS_PER_BLOCK 1024 // the maximum number of sample accurate MIDI messages that can be queued in a single block
+#endif
+
+#ifndef VST3_MESSAGE_BATCH_RESERVE
+#define VST3_MESSAGE_BATCH_RESERVE 8192 // bytes reserved for the messages a distributed VST3 processor sends its controller each timer tick
+#endif
+
 #define PARAM_TRANSFER_SIZE 512
 #define MIDI_TRANSFER_SIZE 32
 #define SYSEX_TRANSFER_SIZE 4
+#define SYSEX_RING_SIZE (SYSEX_TRANSFER_SIZE * (MAX_SYSEX_SIZE + 16)) // in bytes, rounded up to a power of two
+#define MESSAGE_RING_SIZE 16384 // in bytes, for control and arbitrary messages sent from the processor to the editor
+#define QUEUE_BATCH_SIZE 32 // the number of elements popped from a transfer queue at a time on the main thread
+#define WEB_TRANSPORT_BATCH_SIZE 65536 // in bytes, the most a WAM processor can send to its UI per render quantum, see IPlugWebTransport.h
 
 // All version ints are stored as 0xVVVVRRMM: V = version, R = revision, M = minor revision.
 #define IPLUG_VERSION 0x010000
 #define IPLUG_VERSION_MAGIC 'pfft'
+#define SPARSE_PARAMS_MAGIC 0x7FF8695053504131ULL // a quiet NaN bit pattern, so it can never be mistaken for the first value of a plain parameter chunk
+#define SPARSE_PARAMS_VERSION 1
 
 static const int DEFAULT_BLOCK_SIZE = 1024;
+static const int DEFAULT_MIN_SUB_BLOCK_SIZE = 16;
+static const double DEFAULT_SMOOTHING_TIME_MS = 20.0;
+static const int SCRATCH_BUFFER_ALIGNMENT = 64;
+static const int BLOCK_ARENA_MAX_ALLOCATIONS = 32; // the block arena is padded so that this many allocations fit in the declared size, despite alignment
+static const int PARAM_VALUES_ALIGNMENT = 64;
+static const int DEFAULT_SHAPE_TABLE_SIZE = 1024;
+static const int BYTE_CHUNK_POOL_SIZE = 4;
+static const int JOB_COMPLETION_QUEUE_SIZE = 64;
+static const int REALTIME_CHECK_MAX_REPORTS = 32; // with IPLUG_REALTIME_CHECKS, stop reporting realtime violations after this many
+static const int REALTIME_CHECK_BACKTRACE_DEPTH = 32;
+static const int PRESET_SNAPSHOT_TIMEOUT_TICKS = 5; // timer ticks before a preset snapshot is applied on the main thread, if the audio thread isn't running
+static const int BYPASS_CROSSFADE_SAMPLES = 128;
 static const double DEFAULT_TEMPO = 120.0;
 static const int kNoParameter = -1;
 static const int kNoTag = -1;
@@ -177,7 +218,8 @@ enum EAPI
   kAPIAAX = 4,
   kAPIAPP = 5,
   kAPIWAM = 6,
-  kAPIWEB = 7
+  kAPIWEB = 7,
+  kAPICLAP = 8
 };
 
 /** @enum EHost
@@ -231,7 +273,8 @@ enum EResourceLocation
 {
   kNotFound = 0,
   kAbsolutePath,
-  kWinBinary
+  kWinBinary,
+  kPackedArchive // in the memory mapped resources.pak, see IPlugResourceArchive
 };
 
 /**@}*/
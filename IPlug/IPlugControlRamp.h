@@ -0,0 +1,304 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+ */
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc ControlRamp
+ */
+
+#include <cmath>
+#include <cstring>
+
+#include "heapbuf.h"
+
+#include "IPlugParameter.h"
+
+/** A ControlRamp describes one value changing over time. It can
+ * be easily converted into a signal for more processing,
+ * or if sample accuracy is not needed, just the end value can be used.
+ * It describes a piecewise function in three pieces:
+ * from [0, startValue] to [transitionStart, startValue]
+ * from [transitionStart, startValue] to [transitionEnd, endValue]
+ * from [transitionEnd, endValue] to [blockSize, endValue]
+ */
+struct ControlRamp
+{
+public:
+  double startValue;
+  double endValue;
+  int transitionStart;
+  int transitionEnd;
+
+  void Clear()
+  {
+    startValue = endValue = 0.;
+    transitionStart = transitionEnd = 0;
+  }
+
+  bool IsNonzero() const
+  {
+    return (startValue != 0.) || (endValue != 0.);
+  }
+
+  /** @return \c true if the ramp holds one value for the whole block. Then there's no need to Write() it, endValue can be used as is */
+  bool IsConstant() const
+  {
+    return startValue == endValue;
+  }
+
+  /** Writes the ramp signal to an output buffer.
+   * @param buffer Pointer to the start of an output buffer.
+   * @param startIdx Sample index of the start of the desired write within the buffer.
+   * @param nFrames The number of samples to be written. */
+  template <typename T>
+  void Write(T* buffer, int startIdx, int nFrames)
+  {
+    double val = startValue;
+    double dv = transitionEnd > transitionStart ? (endValue - startValue)/(transitionEnd - transitionStart) : 0.;
+    for(int i=startIdx; i<startIdx + transitionStart; ++i)
+    {
+      buffer[i] = (T) val;
+    }
+    for(int i=startIdx + transitionStart; i<startIdx + transitionEnd; ++i)
+    {
+      val += dv;
+      buffer[i] = (T) val;
+    }
+    for(int i=startIdx + transitionEnd; i<startIdx + nFrames; ++i)
+    {
+      buffer[i] = (T) val;
+    }
+  }
+};
+
+struct ControlRampProcessor
+{
+public:
+  // process the glide and write changes to the output ramp.
+  void Process(int blockSize)
+  {
+    // nothing to do while the output is flat
+    if(!mSamplesRemaining && mpOutput->IsConstant())
+      return;
+
+    // always connect with previous block
+    mpOutput->startValue = mpOutput->endValue;
+
+    if(mSamplesRemaining)
+    {
+      if(mSamplesRemaining == mGlideSamples)
+      {
+        // start glide
+        if(mSamplesRemaining > blockSize)
+        {
+          // start with ramp to block end
+          int glideStartSamples = blockSize - mStartOffset;
+          mpOutput->endValue = mpOutput->startValue + glideStartSamples*mChangePerSample;
+          mpOutput->transitionStart = mStartOffset;
+          mpOutput->transitionEnd = blockSize;
+          mSamplesRemaining -= glideStartSamples;
+        }
+        else
+        {
+          // glide starts and finishes within block
+          mpOutput->endValue = mTargetValue;
+          mpOutput->transitionStart = mStartOffset;
+          mpOutput->transitionEnd = mStartOffset + mGlideSamples;
+          mSamplesRemaining = 0;
+        }
+      }
+      else if(mSamplesRemaining > blockSize)
+      {
+        // continue glide
+        mpOutput->endValue = mpOutput->startValue + mChangePerSample*blockSize;
+        mpOutput->transitionStart = 0;
+        mpOutput->transitionEnd = blockSize;
+        mSamplesRemaining -= blockSize;
+      }
+      else
+      {
+        // finish glide
+        mpOutput->endValue = mTargetValue;
+        mpOutput->transitionStart = 0;
+        mpOutput->transitionEnd = mSamplesRemaining;
+        mSamplesRemaining = 0;
+      }
+    }
+  }
+
+  // set the next target for the glide without writing directly to the ramp.
+  void SetTarget(double targetValue, int startOffset, int glideSamples, int blockSize)
+  {
+    mTargetValue = targetValue;
+    if(glideSamples < 1) glideSamples = 1;
+    mGlideSamples = glideSamples;
+    mSamplesRemaining = glideSamples;
+    mChangePerSample = (targetValue - mpOutput->endValue)/glideSamples;
+    mStartOffset = startOffset;
+  }
+
+  ControlRamp* mpOutput {nullptr};
+  double mTargetValue {0.};
+  double mChangePerSample {0.};
+  int mGlideSamples {0};
+  int mSamplesRemaining {0};
+  int mStartOffset {0};
+};
+
+/** A block-sized buffer holding a smoothed version of a control value, such as an IParam, following one of the IParam::ESmoothing policies.
+ * kSmoothLinear uses a ControlRampProcessor to glide to each new target, kSmoothOnePole is an exponential approach with a time constant.
+ * When the value is not moving the buffer is filled with a constant once, and not written again until the target changes. */
+template <typename T>
+class ControlRampBuffer
+{
+public:
+  ControlRampBuffer()
+  {
+    mProcessor.mpOutput = &mRamp;
+  }
+
+  /** Resize the buffer, this should not be called on the audio thread
+   * @param blockSize The maximum number of samples in a block */
+  void Resize(int blockSize)
+  {
+    mBuffer.Resize(blockSize);
+    Reset(mValue);
+  }
+
+  /** Jump to a value without smoothing
+   * @param value The new value */
+  void Reset(double value)
+  {
+    mValue = mTarget = value;
+    mRamp.startValue = mRamp.endValue = value;
+    mRamp.transitionStart = mRamp.transitionEnd = 0;
+    mProcessor.mSamplesRemaining = 0;
+    mMoved = false;
+    mFlat = false;
+  }
+
+  /** Render the smoothed value into the buffer
+   * @param target The value to move toward
+   * @param smoothing The smoothing policy
+   * @param smoothingSamples The linear glide time or one-pole time constant, in samples
+   * @param startIdx Sample index in the buffer to start writing
+   * @param nFrames The number of samples to write */
+  void Process(double target, IParam::ESmoothing smoothing, double smoothingSamples, int startIdx, int nFrames)
+  {
+    if (startIdx + nFrames > mBuffer.GetSize())
+      nFrames = mBuffer.GetSize() - startIdx;
+
+    if (nFrames <= 0)
+      return;
+
+    if (smoothing == IParam::kSmoothNone || smoothingSamples < 1.)
+    {
+      if (target != mValue)
+        Reset(target);
+    }
+    else if (smoothing == IParam::kSmoothLinear)
+    {
+      ProcessLinear(target, static_cast<int>(smoothingSamples), startIdx, nFrames);
+    }
+    else
+    {
+      ProcessOnePole(target, smoothingSamples, startIdx, nFrames);
+    }
+
+    if (!IsSmoothing() && !mFlat)
+    {
+      // fill the whole buffer, so that later sub-blocks can skip writing until the target moves
+      T* pBuffer = mBuffer.Get();
+      const T value = static_cast<T>(mValue);
+      for (int i = 0; i < mBuffer.GetSize(); i++)
+        pBuffer[i] = value;
+      mFlat = true;
+    }
+  }
+
+  /** @return \c true if the value changed during the last call to Process() */
+  bool IsSmoothing() const { return mValue != mTarget || mMoved; }
+
+  /** @return The value at the end of the last call to Process() */
+  double GetValue() const { return mValue; }
+
+  /** @return Pointer to the start of the buffer */
+  const T* Get() const { return mBuffer.Get(); }
+
+  /** @return The memory the buffer holds, in bytes */
+  int64_t GetBytes() const { return static_cast<int64_t>(mBuffer.GetSize()) * sizeof(T); }
+
+private:
+  void ProcessLinear(double target, int glideSamples, int startIdx, int nFrames)
+  {
+    if (target != mTarget)
+    {
+      mTarget = target;
+      mProcessor.SetTarget(target, 0, glideSamples, nFrames);
+    }
+
+    if (!mProcessor.mSamplesRemaining)
+    {
+      mMoved = false;
+      return;
+    }
+
+    mProcessor.Process(nFrames);
+    mRamp.Write(mBuffer.Get(), startIdx, nFrames);
+    mValue = mRamp.endValue;
+    mMoved = true;
+    mFlat = false;
+  }
+
+  void ProcessOnePole(double target, double timeConstantSamples, int startIdx, int nFrames)
+  {
+    mTarget = target;
+
+    if (timeConstantSamples != mTimeConstantSamples)
+    {
+      mTimeConstantSamples = timeConstantSamples;
+      mCoeff = std::exp(-1. / timeConstantSamples);
+    }
+
+    const double threshold = 1e-6 * (1. + std::fabs(target));
+
+    if (std::fabs(mValue - target) <= threshold)
+    {
+      mMoved = mValue != target;
+      mValue = target;
+      if (mMoved) mFlat = false;
+      return;
+    }
+
+    T* pBuffer = mBuffer.Get() + startIdx;
+    double value = mValue;
+    for (int i = 0; i < nFrames; i++)
+    {
+      value = target + mCoeff * (value - target);
+      pBuffer[i] = static_cast<T>(value);
+    }
+
+    mValue = std::fabs(value - target) <= threshold ? target : value;
+    mMoved = true;
+    mFlat = false;
+  }
+
+  WDL_TypedBuf<T> mBuffer;
+  ControlRamp mRamp;
+  ControlRampProcessor mProcessor;
+  double mValue = 0.;
+  double mTarget = 0.;
+  double mCoeff = 0.;
+  double mTimeConstantSamples = 0.;
+  bool mMoved = false;
+  bool mFlat = false;
+};
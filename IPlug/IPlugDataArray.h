@@ -0,0 +1,188 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IPlugDataArray
+ */
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+#include "IPlugStructs.h"
+#include "IPlugTripleBuffer.h"
+
+/** An array of values edited in the user interface and read on the audio thread, such as the steps of a sequencer lane or the points of a drawn wavetable,
+ * for data that would otherwise need an IParam per value. The editor changes the values on the main thread, e.g. through IVMultiSliderControl::AttachDataArray(),
+ * and Publish() hands a copy to the audio thread through an IPlugTripleBuffer, so the audio thread reads a consistent array without locking. The array is saved
+ * in the plug-in's state as one blob, from SerializeState() and UnserializeState(), e.g.
+ * @code
+ * IPlugDataArray<256> mSteps; // a member of the plug-in
+ *
+ * bool SerializeState(IByteChunk& chunk) const override { return SerializeParams(chunk) && mSteps.Serialize(chunk); }
+ * int UnserializeState(const IByteChunk& chunk, int startPos) override { return mSteps.Unserialize(chunk, UnserializeParams(chunk, startPos)); }
+ *
+ * void ProcessBlock(sample** inputs, sample** outputs, int nFrames) override
+ * {
+ *   mSteps.UpdateAudio();
+ *   const float* pSteps = mSteps.GetAudioValues();
+ *   ...
+ * }
+ * @endcode
+ * The values aren't automatable, and the editor shares the array with the processor, so it can't be used by a distributed editor that runs in another process
+ * @tparam N The number of values */
+template <int N>
+class IPlugDataArray
+{
+public:
+  using Values = std::array<float, N>;
+
+  /** @param initial The value every element starts with */
+  IPlugDataArray(float initial = 0.f)
+  : mShared(MakeFilled(initial))
+  {
+    mValues.fill(initial);
+  }
+
+  IPlugDataArray(const IPlugDataArray&) = delete;
+  IPlugDataArray& operator=(const IPlugDataArray&) = delete;
+
+  /** @return The number of values */
+  static constexpr int Size() { return N; }
+
+#pragma mark - Main thread
+
+  /** @param idx The index of a value
+   * @return The value as the editor last set it, which the audio thread has after the next Publish(). Main thread only */
+  float GetValue(int idx) const { return mValues[idx]; }
+
+  /** @return Pointer to the N values, as the editor last set them. Main thread only */
+  const float* GetValues() const { return mValues.data(); }
+
+  /** Set a value, which is marked changed for the editor, and reaches the audio thread at the next Publish(). Main thread only
+   * @param idx The index of the value
+   * @param value The new value */
+  void SetValue(int idx, float value)
+  {
+    if (idx < 0 || idx >= N || mValues[idx] == value)
+      return;
+
+    mValues[idx] = value;
+    MarkChanged(idx, idx + 1);
+  }
+
+  /** Set a run of values, see SetValue(). Main thread only
+   * @param startIdx The index of the first value
+   * @param pValues The values
+   * @param n The number of values, fewer are set if the run goes past the end */
+  void SetValues(int startIdx, const float* pValues, int n)
+  {
+    const int endIdx = std::min(startIdx + n, N);
+
+    if (startIdx < 0 || startIdx >= endIdx)
+      return;
+
+    std::copy(pValues, pValues + (endIdx - startIdx), mValues.begin() + startIdx);
+    MarkChanged(startIdx, endIdx);
+  }
+
+  /** Hand the values to the audio thread, if any changed since the last call. Call this once after a batch of changes, e.g. at the end of a mouse event. Main thread only */
+  void Publish()
+  {
+    if (!mPublishPending)
+      return;
+
+    mShared.Publish(mValues);
+    mPublishPending = false;
+  }
+
+  /** Take the range of values changed since the last call, so that the editor can redraw only those. Changes made by the editor itself are included. Main thread only
+   * @param startIdx Set to the index of the first changed value
+   * @param endIdx Set to one past the index of the last changed value
+   * @return \c true if any values changed */
+  bool TakeChangedRange(int& startIdx, int& endIdx)
+  {
+    if (mChangedStart >= mChangedEnd)
+      return false;
+
+    startIdx = mChangedStart;
+    endIdx = mChangedEnd;
+    mChangedStart = N;
+    mChangedEnd = 0;
+    return true;
+  }
+
+  /** Write the values to a state chunk, as the number of values followed by the values
+   * @param chunk The chunk to append to
+   * @return \c true on success */
+  bool Serialize(IByteChunk& chunk) const
+  {
+    const int32_t n = N;
+    chunk.Put(&n);
+    chunk.PutBytes(mValues.data(), N * static_cast<int>(sizeof(float)));
+    return true;
+  }
+
+  /** Read values written by Serialize(), and publish them. A blob of a different size, saved by another version of the plug-in, sets as many values as both have
+   * @param chunk The chunk to read from
+   * @param startPos The position in the chunk to start reading from, or -1 if an earlier part of the state failed to read
+   * @return The position after the blob, or -1 if it couldn't be read */
+  int Unserialize(const IByteChunk& chunk, int startPos)
+  {
+    int32_t n = 0;
+
+    if (startPos < 0 || (startPos = chunk.Get(&n, startPos)) < 0 || n < 0)
+      return -1;
+
+    const int nRead = std::min<int>(n, N);
+
+    if (chunk.GetBytes(mValues.data(), nRead * static_cast<int>(sizeof(float)), startPos) < 0)
+      return -1;
+
+    MarkChanged(0, N);
+    Publish();
+
+    const int endPos = startPos + n * static_cast<int>(sizeof(float));
+    return endPos <= chunk.Size() ? endPos : -1;
+  }
+
+#pragma mark - Audio thread
+
+  /** Pick up the values published since the last call. Call this at the start of ProcessBlock(). Audio thread only
+   * @return \c true if new values were published */
+  bool UpdateAudio() { return mShared.Update(); }
+
+  /** @return Pointer to the N values as of the last UpdateAudio(). Audio thread only */
+  const float* GetAudioValues() const { return mShared.GetReadBuffer().data(); }
+
+private:
+  static Values MakeFilled(float value)
+  {
+    Values values;
+    values.fill(value);
+    return values;
+  }
+
+  void MarkChanged(int startIdx, int endIdx)
+  {
+    mChangedStart = std::min(mChangedStart, startIdx);
+    mChangedEnd = std::max(mChangedEnd, endIdx);
+    mPublishPending = true;
+  }
+
+  Values mValues; // the main thread's copy
+  IPlugTripleBuffer<Values> mShared;
+  int mChangedStart = 0; // all of them, so that an editor attached to the array first draws every value
+  int mChangedEnd = N;
+  bool mPublishPending = false;
+};
@@ -26,6 +26,9 @@
   #if defined WEBSOCKET_SERVER
     #include "IWebsocketEditorDelegate.h"
     typedef IWebsocketEditorDelegate EDITOR_DELEGATE_CLASS;
+  #elif defined SHM_EDITOR_SERVER
+    #include "ISharedMemoryEditorDelegate.h"
+    typedef ISharedMemoryEditorDelegate EDITOR_DELEGATE_CLASS;
   #else
     #include "IGraphicsEditorDelegate.h"
     typedef IGEditorDelegate EDITOR_DELEGATE_CLASS;
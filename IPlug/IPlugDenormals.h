@@ -0,0 +1,115 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IPlugDenormalGuard
+ */
+
+#include <cstdint>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #include <xmmintrin.h>
+  #define IPLUG_DENORMALS_SSE
+#elif defined(__aarch64__) || defined(_M_ARM64)
+  #if defined(_MSC_VER)
+    #include <intrin.h>
+  #endif
+  #define IPLUG_DENORMALS_ARM64
+#endif
+
+/** Sets flush-to-zero and denormals-are-zero for the enclosing scope, and puts back the floating point environment the host had when it ends.
+ * Filters and reverb tails that decay towards silence end up in denormal numbers, which are many times slower on most CPUs, and hosts don't reliably set these modes for the audio thread.
+ * IPlugProcessor::ProcessBuffers() has one, so all of the processing of a block is covered in every API, see PLUG_FLUSH_DENORMALS.
+ * On x86/x64 this sets the FTZ and DAZ bits of MXCSR, on arm64 the FZ bit of FPCR, which flushes both. Elsewhere, e.g. WebAssembly, it does nothing */
+class IPlugDenormalGuard
+{
+public:
+  /** @param enable \c false to leave the environment as it is */
+  explicit IPlugDenormalGuard(bool enable = true)
+  : mEnabled(enable)
+  {
+    if (!mEnabled)
+      return;
+
+#if defined IPLUG_DENORMALS_SSE
+    mSaved = _mm_getcsr();
+    _mm_setcsr(mSaved | kFTZ | kDAZ);
+#elif defined IPLUG_DENORMALS_ARM64
+    mSaved = GetFPCR();
+    SetFPCR(mSaved | kFZ);
+#endif
+  }
+
+  ~IPlugDenormalGuard()
+  {
+    if (!mEnabled)
+      return;
+
+#if defined IPLUG_DENORMALS_SSE
+    _mm_setcsr(mSaved);
+#elif defined IPLUG_DENORMALS_ARM64
+    SetFPCR(mSaved);
+#endif
+  }
+
+  IPlugDenormalGuard(const IPlugDenormalGuard&) = delete;
+  IPlugDenormalGuard& operator=(const IPlugDenormalGuard&) = delete;
+
+  /** Count the denormal samples in a buffer, e.g. in a plug-in's outputs, to find the DSP that produces them when the modes are off
+   * @param pSrc The samples
+   * @param n The number of samples
+   * @return The number of samples that are denormal */
+  template <typename T>
+  static int CountDenormals(const T* pSrc, int n)
+  {
+    int count = 0;
+
+    for (int i = 0; i < n; i++)
+      count += std::fpclassify(pSrc[i]) == FP_SUBNORMAL;
+
+    return count;
+  }
+
+private:
+#if defined IPLUG_DENORMALS_SSE
+  static constexpr unsigned int kFTZ = 0x8000;
+  static constexpr unsigned int kDAZ = 0x0040;
+  unsigned int mSaved = 0;
+#elif defined IPLUG_DENORMALS_ARM64
+  static constexpr uint64_t kFZ = uint64_t(1) << 24;
+
+  static uint64_t GetFPCR()
+  {
+  #if defined(_MSC_VER)
+    return static_cast<uint64_t>(_ReadStatusReg(ARM64_FPCR));
+  #else
+    uint64_t fpcr;
+    __asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+    return fpcr;
+  #endif
+  }
+
+  static void SetFPCR(uint64_t fpcr)
+  {
+  #if defined(_MSC_VER)
+    _WriteStatusReg(ARM64_FPCR, static_cast<__int64>(fpcr));
+  #else
+    __asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr));
+  #endif
+  }
+
+  uint64_t mSaved = 0;
+#endif
+  const bool mEnabled;
+};
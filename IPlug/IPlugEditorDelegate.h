@@ -18,12 +18,18 @@
 #include <cassert>
 #include <cstring>
 #include <stdint.h>
+#include <algorithm>
+#include <new>
 
 #include "ptrlist.h"
+#include "heapbuf.h"
 
 #include "IPlugParameter.h"
+#include "IPlugParamDesc.h"
 #include "IPlugMidi.h"
 #include "IPlugStructs.h"
+#include "IPlugRunLoop.h"
+#include "IPlugMemoryReport.h"
 
 /** This pure virtual interface delegates communication in both directions between a UI editor and something else (which is usually a plug-in)
  *  It is also the class that owns parameter objects (for historical reasons) - although it's not necessary to allocate them
@@ -47,6 +53,8 @@ class IEditorDelegate
 public:
   IEditorDelegate(int nParams)
   {
+    ReserveParamValues(nParams);
+
     for (int i = 0; i < nParams; i++)
       AddParam();
   }
@@ -59,12 +67,32 @@ public:
   /** Adds an IParam to the parameters ptr list
    * Note: This is only used in special circumstances, since most plug-in formats don't support dynamic parameters
    * @return Ptr to the newly created IParam object */
-  IParam* AddParam() { return mParams.Add(new IParam()); }
+  IParam* AddParam()
+  {
+    if (NParams() >= mParamValuesCapacity)
+      ReserveParamValues(std::max(mParamValuesCapacity * 2, 16));
+
+    IParam* pParam = mParams.Add(new IParam());
+    pParam->SetValueStorage(mParamValues + NParams() - 1);
+    return pParam;
+  }
   
   /** Remove an IParam at a particular index
    * Note: This is only used in special circumstances, since most plug-in formats don't support dynamic parameters
    * @param idx The index of the parameter to remove */
-  void RemoveParam(int idx) { return mParams.Delete(idx); }
+  void RemoveParam(int idx)
+  {
+    mParams.Delete(idx, true);
+
+    // close the gap in the packed values, each value moves down at most one slot so ascending order is safe
+    for (int i = idx; i < NParams(); i++)
+      mParams.Get(i)->SetValueStorage(mParamValues + i);
+  }
+
+  /** Parameter values are stored contiguously, in a cache line aligned array indexed by parameter, with each IParam a view onto its value.
+   * Loops that only need plain (non-normalized) values can read this array directly, rather than visiting every IParam object
+   * @return Pointer to NParams() values */
+  const std::atomic<double>* GetParamValues() const { return mParamValues; }
   
   /** Get a pointer to one of the delegate's IParam objects
    * @param paramIdx The index of the parameter object to be got
@@ -78,10 +106,26 @@ public:
 
   /** @return Returns the number of parameters that belong to the plug-in. */
   int NParams() const { return mParams.GetSize(); }
+
+  /** Initialise the parameters from a constexpr table of descriptions, instead of a call to an Init method for each, see IParamDesc
+   * @param descs The descriptions of the first n parameters
+   * @param n The number of descriptions */
+  void InitParams(const IParamDesc* descs, int n)
+  {
+    assert(n <= NParams());
+
+    for (int i = 0; i < n; i++)
+      GetParam(i)->Init(descs[i]);
+  }
+
+  /** Initialise the parameters from a constexpr table of descriptions, see IParamDesc and IPLUG_CHECK_PARAM_DESCS()
+   * @param descs The table, whose size is the number of parameters it describes */
+  template <int N>
+  void InitParams(const IParamDesc (&descs)[N]) { InitParams(descs, N); }
   
   /** Loops through all parameters, calling SendParameterValueFromDelegate() with the current value of the parameter
    *  This is important when modifying groups of parameters, restoring state and opening the UI, in order to update it with the latest values*/
-  void SendCurrentParamValuesFromDelegate()
+  virtual void SendCurrentParamValuesFromDelegate()
   {
     for (int i = 0; i < NParams(); ++i)
     {
@@ -95,6 +139,25 @@ public:
   /** If you are not using IGraphics you can if you need to free resources etc when the window closes. Call base implementation. */
   virtual void CloseWindow() { OnUIClose(); }
   
+  /** Called by the plug-in API class before OpenWindow(), with the run loop of a host that drives editors from its own UI thread, or nullptr once the window has closed
+   * @param pRunLoop The host's run loop, which outlives the window */
+  void SetHostRunLoop(IPlugRunLoop* pRunLoop) { mHostRunLoop = pRunLoop; }
+  
+  /** @return The host's run loop, or nullptr if the host doesn't provide one, see SetHostRunLoop() */
+  IPlugRunLoop* GetHostRunLoop() const { return mHostRunLoop; }
+  
+  /** Gather the memory this instance holds, by category, and optionally that shared by every instance in the process, see IPlugMemoryReport.h. Call on the main thread
+   * @param report The items are added after any it already holds
+   * @param includeShared Add the items of IMemoryRegistry, such as the StaticStorage caches, in kMemoryShared */
+  void GetMemoryReport(IMemoryReport& report, bool includeShared = true) const
+  {
+    ReportMemory(report);
+    OnReportMemory(report);
+
+    if (includeShared)
+      IMemoryRegistry::Report(report);
+  }
+  
 #pragma mark - Methods you may want to override...
   /** Override this method to do something before the UI is opened. Call base implementation. */
   virtual void OnUIOpen() { SendCurrentParamValuesFromDelegate(); }
@@ -122,6 +185,10 @@ public:
    * If you need to do something when state is restored you can override it
    * If you override this method you should call this parent, or implement the same functionality in order to get controls to update, when state is restored. */
   virtual void OnRestoreState() { SendCurrentParamValuesFromDelegate(); };
+
+  /** Override this method to add the memory your plug-in holds, such as its voices, oversamplers or sample data, to GetMemoryReport(), usually in kMemoryDSP
+   * @param report The report to add items to */
+  virtual void OnReportMemory(IMemoryReport& report) const {}
   
 #pragma mark - Methods for sending values TO the user interface
   /** SendControlValueFromDelegate (Abbreviation: SCVFD)
@@ -249,12 +316,53 @@ public:
   const IByteChunk& GetEditorData() const { return mEditorData; }
   
 protected:
+  /** Add the memory the framework holds for this instance to a report. Each layer, the plug-in, API and editor delegate classes, adds its own and calls its base class
+   * @param report The report to add items to */
+  virtual void ReportMemory(IMemoryReport& report) const
+  {
+    int64_t bytes = mParamValuesBuf.GetSize() + NParams() * static_cast<int64_t>(sizeof(IParam));
+
+    for (int i = 0; i < NParams(); i++)
+      bytes += GetParam(i)->GetAllocatedBytes();
+
+    report.Add(kMemoryParameters, "Parameters", bytes, NParams());
+  }
+
   /** The width of the plug-in editor in pixels. Can be updated by resizing, exists here for persistance, even if UI doesn't exist. */
   int mEditorWidth = 0;
   /** The height of the plug-in editor in pixels. Can be updated by resizing, exists here for persistance, even if UI doesn't exist */
   int mEditorHeight = 0;
   /** Any arbitrary data that the editor need to store (e.g. scale etc.) */
   IByteChunk mEditorData;
+  /** The run loop of a host that drives the editor from its own UI thread, see SetHostRunLoop() */
+  IPlugRunLoop* mHostRunLoop = nullptr;
   /** A list of IParam objects. This list is populated in the delegate constructor depending on the number of parameters passed as an argument to IPLUG_CTOR in the plug-in class implementation constructor */
   WDL_PtrList<IParam> mParams;
+
+private:
+  /** Grow the packed parameter value array, and point every existing IParam at its new slot. Not thread safe, this only happens when parameters are added */
+  void ReserveParamValues(int capacity)
+  {
+    if (capacity <= mParamValuesCapacity)
+      return;
+
+    // park values in the params' own storage while the array is reallocated
+    for (int i = 0; i < NParams(); i++)
+      mParams.Get(i)->SetValueStorage(nullptr);
+
+    mParamValuesBuf.Resize(capacity * sizeof(std::atomic<double>) + PARAM_VALUES_ALIGNMENT, false);
+    mParamValues = (std::atomic<double>*) mParamValuesBuf.GetAligned(PARAM_VALUES_ALIGNMENT);
+
+    for (int i = 0; i < capacity; i++)
+      new (mParamValues + i) std::atomic<double>(0.);
+
+    for (int i = 0; i < NParams(); i++)
+      mParams.Get(i)->SetValueStorage(mParamValues + i);
+
+    mParamValuesCapacity = capacity;
+  }
+
+  WDL_HeapBuf mParamValuesBuf;
+  std::atomic<double>* mParamValues = nullptr;
+  int mParamValuesCapacity = 0;
 };
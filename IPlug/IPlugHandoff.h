@@ -0,0 +1,127 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IPlugHandoff
+ */
+
+#include <atomic>
+#include <memory>
+
+#include "heapbuf.h"
+#include "IPlugQueue.h"
+
+/** The type independent interface of IPlugHandoff, which lets IPlugAPIBase collect retired objects on its timer */
+class IPlugHandoffBase
+{
+public:
+  virtual ~IPlugHandoffBase() {}
+
+  /** Delete the objects the audio thread has retired. Main thread only */
+  virtual void CollectGarbage() = 0;
+};
+
+/** A realtime safe way to hand an object, such as an impulse response or a wavetable, from the main thread (or a worker) to the audio thread,
+ * and to free the object it replaces somewhere other than the audio thread.
+ * Publish() stores the new object in an atomic pointer. At the start of each block the audio thread calls Acquire(), which takes the
+ * newest published object, if any, and retires the one it was using into a lock-free garbage queue. CollectGarbage() deletes retired
+ * objects on the main thread; IPlugAPIBase does this from its timer for handoffs registered with IPlugAPIBase::AttachHandoff().
+ * The audio thread never locks, allocates or frees, and an object is only deleted once the audio thread has stopped using it
+ * @tparam T The type of the object to hand off
+ * @tparam GARBAGE_SIZE The number of retired objects that can wait for collection. If it is full, Acquire() keeps using the current object until it isn't */
+template <typename T, int GARBAGE_SIZE = 16>
+class IPlugHandoff final : public IPlugHandoffBase
+{
+public:
+  IPlugHandoff() {}
+
+  /** IPlugHandoff constructor
+   * @param pInitial The object the audio thread starts with */
+  IPlugHandoff(std::unique_ptr<T> pInitial)
+  : mCurrent(pInitial.release())
+  {
+  }
+
+  IPlugHandoff(const IPlugHandoff&) = delete;
+  IPlugHandoff& operator=(const IPlugHandoff&) = delete;
+
+  /** Deletes every object still owned by the handoff. Make sure the audio thread is no longer using it */
+  ~IPlugHandoff()
+  {
+    T* pPending = mPending.exchange(nullptr);
+
+    if (pPending != NullMarker())
+      delete pPending;
+
+    delete mCurrent;
+    CollectGarbage();
+  }
+
+  /** Hand a new object to the audio thread, which will pick it up at its next Acquire(). Not realtime safe, call from any thread but the audio thread.
+   * If an object published earlier hasn't been picked up yet, it is replaced and deleted here, since the audio thread never saw it
+   * @param pObject The new object, or nullptr to make Acquire() switch to no object */
+  void Publish(std::unique_ptr<T> pObject)
+  {
+    T* pNew = pObject ? pObject.release() : NullMarker();
+    T* pReplaced = mPending.exchange(pNew, std::memory_order_acq_rel);
+
+    if (pReplaced != NullMarker())
+      delete pReplaced;
+  }
+
+  /** Take the most recently published object, retiring the previous one. Audio thread only, call once at the start of each block
+   * @return The object to use for this block, may be nullptr */
+  T* Acquire()
+  {
+    if (mPending.load(std::memory_order_relaxed) && !mGarbage.WasFull())
+    {
+      T* pNew = mPending.exchange(nullptr, std::memory_order_acquire);
+
+      if (pNew)
+      {
+        if (mCurrent)
+          mGarbage.Push(mCurrent);
+
+        mCurrent = pNew == NullMarker() ? nullptr : pNew;
+      }
+    }
+
+    return mCurrent;
+  }
+
+  /** @return The object acquired by the last call to Acquire(). Audio thread only */
+  T* Get() const { return mCurrent; }
+
+  /** @return \c true if an object has been published since the last Acquire(), so that the audio thread can defer Acquire() until it is safe to switch */
+  bool HasPending() const { return mPending.load(std::memory_order_relaxed) != nullptr; }
+
+  void CollectGarbage() override
+  {
+    T* pRetired;
+
+    while (mGarbage.Pop(pRetired))
+      delete pRetired;
+  }
+
+private:
+  /** Published in place of nullptr, so that an empty mPending can mean "nothing new". Never dereferenced */
+  static T* NullMarker()
+  {
+    static char sMarker;
+    return reinterpret_cast<T*>(&sMarker);
+  }
+
+  T* mCurrent = nullptr; // owned by the audio thread
+  std::atomic<T*> mPending {nullptr};
+  IPlugQueue<T*> mGarbage {GARBAGE_SIZE};
+};
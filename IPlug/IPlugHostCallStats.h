@@ -0,0 +1,225 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @brief Histograms of the time the host takes to return from the calls the API classes make to it
+ *
+ * Define IPLUG_HOST_CALL_STATS at project level to enable. Otherwise the markers compile to nothing.
+ * To time a call to the host in an API class:    IPLUG_HOST_CALL_SCOPE(kHostCallPerformEdit);
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include "wdlstring.h"
+
+#include "IPlugLogger.h"
+
+/** The time the host takes in each kind of call the plug-in makes to it, such as beginEdit/performEdit in VST3, AUEventListenerNotify() in AU or SetParameterNormalizedValue() in AAX.
+ * Each kind has a histogram with power of two buckets in microseconds, and a count, total and max, updated with relaxed atomics, so calls can be timed on several threads
+ * and the results read on any, see IPlugAPIBase::GetHostCallStats(). Some hosts block inside these calls, which stalls the UI, and knowing the kinds that take longest shows
+ * where the changes are worth coalescing */
+class IPlugHostCallStats
+{
+public:
+  /** The kinds of call to the host */
+  enum ECall
+  {
+    kHostCallBeginEdit,
+    kHostCallPerformEdit,
+    kHostCallEndEdit,
+    kHostCallGroupEdit, // a batch of changes informed at once, including the calls for each
+    kHostCallParamDetails,
+    kHostCallPresetChange,
+    kHostCallResize,
+    kHostCallLatency,
+    kNHostCalls
+  };
+
+  /** The number of buckets of a histogram. Bucket 0 counts the calls under 1 microsecond, bucket i those under 2^i microseconds and the last all the longer ones */
+  static constexpr int kNBuckets = 18;
+
+  /** Times the enclosing scope, see IPLUG_HOST_CALL_SCOPE */
+  class Scope
+  {
+  public:
+    Scope(IPlugHostCallStats& stats, ECall call)
+    : mStats(stats)
+    , mCall(call)
+    , mStart(std::chrono::steady_clock::now())
+    {
+    }
+
+    ~Scope()
+    {
+      mStats.Add(mCall, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - mStart).count());
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+  private:
+    IPlugHostCallStats& mStats;
+    const ECall mCall;
+    const std::chrono::steady_clock::time_point mStart;
+  };
+
+  IPlugHostCallStats() = default;
+  IPlugHostCallStats(const IPlugHostCallStats&) = delete;
+  IPlugHostCallStats& operator=(const IPlugHostCallStats&) = delete;
+
+  /** Count a call
+   * @param call The kind of call
+   * @param microseconds The time the host took to return */
+  void Add(ECall call, int64_t microseconds)
+  {
+    Histogram& histogram = mHistograms[call];
+    const uint64_t us = static_cast<uint64_t>(std::max<int64_t>(microseconds, 0));
+    int bucket = 0;
+
+    while (bucket < kNBuckets - 1 && us >= (uint64_t(1) << bucket))
+      bucket++;
+
+    histogram.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    histogram.nCalls.fetch_add(1, std::memory_order_relaxed);
+    histogram.totalTime.fetch_add(us, std::memory_order_relaxed);
+
+    uint64_t max = histogram.maxTime.load(std::memory_order_relaxed);
+
+    while (us > max && !histogram.maxTime.compare_exchange_weak(max, us, std::memory_order_relaxed)) {}
+
+    TRACE_COUNTER(GetCallName(call), us);
+  }
+
+  /** Clear the histograms. Calls being counted at the same time may be lost or partly counted */
+  void Reset()
+  {
+    for (Histogram& histogram : mHistograms)
+    {
+      for (auto& bucket : histogram.buckets)
+        bucket.store(0, std::memory_order_relaxed);
+
+      histogram.nCalls.store(0, std::memory_order_relaxed);
+      histogram.totalTime.store(0, std::memory_order_relaxed);
+      histogram.maxTime.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  /** @param call The kind of call
+   * @return The number of calls of the kind since the last Reset() */
+  uint64_t GetNCalls(ECall call) const { return mHistograms[call].nCalls.load(std::memory_order_relaxed); }
+
+  /** @param call The kind of call
+   * @return The mean time the host took, in microseconds */
+  double GetMeanTime(ECall call) const
+  {
+    const uint64_t n = GetNCalls(call);
+    return n ? static_cast<double>(mHistograms[call].totalTime.load(std::memory_order_relaxed)) / n : 0.;
+  }
+
+  /** @param call The kind of call
+   * @return The longest time the host took, in microseconds */
+  uint64_t GetMaxTime(ECall call) const { return mHistograms[call].maxTime.load(std::memory_order_relaxed); }
+
+  /** @param call The kind of call
+   * @param bucket The index of the bucket, less than kNBuckets
+   * @return The number of calls in the bucket, see GetBucketLimit() */
+  uint64_t GetBucketCount(ECall call, int bucket) const { return mHistograms[call].buckets[bucket].load(std::memory_order_relaxed); }
+
+  /** @param bucket The index of the bucket, less than kNBuckets
+   * @return The time in microseconds that the calls in the bucket took less than, or 0 for the last bucket, which has no limit */
+  static uint64_t GetBucketLimit(int bucket) { return bucket < kNBuckets - 1 ? uint64_t(1) << bucket : 0; }
+
+  /** @param call The kind of call
+   * @param fraction The fraction of the calls, e.g. 0.99
+   * @return An estimate of the time in microseconds that the fraction of the calls took less than, the limit of the bucket that it falls in */
+  uint64_t GetPercentile(ECall call, double fraction) const
+  {
+    const uint64_t n = GetNCalls(call);
+    const uint64_t target = static_cast<uint64_t>(fraction * n);
+    uint64_t count = 0;
+
+    for (int i = 0; i < kNBuckets; i++)
+    {
+      count += GetBucketCount(call, i);
+
+      if (count > target)
+        return i < kNBuckets - 1 ? GetBucketLimit(i) : GetMaxTime(call);
+    }
+
+    return GetMaxTime(call);
+  }
+
+  /** @param call The kind of call
+   * @return The name of the kind, for reports and the trace counters */
+  static const char* GetCallName(ECall call)
+  {
+    static const char* names[kNHostCalls] = { "Host begin edit us", "Host perform edit us", "Host end edit us", "Host group edit us",
+                                              "Host param details us", "Host preset change us", "Host resize us", "Host latency us" };
+    return names[call];
+  }
+
+  /** Write the statistics as CSV, one line per kind of call that has been made, with the edges of the buckets as the last columns, and print them with DBGMSG
+   * @param csv Filled with the CSV */
+  void Dump(WDL_String& csv) const
+  {
+    csv.Set("call,count,mean_us,p99_us,max_us");
+
+    for (int i = 0; i < kNBuckets; i++)
+      csv.AppendFormatted(32, i < kNBuckets - 1 ? ",lt_%llu_us" : ",ge_%llu_us", static_cast<unsigned long long>(GetBucketLimit(i < kNBuckets - 1 ? i : i - 1)));
+
+    csv.Append("\n");
+
+    for (int call = 0; call < kNHostCalls; call++)
+    {
+      const ECall c = static_cast<ECall>(call);
+
+      if (!GetNCalls(c))
+        continue;
+
+      csv.AppendFormatted(256, "%s,%llu,%.1f,%llu,%llu", GetCallName(c), static_cast<unsigned long long>(GetNCalls(c)), GetMeanTime(c),
+                          static_cast<unsigned long long>(GetPercentile(c, 0.99)), static_cast<unsigned long long>(GetMaxTime(c)));
+
+      for (int i = 0; i < kNBuckets; i++)
+        csv.AppendFormatted(32, ",%llu", static_cast<unsigned long long>(GetBucketCount(c, i)));
+
+      csv.Append("\n");
+    }
+
+    DBGMSG("%s", csv.Get());
+  }
+
+private:
+  struct Histogram
+  {
+    std::atomic<uint64_t> buckets[kNBuckets] = {};
+    std::atomic<uint64_t> nCalls {0};
+    std::atomic<uint64_t> totalTime {0};
+    std::atomic<uint64_t> maxTime {0};
+  };
+
+  Histogram mHistograms[kNHostCalls];
+};
+
+#define IPLUG_HOST_CALL_CONCAT_(a, b) a##b
+#define IPLUG_HOST_CALL_CONCAT(a, b) IPLUG_HOST_CALL_CONCAT_(a, b)
+
+#ifdef IPLUG_HOST_CALL_STATS
+  #define IPLUG_HOST_CALL_SCOPE(call) IPlugHostCallStats::Scope IPLUG_HOST_CALL_CONCAT(hostCallScope, __LINE__)(GetHostCallStats(), IPlugHostCallStats::call)
+#else
+  #define IPLUG_HOST_CALL_SCOPE(call)
+#endif
@@ -0,0 +1,160 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IPlugLoadMeter
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+/** Measures how much of the time a host's block lasts is spent processing it, for one instance of a plug-in. IPlugProcessor times every call to ProcessBuffers() with one,
+ * except when rendering offline, see IPlugProcessor::GetLoadMeter(). A load of 1 means that processing took as long as the audio it produced, so that the host would drop out
+ * if the plug-in was alone on its thread. The audio thread writes and other threads read the results with relaxed atomics, so reading them, e.g. in a control, never blocks the audio */
+class IPlugLoadMeter
+{
+public:
+  /** The time constant of GetAverageLoad(), in seconds */
+  static constexpr double kAverageTime = 0.3;
+  /** The length of the window of GetPeakLoad(), in seconds */
+  static constexpr double kPeakWindow = 1.0;
+  /** Blocks with more load than this are counted by GetNRiskyBlocks(), as another plug-in on the thread or a busy system could make them drop out */
+  static constexpr double kRiskyLoad = 0.7;
+
+  /** Times the enclosing scope */
+  class Scope
+  {
+  public:
+    /** @param meter The meter to update at the end of the scope
+     * @param nFrames The number of frames processed in the scope
+     * @param sampleRate The sample rate of the frames
+     * @param enabled If \c false nothing is measured, e.g. when rendering offline */
+    Scope(IPlugLoadMeter& meter, int nFrames, double sampleRate, bool enabled)
+    : mMeter(enabled ? &meter : nullptr)
+    , mNFrames(nFrames)
+    , mSampleRate(sampleRate)
+    {
+      if (mMeter)
+        mStart = Clock::now();
+    }
+
+    ~Scope()
+    {
+      if (mMeter)
+        mMeter->Add(std::chrono::duration<double>(Clock::now() - mStart).count(), mNFrames, mSampleRate);
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+  private:
+    IPlugLoadMeter* mMeter;
+    int mNFrames;
+    double mSampleRate;
+    std::chrono::steady_clock::time_point mStart;
+  };
+
+  /** Called on the audio thread with the time that a block took
+   * @param seconds The time spent processing the block
+   * @param nFrames The number of frames in the block
+   * @param sampleRate The sample rate of the block */
+  void Add(double seconds, int nFrames, double sampleRate)
+  {
+    if (nFrames <= 0 || sampleRate <= 0.)
+      return;
+
+    if (mResetRequested.exchange(false, std::memory_order_acquire))
+    {
+      mAverageState = 0.;
+      mWindowPeak = mLastWindowPeak = mWindowTime = 0.;
+      mNBlocks.store(0, std::memory_order_relaxed);
+      mNRisky.store(0, std::memory_order_relaxed);
+      mNOverruns.store(0, std::memory_order_relaxed);
+      mMaxTime.store(0.f, std::memory_order_relaxed);
+    }
+
+    const double budget = nFrames / sampleRate;
+    const double load = seconds / budget;
+
+    // the coefficient depends on the block's duration so that the average decays at the same rate whatever the block size
+    mAverageState += (load - mAverageState) * (1. - std::exp(-budget / kAverageTime));
+    mWindowPeak = std::max(mWindowPeak, load);
+    mWindowTime += budget;
+
+    if (mWindowTime >= kPeakWindow)
+    {
+      mLastWindowPeak = mWindowPeak;
+      mWindowPeak = mWindowTime = 0.;
+    }
+
+    mLoad.store(static_cast<float>(load), std::memory_order_relaxed);
+    mAverage.store(static_cast<float>(mAverageState), std::memory_order_relaxed);
+    mPeak.store(static_cast<float>(std::max(mWindowPeak, mLastWindowPeak)), std::memory_order_relaxed);
+
+    if (static_cast<float>(seconds) > mMaxTime.load(std::memory_order_relaxed))
+      mMaxTime.store(static_cast<float>(seconds), std::memory_order_relaxed);
+
+    mNBlocks.fetch_add(1, std::memory_order_relaxed);
+
+    if (load > kRiskyLoad)
+      mNRisky.fetch_add(1, std::memory_order_relaxed);
+
+    if (load >= 1.)
+      mNOverruns.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /** Clear the counters and averages. This can be called on any thread, and takes effect at the start of the next block */
+  void Reset() { mResetRequested.store(true, std::memory_order_release); }
+
+  /** @return The load of the last block */
+  float GetLoad() const { return mLoad.load(std::memory_order_relaxed); }
+
+  /** @return The load averaged over about kAverageTime */
+  float GetAverageLoad() const { return mAverage.load(std::memory_order_relaxed); }
+
+  /** @return The highest load of a block in the last one or two kPeakWindows */
+  float GetPeakLoad() const { return mPeak.load(std::memory_order_relaxed); }
+
+  /** @return The longest time a block took, in seconds, since the last Reset() */
+  float GetMaxProcessTime() const { return mMaxTime.load(std::memory_order_relaxed); }
+
+  /** @return The number of blocks measured since the last Reset() */
+  uint32_t GetNBlocks() const { return mNBlocks.load(std::memory_order_relaxed); }
+
+  /** @return The number of blocks with a load above kRiskyLoad since the last Reset() */
+  uint32_t GetNRiskyBlocks() const { return mNRisky.load(std::memory_order_relaxed); }
+
+  /** @return The number of blocks that took longer than the audio they produced since the last Reset() */
+  uint32_t GetNOverruns() const { return mNOverruns.load(std::memory_order_relaxed); }
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  // only touched by the audio thread
+  double mAverageState = 0.;
+  double mWindowPeak = 0.;
+  double mLastWindowPeak = 0.;
+  double mWindowTime = 0.;
+
+  std::atomic<bool> mResetRequested {false};
+  std::atomic<float> mLoad {0.f};
+  std::atomic<float> mAverage {0.f};
+  std::atomic<float> mPeak {0.f};
+  std::atomic<float> mMaxTime {0.f};
+  std::atomic<uint32_t> mNBlocks {0};
+  std::atomic<uint32_t> mNRisky {0};
+  std::atomic<uint32_t> mNOverruns {0};
+};
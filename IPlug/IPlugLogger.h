@@ -16,6 +16,10 @@
  *
  * To trace some arbitrary data:                 Trace(TRACELOC, "%s:%d", myStr, myInt);
  * To simply create a trace entry in the log:    TRACE;
+ * To trace the span of the enclosing scope:     TRACE_SCOPE;
+ * To trace a value over time:                   TRACE_COUNTER("voices", nVoices);
+ * Unless TRACETOSTDOUT is defined, entries are recorded by IPlugTraceRecorder, which doesn't lock or allocate, so they can be made on the audio thread,
+ * and are written to TRACEFILE in the home folder. Scripts/trace_to_json.py converts the file, to be viewed in Perfetto or chrome://tracing.
  * No need to wrap tracer calls in #ifdef TRACER_BUILD because Trace is a no-op unless TRACER_BUILD is defined.
  */
 
@@ -44,7 +48,19 @@
 #endif
 
 #if defined TRACER_BUILD
-  #define TRACE Trace(TRACELOC, "");
+  #ifdef TRACETOSTDOUT
+    #define TRACE Trace(TRACELOC, "");
+    #define TRACE_SCOPE TRACE
+    #define TRACE_COUNTER(name, value) Trace(TRACELOC, "%s: %lld", name, (long long) (value));
+  #else
+    #include "IPlugTraceRecorder.h"
+
+    #define TRACE_CONCAT_(a, b) a##b
+    #define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+    #define TRACE IPlugTraceRecorder::Get().Instant(TRACELOC);
+    #define TRACE_SCOPE IPlugTraceScope TRACE_CONCAT(traceScope, __LINE__)(TRACELOC);
+    #define TRACE_COUNTER(name, value) IPlugTraceRecorder::Get().Counter(name, static_cast<int64_t>(value));
+  #endif
 
   #if defined OS_WIN
     #define SYS_THREAD_ID (intptr_t) GetCurrentThreadId()
@@ -54,6 +70,8 @@
 
   #else
     #define TRACE
+    #define TRACE_SCOPE
+    #define TRACE_COUNTER(name, value)
   #endif
 
   #define TRACELOC __FUNCTION__,__LINE__
@@ -94,31 +112,6 @@
 #endif
 #endif
 
-  struct LogFile
-  {
-    FILE* mFP;
-    
-    LogFile()
-    {
-      char logFilePath[100];
-  #ifdef OS_WIN
-      sprintf(logFilePath, "%s/%s", "C:\\", LOGFILE); // TODO: check windows logFilePath
-  #else
-      sprintf(logFilePath, "%s/%s", getenv("HOME"), LOGFILE);
-  #endif
-      mFP = fopen(logFilePath, "w");
-      assert(mFP);
-      
-      DBGMSG("Logging to %s\n", logFilePath);
-    }
-    
-    ~LogFile()
-    {
-      fclose(mFP);
-      mFP = nullptr;
-    }
-  };
-
   static bool IsWhitespace(char c)
   {
     return (c == ' ' || c == '\t' || c == '\n' || c == '\r');
@@ -211,70 +204,22 @@
     return n;
   }
 
-  #define MAX_LOG_LINES 16384
   void Trace(const char* funcName, int line, const char* format, ...)
   {
-    static int sTrace = 0;
-    static int32_t sProcessCount = 0;
-    static int32_t sIdleCount = 0;
+    char str[TXTLEN];
+    VARARGS_TO_STR(str);
 
-    if (sTrace++ < MAX_LOG_LINES)
-    {
-  #ifndef TRACETOSTDOUT
-      static LogFile sLogFile;
-      assert(sLogFile.mFP);
-  #endif
-      static WDL_Mutex sLogMutex;
-      char str[TXTLEN];
-      VARARGS_TO_STR(str);
-      
   #ifdef TRACETOSTDOUT
-      DBGMSG("[%ld:%s:%d]%s", GetOrdinalThreadID(SYS_THREAD_ID), funcName, line, str);
+    static WDL_Mutex sThreadIDMutex;
+    intptr_t threadID;
+    {
+      WDL_MutexLock lock(&sThreadIDMutex);
+      threadID = GetOrdinalThreadID(SYS_THREAD_ID);
+    }
+    DBGMSG("[%ld:%s:%d]%s", (long) threadID, funcName, line, str);
   #else
-      WDL_MutexLock lock(&sLogMutex);
-      intptr_t threadID = GetOrdinalThreadID(SYS_THREAD_ID);
-      
-      if(strstr(funcName, "rocess") || strstr(funcName, "ender")) // These are not typos! by excluding the first character, we can use TRACE; in methods called ProcessXXX or process etc.
-      {
-        if(++sProcessCount > MAX_PROCESS_TRACE_COUNT)
-        {
-          fflush(sLogFile.mFP);
-          return;
-        }
-        else if (sProcessCount == MAX_PROCESS_TRACE_COUNT)
-        {
-          fprintf(sLogFile.mFP, "**************** DISABLING PROCESS TRACING AFTER %d HITS ****************\n\n", sProcessCount);
-          fflush(sLogFile.mFP);
-          return;
-        }
-      }
-      
-#ifdef VST2_API
-      if(strstr(str, "effGetProgram") || strstr(str, "effEditGetRect") || strstr(funcName, "MouseOver"))
-#else
-      if(strstr(funcName, "MouseOver") || strstr(funcName, "idle"))
-#endif
-      {
-        if(++sIdleCount > MAX_IDLE_TRACE_COUNT)
-        {
-          fflush(sLogFile.mFP);
-          return;
-        }
-        else if (sIdleCount == MAX_IDLE_TRACE_COUNT)
-        {
-          fprintf(sLogFile.mFP, "**************** DISABLING IDLE/MOUSEOVER TRACING AFTER %d HITS ****************\n", sIdleCount);
-          fflush(sLogFile.mFP);
-          return;
-        }
-      }
-      
-      if (threadID > 0)
-        fprintf(sLogFile.mFP, "*** -");
-      
-      fprintf(sLogFile.mFP, "[%ld:%s:%d]%s", threadID, funcName, line, str);
-      fflush(sLogFile.mFP);
+    IPlugTraceRecorder::Get().Message(funcName, line, str);
   #endif
-    }
   }
 
   #ifdef VST2_API
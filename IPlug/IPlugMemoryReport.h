@@ -0,0 +1,255 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @brief Accounting of the memory a plug-in instance, and the process, hold in the framework's larger allocations
+ *
+ * IEditorDelegate::GetMemoryReport() fills an IMemoryReport with what one instance holds: its parameters and presets, the queues between the threads sized by
+ * PARAM_TRANSFER_SIZE, MIDI_TRANSFER_SIZE, SYSEX_RING_SIZE and MESSAGE_RING_SIZE, the processor's scratch and block buffers, the editor's own caches while it is open,
+ * and whatever the plug-in adds in IEditorDelegate::OnReportMemory(), such as its voices or oversamplers. Memory shared by every instance in the process,
+ * such as the bitmap, SVG and font caches in StaticStorage, is reported by IMemoryRegistry in the category kMemoryShared, e.g.
+ * @code
+ * IMemoryReport report;
+ * GetMemoryReport(report);
+ * WDL_String str;
+ * report.Format(str);
+ * DBGMSG("%s", str.Get());
+ * @endcode
+ * The sizes are of what the buffers were allocated to hold, not what the allocator rounds them up to, and the report is gathered on the main thread, not the audio thread
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "wdlstring.h"
+
+#include "IPlugPlatform.h"
+
+/** The categories an IMemoryReport totals its items in */
+enum EMemoryCategory
+{
+  kMemoryParameters = 0,
+  kMemoryPresets,
+  kMemoryQueues,
+  kMemoryBuffers,
+  kMemoryDSP,
+  kMemoryGraphics,
+  kMemoryShared,
+  kNumMemoryCategories
+};
+
+/** A list of named allocations, each in an EMemoryCategory, see IEditorDelegate::GetMemoryReport() */
+class IMemoryReport
+{
+public:
+  /** One allocation, or several of the same kind */
+  struct Item
+  {
+    EMemoryCategory category;
+    WDL_String name;
+    int64_t bytes;
+    int count;
+  };
+
+  /** Add an item
+   * @param category The category the item is totalled in
+   * @param name What the memory holds, e.g. "MIDI from editor"
+   * @param bytes The size of the memory
+   * @param count The number of objects it holds, where that is useful, e.g. the number of presets, or 0 */
+  void Add(EMemoryCategory category, const char* name, int64_t bytes, int count = 0)
+  {
+    mItems.push_back({category, WDL_String(name), bytes, count});
+  }
+
+  /** Remove every item */
+  void Clear() { mItems.clear(); }
+
+  /** @param buf A buffer with GetSize() and Get(), such as a WDL_TypedBuf
+   * @return The size of the memory the buffer holds */
+  template <class BUF>
+  static int64_t GetBufferBytes(const BUF& buf) { return static_cast<int64_t>(buf.GetSize()) * static_cast<int64_t>(sizeof(*buf.Get())); }
+
+  /** @return The number of items */
+  int NItems() const { return static_cast<int>(mItems.size()); }
+
+  /** @param idx The index of an item
+   * @return The item */
+  const Item& GetItem(int idx) const { return mItems[idx]; }
+
+  /** @param category A category
+   * @return The bytes of the items in the category */
+  int64_t GetTotal(EMemoryCategory category) const
+  {
+    int64_t total = 0;
+
+    for (const Item& item : mItems)
+    {
+      if (item.category == category)
+        total += item.bytes;
+    }
+
+    return total;
+  }
+
+  /** @param includeShared Include the items in kMemoryShared, which are held once by the process rather than by the instance
+   * @return The bytes of all the items */
+  int64_t GetTotal(bool includeShared = true) const
+  {
+    int64_t total = 0;
+
+    for (const Item& item : mItems)
+    {
+      if (includeShared || item.category != kMemoryShared)
+        total += item.bytes;
+    }
+
+    return total;
+  }
+
+  /** @param category A category
+   * @return Its name, for display */
+  static const char* GetCategoryName(EMemoryCategory category)
+  {
+    static const char* sNames[kNumMemoryCategories] = { "Parameters", "Presets", "Queues", "Buffers", "DSP", "Graphics", "Shared" };
+    return category >= 0 && category < kNumMemoryCategories ? sNames[category] : "";
+  }
+
+  /** Format a size for display
+   * @param bytes The size
+   * @param str Set to e.g. "12.3 KB" */
+  static void FormatBytes(int64_t bytes, WDL_String& str)
+  {
+    if (bytes < 1024)
+      str.SetFormatted(32, "%d B", static_cast<int>(bytes));
+    else if (bytes < 1024 * 1024)
+      str.SetFormatted(32, "%.1f KB", bytes / 1024.);
+    else
+      str.SetFormatted(32, "%.2f MB", bytes / (1024. * 1024.));
+  }
+
+  /** Write the report as text, each category's total followed by its items, then the totals for the instance and with the shared memory.
+   * Items with neither bytes nor a count are left out
+   * @param str Set to the report */
+  void Format(WDL_String& str) const
+  {
+    WDL_String size;
+    str.Set("");
+
+    for (int c = 0; c < kNumMemoryCategories; c++)
+    {
+      const EMemoryCategory category = static_cast<EMemoryCategory>(c);
+
+      if (std::none_of(mItems.begin(), mItems.end(), [category](const Item& item) { return item.category == category && (item.bytes || item.count); }))
+        continue;
+
+      FormatBytes(GetTotal(category), size);
+      str.AppendFormatted(256, "%s: %s\n", GetCategoryName(category), size.Get());
+
+      for (const Item& item : mItems)
+      {
+        if (item.category != category || !(item.bytes || item.count))
+          continue;
+
+        FormatBytes(item.bytes, size);
+
+        if (item.count > 0)
+          str.AppendFormatted(256, "  %s (%d): %s\n", item.name.Get(), item.count, size.Get());
+        else
+          str.AppendFormatted(256, "  %s: %s\n", item.name.Get(), size.Get());
+      }
+    }
+
+    FormatBytes(GetTotal(false), size);
+    str.AppendFormatted(256, "Instance: %s\n", size.Get());
+    FormatBytes(GetTotal(true), size);
+    str.AppendFormatted(256, "With shared: %s\n", size.Get());
+  }
+
+private:
+  std::vector<Item> mItems;
+};
+
+/** The process wide list of memory that isn't owned by a plug-in instance, such as the StaticStorage caches.
+ * Something that holds such memory keeps a Registration for as long as it exists, and its function adds items in kMemoryShared when a report is gathered */
+class IMemoryRegistry
+{
+public:
+  using ReportFunc = std::function<void(IMemoryReport&)>;
+
+  /** Registers a function with the registry until it is destroyed */
+  class Registration
+  {
+  public:
+    /** @param func Called with the report by IMemoryRegistry::Report() */
+    Registration(ReportFunc func)
+    : mFunc(std::move(func))
+    {
+      State& state = GetState();
+      std::lock_guard<std::mutex> lock(state.mutex);
+      mpNext = state.pHead;
+      state.pHead = this;
+    }
+
+    ~Registration()
+    {
+      State& state = GetState();
+      std::lock_guard<std::mutex> lock(state.mutex);
+
+      for (Registration** ppLink = &state.pHead; *ppLink; ppLink = &(*ppLink)->mpNext)
+      {
+        if (*ppLink == this)
+        {
+          *ppLink = mpNext;
+          break;
+        }
+      }
+    }
+
+    Registration(const Registration&) = delete;
+    Registration& operator=(const Registration&) = delete;
+
+  private:
+    friend class IMemoryRegistry;
+    ReportFunc mFunc;
+    Registration* mpNext = nullptr;
+  };
+
+  /** Add the items of every registered function to a report
+   * @param report The report */
+  static void Report(IMemoryReport& report)
+  {
+    State& state = GetState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+
+    for (Registration* pRegistration = state.pHead; pRegistration; pRegistration = pRegistration->mpNext)
+      pRegistration->mFunc(report);
+  }
+
+private:
+  struct State
+  {
+    std::mutex mutex;
+    Registration* pHead = nullptr;
+  };
+
+  // constructed by the first registration, so it outlives the static objects that register
+  static State& GetState()
+  {
+    static State sState;
+    return sState;
+  }
+};
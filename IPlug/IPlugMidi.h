@@ -19,7 +19,9 @@
 #include <cassert>
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
 #include <algorithm>
+#include <vector>
 
 #include "IPlugLogger.h"
 
@@ -640,3 +642,143 @@ protected:
   int mSize, mGrow;
   int mFront, mBack;
 };
+
+/** A fixed capacity alternative to IMidiQueue for the audio thread, which never allocates once constructed.
+  * Add() appends in constant time and only notes whether the messages are still in order. If they aren't, the first Peek() after adding
+  * sorts them, with a stable merge sort into a preallocated scratch buffer, so messages with the same offset keep the order they were added in.
+  * When the buffer is full, a new message is dropped, unless it is a note off, which replaces the newest message that isn't one,
+  * so that notes never get stuck. GetNDropped() counts the messages lost either way
+  * @ingroup IPlugUtilities */
+class IMidiEventBuffer
+{
+public:
+  IMidiEventBuffer(int capacity = 4096)
+  {
+    SetCapacity(capacity);
+  }
+
+  /** Allocates, so call this from a non-realtime thread. Any queued messages are cleared */
+  void SetCapacity(int capacity)
+  {
+    mBuf.assign(std::max(capacity, 1), IMidiMsg());
+    mScratch.assign(mBuf.size(), IMidiMsg());
+    Clear();
+  }
+
+  inline int GetCapacity() const { return static_cast<int>(mBuf.size()); }
+
+  /** Adds a MIDI message at the back of the buffer, see the class description for what happens when the buffer is full */
+  void Add(const IMidiMsg& msg)
+  {
+    if (mBack >= GetCapacity() && mFront > 0)
+      Compact();
+
+    if (mBack >= GetCapacity())
+    {
+      mNDropped++;
+
+      if (!IsNoteOff(msg))
+        return;
+
+      int i = mBack - 1;
+      while (i >= mFront && IsNoteOff(mBuf[i])) --i;
+
+      if (i < mFront) // all note offs, there's nothing to make room with
+        return;
+
+      mBuf[i] = msg;
+      mSorted = false;
+      return;
+    }
+
+    if (mBack > mFront && msg.mOffset < mBuf[mBack - 1].mOffset)
+      mSorted = false;
+
+    mBuf[mBack++] = msg;
+  }
+
+  // Removes the MIDI message at the front of the buffer
+  inline void Remove() { ++mFront; }
+
+  inline bool Empty() const { return mFront == mBack; }
+
+  // Returns the number of MIDI messages in the buffer
+  inline int ToDo() const { return mBack - mFront; }
+
+  // Returns the number of MIDI messages dropped because the buffer was full, since the last ResetNDropped()
+  inline int GetNDropped() const { return mNDropped; }
+  inline void ResetNDropped() { mNDropped = 0; }
+
+  // Returns the message with the earliest offset, without removing it
+  inline const IMidiMsg& Peek()
+  {
+    if (!mSorted)
+      Sort();
+
+    return mBuf[mFront];
+  }
+
+  // Moves the remaining messages to the front, and subtracts nFrames from their offsets
+  inline void Flush(int nFrames)
+  {
+    if (mFront > 0) Compact();
+
+    for (int i = 0; i < mBack; ++i) mBuf[i].mOffset -= nFrames;
+  }
+
+  inline void Clear()
+  {
+    mFront = mBack = 0;
+    mSorted = true;
+  }
+
+private:
+  static bool IsNoteOff(const IMidiMsg& msg)
+  {
+    return msg.StatusMsg() == IMidiMsg::kNoteOff || (msg.StatusMsg() == IMidiMsg::kNoteOn && msg.Velocity() == 0);
+  }
+
+  inline void Compact()
+  {
+    mBack -= mFront;
+    if (mBack > 0) memmove(&mBuf[0], &mBuf[mFront], mBack * sizeof(IMidiMsg));
+    mFront = 0;
+  }
+
+  // bottom up merge sort of [mFront, mBack), ping-ponging between mBuf and mScratch
+  void Sort()
+  {
+    const int n = mBack - mFront;
+    IMidiMsg* pSrc = mBuf.data() + mFront;
+    IMidiMsg* pDst = mScratch.data();
+
+    for (int width = 1; width < n; width *= 2)
+    {
+      for (int lo = 0; lo < n; lo += 2 * width)
+      {
+        const int mid = std::min(lo + width, n);
+        const int hi = std::min(lo + 2 * width, n);
+        int a = lo, b = mid, o = lo;
+
+        while (a < mid && b < hi)
+          pDst[o++] = pSrc[b].mOffset < pSrc[a].mOffset ? pSrc[b++] : pSrc[a++];
+
+        while (a < mid) pDst[o++] = pSrc[a++];
+        while (b < hi) pDst[o++] = pSrc[b++];
+      }
+
+      std::swap(pSrc, pDst);
+    }
+
+    if (pSrc != mBuf.data() + mFront)
+      std::copy(pSrc, pSrc + n, mBuf.data() + mFront);
+
+    mSorted = true;
+  }
+
+  std::vector<IMidiMsg> mBuf;
+  std::vector<IMidiMsg> mScratch;
+  int mFront = 0, mBack = 0;
+  int mNDropped = 0;
+  bool mSorted = true;
+};
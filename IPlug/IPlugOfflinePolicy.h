@@ -0,0 +1,93 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IPlugOfflinePolicy
+ */
+
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/** The settings a plug-in renders with differently when the host renders offline, e.g. while bouncing, where there is no deadline and quality and throughput matter more than the CPU load.
+ * The plug-in registers them in its constructor, with IPlugProcessor::GetOfflinePolicy(), and IPlugProcessor::ProcessBuffers() swaps them in at the start of the first block rendered offline,
+ * and back at the start of the first one rendered in realtime again, so a block is never processed with a mixture of the two, e.g.
+ * @code
+ * GetOfflinePolicy().AddOverSampling(mOverSampler, k16x);
+ * GetOfflinePolicy().Add([this](bool offline) { mSynth.SetNActiveTasks(offline ? 0 : 2); mMeterSender.SetEnabled(!offline); });
+ * @endcode
+ * The swaps run on the audio thread, so they must neither lock nor allocate: an OverSampler's factor up to its maximum, the tasks of a VoiceAllocator set up with SetParallelFor()
+ * for all the cores, an ISender, or a member that ProcessBlock() reads. Anything that changes the latency, such as SetFixedBlockSize(), cannot be swapped, since hosts don't expect the latency to change during a bounce */
+class IPlugOfflinePolicy
+{
+public:
+  /** Changes a setting for offline or realtime rendering, called on the audio thread */
+  using SwapFunc = std::function<void(bool offline)>;
+
+  /** Register a setting. Call in the constructor, not on the audio thread
+   * @param func Applies the offline setting when called with \c true and the realtime one when called with \c false */
+  void Add(SwapFunc func) { mSwaps.push_back(std::move(func)); }
+
+  /** Register a value that ProcessBlock() reads, such as a quality setting. The realtime value is whatever it is when offline rendering starts, and it is put back afterwards
+   * @param value The value, which must outlive the policy
+   * @param offlineValue The value to render offline with */
+  template <typename T>
+  void AddValue(T& value, T offlineValue)
+  {
+    auto pRealtimeValue = std::make_shared<T>(value);
+
+    Add([&value, offlineValue, pRealtimeValue](bool offline) {
+      if (offline)
+      {
+        *pRealtimeValue = value;
+        value = offlineValue;
+      }
+      else
+        value = *pRealtimeValue;
+    });
+  }
+
+  /** Register an OverSampler's factor, switched without a fade since the swap is at a block boundary. Up to the maximum it was created with, so that it doesn't allocate
+   * @param overSampler The OverSampler, which must outlive the policy
+   * @param offlineFactor The factor to render offline with */
+  template <class OVERSAMPLER, typename FACTOR>
+  void AddOverSampling(OVERSAMPLER& overSampler, FACTOR offlineFactor)
+  {
+    auto pRealtimeFactor = std::make_shared<FACTOR>(offlineFactor);
+
+    Add([&overSampler, offlineFactor, pRealtimeFactor](bool offline) {
+      if (offline)
+      {
+        *pRealtimeFactor = OVERSAMPLER::RateToFactor(overSampler.GetRate());
+        overSampler.SetOverSampling(offlineFactor);
+      }
+      else
+        overSampler.SetOverSampling(*pRealtimeFactor);
+    });
+  }
+
+  /** @return \c true if no settings are registered */
+  bool Empty() const { return mSwaps.empty(); }
+
+  /** Apply the offline or realtime settings, see IPlugProcessor::ProcessBuffers()
+   * @param offline \c true to swap in the offline settings */
+  void Apply(bool offline)
+  {
+    for (auto& swap : mSwaps)
+      swap(offline);
+  }
+
+private:
+  std::vector<SwapFunc> mSwaps;
+};
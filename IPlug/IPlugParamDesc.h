@@ -0,0 +1,153 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IParamDesc
+ */
+
+#include <cstddef>
+
+#include "IPlugConstants.h"
+#include "IPlugParameter.h"
+
+/** The display texts of a bool parameter described by IParamDesc::Bool() */
+constexpr const char* kParamDescBoolItems[2] = { "off", "on" };
+
+/** A parameter's description, a literal type so that a plug-in's parameters can be described in a constexpr table, which the compiler checks and puts in read-only data,
+ * rather than built by a series of calls in the constructor. The table is written with the constexpr builders, checked with IPLUG_CHECK_PARAM_DESCS() and applied with
+ * IEditorDelegate::InitParams(), which does no parsing, formatting or variadic calls, and shares the shapes as usual.
+ * @code
+ * constexpr const char* kModeNames[] = { "Clean", "Warm", "Crushed" };
+ *
+ * constexpr IParamDesc kParamDescs[kNumParams] = {
+ *   IParamDesc::Gain("Gain", 0.),
+ *   IParamDesc::Frequency("Cutoff", 1000., 20., 20000.),
+ *   IParamDesc::Enum("Mode", 0, kModeNames),
+ * };
+ *
+ * IPLUG_CHECK_PARAM_DESCS(kParamDescs, kNumParams);
+ *
+ * // in the constructor
+ * InitParams(kParamDescs);
+ * @endcode */
+struct IParamDesc
+{
+  IParam::EParamType type;
+  const char* name;
+  double defaultVal;
+  double minVal;
+  double maxVal;
+  double step;
+  const char* label;
+  int flags;
+  const char* group;
+  IParam::EShapeType shapeType; // kShapeLinear, kShapePowCurve or kShapeExp
+  double shapeArg; // the power of a kShapePowCurve
+  IParam::EParamUnit unit;
+  const char* const* enumItems; // the display texts of a bool or an enum, or nullptr
+  int nEnumItems;
+
+  /** @see IParam::InitDouble() */
+  static constexpr IParamDesc Double(const char* name, double defaultVal, double minVal, double maxVal, double step, const char* label = "", int flags = 0, const char* group = "",
+                                     IParam::EShapeType shapeType = IParam::kShapeLinear, double shapeArg = 1., IParam::EParamUnit unit = IParam::kUnitCustom)
+  {
+    return { IParam::kTypeDouble, name, defaultVal, minVal, maxVal, step, label, flags, group, shapeType, shapeArg, unit, nullptr, 0 };
+  }
+
+  /** @see IParam::InitInt() */
+  static constexpr IParamDesc Int(const char* name, int defaultVal, int minVal, int maxVal, const char* label = "", int flags = 0, const char* group = "")
+  {
+    return { IParam::kTypeInt, name, double(defaultVal), double(minVal), double(maxVal), 1., label, flags | IParam::kFlagStepped, group, IParam::kShapeLinear, 1., IParam::kUnitCustom, nullptr, 0 };
+  }
+
+  /** @see IParam::InitBool(), the display texts are "off" and "on" */
+  static constexpr IParamDesc Bool(const char* name, bool defaultVal, int flags = 0, const char* group = "")
+  {
+    return { IParam::kTypeBool, name, defaultVal ? 1. : 0., 0., 1., 1., "", flags | IParam::kFlagStepped, group, IParam::kShapeLinear, 1., IParam::kUnitCustom, kParamDescBoolItems, 2 };
+  }
+
+  /** @see IParam::InitEnum()
+   * @param items The display texts, one per value, an array with static storage such as a constexpr table */
+  template <size_t N>
+  static constexpr IParamDesc Enum(const char* name, int defaultVal, const char* const (&items)[N], int flags = 0, const char* group = "")
+  {
+    return { IParam::kTypeEnum, name, double(defaultVal), 0., double(N) - 1., 1., "", flags | IParam::kFlagStepped, group, IParam::kShapeLinear, 1., IParam::kUnitCustom, items, int(N) };
+  }
+
+  /** @see IParam::InitGain() */
+  static constexpr IParamDesc Gain(const char* name, double defaultVal = 0., double minVal = -70., double maxVal = 24., double step = 0.5, int flags = 0, const char* group = "")
+  {
+    return Double(name, defaultVal, minVal, maxVal, step, "dB", flags, group, IParam::kShapeLinear, 1., IParam::kUnitDB);
+  }
+
+  /** @see IParam::InitFrequency() */
+  static constexpr IParamDesc Frequency(const char* name, double defaultVal = 1000., double minVal = 0.1, double maxVal = 10000., double step = 0.1, int flags = 0, const char* group = "")
+  {
+    return Double(name, defaultVal, minVal, maxVal, step, "Hz", flags, group, IParam::kShapeExp, 1., IParam::kUnitFrequency);
+  }
+
+  /** @see IParam::InitSeconds() */
+  static constexpr IParamDesc Seconds(const char* name, double defaultVal = 1., double minVal = 0., double maxVal = 10., double step = 0.1, int flags = 0, const char* group = "")
+  {
+    return Double(name, defaultVal, minVal, maxVal, step, "Seconds", flags, group, IParam::kShapeLinear, 1., IParam::kUnitSeconds);
+  }
+
+  /** @see IParam::InitPercentage() */
+  static constexpr IParamDesc Percentage(const char* name, double defaultVal = 0., double minVal = 0., double maxVal = 100., int flags = 0, const char* group = "")
+  {
+    return Double(name, defaultVal, minVal, maxVal, 1., "%", flags, group, IParam::kShapeLinear, 1., IParam::kUnitPercentage);
+  }
+
+  /** @return \c true if the description can be applied: a name, label and group that fit IParam's buffers, a range with the default in it, a positive step,
+   * a shape that suits the range and a display text for each value of an enum */
+  constexpr bool IsValid() const
+  {
+    // single return statements, so that this is constexpr in C++11
+    return name && *name && Length(name) < MAX_PARAM_NAME_LEN && label && Length(label) < MAX_PARAM_LABEL_LEN && group && Length(group) < MAX_PARAM_GROUP_LEN
+        && minVal < maxVal && step > 0. && !(defaultVal < minVal) && !(defaultVal > maxVal)
+        && !(shapeType == IParam::kShapePowCurve && !(shapeArg > 0.)) && !(shapeType == IParam::kShapeExp && !(minVal > 0.))
+        && (shapeType == IParam::kShapeLinear || shapeType == IParam::kShapePowCurve || shapeType == IParam::kShapeExp)
+        && ((type != IParam::kTypeEnum && type != IParam::kTypeBool) || (enumItems && nEnumItems == int(maxVal - minVal) + 1 && EnumItemsValid(0)));
+  }
+
+  /** @param descs A table of descriptions
+   * @param n The number of descriptions
+   * @return The index of the first invalid description, or -1 if they are all valid, see IsValid() */
+  static constexpr int FindInvalid(const IParamDesc* descs, int n)
+  {
+    return FindInvalidFrom(descs, n, 0);
+  }
+
+private:
+  constexpr bool EnumItemsValid(int i) const
+  {
+    return i >= nEnumItems || (enumItems[i] && Length(enumItems[i]) < MAX_PARAM_DISPLAY_LEN && EnumItemsValid(i + 1));
+  }
+
+  static constexpr int FindInvalidFrom(const IParamDesc* descs, int n, int i)
+  {
+    return i >= n ? -1 : !descs[i].IsValid() ? i : FindInvalidFrom(descs, n, i + 1);
+  }
+
+  static constexpr int Length(const char* str, int len = 0)
+  {
+    return str[len] ? Length(str, len + 1) : len;
+  }
+};
+
+/** Check a table of parameter descriptions at compile time: that it describes every parameter, and that each description is valid, see IParamDesc::IsValid()
+ * @param descs The constexpr array of IParamDesc
+ * @param nParams The number of parameters */
+#define IPLUG_CHECK_PARAM_DESCS(descs, nParams) \
+  static_assert(sizeof(descs) / sizeof(descs[0]) == (nParams), "the table must describe every parameter"); \
+  static_assert(IParamDesc::FindInvalid(descs, int(sizeof(descs) / sizeof(descs[0]))) < 0, "a parameter's name, range, default, shape or enum list is invalid, see IParamDesc::IsValid()")
@@ -15,22 +15,17 @@
 
 #include <cstdio>
 #include <algorithm>
+#include <string>
+#include <unordered_map>
+
+#include "mutex.h"
 
 #include "IPlugParameter.h"
+#include "IPlugParamDesc.h"
 #include "IPlugLogger.h"
 
 #pragma mark - Shape
 
-double IParam::ShapeLinear::NormalizedToValue(double value, const IParam& param) const
-{
-  return param.mMin + value * (param.mMax - param.mMin);
-}
-
-double IParam::ShapeLinear::ValueToNormalized(double value, const IParam& param) const
-{
-  return (value - param.mMin) / (param.mMax - param.mMin);
-}
-
 IParam::ShapePowCurve::ShapePowCurve(double shape)
 : mShape(shape)
 {
@@ -46,16 +41,6 @@ IParam::EDisplayType IParam::ShapePowCurve::GetDisplayType() const
   return IParam::kDisplayLinear;
 }
 
-double IParam::ShapePowCurve::NormalizedToValue(double value, const IParam& param) const
-{
-  return param.GetMin() + std::pow(value, mShape) * (param.GetMax() - param.GetMin());
-}
-
-double IParam::ShapePowCurve::ValueToNormalized(double value, const IParam& param) const
-{
-  return std::pow((value - param.GetMin()) / (param.GetMax() - param.GetMin()), 1.0 / mShape);
-}
-
 void IParam::ShapeExp::Init(const IParam& param)
 {
   double min = param.GetMin();
@@ -67,21 +52,92 @@ void IParam::ShapeExp::Init(const IParam& param)
   mMul = std::log(param.GetMax() / min);
 }
 
-double IParam::ShapeExp::NormalizedToValue(double value, const IParam& param) const
+IParam::ShapeTable::ShapeTable(const Shape& shape, int size, bool exact)
+: mShape(shape.Clone())
+, mSize(std::max(size, 1))
+, mExact(exact)
+{
+}
+
+IParam::ShapeTable::ShapeTable(const ShapeTable& other)
+: mShape(other.mShape->Clone())
+, mSize(other.mSize)
+, mExact(other.mExact)
+{
+  mTable = other.mTable;
+}
+
+void IParam::ShapeTable::Init(const IParam& param)
 {
-  return std::exp(mAdd + value * mMul);
+  mShape->Init(param);
+  
+  // one extra point, so that Lookup() can always interpolate to the next entry
+  double* pTable = mTable.Resize(mSize + 1);
+  
+  for (int i = 0; i <= mSize; i++)
+    pTable[i] = mShape->NormalizedToValue((double) i / mSize, param);
+}
+
+bool IParam::ShapeTable::GetSharingKey(WDL_String& key) const
+{
+  WDL_String shapeKey;
+  
+  if (mExact || !mShape->GetSharingKey(shapeKey))
+    return false;
+  
+  key.SetFormatted(shapeKey.GetLength() + 32, "table %d %s", mSize, shapeKey.Get());
+  return true;
+}
+
+double IParam::ShapeTable::NormalizedToValue(double value, const IParam& param) const
+{
+  return mExact ? mShape->NormalizedToValue(value, param) : Lookup(value);
 }
 
-double IParam::ShapeExp::ValueToNormalized(double value, const IParam& param) const
+double IParam::ShapeTable::ValueToNormalized(double value, const IParam& param) const
 {
-  return (std::log(value) - mAdd) / mMul;
+  return mShape->ValueToNormalized(value, param);
+}
+
+/** Process-wide table of shapes that can be shared, so that parameters with the same shape and range, in any plug-in instance, use one Shape object.
+ * Entries are weak, a shape is destroyed when the last parameter using it goes */
+static std::shared_ptr<const IParam::Shape> GetSharedShape(const IParam::Shape& shape, const IParam& param)
+{
+  static WDL_Mutex sMutex;
+  static std::unordered_map<std::string, std::weak_ptr<const IParam::Shape>> sShapes;
+  
+  WDL_String key;
+  
+  if (shape.GetSharingKey(key))
+  {
+    key.AppendFormatted(64, " %.17g %.17g", param.GetMin(), param.GetMax());
+    
+    WDL_MutexLock lock(&sMutex);
+    std::weak_ptr<const IParam::Shape>& entry = sShapes[key.Get()];
+    std::shared_ptr<const IParam::Shape> pShared = entry.lock();
+    
+    if (!pShared)
+    {
+      IParam::Shape* pShape = shape.Clone();
+      pShape->Init(param);
+      pShared.reset(pShape);
+      entry = pShared;
+    }
+    
+    return pShared;
+  }
+  
+  IParam::Shape* pShape = shape.Clone();
+  pShape->Init(param);
+  return std::shared_ptr<const IParam::Shape>(pShape);
 }
 
 #pragma mark -
 
 IParam::IParam()
 {
-  mShape.reset(new ShapeLinear);
+  static const std::shared_ptr<const Shape> sDefaultShape(new ShapeLinear);
+  mShape = sDefaultShape;
   memset(mName, 0, MAX_PARAM_NAME_LEN * sizeof(char));
   memset(mLabel, 0, MAX_PARAM_LABEL_LEN * sizeof(char));
   memset(mParamGroup, 0, MAX_PARAM_LABEL_LEN * sizeof(char));
@@ -151,8 +207,9 @@ void IParam::InitDouble(const char* name, double defaultVal, double minVal, doub
     ;
   }
     
-  mShape.reset(shape.Clone());
-  mShape->Init(*this);
+  mShape = GetSharedShape(shape, *this);
+  mShapeType = mShape->GetShapeType();
+  ResetDisplayCache();
 }
 
 void IParam::InitFrequency(const char *name, double defaultVal, double minVal, double maxVal, double step, int flags, const char *group)
@@ -191,6 +248,23 @@ void IParam::InitAngleDegrees(const char *name, double defaultVal, double minVal
   InitDouble(name, defaultVal, minVal, maxVal, 1, "degrees", flags, group, ShapeLinear(), kUnitDegrees);
 }
 
+void IParam::Init(const IParamDesc& desc)
+{
+  assert(desc.IsValid() && "Invalid parameter description, check the table with IPLUG_CHECK_PARAM_DESCS()");
+
+  if (mType == kTypeNone) mType = desc.type;
+
+  switch (desc.shapeType)
+  {
+    case kShapePowCurve: InitDouble(desc.name, desc.defaultVal, desc.minVal, desc.maxVal, desc.step, desc.label, desc.flags, desc.group, ShapePowCurve(desc.shapeArg), desc.unit); break;
+    case kShapeExp: InitDouble(desc.name, desc.defaultVal, desc.minVal, desc.maxVal, desc.step, desc.label, desc.flags, desc.group, ShapeExp(), desc.unit); break;
+    default: InitDouble(desc.name, desc.defaultVal, desc.minVal, desc.maxVal, desc.step, desc.label, desc.flags, desc.group, ShapeLinear(), desc.unit); break;
+  }
+
+  for (int i = 0; i < desc.nEnumItems; i++)
+    SetDisplayText(i, desc.enumItems[i]);
+}
+
 void IParam::Init(const IParam& p, const char* searchStr, const char* replaceStr, const char* newGroup)
 {
   if (mType == kTypeNone) mType = p.Type();
@@ -216,6 +290,7 @@ void IParam::Init(const IParam& p, const char* searchStr, const char* replaceStr
   }
   
   InitDouble(str.Get(), p.mDefault, p.mMin, p.mMax, p.mStep, p.mLabel, p.mFlags, group.Get(), *p.mShape, p.mUnit, p.mDisplayFunction);
+  SetSmoothing(p.mSmoothing, p.mSmoothingTime);
   
   for (auto i=0; i<p.NDisplayTexts(); i++)
   {
@@ -225,6 +300,29 @@ void IParam::Init(const IParam& p, const char* searchStr, const char* replaceStr
   }
 }
 
+void IParam::CopyDescription(const IParam& p)
+{
+  mType = p.mType;
+  mUnit = p.mUnit;
+  mMin = p.mMin;
+  mMax = p.mMax;
+  mStep = p.mStep;
+  mDefault = p.mDefault;
+  mDisplayPrecision = p.mDisplayPrecision;
+  mFlags = p.mFlags;
+  mSmoothing = p.mSmoothing;
+  mSmoothingTime = p.mSmoothingTime;
+  memcpy(mName, p.mName, sizeof(mName));
+  memcpy(mLabel, p.mLabel, sizeof(mLabel));
+  memcpy(mParamGroup, p.mParamGroup, sizeof(mParamGroup));
+  mShape = p.mShape;
+  mShapeType = p.mShapeType;
+  mDisplayFunction = p.mDisplayFunction;
+  mDisplayTexts = p.mDisplayTexts;
+  Set(mDefault);
+  ResetDisplayCache();
+}
+
 void IParam::SetDisplayText(double value, const char* str)
 {
   int n = mDisplayTexts.GetSize();
@@ -232,6 +330,7 @@ void IParam::SetDisplayText(double value, const char* str)
   DisplayText* pDT = mDisplayTexts.Get() + n;
   pDT->mValue = value;
   strcpy(pDT->mText, str);
+  ResetDisplayCache();
 }
 
 void IParam::GetDisplayForHost(double value, bool normalized, WDL_String& str, bool withDisplayText) const
@@ -244,13 +343,54 @@ void IParam::GetDisplayForHost(double value, bool normalized, WDL_String& str, b
     return;
   }
 
+  char buf[MAX_PARAM_DISPLAY_LEN];
+  GetDisplayForHost(value, false, buf, MAX_PARAM_DISPLAY_LEN, withDisplayText);
+  str.Set(buf);
+}
+
+void IParam::GetDisplayForHost(double value, bool normalized, char* buf, int bufSize, bool withDisplayText) const
+{
+  if (normalized) value = FromNormalized(value);
+
+  if (mDisplayFunction != nullptr)
+  {
+    // display functions may depend on other state, so their output isn't cached
+    WDL_String str;
+    mDisplayFunction(value, str);
+    snprintf(buf, bufSize, "%s", str.Get());
+    return;
+  }
+  
+  const int kind = withDisplayText ? 1 : 0;
+
+  if (!mDisplayCacheLock.test_and_set(std::memory_order_acquire))
+  {
+    if (mDisplayCacheKind != kind || mDisplayCacheValue != value)
+    {
+      FormatDisplay(value, mDisplayCache, MAX_PARAM_DISPLAY_LEN, withDisplayText);
+      mDisplayCacheKind = kind;
+      mDisplayCacheValue = value;
+    }
+    
+    snprintf(buf, bufSize, "%s", mDisplayCache);
+    mDisplayCacheLock.clear(std::memory_order_release);
+    return;
+  }
+  
+  FormatDisplay(value, buf, bufSize, withDisplayText);
+}
+
+void IParam::FormatDisplay(double value, char* buf, int bufSize, bool withDisplayText) const
+{
+  bufSize = std::min(bufSize, MAX_PARAM_DISPLAY_LEN);
+  
   if (withDisplayText)
   {
     const char* displayText = GetDisplayText(value);
 
     if (CStringHasContents(displayText))
     {
-      str.Set(displayText, MAX_PARAM_DISPLAY_LEN);
+      snprintf(buf, bufSize, "%s", displayText);
       return;
     }
   }
@@ -265,17 +405,15 @@ void IParam::GetDisplayForHost(double value, bool normalized, WDL_String& str, b
 
   if (mDisplayPrecision == 0)
   {
-    str.SetFormatted(MAX_PARAM_DISPLAY_LEN, "%d", static_cast<int>(round(displayValue)));
+    snprintf(buf, bufSize, "%d", static_cast<int>(round(displayValue)));
   }
   else if ((mFlags & kFlagSignDisplay) && displayValue)
   {
-    char fmt[16];
-    sprintf(fmt, "%%+.%df", mDisplayPrecision);
-    str.SetFormatted(MAX_PARAM_DISPLAY_LEN, fmt, displayValue);
+    snprintf(buf, bufSize, "%+.*f", mDisplayPrecision, displayValue);
   }
   else
   {
-    str.SetFormatted(MAX_PARAM_DISPLAY_LEN, "%.*f", mDisplayPrecision, displayValue);
+    snprintf(buf, bufSize, "%.*f", mDisplayPrecision, displayValue);
   }
 }
 
@@ -286,7 +424,7 @@ const char* IParam::GetNameForHost() const
 
 const char* IParam::GetLabelForHost() const
 {
-  return (CStringHasContents(GetDisplayText(static_cast<int>(mValue.load())))) ? "" : mLabel;
+  return (CStringHasContents(GetDisplayText(static_cast<int>(mValue->load())))) ? "" : mLabel;
 }
 
 const char* IParam::GetGroupForHost() const
@@ -15,7 +15,9 @@
  * @copydoc IParam
  */
 
+#include <algorithm>
 #include <atomic>
+#include <cmath>
 #include <cstring>
 #include <functional>
 #include <memory>
@@ -24,6 +26,8 @@
 
 #include "IPlugUtilities.h"
 
+struct IParamDesc;
+
 /** IPlug's parameter class */
 class IParam
 {
@@ -49,6 +53,12 @@ public:
     kFlagMeta             = 0x10,
   };
   
+  /** Smoothing policy, used by IPlugProcessor to render a per-sample ramp buffer for the parameter, see IPlugProcessor::GetParamRamp() */
+  enum ESmoothing { kSmoothNone, kSmoothLinear, kSmoothOnePole };
+
+  /** Identifies the built-in shapes, so that FromNormalized() and ToNormalized() can call them directly rather than through the virtual Shape interface */
+  enum EShapeType { kShapeCustom, kShapeLinear, kShapePowCurve, kShapeExp, kShapeTable };
+
   typedef std::function<void(double, WDL_String&)> DisplayFunc;
 
 #pragma mark - Shape
@@ -81,6 +91,16 @@ public:
      * @param param /todo
      * @return double /todo */
     virtual double ValueToNormalized(double value, const IParam& param) const = 0;
+
+    /** Override only in the built-in shapes, custom shapes are always called through the virtual interface
+     * @return The type of the shape */
+    virtual EShapeType GetShapeType() const { return kShapeCustom; }
+
+    /** Shapes with a key are created once per process for each key and parameter range, and shared by every parameter (and plug-in instance) that uses them,
+     * so they must not hold any other state set in Init(). Custom shapes are not shared unless they override this
+     * @param key Set to a string that identifies the shape and its settings
+     * @return \c true if the shape can be shared */
+    virtual bool GetSharingKey(WDL_String& key) const { return false; }
   };
 
   /** Linear parameter shaping */
@@ -88,6 +108,8 @@ public:
   {
     Shape* Clone() const override { return new ShapeLinear(); };
     IParam::EDisplayType GetDisplayType() const override { return kDisplayLinear; }
+    EShapeType GetShapeType() const override { return kShapeLinear; }
+    bool GetSharingKey(WDL_String& key) const override { key.Set("linear"); return true; }
     double NormalizedToValue(double value, const IParam& param) const override;
     double ValueToNormalized(double value, const IParam& param) const override;
   
@@ -100,6 +122,8 @@ public:
     ShapePowCurve(double shape);
     Shape* Clone() const override { return new ShapePowCurve(mShape); };
     IParam::EDisplayType GetDisplayType() const override;
+    EShapeType GetShapeType() const override { return kShapePowCurve; }
+    bool GetSharingKey(WDL_String& key) const override { key.SetFormatted(64, "pow %.17g", mShape); return true; }
     double NormalizedToValue(double value, const IParam& param) const override;
     double ValueToNormalized(double value, const IParam& param) const override;
     
@@ -112,6 +136,8 @@ public:
     void Init(const IParam& param) override;
     Shape* Clone() const override { return new ShapeExp(); };
     IParam::EDisplayType GetDisplayType() const override { return kDisplayLog; }
+    EShapeType GetShapeType() const override { return kShapeExp; }
+    bool GetSharingKey(WDL_String& key) const override { key.Set("exp"); return true; }
     double NormalizedToValue(double value, const IParam& param) const override;
     double ValueToNormalized(double value, const IParam& param) const override;
     
@@ -119,6 +145,36 @@ public:
     double mAdd = 1.0;
   };
 
+  /** Table based parameter shaping. Wraps another shape and samples its NormalizedToValue() into a table when the parameter is initialized,
+   * so that FromNormalized() is a linearly interpolated lookup rather than a call to pow() or exp(). ValueToNormalized() uses the wrapped shape.
+   * In exact mode the wrapped shape is also used for NormalizedToValue(), which is useful for checking the error of the table */
+  struct ShapeTable : public Shape
+  {
+    ShapeTable(const Shape& shape, int size = DEFAULT_SHAPE_TABLE_SIZE, bool exact = false);
+    ShapeTable(const ShapeTable& other);
+    void Init(const IParam& param) override;
+    Shape* Clone() const override { return new ShapeTable(*this); };
+    IParam::EDisplayType GetDisplayType() const override { return mShape->GetDisplayType(); }
+    EShapeType GetShapeType() const override { return mExact ? kShapeCustom : kShapeTable; }
+    bool GetSharingKey(WDL_String& key) const override;
+    double NormalizedToValue(double value, const IParam& param) const override;
+    double ValueToNormalized(double value, const IParam& param) const override;
+    
+    /** Interpolated lookup into the table, without the exact mode check */
+    inline double Lookup(double value) const
+    {
+      const double pos = Clip(value, 0., 1.) * mSize;
+      const int idx = std::min((int) pos, mSize - 1);
+      const double* pTable = mTable.Get();
+      return pTable[idx] + (pos - idx) * (pTable[idx + 1] - pTable[idx]);
+    }
+
+    std::unique_ptr<Shape> mShape;
+    WDL_TypedBuf<double> mTable;
+    int mSize;
+    bool mExact;
+  };
+
 #pragma mark -
 
   IParam();
@@ -231,7 +287,36 @@ public:
    * @param replaceStr /todo
    * @param newGroup /todo */
   void Init(const IParam& p, const char* searchStr = "", const char* replaceStr = "", const char* newGroup = "");
+
+  /** Initialise the parameter from a description in a constexpr table, see IParamDesc
+   * @param desc The description, which must be valid, see IParamDesc::IsValid() */
+  void Init(const IParamDesc& desc);
+
+  /** Copy the description of another parameter as it is, sharing its shape, and set the value to its default. Unlike Init(const IParam&, ...) nothing is
+   * derived again, so this is quick enough for IPluginBase::InitFromPrototype() to describe every parameter of an instance
+   * @param p The parameter to copy */
+  void CopyDescription(const IParam& p);
   
+  /** Set the smoothing policy for this parameter. When set, IPlugProcessor renders a block-sized ramp buffer of the smoothed value before ProcessBlock() is called.
+   * @param smoothing kSmoothLinear glides to a new value over timeMs, kSmoothOnePole uses timeMs as the time constant
+   * @param timeMs The glide time or time constant in milliseconds */
+  void SetSmoothing(ESmoothing smoothing, double timeMs = DEFAULT_SMOOTHING_TIME_MS) { mSmoothing = smoothing; mSmoothingTime = timeMs; }
+
+  /** @return The smoothing policy for this parameter */
+  ESmoothing GetSmoothing() const { return mSmoothing; }
+
+  /** @return The smoothing glide time or time constant in milliseconds */
+  double GetSmoothingTime() const { return mSmoothingTime; }
+
+  /** Move the parameter's value into external storage, so that values of many parameters can be packed together. Not thread safe, used by IEditorDelegate
+   * @param pStorage The new storage for the value, or nullptr to use the parameter's own storage */
+  void SetValueStorage(std::atomic<double>* pStorage)
+  {
+    std::atomic<double>* pNewValue = pStorage ? pStorage : &mOwnValue;
+    pNewValue->store(mValue->load());
+    mValue = pNewValue;
+  }
+
   /** /todo 
    * @param str /todo
    * @return double /todo */
@@ -247,7 +332,18 @@ public:
    * @return double /todo */
   inline double ToNormalized(double nonNormalizedValue) const
   {
-    return Clip(mShape->ValueToNormalized(Constrain(nonNormalizedValue), *this), 0., 1.);
+    const double value = Constrain(nonNormalizedValue);
+    double normalized;
+
+    switch (mShapeType)
+    {
+      case kShapeLinear: normalized = static_cast<const ShapeLinear*>(mShape.get())->ShapeLinear::ValueToNormalized(value, *this); break;
+      case kShapePowCurve: normalized = static_cast<const ShapePowCurve*>(mShape.get())->ShapePowCurve::ValueToNormalized(value, *this); break;
+      case kShapeExp: normalized = static_cast<const ShapeExp*>(mShape.get())->ShapeExp::ValueToNormalized(value, *this); break;
+      default: normalized = mShape->ValueToNormalized(value, *this); break;
+    }
+
+    return Clip(normalized, 0., 1.);
   }
 
   /** /todo 
@@ -255,12 +351,19 @@ public:
    * @return double /todo */
   inline double FromNormalized(double normalizedValue) const
   {
-    return Constrain(mShape->NormalizedToValue(normalizedValue, *this));
+    switch (mShapeType)
+    {
+      case kShapeLinear: return Constrain(static_cast<const ShapeLinear*>(mShape.get())->ShapeLinear::NormalizedToValue(normalizedValue, *this));
+      case kShapePowCurve: return Constrain(static_cast<const ShapePowCurve*>(mShape.get())->ShapePowCurve::NormalizedToValue(normalizedValue, *this));
+      case kShapeExp: return Constrain(static_cast<const ShapeExp*>(mShape.get())->ShapeExp::NormalizedToValue(normalizedValue, *this));
+      case kShapeTable: return Constrain(static_cast<const ShapeTable*>(mShape.get())->Lookup(normalizedValue));
+      default: return Constrain(mShape->NormalizedToValue(normalizedValue, *this));
+    }
   }
 
   /** Sets the parameter value
    * @param value Value to be set. Will be stepped and clamped between \c mMin and \c mMax */
-  void Set(double value) { mValue.store(Constrain(value)); }
+  void Set(double value) { mValue->store(Constrain(value)); }
 
   /** /todo 
    * @param normalizedValue /todo */
@@ -268,10 +371,10 @@ public:
 
   /** /todo 
    * @param str /todo */
-  void SetString(const char* str) { mValue.store(StringToValue(str)); }
+  void SetString(const char* str) { mValue->store(StringToValue(str)); }
 
   /** /todo  */
-  void SetToDefault() { mValue.store(mDefault); }
+  void SetToDefault() { mValue->store(mDefault); }
 
   /** /todo 
    * @param value /todo */
@@ -284,27 +387,27 @@ public:
 
   /** Gets a readable value of the parameter
    * @return Current value of the parameter */
-  double Value() const { return mValue.load(); }
+  double Value() const { return mValue->load(); }
 
   /** Returns the parameter's value as a boolean
    * @return \c true if value >= 0.5, else otherwise */
-  bool Bool() const { return (mValue.load() >= 0.5); }
+  bool Bool() const { return (mValue->load() >= 0.5); }
 
   /** @return Current value of the parameter as an integer */
-  int Int() const { return static_cast<int>(mValue.load()); }
+  int Int() const { return static_cast<int>(mValue->load()); }
   
   /** /todo 
    * @return double /todo */
-  double DBToAmp() const { return ::DBToAmp(mValue.load()); }
+  double DBToAmp() const { return ::DBToAmp(mValue->load()); }
 
   /** /todo 
    * @return double /todo */
-  double GetNormalized() const { return ToNormalized(mValue.load()); }
+  double GetNormalized() const { return ToNormalized(mValue->load()); }
 
   /** /todo 
    * @param display /todo
    * @param withDisplayText /todo */
-  void GetDisplayForHost(WDL_String& display, bool withDisplayText = true) const { GetDisplayForHost(mValue.load(), false, display, withDisplayText); }
+  void GetDisplayForHost(WDL_String& display, bool withDisplayText = true) const { GetDisplayForHost(mValue->load(), false, display, withDisplayText); }
 
   /** /todo 
    * @param value /todo
@@ -313,6 +416,15 @@ public:
    * @param withDisplayText /todo */
   void GetDisplayForHost(double value, bool normalized, WDL_String& display, bool withDisplayText = true) const;
 
+  /** Format the display string for a value into a fixed size buffer, without heap allocation unless the parameter has a DisplayFunc.
+   * The last value formatted is cached per parameter, so hosts polling the display of an unchanged parameter don't reformat it
+   * @param value The value to display
+   * @param normalized \c true if value is normalized
+   * @param buf The output buffer, which is always null terminated
+   * @param bufSize The size of buf, MAX_PARAM_DISPLAY_LEN is always enough
+   * @param withDisplayText \c true to use a display text for the value, if there is one */
+  void GetDisplayForHost(double value, bool normalized, char* buf, int bufSize, bool withDisplayText = true) const;
+
   /** /todo 
    * @return const char* /todo */
   const char* GetNameForHost() const;
@@ -333,6 +445,9 @@ public:
    * @return int /todo */
   int NDisplayTexts() const;
 
+  /** @return The memory the parameter allocates beyond the object itself, for its display texts. The shape, which may be shared, isn't included */
+  int GetAllocatedBytes() const { return mDisplayTexts.GetSize() * static_cast<int>(sizeof(DisplayText)); }
+
   /** /todo 
    * @param value /todo
    * @return const char* /todo */
@@ -387,6 +502,9 @@ public:
    * @return double /todo */
   double GetStep() const { return mStep; }
 
+  /** @return Which of the built-in shapes the parameter has, so that a block of values can be mapped without calling FromNormalized() for each one, e.g. by ModMatrix */
+  EShapeType GetShapeType() const { return mShapeType; }
+
   /** /todo 
    * @return int /todo */
   int GetDisplayPrecision() const {return mDisplayPrecision;}
@@ -432,20 +550,70 @@ private:
 
   EParamType mType = kTypeNone;
   EParamUnit mUnit = kUnitCustom;
-  std::atomic<double> mValue{0.0};
+  std::atomic<double> mOwnValue{0.0};
+  std::atomic<double>* mValue = &mOwnValue; // points into the delegate's packed value array when owned by an IEditorDelegate
   double mMin = 0.0;
   double mMax = 1.0;
   double mStep = 1.0;
   double mDefault = 0.0;
   int mDisplayPrecision = 0;
   int mFlags = 0;
+  ESmoothing mSmoothing = kSmoothNone;
+  double mSmoothingTime = DEFAULT_SMOOTHING_TIME_MS;
 
   char mName[MAX_PARAM_NAME_LEN];
   char mLabel[MAX_PARAM_LABEL_LEN];
   char mParamGroup[MAX_PARAM_GROUP_LEN];
   
-  std::unique_ptr<Shape> mShape;
+  std::shared_ptr<const Shape> mShape; // may be shared with other parameters, see Shape::GetSharingKey()
+  EShapeType mShapeType = kShapeLinear;
   DisplayFunc mDisplayFunction = nullptr;
 
   WDL_TypedBuf<DisplayText> mDisplayTexts;
+
+  /** Format value into buf, without the display function or the cache */
+  void FormatDisplay(double value, char* buf, int bufSize, bool withDisplayText) const;
+
+  /** Invalidate the display cache, when anything that affects formatting changes */
+  void ResetDisplayCache() { mDisplayCacheKind = -1; }
+
+  // cache of the last display string, guarded by a try-lock so a query that finds it busy just skips the cache
+  mutable std::atomic_flag mDisplayCacheLock = ATOMIC_FLAG_INIT;
+  mutable int mDisplayCacheKind = -1; // -1 for empty, otherwise withDisplayText
+  mutable double mDisplayCacheValue = 0.;
+  mutable char mDisplayCache[MAX_PARAM_DISPLAY_LEN];
 } WDL_FIXALIGN;
+
+#pragma mark - Shape
+
+// defined here, so that the direct calls in IParam::FromNormalized() and IParam::ToNormalized() can be inlined
+
+inline double IParam::ShapeLinear::NormalizedToValue(double value, const IParam& param) const
+{
+  return param.mMin + value * (param.mMax - param.mMin);
+}
+
+inline double IParam::ShapeLinear::ValueToNormalized(double value, const IParam& param) const
+{
+  return (value - param.mMin) / (param.mMax - param.mMin);
+}
+
+inline double IParam::ShapePowCurve::NormalizedToValue(double value, const IParam& param) const
+{
+  return param.GetMin() + std::pow(value, mShape) * (param.GetMax() - param.GetMin());
+}
+
+inline double IParam::ShapePowCurve::ValueToNormalized(double value, const IParam& param) const
+{
+  return std::pow((value - param.GetMin()) / (param.GetMax() - param.GetMin()), 1.0 / mShape);
+}
+
+inline double IParam::ShapeExp::NormalizedToValue(double value, const IParam& param) const
+{
+  return std::exp(mAdd + value * mMul);
+}
+
+inline double IParam::ShapeExp::ValueToNormalized(double value, const IParam& param) const
+{
+  return (std::log(value) - mAdd) / mMul;
+}
@@ -16,6 +16,8 @@
 #include "IPlugPlatform.h"
 #include "IPlugConstants.h"
 #include "IPlugPaths.h"
+#include "IPlugResourceIndex.h"
+#include "IPlugResourceArchive.h"
 
 #ifdef OS_WIN
 #include <windows.h>
@@ -171,6 +173,32 @@ EResourceLocation LocateResource(const char* name, const char* type, WDL_String&
 
     HMODULE hInstance = static_cast<HMODULE>(pHInstance);
 
+    // the archive is beside the binary, or in the bundle's resources for VST3
+    if (!IPlugResourceArchive::Get().WasOpened())
+    {
+      WDL_String archivePath;
+#ifdef VST3_API
+      BundleResourcePath(archivePath, pHInstance);
+#else
+      GetModulePath(hInstance, archivePath);
+#endif
+      archivePath.Append(IPlugResourceArchive::kFileName);
+      IPlugResourceArchive::Get().Open(archivePath.Get());
+    }
+
+    if (IPlugResourceArchive::Get().Contains(name))
+    {
+      result.Set(name);
+      return EResourceLocation::kPackedArchive;
+    }
+
+    // an indexed resource is in the binary under its name, so the binary's resources needn't be enumerated
+    if (IPlugResourceIndex::Get().Find(name))
+    {
+      result.SetFormatted(MAX_PATH, "\"%s\"", strlwr(search.Get()));
+      return EResourceLocation::kWinBinary;
+    }
+
     EnumResourceNames(hInstance, _strupr(typeUpper.Get()), (ENUMRESNAMEPROC)EnumResNameProc, (LONG_PTR)&search);
 
     if (strstr(search.Get(), "found: ") != 0)
@@ -222,6 +250,167 @@ const void* LoadWinResource(const char* resid, const char* type, int& sizeInByte
   }
 }
 
+#elif defined OS_LINUX
+#include <dlfcn.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Helper for getting the folder of a path, with its trailing slash
+static void GetFolder(const char* filePath, WDL_String& path)
+{
+  path.Set(filePath);
+  const char* pSlash = strrchr(path.Get(), '/');
+  path.SetLen(pSlash ? static_cast<int>(pSlash - path.Get()) + 1 : 0);
+}
+
+// Helper for getting an XDG base directory in UTF8, or its default beneath the user's home folder
+static void GetXDGFolder(WDL_String& path, const char* envName, const char* homeDefault)
+{
+  const char* pEnv = getenv(envName);
+
+  if (CStringHasContents(pEnv))
+    path.Set(pEnv);
+  else
+  {
+    UserHomePath(path);
+    path.Append(homeDefault);
+  }
+}
+
+static bool FileExists(const char* path)
+{
+  struct stat st;
+  return stat(path, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+void HostPath(WDL_String& path, const char* bundleID)
+{
+  char pathCStr[PATH_MAX];
+  const ssize_t len = readlink("/proc/self/exe", pathCStr, PATH_MAX - 1);
+  pathCStr[len > 0 ? len : 0] = '\0';
+  GetFolder(pathCStr, path);
+}
+
+void PluginPath(WDL_String& path, void* pExtra)
+{
+  // the shared object that contains this function is the plug-in's
+  Dl_info info;
+
+  if (dladdr((void*) &PluginPath, &info) && info.dli_fname)
+    GetFolder(info.dli_fname, path);
+  else
+    path.Set("");
+}
+
+void BundleResourcePath(WDL_String& path, void* pExtra)
+{
+#ifdef VST3_API
+  PluginPath(path, pExtra);
+  path.SetLen(path.GetLength() - static_cast<int>(strlen("x86_64-linux/")));
+  path.Append("Resources/");
+#else
+  PluginPath(path, pExtra);
+  path.Append("Resources/");
+#endif
+}
+
+void DesktopPath(WDL_String& path)
+{
+  UserHomePath(path);
+  path.Append("/Desktop");
+}
+
+void UserHomePath(WDL_String& path)
+{
+  const char* pHome = getenv("HOME");
+  path.Set(pHome ? pHome : "");
+}
+
+void AppSupportPath(WDL_String& path, bool isSystem)
+{
+  if (isSystem)
+    path.Set("/usr/share");
+  else
+    GetXDGFolder(path, "XDG_DATA_HOME", "/.local/share");
+}
+
+void VST3PresetsPath(WDL_String& path, const char* mfrName, const char* pluginName, bool isSystem)
+{
+  if (!isSystem)
+  {
+    UserHomePath(path);
+    path.Append("/.vst3/presets");
+  }
+  else
+    path.Set("/usr/share/vst3/presets");
+
+  path.AppendFormatted(PATH_MAX, "/%s/%s", mfrName, pluginName);
+}
+
+void SandboxSafeAppSupportPath(WDL_String& path)
+{
+  AppSupportPath(path);
+}
+
+void INIPath(WDL_String& path, const char * pluginName)
+{
+  GetXDGFolder(path, "XDG_CONFIG_HOME", "/.config");
+
+  path.AppendFormatted(PATH_MAX, "/%s", pluginName);
+}
+
+EResourceLocation LocateResource(const char* name, const char* type, WDL_String& result, const char*, void* pHInstance)
+{
+  if (CStringHasContents(name))
+  {
+    // resources are copied to the bundle's Resources folder, as on macOS
+    WDL_String resourcePath;
+    BundleResourcePath(resourcePath, pHInstance);
+
+    if (!IPlugResourceArchive::Get().WasOpened())
+    {
+      WDL_String archivePath(resourcePath.Get());
+      archivePath.Append(IPlugResourceArchive::kFileName);
+      IPlugResourceArchive::Get().Open(archivePath.Get());
+    }
+
+    if (IPlugResourceArchive::Get().Contains(name))
+    {
+      result.Set(name);
+      return EResourceLocation::kPackedArchive;
+    }
+
+    // an indexed resource is at its path within the folder, or beside it for an image's scaled file
+    if (const IPlugResourceIndex::Entry* pEntry = IPlugResourceIndex::Get().Find(name))
+    {
+      WDL_String folder(pEntry->path);
+      const char* pSlash = strrchr(folder.Get(), '/');
+      folder.SetLen(pSlash ? static_cast<int>(pSlash - folder.Get()) + 1 : 0);
+      result.SetFormatted(PATH_MAX, "%s%s%s", resourcePath.Get(), folder.Get(), name);
+      return EResourceLocation::kAbsolutePath;
+    }
+
+    if (FileExists(name))
+    {
+      result.Set(name);
+      return EResourceLocation::kAbsolutePath;
+    }
+
+    const char* subFolders[] = { "", "img/", "fonts/" };
+
+    for (const char* subFolder : subFolders)
+    {
+      result.SetFormatted(PATH_MAX, "%s%s%s", resourcePath.Get(), subFolder, name);
+
+      if (FileExists(result.Get()))
+        return EResourceLocation::kAbsolutePath;
+    }
+  }
+  result.Set("");
+  return EResourceLocation::kNotFound;
+}
+
 #elif defined OS_WEB
 
 void AppSupportPath(WDL_String& path, bool isSystem)
@@ -260,7 +449,11 @@ EResourceLocation LocateResource(const char* name, const char* type, WDL_String&
     
     if(strcmp(type, "png") == 0) { //TODO: lowercase/uppercase png
       plusSlash.SetFormatted(strlen("/resources/img/") + strlen(name) + 1, "/resources/img/%s", name);
-      foundResource = val::global("Module")["preloadedImages"].call<bool>("hasOwnProperty", std::string(plusSlash.Get()));
+      val preloadedImages = val::global("Module")["preloadedImages"];
+      val resources = val::global("IPlugResources");
+      // images are either in the preloaded bundle, or listed in the manifest of images that are streamed on demand, see IPlugResources.js
+      foundResource = (!preloadedImages.isUndefined() && preloadedImages.call<bool>("hasOwnProperty", std::string(plusSlash.Get())))
+                   || (!resources.isUndefined() && resources["manifest"].call<bool>("hasOwnProperty", std::string(plusSlash.Get())));
     }
     else if(strcmp(type, "ttf") == 0) { //TODO: lowercase/uppercase ttf
       plusSlash.SetFormatted(strlen("/resources/fonts/") + strlen(name) + 1, "/resources/fonts/%s", name);
@@ -15,6 +15,7 @@
 
 
 #include "IPlugPaths.h"
+#include "IPlugResourceArchive.h"
 
 #ifdef OS_MAC
 void HostPath(WDL_String& path, const char* bundleID)
@@ -184,10 +185,35 @@ bool GetResourcePathFromSharedLocation(const char* fileName, const char* searchE
   }
 }
 
+// Look for a resource in the archive in the bundle's resources, which is mapped the first time
+static bool FindInResourceArchive(const char* name, WDL_String& result, const char* bundleID)
+{
+  if (!IPlugResourceArchive::Get().WasOpened())
+  {
+    WDL_String archivePath;
+
+    if (GetResourcePathFromBundle(IPlugResourceArchive::kFileName, "pak", archivePath, bundleID))
+      IPlugResourceArchive::Get().Open(archivePath.Get());
+    else
+      IPlugResourceArchive::Get().Open("");
+  }
+
+  if (IPlugResourceArchive::Get().Contains(name))
+  {
+    result.Set(name);
+    return true;
+  }
+
+  return false;
+}
+
 EResourceLocation LocateResource(const char* name, const char* type, WDL_String& result, const char* bundleID, void*)
 {
   if(CStringHasContents(name))
   {
+    if(FindInResourceArchive(name, result, bundleID))
+      return EResourceLocation::kPackedArchive;
+
     // first check this bundle
     if(GetResourcePathFromBundle(name, type, result, bundleID))
       return EResourceLocation::kAbsolutePath;
@@ -234,10 +260,35 @@ void INIPath(WDL_String& path, const char* pluginName)
   path.Set("");
 }
 
+// Look for a resource in the archive in the bundle's resources, which is mapped the first time
+static bool FindInResourceArchive(const char* name, WDL_String& result, const char* bundleID)
+{
+  if (!IPlugResourceArchive::Get().WasOpened())
+  {
+    WDL_String archivePath;
+
+    if (GetResourcePathFromBundle(IPlugResourceArchive::kFileName, "pak", archivePath, bundleID))
+      IPlugResourceArchive::Get().Open(archivePath.Get());
+    else
+      IPlugResourceArchive::Get().Open("");
+  }
+
+  if (IPlugResourceArchive::Get().Contains(name))
+  {
+    result.Set(name);
+    return true;
+  }
+
+  return false;
+}
+
 EResourceLocation LocateResource(const char* name, const char* type, WDL_String& result, const char* bundleID, void*)
 {
   if(CStringHasContents(name))
   {
+    if(FindInResourceArchive(name, result, bundleID))
+      return EResourceLocation::kPackedArchive;
+
     if(GetResourcePathFromBundle(name, type, result, bundleID))
       return EResourceLocation::kAbsolutePath;
   }
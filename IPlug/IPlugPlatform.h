@@ -45,9 +45,10 @@
 #include <cstdlib>
 
 #ifdef PARAMS_MUTEX
-  #define ENTER_PARAMS_MUTEX mParams_mutex.Enter(); Trace(TRACELOC, "%s", "ENTER_PARAMS_MUTEX")
+  // IPLUG_CHECK_NOT_REALTIME is defined in IPlugRealtimeCheck.h
+  #define ENTER_PARAMS_MUTEX IPLUG_CHECK_NOT_REALTIME("ENTER_PARAMS_MUTEX"); mParams_mutex.Enter(); Trace(TRACELOC, "%s", "ENTER_PARAMS_MUTEX")
   #define LEAVE_PARAMS_MUTEX mParams_mutex.Leave(); Trace(TRACELOC, "%s", "LEAVE_PARAMS_MUTEX")
-  #define ENTER_PARAMS_MUTEX_STATIC _this->mParams_mutex.Enter(); Trace(TRACELOC, "%s", "ENTER_PARAMS_MUTEX")
+  #define ENTER_PARAMS_MUTEX_STATIC IPLUG_CHECK_NOT_REALTIME("ENTER_PARAMS_MUTEX"); _this->mParams_mutex.Enter(); Trace(TRACELOC, "%s", "ENTER_PARAMS_MUTEX")
   #define LEAVE_PARAMS_MUTEX_STATIC _this->mParams_mutex.Leave(); Trace(TRACELOC, "%s", "LEAVE_PARAMS_MUTEX")
 #else
   #define ENTER_PARAMS_MUTEX
@@ -13,13 +13,21 @@
  * @brief IPluginBase implementation
  */
 
+#include <memory>
+#include <unordered_map>
+
 #include "IPlugPluginBase.h"
+#include "mutex.h"
 #include "wdlendian.h"
 #include "wdl_base64.h"
 
 IPluginBase::IPluginBase(int nParams, int nPresets)
 : EDITOR_DELEGATE_CLASS(nParams)
-{  
+{
+  // detect the CPU and create the kernel dispatches here, rather than on their first use on the audio thread, see IPlugCPU.h
+  IPlugCPU::ResolveDispatchers();
+  ISampleKernels::GetDispatch();
+
 #ifndef NO_PRESETS
   for (int i = 0; i < nPresets; ++i)
     mPresets.Add(new IPreset());
@@ -28,6 +36,8 @@ IPluginBase::IPluginBase(int nParams, int nPresets)
 
 IPluginBase::~IPluginBase()
 {
+  CancelBackgroundJobs();
+  
 #ifndef NO_PRESETS
   mPresets.Empty(true);
 #endif
@@ -77,6 +87,7 @@ const char* IPluginBase::GetAPIStr() const
     case kAPIAPP: return "Standalone";
     case kAPIWAM: return "WAM";
     case kAPIWEB: return "WEB";
+    case kAPICLAP: return "CLAP";
     default: return "";
   }
 }
@@ -106,6 +117,12 @@ void IPluginBase::OnParamChange(int paramIdx, EParamSource source, int sampleOff
   OnParamChange(paramIdx);
 }
 
+void IPluginBase::OnParamChanges(const IParamChange* pChanges, int nChanges, EParamSource source)
+{
+  for (int i = 0; i < nChanges; ++i)
+    OnParamChange(pChanges[i].paramIdx, source);
+}
+
 void IPluginBase::OnParamReset(EParamSource source)
 {
   for (int i = 0; i < NParams(); ++i)
@@ -117,34 +134,129 @@ void IPluginBase::OnParamReset(EParamSource source)
 
 #pragma mark -
 
+static constexpr int32_t kLargeStateMagic = 'IPLS';
+static constexpr int32_t kLargeStateVersion = 1;
+
+bool IPluginBase::WriteLargeState(IStateWriter& writer) const
+{
+  const int32_t compression = mLargeStateCompression;
+
+  if (!writer.Put(kLargeStateMagic) || !writer.Put(kLargeStateVersion) || !writer.Put(compression))
+    return false;
+
+  if (compression <= 0)
+    return SerializeLargeState(writer);
+
+  IStateCompressedWriter compressedWriter(writer, compression);
+  return SerializeLargeState(compressedWriter) && compressedWriter.Finish();
+}
+
+bool IPluginBase::ReadLargeState(IStateReader& reader)
+{
+  int32_t magic = 0, version = 0, compression = 0;
+
+  if (!reader.Get(magic) || magic != kLargeStateMagic || !reader.Get(version) || version > kLargeStateVersion || !reader.Get(compression))
+    return false;
+
+  if (compression <= 0)
+    return UnserializeLargeState(reader);
+
+  IStateCompressedReader compressedReader(reader);
+  return UnserializeLargeState(compressedReader);
+}
+
 bool IPluginBase::SerializeParams(IByteChunk& chunk) const
 {
   TRACE;
+  
+  if (mSparseParamChunks)
+    return SerializeParamsSparse(chunk);
+  
   bool savedOK = true;
   int i, n = mParams.GetSize();
+  const std::atomic<double>* pValues = GetParamValues();
   for (i = 0; i < n && savedOK; ++i)
   {
-    IParam* pParam = mParams.Get(i);
-    Trace(TRACELOC, "%d %s %f", i, pParam->GetNameForHost(), pParam->Value());
-    double v = pParam->Value();
+    double v = pValues[i].load();
+    Trace(TRACELOC, "%d %s %f", i, mParams.Get(i)->GetNameForHost(), v);
     savedOK &= (chunk.Put(&v) > 0);
   }
   return savedOK;
 }
 
+bool IPluginBase::SerializeParamsSparse(IByteChunk& chunk, const double* pBaseline) const
+{
+  TRACE;
+  const int n = mParams.GetSize();
+  const std::atomic<double>* pValues = GetParamValues();
+  
+  uint64_t magic = SPARSE_PARAMS_MAGIC;
+  int version = SPARSE_PARAMS_VERSION;
+  int isDelta = pBaseline ? 1 : 0;
+  int nChanged = 0;
+  
+  for (int i = 0; i < n; ++i)
+  {
+    if (pValues[i].load() != (pBaseline ? pBaseline[i] : mParams.Get(i)->GetDefault()))
+      nChanged++;
+  }
+  
+  bool savedOK = chunk.Put(&magic) > 0;
+  savedOK &= chunk.Put(&version) > 0;
+  savedOK &= chunk.Put(&isDelta) > 0;
+  savedOK &= chunk.Put(&nChanged) > 0;
+  
+  for (int i = 0; i < n && savedOK; ++i)
+  {
+    double v = pValues[i].load();
+    
+    if (v != (pBaseline ? pBaseline[i] : mParams.Get(i)->GetDefault()))
+    {
+      Trace(TRACELOC, "%d %s %f", i, mParams.Get(i)->GetNameForHost(), v);
+      savedOK &= (chunk.Put(&i) > 0);
+      savedOK &= (chunk.Put(&v) > 0);
+    }
+  }
+  
+  return savedOK;
+}
+
+int IPluginBase::GetParamsChunkSize() const
+{
+  const int n = mParams.GetSize();
+  
+  if (mSparseParamChunks)
+    return (int) sizeof(uint64_t) + 3 * (int) sizeof(int) + n * (int) (sizeof(int) + sizeof(double));
+  
+  return n * (int) sizeof(double);
+}
+
+void IPluginBase::SnapshotParamValues(WDL_TypedBuf<double>& values) const
+{
+  const int n = mParams.GetSize();
+  const std::atomic<double>* pValues = GetParamValues();
+  double* pDest = values.Resize(n);
+  
+  for (int i = 0; i < n; ++i)
+    pDest[i] = pValues[i].load();
+}
+
+bool IPluginBase::IsSparseParamChunk(const IByteChunk& chunk, int startPos)
+{
+  uint64_t magic = 0;
+  return chunk.Get(&magic, startPos) > startPos && magic == SPARSE_PARAMS_MAGIC;
+}
+
 int IPluginBase::UnserializeParams(const IByteChunk& chunk, int startPos)
 {
   TRACE;
-  int i, n = mParams.GetSize(), pos = startPos;
   ENTER_PARAMS_MUTEX;
-  for (i = 0; i < n && pos >= 0; ++i)
-  {
-    IParam* pParam = mParams.Get(i);
-    double v = 0.0;
-    pos = chunk.Get(&v, pos);
+  
+  int pos = ReadParamValues(chunk, startPos, [&](int paramIdx, double v) {
+    IParam* pParam = mParams.Get(paramIdx);
     pParam->Set(v);
-    Trace(TRACELOC, "%d %s %f", i, pParam->GetNameForHost(), pParam->Value());
-  }
+    Trace(TRACELOC, "%d %s %f", paramIdx, pParam->GetNameForHost(), pParam->Value());
+  });
 
   OnParamReset(kPresetRecall);
 
@@ -152,6 +264,55 @@ int IPluginBase::UnserializeParams(const IByteChunk& chunk, int startPos)
   return pos;
 }
 
+int IPluginBase::UnserializeParamValues(const IByteChunk& chunk, int startPos, WDL_TypedBuf<double>& values) const
+{
+  SnapshotParamValues(values);
+  double* pValues = values.Get();
+  
+  return ReadParamValues(chunk, startPos, [pValues](int paramIdx, double v) { pValues[paramIdx] = v; });
+}
+
+int IPluginBase::ReadParamValues(const IByteChunk& chunk, int startPos, const std::function<void(int paramIdx, double value)>& func) const
+{
+  int i, n = mParams.GetSize(), pos = startPos;
+  
+  if (IsSparseParamChunk(chunk, pos))
+  {
+    int version = 0, isDelta = 0, nChanged = 0;
+    pos = chunk.Get(&version, pos + (int) sizeof(uint64_t));
+    pos = chunk.Get(&isDelta, pos);
+    pos = chunk.Get(&nChanged, pos);
+    
+    if (pos >= 0 && !isDelta)
+    {
+      for (i = 0; i < n; ++i)
+        func(i, mParams.Get(i)->GetDefault());
+    }
+    
+    for (int c = 0; c < nChanged && pos >= 0; ++c)
+    {
+      int paramIdx = -1;
+      double v = 0.0;
+      pos = chunk.Get(&paramIdx, pos);
+      pos = chunk.Get(&v, pos);
+      
+      if (pos >= 0 && paramIdx >= 0 && paramIdx < n)
+        func(paramIdx, v);
+    }
+  }
+  else
+  {
+    for (i = 0; i < n && pos >= 0; ++i)
+    {
+      double v = 0.0;
+      pos = chunk.Get(&v, pos);
+      func(i, v);
+    }
+  }
+  
+  return pos;
+}
+
 void IPluginBase::InitParamRange(int startIdx, int endIdx, int countStart, const char* nameFmtStr, double defaultVal, double minVal, double maxVal, double step, const char *label, int flags, const char *group, const IParam::Shape& shape, IParam::EParamUnit unit, IParam::DisplayFunc displayFunc)
 {
   WDL_String nameStr;
@@ -289,6 +450,8 @@ IPreset* GetNextUninitializedPreset(WDL_PtrList<IPreset>* pPresets)
 
 void IPluginBase::MakeDefaultPreset(const char* name, int nPresets)
 {
+  IPreset* pFirstPreset = nullptr;
+  
   for (int i = 0; i < nPresets; ++i)
   {
     IPreset* pPreset = GetNextUninitializedPreset(&mPresets);
@@ -296,7 +459,16 @@ void IPluginBase::MakeDefaultPreset(const char* name, int nPresets)
     {
       pPreset->mInitialized = true;
       strcpy(pPreset->mName, (name ? name : "Empty"));
-      SerializeState(pPreset->mChunk);
+      
+      // the state is the same for all of them, so only serialize it once
+      if (pFirstPreset)
+        pPreset->mChunk.PutChunk(&pFirstPreset->mChunk);
+      else
+      {
+        pPreset->mChunk.Reserve(GetStateSizeEstimate());
+        SerializeState(pPreset->mChunk);
+        pFirstPreset = pPreset;
+      }
     }
   }
 }
@@ -311,6 +483,8 @@ void IPluginBase::MakePreset(const char* name, ...)
     
     int i, n = NParams();
     
+    pPreset->mChunk.Reserve(n * sizeof(double));
+    
     double v = 0.0;
     va_list vp;
     va_start(vp, name);
@@ -379,11 +553,47 @@ void IPluginBase::MakePresetFromChunk(const char* name, IByteChunk& chunk)
 
 void IPluginBase::MakePresetFromBlob(const char* name, const char* blob, int sizeOfChunk)
 {
-  IByteChunk presetChunk;
-  presetChunk.Resize(sizeOfChunk);
-  wdl_base64decode(blob, presetChunk.GetData(), sizeOfChunk);
+  IPreset* pPreset = GetNextUninitializedPreset(&mPresets);
+  if (pPreset)
+  {
+    pPreset->mInitialized = true;
+    strcpy(pPreset->mName, name);
+    
+    pPreset->mBlob = blob;
+    pPreset->mSourceSize = sizeOfChunk;
+  }
+}
+
+void IPluginBase::MakePresetFromData(const char* name, const void* pData, int size)
+{
+  IPreset* pPreset = GetNextUninitializedPreset(&mPresets);
+  if (pPreset)
+  {
+    pPreset->mInitialized = true;
+    strcpy(pPreset->mName, name);
+    
+    pPreset->mData = pData;
+    pPreset->mSourceSize = size;
+  }
+}
+
+IByteChunk& IPluginBase::GetPresetChunk(IPreset* pPreset)
+{
+  if (pPreset->mBlob)
+  {
+    pPreset->mChunk.Resize(pPreset->mSourceSize);
+    wdl_base64decode(pPreset->mBlob, pPreset->mChunk.GetData(), pPreset->mSourceSize);
+  }
+  else if (pPreset->mData)
+  {
+    pPreset->mChunk.Clear();
+    pPreset->mChunk.PutBytes(pPreset->mData, pPreset->mSourceSize);
+  }
+  
+  pPreset->mBlob = nullptr;
+  pPreset->mData = nullptr;
   
-  MakePresetFromChunk(name, presetChunk);
+  return pPreset->mChunk;
 }
 
 void MakeDefaultUserPresetName(WDL_PtrList<IPreset>* pPresets, char* str)
@@ -441,7 +651,7 @@ bool IPluginBase::RestorePreset(int idx)
     }
     else
     {
-      restoredOK = (UnserializeState(pPreset->mChunk, 0) > 0);
+      restoredOK = (UnserializeState(GetPresetChunk(pPreset), 0) > 0);
     }
     
     if (restoredOK)
@@ -485,7 +695,7 @@ void IPluginBase::ModifyCurrentPreset(const char* name)
   if (mCurrentPresetIdx >= 0 && mCurrentPresetIdx < mPresets.GetSize())
   {
     IPreset* pPreset = mPresets.Get(mCurrentPresetIdx);
-    pPreset->mChunk.Clear();
+    GetPresetChunk(pPreset).Clear();
     
     Trace(TRACELOC, "%d %s", mCurrentPresetIdx, pPreset->mName);
     
@@ -513,12 +723,28 @@ bool IPluginBase::SerializePresets(IByteChunk& chunk) const
     chunk.Put(&pPreset->mInitialized);
     if (pPreset->mInitialized)
     {
-      savedOK &= (chunk.PutChunk(&(pPreset->mChunk)) > 0);
+      savedOK &= (chunk.PutChunk(&GetPresetChunk(pPreset)) > 0);
     }
   }
   return savedOK;
 }
 
+int IPluginBase::GetPresetsChunkSize() const
+{
+  int size = 0;
+  
+  for (int i = 0; i < mPresets.GetSize(); ++i)
+  {
+    const IPreset* pPreset = mPresets.Get(i);
+    size += (int) sizeof(int) + (int) strlen(pPreset->mName) + (int) sizeof(bool);
+    
+    if (pPreset->mInitialized)
+      size += pPreset->GetChunkSize();
+  }
+  
+  return size;
+}
+
 int IPluginBase::UnserializePresets(IByteChunk& chunk, int startPos)
 {
   TRACE;
@@ -538,7 +764,7 @@ int IPluginBase::UnserializePresets(IByteChunk& chunk, int startPos)
       pos = UnserializeState(chunk, pos);
       if (pos > 0)
       {
-        pPreset->mChunk.Clear();
+        GetPresetChunk(pPreset).Clear();
         SerializeState(pPreset->mChunk);
       }
     }
@@ -598,7 +824,7 @@ void IPluginBase::DumpAllPresetsBlob(const char* filename) const
     fprintf(fp, "MakePresetFromBlob(\"%s\", \"", pPreset->mName);
     
     chnk.Clear();
-    chnk.PutChunk(&(pPreset->mChunk));
+    chnk.PutChunk(&GetPresetChunk(pPreset));
     wdl_base64encode(chnk.GetData(), buf, chnk.Size());
     
     fprintf(fp, "%s\", %i, %i);\n", buf, chnk.Size(), pPreset->mChunk.Size());
@@ -614,7 +840,7 @@ void IPluginBase::DumpPresetBlob(const char* filename) const
   
   char buf[MAX_BLOB_LENGTH];
   
-  IByteChunk* pPresetChunk = &mPresets.Get(mCurrentPresetIdx)->mChunk;
+  IByteChunk* pPresetChunk = &GetPresetChunk(mPresets.Get(mCurrentPresetIdx));
   uint8_t* byteStart = pPresetChunk->GetData();
   
   wdl_base64encode(byteStart, buf, pPresetChunk->Size());
@@ -637,7 +863,7 @@ void IPluginBase::DumpBankBlob(const char* filename) const
     IPreset* pPreset = mPresets.Get(i);
     fprintf(fp, "MakePresetFromBlob(\"%s\", \"", pPreset->mName);
     
-    IByteChunk* pPresetChunk = &pPreset->mChunk;
+    IByteChunk* pPresetChunk = &GetPresetChunk(pPreset);
     wdl_base64encode(pPresetChunk->GetData(), buf, pPresetChunk->Size());
     
     fprintf(fp, "%s\", %i);\n", buf, pPresetChunk->Size());
@@ -812,7 +1038,7 @@ bool IPluginBase::SaveBankAsFXB(const char* file) const
         for (int i = 0; i< NParams(); i++)
         {
           double v = 0.0;
-          pos = pPreset->mChunk.Get(&v, pos);
+          pos = GetPresetChunk(pPreset).Get(&v, pos);
           
           WDL_EndianFloat v32;
           v32.f = (float) GetParam(i)->ToNormalized(v);
@@ -1279,3 +1505,166 @@ bool IPluginBase::SaveProgramAsVSTPreset(const char* path) const
 }
 
 #endif
+
+std::shared_ptr<IPlugJob> IPluginBase::RunInBackground(IPlugJob::IJobFunction func, IPlugJob::ICompletionFunction onComplete, IPlugJob::EPriority priority, IPlugJob::ECompletionThread completionThread)
+{
+  auto job = std::make_shared<IPlugJob>(std::move(func), std::move(onComplete), priority, completionThread);
+  mBackgroundJobs.push_back(job);
+  IPlugWorkerPool::Get().Submit(job);
+  return job;
+}
+
+void IPluginBase::CancelBackgroundJobs()
+{
+  for (auto& job : mBackgroundJobs)
+    job->Cancel();
+  
+  for (auto& job : mBackgroundJobs)
+  {
+    while (job->GetState() == IPlugJob::kRunning)
+      std::this_thread::yield();
+  }
+  
+  // an audio thread completion may still sit in the queue, so only keep those jobs alive
+  mBackgroundJobs.erase(std::remove_if(mBackgroundJobs.begin(), mBackgroundJobs.end(), [](const std::shared_ptr<IPlugJob>& job) {
+    return !job->mCompletionQueued.load(std::memory_order_relaxed) || job->mCompletionDelivered.load(std::memory_order_acquire);
+  }), mBackgroundJobs.end());
+}
+
+void IPluginBase::ProcessJobCompletions()
+{
+  for (auto& job : mBackgroundJobs)
+  {
+    const IPlugJob::EState state = job->GetState();
+    
+    if (state == IPlugJob::kPending || state == IPlugJob::kRunning || job->mCompletionDelivered.load(std::memory_order_acquire))
+      continue;
+    
+    if (state == IPlugJob::kCancelled)
+    {
+      if (!job->mCompletionQueued.load(std::memory_order_relaxed))
+        job->mCompletionDelivered.store(true, std::memory_order_relaxed);
+    }
+    else if (job->GetCompletionThread() == IPlugJob::ECompletionThread::kMainThread)
+    {
+      job->mCompletionDelivered.store(true, std::memory_order_relaxed);
+      
+      if (job->mOnComplete)
+        job->mOnComplete();
+    }
+    else if (!job->mCompletionQueued.load(std::memory_order_relaxed))
+    {
+      if (mAudioThreadJobCompletions.Push(job.get())) // if the queue is full, try again on the next tick
+        job->mCompletionQueued.store(true, std::memory_order_relaxed);
+    }
+  }
+  
+  mBackgroundJobs.erase(std::remove_if(mBackgroundJobs.begin(), mBackgroundJobs.end(), [](const std::shared_ptr<IPlugJob>& job) {
+    return job->mCompletionDelivered.load(std::memory_order_acquire);
+  }), mBackgroundJobs.end());
+}
+
+#pragma mark - Prototype
+
+/** The parameters and presets that the first instance of a plug-in captured, see IPluginBase::CapturePrototype() */
+struct IPluginPrototype
+{
+  ~IPluginPrototype()
+  {
+    mParams.Empty(true);
+    mPresets.Empty(true);
+  }
+
+  WDL_PtrList<IParam> mParams;
+  WDL_PtrList<IPreset> mPresets;
+};
+
+/** The prototypes of the plug-ins in the process, by unique ID */
+struct IPluginPrototypes
+{
+  IPluginPrototypes()
+  : mRegistration([this](IMemoryReport& report) {
+      WDL_MutexLock lock(&mMutex);
+      int64_t bytes = 0;
+
+      for (auto& prototype : mPrototypes)
+      {
+        for (int i = 0; i < prototype.second->mParams.GetSize(); i++)
+          bytes += sizeof(IParam) + prototype.second->mParams.Get(i)->GetAllocatedBytes();
+
+        for (int i = 0; i < prototype.second->mPresets.GetSize(); i++)
+          bytes += sizeof(IPreset) + prototype.second->mPresets.Get(i)->mChunk.Size();
+      }
+
+      report.Add(kMemoryShared, "Plug-in prototypes", bytes, static_cast<int>(mPrototypes.size()));
+    })
+  {}
+
+  static IPluginPrototypes& Get()
+  {
+    static IPluginPrototypes sPrototypes;
+    return sPrototypes;
+  }
+
+  WDL_Mutex mMutex;
+  std::unordered_map<int, std::unique_ptr<IPluginPrototype>> mPrototypes;
+  IMemoryRegistry::Registration mRegistration;
+};
+
+bool IPluginBase::InitFromPrototype()
+{
+  IPluginPrototypes& prototypes = IPluginPrototypes::Get();
+  WDL_MutexLock lock(&prototypes.mMutex);
+  auto it = prototypes.mPrototypes.find(GetUniqueID());
+
+  if (it == prototypes.mPrototypes.end() || it->second->mParams.GetSize() != NParams())
+    return false;
+
+  const IPluginPrototype& prototype = *it->second;
+
+  for (int i = 0; i < NParams(); i++)
+    GetParam(i)->CopyDescription(*prototype.mParams.Get(i));
+
+#ifndef NO_PRESETS
+  const int nPresets = std::min(NPresets(), prototype.mPresets.GetSize());
+
+  for (int i = 0; i < nPresets; i++)
+    *mPresets.Get(i) = *prototype.mPresets.Get(i);
+#endif
+
+  return true;
+}
+
+void IPluginBase::CapturePrototype() const
+{
+  IPluginPrototypes& prototypes = IPluginPrototypes::Get();
+  WDL_MutexLock lock(&prototypes.mMutex);
+  std::unique_ptr<IPluginPrototype>& pPrototype = prototypes.mPrototypes[GetUniqueID()];
+
+  if (pPrototype)
+    return;
+
+  pPrototype.reset(new IPluginPrototype);
+
+  for (int i = 0; i < NParams(); i++)
+    pPrototype->mParams.Add(new IParam())->CopyDescription(*GetParam(i));
+
+#ifndef NO_PRESETS
+  for (int i = 0; i < mPresets.GetSize(); i++)
+    pPrototype->mPresets.Add(new IPreset(*mPresets.Get(i)));
+#endif
+}
+
+void IPluginBase::ReportMemory(IMemoryReport& report) const
+{
+  // the source data of lazy factory presets is static and shared by every instance, so only their decoded chunks count here
+  int64_t presetBytes = 0;
+
+  for (int i = 0; i < mPresets.GetSize(); i++)
+    presetBytes += sizeof(IPreset) + mPresets.Get(i)->mChunk.Size();
+
+  report.Add(kMemoryPresets, "Presets", presetBytes, mPresets.GetSize());
+  report.Add(kMemoryQueues, "Job completions", mAudioThreadJobCompletions.GetBytes());
+
+  EDITOR_DELEGATE_CLASS::ReportMemory(report);
+}
@@ -18,7 +18,11 @@
 #include "IPlugDelegate_select.h"
 #include "IPlugParameter.h"
 #include "IPlugStructs.h"
+#include "IPlugStateStream.h"
 #include "IPlugLogger.h"
+#include "IPlugRealtimeCheck.h"
+#include "IPlugQueue.h"
+#include "IPlugWorkerPool.h"
 
 /** Base class that contains plug-in info and state manipulation methods */
 class IPluginBase : public EDITOR_DELEGATE_CLASS
@@ -117,9 +121,16 @@ public:
    * WARNING: this method can in some cases be called on the realtime audio thread */
   virtual void OnParamChange(int paramIdx) {}
   
+  /** Called once for a batch of parameter changes, see IPlugAPIBase::SetParameterValues(). Override this to update DSP that depends on many parameters
+   * only once per batch. The default implementation calls OnParamChange() for each change
+   * @param pChanges The changes, which have already been applied to the parameters
+   * @param nChanges The number of changes
+   * @param source One of the EParamSource options to indicate where the parameter changes came from */
+  virtual void OnParamChanges(const IParamChange* pChanges, int nChanges, EParamSource source);
+  
   /** Calls OnParamChange() and OnParamChangeUI() for each parameter.
    * @param source Specifies the source of the parameter changes */
-  void OnParamReset(EParamSource source);
+  virtual void OnParamReset(EParamSource source);
   
 #pragma mark - State Serialization
   /** @return \c true if the plug-in has been set up to do state chunks, via config.h */
@@ -136,6 +147,38 @@ public:
    * @return The new chunk position (endPos) */
   int UnserializeParams(const IByteChunk& chunk, int startPos);
   
+  /** Serializes only the parameters whose values differ from a baseline, in a versioned sparse format that UnserializeParams() recognises.
+   * With no baseline, values are compared to the parameter defaults and unserializing resets the parameters that are not in the chunk to their defaults.
+   * With a baseline, for example a snapshot made with SnapshotParamValues(), the chunk is a delta and unserializing leaves the other parameters untouched.
+   * @param chunk The output chunk to serialize to. Will append data if the chunk has already been started.
+   * @param pBaseline NParams() values to compare against, or nullptr to compare against the defaults
+   * @return \c true if the serialization was successful */
+  bool SerializeParamsSparse(IByteChunk& chunk, const double* pBaseline = nullptr) const;
+  
+  /** Decode parameter values from a chunk written by SerializeParams() or SerializeParamsSparse(), without touching the parameters
+   * @param chunk The incoming chunk where parameter values are stored
+   * @param startPos The start position in the chunk where parameter values are stored
+   * @param values Resized to NParams(), parameters that are not in the chunk keep their current value (or default, for a sparse chunk relative to the defaults)
+   * @return The new chunk position (endPos) */
+  int UnserializeParamValues(const IByteChunk& chunk, int startPos, WDL_TypedBuf<double>& values) const;
+  
+  /** Copy the current, non-normalised values of all parameters, for use as a baseline with SerializeParamsSparse()
+   * @param values Resized to NParams() and filled with the values */
+  void SnapshotParamValues(WDL_TypedBuf<double>& values) const;
+  
+  /** Set whether SerializeParams() writes the sparse format, relative to the parameter defaults. Off by default, since older builds of a plug-in can't read it.
+   * UnserializeParams() reads both formats regardless
+   * @param sparse \c true to write sparse parameter chunks */
+  void SetSparseParamChunks(bool sparse) { mSparseParamChunks = sparse; }
+  
+  /** @return \c true if SerializeParams() writes the sparse format */
+  bool GetSparseParamChunks() const { return mSparseParamChunks; }
+  
+  /** @param chunk A chunk containing serialized parameters
+   * @param startPos The position in the chunk where the parameters start
+   * @return \c true if the parameters at startPos were written by SerializeParamsSparse() */
+  static bool IsSparseParamChunk(const IByteChunk& chunk, int startPos);
+  
   /** Override this method to serialize custom state data, if your plugin does state chunks.
    * @param chunk The output bytechunk where data can be serialized
    * @return \c true if serialization was successful*/
@@ -148,6 +191,50 @@ public:
    * @return The new chunk position (endPos)*/
   virtual int UnserializeState(const IByteChunk& chunk, int startPos) { TRACE; return UnserializeParams(chunk, startPos); }
   
+  /** Override this method if your plug-in embeds large data in its state, such as samples or impulse responses, to write it through a stream after SerializeState()
+   * rather than into the state chunk, so that it never has to be held in memory as one chunk. Only called if HasLargeState() returns \c true, see IPlugStateStream.h
+   * @param writer Where the data is written
+   * @return \c true if serialization was successful */
+  virtual bool SerializeLargeState(IStateWriter& writer) const { return true; }
+
+  /** Override this method to read the data written by SerializeLargeState(). It is called after UnserializeState() and OnRestoreState(),
+   * so the parameters are restored and the editor updated before the large data is loaded. Only called for states that have large data
+   * @param reader Where the data is read from
+   * @return \c true if the data was read */
+  virtual bool UnserializeLargeState(IStateReader& reader) { return true; }
+
+  /** Override this method to return \c true if your plug-in implements SerializeLargeState(). States saved without large data are written as before */
+  virtual bool HasLargeState() const { return false; }
+
+  /** Compress the large state (see SerializeLargeState()) with zlib, a block at a time on a worker thread. Needs IPLUG_STATE_COMPRESSION defined and WDL's zlib linked
+   * @param level From 1 for the fastest to 9 for the smallest, or 0 (the default) not to compress */
+  void SetLargeStateCompression(int level) { mLargeStateCompression = level; }
+
+  /** Used by the API classes to write the large state: a short header, then SerializeLargeState(), compressed if set
+   * @param writer Where the data is written
+   * @return \c true if successful */
+  bool WriteLargeState(IStateWriter& writer) const;
+
+  /** Used by the API classes to read the large state written by WriteLargeState() and pass it to UnserializeLargeState()
+   * @param reader Where the data is read from
+   * @return \c true if successful */
+  bool ReadLargeState(IStateReader& reader);
+
+  /** Override this method if your plug-in does state chunks, to return an upper estimate of the size of the data SerializeState() writes,
+   * so that the API classes can reserve a chunk up front rather than growing it as the state is written
+   * @return The size estimate (in bytes) */
+  virtual int GetStateSizeEstimate() const { return GetParamsChunkSize(); }
+  
+  /** @return The largest size (in bytes) that SerializeParams() can write for the current parameters */
+  int GetParamsChunkSize() const;
+  
+  /** @return The size (in bytes) that SerializePresets() writes for the current presets */
+  int GetPresetsChunkSize() const;
+  
+  /** Used by the API classes to get a pooled chunk for saving state, with GetStateSizeEstimate() bytes reserved
+   * @return The chunk, which goes back to the pool when it goes out of scope */
+  IByteChunkPool::ScopedChunk AcquireStateChunk() const { return mStateChunkPool.Acquire(GetStateSizeEstimate()); }
+  
   /** VST3 ONLY! - THIS IS ONLY INCLUDED FOR COMPATIBILITY - NOONE ELSE SHOULD NEED IT!
    * @param chunk The output bytechunk where data can be serialized.
    * @return \c true if serialization was successful */
@@ -245,12 +332,25 @@ public:
    * @param chunk /todo */
   void MakePresetFromChunk(const char* name, IByteChunk& chunk);
 
-  /** /todo 
-   * @param name /todo
-   * @param blob /todo
-   * @param sizeOfChunk /todo */
+  /** Make a preset from base64 encoded state, as written by DumpPresetBlob(). The blob is only decoded when the preset is first used,
+   * so it must stay valid for the lifetime of the plug-in, which is the case for the string literals that DumpPresetBlob() generates
+   * @param name The name of the preset
+   * @param blob The base64 encoded state
+   * @param sizeOfChunk The size of the decoded state (in bytes) */
   void MakePresetFromBlob(const char* name, const char* blob, int sizeOfChunk);
   
+  /** Make a preset that refers to state data, for example a static array compiled into the plug-in or a memory mapped bank file shared by all instances.
+   * The data is only copied when the preset is first used, so it must stay valid for the lifetime of the plug-in
+   * @param name The name of the preset
+   * @param pData The serialized state, in the format written by SerializeState()
+   * @param size The size of the data (in bytes) */
+  void MakePresetFromData(const char* name, const void* pData, int size);
+  
+  /** Get the state of a preset, decoding it first if it was made lazily with MakePresetFromBlob() or MakePresetFromData()
+   * @param pPreset The preset
+   * @return The preset's state */
+  static IByteChunk& GetPresetChunk(IPreset* pPreset);
+  
   /** /todo */
   void PruneUninitializedPresets();
   
@@ -452,10 +552,83 @@ public:
   /** Default parameter values for a parameter group  */
   void PrintParamValues();
 
+#pragma mark - Prototype
+  /** Describe this instance's parameters, and set up its presets, from the prototype captured by the first instance of the plug-in in the process, see CapturePrototype().
+   * This lets the constructor skip the Init calls and MakePreset() calls, which otherwise run again for every instance a host creates, e.g.
+   * @code
+   * if (!InitFromPrototype())
+   * {
+   *   GetParam(kGain)->InitDouble("Gain", 0., 0., 100.0, 0.01, "%");
+   *   MakeDefaultPreset();
+   *   CapturePrototype();
+   * }
+   * @endcode
+   * The parameter values are set to their defaults. Anything else the constructor sets up from the parameters, such as the editor or the DSP, is still up to it.
+   * The channel I/O configs are copied from the first instance's without this, see IPlugProcessor::CopyChannelIOStr()
+   * @return \c true if there was a prototype, \c false if this is the first instance, which should describe the parameters and call CapturePrototype() */
+  bool InitFromPrototype();
+
+  /** Keep a copy of the parameter descriptions and the presets for the later instances of the plug-in in the process, see InitFromPrototype().
+   * Call it at the end of the first instance's constructor, once they are set. The prototype isn't replaced if another instance captured one first,
+   * and it is kept until the process ends */
+  void CapturePrototype() const;
+
+#pragma mark - Background jobs
+  /** Run a non-realtime job, such as loading a sample or an impulse response, on the process wide IPlugWorkerPool.
+   * Call this on the main thread. The completion function is called once the job has finished, unless it was cancelled:
+   * on the main thread from the API class's timer, or at the start of an audio block if completionThread is kAudioThread,
+   * in which case it must be realtime safe.
+   * Jobs that capture members of your plug-in class should be cancelled in its destructor with CancelBackgroundJobs(), since the
+   * IPluginBase destructor, which waits for running jobs, is called after your members have been destroyed
+   * @param func The work to do on a worker thread
+   * @param onComplete Called when the job has finished, may be nullptr
+   * @param priority Jobs with a higher priority are started first
+   * @param completionThread The thread to call onComplete on
+   * @return A handle to the job, which can be used to cancel it */
+  std::shared_ptr<IPlugJob> RunInBackground(IPlugJob::IJobFunction func, IPlugJob::ICompletionFunction onComplete = nullptr,
+                                            IPlugJob::EPriority priority = IPlugJob::kPriorityNormal,
+                                            IPlugJob::ECompletionThread completionThread = IPlugJob::ECompletionThread::kMainThread);
+
+  /** Cancel all the background jobs started by this instance, and wait for any that are running to return. Call this on the main thread */
+  void CancelBackgroundJobs();
+
+  /** Called on the audio thread at the start of each block, to call the completion functions of jobs started with ECompletionThread::kAudioThread */
+  void ProcessAudioThreadJobCompletions()
+  {
+    IPlugJob* pJob;
+    
+    while (mAudioThreadJobCompletions.Pop(pJob))
+    {
+      if (pJob->mOnComplete && !pJob->IsCancelled())
+        pJob->mOnComplete();
+      
+      pJob->mCompletionDelivered.store(true, std::memory_order_release); // the job is released on the main thread
+    }
+  }
+
 protected:
+  /** Call the completion functions of finished main thread jobs, hand finished audio thread jobs to the audio thread and release delivered jobs.
+   * Called by the API class on the main thread, from its timer */
+  void ProcessJobCompletions();
+
+  void ReportMemory(IMemoryReport& report) const override;
+
+  /** Parse serialized parameter values, calling func with the index and value of each one found. Shared by UnserializeParams() and UnserializeParamValues() */
+  int ReadParamValues(const IByteChunk& chunk, int startPos, const std::function<void(int paramIdx, double value)>& func) const;
+  
   int mCurrentPresetIdx = 0;
   /** \c true if the plug-in does opaque state chunks. If false the host will provide a default interface */
   bool mStateChunks = false;
+  /** \c true if SerializeParams() writes the sparse format, see SetSparseParamChunks() */
+  bool mSparseParamChunks = false;
+  /** The zlib level of the large state, see SetLargeStateCompression() */
+  int mLargeStateCompression = 0;
+  /** Reusable chunks for saving state, see AcquireStateChunk() */
+  mutable IByteChunkPool mStateChunkPool;
+  /** Jobs started by RunInBackground() that haven't been delivered yet, only accessed on the main thread */
+  std::vector<std::shared_ptr<IPlugJob>> mBackgroundJobs;
+  /** Finished jobs whose completion function should be called on the audio thread */
+  IPlugQueue<IPlugJob*> mAudioThreadJobCompletions {JOB_COMPLETION_QUEUE_SIZE};
   /** The name of this plug-in */
   WDL_String mPluginName;
   /** Product name: if the plug-in is part of collection of plug-ins it might be one product */
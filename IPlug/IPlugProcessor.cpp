@@ -18,6 +18,10 @@
 #include <cstdio>
 #include <ctime>
 #include <cassert>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 
 //#include "IPlugProcessor.h"
 
@@ -28,18 +32,40 @@
 template<typename T>
 IPlugProcessor<T>::IPlugProcessor(IPlugConfig c, EAPI plugAPI)
   : mLatency(c.latency)
+  , mPluginLatency(c.latency)
   , mPlugType((EIPlugPluginType) c.plugType)
   , mDoesMIDIIn(c.plugDoesMidiIn)
   , mDoesMIDIOut(c.plugDoesMidiOut)
   , mDoesMPE(c.plugDoesMPE)
+  , mDoesInPlaceProcessing(c.plugDoesInPlaceProcessing)
+  , mProcessInterleaved(c.plugProcessInterleaved)
+  , mFlushDenormals(c.plugFlushDenormals)
 {
   int totalNInBuses, totalNOutBuses;
   int totalNInChans, totalNOutChans;
 
-  ParseChannelIOStr(c.channelIOStr, mIOConfigs, totalNInChans, totalNOutChans, totalNInBuses, totalNOutBuses);
+  CopyChannelIOStr(c.channelIOStr, mIOConfigs, totalNInChans, totalNOutChans, totalNInBuses, totalNOutBuses);
+
+  for (auto dir = 0; dir < 2; dir++)
+  {
+    const ERoute direction = (ERoute) dir;
+    const int totalNChans = direction == ERoute::kInput ? totalNInChans : totalNOutChans;
+    const int nBuses = HasWildcardBus(direction) ? 1 : std::max(MaxNBuses(direction), 1);
+
+    mBusChannelOffsets[dir].Resize(nBuses + 1);
+    int* pOffsets = mBusChannelOffsets[dir].Get();
+    pOffsets[0] = 0;
+
+    for (auto busIdx = 0; busIdx < nBuses; busIdx++)
+      pOffsets[busIdx + 1] = nBuses == 1 ? totalNChans : std::min(pOffsets[busIdx] + MaxNChannelsForBus(direction, busIdx), totalNChans);
+  }
 
   mScratchData[ERoute::kInput].Resize(totalNInChans);
   mScratchData[ERoute::kOutput].Resize(totalNOutChans);
+  mSubBlockData[ERoute::kInput].Resize(totalNInChans);
+  mSubBlockData[ERoute::kOutput].Resize(totalNOutChans);
+  mParamEvents.Resize(MAX_PARAM_EVENTS_PER_BLOCK);
+  mMidiEvents.Resize(MAX_MIDI_EVENTS_PER_BLOCK);
 
   T** ppInData = mScratchData[ERoute::kInput].Get();
 
@@ -71,6 +97,7 @@ IPlugProcessor<T>::~IPlugProcessor()
   mChannelData[ERoute::kInput].Empty(true);
   mChannelData[ERoute::kOutput].Empty(true);
   mIOConfigs.Empty(true);
+  mParamRamps.Empty(true);
 }
 
 template<typename T>
@@ -82,7 +109,8 @@ void IPlugProcessor<T>::ProcessBlock(T** inputs, T** outputs, int nFrames)
   {
     if (i < nIn)
     {
-      memcpy(outputs[i], inputs[i], nFrames * sizeof(T));
+      if (outputs[i] != inputs[i]) // in-place buffers are already passed through
+        memcpy(outputs[i], inputs[i], nFrames * sizeof(T));
       j++;
     }
   }
@@ -93,6 +121,18 @@ void IPlugProcessor<T>::ProcessBlock(T** inputs, T** outputs, int nFrames)
   }
 }
 
+template<typename T>
+void IPlugProcessor<T>::ProcessBlockInterleaved(T* inputs, T* outputs, int nFrames)
+{
+  const int nIn = mChannelData[ERoute::kInput].GetSize(), nOut = mChannelData[ERoute::kOutput].GetSize();
+
+  for (auto i = 0; i < nFrames; ++i, inputs += nIn, outputs += nOut)
+  {
+    for (auto c = 0; c < nOut; ++c)
+      outputs[c] = c < nIn ? inputs[c] : 0.;
+  }
+}
+
 template<typename T>
 void IPlugProcessor<T>::ProcessMidiMsg(const IMidiMsg& msg)
 {
@@ -205,15 +245,58 @@ void IPlugProcessor<T>::SetChannelLabel(ERoute direction, int idx, const char* f
     mChannelData[direction].Get(idx)->mLabel.SetFormatted(MAX_CHAN_NAME_LEN, formatStr, idx+(!zeroBased));
 }
 
+template<typename T>
+void IPlugProcessor<T>::SetMaxLatency(int samples)
+{
+  if (mLatencyDelay)
+    mLatencyDelay->SetMaxDelayTime(samples);
+}
+
 template<typename T>
 void IPlugProcessor<T>::SetLatency(int samples)
 {
-  mLatency = samples;
+  mPluginLatency = samples;
+  mLatency = HostLatency(samples);
 
   if (mLatencyDelay)
     mLatencyDelay->SetDelayTime(mLatency);
 }
 
+//static
+template<typename T>
+int IPlugProcessor<T>::CopyChannelIOStr(const char* IOStr, WDL_PtrList<IOConfig>& channelIOList, int& totalNInChans, int& totalNOutChans, int& totalNInBuses, int& totalNOutBuses)
+{
+  struct ParsedChannelIO
+  {
+    ~ParsedChannelIO() { configs.Empty(true); }
+    
+    WDL_PtrList<IOConfig> configs;
+    int totals[4];
+  };
+  
+  static std::mutex sMutex;
+  static std::unordered_map<std::string, std::unique_ptr<ParsedChannelIO>> sParsed;
+  
+  std::lock_guard<std::mutex> lock(sMutex);
+  std::unique_ptr<ParsedChannelIO>& pParsed = sParsed[IOStr];
+  
+  if (!pParsed)
+  {
+    pParsed.reset(new ParsedChannelIO);
+    ParseChannelIOStr(IOStr, pParsed->configs, pParsed->totals[0], pParsed->totals[1], pParsed->totals[2], pParsed->totals[3]);
+  }
+  
+  for (auto i = 0; i < pParsed->configs.GetSize(); i++)
+    channelIOList.Add(pParsed->configs.Get(i)->Clone());
+  
+  totalNInChans = pParsed->totals[0];
+  totalNOutChans = pParsed->totals[1];
+  totalNInBuses = pParsed->totals[2];
+  totalNOutBuses = pParsed->totals[3];
+  
+  return pParsed->configs.GetSize();
+}
+
 //static
 template<typename T>
 int IPlugProcessor<T>::ParseChannelIOStr(const char* IOStr, WDL_PtrList<IOConfig>& channelIOList, int& totalNInChans, int& totalNOutChans, int& totalNInBuses, int& totalNOutBuses)
@@ -343,71 +426,481 @@ int IPlugProcessor<T>::ParseChannelIOStr(const char* IOStr, WDL_PtrList<IOConfig
 template<typename T>
 void IPlugProcessor<T>::SetChannelConnections(ERoute direction, int idx, int n, bool connected)
 {
-  WDL_PtrList<IChannelData<>>& channelData = mChannelData[direction];
+  IChannelData<>** ppChannels = mChannelData[direction].GetList();
 
-  const auto endIdx = std::min(idx + n, channelData.GetSize());
+  const auto endIdx = std::min(idx + n, mChannelData[direction].GetSize());
 
-  for (auto i = idx; i < endIdx; ++i)
-  {
-    IChannelData<>* pChannel = channelData.Get(i);
+  ForEachChannel(idx, endIdx, [&](int i) {
+    IChannelData<>* pChannel = ppChannels[i];
     pChannel->mConnected = connected;
 
     if (!connected)
-      *(pChannel->mData) = pChannel->mScratchBuf.Get();
-  }
+      *(pChannel->mData) = pChannel->mScratchBuf;
+  });
 }
 
 template<typename T>
 void IPlugProcessor<T>::AttachBuffers(ERoute direction, int idx, int n, PLUG_SAMPLE_DST** ppData, int)
 {
-  WDL_PtrList<IChannelData<>>& channelData = mChannelData[direction];
+  IChannelData<>** ppChannels = mChannelData[direction].GetList();
 
-  const auto endIdx = std::min(idx + n, channelData.GetSize());
+  const auto endIdx = std::min(idx + n, mChannelData[direction].GetSize());
 
-  for (auto i = idx; i < endIdx; ++i)
-  {
-    IChannelData<>* pChannel = channelData.Get(i);
+  ForEachChannel(idx, endIdx, [&](int i) {
+    IChannelData<>* pChannel = ppChannels[i];
 
     if (pChannel->mConnected)
       *(pChannel->mData) = *(ppData++);
-  }
+  });
 }
 
 template<typename T>
 void IPlugProcessor<T>::AttachBuffers(ERoute direction, int idx, int n, PLUG_SAMPLE_SRC** ppData, int nFrames)
 {
-  WDL_PtrList<IChannelData<>>& channelData = mChannelData[direction];
+  IChannelData<>** ppChannels = mChannelData[direction].GetList();
+  IChannelData<>** ppOutChannels = mChannelData[ERoute::kOutput].GetList();
+  const int nOutChannels = mChannelData[ERoute::kOutput].GetSize();
 
-  const auto endIdx = std::min(idx + n, channelData.GetSize());
+  const auto endIdx = std::min(idx + n, mChannelData[direction].GetSize());
 
-  for (auto i = idx; i < endIdx; ++i)
-  {
-    IChannelData<>* pChannel = channelData.Get(i);
+  ForEachChannel(idx, endIdx, [&](int i) {
+    IChannelData<>* pChannel = ppChannels[i];
 
     if (pChannel->mConnected)
     {
       if (direction == ERoute::kInput)
       {
-        PLUG_SAMPLE_DST* pScratch = pChannel->mScratchBuf.Get();
+        PLUG_SAMPLE_DST* pScratch = pChannel->mScratchBuf;
+
+        // when processing in place, convert straight into the matching output scratch buffer, so that only one buffer per channel is touched
+        if (mDoesInPlaceProcessing && i < nOutChannels)
+          pScratch = ppOutChannels[i]->mScratchBuf;
+
         CastCopy(pScratch, *(ppData++), nFrames);
         *(pChannel->mData) = pScratch;
       }
       else // output
       {
-        *(pChannel->mData) = pChannel->mScratchBuf.Get();
+        *(pChannel->mData) = pChannel->mScratchBuf;
         pChannel->mIncomingData = *(ppData++);
       }
     }
+  });
+}
+
+template<typename T>
+void IPlugProcessor<T>::AddParamEvent(const IParamEvent& event)
+{
+  if (mNParamEvents == mParamEvents.GetSize())
+  {
+    ProcessParamEvent(event); // no room, apply it now, at the start of the block
+    return;
+  }
+
+  // insertion sort by offset, stable so that multiple points for the same parameter stay in order
+  IParamEvent* pEvents = mParamEvents.Get();
+  int i = mNParamEvents++;
+
+  while (i > 0 && pEvents[i - 1].mOffset > event.mOffset)
+  {
+    pEvents[i] = pEvents[i - 1];
+    i--;
+  }
+
+  pEvents[i] = event;
+}
+
+template<typename T>
+void IPlugProcessor<T>::AddMidiEvent(const IMidiMsg& msg)
+{
+  if (mNMidiEvents == mMidiEvents.GetSize())
+  {
+    ProcessMidiMsg(msg); // no room, deliver it now, relative to the start of the block
+    return;
+  }
+
+  // hosts normally deliver events in order, so this rarely moves anything
+  IMidiMsg* pEvents = mMidiEvents.Get();
+  int i = mNMidiEvents++;
+
+  while (i > 0 && pEvents[i - 1].mOffset > msg.mOffset)
+  {
+    pEvents[i] = pEvents[i - 1];
+    i--;
+  }
+
+  pEvents[i] = msg;
+}
+
+template<typename T>
+void IPlugProcessor<T>::FlushEvents()
+{
+  const IParamEvent* pParamEvents = mParamEvents.Get();
+
+  for (auto i = 0; i < mNParamEvents; ++i)
+    ProcessParamEvent(pParamEvents[i]);
+
+  const IMidiMsg* pMidiEvents = mMidiEvents.Get();
+
+  for (auto i = 0; i < mNMidiEvents; ++i)
+    ProcessMidiMsg(pMidiEvents[i]);
+
+  mNParamEvents = 0;
+  mNMidiEvents = 0;
+}
+
+template<typename T>
+bool IPlugProcessor<T>::UpdateSilence(int nFrames)
+{
+  const bool flaggedSilent = mInputsFlaggedSilent;
+  mInputsFlaggedSilent = false;
+
+  if (!mSilenceDetection || DoesMIDIIn() || mTailSize < 0)
+    return false;
+
+  T** ppInData = mScratchData[ERoute::kInput].Get();
+  int nConnected = 0;
+
+  for (auto i = 0; i < MaxNChannels(ERoute::kInput); ++i)
+  {
+    if (!IsChannelConnected(ERoute::kInput, i))
+      continue;
+
+    nConnected++;
+
+    // the host already knows, so there is no need to touch the samples
+    if (!flaggedSilent && !IsSilent(ppInData[i], nFrames, mSilenceThreshold))
+    {
+      mSilentSamples = 0;
+      return false;
+    }
+  }
+
+  if (!nConnected)
+    return false;
+
+  // the outputs are silent once the silence has passed through the latency and the tail has decayed
+  const int silentSamplesBefore = mSilentSamples;
+
+  if (mSilentSamples < INT_MAX - nFrames) // avoid overflow in long silences
+    mSilentSamples += nFrames;
+
+  return (int64_t) silentSamplesBefore >= (int64_t) GetTailSize() + mLatency;
+}
+
+template<typename T>
+void IPlugProcessor<T>::ProcessBlockWithLayout(T** inputs, T** outputs, int nFrames)
+{
+  mBlockArena.Reset();
+
+  if (!mProcessInterleaved)
+  {
+    ProcessBlock(inputs, outputs, nFrames);
+    return;
+  }
+
+  const int nIn = MaxNChannels(ERoute::kInput), nOut = MaxNChannels(ERoute::kOutput);
+  T* pInterleavedIn = mInterleavedData[ERoute::kInput].Get();
+  T* pInterleavedOut = mInterleavedData[ERoute::kOutput].Get();
+
+  InterleaveSamples(pInterleavedIn, inputs, nIn, nFrames);
+  ProcessBlockInterleaved(pInterleavedIn, pInterleavedOut, nFrames);
+  DeinterleaveSamples(outputs, pInterleavedOut, nOut, nFrames);
+}
+
+template<typename T>
+void IPlugProcessor<T>::ProcessSubBlocks(int nFrames)
+{
+  T** ppInData = mScratchData[ERoute::kInput].Get();
+  T** ppOutData = mScratchData[ERoute::kOutput].Get();
+
+  mOutputsSilent = UpdateSilence(nFrames);
+
+  if (mOutputsSilent)
+  {
+    FlushEvents();
+
+    for (auto i = 0; i < MaxNChannels(ERoute::kOutput); ++i)
+      memset(ppOutData[i], 0, nFrames * sizeof(T));
+
+    return;
+  }
+
+  if (mInputResampler)
+    ProcessResampled(nFrames);
+  else if (mFixedBlockSize)
+    ProcessFixedBlocks(ppInData, ppOutData, nFrames);
+  else
+    ProcessEventBlocks(ppInData, ppOutData, nFrames);
+}
+
+template<typename T>
+void IPlugProcessor<T>::ProcessResampled(int nFrames)
+{
+  T** ppInData = mScratchData[ERoute::kInput].Get();
+  T** ppOutData = mScratchData[ERoute::kOutput].Get();
+  T** ppInternalInData = mResampleData[ERoute::kInput].Get();
+  T** ppInternalOutData = mResampleData[ERoute::kOutput].Get();
+  T** ppFIFOData = mResampleFIFOData.Get();
+  T** ppFIFOWrite = mResampleFIFOWrite.Get();
+  const int nOut = MaxNChannels(ERoute::kOutput);
+
+  // the inputs are all taken before any output is written, in case the host's buffers are in-place
+  const int nInternalFrames = mInputResampler->Process(ppInData, nFrames, ppInternalInData);
+
+  // move the events to the internal timeline
+  const int64_t L = mInputResampler->GetL(), M = mInputResampler->GetM();
+  IParamEvent* pParamEvents = mParamEvents.Get();
+  IMidiMsg* pMidiEvents = mMidiEvents.Get();
+
+  for (auto i = 0; i < mNParamEvents; ++i)
+    pParamEvents[i].mOffset = (int) (pParamEvents[i].mOffset * L / M);
+
+  for (auto i = 0; i < mNMidiEvents; ++i)
+    pMidiEvents[i].mOffset = (int) (pMidiEvents[i].mOffset * L / M);
+
+  if (mFixedBlockSize)
+    ProcessFixedBlocks(ppInternalInData, ppInternalOutData, nInternalFrames);
+  else
+    ProcessEventBlocks(ppInternalInData, ppInternalOutData, nInternalFrames);
+
+  // in total the output resampler produces at least as many frames as the host has taken, so the FIFO only has to hold the few left over
+  for (auto c = 0; c < nOut; ++c)
+    ppFIFOWrite[c] = ppFIFOData[c] + mResampleFIFOFrames;
+
+  mResampleFIFOFrames += mOutputResampler->Process(ppInternalOutData, nInternalFrames, ppFIFOWrite);
+  assert(mResampleFIFOFrames >= nFrames);
+
+  const int nCopy = std::min(nFrames, mResampleFIFOFrames);
+
+  for (auto c = 0; c < nOut; ++c)
+  {
+    memcpy(ppOutData[c], ppFIFOData[c], nCopy * sizeof(T));
+    memset(ppOutData[c] + nCopy, 0, (nFrames - nCopy) * sizeof(T));
+    memmove(ppFIFOData[c], ppFIFOData[c] + nCopy, (mResampleFIFOFrames - nCopy) * sizeof(T));
+  }
+
+  mResampleFIFOFrames -= nCopy;
+}
+
+template<typename T>
+void IPlugProcessor<T>::ProcessFixedBlocks(T** ppInData, T** ppOutData, int nFrames)
+{
+  T** ppFixedInData = mFixedBlockData[ERoute::kInput].Get();
+  T** ppFixedOutData = mFixedBlockData[ERoute::kOutput].Get();
+  const int nIn = MaxNChannels(ERoute::kInput), nOut = MaxNChannels(ERoute::kOutput);
+
+  // the events are held back with the audio, relative to the start of the fixed block they fall in
+  QueueFixedBlockEvents(mParamEvents.Get(), mNParamEvents, mFixedParamEvents.Get(), mNFixedParamEvents, mFixedParamEvents.GetSize(), mFixedBlockFill,
+                        [&](const IParamEvent& event) { ProcessParamEvent(event); });
+  QueueFixedBlockEvents(mMidiEvents.Get(), mNMidiEvents, mFixedMidiEvents.Get(), mNFixedMidiEvents, mFixedMidiEvents.GetSize(), mFixedBlockFill,
+                        [&](IMidiMsg msg) { msg.mOffset = 0; ProcessMidiMsg(msg); });
+
+  int pos = 0;
+
+  while (pos < nFrames)
+  {
+    // the outputs are those of the last block, so the inputs are taken first in case the buffers are in-place
+    const int n = std::min(nFrames - pos, mFixedBlockSize - mFixedBlockFill);
+
+    for (auto c = 0; c < nIn; ++c)
+      memcpy(ppFixedInData[c] + mFixedBlockFill, ppInData[c] + pos, n * sizeof(T));
+
+    for (auto c = 0; c < nOut; ++c)
+      memcpy(ppOutData[c] + pos, ppFixedOutData[c] + mFixedBlockFill, n * sizeof(T));
+
+    mFixedBlockFill += n;
+    pos += n;
+
+    if (mFixedBlockFill == mFixedBlockSize)
+    {
+      TakeFixedBlockEvents(mFixedParamEvents.Get(), mNFixedParamEvents, mParamEvents.Get(), mNParamEvents, mFixedBlockSize);
+      TakeFixedBlockEvents(mFixedMidiEvents.Get(), mNFixedMidiEvents, mMidiEvents.Get(), mNMidiEvents, mFixedBlockSize);
+      ProcessEventBlocks(ppFixedInData, ppFixedOutData, mFixedBlockSize);
+      mFixedBlockFill = 0;
+    }
+  }
+}
+
+template<typename T>
+void IPlugProcessor<T>::ProcessEventBlocks(T** ppInData, T** ppOutData, int nFrames)
+{
+  if (!mNParamEvents && !mNMidiEvents)
+  {
+    ProcessParamRamps(0, nFrames);
+    ProcessBlockWithLayout(ppInData, ppOutData, nFrames);
+    return;
+  }
+
+  const IParamEvent* pParamEvents = mParamEvents.Get();
+  const IMidiMsg* pMidiEvents = mMidiEvents.Get();
+  T** ppSubInData = mSubBlockData[ERoute::kInput].Get();
+  T** ppSubOutData = mSubBlockData[ERoute::kOutput].Get();
+  const int nIn = MaxNChannels(ERoute::kInput);
+  const int nOut = MaxNChannels(ERoute::kOutput);
+  int paramIdx = 0;
+  int midiIdx = 0;
+  int start = 0;
+
+  while (start < nFrames)
+  {
+    // events that fall within the minimum sub-block size are applied together at the start of the sub-block, merged in time order
+    while (true)
+    {
+      const bool paramDue = paramIdx < mNParamEvents && pParamEvents[paramIdx].mOffset < start + mMinSubBlockSize;
+      const bool midiDue = midiIdx < mNMidiEvents && pMidiEvents[midiIdx].mOffset < start + mMinSubBlockSize;
+
+      if (paramDue && (!midiDue || pParamEvents[paramIdx].mOffset <= pMidiEvents[midiIdx].mOffset))
+      {
+        ProcessParamEvent(pParamEvents[paramIdx++]);
+      }
+      else if (midiDue)
+      {
+        IMidiMsg msg = pMidiEvents[midiIdx++];
+        msg.mOffset = std::max(msg.mOffset - start, 0);
+        ProcessMidiMsg(msg);
+      }
+      else
+        break;
+    }
+
+    int end = nFrames;
+
+    if (paramIdx < mNParamEvents)
+      end = std::min(end, pParamEvents[paramIdx].mOffset);
+
+    if (midiIdx < mNMidiEvents)
+      end = std::min(end, pMidiEvents[midiIdx].mOffset);
+
+    for (auto c = 0; c < nIn; ++c)
+      ppSubInData[c] = ppInData[c] + start;
+
+    for (auto c = 0; c < nOut; ++c)
+      ppSubOutData[c] = ppOutData[c] + start;
+
+    mSubBlockOffset = start;
+    ProcessParamRamps(start, end - start);
+    ProcessBlockWithLayout(ppSubInData, ppSubOutData, end - start);
+    start = end;
+  }
+
+  // anything with an offset beyond the end of the block
+  while (paramIdx < mNParamEvents)
+    ProcessParamEvent(pParamEvents[paramIdx++]);
+
+  while (midiIdx < mNMidiEvents)
+  {
+    IMidiMsg msg = pMidiEvents[midiIdx++];
+    msg.mOffset = 0;
+    ProcessMidiMsg(msg);
+  }
+
+  mNParamEvents = 0;
+  mNMidiEvents = 0;
+  mSubBlockOffset = 0;
+}
+
+template<typename T>
+template <class DELEGATE>
+void IPlugProcessor<T>::CreateParamRamps(DELEGATE& delegate)
+{
+  while (mParamRamps.GetSize() < delegate.NParams())
+    mParamRamps.Add(nullptr);
+
+  for (auto i = 0; i < delegate.NParams(); ++i)
+  {
+    const IParam* pParam = delegate.GetParam(i);
+
+    if (mParamRamps.Get(i) || pParam->GetSmoothing() == IParam::kSmoothNone)
+      continue;
+
+    ControlRampBuffer<T>* pRamp = new ControlRampBuffer<T>;
+    pRamp->Resize(mBlockSize);
+    pRamp->Reset(pParam->Value());
+    mParamRamps.Set(i, pRamp);
+  }
+}
+
+template<typename T>
+template <class DELEGATE>
+void IPlugProcessor<T>::RenderParamRamps(DELEGATE& delegate, int startIdx, int nFrames)
+{
+  const double msToSamples = 0.001 * GetSampleRate();
+  const int nRamps = std::min(delegate.NParams(), mParamRamps.GetSize());
+
+  for (auto i = 0; i < nRamps; ++i)
+  {
+    ControlRampBuffer<T>* pRamp = mParamRamps.Get(i);
+
+    if (!pRamp)
+      continue;
+
+    const IParam* pParam = delegate.GetParam(i);
+    pRamp->Process(pParam->Value(), pParam->GetSmoothing(), pParam->GetSmoothingTime() * msToSamples, startIdx, nFrames);
   }
 }
 
 template<typename T>
 void IPlugProcessor<T>::PassThroughBuffers(PLUG_SAMPLE_DST type, int nFrames)
 {
+  FlushEvents();
+  mOutputsSilent = false;
+  mSilentSamples = 0;
+
+  T** ppInData = mScratchData[ERoute::kInput].Get();
+  T** ppOutData = mScratchData[ERoute::kOutput].Get();
+
+  if (!mLastBlockBypassed)
+  {
+    // crossfade from the processed signal to the (delayed) dry signal. The dry signal is taken first, in case ProcessBlock() is in-place
+    mLastBlockBypassed = true;
+    T** ppDryData = ProcessDryBuffers(nFrames);
+    UpdateInputsAliasOutputs();
+    ProcessSubBlocks(nFrames);
+    CrossfadeBuffers(ppOutData, ppDryData, nFrames);
+    return;
+  }
+
+  if (mLatency && mLatencyDelay)
+    mLatencyDelay->ProcessBlock(ppInData, ppOutData, nFrames);
+  else
+    IPlugProcessor<T>::ProcessBlock(ppInData, ppOutData, nFrames);
+}
+
+template<typename T>
+T** IPlugProcessor<T>::ProcessDryBuffers(int nFrames)
+{
+  T** ppInData = mScratchData[ERoute::kInput].Get();
+  T** ppDryData = mDryData.Get();
+
   if (mLatency && mLatencyDelay)
-    mLatencyDelay->ProcessBlock(mScratchData[ERoute::kInput].Get(), mScratchData[ERoute::kOutput].Get(), nFrames);
+    mLatencyDelay->ProcessBlock(ppInData, ppDryData, nFrames);
   else
-    IPlugProcessor<T>::ProcessBlock(mScratchData[ERoute::kInput].Get(), mScratchData[ERoute::kOutput].Get(), nFrames);
+    IPlugProcessor<T>::ProcessBlock(ppInData, ppDryData, nFrames);
+
+  return ppDryData;
+}
+
+template<typename T>
+void IPlugProcessor<T>::CrossfadeBuffers(T** ppFrom, T** ppTo, int nFrames)
+{
+  T** ppOutData = mScratchData[ERoute::kOutput].Get();
+  const int fadeFrames = std::min(nFrames, BYPASS_CROSSFADE_SAMPLES);
+  const T step = (T) 1. / (T) fadeFrames;
+
+  for (auto c = 0; c < MaxNChannels(ERoute::kOutput); ++c)
+  {
+    const T* pFrom = ppFrom[c];
+    const T* pTo = ppTo[c];
+    T* pOut = ppOutData[c];
+    T gain = 0.;
+
+    for (auto s = 0; s < fadeFrames; ++s, gain += step)
+      pOut[s] = pFrom[s] + gain * (pTo[s] - pFrom[s]);
+
+    if (pOut != pTo)
+      memcpy(pOut + fadeFrames, pTo + fadeFrames, (nFrames - fadeFrames) * sizeof(T));
+  }
 }
 
 template<typename T>
@@ -429,91 +922,356 @@ void IPlugProcessor<T>::PassThroughBuffers(PLUG_SAMPLE_SRC type, int nFrames)
   }
 }
 
+template<typename T>
+void IPlugProcessor<T>::UpdateInputsAliasOutputs()
+{
+  const int n = std::min(MaxNChannels(ERoute::kInput), MaxNChannels(ERoute::kOutput));
+  T** ppInData = mScratchData[ERoute::kInput].Get();
+  T** ppOutData = mScratchData[ERoute::kOutput].Get();
+
+  IChannelData<>** ppInChannels = mChannelData[ERoute::kInput].GetList();
+  bool alias = false;
+
+  ForEachChannel(0, n, [&](int i) {
+    alias |= ppInChannels[i]->mConnected && ppInData[i] == ppOutData[i];
+  });
+
+  mInputsAliasOutputs = alias;
+}
+
 template<typename T>
 void IPlugProcessor<T>::ProcessBuffers(PLUG_SAMPLE_DST type, int nFrames)
 {
-  ProcessBlock(mScratchData[ERoute::kInput].Get(), mScratchData[ERoute::kOutput].Get(), nFrames);
+  IPLUG_REALTIME_SCOPE;
+  IPlugDenormalGuard denormalGuard(mFlushDenormals);
+  const bool renderingOffline = GetRenderingOffline();
+
+  // at the block boundary, so that no block mixes the realtime and offline settings
+  if (renderingOffline != mOfflineSettingsApplied)
+  {
+    mOfflineSettingsApplied = renderingOffline;
+    mOfflinePolicy.Apply(renderingOffline);
+    OnRenderingOfflineChanged(renderingOffline);
+  }
+
+  IPlugLoadMeter::Scope loadScope(mLoadMeter, nFrames, mHostSampleRate, !renderingOffline);
+#ifdef IPLUG_PROFILE
+  // declared before the profiler's block, so that the markers are totalled by the time the watchdog reads them
+  IPlugXrunWatchdog::Scope watchdogScope(mXrunWatchdog, nFrames, mHostSampleRate, mNParamEvents, mNMidiEvents, &mProfiler, !renderingOffline);
+  IPlugProfiler::Block profileBlock(mProfiler, nFrames, mHostSampleRate);
+#else
+  IPlugXrunWatchdog::Scope watchdogScope(mXrunWatchdog, nFrames, mHostSampleRate, mNParamEvents, mNMidiEvents, nullptr, !renderingOffline);
+#endif
+  UpdateInputsAliasOutputs();
+
+  // the latency delay keeps running while not bypassed, so that it is ready to crossfade to on bypass
+  if (mLastBlockBypassed || (mLatency && mLatencyDelay))
+  {
+    T** ppDryData = ProcessDryBuffers(nFrames);
+
+    if (mLastBlockBypassed)
+    {
+      // crossfade from the (delayed) dry signal to the processed signal
+      mLastBlockBypassed = false;
+      ProcessSubBlocks(nFrames);
+      CrossfadeBuffers(ppDryData, mScratchData[ERoute::kOutput].Get(), nFrames);
+      CountDenormalOutputs(nFrames);
+      return;
+    }
+  }
+
+  ProcessSubBlocks(nFrames);
+  CountDenormalOutputs(nFrames);
+}
+
+template<typename T>
+void IPlugProcessor<T>::CountDenormalOutputs(int nFrames)
+{
+#ifndef NDEBUG
+  IChannelData<>** ppOutChannels = mChannelData[ERoute::kOutput].GetList();
+  uint64_t count = 0;
+
+  ForEachChannel(0, MaxNChannels(ERoute::kOutput), [&](int i) {
+    if (ppOutChannels[i]->mConnected)
+      count += IPlugDenormalGuard::CountDenormals(*(ppOutChannels[i]->mData), nFrames);
+  });
+
+  if (count)
+    mNDenormalOutputs.fetch_add(count, std::memory_order_relaxed);
+#endif
 }
 
 template<typename T>
 void IPlugProcessor<T>::ProcessBuffers(PLUG_SAMPLE_SRC type, int nFrames)
 {
-  ProcessBlock(mScratchData[ERoute::kInput].Get(), mScratchData[ERoute::kOutput].Get(), nFrames);
-  int i, n = MaxNChannels(ERoute::kOutput);
-  IChannelData<>** ppOutChannel = mChannelData[ERoute::kOutput].GetList();
+  ProcessBuffers(PLUG_SAMPLE_DST(0.), nFrames);
+  IChannelData<>** ppOutChannels = mChannelData[ERoute::kOutput].GetList();
 
-  for (i = 0; i < n; ++i, ++ppOutChannel)
-  {
-    IChannelData<>* pOutChannel = *ppOutChannel;
+  ForEachChannel(0, MaxNChannels(ERoute::kOutput), [&](int i) {
+    IChannelData<>* pOutChannel = ppOutChannels[i];
 
     if (pOutChannel->mConnected)
     {
       CastCopy(pOutChannel->mIncomingData, *(pOutChannel->mData), nFrames);
     }
-  }
+  });
 }
 
 template<typename T>
 void IPlugProcessor<T>::ProcessBuffersAccumulating(int nFrames)
 {
-  ProcessBlock(mScratchData[ERoute::kInput].Get(), mScratchData[ERoute::kOutput].Get(), nFrames);
-  int i, n = MaxNChannels(ERoute::kOutput);
-  IChannelData<>** ppOutChannel = mChannelData[ERoute::kOutput].GetList();
+  ProcessBuffers(PLUG_SAMPLE_DST(0.), nFrames);
+  IChannelData<>** ppOutChannels = mChannelData[ERoute::kOutput].GetList();
 
-  for (i = 0; i < n; ++i, ++ppOutChannel)
-  {
-    IChannelData<>* pOutChannel = *ppOutChannel;
+  ForEachChannel(0, MaxNChannels(ERoute::kOutput), [&](int i) {
+    IChannelData<>* pOutChannel = ppOutChannels[i];
     if (pOutChannel->mConnected)
     {
       PLUG_SAMPLE_SRC* pDest = pOutChannel->mIncomingData;
       PLUG_SAMPLE_DST* pSrc = *(pOutChannel->mData); // TODO : check this: PLUG_SAMPLE_DST will allways be float, because this is only for VST2 accumulating
-      for (int j = 0; j < nFrames; ++j, ++pDest, ++pSrc)
-      {
-        *pDest += (PLUG_SAMPLE_SRC) *pSrc;
-      }
+      AccumulateSamples(pDest, pSrc, nFrames);
     }
-  }
+  });
 }
 
 template<typename T>
 void IPlugProcessor<T>::ZeroScratchBuffers()
 {
-  int i, nIn = MaxNChannels(ERoute::kInput), nOut = MaxNChannels(ERoute::kOutput);
+  memset(mScratchArena[ERoute::kInput].Get(), 0, mScratchArena[ERoute::kInput].GetSize() * sizeof(PLUG_SAMPLE_DST));
+  memset(mScratchArena[ERoute::kOutput].Get(), 0, mScratchArena[ERoute::kOutput].GetSize() * sizeof(PLUG_SAMPLE_DST));
+}
 
-  for (i = 0; i < nIn; ++i)
+template<typename T>
+void IPlugProcessor<T>::AllocateScratchBuffers(ERoute direction, int blockSize)
+{
+  const int alignSamples = SCRATCH_BUFFER_ALIGNMENT / sizeof(PLUG_SAMPLE_DST);
+  int stride = ((blockSize + alignSamples - 1) / alignSamples) * alignSamples;
+
+  // a stride that is a multiple of the page size maps every channel to the same cache sets, so pad it by a line
+  if ((stride * sizeof(PLUG_SAMPLE_DST)) % 4096 == 0)
+    stride += alignSamples;
+
+  const int nChans = MaxNChannels(direction);
+  WDL_TypedBuf<PLUG_SAMPLE_DST>& arena = mScratchArena[direction];
+  arena.Resize(nChans * stride + alignSamples);
+  memset(arena.Get(), 0, arena.GetSize() * sizeof(PLUG_SAMPLE_DST));
+
+  PLUG_SAMPLE_DST* pArena = arena.GetAligned(SCRATCH_BUFFER_ALIGNMENT);
+
+  for (auto i = 0; i < nChans; ++i)
   {
-    IChannelData<>* pInChannel = mChannelData[ERoute::kInput].Get(i);
-    memset(pInChannel->mScratchBuf.Get(), 0, mBlockSize * sizeof(PLUG_SAMPLE_DST));
+    IChannelData<>* pChannel = mChannelData[direction].Get(i);
+    pChannel->mScratchBuf = pArena + i * stride;
+
+    if (!pChannel->mConnected)
+      *(pChannel->mData) = pChannel->mScratchBuf;
   }
+}
 
-  for (i = 0; i < nOut; ++i)
+template<typename T>
+void IPlugProcessor<T>::SetSampleRate(double sampleRate)
+{
+  mHostSampleRate = sampleRate;
+  mSampleRate = mInternalSampleRate > 0. ? mInternalSampleRate : sampleRate;
+  UpdateResampling();
+}
+
+template<typename T>
+void IPlugProcessor<T>::SetInternalSampleRate(double sampleRate)
+{
+  mInternalSampleRate = sampleRate;
+  SetSampleRate(mHostSampleRate);
+}
+
+template<typename T>
+void IPlugProcessor<T>::SetFixedBlockSize(int blockSize)
+{
+  const int nIn = MaxNChannels(ERoute::kInput), nOut = MaxNChannels(ERoute::kOutput);
+
+  mFixedBlockSize = std::max(blockSize, 0);
+  mFixedBlockFill = 0;
+  mFixedBlockBuffer.Resize((nIn + nOut) * mFixedBlockSize);
+  memset(mFixedBlockBuffer.Get(), 0, mFixedBlockBuffer.GetSize() * sizeof(T));
+  mFixedBlockData[ERoute::kInput].Resize(nIn);
+  mFixedBlockData[ERoute::kOutput].Resize(nOut);
+
+  for (auto i = 0; i < nIn + nOut; ++i)
+  {
+    T** ppData = i < nIn ? mFixedBlockData[ERoute::kInput].Get() + i : mFixedBlockData[ERoute::kOutput].Get() + i - nIn;
+    *ppData = mFixedBlockBuffer.Get() + i * mFixedBlockSize;
+  }
+
+  mFixedParamEvents.Resize(mFixedBlockSize ? MAX_PARAM_EVENTS_PER_BLOCK : 0);
+  mFixedMidiEvents.Resize(mFixedBlockSize ? MAX_MIDI_EVENTS_PER_BLOCK : 0);
+  mNFixedParamEvents = 0;
+  mNFixedMidiEvents = 0;
+
+  // the block buffers and the reported latency follow
+  UpdateResampling();
+}
+
+template<typename T>
+void IPlugProcessor<T>::UpdateResampling()
+{
+  const bool resample = mInternalSampleRate > 0. && std::llround(mInternalSampleRate) != std::llround(mHostSampleRate);
+
+  mInputResampler = nullptr;
+  mOutputResampler = nullptr;
+
+  if (resample && mHostBlockSize > 0)
+  {
+    const int nIn = MaxNChannels(ERoute::kInput), nOut = MaxNChannels(ERoute::kOutput);
+
+    mInputResampler = std::unique_ptr<IPlugResampler<T>>(new IPlugResampler<T>);
+    mInputResampler->Init(nIn, mHostSampleRate, mInternalSampleRate, mHostBlockSize);
+    const int internalBlockSize = mInputResampler->MaxOutputFrames(mHostBlockSize);
+
+    mOutputResampler = std::unique_ptr<IPlugResampler<T>>(new IPlugResampler<T>);
+    mOutputResampler->Init(nOut, mInternalSampleRate, mHostSampleRate, internalBlockSize);
+
+    // start the output resampler late enough in its first input that the delay of the pair is a whole number of host samples.
+    // It may then produce one fewer frame, so the FIFO starts with one frame of silence
+    const int64_t outputDelay = (int64_t) mOutputResampler->GetLatency() * mOutputResampler->GetL();
+    const int startPhase = (int) (outputDelay % mOutputResampler->GetM());
+    mOutputResampler->Reset(startPhase);
+    mResampleFIFOPrefill = startPhase ? 1 : 0;
+    mResampleLatency = mInputResampler->GetLatency() + (int) (outputDelay / mOutputResampler->GetM()) + mResampleFIFOPrefill;
+
+    // the frames left over never exceed one internal frame's worth of host frames, plus one
+    const int fifoSize = mOutputResampler->MaxOutputFrames(internalBlockSize) + mOutputResampler->GetL() / mOutputResampler->GetM() + 2 + mResampleFIFOPrefill;
+
+    mResampleBuffer.Resize((nIn + nOut) * internalBlockSize + nOut * fifoSize);
+    memset(mResampleBuffer.Get(), 0, mResampleBuffer.GetSize() * sizeof(T));
+    mResampleData[ERoute::kInput].Resize(nIn);
+    mResampleData[ERoute::kOutput].Resize(nOut);
+    mResampleFIFOData.Resize(nOut);
+    mResampleFIFOWrite.Resize(nOut);
+    mResampleFIFOFrames = mResampleFIFOPrefill;
+
+    T* pBuffer = mResampleBuffer.Get();
+
+    for (auto i = 0; i < nIn; ++i, pBuffer += internalBlockSize)
+      mResampleData[ERoute::kInput].Get()[i] = pBuffer;
+
+    for (auto i = 0; i < nOut; ++i, pBuffer += internalBlockSize)
+      mResampleData[ERoute::kOutput].Get()[i] = pBuffer;
+
+    for (auto i = 0; i < nOut; ++i, pBuffer += fifoSize)
+      mResampleFIFOData.Get()[i] = pBuffer;
+
+    ResizeBlockBuffers(mFixedBlockSize ? mFixedBlockSize : internalBlockSize);
+  }
+  else if (mHostBlockSize > 0)
+    ResizeBlockBuffers(mFixedBlockSize ? mFixedBlockSize : mHostBlockSize);
+
+  // the resamplers and fixed blocks add to the latency reported to the host. The API classes notify it of changes, once it has set up processing
+  if (HostLatency(mPluginLatency) != mLatency)
   {
-    IChannelData<>* pOutChannel = mChannelData[ERoute::kOutput].Get(i);
-    memset(pOutChannel->mScratchBuf.Get(), 0, mBlockSize * sizeof(PLUG_SAMPLE_DST));
+    if (mHostBlockSize > 0)
+      SetLatency(mPluginLatency);
+    else
+      IPlugProcessor<T>::SetLatency(mPluginLatency);
   }
 }
 
 template<typename T>
 void IPlugProcessor<T>::SetBlockSize(int blockSize)
 {
-  if (blockSize != mBlockSize)
+  if (blockSize != mHostBlockSize)
   {
-    int i, nIn = MaxNChannels(ERoute::kInput), nOut = MaxNChannels(ERoute::kOutput);
+    AllocateScratchBuffers(ERoute::kInput, blockSize);
+    AllocateScratchBuffers(ERoute::kOutput, blockSize);
+
+    mDryBuffer.Resize(blockSize * MaxNChannels(ERoute::kOutput));
+    mDryData.Resize(MaxNChannels(ERoute::kOutput));
+
+    memset(mDryBuffer.Get(), 0, mDryBuffer.GetSize() * sizeof(T));
+
+    for (auto i = 0; i < MaxNChannels(ERoute::kOutput); ++i)
+      mDryData.Get()[i] = mDryBuffer.Get() + i * blockSize;
 
-    for (i = 0; i < nIn; ++i)
+    mHostBlockSize = blockSize;
+    UpdateResampling();
+  }
+
+  // after UpdateResampling(), so that new ramps are the size of the blocks. Parameters may have been given smoothing since the last call
+  AllocateParamRamps();
+}
+
+template<typename T>
+void IPlugProcessor<T>::ResizeBlockBuffers(int blockSize)
+{
+  if (blockSize != mBlockSize)
+  {
+    if (mProcessInterleaved)
     {
-      IChannelData<>* pInChannel = mChannelData[ERoute::kInput].Get(i);
-      pInChannel->mScratchBuf.Resize(blockSize);
-      memset(pInChannel->mScratchBuf.Get(), 0, blockSize * sizeof(PLUG_SAMPLE_DST));
+      mInterleavedData[ERoute::kInput].Resize(blockSize * MaxNChannels(ERoute::kInput));
+      mInterleavedData[ERoute::kOutput].Resize(blockSize * MaxNChannels(ERoute::kOutput));
     }
 
-    for (i = 0; i < nOut; ++i)
+    for (auto i = 0; i < mParamRamps.GetSize(); ++i)
     {
-      IChannelData<>* pOutChannel = mChannelData[ERoute::kOutput].Get(i);
-      pOutChannel->mScratchBuf.Resize(blockSize);
-      memset(pOutChannel->mScratchBuf.Get(), 0, blockSize * sizeof(PLUG_SAMPLE_DST));
+      if (mParamRamps.Get(i))
+        mParamRamps.Get(i)->Resize(blockSize);
     }
 
     mBlockSize = blockSize;
+    ReserveBlockArena();
   }
 }
+
+template<typename T>
+void IPlugProcessor<T>::SetBlockArenaSize(int bytesPerFrame, int fixedBytes)
+{
+  mBlockArenaBytesPerFrame = bytesPerFrame;
+  mBlockArenaFixedBytes = fixedBytes;
+  ReserveBlockArena();
+}
+
+template<typename T>
+void IPlugProcessor<T>::ReserveBlockArena()
+{
+  if (mBlockArenaBytesPerFrame == 0 && mBlockArenaFixedBytes == 0)
+    return;
+
+  mBlockArena.Reserve(mBlockArenaBytesPerFrame * mBlockSize + mBlockArenaFixedBytes + BLOCK_ARENA_MAX_ALLOCATIONS * SCRATCH_BUFFER_ALIGNMENT);
+}
+
+template<typename T>
+void IPlugProcessor<T>::ReportProcessorMemory(IMemoryReport& report) const
+{
+  report.Add(kMemoryBuffers, "Scratch", IMemoryReport::GetBufferBytes(mScratchArena[ERoute::kInput]) + IMemoryReport::GetBufferBytes(mScratchArena[ERoute::kOutput]));
+  report.Add(kMemoryBuffers, "Interleaved", IMemoryReport::GetBufferBytes(mInterleavedData[ERoute::kInput]) + IMemoryReport::GetBufferBytes(mInterleavedData[ERoute::kOutput]));
+  report.Add(kMemoryBuffers, "Dry", IMemoryReport::GetBufferBytes(mDryBuffer));
+  report.Add(kMemoryBuffers, "Block arena", mBlockArena.GetCapacity());
+  report.Add(kMemoryBuffers, "Fixed block", IMemoryReport::GetBufferBytes(mFixedBlockBuffer));
+  report.Add(kMemoryBuffers, "Resampling", IMemoryReport::GetBufferBytes(mResampleBuffer));
+
+  int64_t rampBytes = 0;
+  int nRamps = 0;
+
+  // parameters without smoothing have no ramp
+  for (int i = 0; i < mParamRamps.GetSize(); i++)
+  {
+    if (const ControlRampBuffer<T>* pRamp = mParamRamps.Get(i))
+    {
+      rampBytes += pRamp->GetBytes();
+      nRamps++;
+    }
+  }
+
+  report.Add(kMemoryBuffers, "Parameter ramps", rampBytes, nRamps);
+  report.Add(kMemoryQueues, "Parameter events", IMemoryReport::GetBufferBytes(mParamEvents) + IMemoryReport::GetBufferBytes(mFixedParamEvents));
+  report.Add(kMemoryQueues, "MIDI events", IMemoryReport::GetBufferBytes(mMidiEvents) + IMemoryReport::GetBufferBytes(mFixedMidiEvents));
+
+  int64_t resamplerBytes = 0;
+
+  if (mInputResampler)
+    resamplerBytes += mInputResampler->GetBytes();
+
+  if (mOutputResampler)
+    resamplerBytes += mOutputResampler->GetBytes();
+
+  report.Add(kMemoryDSP, "Resamplers", resamplerBytes);
+  report.Add(kMemoryDSP, "Latency delay", mLatencyDelay ? mLatencyDelay->GetBytes() : 0);
+}
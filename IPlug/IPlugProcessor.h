@@ -10,8 +10,10 @@
 
 #pragma once
 
+#include <atomic>
 #include <cstring>
 #include <cstdint>
+#include <climits>
 #include <memory>
 
 #include "ptrlist.h"
@@ -20,7 +22,19 @@
 #include "IPlugConstants.h"
 #include "IPlugStructs.h"
 #include "IPlugUtilities.h"
+#include "IPlugControlRamp.h"
+#include "IPlugArena.h"
+#include "IPlugLoadMeter.h"
+#include "IPlugProfiler.h"
+#include "IPlugXrunWatchdog.h"
+#include "IPlugRealtimeCheck.h"
+#include "IPlugDenormals.h"
+#include "IPlugRealtimeThread.h"
+#include "IPlugOfflinePolicy.h"
+#include "IPlugTransport.h"
+#include "IPlugMemoryReport.h"
 #include "NChanDelay.h"
+#include "IPlugResampler.h"
 
 /**
  * @file
@@ -48,12 +62,21 @@ public:
    * In ProcessBlock you are always guaranteed to get valid pointers to all the channels the plugin requested
    * (the maximum possible input channel count and the maximum possible output channel count including multiple buses).
    * If the host hasn't connected all the pins, the unconnected channels will be full of zeros.
+   * Inputs and outputs may share memory if the host processes in place or PLUG_DOES_IN_PLACE_PROCESSING is set, check InputsAliasOutputs().
    * THIS METHOD IS CALLED BY THE HIGH PRIORITY AUDIO THREAD - You should be careful not to do any unbounded, blocking operations such as file I/O which could cause audio dropouts
    * @param inputs Two-dimensional array containing the non-interleaved input buffers of audio samples for all channels
    * @param outputs Two-dimensional array for audio output (non-interleaved).
    * @param nFrames The block size for this block: number of samples per channel.*/
   virtual void ProcessBlock(T** inputs, T** outputs, int nFrames);
 
+  /** Override in your plug-in class to process audio as interleaved frames. This is called instead of ProcessBlock() if PLUG_PROCESS_INTERLEAVED is set to 1 in config.h.
+   * The framework transposes the planar host buffers to and from interleaved buffers, that hold all the channels the plug-in requested
+   * THIS METHOD IS CALLED BY THE HIGH PRIORITY AUDIO THREAD - You should be careful not to do any unbounded, blocking operations such as file I/O which could cause audio dropouts
+   * @param inputs Interleaved input frames, each of MaxNChannels(ERoute::kInput) samples
+   * @param outputs Interleaved output frames, each of MaxNChannels(ERoute::kOutput) samples
+   * @param nFrames The block size for this block: number of frames */
+  virtual void ProcessBlockInterleaved(T* inputs, T* outputs, int nFrames);
+
   /** Override this method to handle incoming MIDI messages. The method is called prior to ProcessBlock().
    * You can use IMidiQueue in combination with this method in order to queue the message and process at the appropriate time in ProcessBlock()
    * THIS METHOD IS CALLED BY THE HIGH PRIORITY AUDIO THREAD - You should be careful not to do any unbounded, blocking operations such as file I/O which could cause audio dropouts
@@ -64,6 +87,12 @@ public:
    * THIS METHOD IS CALLED BY THE HIGH PRIORITY AUDIO THREAD - You should be careful not to do any unbounded, blocking operations such as file I/O which could cause audio dropouts */
   virtual void ProcessSysEx(ISysEx& msg) {}
 
+  /** Called by IPlugProcessor at the start of each sub-block when sample accurate parameter changes are enabled (see SetSampleAccurateParams()).
+   * The API classes implement this to update the IParam and call OnParamChange() with the event's sample offset.
+   * THIS METHOD IS CALLED BY THE HIGH PRIORITY AUDIO THREAD
+   * @param event The parameter change, which takes effect from the start of the next call to ProcessBlock() */
+  virtual void ProcessParamEvent(const IParamEvent& event) {}
+
   /** Override this method in your plug-in class to do something prior to playback etc. (e.g.clear buffers, update internal DSP with the latest sample rate) */
   virtual void OnReset() { TRACE; }
 
@@ -90,23 +119,130 @@ public:
    * @return \c true if successful */
   virtual bool SendSysEx(const ISysEx& msg) { return false; }
 
-  /** @return Sample rate (in Hz) */
+  /** @return Sample rate (in Hz) that ProcessBlock() runs at. This is the internal sample rate, if one has been set with SetInternalSampleRate() */
   double GetSampleRate() const { return mSampleRate; }
 
-  /** @return Current block size in samples */
+  /** @return Current block size in samples, the most frames that ProcessBlock() will be called with */
   int GetBlockSize() const { return mBlockSize; }
 
-  /** @return Plugin latency (in samples) */
+  /** @return The host's sample rate (in Hz), which is only different to GetSampleRate() with an internal sample rate */
+  double GetHostSampleRate() const { return mHostSampleRate; }
+
+  /** @return The host's maximum block size in samples, which is only different to GetBlockSize() with an internal sample rate */
+  int GetHostBlockSize() const { return mHostBlockSize; }
+
+  /** @return Plugin latency (in samples, at the host's sample rate). With an internal sample rate this includes the resamplers */
   int GetLatency() const { return mLatency; }
 
-  /** @return The tail size in samples (useful for reverberation plug-ins, that may need to decay after the transport stops or an audio item ends) */
-  int GetTailSize() { return mTailSize; }
+  /** @return The tail size in samples at the host's sample rate (useful for reverberation plug-ins, that may need to decay after the transport stops or an audio item ends) */
+  int GetTailSize() { return mInputResampler && mTailSize > 1 ? ToHostSamples(mTailSize) : mTailSize; }
+
+  /** Run ProcessBlock() at a fixed sample rate, whatever the host's, for DSP that is only designed for one rate, or that is too expensive to run at 192 kHz.
+   * The inputs and outputs are converted with polyphase resamplers (see IPlugResampler) and a small FIFO absorbs the variation in the number of frames per block,
+   * so GetSampleRate() and GetBlockSize() report the internal rate and the largest internal block. SetLatency() and SetTailSize() take samples at the internal rate,
+   * and the latency reported to the host adds the resamplers' delay.
+   * NOTE: parameter and MIDI event offsets are mapped to the internal rate, but ITimeInfo::mSamplePos stays in host samples.
+   * Call this in your constructor, not on the audio thread; nothing is resampled while the host runs at the internal rate
+   * @param sampleRate The rate ProcessBlock() should run at, in Hz, or 0. to run at the host's rate */
+  void SetInternalSampleRate(double sampleRate);
+
+  /** @return The sample rate set with SetInternalSampleRate(), or 0. */
+  double GetInternalSampleRate() const { return mInternalSampleRate; }
+
+  /** Call ProcessBlock() with blocks of a fixed size, whatever the host's, for frame based DSP such as an FFT with a fixed hop size.
+   * The host's inputs are collected in a FIFO, and each time it has a whole block ProcessBlock() is called, so the outputs are delayed by one block, which is added
+   * to the latency reported to the host. Parameter changes and MIDI messages that go through the event list are held back with the audio, and their offsets are made
+   * relative to the block they fall in. With SetSampleAccurateParams() the block is still split at events.
+   * With an internal sample rate, the blocks are at that rate. Call this in your constructor, not on the audio thread
+   * @param blockSize The number of frames ProcessBlock() is called with, or 0 to use the host's blocks */
+  void SetFixedBlockSize(int blockSize);
+
+  /** @return The block size set with SetFixedBlockSize(), or 0 */
+  int GetFixedBlockSize() const { return mFixedBlockSize; }
+
+  /** Enable splitting ProcessBlock() into sub-blocks at the sample offsets of incoming parameter changes, so that automation is applied sample accurately.
+   * Changes that arrive closer together than minSubBlockSize are applied together at the start of a sub-block.
+   * NOTE: MIDI message offsets remain relative to the start of the host's block, use GetSubBlockOffset() to align them, unless SetSampleAccurateMidi() is enabled
+   * @param enable \c true to enable sub-block splitting
+   * @param minSubBlockSize The smallest number of samples between splits */
+  void SetSampleAccurateParams(bool enable, int minSubBlockSize = DEFAULT_MIN_SUB_BLOCK_SIZE) { mSampleAccurateParams = enable; mMinSubBlockSize = std::max(minSubBlockSize, 1); }
+
+  /** @return \c true if ProcessBlock() is split at parameter change points, see SetSampleAccurateParams() */
+  bool GetSampleAccurateParams() const { return mSampleAccurateParams; }
+
+  /** @return The smallest number of samples between sub-block splits, see SetSampleAccurateParams() */
+  int GetMinSubBlockSize() const { return mMinSubBlockSize; }
+
+  /** Enable merging incoming MIDI messages into the same time-sorted event list as sample accurate parameter changes, in APIs that support it (VST3, AUv3, AAX and CLAP).
+   * ProcessBlock() is then also split at MIDI messages, and ProcessMidiMsg() is called at the start of the sub-block that contains the message,
+   * after any parameter changes at the same offset, with the message's offset relative to the start of that sub-block.
+   * The smallest sub-block size is the one given to SetSampleAccurateParams()
+   * @param enable \c true to merge MIDI messages into the event list */
+  void SetSampleAccurateMidi(bool enable) { mSampleAccurateMidi = enable; }
+
+  /** @return \c true if MIDI messages are merged into the event list, see SetSampleAccurateMidi() */
+  bool GetSampleAccurateMidi() const { return mSampleAccurateMidi; }
+
+  /** @return When sample accurate parameter changes are enabled, the offset in samples of the current ProcessBlock() call from the start of the host's block, otherwise 0 */
+  int GetSubBlockOffset() const { return mSubBlockOffset; }
+
+  /** Run task(taskCtx, i) for every i in [0, nTasks) on the host's thread pool, in APIs that provide one (currently CLAP), and return once all tasks have finished.
+   * Call this from ProcessBlock() only. The tasks run concurrently with each other, so they must not share mutable state
+   * @return \c false if the host can't run the tasks, in which case none of them have run and the caller should run them itself */
+  virtual bool HostParallelFor(int nTasks, void (*task)(void* taskCtx, int taskIdx), void* taskCtx) { return false; }
+
+  /** HostParallelFor() as a plain function, with pProcessor as the context, e.g. for VoiceAllocator::SetParallelFor() */
+  static bool HostParallelForFunc(void* pProcessor, int nTasks, void (*task)(void* taskCtx, int taskIdx), void* taskCtx)
+  {
+    return static_cast<IPlugProcessor*>(pProcessor)->HostParallelFor(nTasks, task, taskCtx);
+  }
+
+  /** Enable framework managed silence detection. Once all connected inputs have been silent for longer than the tail size (see SetTailSize()) plus the latency,
+   * ProcessBlock() is skipped and the outputs are zeroed until non-silent input arrives. The API classes report silent outputs to the host where possible.
+   * NOTE: detection is only active for plug-ins with connected inputs and no MIDI input, and a negative tail size means an infinite tail.
+   * @param enable \c true to enable silence detection
+   * @param threshold The largest absolute sample value that counts as silence */
+  void SetSilenceDetection(bool enable, T threshold = 0.) { mSilenceDetection = enable; mSilenceThreshold = threshold; mSilentSamples = 0; }
+
+  /** @return \c true if silence detection is enabled, see SetSilenceDetection() */
+  bool GetSilenceDetection() const { return mSilenceDetection; }
+
+  /** @return \c true if ProcessBlock() was skipped for the last block, because the inputs and tail were silent */
+  bool GetOutputsSilent() const { return mOutputsSilent; }
+
+  /** Only valid during ProcessBlock(). Get the ramp buffer for a parameter that has a smoothing policy (see IParam::SetSmoothing()).
+   * The buffer holds one smoothed value per sample, index 0 corresponding to the first sample of the current ProcessBlock()
+   * @param paramIdx The index of the parameter
+   * @return Pointer to nFrames smoothed values, or nullptr if the parameter has never had a smoothing policy */
+  const T* GetParamRamp(int paramIdx) const
+  {
+    const ControlRampBuffer<T>* pRamp = mParamRamps.Get(paramIdx);
+    return pRamp ? pRamp->Get() + mSubBlockOffset : nullptr;
+  }
+
+  /** Only valid during ProcessBlock(). If this returns \c false the ramp buffer for the parameter is constant, so per-sample processing can be skipped
+   * @param paramIdx The index of the parameter
+   * @return \c true if the smoothed value of the parameter is changing during the current ProcessBlock() */
+  bool IsParamRampSmoothing(int paramIdx) const
+  {
+    const ControlRampBuffer<T>* pRamp = mParamRamps.Get(paramIdx);
+    return pRamp && pRamp->IsSmoothing();
+  }
 
   /** @return \c true if the plugin is currently bypassed */
   bool GetBypassed() const { return mBypassed; }
 
   /** @return \c true if the plugin is currently rendering off-line */
-  bool GetRenderingOffline() const { return mRenderingOffline; };
+  bool GetRenderingOffline() const { return mRenderingOffline.load(std::memory_order_relaxed); };
+
+  /** The settings to render with while the host renders offline, swapped in and out at block boundaries, see IPlugOfflinePolicy. Register them in your constructor
+   * @return The offline policy */
+  IPlugOfflinePolicy& GetOfflinePolicy() { return mOfflinePolicy; }
+
+  /** Override this to change what the offline policy can't, on the audio thread at the start of the first block rendered offline, or in realtime again, after the policy's settings have been swapped.
+   * Like ProcessBlock() this must neither lock nor allocate
+   * @param offline \c true if the host has started rendering offline */
+  virtual void OnRenderingOfflineChanged(bool offline) {}
 
 #pragma mark -
   /** @return The number of samples elapsed since start of project timeline. */
@@ -118,6 +254,11 @@ public:
   /** @return The number of samples in a beat */
   double GetSamplesPerBeat() const;
 
+  /** The musical position at each sample of the host's block, following tempo ramps and changes and the wrap at the end of a cycle, for tempo-synced LFOs and arpeggiators.
+   * Only valid during ProcessBlock(). Offsets are from the start of the host's block, see GetSubBlockOffset()
+   * @return The transport of the current block */
+  const IPlugTransport& GetTransport() const { return mTransport; }
+
   /** @param numerator The upper part of the current time signature e.g "6" in the time signature 6/8
    *  @param denominator The lower part of the current time signature e.g "8" in the time signature 6/8 */
   void GetTimeSig(int& numerator, int& denominator) const { numerator = mTimeInfo.mNumerator; denominator = mTimeInfo.mDenominator; }
@@ -175,8 +316,43 @@ public:
   /** @return \c true if this plug-in has a side-chain input, which may not necessarily be active in the current I/O config */
   bool HasSidechainInput() const { return MaxNBuses(ERoute::kInput) > 1; }
 
-  /** @return The number of channels and the side-chain input \todo this will change */
-  int NSidechainChannels() const { return 1; } // TODO: this needs to be more flexible, based on channel I/O
+  /** @return The total number of channels on all the side-chain/aux input buses (every input bus after the first) */
+  int NSidechainChannels() const { return HasSidechainInput() ? MaxNChannels(ERoute::kInput) - GetBusChannelOffset(ERoute::kInput, 1) : 0; }
+
+  /** Buses are laid out consecutively in the inputs and outputs arrays passed to ProcessBlock(), each taking MaxNChannelsForBus() channels
+   * @param direction Input or output
+   * @param busIdx The index of the bus
+   * @return The index of the first channel of the bus in the inputs or outputs arrays */
+  int GetBusChannelOffset(ERoute direction, int busIdx) const
+  {
+    const int nBuses = mBusChannelOffsets[direction].GetSize() - 1;
+    return mBusChannelOffsets[direction].Get()[Clip(busIdx, 0, nBuses)];
+  }
+
+  /** @param direction Input or output
+   * @param busIdx The index of the bus
+   * @return The number of channels reserved for the bus in the inputs or outputs arrays passed to ProcessBlock() */
+  int NChannelsOnBus(ERoute direction, int busIdx) const { return GetBusChannelOffset(direction, busIdx + 1) - GetBusChannelOffset(direction, busIdx); }
+
+  /** Get a bus-indexed view of the inputs or outputs arrays passed to ProcessBlock(), for example GetBusChannels(inputs, ERoute::kInput, 2) to reach the second side-chain bus
+   * @param ppChannels The inputs or outputs array passed to ProcessBlock()
+   * @param direction Input or output
+   * @param busIdx The index of the bus
+   * @return Pointer to NChannelsOnBus() channel pointers */
+  T** GetBusChannels(T** ppChannels, ERoute direction, int busIdx) const { return ppChannels + GetBusChannelOffset(direction, busIdx); }
+
+  /** @param direction Input or output
+   * @param busIdx The index of the bus
+   * @return \c true if the host has connected any channel on the bus */
+  bool IsBusConnected(ERoute direction, int busIdx) const
+  {
+    for (auto i = GetBusChannelOffset(direction, busIdx); i < GetBusChannelOffset(direction, busIdx + 1); ++i)
+    {
+      if (IsChannelConnected(direction, i))
+        return true;
+    }
+    return false;
+  }
 
   /** This is called by IPlugVST in order to limit a plug-in to stereo I/O for certain picky hosts \todo may no longer be relevant*/
   void LimitToStereoIO();//TODO: this should be updated
@@ -216,6 +392,24 @@ public:
   /** @return \c true if the plug-in was configured to support midi polyphonic expression at compile time */
   bool DoesMPE() const { return mDoesMPE; }
 
+  /** @return \c true if the plug-in was configured (PLUG_DOES_IN_PLACE_PROCESSING) to accept input and output buffers that share memory */
+  bool DoesInPlaceProcessing() const { return mDoesInPlaceProcessing; }
+
+  /** @return \c true if the plug-in was configured (PLUG_PROCESS_INTERLEAVED) to process interleaved frames in ProcessBlockInterleaved() */
+  bool GetProcessInterleaved() const { return mProcessInterleaved; }
+
+  /** @return \c true if the plug-in was configured (PLUG_FLUSH_DENORMALS) to process with flush-to-zero and denormals-are-zero set, see IPlugDenormalGuard */
+  bool GetFlushDenormals() const { return mFlushDenormals; }
+
+  /** Only counted in debug builds, since it reads every output sample once more. Most useful with PLUG_FLUSH_DENORMALS set to 0, to find the DSP that produces them
+   * @return The number of denormal samples the plug-in has output since it was created */
+  uint64_t GetNDenormalOutputs() const { return mNDenormalOutputs.load(std::memory_order_relaxed); }
+
+  /** Only valid during ProcessBlock(). If this returns \c true, at least one connected channel has inputs[i] == outputs[i], so each input sample must be read before the corresponding output sample is written.
+   * This can only happen if the host provides in-place buffers, or if the plug-in was configured with PLUG_DOES_IN_PLACE_PROCESSING
+   * @return \c true if any connected input buffer aliases the output buffer of the same channel index */
+  bool InputsAliasOutputs() const { return mInputsAliasOutputs; }
+
   /**  This allows you to label input/output channels in supporting VST2 hosts.
    * * For example a 4 channel plug-in that deals with FuMa BFormat first order ambisonic material, might label these channels
    "W", "X", "Y", "Z", rather than the default "input 1", "input 2", "input 3", "input 4"
@@ -226,9 +420,49 @@ public:
 
   /** Call this if the latency of your plug-in changes after initialization (perhaps from OnReset() )
    * This may not be supported by the host. The method is virtual because it's overridden in API classes.
-   @param latency Latency in samples */
+   * The bypass delay compensation is updated lock-free and crossfaded, if latency is within SetMaxLatency(). NOTE: the API classes also notify the host, which some hosts expect on the main thread
+   @param latency Latency in samples, at the internal sample rate if one has been set with SetInternalSampleRate() */
   virtual void SetLatency(int latency);
 
+  /** Preallocate the delay line used to compensate for latency when the plug-in is bypassed, so that later calls to SetLatency() up to this value do not allocate. Call this in your constructor or OnReset(), not on the audio thread
+   * @param maxLatency The largest latency in samples that the plug-in will set */
+  void SetMaxLatency(int maxLatency);
+
+  /** Declare how much temporary memory ProcessBlock() takes from the block arena, see GetBlockArena(). The arena is reallocated to fit whenever this or the block size changes.
+   * Call this in your constructor or OnReset(), not on the audio thread
+   * @param bytesPerFrame The part of the requirement that scales with the block size, e.g. 2 * OVERSAMPLING * sizeof(sample) for a stereo oversampling buffer
+   * @param fixedBytes The part of the requirement that doesn't depend on the block size, e.g. an FFT work area */
+  void SetBlockArenaSize(int bytesPerFrame, int fixedBytes = 0);
+
+  /** A realtime safe allocator for temporary memory in ProcessBlock(), sized by SetBlockArenaSize(). It is reset before every call to ProcessBlock(),
+   * so memory taken from it must not be kept across blocks. NOTE: with sample accurate parameters ProcessBlock() may be called for a sub-block of the host's block
+   * @return The block arena */
+  IPlugArena& GetBlockArena() { return mBlockArena; }
+
+  /** The time this instance spends in each host block, against the duration of the block, measured around all the processing of the block but not when rendering offline.
+   * The results can be read on any thread without blocking the audio, e.g. by an ILoadMeterControl. NOTE: with a distributed editor the meter is only in the processor
+   * @return The processor's load meter */
+  IPlugLoadMeter& GetLoadMeter() { return mLoadMeter; }
+
+  /** The time per block spent in the stages marked with IPLUG_PROFILE_SCOPE, which is only recorded if IPLUG_PROFILE is defined
+   * @return The processor's profiler */
+  IPlugProfiler& GetProfiler() { return mProfiler; }
+
+  /** Catches the host blocks that take longer to process than their duration, keeping the context of each for a report, once it is enabled with IPlugXrunWatchdog::Enable().
+   * Like the load meter it times all the processing of the block, but not when rendering offline. NOTE: with a distributed editor the watchdog is only in the processor
+   * @return The processor's watchdog */
+  IPlugXrunWatchdog& GetXrunWatchdog() { return mXrunWatchdog; }
+
+  /** The host's audio workgroup on macOS and iOS, set by the AUv2 and AUv3 API classes when the host provides one, for the threads that help the audio thread to join,
+   * e.g. those of an IPlugRealtimePool. Empty in the other APIs and on other platforms
+   * @return The workgroup */
+  IPlugAudioWorkgroup& GetAudioWorkgroup() { return mAudioWorkgroup; }
+
+  /** Add the memory the processor holds for its buffers, queued events and resamplers to a report, called by IPlugAPIBase for IEditorDelegate::GetMemoryReport().
+   * Call on the main thread, not while the buffers may be resized in OnReset()
+   * @param report The report to add items to */
+  void ReportProcessorMemory(IMemoryReport& report) const;
+
   /** Call this method if you need to update the tail size at runtime, for example if the decay time of your reverb effect changes
    * Some apis have special interpretations of certain numbers. For VST3 set to 0xffffffff for infinite tail, or 0 for none (default)
    * For VST2 setting to 1 means no tail
@@ -248,6 +482,10 @@ public:
    * @return The number of space separated channel I/O configs that have been detected in IOStr */
   static int ParseChannelIOStr(const char* IOStr, WDL_PtrList<IOConfig>& channelIOList, int& totalNInChans, int& totalNOutChans, int& totalNInBuses, int& totalNOutBuses);
 
+  /** The same as ParseChannelIOStr(), but each string is only parsed the first time it is seen in the process, later calls copy the IOConfigs
+   * that were parsed then, so that creating many instances of a plug-in doesn't parse its channel I/O string for each of them. Takes the same arguments */
+  static int CopyChannelIOStr(const char* IOStr, WDL_PtrList<IOConfig>& channelIOList, int& totalNInChans, int& totalNOutChans, int& totalNInBuses, int& totalNOutBuses);
+
 protected:
 #pragma mark - Methods called by the API class - you do not call these methods in your plug-in class
   void SetChannelConnections(ERoute direction, int idx, int n, bool connected);
@@ -262,14 +500,129 @@ protected:
   void ProcessBuffers(PLUG_SAMPLE_DST type, int nFrames);
   void ProcessBuffersAccumulating(int nFrames); // only for VST2 deprecated method single precision
   void ZeroScratchBuffers();
-  void SetSampleRate(double sampleRate) { mSampleRate = sampleRate; }
+  void AllocateScratchBuffers(ERoute direction, int blockSize);
+  void UpdateInputsAliasOutputs();
+  void CountDenormalOutputs(int nFrames);
+  void AddParamEvent(const IParamEvent& event);
+  void AddMidiEvent(const IMidiMsg& msg);
+  void ProcessSubBlocks(int nFrames);
+  void ProcessEventBlocks(T** ppInData, T** ppOutData, int nFrames);
+  void ProcessResampled(int nFrames);
+  void ProcessFixedBlocks(T** ppInData, T** ppOutData, int nFrames);
+  void FlushEvents();
+  void ProcessBlockWithLayout(T** inputs, T** outputs, int nFrames);
+  bool UpdateSilence(int nFrames);
+  T** ProcessDryBuffers(int nFrames);
+  void ReserveBlockArena();
+  void CrossfadeBuffers(T** ppFrom, T** ppTo, int nFrames);
+
+  /** Called by IPlugProcessor before each ProcessBlock(). The API classes implement this by calling RenderParamRamps() with their parameters
+   * @param startIdx The offset of the sub-block from the start of the host's block
+   * @param nFrames The length of the sub-block */
+  virtual void ProcessParamRamps(int startIdx, int nFrames) {}
+
+  /** Called off the audio thread by SetBlockSize(), and by API classes whose hosts may not set the block size when they initialise, to create the ramp buffers.
+   * The API classes implement this by calling CreateParamRamps() with their parameters */
+  virtual void AllocateParamRamps() {}
+
+  /** Create a ramp buffer, the size of the blocks, for each parameter of delegate that has a smoothing policy and does not have one yet. This is not realtime safe */
+  template <class DELEGATE>
+  void CreateParamRamps(DELEGATE& delegate);
+
+  /** Render the ramp buffers for all the parameters of delegate that have a smoothing policy
+   * NOTE: this does not allocate, a parameter given a smoothing policy after the last SetBlockSize() has no ramp until the next, see CreateParamRamps() */
+  template <class DELEGATE>
+  void RenderParamRamps(DELEGATE& delegate, int startIdx, int nFrames);
+  void SetSampleRate(double sampleRate);
   void SetBlockSize(int blockSize);
   void SetBypassed(bool bypassed) { mBypassed = bypassed; }
-  void SetTimeInfo(const ITimeInfo& timeInfo) { mTimeInfo = timeInfo; }
-  void SetRenderingOffline(bool renderingOffline) { mRenderingOffline = renderingOffline; }
+  void SetTimeInfo(const ITimeInfo& timeInfo) { mTimeInfo = timeInfo; mTransport.Begin(timeInfo, mHostSampleRate); }
+
+  /** Called by API classes after SetTimeInfo() for the changes of tempo or position the host reports during the block, see IPlugTransport::AddChange() */
+  void AddTransportChange(int offset, double tempo, double tempoIncrement, double ppqPos = -1.) { mTransport.AddChange(offset, tempo, tempoIncrement, ppqPos); }
+  void SetRenderingOffline(bool renderingOffline) { mRenderingOffline.store(renderingOffline, std::memory_order_relaxed); }
+
+  /** Called by API classes before ProcessBuffers() when the host has flagged every connected input channel as silent (e.g. VST3 silenceFlags),
+   * so that silence detection can trust the host rather than scan the inputs. Only applies to the next block */
+  void SetInputsFlaggedSilent(bool silent) { mInputsFlaggedSilent = silent; }
   const WDL_String& GetChannelLabel(ERoute direction, int idx) { return mChannelData[direction].Get(idx)->mLabel; }
 
 private:
+  /** Allocate the buffers that depend on the size of the blocks ProcessBlock() is called with, which is the host's unless resampling */
+  void ResizeBlockBuffers(int blockSize);
+
+  /** Create or remove the resamplers, when the host's sample rate or block size changes, see SetInternalSampleRate() */
+  void UpdateResampling();
+
+  /** @return A number of samples at the internal sample rate in host samples, see SetInternalSampleRate() */
+  int ToHostSamples(double samples) const { return (int) std::lround(samples * mInputResampler->GetM() / mInputResampler->GetL()); }
+
+  /** @return The latency to report to the host for a plug-in latency, which adds the resamplers' delay if resampling */
+  int HostLatency(int samples) const { return mInputResampler ? mResampleLatency + ToHostSamples(samples + mFixedBlockSize) : samples + mFixedBlockSize; }
+
+  /** Append the events for the current host block to a fixed block event list, offset by the frames already collected, or apply them now if it is full */
+  template <class EVENT, class FUNC>
+  static void QueueFixedBlockEvents(EVENT* pEvents, int& nEvents, EVENT* pQueue, int& nQueued, int maxQueued, int offset, FUNC&& apply)
+  {
+    for (auto i = 0; i < nEvents; ++i)
+    {
+      EVENT event = pEvents[i];
+      event.mOffset += offset;
+
+      if (nQueued < maxQueued)
+        pQueue[nQueued++] = event;
+      else
+        apply(event);
+    }
+
+    nEvents = 0;
+  }
+
+  /** Move the queued events that fall within the next blockSize frames to the event list, and the rest to the start of the queue, relative to the following block */
+  template <class EVENT>
+  static void TakeFixedBlockEvents(EVENT* pQueue, int& nQueued, EVENT* pEvents, int& nEvents, int blockSize)
+  {
+    int i = 0;
+
+    for (; i < nQueued && pQueue[i].mOffset < blockSize; ++i)
+      pEvents[nEvents++] = pQueue[i];
+
+    for (auto j = i; j < nQueued; ++j)
+    {
+      pQueue[j - i] = pQueue[j];
+      pQueue[j - i].mOffset -= blockSize;
+    }
+
+    nQueued -= i;
+  }
+
+  /** Call func(i) for each channel index from startIdx to endIdx - 1. The most common channel counts are dispatched to fixed count loops, which the compiler can unroll, avoiding per-channel branches
+   * @param startIdx The first channel index
+   * @param endIdx One past the last channel index
+   * @param func A callable taking the channel index */
+  template <class FUNC>
+  static inline void ForEachChannel(int startIdx, int endIdx, FUNC&& func)
+  {
+    switch (endIdx - startIdx)
+    {
+      case 1: ForNChannels<1>(startIdx, func); break;
+      case 2: ForNChannels<2>(startIdx, func); break;
+      case 6: ForNChannels<6>(startIdx, func); break;
+      case 8: ForNChannels<8>(startIdx, func); break;
+      default:
+        for (int i = startIdx; i < endIdx; ++i)
+          func(i);
+        break;
+    }
+  }
+
+  template <int N, class FUNC>
+  static inline void ForNChannels(int startIdx, FUNC& func)
+  {
+    for (int i = 0; i < N; ++i)
+      func(startIdx + i);
+  }
+
   /** See EIPlugPluginTypes */
   EIPlugPluginType mPlugType;
   /** \c true if the plug-in accepts MIDI input */
@@ -278,29 +631,134 @@ private:
   bool mDoesMIDIOut;
   /** \c true if the plug-in supports MIDI Polyphonic Expression */
   bool mDoesMPE;
-  /** Plug-in latency (in samples) */
+  /** \c true if the plug-in can process with inputs and outputs sharing memory, see PLUG_DOES_IN_PLACE_PROCESSING */
+  bool mDoesInPlaceProcessing;
+  /** \c true if the plug-in processes interleaved frames, see PLUG_PROCESS_INTERLEAVED */
+  bool mProcessInterleaved;
+  /** \c true if ProcessBuffers() sets flush-to-zero and denormals-are-zero, see PLUG_FLUSH_DENORMALS */
+  bool mFlushDenormals;
+  /** The denormal samples output, counted in debug builds, see GetNDenormalOutputs() */
+  std::atomic<uint64_t> mNDenormalOutputs {0};
+  /** \c true if during the current ProcessBlock() at least one input buffer is the same as its output buffer */
+  bool mInputsAliasOutputs = false;
+  /** Plug-in latency (in samples), at the host's sample rate */
   int mLatency;
+  /** The latency set by the plug-in, at the internal sample rate if resampling */
+  int mPluginLatency;
   /** Current sample rate (in Hz) */
   double mSampleRate = DEFAULT_SAMPLE_RATE;
   /** Current block size (in samples) */
   int mBlockSize = 0;
+  /** The host's sample rate (in Hz) */
+  double mHostSampleRate = DEFAULT_SAMPLE_RATE;
+  /** The host's maximum block size (in samples) */
+  int mHostBlockSize = 0;
+  /** The sample rate ProcessBlock() runs at, or 0. to run at the host's, see SetInternalSampleRate() */
+  double mInternalSampleRate = 0.;
   /** Current tail size (in samples) */
   int mTailSize = 0;
   /** \c true if the plug-in is bypassed */
   bool mBypassed = false;
-  /** \c true if the plug-in is rendering off-line*/
-  bool mRenderingOffline = false;
+  /** \c true if the plug-in is rendering off-line, set by the API class on the audio thread or, in AUv2, on the main thread */
+  std::atomic<bool> mRenderingOffline {false};
+  /** \c true while the offline settings are swapped in, only touched on the audio thread, see GetOfflinePolicy() */
+  bool mOfflineSettingsApplied = false;
+  /** See GetOfflinePolicy() */
+  IPlugOfflinePolicy mOfflinePolicy;
   /** A list of IOConfig structures populated by ParseChannelIOStr in the IPlugProcessor constructor */
   WDL_PtrList<IOConfig> mIOConfigs;
   /* Manages pointers to the actual data for each channel */
   WDL_TypedBuf<T*> mScratchData[2];
+  /* One contiguous allocation per direction holding every channel's scratch buffer, each SCRATCH_BUFFER_ALIGNMENT aligned at a padded stride */
+  WDL_TypedBuf<PLUG_SAMPLE_DST> mScratchArena[2];
+  /* Interleaved input and output frames, only allocated if mProcessInterleaved */
+  WDL_TypedBuf<T> mInterleavedData[2];
+  /* The first channel index of each bus, with a final entry for the total channel count, see GetBusChannelOffset() */
+  WDL_TypedBuf<int> mBusChannelOffsets[2];
   /* A list of IChannelData structures corresponding to every input/output channel */
   WDL_PtrList<IChannelData<>> mChannelData[2];
+  /* Channel pointers offset to the start of the current sub-block, when splitting ProcessBlock() at parameter changes */
+  WDL_TypedBuf<T*> mSubBlockData[2];
+  /* Parameter changes for the current block, sorted by sample offset. Preallocated to MAX_PARAM_EVENTS_PER_BLOCK */
+  WDL_TypedBuf<IParamEvent> mParamEvents;
+  /** The number of valid entries in mParamEvents */
+  int mNParamEvents = 0;
+  /* MIDI messages for the current block, sorted by sample offset. Preallocated to MAX_MIDI_EVENTS_PER_BLOCK */
+  WDL_TypedBuf<IMidiMsg> mMidiEvents;
+  /** The number of valid entries in mMidiEvents */
+  int mNMidiEvents = 0;
+  /** \c true if ProcessBlock() is split at parameter change points */
+  bool mSampleAccurateParams = false;
+  /** \c true if MIDI messages are merged into the event list */
+  bool mSampleAccurateMidi = false;
+  /** The smallest sub-block size when splitting ProcessBlock() */
+  int mMinSubBlockSize = DEFAULT_MIN_SUB_BLOCK_SIZE;
+  /** The offset of the current sub-block from the start of the host's block */
+  int mSubBlockOffset = 0;
+  /** \c true if ProcessBlock() is skipped when the inputs and tail are silent */
+  bool mSilenceDetection = false;
+  /** \c true if ProcessBlock() was skipped for the last block */
+  bool mOutputsSilent = false;
+  /** The largest absolute sample value that counts as silence */
+  T mSilenceThreshold = 0.;
+  /** The number of samples for which the inputs have been silent */
+  int mSilentSamples = 0;
+  /** \c true if the host has flagged the inputs of the current block as silent, see SetInputsFlaggedSilent() */
+  bool mInputsFlaggedSilent = false;
+  /** \c true if the last block was passed through, used to crossfade when bypass changes */
+  bool mLastBlockBypassed = false;
+  /** The (latency compensated) dry signal, used to crossfade when bypass changes */
+  WDL_TypedBuf<T> mDryBuffer;
+  WDL_TypedBuf<T*> mDryData;
+  /** Ramp buffers indexed by parameter, nullptr for parameters that have never had a smoothing policy */
+  WDL_PtrList<ControlRampBuffer<T>> mParamRamps;
+  /** Temporary memory for ProcessBlock(), see GetBlockArena() */
+  IPlugArena mBlockArena;
+  /** The block arena requirement that scales with the block size, see SetBlockArenaSize() */
+  int mBlockArenaBytesPerFrame = 0;
+  /** The block arena requirement that doesn't depend on the block size, see SetBlockArenaSize() */
+  int mBlockArenaFixedBytes = 0;
+  /** Times ProcessBuffers(), see GetLoadMeter() */
+  IPlugLoadMeter mLoadMeter;
+  /** Aggregates IPLUG_PROFILE_SCOPE markers per block, see GetProfiler() */
+  IPlugProfiler mProfiler;
+  /** Checks ProcessBuffers() against the block's duration, see GetXrunWatchdog() */
+  IPlugXrunWatchdog mXrunWatchdog;
+  /** The host's render workgroup, see GetAudioWorkgroup() */
+  IPlugAudioWorkgroup mAudioWorkgroup;
+  /** Convert the host's inputs to the internal sample rate, and the plug-in's outputs back, nullptr unless resampling */
+  std::unique_ptr<IPlugResampler<T>> mInputResampler;
+  std::unique_ptr<IPlugResampler<T>> mOutputResampler;
+  /** The internal inputs and outputs, and the output FIFO, in one allocation */
+  WDL_TypedBuf<T> mResampleBuffer;
+  WDL_TypedBuf<T*> mResampleData[2];
+  /** The output FIFO holds the frames the output resampler has produced beyond what the host has taken, never more than a few */
+  WDL_TypedBuf<T*> mResampleFIFOData;
+  WDL_TypedBuf<T*> mResampleFIFOWrite;
+  int mResampleFIFOFrames = 0;
+  /** The frames of silence the FIFO starts with, see UpdateResampling() */
+  int mResampleFIFOPrefill = 0;
+  /** The delay of the resamplers and the FIFO, in host samples */
+  int mResampleLatency = 0;
+  /** The number of frames ProcessBlock() is always called with, or 0, see SetFixedBlockSize() */
+  int mFixedBlockSize = 0;
+  /** The number of frames collected towards the next fixed block */
+  int mFixedBlockFill = 0;
+  /** The collected inputs and the outputs of the last fixed block, in one allocation */
+  WDL_TypedBuf<T> mFixedBlockBuffer;
+  WDL_TypedBuf<T*> mFixedBlockData[2];
+  /** Events for the fixed block being collected and any after it, with offsets from its start */
+  WDL_TypedBuf<IParamEvent> mFixedParamEvents;
+  int mNFixedParamEvents = 0;
+  WDL_TypedBuf<IMidiMsg> mFixedMidiEvents;
+  int mNFixedMidiEvents = 0;
 protected: // these members are protected because they need to be access by the API classes, and don't want a setter/getter
   /** A multichannel delay line used to delay the bypassed signal when a plug-in with latency is bypassed. */
   std::unique_ptr<NChanDelayLine<T>> mLatencyDelay = nullptr;
   /** Contains detailed information about the transport state */
   ITimeInfo mTimeInfo;
+  /** The position through the block, see GetTransport() */
+  IPlugTransport mTransport;
 };
 
 #include "IPlugProcessor.cpp"
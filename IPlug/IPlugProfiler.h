@@ -0,0 +1,274 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @brief Scoped markers that time the stages of ProcessBlock()
+ *
+ * Define IPLUG_PROFILE at project level, in an optimized build, to enable. Otherwise the markers compile to nothing.
+ * To time a stage in a method of your plug-in class:    IPLUG_PROFILE_SCOPE("filter");
+ * To time a stage elsewhere, e.g. in a DSP class:       IPLUG_PROFILE_SCOPE_IN(profiler, "filter");
+ * where profiler is the plug-in's GetProfiler(). The name must be a string literal, or outlive the plug-in.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+  #ifdef _MSC_VER
+    #include <intrin.h>
+  #else
+    #include <x86intrin.h>
+  #endif
+#endif
+
+#include "IPlugLogger.h"
+
+/** The time per block spent in the scopes with each name, see IPLUG_PROFILE_SCOPE. Each plug-in instance has one, see IPlugProcessor::GetProfiler().
+ * The scopes read the CPU's cycle or virtual counter where there is one and add to preallocated per-marker totals, so they don't lock or allocate.
+ * At the end of each host block the totals are aggregated into the min, mean and max per block, which are published every kWindow seconds
+ * with relaxed atomics, so they can be read on any thread, e.g. by an ILoadMeterControl. With TRACER_BUILD the mean is also recorded as a counter, see TRACE_COUNTER */
+class IPlugProfiler
+{
+public:
+  static constexpr int kMaxMarkers = 32;
+  /** The time over which the statistics are aggregated, in seconds */
+  static constexpr double kWindow = 0.5;
+
+  /** The statistics of one marker, in seconds per block, over the last window in which it was hit */
+  struct Stats
+  {
+    float min = 0.f;
+    float mean = 0.f;
+    float max = 0.f;
+  };
+
+  /** Times the enclosing scope, see IPLUG_PROFILE_SCOPE */
+  class Scope
+  {
+  public:
+    Scope(IPlugProfiler& profiler, const char* name)
+    : mProfiler(profiler)
+    , mIdx(profiler.FindMarker(name))
+    , mStart(Ticks())
+    {
+    }
+
+    ~Scope()
+    {
+      if (mIdx >= 0)
+        mProfiler.mMarkers[mIdx].blockTicks += Ticks() - mStart;
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+  private:
+    IPlugProfiler& mProfiler;
+    const int mIdx;
+    const uint64_t mStart;
+  };
+
+  /** Ends a host block at the end of the enclosing scope, used by IPlugProcessor::ProcessBuffers() */
+  class Block
+  {
+  public:
+    Block(IPlugProfiler& profiler, int nFrames, double sampleRate)
+    : mProfiler(profiler)
+    , mDuration(sampleRate > 0. ? nFrames / sampleRate : 0.)
+    {
+    }
+
+    ~Block() { mProfiler.EndBlock(mDuration); }
+
+    Block(const Block&) = delete;
+    Block& operator=(const Block&) = delete;
+
+  private:
+    IPlugProfiler& mProfiler;
+    const double mDuration;
+  };
+
+  IPlugProfiler()
+  : mStartTicks(Ticks())
+  , mStartTime(std::chrono::steady_clock::now())
+  {
+  }
+
+  IPlugProfiler(const IPlugProfiler&) = delete;
+  IPlugProfiler& operator=(const IPlugProfiler&) = delete;
+
+  /** @return The number of markers that have been hit */
+  int GetNMarkers() const { return mNMarkers.load(std::memory_order_acquire); }
+
+  /** @param idx The index of a marker, less than GetNMarkers()
+   * @return The marker's name */
+  const char* GetMarkerName(int idx) const { return mMarkers[idx].name.load(std::memory_order_relaxed); }
+
+  /** @param idx The index of a marker, less than GetNMarkers()
+   * @return The marker's statistics */
+  Stats GetMarkerStats(int idx) const
+  {
+    const Marker& marker = mMarkers[idx];
+    Stats stats;
+    stats.min = marker.min.load(std::memory_order_relaxed);
+    stats.mean = marker.mean.load(std::memory_order_relaxed);
+    stats.max = marker.max.load(std::memory_order_relaxed);
+    return stats;
+  }
+
+  /** The time spent in a marker in the last host block, for the context of an IPlugXrunWatchdog record. Audio thread only
+   * @param idx The index of a marker, less than GetNMarkers()
+   * @return The time in seconds, or 0 if the marker wasn't hit */
+  double GetLastBlockTime(int idx) const
+  {
+    return mMarkers[idx].lastBlockTicks * SecondsPerTick();
+  }
+
+private:
+  struct Marker
+  {
+    std::atomic<const char*> name {nullptr};
+
+    // only touched by the audio thread
+    uint64_t blockTicks = 0;
+    uint64_t lastBlockTicks = 0;
+    uint64_t windowMin = UINT64_MAX;
+    uint64_t windowMax = 0;
+    uint64_t windowSum = 0;
+    uint32_t windowBlocks = 0;
+
+    std::atomic<float> min {0.f};
+    std::atomic<float> mean {0.f};
+    std::atomic<float> max {0.f};
+  };
+
+  static inline uint64_t Ticks()
+  {
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    return __rdtsc();
+#elif defined(__aarch64__) && !defined(_MSC_VER)
+    uint64_t ticks;
+    asm volatile("mrs %0, cntvct_el0" : "=r" (ticks));
+    return ticks;
+#else
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+  }
+
+  /** @return The index of the marker with a name, which is added the first time it is hit, or -1 if there are already kMaxMarkers */
+  int FindMarker(const char* name)
+  {
+    const int n = mNMarkers.load(std::memory_order_relaxed);
+
+    // names are usually literals, so compare the pointers before the strings
+    for (int i = 0; i < n; i++)
+    {
+      const char* markerName = mMarkers[i].name.load(std::memory_order_relaxed);
+
+      if (markerName == name || !strcmp(markerName, name))
+        return i;
+    }
+
+    if (n == kMaxMarkers)
+      return -1;
+
+    mMarkers[n].name.store(name, std::memory_order_relaxed);
+    mNMarkers.store(n + 1, std::memory_order_release);
+    return n;
+  }
+
+  void EndBlock(double duration)
+  {
+    const int n = mNMarkers.load(std::memory_order_relaxed);
+
+    for (int i = 0; i < n; i++)
+    {
+      Marker& marker = mMarkers[i];
+      marker.lastBlockTicks = marker.blockTicks;
+
+      if (!marker.blockTicks)
+        continue;
+
+      marker.windowMin = std::min(marker.windowMin, marker.blockTicks);
+      marker.windowMax = std::max(marker.windowMax, marker.blockTicks);
+      marker.windowSum += marker.blockTicks;
+      marker.windowBlocks++;
+      marker.blockTicks = 0;
+    }
+
+    mWindowTime += duration;
+
+    if (mWindowTime >= kWindow)
+    {
+      mWindowTime = 0.;
+      Publish(n);
+    }
+  }
+
+  /** The counter's rate is measured against the steady clock since the profiler was created, rather than relying on a nominal frequency */
+  double SecondsPerTick() const
+  {
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - mStartTime).count();
+    const double ticks = static_cast<double>(Ticks() - mStartTicks);
+
+    return elapsed > 0. && ticks > 0. ? elapsed / ticks : 0.;
+  }
+
+  void Publish(int nMarkers)
+  {
+    const double secondsPerTick = SecondsPerTick();
+
+    if (secondsPerTick <= 0.)
+      return;
+
+    for (int i = 0; i < nMarkers; i++)
+    {
+      Marker& marker = mMarkers[i];
+
+      if (!marker.windowBlocks)
+        continue;
+
+      const double mean = static_cast<double>(marker.windowSum) / marker.windowBlocks * secondsPerTick;
+
+      marker.min.store(static_cast<float>(marker.windowMin * secondsPerTick), std::memory_order_relaxed);
+      marker.mean.store(static_cast<float>(mean), std::memory_order_relaxed);
+      marker.max.store(static_cast<float>(marker.windowMax * secondsPerTick), std::memory_order_relaxed);
+
+      TRACE_COUNTER(marker.name.load(std::memory_order_relaxed), mean * 1e9);
+
+      marker.windowMin = UINT64_MAX;
+      marker.windowMax = marker.windowSum = 0;
+      marker.windowBlocks = 0;
+    }
+  }
+
+  Marker mMarkers[kMaxMarkers];
+  std::atomic<int> mNMarkers {0};
+  double mWindowTime = 0.;
+  const uint64_t mStartTicks;
+  const std::chrono::steady_clock::time_point mStartTime;
+};
+
+#define IPLUG_PROFILE_CONCAT_(a, b) a##b
+#define IPLUG_PROFILE_CONCAT(a, b) IPLUG_PROFILE_CONCAT_(a, b)
+
+#ifdef IPLUG_PROFILE
+  #define IPLUG_PROFILE_SCOPE_IN(profiler, name) IPlugProfiler::Scope IPLUG_PROFILE_CONCAT(profileScope, __LINE__)(profiler, name)
+  #define IPLUG_PROFILE_SCOPE(name) IPLUG_PROFILE_SCOPE_IN(GetProfiler(), name)
+#else
+  #define IPLUG_PROFILE_SCOPE_IN(profiler, name)
+  #define IPLUG_PROFILE_SCOPE(name)
+#endif
@@ -16,17 +16,24 @@
  */
 
 #include <atomic>
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
 
 /** A lock-free SPSC queue used to transfer data between threads
  * based on MLQueue.h by Randy Jones
- * based on https://kjellkod.wordpress.com/2012/11/28/c-debt-paid-in-full-wait-free-lock-free-queue/ */
+ * based on https://kjellkod.wordpress.com/2012/11/28/c-debt-paid-in-full-wait-free-lock-free-queue/
+ * The capacity is rounded up to a power of two so that indices can be masked rather than wrapped with a modulo.
+ * The read and write indices live on separate cache lines, and each side keeps a cached copy of the other side's index,
+ * so the producer and consumer only touch each other's cache line when the queue looks full or empty */
 template<typename T>
 class IPlugQueue final
 {
 public:
   /** IPlugQueue constructor 
-   * @param size /todo */
+   * @param size The minimum number of elements the queue can hold. Rounded up to a power of two */
   IPlugQueue(int size)
   {
     Resize(size);
@@ -34,51 +41,129 @@ public:
 
   ~IPlugQueue(){}
 
-  /** /todo 
-   * @param size /todo */
+  /** Resize the queue, discarding any queued elements. Not thread safe: make sure neither side is using the queue
+   * @param size The minimum number of elements the queue can hold. Rounded up to a power of two */
   void Resize(int size)
   {
-    mData.Resize(size + 1);
+    size_t capacity = 1;
+    
+    while (capacity < static_cast<size_t>(size))
+      capacity <<= 1;
+    
+    mData.Resize(static_cast<int>(capacity));
+    mMask = capacity - 1;
+    mWriteIndex.store(0, std::memory_order_relaxed);
+    mReadIndex.store(0, std::memory_order_relaxed);
+    mCachedReadIndex = 0;
+    mCachedWriteIndex = 0;
   }
 
-  /** /todo 
-   * @param item /todo
-   * @return true /todo
-   * @return false /todo */
+  /** @return The number of elements the queue can hold */
+  size_t Capacity() const { return mMask + 1; }
+
+  /** @return The memory the queue holds, in bytes */
+  size_t GetBytes() const { return Capacity() * sizeof(T); }
+
+  /** Push an element onto the queue. Producer thread only
+   * @param item The element to copy into the queue
+   * @return true if the element was queued
+   * @return false if the queue was full */
   bool Push(const T& item)
   {
     const auto currentWriteIndex = mWriteIndex.load(std::memory_order_relaxed);
-    const auto nextWriteIndex = Increment(currentWriteIndex);
-    if(nextWriteIndex != mReadIndex.load(std::memory_order_acquire))
+    
+    if (currentWriteIndex - mCachedReadIndex > mMask)
     {
-      mData.Get()[currentWriteIndex] = item;
-      mWriteIndex.store(nextWriteIndex, std::memory_order_release);
-      return true;
+      mCachedReadIndex = mReadIndex.load(std::memory_order_acquire);
+      
+      if (currentWriteIndex - mCachedReadIndex > mMask)
+        return false;
     }
-    return false;
+    
+    mData.Get()[currentWriteIndex & mMask] = item;
+    mWriteIndex.store(currentWriteIndex + 1, std::memory_order_release);
+    return true;
   }
 
-  /** /todo 
-   * @param item /todo
-   * @return true /todo
-   * @return false /todo */
+  /** Push up to nItems elements onto the queue, publishing them to the consumer in one go. Producer thread only
+   * @param pItems Pointer to the elements to copy into the queue
+   * @param nItems The number of elements in pItems
+   * @return The number of elements that were queued, which is less than nItems if the queue filled up */
+  int PushBulk(const T* pItems, int nItems)
+  {
+    const auto currentWriteIndex = mWriteIndex.load(std::memory_order_relaxed);
+    size_t space = Capacity() - (currentWriteIndex - mCachedReadIndex);
+    
+    if (space < static_cast<size_t>(nItems))
+    {
+      mCachedReadIndex = mReadIndex.load(std::memory_order_acquire);
+      space = Capacity() - (currentWriteIndex - mCachedReadIndex);
+    }
+    
+    const size_t n = std::min(space, static_cast<size_t>(nItems));
+    T* pData = mData.Get();
+    
+    for (size_t i = 0; i < n; i++)
+      pData[(currentWriteIndex + i) & mMask] = pItems[i];
+    
+    if (n)
+      mWriteIndex.store(currentWriteIndex + n, std::memory_order_release);
+    
+    return static_cast<int>(n);
+  }
+
+  /** Pop an element from the queue. Consumer thread only
+   * @param item Reference to receive the element
+   * @return true if an element was popped
+   * @return false if the queue was empty */
   bool Pop(T& item)
   {
     const auto currentReadIndex = mReadIndex.load(std::memory_order_relaxed);
-    if(currentReadIndex == mWriteIndex.load(std::memory_order_acquire))
+    
+    if (currentReadIndex == mCachedWriteIndex)
     {
-      return false; // empty the queue
+      mCachedWriteIndex = mWriteIndex.load(std::memory_order_acquire);
+      
+      if (currentReadIndex == mCachedWriteIndex)
+        return false; // empty the queue
     }
-    item = mData.Get()[currentReadIndex];
-    mReadIndex.store(Increment(currentReadIndex), std::memory_order_release);
+    
+    item = mData.Get()[currentReadIndex & mMask];
+    mReadIndex.store(currentReadIndex + 1, std::memory_order_release);
     return true;
   }
 
-  /** /todo 
-   * @return size_t /todo */
+  /** Pop up to maxItems elements from the queue, releasing their slots to the producer in one go. Consumer thread only
+   * @param pItems Pointer to storage for at least maxItems elements
+   * @param maxItems The maximum number of elements to pop
+   * @return The number of elements that were popped, 0 if the queue was empty */
+  int PopBulk(T* pItems, int maxItems)
+  {
+    const auto currentReadIndex = mReadIndex.load(std::memory_order_relaxed);
+    size_t available = mCachedWriteIndex - currentReadIndex;
+    
+    if (available < static_cast<size_t>(maxItems))
+    {
+      mCachedWriteIndex = mWriteIndex.load(std::memory_order_acquire);
+      available = mCachedWriteIndex - currentReadIndex;
+    }
+    
+    const size_t n = std::min(available, static_cast<size_t>(maxItems));
+    const T* pData = mData.Get();
+    
+    for (size_t i = 0; i < n; i++)
+      pItems[i] = pData[(currentReadIndex + i) & mMask];
+    
+    if (n)
+      mReadIndex.store(currentReadIndex + n, std::memory_order_release);
+    
+    return static_cast<int>(n);
+  }
+
+  /** @return size_t The number of elements in the queue at the time of the call */
   size_t ElementsAvailable() const
   {
-    return (mWriteIndex.load(std::memory_order_acquire) - mReadIndex.load(std::memory_order_relaxed))%mData.GetSize();
+    return mWriteIndex.load(std::memory_order_acquire) - mReadIndex.load(std::memory_order_relaxed);
   }
 
   /** /todo
@@ -88,7 +173,7 @@ public:
   const T& Peek()
   {
     const auto currentReadIndex = mReadIndex.load(std::memory_order_relaxed);
-    return mData[currentReadIndex];
+    return mData.Get()[currentReadIndex & mMask];
   }
 
   /** /todo 
@@ -104,21 +189,345 @@ public:
    * @return false /todo */
   bool WasFull() const
   {
-    const auto nextWriteIndex = increment(mWriteIndex.load());
-    return (nextWriteIndex == mReadIndex.load());
+    return (mWriteIndex.load() - mReadIndex.load() > mMask);
   }
 
 private:
-  /** /todo 
-   * @param idx /todo
-   * @return size_t /todo */
-  size_t Increment(size_t idx) const
+  static constexpr size_t kCacheLineSize = 64;
+
+  WDL_TypedBuf<T> mData;
+  size_t mMask = 0;
+  // indices increase monotonically and are masked on access, so full and empty can be told apart without a spare slot.
+  // The producer's and the consumer's indices are a cache line apart, padded rather than aligned, since new ignores over-alignment before C++17
+  char mPadWrite[kCacheLineSize];
+  std::atomic<size_t> mWriteIndex{0};
+  size_t mCachedReadIndex = 0; // producer's copy of mReadIndex
+  char mPadRead[kCacheLineSize];
+  std::atomic<size_t> mReadIndex{0};
+  size_t mCachedWriteIndex = 0; // consumer's copy of mWriteIndex
+  char mPadEnd[kCacheLineSize];
+};
+
+/** A lock-free bounded MPSC queue, for transfers where several threads may push at once, such as a host that sets parameters
+ * from both its audio and worker threads. Each slot carries a sequence number, so producers only contend on a single
+ * compare-and-swap of the write index, and the consumer never has to synchronise with other consumers
+ * based on the bounded MPMC queue by Dmitry Vyukov http://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue */
+template<typename T>
+class IPlugMPSCQueue final
+{
+public:
+  /** IPlugMPSCQueue constructor
+   * @param size The minimum number of elements the queue can hold. Rounded up to a power of two */
+  IPlugMPSCQueue(int size)
   {
-    return (idx + 1) % (mData.GetSize());
+    Resize(size);
   }
 
-  WDL_TypedBuf<T> mData;
+  IPlugMPSCQueue(const IPlugMPSCQueue&) = delete;
+  IPlugMPSCQueue& operator=(const IPlugMPSCQueue&) = delete;
+
+  /** Resize the queue, discarding any queued elements. Not thread safe: make sure no thread is using the queue
+   * @param size The minimum number of elements the queue can hold. Rounded up to a power of two */
+  void Resize(int size)
+  {
+    size_t capacity = 1;
+    
+    while (capacity < static_cast<size_t>(size))
+      capacity <<= 1;
+    
+    mSlots.reset(new Slot[capacity]);
+    mMask = capacity - 1;
+    
+    for (size_t i = 0; i < capacity; i++)
+      mSlots[i].mSequence.store(i, std::memory_order_relaxed);
+    
+    mWriteIndex.store(0, std::memory_order_relaxed);
+    mReadIndex.store(0, std::memory_order_relaxed);
+  }
+
+  /** @return The number of elements the queue can hold */
+  size_t Capacity() const { return mMask + 1; }
+
+  /** @return The memory the queue holds, in bytes */
+  size_t GetBytes() const { return Capacity() * sizeof(Slot); }
+
+  /** Push an element onto the queue. Safe to call from any number of threads at once
+   * @param item The element to copy into the queue
+   * @return true if the element was queued
+   * @return false if the queue was full */
+  bool Push(const T& item)
+  {
+    auto pos = mWriteIndex.load(std::memory_order_relaxed);
+    Slot* pSlot;
+    
+    while (true)
+    {
+      pSlot = &mSlots[pos & mMask];
+      const auto seq = pSlot->mSequence.load(std::memory_order_acquire);
+      const auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+      
+      if (diff == 0)
+      {
+        if (mWriteIndex.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      }
+      else if (diff < 0)
+        return false; // the consumer hasn't released this slot yet, the queue is full
+      else
+        pos = mWriteIndex.load(std::memory_order_relaxed); // another producer claimed the slot
+    }
+    
+    pSlot->mItem = item;
+    pSlot->mSequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  /** Pop an element from the queue. Consumer thread only
+   * @param item Reference to receive the element
+   * @return true if an element was popped
+   * @return false if the queue was empty, or the producer of the next element hasn't finished writing it */
+  bool Pop(T& item)
+  {
+    const auto pos = mReadIndex.load(std::memory_order_relaxed);
+    Slot& slot = mSlots[pos & mMask];
+    
+    if (slot.mSequence.load(std::memory_order_acquire) != pos + 1)
+      return false;
+    
+    item = slot.mItem;
+    slot.mSequence.store(pos + mMask + 1, std::memory_order_release);
+    mReadIndex.store(pos + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  /** Pop up to maxItems elements from the queue. Consumer thread only
+   * @param pItems Pointer to storage for at least maxItems elements
+   * @param maxItems The maximum number of elements to pop
+   * @return The number of elements that were popped */
+  int PopBulk(T* pItems, int maxItems)
+  {
+    int n = 0;
+    
+    while (n < maxItems && Pop(pItems[n]))
+      n++;
+    
+    return n;
+  }
+
+  /** @return size_t The number of elements pushed or being pushed at the time of the call. Pop() may still fail
+   * while a producer is part way through writing, so drain with Pop() rather than counting on this */
+  size_t ElementsAvailable() const
+  {
+    return mWriteIndex.load(std::memory_order_acquire) - mReadIndex.load(std::memory_order_relaxed);
+  }
+
+private:
+  static constexpr size_t kCacheLineSize = 64;
+
+  struct Slot
+  {
+    std::atomic<size_t> mSequence{0};
+    T mItem;
+  };
+
+  std::unique_ptr<Slot[]> mSlots;
+  size_t mMask = 0;
+  // padded rather than aligned, see IPlugQueue
+  char mPadWrite[kCacheLineSize];
   std::atomic<size_t> mWriteIndex{0};
+  char mPadRead[kCacheLineSize];
   std::atomic<size_t> mReadIndex{0};
+  char mPadEnd[kCacheLineSize];
 };
 
+/** A lock-free SPSC ring of variable length records, used to transfer sysex and arbitrary message payloads between threads.
+ * Each record is a small header followed by its payload, stored contiguously, so a record only costs its own size rather than the
+ * largest possible payload. Records can be written and read in place: BeginWrite()/CommitWrite() on the producer side, and
+ * Peek()/Release() on the consumer side.
+ * A single record can be at most half the capacity of the ring */
+class IPlugMessageRing final
+{
+public:
+  /** A record as seen by the consumer. mData points into the ring and stays valid until Release() */
+  struct Record
+  {
+    int mTag;
+    int mSubTag;
+    int mSize;
+    const uint8_t* mData;
+  };
+
+  /** IPlugMessageRing constructor
+   * @param sizeInBytes The minimum capacity of the ring in bytes. Rounded up to a power of two */
+  IPlugMessageRing(int sizeInBytes)
+  {
+    Resize(sizeInBytes);
+  }
+
+  IPlugMessageRing(const IPlugMessageRing&) = delete;
+  IPlugMessageRing& operator=(const IPlugMessageRing&) = delete;
+
+  /** Resize the ring, discarding any queued records. Not thread safe: make sure neither side is using the ring
+   * @param sizeInBytes The minimum capacity of the ring in bytes. Rounded up to a power of two */
+  void Resize(int sizeInBytes)
+  {
+    size_t capacity = 2 * kAlignment;
+    
+    while (capacity < static_cast<size_t>(sizeInBytes))
+      capacity <<= 1;
+    
+    mData.reset(new Header[capacity / kAlignment]);
+    mMask = capacity - 1;
+    mWriteIndex.store(0, std::memory_order_relaxed);
+    mReadIndex.store(0, std::memory_order_relaxed);
+    mCachedReadIndex = 0;
+    mCachedWriteIndex = 0;
+    mPendingWriteSize = 0;
+  }
+
+  /** @return The capacity of the ring in bytes */
+  size_t Capacity() const { return mMask + 1; }
+
+  /** @return The memory the ring holds, in bytes, which is its capacity */
+  size_t GetBytes() const { return Capacity(); }
+
+  /** @return The largest payload a single record can carry */
+  int MaxRecordSize() const { return static_cast<int>(Capacity() / 2 - sizeof(Header)); }
+
+  /** Reserve space for a record, to fill in place before calling CommitWrite(). Producer thread only
+   * @param tag A value stored with the record, such as a message tag or sysex offset
+   * @param subTag A second value stored with the record, such as a control tag
+   * @param size The size of the payload in bytes
+   * @return Pointer to size bytes to write the payload into, or nullptr if the ring is full */
+  uint8_t* BeginWrite(int tag, int subTag, int size)
+  {
+    if (size < 0 || size > MaxRecordSize())
+      return nullptr;
+    
+    const auto currentWriteIndex = mWriteIndex.load(std::memory_order_relaxed);
+    const size_t recordSize = AlignedSize(size);
+    const size_t untilEnd = Capacity() - (currentWriteIndex & mMask);
+    const size_t skip = untilEnd < recordSize ? untilEnd : 0; // records never wrap, so any space left at the end is skipped
+    
+    if (currentWriteIndex + skip + recordSize - mCachedReadIndex > Capacity())
+    {
+      mCachedReadIndex = mReadIndex.load(std::memory_order_acquire);
+      
+      if (currentWriteIndex + skip + recordSize - mCachedReadIndex > Capacity())
+        return nullptr;
+    }
+    
+    if (skip)
+      HeaderAt(currentWriteIndex)->mSize = kSkip;
+    
+    Header* pHeader = HeaderAt(currentWriteIndex + skip);
+    pHeader->mTag = tag;
+    pHeader->mSubTag = subTag;
+    pHeader->mSize = size;
+    mPendingWriteSize = skip + recordSize;
+    return reinterpret_cast<uint8_t*>(pHeader + 1);
+  }
+
+  /** Publish the record reserved by the last successful BeginWrite(). Producer thread only */
+  void CommitWrite()
+  {
+    mWriteIndex.store(mWriteIndex.load(std::memory_order_relaxed) + mPendingWriteSize, std::memory_order_release);
+    mPendingWriteSize = 0;
+  }
+
+  /** Copy a record into the ring. Producer thread only
+   * @param tag A value stored with the record, such as a message tag or sysex offset
+   * @param subTag A second value stored with the record, such as a control tag
+   * @param pData Pointer to the payload, may be nullptr if size is 0
+   * @param size The size of the payload in bytes
+   * @return true if the record was queued
+   * @return false if the ring was full or the record too large */
+  bool Push(int tag, int subTag, const void* pData, int size)
+  {
+    uint8_t* pDst = BeginWrite(tag, subTag, size);
+    
+    if (!pDst)
+      return false;
+    
+    if (size)
+      memcpy(pDst, pData, size);
+    
+    CommitWrite();
+    return true;
+  }
+
+  /** Get the oldest record without removing it. Consumer thread only
+   * @param record Receives the record, its data can be read in place until Release() is called
+   * @return true if a record was available
+   * @return false if the ring was empty */
+  bool Peek(Record& record)
+  {
+    auto currentReadIndex = mReadIndex.load(std::memory_order_relaxed);
+    
+    if (currentReadIndex == mCachedWriteIndex)
+    {
+      mCachedWriteIndex = mWriteIndex.load(std::memory_order_acquire);
+      
+      if (currentReadIndex == mCachedWriteIndex)
+        return false;
+    }
+    
+    const Header* pHeader = HeaderAt(currentReadIndex);
+    
+    if (pHeader->mSize == kSkip)
+    {
+      currentReadIndex += Capacity() - (currentReadIndex & mMask);
+      mReadIndex.store(currentReadIndex, std::memory_order_release);
+      pHeader = HeaderAt(currentReadIndex); // the producer publishes the skip and the record after it together
+    }
+    
+    record.mTag = pHeader->mTag;
+    record.mSubTag = pHeader->mSubTag;
+    record.mSize = pHeader->mSize;
+    record.mData = reinterpret_cast<const uint8_t*>(pHeader + 1);
+    return true;
+  }
+
+  /** Remove the record returned by the last successful Peek(). Consumer thread only */
+  void Release()
+  {
+    const auto currentReadIndex = mReadIndex.load(std::memory_order_relaxed);
+    mReadIndex.store(currentReadIndex + AlignedSize(HeaderAt(currentReadIndex)->mSize), std::memory_order_release);
+  }
+
+  /** @return true if the ring held no records at the time of the call */
+  bool WasEmpty() const
+  {
+    return (mWriteIndex.load() == mReadIndex.load());
+  }
+
+private:
+  static constexpr size_t kCacheLineSize = 64;
+  static constexpr int kSkip = -1;
+
+  struct Header
+  {
+    int mTag;
+    int mSubTag;
+    int mSize;
+    int mReserved;
+  };
+
+  static constexpr size_t kAlignment = sizeof(Header); // every record starts on a header boundary, so there is always room for a skip marker
+
+  static size_t AlignedSize(int size) { return (sizeof(Header) + size + kAlignment - 1) & ~(kAlignment - 1); }
+
+  Header* HeaderAt(size_t idx) const { return mData.get() + ((idx & mMask) / kAlignment); }
+
+  std::unique_ptr<Header[]> mData;
+  size_t mMask = 0;
+  // padded rather than aligned, see IPlugQueue
+  char mPadWrite[kCacheLineSize];
+  std::atomic<size_t> mWriteIndex{0};
+  size_t mCachedReadIndex = 0; // producer's copy of mReadIndex
+  size_t mPendingWriteSize = 0;
+  char mPadRead[kCacheLineSize];
+  std::atomic<size_t> mReadIndex{0};
+  size_t mCachedWriteIndex = 0; // consumer's copy of mWriteIndex
+  char mPadEnd[kCacheLineSize];
+};
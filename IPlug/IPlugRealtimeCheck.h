@@ -0,0 +1,166 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @brief Debug build detection of allocations and locks on the realtime audio thread
+ *
+ * Define IPLUG_REALTIME_CHECKS at project level to enable. It has no effect in release (NDEBUG) builds.
+ * While ProcessBuffers() (and so ProcessBlock()) is running, the audio thread is marked as realtime and:
+ * - operator new and delete, which are replaced in IPlug_include_in_plug_src.h
+ * - ENTER_PARAMS_MUTEX
+ * - anything you wrap with IPLUG_CHECK_NOT_REALTIME("what")
+ * report a violation with a backtrace via DBGMSG. Use IPLUG_ALLOW_REALTIME_VIOLATIONS in a scope where you knowingly do one of these things.
+ *
+ * In any build, IPLUG_COUNT_ALLOCATIONS set to 1 replaces operator new in the same way, to count the allocations made inside an IAllocationCounter::Scope.
+ * It is set by default for the standalone app, whose --benchmark mode reports them, see IPlugAPPBenchmark.
+ */
+
+#include <atomic>
+#include <cstdint>
+
+#include "IPlugConstants.h"
+#include "IPlugLogger.h"
+
+#ifndef IPLUG_COUNT_ALLOCATIONS
+  #ifdef APP_API
+    #define IPLUG_COUNT_ALLOCATIONS 1
+  #else
+    #define IPLUG_COUNT_ALLOCATIONS 0
+  #endif
+#endif
+
+/** Counts the allocations made on the calling thread while it is inside a Scope, if IPLUG_COUNT_ALLOCATIONS is set */
+class IAllocationCounter
+{
+public:
+  /** Counts the allocations on the calling thread for its lifetime */
+  struct Scope
+  {
+    Scope() { Depth()++; }
+    ~Scope() { Depth()--; }
+  };
+
+  /** Called by the replaced operator new */
+  static void OnAllocation()
+  {
+    if (Depth())
+      Count()++;
+  }
+
+  /** @return The number of allocations counted on the calling thread */
+  static uint64_t GetCount() { return Count(); }
+
+private:
+  static int& Depth()
+  {
+    static thread_local int sDepth = 0;
+    return sDepth;
+  }
+
+  static uint64_t& Count()
+  {
+    static thread_local uint64_t sCount = 0;
+    return sCount;
+  }
+};
+
+#if defined IPLUG_REALTIME_CHECKS && defined NDEBUG
+  #undef IPLUG_REALTIME_CHECKS
+#endif
+
+#ifdef IPLUG_REALTIME_CHECKS
+
+#if defined OS_MAC || defined OS_IOS || defined OS_LINUX
+  #include <execinfo.h>
+#endif
+
+/** Static helpers that track whether the current thread is in a realtime scope, and report violations */
+class IRealtimeCheck
+{
+public:
+  /** @return \c true if the calling thread is inside ProcessBuffers(), and violations are not currently allowed */
+  static bool IsRealtime() { return Depth() > 0 && !Suspended(); }
+
+  /** Report a violation if the calling thread is realtime
+   * @param what A description of the operation, e.g. "operator new" */
+  static void Check(const char* what)
+  {
+    if (IsRealtime())
+      Report(what);
+  }
+
+  /** Marks the calling thread as realtime for its lifetime, see IPLUG_REALTIME_SCOPE */
+  struct Scope
+  {
+    Scope() { Depth()++; }
+    ~Scope() { Depth()--; }
+  };
+
+  /** Allows violations on the calling thread for its lifetime, see IPLUG_ALLOW_REALTIME_VIOLATIONS */
+  struct Suspender
+  {
+    Suspender() { Suspended()++; }
+    ~Suspender() { Suspended()--; }
+  };
+
+private:
+  static int& Depth()
+  {
+    static thread_local int sDepth = 0;
+    return sDepth;
+  }
+
+  static int& Suspended()
+  {
+    static thread_local int sSuspended = 0;
+    return sSuspended;
+  }
+
+  static void Report(const char* what)
+  {
+    static std::atomic<int> sNReports {0};
+
+    if (sNReports.fetch_add(1, std::memory_order_relaxed) >= REALTIME_CHECK_MAX_REPORTS)
+      return;
+
+    Suspender suspend; // reporting allocates
+
+    DBGMSG("IPlug realtime violation: %s on the audio thread\n", what);
+
+    void* frames[REALTIME_CHECK_BACKTRACE_DEPTH];
+
+#if defined OS_MAC || defined OS_IOS || defined OS_LINUX
+    const int nFrames = backtrace(frames, REALTIME_CHECK_BACKTRACE_DEPTH);
+    char** symbols = backtrace_symbols(frames, nFrames);
+
+    for (int i = 2; i < nFrames; i++) // skip Report() and Check()
+      DBGMSG("  %s\n", symbols ? symbols[i] : "?");
+
+    free(symbols);
+#elif defined OS_WIN
+    const int nFrames = CaptureStackBackTrace(2, REALTIME_CHECK_BACKTRACE_DEPTH, frames, nullptr);
+
+    for (int i = 0; i < nFrames; i++)
+      DBGMSG("  %p\n", frames[i]);
+#endif
+  }
+};
+
+  #define IPLUG_REALTIME_SCOPE IRealtimeCheck::Scope realtimeScope
+  #define IPLUG_ALLOW_REALTIME_VIOLATIONS IRealtimeCheck::Suspender realtimeSuspender
+  #define IPLUG_CHECK_NOT_REALTIME(what) IRealtimeCheck::Check(what)
+#else
+  #define IPLUG_REALTIME_SCOPE
+  #define IPLUG_ALLOW_REALTIME_VIOLATIONS
+  #define IPLUG_CHECK_NOT_REALTIME(what)
+#endif
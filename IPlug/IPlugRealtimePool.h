@@ -0,0 +1,223 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IPlugRealtimePool
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+  #include <windows.h>
+#elif defined(__APPLE__)
+  #include <pthread.h>
+  #include <mach/mach.h>
+  #include <mach/thread_policy.h>
+#else
+  #include <pthread.h>
+  #include <sched.h>
+#endif
+
+#include "IPlugRealtimeThread.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+  #include <immintrin.h>
+  #define IPLUG_SPIN_PAUSE() _mm_pause()
+#elif defined(__aarch64__) || defined(_M_ARM64)
+  #if defined(_MSC_VER)
+    #include <intrin.h>
+    #define IPLUG_SPIN_PAUSE() __yield()
+  #else
+    #define IPLUG_SPIN_PAUSE() __asm__ __volatile__("yield")
+  #endif
+#else
+  #define IPLUG_SPIN_PAUSE() std::this_thread::yield()
+#endif
+
+/** A pool of spinning worker threads for splitting realtime work, such as the voices of a synth, across cores within one audio block.
+ * Use it where the host doesn't provide a thread pool, see IPlugProcessor::HostParallelFor(), e.g.
+ * mSynth.SetParallelFor(IPlugRealtimePool::ParallelForFunc, &mPool, mPool.NThreads(), nOutputs, maxBlockSize);
+ *
+ * ParallelFor() is called on the audio thread and neither locks nor allocates. The calling thread takes tasks too, so a job never waits for a worker
+ * to wake up: a worker that is asleep or preempted simply runs fewer tasks. Workers spin (with a pause instruction) for a while after each job,
+ * then yield, then sleep once they have been idle for longer than a few blocks, so an idle pool costs next to nothing.
+ * Workers run at realtime priority, see IPlugRealtimeThread, and join the host's audio workgroup where there is one, e.g. mPool(0, false, &GetAudioWorkgroup()),
+ * which keeps them on the performance cores of Apple silicon. They can be pinned to cores, which helps on some systems and hurts on others, since the host's own threads are pinned too */
+class IPlugRealtimePool final
+{
+public:
+  /** @param nThreads The number of threads that run tasks, including the one that calls ParallelFor(). 0 means one per core
+   * @param pinThreads \c true to pin each worker to its own core. The calling thread isn't pinned
+   * @param pWorkgroup The host's audio workgroup, see IPlugProcessor::GetAudioWorkgroup(), which must outlive the pool, or nullptr */
+  IPlugRealtimePool(int nThreads = 0, bool pinThreads = false, const IPlugAudioWorkgroup* pWorkgroup = nullptr)
+  : mpWorkgroup(pWorkgroup)
+  {
+    if (nThreads <= 0)
+      nThreads = (std::max)(1, static_cast<int>(std::thread::hardware_concurrency()));
+
+    for (int i = 1; i < nThreads; i++)
+    {
+      mThreads.emplace_back([this, i, pinThreads]() {
+        IPlugRealtimeThread::SetCurrentThreadRealtime();
+
+        if (pinThreads)
+          PinWorkerThread(i);
+
+        WorkerLoop();
+      });
+    }
+  }
+
+  IPlugRealtimePool(const IPlugRealtimePool&) = delete;
+  IPlugRealtimePool& operator=(const IPlugRealtimePool&) = delete;
+
+  ~IPlugRealtimePool()
+  {
+    mQuit.store(true);
+
+    for (auto& thread : mThreads)
+      thread.join();
+  }
+
+  /** @return The number of threads that run tasks, including the calling thread */
+  int NThreads() const { return static_cast<int>(mThreads.size()) + 1; }
+
+  /** Run task(taskCtx, i) for every i in [0, nTasks) and return once all have finished. Call from one thread at a time, normally the audio thread
+   * @return \c true, the tasks always run, on the calling thread alone if need be */
+  bool ParallelFor(int nTasks, void (*task)(void* taskCtx, int taskIdx), void* taskCtx)
+  {
+    if (nTasks <= 0)
+      return true;
+
+    // tell workers a job is being written, and wait for any still inside the last one, so that the job can be rewritten safely
+    const uint32_t generation = mGeneration.load(std::memory_order_relaxed);
+    mGeneration.store(generation + 1);
+
+    while (mNWorkersInJob.load() > 0)
+      IPLUG_SPIN_PAUSE();
+
+    mTask = task;
+    mTaskCtx = taskCtx;
+    mNTasks = nTasks;
+    mNextTask.store(0, std::memory_order_relaxed);
+    mNCompleted.store(0, std::memory_order_relaxed);
+    mGeneration.store(generation + 2); // even again: the job is ready
+
+    RunTasks();
+
+    while (mNCompleted.load(std::memory_order_acquire) < nTasks)
+      IPLUG_SPIN_PAUSE();
+
+    return true;
+  }
+
+  /** ParallelFor() as a plain function with the pool as its context, matching VoiceAllocator::ParallelForFunc */
+  static bool ParallelForFunc(void* pPool, int nTasks, void (*task)(void* taskCtx, int taskIdx), void* taskCtx)
+  {
+    return static_cast<IPlugRealtimePool*>(pPool)->ParallelFor(nTasks, task, taskCtx);
+  }
+
+private:
+  static constexpr int kSpinIterations = 20000; // pause instructions before a worker starts yielding, around a millisecond
+  static constexpr int kIdleMsBeforeSleep = 50; // yielding time before a worker starts sleeping between checks
+
+  void RunTasks()
+  {
+    int taskIdx;
+
+    while ((taskIdx = mNextTask.fetch_add(1, std::memory_order_relaxed)) < mNTasks)
+    {
+      mTask(mTaskCtx, taskIdx);
+      mNCompleted.fetch_add(1, std::memory_order_release);
+    }
+  }
+
+  void WorkerLoop()
+  {
+    uint32_t lastGeneration = mGeneration.load();
+    IPlugRealtimeThread::WorkgroupMember workgroupMember;
+    int spins = 0;
+    auto idleSince = std::chrono::steady_clock::now();
+
+    while (!mQuit.load(std::memory_order_relaxed))
+    {
+      if (mGeneration.load(std::memory_order_relaxed) != lastGeneration)
+      {
+        // announce ourselves before looking at the job, so that ParallelFor() can't rewrite it while we're inside
+        mNWorkersInJob.fetch_add(1);
+        const uint32_t generation = mGeneration.load();
+
+        if ((generation & 1) == 0 && generation != lastGeneration)
+        {
+          lastGeneration = generation;
+
+          // follows the host's workgroup, which changes when the device or render context does
+          if (mpWorkgroup)
+            workgroupMember.Update(*mpWorkgroup);
+
+          RunTasks();
+        }
+
+        mNWorkersInJob.fetch_sub(1);
+        spins = 0;
+        idleSince = std::chrono::steady_clock::now();
+        continue;
+      }
+
+      if (spins < kSpinIterations)
+      {
+        spins++;
+        IPLUG_SPIN_PAUSE();
+      }
+      else if (std::chrono::steady_clock::now() - idleSince < std::chrono::milliseconds(kIdleMsBeforeSleep))
+        std::this_thread::yield();
+      else
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+
+  static void PinWorkerThread(int workerIdx)
+  {
+    const int nCores = (std::max)(1, static_cast<int>(std::thread::hardware_concurrency()));
+    const int core = workerIdx % nCores;
+
+#if defined(_WIN32)
+    SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(1) << core);
+#elif defined(__APPLE__)
+    thread_affinity_policy_data_t policy { core + 1 }; // a hint: threads with different tags are kept apart
+    thread_policy_set(pthread_mach_thread_np(pthread_self()), THREAD_AFFINITY_POLICY, reinterpret_cast<thread_policy_t>(&policy), THREAD_AFFINITY_POLICY_COUNT);
+#else
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(core, &cpuSet);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+#endif
+  }
+
+  std::vector<std::thread> mThreads;
+  std::atomic<bool> mQuit {false};
+  const IPlugAudioWorkgroup* mpWorkgroup;
+
+  // the current job. mGeneration is odd while ParallelFor() is writing it
+  std::atomic<uint32_t> mGeneration {0};
+  std::atomic<int> mNWorkersInJob {0};
+  void (*mTask)(void* taskCtx, int taskIdx) = nullptr;
+  void* mTaskCtx = nullptr;
+  int mNTasks = 0;
+  std::atomic<int> mNextTask {0};
+  std::atomic<int> mNCompleted {0};
+};
@@ -0,0 +1,213 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @brief Realtime priority for the threads a plug-in starts to help the audio thread, and membership of the host's audio workgroup on macOS and iOS
+ *
+ * A worker that runs part of a block, such as some of the voices of a synth or a partition of a convolution, has the same deadline as the audio thread.
+ * At normal priority it can be preempted for longer than a block, and on Apple silicon it is put on an efficiency core.
+ * IPlugRealtimeThread gives a thread realtime priority on each OS, IPlugAudioWorkgroup holds the host's workgroup, set by the API class where the host provides one,
+ * and IPlugRealtimeThread::WorkgroupMember joins a thread to it. IPlugRealtimePool does all of this for its workers
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <utility>
+
+#if defined(_WIN32)
+  #include <windows.h>
+  #include <avrt.h>
+  #pragma comment(lib, "avrt.lib")
+#elif defined(__APPLE__)
+  #include <pthread.h>
+  #include <mach/mach.h>
+  #include <mach/mach_time.h>
+  #include <mach/thread_policy.h>
+  #if __has_include(<os/workgroup.h>)
+    #include <os/workgroup.h>
+    #define IPLUG_OS_WORKGROUP
+    #if defined(__OBJC__) && __has_feature(objc_arc)
+      #define IPLUG_OS_WORKGROUP_CAST(p) ((__bridge os_workgroup_t) (p))
+    #else
+      #define IPLUG_OS_WORKGROUP_CAST(p) ((os_workgroup_t) (p))
+    #endif
+  #endif
+#else
+  #include <pthread.h>
+  #include <sched.h>
+  #include <sys/resource.h>
+#endif
+
+/** The audio workgroup of the host's render thread, an os_workgroup_t on macOS 11 and iOS 14 or later, which the API class sets while the host renders:
+ * AUv2 from kAudioUnitProperty_RenderContextObserver and AUv3 from renderContextObserver. The other APIs don't pass one, and there it stays empty.
+ * Threads that run part of the audio thread's work join it, so the OS schedules them as part of the audio deadline, on the same cores.
+ * Set() may be called on the render thread, and threads joined with IPlugRealtimeThread::WorkgroupMember notice the change the next time they Update() */
+class IPlugAudioWorkgroup
+{
+public:
+  /** @param pWorkgroup The host's os_workgroup_t, or nullptr if it has none. It is not retained: the host keeps it valid until it sets another */
+  void Set(void* pWorkgroup)
+  {
+    if (mWorkgroup.exchange(pWorkgroup, std::memory_order_acq_rel) != pWorkgroup)
+      mGeneration.fetch_add(1, std::memory_order_release);
+  }
+
+  /** @return The host's os_workgroup_t, or nullptr */
+  void* Get() const { return mWorkgroup.load(std::memory_order_acquire); }
+
+  /** @return A count incremented whenever the workgroup changes */
+  uint32_t GetGeneration() const { return mGeneration.load(std::memory_order_acquire); }
+
+private:
+  std::atomic<void*> mWorkgroup {nullptr};
+  std::atomic<uint32_t> mGeneration {0};
+};
+
+/** Realtime scheduling for the calling thread: MMCSS "Pro Audio" on Windows, a time constraint policy on macOS and iOS, and SCHED_FIFO on Linux,
+ * falling back to the highest nice level the process is allowed, which is what rtkit grants on desktops that have it */
+class IPlugRealtimeThread
+{
+public:
+  /** Give the calling thread realtime priority
+   * @param periodMs The time between the deadlines, normally the duration of a block
+   * @param computeFraction The fraction of the period the thread computes for, a hint to the macOS scheduler
+   * @return \c true if the thread was made realtime, \c false if it only got a raised priority, or none */
+  static bool SetCurrentThreadRealtime(double periodMs = 5.8, double computeFraction = 0.5)
+  {
+#if defined(_WIN32)
+    DWORD taskIndex = 0;
+    HANDLE hTask = AvSetMmThreadCharacteristicsW(L"Pro Audio", &taskIndex);
+
+    if (hTask)
+    {
+      AvSetMmThreadPriority(hTask, AVRT_PRIORITY_HIGH);
+      return true;
+    }
+
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+    return false;
+#elif defined(__APPLE__)
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    const double ticksPerMs = 1000000. * timebase.denom / timebase.numer;
+
+    thread_time_constraint_policy_data_t policy;
+    policy.period = static_cast<uint32_t>(periodMs * ticksPerMs);
+    policy.computation = static_cast<uint32_t>(periodMs * computeFraction * ticksPerMs);
+    policy.constraint = policy.period;
+    policy.preemptible = 1;
+
+    if (thread_policy_set(pthread_mach_thread_np(pthread_self()), THREAD_TIME_CONSTRAINT_POLICY, reinterpret_cast<thread_policy_t>(&policy), THREAD_TIME_CONSTRAINT_POLICY_COUNT) == KERN_SUCCESS)
+      return true;
+
+    pthread_set_qos_class_self_np(QOS_CLASS_USER_INTERACTIVE, 0);
+    return false;
+#else
+    (void) periodMs;
+    (void) computeFraction;
+    sched_param param {};
+    param.sched_priority = sched_get_priority_min(SCHED_FIFO) + 1;
+
+    // fails without CAP_SYS_NICE or an RLIMIT_RTPRIO, in which case take the best nice level we're allowed
+    if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0)
+      return true;
+
+    rlimit limit;
+
+    if (getrlimit(RLIMIT_NICE, &limit) == 0 && limit.rlim_cur > 20)
+      setpriority(PRIO_PROCESS, 0, 20 - static_cast<int>(limit.rlim_cur)); // on Linux this applies to the calling thread
+
+    return false;
+#endif
+  }
+
+  /** A thread's membership of the host's audio workgroup. Construct, Update() and destroy it on the thread that is joined */
+  class WorkgroupMember
+  {
+  public:
+    WorkgroupMember() = default;
+    ~WorkgroupMember() { Leave(); }
+
+    WorkgroupMember(const WorkgroupMember&) = delete;
+    WorkgroupMember& operator=(const WorkgroupMember&) = delete;
+
+    /** Join the workgroup, or the new one if it has changed since the last call. Cheap when it hasn't, so can be called before each job
+     * @param workgroup The host's workgroup
+     * @return \c true if the thread is in a workgroup */
+    bool Update(const IPlugAudioWorkgroup& workgroup)
+    {
+      const uint32_t generation = workgroup.GetGeneration();
+
+      if (generation == mGeneration)
+        return mJoined;
+
+      mGeneration = generation;
+      Leave();
+#ifdef IPLUG_OS_WORKGROUP
+      if (__builtin_available(macOS 11.0, iOS 14.0, *))
+      {
+        void* pWorkgroup = workgroup.Get();
+
+        // joining fails if the host has already cancelled the workgroup, e.g. because the device changed
+        if (pWorkgroup && os_workgroup_join(IPLUG_OS_WORKGROUP_CAST(pWorkgroup), &mToken) == 0)
+        {
+          mpWorkgroup = pWorkgroup;
+          mJoined = true;
+        }
+      }
+#endif
+      return mJoined;
+    }
+
+    void Leave()
+    {
+#ifdef IPLUG_OS_WORKGROUP
+      if (mJoined)
+      {
+        if (__builtin_available(macOS 11.0, iOS 14.0, *))
+          os_workgroup_leave(IPLUG_OS_WORKGROUP_CAST(mpWorkgroup), &mToken);
+      }
+#endif
+      mJoined = false;
+      mpWorkgroup = nullptr;
+    }
+
+  private:
+    uint32_t mGeneration = 0;
+    bool mJoined = false;
+    void* mpWorkgroup = nullptr;
+#ifdef IPLUG_OS_WORKGROUP
+    os_workgroup_join_token_s mToken {};
+#endif
+  };
+
+  /** Start a thread that has realtime priority and, while it runs func, is in the workgroup
+   * @param func The thread's function, which should return when told to stop
+   * @param pWorkgroup The host's workgroup, which must outlive the thread, or nullptr
+   * @param periodMs See SetCurrentThreadRealtime()
+   * @return The thread */
+  template <class FUNC>
+  static std::thread Create(FUNC&& func, const IPlugAudioWorkgroup* pWorkgroup = nullptr, double periodMs = 5.8)
+  {
+    return std::thread([pWorkgroup, periodMs](FUNC threadFunc) {
+      SetCurrentThreadRealtime(periodMs);
+      WorkgroupMember member;
+
+      if (pWorkgroup)
+        member.Update(*pWorkgroup);
+
+      threadFunc();
+    }, std::forward<FUNC>(func));
+  }
+};
@@ -0,0 +1,259 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IPlugResampler
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+
+#include "heapbuf.h"
+
+#include "IPlugConstants.h"
+
+/** A streaming, multichannel polyphase resampler, used by IPlugProcessor to run ProcessBlock() at a fixed internal sample rate, see IPlugProcessor::SetInternalSampleRate().
+ * The kernel is a Kaiser windowed sinc. The rates are rounded to whole Hz and the ratio between them is reduced to L / M, so that the position of each output
+ * is tracked exactly: if L is small enough there is one row of coefficients per phase, otherwise adjacent rows of a finer table are interpolated.
+ * Each output is a dot product over a contiguous history, with four partial sums so that the compiler can vectorize it, and the row is shared by all channels.
+ * Every input is consumed, and after S inputs in total exactly ceil(S * L / M) outputs have been produced, whatever the block sizes, so that two resamplers
+ * that convert there and back produce at least as many outputs as inputs. The signal is delayed by GetLatency() input samples
+ * @tparam T The sample type */
+template <typename T>
+class IPlugResampler
+{
+public:
+  /** The largest number of phases that get a row of their own */
+  static constexpr int kMaxPhases = 512;
+
+  /** Allocate and design the kernel. Not realtime safe
+   * @param nChans The number of channels
+   * @param inRate The input sample rate, in Hz
+   * @param outRate The output sample rate, in Hz
+   * @param maxInFrames The most input frames that will be passed to Process() at once
+   * @param zeroCrossings The number of zero crossings of the kernel on each side, at the lower of the two rates. This sets the steepness of the filter, and the latency
+   * @param attenuationDB The stopband attenuation, which sets the window's shape */
+  void Init(int nChans, double inRate, double outRate, int maxInFrames, int zeroCrossings = 40, double attenuationDB = 100.)
+  {
+    const int64_t in = std::max<int64_t>(std::llround(inRate), 1);
+    const int64_t out = std::max<int64_t>(std::llround(outRate), 1);
+    const int64_t g = GCD(in, out);
+
+    mL = (int) (out / g);
+    mM = (int) (in / g);
+
+    // the kernel widens when downsampling, so that its cutoff is below the output's Nyquist frequency
+    const double scale = std::min(1., (double) mL / (double) mM);
+    mHalfLength = (int) std::ceil(zeroCrossings / scale);
+    mNTaps = 2 * mHalfLength;
+    mNRows = std::min(mL, kMaxPhases);
+    mInterpolate = mNRows != mL;
+
+    // the transition band ends at the lower Nyquist frequency
+    const double beta = attenuationDB > 50. ? 0.1102 * (attenuationDB - 8.7) : 0.5842 * std::pow(attenuationDB - 21., 0.4) + 0.07886 * (attenuationDB - 21.);
+    const double transition = (attenuationDB - 8.) / (2.285 * 2. * PI * 2. * zeroCrossings);
+    const double cutoff = scale * std::max(1. - transition, 0.5);
+
+    mCoeffs.Resize((mNRows + 1) * mNTaps);
+
+    for (int r = 0; r <= mNRows; r++)
+    {
+      // the row for an output a fraction frac of an input sample after the centre tap
+      const double frac = (double) r / (double) mNRows;
+      T* pRow = mCoeffs.Get() + r * mNTaps;
+      double sum = 0.;
+
+      for (int j = 0; j < mNTaps; j++)
+      {
+        const double d = j - (mHalfLength - 1) - frac;
+        const double x = d / mHalfLength;
+        const double window = x <= -1. || x >= 1. ? 0. : BesselI0(beta * std::sqrt(1. - x * x)) / BesselI0(beta);
+        const double sinc = d == 0. ? 1. : std::sin(PI * cutoff * d) / (PI * cutoff * d);
+        pRow[j] = (T) (cutoff * sinc * window);
+        sum += pRow[j];
+      }
+
+      // unity gain at DC for every phase
+      for (int j = 0; j < mNTaps; j++)
+        pRow[j] = (T) (pRow[j] / sum);
+    }
+
+    mRow.Resize(mNTaps);
+    mHistoryStride = mNTaps + maxInFrames + mM / mL + 1;
+    mHistory.Resize(nChans * mHistoryStride);
+    mNChans = nChans;
+    mMaxInFrames = maxInFrames;
+    Reset();
+  }
+
+  /** Clear the history, so that the next output is of silence followed by the next input. Realtime safe
+   * @param startPhase Where the first output falls, in 1 / GetL() of an input sample. This shortens the latency by startPhase / GetL() input samples,
+   * so that it can be made a whole number of output samples, but up to one fewer output may be produced in total */
+  void Reset(int startPhase = 0)
+  {
+    memset(mHistory.Get(), 0, mHistory.GetSize() * sizeof(T));
+    mHistoryFrames = mNTaps - 1;
+    mIdx = startPhase / mL;
+    mPhase = startPhase % mL;
+  }
+
+  /** Resample a block. Realtime safe
+   * @param inputs nChans pointers to nFrames input frames
+   * @param nFrames The number of input frames, no more than maxInFrames
+   * @param outputs nChans pointers to room for at least MaxOutputFrames(nFrames) frames. They may not overlap the inputs
+   * @return The number of frames written to outputs */
+  int Process(T** inputs, int nFrames, T** outputs)
+  {
+    assert(nFrames <= mMaxInFrames);
+
+    for (int c = 0; c < mNChans; c++)
+      memcpy(GetHistory(c) + mHistoryFrames, inputs[c], nFrames * sizeof(T));
+
+    mHistoryFrames += nFrames;
+
+    int nOut = 0;
+
+    while (mIdx + mNTaps <= mHistoryFrames)
+    {
+      const T* pRow = GetRow();
+
+      for (int c = 0; c < mNChans; c++)
+        outputs[c][nOut] = Dot(pRow, GetHistory(c) + mIdx, mNTaps);
+
+      nOut++;
+      mPhase += mM;
+      mIdx += mPhase / mL;
+      mPhase %= mL;
+    }
+
+    // keep what the next outputs need at the start of the history
+    const int consumed = std::min(mIdx, mHistoryFrames);
+
+    for (int c = 0; c < mNChans; c++)
+      memmove(GetHistory(c), GetHistory(c) + consumed, (mHistoryFrames - consumed) * sizeof(T));
+
+    mHistoryFrames -= consumed;
+    mIdx -= consumed;
+
+    return nOut;
+  }
+
+  /** @param nInFrames A number of input frames
+   * @return The most frames that Process() can output for that many inputs */
+  int MaxOutputFrames(int nInFrames) const
+  {
+    return (int) (((int64_t) nInFrames * mL + mM - 1) / mM) + 1;
+  }
+
+  /** @return The delay of the filter, in input samples */
+  int GetLatency() const { return mHalfLength; }
+
+  /** @return The numerator of the reduced ratio of the output rate to the input rate */
+  int GetL() const { return mL; }
+
+  /** @return The denominator of the reduced ratio of the output rate to the input rate */
+  int GetM() const { return mM; }
+
+  /** @return The memory the resampler holds for its filter and history, in bytes */
+  int64_t GetBytes() const { return static_cast<int64_t>(mCoeffs.GetSize() + mRow.GetSize() + mHistory.GetSize()) * sizeof(T); }
+
+private:
+  static int64_t GCD(int64_t a, int64_t b)
+  {
+    while (b)
+    {
+      const int64_t t = a % b;
+      a = b;
+      b = t;
+    }
+
+    return a;
+  }
+
+  static double BesselI0(double x)
+  {
+    double sum = 1., term = 1.;
+
+    for (int k = 1; k < 50 && term > 1e-12 * sum; k++)
+    {
+      term *= (x / (2. * k)) * (x / (2. * k));
+      sum += term;
+    }
+
+    return sum;
+  }
+
+  /** Dot product of n values, with four partial sums so that it vectorizes without reassociating a single sum */
+  static inline T Dot(const T* pA, const T* pB, int n)
+  {
+    T s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4)
+    {
+      s0 += pA[i] * pB[i];
+      s1 += pA[i + 1] * pB[i + 1];
+      s2 += pA[i + 2] * pB[i + 2];
+      s3 += pA[i + 3] * pB[i + 3];
+    }
+
+    for (; i < n; i++)
+      s0 += pA[i] * pB[i];
+
+    return (s0 + s1) + (s2 + s3);
+  }
+
+  /** @return The coefficients for the current phase */
+  const T* GetRow()
+  {
+    if (!mInterpolate)
+      return mCoeffs.Get() + mPhase * mNTaps;
+
+    const double pos = (double) mPhase * mNRows / mL;
+    const int r = (int) pos;
+    const T frac = (T) (pos - r);
+    const T* pA = mCoeffs.Get() + r * mNTaps;
+    const T* pB = pA + mNTaps;
+    T* pRow = mRow.Get();
+
+    for (int j = 0; j < mNTaps; j++)
+      pRow[j] = pA[j] + frac * (pB[j] - pA[j]);
+
+    return pRow;
+  }
+
+  T* GetHistory(int chan) { return mHistory.Get() + chan * mHistoryStride; }
+
+  int mL = 1;
+  int mM = 1;
+  int mHalfLength = 0;
+  int mNTaps = 0;
+  int mNRows = 1;
+  bool mInterpolate = false;
+  int mNChans = 0;
+  int mMaxInFrames = 0;
+  int mHistoryStride = 0;
+  int mHistoryFrames = 0;
+  /** The first history frame of the next output's window */
+  int mIdx = 0;
+  /** The next output's position after mIdx, in 1 / mL of an input sample */
+  int mPhase = 0;
+  /** (mNRows + 1) rows of mNTaps coefficients */
+  WDL_TypedBuf<T> mCoeffs;
+  /** The interpolated row, if mInterpolate */
+  WDL_TypedBuf<T> mRow;
+  WDL_TypedBuf<T> mHistory;
+};
@@ -0,0 +1,238 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IPlugResourceArchive
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "IPlugPlatform.h"
+
+#if defined OS_WIN
+  #include <windows.h>
+#elif !defined OS_WEB
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+/** The resources of a plug-in packed into one file, resources.pak, written by Scripts/make_resource_archive.py and copied beside its other resources.
+ * The file is memory mapped once per process, the first time LocateResource() looks for it, and a resource that is in it is found as EResourceLocation::kPackedArchive,
+ * with its name as the result. The backends decode images and fonts straight from the mapped bytes, so each instance doesn't open, read and copy the files,
+ * and the pages are shared by the OS between the instances and processes that load the bundle. SVGs are copied, as NanoSVG parses in place.
+ * Everything that isn't in the archive is found as before.
+ *
+ * The file is little endian: "IPAK", a version, the number of entries and a reserved word, then for each entry the offsets and sizes of its name and data,
+ * which are four 32 bit words, then the names and the data, each of which is aligned to 16 bytes and followed by a zero byte */
+class IPlugResourceArchive
+{
+public:
+  static constexpr const char* kFileName = "resources.pak";
+  static constexpr uint32_t kVersion = 1;
+
+  static IPlugResourceArchive& Get()
+  {
+    static IPlugResourceArchive sArchive;
+    return sArchive;
+  }
+
+  ~IPlugResourceArchive() { Unmap(); }
+
+  IPlugResourceArchive(const IPlugResourceArchive&) = delete;
+  IPlugResourceArchive& operator=(const IPlugResourceArchive&) = delete;
+
+  /** Map the archive, the first time this is called. Later calls, including ones after failing to map it, do nothing
+   * @param path The path of the archive
+   * @return \c true if the archive is mapped */
+  bool Open(const char* path)
+  {
+    if (mTried.load(std::memory_order_acquire))
+      return IsOpen();
+
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    if (!mTried.load(std::memory_order_relaxed))
+    {
+      if (!Map(path) || !Index())
+        Unmap();
+
+      mTried.store(true, std::memory_order_release);
+    }
+
+    return IsOpen();
+  }
+
+  /** @return \c true if Open() has been called, whether or not it mapped the archive, so that callers only look for it once */
+  bool WasOpened() const { return mTried.load(std::memory_order_acquire); }
+
+  /** @return \c true if the archive is mapped */
+  bool IsOpen() const { return mTried.load(std::memory_order_acquire) && mpData; }
+
+  /** @param name The file name of a resource, e.g. knob@2x.png
+   * @param sizeInBytes Set to the size of the resource
+   * @return The mapped bytes of the resource, followed by a zero byte, or nullptr if it isn't in the archive */
+  const void* Find(const char* name, int& sizeInBytes) const
+  {
+    sizeInBytes = 0;
+
+    if (!IsOpen() || !name)
+      return nullptr;
+
+    auto it = mEntries.find(name);
+
+    if (it == mEntries.end())
+      return nullptr;
+
+    sizeInBytes = static_cast<int>(it->second.size);
+    return mpData + it->second.offset;
+  }
+
+  /** @return \c true if a resource is in the archive */
+  bool Contains(const char* name) const
+  {
+    int size;
+    return Find(name, size) != nullptr;
+  }
+
+private:
+  IPlugResourceArchive() = default;
+
+  struct Entry
+  {
+    uint32_t offset;
+    uint32_t size;
+  };
+
+  static uint32_t Read32(const uint8_t* pData)
+  {
+    return static_cast<uint32_t>(pData[0]) | (static_cast<uint32_t>(pData[1]) << 8) | (static_cast<uint32_t>(pData[2]) << 16) | (static_cast<uint32_t>(pData[3]) << 24);
+  }
+
+  /** Read the table of entries, checking that each lies within the file */
+  bool Index()
+  {
+    if (mSize < 16 || memcmp(mpData, "IPAK", 4) || Read32(mpData + 4) != kVersion)
+      return false;
+
+    const uint32_t nEntries = Read32(mpData + 8);
+
+    if (nEntries > (mSize - 16) / 16)
+      return false;
+
+    mEntries.reserve(nEntries);
+
+    for (uint32_t i = 0; i < nEntries; i++)
+    {
+      const uint8_t* pRecord = mpData + 16 + i * 16;
+      const uint64_t nameOffset = Read32(pRecord), nameSize = Read32(pRecord + 4);
+      const uint64_t dataOffset = Read32(pRecord + 8), dataSize = Read32(pRecord + 12);
+
+      if (nameOffset + nameSize > mSize || dataOffset + dataSize + 1 > mSize)
+        return false;
+
+      mEntries[std::string(reinterpret_cast<const char*>(mpData + nameOffset), static_cast<size_t>(nameSize))] = { static_cast<uint32_t>(dataOffset), static_cast<uint32_t>(dataSize) };
+    }
+
+    return true;
+  }
+
+  bool Map(const char* path)
+  {
+#if defined OS_WIN
+    wchar_t pathW[MAX_PATH];
+
+    if (!MultiByteToWideChar(CP_UTF8, 0, path, -1, pathW, MAX_PATH))
+      return false;
+
+    mFile = CreateFileW(pathW, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+    if (mFile == INVALID_HANDLE_VALUE)
+      return false;
+
+    LARGE_INTEGER size;
+
+    if (!GetFileSizeEx(mFile, &size) || !size.QuadPart)
+      return false;
+
+    mMapping = CreateFileMapping(mFile, NULL, PAGE_READONLY, 0, 0, NULL);
+
+    if (!mMapping)
+      return false;
+
+    mpData = static_cast<const uint8_t*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+    mSize = static_cast<size_t>(size.QuadPart);
+#elif !defined OS_WEB
+    const int fd = open(path, O_RDONLY);
+
+    if (fd < 0)
+      return false;
+
+    struct stat st;
+
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+      void* pData = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+
+      if (pData != MAP_FAILED)
+      {
+        mpData = static_cast<const uint8_t*>(pData);
+        mSize = static_cast<size_t>(st.st_size);
+      }
+    }
+
+    // the mapping keeps the file open
+    close(fd);
+#endif
+    return mpData != nullptr;
+  }
+
+  void Unmap()
+  {
+#if defined OS_WIN
+    if (mpData)
+      UnmapViewOfFile(mpData);
+
+    if (mMapping)
+      CloseHandle(mMapping);
+
+    if (mFile != INVALID_HANDLE_VALUE)
+      CloseHandle(mFile);
+
+    mMapping = NULL;
+    mFile = INVALID_HANDLE_VALUE;
+#elif !defined OS_WEB
+    if (mpData)
+      munmap(const_cast<uint8_t*>(mpData), mSize);
+#endif
+    mpData = nullptr;
+    mSize = 0;
+    mEntries.clear();
+  }
+
+  std::mutex mMutex;
+  std::atomic<bool> mTried {false};
+  const uint8_t* mpData = nullptr;
+  size_t mSize = 0;
+  std::unordered_map<std::string, Entry> mEntries;
+#if defined OS_WIN
+  HANDLE mFile = INVALID_HANDLE_VALUE;
+  HANDLE mMapping = NULL;
+#endif
+};
@@ -0,0 +1,117 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IPlugResourceIndex
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+
+/** An index of the resources that a plug-in was built with, generated from its resources folder by Scripts/make_resource_index.py, so that finding a resource is
+ * a table hit rather than a search: IGraphics::SearchImageResource() only asks LocateResource() for the one scale of an image that exists, and LocateResource()
+ * goes straight to an indexed resource, without trying paths or enumerating the binary's resources. Resources that aren't indexed, such as absolute paths, are
+ * searched for as usual. The index is installed by including the generated header in one source file of the plug-in, which installs it before main() */
+class IPlugResourceIndex
+{
+public:
+  /** A resource, under the name it is loaded by. An image's scaled versions, e.g. knob@2x.png, are one entry */
+  struct Entry
+  {
+    const char* name; // the file name, e.g. knob.png
+    const char* path; // the path within the resources folder, e.g. img/knob.png
+    uint32_t scales; // for an image, a bit for each scale that there is a file for, e.g. 0x6 for 1x and 2x, bit 1 being 1x; 0x2 for other resources
+    uint32_t bytes; // the size of the file at the lowest scale
+    uint32_t hash; // the FNV-1a hash of that file, which changes when the resource does
+  };
+
+  /** Installs an index while in scope, declared by the generated header */
+  class Installer
+  {
+  public:
+    Installer(const Entry* pEntries, int nEntries) { Get().Set(pEntries, nEntries); }
+  };
+
+  static IPlugResourceIndex& Get()
+  {
+    static IPlugResourceIndex sIndex;
+    return sIndex;
+  }
+
+  /** Install an index, which must be done before any resources are looked up, as the index isn't locked
+   * @param pEntries The entries, which must outlive the index
+   * @param nEntries The number of entries */
+  void Set(const Entry* pEntries, int nEntries)
+  {
+    mEntries.clear();
+    mEntries.reserve(nEntries * 2);
+
+    for (int i = 0; i < nEntries; i++)
+    {
+      const Entry& entry = pEntries[i];
+      mEntries[entry.name] = { &entry, 1 };
+
+      // each scaled file name of an image, as LocateResource() is asked for them
+      for (int scale = 2; scale < 32; scale++)
+      {
+        if (entry.scales & (1u << scale))
+          mEntries[ScaledName(entry.name, scale)] = { &entry, scale };
+      }
+    }
+  }
+
+  /** @return \c true if an index is installed */
+  bool IsSet() const { return !mEntries.empty(); }
+
+  /** @param name The file name of a resource, which may be a scaled name such as knob@2x.png
+   * @param pScale If not nullptr, set to the scale that the name is for
+   * @return The resource's entry, or nullptr if it isn't indexed */
+  const Entry* Find(const char* name, int* pScale = nullptr) const
+  {
+    if (mEntries.empty() || !name)
+      return nullptr;
+
+    auto it = mEntries.find(name);
+
+    if (it == mEntries.end())
+      return nullptr;
+
+    if (pScale)
+      *pScale = it->second.scale;
+
+    return it->second.pEntry;
+  }
+
+  /** @return The name of an image at a scale, e.g. knob@2x.png, as in IGraphics::SearchImageResource() */
+  static std::string ScaledName(const char* name, int scale)
+  {
+    if (scale == 1)
+      return name;
+
+    const char* pExt = strrchr(name, '.');
+    const std::string baseName = pExt ? std::string(name, pExt - name) : std::string(name);
+
+    return baseName + "@" + std::to_string(scale) + "x" + (pExt ? pExt : "");
+  }
+
+private:
+  struct Lookup
+  {
+    const Entry* pEntry;
+    int scale;
+  };
+
+  std::unordered_map<std::string, Lookup> mEntries;
+};
@@ -0,0 +1,48 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/** @file
+ * @brief The run loop of a host that drives its plug-ins' editors from its own UI thread, such as the Steinberg::Linux::IRunLoop of a VST3 host on Linux.
+ * An editor that is given one, see IEditorDelegate::SetHostRunLoop(), asks it to watch its file descriptors and to call it at its frame rate,
+ * rather than running a loop or thread of its own, so that it is only ever called on the host's UI thread
+ */
+
+#include <cstdint>
+#include <functional>
+
+/** Interface to the run loop of a host, implemented by a plug-in API class */
+class IPlugRunLoop
+{
+public:
+  typedef std::function<void()> IRunLoopFunction;
+
+  virtual ~IPlugRunLoop() {}
+
+  /** Watch a file descriptor
+   * @param fd The file descriptor
+   * @param func Called on the host's UI thread whenever the file descriptor has data to read
+   * @return \c true if the host is watching it */
+  virtual bool AddFD(int fd, IRunLoopFunction func) = 0;
+
+  /** Stop watching a file descriptor
+   * @param fd The file descriptor */
+  virtual void RemoveFD(int fd) = 0;
+
+  /** Start the timer, or change its interval if it is running
+   * @param intervalMs The interval in milliseconds
+   * @param func Called on the host's UI thread at each tick
+   * @return \c true if the host started the timer */
+  virtual bool StartTimer(uint32_t intervalMs, IRunLoopFunction func) = 0;
+
+  /** Stop the timer */
+  virtual void StopTimer() = 0;
+};
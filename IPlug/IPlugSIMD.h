@@ -0,0 +1,744 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @brief Vectorised kernels for converting, accumulating and checking blocks of samples, used when moving audio between host and plug-in buffers
+ * SSE2 (x86/x64), NEON (arm64) and WebAssembly SIMD128 (Emscripten with -msimd128, see WAM_SIMD in common-web.mk) versions are chosen at compile time.
+ * On x86/x64 an AVX version is chosen at runtime, if the CPU and OS support it, see IPlugCPU.h.
+ * Everything else falls back to plain scalar loops.
+ * @defgroup IPlugSIMD IPlug::SIMD
+ * Vectorised sample conversion kernels
+ * @{
+ */
+
+#include <cstring>
+#include <cfloat>
+#include <cmath>
+
+#include "IPlugCPU.h"
+
+/** Function pointer types for the sample kernels. pDest and pSrc may be the same pointer only for same-type accumulate */
+typedef void (*IConvertFloatToDoubleFunc)(double* pDest, const float* pSrc, int n);
+typedef void (*IConvertDoubleToFloatFunc)(float* pDest, const double* pSrc, int n);
+typedef void (*IAccumulateFloatToDoubleFunc)(double* pDest, const float* pSrc, int n);
+typedef void (*IAccumulateDoubleToFloatFunc)(float* pDest, const double* pSrc, int n);
+typedef bool (*IIsSilentFloatFunc)(const float* pSrc, int n, float threshold);
+typedef bool (*IIsSilentDoubleFunc)(const double* pSrc, int n, double threshold);
+
+/** A table of sample conversion kernels for the instruction set that was selected for this CPU */
+struct ISampleKernels
+{
+  IConvertFloatToDoubleFunc floatToDouble;
+  IConvertDoubleToFloatFunc doubleToFloat;
+  IConvertFloatToDoubleFunc floatToDoubleFTZ;
+  IConvertDoubleToFloatFunc doubleToFloatFTZ;
+  IAccumulateFloatToDoubleFunc accumulateFloatToDouble;
+  IAccumulateDoubleToFloatFunc accumulateDoubleToFloat;
+  IIsSilentFloatFunc isSilentFloat;
+  IIsSilentDoubleFunc isSilentDouble;
+  const char* name;
+
+#pragma mark - Scalar
+
+  static void ScalarFloatToDouble(double* pDest, const float* pSrc, int n)
+  {
+    for (int i = 0; i < n; i++)
+      pDest[i] = (double) pSrc[i];
+  }
+
+  static void ScalarDoubleToFloat(float* pDest, const double* pSrc, int n)
+  {
+    for (int i = 0; i < n; i++)
+      pDest[i] = (float) pSrc[i];
+  }
+
+  static void ScalarFloatToDoubleFTZ(double* pDest, const float* pSrc, int n)
+  {
+    for (int i = 0; i < n; i++)
+      pDest[i] = std::fabs(pSrc[i]) < FLT_MIN ? 0. : (double) pSrc[i];
+  }
+
+  static void ScalarDoubleToFloatFTZ(float* pDest, const double* pSrc, int n)
+  {
+    for (int i = 0; i < n; i++)
+      pDest[i] = std::fabs(pSrc[i]) < FLT_MIN ? 0.f : (float) pSrc[i];
+  }
+
+  static void ScalarAccumulateFloatToDouble(double* pDest, const float* pSrc, int n)
+  {
+    for (int i = 0; i < n; i++)
+      pDest[i] += (double) pSrc[i];
+  }
+
+  static void ScalarAccumulateDoubleToFloat(float* pDest, const double* pSrc, int n)
+  {
+    for (int i = 0; i < n; i++)
+      pDest[i] += (float) pSrc[i];
+  }
+
+  static bool ScalarIsSilentFloat(const float* pSrc, int n, float threshold)
+  {
+    for (int i = 0; i < n; i++)
+      if (std::fabs(pSrc[i]) > threshold) return false;
+    return true;
+  }
+
+  static bool ScalarIsSilentDouble(const double* pSrc, int n, double threshold)
+  {
+    for (int i = 0; i < n; i++)
+      if (std::fabs(pSrc[i]) > threshold) return false;
+    return true;
+  }
+
+#pragma mark - SSE2
+#ifdef IPLUG_SIMD_SSE2
+  static void SSE2FloatToDouble(double* pDest, const float* pSrc, int n)
+  {
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+      const __m128 v = _mm_loadu_ps(pSrc + i);
+      _mm_storeu_pd(pDest + i, _mm_cvtps_pd(v));
+      _mm_storeu_pd(pDest + i + 2, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+    }
+    ScalarFloatToDouble(pDest + i, pSrc + i, n - i);
+  }
+
+  static void SSE2DoubleToFloat(float* pDest, const double* pSrc, int n)
+  {
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+      const __m128 lo = _mm_cvtpd_ps(_mm_loadu_pd(pSrc + i));
+      const __m128 hi = _mm_cvtpd_ps(_mm_loadu_pd(pSrc + i + 2));
+      _mm_storeu_ps(pDest + i, _mm_movelh_ps(lo, hi));
+    }
+    ScalarDoubleToFloat(pDest + i, pSrc + i, n - i);
+  }
+
+  static void SSE2FloatToDoubleFTZ(double* pDest, const float* pSrc, int n)
+  {
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    const __m128 minNormal = _mm_set1_ps(FLT_MIN);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+      __m128 v = _mm_loadu_ps(pSrc + i);
+      v = _mm_and_ps(v, _mm_cmpge_ps(_mm_and_ps(v, absMask), minNormal));
+      _mm_storeu_pd(pDest + i, _mm_cvtps_pd(v));
+      _mm_storeu_pd(pDest + i + 2, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+    }
+    ScalarFloatToDoubleFTZ(pDest + i, pSrc + i, n - i);
+  }
+
+  static void SSE2DoubleToFloatFTZ(float* pDest, const double* pSrc, int n)
+  {
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    const __m128 minNormal = _mm_set1_ps(FLT_MIN);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+      const __m128 lo = _mm_cvtpd_ps(_mm_loadu_pd(pSrc + i));
+      const __m128 hi = _mm_cvtpd_ps(_mm_loadu_pd(pSrc + i + 2));
+      const __m128 v = _mm_movelh_ps(lo, hi);
+      _mm_storeu_ps(pDest + i, _mm_and_ps(v, _mm_cmpge_ps(_mm_and_ps(v, absMask), minNormal)));
+    }
+    ScalarDoubleToFloatFTZ(pDest + i, pSrc + i, n - i);
+  }
+
+  static void SSE2AccumulateFloatToDouble(double* pDest, const float* pSrc, int n)
+  {
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+      const __m128 v = _mm_loadu_ps(pSrc + i);
+      _mm_storeu_pd(pDest + i, _mm_add_pd(_mm_loadu_pd(pDest + i), _mm_cvtps_pd(v)));
+      _mm_storeu_pd(pDest + i + 2, _mm_add_pd(_mm_loadu_pd(pDest + i + 2), _mm_cvtps_pd(_mm_movehl_ps(v, v))));
+    }
+    ScalarAccumulateFloatToDouble(pDest + i, pSrc + i, n - i);
+  }
+
+  static void SSE2AccumulateDoubleToFloat(float* pDest, const double* pSrc, int n)
+  {
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+      const __m128 lo = _mm_cvtpd_ps(_mm_loadu_pd(pSrc + i));
+      const __m128 hi = _mm_cvtpd_ps(_mm_loadu_pd(pSrc + i + 2));
+      _mm_storeu_ps(pDest + i, _mm_add_ps(_mm_loadu_ps(pDest + i), _mm_movelh_ps(lo, hi)));
+    }
+    ScalarAccumulateDoubleToFloat(pDest + i, pSrc + i, n - i);
+  }
+
+  static bool SSE2IsSilentFloat(const float* pSrc, int n, float threshold)
+  {
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    const __m128 thresh = _mm_set1_ps(threshold);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+      const __m128 a = _mm_and_ps(_mm_loadu_ps(pSrc + i), absMask);
+      const __m128 b = _mm_and_ps(_mm_loadu_ps(pSrc + i + 4), absMask);
+      if (_mm_movemask_ps(_mm_cmpgt_ps(_mm_max_ps(a, b), thresh))) return false;
+    }
+    return ScalarIsSilentFloat(pSrc + i, n - i, threshold);
+  }
+
+  static bool SSE2IsSilentDouble(const double* pSrc, int n, double threshold)
+  {
+    const __m128d absMask = _mm_castsi128_pd(_mm_set1_epi64x(0x7FFFFFFFFFFFFFFFLL));
+    const __m128d thresh = _mm_set1_pd(threshold);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+      const __m128d a = _mm_and_pd(_mm_loadu_pd(pSrc + i), absMask);
+      const __m128d b = _mm_and_pd(_mm_loadu_pd(pSrc + i + 2), absMask);
+      if (_mm_movemask_pd(_mm_cmpgt_pd(_mm_max_pd(a, b), thresh))) return false;
+    }
+    return ScalarIsSilentDouble(pSrc + i, n - i, threshold);
+  }
+#endif
+
+#pragma mark - AVX
+#ifdef IPLUG_SIMD_AVX
+  IPLUG_TARGET_AVX static void AVXFloatToDouble(double* pDest, const float* pSrc, int n)
+  {
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+      _mm256_storeu_pd(pDest + i, _mm256_cvtps_pd(_mm_loadu_ps(pSrc + i)));
+      _mm256_storeu_pd(pDest + i + 4, _mm256_cvtps_pd(_mm_loadu_ps(pSrc + i + 4)));
+    }
+    ScalarFloatToDouble(pDest + i, pSrc + i, n - i);
+  }
+
+  IPLUG_TARGET_AVX static void AVXDoubleToFloat(float* pDest, const double* pSrc, int n)
+  {
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+      _mm_storeu_ps(pDest + i, _mm256_cvtpd_ps(_mm256_loadu_pd(pSrc + i)));
+      _mm_storeu_ps(pDest + i + 4, _mm256_cvtpd_ps(_mm256_loadu_pd(pSrc + i + 4)));
+    }
+    ScalarDoubleToFloat(pDest + i, pSrc + i, n - i);
+  }
+
+  IPLUG_TARGET_AVX static void AVXFloatToDoubleFTZ(double* pDest, const float* pSrc, int n)
+  {
+    const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+    const __m256 minNormal = _mm256_set1_ps(FLT_MIN);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+      __m256 v = _mm256_loadu_ps(pSrc + i);
+      v = _mm256_and_ps(v, _mm256_cmp_ps(_mm256_and_ps(v, absMask), minNormal, _CMP_GE_OQ));
+      _mm256_storeu_pd(pDest + i, _mm256_cvtps_pd(_mm256_castps256_ps128(v)));
+      _mm256_storeu_pd(pDest + i + 4, _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)));
+    }
+    ScalarFloatToDoubleFTZ(pDest + i, pSrc + i, n - i);
+  }
+
+  IPLUG_TARGET_AVX static void AVXDoubleToFloatFTZ(float* pDest, const double* pSrc, int n)
+  {
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    const __m128 minNormal = _mm_set1_ps(FLT_MIN);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+      const __m128 v = _mm256_cvtpd_ps(_mm256_loadu_pd(pSrc + i));
+      _mm_storeu_ps(pDest + i, _mm_and_ps(v, _mm_cmpge_ps(_mm_and_ps(v, absMask), minNormal)));
+    }
+    ScalarDoubleToFloatFTZ(pDest + i, pSrc + i, n - i);
+  }
+
+  IPLUG_TARGET_AVX static void AVXAccumulateFloatToDouble(double* pDest, const float* pSrc, int n)
+  {
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+      _mm256_storeu_pd(pDest + i, _mm256_add_pd(_mm256_loadu_pd(pDest + i), _mm256_cvtps_pd(_mm_loadu_ps(pSrc + i))));
+    }
+    ScalarAccumulateFloatToDouble(pDest + i, pSrc + i, n - i);
+  }
+
+  IPLUG_TARGET_AVX static void AVXAccumulateDoubleToFloat(float* pDest, const double* pSrc, int n)
+  {
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+      _mm_storeu_ps(pDest + i, _mm_add_ps(_mm_loadu_ps(pDest + i), _mm256_cvtpd_ps(_mm256_loadu_pd(pSrc + i))));
+    }
+    ScalarAccumulateDoubleToFloat(pDest + i, pSrc + i, n - i);
+  }
+
+  IPLUG_TARGET_AVX static bool AVXIsSilentFloat(const float* pSrc, int n, float threshold)
+  {
+    const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+    const __m256 thresh = _mm256_set1_ps(threshold);
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+      const __m256 a = _mm256_and_ps(_mm256_loadu_ps(pSrc + i), absMask);
+      const __m256 b = _mm256_and_ps(_mm256_loadu_ps(pSrc + i + 8), absMask);
+      if (_mm256_movemask_ps(_mm256_cmp_ps(_mm256_max_ps(a, b), thresh, _CMP_GT_OQ))) return false;
+    }
+    return ScalarIsSilentFloat(pSrc + i, n - i, threshold);
+  }
+
+  IPLUG_TARGET_AVX static bool AVXIsSilentDouble(const double* pSrc, int n, double threshold)
+  {
+    const __m256d absMask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7FFFFFFFFFFFFFFFLL));
+    const __m256d thresh = _mm256_set1_pd(threshold);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+      const __m256d a = _mm256_and_pd(_mm256_loadu_pd(pSrc + i), absMask);
+      const __m256d b = _mm256_and_pd(_mm256_loadu_pd(pSrc + i + 4), absMask);
+      if (_mm256_movemask_pd(_mm256_cmp_pd(_mm256_max_pd(a, b), thresh, _CMP_GT_OQ))) return false;
+    }
+    return ScalarIsSilentDouble(pSrc + i, n - i, threshold);
+  }
+#endif
+
+#pragma mark - NEON
+#ifdef IPLUG_SIMD_NEON
+  static void NEONFloatToDouble(double* pDest, const float* pSrc, int n)
+  {
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+      const float32x4_t v = vld1q_f32(pSrc + i);
+      vst1q_f64(pDest + i, vcvt_f64_f32(vget_low_f32(v)));
+      vst1q_f64(pDest + i + 2, vcvt_high_f64_f32(v));
+    }
+    ScalarFloatToDouble(pDest + i, pSrc + i, n - i);
+  }
+
+  static void NEONDoubleToFloat(float* pDest, const double* pSrc, int n)
+  {
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+      const float32x2_t lo = vcvt_f32_f64(vld1q_f64(pSrc + i));
+      vst1q_f32(pDest + i, vcvt_high_f32_f64(lo, vld1q_f64(pSrc + i + 2)));
+    }
+    ScalarDoubleToFloat(pDest + i, pSrc + i, n - i);
+  }
+
+  static void NEONFloatToDoubleFTZ(double* pDest, const float* pSrc, int n)
+  {
+    const float32x4_t minNormal = vdupq_n_f32(FLT_MIN);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+      float32x4_t v = vld1q_f32(pSrc + i);
+      v = vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(v), vcageq_f32(v, minNormal)));
+      vst1q_f64(pDest + i, vcvt_f64_f32(vget_low_f32(v)));
+      vst1q_f64(pDest + i + 2, vcvt_high_f64_f32(v));
+    }
+    ScalarFloatToDoubleFTZ(pDest + i, pSrc + i, n - i);
+  }
+
+  static void NEONDoubleToFloatFTZ(float* pDest, const double* pSrc, int n)
+  {
+    const float32x4_t minNormal = vdupq_n_f32(FLT_MIN);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+      const float32x2_t lo = vcvt_f32_f64(vld1q_f64(pSrc + i));
+      const float32x4_t v = vcvt_high_f32_f64(lo, vld1q_f64(pSrc + i + 2));
+      vst1q_f32(pDest + i, vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(v), vcageq_f32(v, minNormal))));
+    }
+    ScalarDoubleToFloatFTZ(pDest + i, pSrc + i, n - i);
+  }
+
+  static void NEONAccumulateFloatToDouble(double* pDest, const float* pSrc, int n)
+  {
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+      const float32x4_t v = vld1q_f32(pSrc + i);
+      vst1q_f64(pDest + i, vaddq_f64(vld1q_f64(pDest + i), vcvt_f64_f32(vget_low_f32(v))));
+      vst1q_f64(pDest + i + 2, vaddq_f64(vld1q_f64(pDest + i + 2), vcvt_high_f64_f32(v)));
+    }
+    ScalarAccumulateFloatToDouble(pDest + i, pSrc + i, n - i);
+  }
+
+  static void NEONAccumulateDoubleToFloat(float* pDest, const double* pSrc, int n)
+  {
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+      const float32x2_t lo = vcvt_f32_f64(vld1q_f64(pSrc + i));
+      vst1q_f32(pDest + i, vaddq_f32(vld1q_f32(pDest + i), vcvt_high_f32_f64(lo, vld1q_f64(pSrc + i + 2))));
+    }
+    ScalarAccumulateDoubleToFloat(pDest + i, pSrc + i, n - i);
+  }
+
+  static bool NEONIsSilentFloat(const float* pSrc, int n, float threshold)
+  {
+    const float32x4_t thresh = vdupq_n_f32(threshold);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+      const float32x4_t m = vmaxq_f32(vabsq_f32(vld1q_f32(pSrc + i)), vabsq_f32(vld1q_f32(pSrc + i + 4)));
+      if (vmaxvq_u32(vcgtq_f32(m, thresh))) return false;
+    }
+    return ScalarIsSilentFloat(pSrc + i, n - i, threshold);
+  }
+
+  static bool NEONIsSilentDouble(const double* pSrc, int n, double threshold)
+  {
+    const float64x2_t thresh = vdupq_n_f64(threshold);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+      const float64x2_t m = vmaxq_f64(vabsq_f64(vld1q_f64(pSrc + i)), vabsq_f64(vld1q_f64(pSrc + i + 2)));
+      if (vmaxvq_u32(vreinterpretq_u32_u64(vcgtq_f64(m, thresh)))) return false;
+    }
+    return ScalarIsSilentDouble(pSrc + i, n - i, threshold);
+  }
+#endif
+
+#pragma mark - WebAssembly SIMD128
+#ifdef IPLUG_SIMD_WASM
+  static void WASMFloatToDouble(double* pDest, const float* pSrc, int n)
+  {
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+      const v128_t v = wasm_v128_load(pSrc + i);
+      wasm_v128_store(pDest + i, wasm_f64x2_promote_low_f32x4(v));
+      wasm_v128_store(pDest + i + 2, wasm_f64x2_promote_low_f32x4(wasm_i32x4_shuffle(v, v, 2, 3, 2, 3)));
+    }
+    ScalarFloatToDouble(pDest + i, pSrc + i, n - i);
+  }
+
+  static void WASMDoubleToFloat(float* pDest, const double* pSrc, int n)
+  {
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+      const v128_t lo = wasm_f32x4_demote_f64x2_zero(wasm_v128_load(pSrc + i));
+      const v128_t hi = wasm_f32x4_demote_f64x2_zero(wasm_v128_load(pSrc + i + 2));
+      wasm_v128_store(pDest + i, wasm_i32x4_shuffle(lo, hi, 0, 1, 4, 5));
+    }
+    ScalarDoubleToFloat(pDest + i, pSrc + i, n - i);
+  }
+
+  static void WASMFloatToDoubleFTZ(double* pDest, const float* pSrc, int n)
+  {
+    const v128_t minNormal = wasm_f32x4_splat(FLT_MIN);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+      v128_t v = wasm_v128_load(pSrc + i);
+      v = wasm_v128_and(v, wasm_f32x4_ge(wasm_f32x4_abs(v), minNormal));
+      wasm_v128_store(pDest + i, wasm_f64x2_promote_low_f32x4(v));
+      wasm_v128_store(pDest + i + 2, wasm_f64x2_promote_low_f32x4(wasm_i32x4_shuffle(v, v, 2, 3, 2, 3)));
+    }
+    ScalarFloatToDoubleFTZ(pDest + i, pSrc + i, n - i);
+  }
+
+  static void WASMDoubleToFloatFTZ(float* pDest, const double* pSrc, int n)
+  {
+    const v128_t minNormal = wasm_f32x4_splat(FLT_MIN);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+      const v128_t lo = wasm_f32x4_demote_f64x2_zero(wasm_v128_load(pSrc + i));
+      const v128_t hi = wasm_f32x4_demote_f64x2_zero(wasm_v128_load(pSrc + i + 2));
+      const v128_t v = wasm_i32x4_shuffle(lo, hi, 0, 1, 4, 5);
+      wasm_v128_store(pDest + i, wasm_v128_and(v, wasm_f32x4_ge(wasm_f32x4_abs(v), minNormal)));
+    }
+    ScalarDoubleToFloatFTZ(pDest + i, pSrc + i, n - i);
+  }
+
+  static void WASMAccumulateFloatToDouble(double* pDest, const float* pSrc, int n)
+  {
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+      const v128_t v = wasm_v128_load(pSrc + i);
+      wasm_v128_store(pDest + i, wasm_f64x2_add(wasm_v128_load(pDest + i), wasm_f64x2_promote_low_f32x4(v)));
+      wasm_v128_store(pDest + i + 2, wasm_f64x2_add(wasm_v128_load(pDest + i + 2), wasm_f64x2_promote_low_f32x4(wasm_i32x4_shuffle(v, v, 2, 3, 2, 3))));
+    }
+    ScalarAccumulateFloatToDouble(pDest + i, pSrc + i, n - i);
+  }
+
+  static void WASMAccumulateDoubleToFloat(float* pDest, const double* pSrc, int n)
+  {
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+      const v128_t lo = wasm_f32x4_demote_f64x2_zero(wasm_v128_load(pSrc + i));
+      const v128_t hi = wasm_f32x4_demote_f64x2_zero(wasm_v128_load(pSrc + i + 2));
+      wasm_v128_store(pDest + i, wasm_f32x4_add(wasm_v128_load(pDest + i), wasm_i32x4_shuffle(lo, hi, 0, 1, 4, 5)));
+    }
+    ScalarAccumulateDoubleToFloat(pDest + i, pSrc + i, n - i);
+  }
+
+  static bool WASMIsSilentFloat(const float* pSrc, int n, float threshold)
+  {
+    const v128_t thresh = wasm_f32x4_splat(threshold);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+      const v128_t a = wasm_f32x4_gt(wasm_f32x4_abs(wasm_v128_load(pSrc + i)), thresh);
+      const v128_t b = wasm_f32x4_gt(wasm_f32x4_abs(wasm_v128_load(pSrc + i + 4)), thresh);
+      if (wasm_v128_any_true(wasm_v128_or(a, b))) return false;
+    }
+    return ScalarIsSilentFloat(pSrc + i, n - i, threshold);
+  }
+
+  static bool WASMIsSilentDouble(const double* pSrc, int n, double threshold)
+  {
+    const v128_t thresh = wasm_f64x2_splat(threshold);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+      const v128_t a = wasm_f64x2_gt(wasm_f64x2_abs(wasm_v128_load(pSrc + i)), thresh);
+      const v128_t b = wasm_f64x2_gt(wasm_f64x2_abs(wasm_v128_load(pSrc + i + 2)), thresh);
+      if (wasm_v128_any_true(wasm_v128_or(a, b))) return false;
+    }
+    return ScalarIsSilentDouble(pSrc + i, n - i, threshold);
+  }
+#endif
+
+#pragma mark -
+
+  /** @return The kernel table for the instruction set selected by IPlugCPU */
+  static const ISampleKernels& Get() { return *GetDispatch().Get(); }
+
+  /** @return The dispatch of the kernel tables, e.g. to compare one instruction set's with another's with GetFor() */
+  static const IPlugDispatch<const ISampleKernels*>& GetDispatch()
+  {
+    static const ISampleKernels sScalar { ScalarFloatToDouble, ScalarDoubleToFloat, ScalarFloatToDoubleFTZ, ScalarDoubleToFloatFTZ, ScalarAccumulateFloatToDouble, ScalarAccumulateDoubleToFloat, ScalarIsSilentFloat, ScalarIsSilentDouble, "Scalar" };
+  #if defined IPLUG_SIMD_SSE2
+    static const ISampleKernels sSSE2 { SSE2FloatToDouble, SSE2DoubleToFloat, SSE2FloatToDoubleFTZ, SSE2DoubleToFloatFTZ, SSE2AccumulateFloatToDouble, SSE2AccumulateDoubleToFloat, SSE2IsSilentFloat, SSE2IsSilentDouble, "SSE2" };
+    #ifdef IPLUG_SIMD_AVX
+    static const ISampleKernels sAVX { AVXFloatToDouble, AVXDoubleToFloat, AVXFloatToDoubleFTZ, AVXDoubleToFloatFTZ, AVXAccumulateFloatToDouble, AVXAccumulateDoubleToFloat, AVXIsSilentFloat, AVXIsSilentDouble, "AVX" };
+    static const IPlugDispatch<const ISampleKernels*> sDispatch { &sScalar, { { kISASSE2, &sSSE2 }, { kISAAVX, &sAVX } } };
+    #else
+    static const IPlugDispatch<const ISampleKernels*> sDispatch { &sScalar, { { kISASSE2, &sSSE2 } } };
+    #endif
+  #elif defined IPLUG_SIMD_NEON
+    static const ISampleKernels sNEON { NEONFloatToDouble, NEONDoubleToFloat, NEONFloatToDoubleFTZ, NEONDoubleToFloatFTZ, NEONAccumulateFloatToDouble, NEONAccumulateDoubleToFloat, NEONIsSilentFloat, NEONIsSilentDouble, "NEON" };
+    static const IPlugDispatch<const ISampleKernels*> sDispatch { &sScalar, { { kISANEON, &sNEON } } };
+  #elif defined IPLUG_SIMD_WASM
+    static const ISampleKernels sWASM { WASMFloatToDouble, WASMDoubleToFloat, WASMFloatToDoubleFTZ, WASMDoubleToFloatFTZ, WASMAccumulateFloatToDouble, WASMAccumulateDoubleToFloat, WASMIsSilentFloat, WASMIsSilentDouble, "WASM SIMD128" };
+    static const IPlugDispatch<const ISampleKernels*> sDispatch { &sScalar, { { kISAWASM, &sWASM } } };
+  #else
+    static const IPlugDispatch<const ISampleKernels*> sDispatch { &sScalar };
+  #endif
+    return sDispatch;
+  }
+};
+
+/** Copy and convert a block of samples. Same-type copies are a memcpy, float/double conversions use ISampleKernels
+ * @param pDest Destination buffer
+ * @param pSrc Source buffer
+ * @param n Number of samples */
+static inline void ConvertSamples(double* pDest, const float* pSrc, int n) { ISampleKernels::Get().floatToDouble(pDest, pSrc, n); }
+static inline void ConvertSamples(float* pDest, const double* pSrc, int n) { ISampleKernels::Get().doubleToFloat(pDest, pSrc, n); }
+static inline void ConvertSamples(float* pDest, const float* pSrc, int n) { if (pDest != pSrc) memcpy(pDest, pSrc, n * sizeof(float)); }
+static inline void ConvertSamples(double* pDest, const double* pSrc, int n) { if (pDest != pSrc) memcpy(pDest, pSrc, n * sizeof(double)); }
+
+/** Copy and convert a block of samples, replacing values below the smallest normal single precision float with zero
+ * @param pDest Destination buffer
+ * @param pSrc Source buffer
+ * @param n Number of samples */
+static inline void ConvertSamplesFlushDenormals(double* pDest, const float* pSrc, int n) { ISampleKernels::Get().floatToDoubleFTZ(pDest, pSrc, n); }
+static inline void ConvertSamplesFlushDenormals(float* pDest, const double* pSrc, int n) { ISampleKernels::Get().doubleToFloatFTZ(pDest, pSrc, n); }
+
+/** Add a block of samples to another, converting if necessary
+ * @param pDest Destination buffer, which will be added to
+ * @param pSrc Source buffer
+ * @param n Number of samples */
+static inline void AccumulateSamples(double* pDest, const float* pSrc, int n) { ISampleKernels::Get().accumulateFloatToDouble(pDest, pSrc, n); }
+static inline void AccumulateSamples(float* pDest, const double* pSrc, int n) { ISampleKernels::Get().accumulateDoubleToFloat(pDest, pSrc, n); }
+
+template <typename T>
+static inline void AccumulateSamples(T* pDest, const T* pSrc, int n)
+{
+  for (int i = 0; i < n; i++)
+    pDest[i] += pSrc[i];
+}
+
+/** Check whether a block of samples is silent
+ * @param pSrc Source buffer
+ * @param n Number of samples
+ * @param threshold The largest absolute sample value that counts as silence
+ * @return \c true if no sample in the block has an absolute value above threshold */
+static inline bool IsSilent(const float* pSrc, int n, float threshold = 0.f) { return ISampleKernels::Get().isSilentFloat(pSrc, n, threshold); }
+static inline bool IsSilent(const double* pSrc, int n, double threshold = 0.) { return ISampleKernels::Get().isSilentDouble(pSrc, n, threshold); }
+
+/** Interleave planar channel buffers into frames, stereo uses SSE2/NEON/WASM SIMD128 unpack instructions
+ * @param pDest Destination buffer of nChans * n samples
+ * @param ppSrc nChans source buffers of n samples
+ * @param nChans Number of channels
+ * @param n Number of frames */
+template <typename T>
+static inline void InterleaveSamples(T* pDest, const T* const* ppSrc, int nChans, int n)
+{
+  int i = 0;
+  if (nChans == 2)
+  {
+    const T* pL = ppSrc[0];
+    const T* pR = ppSrc[1];
+#if defined IPLUG_SIMD_SSE2
+    if (sizeof(T) == sizeof(double))
+    {
+      for (; i + 2 <= n; i += 2)
+      {
+        const __m128d l = _mm_loadu_pd((const double*) pL + i);
+        const __m128d r = _mm_loadu_pd((const double*) pR + i);
+        _mm_storeu_pd((double*) pDest + 2 * i, _mm_unpacklo_pd(l, r));
+        _mm_storeu_pd((double*) pDest + 2 * i + 2, _mm_unpackhi_pd(l, r));
+      }
+    }
+    else
+    {
+      for (; i + 4 <= n; i += 4)
+      {
+        const __m128 l = _mm_loadu_ps((const float*) pL + i);
+        const __m128 r = _mm_loadu_ps((const float*) pR + i);
+        _mm_storeu_ps((float*) pDest + 2 * i, _mm_unpacklo_ps(l, r));
+        _mm_storeu_ps((float*) pDest + 2 * i + 4, _mm_unpackhi_ps(l, r));
+      }
+    }
+#elif defined IPLUG_SIMD_NEON
+    if (sizeof(T) == sizeof(float))
+    {
+      for (; i + 4 <= n; i += 4)
+        vst2q_f32((float*) pDest + 2 * i, float32x4x2_t {{ vld1q_f32((const float*) pL + i), vld1q_f32((const float*) pR + i) }});
+    }
+#elif defined IPLUG_SIMD_WASM
+    if (sizeof(T) == sizeof(double))
+    {
+      for (; i + 2 <= n; i += 2)
+      {
+        const v128_t l = wasm_v128_load((const double*) pL + i);
+        const v128_t r = wasm_v128_load((const double*) pR + i);
+        wasm_v128_store((double*) pDest + 2 * i, wasm_i64x2_shuffle(l, r, 0, 2));
+        wasm_v128_store((double*) pDest + 2 * i + 2, wasm_i64x2_shuffle(l, r, 1, 3));
+      }
+    }
+    else
+    {
+      for (; i + 4 <= n; i += 4)
+      {
+        const v128_t l = wasm_v128_load((const float*) pL + i);
+        const v128_t r = wasm_v128_load((const float*) pR + i);
+        wasm_v128_store((float*) pDest + 2 * i, wasm_i32x4_shuffle(l, r, 0, 4, 1, 5));
+        wasm_v128_store((float*) pDest + 2 * i + 4, wasm_i32x4_shuffle(l, r, 2, 6, 3, 7));
+      }
+    }
+#endif
+    for (; i < n; i++)
+    {
+      pDest[2 * i] = pL[i];
+      pDest[2 * i + 1] = pR[i];
+    }
+    return;
+  }
+
+  for (; i < n; i++)
+  {
+    for (int c = 0; c < nChans; c++)
+      pDest[i * nChans + c] = ppSrc[c][i];
+  }
+}
+
+/** De-interleave frames into planar channel buffers, stereo uses SSE2/NEON/WASM SIMD128 shuffle instructions
+ * @param ppDest nChans destination buffers of n samples
+ * @param pSrc Source buffer of nChans * n samples
+ * @param nChans Number of channels
+ * @param n Number of frames */
+template <typename T>
+static inline void DeinterleaveSamples(T* const* ppDest, const T* pSrc, int nChans, int n)
+{
+  int i = 0;
+  if (nChans == 2)
+  {
+    T* pL = ppDest[0];
+    T* pR = ppDest[1];
+#if defined IPLUG_SIMD_SSE2
+    if (sizeof(T) == sizeof(double))
+    {
+      for (; i + 2 <= n; i += 2)
+      {
+        const __m128d a = _mm_loadu_pd((const double*) pSrc + 2 * i);
+        const __m128d b = _mm_loadu_pd((const double*) pSrc + 2 * i + 2);
+        _mm_storeu_pd((double*) pL + i, _mm_unpacklo_pd(a, b));
+        _mm_storeu_pd((double*) pR + i, _mm_unpackhi_pd(a, b));
+      }
+    }
+    else
+    {
+      for (; i + 4 <= n; i += 4)
+      {
+        const __m128 a = _mm_loadu_ps((const float*) pSrc + 2 * i);
+        const __m128 b = _mm_loadu_ps((const float*) pSrc + 2 * i + 4);
+        _mm_storeu_ps((float*) pL + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm_storeu_ps((float*) pR + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+      }
+    }
+#elif defined IPLUG_SIMD_NEON
+    if (sizeof(T) == sizeof(float))
+    {
+      for (; i + 4 <= n; i += 4)
+      {
+        const float32x4x2_t v = vld2q_f32((const float*) pSrc + 2 * i);
+        vst1q_f32((float*) pL + i, v.val[0]);
+        vst1q_f32((float*) pR + i, v.val[1]);
+      }
+    }
+#elif defined IPLUG_SIMD_WASM
+    if (sizeof(T) == sizeof(double))
+    {
+      for (; i + 2 <= n; i += 2)
+      {
+        const v128_t a = wasm_v128_load((const double*) pSrc + 2 * i);
+        const v128_t b = wasm_v128_load((const double*) pSrc + 2 * i + 2);
+        wasm_v128_store((double*) pL + i, wasm_i64x2_shuffle(a, b, 0, 2));
+        wasm_v128_store((double*) pR + i, wasm_i64x2_shuffle(a, b, 1, 3));
+      }
+    }
+    else
+    {
+      for (; i + 4 <= n; i += 4)
+      {
+        const v128_t a = wasm_v128_load((const float*) pSrc + 2 * i);
+        const v128_t b = wasm_v128_load((const float*) pSrc + 2 * i + 4);
+        wasm_v128_store((float*) pL + i, wasm_i32x4_shuffle(a, b, 0, 2, 4, 6));
+        wasm_v128_store((float*) pR + i, wasm_i32x4_shuffle(a, b, 1, 3, 5, 7));
+      }
+    }
+#endif
+    for (; i < n; i++)
+    {
+      pL[i] = pSrc[2 * i];
+      pR[i] = pSrc[2 * i + 1];
+    }
+    return;
+  }
+
+  for (; i < n; i++)
+  {
+    for (int c = 0; c < nChans; c++)
+      ppDest[c][i] = pSrc[i * nChans + c];
+  }
+}
+
+/**@}*/
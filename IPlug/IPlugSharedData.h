@@ -0,0 +1,169 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @brief Sharing read-only DSP data and state between instances of a plug-in that are loaded in the same process
+ */
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+/** A process-wide cache of immutable objects, such as filter coefficient tables, lookup tables or window functions, shared by every instance that asks for the same key.
+ * An object is created by the first instance to ask for it and freed when the last instance lets go of its std::shared_ptr, so e.g. the twelve
+ * instances of a multi-mono plug-in on a 7.1.4 track build one coefficient table between them. Get() locks and may allocate, so call it from
+ * OnReset() or another non-realtime method, and keep the pointer in a member for ProcessBlock() */
+class IPlugSharedData
+{
+public:
+  /** Get the object for key, creating it if no instance holds one
+   * @tparam T The type of the object. Objects of different types never share an entry, even with the same key
+   * @param key Identifies the contents, so it should encode everything the object depends on, e.g. "lpf-coeffs-48000-512"
+   * @param create Called with the lock held to create the object if needed, returns std::shared_ptr<T> or std::unique_ptr<T>
+   * @return The shared object, which must be treated as read-only */
+  template <typename T, typename FUNC>
+  static std::shared_ptr<const T> Get(const char* key, FUNC&& create)
+  {
+    const std::string entryKey = std::string(typeid(T).name()) + ":" + key;
+
+    std::lock_guard<std::mutex> lock(Mutex());
+    auto& entries = Entries();
+
+    auto it = entries.find(entryKey);
+
+    if (it != entries.end())
+    {
+      if (auto pExisting = it->second.lock())
+        return std::static_pointer_cast<const T>(pExisting);
+    }
+
+    std::shared_ptr<const T> pNew(create());
+    entries[entryKey] = pNew;
+
+    // drop entries whose objects have been freed, so that the map doesn't grow with every sample rate change
+    for (auto e = entries.begin(); e != entries.end();)
+    {
+      if (e->second.expired())
+        e = entries.erase(e);
+      else
+        ++e;
+    }
+
+    return pNew;
+  }
+
+private:
+  static std::mutex& Mutex()
+  {
+    static std::mutex sMutex;
+    return sMutex;
+  }
+
+  static std::map<std::string, std::weak_ptr<const void>>& Entries()
+  {
+    static std::map<std::string, std::weak_ptr<const void>> sEntries;
+    return sEntries;
+  }
+};
+
+/** A process-wide registry of live plug-in instances, grouped by a key chosen by the API class, e.g. the multi-mono instances on one Pro Tools track.
+ * The members of a group can visit their siblings to share state that the host doesn't sync itself. Every method locks, so call them from the main thread only
+ * @tparam T The type of the instances, usually an API class */
+template <typename T>
+class IPlugInstanceGroup
+{
+public:
+  /** Add an instance to a group, leaving the group it was in before
+   * @param pInstance The instance
+   * @param key The group, instances with equal keys are siblings. An empty key leaves the current group without joining another */
+  static void Join(T* pInstance, const char* key)
+  {
+    std::lock_guard<std::mutex> lock(Mutex());
+    RemoveLocked(pInstance);
+
+    if (key && *key)
+      Members().push_back({key, pInstance});
+  }
+
+  /** Remove an instance from its group. Call this before the instance is destroyed */
+  static void Leave(T* pInstance)
+  {
+    std::lock_guard<std::mutex> lock(Mutex());
+    RemoveLocked(pInstance);
+  }
+
+  /** Call func for every other instance in the same group as pInstance
+   * @param func Called as func(T& sibling). It must not Join() or Leave() */
+  static void ForEachSibling(T* pInstance, const std::function<void(T&)>& func)
+  {
+    std::lock_guard<std::mutex> lock(Mutex());
+    auto& members = Members();
+
+    auto self = std::find_if(members.begin(), members.end(), [pInstance](const Member& m) { return m.mInstance == pInstance; });
+
+    if (self == members.end())
+      return;
+
+    const std::string key = self->mKey;
+
+    for (auto& m : members)
+    {
+      if (m.mInstance != pInstance && m.mKey == key)
+        func(*m.mInstance);
+    }
+  }
+
+  /** @return The number of instances in the same group as pInstance, including itself, or 0 if it isn't in a group */
+  static int NInstancesInGroup(T* pInstance)
+  {
+    std::lock_guard<std::mutex> lock(Mutex());
+    auto& members = Members();
+
+    auto self = std::find_if(members.begin(), members.end(), [pInstance](const Member& m) { return m.mInstance == pInstance; });
+
+    if (self == members.end())
+      return 0;
+
+    return (int) std::count_if(members.begin(), members.end(), [&self](const Member& m) { return m.mKey == self->mKey; });
+  }
+
+private:
+  struct Member
+  {
+    std::string mKey;
+    T* mInstance;
+  };
+
+  static void RemoveLocked(T* pInstance)
+  {
+    auto& members = Members();
+    members.erase(std::remove_if(members.begin(), members.end(), [pInstance](const Member& m) { return m.mInstance == pInstance; }), members.end());
+  }
+
+  static std::mutex& Mutex()
+  {
+    static std::mutex sMutex;
+    return sMutex;
+  }
+
+  static std::vector<Member>& Members()
+  {
+    static std::vector<Member> sMembers;
+    return sMembers;
+  }
+};
@@ -0,0 +1,362 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @brief Streaming state I/O, for plug-ins that embed large assets such as samples or impulse responses in their state
+ *
+ * The core state, the parameters and anything small, is still written by IPluginBase::SerializeState() into an IByteChunk.
+ * Large data is written afterwards by IPluginBase::SerializeLargeState() through an IStateWriter, which the API class connects to the host's stream
+ * (VST3's IBStream, CLAP's clap_ostream) or to a buffer that grows without copying what has been written (AU's CFData), so that it is never built up in memory as one chunk.
+ * On load IPluginBase::UnserializeLargeState() reads it through an IStateReader after the core state has been restored and OnRestoreState() called,
+ * so parameters apply at once and the assets follow. With IPLUG_STATE_COMPRESSION defined, and WDL's zlib linked, the data can be compressed, see IPluginBase::SetLargeStateCompression(),
+ * a block at a time on a worker thread while the plug-in writes the next block
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <vector>
+
+#ifdef IPLUG_STATE_COMPRESSION
+#include "zlib/zlib.h"
+#endif
+
+#include "IPlugStructs.h"
+
+/** Where large state data is written, see IPluginBase::SerializeLargeState() */
+class IStateWriter
+{
+public:
+  virtual ~IStateWriter() {}
+
+  /** @param pData The bytes to write
+   * @param size The number of bytes
+   * @return \c true if all of them were written */
+  virtual bool Write(const void* pData, int64_t size) = 0;
+
+  template <class T>
+  bool Put(const T& value) { return Write(&value, sizeof(T)); }
+
+  /** Write a chunk, preceded by its size, so that IStateReader::GetChunk() can read it back */
+  bool PutChunk(const IByteChunk& chunk)
+  {
+    return Put<int32_t>(chunk.Size()) && Write(chunk.GetData(), chunk.Size());
+  }
+};
+
+/** Where large state data is read from, see IPluginBase::UnserializeLargeState() */
+class IStateReader
+{
+public:
+  virtual ~IStateReader() {}
+
+  /** @param pData Filled with up to size bytes
+   * @param size The number of bytes wanted
+   * @return The number of bytes read, which is less than size only at the end of the data, or -1 on an error */
+  virtual int64_t Read(void* pData, int64_t size) = 0;
+
+  /** Read exactly size bytes
+   * @return \c true if all of them were read */
+  bool ReadAll(void* pData, int64_t size) { return Read(pData, size) == size; }
+
+  template <class T>
+  bool Get(T& value) { return ReadAll(&value, sizeof(T)); }
+
+  /** Read a chunk written by IStateWriter::PutChunk() */
+  bool GetChunk(IByteChunk& chunk)
+  {
+    int32_t size = 0;
+
+    if (!Get(size) || size < 0)
+      return false;
+
+    chunk.Resize(size);
+    return ReadAll(chunk.GetData(), size);
+  }
+};
+
+/** An IStateWriter that appends to memory, which grows in blocks rather than being reallocated and copied as it grows */
+class IStateMemoryWriter : public IStateWriter
+{
+public:
+  /** @param blockSize The size of each block of memory */
+  IStateMemoryWriter(int64_t blockSize = 1 << 20)
+  : mBlockSize(std::max<int64_t>(blockSize, 1))
+  {}
+
+  bool Write(const void* pData, int64_t size) override
+  {
+    const uint8_t* pBytes = static_cast<const uint8_t*>(pData);
+
+    while (size > 0)
+    {
+      if (mBlocks.empty() || mBlocks.back().size() == (size_t) mBlockSize)
+      {
+        mBlocks.emplace_back();
+        mBlocks.back().reserve((size_t) mBlockSize);
+      }
+
+      std::vector<uint8_t>& block = mBlocks.back();
+      const int64_t n = std::min<int64_t>(size, mBlockSize - (int64_t) block.size());
+      block.insert(block.end(), pBytes, pBytes + n);
+      pBytes += n;
+      size -= n;
+      mSize += n;
+    }
+
+    return true;
+  }
+
+  /** @return The number of bytes written */
+  int64_t Size() const { return mSize; }
+
+  /** Copy everything written into one buffer, e.g. a CFMutableData
+   * @param pDest At least Size() bytes */
+  void CopyTo(uint8_t* pDest) const
+  {
+    for (const auto& block : mBlocks)
+    {
+      memcpy(pDest, block.data(), block.size());
+      pDest += block.size();
+    }
+  }
+
+private:
+  int64_t mBlockSize;
+  int64_t mSize = 0;
+  std::vector<std::vector<uint8_t>> mBlocks;
+};
+
+/** An IStateReader over memory that isn't owned, such as the bytes of a CFData */
+class IStateMemoryReader : public IStateReader
+{
+public:
+  IStateMemoryReader(const void* pData, int64_t size)
+  : mData(static_cast<const uint8_t*>(pData))
+  , mSize(size)
+  {}
+
+  int64_t Read(void* pData, int64_t size) override
+  {
+    const int64_t n = std::max<int64_t>(std::min(size, mSize - mPos), 0);
+    memcpy(pData, mData + mPos, (size_t) n);
+    mPos += n;
+    return n;
+  }
+
+private:
+  const uint8_t* mData;
+  int64_t mSize;
+  int64_t mPos = 0;
+};
+
+/** Compresses what is written to it a block at a time and writes the blocks to another IStateWriter.
+ * Each block is compressed on a worker thread while the next one is filled, and written to the destination on the calling thread,
+ * since a host's stream may only be used on the thread that is saving. Each block is [int32 raw size][int32 stored size][stored size bytes],
+ * and is stored uncompressed if compressing doesn't make it smaller. A raw size of 0 ends the data. Without IPLUG_STATE_COMPRESSION the blocks are all stored */
+class IStateCompressedWriter : public IStateWriter
+{
+public:
+  /** @param dest Where the blocks are written
+   * @param level The zlib level, from 1 for the fastest to 9 for the smallest
+   * @param blockSize The amount of data compressed at a time */
+  IStateCompressedWriter(IStateWriter& dest, int level, int blockSize = 1 << 20)
+  : mDest(dest)
+  , mLevel(level)
+  , mBlockSize(std::max(blockSize, 1024))
+  {
+    mBlock.reserve(mBlockSize);
+  }
+
+  ~IStateCompressedWriter()
+  {
+    if (mPending.valid())
+      mPending.wait();
+  }
+
+  bool Write(const void* pData, int64_t size) override
+  {
+    const uint8_t* pBytes = static_cast<const uint8_t*>(pData);
+
+    while (size > 0 && mOK)
+    {
+      const int64_t n = std::min<int64_t>(size, mBlockSize - (int64_t) mBlock.size());
+      mBlock.insert(mBlock.end(), pBytes, pBytes + n);
+      pBytes += n;
+      size -= n;
+
+      if ((int) mBlock.size() == mBlockSize)
+        Submit();
+    }
+
+    return mOK;
+  }
+
+  /** Write the last block and the end marker. Call once everything has been written
+   * @return \c true if all of the data was written */
+  bool Finish()
+  {
+    if (!mBlock.empty())
+      Submit();
+
+    WritePending();
+    return mOK && mDest.Put<int32_t>(0);
+  }
+
+private:
+  struct Block
+  {
+    int32_t rawSize;
+    std::vector<uint8_t> stored; // compressed, or the raw data if compressing didn't make it smaller
+  };
+
+  static Block Compress(std::vector<uint8_t> raw, int level)
+  {
+    Block block {(int32_t) raw.size(), {}};
+#ifdef IPLUG_STATE_COMPRESSION
+    uLongf compressedSize = compressBound((uLong) raw.size());
+    block.stored.resize(compressedSize);
+
+    if (compress2(block.stored.data(), &compressedSize, raw.data(), (uLong) raw.size(), level) == Z_OK && compressedSize < raw.size())
+    {
+      block.stored.resize(compressedSize);
+      return block;
+    }
+#else
+    (void) level;
+#endif
+    block.stored = std::move(raw);
+    return block;
+  }
+
+  void WritePending()
+  {
+    if (!mPending.valid())
+      return;
+
+    const Block block = mPending.get();
+    mOK = mOK && mDest.Put<int32_t>(block.rawSize) && mDest.Put<int32_t>((int32_t) block.stored.size()) && mDest.Write(block.stored.data(), (int64_t) block.stored.size());
+  }
+
+  void Submit()
+  {
+    // write the block compressed while this one was filled, then compress this one while the next is filled
+    WritePending();
+    mPending = std::async(std::launch::async, Compress, std::move(mBlock), mLevel);
+    mBlock = std::vector<uint8_t>();
+    mBlock.reserve(mBlockSize);
+  }
+
+  IStateWriter& mDest;
+  int mLevel;
+  int mBlockSize;
+  std::vector<uint8_t> mBlock;
+  std::future<Block> mPending;
+  bool mOK = true;
+};
+
+/** Reads the blocks written by IStateCompressedWriter. The next block is read from the source and decompressed on a worker thread while the current one is consumed */
+class IStateCompressedReader : public IStateReader
+{
+public:
+  /** @param src Where the blocks are read from */
+  IStateCompressedReader(IStateReader& src)
+  : mSrc(src)
+  {
+    Prefetch();
+  }
+
+  ~IStateCompressedReader()
+  {
+    if (mNext.valid())
+      mNext.wait();
+  }
+
+  int64_t Read(void* pData, int64_t size) override
+  {
+    uint8_t* pBytes = static_cast<uint8_t*>(pData);
+    int64_t nRead = 0;
+
+    while (nRead < size)
+    {
+      if (mPos == mBlock.size())
+      {
+        if (!mNext.valid())
+          break;
+
+        mBlock = mNext.get();
+        mPos = 0;
+
+        if (mBlock.empty()) // a block that couldn't be read or decompressed
+          return -1;
+
+        Prefetch();
+      }
+
+      const int64_t n = std::min<int64_t>(size - nRead, (int64_t) (mBlock.size() - mPos));
+      memcpy(pBytes + nRead, mBlock.data() + mPos, (size_t) n);
+      mPos += (size_t) n;
+      nRead += n;
+    }
+
+    return nRead;
+  }
+
+private:
+  static std::vector<uint8_t> Decompress(std::vector<uint8_t> stored, int32_t rawSize)
+  {
+    if ((int32_t) stored.size() == rawSize)
+      return stored;
+
+#ifdef IPLUG_STATE_COMPRESSION
+    std::vector<uint8_t> raw((size_t) rawSize);
+    uLongf size = (uLongf) rawSize;
+
+    if (uncompress(raw.data(), &size, stored.data(), (uLong) stored.size()) == Z_OK && size == (uLongf) rawSize)
+      return raw;
+#endif
+    return {}; // corrupt, or compressed by a build with IPLUG_STATE_COMPRESSION that this one lacks
+  }
+
+  // reading the host's stream has to happen on this thread, only the decompression runs on the worker
+  void Prefetch()
+  {
+    int32_t rawSize = 0, storedSize = 0;
+
+    if (!mSrc.Get(rawSize) || rawSize <= 0)
+      return;
+
+    std::vector<uint8_t> stored;
+
+    if (mSrc.Get(storedSize) && storedSize > 0 && storedSize <= rawSize)
+    {
+      stored.resize((size_t) storedSize);
+
+      if (mSrc.ReadAll(stored.data(), storedSize))
+      {
+        mNext = std::async(std::launch::async, Decompress, std::move(stored), rawSize);
+        return;
+      }
+    }
+
+    std::promise<std::vector<uint8_t>> failed;
+    failed.set_value({});
+    mNext = failed.get_future();
+  }
+
+  IStateReader& mSrc;
+  std::vector<uint8_t> mBlock;
+  size_t mPos = 0;
+  std::future<std::vector<uint8_t>> mNext;
+};
@@ -18,6 +18,7 @@
  */
 
 #include <algorithm>
+#include <atomic>
 #include "wdlstring.h"
 #include "ptrlist.h"
 
@@ -34,6 +35,15 @@ struct IParamChange
   bool normalized; // TODO: Remove this
 };
 
+/** A parameter change at a sample offset within the current block, used for sample accurate automation. See IPlugProcessor::SetSampleAccurateParams() */
+struct IParamEvent
+{
+  int mOffset;
+  int mParamIdx;
+  double mValue;
+  bool mNormalized;
+};
+
 /** This structure is used when queueing Sysex messages. You may need to set MAX_SYSEX_SIZE to reflect the max sysex payload in bytes */
 struct SysExData
 {
@@ -140,7 +150,7 @@ public:
   inline int PutBytes(const void* pBuf, int size)
   {
     int n = mBytes.GetSize();
-    mBytes.Resize(n + size);
+    mBytes.Resize(n + size, false);
     memcpy(mBytes.Get() + n, pBuf, size);
     return mBytes.GetSize();
   }
@@ -201,10 +211,23 @@ public:
     return PutBytes(pRHS->GetData(), pRHS->Size());
   }
   
-  /** Clears the chunk */
+  /** Clears the chunk. The memory is kept, so that refilling the chunk doesn't allocate again */
   inline void Clear()
   {
-    mBytes.Resize(0);
+    mBytes.Resize(0, false);
+  }
+  
+  /** Preallocate memory, so that putting up to size bytes into the chunk doesn't allocate
+   * @param size The capacity to reserve (in bytes) */
+  inline void Reserve(int size)
+  {
+    int n = mBytes.GetSize();
+    
+    if (size > n)
+    {
+      mBytes.Resize(size, false);
+      mBytes.Resize(n, false);
+    }
   }
   
   /** Returns the current size of the chunk
@@ -255,6 +278,76 @@ private:
   WDL_TypedBuf<uint8_t> mBytes;
 };
 
+/** A small pool of reusable IByteChunks. Released chunks keep their memory, so once the pool has warmed up, saving state does no heap allocation.
+ * Chunks are claimed with an atomic flag, so the pool may be used from several threads. If every chunk is in use, a chunk is allocated for that call only */
+class IByteChunkPool
+{
+public:
+  /** Holds a chunk from the pool, and returns it to the pool when it goes out of scope */
+  class ScopedChunk
+  {
+  public:
+    ScopedChunk(IByteChunkPool& pool, int reserveSize)
+    : mPool(pool)
+    {
+      mIdx = pool.Claim();
+      mChunk = mIdx >= 0 ? &pool.mChunks[mIdx] : new IByteChunk();
+      mChunk->Clear();
+      mChunk->Reserve(reserveSize);
+    }
+    
+    ScopedChunk(ScopedChunk&& other)
+    : mPool(other.mPool)
+    , mChunk(other.mChunk)
+    , mIdx(other.mIdx)
+    {
+      other.mChunk = nullptr;
+    }
+    
+    ~ScopedChunk()
+    {
+      if (!mChunk)
+        return;
+      
+      if (mIdx >= 0)
+        mPool.mInUse[mIdx].store(false, std::memory_order_release);
+      else
+        delete mChunk;
+    }
+    
+    ScopedChunk(const ScopedChunk&) = delete;
+    ScopedChunk& operator=(const ScopedChunk&) = delete;
+    
+    IByteChunk& Get() { return *mChunk; }
+    
+  private:
+    IByteChunkPool& mPool;
+    IByteChunk* mChunk;
+    int mIdx;
+  };
+  
+  /** Get a cleared chunk from the pool
+   * @param reserveSize The capacity to reserve (in bytes), see IByteChunk::Reserve()
+   * @return The chunk, which goes back to the pool when the ScopedChunk is destroyed */
+  ScopedChunk Acquire(int reserveSize = 0) { return ScopedChunk(*this, reserveSize); }
+  
+private:
+  int Claim()
+  {
+    for (int i = 0; i < BYTE_CHUNK_POOL_SIZE; i++)
+    {
+      bool expected = false;
+      if (mInUse[i].compare_exchange_strong(expected, true, std::memory_order_acquire))
+        return i;
+    }
+    
+    return -1;
+  }
+  
+  IByteChunk mChunks[BYTE_CHUNK_POOL_SIZE];
+  std::atomic<bool> mInUse[BYTE_CHUNK_POOL_SIZE] = {};
+};
+
 /** Manages a non-owned block of memory, for receiving arbitrary message byte streams */
 class IByteStream : private IByteGetter
 {
@@ -341,6 +434,9 @@ struct IPlugConfig
   int plugWidth;
   int plugHeight;
   const char* bundleID;
+  bool plugDoesInPlaceProcessing;
+  bool plugProcessInterleaved;
+  bool plugFlushDenormals;
   
   IPlugConfig(int nParams,
               int nPresets,
@@ -360,7 +456,10 @@ struct IPlugConfig
               bool plugHasUI,
               int plugWidth,
               int plugHeight,
-              const char* bundleID)
+              const char* bundleID,
+              bool plugDoesInPlaceProcessing,
+              bool plugProcessInterleaved,
+              bool plugFlushDenormals = true)
               
   : nParams(nParams)
   , nPresets(nPresets)
@@ -381,6 +480,9 @@ struct IPlugConfig
   , plugWidth(plugWidth)
   , plugHeight(plugHeight)
   , bundleID(bundleID)
+  , plugDoesInPlaceProcessing(plugDoesInPlaceProcessing)
+  , plugProcessInterleaved(plugProcessInterleaved)
+  , plugFlushDenormals(plugFlushDenormals)
   {};
 };
 
@@ -391,7 +493,7 @@ struct IChannelData
   bool mConnected = false;
   TOUT** mData = nullptr; // If this is for an input channel, points into IPlugProcessor::mInData, if it's for an output channel points into IPlugProcessor::mOutData
   TIN* mIncomingData = nullptr;
-  WDL_TypedBuf<TOUT> mScratchBuf;
+  TOUT* mScratchBuf = nullptr; // Points into IPlugProcessor's aligned scratch arena for this direction, see IPlugProcessor::SetBlockSize()
   WDL_String mLabel = WDL_String("");
 };
 
@@ -433,6 +535,23 @@ struct IOConfig
     mBusInfo[direction].Add(new IBusInfo(direction, NChans, label));
   }
   
+  /** @return A new IOConfig with the same buses, which the caller owns */
+  IOConfig* Clone() const
+  {
+    IOConfig* pConfig = new IOConfig();
+    
+    for (int d = 0; d < 2; d++)
+    {
+      for (int i = 0; i < mBusInfo[d].GetSize(); i++)
+      {
+        const IBusInfo* pBus = mBusInfo[d].Get(i);
+        pConfig->mBusInfo[d].Add(new IBusInfo(pBus->mDirection, pBus->mNChans, pBus->mLabel.Get()));
+      }
+    }
+    
+    return pConfig;
+  }
+  
   /** /todo
    * @param direction /todo
    * @param index /todo
@@ -498,6 +617,7 @@ struct IOConfig
 struct ITimeInfo
 {
   double mTempo = DEFAULT_TEMPO;
+  double mTempoIncrement = 0.0; // the change of tempo per sample through the block, where the host gives a ramp, see IPlugTransport
   double mSamplePos = -1.0;
   double mPPQPos = -1.0;
   double mLastBar = -1.0;
@@ -518,11 +638,23 @@ struct IPreset
   char mName[MAX_PRESET_NAME_LEN];
 
   IByteChunk mChunk;
+  
+  /** Factory presets made with MakePresetFromBlob() or MakePresetFromData() only keep a pointer to their source data, which is decoded into mChunk
+   * the first time the preset is used, see IPluginBase::GetPresetChunk(). The source is not owned and is shared by every instance of the plug-in */
+  const char* mBlob = nullptr;
+  const void* mData = nullptr;
+  int mSourceSize = 0;
 
   IPreset()
   {
     sprintf(mName, "%s", UNUSED_PRESET_NAME);
   }
+  
+  /** @return \c true if the preset has source data that has not been decoded into mChunk yet */
+  bool IsLazy() const { return mBlob || mData; }
+  
+  /** @return The size of the preset's state (in bytes), without decoding it */
+  int GetChunkSize() const { return IsLazy() ? mSourceSize : mChunk.Size(); }
 };
 
 /**@}*/
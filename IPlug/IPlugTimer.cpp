@@ -26,6 +26,11 @@ Timer_impl::Timer_impl(ITimerFunction func, uint32_t intervalMs)
 : mTimerFunc(func)
 , mIntervalMs(intervalMs)
 
+{
+  Start();
+}
+
+void Timer_impl::Start()
 {
   CFRunLoopTimerContext context;
   context.version = 0;
@@ -33,12 +38,23 @@ Timer_impl::Timer_impl(ITimerFunction func, uint32_t intervalMs)
   context.retain = nullptr;
   context.release = nullptr;
   context.copyDescription = nullptr;
-  CFTimeInterval interval = intervalMs / 1000.0;
+  CFTimeInterval interval = mIntervalMs / 1000.0;
   CFRunLoopRef runLoop = CFRunLoopGetMain();
-  mOSTimer = CFRunLoopTimerCreate(kCFAllocatorDefault, CFAbsoluteTimeGetCurrent(), interval, 0, 0, TimerProc, &context);
+  mOSTimer = CFRunLoopTimerCreate(kCFAllocatorDefault, CFAbsoluteTimeGetCurrent() + interval, interval, 0, 0, TimerProc, &context);
   CFRunLoopAddTimer(runLoop, mOSTimer, kCFRunLoopCommonModes);
 }
 
+void Timer_impl::SetInterval(uint32_t intervalMs)
+{
+  if (!mOSTimer || intervalMs == mIntervalMs)
+    return;
+  
+  // a CFRunLoopTimer's interval is fixed, so replace it
+  mIntervalMs = intervalMs;
+  Stop();
+  Start();
+}
+
 Timer_impl::~Timer_impl()
 {
   Stop();
@@ -100,6 +116,15 @@ void Timer_impl::Stop()
   }
 }
 
+void Timer_impl::SetInterval(uint32_t intervalMs)
+{
+  if (!ID || intervalMs == mIntervalMs)
+    return;
+  
+  mIntervalMs = intervalMs;
+  SetTimer(0, ID, intervalMs, TimerProc); // passing the existing ID replaces the timer's interval
+}
+
 void CALLBACK Timer_impl::TimerProc(HWND hwnd, UINT uMsg, UINT_PTR idEvent, DWORD dwTime)
 {
   WDL_MutexLock lock(&sMutex);
@@ -40,6 +40,10 @@ struct Timer
   void Stop()
   {
   }
+  
+  void SetInterval(uint32_t intervalMs)
+  {
+  }
 };
 #else
 /** Base class for timer */
@@ -50,6 +54,9 @@ struct Timer
   static Timer* Create(ITimerFunction func, uint32_t intervalMs);
   virtual ~Timer() {};
   virtual void Stop() = 0;
+  
+  /** Change the interval of a running timer. Can be called from within the timer function */
+  virtual void SetInterval(uint32_t intervalMs) = 0;
 };
 #endif
 
@@ -65,10 +72,13 @@ public:
   ~Timer_impl();
   
   void Stop() override;
+  void SetInterval(uint32_t intervalMs) override;
   static void TimerProc(CFRunLoopTimerRef timer, void *info);
   
 private:
-  CFRunLoopTimerRef mOSTimer;
+  void Start();
+  
+  CFRunLoopTimerRef mOSTimer = nullptr;
   ITimerFunction mTimerFunc;
   uint32_t mIntervalMs;
 };
@@ -79,6 +89,7 @@ public:
   Timer_impl(ITimerFunction func, uint32_t intervalMs);
   ~Timer_impl();
   void Stop() override;
+  void SetInterval(uint32_t intervalMs) override;
   static void CALLBACK TimerProc(HWND hwnd, UINT uMsg, UINT_PTR idEvent, DWORD dwTime);
   
 private:
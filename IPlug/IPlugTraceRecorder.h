@@ -0,0 +1,387 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IPlugTraceRecorder
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include "IPlugConstants.h"
+
+#if defined OS_WIN
+  #include <windows.h>
+#else
+  #include <pthread.h>
+#endif
+
+/** Records trace events without locking, formatting or writing on the thread that traces them, so that tracing the audio thread doesn't change its timing.
+ * Each thread that traces gets a ring buffer of fixed size records from a pool allocated up front, which it alone writes, and a background thread drains the buffers
+ * into TRACEFILE in the user's home folder, or %TEMP% on Windows. Names are pointers to string literals, such as __FUNCTION__, so are written once each.
+ * When a thread's buffer is full its events are dropped until the flusher catches up, and the number dropped is written with them.
+ * Scripts/trace_to_json.py converts the file to the Chrome trace event format, which Perfetto and chrome://tracing open.
+ *
+ * The file is native endian: "ITRC", a version, then 32 byte entries, each of which is a type, a phase, a thread index, a name index, a time in nanoseconds and two arguments.
+ * A name or a message's text follows its entry, padded to 8 bytes */
+class IPlugTraceRecorder
+{
+public:
+  /** The kind of an event, which matches the phases of the Chrome trace event format */
+  enum EPhase : uint8_t
+  {
+    kInstant = 'i',
+    kBegin = 'B',
+    kEnd = 'E',
+    kCounter = 'C',
+    kMessage = 'M'
+  };
+
+  static constexpr uint32_t kVersion = 1;
+  static constexpr int kMaxThreads = 16;
+  static constexpr uint32_t kRecordsPerThread = 8192; // a power of two
+  static constexpr int kFlushIntervalMs = 50;
+
+  static IPlugTraceRecorder& Get()
+  {
+    static IPlugTraceRecorder sRecorder;
+    return sRecorder;
+  }
+
+  IPlugTraceRecorder(const IPlugTraceRecorder&) = delete;
+  IPlugTraceRecorder& operator=(const IPlugTraceRecorder&) = delete;
+
+  ~IPlugTraceRecorder()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mFlushMutex);
+      mStop = true;
+    }
+
+    mFlushCondition.notify_one();
+
+    if (mFlusher.joinable())
+      mFlusher.join();
+
+    if (mFP)
+      fclose(mFP);
+  }
+
+  /** Record an instant event
+   * @param name A string literal, e.g. __FUNCTION__
+   * @param line The line it was traced at */
+  void Instant(const char* name, int line) { Record(kInstant, name, line, 0); }
+
+  /** Record the start of a span, which ends at the next End() on the same thread, see TRACE_SCOPE */
+  void Begin(const char* name, int line) { Record(kBegin, name, line, 0); }
+
+  /** Record the end of the last span begun on this thread */
+  void End(const char* name, int line) { Record(kEnd, name, line, 0); }
+
+  /** Record the value of a counter, which is drawn as a graph */
+  void Counter(const char* name, int64_t value) { Record(kCounter, name, 0, value); }
+
+  /** Record a formatted message, copying its text into the buffer
+   * @param name A string literal, e.g. __FUNCTION__
+   * @param line The line it was traced at
+   * @param text The message */
+  void Message(const char* name, int line, const char* text)
+  {
+    ThreadBuffer* pBuffer = GetThreadBuffer();
+
+    if (!pBuffer)
+      return;
+
+    const uint32_t length = static_cast<uint32_t>(strlen(text));
+    const uint32_t nRecords = 1 + (length + kTextPerRecord - 1) / kTextPerRecord;
+    const uint32_t head = pBuffer->head.load(std::memory_order_relaxed);
+
+    if (kRecordsPerThread - (head - pBuffer->tail.load(std::memory_order_acquire)) < nRecords)
+    {
+      pBuffer->dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+
+    Entry& entry = pBuffer->records[head & kRecordMask];
+    entry.time = Now();
+    entry.name = name;
+    entry.line = line;
+    entry.phase = kMessage;
+    entry.args[0] = length;
+
+    for (uint32_t i = 1; i < nRecords; i++)
+      memcpy(pBuffer->records[(head + i) & kRecordMask].text, text + (i - 1) * kTextPerRecord, ChunkSize(length, i));
+
+    pBuffer->head.store(head + nRecords, std::memory_order_release);
+  }
+
+private:
+  static constexpr uint32_t kRecordMask = kRecordsPerThread - 1;
+  static constexpr uint32_t kTextPerRecord = 16;
+
+  struct Entry
+  {
+    uint64_t time;
+    const char* name;
+    union
+    {
+      int64_t args[2];
+      char text[kTextPerRecord];
+    };
+    int32_t line;
+    uint8_t phase;
+  };
+
+  struct ThreadBuffer
+  {
+    Entry records[kRecordsPerThread];
+    std::atomic<uint32_t> head {0};
+    std::atomic<uint32_t> tail {0};
+    std::atomic<uint32_t> dropped {0};
+    std::atomic<int64_t> sysThreadID {0}; // set once the buffer is claimed
+    bool announced = false;
+  };
+
+  struct FileEntry
+  {
+    uint8_t type;
+    uint8_t phase;
+    uint16_t thread;
+    uint32_t name;
+    uint64_t time;
+    int64_t args[2];
+  };
+
+  enum EFileEntryType : uint8_t { kFileName = 0, kFileThread, kFileEvent, kFileMessage, kFileDropped };
+
+  IPlugTraceRecorder()
+  : mBuffers(new ThreadBuffer[kMaxThreads])
+  , mStart(Now())
+  {
+    char path[1024];
+#ifdef OS_WIN
+    const char* pFolder = getenv("TEMP");
+    snprintf(path, sizeof(path), "%s\\%s", pFolder ? pFolder : "C:", TRACEFILE);
+#else
+    const char* pFolder = getenv("HOME");
+    snprintf(path, sizeof(path), "%s/%s", pFolder ? pFolder : ".", TRACEFILE);
+#endif
+    mFP = fopen(path, "wb");
+
+    if (mFP)
+    {
+      const uint32_t version = kVersion;
+      fwrite("ITRC", 4, 1, mFP);
+      fwrite(&version, sizeof(version), 1, mFP);
+      mFlusher = std::thread([this]() { FlushLoop(); });
+    }
+  }
+
+  /** @return The number of bytes of a message of a length in the ith record after its first */
+  static size_t ChunkSize(uint32_t length, uint32_t i)
+  {
+    const uint32_t remaining = length - (i - 1) * kTextPerRecord;
+    return remaining < kTextPerRecord ? remaining : kTextPerRecord;
+  }
+
+  static uint64_t Now()
+  {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+  }
+
+  static int64_t GetSysThreadID()
+  {
+#ifdef OS_WIN
+    return static_cast<int64_t>(GetCurrentThreadId());
+#else
+    return (int64_t) (intptr_t) pthread_self();
+#endif
+  }
+
+  /** @return This thread's buffer, claimed from the pool the first time it traces, or nullptr if the pool is used up */
+  ThreadBuffer* GetThreadBuffer()
+  {
+    thread_local ThreadBuffer* tBuffer = nullptr;
+    thread_local bool tClaimed = false;
+
+    if (!tClaimed)
+    {
+      tClaimed = true;
+      const int idx = mNBuffers.fetch_add(1, std::memory_order_relaxed);
+
+      if (idx < kMaxThreads && mFP)
+      {
+        tBuffer = &mBuffers[idx];
+        tBuffer->sysThreadID.store(GetSysThreadID(), std::memory_order_release);
+      }
+    }
+
+    return tBuffer;
+  }
+
+  void Record(EPhase phase, const char* name, int line, int64_t value)
+  {
+    ThreadBuffer* pBuffer = GetThreadBuffer();
+
+    if (!pBuffer)
+      return;
+
+    const uint32_t head = pBuffer->head.load(std::memory_order_relaxed);
+
+    if (head - pBuffer->tail.load(std::memory_order_acquire) >= kRecordsPerThread)
+    {
+      pBuffer->dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+
+    Entry& entry = pBuffer->records[head & kRecordMask];
+    entry.time = Now();
+    entry.name = name;
+    entry.line = line;
+    entry.phase = phase;
+    entry.args[0] = value;
+    entry.args[1] = 0;
+    pBuffer->head.store(head + 1, std::memory_order_release);
+  }
+
+  void FlushLoop()
+  {
+    std::unique_lock<std::mutex> lock(mFlushMutex);
+
+    while (!mStop)
+    {
+      mFlushCondition.wait_for(lock, std::chrono::milliseconds(kFlushIntervalMs));
+      Flush();
+    }
+
+    Flush();
+  }
+
+  /** Drain every buffer into the file, called on the flusher thread only */
+  void Flush()
+  {
+    const int nBuffers = mNBuffers.load(std::memory_order_relaxed);
+
+    for (int t = 0; t < nBuffers && t < kMaxThreads; t++)
+    {
+      ThreadBuffer& buffer = mBuffers[t];
+      const int64_t sysThreadID = buffer.sysThreadID.load(std::memory_order_acquire);
+
+      // claimed, but its thread hasn't set it up yet
+      if (!sysThreadID)
+        continue;
+
+      if (!buffer.announced)
+      {
+        Write({ kFileThread, 0, static_cast<uint16_t>(t), 0, 0, { sysThreadID, 0 } });
+        buffer.announced = true;
+      }
+
+      const uint32_t head = buffer.head.load(std::memory_order_acquire);
+      uint32_t tail = buffer.tail.load(std::memory_order_relaxed);
+
+      while (tail != head)
+      {
+        const Entry& entry = buffer.records[tail & kRecordMask];
+        const uint32_t nameIdx = GetNameIndex(entry.name);
+        const uint64_t time = entry.time - mStart;
+
+        if (entry.phase == kMessage)
+        {
+          const uint32_t length = static_cast<uint32_t>(entry.args[0]);
+          const uint32_t nRecords = 1 + (length + kTextPerRecord - 1) / kTextPerRecord;
+
+          Write({ kFileMessage, kMessage, static_cast<uint16_t>(t), nameIdx, time, { entry.line, length } });
+
+          for (uint32_t i = 1; i < nRecords; i++)
+            fwrite(buffer.records[(tail + i) & kRecordMask].text, 1, ChunkSize(length, i), mFP);
+
+          Pad(length);
+          tail += nRecords;
+        }
+        else
+        {
+          Write({ kFileEvent, entry.phase, static_cast<uint16_t>(t), nameIdx, time, { entry.phase == kCounter ? entry.args[0] : entry.line, 0 } });
+          tail++;
+        }
+      }
+
+      buffer.tail.store(tail, std::memory_order_release);
+
+      if (const uint32_t dropped = buffer.dropped.exchange(0, std::memory_order_relaxed))
+        Write({ kFileDropped, 0, static_cast<uint16_t>(t), 0, Now() - mStart, { dropped, 0 } });
+    }
+
+    fflush(mFP);
+  }
+
+  uint32_t GetNameIndex(const char* name)
+  {
+    if (!name)
+      name = "";
+
+    auto it = mNames.find(name);
+
+    if (it != mNames.end())
+      return it->second;
+
+    const uint32_t idx = static_cast<uint32_t>(mNames.size());
+    const uint32_t length = static_cast<uint32_t>(strlen(name));
+    mNames[name] = idx;
+    Write({ kFileName, 0, 0, idx, 0, { length, 0 } });
+    fwrite(name, 1, length, mFP);
+    Pad(length);
+    return idx;
+  }
+
+  void Write(const FileEntry& entry) { fwrite(&entry, sizeof(FileEntry), 1, mFP); }
+
+  void Pad(uint32_t length)
+  {
+    static const char zeros[8] = {};
+
+    if (length % 8)
+      fwrite(zeros, 1, 8 - length % 8, mFP);
+  }
+
+  std::unique_ptr<ThreadBuffer[]> mBuffers;
+  std::atomic<int> mNBuffers {0};
+  uint64_t mStart;
+  FILE* mFP = nullptr;
+  std::unordered_map<const char*, uint32_t> mNames; // written by the flusher only
+  std::thread mFlusher;
+  std::mutex mFlushMutex;
+  std::condition_variable mFlushCondition;
+  bool mStop = false;
+};
+
+/** Records the span of the enclosing scope, see TRACE_SCOPE */
+class IPlugTraceScope
+{
+public:
+  IPlugTraceScope(const char* name, int line) : mName(name) { IPlugTraceRecorder::Get().Begin(name, line); }
+  ~IPlugTraceScope() { IPlugTraceRecorder::Get().End(mName, 0); }
+
+private:
+  const char* mName;
+};
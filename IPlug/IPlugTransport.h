@@ -0,0 +1,285 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IPlugTransport
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "IPlugStructs.h"
+
+/** The host's musical position at every sample of a block, from the ITimeInfo the API class sets at its start, see IPlugProcessor::GetTransport().
+ * The position follows the tempo through the block, including a ramp where the host gives one (CLAP's tempo_inc) and changes the host reports inside the block (CLAP transport events),
+ * and wraps at the end of the cycle when the host is looping, on the sample where it does. The fills are plain loops over each segment of the block, which the compiler vectorizes,
+ * so a tempo-synced LFO or an arpeggiator doesn't have to work out the position sample by sample itself, e.g.
+ * @code
+ * GetTransport().FillPhase(mLFOPhase, GetSubBlockOffset(), nFrames, 0.25); // a sixteenth note LFO
+ *
+ * for (int offset = GetTransport().FindNextGridOffset(0, 0.25, nFrames); offset >= 0; offset = GetTransport().FindNextGridOffset(offset + 1, 0.25, nFrames))
+ *   TriggerStep(offset);
+ * @endcode
+ * Offsets are in samples from the start of the host's block, at the host's sample rate, so within a sub-block add GetSubBlockOffset(). The position only advances while the transport runs */
+class IPlugTransport
+{
+public:
+  /** The most changes within a block that are followed. Later ones are ignored */
+  static constexpr int kMaxSegments = 16;
+
+  /** Start a block, called by IPlugProcessor::SetTimeInfo()
+   * @param timeInfo The host's position at the start of the block
+   * @param sampleRate The host's sample rate */
+  void Begin(const ITimeInfo& timeInfo, double sampleRate)
+  {
+    mBeatsPerSampleAtBPM = 1. / (60. * std::max(sampleRate, 1.));
+    mRunning = timeInfo.mTransportIsRunning;
+    mLooping = timeInfo.mTransportLoopEnabled && timeInfo.mCycleEnd > timeInfo.mCycleStart && timeInfo.mCycleStart >= 0.;
+    mCycleStart = timeInfo.mCycleStart;
+    mCycleEnd = timeInfo.mCycleEnd;
+    mNSegments = 1;
+    Segment& segment = mSegments[0];
+    segment.offset = 0;
+    segment.ppq = std::max(timeInfo.mPPQPos, 0.);
+    segment.tempo = timeInfo.mTempo;
+    segment.tempoIncrement = timeInfo.mTempoIncrement;
+    segment.wraps = mLooping && segment.ppq < mCycleEnd;
+  }
+
+  /** A change of tempo or position during the block, called by the API class for the changes the host reports, in order
+   * @param offset The sample at which it changes
+   * @param tempo The tempo from then on, in beats per minute
+   * @param tempoIncrement The change of tempo per sample from then on
+   * @param ppqPos The position from then on, or a negative value if the position carries on from the tempo */
+  void AddChange(int offset, double tempo, double tempoIncrement, double ppqPos = -1.)
+  {
+    if (mNSegments >= kMaxSegments || offset < mSegments[mNSegments - 1].offset)
+      return;
+
+    const Segment& previous = mSegments[mNSegments - 1];
+    const double ppq = ppqPos >= 0. ? ppqPos : Wrap(previous, GetUnwrappedPPQ(previous, offset));
+
+    Segment& segment = mSegments[mNSegments++];
+    segment.offset = offset;
+    segment.ppq = ppq;
+    segment.tempo = tempo;
+    segment.tempoIncrement = tempoIncrement;
+    segment.wraps = mLooping && ppq < mCycleEnd;
+  }
+
+  /** @param offset A sample in the block
+   * @return The position in quarter notes at the sample */
+  double GetPPQ(int offset) const
+  {
+    const Segment& segment = FindSegment(offset);
+    return Wrap(segment, GetUnwrappedPPQ(segment, offset));
+  }
+
+  /** @param offset A sample in the block
+   * @return The tempo at the sample, in beats per minute */
+  double GetTempo(int offset) const
+  {
+    const Segment& segment = FindSegment(offset);
+    return segment.tempo + segment.tempoIncrement * (offset - segment.offset);
+  }
+
+  /** @param offset A sample in the block
+   * @param periodBeats The length of a cycle in quarter notes, e.g. 4 for a bar of 4/4
+   * @return The phase in [0, 1) of the cycle at the sample, in step with the song position */
+  double GetPhase(int offset, double periodBeats) const
+  {
+    const double x = GetPPQ(offset) / periodBeats;
+    return x - std::floor(x);
+  }
+
+  /** Fill a buffer with the position at each sample
+   * @param pDest Filled with nFrames positions in quarter notes
+   * @param startOffset The sample in the block of pDest[0]
+   * @param nFrames The number of samples */
+  void FillPPQ(double* pDest, int startOffset, int nFrames) const
+  {
+    ForEachPPQ(startOffset, nFrames, [pDest](int i, double ppq) { pDest[i] = ppq; });
+  }
+
+  /** Fill a buffer with the phase of a cycle at each sample, e.g. for a tempo-synced LFO
+   * @param pDest Filled with nFrames phases in [0, 1)
+   * @param startOffset The sample in the block of pDest[0]
+   * @param nFrames The number of samples
+   * @param periodBeats The length of a cycle in quarter notes */
+  template <typename T>
+  void FillPhase(T* pDest, int startOffset, int nFrames, double periodBeats) const
+  {
+    const double scale = 1. / periodBeats;
+
+    ForEachPPQ(startOffset, nFrames, [pDest, scale](int i, double ppq) {
+      const double x = ppq * scale;
+      pDest[i] = static_cast<T>(x - std::floor(x));
+    });
+  }
+
+  /** Find the next sample at which a step of a grid starts, e.g. the next sixteenth note of an arpeggiator. The sample where the cycle wraps also starts a step
+   * @param startOffset The first sample to look at
+   * @param gridBeats The length of a step in quarter notes
+   * @param blockSize The number of samples in the block
+   * @return The offset of the sample, or -1 if there is none before blockSize */
+  int FindNextGridOffset(int startOffset, double gridBeats, int blockSize) const
+  {
+    if (!mRunning || gridBeats <= 0.)
+      return -1;
+
+    int offset = std::max(startOffset, 0);
+
+    while (offset < blockSize)
+    {
+      if (StartsStep(offset, gridBeats))
+        return offset;
+
+      const int s = FindSegmentIndex(offset);
+      const Segment& segment = mSegments[s];
+      const int segEnd = s + 1 < mNSegments ? std::min(mSegments[s + 1].offset, blockSize) : blockSize;
+
+      // within a segment the unwrapped position only increases, so search for where it reaches the next step or the end of the cycle
+      const double ppq = GetUnwrappedPPQ(segment, offset);
+      const double wrapped = Wrap(segment, ppq);
+      double target = ppq + (std::floor(wrapped / gridBeats + kGridTolerance) + 1.) * gridBeats - wrapped;
+
+      if (segment.wraps)
+        target = std::min(target, ppq + mCycleEnd - wrapped);
+
+      int lo = offset + 1, hi = segEnd;
+
+      while (lo < hi)
+      {
+        const int mid = lo + (hi - lo) / 2;
+
+        if (GetUnwrappedPPQ(segment, mid) >= target - kGridTolerance * gridBeats)
+          hi = mid;
+        else
+          lo = mid + 1;
+      }
+
+      offset = lo;
+    }
+
+    return -1;
+  }
+
+  /** @return \c true if the host's transport is running */
+  bool IsRunning() const { return mRunning; }
+
+  /** @return \c true if the host is looping between the cycle start and end */
+  bool IsLooping() const { return mLooping; }
+
+private:
+  struct Segment
+  {
+    int offset = 0;
+    double ppq = 0.; // at offset, before wrapping
+    double tempo = DEFAULT_TEMPO;
+    double tempoIncrement = 0.;
+    bool wraps = false; // the position started before the end of the cycle, so wraps when it reaches it
+  };
+
+  int FindSegmentIndex(int offset) const
+  {
+    int s = mNSegments - 1;
+
+    while (s > 0 && mSegments[s].offset > offset)
+      s--;
+
+    return s;
+  }
+
+  const Segment& FindSegment(int offset) const { return mSegments[FindSegmentIndex(offset)]; }
+
+  double GetUnwrappedPPQ(const Segment& segment, int offset) const
+  {
+    if (!mRunning)
+      return segment.ppq;
+
+    const double n = offset - segment.offset;
+    return segment.ppq + (segment.tempo * n + segment.tempoIncrement * 0.5 * n * (n - 1.)) * mBeatsPerSampleAtBPM;
+  }
+
+  double Wrap(const Segment& segment, double ppq) const
+  {
+    if (!segment.wraps || ppq < mCycleEnd)
+      return ppq;
+
+    const double length = mCycleEnd - mCycleStart;
+    return ppq - length * std::floor((ppq - mCycleStart) / length);
+  }
+
+  static constexpr double kGridTolerance = 1e-9; // in steps, so that a position a rounding error short of a step counts as on it
+
+  double GetStep(int offset, double gridBeats) const { return std::floor(GetPPQ(offset) / gridBeats + kGridTolerance); }
+
+  bool StartsStep(int offset, double gridBeats) const
+  {
+    if (offset > 0)
+      return GetStep(offset, gridBeats) != GetStep(offset - 1, gridBeats);
+
+    const double x = GetPPQ(0) / gridBeats;
+    return x - std::floor(x + kGridTolerance) < kGridTolerance;
+  }
+
+  template <class FUNC>
+  void ForEachPPQ(int startOffset, int nFrames, FUNC&& func) const
+  {
+    const int endOffset = startOffset + nFrames;
+
+    for (int s = 0; s < mNSegments; s++)
+    {
+      const Segment& segment = mSegments[s];
+      const int from = std::max(startOffset, s == 0 ? startOffset : segment.offset);
+      const int to = std::min(endOffset, s + 1 < mNSegments ? mSegments[s + 1].offset : endOffset);
+
+      if (from >= to)
+        continue;
+
+      const double base = segment.ppq;
+      const double tempo = mRunning ? segment.tempo * mBeatsPerSampleAtBPM : 0.;
+      const double halfIncrement = mRunning ? segment.tempoIncrement * 0.5 * mBeatsPerSampleAtBPM : 0.;
+      const double first = from - segment.offset;
+      const double length = mCycleEnd - mCycleStart;
+      const double cycleStart = mCycleStart;
+      const double cycleEnd = mCycleEnd;
+
+      if (segment.wraps)
+      {
+        for (int i = from; i < to; i++)
+        {
+          const double n = first + (i - from);
+          const double ppq = base + tempo * n + halfIncrement * n * (n - 1.);
+          func(i - startOffset, ppq < cycleEnd ? ppq : ppq - length * std::floor((ppq - cycleStart) / length));
+        }
+      }
+      else
+      {
+        for (int i = from; i < to; i++)
+        {
+          const double n = first + (i - from);
+          func(i - startOffset, base + tempo * n + halfIncrement * n * (n - 1.));
+        }
+      }
+    }
+  }
+
+  Segment mSegments[kMaxSegments];
+  int mNSegments = 1;
+  double mBeatsPerSampleAtBPM = 1. / (60. * DEFAULT_SAMPLE_RATE);
+  double mCycleStart = 0.;
+  double mCycleEnd = 0.;
+  bool mRunning = false;
+  bool mLooping = false;
+};
@@ -0,0 +1,104 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IPlugTripleBuffer
+ */
+
+#include <atomic>
+#include <type_traits>
+
+/** The type independent interface of IPlugTripleBuffer, which lets IPlugAPIBase forward the latest state to a control by tag
+ * without knowing what it contains */
+class IPlugTripleBufferBase
+{
+public:
+  static constexpr int kUpdateMessage = 0;
+
+  virtual ~IPlugTripleBufferBase() {}
+
+  /** Make the most recently published buffer the read buffer. Reader thread only
+   * @return \c true if a new buffer was published since the last call */
+  virtual bool Update() = 0;
+
+  /** @return Pointer to the bytes of the read buffer, valid until the next call to Update() */
+  virtual const void* GetReadData() const = 0;
+
+  /** @return The size of the read buffer in bytes */
+  virtual int GetReadDataSize() const = 0;
+};
+
+/** A lock-free triple buffer for sharing large state, such as a spectrum or a waveform preview, from the realtime audio thread with the user interface.
+ * The writer always has a buffer of its own to fill, and publishing it is a single atomic exchange, so the writer never waits and never drops the latest data.
+ * The reader always sees the most recently published complete buffer, and reads it in place rather than copying it out of a queue.
+ * Intermediate buffers that the reader never picked up are simply overwritten.
+ * T must be trivially copyable, e.g. a struct or a std::array of samples, so it can be forwarded to remote editors as bytes
+ * @tparam T The type of the shared state */
+template <typename T>
+class IPlugTripleBuffer final : public IPlugTripleBufferBase
+{
+  static_assert(std::is_trivially_copyable<T>::value, "IPlugTripleBuffer requires a trivially copyable type");
+
+public:
+  /** IPlugTripleBuffer constructor
+   * @param initial The value all three buffers start with */
+  IPlugTripleBuffer(const T& initial = T())
+  {
+    for (auto& buffer : mBuffers)
+      buffer = initial;
+  }
+
+  IPlugTripleBuffer(const IPlugTripleBuffer&) = delete;
+  IPlugTripleBuffer& operator=(const IPlugTripleBuffer&) = delete;
+
+  /** @return The buffer to fill with the next state. Writer thread only. It keeps its contents from two publishes ago, not the last one */
+  T& GetWriteBuffer() { return mBuffers[mWriteIdx]; }
+
+  /** Publish the write buffer, making it the latest state, and take the spare buffer as the new write buffer. Writer thread only */
+  void Publish()
+  {
+    mWriteIdx = mSpare.exchange(mWriteIdx | kNewDataBit, std::memory_order_acq_rel) & kIndexMask;
+  }
+
+  /** Copy a value into the write buffer and publish it. Writer thread only */
+  void Publish(const T& value)
+  {
+    GetWriteBuffer() = value;
+    Publish();
+  }
+
+  bool Update() override
+  {
+    if ((mSpare.load(std::memory_order_relaxed) & kNewDataBit) == 0)
+      return false;
+
+    mReadIdx = mSpare.exchange(mReadIdx, std::memory_order_acq_rel) & kIndexMask;
+    return true;
+  }
+
+  /** @return The most recently published state as of the last Update(). Reader thread only */
+  const T& GetReadBuffer() const { return mBuffers[mReadIdx]; }
+
+  const void* GetReadData() const override { return &mBuffers[mReadIdx]; }
+
+  int GetReadDataSize() const override { return static_cast<int>(sizeof(T)); }
+
+private:
+  static constexpr int kIndexMask = 0x3;
+  static constexpr int kNewDataBit = 0x4;
+
+  T mBuffers[3];
+  int mWriteIdx = 0; // owned by the writer
+  int mReadIdx = 1; // owned by the reader
+  std::atomic<int> mSpare {2}; // the buffer in between, with kNewDataBit set when the writer has published it
+};
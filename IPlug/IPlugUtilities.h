@@ -29,6 +29,7 @@
 
 #include "IPlugConstants.h"
 #include "IPlugPlatform.h"
+#include "IPlugSIMD.h"
 
 #ifdef OS_WIN
 #undef _WIN32_WINNT
@@ -149,6 +150,13 @@ void CastCopy(DEST* pDest, SRC* pSrc, int n)
   }
 }
 
+/** Vectorised overloads of CastCopy() for the float <-> double conversions that happen between host and plug-in buffers, see IPlugSIMD.h
+ * @param pDest Destination buffer
+ * @param pSrc Source buffer
+ * @param n Number of samples */
+static inline void CastCopy(double* pDest, float* pSrc, int n) { ConvertSamples(pDest, pSrc, n); }
+static inline void CastCopy(float* pDest, double* pSrc, int n) { ConvertSamples(pDest, pSrc, n); }
+
 /** /todo  
  * @param cDest /todo
  * @param cSrc /todo */
@@ -0,0 +1,209 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IPlugWorkerPool
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** A unit of non-realtime work run by IPlugWorkerPool, e.g. loading a sample or an impulse response, planning an FFT or scanning presets.
+ * Jobs are created with IPluginBase::RunInBackground(), which returns a handle that can be used to cancel the job or query its state */
+class IPlugJob
+{
+public:
+  /** The work to do, called on a worker thread. Long jobs should poll IsCancelled() and return early */
+  using IJobFunction = std::function<void(IPlugJob& job)>;
+
+  /** Called when the job has finished, on the main thread or at the start of an audio block, see ECompletionThread */
+  using ICompletionFunction = std::function<void()>;
+
+  enum EPriority { kPriorityLow = 0, kPriorityNormal, kPriorityHigh, kNumPriorities };
+
+  enum class ECompletionThread { kMainThread, kAudioThread };
+
+  enum EState { kPending = 0, kRunning, kFinished, kCancelled };
+
+  IPlugJob(IJobFunction func, ICompletionFunction onComplete, EPriority priority, ECompletionThread completionThread)
+  : mFunc(std::move(func))
+  , mOnComplete(std::move(onComplete))
+  , mPriority(priority)
+  , mCompletionThread(completionThread)
+  {
+  }
+
+  IPlugJob(const IPlugJob&) = delete;
+  IPlugJob& operator=(const IPlugJob&) = delete;
+
+  /** Ask the job to stop. A job that hasn't started will not run, and a job that is running can see the request via IsCancelled().
+   * The completion function of a cancelled job is not called */
+  void Cancel() { mCancelled.store(true); }
+
+  /** @return \c true if Cancel() has been called */
+  bool IsCancelled() const { return mCancelled.load(); }
+
+  /** @return The current EState of the job */
+  EState GetState() const { return static_cast<EState>(mState.load()); }
+
+  EPriority GetPriority() const { return mPriority; }
+
+  ECompletionThread GetCompletionThread() const { return mCompletionThread; }
+
+private:
+  friend class IPlugWorkerPool;
+  friend class IPluginBase;
+
+  /** Called on a worker thread */
+  void Run()
+  {
+    int expected = kPending;
+
+    if (!mState.compare_exchange_strong(expected, kRunning))
+      return;
+
+    // checked after claiming the job, so that CancelBackgroundJobs() either sees it running or it sees the cancellation
+    if (!IsCancelled())
+      mFunc(*this);
+
+    mState.store(IsCancelled() ? kCancelled : kFinished);
+  }
+
+  IJobFunction mFunc;
+  ICompletionFunction mOnComplete;
+  EPriority mPriority;
+  ECompletionThread mCompletionThread;
+  std::atomic<bool> mCancelled {false};
+  std::atomic<int> mState {kPending};
+  std::atomic<bool> mCompletionQueued {false}; // kAudioThread only: handed to the audio thread's completion queue
+  std::atomic<bool> mCompletionDelivered {false}; // set once the completion function has been called, or skipped
+};
+
+/** A process wide pool of worker threads for jobs that should run neither on the realtime audio thread nor on the UI thread.
+ * The pool is shared by all plug-in instances in the binary and its threads are only started when the first job is submitted.
+ * Jobs with a higher EPriority are always taken first. Plug-ins normally use IPluginBase::RunInBackground() rather than this class directly */
+class IPlugWorkerPool final
+{
+public:
+  /** @return The process wide pool */
+  static IPlugWorkerPool& Get()
+  {
+    static IPlugWorkerPool sPool;
+    return sPool;
+  }
+
+  IPlugWorkerPool(const IPlugWorkerPool&) = delete;
+  IPlugWorkerPool& operator=(const IPlugWorkerPool&) = delete;
+
+  ~IPlugWorkerPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mQuit = true;
+    }
+
+    mCondition.notify_all();
+
+    for (auto& thread : mThreads)
+      thread.join();
+  }
+
+  /** Queue a job to run on a worker thread. Not realtime safe
+   * @param job The job, the pool keeps a reference until the job has run */
+  void Submit(std::shared_ptr<IPlugJob> job)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+
+      if (mThreads.empty())
+        Start();
+
+      mJobs[job->GetPriority()].push_back(std::move(job));
+    }
+
+    mCondition.notify_one();
+  }
+
+  /** @return The number of worker threads, 0 until the first job is submitted */
+  int NThreads() const
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return static_cast<int>(mThreads.size());
+  }
+
+private:
+  IPlugWorkerPool() {}
+
+  /** Called with mMutex held */
+  void Start()
+  {
+    // leave a core for the audio and UI threads
+    const int nThreads = std::max(1, std::min(static_cast<int>(std::thread::hardware_concurrency()) - 1, 4));
+
+    for (int i = 0; i < nThreads; i++)
+      mThreads.emplace_back([this]() { ThreadProc(); });
+  }
+
+  void ThreadProc()
+  {
+    while (true)
+    {
+      std::shared_ptr<IPlugJob> job;
+
+      {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mCondition.wait(lock, [this]() { return mQuit || HasJobs(); });
+
+        if (mQuit)
+          return;
+
+        for (int p = IPlugJob::kNumPriorities - 1; p >= 0; p--)
+        {
+          if (!mJobs[p].empty())
+          {
+            job = std::move(mJobs[p].front());
+            mJobs[p].pop_front();
+            break;
+          }
+        }
+      }
+
+      job->Run();
+    }
+  }
+
+  /** Called with mMutex held */
+  bool HasJobs() const
+  {
+    for (int p = 0; p < IPlugJob::kNumPriorities; p++)
+    {
+      if (!mJobs[p].empty())
+        return true;
+    }
+
+    return false;
+  }
+
+  mutable std::mutex mMutex;
+  std::condition_variable mCondition;
+  std::deque<std::shared_ptr<IPlugJob>> mJobs[IPlugJob::kNumPriorities];
+  std::vector<std::thread> mThreads;
+  bool mQuit = false;
+};
@@ -0,0 +1,268 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IPlugXrunWatchdog
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include "wdlstring.h"
+
+#include "IPlugLogger.h"
+#include "IPlugProfiler.h"
+#include "IPlugQueue.h"
+
+/** Catches the host blocks that took longer to process than the audio they produced, the blocks which could have dropped out, and keeps what was going on in them, so that
+ * a user can send a report after a glitch. IPlugProcessor times every call to ProcessBuffers() with one when it is enabled, see IPlugProcessor::GetXrunWatchdog().
+ * The audio thread copies the context of a late block into a preallocated queue, without locking or allocating: the block's size, the parameter and MIDI events queued for it,
+ * the number of voices reported with SetNVoices() and the time in each IPLUG_PROFILE_SCOPE marker, if IPLUG_PROFILE is defined.
+ * WriteReport() then appends the records to a text file on the main thread, e.g. from IPlugAPIBase::OnIdle() */
+class IPlugXrunWatchdog
+{
+public:
+  /** The number of records that can wait for WriteReport(), later ones are counted as dropped */
+  static constexpr int kNRecords = 64;
+  /** The number of profiler markers kept in a record */
+  static constexpr int kMaxMarkers = 8;
+
+  /** The context of a block that was over its deadline */
+  struct Record
+  {
+    int64_t time = 0; // the system clock at the end of the block, in microseconds since the epoch
+    uint32_t block = 0; // the number of blocks watched until this one
+    float processTime = 0.f; // in seconds
+    float deadline = 0.f; // the duration of the block's audio, in seconds
+    int nFrames = 0;
+    float sampleRate = 0.f;
+    int nParamEvents = 0;
+    int nMidiEvents = 0;
+    int nVoices = -1; // -1 if the plug-in doesn't call SetNVoices()
+    int nMarkers = 0;
+    const char* markerNames[kMaxMarkers] = {};
+    float markerTimes[kMaxMarkers] = {};
+  };
+
+  /** Times the enclosing scope, and records its context if it is over the deadline */
+  class Scope
+  {
+  public:
+    /** @param watchdog The watchdog to check at the end of the scope, which does nothing unless it is enabled
+     * @param nFrames The number of frames processed in the scope
+     * @param sampleRate The sample rate of the frames
+     * @param nParamEvents The number of parameter events queued for the block
+     * @param nMidiEvents The number of MIDI events queued for the block
+     * @param pProfiler The profiler whose markers to record, which must have ended its block before the scope ends, or nullptr
+     * @param enabled If \c false nothing is checked, e.g. when rendering offline */
+    Scope(IPlugXrunWatchdog& watchdog, int nFrames, double sampleRate, int nParamEvents, int nMidiEvents, const IPlugProfiler* pProfiler, bool enabled)
+    : mWatchdog(enabled && watchdog.IsEnabled() ? &watchdog : nullptr)
+    , mNFrames(nFrames)
+    , mSampleRate(sampleRate)
+    , mNParamEvents(nParamEvents)
+    , mNMidiEvents(nMidiEvents)
+    , mProfiler(pProfiler)
+    {
+      if (mWatchdog)
+        mStart = std::chrono::steady_clock::now();
+    }
+
+    ~Scope()
+    {
+      if (mWatchdog)
+        mWatchdog->Check(std::chrono::duration<double>(std::chrono::steady_clock::now() - mStart).count(), *this);
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+  private:
+    friend class IPlugXrunWatchdog;
+
+    IPlugXrunWatchdog* mWatchdog;
+    int mNFrames;
+    double mSampleRate;
+    int mNParamEvents;
+    int mNMidiEvents;
+    const IPlugProfiler* mProfiler;
+    std::chrono::steady_clock::time_point mStart;
+  };
+
+  IPlugXrunWatchdog()
+  : mRecords(kNRecords)
+  {
+  }
+
+  IPlugXrunWatchdog(const IPlugXrunWatchdog&) = delete;
+  IPlugXrunWatchdog& operator=(const IPlugXrunWatchdog&) = delete;
+
+  /** Start or stop watching the blocks. This can be called on any thread, and takes effect at the next block
+   * @param enable \c true to start watching
+   * @param threshold The fraction of a block's duration that its processing may take, 1 to catch the blocks that could have dropped out, or less to catch near misses */
+  void Enable(bool enable, float threshold = 1.f)
+  {
+    mThreshold.store(threshold, std::memory_order_relaxed);
+    mEnabled.store(enable, std::memory_order_release);
+  }
+
+  /** @return \c true if the blocks are being watched */
+  bool IsEnabled() const { return mEnabled.load(std::memory_order_acquire); }
+
+  /** Report the number of voices playing, to be kept with the records of late blocks. Call it from ProcessBlock(), e.g. with MidiSynth::NActiveVoices(). Audio thread only
+   * @param nVoices The number of voices playing in the block */
+  void SetNVoices(int nVoices) { mNVoices = nVoices; }
+
+  /** @return The number of late blocks since the watchdog was created */
+  uint32_t GetNXruns() const { return mNXruns.load(std::memory_order_relaxed); }
+
+  /** @return The number of late blocks whose records didn't fit in the queue, because WriteReport() wasn't called often enough */
+  uint32_t GetNDropped() const { return mNDropped.load(std::memory_order_relaxed); }
+
+  /** Take the next record of a late block. Main thread only, or one thread at a time
+   * @param record Set to the record
+   * @return \c true if there was a record */
+  bool Pop(Record& record) { return mRecords.Pop(record); }
+
+  /** Describe a record in a line of text
+   * @param record The record
+   * @param str Appended with the description, ending with a new line */
+  static void Describe(const Record& record, WDL_String& str)
+  {
+    const time_t seconds = static_cast<time_t>(record.time / 1000000);
+    char timeStr[32] = "";
+    struct tm localTime;
+#ifdef _WIN32
+    localtime_s(&localTime, &seconds);
+#else
+    localtime_r(&seconds, &localTime);
+#endif
+    strftime(timeStr, sizeof(timeStr), "%Y-%m-%d %H:%M:%S", &localTime);
+
+    str.AppendFormatted(256, "%s.%03i block %u: %.2f ms of %.2f ms (%.0f%%), %i frames at %.0f Hz, %i param events, %i MIDI events",
+                        timeStr, static_cast<int>(record.time / 1000 % 1000), record.block, record.processTime * 1000., record.deadline * 1000.,
+                        record.deadline > 0.f ? record.processTime / record.deadline * 100. : 0., record.nFrames, record.sampleRate, record.nParamEvents, record.nMidiEvents);
+
+    if (record.nVoices >= 0)
+      str.AppendFormatted(32, ", %i voices", record.nVoices);
+
+    for (int i = 0; i < record.nMarkers; i++)
+      str.AppendFormatted(128, ", %s %.2f ms", record.markerNames[i], record.markerTimes[i] * 1000.);
+
+    str.Append("\n");
+  }
+
+  /** Append the records of the late blocks since the last call to a text file, a line each, and say how many were dropped. Main thread only, e.g. from IPlugAPIBase::OnIdle()
+   * @param path The path of the report file, which is created if it doesn't exist
+   * @return The number of records written, or -1 if the file couldn't be opened */
+  int WriteReport(const char* path)
+  {
+    Record record;
+
+    if (!mRecords.ElementsAvailable() && mNDropped.load(std::memory_order_relaxed) == mNDroppedReported)
+      return 0;
+
+    FILE* fp = fopen(path, "a");
+
+    if (!fp)
+      return -1;
+
+    WDL_String str;
+    int nWritten = 0;
+
+    while (Pop(record))
+    {
+      str.Set("");
+      Describe(record, str);
+      fputs(str.Get(), fp);
+      nWritten++;
+    }
+
+    const uint32_t nDropped = mNDropped.load(std::memory_order_relaxed);
+
+    if (nDropped != mNDroppedReported)
+    {
+      fprintf(fp, "%u late blocks were not recorded\n", nDropped - mNDroppedReported);
+      mNDroppedReported = nDropped;
+    }
+
+    fclose(fp);
+    DBGMSG("IPlugXrunWatchdog: wrote %i late blocks to %s\n", nWritten, path);
+    return nWritten;
+  }
+
+private:
+  void Check(double seconds, const Scope& scope)
+  {
+    mNBlocks++;
+
+    if (scope.mNFrames <= 0 || scope.mSampleRate <= 0.)
+      return;
+
+    const double deadline = scope.mNFrames / scope.mSampleRate;
+
+    if (seconds <= deadline * mThreshold.load(std::memory_order_relaxed))
+      return;
+
+    mNXruns.fetch_add(1, std::memory_order_relaxed);
+    TRACE_COUNTER("Xrun ms", seconds * 1000.);
+
+    Record record;
+    record.time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    record.block = mNBlocks;
+    record.processTime = static_cast<float>(seconds);
+    record.deadline = static_cast<float>(deadline);
+    record.nFrames = scope.mNFrames;
+    record.sampleRate = static_cast<float>(scope.mSampleRate);
+    record.nParamEvents = scope.mNParamEvents;
+    record.nMidiEvents = scope.mNMidiEvents;
+    record.nVoices = mNVoices;
+    record.nMarkers = 0;
+
+    if (const IPlugProfiler* pProfiler = scope.mProfiler)
+    {
+      const int nMarkers = pProfiler->GetNMarkers();
+
+      for (int i = 0; i < nMarkers && record.nMarkers < kMaxMarkers; i++)
+      {
+        const double time = pProfiler->GetLastBlockTime(i);
+
+        if (time > 0.)
+        {
+          record.markerNames[record.nMarkers] = pProfiler->GetMarkerName(i);
+          record.markerTimes[record.nMarkers++] = static_cast<float>(time);
+        }
+      }
+    }
+
+    if (!mRecords.Push(record))
+      mNDropped.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  IPlugQueue<Record> mRecords;
+  std::atomic<bool> mEnabled {false};
+  std::atomic<float> mThreshold {1.f};
+  std::atomic<uint32_t> mNXruns {0};
+  std::atomic<uint32_t> mNDropped {0};
+
+  // only touched by the audio thread
+  uint32_t mNBlocks = 0;
+  int mNVoices = -1;
+
+  // only touched by the main thread
+  uint32_t mNDroppedReported = 0;
+};
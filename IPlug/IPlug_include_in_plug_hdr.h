@@ -52,6 +52,10 @@
   #include "IPlugAPP.h"
   typedef IPlugAPP IPlug;
   #define API_EXT "app"
+#elif defined CLAP_API
+  #include "IPlugCLAP.h"
+  typedef IPlugCLAP IPlug;
+  #define API_EXT "clap"
 #elif defined WAM_API
   #include "IPlugWAM.h"
   typedef IPlugWAM IPlug;
@@ -201,6 +205,18 @@
   #define PLUG_SHARED_RESOURCES 0
 #endif
 
+#ifndef PLUG_DOES_IN_PLACE_PROCESSING
+  #define PLUG_DOES_IN_PLACE_PROCESSING 0 // set to 1 if ProcessBlock() can cope with inputs[i] and outputs[i] pointing at the same memory
+#endif
+
+#ifndef PLUG_PROCESS_INTERLEAVED
+  #define PLUG_PROCESS_INTERLEAVED 0 // set to 1 to process interleaved frames in ProcessBlockInterleaved() instead of ProcessBlock()
+#endif
+
+#ifndef PLUG_FLUSH_DENORMALS
+  #define PLUG_FLUSH_DENORMALS 1 // set to 0 to process with the host's floating point environment, rather than with flush-to-zero and denormals-are-zero
+#endif
+
 #ifdef IPLUG_VST3
   #ifndef PLUG_VERSION_STR
     #error You need to define PLUG_VERSION_STR in config.h - A string to identify the version number
@@ -247,6 +263,33 @@
   #endif
 #endif
 
+#ifdef AUv3_API
+  #ifndef AUV3_AUAUDIOUNIT_CLASS
+    #error AUV3_AUAUDIOUNIT_CLASS not defined - the name of the Objective-C AUAudioUnit subclass for the AUv3 plug-in, without quotes
+  #endif
+#endif
+
+#ifdef CLAP_API
+  #ifndef PLUG_VERSION_STR
+    #error You need to define PLUG_VERSION_STR in config.h - A string to identify the version number
+  #endif
+
+  #ifndef PLUG_URL_STR
+    #pragma message WARN("PLUG_URL_STR not defined, setting to empty string")
+    #define PLUG_URL_STR ""
+  #endif
+
+  #ifndef CLAP_PLUGIN_ID
+    #define CLAP_PLUGIN_ID BUNDLE_DOMAIN "." BUNDLE_MFR "." BUNDLE_NAME // reverse domain name, unique to the plug-in
+  #endif
+#endif
+
+#ifdef WAM_API
+  #ifndef WAM_BLOCK_SIZE
+    #define WAM_BLOCK_SIZE 0 // the number of frames to collect from render quanta before calling ProcessBlock(), 0 to process each quantum
+  #endif
+#endif
+
 #ifdef AAX_API
   #ifndef AAX_TYPE_IDS
     #error AAX_TYPE_IDS not defined - list of comma separated four char IDs, that correspond to the different possible channel layouts of your plug-in, e.g. 'EFN1', 'EFN2'
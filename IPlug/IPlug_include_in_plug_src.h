@@ -324,6 +324,7 @@ extern "C"
   IPlug* MakePlug()
   {
     IPlugInstanceInfo instanceInfo;
+    instanceInfo.mAccumulateBlockSize = WAM_BLOCK_SIZE;
     return new PLUG_CLASS_NAME(instanceInfo);
   }
 
@@ -335,6 +336,85 @@ extern "C"
       return (void*) pWAM;
     }
   }
+#pragma mark - CLAP
+#elif defined CLAP_API
+  IPlug* MakePlug(const clap_host* pHost, const clap_plugin_descriptor* pDescriptor)
+  {
+    IPlugInstanceInfo instanceInfo;
+    instanceInfo.mHost = pHost;
+    instanceInfo.mDescriptor = pDescriptor;
+
+    return new PLUG_CLASS_NAME(instanceInfo);
+  }
+
+  static const char* sClapFeatures[] = {
+  #if PLUG_TYPE == 1
+    CLAP_PLUGIN_FEATURE_INSTRUMENT,
+  #elif PLUG_TYPE == 2
+    CLAP_PLUGIN_FEATURE_NOTE_EFFECT,
+  #else
+    CLAP_PLUGIN_FEATURE_AUDIO_EFFECT,
+  #endif
+  #ifdef CLAP_FEATURES
+    CLAP_FEATURES, // extra comma separated CLAP_PLUGIN_FEATURE_ strings, e.g. CLAP_PLUGIN_FEATURE_REVERB
+  #endif
+    nullptr
+  };
+
+  static const clap_plugin_descriptor sClapDescriptor = {
+    CLAP_VERSION_INIT,
+    CLAP_PLUGIN_ID,
+    PLUG_NAME,
+    PLUG_MFR,
+    PLUG_URL_STR,
+    PLUG_URL_STR,
+    PLUG_URL_STR,
+    PLUG_VERSION_STR,
+    "",
+    sClapFeatures
+  };
+
+  static uint32_t ClapFactoryGetPluginCount(const clap_plugin_factory* pFactory)
+  {
+    return 1;
+  }
+
+  static const clap_plugin_descriptor* ClapFactoryGetPluginDescriptor(const clap_plugin_factory* pFactory, uint32_t index)
+  {
+    return index == 0 ? &sClapDescriptor : nullptr;
+  }
+
+  static const clap_plugin* ClapFactoryCreatePlugin(const clap_plugin_factory* pFactory, const clap_host* pHost, const char* pluginID)
+  {
+    if (!clap_version_is_compatible(pHost->clap_version) || strcmp(pluginID, sClapDescriptor.id))
+      return nullptr;
+
+    return MakePlug(pHost, &sClapDescriptor)->GetClapPlugin();
+  }
+
+  static const clap_plugin_factory sClapFactory = {
+    ClapFactoryGetPluginCount,
+    ClapFactoryGetPluginDescriptor,
+    ClapFactoryCreatePlugin
+  };
+
+  static bool ClapEntryInit(const char* pluginPath) { return true; }
+  static void ClapEntryDeinit() {}
+
+  static const void* ClapEntryGetFactory(const char* factoryID)
+  {
+    return !strcmp(factoryID, CLAP_PLUGIN_FACTORY_ID) ? &sClapFactory : nullptr;
+  }
+
+  extern "C"
+  {
+    CLAP_EXPORT const clap_plugin_entry clap_entry = {
+      CLAP_VERSION_INIT,
+      ClapEntryInit,
+      ClapEntryDeinit,
+      ClapEntryGetFactory
+    };
+  }
 #pragma mark - WEB
 #elif defined WEB_API
   #include "config.h"
@@ -417,11 +497,49 @@ extern "C"
 
 #define PUBLIC_NAME PLUG_NAME
 
+#pragma mark - Realtime checks
+#if defined IPLUG_REALTIME_CHECKS || IPLUG_COUNT_ALLOCATIONS
+  #include <new>
+
+  // replaced here, because this file is included exactly once per plug-in binary. The other forms of new and delete forward to these
+  void* operator new(std::size_t size)
+  {
+    IPLUG_CHECK_NOT_REALTIME("operator new");
+  #if IPLUG_COUNT_ALLOCATIONS
+    IAllocationCounter::OnAllocation();
+  #endif
+    void* pMem = malloc(size ? size : 1);
+
+    if (!pMem)
+      throw std::bad_alloc();
+
+    return pMem;
+  }
+
+  void* operator new[](std::size_t size)
+  {
+    return operator new(size);
+  }
+
+  void operator delete(void* pMem) noexcept
+  {
+    if (pMem)
+      IPLUG_CHECK_NOT_REALTIME("operator delete");
+
+    free(pMem);
+  }
+
+  void operator delete[](void* pMem) noexcept
+  {
+    operator delete(pMem);
+  }
+#endif
+
 #define IPLUG_CTOR(nParams, nPresets, instanceInfo) \
   IPlug(instanceInfo, IPlugConfig(nParams, nPresets, PLUG_CHANNEL_IO,\
     PUBLIC_NAME, "", PLUG_MFR, PLUG_VERSION_HEX, PLUG_UNIQUE_ID, PLUG_MFR_ID, \
     PLUG_LATENCY, PLUG_DOES_MIDI_IN, PLUG_DOES_MIDI_OUT, PLUG_DOES_MPE, PLUG_DOES_STATE_CHUNKS, PLUG_TYPE, \
-    PLUG_HAS_UI, PLUG_WIDTH, PLUG_HEIGHT, BUNDLE_ID))
+    PLUG_HAS_UI, PLUG_WIDTH, PLUG_HEIGHT, BUNDLE_ID, PLUG_DOES_IN_PLACE_PROCESSING, PLUG_PROCESS_INTERLEAVED, PLUG_FLUSH_DENORMALS))
 
 #if !defined NO_IGRAPHICS && !defined VST3P_API
 #include "IGraphics_include_in_plug_src.h"
@@ -0,0 +1,343 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc ISender
+ */
+
+#include <array>
+#include <atomic>
+#include <cmath>
+
+#include "IPlugEditorDelegate.h"
+#include "IPlugQueue.h"
+#include "IPlugUtilities.h"
+
+/** A frame of data sent from the realtime audio thread to a control in the user interface
+ * @tparam MAXNC The maximum number of channels in a frame
+ * @tparam T The per channel value, e.g. a float for a meter or a std::array of floats for a buffer */
+template <int MAXNC = 1, typename T = float>
+struct ISenderData
+{
+  int ctrlTag = kNoTag;
+  int nChans = MAXNC;
+  int chanOffset = 0;
+  std::array<T, MAXNC> vals;
+
+  ISenderData()
+  {
+    vals.fill(T());
+  }
+};
+
+/** ISender is a utility class used to transfer frames of visualisation data from the realtime audio thread to the user interface.
+ * Frames are pushed into a preallocated lock-free queue on the audio thread. On the main thread TransmitData() drains the queue and
+ * sends only the newest frame for each control tag via IEditorDelegate::SendControlMsgFromDelegate(), so a slow UI never falls behind
+ * and the same code works with IGraphics, WAM and remote editors.
+ * The message can be handled in the destination control via IControl::OnMsgFromDelegate(), with messageTag ISender::kUpdateMessage
+ * and pData pointing to an ISenderData
+ * @tparam MAXNC The maximum number of channels in a frame
+ * @tparam QUEUE_SIZE The number of frames the queue can hold
+ * @tparam T The per channel value */
+template <int MAXNC = 1, int QUEUE_SIZE = 64, typename T = float>
+class ISender
+{
+public:
+  static constexpr int kUpdateMessage = 0;
+
+  using Data = ISenderData<MAXNC, T>;
+
+  /** ISender constructor
+   * @param ctrlTag The control tag that frames are sent to by default */
+  ISender(int ctrlTag = kNoTag)
+  : mCtrlTag(ctrlTag)
+  {
+  }
+
+  virtual ~ISender() {}
+
+  /** Queue a frame to send to the user interface. Realtime thread only
+   * @param d The frame to send, d.ctrlTag should identify the destination control
+   * @return \c true if the frame was queued, \c false if the queue was full */
+  bool PushData(const Data& d)
+  {
+    return mEnabled.load(std::memory_order_relaxed) && mQueue.Push(d);
+  }
+
+  /** Stop or start queueing frames, e.g. while rendering offline, when there is nobody watching the meters, see IPlugOfflinePolicy. Any thread
+   * @param enabled \c false to drop the frames pushed, and skip the analysis in the ProcessBlock() of the senders below */
+  void SetEnabled(bool enabled) { mEnabled.store(enabled, std::memory_order_relaxed); }
+
+  /** @return \c true if frames are queued, see SetEnabled() */
+  bool GetEnabled() const { return mEnabled.load(std::memory_order_relaxed); }
+
+  /** Send the newest queued frame for each control tag to the user interface, dropping any older ones.
+   * This must be called on the main thread - typically in MyPlugin::OnIdle()
+   * @param dlg The editor delegate to send the frames via, usually the plug-in */
+  void TransmitData(IEditorDelegate& dlg)
+  {
+    int nLatest = 0;
+
+    while (mQueue.ElementsAvailable())
+    {
+      const int ctrlTag = mQueue.Peek().ctrlTag;
+      int slot = 0;
+
+      while (slot < nLatest && mLatest.Get()[slot].ctrlTag != ctrlTag)
+        slot++;
+
+      if (slot == nLatest)
+      {
+        if (mLatest.GetSize() <= slot)
+          mLatest.Resize(slot + 1);
+
+        nLatest++;
+      }
+
+      mQueue.Pop(mLatest.Get()[slot]); // pop straight into the slot, overwriting any older frame for the same control
+    }
+
+    for (int i = 0; i < nLatest; i++)
+    {
+      const Data& d = mLatest.Get()[i];
+      dlg.SendControlMsgFromDelegate(d.ctrlTag, kUpdateMessage, sizeof(Data), (void*) &d);
+    }
+  }
+
+protected:
+  int mCtrlTag;
+
+private:
+  std::atomic<bool> mEnabled {true};
+  IPlugQueue<Data> mQueue {QUEUE_SIZE};
+  WDL_TypedBuf<Data> mLatest; // only touched on the main thread, grows once per distinct control tag
+};
+
+/** IPeakSender is a utility class that can be used to measure the peak or RMS level of a group of channels and send it to a meter control.
+ * One frame is sent per window of samples, so the rate of UI updates is independent of the host's block size.
+ * Once the level drops below the threshold a final frame is sent and the sender goes quiet until the level rises again
+ * @tparam MAXNC The maximum number of channels
+ * @tparam QUEUE_SIZE The number of frames the queue can hold */
+template <int MAXNC = 1, int QUEUE_SIZE = 64>
+class IPeakSender : public ISender<MAXNC, QUEUE_SIZE, float>
+{
+public:
+  enum class EMode { kPeak, kRMS };
+
+  /** IPeakSender constructor
+   * @param ctrlTag The control tag that frames are sent to by default
+   * @param windowSize The number of samples measured for each frame
+   * @param mode Whether the frames contain the peak or the RMS level of each window
+   * @param thresholdDB Frames are only sent while the sum of the levels is above this value in dB */
+  IPeakSender(int ctrlTag = kNoTag, int windowSize = 512, EMode mode = EMode::kPeak, double thresholdDB = -90.)
+  : ISender<MAXNC, QUEUE_SIZE, float>(ctrlTag)
+  , mWindowSize(std::max(windowSize, 1))
+  , mMode(mode)
+  , mThreshold((float) DBToAmp(thresholdDB))
+  {
+    mAccumulators.fill(0.f);
+  }
+
+  /** Set the number of samples measured for each frame. Call this from OnReset(), not while processing */
+  void SetWindowSize(int windowSize)
+  {
+    mWindowSize = std::max(windowSize, 1);
+    Reset();
+  }
+
+  /** Clear the current window */
+  void Reset()
+  {
+    mAccumulators.fill(0.f);
+    mCount = 0;
+  }
+
+  /** Measure MAXNC channels of a block and send a frame to the default control tag at the end of each window. Realtime thread only */
+  void ProcessBlock(sample** inputs, int nFrames)
+  {
+    ProcessBlock(inputs, nFrames, this->mCtrlTag, MAXNC, 0);
+  }
+
+  /** Measure a block and send a frame at the end of each window. Realtime thread only
+   * @param inputs The channel pointers to measure
+   * @param nFrames The number of samples in the block
+   * @param ctrlTag The control tag to send frames to
+   * @param nChans The number of channels to measure, at most MAXNC
+   * @param chanOffset The index of the first channel in inputs to measure */
+  void ProcessBlock(sample** inputs, int nFrames, int ctrlTag, int nChans = MAXNC, int chanOffset = 0)
+  {
+    if (!this->GetEnabled())
+      return;
+
+    nChans = std::min(nChans, MAXNC);
+    int s = 0;
+
+    while (s < nFrames)
+    {
+      const int n = std::min(nFrames - s, mWindowSize - mCount);
+
+      for (int c = 0; c < nChans; c++)
+      {
+        const sample* pIn = inputs[chanOffset + c] + s;
+        float acc = mAccumulators[c];
+
+        if (mMode == EMode::kPeak)
+        {
+          for (int i = 0; i < n; i++)
+            acc = std::max(acc, (float) std::fabs(pIn[i]));
+        }
+        else
+        {
+          for (int i = 0; i < n; i++)
+            acc += (float) (pIn[i] * pIn[i]);
+        }
+
+        mAccumulators[c] = acc;
+      }
+
+      s += n;
+      mCount += n;
+
+      if (mCount == mWindowSize)
+      {
+        typename ISender<MAXNC, QUEUE_SIZE, float>::Data d;
+        d.ctrlTag = ctrlTag;
+        d.nChans = nChans;
+        d.chanOffset = chanOffset;
+        float sum = 0.f;
+
+        for (int c = 0; c < nChans; c++)
+        {
+          d.vals[c] = mMode == EMode::kPeak ? mAccumulators[c] : std::sqrt(mAccumulators[c] / (float) mWindowSize);
+          sum += d.vals[c];
+        }
+
+        const bool aboveThreshold = sum > mThreshold;
+
+        if (aboveThreshold || mPrevAboveThreshold)
+          this->PushData(d);
+
+        mPrevAboveThreshold = aboveThreshold;
+        Reset();
+      }
+    }
+  }
+
+private:
+  int mWindowSize;
+  int mCount = 0;
+  EMode mMode;
+  float mThreshold;
+  bool mPrevAboveThreshold = true;
+  std::array<float, MAXNC> mAccumulators;
+};
+
+/** IBufferSender is a utility class that can be used to send buffers of samples to an oscilloscope-like control.
+ * The input can be decimated, in which case each point in the buffer is the sample with the largest magnitude in its span,
+ * so that peaks stay visible. Once the buffer goes quiet a final frame is sent and the sender stops until the signal returns
+ * @tparam MAXNC The maximum number of channels
+ * @tparam MAXBUF The number of points in each buffer
+ * @tparam QUEUE_SIZE The number of frames the queue can hold */
+template <int MAXNC = 1, int MAXBUF = 128, int QUEUE_SIZE = 64>
+class IBufferSender : public ISender<MAXNC, QUEUE_SIZE, std::array<float, MAXBUF>>
+{
+public:
+  using Data = ISenderData<MAXNC, std::array<float, MAXBUF>>;
+
+  /** IBufferSender constructor
+   * @param ctrlTag The control tag that frames are sent to by default
+   * @param decimation The number of input samples represented by each point in the buffer
+   * @param thresholdDB Frames are only sent while the sum of the absolute sample values is above this value in dB */
+  IBufferSender(int ctrlTag = kNoTag, int decimation = 1, double thresholdDB = -90.)
+  : ISender<MAXNC, QUEUE_SIZE, std::array<float, MAXBUF>>(ctrlTag)
+  , mDecimation(std::max(decimation, 1))
+  , mThreshold((float) DBToAmp(thresholdDB))
+  {
+  }
+
+  /** Set the number of input samples represented by each point in the buffer. Call this from OnReset(), not while processing */
+  void SetDecimation(int decimation)
+  {
+    mDecimation = std::max(decimation, 1);
+    mBufCount = 0;
+    mDecimationCount = 0;
+  }
+
+  /** Buffer MAXNC channels of a block and send a frame to the default control tag whenever the buffer is full. Realtime thread only */
+  void ProcessBlock(sample** inputs, int nFrames)
+  {
+    ProcessBlock(inputs, nFrames, this->mCtrlTag, MAXNC, 0);
+  }
+
+  /** Buffer a block and send a frame whenever the buffer is full. Realtime thread only
+   * @param inputs The channel pointers to buffer
+   * @param nFrames The number of samples in the block
+   * @param ctrlTag The control tag to send frames to
+   * @param nChans The number of channels to buffer, at most MAXNC
+   * @param chanOffset The index of the first channel in inputs to buffer */
+  void ProcessBlock(sample** inputs, int nFrames, int ctrlTag, int nChans = MAXNC, int chanOffset = 0)
+  {
+    if (!this->GetEnabled())
+      return;
+
+    nChans = std::min(nChans, MAXNC);
+
+    for (int s = 0; s < nFrames; s++)
+    {
+      for (int c = 0; c < nChans; c++)
+      {
+        const float v = (float) inputs[chanOffset + c][s];
+        float& point = mBuf.vals[c][mBufCount];
+
+        if (mDecimationCount == 0 || std::fabs(v) > std::fabs(point))
+          point = v;
+      }
+
+      if (++mDecimationCount < mDecimation)
+        continue;
+
+      mDecimationCount = 0;
+
+      if (++mBufCount == MAXBUF)
+      {
+        mBuf.ctrlTag = ctrlTag;
+        mBuf.nChans = nChans;
+        mBuf.chanOffset = chanOffset;
+
+        float sum = 0.f;
+
+        for (int c = 0; c < nChans; c++)
+        {
+          for (int i = 0; i < MAXBUF; i++)
+            sum += std::fabs(mBuf.vals[c][i]);
+        }
+
+        const bool aboveThreshold = sum > mThreshold;
+
+        if (aboveThreshold || mPrevAboveThreshold)
+          this->PushData(mBuf);
+
+        mPrevAboveThreshold = aboveThreshold;
+        mBufCount = 0;
+      }
+    }
+  }
+
+private:
+  Data mBuf;
+  int mDecimation;
+  int mDecimationCount = 0;
+  int mBufCount = 0;
+  float mThreshold;
+  bool mPrevAboveThreshold = true;
+};
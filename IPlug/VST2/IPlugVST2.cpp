@@ -67,6 +67,8 @@ IPlugVST2::IPlugVST2(IPlugInstanceInfo instanceInfo, IPlugConfig c)
   // Default everything to connected, then disconnect pins if the host says to.
   SetChannelConnections(ERoute::kInput, 0, nInputs, true);
   SetChannelConnections(ERoute::kOutput, 0, nOutputs, true);
+  mNInputsConnected = nInputs;
+  mNOutputsConnected = nOutputs;
 
   SetBlockSize(DEFAULT_BLOCK_SIZE);
 
@@ -83,21 +85,25 @@ IPlugVST2::IPlugVST2(IPlugInstanceInfo instanceInfo, IPlugConfig c)
 
 void IPlugVST2::BeginInformHostOfParamChange(int idx)
 {
+  IPLUG_HOST_CALL_SCOPE(kHostCallBeginEdit);
   mHostCallback(&mAEffect, audioMasterBeginEdit, idx, 0, 0, 0.0f);
 }
 
 void IPlugVST2::InformHostOfParamChange(int idx, double normalizedValue)
 {
+  IPLUG_HOST_CALL_SCOPE(kHostCallPerformEdit);
   mHostCallback(&mAEffect, audioMasterAutomate, idx, 0, 0, (float) normalizedValue);
 }
 
 void IPlugVST2::EndInformHostOfParamChange(int idx)
 {
+  IPLUG_HOST_CALL_SCOPE(kHostCallEndEdit);
   mHostCallback(&mAEffect, audioMasterEndEdit, idx, 0, 0, 0.0f);
 }
 
 void IPlugVST2::InformHostOfProgramChange()
 {
+  IPLUG_HOST_CALL_SCOPE(kHostCallPresetChange);
   mHostCallback(&mAEffect, audioMasterUpdateDisplay, 0, 0, 0, 0.0f);
 }
 
@@ -111,6 +117,7 @@ void IPlugVST2::EditorPropertiesChangedFromDelegate(int viewWidth, int viewHeigh
       mEditRect.right = viewWidth;
       mEditRect.bottom = viewHeight;
     
+      IPLUG_HOST_CALL_SCOPE(kHostCallResize);
       mHostCallback(&mAEffect, audioMasterSizeWindow, viewWidth, viewHeight, 0, 0.f);
     }
     
@@ -120,8 +127,8 @@ void IPlugVST2::EditorPropertiesChangedFromDelegate(int viewWidth, int viewHeigh
 
 void IPlugVST2::SetLatency(int samples)
 {
-  mAEffect.initialDelay = samples;
   IPlugProcessor::SetLatency(samples);
+  mAEffect.initialDelay = GetLatency();
 }
 
 bool IPlugVST2::SendVSTEvent(VstEvent& event)
@@ -341,6 +348,10 @@ VstIntPtr VSTCALLBACK IPlugVST2::VSTDispatcher(AEffect *pEffect, VstInt32 opCode
       }
       else
       {
+        // the VST SDK asks for wantEvents to be called on resume, not on every process call
+        if (_this->DoesMIDIIn())
+          _this->mHostCallback(&_this->mAEffect, __audioMasterWantMidiDeprecated, 0, 0, 0, 0.0f);
+
         _this->OnActivate(true);
       }
       return 0;
@@ -399,10 +410,12 @@ VstIntPtr VSTCALLBACK IPlugVST2::VSTDispatcher(AEffect *pEffect, VstInt32 opCode
         if (isBank)
         {
           _this->ModifyCurrentPreset();
+          chunk.Reserve(chunk.Size() + _this->GetPresetsChunkSize());
           savedOK = static_cast<IPluginBase*>(_this)->SerializePresets(chunk);
         }
         else
         {
+          chunk.Reserve(chunk.Size() + _this->GetStateSizeEstimate());
           savedOK = _this->SerializeState(chunk);
         }
 
@@ -538,15 +551,17 @@ VstIntPtr VSTCALLBACK IPlugVST2::VSTDispatcher(AEffect *pEffect, VstInt32 opCode
       VstSpeakerArrangement* pOutputArr = (VstSpeakerArrangement*) ptr;
       if (pInputArr)
       {
-        int n = pInputArr->numChannels;
+        int n = std::min((int) pInputArr->numChannels, _this->MaxNChannels(ERoute::kInput));
         _this->SetChannelConnections(ERoute::kInput, 0, n, true);
         _this->SetChannelConnections(ERoute::kInput, n, _this->MaxNChannels(ERoute::kInput) - n, false);
+        _this->mNInputsConnected = n;
       }
       if (pOutputArr)
       {
-        int n = pOutputArr->numChannels;
+        int n = std::min((int) pOutputArr->numChannels, _this->MaxNChannels(ERoute::kOutput));
         _this->SetChannelConnections(ERoute::kOutput, 0, n, true);
         _this->SetChannelConnections(ERoute::kOutput, n, _this->MaxNChannels(ERoute::kOutput) - n, false);
+        _this->mNOutputsConnected = n;
       }
       return 1;
     }
@@ -785,11 +800,9 @@ VstIntPtr VSTCALLBACK IPlugVST2::VSTDispatcher(AEffect *pEffect, VstInt32 opCode
 template <class SAMPLETYPE>
 void IPlugVST2::VSTPreProcess(SAMPLETYPE** inputs, SAMPLETYPE** outputs, VstInt32 nFrames)
 {
-  if (DoesMIDIIn())
-    mHostCallback(&mAEffect, __audioMasterWantMidiDeprecated, 0, 0, 0, 0.0f);
-
-  AttachBuffers(ERoute::kInput, 0, MaxNChannels(ERoute::kInput), inputs, nFrames);
-  AttachBuffers(ERoute::kOutput, 0, MaxNChannels(ERoute::kOutput), outputs, nFrames);
+  // the connected channels are always the first ones, so only those are visited. When SAMPLETYPE is PLUG_SAMPLE_DST the host's pointers are used directly
+  AttachBuffers(ERoute::kInput, 0, mNInputsConnected, inputs, nFrames);
+  AttachBuffers(ERoute::kOutput, 0, mNOutputsConnected, outputs, nFrames);
 
   VstTimeInfo* pTI = (VstTimeInfo*) mHostCallback(&mAEffect, audioMasterGetTime, 0, kVstPpqPosValid | kVstTempoValid | kVstBarsValid | kVstCyclePosValid | kVstTimeSigValid, 0, 0);
 
@@ -835,6 +848,7 @@ void VSTCALLBACK IPlugVST2::VSTProcess(AEffect* pEffect, float** inputs, float**
   TRACE;
   IPlugVST2* _this = (IPlugVST2*) pEffect->object;
   _this->VSTPreProcess(inputs, outputs, nFrames);
+  _this->ProcessBlockStartTasks();
   _this->ProcessBuffersAccumulating(nFrames);
   _this->OutputSysexFromEditor();
 }
@@ -844,6 +858,7 @@ void VSTCALLBACK IPlugVST2::VSTProcessReplacing(AEffect* pEffect, float** inputs
   TRACE;
   IPlugVST2* _this = (IPlugVST2*) pEffect->object;
   _this->VSTPreProcess(inputs, outputs, nFrames);
+  _this->ProcessBlockStartTasks();
   _this->ProcessBuffers((float) 0.0f, nFrames);
   _this->OutputSysexFromEditor();
 }
@@ -853,6 +868,7 @@ void VSTCALLBACK IPlugVST2::VSTProcessDoubleReplacing(AEffect* pEffect, double**
   TRACE;
   IPlugVST2* _this = (IPlugVST2*) pEffect->object;
   _this->VSTPreProcess(inputs, outputs, nFrames);
+  _this->ProcessBlockStartTasks();
   _this->ProcessBuffers((double) 0.0, nFrames);
   _this->OutputSysexFromEditor();
 }
@@ -889,12 +905,12 @@ void VSTCALLBACK IPlugVST2::VSTSetParameter(AEffect *pEffect, VstInt32 idx, floa
 void IPlugVST2::OutputSysexFromEditor()
 {
   //Output SYSEX from the editor, which has bypassed ProcessSysEx()
-  if(mSysExDataFromEditor.ElementsAvailable())
+  IPlugMessageRing::Record record;
+  
+  while (mSysExDataFromEditor.Peek(record))
   {
-    while (mSysExDataFromEditor.Pop(mSysexBuf))
-    {
-      ISysEx smsg {mSysexBuf.mOffset, mSysexBuf.mData, mSysexBuf.mSize};
-      SendSysEx(smsg);
-    }
+    ISysEx smsg {record.mTag, record.mData, record.mSize};
+    SendSysEx(smsg);
+    mSysExDataFromEditor.Release();
   }
 }
@@ -47,6 +47,8 @@ public:
   void SetLatency(int samples) override;
   bool SendMidiMsg(const IMidiMsg& msg) override;
   bool SendSysEx(const ISysEx& msg) override;
+  void ProcessParamRamps(int startIdx, int nFrames) override { RenderParamRamps(*this, startIdx, nFrames); }
+  void AllocateParamRamps() override { CreateParamRamps(*this); }
 
   //IPlugVST
   audioMasterCallback& GetHostCallback() { return mHostCallback; }
@@ -83,6 +85,9 @@ private:
   enum { VSTEXT_NONE=0, VSTEXT_COCKOS, VSTEXT_COCOA }; // list of VST extensions supported by host
   int mHasVSTExtensions;
 
+  int mNInputsConnected = 0; // from effSetSpeakerArrangement, so that processing doesn't visit the disconnected channels
+  int mNOutputsConnected = 0;
+
   IByteChunk mState;     // Persistent storage if the host asks for plugin state.
   IByteChunk mBankState; // Persistent storage if the host asks for bank state.
 protected:
@@ -89,7 +89,7 @@ tresult PLUGIN_API IPlugVST3::process(ProcessData& data)
 {
   TRACE;
 
-  Process(data, processSetup, audioInputs, audioOutputs, mMidiMsgsFromEditor, mMidiMsgsFromProcessor, mSysExDataFromEditor, mSysexBuf);
+  Process(data, processSetup, audioInputs, audioOutputs, mMidiMsgsFromEditor, mMidiMsgsFromProcessor, mSysExDataFromEditor);
   return kResultOk;
 }
 
@@ -221,23 +221,35 @@ tresult PLUGIN_API IPlugVST3::getProgramName(ProgramListID listId, int32 program
 void IPlugVST3::BeginInformHostOfParamChange(int idx)
 {
   Trace(TRACELOC, "%d", idx);
+  IPLUG_HOST_CALL_SCOPE(kHostCallBeginEdit);
   beginEdit(idx);
 }
 
 void IPlugVST3::InformHostOfParamChange(int idx, double normalizedValue)
 {
   Trace(TRACELOC, "%d:%f", idx, normalizedValue);
+  IPLUG_HOST_CALL_SCOPE(kHostCallPerformEdit);
   performEdit(idx, normalizedValue);
 }
 
 void IPlugVST3::EndInformHostOfParamChange(int idx)
 {
   Trace(TRACELOC, "%d", idx);
+  IPLUG_HOST_CALL_SCOPE(kHostCallEndEdit);
   endEdit(idx);
 }
 
+void IPlugVST3::InformHostOfParamChanges(const IParamChange* pChanges, int nChanges)
+{
+  IPLUG_HOST_CALL_SCOPE(kHostCallGroupEdit);
+  startGroupEdit();
+  IPlugAPIBase::InformHostOfParamChanges(pChanges, nChanges);
+  finishGroupEdit();
+}
+
 void IPlugVST3::InformHostOfParameterDetailsChange()
 {
+  IPLUG_HOST_CALL_SCOPE(kHostCallParamDetails);
   FUnknownPtr<IComponentHandler>handler(componentHandler);
   handler->restartComponent(kParamTitlesChanged);
 }
@@ -247,7 +259,10 @@ void IPlugVST3::EditorPropertiesChangedFromDelegate(int viewWidth, int viewHeigh
   if (HasUI())
   {
     if (viewWidth != GetEditorWidth() || viewHeight != GetEditorHeight())
+    {
+      IPLUG_HOST_CALL_SCOPE(kHostCallResize);
       mView->resize(viewWidth, viewHeight);
+    }
 
     IPlugAPIBase::EditorPropertiesChangedFromDelegate(viewWidth, viewHeight, data);
   }
@@ -255,6 +270,7 @@ void IPlugVST3::EditorPropertiesChangedFromDelegate(int viewWidth, int viewHeigh
 
 void IPlugVST3::DirtyParametersFromUI()
 {
+  IPLUG_HOST_CALL_SCOPE(kHostCallGroupEdit);
   startGroupEdit();
   IPlugAPIBase::DirtyParametersFromUI();
   finishGroupEdit();
@@ -264,6 +280,7 @@ void IPlugVST3::SetLatency(int latency)
 {
   IPlugProcessor::SetLatency(latency);
 
+  IPLUG_HOST_CALL_SCOPE(kHostCallLatency);
   FUnknownPtr<IComponentHandler>handler(componentHandler);
   handler->restartComponent(kLatencyChanged);
 }
@@ -56,6 +56,7 @@ public:
   void BeginInformHostOfParamChange(int idx) override;
   void InformHostOfParamChange(int idx, double normalizedValue) override;
   void EndInformHostOfParamChange(int idx) override;
+  void InformHostOfParamChanges(const IParamChange* pChanges, int nChanges) override;
   void InformHostOfProgramChange() override {}
   void InformHostOfParameterDetailsChange() override;
   
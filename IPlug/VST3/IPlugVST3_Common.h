@@ -19,63 +19,158 @@
 using namespace Steinberg;
 using namespace Vst;
 
-/** Shared VST3 State management code */
+/** Shared VST3 State management code.
+ * A plug-in without large state (see IPluginBase::HasLargeState()) writes [state chunk][int32 bypass] as it always has.
+ * One with large state writes [int32 'IPLV'][int32 state chunk size][state chunk][int32 bypass][large state], so that on load only the state chunk is buffered,
+ * and the large state is read straight from the host's stream after the parameters have been restored */
 struct IPlugVST3State
 {
+  static constexpr int32 kLargeStateLayoutMagic = 'IPLV';
+
+  /** Writes to the host's stream, which may accept less than it is given */
+  class StreamWriter : public IStateWriter
+  {
+  public:
+    StreamWriter(IBStream* pStream) : mStream(pStream) {}
+
+    bool Write(const void* pData, int64_t size) override
+    {
+      const char* pBytes = static_cast<const char*>(pData);
+
+      while (size > 0)
+      {
+        int32 written = 0;
+        const int32 toWrite = (int32) std::min<int64_t>(size, 1 << 30);
+
+        if (mStream->write((void*) pBytes, toWrite, &written) != kResultOk || written <= 0)
+          return false;
+
+        pBytes += written;
+        size -= written;
+      }
+
+      return true;
+    }
+
+  private:
+    IBStream* mStream;
+  };
+
+  /** Reads from the host's stream */
+  class StreamReader : public IStateReader
+  {
+  public:
+    StreamReader(IBStream* pStream) : mStream(pStream) {}
+
+    int64_t Read(void* pData, int64_t size) override
+    {
+      char* pBytes = static_cast<char*>(pData);
+      int64_t nRead = 0;
+
+      while (nRead < size)
+      {
+        int32 bytesRead = 0;
+        const int32 toRead = (int32) std::min<int64_t>(size - nRead, 1 << 30);
+
+        if (mStream->read(pBytes + nRead, toRead, &bytesRead) != kResultOk || bytesRead <= 0)
+          break;
+
+        nRead += bytesRead;
+      }
+
+      return nRead;
+    }
+
+  private:
+    IBStream* mStream;
+  };
+
   template <class T>
   static bool GetState(T* pPlug, IBStream* pState)
   {
-    IByteChunk chunk;
+    IByteChunkPool::ScopedChunk scopedChunk = pPlug->AcquireStateChunk();
+    IByteChunk& chunk = scopedChunk.Get();
     
     // TODO: IPlugVer should be in chunk!
     //  IByteChunk::GetIPlugVerFromChunk(chunk)
     
-    if (pPlug->SerializeState(chunk))
-    {
-      /*
-       int chunkSize = chunk.Size();
-       void* data = (void*) &chunkSize;
-       state->write(data, (int32) sizeof(int));*/
-      pState->write(chunk.GetData(), chunk.Size());
-    }
-    else
-    {
+    if (!pPlug->SerializeState(chunk))
       return false;
+
+    const bool largeState = pPlug->HasLargeState();
+
+    if (largeState)
+    {
+      int32 header[2] = {kLargeStateLayoutMagic, (int32) chunk.Size()};
+      pState->write(header, sizeof(header));
     }
+
+    pState->write(chunk.GetData(), chunk.Size());
     
     int32 toSaveBypass = pPlug->GetBypassed() ? 1 : 0;
     pState->write(&toSaveBypass, sizeof (int32));
     
+    if (largeState)
+    {
+      StreamWriter writer(pState);
+      return pPlug->WriteLargeState(writer);
+    }
+
     return true;
   };
   
+  /** @param readLargeState \c false to skip the large state, e.g. in a controller that only needs the parameters */
   template <class T>
-  static bool SetState(T* pPlug, IBStream* pState)
+  static bool SetState(T* pPlug, IBStream* pState, bool readLargeState = true)
   {
     TRACE;
     
     IByteChunk chunk;
-    
-    const int bytesPerBlock = 128;
+    int64 streamStart = 0;
+    pState->tell(&streamStart);
+
+    const int bytesPerBlock = 4096;
     char buffer[bytesPerBlock];
-    
-    while(true)
+    int32 header[2] = {0, 0};
+    Steinberg::int32 headerRead = 0;
+    pState->read(header, (Steinberg::int32) sizeof(header), &headerRead);
+    const bool largeState = headerRead == (Steinberg::int32) sizeof(header) && header[0] == kLargeStateLayoutMagic && header[1] >= 0;
+    int64 chunkStart = streamStart;
+
+    if (largeState)
     {
-      Steinberg::int32 bytesRead = 0;
-      auto status = pState->read(buffer, (Steinberg::int32) bytesPerBlock, &bytesRead);
-      
-      if (bytesRead <= 0 || (status != kResultTrue && pPlug->GetHost() != kHostWaveLab))
-        break;
-      
-      chunk.PutBytes(buffer, bytesRead);
+      // only the state chunk is buffered, the large state is read from the stream below
+      chunkStart += sizeof(header);
+      StreamReader reader(pState);
+      chunk.Resize(header[1]);
+
+      if (!reader.ReadAll(chunk.GetData(), header[1]))
+        return false;
     }
+    else
+    {
+      if (headerRead > 0)
+        chunk.PutBytes(header, headerRead);
+
+      while(true)
+      {
+        Steinberg::int32 bytesRead = 0;
+        auto status = pState->read(buffer, (Steinberg::int32) bytesPerBlock, &bytesRead);
+        
+        if (bytesRead <= 0 || (status != kResultTrue && pPlug->GetHost() != kHostWaveLab))
+          break;
+        
+        chunk.PutBytes(buffer, bytesRead);
+      }
+    }
+
     int pos = pPlug->UnserializeState(chunk,0);
     
     int32 savedBypass = 0;
     
-    pState->seek(pos,IBStream::IStreamSeekMode::kIBSeekSet);
+    pState->seek(chunkStart + pos, IBStream::IStreamSeekMode::kIBSeekSet);
     if (pState->read (&savedBypass, sizeof (Steinberg::int32)) != kResultOk) {
-      return kResultFalse;
+      return false;
     }
     
     IPlugVST3ControllerBase* pController = dynamic_cast<IPlugVST3ControllerBase*>(pPlug);
@@ -87,7 +182,107 @@ struct IPlugVST3State
     }
     
     pPlug->OnRestoreState();
-    return kResultOk;
+
+    if (largeState && readLargeState)
+    {
+      pState->seek(chunkStart + header[1] + sizeof(int32), IBStream::IStreamSeekMode::kIBSeekSet);
+      StreamReader reader(pState);
+      return pPlug->ReadLargeState(reader);
+    }
+
+    return true;
+  }
+};
+
+/** Shared VST3 code for batching messages from the processor to the controller. Rather than allocating and sending one IMessage for every
+ * MIDI message, sysex, control value or control message, the processor appends compact records to an IByteChunk and sends them all in a
+ * single "BATCH" IMessage from its timer. Each record is [int32 type][int32 a][int32 b][int32 size][size bytes of payload] */
+struct IPlugVST3MessageBatch
+{
+  enum ERecordType { kMidiMsg = 0, kSysEx, kControlValue, kControlMsg, kArbitraryMsg };
+
+  /** Append a record to a batch. Main thread only
+   * @param batch The chunk that collects the records
+   * @param type The ERecordType
+   * @param a kSysEx: the offset, kControlValue, kControlMsg: the control tag, kArbitraryMsg: the message tag
+   * @param b kControlMsg: the message tag
+   * @param dataSize The size of the payload in bytes
+   * @param pData The payload */
+  static void Add(IByteChunk& batch, int type, int a, int b, int dataSize, const void* pData)
+  {
+    batch.Put(&type);
+    batch.Put(&a);
+    batch.Put(&b);
+    batch.Put(&dataSize);
+
+    if (dataSize > 0)
+      batch.PutBytes(pData, dataSize);
+  }
+
+  /** Decode a batch and call the matching SendXXXFromDelegate() method of the controller for each record, in the order they were added
+   * @return \c false if the batch is malformed, records before the bad one have been dispatched */
+  template <class T>
+  static bool Dispatch(T* pController, const void* pBatch, int batchSize)
+  {
+    IByteStream stream(pBatch, batchSize);
+    const uint8_t* pBytes = static_cast<const uint8_t*>(pBatch);
+    int pos = 0;
+
+    while (pos < batchSize)
+    {
+      int type, a, b, dataSize;
+
+      pos = stream.Get(&type, pos);
+      pos = stream.Get(&a, pos);
+      pos = stream.Get(&b, pos);
+      pos = stream.Get(&dataSize, pos);
+
+      if (pos < 0 || dataSize < 0 || dataSize > batchSize - pos)
+        return false;
+
+      const void* pData = pBytes + pos;
+      pos += dataSize;
+
+      switch (type)
+      {
+        case kMidiMsg:
+        {
+          if (dataSize != sizeof(IMidiMsg))
+            return false;
+
+          IMidiMsg msg;
+          memcpy(&msg, pData, sizeof(IMidiMsg));
+          pController->SendMidiMsgFromDelegate(msg);
+          break;
+        }
+        case kSysEx:
+        {
+          ISysEx msg {a, static_cast<const uint8_t*>(pData), dataSize};
+          pController->SendSysexMsgFromDelegate(msg);
+          break;
+        }
+        case kControlValue:
+        {
+          if (dataSize != sizeof(double))
+            return false;
+
+          double normalizedValue;
+          memcpy(&normalizedValue, pData, sizeof(double));
+          pController->SendControlValueFromDelegate(a, normalizedValue);
+          break;
+        }
+        case kControlMsg:
+          pController->SendControlMsgFromDelegate(a, b, dataSize, pData);
+          break;
+        case kArbitraryMsg:
+          pController->SendArbitraryMsgFromDelegate(a, dataSize, pData);
+          break;
+        default:
+          return false;
+      }
+    }
+
+    return true;
   }
 };
 
@@ -61,7 +61,7 @@ IPlugView* PLUGIN_API IPlugVST3Controller::createView(const char* name)
 
 tresult PLUGIN_API IPlugVST3Controller::setComponentState(IBStream* pState)
 {
-  return IPlugVST3State::SetState(this, pState) ? kResultOk :kResultFalse;
+  return IPlugVST3State::SetState(this, pState, false) ? kResultOk :kResultFalse; // the processor loads the large state
 }
 
 tresult PLUGIN_API IPlugVST3Controller::setState(IBStream* pState)
@@ -162,7 +162,10 @@ void IPlugVST3Controller::EditorPropertiesChangedFromDelegate(int viewWidth, int
   if (HasUI())
   {
     if (viewWidth != GetEditorWidth() || viewHeight != GetEditorHeight())
+    {
+      IPLUG_HOST_CALL_SCOPE(kHostCallResize);
       mView->resize(viewWidth, viewHeight);
+    }
  
     IPlugAPIBase::EditorPropertiesChangedFromDelegate(viewWidth, viewHeight, data);
   }
@@ -170,6 +173,7 @@ void IPlugVST3Controller::EditorPropertiesChangedFromDelegate(int viewWidth, int
 
 void IPlugVST3Controller::DirtyParametersFromUI()
 {
+  IPLUG_HOST_CALL_SCOPE(kHostCallGroupEdit);
   startGroupEdit();
   IPlugAPIBase::DirtyParametersFromUI();
   finishGroupEdit();
@@ -182,7 +186,17 @@ tresult PLUGIN_API IPlugVST3Controller::notify(IMessage* message)
   if (!message)
     return kInvalidArgument;
   
-  if (!strcmp(message->getMessageID(), "SCVFD"))
+  if (!strcmp(message->getMessageID(), "BATCH"))
+  {
+    const void* data = nullptr;
+    uint32 size;
+    
+    if (message->getAttributes()->getBinary("D", data, size) == kResultOk)
+      return IPlugVST3MessageBatch::Dispatch(this, data, (int) size) ? kResultOk : kResultFalse;
+    
+    return kResultFalse;
+  }
+  else if (!strcmp(message->getMessageID(), "SCVFD"))
   {
     Steinberg::int64 controlTag = kNoTag;
     double normalizedValue = 0.;
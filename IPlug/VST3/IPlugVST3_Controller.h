@@ -68,9 +68,10 @@ public:
   tresult PLUGIN_API queryInterface(const char* iid, void** obj) override;
   
   // IPlugAPIBase
-  void BeginInformHostOfParamChange(int idx) override { beginEdit(idx); }
-  void InformHostOfParamChange(int idx, double normalizedValue) override  { performEdit(idx, normalizedValue); }
-  void EndInformHostOfParamChange(int idx) override  { endEdit(idx); }
+  void BeginInformHostOfParamChange(int idx) override { IPLUG_HOST_CALL_SCOPE(kHostCallBeginEdit); beginEdit(idx); }
+  void InformHostOfParamChange(int idx, double normalizedValue) override  { IPLUG_HOST_CALL_SCOPE(kHostCallPerformEdit); performEdit(idx, normalizedValue); }
+  void EndInformHostOfParamChange(int idx) override  { IPLUG_HOST_CALL_SCOPE(kHostCallEndEdit); endEdit(idx); }
+  void InformHostOfParamChanges(const IParamChange* pChanges, int nChanges) override { IPLUG_HOST_CALL_SCOPE(kHostCallGroupEdit); startGroupEdit(); IPlugAPIBase::InformHostOfParamChanges(pChanges, nChanges); finishGroupEdit(); }
   void InformHostOfProgramChange() override  { /* TODO: */}
   void EditorPropertiesChangedFromDelegate(int viewWidth, int viewHeight, const IByteChunk& data) override;
   void DirtyParametersFromUI() override;
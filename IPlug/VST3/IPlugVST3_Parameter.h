@@ -49,9 +49,9 @@ public:
 
   virtual void toString(ParamValue valueNormalized, String128 string) const override
   {
-    WDL_String display;
-    mIPlugParam->GetDisplayForHost(valueNormalized, true, display);
-    Steinberg::UString(string, 128).fromAscii(display.Get());
+    char display[MAX_PARAM_DISPLAY_LEN];
+    mIPlugParam->GetDisplayForHost(valueNormalized, true, display, MAX_PARAM_DISPLAY_LEN);
+    Steinberg::UString(string, 128).fromAscii(display);
   }
 
   virtual bool fromString(const TChar* string, ParamValue& valueNormalized) const override
@@ -17,6 +17,7 @@ IPlugVST3Processor::IPlugVST3Processor(IPlugInstanceInfo instanceInfo, IPlugConf
 , IPlugVST3ProcessorBase(c, *this)
 {
   setControllerClass(instanceInfo.mOtherGUID);
+  mMessageBatch.Reserve(VST3_MESSAGE_BATCH_RESERVE);
   CreateTimer();
 }
 
@@ -71,7 +72,7 @@ tresult PLUGIN_API IPlugVST3Processor::process(ProcessData& data)
 {
   TRACE;
   
-  Process(data, processSetup, audioInputs, audioOutputs, mMidiMsgsFromEditor, mMidiMsgsFromProcessor, mSysExDataFromEditor, mSysexBuf);
+  Process(data, processSetup, audioInputs, audioOutputs, mMidiMsgsFromEditor, mMidiMsgsFromProcessor, mSysExDataFromEditor);
   return kResultOk;
 }
 
@@ -98,51 +99,17 @@ tresult PLUGIN_API IPlugVST3Processor::getState(IBStream* pState)
 
 void IPlugVST3Processor::SendControlValueFromDelegate(int controlTag, double normalizedValue)
 {
-  OPtr<IMessage> message = allocateMessage();
-  
-  if (!message)
-    return;
-  
-  message->setMessageID("SCVFD");
-  message->getAttributes()->setInt("CT", controlTag);
-  message->getAttributes()->setFloat("NV", normalizedValue);
-  
-  sendMessage(message);
+  IPlugVST3MessageBatch::Add(mMessageBatch, IPlugVST3MessageBatch::kControlValue, controlTag, 0, sizeof(double), &normalizedValue);
 }
 
 void IPlugVST3Processor::SendControlMsgFromDelegate(int controlTag, int messageTag, int dataSize, const void* pData)
 {
-  OPtr<IMessage> message = allocateMessage();
-  
-  if (!message)
-    return;
-  
-  message->setMessageID("SCMFD");
-  message->getAttributes()->setInt("CT", controlTag);
-  message->getAttributes()->setInt("MT", messageTag);
-  message->getAttributes()->setBinary("D", pData, dataSize);
-  
-  sendMessage(message);
+  IPlugVST3MessageBatch::Add(mMessageBatch, IPlugVST3MessageBatch::kControlMsg, controlTag, messageTag, dataSize, pData);
 }
 
 void IPlugVST3Processor::SendArbitraryMsgFromDelegate(int messageTag, int dataSize, const void* pData)
 {
-  OPtr<IMessage> message = allocateMessage();
-  
-  if (!message)
-    return;
-  
-  if (dataSize == 0) // allow sending messages with no data
-  {
-    dataSize = 1;
-    uint8_t dummy = 0;
-    pData = &dummy;
-  }
-  
-  message->setMessageID("SAMFD");
-  message->getAttributes()->setInt("MT", messageTag);
-  message->getAttributes()->setBinary("D", pData, dataSize);
-  sendMessage(message);
+  IPlugVST3MessageBatch::Add(mMessageBatch, IPlugVST3MessageBatch::kArbitraryMsg, messageTag, 0, dataSize, pData);
 }
 
 #pragma mark IConnectionPoint override
@@ -196,25 +163,27 @@ tresult PLUGIN_API IPlugVST3Processor::notify(IMessage* message)
 
 void IPlugVST3Processor::TransmitMidiMsgFromProcessor(const IMidiMsg& msg)
 {
-  OPtr<IMessage> message = allocateMessage();
-  
-  if (!message)
-    return;
-  
-  message->setMessageID("SMMFD");
-  message->getAttributes()->setBinary("D", (void*) &msg, sizeof(IMidiMsg));
-  sendMessage(message);
+  IPlugVST3MessageBatch::Add(mMessageBatch, IPlugVST3MessageBatch::kMidiMsg, 0, 0, sizeof(IMidiMsg), &msg);
 }
 
-void IPlugVST3Processor::TransmitSysExDataFromProcessor(const SysExData& data)
+void IPlugVST3Processor::TransmitSysExDataFromProcessor(const ISysEx& data)
 {
+  IPlugVST3MessageBatch::Add(mMessageBatch, IPlugVST3MessageBatch::kSysEx, data.mOffset, 0, data.mSize, data.mData);
+}
+
+void IPlugVST3Processor::FlushMessagesFromProcessor()
+{
+  if (!mMessageBatch.Size())
+    return;
+  
   OPtr<IMessage> message = allocateMessage();
   
-  if (!message)
-    return;
+  if (message)
+  {
+    message->setMessageID("BATCH");
+    message->getAttributes()->setBinary("D", mMessageBatch.GetData(), mMessageBatch.Size());
+    sendMessage(message);
+  }
   
-  message->setMessageID("SSMFD");
-  message->getAttributes()->setBinary("D", (void*) data.mData, data.mSize);
-  message->getAttributes()->setInt("O", data.mOffset);
-  sendMessage(message);
+  mMessageBatch.Clear(); // keeps its memory for the next tick
 }
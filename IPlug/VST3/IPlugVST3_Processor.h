@@ -66,13 +66,15 @@ public:
   
 private:
   void TransmitMidiMsgFromProcessor(const IMidiMsg& msg) override;
-  void TransmitSysExDataFromProcessor(const SysExData& data) override;
+  void TransmitSysExDataFromProcessor(const ISysEx& msg) override;
+  void FlushMessagesFromProcessor() override;
 
   // IConnectionPoint
   tresult PLUGIN_API notify(IMessage* message) override;
   
   ParameterChanges mOutputParamChanges;
   IMidiQueue mMidiOutputQueue;
+  IByteChunk mMessageBatch; // see IPlugVST3MessageBatch
 };
 
 IPlugVST3Processor* MakeProcessor();
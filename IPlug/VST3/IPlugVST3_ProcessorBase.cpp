@@ -8,6 +8,7 @@
  ==============================================================================
  */
 
+#include "pluginterfaces/vst/ivstmidicontrollers.h"
 #include "pluginterfaces/vst/ivstparameterchanges.h"
 #include "pluginterfaces/vst/vstspeaker.h"
 
@@ -52,6 +53,9 @@ IPlugVST3ProcessorBase::IPlugVST3ProcessorBase(IPlugConfig c, IPlugAPIBase& plug
 {
   SetChannelConnections(ERoute::kInput, 0, MaxNChannels(ERoute::kInput), true);
   SetChannelConnections(ERoute::kOutput, 0, MaxNChannels(ERoute::kOutput), true);
+
+  mBusLayout[ERoute::kInput].Resize(MaxNBuses(ERoute::kInput));
+  mBusLayout[ERoute::kOutput].Resize(MaxNBuses(ERoute::kOutput));
   
   if (MaxNChannels(ERoute::kInput))
   {
@@ -67,6 +71,14 @@ void IPlugVST3ProcessorBase::ProcessMidiIn(IEventList* eventList, IPlugQueue<IMi
 {
   IMidiMsg msg;
   
+  // with sample accurate MIDI, messages are merged with the parameter changes and delivered as ProcessBlock() reaches them
+  auto DeliverMidiMsg = [this](const IMidiMsg& midiMsg) {
+    if (GetSampleAccurateMidi())
+      AddMidiEvent(midiMsg);
+    else
+      ProcessMidiMsg(midiMsg);
+  };
+  
   // Process events.. only midi note on and note off?
   
   if (eventList)
@@ -82,7 +94,7 @@ void IPlugVST3ProcessorBase::ProcessMidiIn(IEventList* eventList, IPlugQueue<IMi
           case Event::kNoteOnEvent:
           {
             msg.MakeNoteOnMsg(event.noteOn.pitch, event.noteOn.velocity * 127, event.sampleOffset, event.noteOn.channel);
-            ProcessMidiMsg(msg);
+            DeliverMidiMsg(msg);
             processorQueue.Push(msg);
             break;
           }
@@ -90,14 +102,14 @@ void IPlugVST3ProcessorBase::ProcessMidiIn(IEventList* eventList, IPlugQueue<IMi
           case Event::kNoteOffEvent:
           {
             msg.MakeNoteOffMsg(event.noteOff.pitch, event.sampleOffset, event.noteOff.channel);
-            ProcessMidiMsg(msg);
+            DeliverMidiMsg(msg);
             processorQueue.Push(msg);
             break;
           }
           case Event::kPolyPressureEvent:
           {
             msg.MakePolyATMsg(event.polyPressure.pitch, event.polyPressure.pressure * 127., event.sampleOffset, event.polyPressure.channel);
-            ProcessMidiMsg(msg);
+            DeliverMidiMsg(msg);
             processorQueue.Push(msg);
             break;
           }
@@ -119,87 +131,106 @@ void IPlugVST3ProcessorBase::ProcessMidiIn(IEventList* eventList, IPlugQueue<IMi
   }
 }
 
-void IPlugVST3ProcessorBase::ProcessMidiOut(IPlugQueue<SysExData>& sysExQueue, SysExData& sysExBuf, IEventList* outputEvents, int32 numSamples)
+void IPlugVST3ProcessorBase::ProcessMidiOut(IPlugMessageRing& sysExRing, IEventList* outputEvents, int32 numSamples)
 {
-  // MIDI
-  if (!mMidiOutputQueue.Empty() && outputEvents)
+  // MIDI, the block's messages in order, translated in one pass
+  if (outputEvents)
   {
     Event toAdd = {0};
-    IMidiMsg msg;
-    
+
     while (!mMidiOutputQueue.Empty())
     {
-      IMidiMsg& msg = mMidiOutputQueue.Peek();
-      
-      if (msg.StatusMsg() == IMidiMsg::kNoteOn)
-      {
-        toAdd.type = Event::kNoteOnEvent;
-        toAdd.noteOn.channel = msg.Channel();
-        toAdd.noteOn.pitch = msg.NoteNumber();
-        toAdd.noteOn.tuning = 0.;
-        toAdd.noteOn.velocity = (float) msg.Velocity() * (1.f / 127.f);
-        toAdd.noteOn.length = -1;
-        toAdd.noteOn.noteId = -1; // TODO ?
-        toAdd.sampleOffset = msg.mOffset;
-        outputEvents->addEvent(toAdd);
-      }
-      else if (msg.StatusMsg() == IMidiMsg::kNoteOff)
-      {
-        toAdd.type = Event::kNoteOffEvent;
-        toAdd.noteOff.channel = msg.Channel();
-        toAdd.noteOff.pitch = msg.NoteNumber();
-        toAdd.noteOff.velocity = (float) msg.Velocity() * (1.f / 127.f);
-        toAdd.noteOff.noteId = -1; // TODO ?
-        toAdd.sampleOffset = msg.mOffset;
-        outputEvents->addEvent(toAdd);
-      }
-      else if (msg.StatusMsg() == IMidiMsg::kPolyAftertouch)
-      {
-        toAdd.type = Event::kPolyPressureEvent;
-        toAdd.polyPressure.channel = msg.Channel();
-        toAdd.polyPressure.pitch = msg.NoteNumber();
-        toAdd.polyPressure.pressure = (float) msg.PolyAfterTouch() * (1.f / 127.f);
-        toAdd.polyPressure.noteId = -1; // TODO ?
-        toAdd.sampleOffset = msg.mOffset;
-        outputEvents->addEvent(toAdd);
-      }
-      else if (msg.StatusMsg() == IMidiMsg::kControlChange)
-      {
-        toAdd.type = Event::kLegacyMIDICCOutEvent;
-        toAdd.midiCCOut.channel = msg.Channel();
-        toAdd.midiCCOut.controlNumber = msg.mData1;
-        toAdd.midiCCOut.value = msg.mData2;
-        toAdd.midiCCOut.value2 = 0;
-      }
-      else if (msg.StatusMsg() == IMidiMsg::kPitchWheel)
+      const IMidiMsg& msg = mMidiOutputQueue.Peek();
+
+      if (msg.mOffset >= numSamples) // belongs to a later block, see Flush() below
+        break;
+
+      toAdd.sampleOffset = std::max(msg.mOffset, 0);
+
+      switch (msg.StatusMsg())
       {
-        toAdd.type = Event::kLegacyMIDICCOutEvent;
-        toAdd.midiCCOut.channel = msg.Channel();
-        toAdd.midiCCOut.value = msg.mData1;
-        toAdd.midiCCOut.value = msg.mData2;
+        case IMidiMsg::kNoteOn:
+          toAdd.type = Event::kNoteOnEvent;
+          toAdd.noteOn.channel = msg.Channel();
+          toAdd.noteOn.pitch = msg.NoteNumber();
+          toAdd.noteOn.tuning = 0.;
+          toAdd.noteOn.velocity = (float) msg.Velocity() * (1.f / 127.f);
+          toAdd.noteOn.length = -1;
+          toAdd.noteOn.noteId = -1; // TODO ?
+          outputEvents->addEvent(toAdd);
+          break;
+        case IMidiMsg::kNoteOff:
+          toAdd.type = Event::kNoteOffEvent;
+          toAdd.noteOff.channel = msg.Channel();
+          toAdd.noteOff.pitch = msg.NoteNumber();
+          toAdd.noteOff.velocity = (float) msg.Velocity() * (1.f / 127.f);
+          toAdd.noteOff.noteId = -1; // TODO ?
+          outputEvents->addEvent(toAdd);
+          break;
+        case IMidiMsg::kPolyAftertouch:
+          toAdd.type = Event::kPolyPressureEvent;
+          toAdd.polyPressure.channel = msg.Channel();
+          toAdd.polyPressure.pitch = msg.NoteNumber();
+          toAdd.polyPressure.pressure = (float) msg.PolyAfterTouch() * (1.f / 127.f);
+          toAdd.polyPressure.noteId = -1; // TODO ?
+          outputEvents->addEvent(toAdd);
+          break;
+        case IMidiMsg::kControlChange:
+        case IMidiMsg::kChannelAftertouch:
+        case IMidiMsg::kProgramChange:
+        case IMidiMsg::kPitchWheel:
+          toAdd.type = Event::kLegacyMIDICCOutEvent;
+          toAdd.midiCCOut.channel = msg.Channel();
+          toAdd.midiCCOut.value = msg.mData1;
+          toAdd.midiCCOut.value2 = 0;
+
+          if (msg.StatusMsg() == IMidiMsg::kControlChange)
+          {
+            toAdd.midiCCOut.controlNumber = msg.mData1;
+            toAdd.midiCCOut.value = msg.mData2;
+          }
+          else if (msg.StatusMsg() == IMidiMsg::kChannelAftertouch)
+            toAdd.midiCCOut.controlNumber = kAfterTouch;
+          else if (msg.StatusMsg() == IMidiMsg::kProgramChange)
+            toAdd.midiCCOut.controlNumber = kCtrlProgramChange;
+          else
+          {
+            toAdd.midiCCOut.controlNumber = kPitchBend;
+            toAdd.midiCCOut.value2 = msg.mData2;
+          }
+
+          outputEvents->addEvent(toAdd);
+          break;
+        default:
+          break;
       }
-      
+
       mMidiOutputQueue.Remove();
-      // don't add any midi messages other than noteon/noteoff
     }
   }
   
   mMidiOutputQueue.Flush(numSamples);
   
   // Output SYSEX from the editor, which has bypassed the processors' ProcessSysEx()
-  if (sysExQueue.ElementsAvailable())
+  // The event points into the ring, so only one message is sent per block and it is released on the next one
+  if (mSysExOutputPending)
+  {
+    sysExRing.Release();
+    mSysExOutputPending = false;
+  }
+  
+  IPlugMessageRing::Record record;
+  
+  if (outputEvents && sysExRing.Peek(record))
   {
     Event toAdd = {0};
-    
-    while (sysExQueue.Pop(sysExBuf))
-    {
-      toAdd.type = Event::kDataEvent;
-      toAdd.sampleOffset = sysExBuf.mOffset;
-      toAdd.data.type = DataEvent::kMidiSysEx;
-      toAdd.data.size = sysExBuf.mSize;
-      toAdd.data.bytes = (uint8*) sysExBuf.mData; // TODO!  this is a problem if more than one message in this block!
-      outputEvents->addEvent(toAdd);
-    }
+    toAdd.type = Event::kDataEvent;
+    toAdd.sampleOffset = record.mTag;
+    toAdd.data.type = DataEvent::kMidiSysEx;
+    toAdd.data.size = record.mSize;
+    toAdd.data.bytes = record.mData;
+    outputEvents->addEvent(toAdd);
+    mSysExOutputPending = true;
   }
 }
 
@@ -208,6 +239,7 @@ void IPlugVST3ProcessorBase::SetBusArrangments(SpeakerArrangement* pInputBusArra
   // disconnect all io pins, they will be reconnected in process
   SetChannelConnections(ERoute::kInput, 0, MaxNChannels(ERoute::kInput), false);
   SetChannelConnections(ERoute::kOutput, 0, MaxNChannels(ERoute::kOutput), false);
+  mBusLayoutDirty = true;
   
   //TODO: setBusArrangements !!!
   //const int maxNInputChans = MaxNBuses(ERoute::kInput);
@@ -265,7 +297,8 @@ bool IPlugVST3ProcessorBase::SetupProcessing(const ProcessSetup& setup, ProcessS
   
   SetSampleRate(setup.sampleRate);
   IPlugProcessor::SetBlockSize(setup.maxSamplesPerBlock); // TODO: should IPlugVST3Processor call SetBlockSize in construct unlike other APIs?
-  mMidiOutputQueue.Resize(setup.maxSamplesPerBlock);
+  if (mMidiOutputQueue.GetCapacity() < setup.maxSamplesPerBlock)
+    mMidiOutputQueue.SetCapacity(setup.maxSamplesPerBlock);
   OnReset();
   
   return true;
@@ -283,10 +316,10 @@ bool IPlugVST3ProcessorBase::CanProcessSampleSize(int32 symbolicSampleSize)
 
 bool IsBusActive(const BusList& list, int32 idx)
 {
-  bool exists = false;
-  if (idx < static_cast<int32> (list.size()))
-    exists = static_cast<bool>(list.at(idx));
-  return exists;
+  if (idx < static_cast<int32> (list.size()) && list.at(idx))
+    return list.at(idx)->isActive();
+
+  return false;
 }
 
 void IPlugVST3ProcessorBase::PrepareProcessContext(ProcessData& data, ProcessSetup& setup)
@@ -320,8 +353,7 @@ void IPlugVST3ProcessorBase::ProcessParameterChanges(ProcessData& data)
   {
     int32 numParamsChanged = paramChanges->getParameterCount();
     
-    // it is possible to get a finer resolution of control here by retrieving more values (points) from the queue
-    // for now we just grab the last one
+    // unless sample accurate parameters are enabled, we just grab the last point in the queue
     
     for (int32 i = 0; i < numParamsChanged; i++)
     {
@@ -355,11 +387,28 @@ void IPlugVST3ProcessorBase::ProcessParameterChanges(ProcessData& data)
             {
               if (idx >= 0 && idx < mPlug.NParams())
               {
-                ENTER_PARAMS_MUTEX;
-                mPlug.GetParam(idx)->SetNormalized((double)value);
-                mPlug.SendParameterValueFromAPI(idx, (double) value, true);
-                mPlug.OnParamChange(idx, kHost, offsetSamples);
-                LEAVE_PARAMS_MUTEX;
+                if (GetSampleAccurateParams())
+                {
+                  // queue every point, they will be applied by IPlugProcessor as ProcessBlock() is split into sub-blocks
+                  for (int32 pointIdx = 0; pointIdx < numPoints; pointIdx++)
+                  {
+                    int32 pointOffset;
+                    double pointValue;
+                    
+                    if (paramQueue->getPoint(pointIdx, pointOffset, pointValue) == kResultTrue)
+                      AddParamEvent(IParamEvent { pointOffset, idx, pointValue, true });
+                  }
+                  
+                  mPlug.SendParameterValueFromAPI(idx, (double) value, true);
+                }
+                else
+                {
+                  ENTER_PARAMS_MUTEX;
+                  mPlug.GetParam(idx)->SetNormalized((double)value);
+                  mPlug.SendParameterValueFromAPI(idx, (double) value, true);
+                  mPlug.OnParamChange(idx, kHost, offsetSamples);
+                  LEAVE_PARAMS_MUTEX;
+                }
               }
             }
               break;
@@ -370,51 +419,96 @@ void IPlugVST3ProcessorBase::ProcessParameterChanges(ProcessData& data)
   }
 }
 
+void IPlugVST3ProcessorBase::ProcessParamEvent(const IParamEvent& event)
+{
+  // no params mutex here: parameter values are atomic, and every event in the list is applied on the audio thread
+  if (event.mNormalized)
+    mPlug.GetParam(event.mParamIdx)->SetNormalized(event.mValue);
+  else
+    mPlug.GetParam(event.mParamIdx)->Set(event.mValue);
+  mPlug.OnParamChange(event.mParamIdx, kHost, event.mOffset);
+}
+
+bool IPlugVST3ProcessorBase::BusLayoutChanged(ProcessData& data, const BusList& ins, const BusList& outs)
+{
+  bool changed = mBusLayoutDirty;
+
+  auto update = [&changed](int* pLayout, int nBuses, int nHostBuses, AudioBusBuffers* pBuffers, const BusList& list) {
+    for (int busIdx = 0; busIdx < nBuses; busIdx++)
+    {
+      // main buses are connected whenever the host provides them, other buses also need to be activated
+      const bool active = busIdx < nHostBuses && (busIdx == 0 || IsBusActive(list, busIdx));
+      const int nChans = active ? pBuffers[busIdx].numChannels : 0;
+      changed |= pLayout[busIdx] != nChans;
+      pLayout[busIdx] = nChans;
+    }
+  };
+
+  update(mBusLayout[ERoute::kInput].Get(), mBusLayout[ERoute::kInput].GetSize(), data.numInputs, data.inputs, ins);
+  update(mBusLayout[ERoute::kOutput].Get(), mBusLayout[ERoute::kOutput].GetSize(), data.numOutputs, data.outputs, outs);
+
+  return changed;
+}
+
+void IPlugVST3ProcessorBase::UpdateBusConnections(ProcessData& data, const BusList& ins, const BusList& outs)
+{
+  for (int dir = 0; dir < 2; dir++)
+  {
+    const ERoute direction = (ERoute) dir;
+    const int* pLayout = mBusLayout[dir].Get();
+
+    SetChannelConnections(direction, 0, MaxNChannels(direction), false);
+
+    for (int busIdx = 0; busIdx < mBusLayout[dir].GetSize(); busIdx++)
+      SetChannelConnections(direction, GetBusChannelOffset(direction, busIdx), std::min(pLayout[busIdx], NChannelsOnBus(direction, busIdx)), true);
+  }
+
+  // disconnected channels now read from the scratch buffers, which may hold stale audio
+  ZeroScratchBuffers();
+  mBusLayoutDirty = false;
+}
+
+bool IPlugVST3ProcessorBase::InputsFlaggedSilent(const ProcessData& data) const
+{
+  bool anyConnected = false;
+  
+  for (int inBus = 0; inBus < data.numInputs && inBus < mBusLayout[ERoute::kInput].GetSize(); inBus++)
+  {
+    const int busChannels = data.inputs[inBus].numChannels;
+    
+    if (mBusLayout[ERoute::kInput].Get()[inBus] <= 0 || busChannels <= 0)
+      continue;
+    
+    const uint64 allChannels = AllChannelsMask(busChannels);
+    
+    if ((data.inputs[inBus].silenceFlags & allChannels) != allChannels)
+      return false;
+    
+    anyConnected = true;
+  }
+  
+  return anyConnected;
+}
+
 void IPlugVST3ProcessorBase::ProcessAudio(ProcessData& data, ProcessSetup& setup, const BusList& ins, const BusList& outs)
 {
   int32 sampleSize = setup.symbolicSampleSize;
   
   if (sampleSize == kSample32 || sampleSize == kSample64)
   {
-    if (data.numInputs)
+    if (BusLayoutChanged(data, ins, outs))
+      UpdateBusConnections(data, ins, outs);
+
+    for (int inBus = 0; inBus < data.numInputs && inBus < mBusLayout[ERoute::kInput].GetSize(); inBus++)
     {
-      if (HasSidechainInput())
-      {
-        if (IsBusActive(ins, 1)) // Sidechain is active
-        {
-          mSidechainActive = true;
-          SetChannelConnections(ERoute::kInput, 0, MaxNChannels(ERoute::kInput), true);
-        }
-        else
-        {
-          if (mSidechainActive)
-          {
-            ZeroScratchBuffers();
-            mSidechainActive = false;
-          }
-          
-          SetChannelConnections(ERoute::kInput, 0, MaxNChannels(ERoute::kInput), true);
-          SetChannelConnections(ERoute::kInput, data.inputs[0].numChannels, MaxNChannels(ERoute::kInput) - NSidechainChannels(), false);
-        }
-        
-        AttachBuffers(ERoute::kInput, 0, MaxNChannels(ERoute::kInput) - NSidechainChannels(), data.inputs[0], data.numSamples, sampleSize);
-        AttachBuffers(ERoute::kInput, NSidechainChannels(), MaxNChannels(ERoute::kInput) - NSidechainChannels(), data.inputs[1], data.numSamples, sampleSize);
-      }
-      else
-      {
-        SetChannelConnections(ERoute::kInput, 0, data.inputs[0].numChannels, true);
-        SetChannelConnections(ERoute::kInput, data.inputs[0].numChannels, MaxNChannels(ERoute::kInput) - data.inputs[0].numChannels, false);
-        AttachBuffers(ERoute::kInput, 0, MaxNChannels(ERoute::kInput), data.inputs[0], data.numSamples, sampleSize);
-      }
+      if (mBusLayout[ERoute::kInput].Get()[inBus] > 0)
+        AttachBuffers(ERoute::kInput, GetBusChannelOffset(ERoute::kInput, inBus), NChannelsOnBus(ERoute::kInput, inBus), data.inputs[inBus], data.numSamples, sampleSize);
     }
-    
-    for (int outBus = 0, chanOffset = 0; outBus < data.numOutputs; outBus++)
+
+    for (int outBus = 0; outBus < data.numOutputs && outBus < mBusLayout[ERoute::kOutput].GetSize(); outBus++)
     {
-      int busChannels = data.outputs[outBus].numChannels;
-      SetChannelConnections(ERoute::kOutput, chanOffset, busChannels, IsBusActive(outs, outBus));
-      SetChannelConnections(ERoute::kOutput, chanOffset + busChannels, MaxNChannels(ERoute::kOutput) - (chanOffset + busChannels), false);
-      AttachBuffers(ERoute::kOutput, chanOffset, busChannels, data.outputs[outBus], data.numSamples, sampleSize);
-      chanOffset += busChannels;
+      if (mBusLayout[ERoute::kOutput].Get()[outBus] > 0)
+        AttachBuffers(ERoute::kOutput, GetBusChannelOffset(ERoute::kOutput, outBus), NChannelsOnBus(ERoute::kOutput, outBus), data.outputs[outBus], data.numSamples, sampleSize);
     }
     
     if (GetBypassed())
@@ -426,15 +520,23 @@ void IPlugVST3ProcessorBase::ProcessAudio(ProcessData& data, ProcessSetup& setup
     }
     else
     {
+      mPlug.ProcessBlockStartTasks();
+      SetInputsFlaggedSilent(InputsFlaggedSilent(data));
+      
       if (sampleSize == kSample32)
         ProcessBuffers(0.f, data.numSamples); // single precision
       else
         ProcessBuffers(0.0, data.numSamples); // double precision
     }
+
+    for (int outBus = 0; outBus < data.numOutputs; outBus++)
+    {
+      data.outputs[outBus].silenceFlags = GetOutputsSilent() ? AllChannelsMask(data.outputs[outBus].numChannels) : 0;
+    }
   }
 }
 
-void IPlugVST3ProcessorBase::Process(ProcessData& data, ProcessSetup& setup, const BusList& ins, const BusList& outs, IPlugQueue<IMidiMsg>& fromEditor, IPlugQueue<IMidiMsg>& fromProcessor, IPlugQueue<SysExData>& sysExFromEditor, SysExData& sysExBuf)
+void IPlugVST3ProcessorBase::Process(ProcessData& data, ProcessSetup& setup, const BusList& ins, const BusList& outs, IPlugQueue<IMidiMsg>& fromEditor, IPlugQueue<IMidiMsg>& fromProcessor, IPlugMessageRing& sysExFromEditor)
 {
   PrepareProcessContext(data, setup);
   ProcessParameterChanges(data);
@@ -448,7 +550,7 @@ void IPlugVST3ProcessorBase::Process(ProcessData& data, ProcessSetup& setup, con
   
   if (DoesMIDIOut())
   {
-    ProcessMidiOut(sysExFromEditor, sysExBuf, data.outputEvents, data.numSamples);
+    ProcessMidiOut(sysExFromEditor, data.outputEvents, data.numSamples);
   }
 }
 
@@ -457,3 +559,13 @@ bool IPlugVST3ProcessorBase::SendMidiMsg(const IMidiMsg& msg)
   mMidiOutputQueue.Add(msg);
   return true;
 }
+
+bool IPlugVST3ProcessorBase::SendMidiMsgs(WDL_TypedBuf<IMidiMsg>& msgs)
+{
+  const IMidiMsg* pMsgs = msgs.Get();
+
+  for (int i = 0; i < msgs.GetSize(); i++)
+    mMidiOutputQueue.Add(pMsgs[i]);
+
+  return true;
+}
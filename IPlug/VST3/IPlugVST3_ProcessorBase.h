@@ -72,7 +72,7 @@ public:
   
   // MIDI Processing
   void ProcessMidiIn(Vst::IEventList* eventList, IPlugQueue<IMidiMsg>& editorQueue, IPlugQueue<IMidiMsg>& processorQueue);
-  void ProcessMidiOut(IPlugQueue<SysExData>& sysExQueue, SysExData& sysExBuf, Vst::IEventList* outputEvents, int32 numSamples);
+  void ProcessMidiOut(IPlugMessageRing& sysExRing, Vst::IEventList* outputEvents, int32 numSamples);
   
   // Audio Processing Setup
   void SetBusArrangments(Vst::SpeakerArrangement* pInputBusArrangements, int32 numInBuses, Vst::SpeakerArrangement* pOutputBusArrangements, int32 numOutBuses);
@@ -83,15 +83,30 @@ public:
   // Audio Processing
   void PrepareProcessContext(Vst::ProcessData& data, Vst::ProcessSetup& setup);
   void ProcessParameterChanges(Vst::ProcessData& data);
+  bool BusLayoutChanged(Vst::ProcessData& data, const Vst::BusList& ins, const Vst::BusList& outs);
+  void UpdateBusConnections(Vst::ProcessData& data, const Vst::BusList& ins, const Vst::BusList& outs);
   void ProcessAudio(Vst::ProcessData& data, Vst::ProcessSetup& setup, const Vst::BusList& ins, const Vst::BusList& outs);
-  void Process(Vst::ProcessData& data, Vst::ProcessSetup& setup, const Vst::BusList& ins, const Vst::BusList& outs, IPlugQueue<IMidiMsg>& fromEditor, IPlugQueue<IMidiMsg>& fromProcessor, IPlugQueue<SysExData>& sysExFromEditor, SysExData& sysExBuf);
+  void Process(Vst::ProcessData& data, Vst::ProcessSetup& setup, const Vst::BusList& ins, const Vst::BusList& outs, IPlugQueue<IMidiMsg>& fromEditor, IPlugQueue<IMidiMsg>& fromProcessor, IPlugMessageRing& sysExFromEditor);
   
   // IPlugProcessor overrides
   bool SendMidiMsg(const IMidiMsg& msg) override;
+  bool SendMidiMsgs(WDL_TypedBuf<IMidiMsg>& msgs) override;
+  void ProcessParamEvent(const IParamEvent& event) override;
+  void ProcessParamRamps(int startIdx, int nFrames) override { RenderParamRamps(mPlug, startIdx, nFrames); }
+  void AllocateParamRamps() override { CreateParamRamps(mPlug); }
 
 private:
+  /** @return A silenceFlags bitmask with a bit set for each of nChannels channels */
+  static uint64 AllChannelsMask(int nChannels) { return nChannels < 64 ? ((uint64) 1 << nChannels) - 1 : ~((uint64) 0); }
+  
+  /** @return \c true if the host has flagged every channel of every connected input bus as silent */
+  bool InputsFlaggedSilent(const Vst::ProcessData& data) const;
+  
   IPlugAPIBase& mPlug;
   Vst::ProcessContext mProcessContext;
-  IMidiQueue mMidiOutputQueue;
-  bool mSidechainActive = false;
+  IMidiEventBuffer mMidiOutputQueue; // preallocated, and sorted by offset when it is sent, see ProcessMidiOut()
+  bool mSysExOutputPending = false; // the host reads sysex output in place, so the last record sent is only released on the next block
+  /** The host channel count of each bus at the last call to process, 0 if inactive */
+  WDL_TypedBuf<int> mBusLayout[2];
+  bool mBusLayoutDirty = true;
 };
@@ -11,9 +11,130 @@
 #pragma once
 #include "pluginterfaces/gui/iplugviewcontentscalesupport.h"
 
+#ifdef OS_LINUX
+#include <map>
+#include <memory>
+
+#include "IPlugRunLoop.h"
+#endif
+
 using namespace Steinberg;
 using namespace Vst;
 
+#ifdef OS_LINUX
+/** The host's Steinberg::Linux::IRunLoop, which a Linux host provides through the IPlugFrame, behind the IPlugRunLoop interface that the editor uses */
+class IPlugVST3RunLoop : public IPlugRunLoop
+{
+public:
+  IPlugVST3RunLoop(Linux::IRunLoop* pRunLoop)
+  : mRunLoop(pRunLoop)
+  {}
+  
+  ~IPlugVST3RunLoop()
+  {
+    StopTimer();
+    
+    for (auto& handler : mFDHandlers)
+      mRunLoop->unregisterEventHandler(handler.second);
+  }
+  
+  bool AddFD(int fd, IRunLoopFunction func) override
+  {
+    RemoveFD(fd);
+    
+    // a handler is registered for each file descriptor, since a handler can only be unregistered from all of its file descriptors at once
+    IPtr<FDHandler> handler = owned(new FDHandler(func));
+    
+    if (mRunLoop->registerEventHandler(handler, fd) != kResultOk)
+      return false;
+    
+    mFDHandlers[fd] = handler;
+    return true;
+  }
+  
+  void RemoveFD(int fd) override
+  {
+    auto it = mFDHandlers.find(fd);
+    
+    if (it != mFDHandlers.end())
+    {
+      mRunLoop->unregisterEventHandler(it->second);
+      mFDHandlers.erase(it);
+    }
+  }
+  
+  bool StartTimer(uint32_t intervalMs, IRunLoopFunction func) override
+  {
+    if (mTimerHandler && mTimerIntervalMs == intervalMs)
+    {
+      mTimerHandler->mFunc = func;
+      return true;
+    }
+    
+    // a timer's interval is fixed, so replace it
+    StopTimer();
+    IPtr<TimerHandler> handler = owned(new TimerHandler(func));
+    
+    if (mRunLoop->registerTimer(handler, intervalMs) != kResultOk)
+      return false;
+    
+    mTimerHandler = handler;
+    mTimerIntervalMs = intervalMs;
+    return true;
+  }
+  
+  void StopTimer() override
+  {
+    if (mTimerHandler)
+    {
+      mRunLoop->unregisterTimer(mTimerHandler);
+      mTimerHandler = nullptr;
+    }
+  }
+  
+private:
+  class FDHandler : public FObject
+                  , public Linux::IEventHandler
+  {
+  public:
+    FDHandler(IRunLoopFunction func) : mFunc(func) {}
+    
+    void PLUGIN_API onFDIsSet(Linux::FileDescriptor fd) override { mFunc(); }
+    
+    OBJ_METHODS(FDHandler, FObject)
+    DEFINE_INTERFACES
+      DEF_INTERFACE(Linux::IEventHandler)
+    END_DEFINE_INTERFACES(FObject)
+    REFCOUNT_METHODS(FObject)
+    
+  private:
+    IRunLoopFunction mFunc;
+  };
+  
+  class TimerHandler : public FObject
+                     , public Linux::ITimerHandler
+  {
+  public:
+    TimerHandler(IRunLoopFunction func) : mFunc(func) {}
+    
+    void PLUGIN_API onTimer() override { mFunc(); }
+    
+    OBJ_METHODS(TimerHandler, FObject)
+    DEFINE_INTERFACES
+      DEF_INTERFACE(Linux::ITimerHandler)
+    END_DEFINE_INTERFACES(FObject)
+    REFCOUNT_METHODS(FObject)
+    
+    IRunLoopFunction mFunc;
+  };
+  
+  IPtr<Linux::IRunLoop> mRunLoop;
+  std::map<int, IPtr<FDHandler>> mFDHandlers;
+  IPtr<TimerHandler> mTimerHandler;
+  uint32_t mTimerIntervalMs = 0;
+};
+#endif
+
 /** IPlug VST3 View  */
 template <class T>
 class IPlugVST3View : public CPluginView
@@ -43,6 +164,9 @@ public:
 #elif defined OS_MAC
       if (strcmp (type, kPlatformTypeNSView) == 0)
         return kResultTrue;
+#elif defined OS_LINUX
+      if (strcmp(type, kPlatformTypeX11EmbedWindowID) == 0)
+        return kResultTrue;
 #endif
     }
     
@@ -88,6 +212,20 @@ public:
         pView = mOwner.OpenWindow(pParent);
       else // Carbon
         return kResultFalse;
+#elif defined OS_LINUX
+      if (strcmp(type, kPlatformTypeX11EmbedWindowID) == 0)
+      {
+        // the editor is driven from the host's UI thread by its run loop
+        FUnknownPtr<Linux::IRunLoop> runLoop(plugFrame);
+        
+        if (runLoop)
+        {
+          mRunLoop.reset(new IPlugVST3RunLoop(runLoop));
+          mOwner.SetHostRunLoop(mRunLoop.get());
+        }
+        
+        pView = mOwner.OpenWindow(pParent);
+      }
 #endif
       if (pView)
         mOwner.OnUIOpen();
@@ -103,6 +241,11 @@ public:
     if (mOwner.HasUI())
       mOwner.CloseWindow();
     
+#ifdef OS_LINUX
+    mOwner.SetHostRunLoop(nullptr);
+    mRunLoop = nullptr;
+#endif
+    
     return CPluginView::removed();
   }
 
@@ -129,4 +272,7 @@ public:
   }
 
   T& mOwner;
+#ifdef OS_LINUX
+  std::unique_ptr<IPlugVST3RunLoop> mRunLoop;
+#endif
 };
@@ -9,6 +9,7 @@
 */
 
 #include "IPlugWAM.h"
+#include <emscripten.h>
 
 IPlugWAM::IPlugWAM(IPlugInstanceInfo instanceInfo, IPlugConfig c)
   : IPlugAPIBase(c, kAPIWAM)
@@ -18,6 +19,19 @@ IPlugWAM::IPlugWAM(IPlugInstanceInfo instanceInfo, IPlugConfig c)
 
   SetChannelConnections(ERoute::kInput, 0, nInputs, true);
   SetChannelConnections(ERoute::kOutput, 0, nOutputs, true);
+
+  mTransportBatch.Resize(WEB_TRANSPORT_BATCH_SIZE);
+  mUIBatch.Resize(WEB_TRANSPORT_BATCH_SIZE); // IPlugWeb doesn't send larger batches
+
+  if (instanceInfo.mAccumulateBlockSize > 0)
+  {
+    int blockSize = 1;
+
+    while (blockSize < instanceInfo.mAccumulateBlockSize)
+      blockSize <<= 1;
+
+    mAccumulateBlockSize = blockSize;
+  }
 }
 
 const char* IPlugWAM::init(uint32_t bufsize, uint32_t sr, void* pDesc)
@@ -25,13 +39,42 @@ const char* IPlugWAM::init(uint32_t bufsize, uint32_t sr, void* pDesc)
   DBGMSG("init\n");
 
   SetSampleRate(sr);
-  SetBlockSize(bufsize);
+  mQuantumSize = bufsize;
+
+  // the quantum has to divide the accumulation block, which is always true for the AudioWorklet's 128 frames
+  if (mAccumulateBlockSize && (mAccumulateBlockSize < (int) bufsize || mAccumulateBlockSize % bufsize))
+  {
+    DBGMSG("IPlugWAM: can't accumulate blocks of %i from render quanta of %i, processing each quantum\n", mAccumulateBlockSize, bufsize);
+    mAccumulateBlockSize = 0;
+  }
+
+  if (mAccumulateBlockSize)
+  {
+    const int nInputs = MaxNChannels(ERoute::kInput), nOutputs = MaxNChannels(ERoute::kOutput);
+
+    mAccumulateData.Resize((nInputs + nOutputs) * mAccumulateBlockSize);
+    memset(mAccumulateData.Get(), 0, mAccumulateData.GetSize() * sizeof(float));
+    mAccumulateInputs.Resize(nInputs);
+    mAccumulateOutputs.Resize(nOutputs);
+
+    for (int c = 0; c < nInputs; c++)
+      mAccumulateInputs.Get()[c] = mAccumulateData.Get() + c * mAccumulateBlockSize;
+
+    for (int c = 0; c < nOutputs; c++)
+      mAccumulateOutputs.Get()[c] = mAccumulateData.Get() + (nInputs + c) * mAccumulateBlockSize;
+
+    mAccumulatePos = 0;
+    SetBlockSize(mAccumulateBlockSize);
+  }
+  else
+    SetBlockSize(bufsize);
 
   DBGMSG("%i %i\n", sr, bufsize);
 
   WDL_String json;
   json.Set("{\n");
   json.AppendFormatted(8192, "\"audio\": { \"inputs\": [{ \"id\":0, \"channels\":%i }], \"outputs\": [{ \"id\":0, \"channels\":%i }] },\n", MaxNChannels(ERoute::kInput), MaxNChannels(ERoute::kOutput));
+  json.AppendFormatted(8192, "\"latency\": %i,\n", GetHostLatency());
   json.AppendFormatted(8192, "\"parameters\": [\n");
 
   for (int idx = 0; idx < NParams(); idx++)
@@ -55,23 +98,27 @@ const char* IPlugWAM::init(uint32_t bufsize, uint32_t sr, void* pDesc)
 
 void IPlugWAM::onProcess(WAM::AudioBus* pAudio, void* pData)
 {
-  const int blockSize = GetBlockSize();
-  
   SetChannelConnections(ERoute::kInput, 0, MaxNChannels(ERoute::kInput), !IsInstrument()); //TODO: go elsewhere
   SetChannelConnections(ERoute::kOutput, 0, MaxNChannels(ERoute::kOutput), true); //TODO: go elsewhere
-  AttachBuffers(ERoute::kInput, 0, NChannelsConnected(ERoute::kInput), pAudio->inputs, blockSize);
-  AttachBuffers(ERoute::kOutput, 0, NChannelsConnected(ERoute::kOutput), pAudio->outputs, blockSize);
-  ProcessBuffers((float) 0.0f, blockSize);
+
+  if (mAccumulateBlockSize)
+    AccumulateAndProcess(pAudio, mQuantumSize);
+  else
+  {
+    const int blockSize = GetHostBlockSize();
+
+    AttachBuffers(ERoute::kInput, 0, NChannelsConnected(ERoute::kInput), pAudio->inputs, blockSize);
+    AttachBuffers(ERoute::kOutput, 0, NChannelsConnected(ERoute::kOutput), pAudio->outputs, blockSize);
+    ProcessBlockStartTasks();
+    ProcessBuffers((float) 0.0f, blockSize);
+  }
   
   //emulate IPlugAPIBase::OnTimer - should be called on the main thread - how to do that in audio worklet processor?
   if(mBlockCounter == 0)
   {
-    while(mParamChangeFromProcessor.ElementsAvailable())
-    {
-      IParamChange p;
-      mParamChangeFromProcessor.Pop(p);
-      SendParameterValueFromDelegate(p.paramIdx, p.value, p.normalized);
-    }
+    ProcessPresetRequests();
+    ProcessJobCompletions();
+    SendParameterValuesFromProcessor();
     
     while (mMidiMsgsFromProcessor.ElementsAvailable())
     {
@@ -88,6 +135,29 @@ void IPlugWAM::onProcess(WAM::AudioBus* pAudio, void* pData)
   mBlockCounter--;
 }
 
+void IPlugWAM::AccumulateAndProcess(WAM::AudioBus* pAudio, int nFrames)
+{
+  const int nInputs = NChannelsConnected(ERoute::kInput), nOutputs = NChannelsConnected(ERoute::kOutput);
+
+  for (int c = 0; c < nInputs; c++)
+    memcpy(mAccumulateInputs.Get()[c] + mAccumulatePos, pAudio->inputs[c], nFrames * sizeof(float));
+
+  // the outputs of the previous block
+  for (int c = 0; c < nOutputs; c++)
+    memcpy(pAudio->outputs[c], mAccumulateOutputs.Get()[c] + mAccumulatePos, nFrames * sizeof(float));
+
+  mAccumulatePos += nFrames;
+
+  if (mAccumulatePos < mAccumulateBlockSize)
+    return;
+
+  AttachBuffers(ERoute::kInput, 0, nInputs, mAccumulateInputs.Get(), mAccumulateBlockSize);
+  AttachBuffers(ERoute::kOutput, 0, nOutputs, mAccumulateOutputs.Get(), mAccumulateBlockSize);
+  ProcessBlockStartTasks();
+  ProcessBuffers((float) 0.0f, mAccumulateBlockSize);
+  mAccumulatePos = 0;
+}
+
 void IPlugWAM::onMessage(char* verb, char* res, double data)
 {
   if(strcmp(verb, "SMMFUI") == 0)
@@ -140,14 +210,7 @@ void IPlugWAM::onMidi(byte status, byte data1, byte data2)
 //   DBGMSG("onMidi\n");
   IMidiMsg msg = {0, status, data1, data2};
   ProcessMidiMsg(msg); // onMidi is not called on HPT. We could queue things up, but just process the message straightaway for now
-  //mMidiMsgsFromProcessor.Push(msg);
-  
-  WDL_String dataStr;
-  dataStr.SetFormatted(16, "%i:%i:%i", msg.mStatus, msg.mData1, msg.mData2);
-  
-  // TODO: in the future this will be done via shared array buffer
-  // if onMidi ever gets called on HPT, should defer via queue
-  postMessage("SMMFD", dataStr.Get(), "");
+  SendMidiMsgFromDelegate(msg); // echo to the UI
 }
 
 void IPlugWAM::onParam(uint32_t idparam, double value)
@@ -160,53 +223,112 @@ void IPlugWAM::onSysex(byte* pData, uint32_t size)
 {
   ISysEx sysex = {0 /* no offset */, pData, (int) size };
   ProcessSysEx(sysex);
-  
-  WDL_String dataStr;
-  dataStr.SetFormatted(16, "%i", size);
-  
-  // TODO: in the future this will be done via shared array buffer
-  // if onSysex ever gets called on HPT, should defer via queue
-  postMessage("SSMFD", dataStr.Get(), "");
+  SendSysexMsgFromDelegate(sysex); // echo to the UI
 }
 
-void IPlugWAM::SendControlValueFromDelegate(int controlTag, double normalizedValue)
+void IPlugWAM::ProcessUIBatch(int size)
 {
-  WDL_String propStr;
-  WDL_String dataStr;
+  IWebTransportRecord::ForEach(mUIBatch.Get(), size, [this](const IWebTransportRecord& record, const uint8_t* pRecordData) {
+    switch (record.mType)
+    {
+      case kWebTransportParamValue:
+      {
+        double value = 0.;
+        memcpy(&value, pRecordData, sizeof(double));
 
-  propStr.SetFormatted(16, "%i", controlTag);
-  dataStr.SetFormatted(16, "%f", normalizedValue);
+        if (record.mIdx >= 0 && record.mIdx < NParams())
+          SetParameterValue(record.mIdx, value);
+        break;
+      }
+      case kWebTransportMidiMsg:
+      {
+        IMidiMsg msg {0, pRecordData[0], pRecordData[1], pRecordData[2]};
+        ProcessMidiMsg(msg);
+        break;
+      }
+      case kWebTransportSysExMsg:
+      {
+        ISysEx sysex(0, pRecordData, record.mSize);
+        ProcessSysEx(sysex);
+        break;
+      }
+      case kWebTransportArbitraryMsg:
+        OnMessage(record.mTag, record.mIdx, record.mSize, pRecordData);
+        break;
+      default:
+        break;
+    }
+  });
+}
+
+void IPlugWAM::AddTransportRecord(int type, int idx, int tag, const void* pData, int dataSize)
+{
+  // if the processor script hasn't taken the batch because the UI has stalled, later updates are dropped rather than allocating
+  if (!IWebTransportRecord::Write(mTransportBatch.Get(), mTransportBatch.GetSize(), mTransportBatchSize, type, idx, tag, pData, dataSize))
+    DBGMSG("IPlugWAM: transport batch full, update dropped\n");
+}
 
-  // TODO: in the future this will be done via shared array buffer
-  postMessage("SCVFD", propStr.Get(), dataStr.Get());
+void IPlugWAM::SendControlValueFromDelegate(int controlTag, double normalizedValue)
+{
+  AddTransportRecord(kWebTransportControlValue, controlTag, 0, &normalizedValue, sizeof(double));
 }
 
 void IPlugWAM::SendControlMsgFromDelegate(int controlTag, int messageTag, int dataSize, const void* pData)
 {
-  WDL_String propStr;
-  propStr.SetFormatted(16, "%i:%i", controlTag, messageTag);
-  
-  // TODO: in the future this will be done via shared array buffer
-  postMessage("SCMFD", propStr.Get(), pData, (uint32_t) dataSize);
+  AddTransportRecord(kWebTransportControlMsg, controlTag, messageTag, pData, dataSize);
 }
 
 void IPlugWAM::SendParameterValueFromDelegate(int paramIdx, double value, bool normalized)
 {
-  WDL_String propStr;
-  WDL_String dataStr;
-  propStr.SetFormatted(16, "%i", paramIdx);
-  dataStr.SetFormatted(16, "%f", value);
+  if (!normalized)
+    value = GetParam(paramIdx)->ToNormalized(value);
 
-  // TODO: in the future this will be done via shared array buffer
-  postMessage("SPVFD", propStr.Get(), dataStr.Get());
+  AddTransportRecord(kWebTransportParamValue, paramIdx, 0, &value, sizeof(double));
 }
 
 void IPlugWAM::SendArbitraryMsgFromDelegate(int messageTag, int dataSize, const void* pData)
 {
-  WDL_String propStr;
-  propStr.SetFormatted(16, "%i", messageTag);
-  
-  // TODO: in the future this will be done via shared array buffer
-  postMessage("SAMFD", propStr.Get(), pData, (uint32_t) dataSize);
+  AddTransportRecord(kWebTransportArbitraryMsg, 0, messageTag, pData, dataSize);
 }
 
+void IPlugWAM::SendMidiMsgFromDelegate(const IMidiMsg& msg)
+{
+  const uint8_t data[3] = { msg.mStatus, msg.mData1, msg.mData2 };
+  AddTransportRecord(kWebTransportMidiMsg, 0, 0, data, 3);
+}
+
+void IPlugWAM::SendSysexMsgFromDelegate(const ISysEx& msg)
+{
+  AddTransportRecord(kWebTransportSysExMsg, 0, 0, msg.mData, msg.mSize);
+}
+
+extern "C"
+{
+  // called by the processor script (IPlugWAM-awp.js) after each render quantum, see IPlugWebTransport.h
+  EMSCRIPTEN_KEEPALIVE uintptr_t iplug_transportbatch(void* pProc)
+  {
+    return reinterpret_cast<uintptr_t>(static_cast<IPlugWAM*>(static_cast<Processor*>(pProc))->GetTransportBatch());
+  }
+
+  EMSCRIPTEN_KEEPALIVE int iplug_taketransportbatch(void* pProc)
+  {
+    return static_cast<IPlugWAM*>(static_cast<Processor*>(pProc))->TakeTransportBatch();
+  }
+
+  // called by the processor script when the controller posts a batch from the UI: copy it to the returned memory, then process it
+  EMSCRIPTEN_KEEPALIVE uintptr_t iplug_uibatch(void* pProc, int size)
+  {
+    return reinterpret_cast<uintptr_t>(static_cast<IPlugWAM*>(static_cast<Processor*>(pProc))->GetUIBatch(size));
+  }
+
+  EMSCRIPTEN_KEEPALIVE void iplug_processuibatch(void* pProc, int size)
+  {
+    static_cast<IPlugWAM*>(static_cast<Processor*>(pProc))->ProcessUIBatch(size);
+  }
+
+  // polled by the processor script after each render quantum, which posts changes to the controller
+  EMSCRIPTEN_KEEPALIVE int iplug_latency(void* pProc)
+  {
+    return static_cast<IPlugWAM*>(static_cast<Processor*>(pProc))->GetHostLatency();
+  }
+}
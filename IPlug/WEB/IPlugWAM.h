@@ -14,14 +14,20 @@
 #include "IPlugAPIBase.h"
 #include "IPlugProcessor.h"
 #include "processor.h"
+#include "IPlugWebTransport.h"
 
 using namespace WAM;
 
 /** Used to pass various instance info to the API class */
 struct IPlugInstanceInfo
-{};
+{
+  int mAccumulateBlockSize = 0; // WAM_BLOCK_SIZE, see IPlugWAM
+};
 
 /** WebAudioModule (WAM) API base class. This is used for the DSP processor side of a WAM, which is sandboxed and lives in the AudioWorkletGlobalScope
+ * By default ProcessBlock() is called once per render quantum (128 frames). If WAM_BLOCK_SIZE is defined in config.h, quanta are collected into
+ * blocks of that many frames (rounded up to a power of two) so that FFT or oversampling stages run less often, at the cost of one block of latency.
+ * The extra latency is added to the plug-in's own latency and reported to the host page, see GetHostLatency()
  * @ingroup APIClasses */
 class IPlugWAM : public IPlugAPIBase
                , public IPlugProcessor<float>
@@ -44,18 +50,58 @@ public:
   virtual void onParam(uint32_t idparam, double value) override;
 
   //IPlugProcessor
-  void SetLatency(int samples) override {};
+  void SetLatency(int samples) override { IPlugProcessor<float>::SetLatency(samples); }
   bool SendMidiMsg(const IMidiMsg& msg) override { return false; }
   bool SendSysEx(const ISysEx& msg) override { return false; }
+  void ProcessParamRamps(int startIdx, int nFrames) override { RenderParamRamps(*this, startIdx, nFrames); }
+  void AllocateParamRamps() override { CreateParamRamps(*this); }
   
   //IEditorDelegate - these are overwritten because we need to use WAM messaging system
   void SendControlValueFromDelegate(int controlTag, double normalizedValue) override;
   void SendControlMsgFromDelegate(int controlTag, int messageTag, int dataSize, const void* pData) override;
   void SendParameterValueFromDelegate(int paramIdx, double value, bool normalized) override;
   void SendArbitraryMsgFromDelegate(int messageTag, int dataSize = 0, const void* pData = nullptr) override;
-  
+  void SendMidiMsgFromDelegate(const IMidiMsg& msg) override;
+  void SendSysexMsgFromDelegate(const ISysEx& msg) override;
+
+  //IPlugWAM
+  /** @return The batch of updates for the UI, see IPlugWebTransport.h. Called from the processor script after each render quantum */
+  const uint8_t* GetTransportBatch() const { return mTransportBatch.Get(); }
+
+  /** @return The size of the batch in bytes, and start a new batch. The data stays valid until the next call to Send*FromDelegate() */
+  int TakeTransportBatch() { const int size = mTransportBatchSize; mTransportBatchSize = 0; return size; }
+
+  /** @param size The size of a batch of updates from the UI, see IPlugWebTransport.h
+   * @return Where the processor script should copy it, or nullptr if it is too large */
+  uint8_t* GetUIBatch(int size) { return size <= mUIBatch.GetSize() ? mUIBatch.Get() : nullptr; }
+
+  /** Apply the updates in the batch the processor script copied to GetUIBatch(), in the order the UI sent them */
+  void ProcessUIBatch(int size);
+
+  /** @return The latency in samples that the host page should compensate for: the plug-in's latency plus any added by block accumulation.
+   * The processor script posts it to the controller whenever it changes */
+  int GetHostLatency() const { return GetLatency() + mAccumulateBlockSize; }
+
 private:
+  void AddTransportRecord(int type, int idx, int tag, const void* pData, int dataSize);
+
+  /** Collect a render quantum into the accumulation buffers, and process them when a whole block has been collected */
+  void AccumulateAndProcess(WAM::AudioBus* pAudio, int nFrames);
+
   int mBlockCounter = 0;
+  int mQuantumSize = 0;
+
+  // block accumulation, off if mAccumulateBlockSize is 0. Output lags input by one block
+  int mAccumulateBlockSize = 0;
+  int mAccumulatePos = 0;
+  WDL_TypedBuf<float> mAccumulateData;
+  WDL_TypedBuf<float*> mAccumulateInputs;
+  WDL_TypedBuf<float*> mAccumulateOutputs;
+
+  WDL_TypedBuf<uint8_t> mTransportBatch;
+  int mTransportBatchSize = 0;
+
+  WDL_TypedBuf<uint8_t> mUIBatch;
 };
 
 IPlugWAM* MakePlug();
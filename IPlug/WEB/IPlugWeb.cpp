@@ -9,6 +9,7 @@
 */
 
 #include "IPlugWeb.h"
+#include "IPlugWebTransport.h"
 #include <emscripten.h>
 #include <emscripten/bind.h>
 
@@ -29,6 +30,63 @@ IPlugWeb::IPlugWeb(IPlugInstanceInfo instanceInfo, IPlugConfig config)
   mSAMFUIBuf.Resize(kNumSAMFUIBytes); memcpy(mSAMFUIBuf.GetData(), "SAMFUI", kNumMsgHeaderBytes);
 
   mWAMCtrlrJSObjectName.SetFormatted(32, "%s_WAM", GetPluginName());
+
+  mUIBatch.Resize(WEB_TRANSPORT_BATCH_SIZE);
+  mUIBatchParamPos.Resize(NParams());
+
+  for (int i = 0; i < NParams(); i++)
+    mUIBatchParamPos.Get()[i] = -1;
+}
+
+int IPlugWeb::AddUIRecord(int type, int idx, int tag, const void* pData, int dataSize)
+{
+  if (IWebTransportRecord::RecordSize(dataSize) > mUIBatch.GetSize() - mUIBatchSize)
+    FlushUIBatch();
+
+  const int pos = mUIBatchSize;
+
+  if (!IWebTransportRecord::Write(mUIBatch.Get(), mUIBatch.GetSize(), mUIBatchSize, type, idx, tag, pData, dataSize))
+  {
+    DBGMSG("IPlugWeb: message too large for the UI batch, dropped\n");
+    return -1;
+  }
+
+  if (!mUIBatchScheduled)
+  {
+    mUIBatchScheduled = true;
+    emscripten_async_call(OnUIBatchTimer, this, -1); // -1: on the next requestAnimationFrame, falling back to a timeout where there is none
+  }
+
+  return pos;
+}
+
+//static
+void IPlugWeb::OnUIBatchTimer(void* pPlug)
+{
+  IPlugWeb* pWeb = static_cast<IPlugWeb*>(pPlug);
+  pWeb->mUIBatchScheduled = false;
+  pWeb->FlushUIBatch();
+}
+
+void IPlugWeb::FlushUIBatch()
+{
+  if (mUIBatchSize == 0)
+    return;
+
+  // the controller posts the copy to the processor as a transferable, a worker's proxy forwards it to the controller on the page
+  EM_ASM({
+    var wam = self[Module.UTF8ToString($0)];
+
+    if(wam)
+      wam.sendUIBatch(Module.HEAPU8.slice($1, $1 + $2).buffer);
+  }, mWAMCtrlrJSObjectName.Get(), (int) mUIBatch.Get(), mUIBatchSize);
+
+  IWebTransportRecord::ForEach(mUIBatch.Get(), mUIBatchSize, [this](const IWebTransportRecord& record, const uint8_t* pRecordData) {
+    if (record.mType == kWebTransportParamValue)
+      mUIBatchParamPos.Get()[record.mIdx] = -1;
+  });
+
+  mUIBatchSize = 0;
 }
 
 void IPlugWeb::SendParameterValueFromUI(int paramIdx, double value)
@@ -44,7 +102,13 @@ void IPlugWeb::SendParameterValueFromUI(int paramIdx, double value)
   }, (int) mSPVFUIBuf.GetData(), kNumSPVFUIBytes);
 
 #else
-  val::global(mWAMCtrlrJSObjectName.Get()).call<void>("setParam", paramIdx, value);
+  int* pPos = mUIBatchParamPos.Get() + paramIdx;
+
+  // a later value in the same frame replaces the one already batched
+  if (*pPos >= 0)
+    memcpy(mUIBatch.Get() + *pPos + sizeof(IWebTransportRecord), &value, sizeof(double));
+  else
+    *pPos = AddUIRecord(kWebTransportParamValue, paramIdx, 0, &value, sizeof(double));
 #endif
   IPlugAPIBase::SendParameterValueFromUI(paramIdx, value); // call super class in order to make sure OnParamChangeUI() gets triggered
 };
@@ -63,41 +127,23 @@ void IPlugWeb::SendMidiMsgFromUI(const IMidiMsg& msg)
   }, (int) mSMMFUIBuf.GetData(), kNumSMMFUIBytes);
 
 #else
-  WDL_String dataStr;
-  dataStr.SetFormatted(16, "%i:%i:%i", msg.mStatus, msg.mData1, msg.mData2);
-  val::global(mWAMCtrlrJSObjectName.Get()).call<void>("sendMessage", std::string("SMMFUI"), std::string(dataStr.Get()));
+  const uint8_t data[3] = { msg.mStatus, msg.mData1, msg.mData2 };
+  AddUIRecord(kWebTransportMidiMsg, 0, 0, data, 3);
 #endif
 }
 
 void IPlugWeb::SendSysexMsgFromUI(const ISysEx& msg)
 {
+#if WEBSOCKET_CLIENT
   DBGMSG("TODO: SendSysexMsgFromUI");
-
-//   EM_ASM({
-//     window[Module.UTF8ToString($0)]["midiOut"].send(0x90, 0x45, 0x7f);
-//   }, mWAMCtrlrJSObjectName.Get());
-//  val::global(mWAMCtrlrJSObjectName.Get())["midiOut"].call<void>("send", {0x90, 0x45, 0x7f} );
-
-// #if WEBSOCKET_CLIENT
-//   mSSMFUIBuf.Resize(kNumSSMFUIBytes + msg.mSize);
-//   int pos = kNumMsgHeaderBytes;
-//
-//   *((int*)(mSSMFUIBuf.GetData() + pos)) = msg.mSize; pos += sizeof(int);
-//   memcpy(mSSMFUIBuf.GetData() + pos, msg.mData, msg.mSize);
-//
-//   EM_ASM({
-//     var jsbuff = Module.HEAPU8.subarray($0, $0 + $1);
-//     ws.send(jsbuff);
-//   }, (int) mSSMFUIBuf.GetData(), mSSMFUIBuf.Size());
-// #else
-//   EM_ASM({
-//     window[Module.UTF8ToString($0)].sendMessage('SSMFUI', $1, Module.HEAPU8.slice($1, $1 + $2).buffer);
-//   }, mWAMCtrlrJSObjectName.Get(), (int) msg.mData, msg.mSize);
-// #endif
+#else
+  AddUIRecord(kWebTransportSysExMsg, 0, 0, msg.mData, msg.mSize);
+#endif
 }
 
 void IPlugWeb::SendArbitraryMsgFromUI(int messageTag, int controlTag, int dataSize, const void* pData)
 {
+#if WEBSOCKET_CLIENT
   mSAMFUIBuf.Resize(kNumSAMFUIBytes + dataSize);
   int pos = kNumMsgHeaderBytes;
 
@@ -107,15 +153,12 @@ void IPlugWeb::SendArbitraryMsgFromUI(int messageTag, int controlTag, int dataSi
 
   memcpy(mSAMFUIBuf.GetData() + pos, pData, dataSize);
 
-#if WEBSOCKET_CLIENT
   EM_ASM({
     var jsbuff = Module.HEAPU8.subarray($0, $0 + $1);
     ws.send(jsbuff);
   }, (int) mSAMFUIBuf.GetData(), mSAMFUIBuf.Size());
 #else
-  EM_ASM({
-    window[Module.UTF8ToString($0)].sendMessage('SAMFUI', "", Module.HEAPU8.slice($1, $1 + $2).buffer);
-  }, mWAMCtrlrJSObjectName.Get(), (int) mSAMFUIBuf.GetData() + kNumMsgHeaderBytes, mSAMFUIBuf.Size() - kNumMsgHeaderBytes); // Non websocket doesn't need "SAMFUI" bytes at beginning
+  AddUIRecord(kWebTransportArbitraryMsg, controlTag, messageTag, pData, dataSize);
 #endif
 }
 
@@ -158,7 +201,50 @@ void _SendSysexMsgFromDelegate(int dataSize, uintptr_t pData)
   gPlug->SendSysexMsgFromDelegate(msg);
 }
 
+// a whole batch of updates from the WAM processor, see IPlugWebTransport.h
+void _SendTransportBatchFromDelegate(uintptr_t pData, int size)
+{
+  const uint8_t* pBatch = reinterpret_cast<uint8_t*>(pData); // embind doesn't allow us to pass raw pointers
+
+  IWebTransportRecord::ForEach(pBatch, size, [](const IWebTransportRecord& record, const uint8_t* pRecordData) {
+    double value = 0.;
+
+    switch (record.mType)
+    {
+      case kWebTransportParamValue:
+        memcpy(&value, pRecordData, sizeof(double));
+        gPlug->SendParameterValueFromDelegate(record.mIdx, value, true);
+        break;
+      case kWebTransportControlValue:
+        memcpy(&value, pRecordData, sizeof(double));
+        gPlug->SendControlValueFromDelegate(record.mIdx, value);
+        break;
+      case kWebTransportControlMsg:
+        gPlug->SendControlMsgFromDelegate(record.mIdx, record.mTag, record.mSize, pRecordData);
+        break;
+      case kWebTransportMidiMsg:
+      {
+        IMidiMsg msg {0, pRecordData[0], pRecordData[1], pRecordData[2]};
+        gPlug->SendMidiMsgFromDelegate(msg);
+        break;
+      }
+      case kWebTransportSysExMsg:
+      {
+        ISysEx msg(0, pRecordData, record.mSize);
+        gPlug->SendSysexMsgFromDelegate(msg);
+        break;
+      }
+      case kWebTransportArbitraryMsg:
+        gPlug->SendArbitraryMsgFromDelegate(record.mTag, record.mSize, pRecordData);
+        break;
+      default:
+        break;
+    }
+  });
+}
+
 EMSCRIPTEN_BINDINGS(IPlugWeb) {
+  function("SBFD", &_SendTransportBatchFromDelegate);
   function("SPVFD", &_SendParameterValueFromDelegate);
   function("SAMFD", &_SendArbitraryMsgFromDelegate);
   function("SCMFD", &_SendControlMsgFromDelegate);
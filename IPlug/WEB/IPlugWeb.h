@@ -33,12 +33,27 @@ public:
   void SendSysexMsgFromUI(const ISysEx& msg) override;
   void SendArbitraryMsgFromUI(int messageTag, int controlTag = kNoTag, int dataSize = 0, const void* pData = nullptr) override;
 
+  //IPlugWeb
+  /** Post the updates the UI has batched to the WAM processor, see IPlugWebTransport.h. Called at the end of each animation frame in which there were any, or when the batch is full */
+  void FlushUIBatch();
+
 private:
+  /** Append a record to the batch for the processor, scheduling a flush at the end of the frame if it is the first
+   * @return The position of the record in the batch, or -1 if it was too large to send */
+  int AddUIRecord(int type, int idx, int tag, const void* pData, int dataSize);
+
+  static void OnUIBatchTimer(void* pPlug);
+
   WDL_String mWAMCtrlrJSObjectName;
   IByteChunk mSPVFUIBuf;
   IByteChunk mSMMFUIBuf;
   IByteChunk mSSMFUIBuf;
   IByteChunk mSAMFUIBuf;
+
+  WDL_TypedBuf<uint8_t> mUIBatch;
+  int mUIBatchSize = 0;
+  WDL_TypedBuf<int> mUIBatchParamPos; // for each parameter, the position in the batch of its value, or -1, so that a drag sends one value per frame
+  bool mUIBatchScheduled = false;
 };
 
 IPlugWeb* MakePlug();
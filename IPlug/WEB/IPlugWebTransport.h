@@ -0,0 +1,89 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @brief The batched transport of updates between the WAM processor (IPlugWAM, in the AudioWorklet) and the UI (IPlugWeb, on the main thread)
+ *
+ * IPlugWAM appends a record for each parameter value, control value, control message, MIDI or SysEx message and arbitrary message
+ * to a preallocated buffer in its wasm memory. After each render quantum the processor script moves the whole batch into a
+ * SharedArrayBuffer ring (see IPlugWAM-awp.js), which the controller script polls once per animation frame and hands to
+ * IPlugWeb in one call (see IPlugWAM-awn.js). If SharedArrayBuffer isn't available (the page isn't cross origin isolated), each
+ * batch is posted as a single message instead. Either way no JavaScript objects are created per update.
+ *
+ * The other way, IPlugWeb appends a record for each parameter value, MIDI, SysEx and arbitrary message that the UI sends during an animation frame,
+ * and at the end of the frame posts the batch to the processor as one transferred ArrayBuffer, which IPlugWAM decodes in one call (see IPlugWAM-awp.js).
+ */
+
+#include <cstdint>
+#include <cstring>
+
+/** The types of record in a transport batch */
+enum EWebTransportRecord
+{
+  kWebTransportParamValue = 0, // mIdx = parameter index, data = double normalized value
+  kWebTransportControlValue, // mIdx = control tag, data = double normalized value
+  kWebTransportControlMsg, // mIdx = control tag, mTag = message tag, data = message
+  kWebTransportMidiMsg, // data = status, data1, data2
+  kWebTransportSysExMsg, // data = the SysEx bytes
+  kWebTransportArbitraryMsg // mIdx = control tag (from the UI only), mTag = message tag, data = message
+};
+
+/** The header of a record in a transport batch, followed by mSize bytes of data, padded to a multiple of 4 bytes */
+struct IWebTransportRecord
+{
+  int32_t mType;
+  int32_t mIdx;
+  int32_t mTag;
+  int32_t mSize;
+
+  /** @return The number of bytes a record with dataSize bytes of data takes, including the header and padding */
+  static int RecordSize(int dataSize) { return (int) sizeof(IWebTransportRecord) + ((dataSize + 3) & ~3); }
+
+  /** Append a record to a batch
+   * @return \c false if the record doesn't fit in the space left, in which case nothing is written */
+  static bool Write(uint8_t* pBatch, int capacity, int& size, int type, int idx, int tag, const void* pData, int dataSize)
+  {
+    const int recordSize = RecordSize(dataSize);
+
+    if (size + recordSize > capacity)
+      return false;
+
+    IWebTransportRecord header { type, idx, tag, dataSize };
+    memcpy(pBatch + size, &header, sizeof(header));
+
+    if (dataSize)
+      memcpy(pBatch + size + sizeof(header), pData, dataSize);
+
+    size += recordSize;
+    return true;
+  }
+
+  /** Call func(const IWebTransportRecord& record, const uint8_t* pData) for each record in a batch */
+  template <typename FUNC>
+  static void ForEach(const uint8_t* pBatch, int size, FUNC&& func)
+  {
+    int pos = 0;
+
+    while (pos + (int) sizeof(IWebTransportRecord) <= size)
+    {
+      IWebTransportRecord header;
+      memcpy(&header, pBatch + pos, sizeof(header));
+
+      if (header.mSize < 0 || pos + RecordSize(header.mSize) > size)
+        break;
+
+      func(header, pBatch + pos + sizeof(header));
+      pos += RecordSize(header.mSize);
+    }
+  }
+};
@@ -0,0 +1,134 @@
+// Streams bitmaps for IGraphicsWeb on demand, instead of preloading them with the rest of the resources.
+// IPlugResources.manifest maps each streamed image ("/resources/img/name.png") to its [width, height], so that a placeholder of the right size can be
+// laid out straight away. It is written to resources.js by Scripts/web_resource_manifest.py (see makedist-web.sh), and is empty when images are preloaded.
+// An image is fetched at high priority the first time its bitmap is drawn, and any others are prefetched at low priority when the browser is idle.
+// Images are ordinary GET requests relative to the page (or to baseURL, when running on a worker, see IPlugWebWorker.js), so the server's HTTP caching headers apply to them.
+
+var IPlugResources = IPlugResources || {};
+IPlugResources.manifest = IPlugResources.manifest || {};
+IPlugResources.entries = [];
+IPlugResources.idleScheduled = false;
+IPlugResources.prefetchPerIdle = 4;
+IPlugResources.placeholderColor = "rgba(128, 128, 128, 0.15)";
+IPlugResources.baseURL = IPlugResources.baseURL || "";
+
+// a canvas to draw into, which is an OffscreenCanvas when there is no document
+IPlugResources.createCanvas = function(width, height) {
+  if(typeof document === "undefined")
+    return new OffscreenCanvas(width, height);
+
+  var canvas = document.createElement("canvas");
+  canvas.width = width;
+  canvas.height = height;
+  return canvas;
+}
+
+// IGraphicsCanvas: a placeholder canvas that the image is drawn into when it arrives. canvas.iplugHandle is passed to request()
+IPlugResources.createPlaceholder = function(path) {
+  var size = IPlugResources.manifest[path];
+  var canvas = IPlugResources.createCanvas(size[0], size[1]);
+
+  var ctx = canvas.getContext("2d");
+  ctx.fillStyle = IPlugResources.placeholderColor;
+  ctx.fillRect(0, 0, canvas.width, canvas.height);
+
+  canvas.iplugHandle = IPlugResources.add(path, canvas, 0);
+  return canvas;
+}
+
+// IGraphicsNanoVG: the image's RGBA pixels are passed to Module.IGWRP(textureID, pixels), to update the placeholder texture
+IPlugResources.addTexture = function(path, textureID) {
+  return IPlugResources.add(path, null, textureID);
+}
+
+IPlugResources.add = function(path, canvas, textureID) {
+  IPlugResources.entries.push({path: path, canvas: canvas, textureID: textureID, requested: false});
+  IPlugResources.scheduleIdle();
+  return IPlugResources.entries.length - 1;
+}
+
+IPlugResources.request = function(handle, highPriority) {
+  var entry = IPlugResources.entries[handle];
+
+  if(!entry || entry.requested)
+    return;
+
+  entry.requested = true;
+
+  var url = IPlugResources.baseURL + entry.path.replace(/^\//, "");
+
+  var onload = function(img) {
+    var size = IPlugResources.manifest[entry.path];
+    var canvas = entry.canvas || IPlugResources.createCanvas(size[0], size[1]);
+    canvas.width = size[0]; // also clears the placeholder
+    canvas.height = size[1];
+
+    var ctx = canvas.getContext("2d");
+    ctx.drawImage(img, 0, 0, canvas.width, canvas.height);
+
+    if(entry.canvas) {
+      Module.IGWRL();
+    }
+    else {
+      var pixels = ctx.getImageData(0, 0, canvas.width, canvas.height).data;
+      var pData = Module._malloc(pixels.length);
+      Module.HEAPU8.set(pixels, pData);
+      Module.IGWRP(entry.textureID, pData);
+      Module._free(pData);
+    }
+  };
+
+  var onerror = function() {
+    console.log("IPlugResources: couldn't load " + entry.path);
+  };
+
+  if(typeof Image === "undefined") { // a worker can't create Image elements, decode with createImageBitmap instead
+    fetch(url, {priority: highPriority ? "high" : "low"})
+      .then(function(response) { return response.ok ? response.blob() : Promise.reject(); })
+      .then(function(blob) { return createImageBitmap(blob); })
+      .then(onload, onerror);
+    return;
+  }
+
+  var img = new Image();
+  img.decoding = "async";
+  img.fetchPriority = highPriority ? "high" : "low"; // ignored by browsers that don't support it
+  img.onload = function() { onload(img); };
+  img.onerror = onerror;
+  img.src = url;
+}
+
+// prefetch a few of the images that haven't been drawn yet each time the browser is idle
+IPlugResources.scheduleIdle = function() {
+  if(IPlugResources.idleScheduled)
+    return;
+
+  IPlugResources.idleScheduled = true;
+
+  var whenIdle = self.requestIdleCallback || function(callback) { return setTimeout(callback, 50); };
+
+  whenIdle(function() {
+    var entries = IPlugResources.entries;
+    var started = 0;
+    var remaining = false;
+
+    IPlugResources.idleScheduled = false;
+
+    for(var i = 0; i < entries.length; i++) {
+      if(entries[i].requested)
+        continue;
+
+      if(started < IPlugResources.prefetchPerIdle) {
+        IPlugResources.request(i, false);
+        started++;
+      }
+      else {
+        remaining = true;
+        break;
+      }
+    }
+
+    if(remaining)
+      IPlugResources.scheduleIdle();
+  });
+}
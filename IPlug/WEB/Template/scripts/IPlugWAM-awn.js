@@ -7,6 +7,75 @@ class NAME_PLACEHOLDERController extends WAMController
     options.outputChannelCount = [2];
 
     super(actx, "NAME_PLACEHOLDER", options);
+
+    // the processing latency in samples, which the page should compensate for. Set onlatencychange to be told when it changes
+    this.latency = 0;
+    this.onlatencychange = null;
+
+    // updates from the processor arrive in batches, see IPlugWebTransport.h. A SharedArrayBuffer ring is polled once
+    // per animation frame, and needs a cross origin isolated page. Otherwise the processor posts each batch
+    this.transportStaging = 0;
+    this.transportStagingSize = 0;
+
+    if(typeof SharedArrayBuffer !== "undefined") {
+      var ringSize = 262144; // must be a power of two
+      var buffer = new SharedArrayBuffer(16 + ringSize);
+      this.transportHeader = new Int32Array(buffer, 0, 4);
+      this.transportData = new Uint8Array(buffer, 16);
+      this.port.postMessage({type: "iplug-transport-ring", buffer: buffer});
+      this.pollTransport = this.pollTransport.bind(this);
+      requestAnimationFrame(this.pollTransport);
+    }
+  }
+
+  // the UI module runs on a worker (see IPlugWebWorkerHost.js): hand the ring to the worker, which polls it itself, or forward the posted batches to it
+  attachUIWorker(worker) {
+    this.uiWorker = worker;
+
+    if(this.transportHeader)
+      worker.postMessage({type: "transport-ring", buffer: this.transportHeader.buffer});
+  }
+
+  // a batch of parameter changes and messages from the UI, see IPlugWeb::FlushUIBatch(). The buffer is transferred, not copied
+  sendUIBatch(buffer) {
+    this.port.postMessage({type: "iplug-ui-batch", data: buffer}, [buffer]);
+  }
+
+  // copy a batch into the UI module's memory and hand it to IPlugWeb in one call
+  sendTransportBatchToUI(size, getByte) {
+    if(size > this.transportStagingSize) {
+      if(this.transportStaging)
+        Module._free(this.transportStaging);
+
+      this.transportStaging = Module._malloc(size);
+      this.transportStagingSize = size;
+    }
+
+    var heap = Module.HEAPU8;
+
+    for(var i = 0; i < size; i++)
+      heap[this.transportStaging + i] = getByte(i);
+
+    Module.SBFD(this.transportStaging, size);
+  }
+
+  pollTransport() {
+    if(this.uiWorker)
+      return;
+
+    var header = this.transportHeader;
+    var data = this.transportData;
+    var writeIdx = Atomics.load(header, 0);
+    var readIdx = Atomics.load(header, 1);
+    var size = (writeIdx - readIdx) & 0x7fffffff;
+
+    if(size > 0 && typeof Module.SBFD !== "undefined") {
+      var mask = data.length - 1;
+      this.sendTransportBatchToUI(size, (i) => data[(readIdx + i) & mask]);
+      Atomics.store(header, 1, (readIdx + size) & 0x7fffffff);
+    }
+
+    requestAnimationFrame(this.pollTransport);
   }
 
   static importScripts (actx) {
@@ -27,42 +96,19 @@ class NAME_PLACEHOLDERController extends WAMController
       console.log("got WAM descriptor...");
     }
 
-    if(msg.verb == "SPVFD") {
-      Module.SPVFD(parseInt(msg.prop), parseFloat(msg.data));
-    }
-    //Send Control Message From Delegate
-    else if(msg.verb == "SCMFD") {
-      var res = msg.prop.split(":");
-      var data = new Uint8Array(msg.data);
-      const buffer = Module._malloc(data.length);
-      Module.HEAPU8.set(data, buffer);
-      Module.SCMFD(parseInt(res[0]), parseInt(res[1]), data.length, buffer);
-      Module._free(buffer);
-    }
-    //Send Arbitrary Message From Delegate
-    else if(msg.verb == "SAMFD") {
-      var data = new Uint8Array(msg.data);
-      const buffer = Module._malloc(data.length);
-      Module.HEAPU8.set(data, buffer);
-      Module.SAMFD(parseInt(msg.prop), data.length, buffer);
-      Module._free(buffer);
-    }
-    //Set Control Value From Delegate
-    else if(msg.verb == "SCVFD") {
-      Module.SCVFD(parseInt(msg.prop), parseFloat(msg.data));
+    if(msg.type == "iplug-latency") {
+      this.latency = msg.latency;
+
+      if(this.onlatencychange)
+        this.onlatencychange(msg.latency);
     }
-    //Send Midi Message From Delegate
-    else if(msg.verb == "SMMFD") {
-      var res = msg.prop.split(":");
-      Module.SMMFD(parseInt(res[0]), parseInt(res[1]), parseInt(res[2]));
+
+    if(msg.type == "iplug-transport-batch" && this.uiWorker) {
+      this.uiWorker.postMessage({type: "transport-batch", data: msg.data});
     }
-    //Send Sysex Message From Delegate
-    else if(msg.verb == "SSMFD") {
+    else if(msg.type == "iplug-transport-batch" && typeof Module.SBFD !== "undefined") {
       var data = new Uint8Array(msg.data);
-      const buffer = Module._malloc(data.length);
-      Module.HEAPU8.set(data, buffer);
-      Module.SSMFD(parseInt(msg.prop), data.length, buffer);
-      Module._free(buffer);
+      this.sendTransportBatchToUI(data.length, (i) => data[i]);
     }
   }
 }
@@ -4,6 +4,83 @@ class NAME_PLACEHOLDER_AWP extends AudioWorkletGlobalScope.WAMProcessor
     options = options || {}
     options.mod = AudioWorkletGlobalScope.WAM.NAME_PLACEHOLDER;
     super(options);
+
+    // SharedArrayBuffer ring to the controller, see IPlugWebTransport.h. Until the controller sends one, batches are posted
+    this.transportHeader = null;
+    this.transportData = null;
+    this.latency = -1;
+  }
+
+  onmessage(e) {
+    var msg = e.data;
+
+    if(msg.type == "iplug-transport-ring") {
+      this.transportHeader = new Int32Array(msg.buffer, 0, 4);
+      this.transportData = new Uint8Array(msg.buffer, 16);
+      return;
+    }
+
+    // the parameter changes and messages the UI sent during an animation frame, decoded by IPlugWAM in one call
+    if(msg.type == "iplug-ui-batch") {
+      var mod = AudioWorkletGlobalScope.WAM.NAME_PLACEHOLDER;
+      var data = new Uint8Array(msg.data);
+      var ptr = mod._iplug_uibatch(this.inst, data.length);
+
+      if(ptr) {
+        mod.HEAPU8.set(data, ptr);
+        mod._iplug_processuibatch(this.inst, data.length);
+      }
+      return;
+    }
+
+    super.onmessage(e);
+  }
+
+  process(inputs, outputs, params) {
+    var keepAlive = super.process(inputs, outputs, params);
+    this.sendTransportBatch();
+
+    // IPlugWAM::GetHostLatency() changes with SetLatency(), and includes any block accumulation
+    var latency = AudioWorkletGlobalScope.WAM.NAME_PLACEHOLDER._iplug_latency(this.inst);
+
+    if(latency != this.latency) {
+      this.latency = latency;
+      this.port.postMessage({type: "iplug-latency", latency: latency});
+    }
+
+    return keepAlive;
+  }
+
+  // move the updates IPlugWAM batched during this render quantum to the controller
+  sendTransportBatch() {
+    var mod = AudioWorkletGlobalScope.WAM.NAME_PLACEHOLDER;
+    var size = mod._iplug_taketransportbatch(this.inst);
+
+    if(size == 0)
+      return;
+
+    var ptr = mod._iplug_transportbatch(this.inst);
+    var heap = mod.HEAPU8;
+
+    if(this.transportHeader) {
+      var header = this.transportHeader;
+      var data = this.transportData;
+      var mask = data.length - 1;
+      var writeIdx = Atomics.load(header, 0);
+      var readIdx = Atomics.load(header, 1);
+
+      // if the UI has fallen behind, drop this batch rather than overwrite one it hasn't read
+      if(data.length - ((writeIdx - readIdx) & 0x7fffffff) < size)
+        return;
+
+      for(var i = 0; i < size; i++)
+        data[(writeIdx + i) & mask] = heap[ptr + i];
+
+      Atomics.store(header, 0, (writeIdx + size) & 0x7fffffff);
+    }
+    else {
+      this.port.postMessage({type: "iplug-transport-batch", data: heap.slice(ptr, ptr + size).buffer});
+    }
   }
 }
 
@@ -0,0 +1,134 @@
+// Runs the UI module (NAME_PLACEHOLDER-web.js) on a dedicated worker, drawing into an OffscreenCanvas. Used when the UI module is built with WEB_WORKER=1
+// (IGRAPHICS_WEB_WORKER), so that drawing and the UI's C++ never block the page's main thread. The page side is IPlugWebWorkerHost.js:
+// it transfers the canvas, forwards input events and the updates from the WAM processor, and carries out the requests that a worker can't,
+// such as setting the cursor or opening a URL (see PostToPage() in IGraphicsWeb.h).
+// Bitmaps are always streamed in worker mode (IPLUG_WEB_STREAM_IMAGES=1), since the preloaded image packages need a document to decode into.
+
+var IPlugWebWorker = {};
+
+IPlugWebWorker.postToPage = function(msg) {
+  self.postMessage(msg);
+}
+
+// IGraphicsCanvas: add a font to the worker's font set, in place of the @font-face CSS used on the main thread. Text is redrawn when it has loaded
+IPlugWebWorker.addFont = function(name, data) {
+  var face = new FontFace(name, new Uint8Array(data)); // copy, data is a view into the module's memory
+  self.fonts.add(face);
+  face.load().then(function() { Module.IGWRL(); }, function() { console.log("IPlugWebWorker: couldn't load font " + name); });
+}
+
+// The controller object that IPlugWeb calls to send parameter changes and messages to the processor. It lives on the page, so forward the calls
+IPlugWebWorker.createControllerProxy = function(name) {
+  var forward = function(method) {
+    return function() { self.postMessage({type: "wam", method: method, args: Array.prototype.slice.call(arguments)}); };
+  };
+
+  // IPlugWeb's batches are transferred rather than copied again
+  var sendUIBatch = function(buffer) { self.postMessage({type: "wam", method: "sendUIBatch", args: [buffer]}, [buffer]); };
+
+  self[name + "_WAM"] = { setParam: forward("setParam"), sendMessage: forward("sendMessage"), sendUIBatch: sendUIBatch };
+}
+
+// Updates from the processor, see IPlugWebTransport.h. Either the page hands over the SharedArrayBuffer ring, which is polled here once per frame,
+// or it forwards each batch that the processor posted
+IPlugWebWorker.transportStaging = 0;
+IPlugWebWorker.transportStagingSize = 0;
+
+IPlugWebWorker.sendTransportBatchToUI = function(size, getByte) {
+  if(size > IPlugWebWorker.transportStagingSize) {
+    if(IPlugWebWorker.transportStaging)
+      Module._free(IPlugWebWorker.transportStaging);
+
+    IPlugWebWorker.transportStaging = Module._malloc(size);
+    IPlugWebWorker.transportStagingSize = size;
+  }
+
+  var heap = Module.HEAPU8;
+
+  for(var i = 0; i < size; i++)
+    heap[IPlugWebWorker.transportStaging + i] = getByte(i);
+
+  Module.SBFD(IPlugWebWorker.transportStaging, size);
+}
+
+IPlugWebWorker.nextFrame = function(callback) {
+  if(typeof self.requestAnimationFrame !== "undefined")
+    self.requestAnimationFrame(callback);
+  else
+    setTimeout(callback, 16);
+}
+
+IPlugWebWorker.pollTransport = function() {
+  var header = IPlugWebWorker.transportHeader;
+  var data = IPlugWebWorker.transportData;
+  var writeIdx = Atomics.load(header, 0);
+  var readIdx = Atomics.load(header, 1);
+  var size = (writeIdx - readIdx) & 0x7fffffff;
+
+  if(size > 0 && typeof Module.SBFD !== "undefined") {
+    var mask = data.length - 1;
+    IPlugWebWorker.sendTransportBatchToUI(size, function(i) { return data[(readIdx + i) & mask]; });
+    Atomics.store(header, 1, (readIdx + size) & 0x7fffffff);
+  }
+
+  IPlugWebWorker.nextFrame(IPlugWebWorker.pollTransport);
+}
+
+IPlugWebWorker.init = function(msg) {
+  IPlugWebWorker.createControllerProxy(msg.name);
+
+  Module = {
+    canvas: msg.canvas,
+    devicePixelRatio: msg.devicePixelRatio, // read by IGraphicsWeb::OpenWindow(), workers have no window
+    // the .data packages sit next to the page, the module's .wasm next to this script
+    locateFile: function(path, prefix) { return path.endsWith(".data") ? "../" + path : prefix + path; },
+    preRun: [function() { specialHTMLTargets["#canvas"] = msg.canvas; }], // so that emscripten_webgl_create_context("#canvas") finds the OffscreenCanvas
+    postRun: function() { self.postMessage({type: "ready"}); },
+    setStatus: function(text) { self.postMessage({type: "status", text: text}); },
+    monitorRunDependencies: function(left) {},
+    print: function(text) { console.log(text); },
+    printErr: function(text) { console.error(text); }
+  };
+
+  IPlugResources.baseURL = "../";
+
+  importScripts("../fonts.js", "../svgs.js", "../resources.js", "IPlugResources.js", msg.name + "-web.js");
+}
+
+var Module;
+var IPlugResources = IPlugResources || {};
+
+self.onmessage = function(e) {
+  var msg = e.data;
+
+  switch(msg.type) {
+    case "init":
+      IPlugWebWorker.init(msg);
+      break;
+    case "transport-ring":
+      IPlugWebWorker.transportHeader = new Int32Array(msg.buffer, 0, 4);
+      IPlugWebWorker.transportData = new Uint8Array(msg.buffer, 16);
+      IPlugWebWorker.nextFrame(IPlugWebWorker.pollTransport);
+      break;
+    case "transport-batch":
+      if(typeof Module.SBFD !== "undefined") {
+        var data = new Uint8Array(msg.data);
+        IPlugWebWorker.sendTransportBatchToUI(data.length, function(i) { return data[i]; });
+      }
+      break;
+    case "mouse":
+      if(typeof Module.IGWME !== "undefined")
+        Module.IGWME(msg.eventType, msg.x, msg.y, msg.movementX, msg.movementY, msg.buttons, msg.modifiers);
+      break;
+    case "wheel":
+      if(typeof Module.IGWMW !== "undefined")
+        Module.IGWMW(msg.x, msg.y, msg.deltaY, msg.modifiers);
+      break;
+    case "key":
+      if(typeof Module.IGWKD !== "undefined")
+        Module.IGWKD(msg.keyCode, msg.key, msg.modifiers);
+      break;
+    default:
+      break;
+  }
+}
@@ -0,0 +1,109 @@
+// The page side of a UI module that runs on a dedicated worker (see IPlugWebWorker.js). Transfers the canvas to the worker as an OffscreenCanvas,
+// forwards input events to it, and carries out the requests it posts back. Call IPlugWebWorkerHost.start() in place of loading NAME_PLACEHOLDER-web.js,
+// and hand the returned worker to the WAM controller with attachUIWorker(), so that the processor's updates go straight to the worker.
+
+var IPlugWebWorkerHost = {};
+
+// the values of EMSCRIPTEN_EVENT_* in html5.h, which IGraphicsWeb's mouse_callback() switches on
+IPlugWebWorkerHost.mouseEventTypes = {
+  pointerdown: 5, pointerup: 6, dblclick: 7, pointermove: 8, pointerenter: 33, pointerleave: 34
+};
+
+IPlugWebWorkerHost.modifiers = function(e) {
+  return (e.shiftKey ? 1 : 0) | (e.ctrlKey ? 2 : 0) | (e.altKey ? 4 : 0);
+}
+
+IPlugWebWorkerHost.start = function(name, canvas) {
+  var worker = new Worker("scripts/IPlugWebWorker.js");
+  var offscreen = canvas.transferControlToOffscreen();
+
+  worker.postMessage({type: "init", name: name, canvas: offscreen, devicePixelRatio: window.devicePixelRatio}, [offscreen]);
+
+  var forwardMouse = function(e) {
+    // capture the pointer while a button is down, so that drags outside the canvas keep arriving
+    if(e.type == "pointerdown")
+      canvas.setPointerCapture(e.pointerId);
+    else if(e.type == "pointerup")
+      canvas.releasePointerCapture(e.pointerId);
+
+    worker.postMessage({type: "mouse", eventType: IPlugWebWorkerHost.mouseEventTypes[e.type], x: e.offsetX, y: e.offsetY,
+                        movementX: e.movementX || 0, movementY: e.movementY || 0, buttons: e.buttons, modifiers: IPlugWebWorkerHost.modifiers(e)});
+  };
+
+  for(var type in IPlugWebWorkerHost.mouseEventTypes)
+    canvas.addEventListener(type, forwardMouse);
+
+  canvas.addEventListener("wheel", function(e) {
+    worker.postMessage({type: "wheel", x: e.offsetX, y: e.offsetY, deltaY: e.deltaY, modifiers: IPlugWebWorkerHost.modifiers(e)});
+    e.preventDefault();
+  }, {passive: false});
+
+  window.addEventListener("keydown", function(e) {
+    worker.postMessage({type: "key", keyCode: e.keyCode, key: e.key, modifiers: IPlugWebWorkerHost.modifiers(e)});
+  });
+
+  worker.onmessage = function(e) {
+    var msg = e.data;
+
+    switch(msg.type) {
+      case "wam": {
+        var wam = window[name + "_WAM"]; // undefined until web audio has been started
+
+        if(wam)
+          wam[msg.method].apply(wam, msg.args);
+        break;
+      }
+      case "cursor":
+        document.body.style.cursor = msg.cursor;
+        break;
+      case "hidecursor":
+        if(msg.hide) {
+          if(msg.lock)
+            canvas.requestPointerLock();
+          else
+            canvas.style.cursor = "none";
+        }
+        else {
+          if(msg.lock)
+            document.exitPointerLock();
+
+          canvas.style.cursor = "";
+        }
+        break;
+      case "resize":
+        canvas.style.width = msg.width + "px";
+        canvas.style.height = msg.height + "px";
+        break;
+      case "alert":
+        window.alert(msg.text);
+        break;
+      case "openurl":
+        window.open(msg.url, "_blank");
+        break;
+      case "prompt": {
+        var inputEl = document.getElementById("pluginInput");
+
+        if(msg.directory)
+          inputEl.setAttribute("webkitdirectory", "");
+        else
+          inputEl.removeAttribute("webkitdirectory");
+
+        inputEl.setAttribute("accept", msg.accept || "");
+        inputEl.click();
+        break;
+      }
+      case "status":
+        if(typeof Module !== "undefined" && Module.setStatus)
+          Module.setStatus(msg.text);
+        break;
+      case "ready":
+        if(typeof Module !== "undefined" && Module.postRun)
+          Module.postRun();
+        break;
+      default:
+        break;
+    }
+  };
+
+  return worker;
+}
@@ -0,0 +1,61 @@
+#!/usr/bin/python
+
+# python shell script to compare the reports written by the IGraphicsStressTest benchmark, see Tests/IGraphicsStressTest/IGraphicsStressTest_Benchmark.h
+# usage: compare_stress_benchmarks.py baseline.csv other.csv [more.csv ...] [--threshold percent]
+# prints the mean frame time of each test in each report, and the change from the first report. The exit code is 1 if any test in another report
+# is slower than the baseline by more than the threshold, 10% by default, so that the reports of two revisions of one backend can be compared in CI
+
+import csv, sys
+
+def read_report(path):
+  rows = {}
+
+  with open(path) as f:
+    for row in csv.DictReader(f):
+      rows[(row["thing"], int(row["count"]), float(row["scale"]))] = (row["api"], float(row["mean_ms"]))
+
+  return rows
+
+def main():
+  args = sys.argv[1:]
+  threshold = 10.
+
+  if "--threshold" in args:
+    i = args.index("--threshold")
+    threshold = float(args[i + 1])
+    del args[i:i + 2]
+
+  if len(args) < 2:
+    print("usage: compare_stress_benchmarks.py baseline.csv other.csv [more.csv ...] [--threshold percent]")
+    sys.exit(1)
+
+  reports = [read_report(path) for path in args]
+  baseline = reports[0]
+  names = [next(iter(report.values()))[0] if report else path for report, path in zip(reports, args)]
+  regressions = 0
+
+  print("%-20s %6s %5s " % ("thing", "count", "scale") + " ".join("%24s" % name[:24] for name in names))
+
+  for key in sorted(baseline.keys(), key=lambda k: (k[2], k[0], k[1])):
+    base = baseline[key][1]
+    cells = ["%24.3f" % base]
+
+    for report in reports[1:]:
+      if key not in report:
+        cells.append("%24s" % "-")
+        continue
+
+      mean = report[key][1]
+      change = (mean - base) / base * 100. if base > 0. else 0.
+      flag = " !" if change > threshold else "  "
+      regressions += change > threshold
+      cells.append("%14.3f %+7.1f%%%s" % (mean, change, flag))
+
+    print("%-20s %6i %5g " % key + " ".join(cells))
+
+  if regressions:
+    print(str(regressions) + " tests are more than " + str(threshold) + "% slower than " + args[0])
+    sys.exit(1)
+
+if __name__ == '__main__':
+  main()
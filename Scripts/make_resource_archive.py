@@ -0,0 +1,68 @@
+#!/usr/bin/python
+
+# python shell script to pack the resources of a plug-in into one file, see IPlug/IPlugResourceArchive.h
+# usage: make_resource_archive.py output.pak [resources folder]
+# each png, svg, ttf and ktx in the resources folder and its img and fonts folders is packed under its file name, including @2x etc versions,
+# the output should be named resources.pak and copied where the plug-in's resources are, i.e. the bundle's Resources folder or beside the binary
+
+import os, struct, sys
+
+TYPES = (".png", ".svg", ".ttf", ".ktx")
+FOLDERS = ("", "img", "fonts")
+VERSION = 1
+ALIGNMENT = 16
+
+def pad(blob):
+  # a zero byte after each name and resource, then up to the next aligned offset
+  blob += b"\0"
+  return blob + b"\0" * (-len(blob) % ALIGNMENT)
+
+def main():
+  if len(sys.argv) < 2:
+    print("usage: make_resource_archive.py output.pak [resources folder]")
+    sys.exit(1)
+
+  root = sys.argv[2] if len(sys.argv) > 2 else "resources"
+  files = {}
+
+  for folder in FOLDERS:
+    path = os.path.join(root, folder)
+
+    if not os.path.isdir(path):
+      continue
+
+    for fileName in sorted(os.listdir(path)):
+      if not fileName.lower().endswith(TYPES) or not os.path.isfile(os.path.join(path, fileName)):
+        continue
+
+      if fileName in files:
+        print("skipping " + os.path.join(folder, fileName) + ", it is already in " + (os.path.dirname(files[fileName]) or "the resources folder"))
+        continue
+
+      files[fileName] = os.path.join(path, fileName)
+
+  names = sorted(files)
+  offset = 16 + 16 * len(names)
+  records = b""
+  body = b""
+
+  for name in names:
+    with open(files[name], "rb") as f:
+      data = f.read()
+
+    nameBytes = name.encode("utf-8")
+    nameOffset = offset + len(body)
+    body += pad(nameBytes)
+    dataOffset = offset + len(body)
+    body += pad(data)
+    records += struct.pack("<IIII", nameOffset, len(nameBytes), dataOffset, len(data))
+
+  with open(sys.argv[1], "wb") as out:
+    out.write(b"IPAK" + struct.pack("<III", VERSION, len(names), 0))
+    out.write(records)
+    out.write(body)
+
+  print("packed " + str(len(names)) + " resources into " + sys.argv[1])
+
+if __name__ == '__main__':
+  main()
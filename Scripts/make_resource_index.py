@@ -0,0 +1,74 @@
+#!/usr/bin/python
+
+# python shell script to write the resource index of a plug-in, see IPlug/IPlugResourceIndex.h
+# usage: make_resource_index.py output.h [resources folder]
+# each png, svg and ttf in the resources folder and its img and fonts folders is listed once, with the scales it has @2x etc versions for,
+# the output is included in one source file of the plug-in, e.g. after IPlug_include_in_plug_src.h, and should be written again when resources change
+
+import os, re, sys
+
+TYPES = (".png", ".svg", ".ttf")
+FOLDERS = ("", "img", "fonts")
+SCALED = re.compile(r"^(.*)@(\d+)x(\.[^.]+)$")
+
+def fnv1a(path):
+  h = 0x811c9dc5
+
+  with open(path, "rb") as f:
+    for byte in bytearray(f.read()):
+      h = ((h ^ byte) * 0x01000193) & 0xffffffff
+
+  return h
+
+def main():
+  if len(sys.argv) < 2:
+    print("usage: make_resource_index.py output.h [resources folder]")
+    sys.exit(1)
+
+  root = sys.argv[2] if len(sys.argv) > 2 else "resources"
+  entries = {}
+
+  for folder in FOLDERS:
+    path = os.path.join(root, folder)
+
+    if not os.path.isdir(path):
+      continue
+
+    for fileName in sorted(os.listdir(path)):
+      if not fileName.lower().endswith(TYPES) or not os.path.isfile(os.path.join(path, fileName)):
+        continue
+
+      match = SCALED.match(fileName)
+      name, scale = (match.group(1) + match.group(3), int(match.group(2))) if match else (fileName, 1)
+
+      if name in entries and entries[name]["folder"] != folder:
+        print("skipping " + os.path.join(folder, fileName) + ", " + name + " is already in " + (entries[name]["folder"] or "the resources folder"))
+        continue
+
+      entry = entries.setdefault(name, { "folder": folder, "scales": 0, "lowest": None })
+      entry["scales"] |= 1 << scale
+
+      if entry["lowest"] is None or scale < entry["lowest"]:
+        entry["lowest"] = scale
+        entry["file"] = os.path.join(path, fileName)
+
+  lines = []
+
+  for name in sorted(entries):
+    entry = entries[name]
+    relPath = (entry["folder"] + "/" if entry["folder"] else "") + name
+    lines.append('  { "%s", "%s", 0x%x, %i, 0x%08x }' % (name, relPath, entry["scales"], os.path.getsize(entry["file"]), fnv1a(entry["file"])))
+
+  with open(sys.argv[1], "w") as out:
+    out.write("// written by make_resource_index.py, don't edit\n\n")
+    out.write("#pragma once\n\n")
+    out.write('#include "IPlugResourceIndex.h"\n\n')
+
+    if lines:
+      out.write("static const IPlugResourceIndex::Entry gResourceIndexEntries[] = {\n" + ",\n".join(lines) + "\n};\n\n")
+      out.write("static IPlugResourceIndex::Installer gResourceIndexInstaller(gResourceIndexEntries, %i);\n" % len(lines))
+
+  print("wrote " + str(len(lines)) + " resources to " + sys.argv[1])
+
+if __name__ == '__main__':
+  main()
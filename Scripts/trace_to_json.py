@@ -0,0 +1,71 @@
+#!/usr/bin/python
+
+# python shell script to convert a trace written by IPlugTraceRecorder, see IPlug/IPlugTraceRecorder.h, to the Chrome trace event format
+# usage: trace_to_json.py IPlugTrace.itrc [output.json]
+# the output opens in Perfetto (ui.perfetto.dev) or chrome://tracing
+
+import json, struct, sys
+
+ENTRY = struct.Struct("<BBHIQqq")
+NAME, THREAD, EVENT, MESSAGE, DROPPED = range(5)
+
+def padded(length):
+  return (length + 7) // 8 * 8
+
+def main():
+  if len(sys.argv) < 2:
+    print("usage: trace_to_json.py IPlugTrace.itrc [output.json]")
+    sys.exit(1)
+
+  with open(sys.argv[1], "rb") as f:
+    data = f.read()
+
+  if data[:4] != b"ITRC" or struct.unpack_from("<I", data, 4)[0] != 1:
+    print(sys.argv[1] + " is not a version 1 trace")
+    sys.exit(1)
+
+  names = {}
+  events = []
+  pos = 8
+
+  while pos + ENTRY.size <= len(data):
+    entryType, phase, thread, name, time, arg0, arg1 = ENTRY.unpack_from(data, pos)
+    pos += ENTRY.size
+    ts = time / 1000.0
+
+    if entryType == NAME:
+      names[name] = data[pos:pos + arg0].decode("utf-8", "replace")
+      pos += padded(arg0)
+    elif entryType == THREAD:
+      events.append({ "name": "thread_name", "ph": "M", "pid": 0, "tid": thread, "args": { "name": "thread %i (%x)" % (thread, arg0 & 0xffffffffffffffff) } })
+    elif entryType == EVENT:
+      event = { "name": names.get(name, "?"), "ph": chr(phase), "ts": ts, "pid": 0, "tid": thread }
+
+      if chr(phase) == "C":
+        event["args"] = { "value": arg0 }
+      else:
+        event["args"] = { "line": arg0 }
+
+        if chr(phase) == "i":
+          event["s"] = "t"
+
+      events.append(event)
+    elif entryType == MESSAGE:
+      text = data[pos:pos + arg1].decode("utf-8", "replace").rstrip()
+      pos += padded(arg1)
+      events.append({ "name": names.get(name, "?"), "ph": "i", "s": "t", "ts": ts, "pid": 0, "tid": thread, "args": { "line": arg0, "message": text } })
+    elif entryType == DROPPED:
+      events.append({ "name": "dropped %i events" % arg0, "ph": "i", "s": "t", "ts": ts, "pid": 0, "tid": thread })
+    else:
+      print("unknown entry type " + str(entryType) + ", stopping")
+      break
+
+  output = sys.argv[2] if len(sys.argv) > 2 else sys.argv[1].rsplit(".", 1)[0] + ".json"
+
+  with open(output, "w") as out:
+    json.dump({ "traceEvents": events, "displayTimeUnit": "ns" }, out)
+
+  print("wrote " + str(len(events)) + " events to " + output)
+
+if __name__ == '__main__':
+  main()
@@ -0,0 +1,47 @@
+#!/usr/bin/python
+
+# python shell script to write the manifest of streamed images for a web build, see IPlug/WEB/Template/scripts/IPlugResources.js
+# usage: web_resource_manifest.py output.js [image folder]
+# with an image folder, each png in it is listed with its size, otherwise an empty manifest is written and all images are preloaded
+
+import os, struct, sys
+
+def png_size(path):
+  with open(path, "rb") as f:
+    header = f.read(24)
+
+  if len(header) < 24 or header[:8] != b"\x89PNG\r\n\x1a\n":
+    return None
+
+  return struct.unpack(">II", header[16:24])
+
+def main():
+  if len(sys.argv) < 2:
+    print("usage: web_resource_manifest.py output.js [image folder]")
+    sys.exit(1)
+
+  entries = []
+
+  if len(sys.argv) > 2:
+    folder = sys.argv[2]
+
+    for name in sorted(os.listdir(folder)):
+      if not name.lower().endswith(".png"):
+        continue
+
+      size = png_size(os.path.join(folder, name))
+
+      if size is None:
+        print("skipping " + name + ", not a png")
+        continue
+
+      entries.append('  "/resources/img/%s": [%i, %i]' % (name, size[0], size[1]))
+
+  with open(sys.argv[1], "w") as out:
+    out.write("var IPlugResources = IPlugResources || {};\n")
+    out.write("IPlugResources.manifest = {\n" + ",\n".join(entries) + "\n};\n")
+
+  print("wrote " + str(len(entries)) + " streamed images to " + sys.argv[1])
+
+if __name__ == '__main__':
+  main()
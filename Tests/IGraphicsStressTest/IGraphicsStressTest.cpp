@@ -3,6 +3,10 @@
 
 #include "IControl.h"
 
+#if IPLUG_EDITOR
+#include "IGraphicsStressTest_Benchmark.h"
+#endif
+
 IGraphicsStressTest::IGraphicsStressTest(IPlugInstanceInfo instanceInfo)
 : IPLUG_CTOR(kNumParams, 1, instanceInfo)
 {
@@ -25,6 +29,7 @@ void IGraphicsStressTest::LayoutUI(IGraphics* pGraphics)
     pGraphics->GetControl(1)->SetTargetAndDrawRECTs(bounds);
     pGraphics->GetControlWithTag(kCtrlTagNumThings)->SetTargetAndDrawRECTs(bounds.GetGridCell(0, 2, 1));
     pGraphics->GetControlWithTag(kCtrlTagTestNum)->SetTargetAndDrawRECTs(bounds.GetGridCell(1, 2, 1));
+    pGraphics->GetControlWithTag(kCtrlTagBenchmark)->SetTargetAndDrawRECTs(bounds);
     
     return;
   }
@@ -38,11 +43,17 @@ void IGraphicsStressTest::LayoutUI(IGraphics* pGraphics)
       case kVK_UP: mNumberOfThings++; break;
       case kVK_DOWN: mNumberOfThings--; break;
       case kVK_TAB: key.S ? mKindOfThing-- : mKindOfThing++; break;
-      default: return false;
+      default:
+        if (key.Ascii == 'b' || key.Ascii == 'B')
+        {
+          dynamic_cast<IStressBenchmarkControl*>(GetUI()->GetControlWithTag(kCtrlTagBenchmark))->Start();
+          return true;
+        }
+        return false;
     }
 
     dynamic_cast<ITextControl*>(GetUI()->GetControlWithTag(kCtrlTagNumThings))->SetStrFmt(64, "Number of things = %i", mNumberOfThings);
-    dynamic_cast<ITextControl*>(GetUI()->GetControlWithTag(kCtrlTagTestNum))->SetStrFmt(64, "Test %i/%i", mKindOfThing, 32);
+    dynamic_cast<ITextControl*>(GetUI()->GetControlWithTag(kCtrlTagTestNum))->SetStrFmt(64, "Test %i/%i", mKindOfThing, kNumThings - 1);
     GetUI()->SetAllControlsDirty();
     return true;
   });
@@ -56,51 +67,31 @@ void IGraphicsStressTest::LayoutUI(IGraphics* pGraphics)
     static ISVG tiger = g.LoadSVG(TIGER_FN);
     
     if(mKindOfThing == 0)
-      g.DrawText(IText(40), "Press tab to go to next test, up/down to change the # of things", r);
-    
-    //      if (!g.CheckLayer(pCaller->mLayer))
-    {
-      //        g.StartLayer(r);
-      
-      for (int i=0; i<this->mNumberOfThings; i++)
-      {
-        IRECT rr = r.GetRandomSubRect();
-        IColor rc = IColor::GetRandomColor();
-        IBlend rb = {};
-        static bool dir = 0;
-        static float thickness = 5.f;
-        static float roundness = 5.f;
-        float rrad1 = rand() % 360;
-        float rrad2 = rand() % 360;
-        
-        switch (mKindOfThing)
-        {
-          case 1:  g.DrawRect(rc, rr, &rb); break;
-          case 2:  g.FillRect(rc, rr, &rb); break;
-          case 3:  g.DrawRoundRect(rc, rr, roundness, &rb); break;
-          case 4:  g.FillRoundRect(rc, rr, roundness, &rb); break;
-          case 5:  g.DrawEllipse(rc, rr, &rb); break;
-          case 6:  g.FillEllipse(rc, rr, &rb); break;
-          case 7:  g.DrawArc(rc, rr.MW(), rr.MH(), rr.W() > rr.H() ? rr.H() : rr.W(), rrad1, rrad2, &rb,thickness); break;
-          case 8:  g.FillArc(rc, rr.MW(), rr.MH(), rr.W() > rr.H() ? rr.H() : rr.W(), rrad1, rrad2, &rb); break;
-          case 9:  g.DrawLine(rc, dir == 0 ? rr.L : rr.R, rr.B, dir == 0 ? rr.R : rr.L, rr.T, &rb,thickness); break;
-          case 10: g.DrawDottedLine(rc, dir == 0 ? rr.L : rr.R, rr.B, dir == 0 ? rr.R : rr.L, rr.T, &rb, thickness); break;
-          case 11: g.DrawFittedBitmap(smiley, rr, &rb); break;
-          case 12: g.DrawSVG(tiger, rr); break;
-          default:
-            break;
-        }
-        
-        dir = !dir;
-      }
-      //        pCaller->mLayer = g.EndLayer();
-    }
-    
-    //      g.DrawLayer(pCaller->mLayer);
+      g.DrawText(IText(40), "Press tab to go to next test, up/down to change the # of things, b to benchmark", r);
     
+    DrawStressThings(g, mKindOfThing, mNumberOfThings, r, smiley, tiger);
   }, 10000, false, false));
   
   pGraphics->AttachControl(new ITextControl(bounds.GetGridCell(0, 2, 1), "", IText(100)), kCtrlTagNumThings);
   pGraphics->AttachControl(new ITextControl(bounds.GetGridCell(1, 2, 1), "", IText(100)), kCtrlTagTestNum);
+
+  // with IGRAPHICS_STRESS_BENCHMARK set in the environment, the app benchmarks straight away and quits when it is done
+  const bool scripted = getenv("IGRAPHICS_STRESS_BENCHMARK") != nullptr;
+  IStressBenchmarkControl* pBenchmark = new IStressBenchmarkControl(bounds, scripted);
+  pGraphics->AttachControl(pBenchmark, kCtrlTagBenchmark);
+
+  if (scripted)
+    pBenchmark->Start();
+}
+
+void IGraphicsStressTest::OnIdle()
+{
+  IGraphics* pGraphics = GetUI();
+  IStressBenchmarkControl* pBenchmark = pGraphics ? dynamic_cast<IStressBenchmarkControl*>(pGraphics->GetControlWithTag(kCtrlTagBenchmark)) : nullptr;
+  float scale;
+
+  // resizing isn't safe while drawing, so the benchmark asks for the scale of its next step here
+  if (pBenchmark && pBenchmark->GetScaleToSet(scale))
+    pGraphics->Resize(PLUG_WIDTH, PLUG_HEIGHT, scale);
 }
 #endif
@@ -11,7 +11,8 @@ enum EParam
 enum EControlTags
 {
   kCtrlTagNumThings = 0,
-  kCtrlTagTestNum
+  kCtrlTagTestNum,
+  kCtrlTagBenchmark
 };
 
 class IGraphicsStressTest : public IPlug
@@ -20,6 +21,7 @@ public:
   IGraphicsStressTest(IPlugInstanceInfo instanceInfo);
 #if IPLUG_EDITOR
   void LayoutUI(IGraphics* pGraphics) override;
+  void OnIdle() override;
 public:
   int mNumberOfThings = 16;
   int mKindOfThing = 0;
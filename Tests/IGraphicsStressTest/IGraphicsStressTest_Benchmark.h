@@ -0,0 +1,251 @@
+#pragma once
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "IControl.h"
+#include "IPlugPaths.h"
+
+enum EStressThing
+{
+  kThingNone = 0,
+  kThingDrawRect,
+  kThingFillRect,
+  kThingDrawRoundRect,
+  kThingFillRoundRect,
+  kThingDrawEllipse,
+  kThingFillEllipse,
+  kThingDrawArc,
+  kThingFillArc,
+  kThingDrawLine,
+  kThingDrawDottedLine,
+  kThingBitmap,
+  kThingSVG,
+  kThingText,
+  kThingLayer,
+  kThingShadow,
+  kNumThings
+};
+
+static const char* kThingNames[kNumThings] = { "none", "draw rect", "fill rect", "draw round rect", "fill round rect", "draw ellipse", "fill ellipse",
+                                               "draw arc", "fill arc", "draw line", "draw dotted line", "bitmap", "svg", "text", "layer", "shadow" };
+
+/** Draw n random things of one kind in r */
+static void DrawStressThings(IGraphics& g, int kind, int n, const IRECT& r, const IBitmap& smiley, const ISVG& tiger)
+{
+  const float thickness = 5.f;
+  const float roundness = 5.f;
+  const IShadow shadow(COLOR_BLACK, 4.f, 3.f, 3.f, 0.5f);
+  bool dir = false;
+
+  for (int i = 0; i < n; i++)
+  {
+    IRECT rr = r.GetRandomSubRect();
+    IColor rc = IColor::GetRandomColor();
+    IBlend rb = {};
+    float rrad1 = rand() % 360;
+    float rrad2 = rand() % 360;
+
+    switch (kind)
+    {
+      case kThingDrawRect:       g.DrawRect(rc, rr, &rb); break;
+      case kThingFillRect:       g.FillRect(rc, rr, &rb); break;
+      case kThingDrawRoundRect:  g.DrawRoundRect(rc, rr, roundness, &rb); break;
+      case kThingFillRoundRect:  g.FillRoundRect(rc, rr, roundness, &rb); break;
+      case kThingDrawEllipse:    g.DrawEllipse(rc, rr, &rb); break;
+      case kThingFillEllipse:    g.FillEllipse(rc, rr, &rb); break;
+      case kThingDrawArc:        g.DrawArc(rc, rr.MW(), rr.MH(), rr.W() > rr.H() ? rr.H() : rr.W(), rrad1, rrad2, &rb, thickness); break;
+      case kThingFillArc:        g.FillArc(rc, rr.MW(), rr.MH(), rr.W() > rr.H() ? rr.H() : rr.W(), rrad1, rrad2, &rb); break;
+      case kThingDrawLine:       g.DrawLine(rc, !dir ? rr.L : rr.R, rr.B, !dir ? rr.R : rr.L, rr.T, &rb, thickness); break;
+      case kThingDrawDottedLine: g.DrawDottedLine(rc, !dir ? rr.L : rr.R, rr.B, !dir ? rr.R : rr.L, rr.T, &rb, thickness); break;
+      case kThingBitmap:         g.DrawFittedBitmap(smiley, rr, &rb); break;
+      case kThingSVG:            g.DrawSVG(tiger, rr); break;
+      case kThingText:           g.DrawText(IText(Clip(rr.H(), 8.f, 64.f), rc), "iPlug 2", rr); break;
+      case kThingLayer:
+      case kThingShadow:
+      {
+        // layers of less than a pixel have no bitmap
+        if (rr.W() < 1.f || rr.H() < 1.f)
+          break;
+
+        g.StartLayer(rr);
+        g.FillRoundRect(rc, rr.GetPadded(-shadow.mBlurSize), roundness);
+        ILayerPtr layer = g.EndLayer();
+
+        if (kind == kThingShadow)
+          g.ApplyLayerDropShadow(layer, shadow);
+
+        g.DrawLayer(layer, &rb);
+        break;
+      }
+      default:
+        break;
+    }
+
+    dir = !dir;
+  }
+}
+
+/** The scripted mode of IGraphicsStressTest, which sweeps every kind of thing over a range of counts, at draw scales of 1 and 2. Each combination is drawn into a layer for kFramesPerStep frames,
+ * after kWarmupFrames, with the same random things every frame. The layer is read back after each frame, which waits for a GPU backend to finish drawing it,
+ * so the frame times include the read back, which depends only on the scale. The mean, min and max times are written to a CSV file on the desktop,
+ * named after the drawing API, so that the reports of builds with different backends, or of different revisions, can be compared, see Scripts/compare_stress_benchmarks.py */
+class IStressBenchmarkControl : public IControl
+{
+public:
+  static constexpr int kWarmupFrames = 2;
+  static constexpr int kFramesPerStep = 30;
+
+  /** @param bounds The control's bounds, which are drawn over while it runs
+   * @param quitWhenDone If \c true the app exits once the report is written, for running from a script */
+  IStressBenchmarkControl(const IRECT& bounds, bool quitWhenDone)
+  : IControl(bounds)
+  , mQuitWhenDone(quitWhenDone)
+  {
+    mIgnoreMouse = true;
+
+    static const int counts[] = { 1, 16, 128, 1024 };
+    static const float scales[] = { 1.f, 2.f };
+
+    for (auto scale : scales)
+      for (int kind = kThingDrawRect; kind < kNumThings; kind++)
+        for (auto count : counts)
+          mSteps.push_back({ kind, count, scale });
+  }
+
+  void Start()
+  {
+    mStepIdx = 0;
+    mFrame = 0;
+    mResults.clear();
+    mRunning = true;
+    // IsDirty() is asked each frame only while the control is polled
+    SetPollDirty(true);
+    SetDirty(false);
+  }
+
+  bool IsRunning() const { return mRunning; }
+
+  /** @param scale Set to the draw scale that the next step needs
+   * @return \c true if the UI should be resized to it, which IGraphicsStressTest::OnIdle() does, outside of drawing */
+  bool GetScaleToSet(float& scale)
+  {
+    if (!mRunning || !GetUI())
+      return false;
+
+    scale = mSteps[mStepIdx].scale;
+    return scale != GetUI()->GetDrawScale();
+  }
+
+  bool IsDirty() override { return mRunning || IControl::IsDirty(); }
+
+  void Draw(IGraphics& g) override
+  {
+    const Step& step = mSteps[std::min(mStepIdx, (int) mSteps.size() - 1)];
+
+    if (!mRunning || g.GetDrawScale() != step.scale)
+      return;
+
+    static IBitmap smiley = g.LoadBitmap(SMILEY_FN);
+    static ISVG tiger = g.LoadSVG(TIGER_FN);
+
+    // the same things each frame, and in every report
+    srand(mStepIdx + 1);
+
+    const double start = GetTimestamp();
+    g.StartLayer(mRECT);
+    g.FillRect(COLOR_GRAY, mRECT);
+    DrawStressThings(g, step.kind, step.count, mRECT, smiley, tiger);
+    ILayerPtr layer = g.EndLayer();
+    g.CopyLayerPixels(layer, mPixels);
+    const double time = GetTimestamp() - start;
+
+    g.DrawLayer(layer);
+
+    if (mFrame++ < kWarmupFrames)
+      return;
+
+    if (mFrame == kWarmupFrames + 1)
+      mResults.push_back({ 0., time, time });
+
+    Result& result = mResults.back();
+    result.total += time;
+    result.min = std::min(result.min, time);
+    result.max = std::max(result.max, time);
+
+    if (mFrame == kWarmupFrames + kFramesPerStep)
+    {
+      mFrame = 0;
+
+      if (++mStepIdx == (int) mSteps.size())
+      {
+        mRunning = false;
+        SetPollDirty(false);
+        WriteReport(g.GetDrawingAPIStr());
+      }
+    }
+  }
+
+private:
+  struct Step
+  {
+    int kind;
+    int count;
+    float scale;
+  };
+
+  struct Result
+  {
+    double total;
+    double min;
+    double max;
+  };
+
+  void WriteReport(const char* api)
+  {
+    WDL_String name(api), path;
+
+    for (char* p = name.Get(); *p; p++)
+    {
+      if (!isalnum(*p))
+        *p = '_';
+    }
+
+    DesktopPath(path);
+    path.AppendFormatted(1024, "%sIGraphicsStressTest-%s.csv", path.GetLength() && path.Get()[path.GetLength() - 1] != WDL_DIRCHAR ? WDL_DIRCHAR_STR : "", name.Get());
+
+    FILE* fp = fopen(path.Get(), "w");
+    const bool written = fp != nullptr;
+
+    if (fp)
+    {
+      fprintf(fp, "api,thing,count,scale,frames,mean_ms,min_ms,max_ms\n");
+
+      for (size_t i = 0; i < mResults.size(); i++)
+      {
+        const Step& step = mSteps[i];
+        const Result& result = mResults[i];
+        fprintf(fp, "%s,%s,%i,%g,%i,%.4f,%.4f,%.4f\n", api, kThingNames[step.kind], step.count, step.scale, kFramesPerStep,
+                result.total / kFramesPerStep * 1000., result.min * 1000., result.max * 1000.);
+      }
+
+      fclose(fp);
+      DBGMSG("wrote %s\n", path.Get());
+    }
+    else
+      DBGMSG("couldn't write %s\n", path.Get());
+
+    if (mQuitWhenDone)
+      exit(written ? 0 : 1);
+  }
+
+  const bool mQuitWhenDone;
+  std::vector<Step> mSteps;
+  std::vector<Result> mResults;
+  RawBitmapData mPixels;
+  int mStepIdx = 0;
+  int mFrame = 0;
+  bool mRunning = false;
+};
@@ -47,7 +47,7 @@
 #define APP_MULT 1
 #define APP_COPY_AUV3 0
 #define APP_RESIZABLE 1
-#define APP_SIGNAL_VECTOR_SIZE 64
+#define APP_SIGNAL_VECTOR_SIZE 0
 
 #define ROBOTTO_FN "Roboto-Regular.ttf"
 #define MONTSERRAT_FN "Montserrat-LightItalic.ttf"
@@ -0,0 +1,823 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+/**
+ * @file
+ * Microbenchmarks of the DSP building blocks in IPlug/Extras, see README.md for how to build and run them.
+ * Each benchmark processes blocks of one size for one sample type and channel count, repeatedly, for at least the minimum time, and reports the time per sample
+ * of one channel and the throughput. Where a block runs its channels in SIMD lanes (SVF, OverSampler, hiir's Multi2x stages, the IPlugSIMD kernels) it is
+ * registered twice, as "scalar", one channel at a time, and "simd", and --compare prints the speed up of one over the other.
+ * Built with FAUST_BENCHMARK_CODE, it also runs a FAUST DSP compiled with several sets of options, see MakeFaustBenchmark.sh, and says which is fastest
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "IPlugConstants.h"
+#include "IPlugUtilities.h"
+#include "IPlugSIMD.h"
+#include "SVF.h"
+#include "Oversampler.h"
+#include "Oscillator.h"
+#include "ADSREnvelope.h"
+#include "NChanDelay.h"
+#include "Synth/VoiceAllocator.h"
+
+// built into the benchmark, so that it is a single file to compile
+#include "Synth/VoiceAllocator.cpp"
+
+#ifdef FAUST_BENCHMARK_CODE
+  #ifndef FAUSTFLOAT
+    #define FAUSTFLOAT float
+  #endif
+  #include "faust/dsp/dsp.h"
+  #include "faust/gui/UI.h"
+  #include "faust/gui/meta.h"
+  #include FAUST_BENCHMARK_CODE // defines FAUST_BENCHMARK_NAME and FAUST_BENCHMARK_VARIANTS
+#endif
+
+#pragma mark - Harness
+
+/** One benchmark: a block of processing, set up for one sample type, channel count and block size */
+struct IDSPBenchmark
+{
+  std::string name; // the building block
+  std::string variant; // "block", "sample", "scalar" or "simd"
+  const char* type;
+  int nChans;
+  int blockSize;
+  std::function<void()> run; // process one block
+  std::function<double()> checksum; // read the outputs, so that the work can't be optimised away
+};
+
+/** The result of running one benchmark */
+struct IDSPBenchmarkResult
+{
+  const IDSPBenchmark* pBenchmark;
+  double nsPerSample; // per sample of one channel
+  double checksum;
+};
+
+/** Buffers of nChans channels of input and output, the input filled with noise */
+template <typename T>
+struct IBenchmarkBuffers
+{
+  IBenchmarkBuffers(int nChans, int nFrames)
+  : mData(nChans * nFrames * 2)
+  {
+    uint32_t seed = 1;
+
+    for (auto c = 0; c < nChans; c++)
+    {
+      mInputs.push_back(mData.data() + c * nFrames);
+      mOutputs.push_back(mData.data() + (nChans + c) * nFrames);
+
+      for (auto s = 0; s < nFrames; s++)
+      {
+        seed = seed * 1664525u + 1013904223u;
+        mInputs[c][s] = T((seed >> 8) * (2. / 16777216.) - 1.) * T(0.5);
+      }
+    }
+  }
+
+  double Checksum() const
+  {
+    double sum = 0.;
+
+    for (auto pOut : mOutputs)
+      sum += pOut[0];
+
+    return sum;
+  }
+
+  std::vector<T> mData;
+  std::vector<T*> mInputs;
+  std::vector<T*> mOutputs;
+};
+
+static const char* TypeName(float) { return "float"; }
+static const char* TypeName(double) { return "double"; }
+
+/** Add a benchmark whose state is made by make(nChans, blockSize), which returns a shared pointer to something with Run() and Checksum() */
+template <typename T, typename MAKE>
+static void Add(std::vector<IDSPBenchmark>& benchmarks, const char* name, const char* variant, int nChans, int blockSize, MAKE make)
+{
+  auto pState = make(nChans, blockSize);
+
+  if (!pState)
+    return;
+
+  benchmarks.push_back({ name, variant, TypeName(T()), nChans, blockSize, [pState]() { pState->Run(); }, [pState]() { return pState->Checksum(); } });
+}
+
+#pragma mark - Benchmarks
+
+/** SVF, as SVF<T, NC> with the channels in lanes, or as an SVF<T, 1> for each channel */
+template <typename T, int NC>
+struct SVFBench : IBenchmarkBuffers<T>
+{
+  SVFBench(int blockSize, bool lanes)
+  : IBenchmarkBuffers<T>(NC, blockSize), mBlockSize(blockSize), mLanes(lanes), mSingles(NC)
+  {
+    mFilter.SetSampleRate(48000.);
+    mFilter.SetFreqCPS(2000.);
+    mFilter.SetQ(2.);
+
+    for (auto& filter : mSingles)
+    {
+      filter.SetSampleRate(48000.);
+      filter.SetFreqCPS(2000.);
+      filter.SetQ(2.);
+    }
+  }
+
+  void Run()
+  {
+    if (mLanes)
+      mFilter.ProcessBlock(this->mInputs.data(), this->mOutputs.data(), NC, mBlockSize);
+    else
+    {
+      for (auto c = 0; c < NC; c++)
+        mSingles[c].ProcessBlock(&this->mInputs[c], &this->mOutputs[c], 1, mBlockSize);
+    }
+  }
+
+  int mBlockSize;
+  bool mLanes;
+  SVF<T, NC> mFilter;
+  std::vector<SVF<T, 1>> mSingles;
+};
+
+template <typename T, int NC>
+static void AddSVF(std::vector<IDSPBenchmark>& benchmarks, int blockSize)
+{
+  Add<T>(benchmarks, "SVF", "scalar", NC, blockSize, [](int, int n) { return std::make_shared<SVFBench<T, NC>>(n, false); });
+
+  if (NC > 1)
+    Add<T>(benchmarks, "SVF", "simd", NC, blockSize, [](int, int n) { return std::make_shared<SVFBench<T, NC>>(n, true); });
+}
+
+/** OverSampler at 4x with a light waveshaper, as one multi-channel OverSampler, whose stages run kLanes channels at once, or as one for each channel */
+template <typename T>
+struct OverSamplerBench : IBenchmarkBuffers<T>
+{
+  OverSamplerBench(int nChans, int blockSize, bool lanes)
+  : IBenchmarkBuffers<T>(nChans, blockSize), mNChans(nChans), mBlockSize(blockSize), mLanes(lanes)
+  {
+    for (auto i = 0; i < (lanes ? 1 : nChans); i++)
+    {
+      mOverSamplers.emplace_back(new OverSampler<T>(k4x, true, lanes ? nChans : 1, k4x));
+      mOverSamplers.back()->Reset(blockSize);
+    }
+  }
+
+  void Run()
+  {
+    auto shape = [](T** inputs, T** outputs, int nFrames, int nChans) {
+      for (auto c = 0; c < nChans; c++)
+        for (auto s = 0; s < nFrames; s++)
+          outputs[c][s] = inputs[c][s] * (T(1.5) - T(0.5) * inputs[c][s] * inputs[c][s]);
+    };
+
+    if (mLanes)
+      mOverSamplers[0]->ProcessBlockFullRate(this->mInputs.data(), this->mOutputs.data(), mBlockSize, mNChans, [&](T** in, T** out, int n) { shape(in, out, n, mNChans); });
+    else
+    {
+      for (auto c = 0; c < mNChans; c++)
+        mOverSamplers[c]->ProcessBlockFullRate(&this->mInputs[c], &this->mOutputs[c], mBlockSize, 1, [&](T** in, T** out, int n) { shape(in, out, n, 1); });
+    }
+  }
+
+  int mNChans;
+  int mBlockSize;
+  bool mLanes;
+  std::vector<std::unique_ptr<OverSampler<T>>> mOverSamplers;
+};
+
+/** hiir's 2x up and down sampling stages, with the 12 coefficients OverSampler uses at 2x, one Upsampler2xFPU/Downsampler2xFPU pair per channel,
+ * or the Multi2x versions, kLanes channels at a time */
+template <typename T>
+struct HIIRBench : IBenchmarkBuffers<T>
+{
+  static constexpr int kNCoeffs = 12;
+  static constexpr int kLanes = OverSampler<T>::kLanes;
+
+  HIIRBench(int nChans, int blockSize, bool lanes)
+  : IBenchmarkBuffers<T>(nChans, blockSize), mNChans(nChans), mBlockSize(blockSize), mLanes(lanes)
+  , mUp(nChans), mDown(nChans), mUpMulti((nChans + kLanes - 1) / kLanes), mDownMulti((nChans + kLanes - 1) / kLanes)
+  , mUpsampled(nChans * blockSize * 2)
+  {
+    for (auto c = 0; c < nChans; c++)
+    {
+      mUp[c].set_coefs(OverSamplerCoeffs::Get2x());
+      mDown[c].set_coefs(OverSamplerCoeffs::Get2x());
+      mUpsampledPtrs.push_back(mUpsampled.data() + c * blockSize * 2);
+    }
+
+    for (size_t g = 0; g < mUpMulti.size(); g++)
+    {
+      mUpMulti[g].set_coefs(OverSamplerCoeffs::Get2x());
+      mDownMulti[g].set_coefs(OverSamplerCoeffs::Get2x());
+    }
+  }
+
+  void Run()
+  {
+    if (mLanes)
+    {
+      for (auto g = 0; g * kLanes < mNChans; g++)
+      {
+        const int nLaneChans = std::min(kLanes, mNChans - g * kLanes);
+        mUpMulti[g].process_block(mUpsampledPtrs.data() + g * kLanes, this->mInputs.data() + g * kLanes, mBlockSize, nLaneChans);
+        mDownMulti[g].process_block(this->mOutputs.data() + g * kLanes, mUpsampledPtrs.data() + g * kLanes, mBlockSize, nLaneChans);
+      }
+    }
+    else
+    {
+      for (auto c = 0; c < mNChans; c++)
+      {
+        mUp[c].process_block(mUpsampledPtrs[c], this->mInputs[c], mBlockSize);
+        mDown[c].process_block(this->mOutputs[c], mUpsampledPtrs[c], mBlockSize);
+      }
+    }
+  }
+
+  int mNChans;
+  int mBlockSize;
+  bool mLanes;
+  std::vector<hiir::Upsampler2xFPU<kNCoeffs, T>> mUp;
+  std::vector<hiir::Downsampler2xFPU<kNCoeffs, T>> mDown;
+  std::vector<hiir::Upsampler2xMulti<kNCoeffs, T, kLanes>> mUpMulti;
+  std::vector<hiir::Downsampler2xMulti<kNCoeffs, T, kLanes>> mDownMulti;
+  std::vector<T> mUpsampled;
+  std::vector<T*> mUpsampledPtrs;
+};
+
+// std::min() binds kLanes by reference, which needs a definition before C++17
+template <typename T>
+constexpr int HIIRBench<T>::kLanes;
+
+/** FastSinOscillator, a block at a time or with Process() for each sample */
+template <typename T>
+struct FastSinBench : IBenchmarkBuffers<T>
+{
+  FastSinBench(int nChans, int blockSize, bool perSample)
+  : IBenchmarkBuffers<T>(nChans, blockSize), mBlockSize(blockSize), mPerSample(perSample)
+  {
+    for (auto c = 0; c < nChans; c++)
+    {
+      mOscillators.emplace_back(0., 440. * (c + 1));
+      mOscillators.back().SetSampleRate(48000.);
+    }
+  }
+
+  void Run()
+  {
+    for (size_t c = 0; c < mOscillators.size(); c++)
+    {
+      if (mPerSample)
+      {
+        for (auto s = 0; s < mBlockSize; s++)
+          this->mOutputs[c][s] = mOscillators[c].Process();
+      }
+      else
+        mOscillators[c].ProcessBlock(this->mOutputs[c], mBlockSize);
+    }
+  }
+
+  int mBlockSize;
+  bool mPerSample;
+  std::vector<FastSinOscillator<T>> mOscillators;
+};
+
+/** ADSREnvelope, retriggered every 64 ms so that every stage is rendered, a block at a time or with Process() for each sample */
+template <typename T>
+struct ADSRBench : IBenchmarkBuffers<T>
+{
+  ADSRBench(int nChans, int blockSize, bool perSample)
+  : IBenchmarkBuffers<T>(nChans, blockSize), mBlockSize(blockSize), mPerSample(perSample), mEnvelopes(nChans)
+  {
+    for (auto& env : mEnvelopes)
+    {
+      env.SetSampleRate(48000.);
+      env.SetStageTime(ADSREnvelope<T>::kAttack, 5.);
+      env.SetStageTime(ADSREnvelope<T>::kDecay, 20.);
+      env.SetStageTime(ADSREnvelope<T>::kRelease, 30.);
+    }
+  }
+
+  void Run()
+  {
+    const int period = 3072;
+    const bool start = mPos % period < mBlockSize;
+    const bool release = (mPos + period / 2) % period < mBlockSize;
+
+    for (size_t c = 0; c < mEnvelopes.size(); c++)
+    {
+      auto& env = mEnvelopes[c];
+
+      if (start)
+        env.Start(1.);
+      else if (release)
+        env.Release();
+
+      if (mPerSample)
+      {
+        for (auto s = 0; s < mBlockSize; s++)
+          this->mOutputs[c][s] = (T) env.Process(0.5);
+      }
+      else
+        env.ProcessBlock(this->mOutputs[c], mBlockSize, 0.5);
+    }
+
+    mPos += mBlockSize;
+  }
+
+  int mBlockSize;
+  bool mPerSample;
+  int mPos = 0;
+  std::vector<ADSREnvelope<T>> mEnvelopes;
+};
+
+/** NChanDelayLine, a fixed delay of ProcessBlock(), or cubic interpolated taps of a modulated delay with ReadTap() */
+template <typename T>
+struct DelayBench : IBenchmarkBuffers<T>
+{
+  DelayBench(int nChans, int blockSize, bool taps)
+  : IBenchmarkBuffers<T>(nChans, blockSize), mBlockSize(blockSize), mTaps(taps), mDelay(nChans, nChans, 4800), mDelays(blockSize)
+  {
+    mDelay.SetDelayTime(1000);
+
+    for (auto s = 0; s < blockSize; s++)
+      mDelays[s] = T(1000. + 200. * std::sin(s * 0.01));
+  }
+
+  void Run()
+  {
+    if (mTaps)
+    {
+      mDelay.Write(this->mInputs.data(), mBlockSize);
+
+      for (size_t c = 0; c < this->mOutputs.size(); c++)
+        mDelay.ReadTap((int) c, this->mOutputs[c], mDelays.data(), NChanDelayLine<T>::kInterpCubic);
+    }
+    else
+      mDelay.ProcessBlock(this->mInputs.data(), this->mOutputs.data(), mBlockSize);
+  }
+
+  int mBlockSize;
+  bool mTaps;
+  NChanDelayLine<T> mDelay;
+  std::vector<T> mDelays;
+};
+
+/** A voice for the VoiceAllocator benchmark, a FastSinOscillator through an ADSREnvelope */
+class BenchVoice : public SynthVoice
+{
+public:
+  bool GetBusy() const override { return mEnv.GetBusy(); }
+  void Trigger(double level, bool isRetrigger) override { mEnv.Start(level); }
+  void Release() override { mEnv.Release(); }
+  void SetSampleRate(double sampleRate) override { mOsc.SetSampleRate(sampleRate); mEnv.SetSampleRate(sampleRate); }
+
+  void ProcessSamplesAccumulating(sample** inputs, sample** outputs, int nInputs, int nOutputs, int startIdx, int nFrames) override
+  {
+    const double pitch = mInputs[kVoiceControlPitch].endValue;
+
+    for (auto s = startIdx; s < startIdx + nFrames; s++)
+    {
+      const sample y = mOsc.Process(440. * std::pow(2., pitch)) * mEnv.Process(0.5);
+
+      for (auto c = 0; c < nOutputs; c++)
+        outputs[c][s] += y;
+    }
+  }
+
+private:
+  FastSinOscillator<sample> mOsc;
+  ADSREnvelope<sample> mEnv;
+};
+
+/** VoiceAllocator with 32 voices rendering stereo, with a chord of 16 notes started and released in turn, the events and then the voices of each block */
+struct VoiceAllocatorBench : IBenchmarkBuffers<sample>
+{
+  static constexpr int kNVoices = 32;
+  static constexpr int kNNotes = 16;
+
+  VoiceAllocatorBench(int blockSize)
+  : IBenchmarkBuffers<sample>(2, blockSize), mBlockSize(blockSize), mVoices(kNVoices)
+  {
+    for (auto& voice : mVoices)
+      mAllocator.AddVoice(&voice, 0);
+
+    mAllocator.SetSampleRate(48000.);
+  }
+
+  void Run()
+  {
+    const int period = 4800;
+
+    if (mPos % period < mBlockSize || (mPos + period / 2) % period < mBlockSize)
+    {
+      const bool on = mPos % period < mBlockSize;
+
+      for (auto i = 0; i < kNNotes; i++)
+      {
+        VoiceInputEvent event{};
+        event.mAddress.mKey = static_cast<uint8_t>(48 + i);
+        event.mAction = on ? kNoteOnAction : kNoteOffAction;
+        event.mValue = 0.8f;
+        mAllocator.AddEvent(event);
+      }
+    }
+
+    for (auto pOut : mOutputs)
+      std::fill(pOut, pOut + mBlockSize, 0.);
+
+    mAllocator.ProcessEvents(mBlockSize, mPos);
+    mAllocator.ProcessVoices(mInputs.data(), mOutputs.data(), 0, 2, 0, mBlockSize);
+    mPos += mBlockSize;
+  }
+
+  int mBlockSize;
+  int64_t mPos = 0;
+  std::vector<BenchVoice> mVoices;
+  VoiceAllocator mAllocator;
+};
+
+/** The IPlugSIMD kernels that move samples between the host's buffers and the plug-in's, the scalar versions or those chosen for this CPU */
+template <typename T>
+struct KernelsBench : IBenchmarkBuffers<T>
+{
+  KernelsBench(int nChans, int blockSize, bool simd)
+  : IBenchmarkBuffers<T>(nChans, blockSize), mBlockSize(blockSize), mSimd(simd), mOther(blockSize)
+  {
+  }
+
+  void Run()
+  {
+    const ISampleKernels& kernels = ISampleKernels::Get();
+
+    for (size_t c = 0; c < this->mInputs.size(); c++)
+    {
+      if (std::is_same<T, float>::value)
+      {
+        auto pIn = reinterpret_cast<const float*>(this->mInputs[c]);
+        auto pOut = reinterpret_cast<float*>(this->mOutputs[c]);
+        (mSimd ? kernels.floatToDouble : ISampleKernels::ScalarFloatToDouble)(mOther.data(), pIn, mBlockSize);
+        (mSimd ? kernels.accumulateDoubleToFloat : ISampleKernels::ScalarAccumulateDoubleToFloat)(pOut, mOther.data(), mBlockSize);
+      }
+      else
+      {
+        auto pIn = reinterpret_cast<const double*>(this->mInputs[c]);
+        auto pOut = reinterpret_cast<double*>(this->mOutputs[c]);
+        std::vector<float>& buf = mOtherFloat;
+        buf.resize(mBlockSize);
+        (mSimd ? kernels.doubleToFloat : ISampleKernels::ScalarDoubleToFloat)(buf.data(), pIn, mBlockSize);
+        (mSimd ? kernels.accumulateFloatToDouble : ISampleKernels::ScalarAccumulateFloatToDouble)(pOut, buf.data(), mBlockSize);
+      }
+    }
+  }
+
+  int mBlockSize;
+  bool mSimd;
+  std::vector<double> mOther;
+  std::vector<float> mOtherFloat;
+};
+
+#ifdef FAUST_BENCHMARK_CODE
+/** A FAUST DSP generated with one set of compile options, run for the channel count it has */
+template <class DSP>
+struct FaustBench : IBenchmarkBuffers<FAUSTFLOAT>
+{
+  FaustBench(int blockSize)
+  : IBenchmarkBuffers<FAUSTFLOAT>(NChans(), blockSize), mBlockSize(blockSize), mDSP(new DSP())
+  {
+    mDSP->init(48000);
+  }
+
+  /** @return The number of channels of the DSP, the larger of its inputs and outputs */
+  static int NChans()
+  {
+    std::unique_ptr<DSP> pDSP(new DSP()); // on the heap, since the delay lines are members
+    return std::max(pDSP->getNumInputs(), pDSP->getNumOutputs());
+  }
+
+  void Run()
+  {
+    mDSP->compute(mBlockSize, this->mInputs.data(), this->mOutputs.data());
+  }
+
+  int mBlockSize;
+  std::unique_ptr<DSP> mDSP;
+};
+
+/** @return The compile options of a FAUST variant, by its name */
+static const char* FaustOptions(const std::string& variant)
+{
+#define X(CLASS, VARIANT, OPTIONS) if (variant == VARIANT) return OPTIONS;
+  FAUST_BENCHMARK_VARIANTS
+#undef X
+  return "";
+}
+
+/** Print the fastest FAUST variant for each channel count and block size that was run */
+static void PrintFaustWinners(const std::vector<IDSPBenchmarkResult>& results)
+{
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    const IDSPBenchmark& benchmark = *results[i].pBenchmark;
+
+    if (benchmark.name.compare(0, 6, "Faust ") != 0)
+      continue;
+
+    const IDSPBenchmarkResult* pBest = &results[i];
+    const IDSPBenchmarkResult* pWorst = &results[i];
+    bool first = true;
+
+    for (size_t j = 0; j < results.size(); j++)
+    {
+      const IDSPBenchmark& other = *results[j].pBenchmark;
+
+      if (other.name != benchmark.name || other.nChans != benchmark.nChans || other.blockSize != benchmark.blockSize)
+        continue;
+
+      if (j < i)
+        first = false;
+
+      if (results[j].nsPerSample < pBest->nsPerSample)
+        pBest = &results[j];
+
+      if (results[j].nsPerSample > pWorst->nsPerSample)
+        pWorst = &results[j];
+    }
+
+    // once for each channel count and block size
+    if (first)
+    {
+      const char* options = FaustOptions(pBest->pBenchmark->variant);
+      printf("%s, %i chans, block %i: fastest %s (%s) at %.3f ns/sample, %.2fx faster than %s\n", benchmark.name.c_str(), benchmark.nChans, benchmark.blockSize,
+             pBest->pBenchmark->variant.c_str(), *options ? options : "default options", pBest->nsPerSample, pWorst->nsPerSample / pBest->nsPerSample,
+             pWorst->pBenchmark->variant.c_str());
+    }
+  }
+}
+#endif
+
+template <typename T>
+static void AddBenchmarks(std::vector<IDSPBenchmark>& benchmarks, int nChans, int blockSize)
+{
+  switch (nChans)
+  {
+    case 1: AddSVF<T, 1>(benchmarks, blockSize); break;
+    case 2: AddSVF<T, 2>(benchmarks, blockSize); break;
+    case 4: AddSVF<T, 4>(benchmarks, blockSize); break;
+    case 8: AddSVF<T, 8>(benchmarks, blockSize); break;
+    default: break;
+  }
+
+  Add<T>(benchmarks, "OverSampler 4x", "scalar", nChans, blockSize, [](int c, int n) { return std::make_shared<OverSamplerBench<T>>(c, n, false); });
+
+  if (nChans > 1)
+    Add<T>(benchmarks, "OverSampler 4x", "simd", nChans, blockSize, [](int c, int n) { return std::make_shared<OverSamplerBench<T>>(c, n, true); });
+
+  Add<T>(benchmarks, "HIIR 2x up+down", "scalar", nChans, blockSize, [](int c, int n) { return std::make_shared<HIIRBench<T>>(c, n, false); });
+  Add<T>(benchmarks, "HIIR 2x up+down", "simd", nChans, blockSize, [](int c, int n) { return std::make_shared<HIIRBench<T>>(c, n, true); });
+  Add<T>(benchmarks, "FastSinOscillator", "block", nChans, blockSize, [](int c, int n) { return std::make_shared<FastSinBench<T>>(c, n, false); });
+  Add<T>(benchmarks, "FastSinOscillator", "sample", nChans, blockSize, [](int c, int n) { return std::make_shared<FastSinBench<T>>(c, n, true); });
+  Add<T>(benchmarks, "ADSREnvelope", "block", nChans, blockSize, [](int c, int n) { return std::make_shared<ADSRBench<T>>(c, n, false); });
+  Add<T>(benchmarks, "ADSREnvelope", "sample", nChans, blockSize, [](int c, int n) { return std::make_shared<ADSRBench<T>>(c, n, true); });
+  Add<T>(benchmarks, "NChanDelayLine", "block", nChans, blockSize, [](int c, int n) { return std::make_shared<DelayBench<T>>(c, n, false); });
+  Add<T>(benchmarks, "NChanDelayLine cubic tap", "block", nChans, blockSize, [](int c, int n) { return std::make_shared<DelayBench<T>>(c, n, true); });
+  Add<T>(benchmarks, "IPlugSIMD convert+accumulate", "scalar", nChans, blockSize, [](int c, int n) { return std::make_shared<KernelsBench<T>>(c, n, false); });
+  Add<T>(benchmarks, "IPlugSIMD convert+accumulate", "simd", nChans, blockSize, [](int c, int n) { return std::make_shared<KernelsBench<T>>(c, n, true); });
+
+  // the voices render stereo, in whichever type sample is
+  if (std::is_same<T, sample>::value && nChans == 2)
+    Add<sample>(benchmarks, "VoiceAllocator 32 voices", "block", nChans, blockSize, [](int, int n) { return std::make_shared<VoiceAllocatorBench>(n); });
+
+#ifdef FAUST_BENCHMARK_CODE
+  // the generated code is for FAUSTFLOAT and the DSP's own channel count
+  if (std::is_same<T, FAUSTFLOAT>::value)
+  {
+#define X(CLASS, VARIANT, OPTIONS) \
+    Add<FAUSTFLOAT>(benchmarks, "Faust " FAUST_BENCHMARK_NAME, VARIANT, nChans, blockSize, \
+                    [](int c, int n) { return FaustBench<CLASS>::NChans() == c ? std::make_shared<FaustBench<CLASS>>(n) : nullptr; });
+    FAUST_BENCHMARK_VARIANTS
+#undef X
+  }
+#endif
+}
+
+#pragma mark - Running
+
+static IDSPBenchmarkResult Run(const IDSPBenchmark& benchmark, double minSeconds)
+{
+  using clock = std::chrono::steady_clock;
+
+  // warm the caches and let the envelopes and filters settle
+  for (auto i = 0; i < 16; i++)
+    benchmark.run();
+
+  int64_t nBlocks = 0;
+  int64_t batch = 1;
+  double seconds = 0.;
+
+  // batches of blocks, doubled until the clock's resolution doesn't matter
+  while (seconds < minSeconds)
+  {
+    const auto start = clock::now();
+
+    for (int64_t i = 0; i < batch; i++)
+      benchmark.run();
+
+    seconds += std::chrono::duration<double>(clock::now() - start).count();
+    nBlocks += batch;
+
+    if (batch < (1 << 16))
+      batch *= 2;
+  }
+
+  const double nSamples = double(nBlocks) * benchmark.blockSize * benchmark.nChans;
+  return { &benchmark, seconds * 1e9 / nSamples, benchmark.checksum() };
+}
+
+static std::vector<int> ParseList(const char* str)
+{
+  std::vector<int> values;
+
+  for (const char* p = str; *p; )
+  {
+    values.push_back(atoi(p));
+
+    while (*p && *p != ',')
+      p++;
+
+    if (*p == ',')
+      p++;
+  }
+
+  return values;
+}
+
+static void PrintUsage()
+{
+  printf("usage: IPlugDSPBenchmark [--filter text] [--channels 1,2,8] [--blocksizes 32,256,1024] [--types float,double] [--min-time seconds] [--compare] [--csv path] [--isa name]\n");
+  printf("  --filter    only run the benchmarks whose name contains text\n");
+  printf("  --compare   only run the benchmarks with scalar and simd variants, and print the speed up of simd over scalar\n");
+  printf("  --csv       also write the results to a CSV file\n");
+  printf("  --isa       limit the runtime dispatched kernels to an instruction set, e.g. sse2 or avx2, see IPlugCPU.h\n");
+}
+
+int main(int argc, char* argv[])
+{
+  std::vector<int> channelCounts = { 1, 2, 8 };
+  std::vector<int> blockSizes = { 32, 256, 1024 };
+  bool runFloat = true, runDouble = true, compare = false;
+  double minSeconds = 0.2;
+  const char* filter = nullptr;
+  const char* csvPath = nullptr;
+
+  for (auto i = 1; i < argc; i++)
+  {
+    const bool hasValue = i + 1 < argc;
+
+    if (!strcmp(argv[i], "--filter") && hasValue)
+      filter = argv[++i];
+    else if (!strcmp(argv[i], "--channels") && hasValue)
+      channelCounts = ParseList(argv[++i]);
+    else if (!strcmp(argv[i], "--blocksizes") && hasValue)
+      blockSizes = ParseList(argv[++i]);
+    else if (!strcmp(argv[i], "--types") && hasValue)
+    {
+      const char* types = argv[++i];
+      runFloat = strstr(types, "float") != nullptr;
+      runDouble = strstr(types, "double") != nullptr;
+    }
+    else if (!strcmp(argv[i], "--min-time") && hasValue)
+      minSeconds = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--csv") && hasValue)
+      csvPath = argv[++i];
+    else if (!strcmp(argv[i], "--isa") && hasValue)
+    {
+      const char* name = argv[++i];
+
+      if (!IPlugCPU::ForceISA(IPlugCPU::FindISA(name)))
+      {
+        printf("instruction set %s isn't supported by this CPU\n", name);
+        return 1;
+      }
+    }
+    else if (!strcmp(argv[i], "--compare"))
+      compare = true;
+    else
+    {
+      PrintUsage();
+      return 1;
+    }
+  }
+
+  std::vector<IDSPBenchmark> benchmarks;
+
+  for (auto nChans : channelCounts)
+  {
+    for (auto blockSize : blockSizes)
+    {
+      if (nChans < 1 || blockSize < 1)
+        continue;
+
+      if (runFloat)
+        AddBenchmarks<float>(benchmarks, nChans, blockSize);
+
+      if (runDouble)
+        AddBenchmarks<double>(benchmarks, nChans, blockSize);
+    }
+  }
+
+  printf("Instruction set: %s (best %s), IPlugSIMD kernels: %s, OverSampler lanes: float %i, double %i\n\n", IPlugCPU::GetISAName(IPlugCPU::GetISA()), IPlugCPU::GetISAName(IPlugCPU::GetBestISA()), ISampleKernels::Get().name, OverSampler<float>::kLanes, OverSampler<double>::kLanes);
+  printf("%-30s %-7s %-7s %5s %6s %12s %12s %9s\n", "benchmark", "variant", "type", "chans", "block", "ns/sample", "Msamples/s", compare ? "speed up" : "");
+
+  std::vector<IDSPBenchmarkResult> results;
+
+  for (const auto& benchmark : benchmarks)
+  {
+    if (filter && benchmark.name.find(filter) == std::string::npos)
+      continue;
+
+    if (compare && benchmark.variant != "scalar" && benchmark.variant != "simd")
+      continue;
+
+    const IDSPBenchmarkResult result = Run(benchmark, minSeconds);
+    results.push_back(result);
+
+    char speedUp[32] = "";
+
+    // the scalar variant of the same benchmark was run just before
+    if (compare && benchmark.variant == "simd" && results.size() > 1)
+    {
+      const IDSPBenchmarkResult& scalar = results[results.size() - 2];
+
+      if (scalar.pBenchmark->name == benchmark.name && scalar.pBenchmark->variant == "scalar")
+        snprintf(speedUp, sizeof(speedUp), "%.2fx", scalar.nsPerSample / result.nsPerSample);
+    }
+
+    printf("%-30s %-7s %-7s %5i %6i %12.3f %12.1f %9s\n", benchmark.name.c_str(), benchmark.variant.c_str(), benchmark.type, benchmark.nChans, benchmark.blockSize,
+           result.nsPerSample, 1e3 / result.nsPerSample, speedUp);
+    fflush(stdout);
+  }
+
+  if (csvPath)
+  {
+    FILE* fp = fopen(csvPath, "w");
+
+    if (!fp)
+    {
+      fprintf(stderr, "couldn't write %s\n", csvPath);
+      return 1;
+    }
+
+    fprintf(fp, "benchmark,variant,type,channels,block_size,ns_per_sample,msamples_per_s\n");
+
+    for (const auto& result : results)
+    {
+      const IDSPBenchmark& benchmark = *result.pBenchmark;
+      fprintf(fp, "%s,%s,%s,%i,%i,%.4f,%.2f\n", benchmark.name.c_str(), benchmark.variant.c_str(), benchmark.type, benchmark.nChans, benchmark.blockSize,
+              result.nsPerSample, 1e3 / result.nsPerSample);
+    }
+
+    fclose(fp);
+  }
+
+#ifdef FAUST_BENCHMARK_CODE
+  printf("\n");
+  PrintFaustWinners(results);
+#endif
+
+  // printed so that the outputs are used
+  double checksum = 0.;
+
+  for (const auto& result : results)
+    checksum += result.checksum;
+
+  printf("\nchecksum %g\n", checksum);
+
+  return 0;
+}
@@ -0,0 +1,52 @@
+#!/bin/sh
+# Generates FaustBenchmark.hpp, the DSP in a .dsp file compiled by the FAUST compiler with each set of options below,
+# for IPlugDSPBenchmark built with -DFAUST_BENCHMARK_CODE='"FaustBenchmark.hpp"', see README.md
+#
+# usage: MakeFaustBenchmark.sh file.dsp [faust executable] [extra options, e.g. -double]
+
+if [ -z "$1" ]; then
+  echo "usage: MakeFaustBenchmark.sh file.dsp [faust executable] [extra options]"
+  exit 1
+fi
+
+DSP_FILE=$1
+FAUST=${2:-faust}
+EXTRA_OPTIONS=$3
+OUTPUT=FaustBenchmark.hpp
+ARCH_FILE=$(mktemp)
+
+# the classes only, the benchmark includes the FAUST headers
+printf '<<includeIntrinsic>>\n<<includeclass>>\n#undef FAUSTCLASS\n' > "$ARCH_FILE"
+
+# variant name (at most 7 characters), then the options
+VARIANTS="novec:
+vec16:-vec -vs 16
+vec32:-vec -vs 32
+vec64:-vec -vs 64
+v32dfs:-vec -vs 32 -dfs
+v64dfs:-vec -vs 64 -dfs"
+
+: > "$OUTPUT"
+LIST=""
+
+while IFS=: read -r NAME OPTIONS; do
+  CLASS="FaustBench_$NAME"
+  echo "$FAUST -cn $CLASS $OPTIONS $EXTRA_OPTIONS -a $ARCH_FILE $DSP_FILE"
+
+  # shellcheck disable=SC2086
+  if ! "$FAUST" -cn "$CLASS" $OPTIONS $EXTRA_OPTIONS -a "$ARCH_FILE" "$DSP_FILE" >> "$OUTPUT"; then
+    rm -f "$ARCH_FILE"
+    exit 1
+  fi
+
+  LIST="$LIST  X($CLASS, \"$NAME\", \"$OPTIONS\") \\
+"
+done <<END
+$VARIANTS
+END
+
+NAME=$(basename "$DSP_FILE" .dsp)
+printf '\n#define FAUST_BENCHMARK_NAME "%s"\n#define FAUST_BENCHMARK_VARIANTS \\\n%s\n' "$NAME" "$LIST" >> "$OUTPUT"
+
+rm -f "$ARCH_FILE"
+echo "wrote $OUTPUT"
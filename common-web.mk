@@ -69,16 +69,25 @@ WAM_CFLAGS = -DWAM_API \
 -DNO_IGRAPHICS \
 -DSAMPLE_TYPE_FLOAT
 
+# Build the WAM processor with WebAssembly SIMD128, e.g. emmake make --makefile projects/MyPlugin-wam-processor.mk WAM_SIMD=1
+# This selects the SIMD128 kernels in IPlugSIMD.h and lets the compiler vectorise other DSP loops. The module then needs a browser
+# with wasm SIMD support (Chrome 91+, Firefox 89+, Safari 16.4+), so a scalar build should be kept as a fallback for older ones
+WAM_SIMD ?= 0
+ifeq ($(WAM_SIMD), 1)
+WAM_CFLAGS += -msimd128
+endif
+
 WEB_CFLAGS = -DWEB_API \
 -DIPLUG_EDITOR=1
 
 WAM_EXPORTS = "[\
   '_createModule','_wam_init','_wam_terminate','_wam_resize', \
   '_wam_onprocess', '_wam_onmidi', '_wam_onsysex', '_wam_onparam', \
-  '_wam_onmessageN', '_wam_onmessageS', '_wam_onmessageA', '_wam_onpatch' \
+  '_wam_onmessageN', '_wam_onmessageS', '_wam_onmessageA', '_wam_onpatch', \
+  '_iplug_transportbatch', '_iplug_taketransportbatch', '_iplug_uibatch', '_iplug_processuibatch', '_iplug_latency' \
   ]"
 
-WEB_EXPORTS = "['_main', '_iplug_fsready', '_iplug_syncfs']"
+WEB_EXPORTS = "['_main', '_iplug_fsready', '_iplug_syncfs', '_malloc', '_free']"
 
 # LDFLAGS for both WAM and WEB targets
 LDFLAGS = -s ALLOW_MEMORY_GROWTH=1 --bind
@@ -97,3 +106,10 @@ WEB_LDFLAGS = -s EXPORTED_FUNCTIONS=$(WEB_EXPORTS) \
 -s FORCE_FILESYSTEM=1 \
 -s ENVIRONMENT=web
 
+# Run the UI module on a dedicated worker, drawing into an OffscreenCanvas (see IPlugWebWorker.js), e.g. emmake make --makefile projects/MyPlugin-wam-controller.mk WEB_WORKER=1
+# Requires streamed bitmaps (IPLUG_WEB_STREAM_IMAGES=1 in makedist-web.sh)
+WEB_WORKER ?= 0
+ifeq ($(WEB_WORKER), 1)
+WEB_CFLAGS += -DIGRAPHICS_WEB_WORKER
+WEB_LDFLAGS += -s ENVIRONMENT=web,worker
+endif